@@ -5,16 +5,21 @@
 # Minimal makefile capable of compiling futility to sign images
 
 LOCAL_PATH := $(call my-dir)
-include $(CLEAR_VARS)
-
-LOCAL_MODULE := libvboot_util-host
 
 ifeq ($(HOST_OS),darwin)
-LOCAL_CFLAGS += -DHAVE_MACOS -DO_LARGEFILE=0
+VBOOT_HOST_CFLAGS := -DHAVE_MACOS -DO_LARGEFILE=0
+else
+VBOOT_HOST_CFLAGS :=
 endif
 
 # These are required to access large disks and files on 32-bit systems.
-LOCAL_CFLAGS += -D_GNU_SOURCE -D_FILE_OFFSET_BITS=64
+VBOOT_HOST_CFLAGS += -D_GNU_SOURCE -D_FILE_OFFSET_BITS=64
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libvboot_util-host
+
+LOCAL_CFLAGS += $(VBOOT_HOST_CFLAGS)
 
 LOCAL_C_INCLUDES += \
 	$(LOCAL_PATH)/firmware/include \
@@ -36,8 +41,17 @@ VBINIT_SRCS = \
 	firmware/lib/vboot_nvstorage_rollback.c \
 	firmware/lib/region-init.c \
 
-# Additional firmware library sources needed by VbSelectFirmware() call
+# Additional firmware library sources needed by VbSelectFirmware() call.
+# cryptolib wraps the 2lib hash and RSA code, so that comes along too.
 VBSF_SRCS = \
+	firmware/2lib/2common.c \
+	firmware/2lib/2rsa.c \
+	firmware/2lib/2sha1.c \
+	firmware/2lib/2sha256.c \
+	firmware/2lib/2sha256_simd.c \
+	firmware/2lib/2sha512.c \
+	firmware/2lib/2blake2s.c \
+	firmware/2lib/2sha_utility.c \
 	firmware/lib/cryptolib/padding.c \
 	firmware/lib/cryptolib/rsa.c \
 	firmware/lib/cryptolib/rsa_utility.c \
@@ -49,10 +63,12 @@ VBSF_SRCS = \
 	firmware/lib/vboot_api_firmware.c \
 	firmware/lib/vboot_common.c \
 	firmware/lib/vboot_firmware.c \
+	firmware/lib/vboot_workbuf.c \
 	firmware/lib/region-fw.c \
 
 # Additional firmware library sources needed by VbSelectAndLoadKernel() call
 VBSLK_SRCS = \
+	firmware/lib/bmpblk_rle.c \
 	firmware/lib/cgptlib/cgptlib.c \
 	firmware/lib/cgptlib/cgptlib_internal.c \
 	firmware/lib/cgptlib/crc32.c \
@@ -78,6 +94,39 @@ VBSLK_SRCS += \
 	firmware/stub/vboot_api_stub_disk.c \
 	firmware/stub/vboot_api_stub_stream.c
 
+# Code common to both vboot 2.0 (old structs) and 2.1 (new structs)
+FWLIB2X_SRCS = \
+	firmware/2lib/2api.c \
+	firmware/2lib/2common.c \
+	firmware/2lib/2crc8.c \
+	firmware/2lib/2ed25519.c \
+	firmware/2lib/2misc.c \
+	firmware/2lib/2nvstorage.c \
+	firmware/2lib/2rsa.c \
+	firmware/2lib/2secdata.c \
+	firmware/2lib/2sha1.c \
+	firmware/2lib/2sha256.c \
+	firmware/2lib/2sha256_simd.c \
+	firmware/2lib/2sha512.c \
+	firmware/2lib/2blake2s.c \
+	firmware/2lib/2sha_multi.c \
+	firmware/2lib/2sha_utility.c \
+	firmware/2lib/2stub.c \
+	firmware/2lib/2tpm_bootmode.c \
+	firmware/2lib/2verify_cache.c
+
+FWLIB20_SRCS = \
+	firmware/lib20/api.c \
+	firmware/lib20/common.c \
+	firmware/lib20/misc.c \
+	firmware/lib20/packed_key.c
+
+FWLIB21_SRCS = \
+	firmware/lib21/api.c \
+	firmware/lib21/common.c \
+	firmware/lib21/misc.c \
+	firmware/lib21/packed_key.c
+
 UTILLIB_SRCS = \
 	cgpt/cgpt_create.c \
 	cgpt/cgpt_add.c \
@@ -88,10 +137,16 @@ UTILLIB_SRCS = \
 	cgpt/cgpt_common.c \
 	futility/dump_kernel_config_lib.c \
 	host/lib/crossystem.c \
+	host/lib/extract_vmlinuz.c \
 	host/lib/file_keys.c \
 	host/lib/fmap.c \
 	host/lib/host_common.c \
+	host/lib/host_context_pool.c \
+	host/lib/host_crypto.c \
+	host/lib/host_io.c \
+	host/lib/host_kernel_scan.c \
 	host/lib/host_key.c \
+	host/lib/host_key_bundle.c \
 	host/lib/host_keyblock.c \
 	host/lib/host_misc.c \
 	host/lib/util_misc.c \
@@ -100,17 +155,48 @@ UTILLIB_SRCS = \
 
 #	host/arch/${HOST_ARCH}/lib/crossystem_arch.c \
 
-LOCAL_SRC_FILES := \
+UTILLIB21_SRCS = \
+	host/lib21/host_ed25519.c \
+	host/lib21/host_fw_preamble.c \
+	host/lib21/host_key.c \
+	host/lib21/host_keyblock.c \
+	host/lib21/host_misc.c \
+	host/lib21/host_signature.c
+
+# VBSF_SRCS shares some 2lib files with FWLIB2X_SRCS, so sort out duplicates
+LOCAL_SRC_FILES := $(sort \
 	$(VBINIT_SRCS) \
 	$(VBSF_SRCS) \
 	$(VBSLK_SRCS) \
-	$(UTILLIB_SRCS)
+	$(UTILLIB_SRCS))
 
 LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_C_INCLUDES)
 LOCAL_STATIC_LIBRARIES := libcrypto_static
 
 include $(BUILD_HOST_STATIC_LIBRARY)
 
+# The vboot 2.1 host library is separate, as in the main Makefile, since
+# lib20 and lib21 both define vb2_unpack_key().
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libvboot_util21-host
+
+LOCAL_CFLAGS += $(VBOOT_HOST_CFLAGS)
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/firmware/lib21/include \
+	$(LOCAL_PATH)/host/lib21/include
+
+LOCAL_SRC_FILES := $(sort \
+	$(FWLIB2X_SRCS) \
+	$(FWLIB21_SRCS) \
+	$(UTILLIB21_SRCS))
+
+LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_C_INCLUDES)
+LOCAL_STATIC_LIBRARIES := libvboot_util-host
+
+include $(BUILD_HOST_STATIC_LIBRARY)
+
 include $(CLEAR_VARS)
 
 LOCAL_MODULE := futility-host
@@ -118,12 +204,7 @@ LOCAL_IS_HOST_MODULE := true
 LOCAL_MODULE_CLASS := EXECUTABLES
 generated_sources := $(call local-generated-sources-dir)
 
-ifeq ($(HOST_OS),darwin)
-LOCAL_CFLAGS += -DHAVE_MACOS
-endif
-
-# These are required to access large disks and files on 32-bit systems.
-LOCAL_CFLAGS += -D_GNU_SOURCE -D_FILE_OFFSET_BITS=64
+LOCAL_CFLAGS += $(VBOOT_HOST_CFLAGS)
 
 FUTIL_STATIC_SRCS = \
 	futility/futility.c \
@@ -133,18 +214,27 @@ FUTIL_STATIC_SRCS = \
 
 FUTIL_SRCS = \
 	${FUTIL_STATIC_SRCS} \
+	futility/cmd_create.c \
+	futility/cmd_create_keyset.c \
+	futility/cmd_debug_report.c \
+	futility/cmd_delta.c \
 	futility/cmd_dump_kernel_config.c \
+	futility/cmd_key_bundle.c \
 	futility/cmd_load_fmap.c \
 	futility/cmd_pcr.c \
+	futility/cmd_recovery_to_ssd.c \
 	futility/cmd_show.c \
 	futility/cmd_sign.c \
 	futility/cmd_vbutil_firmware.c \
 	futility/cmd_vbutil_kernel.c \
 	futility/cmd_vbutil_key.c \
 	futility/cmd_vbutil_keyblock.c \
+	futility/cmd_verify_rootfs.c \
 	futility/file_type.c \
+	futility/json_writer.c \
 	futility/traversal.c \
-	futility/vb1_helper.c
+	futility/vb1_helper.c \
+	futility/verify_cache.c
 
 #	${FUTIL_STATIC_WORKAROUND_SRCS:%.c=${BUILD}/%.o} \
 
@@ -173,7 +263,49 @@ $(generated_sources)/futility_cmds.c: ${FUTIL_SRCS:%=${LOCAL_PATH}/%}
 
 LOCAL_GENERATED_SOURCES := $(generated_sources)/futility_cmds.c
 
+LOCAL_STATIC_LIBRARIES := libvboot_util21-host libvboot_util-host
+LOCAL_SHARED_LIBRARIES := libcrypto-host
+# Batch signing and verifying run in threads
+LOCAL_LDLIBS += -lpthread
+# Kernel bodies can be compressed with LZMA
+LOCAL_LDLIBS += -llzma
+include $(BUILD_HOST_EXECUTABLE)
+
+# Benchmarks for the signing crypto and for starting futility, which print
+# JSON results.  Not run by the build; run them on the build host as
+#   vb2_crypto_benchmark-host tests/testkeys
+#   futility_startup_benchmark-host out/host/<os>/bin/futility-host <file>
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := vb2_crypto_benchmark-host
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += $(VBOOT_HOST_CFLAGS)
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/firmware/lib20/include \
+	$(LOCAL_PATH)/tests
+
+LOCAL_SRC_FILES := \
+	tests/vb2_crypto_benchmark.c \
+	tests/timer_utils.c \
+	$(filter-out $(VBSF_SRCS),$(FWLIB2X_SRCS)) \
+	$(FWLIB20_SRCS)
+
 LOCAL_STATIC_LIBRARIES := libvboot_util-host
 LOCAL_SHARED_LIBRARIES := libcrypto-host
 include $(BUILD_HOST_EXECUTABLE)
 
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := futility_startup_benchmark-host
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += $(VBOOT_HOST_CFLAGS)
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/tests
+
+LOCAL_SRC_FILES := \
+	tests/futility_startup_benchmark.c \
+	tests/timer_utils.c
+
+include $(BUILD_HOST_EXECUTABLE)
+
@@ -37,6 +37,7 @@ struct {
   {"prioritize", cmd_prioritize,
    "Reorder the priority of all kernel partitions"},
   {"legacy", cmd_legacy, "Switch between GPT and Legacy GPT"},
+  {"batch", cmd_batch, "Run many commands, writing the changes once"},
 };
 
 void Usage(void) {
@@ -52,25 +53,19 @@ void Usage(void) {
   printf("\nFor more detailed usage, use %s COMMAND -h\n\n", progname);
 }
 
-int main(int argc, char *argv[]) {
+int RunCommand(int argc, char *argv[]) {
   int i;
   int match_count = 0;
   int match_index = 0;
-  char* command;
+  char* command = argv[0];
 
-  progname = strrchr(argv[0], '/');
-  if (progname)
-    progname++;
-  else
-    progname = argv[0];
-
-  if (argc < 2) {
-    Usage();
-    return CGPT_FAILED;
-  }
-
-  // increment optind now, so that getopt skips argv[0] in command function
-  command = argv[optind++];
+  // Start getopt over, so it skips argv[0] in the command function
+#ifdef HAVE_MACOS
+  optreset = 1;
+  optind = 1;
+#else
+  optind = 0;
+#endif
 
   // Find the command to invoke.
   for (i = 0; command && i < sizeof(cmds)/sizeof(cmds[0]); ++i) {
@@ -95,3 +90,18 @@ int main(int argc, char *argv[]) {
 
   return CGPT_FAILED;
 }
+
+int main(int argc, char *argv[]) {
+  progname = strrchr(argv[0], '/');
+  if (progname)
+    progname++;
+  else
+    progname = argv[0];
+
+  if (argc < 2) {
+    Usage();
+    return CGPT_FAILED;
+  }
+
+  return RunCommand(argc - 1, argv + 1);
+}
@@ -60,9 +60,56 @@ struct drive {
 // Returns CGPT_OK if success and information are stored in 'drive'. */
 int DriveOpen(const char *drive_path, struct drive *drive, int mode,
               uint64_t drive_size);
+// Like DriveOpen(), but if 'drive_path' is an image file, it's taken to have
+// 'sector_bytes'-byte sectors. If that's 0, or 'drive_path' is a block device,
+// the sector size is worked out as DriveOpen() does.
+int DriveOpenSectors(const char *drive_path, struct drive *drive, int mode,
+                     uint64_t drive_size, uint32_t sector_bytes);
 int DriveClose(struct drive *drive, int update_as_needed);
+
+// Batch mode, for running many commands on the same drives.
+// Between DriveBatchBegin() and DriveBatchEnd(), DriveOpen() opens and loads
+// each drive only once, and DriveClose() keeps it, changes and all, for the
+// next command instead of writing it. Writing the PMBR is put off too.
+//
+// DriveBatchEnd() closes them all, writing the changes if 'commit' is set
+// and throwing them away if not.
+//
+// Returns CGPT_FAILED if any error happens writing or closing a drive.
+void DriveBatchBegin(void);
+int DriveBatchEnd(int commit);
+
+// Returns true between DriveBatchBegin() and DriveBatchEnd(). The drives are
+// shared then, so DriveOpen() and DriveClose() must not be called from more
+// than one thread at a time.
+int DriveBatchActive(void);
+
 int CheckValid(const struct drive *drive);
 
+// A cache of partition tables for cgpt find, kept in a file between runs.
+// It's best kept on a tmpfs. Each drive's table is checked against the
+// primary header on the drive before it's used, so it's never stale.
+struct find_cache;
+struct find_cache_drive;
+
+// Opens the cache in the file at 'path', which needn't exist yet. Returns
+// NULL if out of memory.
+struct find_cache *FindCacheOpen(const char *path);
+// If the cache has the table of the drive open at 'fd', and it's unchanged,
+// sets up 'drive' with it and 'fd', as if DriveOpen() had loaded it (but only
+// the primary GPT is there). Free it with FindCacheFreeDrive(), not
+// DriveClose(). Only reads 'cache', so threads can share it.
+int FindCacheLoadDrive(const struct find_cache *cache, int fd,
+                       struct drive *drive);
+void FindCacheFreeDrive(struct drive *drive);
+// Copies the table of a drive which DriveOpen() loaded and GptSanityCheck()
+// checked, for FindCacheAddDrive(). Returns NULL if it can't be cached.
+struct find_cache_drive *FindCacheNewDrive(struct drive *drive);
+// Adds (or replaces) a drive in the cache, and frees 'd'.
+void FindCacheAddDrive(struct find_cache *cache, struct find_cache_drive *d);
+// Writes the cache back if it changed, and frees it.
+int FindCacheClose(struct find_cache *cache);
+
 /* Loads sectors from 'drive'.
  * *buf is pointed to an allocated memory when returned, and should be
  * freed.
@@ -80,7 +127,8 @@ int Load(struct drive *drive, uint8_t **buf,
                 const uint64_t sector_bytes,
                 const uint64_t sector_count);
 
-/* Saves sectors to 'drive'.
+/* Saves sectors to 'drive'. If 'drive' is an image file, sectors of zeros
+ * which would land in a hole are skipped, to keep the image sparse.
  *
  *   drive -- open drive
  *   buf -- pointer to buffer
@@ -195,6 +243,10 @@ int cmd_boot(int argc, char *argv[]);
 int cmd_find(int argc, char *argv[]);
 int cmd_prioritize(int argc, char *argv[]);
 int cmd_legacy(int argc, char *argv[]);
+int cmd_batch(int argc, char *argv[]);
+
+// Runs the command named by argv[0] with the rest of argv.
+int RunCommand(int argc, char *argv[]);
 
 #define ARRAY_COUNT(array) (sizeof(array)/sizeof((array)[0]))
 const char *GptError(int errnum);
@@ -12,55 +12,55 @@
 #include "utility.h"
 #include "vboot_host.h"
 
-static const char* DumpCgptAddParams(const CgptAddParams *params) {
-  static char buf[256];
+static const char* DumpCgptAddParams(const CgptAddParams *params,
+                                     char *buf, size_t buf_size) {
   char tmp[64];
 
   buf[0] = 0;
   snprintf(tmp, sizeof(tmp), "-i %d ", params->partition);
-  StrnAppend(buf, tmp, sizeof(buf));
+  StrnAppend(buf, tmp, buf_size);
   if (params->label) {
     snprintf(tmp, sizeof(tmp), "-l %s ", params->label);
-    StrnAppend(buf, tmp, sizeof(buf));
+    StrnAppend(buf, tmp, buf_size);
   }
   if (params->set_begin) {
     snprintf(tmp, sizeof(tmp), "-b %llu ", (unsigned long long)params->begin);
-    StrnAppend(buf, tmp, sizeof(buf));
+    StrnAppend(buf, tmp, buf_size);
   }
   if (params->set_size) {
     snprintf(tmp, sizeof(tmp), "-s %llu ", (unsigned long long)params->size);
-    StrnAppend(buf, tmp, sizeof(buf));
+    StrnAppend(buf, tmp, buf_size);
   }
   if (params->set_type) {
     GuidToStr(&params->type_guid, tmp, sizeof(tmp));
-    StrnAppend(buf, "-t ", sizeof(buf));
-    StrnAppend(buf, tmp, sizeof(buf));
-    StrnAppend(buf, " ", sizeof(buf));
+    StrnAppend(buf, "-t ", buf_size);
+    StrnAppend(buf, tmp, buf_size);
+    StrnAppend(buf, " ", buf_size);
   }
   if (params->set_unique) {
     GuidToStr(&params->unique_guid, tmp, sizeof(tmp));
-    StrnAppend(buf, "-u ", sizeof(buf));
-    StrnAppend(buf, tmp, sizeof(buf));
-    StrnAppend(buf, " ", sizeof(buf));
+    StrnAppend(buf, "-u ", buf_size);
+    StrnAppend(buf, tmp, buf_size);
+    StrnAppend(buf, " ", buf_size);
   }
   if (params->set_successful) {
     snprintf(tmp, sizeof(tmp), "-S %d ", params->successful);
-    StrnAppend(buf, tmp, sizeof(buf));
+    StrnAppend(buf, tmp, buf_size);
   }
   if (params->set_tries) {
     snprintf(tmp, sizeof(tmp), "-T %d ", params->tries);
-    StrnAppend(buf, tmp, sizeof(buf));
+    StrnAppend(buf, tmp, buf_size);
   }
   if (params->set_priority) {
     snprintf(tmp, sizeof(tmp), "-P %d ", params->priority);
-    StrnAppend(buf, tmp, sizeof(buf));
+    StrnAppend(buf, tmp, buf_size);
   }
   if (params->set_raw) {
     snprintf(tmp, sizeof(tmp), "-A 0x%x ", params->raw_value);
-    StrnAppend(buf, tmp, sizeof(buf));
+    StrnAppend(buf, tmp, buf_size);
   }
 
-  StrnAppend(buf, "\n", sizeof(buf));
+  StrnAppend(buf, "\n", buf_size);
   return buf;
 }
 
@@ -266,6 +266,7 @@ bad:
 
 static int GptAdd(struct drive *drive, CgptAddParams *params, uint32_t index) {
   GptEntry *entry, backup;
+  char params_text[256];
   int rv;
 
   entry = GetEntry(&drive->gpt, PRIMARY, index);
@@ -286,7 +287,7 @@ static int GptAdd(struct drive *drive, CgptAddParams *params, uint32_t index) {
     // If the modified entry is illegal, recover it and return error.
     memcpy(entry, &backup, sizeof(*entry));
     Error("%s\n", GptErrorText(rv));
-    Error(DumpCgptAddParams(params));
+    Error(DumpCgptAddParams(params, params_text, sizeof(params_text)));
     return -1;
   }
 
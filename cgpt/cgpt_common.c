@@ -22,13 +22,29 @@
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "cgpt.h"
 #include "cgptlib_internal.h"
 #include "crc32.h"
+#include "host_io.h"
 #include "vboot_host.h"
 
+// Drives kept open in batch mode
+struct batch_drive {
+  struct drive drive;
+  int mode;
+  uint64_t drive_size;
+  dev_t dev;
+  ino_t ino;
+  int pmbr_modified;
+  struct batch_drive *next;
+};
+
+static int batch_mode;
+static struct batch_drive *batch_drives;
+
 static const char kErrorTag[] = "ERROR";
 static const char kWarningTag[] = "WARNING";
 
@@ -83,12 +99,7 @@ int Load(struct drive *drive, uint8_t **buf,
   *buf = malloc(count);
   require(*buf);
 
-  if (-1 == lseek(drive->fd, sector * sector_bytes, SEEK_SET)) {
-    Error("Can't seek: %s\n", strerror(errno));
-    goto error_free;
-  }
-
-  nread = read(drive->fd, *buf, count);
+  nread = pread(drive->fd, *buf, count, sector * sector_bytes);
   if (nread < count) {
     Error("Can't read enough: %d, not %d\n", nread, count);
     goto error_free;
@@ -103,11 +114,26 @@ error_free:
 }
 
 
+// The batch drive that 'fd' belongs to, or NULL.
+static struct batch_drive *FindBatchDrive(int fd) {
+  struct batch_drive *bd;
+
+  for (bd = batch_drives; bd; bd = bd->next)
+    if (bd->drive.fd == fd)
+      return bd;
+  return NULL;
+}
+
 int ReadPMBR(struct drive *drive) {
-  if (-1 == lseek(drive->fd, 0, SEEK_SET))
-    return CGPT_FAILED;
+  struct batch_drive *bd = FindBatchDrive(drive->fd);
 
-  int nread = read(drive->fd, &drive->pmbr, sizeof(struct pmbr));
+  // Not written yet, so the disk is out of date
+  if (bd && bd->pmbr_modified) {
+    memcpy(&drive->pmbr, &bd->drive.pmbr, sizeof(struct pmbr));
+    return CGPT_OK;
+  }
+
+  int nread = pread(drive->fd, &drive->pmbr, sizeof(struct pmbr), 0);
   if (nread != sizeof(struct pmbr))
     return CGPT_FAILED;
 
@@ -115,34 +141,177 @@ int ReadPMBR(struct drive *drive) {
 }
 
 int WritePMBR(struct drive *drive) {
-  if (-1 == lseek(drive->fd, 0, SEEK_SET))
-    return CGPT_FAILED;
+  struct batch_drive *bd = FindBatchDrive(drive->fd);
 
-  int nwrote = write(drive->fd, &drive->pmbr, sizeof(struct pmbr));
+  // DriveClose() will save drive->pmbr for DriveBatchEnd() to write.
+  if (batch_mode && bd) {
+    bd->pmbr_modified = 1;
+    return CGPT_OK;
+  }
+
+  int nwrote = pwrite(drive->fd, &drive->pmbr, sizeof(struct pmbr), 0);
   if (nwrote != sizeof(struct pmbr))
     return CGPT_FAILED;
 
   return CGPT_OK;
 }
 
+// One piece of a run of sectors to write
+struct extent {
+  const uint8_t *buf;
+  uint64_t sector_count;
+};
+
+static int AllZeros(const uint8_t *buf, uint64_t count) {
+  while (count--)
+    if (*buf++)
+      return 0;
+  return 1;
+}
+
+// Whether 'count' bytes at 'offset' in the image file are all in a hole.
+// Writing zeros there would only allocate blocks that read back the same.
+static int InHole(int fd, uint64_t offset, uint64_t count) {
+#ifdef SEEK_DATA
+  off_t data = lseek(fd, offset, SEEK_DATA);
+  if (data == -1)
+    return errno == ENXIO;
+  return (uint64_t)data >= offset + count;
+#else
+  return 0;
+#endif
+}
+
+static int WriteVec(int fd, const struct iovec *iov, int iovcnt,
+                    uint64_t offset) {
+  ssize_t count = 0;
+  int i;
+
+  if (!iovcnt)
+    return CGPT_OK;
+  for (i = 0; i < iovcnt; i++)
+    count += iov[i].iov_len;
+  if (pwritev(fd, iov, iovcnt, offset) < count)
+    return CGPT_FAILED;
+  return CGPT_OK;
+}
+
+// Writes the extents end to end from 'sector', with a single pwritev() for
+// each contiguous run. On an image file, sectors of zeros which land in a
+// hole are left out so the image stays sparse.
+static int SaveExtents(struct drive *drive, uint64_t sector,
+                       uint64_t sector_bytes, const struct extent *extents,
+                       int num_extents) {
+  struct iovec *iov;
+  struct stat stat;
+  uint64_t total = 0;
+  uint64_t offset, start;
+  int sparse = 0;
+  int iovcnt = 0;
+  int retval = CGPT_OK;
+  int i;
+
+  for (i = 0; i < num_extents; i++) {
+    require(extents[i].buf);
+    total += extents[i].sector_count;
+  }
+  if (fstat(drive->fd, &stat) == 0 && S_ISREG(stat.st_mode))
+    sparse = (sector + total) * sector_bytes <= (uint64_t)stat.st_size;
+
+  iov = malloc(sizeof(*iov) * (total + 1));
+  require(iov);
+
+  start = offset = sector * sector_bytes;
+  for (i = 0; i < num_extents; i++) {
+    const uint8_t *buf = extents[i].buf;
+    uint64_t s;
+
+    for (s = 0; s < extents[i].sector_count; s++, buf += sector_bytes) {
+      if (sparse && AllZeros(buf, sector_bytes) &&
+          InHole(drive->fd, offset, sector_bytes)) {
+        // Skip it, and start a new run after it.
+        if (CGPT_OK != WriteVec(drive->fd, iov, iovcnt, start))
+          retval = CGPT_FAILED;
+        iovcnt = 0;
+        start = offset + sector_bytes;
+      } else if (iovcnt &&
+                 (const uint8_t *)iov[iovcnt-1].iov_base +
+                 iov[iovcnt-1].iov_len == buf) {
+        iov[iovcnt-1].iov_len += sector_bytes;
+      } else {
+        iov[iovcnt].iov_base = (void *)buf;
+        iov[iovcnt].iov_len = sector_bytes;
+        iovcnt++;
+      }
+      offset += sector_bytes;
+    }
+  }
+  if (CGPT_OK != WriteVec(drive->fd, iov, iovcnt, start))
+    retval = CGPT_FAILED;
+
+  free(iov);
+  return retval;
+}
+
 int Save(struct drive *drive, const uint8_t *buf,
                 const uint64_t sector,
                 const uint64_t sector_bytes,
                 const uint64_t sector_count) {
-  int count;  /* byte count to write */
-  int nwrote;
+  struct extent extent = { buf, sector_count };
 
-  require(buf);
-  count = sector_bytes * sector_count;
+  return SaveExtents(drive, sector, sector_bytes, &extent, 1);
+}
 
-  if (-1 == lseek(drive->fd, sector * sector_bytes, SEEK_SET))
-    return CGPT_FAILED;
+// Returns a zeroed buffer for a copy of the entries which couldn't be read,
+// so GptRepair() has somewhere to rebuild them.
+static uint8_t *EmptyEntries(void) {
+  uint8_t *entries = calloc(MAX_NUMBER_OF_ENTRIES, sizeof(GptEntry));
 
-  nwrote = write(drive->fd, buf, count);
-  if (nwrote < count)
-    return CGPT_FAILED;
+  require(entries);
+  return entries;
+}
 
-  return CGPT_OK;
+// Copies 'sector_count' sectors of 'buf' read by Load() into a new buffer.
+static uint8_t *CopySectors(struct drive *drive, const uint8_t *buf,
+                            uint64_t sector_count) {
+  uint64_t count = sector_count * drive->gpt.sector_bytes;
+  uint8_t *copy = malloc(count);
+
+  require(copy);
+  memcpy(copy, buf, count);
+  return copy;
+}
+
+// Reads 'sector_count' sectors at each of 'primary_sector' and
+// 'secondary_sector' into new buffers. Where both copies of the GPT are is
+// known up front, so the two reads are in flight together.
+static int LoadBoth(struct drive *drive, uint8_t **primary,
+                    uint64_t primary_sector, uint8_t **secondary,
+                    uint64_t secondary_sector, uint64_t sector_count) {
+  uint64_t count = sector_count * drive->gpt.sector_bytes;
+  struct read_request reqs[2];
+
+  *primary = malloc(count);
+  *secondary = malloc(count);
+  require(*primary && *secondary);
+
+  memset(reqs, 0, sizeof(reqs));
+  reqs[0].fd = drive->fd;
+  reqs[0].buf = *primary;
+  reqs[0].size = count;
+  reqs[0].offset = primary_sector * drive->gpt.sector_bytes;
+  reqs[1] = reqs[0];
+  reqs[1].buf = *secondary;
+  reqs[1].offset = secondary_sector * drive->gpt.sector_bytes;
+  if (ReadBatch(reqs, 2) == 0)
+    return CGPT_OK;
+
+  Error("Cannot read %s GPT header\n",
+        reqs[0].result == (ssize_t)count ? "secondary" : "primary");
+  free(*primary);
+  free(*secondary);
+  *primary = *secondary = NULL;
+  return CGPT_FAILED;
 }
 
 static int GptLoad(struct drive *drive, uint32_t sector_bytes) {
@@ -159,52 +328,158 @@ static int GptLoad(struct drive *drive, uint32_t sector_bytes) {
     drive->gpt.gpt_drive_sectors = drive->gpt.streaming_drive_sectors;
   } /* Else, we trust gpt.gpt_drive_sectors. */
 
-  // Read the data.
-  if (CGPT_OK != Load(drive, &drive->gpt.primary_header,
-                      GPT_PMBR_SECTORS,
-                      drive->gpt.sector_bytes, GPT_HEADER_SECTORS)) {
-    Error("Cannot read primary GPT header\n");
-    return -1;
-  }
-  if (CGPT_OK != Load(drive, &drive->gpt.secondary_header,
-                      drive->gpt.gpt_drive_sectors - GPT_PMBR_SECTORS,
-                      drive->gpt.sector_bytes, GPT_HEADER_SECTORS)) {
-    Error("Cannot read secondary GPT header\n");
-    return -1;
+  // Each header is normally next to its entries, so read them together. Not
+  // if the drive's so small that would take the two copies past each other.
+  uint64_t max_entries_sectors = MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry) /
+      drive->gpt.sector_bytes;
+  uint64_t copy_sectors = GPT_HEADER_SECTORS + max_entries_sectors;
+  uint64_t secondary_lba = drive->gpt.gpt_drive_sectors - copy_sectors;
+  uint8_t *primary = NULL;
+  uint8_t *secondary = NULL;
+  int retval = -1;
+
+  if (drive->gpt.gpt_drive_sectors >= GPT_PMBR_SECTORS + 2 * copy_sectors) {
+    if (CGPT_OK != LoadBoth(drive, &primary, GPT_PMBR_SECTORS,
+                            &secondary, secondary_lba, copy_sectors))
+      goto out;
+    drive->gpt.primary_header = CopySectors(drive, primary, GPT_HEADER_SECTORS);
+    drive->gpt.secondary_header = CopySectors(
+        drive, secondary + max_entries_sectors * drive->gpt.sector_bytes,
+        GPT_HEADER_SECTORS);
+  } else {
+    if (CGPT_OK != LoadBoth(drive, &drive->gpt.primary_header,
+                            GPT_PMBR_SECTORS, &drive->gpt.secondary_header,
+                            drive->gpt.gpt_drive_sectors - GPT_PMBR_SECTORS,
+                            GPT_HEADER_SECTORS))
+      goto out;
   }
   GptHeader* primary_header = (GptHeader*)drive->gpt.primary_header;
   if (CheckHeader(primary_header, 0, drive->gpt.streaming_drive_sectors,
                   drive->gpt.gpt_drive_sectors,
-                  drive->gpt.flags) == 0) {
-    if (CGPT_OK != Load(drive, &drive->gpt.primary_entries,
-                        primary_header->entries_lba,
-                        drive->gpt.sector_bytes,
-                        CalculateEntriesSectors(primary_header))) {
+                  drive->gpt.flags, drive->gpt.sector_bytes) == 0) {
+    uint64_t entries_sectors = CalculateEntriesSectors(primary_header,
+                                                       drive->gpt.sector_bytes);
+    if (primary &&
+        primary_header->entries_lba == GPT_PMBR_SECTORS + GPT_HEADER_SECTORS &&
+        entries_sectors <= max_entries_sectors) {
+      drive->gpt.primary_entries = CopySectors(
+          drive, primary + GPT_HEADER_SECTORS * drive->gpt.sector_bytes,
+          entries_sectors);
+    } else if (CGPT_OK != Load(drive, &drive->gpt.primary_entries,
+                               primary_header->entries_lba,
+                               drive->gpt.sector_bytes, entries_sectors)) {
       Error("Cannot read primary partition entry array\n");
-      return -1;
+      goto out;
     }
+    drive->gpt.entries_loaded |= GPT_MODIFIED_ENTRIES1;
   } else {
     Warning("Primary GPT header is invalid\n");
+    drive->gpt.primary_entries = EmptyEntries();
   }
   GptHeader* secondary_header = (GptHeader*)drive->gpt.secondary_header;
   if (CheckHeader(secondary_header, 1, drive->gpt.streaming_drive_sectors,
                   drive->gpt.gpt_drive_sectors,
-                  drive->gpt.flags) == 0) {
-    if (CGPT_OK != Load(drive, &drive->gpt.secondary_entries,
-                        secondary_header->entries_lba,
-                        drive->gpt.sector_bytes,
-                        CalculateEntriesSectors(secondary_header))) {
+                  drive->gpt.flags, drive->gpt.sector_bytes) == 0) {
+    uint64_t entries_sectors = CalculateEntriesSectors(secondary_header,
+                                                       drive->gpt.sector_bytes);
+    if (secondary &&
+        secondary_header->entries_lba >= secondary_lba &&
+        secondary_header->entries_lba + entries_sectors <=
+        secondary_lba + max_entries_sectors) {
+      drive->gpt.secondary_entries = CopySectors(
+          drive, secondary + (secondary_header->entries_lba - secondary_lba) *
+          drive->gpt.sector_bytes, entries_sectors);
+    } else if (CGPT_OK != Load(drive, &drive->gpt.secondary_entries,
+                               secondary_header->entries_lba,
+                               drive->gpt.sector_bytes, entries_sectors)) {
       Error("Cannot read secondary partition entry array\n");
-      return -1;
+      goto out;
     }
+    drive->gpt.entries_loaded |= GPT_MODIFIED_ENTRIES2;
   } else {
     Warning("Secondary GPT header is invalid\n");
+    drive->gpt.secondary_entries = EmptyEntries();
   }
-  return 0;
+  retval = 0;
+
+out:
+  free(primary);
+  free(secondary);
+  return retval;
+}
+
+static void GptFree(struct drive *drive) {
+  if (drive->gpt.primary_header)
+    free(drive->gpt.primary_header);
+  drive->gpt.primary_header = 0;
+  if (drive->gpt.primary_entries)
+    free(drive->gpt.primary_entries);
+  drive->gpt.primary_entries = 0;
+  if (drive->gpt.secondary_header)
+    free(drive->gpt.secondary_header);
+  drive->gpt.secondary_header = 0;
+  if (drive->gpt.secondary_entries)
+    free(drive->gpt.secondary_entries);
+  drive->gpt.secondary_entries = 0;
 }
 
 static int GptSave(struct drive *drive) {
+  GptHeader *primary_header = (GptHeader *)drive->gpt.primary_header;
+  GptHeader *secondary_header = (GptHeader *)drive->gpt.secondary_header;
+  uint64_t sector_bytes = drive->gpt.sector_bytes;
+  uint64_t secondary_lba = drive->gpt.gpt_drive_sectors - GPT_PMBR_SECTORS;
+  uint64_t primary_entries_sectors =
+      CalculateEntriesSectors(primary_header, sector_bytes);
+  uint64_t secondary_entries_sectors =
+      CalculateEntriesSectors(secondary_header, sector_bytes);
+  uint64_t primary_first, secondary_first;
   int errors = 0;
+
+  // After a repair, only the sectors of the entries which were out of date
+  // need writing.
+  if (!GptEntriesToWrite(&drive->gpt, GPT_MODIFIED_ENTRIES1,
+                         primary_entries_sectors, &primary_first,
+                         &primary_entries_sectors))
+    drive->gpt.modified &= ~GPT_MODIFIED_ENTRIES1;
+  if (!GptEntriesToWrite(&drive->gpt, GPT_MODIFIED_ENTRIES2,
+                         secondary_entries_sectors, &secondary_first,
+                         &secondary_entries_sectors))
+    drive->gpt.modified &= ~GPT_MODIFIED_ENTRIES2;
+
+  // Normally each header sits right next to its entries, so when both have
+  // changed they go out together, in one write for each copy.
+  if ((drive->gpt.modified & GPT_MODIFIED_HEADER1) &&
+      (drive->gpt.modified & GPT_MODIFIED_ENTRIES1) && !primary_first &&
+      primary_header->entries_lba == GPT_PMBR_SECTORS + GPT_HEADER_SECTORS) {
+    struct extent extents[] = {
+      { drive->gpt.primary_header, GPT_HEADER_SECTORS },
+      { drive->gpt.primary_entries, primary_entries_sectors },
+    };
+    if (CGPT_OK != SaveExtents(drive, GPT_PMBR_SECTORS, sector_bytes,
+                               extents, 2)) {
+      errors++;
+      Error("Cannot write primary GPT: %s\n", strerror(errno));
+    }
+    drive->gpt.modified &= ~(GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1);
+  }
+  if ((drive->gpt.modified & GPT_MODIFIED_HEADER2) &&
+      (drive->gpt.modified & GPT_MODIFIED_ENTRIES2) &&
+      secondary_header->entries_lba + secondary_first +
+      secondary_entries_sectors == secondary_lba) {
+    struct extent extents[] = {
+      { drive->gpt.secondary_entries + secondary_first * sector_bytes,
+        secondary_entries_sectors },
+      { drive->gpt.secondary_header, GPT_HEADER_SECTORS },
+    };
+    if (CGPT_OK != SaveExtents(drive,
+                               secondary_header->entries_lba + secondary_first,
+                               sector_bytes, extents, 2)) {
+      errors++;
+      Error("Cannot write secondary GPT: %s\n", strerror(errno));
+    }
+    drive->gpt.modified &= ~(GPT_MODIFIED_HEADER2 | GPT_MODIFIED_ENTRIES2);
+  }
+
   if (drive->gpt.modified & GPT_MODIFIED_HEADER1) {
     if (CGPT_OK != Save(drive, drive->gpt.primary_header,
                         GPT_PMBR_SECTORS,
@@ -215,52 +490,63 @@ static int GptSave(struct drive *drive) {
   }
 
   if (drive->gpt.modified & GPT_MODIFIED_HEADER2) {
-    if(CGPT_OK != Save(drive, drive->gpt.secondary_header,
-                       drive->gpt.gpt_drive_sectors - GPT_PMBR_SECTORS,
+    if(CGPT_OK != Save(drive, drive->gpt.secondary_header, secondary_lba,
                        drive->gpt.sector_bytes, GPT_HEADER_SECTORS)) {
       errors++;
       Error("Cannot write secondary header: %s\n", strerror(errno));
     }
   }
-  GptHeader* primary_header = (GptHeader*)drive->gpt.primary_header;
   if (drive->gpt.modified & GPT_MODIFIED_ENTRIES1) {
-    if (CGPT_OK != Save(drive, drive->gpt.primary_entries,
-                        primary_header->entries_lba,
+    if (CGPT_OK != Save(drive,
+                        drive->gpt.primary_entries +
+                        primary_first * sector_bytes,
+                        primary_header->entries_lba + primary_first,
                         drive->gpt.sector_bytes,
-                        CalculateEntriesSectors(primary_header))) {
+                        primary_entries_sectors)) {
       errors++;
       Error("Cannot write primary entries: %s\n", strerror(errno));
     }
   }
-  GptHeader* secondary_header = (GptHeader*)drive->gpt.secondary_header;
   if (drive->gpt.modified & GPT_MODIFIED_ENTRIES2) {
-    if (CGPT_OK != Save(drive, drive->gpt.secondary_entries,
-                        secondary_header->entries_lba,
+    if (CGPT_OK != Save(drive,
+                        drive->gpt.secondary_entries +
+                        secondary_first * sector_bytes,
+                        secondary_header->entries_lba + secondary_first,
                         drive->gpt.sector_bytes,
-                        CalculateEntriesSectors(secondary_header))) {
+                        secondary_entries_sectors)) {
       errors++;
       Error("Cannot write secondary entries: %s\n", strerror(errno));
     }
   }
 
-  if (drive->gpt.primary_header)
-    free(drive->gpt.primary_header);
-  drive->gpt.primary_header = 0;
-  if (drive->gpt.primary_entries)
-    free(drive->gpt.primary_entries);
-  drive->gpt.primary_entries = 0;
-  if (drive->gpt.secondary_header)
-    free(drive->gpt.secondary_header);
-  drive->gpt.secondary_header = 0;
-  if (drive->gpt.secondary_entries)
-    free(drive->gpt.secondary_entries);
-  drive->gpt.secondary_entries = 0;
+  GptFree(drive);
   return errors ? -1 : 0;
 }
 
 /*
- * Query drive size and bytes per sector. Return zero on success. On error,
- * -1 is returned and errno is set appropriately.
+ * An image file doesn't say what size sectors it was made for, so look for the
+ * primary GPT header where a native 4K drive would have it. Anything else has
+ * 512-byte sectors.
+ */
+static uint32_t ImageSectorBytes(int fd) {
+  static const uint32_t sizes[] = { GPT_SECTOR_SIZE, GPT_SECTOR_SIZE_4K };
+  char signature[GPT_HEADER_SIGNATURE_SIZE];
+  int i;
+
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    if (pread(fd, signature, sizeof(signature),
+              GPT_PMBR_SECTORS * sizes[i]) == sizeof(signature) &&
+        (!memcmp(signature, GPT_HEADER_SIGNATURE, sizeof(signature)) ||
+         !memcmp(signature, GPT_HEADER_SIGNATURE2, sizeof(signature))))
+      return sizes[i];
+  }
+  return GPT_SECTOR_SIZE;
+}
+
+/*
+ * Query drive size and bytes per sector. For an image file, a non-zero
+ * *sector_bytes is used as is. Return zero on success. On error, -1 is
+ * returned and errno is set appropriately.
  */
 static int ObtainDriveSize(int fd, uint64_t* size, uint32_t* sector_bytes) {
   struct stat stat;
@@ -275,20 +561,87 @@ static int ObtainDriveSize(int fd, uint64_t* size, uint32_t* sector_bytes) {
     if (ioctl(fd, BLKSSZGET, sector_bytes) < 0) {
       return -1;
     }
-  } else {
-    *sector_bytes = 512;  /* bytes */
-    *size = stat.st_size;
+    return 0;
   }
-#else
-  *sector_bytes = 512;  /* bytes */
-  *size = stat.st_size;
 #endif
+  if (!*sector_bytes)
+    *sector_bytes = ImageSectorBytes(fd);
+  *size = stat.st_size;
   return 0;
 }
 
+// In batch mode, reuse the drive if it's already open. Returns 1 if it is,
+// with 'drive' filled in (and fd closed, or kept if it has a better mode),
+// or -1 if it's open but in a way we can't use.
+static int ReuseBatchDrive(int fd, struct drive *drive, int mode,
+                           uint64_t drive_size) {
+  struct batch_drive *bd;
+  struct stat stat;
+
+  if (fstat(fd, &stat) == -1)
+    return 0;
+
+  for (bd = batch_drives; bd; bd = bd->next)
+    if (bd->dev == stat.st_dev && bd->ino == stat.st_ino)
+      break;
+  if (!bd)
+    return 0;
+
+  if (bd->drive_size != drive_size) {
+    Error("drive size doesn't match earlier commands in the batch\n");
+    close(fd);
+    return -1;
+  }
+
+  if ((mode & O_ACCMODE) == O_RDWR && (bd->mode & O_ACCMODE) != O_RDWR) {
+    close(bd->drive.fd);
+    bd->drive.fd = fd;
+    bd->mode = mode;
+  } else {
+    close(fd);
+  }
+
+  // Each command only sees its own changes as modified
+  *drive = bd->drive;
+  drive->gpt.modified = 0;
+  drive->gpt.entries_partial = 0;
+  return 1;
+}
+
+// Keep a newly opened drive around for later commands in the batch
+static int AddBatchDrive(struct drive *drive, int mode, uint64_t drive_size) {
+  struct batch_drive *bd;
+  struct stat stat;
+
+  if (fstat(drive->fd, &stat) == -1) {
+    Error("Can't stat drive: %s\n", strerror(errno));
+    return CGPT_FAILED;
+  }
+
+  bd = calloc(1, sizeof(*bd));
+  if (!bd) {
+    Error("Out of memory\n");
+    return CGPT_FAILED;
+  }
+  bd->drive = *drive;
+  bd->drive.gpt.modified = 0;
+  bd->mode = mode;
+  bd->drive_size = drive_size;
+  bd->dev = stat.st_dev;
+  bd->ino = stat.st_ino;
+  bd->next = batch_drives;
+  batch_drives = bd;
+  return CGPT_OK;
+}
+
 int DriveOpen(const char *drive_path, struct drive *drive, int mode,
               uint64_t drive_size) {
-  uint32_t sector_bytes;
+  return DriveOpenSectors(drive_path, drive, mode, drive_size, 0);
+}
+
+int DriveOpenSectors(const char *drive_path, struct drive *drive, int mode,
+                     uint64_t drive_size, uint32_t sector_bytes) {
+  int reused;
 
   require(drive_path);
   require(drive);
@@ -306,7 +659,12 @@ int DriveOpen(const char *drive_path, struct drive *drive, int mode,
     return CGPT_FAILED;
   }
 
-  sector_bytes = 512;
+  if (batch_mode) {
+    reused = ReuseBatchDrive(drive->fd, drive, mode, drive_size);
+    if (reused)
+      return reused > 0 ? CGPT_OK : CGPT_FAILED;
+  }
+
   uint64_t gpt_drive_size;
   if (ObtainDriveSize(drive->fd, &gpt_drive_size, &sector_bytes) != 0) {
     Error("Can't get drive size and bytes per sector for %s: %s\n",
@@ -328,6 +686,9 @@ int DriveOpen(const char *drive_path, struct drive *drive, int mode,
     goto error_close;
   }
 
+  if (batch_mode && CGPT_OK != AddBatchDrive(drive, mode, drive_size))
+    goto error_close;
+
   // We just load the data. Caller must validate it.
   return CGPT_OK;
 
@@ -337,9 +698,40 @@ error_close:
 }
 
 
+// Adds what earlier commands in the batch modified to what this one did.
+static void MergeModified(GptData *gpt, const GptData *earlier) {
+  static const uint8_t copies[] = {
+    GPT_MODIFIED_ENTRIES1, GPT_MODIFIED_ENTRIES2,
+  };
+  int i;
+
+  for (i = 0; i < ARRAY_COUNT(copies); i++) {
+    uint8_t copy = copies[i];
+    if (!(earlier->modified & copy))
+      continue;
+    if (earlier->entries_partial & copy) {
+      GptEntriesModified(gpt, copy, earlier->entries_first[i],
+                         earlier->entries_end[i]);
+    } else {
+      gpt->modified |= copy;
+      gpt->entries_partial &= ~copy;
+    }
+  }
+  gpt->modified |= earlier->modified;
+}
+
 int DriveClose(struct drive *drive, int update_as_needed) {
+  struct batch_drive *bd;
   int errors = 0;
 
+  if (batch_mode && (bd = FindBatchDrive(drive->fd))) {
+    // Keep it all for the next command, and DriveBatchEnd()
+    GptData earlier = bd->drive.gpt;
+    bd->drive = *drive;
+    MergeModified(&bd->drive.gpt, &earlier);
+    return CGPT_OK;
+  }
+
   if (update_as_needed) {
     if (GptSave(drive)) {
         errors++;
@@ -356,6 +748,36 @@ int DriveClose(struct drive *drive, int update_as_needed) {
   return errors ? CGPT_FAILED : CGPT_OK;
 }
 
+void DriveBatchBegin(void) {
+  batch_mode = 1;
+}
+
+int DriveBatchActive(void) {
+  return batch_mode;
+}
+
+int DriveBatchEnd(int commit) {
+  struct batch_drive *bd;
+  int errors = 0;
+
+  batch_mode = 0;
+  while ((bd = batch_drives)) {
+    batch_drives = bd->next;
+
+    if (commit && bd->pmbr_modified && CGPT_OK != WritePMBR(&bd->drive)) {
+      Error("Cannot write PMBR: %s\n", strerror(errno));
+      errors++;
+    }
+    if (CGPT_OK != DriveClose(&bd->drive, commit))
+      errors++;
+    if (!commit)
+      GptFree(&bd->drive);
+    free(bd);
+  }
+
+  return errors ? CGPT_FAILED : CGPT_OK;
+}
+
 
 /* GUID conversion functions. Accepted format:
  *
@@ -776,11 +1198,14 @@ void SetRaw(struct drive *drive, int secondary, uint32_t entry_index,
 }
 
 void UpdateAllEntries(struct drive *drive) {
+  // The primary entries have been changed in place; the secondary ones are
+  // brought up to date from them, and only the sectors which differ marked.
   RepairEntries(&drive->gpt, MASK_PRIMARY);
   RepairHeader(&drive->gpt, MASK_PRIMARY);
 
   drive->gpt.modified |= (GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1 |
-                          GPT_MODIFIED_HEADER2 | GPT_MODIFIED_ENTRIES2);
+                          GPT_MODIFIED_HEADER2);
+  drive->gpt.entries_partial &= ~GPT_MODIFIED_ENTRIES1;
   UpdateCrc(&drive->gpt);
 }
 
@@ -874,6 +1299,7 @@ int IsSynonymous(const GptHeader* a, const GptHeader* b) {
  * and marks secondary as modified.
  * If only one is valid, overwrites invalid one.
  * If all are invalid, does nothing.
+ * Only the sectors which differ are copied, and marked modified in gpt.
  * This function returns bit masks for GptData.modified field.
  * Note that CRC is NOT re-computed in this function.
  */
@@ -898,14 +1324,14 @@ uint8_t RepairEntries(GptData *gpt, const uint32_t valid_entries) {
   size_t entries_size = h->number_of_entries * h->size_of_entry;
   if (valid_entries == MASK_BOTH) {
     if (memcmp(gpt->primary_entries, gpt->secondary_entries, entries_size)) {
-      memcpy(gpt->secondary_entries, gpt->primary_entries, entries_size);
+      GptCopyEntries(gpt, GPT_MODIFIED_ENTRIES2, entries_size);
       return GPT_MODIFIED_ENTRIES2;
     }
   } else if (valid_entries == MASK_PRIMARY) {
-    memcpy(gpt->secondary_entries, gpt->primary_entries, entries_size);
+    GptCopyEntries(gpt, GPT_MODIFIED_ENTRIES2, entries_size);
     return GPT_MODIFIED_ENTRIES2;
   } else if (valid_entries == MASK_SECONDARY) {
-    memcpy(gpt->primary_entries, gpt->secondary_entries, entries_size);
+    GptCopyEntries(gpt, GPT_MODIFIED_ENTRIES1, entries_size);
     return GPT_MODIFIED_ENTRIES1;
   }
 
@@ -946,18 +1372,24 @@ uint8_t RepairHeader(GptData *gpt, const uint32_t valid_headers) {
       return GPT_MODIFIED_HEADER2;
     }
   } else if (valid_headers == MASK_PRIMARY) {
+    uint64_t old_entries_lba = secondary_header->entries_lba;
     memcpy(secondary_header, primary_header, sizeof(GptHeader));
     secondary_header->my_lba = gpt->gpt_drive_sectors - 1;  /* the last sector */
     secondary_header->alternate_lba = primary_header->my_lba;
     secondary_header->entries_lba = secondary_header->my_lba -
-        CalculateEntriesSectors(primary_header);
+        CalculateEntriesSectors(primary_header, gpt->sector_bytes);
+    if (secondary_header->entries_lba != old_entries_lba)
+      GptEntriesMoved(gpt, GPT_MODIFIED_ENTRIES2);
     return GPT_MODIFIED_HEADER2;
   } else if (valid_headers == MASK_SECONDARY) {
+    uint64_t old_entries_lba = primary_header->entries_lba;
     memcpy(primary_header, secondary_header, sizeof(GptHeader));
     primary_header->my_lba = GPT_PMBR_SECTORS;  /* the second sector on drive */
     primary_header->alternate_lba = secondary_header->my_lba;
     /* TODO (namnguyen): Preserve (header, entries) padding space. */
     primary_header->entries_lba = primary_header->my_lba + GPT_HEADER_SECTORS;
+    if (primary_header->entries_lba != old_entries_lba)
+      GptEntriesMoved(gpt, GPT_MODIFIED_ENTRIES1);
     return GPT_MODIFIED_HEADER1;
   }
 
@@ -32,6 +32,7 @@ static int GptCreate(struct drive *drive, CgptCreateParams *params) {
 
   drive->gpt.modified |= (GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1 |
                          GPT_MODIFIED_HEADER2 | GPT_MODIFIED_ENTRIES2);
+  drive->gpt.entries_partial = 0;
 
   // Initialize a blank set
   if (!params->zap) {
@@ -81,15 +82,19 @@ static int GptCreate(struct drive *drive, CgptCreateParams *params) {
     h->entries_lba = h->my_lba + GPT_HEADER_SECTORS;
     if (!(drive->gpt.flags & GPT_FLAG_EXTERNAL)) {
       h->entries_lba += params->padding;
-      h->first_usable_lba = h->entries_lba + CalculateEntriesSectors(h);
+      h->first_usable_lba = h->entries_lba +
+          CalculateEntriesSectors(h, drive->gpt.sector_bytes);
       h->last_usable_lba = (drive->gpt.streaming_drive_sectors - GPT_HEADER_SECTORS -
-                            CalculateEntriesSectors(h) - 1);
+                            CalculateEntriesSectors(h, drive->gpt.sector_bytes) -
+                            1);
     } else {
       h->first_usable_lba = params->padding;
       h->last_usable_lba = (drive->gpt.streaming_drive_sectors - 1);
     }
 
-    size_t entries_size = h->number_of_entries * h->size_of_entry;
+    // Whole sectors, since that's how the entries are written out
+    size_t entries_size = CalculateEntriesSectors(h, drive->gpt.sector_bytes) *
+                          drive->gpt.sector_bytes;
     AllocAndClear(&drive->gpt.primary_entries, entries_size);
     AllocAndClear(&drive->gpt.secondary_entries, entries_size);
 
@@ -108,8 +113,8 @@ int CgptCreate(CgptCreateParams *params) {
   if (params == NULL)
     return CGPT_FAILED;
 
-  if (CGPT_OK != DriveOpen(params->drive_name, &drive, O_RDWR,
-                           params->drive_size))
+  if (CGPT_OK != DriveOpenSectors(params->drive_name, &drive, O_RDWR,
+                                  params->drive_size, params->sector_bytes))
     return CGPT_FAILED;
 
   if (GptCreate(&drive, params))
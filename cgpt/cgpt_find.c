@@ -2,6 +2,8 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <fcntl.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -13,61 +15,108 @@
 #include "vboot_host.h"
 
 #define BUFSIZE 1024
-// FIXME: currently we only support 512-byte sectors.
-#define LBA_SIZE 512
 
+// How much of a -W window to read at a time
+#define WINDOW_CHUNK (1024 * 1024)
 
-// fill comparebuf with the data to be examined, returning true on success.
-static int FillBuffer(CgptFindParams *params, int fd, uint64_t pos,
-                       uint64_t count) {
-  uint8_t *bufptr = params->comparebuf;
+// Most drives to search at once when scanning them all
+#define MAX_SEARCH_THREADS 16
 
-  if (-1 == lseek(fd, pos, SEEK_SET))
-    return 0;
 
+// fill buf with the data to be examined, returning true on success.
+static int FillBuffer(int fd, uint8_t *buf, uint64_t pos, uint64_t count) {
   // keep reading until done or error
   while (count) {
-    ssize_t bytes_read = read(fd, bufptr, count);
+    ssize_t bytes_read = pread(fd, buf, count, pos);
     // negative means error, 0 means (unexpected) EOF
     if (bytes_read <= 0)
       return 0;
     count -= bytes_read;
-    bufptr += bytes_read;
+    buf += bytes_read;
+    pos += bytes_read;
   }
 
   return 1;
 }
 
+// look for the match data anywhere in 'window' bytes at 'pos', reading it a
+// chunk at a time. return true for match, 0 for no match or error
+static int search_window(CgptFindParams *params, int fd, uint8_t *buf,
+                         uint64_t pos, uint64_t window) {
+  uint64_t done = 0;
+  uint64_t kept = 0;
+  uint64_t count;
+
+  while (done < window) {
+    count = window - done;
+    if (count > WINDOW_CHUNK)
+      count = WINDOW_CHUNK;
+
+    if (!FillBuffer(fd, buf + kept, pos + done, count))
+      return -1;
+    if (memmem(buf, kept + count, params->matchbuf, params->matchlen))
+      return 1;
+    done += count;
+
+    // a match may start in this chunk and end in the next one
+    if (kept + count >= params->matchlen) {
+      memmove(buf, buf + kept + count - (params->matchlen - 1),
+              params->matchlen - 1);
+      kept = params->matchlen - 1;
+    } else {
+      kept += count;
+    }
+  }
+
+  return 0;
+}
+
 // check partition data content. return true for match, 0 for no match or error
 static int match_content(CgptFindParams *params, struct drive *drive,
                              GptEntry *entry) {
-  uint64_t part_size;
+  uint64_t part_size, window, pos;
+  uint8_t *buf;
+  int retval;
 
   if (!params->matchlen)
     return 1;
 
   // Ensure that the region we want to match against is inside the partition.
-  part_size = LBA_SIZE * (entry->ending_lba - entry->starting_lba + 1);
+  part_size = drive->gpt.sector_bytes *
+      (entry->ending_lba - entry->starting_lba + 1);
   if (params->matchoffset + params->matchlen > part_size) {
     return 0;
   }
-
-  // Read the partition data.
-  if (!FillBuffer(params,
-                  drive->fd,
-                  (LBA_SIZE * entry->starting_lba) + params->matchoffset,
-                  params->matchlen)) {
-    Error("unable to read partition data\n");
+  pos = (drive->gpt.sector_bytes * entry->starting_lba) + params->matchoffset;
+
+  // Each caller needs its own buffer, since drives may be searched in parallel
+  window = params->matchwindow;
+  if (window > part_size - params->matchoffset)
+    window = part_size - params->matchoffset;
+  if (window > params->matchlen)
+    buf = malloc(WINDOW_CHUNK + params->matchlen - 1);
+  else
+    buf = malloc(params->matchlen);
+  if (!buf) {
+    Error("unable to allocate comparison buffer\n");
     return 0;
   }
 
-  // Compare it
-  if (0 == memcmp(params->matchbuf, params->comparebuf, params->matchlen)) {
-    return 1;
+  // Read only what's needed, and compare it
+  if (window > params->matchlen) {
+    retval = search_window(params, drive->fd, buf, pos, window);
+  } else if (FillBuffer(drive->fd, buf, pos, params->matchlen)) {
+    retval = !memcmp(params->matchbuf, buf, params->matchlen);
+  } else {
+    retval = -1;
   }
+  free(buf);
 
-  // Nope.
-  return 0;
+  if (retval < 0) {
+    Error("unable to read partition data\n");
+    return 0;
+  }
+  return retval;
 }
 
 // This needs to handle /dev/mmcblk0 -> /dev/mmcblk0p3, /dev/sda -> /dev/sda3
@@ -103,21 +152,17 @@ static void chromeos_mtd_show(CgptFindParams *params, char *filename,
   }
 }
 
-// This returns true if a GPT partition matches the search criteria. If a match
-// isn't found (or if the file doesn't contain a GPT), it returns false. The
-// filename and partition number that matched is left in a global, since we
-// could have multiple hits.
-static int gpt_search(CgptFindParams *params, struct drive *drive,
-                      char *filename) {
+// This finds the GPT partitions that match the search criteria, without
+// showing them. Their indexes are left in 'matches', which must have room for
+// all the entries, and the number found is returned. The GPT must already have
+// been checked.
+static int gpt_match(CgptFindParams *params, struct drive *drive,
+                     int *matches) {
   int i;
   GptEntry *entry;
   int retval = 0;
   char partlabel[GPT_PARTNAME_LEN];
 
-  if (GPT_SUCCESS != GptSanityCheck(&drive->gpt)) {
-    return 0;
-  }
-
   for (i = 0; i < GetNumberOfEntries(drive); ++i) {
     entry = GetEntry(&drive->gpt, ANY_VALID, i);
 
@@ -138,32 +183,165 @@ static int gpt_search(CgptFindParams *params, struct drive *drive,
       if (!strncmp(params->label, partlabel, sizeof(partlabel)))
         found = 1;
     }
-    if (found && match_content(params, drive, entry)) {
-      params->hits++;
-      retval++;
-      showmatch(params, filename, i+1, entry);
-      if (!params->match_partnum)
-        params->match_partnum = i+1;
-    }
+    if (found && match_content(params, drive, entry))
+      matches[retval++] = i;
   }
 
   return retval;
 }
 
-static int do_search(CgptFindParams *params, char *fileName) {
-  int retval;
-  struct drive drive;
+// This shows the partitions found by gpt_match(). The filename and partition
+// number that matched is left in a global, since we could have multiple hits.
+static void gpt_show(CgptFindParams *params, struct drive *drive,
+                     char *filename, const int *matches, int count) {
+  int i;
+
+  for (i = 0; i < count; ++i) {
+    params->hits++;
+    showmatch(params, filename, matches[i] + 1,
+              GetEntry(&drive->gpt, ANY_VALID, matches[i]));
+    if (!params->match_partnum)
+      params->match_partnum = matches[i] + 1;
+  }
+}
 
-  if (CGPT_OK != DriveOpen(fileName, &drive, O_RDONLY, params->drive_size))
+// A drive to search, and what was found there
+struct search_job {
+  char *filename;
+  struct drive drive;
+  int opened;
+  int cached;                           // the drive came from params->cache
+  struct find_cache_drive *new_cached;  // for params->cache, if it didn't
+  int *matches;
+  int count;
+};
+
+// Sets up the drive from the cache, if it has it. Returns true if so.
+static int search_open_cached(CgptFindParams *params, struct search_job *job) {
+  int fd;
+
+  if (!params->cache || params->drive_size)
+    return 0;
+  fd = open(job->filename, O_RDONLY | O_NOFOLLOW);
+  if (fd < 0)
+    return 0;
+  if (CGPT_OK != FindCacheLoadDrive(params->cache, fd, &job->drive)) {
+    close(fd);
     return 0;
+  }
+  job->cached = 1;
+  return 1;
+}
+
+static void search_open(CgptFindParams *params, struct search_job *job) {
+  if (search_open_cached(params, job)) {
+    job->opened = 1;
+  } else {
+    if (CGPT_OK != DriveOpen(job->filename, &job->drive, O_RDONLY,
+                             params->drive_size))
+      return;
+    job->opened = 1;
+
+    // If the file doesn't contain a GPT, there's nothing to find
+    if (GPT_SUCCESS != GptSanityCheck(&job->drive.gpt))
+      return;
+    if (params->cache)
+      job->new_cached = FindCacheNewDrive(&job->drive);
+  }
+
+  job->matches = malloc(GetNumberOfEntries(&job->drive) *
+                        sizeof(job->matches[0]));
+  if (!job->matches) {
+    Error("Out of memory\n");
+    return;
+  }
+  job->count = gpt_match(params, &job->drive, job->matches);
+}
+
+static int search_show(CgptFindParams *params, struct search_job *job) {
+  if (job->count)
+    gpt_show(params, &job->drive, job->filename, job->matches, job->count);
+  free(job->matches);
+  if (job->new_cached)
+    FindCacheAddDrive(params->cache, job->new_cached);
+  if (job->cached) {
+    FindCacheFreeDrive(&job->drive);
+    close(job->drive.fd);
+  } else if (job->opened) {
+    (void) DriveClose(&job->drive, 0);
+  }
 
-  retval = gpt_search(params, &drive, fileName);
+  return job->count;
+}
+
+static int do_search(CgptFindParams *params, char *fileName) {
+  struct search_job job;
 
-  (void) DriveClose(&drive, 0);
+  memset(&job, 0, sizeof(job));
+  job.filename = fileName;
+  search_open(params, &job);
 
-  return retval;
+  return search_show(params, &job);
 }
 
+// Searching is mostly waiting for the drives, so search them all at once.
+struct search_queue {
+  CgptFindParams *params;
+  struct search_job *jobs;
+  int count;
+  int next;
+  pthread_mutex_t lock;
+};
+
+static void *search_thread(void *arg) {
+  struct search_queue *queue = arg;
+  int i;
+
+  for (;;) {
+    pthread_mutex_lock(&queue->lock);
+    i = queue->next++;
+    pthread_mutex_unlock(&queue->lock);
+    if (i >= queue->count)
+      return NULL;
+    search_open(queue->params, &queue->jobs[i]);
+  }
+}
+
+// Search all the drives, then show what was found in the order they're given.
+// Returns the number of drives with a match.
+static int search_all(CgptFindParams *params, struct search_job *jobs,
+                      int count) {
+  pthread_t threads[MAX_SEARCH_THREADS];
+  struct search_queue queue;
+  int nthreads = 0;
+  int found = 0;
+  int i;
+
+  memset(&queue, 0, sizeof(queue));
+  queue.params = params;
+  queue.jobs = jobs;
+  queue.count = count;
+  pthread_mutex_init(&queue.lock, NULL);
+
+  // The batch mode drive cache isn't thread-safe
+  if (!DriveBatchActive()) {
+    while (nthreads < count - 1 && nthreads < MAX_SEARCH_THREADS &&
+           0 == pthread_create(&threads[nthreads], NULL, search_thread,
+                               &queue))
+      nthreads++;
+  }
+  // Help out, or do it all if there aren't any threads
+  search_thread(&queue);
+  for (i = 0; i < nthreads; i++)
+    pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&queue.lock);
+
+  for (i = 0; i < count; i++)
+    if (search_show(params, &jobs[i]))
+      found++;
+
+  return found;
+}
 
 #define PROC_MTD "/proc/mtd"
 #define PROC_PARTITIONS "/proc/partitions"
@@ -223,6 +401,8 @@ static int scan_real_devs(CgptFindParams *params) {
 
   size_t line_length = 0;
   char *line = NULL;
+  struct search_job *jobs = NULL;
+  int njobs = 0;
   while (getline(&line, &line_length, fp) != -1) {
     int ma, mi;
     long long unsigned int sz;
@@ -231,14 +411,26 @@ static int scan_real_devs(CgptFindParams *params) {
       continue;
 
     if ((pathname = is_wholedev(partname))) {
-      if (do_search(params, pathname)) {
-        found++;
+      struct search_job *new_jobs = realloc(jobs, (njobs + 1) * sizeof(*jobs));
+      if (!new_jobs) {
+        Error("Out of memory\n");
+        break;
       }
+      jobs = new_jobs;
+      memset(&jobs[njobs], 0, sizeof(*jobs));
+      jobs[njobs].filename = strdup(pathname);
+      if (jobs[njobs].filename)
+        njobs++;
     }
   }
 
   fclose(fp);
 
+  found += search_all(params, jobs, njobs);
+  while (njobs--)
+    free(jobs[njobs].filename);
+  free(jobs);
+
   fp = fopen(PROC_MTD, "re");
   if (!fp) {
     free(line);
@@ -288,8 +480,15 @@ void CgptFind(CgptFindParams *params) {
   if (params == NULL)
     return;
 
+  // The batch mode drives may have changes that aren't on the drive yet
+  if (params->cache_file && !params->drive_size && !DriveBatchActive())
+    params->cache = FindCacheOpen(params->cache_file);
+
   if (params->drive_name != NULL)
     do_search(params, params->drive_name);
   else
     scan_real_devs(params);
+
+  (void) FindCacheClose(params->cache);
+  params->cache = NULL;
 }
@@ -0,0 +1,313 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// A cache of the partition tables that cgpt find has read, so that looking
+// the same partitions up again only needs the primary header of each drive.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "cgpt.h"
+#include "cgptlib_internal.h"
+#include "vboot_host.h"
+
+#define FIND_CACHE_MAGIC "CGPTFC01"
+#define FIND_CACHE_MAGIC_SIZE 8
+
+// Most drives to remember; the oldest are dropped after that
+#define FIND_CACHE_MAX_DRIVES 64
+
+// What's kept for each drive, followed by its primary entries. A drive is
+// known by its device number (or, for an image file, its inode) and size,
+// and the rest is only used if the primary header on it is still the same.
+struct find_cache_key {
+  uint64_t dev;                 // st_rdev of a device, st_dev of a file
+  uint64_t ino;                 // 0 for a device
+  uint64_t size;
+} __attribute__((packed));
+
+struct find_cache_record {
+  struct find_cache_key key;
+  uint32_t sector_bytes;
+  uint32_t entries_size;
+  GptHeader header;
+} __attribute__((packed));
+
+struct find_cache_drive {
+  struct find_cache_record rec;
+  uint8_t *entries;
+};
+
+struct find_cache {
+  char *path;
+  struct find_cache_drive *drives;
+  int count;
+  int changed;
+};
+
+static int GetKey(int fd, struct find_cache_key *key) {
+  struct stat st;
+  off_t size;
+
+  if (fstat(fd, &st))
+    return CGPT_FAILED;
+  memset(key, 0, sizeof(*key));
+  if (S_ISBLK(st.st_mode)) {
+    key->dev = st.st_rdev;
+  } else if (S_ISREG(st.st_mode)) {
+    key->dev = st.st_dev;
+    key->ino = st.st_ino;
+  } else {
+    return CGPT_FAILED;
+  }
+  // Works for block devices too, unlike fstat()
+  size = lseek(fd, 0, SEEK_END);
+  if (size < 0)
+    return CGPT_FAILED;
+  key->size = size;
+  return CGPT_OK;
+}
+
+static void FreeDrives(struct find_cache_drive *drives, int count) {
+  int i;
+
+  for (i = 0; i < count; i++)
+    free(drives[i].entries);
+  free(drives);
+}
+
+// Loads the drives from the cache file. Anything wrong with it just means
+// starting again with an empty cache.
+static void LoadDrives(struct find_cache *cache) {
+  struct find_cache_drive *drives = NULL;
+  char magic[FIND_CACHE_MAGIC_SIZE];
+  struct stat st;
+  int count = 0;
+  FILE *fp;
+
+  fp = fopen(cache->path, "rbe");
+  if (!fp)
+    return;
+  // Anyone else who could write it could make us find the wrong partition
+  if (fstat(fileno(fp), &st) || st.st_uid != geteuid() ||
+      (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+      1 != fread(magic, sizeof(magic), 1, fp) ||
+      memcmp(magic, FIND_CACHE_MAGIC, sizeof(magic)))
+    goto out;
+
+  while (count < FIND_CACHE_MAX_DRIVES) {
+    struct find_cache_drive *new_drives;
+    struct find_cache_drive *d;
+
+    new_drives = realloc(drives, (count + 1) * sizeof(*drives));
+    if (!new_drives)
+      goto bad;
+    drives = new_drives;
+    d = &drives[count];
+    if (1 != fread(&d->rec, sizeof(d->rec), 1, fp))
+      break;
+    if (d->rec.sector_bytes < sizeof(GptHeader) ||
+        d->rec.entries_size > MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry) ||
+        d->rec.entries_size < (uint64_t)d->rec.header.number_of_entries *
+        d->rec.header.size_of_entry)
+      goto bad;
+    d->entries = malloc(d->rec.entries_size);
+    if (!d->entries)
+      goto bad;
+    count++;
+    if (1 != fread(d->entries, d->rec.entries_size, 1, fp))
+      goto bad;
+  }
+  if (!feof(fp))
+    goto bad;
+
+  cache->drives = drives;
+  cache->count = count;
+  goto out;
+
+bad:
+  FreeDrives(drives, count);
+out:
+  fclose(fp);
+}
+
+struct find_cache *FindCacheOpen(const char *path) {
+  struct find_cache *cache = calloc(1, sizeof(*cache));
+
+  if (!cache)
+    return NULL;
+  cache->path = strdup(path);
+  if (!cache->path) {
+    free(cache);
+    return NULL;
+  }
+  LoadDrives(cache);
+  return cache;
+}
+
+int FindCacheLoadDrive(const struct find_cache *cache, int fd,
+                       struct drive *drive) {
+  const struct find_cache_drive *d = NULL;
+  struct find_cache_key key;
+  GptHeader header;
+  int i;
+
+  if (CGPT_OK != GetKey(fd, &key))
+    return CGPT_FAILED;
+  for (i = 0; i < cache->count && !d; i++)
+    if (!memcmp(&cache->drives[i].rec.key, &key, sizeof(key)))
+      d = &cache->drives[i];
+  if (!d)
+    return CGPT_FAILED;
+
+  // Any change to the table changes the header, through its CRCs
+  if (sizeof(header) != pread(fd, &header, sizeof(header),
+                              GPT_PMBR_SECTORS * d->rec.sector_bytes) ||
+      memcmp(&header, &d->rec.header, sizeof(header)))
+    return CGPT_FAILED;
+
+  memset(drive, 0, sizeof(*drive));
+  drive->gpt.primary_header = calloc(1, d->rec.sector_bytes);
+  drive->gpt.primary_entries = malloc(d->rec.entries_size);
+  if (!drive->gpt.primary_header || !drive->gpt.primary_entries) {
+    FindCacheFreeDrive(drive);
+    return CGPT_FAILED;
+  }
+  memcpy(drive->gpt.primary_header, &header, sizeof(header));
+  memcpy(drive->gpt.primary_entries, d->entries, d->rec.entries_size);
+  drive->fd = fd;
+  drive->size = key.size;
+  drive->gpt.sector_bytes = d->rec.sector_bytes;
+  drive->gpt.streaming_drive_sectors = key.size / d->rec.sector_bytes;
+  drive->gpt.gpt_drive_sectors = drive->gpt.streaming_drive_sectors;
+  drive->gpt.valid_headers = MASK_PRIMARY;
+  drive->gpt.valid_entries = MASK_PRIMARY;
+  return CGPT_OK;
+}
+
+void FindCacheFreeDrive(struct drive *drive) {
+  free(drive->gpt.primary_header);
+  free(drive->gpt.primary_entries);
+  drive->gpt.primary_header = NULL;
+  drive->gpt.primary_entries = NULL;
+}
+
+struct find_cache_drive *FindCacheNewDrive(struct drive *drive) {
+  struct find_cache_drive *d;
+  uint64_t entries_size;
+
+  // Only a drive whose primary GPT is good can be checked by its header
+  if (!(drive->gpt.valid_headers & MASK_PRIMARY) ||
+      !(drive->gpt.valid_entries & MASK_PRIMARY) ||
+      (drive->gpt.flags & GPT_FLAG_EXTERNAL))
+    return NULL;
+  entries_size = CalculateEntriesSectors(
+      (GptHeader *)drive->gpt.primary_header, drive->gpt.sector_bytes) *
+      drive->gpt.sector_bytes;
+
+  d = calloc(1, sizeof(*d));
+  if (!d)
+    return NULL;
+  d->entries = malloc(entries_size);
+  if (!d->entries || CGPT_OK != GetKey(drive->fd, &d->rec.key)) {
+    free(d->entries);
+    free(d);
+    return NULL;
+  }
+  d->rec.sector_bytes = drive->gpt.sector_bytes;
+  d->rec.entries_size = entries_size;
+  memcpy(&d->rec.header, drive->gpt.primary_header, sizeof(d->rec.header));
+  memcpy(d->entries, drive->gpt.primary_entries, entries_size);
+  return d;
+}
+
+void FindCacheAddDrive(struct find_cache *cache, struct find_cache_drive *d) {
+  struct find_cache_drive *drives;
+  int i;
+
+  // Forget whatever was there before, and keep the newest at the end
+  for (i = 0; i < cache->count; i++) {
+    if (!memcmp(&cache->drives[i].rec.key, &d->rec.key, sizeof(d->rec.key))) {
+      free(cache->drives[i].entries);
+      memmove(&cache->drives[i], &cache->drives[i + 1],
+              (cache->count - i - 1) * sizeof(*drives));
+      cache->count--;
+      break;
+    }
+  }
+  if (cache->count == FIND_CACHE_MAX_DRIVES) {
+    free(cache->drives[0].entries);
+    memmove(&cache->drives[0], &cache->drives[1],
+            (cache->count - 1) * sizeof(*drives));
+    cache->count--;
+  }
+
+  drives = realloc(cache->drives, (cache->count + 1) * sizeof(*drives));
+  if (!drives) {
+    free(d->entries);
+    free(d);
+    return;
+  }
+  cache->drives = drives;
+  cache->drives[cache->count++] = *d;
+  cache->changed = 1;
+  free(d);
+}
+
+// Writes the cache to a new file, and puts it in place of the old one, so
+// nobody ever sees half of it.
+static int SaveDrives(struct find_cache *cache) {
+  size_t len = strlen(cache->path) + 8;
+  char *tmp = malloc(len);
+  int retval = CGPT_FAILED;
+  FILE *fp = NULL;
+  int fd, i;
+
+  if (!tmp)
+    return CGPT_FAILED;
+  snprintf(tmp, len, "%s.XXXXXX", cache->path);
+  fd = mkstemp(tmp);
+  if (fd < 0 || !(fp = fdopen(fd, "wb"))) {
+    if (fd >= 0)
+      close(fd);
+    goto out;
+  }
+  if (1 != fwrite(FIND_CACHE_MAGIC, FIND_CACHE_MAGIC_SIZE, 1, fp))
+    goto out;
+  for (i = 0; i < cache->count; i++) {
+    struct find_cache_drive *d = &cache->drives[i];
+    if (1 != fwrite(&d->rec, sizeof(d->rec), 1, fp) ||
+        1 != fwrite(d->entries, d->rec.entries_size, 1, fp))
+      goto out;
+  }
+  if (fclose(fp) == 0 && rename(tmp, cache->path) == 0)
+    retval = CGPT_OK;
+  fp = NULL;
+
+out:
+  if (fp)
+    fclose(fp);
+  if (retval != CGPT_OK && fd >= 0)
+    unlink(tmp);
+  free(tmp);
+  return retval;
+}
+
+int FindCacheClose(struct find_cache *cache) {
+  int retval = CGPT_OK;
+
+  if (!cache)
+    return CGPT_OK;
+  if (cache->changed && CGPT_OK != (retval = SaveDrives(cache)))
+    Warning("Unable to write %s: %s\n", cache->path, strerror(errno));
+  FreeDrives(cache->drives, cache->count);
+  free(cache->path);
+  free(cache);
+  return retval;
+}
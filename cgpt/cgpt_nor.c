@@ -6,9 +6,12 @@
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <dirent.h>
 #include <ftw.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <linux/major.h>
+#include <mtd/mtd-user.h>
 #include <stdbool.h>
 #include <stdarg.h>
 #include <stdlib.h>
@@ -16,15 +19,307 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include "cgpt.h"
 #include "cgpt_nor.h"
+#include "fmap.h"
 
 static const char FLASHROM_PATH[] = "/usr/sbin/flashrom";
 
+// FMAPs are placed on at least this alignment, so that's all we probe.
+static const uint32_t NOR_FMAP_ALIGN = 4096;
+
+// The NOR flash holding RW_GPT, when the kernel exposes it as an MTD device.
+// Going through it directly saves launching flashrom, and lets us touch
+// only the erase blocks of RW_GPT that change.
+struct nor_gpt {
+  int fd;               // of the MTD device, or -1 if there isn't one
+  uint32_t erase_size;
+  uint64_t offset;      // of RW_GPT in the flash
+  uint32_t size;        // of RW_GPT
+};
+
+static struct nor_gpt nor = { .fd = -1 };
+static bool nor_probed;
+
+static int pread_all(int fd, void *buf, size_t size, uint64_t offset) {
+  uint8_t *p = buf;
+  while (size) {
+    ssize_t n = pread(fd, p, size, offset);
+    if (n <= 0) {
+      return 1;
+    }
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return 0;
+}
+
+static int pwrite_all(int fd, const void *buf, size_t size, uint64_t offset) {
+  const uint8_t *p = buf;
+  while (size) {
+    ssize_t n = pwrite(fd, p, size, offset);
+    if (n <= 0) {
+      return 1;
+    }
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return 0;
+}
+
+// Check if the FMAP at |offset| in |fd| has RW_GPT, and record it in |gpt|.
+static int nor_find_gpt(int fd, uint64_t offset, uint64_t flash_size,
+                        struct nor_gpt *gpt) {
+  FmapHeader header;
+  if (pread_all(fd, &header, sizeof(header), offset) != 0 ||
+      memcmp(header.fmap_signature, FMAP_SIGNATURE, FMAP_SIGNATURE_SIZE)) {
+    return 1;
+  }
+
+  int ret = 1;
+  size_t size = sizeof(header) + header.fmap_nareas * sizeof(FmapAreaHeader);
+  uint8_t *buf = malloc(size);
+  FmapAreaHeader *ah;
+  if (buf != NULL && pread_all(fd, buf, size, offset) == 0 &&
+      fmap_find_by_name(buf, size, NULL, "RW_GPT", &ah) != NULL &&
+      ah->area_size % 2 == 0 &&
+      (uint64_t)ah->area_offset + ah->area_size <= flash_size) {
+    gpt->offset = ah->area_offset;
+    gpt->size = ah->area_size;
+    ret = 0;
+  }
+  free(buf);
+  return ret;
+}
+
+// Check if /dev/|name| is a NOR flash with RW_GPT in its FMAP.
+static int nor_open_mtd(const char *name, struct nor_gpt *gpt) {
+  char path[PATH_MAX];
+  char type[16] = "";
+  snprintf(path, sizeof(path), "/sys/class/mtd/%s/type", name);
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) {
+    return 1;
+  }
+  int is_nor = fscanf(fp, "%15s", type) == 1 && strcmp(type, "nor") == 0;
+  fclose(fp);
+  if (!is_nor) {
+    return 1;
+  }
+
+  snprintf(path, sizeof(path), "/dev/%s", name);
+  int fd = open(path, O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    return 1;
+  }
+  struct mtd_info_user info;
+  if (ioctl(fd, MEMGETINFO, &info) != 0 || info.erasesize == 0) {
+    close(fd);
+    return 1;
+  }
+
+  // Try the most aligned offsets first; that's where FMAPs usually are.
+  uint64_t align, offset;
+  int found = nor_find_gpt(fd, 0, info.size, gpt) == 0;
+  for (align = info.size / 2; !found && align >= NOR_FMAP_ALIGN; align /= 2) {
+    for (offset = align; !found && offset < info.size; offset += 2 * align) {
+      found = nor_find_gpt(fd, offset, info.size, gpt) == 0;
+    }
+  }
+  if (!found) {
+    close(fd);
+    return 1;
+  }
+
+  gpt->fd = fd;
+  gpt->erase_size = info.erasesize;
+  return 0;
+}
+
+// Look for a NOR MTD device holding RW_GPT, once. Returns the one found, or
+// NULL if flashrom has to be used instead.
+static struct nor_gpt *nor_open(void) {
+  if (nor_probed) {
+    return nor.fd >= 0 ? &nor : NULL;
+  }
+  nor_probed = true;
+
+  DIR *dir = opendir("/sys/class/mtd");
+  if (dir == NULL) {
+    return NULL;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const char *name = entry->d_name;
+    // Skip the read-only aliases (mtdNro).
+    if (strncmp(name, "mtd", 3) != 0 || strchr(name, 'r') != NULL) {
+      continue;
+    }
+    if (nor_open_mtd(name, &nor) == 0) {
+      break;
+    }
+  }
+  closedir(dir);
+  return nor.fd >= 0 ? &nor : NULL;
+}
+
+// Write |size| bytes of |data| at |offset| of the flash. Only erase blocks
+// whose contents change are erased and rewritten, and each of those is
+// read back to verify it.
+static int nor_write(const struct nor_gpt *gpt, uint64_t offset,
+                     const uint8_t *data, uint32_t size) {
+  int ret = 1;
+  uint32_t block_size = gpt->erase_size;
+  uint8_t *current = malloc(block_size);
+  uint8_t *wanted = malloc(block_size);
+  if (current == NULL || wanted == NULL) {
+    goto free_bufs;
+  }
+
+  uint64_t end = offset + size;
+  uint64_t block;
+  for (block = offset - offset % block_size; block < end;
+       block += block_size) {
+    if (pread_all(gpt->fd, current, block_size, block) != 0) {
+      goto free_bufs;
+    }
+    // Patch the part of |data| that falls in this block over what's there.
+    uint64_t start = block > offset ? block : offset;
+    uint64_t stop = block + block_size < end ? block + block_size : end;
+    memcpy(wanted, current, block_size);
+    memcpy(wanted + (start - block), data + (start - offset), stop - start);
+    if (memcmp(wanted, current, block_size) == 0) {
+      continue;
+    }
+
+    struct erase_info_user erase = { .start = block, .length = block_size };
+    if (ioctl(gpt->fd, MEMERASE, &erase) != 0 ||
+        pwrite_all(gpt->fd, wanted, block_size, block) != 0 ||
+        pread_all(gpt->fd, current, block_size, block) != 0 ||
+        memcmp(wanted, current, block_size) != 0) {
+      goto free_bufs;
+    }
+  }
+  ret = 0;
+
+free_bufs:
+  free(current);
+  free(wanted);
+  return ret;
+}
+
+static int nor_read_gpt(const struct nor_gpt *gpt, const char *dir) {
+  int ret = 1;
+  uint8_t *buf = malloc(gpt->size);
+  if (buf == NULL) {
+    return ret;
+  }
+
+  ret++;
+  if (pread_all(gpt->fd, buf, gpt->size, gpt->offset) != 0) {
+    goto free_buf;
+  }
+
+  ret++;
+  char *path;
+  if (asprintf(&path, "%s/rw_gpt", dir) == -1) {
+    goto free_buf;
+  }
+  int fd = open(path, O_WRONLY | O_CLOEXEC | O_CREAT | O_TRUNC, 0600);
+  free(path);
+  if (fd < 0) {
+    goto free_buf;
+  }
+  ret++;
+  if (pwrite_all(fd, buf, gpt->size, 0) == 0) {
+    ret = 0;
+  }
+  close(fd);
+
+free_buf:
+  free(buf);
+  return ret;
+}
+
+// Say how writing |nr_writes| halves of rw_gpt with |nr_fails| failures went.
+static int report_writes(int nr_writes, int nr_fails, const char *via) {
+  if (nr_fails == 0) {
+    return 0;
+  }
+  if (nr_fails < nr_writes) {
+    Warning("It might still be okay.\n");
+  } else if (nr_writes == 2) {
+    Error("Cannot write both parts back %s.\n", via);
+  } else {
+    Error("Cannot write rw_gpt back %s.\n", via);
+  }
+  return 1;
+}
+
+static int nor_write_gpt(const struct nor_gpt *gpt, const char *dir,
+                         uint32_t modified) {
+  int ret = 1;
+  uint8_t *buf = malloc(gpt->size);
+  if (buf == NULL) {
+    return ret;
+  }
+
+  ret++;
+  char *path;
+  if (asprintf(&path, "%s/rw_gpt", dir) == -1) {
+    goto free_buf;
+  }
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  free(path);
+  if (fd < 0) {
+    goto free_buf;
+  }
+  struct stat stat;
+  int ok = fstat(fd, &stat) == 0 && stat.st_size == gpt->size &&
+           pread_all(fd, buf, gpt->size, 0) == 0;
+  close(fd);
+  ret++;
+  if (!ok) {
+    goto free_buf;
+  }
+
+  // Write the halves separately, like the flashrom path, so an interrupted
+  // write can only damage one copy of the GPT.
+  ret++;
+  uint32_t half_size = gpt->size / 2;
+  int nr_writes = 0;
+  int nr_fails = 0;
+  if (modified & NOR_GPT_PRIMARY) {
+    nr_writes++;
+    if (nor_write(gpt, gpt->offset, buf, half_size) != 0) {
+      Warning("Cannot write the 1st half of rw_gpt back to NOR flash.\n");
+      nr_fails++;
+    }
+  }
+  if (modified & NOR_GPT_SECONDARY) {
+    nr_writes++;
+    if (nor_write(gpt, gpt->offset + half_size, buf + half_size,
+                  half_size) != 0) {
+      Warning("Cannot write the 2nd half of rw_gpt back to NOR flash.\n");
+      nr_fails++;
+    }
+  }
+  if (report_writes(nr_writes, nr_fails, "to NOR flash") == 0) {
+    ret = 0;
+  }
+
+free_buf:
+  free(buf);
+  return ret;
+}
+
 // Obtain the MTD size from its sysfs node.
 int GetMtdSize(const char *mtd_device, uint64_t *size) {
   mtd_device = strrchr(mtd_device, '/');
@@ -209,6 +504,15 @@ int ReadNorFlash(char *temp_dir_template) {
 
   // Read RW_GPT section from NOR flash to "rw_gpt".
   ret++;
+  struct nor_gpt *gpt = nor_open();
+  if (gpt != NULL) {
+    if (nor_read_gpt(gpt, temp_dir_template) != 0) {
+      Error("Cannot read RW_GPT from NOR flash.\n");
+      RemoveDir(temp_dir_template);
+      return ret;
+    }
+    return 0;
+  }
   int fd_flags = fcntl(1, F_GETFD);
   // Close stdout on exec so that flashrom does not muck up cgpt's output.
   fcntl(1, F_SETFD, FD_CLOEXEC);
@@ -224,8 +528,17 @@ int ReadNorFlash(char *temp_dir_template) {
   return ret;
 }
 
-// Write "rw_gpt" back to NOR flash. We write the file in two parts for safety.
-int WriteNorFlash(const char *dir) {
+// Write "rw_gpt" back to NOR flash. We write the file in two parts for safety,
+// and skip the parts that |modified| says haven't changed.
+int WriteNorFlash(const char *dir, uint32_t modified) {
+  if (!(modified & (NOR_GPT_PRIMARY | NOR_GPT_SECONDARY))) {
+    return 0;
+  }
+  struct nor_gpt *gpt = nor_open();
+  if (gpt != NULL) {
+    return nor_write_gpt(gpt, dir, modified);
+  }
+
   int ret = 0;
   ret++;
   if (split_gpt(dir, "rw_gpt") != 0) {
@@ -233,25 +546,30 @@ int WriteNorFlash(const char *dir) {
     return ret;
   }
   ret++;
+  int nr_writes = 0;
   int nr_fails = 0;
   int fd_flags = fcntl(1, F_GETFD);
   // Close stdout on exec so that flashrom does not muck up cgpt's output.
   fcntl(1, F_SETFD, FD_CLOEXEC);
-  if (ForkExecL(dir, FLASHROM_PATH, "-i", "RW_GPT_PRIMARY:rw_gpt_1",
-                "-w", "--fast-verify", NULL) != 0) {
-    Warning("Cannot write the 1st half of rw_gpt back with flashrom.\n");
-    nr_fails++;
+  if (modified & NOR_GPT_PRIMARY) {
+    nr_writes++;
+    if (ForkExecL(dir, FLASHROM_PATH, "-i", "RW_GPT_PRIMARY:rw_gpt_1",
+                  "-w", "--fast-verify", NULL) != 0) {
+      Warning("Cannot write the 1st half of rw_gpt back with flashrom.\n");
+      nr_fails++;
+    }
   }
-  if (ForkExecL(dir, FLASHROM_PATH, "-i", "RW_GPT_SECONDARY:rw_gpt_2",
-                "-w", "--fast-verify", NULL) != 0) {
-    Warning("Cannot write the 2nd half of rw_gpt back with flashrom.\n");
-    nr_fails++;
+  if (modified & NOR_GPT_SECONDARY) {
+    nr_writes++;
+    if (ForkExecL(dir, FLASHROM_PATH, "-i", "RW_GPT_SECONDARY:rw_gpt_2",
+                  "-w", "--fast-verify", NULL) != 0) {
+      Warning("Cannot write the 2nd half of rw_gpt back with flashrom.\n");
+      nr_fails++;
+    }
   }
   fcntl(1, F_SETFD, fd_flags);
-  switch (nr_fails) {
-    case 0: ret = 0; break;
-    case 1: Warning("It might still be okay.\n"); break;
-    case 2: Error("Cannot write both parts back with flashrom.\n"); break;
+  if (report_writes(nr_writes, nr_fails, "with flashrom") == 0) {
+    ret = 0;
   }
   return ret;
 }
@@ -2,8 +2,9 @@
  * Use of this source code is governed by a BSD-style license that can be
  * found in the LICENSE file.
  *
- * This module provides some utility functions to use "flashrom" to read from
- * and write to NOR flash.
+ * This module provides some utility functions to read from and write to NOR
+ * flash. If the flash is exposed as an MTD device with RW_GPT in its FMAP, it
+ * is accessed directly; otherwise "flashrom" is used.
  */
 
 #ifndef VBOOT_REFERCENCE_CGPT_CGPT_NOR_H_
@@ -28,7 +29,13 @@ int RemoveDir(const char *dir);
 // requirements by mkdtemp().
 int ReadNorFlash(char *temp_dir_template);
 
-// Write "rw_gpt" back to NOR flash. We write the file in two parts for safety.
-int WriteNorFlash(const char *dir);
+// The GPT_MODIFIED_* bits for what each half of "rw_gpt" holds.
+#define NOR_GPT_PRIMARY (GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1)
+#define NOR_GPT_SECONDARY (GPT_MODIFIED_HEADER2 | GPT_MODIFIED_ENTRIES2)
+
+// Write "rw_gpt" back to NOR flash. We write the file in two parts for safety,
+// and only the parts whose bits are set in |modified| (GPT_MODIFIED_*).
+// Through an MTD device, only the erase blocks that change are rewritten.
+int WriteNorFlash(const char *dir, uint32_t modified);
 
 #endif  // VBOOT_REFERCENCE_CGPT_CGPT_NOR_H_
@@ -78,6 +78,96 @@ static void ChangeGroup(group_list_t *gl, int old_priority, int new_priority) {
     }
 }
 
+// Sets the priority of one kernel, unless it already has it. Returns 1 if the
+// entry changed.
+static int ApplyPriority(struct drive *drive, uint32_t index, int priority) {
+  if (GetPriority(drive, PRIMARY, index) == priority)
+    return 0;
+  SetPriority(drive, PRIMARY, index, priority);
+  return 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// With an explicit order we rank every kernel at once. The kernels named in
+// the order go to the top, in that order, and the rest keep their relative
+// order beneath them, so it's the same as doing "-i" on each named kernel,
+// last to first, but with a single sort and a single write.
+
+typedef struct {
+  int key;                              // rank: higher goes first
+  uint32_t entry;                       // entry index
+} rank_t;
+
+static int CompareRanks(const void *a, const void *b) {
+  const rank_t *ra = (const rank_t *)a;
+  const rank_t *rb = (const rank_t *)b;
+  if (ra->key != rb->key)
+    return rb->key - ra->key;
+  return (int)ra->entry - (int)rb->entry;
+}
+
+// Returns the number of entries changed, or -1 on error.
+static int PrioritizeInOrder(struct drive *drive,
+                             CgptPrioritizeParams *params) {
+  rank_t ranks[GPT_MAX_KERNELS];
+  uint32_t num_kernels = drive->gpt.num_kernels;
+  uint32_t max_part = GetNumberOfEntries(drive);
+  int num_groups = 0;
+  int changed = 0;
+  int priority;
+  uint32_t i;
+  int j;
+
+  for (i = 0; i < num_kernels; i++) {
+    ranks[i].entry = drive->gpt.kernels[i].entry;
+    ranks[i].key = drive->gpt.kernels[i].priority;
+  }
+
+  // The named kernels rank above anything a priority can say.
+  for (j = 0; j < params->num_order; j++) {
+    uint32_t part = params->order[j];
+    if (part < 1 || part > max_part) {
+      Error("invalid partition number: %d (must be between 1 and %d\n",
+            part, max_part);
+      return -1;
+    }
+    for (i = 0; i < num_kernels; i++)
+      if (ranks[i].entry == part - 1)
+        break;
+    if (i == num_kernels) {
+      Error("partition %d is not a ChromeOS kernel\n", part);
+      return -1;
+    }
+    if (ranks[i].key > 15) {
+      Error("partition %d is given more than once\n", part);
+      return -1;
+    }
+    ranks[i].key = 16 + params->num_order - j;
+  }
+
+  qsort(ranks, num_kernels, sizeof(ranks[0]), CompareRanks);
+
+  // We'll never lower anything to zero, so priority zero isn't a rank.
+  for (i = 0; i < num_kernels && ranks[i].key; i++)
+    if (!i || ranks[i].key != ranks[i-1].key)
+      num_groups++;
+
+  // Where do we start?
+  if (params->max_priority)
+    priority = params->max_priority;
+  else
+    priority = num_groups > 15 ? 15 : num_groups;
+
+  // Walk down the ranks, touching only the entries that change.
+  for (i = 0; i < num_kernels && ranks[i].key; i++) {
+    if (i && ranks[i].key != ranks[i-1].key && priority > 1)
+      priority--;
+    changed += ApplyPriority(drive, ranks[i].entry, priority);
+  }
+
+  return changed;
+}
+
 static void SortGroups(group_list_t *gl) {
   int i, j;
   group_t tmp;
@@ -100,6 +190,7 @@ int CgptPrioritize(CgptPrioritizeParams *params) {
   uint32_t index;
   uint32_t max_part;
   int num_kernels;
+  int changed = 0;
   int i,j;
   group_list_t *groups;
 
@@ -118,6 +209,11 @@ int CgptPrioritize(CgptPrioritizeParams *params) {
 
   max_part = GetNumberOfEntries(&drive);
 
+  if (params->num_order && params->set_partition) {
+    Error("only one of an order and a partition can be given\n");
+    goto bad;
+  }
+
   if (params->set_partition) {
     if (params->set_partition < 1 || params->set_partition > max_part) {
       Error("invalid partition number: %d (must be between 1 and %d\n",
@@ -132,21 +228,21 @@ int CgptPrioritize(CgptPrioritizeParams *params) {
     }
   }
 
-  // How many kernel partitions do I have?
-  num_kernels = 0;
-  for (i = 0; i < max_part; i++) {
-    if (IsKernel(&drive, PRIMARY, i))
-      num_kernels++;
-  }
+  // How many kernel partitions do I have?  The index has them all, so we
+  // needn't look at the other entries again.
+  GptIndexKernels(&drive.gpt);
+  num_kernels = drive.gpt.num_kernels;
 
-  if (num_kernels) {
+  if (params->num_order) {
+    changed = PrioritizeInOrder(&drive, params);
+    if (changed < 0)
+      goto bad;
+  } else if (num_kernels) {
     // Determine the current priority groups
     groups = NewGroupList(num_kernels);
-    for (i = 0; i < max_part; i++) {
-      if (!IsKernel(&drive, PRIMARY, i))
-        continue;
-
-      priority = GetPriority(&drive, PRIMARY, i);
+    for (j = 0; j < num_kernels; j++) {
+      i = drive.gpt.kernels[j].entry;
+      priority = drive.gpt.kernels[j].priority;
 
       // Is this partition special?
       if (params->set_partition && (i+1 == params->set_partition)) {
@@ -191,12 +287,16 @@ int CgptPrioritize(CgptPrioritizeParams *params) {
     // Now apply the ranking to the GPT
     for (i=0; i<groups->num_groups; i++)
       for (j=0; j<groups->group[i].num_parts; j++)
-        SetPriority(&drive, PRIMARY,
-                    groups->group[i].part[j], groups->group[i].priority);
+        changed += ApplyPriority(&drive, groups->group[i].part[j],
+                                 groups->group[i].priority);
 
     FreeGroups(groups);
   }
 
+  // If nothing moved, there's nothing to write.
+  if (!changed)
+    return DriveClose(&drive, 0);
+
   // Write it all out
   UpdateAllEntries(&drive);
 
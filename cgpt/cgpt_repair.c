@@ -15,7 +15,8 @@ int CgptRepair(CgptRepairParams *params) {
   if (params == NULL)
     return CGPT_FAILED;
 
-  if (CGPT_OK != DriveOpen(params->drive_name, &drive, O_RDWR,
+  if (CGPT_OK != DriveOpen(params->drive_name, &drive,
+                           params->check_only ? O_RDONLY : O_RDWR,
                            params->drive_size))
     return CGPT_FAILED;
 
@@ -24,6 +25,22 @@ int CgptRepair(CgptRepairParams *params) {
     printf("GptSanityCheck() returned %d: %s\n",
            gpt_retval, GptError(gpt_retval));
 
+  // Just report what GptRepair() would fix, leaving the GPT untouched.
+  if (params->check_only) {
+    uint32_t bad_headers = MASK_BOTH & ~drive.gpt.valid_headers;
+    uint32_t bad_entries = MASK_BOTH & ~drive.gpt.valid_entries;
+    if (bad_headers & MASK_PRIMARY)
+      printf("Primary Header needs repair.\n");
+    if (bad_entries & MASK_PRIMARY)
+      printf("Primary Entries needs repair.\n");
+    if (bad_entries & MASK_SECONDARY)
+      printf("Secondary Entries needs repair.\n");
+    if (bad_headers & MASK_SECONDARY)
+      printf("Secondary Header needs repair.\n");
+    DriveClose(&drive, 0);
+    return (bad_headers || bad_entries) ? CGPT_FAILED : CGPT_OK;
+  }
+
   GptRepair(&drive.gpt);
   if (drive.gpt.modified & GPT_MODIFIED_HEADER1)
     printf("Primary Header is updated.\n");
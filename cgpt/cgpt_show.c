@@ -4,6 +4,9 @@
 
 #define __STDC_FORMAT_MACROS
 
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <string.h>
 
 #include "cgpt.h"
@@ -271,7 +274,8 @@ static int GptShow(struct drive *drive, CgptShowParams *params) {
 
     GptHeader* primary_header = (GptHeader*)drive->gpt.primary_header;
     printf(GPT_FMT, (int)primary_header->entries_lba,
-           (int)CalculateEntriesSectors(primary_header),
+           (int)CalculateEntriesSectors(primary_header,
+                                        drive->gpt.sector_bytes),
            drive->gpt.valid_entries & MASK_PRIMARY ? "" : "INVALID",
            "Pri GPT table");
 
@@ -282,7 +286,8 @@ static int GptShow(struct drive *drive, CgptShowParams *params) {
     /****************************** Secondary *************************/
     GptHeader* secondary_header = (GptHeader*)drive->gpt.secondary_header;
     printf(GPT_FMT, (int)secondary_header->entries_lba,
-           (int)CalculateEntriesSectors(secondary_header),
+           (int)CalculateEntriesSectors(secondary_header,
+                                        drive->gpt.sector_bytes),
            drive->gpt.valid_entries & MASK_SECONDARY ? "" : "INVALID",
            "Sec GPT table");
     /* We show secondary table details if any of following is true.
@@ -331,12 +336,289 @@ static int GptShow(struct drive *drive, CgptShowParams *params) {
   return CGPT_OK;
 }
 
+// The JSON for a drive is built up here, so it can be made in another thread
+// and written out in one go.
+struct show_buf {
+  char *data;
+  size_t len;
+  size_t size;
+  int failed;
+};
+
+static void BufReserve(struct show_buf *buf, size_t more) {
+  char *data;
+  size_t size;
+
+  if (buf->failed || buf->len + more < buf->size)
+    return;
+  size = buf->size ? buf->size : 1024;
+  while (size <= buf->len + more)
+    size *= 2;
+  data = realloc(buf->data, size);
+  if (!data) {
+    buf->failed = 1;
+    return;
+  }
+  buf->data = data;
+  buf->size = size;
+}
+
+static void BufAdd(struct show_buf *buf, const char *fmt, ...) {
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  n = vsnprintf(NULL, 0, fmt, ap);
+  va_end(ap);
+  BufReserve(buf, n);
+  if (buf->failed)
+    return;
+  va_start(ap, fmt);
+  vsnprintf(buf->data + buf->len, buf->size - buf->len, fmt, ap);
+  va_end(ap);
+  buf->len += n;
+}
+
+// Adds 'str' as a JSON string. Only '"', '\\' and control characters need
+// escaping; anything else, UTF-8 included, goes in as it is.
+static void BufAddString(struct show_buf *buf, const char *str) {
+  const unsigned char *s = (const unsigned char *)str;
+
+  BufReserve(buf, strlen(str) * 6 + 2);
+  if (buf->failed)
+    return;
+  buf->data[buf->len++] = '"';
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      buf->data[buf->len++] = '\\';
+      buf->data[buf->len++] = *s;
+    } else if (*s < 0x20) {
+      buf->len += sprintf(buf->data + buf->len, "\\u%04x", *s);
+    } else {
+      buf->data[buf->len++] = *s;
+    }
+  }
+  buf->data[buf->len++] = '"';
+}
+
+// Adds a partition as a JSON object, with only the fields that were asked for.
+// Nothing is converted to a string unless it's going to be shown.
+static void EntryJson(struct show_buf *buf, struct drive *drive,
+                      uint32_t index, uint32_t fields, int raw) {
+  GptEntry *entry = GetEntry(&drive->gpt, ANY_VALID, index);
+  char str[256];                        // scratch buffer for conversions
+
+  BufAdd(buf, "{\"part\":%u", index + 1);
+  if (fields & CGPT_SHOW_FIELD_START)
+    BufAdd(buf, ",\"start\":%" PRIu64, entry->starting_lba);
+  if (fields & CGPT_SHOW_FIELD_SIZE) {
+    uint64_t size = 0;
+    if (entry->ending_lba || entry->starting_lba)
+      size = entry->ending_lba - entry->starting_lba + 1;
+    BufAdd(buf, ",\"size\":%" PRIu64, size);
+  }
+  if (fields & CGPT_SHOW_FIELD_TYPE) {
+    if (raw || CGPT_OK != ResolveType(&entry->type, str))
+      GuidToStr(&entry->type, str, GUID_STRLEN);
+    BufAdd(buf, ",\"type\":");
+    BufAddString(buf, str);
+  }
+  if (fields & CGPT_SHOW_FIELD_UUID) {
+    GuidToStr(&entry->unique, str, GUID_STRLEN);
+    BufAdd(buf, ",\"uuid\":");
+    BufAddString(buf, str);
+  }
+  if (fields & CGPT_SHOW_FIELD_LABEL) {
+    UTF16ToUTF8(entry->name, sizeof(entry->name) / sizeof(entry->name[0]),
+                (uint8_t *)str, sizeof(str));
+    BufAdd(buf, ",\"label\":");
+    BufAddString(buf, str);
+  }
+  if (fields & CGPT_SHOW_FIELD_ATTR)
+    BufAdd(buf, ",\"attr\":\"0x%x\"", entry->attrs.fields.gpt_att);
+  // These only mean something for kernels
+  if (GuidEqual(&guid_chromeos_kernel, &entry->type)) {
+    if (fields & CGPT_SHOW_FIELD_PRIORITY)
+      BufAdd(buf, ",\"priority\":%d", GetPriority(drive, ANY_VALID, index));
+    if (fields & CGPT_SHOW_FIELD_TRIES)
+      BufAdd(buf, ",\"tries\":%d", GetTries(drive, ANY_VALID, index));
+    if (fields & CGPT_SHOW_FIELD_SUCCESSFUL)
+      BufAdd(buf, ",\"successful\":%d",
+             GetSuccessful(drive, ANY_VALID, index));
+  }
+  BufAdd(buf, "}");
+}
+
+// Adds a drive as a JSON object. Returns CGPT_FAILED if the GPT isn't valid.
+static int GptJson(struct show_buf *buf, const char *name, struct drive *drive,
+                   CgptShowParams *params) {
+  uint32_t fields = params->fields ? params->fields : ~0U;
+  uint32_t i;
+  int first = 1;
+
+  BufAdd(buf, "{\"drive\":");
+  BufAddString(buf, name);
+  if (GPT_SUCCESS != GptSanityCheck(&drive->gpt)) {
+    BufAdd(buf, ",\"error\":\"invalid GPT\"}");
+    return CGPT_FAILED;
+  }
+  if (params->partition > GetNumberOfEntries(drive)) {
+    BufAdd(buf, ",\"error\":\"invalid partition number\"}");
+    return CGPT_FAILED;
+  }
+
+  BufAdd(buf, ",\"sector_bytes\":%u,\"partitions\":[",
+         drive->gpt.sector_bytes);
+  if (params->partition) {
+    EntryJson(buf, drive, params->partition - 1, fields, params->numeric);
+  } else {
+    for (i = 0; i < GetNumberOfEntries(drive); ++i) {
+      if (GuidIsZero(&GetEntry(&drive->gpt, ANY_VALID, i)->type))
+        continue;
+      if (!first)
+        BufAdd(buf, ",");
+      first = 0;
+      EntryJson(buf, drive, i, fields, params->numeric);
+    }
+  }
+  BufAdd(buf, "]}");
+
+  return CGPT_OK;
+}
+
+// A drive to show. The slow part is loading it, so that's done for all of the
+// drives at once; with JSON, so is building the output.
+struct show_job {
+  const char *name;
+  struct drive drive;
+  int opened;
+  int retval;
+  struct show_buf buf;
+};
+
+#define MAX_SHOW_THREADS 16
+
+struct show_queue {
+  CgptShowParams *params;
+  struct show_job *jobs;
+  int count;
+  int next;
+  pthread_mutex_t lock;
+};
+
+static void show_load(CgptShowParams *params, struct show_job *job) {
+  job->retval = DriveOpen(job->name, &job->drive, O_RDONLY,
+                          params->drive_size);
+  if (CGPT_OK != job->retval) {
+    if (params->json) {
+      BufAdd(&job->buf, "{\"drive\":");
+      BufAddString(&job->buf, job->name);
+      BufAdd(&job->buf, ",\"error\":\"can't open drive\"}");
+    }
+    return;
+  }
+  job->opened = 1;
+
+  if (params->json) {
+    job->retval = GptJson(&job->buf, job->name, &job->drive, params);
+    DriveClose(&job->drive, 0);
+    job->opened = 0;
+  }
+}
+
+static void *show_thread(void *arg) {
+  struct show_queue *queue = arg;
+  int i;
+
+  for (;;) {
+    pthread_mutex_lock(&queue->lock);
+    i = queue->next++;
+    pthread_mutex_unlock(&queue->lock);
+    if (i >= queue->count)
+      return NULL;
+    show_load(queue->params, &queue->jobs[i]);
+  }
+}
+
+// Shows many drives, in the order they're given.
+static int CgptShowAll(CgptShowParams *params, char **names, int count) {
+  pthread_t threads[MAX_SHOW_THREADS];
+  struct show_queue queue;
+  struct show_job *jobs;
+  int nthreads = 0;
+  int retval = CGPT_OK;
+  int i;
+
+  jobs = calloc(count, sizeof(*jobs));
+  if (!jobs) {
+    Error("Out of memory\n");
+    return CGPT_FAILED;
+  }
+  for (i = 0; i < count; i++)
+    jobs[i].name = names[i];
+
+  memset(&queue, 0, sizeof(queue));
+  queue.params = params;
+  queue.jobs = jobs;
+  queue.count = count;
+  pthread_mutex_init(&queue.lock, NULL);
+
+  // The batch mode drive cache isn't thread-safe
+  if (!DriveBatchActive()) {
+    while (nthreads < count - 1 && nthreads < MAX_SHOW_THREADS &&
+           0 == pthread_create(&threads[nthreads], NULL, show_thread, &queue))
+      nthreads++;
+  }
+  show_thread(&queue);
+  for (i = 0; i < nthreads; i++)
+    pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&queue.lock);
+
+  if (params->json)
+    printf("[");
+  for (i = 0; i < count; i++) {
+    struct show_job *job = &jobs[i];
+
+    if (params->json) {
+      if (job->buf.failed) {
+        Error("Out of memory\n");
+        job->retval = CGPT_FAILED;
+      } else {
+        if (i)
+          printf(",");
+        fwrite(job->buf.data, 1, job->buf.len, stdout);
+      }
+    } else if (job->opened) {
+      printf("%s%s:\n", i ? "\n" : "", job->name);
+      job->retval = GptShow(&job->drive, params);
+    }
+    if (job->opened)
+      DriveClose(&job->drive, 0);
+    if (job->retval)
+      retval = CGPT_FAILED;
+    free(job->buf.data);
+  }
+  if (params->json)
+    printf("]\n");
+
+  free(jobs);
+  return retval;
+}
+
 int CgptShow(CgptShowParams *params) {
   struct drive drive;
 
   if (params == NULL)
     return CGPT_FAILED;
 
+  if (params->json || params->num_drives > 1) {
+    if (params->num_drives)
+      return CgptShowAll(params, params->drive_names, params->num_drives);
+    return CgptShowAll(params, &params->drive_name, 1);
+  }
+  if (params->num_drives)
+    params->drive_name = params->drive_names[0];
+
   if (CGPT_OK != DriveOpen(params->drive_name, &drive, O_RDONLY,
                            params->drive_size))
     return CGPT_FAILED;
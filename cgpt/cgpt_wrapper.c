@@ -23,7 +23,6 @@
 
 #include "cgpt.h"
 #include "cgpt_nor.h"
-#include "cryptolib.h"
 
 // Check if cmdline |argv| has "-D". "-D" signifies that GPT structs are stored
 // off device, and hence we should not wrap around cgpt.
@@ -63,11 +62,54 @@ static const char *find_mtd_device(int argc, const char *const argv[]) {
   return NULL;
 }
 
+// Read all of |path| into a buffer the caller frees. Returns NULL on error.
+static uint8_t *read_file(const char *path, uint64_t *size) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  uint8_t *buf = NULL;
+  struct stat stat;
+  if (fstat(fd, &stat) == 0 && stat.st_size > 0 &&
+      (buf = malloc(stat.st_size)) != NULL) {
+    if (read(fd, buf, stat.st_size) == stat.st_size) {
+      *size = stat.st_size;
+    } else {
+      free(buf);
+      buf = NULL;
+    }
+  }
+  close(fd);
+  return buf;
+}
+
+// Return the GPT_MODIFIED_* bits for the halves of rw_gpt that differ between
+// |original| and |modified|.
+static uint32_t modified_halves(const uint8_t *original, uint64_t original_size,
+                                const uint8_t *modified,
+                                uint64_t modified_size) {
+  if (original == NULL || modified == NULL || original_size != modified_size) {
+    return NOR_GPT_PRIMARY | NOR_GPT_SECONDARY;
+  }
+  uint64_t half_size = original_size / 2;
+  uint32_t bits = 0;
+  if (memcmp(original, modified, half_size) != 0) {
+    bits |= NOR_GPT_PRIMARY;
+  }
+  if (memcmp(original + half_size, modified + half_size,
+             original_size - half_size) != 0) {
+    bits |= NOR_GPT_SECONDARY;
+  }
+  return bits;
+}
+
 static int wrap_cgpt(int argc,
                      const char *const argv[],
                      const char *mtd_device) {
-  uint8_t *original_hash = NULL;
-  uint8_t *modified_hash = NULL;
+  uint8_t *original = NULL;
+  uint8_t *modified = NULL;
+  uint64_t original_size = 0;
+  uint64_t modified_size = 0;
   int ret = 0;
 
   // Create a temp dir to work in.
@@ -80,7 +122,7 @@ static int wrap_cgpt(int argc,
   if (snprintf(rw_gpt_path, sizeof(rw_gpt_path), "%s/rw_gpt", temp_dir) < 0) {
     goto cleanup;
   }
-  original_hash = DigestFile(rw_gpt_path, SHA1_DIGEST_ALGORITHM);
+  original = read_file(rw_gpt_path, &original_size);
 
   // Obtain the MTD size.
   ret++;
@@ -123,20 +165,17 @@ static int wrap_cgpt(int argc,
     goto cleanup;
   }
 
-  // Write back "rw_gpt" to NOR flash in two chunks.
+  // Write back the halves of "rw_gpt" that cgpt changed to NOR flash.
   ret++;
-  modified_hash = DigestFile(rw_gpt_path, SHA1_DIGEST_ALGORITHM);
-  if (original_hash != NULL && modified_hash != NULL) {
-    if (memcmp(original_hash, modified_hash, SHA1_DIGEST_SIZE) != 0) {
-      ret = WriteNorFlash(temp_dir);
-    } else {
-      ret = 0;
-    }
+  modified = read_file(rw_gpt_path, &modified_size);
+  if (modified != NULL) {
+    ret = WriteNorFlash(temp_dir, modified_halves(original, original_size,
+                                                  modified, modified_size));
   }
 
 cleanup:
-  free(original_hash);
-  free(modified_hash);
+  free(original);
+  free(modified);
   RemoveDir(temp_dir);
   return ret;
 }
@@ -0,0 +1,182 @@
+// Copyright (c) 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgpt.h"
+#include "vboot_host.h"
+
+extern const char* progname;
+
+#define MAX_BATCH_ARGS 64
+
+static void Usage(void)
+{
+  printf("\nUsage: %s batch [OPTIONS] [FILE]\n\n"
+         "Run the commands in FILE (or stdin, if FILE is missing or \"-\"),\n"
+         "one per line, like this:\n\n"
+         "  COMMAND [OPTIONS] DRIVE\n\n"
+         "Each drive is read once, and all the changes are written at the\n"
+         "end. If any command fails, nothing is written. Blank lines and\n"
+         "lines starting with '#' are ignored. Arguments may be quoted\n"
+         "with '' or \"\", or escaped with \\.\n\n"
+         "Options:\n"
+         "  -h           Show this help\n"
+         "\n", progname);
+}
+
+// Splits 'line' into words, in place. Returns the number of words, or -1 if
+// there are too many or a quote isn't closed.
+static int SplitLine(char *line, char *argv[], int max_args) {
+  char *in = line;
+  char *out = line;
+  int argc = 0;
+  char quote;
+
+  for (;;) {
+    while (*in == ' ' || *in == '\t' || *in == '\r' || *in == '\n')
+      in++;
+    if (!*in || *in == '#')
+      return argc;
+    if (argc >= max_args)
+      return -1;
+
+    argv[argc++] = out;
+    quote = 0;
+    while (*in) {
+      if (quote) {
+        if (*in == quote) {
+          quote = 0;
+          in++;
+          continue;
+        }
+        // Only backslash and the quote itself can be escaped in "..."
+        if (quote == '"' && *in == '\\' && (in[1] == '"' || in[1] == '\\'))
+          in++;
+      } else if (*in == '\'' || *in == '"') {
+        quote = *in++;
+        continue;
+      } else if (*in == ' ' || *in == '\t' || *in == '\r' || *in == '\n') {
+        break;
+      } else if (*in == '\\' && in[1]) {
+        in++;
+      }
+      *out++ = *in++;
+    }
+    if (quote)
+      return -1;
+    if (*in)
+      in++;
+    *out++ = '\0';
+  }
+}
+
+static int RunBatch(FILE *fp, const char *filename) {
+  char *argv[MAX_BATCH_ARGS + 1];
+  char *line = NULL;
+  size_t line_size = 0;
+  int line_num = 0;
+  int argc;
+  int rv = CGPT_OK;
+
+  DriveBatchBegin();
+
+  while (getline(&line, &line_size, fp) != -1) {
+    line_num++;
+
+    argc = SplitLine(line, argv, MAX_BATCH_ARGS);
+    if (argc == 0)
+      continue;
+    if (argc < 0) {
+      Error("%s:%d: bad quoting or too many arguments\n", filename, line_num);
+      rv = CGPT_FAILED;
+      break;
+    }
+    argv[argc] = NULL;
+
+    if (0 == strcmp(argv[0], "batch")) {
+      Error("%s:%d: batch can't be nested\n", filename, line_num);
+      rv = CGPT_FAILED;
+      break;
+    }
+
+    if (CGPT_OK != RunCommand(argc, argv)) {
+      Error("%s:%d: \"%s\" failed, nothing was written\n", filename,
+            line_num, argv[0]);
+      rv = CGPT_FAILED;
+      break;
+    }
+  }
+
+  if (rv == CGPT_OK && ferror(fp)) {
+    Error("Can't read %s\n", filename);
+    rv = CGPT_FAILED;
+  }
+
+  free(line);
+
+  if (CGPT_OK != DriveBatchEnd(rv == CGPT_OK))
+    rv = CGPT_FAILED;
+
+  return rv;
+}
+
+int cmd_batch(int argc, char *argv[]) {
+  const char *filename = "-";
+  FILE *fp = stdin;
+  int c;
+  int errorcnt = 0;
+  int rv;
+
+  opterr = 0;                     // quiet, you
+  while ((c=getopt(argc, argv, ":h")) != -1)
+  {
+    switch (c)
+    {
+    case 'h':
+      Usage();
+      return CGPT_OK;
+    case '?':
+      Error("unrecognized option: -%c\n", optopt);
+      errorcnt++;
+      break;
+    default:
+      errorcnt++;
+      break;
+    }
+  }
+  if (optind + 1 < argc) {
+    Error("too many arguments\n");
+    errorcnt++;
+  }
+  if (errorcnt)
+  {
+    Usage();
+    return CGPT_FAILED;
+  }
+
+  if (optind < argc)
+    filename = argv[optind];
+
+  if (strcmp(filename, "-")) {
+    fp = fopen(filename, "r");
+    if (!fp) {
+      Error("Can't open %s: %s\n", filename, strerror(errno));
+      return CGPT_FAILED;
+    }
+  } else {
+    filename = "stdin";
+  }
+
+  rv = RunBatch(fp, filename);
+
+  if (fp != stdin)
+    fclose(fp);
+
+  return rv;
+}
@@ -21,6 +21,8 @@ static void Usage(void)
          "  -z           Zero the sectors of the GPT table and entries\n"
          "  -p NUM       Size (in blocks) of the disk to pad between the\n"
          "                 primary GPT header and its entries, default 0\n"
+         "  -b NUM       Size (in bytes) of a sector, if DRIVE is an image\n"
+         "                 file; 512 (default) or 4096\n"
          "\n", progname);
 }
 
@@ -33,7 +35,7 @@ int cmd_create(int argc, char *argv[]) {
   char *e = 0;
 
   opterr = 0;                     // quiet, you
-  while ((c=getopt(argc, argv, ":hzp:D:")) != -1)
+  while ((c=getopt(argc, argv, ":hzp:D:b:")) != -1)
   {
     switch (c)
     {
@@ -56,6 +58,15 @@ int cmd_create(int argc, char *argv[]) {
         errorcnt++;
       }
       break;
+    case 'b':
+      params.sector_bytes = (uint32_t)strtoul(optarg, &e, 0);
+      if (!*optarg || (e && *e) ||
+          (params.sector_bytes != 512 && params.sector_bytes != 4096))
+      {
+        Error("invalid argument to -%c: \"%s\"\n", c, optarg);
+        errorcnt++;
+      }
+      break;
     case 'h':
       Usage();
       return CGPT_OK;
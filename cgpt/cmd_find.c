@@ -5,7 +5,10 @@
 #include <getopt.h>
 #include <string.h>
 
+#include "2sysincludes.h"
+#include "2return_codes.h"
 #include "cgpt.h"
+#include "host_common.h"
 #include "vboot_host.h"
 
 extern const char* progname;
@@ -29,52 +32,30 @@ static void Usage(void)
          "      Matching partition data must also contain FILE content\n"
          "  -O NUM"
          "       Byte offset into partition to match content (default 0)\n"
+         "  -W NUM"
+         "       Match the content anywhere in NUM bytes starting at\n"
+         "               the -O offset, instead of only at the offset\n"
+         "  -C FILE"
+         "      Keep the partition tables in FILE (best on a tmpfs)\n"
+         "               between runs, so that each drive's table is\n"
+         "               only read again if its header has changed\n"
          "\n", progname);
   PrintTypes();
 }
 
-// read a file into a buffer, return buffer and update size
-static uint8_t *ReadFile(const char *filename, uint64_t *size) {
-  FILE *f;
-  uint8_t *buf;
-
-  f = fopen(filename, "rb");
-  if (!f) {
-    return NULL;
-  }
-
-  fseek(f, 0, SEEK_END);
-  *size = ftell(f);
-  rewind(f);
-
-  buf = malloc(*size);
-  if (!buf) {
-    fclose(f);
-    return NULL;
-  }
-
-  if(1 != fread(buf, *size, 1, f)) {
-    fclose(f);
-    free(buf);
-    return NULL;
-  }
-
-  fclose(f);
-  return buf;
-}
-
 int cmd_find(int argc, char *argv[]) {
 
   CgptFindParams params;
   memset(&params, 0, sizeof(params));
 
   int i;
+  uint32_t matchlen;
   int errorcnt = 0;
   char *e = 0;
   int c;
 
   opterr = 0;                     // quiet, you
-  while ((c=getopt(argc, argv, ":hv1nt:u:l:M:O:D:")) != -1)
+  while ((c=getopt(argc, argv, ":hv1nt:u:l:M:O:W:D:C:")) != -1)
   {
     switch (c)
     {
@@ -115,18 +96,14 @@ int cmd_find(int argc, char *argv[]) {
       }
       break;
     case 'M':
-      params.matchbuf = ReadFile(optarg, &params.matchlen);
-      if (!params.matchbuf || !params.matchlen) {
+      // The content is only compared, so there's no need to copy it
+      if (VB2_SUCCESS != vb2_map_file(optarg, VB2_MAP_RO,
+                                      &params.matchbuf, &matchlen) ||
+          !matchlen) {
         Error("Unable to read from %s\n", optarg);
         errorcnt++;
       }
-      // Go ahead and allocate space for the comparison too
-      params.comparebuf = (uint8_t *)malloc(params.matchlen);
-      if (!params.comparebuf) {
-        Error("Unable to allocate %" PRIu64 "bytes for comparison buffer\n",
-              params.matchlen);
-        errorcnt++;
-      }
+      params.matchlen = matchlen;
       break;
     case 'O':
       params.matchoffset = strtoull(optarg, &e, 0);
@@ -135,6 +112,16 @@ int cmd_find(int argc, char *argv[]) {
         errorcnt++;
       }
       break;
+    case 'W':
+      params.matchwindow = strtoull(optarg, &e, 0);
+      if (!*optarg || (e && *e)) {
+        Error("invalid argument to -%c: \"%s\"\n", c, optarg);
+        errorcnt++;
+      }
+      break;
+    case 'C':
+      params.cache_file = optarg;
+      break;
 
     case 'h':
       Usage();
@@ -156,6 +143,10 @@ int cmd_find(int argc, char *argv[]) {
     Error("You must specify at least one of -t, -u, or -l\n");
     errorcnt++;
   }
+  if (params.matchwindow && !params.matchlen) {
+    Error("-W needs -M\n");
+    errorcnt++;
+  }
   if (errorcnt)
   {
     Usage();
@@ -9,6 +9,7 @@
 #include <uuid/uuid.h>
 
 #include "cgpt.h"
+#include "cgptlib_internal.h"
 #include "vboot_host.h"
 
 extern const char* progname;
@@ -31,14 +32,37 @@ static void Usage(void)
          "  -f           Friends of the given partition (those with the same\n"
          "                 starting priority) are also updated to the new\n"
          "                 highest priority.\n"
+         "  -o LIST      Comma-separated partitions to put at the top of the\n"
+         "                 new order, highest first. The others keep their\n"
+         "                 order beneath them. Only the entries whose\n"
+         "                 priority changes are rewritten.\n"
          "\n"
          "With no options this will set the lowest active kernel to\n"
          "priority 1 while maintaining the original order.\n"
          "\n", progname);
 }
 
+// Parses a comma-separated list of partition numbers. Returns the number of
+// partitions, or -1 if the list is malformed.
+static int ParseOrder(const char *arg, uint32_t *order, int max) {
+  int count = 0;
+  char *e;
+
+  do {
+    if (count == max)
+      return -1;
+    order[count++] = (uint32_t)strtoul(arg, &e, 0);
+    if (e == arg || (*e && *e != ','))
+      return -1;
+    arg = e + 1;
+  } while (*e);
+
+  return count;
+}
+
 int cmd_prioritize(int argc, char *argv[]) {
   CgptPrioritizeParams params;
+  uint32_t order[MAX_NUMBER_OF_ENTRIES];
   memset(&params, 0, sizeof(params));
 
   int c;
@@ -46,7 +70,7 @@ int cmd_prioritize(int argc, char *argv[]) {
   char *e = 0;
 
   opterr = 0;                     // quiet, you
-  while ((c=getopt(argc, argv, ":hi:fP:D:")) != -1)
+  while ((c=getopt(argc, argv, ":hi:fo:P:D:")) != -1)
   {
     switch (c)
     {
@@ -69,6 +93,15 @@ int cmd_prioritize(int argc, char *argv[]) {
     case 'f':
       params.set_friends = 1;
       break;
+    case 'o':
+      params.num_order = ParseOrder(optarg, order, MAX_NUMBER_OF_ENTRIES);
+      if (params.num_order < 0)
+      {
+        Error("invalid argument to -%c: \"%s\"\n", c, optarg);
+        errorcnt++;
+      }
+      params.order = order;
+      break;
     case 'P':
       params.max_priority = (int)strtol(optarg, &e, 0);
       if (!*optarg || (e && *e))
@@ -110,6 +143,12 @@ int cmd_prioritize(int argc, char *argv[]) {
     return CGPT_FAILED;
   }
 
+  if (params.num_order && params.set_partition) {
+    Error("the -o and -i options can't be used together\n");
+    Usage();
+    return CGPT_FAILED;
+  }
+
   if (optind >= argc) {
     Error("missing drive argument\n");
     return CGPT_FAILED;
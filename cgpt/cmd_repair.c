@@ -15,6 +15,8 @@ static void Usage(void)
   printf("\nUsage: %s repair [OPTIONS] DRIVE\n\n"
          "Repair damaged GPT headers and tables.\n\n"
          "Options:\n"
+         "  -c           Only check; report what needs repair and fail if\n"
+         "                 anything does, without writing to DRIVE\n"
          "  -D NUM       Size (in bytes) of the disk where partitions reside\n"
          "                 default 0, meaning partitions and GPT structs are\n"
          "                 both on DRIVE\n"
@@ -31,7 +33,7 @@ int cmd_repair(int argc, char *argv[]) {
   int errorcnt = 0;
 
   opterr = 0;                     // quiet, you
-  while ((c=getopt(argc, argv, ":hvD:")) != -1)
+  while ((c=getopt(argc, argv, ":hcvD:")) != -1)
   {
     switch (c)
     {
@@ -43,6 +45,9 @@ int cmd_repair(int argc, char *argv[]) {
         errorcnt++;
       }
       break;
+    case 'c':
+      params.check_only = 1;
+      break;
     case 'v':
       params.verbose++;
       break;
@@ -14,7 +14,7 @@ extern const char* progname;
 
 static void Usage(void)
 {
-  printf("\nUsage: %s show [OPTIONS] DRIVE\n\n"
+  printf("\nUsage: %s show [OPTIONS] DRIVE [DRIVE...]\n\n"
          "Display the GPT table\n\n"
          "Options:\n"
          "  -D NUM       Size (in bytes) of the disk where partitions reside\n"
@@ -34,9 +34,56 @@ static void Usage(void)
          "               -P  Priority flag\n"
          "               -A  raw 64-bit attribute value\n"
          "  -d           Debug output (including invalid headers)\n"
+         "  -j           JSON output, on one line, for all the drives\n"
+         "  -F LIST      Partition fields for -j, comma-separated from:\n"
+         "                 start,size,type,uuid,label,attr,\n"
+         "                 priority,tries,successful\n"
+         "                 default all of them\n"
+         "\n"
+         "With more than one DRIVE, they are all loaded at once.\n"
          "\n", progname);
 }
 
+static const struct {
+  const char *name;
+  uint32_t field;
+} show_fields[] = {
+  {"start", CGPT_SHOW_FIELD_START},
+  {"size", CGPT_SHOW_FIELD_SIZE},
+  {"type", CGPT_SHOW_FIELD_TYPE},
+  {"uuid", CGPT_SHOW_FIELD_UUID},
+  {"label", CGPT_SHOW_FIELD_LABEL},
+  {"attr", CGPT_SHOW_FIELD_ATTR},
+  {"priority", CGPT_SHOW_FIELD_PRIORITY},
+  {"tries", CGPT_SHOW_FIELD_TRIES},
+  {"successful", CGPT_SHOW_FIELD_SUCCESSFUL},
+};
+
+// Parses a comma-separated list of field names. Returns 0 if any is unknown.
+static uint32_t ParseFields(const char *list) {
+  uint32_t fields = 0;
+  const char *s = list;
+
+  while (*s) {
+    size_t len = strcspn(s, ",");
+    int i, found = 0;
+
+    for (i = 0; i < ARRAY_COUNT(show_fields); i++) {
+      if (strlen(show_fields[i].name) == len &&
+          !strncmp(show_fields[i].name, s, len)) {
+        fields |= show_fields[i].field;
+        found = 1;
+      }
+    }
+    if (!found)
+      return 0;
+    s += len;
+    if (*s == ',')
+      s++;
+  }
+  return fields;
+}
+
 int cmd_show(int argc, char *argv[]) {
   CgptShowParams params;
   memset(&params, 0, sizeof(params));
@@ -46,7 +93,7 @@ int cmd_show(int argc, char *argv[]) {
   char *e = 0;
 
   opterr = 0;                     // quiet, you
-  while ((c=getopt(argc, argv, ":hnvqi:bstulSTPAdD:")) != -1)
+  while ((c=getopt(argc, argv, ":hnvqi:bstulSTPAdD:jF:")) != -1)
   {
     switch (c)
     {
@@ -90,6 +137,17 @@ int cmd_show(int argc, char *argv[]) {
     case 'd':
       params.debug = 1;
       break;
+    case 'j':
+      params.json = 1;
+      break;
+    case 'F':
+      params.fields = ParseFields(optarg);
+      if (!params.fields)
+      {
+        Error("invalid argument to -%c: \"%s\"\n", c, optarg);
+        errorcnt++;
+      }
+      break;
 
     case 'h':
       Usage();
@@ -107,6 +165,11 @@ int cmd_show(int argc, char *argv[]) {
       break;
     }
   }
+  if (params.json && params.single_item)
+  {
+    Error("-%c can't be used with -j\n", params.single_item);
+    errorcnt++;
+  }
   if (errorcnt)
   {
     Usage();
@@ -120,6 +183,8 @@ int cmd_show(int argc, char *argv[]) {
   }
 
   params.drive_name = argv[optind];
+  params.drive_names = argv + optind;
+  params.num_drives = argc - optind;
 
   return CgptShow(&params);
 }
@@ -34,7 +34,7 @@ void vb2api_fail(struct vb2_context *ctx, uint8_t reason, uint8_t subcode)
 	vb2_fail(ctx, reason, subcode);
 }
 
-int vb2api_fw_phase1(struct vb2_context *ctx)
+static int fw_phase1(struct vb2_context *ctx)
 {
 	int rv;
 
@@ -76,7 +76,20 @@ int vb2api_fw_phase1(struct vb2_context *ctx)
 	return VB2_SUCCESS;
 }
 
-int vb2api_fw_phase2(struct vb2_context *ctx)
+int vb2api_fw_phase1(struct vb2_context *ctx)
+{
+	int rv;
+
+	/* Initialize the context first, so there's somewhere to record times */
+	vb2_init_context(ctx);
+
+	vb2_record_timestamp(ctx, VB2_TS_FW_PHASE1_ENTER);
+	rv = fw_phase1(ctx);
+	vb2_record_timestamp(ctx, VB2_TS_FW_PHASE1_EXIT);
+	return rv;
+}
+
+static int fw_phase2(struct vb2_context *ctx)
 {
 	int rv;
 
@@ -101,6 +114,16 @@ int vb2api_fw_phase2(struct vb2_context *ctx)
 	return VB2_SUCCESS;
 }
 
+int vb2api_fw_phase2(struct vb2_context *ctx)
+{
+	int rv;
+
+	vb2_record_timestamp(ctx, VB2_TS_FW_PHASE2_ENTER);
+	rv = fw_phase2(ctx);
+	vb2_record_timestamp(ctx, VB2_TS_FW_PHASE2_EXIT);
+	return rv;
+}
+
 int vb2api_extend_hash(struct vb2_context *ctx,
 		       const void *buf,
 		       uint32_t size)
@@ -125,6 +148,73 @@ int vb2api_extend_hash(struct vb2_context *ctx,
 		return vb2_digest_extend(dc, buf, size);
 }
 
+int vb2api_hash_regions(struct vb2_context *ctx,
+			const struct vb2_region *regions,
+			uint32_t count)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	struct vb2_digest_context *dc = (struct vb2_digest_context *)
+		(ctx->workbuf + sd->workbuf_hash_offset);
+	struct vb2_workbuf wb;
+	uint32_t total = 0;
+	uint32_t buf_size;
+	uint8_t *buf;
+	uint32_t i;
+	int rv;
+
+	/* Must have initialized hash digest work area */
+	if (!sd->workbuf_hash_size)
+		return VB2_ERROR_API_HASH_REGIONS_WORKBUF;
+
+	/* Check the whole list up front, so nothing is hashed if it's bad */
+	for (i = 0; i < count; i++) {
+		if (!regions[i].size ||
+		    regions[i].size > sd->hash_remaining_size - total)
+			return VB2_ERROR_API_HASH_REGIONS_SIZE;
+		total += regions[i].size;
+	}
+
+	if (dc->using_hwcrypto) {
+		rv = vb2ex_hwcrypto_digest_region(ctx, regions, count);
+		if (!rv) {
+			sd->hash_remaining_size -= total;
+			return VB2_SUCCESS;
+		}
+		if (rv != VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED)
+			return rv;
+	}
+
+	/* Read into whatever work buffer is free, and hash from there */
+	vb2_workbuf_from_ctx(ctx, &wb);
+	buf_size = wb.size & ~(VB2_WORKBUF_ALIGN - 1);
+	buf = vb2_workbuf_alloc(&wb, buf_size);
+	if (!buf || !buf_size)
+		return VB2_ERROR_API_HASH_REGIONS_BUF;
+
+	for (i = 0; i < count; i++) {
+		uint32_t offset = regions[i].offset;
+		uint32_t left = regions[i].size;
+
+		while (left) {
+			uint32_t size = left < buf_size ? left : buf_size;
+
+			rv = vb2ex_read_resource(ctx, VB2_RES_FW_BODY,
+						 offset, buf, size);
+			if (rv)
+				return rv;
+
+			rv = vb2api_extend_hash(ctx, buf, size);
+			if (rv)
+				return rv;
+
+			offset += size;
+			left -= size;
+		}
+	}
+
+	return VB2_SUCCESS;
+}
+
 int vb2api_get_pcr_digest(struct vb2_context *ctx,
 			  enum vb2_pcr_digest which_digest,
 			  uint8_t *dest,
@@ -154,3 +244,37 @@ int vb2api_get_pcr_digest(struct vb2_context *ctx,
 
 	return VB2_SUCCESS;
 }
+
+int vb2api_get_body_digest(struct vb2_context *ctx,
+			   enum vb2_hash_algorithm *hash_alg,
+			   uint8_t *dest,
+			   uint32_t *dest_size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	uint32_t digest_size;
+
+	if (sd->body_hash_alg == VB2_HASH_INVALID)
+		return VB2_ERROR_API_BODY_DIGEST;
+
+	digest_size = vb2_digest_size(sd->body_hash_alg);
+	if (*dest_size < digest_size)
+		return VB2_ERROR_API_BODY_DIGEST_BUF;
+
+	memcpy(dest, sd->body_digest, digest_size);
+	*dest_size = digest_size;
+	*hash_alg = sd->body_hash_alg;
+
+	return VB2_SUCCESS;
+}
+
+int vb2api_get_body_compression(struct vb2_context *ctx, int *compressed)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+
+	/* Only a verified body is worth decompressing */
+	if (sd->body_hash_alg == VB2_HASH_INVALID)
+		return VB2_ERROR_API_BODY_COMPRESSION;
+
+	*compressed = !!(sd->flags & VB2_SD_FLAG_BODY_COMPRESSED);
+	return VB2_SUCCESS;
+}
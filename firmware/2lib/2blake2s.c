@@ -0,0 +1,153 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * BLAKE2s-256 (RFC 7693), unkeyed.  Only the parameters vboot needs are
+ * supported: a 32-byte digest, no key, salt or personalization, and
+ * sequential (not tree) hashing.
+ */
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
+
+static const uint32_t blake2s_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint8_t blake2s_sigma[10][16] = {
+	{  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+	{ 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+	{ 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+	{  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+	{  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+	{  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+	{ 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+	{ 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+	{  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+	{ 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define G(a, b, c, d, x, y)				\
+	do {						\
+		a = a + b + (x);			\
+		d = ROTR32(d ^ a, 16);			\
+		c = c + d;				\
+		b = ROTR32(b ^ c, 12);			\
+		a = a + b + (y);			\
+		d = ROTR32(d ^ a, 8);			\
+		c = c + d;				\
+		b = ROTR32(b ^ c, 7);			\
+	} while (0)
+
+static uint32_t load32_le(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+		((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Mix one 64-byte block into the state; [last] is set for the final block */
+static void blake2s_compress(struct vb2_blake2s_context *ctx,
+			     const uint8_t *block, int last)
+{
+	uint32_t m[16], v[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		m[i] = load32_le(block + 4 * i);
+
+	for (i = 0; i < 8; i++) {
+		v[i] = ctx->h[i];
+		v[i + 8] = blake2s_iv[i];
+	}
+	v[12] ^= (uint32_t)ctx->total_size;
+	v[13] ^= (uint32_t)(ctx->total_size >> 32);
+	if (last)
+		v[14] = ~v[14];
+
+	for (i = 0; i < 10; i++) {
+		const uint8_t *s = blake2s_sigma[i];
+
+		G(v[0], v[4], v[ 8], v[12], m[s[ 0]], m[s[ 1]]);
+		G(v[1], v[5], v[ 9], v[13], m[s[ 2]], m[s[ 3]]);
+		G(v[2], v[6], v[10], v[14], m[s[ 4]], m[s[ 5]]);
+		G(v[3], v[7], v[11], v[15], m[s[ 6]], m[s[ 7]]);
+		G(v[0], v[5], v[10], v[15], m[s[ 8]], m[s[ 9]]);
+		G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+		G(v[2], v[7], v[ 8], v[13], m[s[12]], m[s[13]]);
+		G(v[3], v[4], v[ 9], v[14], m[s[14]], m[s[15]]);
+	}
+
+	for (i = 0; i < 8; i++)
+		ctx->h[i] ^= v[i] ^ v[i + 8];
+}
+
+void vb2_blake2s_init(struct vb2_blake2s_context *ctx)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		ctx->h[i] = blake2s_iv[i];
+
+	/* Parameter block: digest length, no key, fanout 1, depth 1 */
+	ctx->h[0] ^= 0x01010000 | VB2_BLAKE2S_DIGEST_SIZE;
+
+	ctx->total_size = 0;
+	ctx->size = 0;
+}
+
+void vb2_blake2s_update(struct vb2_blake2s_context *ctx,
+			const uint8_t *data,
+			uint32_t size)
+{
+	uint32_t n;
+
+	/*
+	 * The last block gets different treatment in blake2s_compress(), so
+	 * a full block is only compressed once there's more data after it.
+	 */
+	while (size) {
+		if (ctx->size == VB2_BLAKE2S_BLOCK_SIZE) {
+			ctx->total_size += VB2_BLAKE2S_BLOCK_SIZE;
+			blake2s_compress(ctx, ctx->block, 0);
+			ctx->size = 0;
+		}
+
+		/* Whole blocks which aren't the last go straight from data */
+		if (!ctx->size) {
+			while (size > VB2_BLAKE2S_BLOCK_SIZE) {
+				ctx->total_size += VB2_BLAKE2S_BLOCK_SIZE;
+				blake2s_compress(ctx, data, 0);
+				data += VB2_BLAKE2S_BLOCK_SIZE;
+				size -= VB2_BLAKE2S_BLOCK_SIZE;
+			}
+		}
+
+		n = VB2_BLAKE2S_BLOCK_SIZE - ctx->size;
+		if (n > size)
+			n = size;
+		memcpy(ctx->block + ctx->size, data, n);
+		ctx->size += n;
+		data += n;
+		size -= n;
+	}
+}
+
+void vb2_blake2s_finalize(struct vb2_blake2s_context *ctx, uint8_t *digest)
+{
+	int i;
+
+	ctx->total_size += ctx->size;
+	memset(ctx->block + ctx->size, 0, VB2_BLAKE2S_BLOCK_SIZE - ctx->size);
+	blake2s_compress(ctx, ctx->block, 1);
+
+	for (i = 0; i < 8; i++) {
+		digest[4 * i] = (uint8_t)ctx->h[i];
+		digest[4 * i + 1] = (uint8_t)(ctx->h[i] >> 8);
+		digest[4 * i + 2] = (uint8_t)(ctx->h[i] >> 16);
+		digest[4 * i + 3] = (uint8_t)(ctx->h[i] >> 24);
+	}
+}
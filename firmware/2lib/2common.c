@@ -11,15 +11,38 @@
 #include "2rsa.h"
 #include "2sha.h"
 
+/* Machine words, which may alias the bytes they're compared as */
+typedef uintptr_t __attribute__((__may_alias__)) vb2_word_t;
+#define VB2_WORD_OFFSET(p) ((uintptr_t)(p) & (sizeof(vb2_word_t) - 1))
+
 int vb2_safe_memcmp(const void *s1, const void *s2, size_t size)
 {
 	const unsigned char *us1 = s1;
 	const unsigned char *us2 = s2;
+	vb2_word_t word_result = 0;
 	int result = 0;
 
 	if (0 == size)
 		return 0;
 
+	/*
+	 * Compare a word at a time if the buffers line up.  This only
+	 * branches on their addresses and size, never on their contents.
+	 */
+	if (VB2_WORD_OFFSET(us1) == VB2_WORD_OFFSET(us2)) {
+		while (size && VB2_WORD_OFFSET(us1)) {
+			result |= *us1++ ^ *us2++;
+			size--;
+		}
+		while (size >= sizeof(vb2_word_t)) {
+			word_result |= *(const vb2_word_t *)us1 ^
+				*(const vb2_word_t *)us2;
+			us1 += sizeof(vb2_word_t);
+			us2 += sizeof(vb2_word_t);
+			size -= sizeof(vb2_word_t);
+		}
+	}
+
 	/*
 	 * Code snippet without data-dependent branch due to Nate Lawson
 	 * (nate@root.org) of Root Labs.
@@ -27,7 +50,7 @@ int vb2_safe_memcmp(const void *s1, const void *s2, size_t size)
 	while (size--)
 		result |= *us1++ ^ *us2++;
 
-	return result != 0;
+	return (result | (word_result != 0)) != 0;
 }
 
 int vb2_align(uint8_t **ptr, uint32_t *size, uint32_t align, uint32_t want_size)
@@ -51,6 +74,47 @@ int vb2_align(uint8_t **ptr, uint32_t *size, uint32_t align, uint32_t want_size)
 	return VB2_SUCCESS;
 }
 
+#ifdef VB2_WORKBUF_STATS
+/* Highest address handed out by vb2_workbuf_alloc() since the last reset */
+static uintptr_t workbuf_high;
+
+void vb2_workbuf_stats_reset(void)
+{
+	workbuf_high = 0;
+}
+
+uint32_t vb2_workbuf_stats_peak(const void *buf)
+{
+	if (workbuf_high <= (uintptr_t)buf)
+		return 0;
+
+	return workbuf_high - (uintptr_t)buf;
+}
+#endif
+
+#ifdef VB2_CRYPTO_STATS
+struct vb2_crypto_stats vb2_crypto_stats;
+#endif
+
+void vb2_crypto_stats_flush(struct vb2_crypto_stats *dest)
+{
+#ifdef VB2_CRYPTO_STATS
+	struct vb2_crypto_stats *s = &vb2_crypto_stats;
+	int i;
+
+	for (i = 0; i < VB2_CRYPTO_STATS_HASH_ALGS; i++)
+		dest->hash_bytes[i] += s->hash_bytes[i];
+	for (i = 0; i < VB2_CRYPTO_STATS_RSA_SIZES; i++)
+		dest->rsa_verifies[i] += s->rsa_verifies[i];
+	dest->crc32_bytes += s->crc32_bytes;
+	dest->decompress_calls += s->decompress_calls;
+	dest->decompress_in_bytes += s->decompress_in_bytes;
+	dest->decompress_out_bytes += s->decompress_out_bytes;
+
+	memset(s, 0, sizeof(*s));
+#endif
+}
+
 void vb2_workbuf_init(struct vb2_workbuf *wb, uint8_t *buf, uint32_t size)
 {
 	wb->buf = buf;
@@ -85,6 +149,11 @@ void *vb2_workbuf_alloc(struct vb2_workbuf *wb, uint32_t size)
 	wb->buf += size;
 	wb->size -= size;
 
+#ifdef VB2_WORKBUF_STATS
+	if ((uintptr_t)wb->buf > workbuf_high)
+		workbuf_high = (uintptr_t)wb->buf;
+#endif
+
 	return ptr;
 }
 
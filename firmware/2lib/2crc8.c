@@ -10,20 +10,20 @@ uint8_t vb2_crc8(const void *vptr, uint32_t size)
 {
 	const uint8_t *data = vptr;
 	unsigned crc = 0;
-	uint32_t i, j;
+	unsigned t;
 
 	/*
-	 * Calculate CRC-8 directly.  A table-based algorithm would be faster,
-	 * but for only a few bytes it isn't worth the code size.
+	 * Calculate CRC-8 a byte at a time without a table.  For the
+	 * polynomial x^8 + x^2 + x + 1, shifting a byte x through the CRC
+	 * gives x * (x^2 + x + 1) mod P.  The product is at most 10 bits, and
+	 * folding bits 8-9 back in the same way can't overflow again.
 	 */
-	for (j = size; j; j--, data++) {
-		crc ^= (*data << 8);
-		for(i = 8; i; i--) {
-			if (crc & 0x8000)
-				crc ^= (0x1070 << 3);
-			crc <<= 1;
-		}
+	for (; size; size--, data++) {
+		t = crc ^ *data;
+		t ^= (t << 1) ^ (t << 2);
+		t ^= (t >> 8) ^ ((t >> 8) << 1) ^ ((t >> 8) << 2);
+		crc = t & 0xff;
 	}
 
-	return (uint8_t)(crc >> 8);
+	return (uint8_t)crc;
 }
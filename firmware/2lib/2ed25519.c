@@ -0,0 +1,502 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Ed25519 signature verification (RFC 8032).  The field and group arithmetic
+ * follows TweetNaCl (public domain), which is small and portable rather than
+ * fast; that's plenty for the few signatures checked in a boot.
+ */
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2ed25519.h"
+#include "2ed25519_private.h"
+#include "2sha.h"
+
+/* Elements of the field mod 2^255 - 19, as 16 signed limbs of 16 bits */
+typedef int64_t gf[16];
+
+static const gf gf0;
+static const gf gf1 = {1};
+
+/* Curve constant d = -121665 / 121666, and 2 * d */
+static const gf ed_d = {
+	0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141, 0x0a4d, 0x0070,
+	0xe898, 0x7779, 0x4079, 0x8cc7, 0xfe73, 0x2b6f, 0x6cee, 0x5203
+};
+static const gf ed_d2 = {
+	0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0,
+	0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406
+};
+
+/* Square root of -1 */
+static const gf sqrtm1 = {
+	0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43,
+	0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83
+};
+
+/* Base point B */
+static const gf base_x = {
+	0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c,
+	0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169
+};
+static const gf base_y = {
+	0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666,
+	0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666
+};
+
+/* Order of the group, little endian */
+static const int64_t ed_l[32] = {
+	0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58,
+	0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0x10
+};
+
+static void set25519(gf r, const gf a)
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+		r[i] = a[i];
+}
+
+/* Carry each limb into the next, so limbs 1-15 end up in 0-0xffff */
+static void car25519(gf o)
+{
+	int64_t c;
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		c = o[i] >> 16;
+		o[i] &= 0xffff;
+		if (i < 15)
+			o[i + 1] += c;
+		else
+			o[0] += 38 * c;	/* 2^256 = 38 mod p */
+	}
+}
+
+/* Swap p and q if b is 1, without branching on b */
+static void sel25519(gf p, gf q, int b)
+{
+	int64_t t, c = ~((int64_t)b - 1);
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		t = c & (p[i] ^ q[i]);
+		p[i] ^= t;
+		q[i] ^= t;
+	}
+}
+
+/* Encode n in its canonical 32-byte little endian form */
+static void pack25519(uint8_t *o, const gf n)
+{
+	gf m, t;
+	int i, j, b;
+
+	set25519(t, n);
+	car25519(t);
+	car25519(t);
+	car25519(t);
+
+	/* Subtract p while that doesn't go negative */
+	for (j = 0; j < 2; j++) {
+		m[0] = t[0] - 0xffed;
+		for (i = 1; i < 15; i++) {
+			m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+			m[i - 1] &= 0xffff;
+		}
+		m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+		b = (m[15] >> 16) & 1;
+		m[14] &= 0xffff;
+		sel25519(t, m, 1 - b);
+	}
+
+	for (i = 0; i < 16; i++) {
+		o[2 * i] = t[i] & 0xff;
+		o[2 * i + 1] = t[i] >> 8;
+	}
+}
+
+static int neq25519(const gf a, const gf b)
+{
+	uint8_t c[32], d[32];
+
+	pack25519(c, a);
+	pack25519(d, b);
+	return vb2_safe_memcmp(c, d, 32);
+}
+
+/* Low bit of the canonical form, which is the "sign" of x in encodings */
+static int par25519(const gf a)
+{
+	uint8_t d[32];
+
+	pack25519(d, a);
+	return d[0] & 1;
+}
+
+static void unpack25519(gf o, const uint8_t *n)
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+		o[i] = n[2 * i] + ((int64_t)n[2 * i + 1] << 8);
+	o[15] &= 0x7fff;
+}
+
+static void fadd(gf o, const gf a, const gf b)
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+		o[i] = a[i] + b[i];
+}
+
+static void fsub(gf o, const gf a, const gf b)
+{
+	int i;
+
+	for (i = 0; i < 16; i++)
+		o[i] = a[i] - b[i];
+}
+
+static void fmul(gf o, const gf a, const gf b)
+{
+	int64_t t[31];
+	int i, j;
+
+	for (i = 0; i < 31; i++)
+		t[i] = 0;
+	for (i = 0; i < 16; i++)
+		for (j = 0; j < 16; j++)
+			t[i + j] += a[i] * b[j];
+	for (i = 0; i < 15; i++)
+		t[i] += 38 * t[i + 16];
+	for (i = 0; i < 16; i++)
+		o[i] = t[i];
+	car25519(o);
+	car25519(o);
+}
+
+static void fsq(gf o, const gf a)
+{
+	fmul(o, a, a);
+}
+
+/* o = i^(p - 2) = 1 / i */
+static void inv25519(gf o, const gf i)
+{
+	gf c;
+	int a;
+
+	set25519(c, i);
+	for (a = 253; a >= 0; a--) {
+		fsq(c, c);
+		if (a != 2 && a != 4)
+			fmul(c, c, i);
+	}
+	set25519(o, c);
+}
+
+/* o = i^((p - 5) / 8), for square roots */
+static void pow2523(gf o, const gf i)
+{
+	gf c;
+	int a;
+
+	set25519(c, i);
+	for (a = 250; a >= 0; a--) {
+		fsq(c, c);
+		if (a != 1)
+			fmul(c, c, i);
+	}
+	set25519(o, c);
+}
+
+/*
+ * Points are in extended coordinates (X, Y, Z, T), with x = X/Z, y = Y/Z and
+ * xy = T/Z.
+ */
+
+/* p += q.  The formula holds for doubling too, so q may be p. */
+static void point_add(gf p[4], gf q[4])
+{
+	gf a, b, c, d, t, e, f, g, h;
+
+	fsub(a, p[1], p[0]);
+	fsub(t, q[1], q[0]);
+	fmul(a, a, t);
+	fadd(b, p[0], p[1]);
+	fadd(t, q[0], q[1]);
+	fmul(b, b, t);
+	fmul(c, p[3], q[3]);
+	fmul(c, c, ed_d2);
+	fmul(d, p[2], q[2]);
+	fadd(d, d, d);
+	fsub(e, b, a);
+	fsub(f, d, c);
+	fadd(g, d, c);
+	fadd(h, b, a);
+
+	fmul(p[0], e, f);
+	fmul(p[1], h, g);
+	fmul(p[2], g, f);
+	fmul(p[3], e, h);
+}
+
+static void point_copy(gf p[4], gf q[4])
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		set25519(p[i], q[i]);
+}
+
+/* Swap p and q if b is 1, without branching on b */
+static void point_swap(gf p[4], gf q[4], int b)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		sel25519(p[i], q[i], b);
+}
+
+static void point_set_zero(gf p[4])
+{
+	set25519(p[0], gf0);
+	set25519(p[1], gf1);
+	set25519(p[2], gf1);
+	set25519(p[3], gf0);
+}
+
+static void point_set_base(gf p[4])
+{
+	set25519(p[0], base_x);
+	set25519(p[1], base_y);
+	set25519(p[2], gf1);
+	fmul(p[3], base_x, base_y);
+}
+
+static void point_pack(uint8_t *r, gf p[4])
+{
+	gf tx, ty, zi;
+
+	inv25519(zi, p[2]);
+	fmul(tx, p[0], zi);
+	fmul(ty, p[1], zi);
+	pack25519(r, ty);
+	r[31] ^= par25519(tx) << 7;
+}
+
+/*
+ * Decode a point, negated.  Returns 0 if success, non-zero if [s] isn't the
+ * canonical encoding of a point on the curve.
+ */
+static int point_unpack_neg(gf r[4], const uint8_t *s)
+{
+	gf t, chk, num, den, den2, den4, den6;
+	uint8_t check[32];
+
+	set25519(r[2], gf1);
+	unpack25519(r[1], s);
+
+	/* y must be less than p */
+	pack25519(check, r[1]);
+	if (memcmp(check, s, 31) || check[31] != (s[31] & 0x7f))
+		return 1;
+
+	/* x^2 = (y^2 - 1) / (d y^2 + 1) */
+	fsq(num, r[1]);
+	fmul(den, num, ed_d);
+	fsub(num, num, r[2]);
+	fadd(den, r[2], den);
+
+	/* x = num * den^3 * (num * den^7)^((p - 5) / 8) */
+	fsq(den2, den);
+	fsq(den4, den2);
+	fmul(den6, den4, den2);
+	fmul(t, den6, num);
+	fmul(t, t, den);
+	pow2523(t, t);
+	fmul(t, t, num);
+	fmul(t, t, den);
+	fmul(t, t, den);
+	fmul(r[0], t, den);
+
+	/* That's the square root, or the square root of minus it */
+	fsq(chk, r[0]);
+	fmul(chk, chk, den);
+	if (neq25519(chk, num))
+		fmul(r[0], r[0], sqrtm1);
+	fsq(chk, r[0]);
+	fmul(chk, chk, den);
+	if (neq25519(chk, num))
+		return 1;
+
+	/* Pick the root with the other sign, which negates the point */
+	if (par25519(r[0]) == (s[31] >> 7))
+		fsub(r[0], gf0, r[0]);
+
+	fmul(r[3], r[0], r[1]);
+	return 0;
+}
+
+/* Reduce x mod L into r; x[] is clobbered */
+static void mod_l(uint8_t *r, int64_t x[64])
+{
+	int64_t carry;
+	int i, j;
+
+	for (i = 63; i >= 32; i--) {
+		carry = 0;
+		for (j = i - 32; j < i - 12; j++) {
+			x[j] += carry - 16 * x[i] * ed_l[j - (i - 32)];
+			carry = (x[j] + 128) >> 8;
+			x[j] -= carry * 256;
+		}
+		x[j] += carry;
+		x[i] = 0;
+	}
+
+	carry = 0;
+	for (j = 0; j < 32; j++) {
+		x[j] += carry - (x[31] >> 4) * ed_l[j];
+		carry = x[j] >> 8;
+		x[j] &= 255;
+	}
+	for (j = 0; j < 32; j++)
+		x[j] -= carry * ed_l[j];
+	for (i = 0; i < 32; i++) {
+		x[i + 1] += x[i] >> 8;
+		r[i] = x[i] & 255;
+	}
+}
+
+void vb2_ed25519_reduce(uint8_t *out, const uint8_t *in)
+{
+	int64_t x[64];
+	int i;
+
+	for (i = 0; i < 64; i++)
+		x[i] = in[i];
+	mod_l(out, x);
+}
+
+void vb2_ed25519_muladd(uint8_t *out, const uint8_t *a, const uint8_t *b,
+			const uint8_t *c)
+{
+	int64_t x[64];
+	int i, j;
+
+	for (i = 0; i < 64; i++)
+		x[i] = i < 32 ? c[i] : 0;
+	for (i = 0; i < 32; i++)
+		for (j = 0; j < 32; j++)
+			x[i + j] += (int64_t)a[i] * b[j];
+	mod_l(out, x);
+}
+
+void vb2_ed25519_scalarmult_base(uint8_t *out, const uint8_t *scalar)
+{
+	gf p[4], q[4];
+	int i, b;
+
+	/* Montgomery ladder, since the scalar is secret when signing */
+	point_set_zero(p);
+	point_set_base(q);
+	for (i = 255; i >= 0; i--) {
+		b = (scalar[i / 8] >> (i & 7)) & 1;
+		point_swap(p, q, b);
+		point_add(q, p);
+		point_add(p, p);
+		point_swap(p, q, b);
+	}
+
+	point_pack(out, p);
+}
+
+/* Return 1 if the little endian scalar s is less than L */
+static int scalar_is_canonical(const uint8_t *s)
+{
+	int i;
+
+	for (i = 31; i >= 0; i--) {
+		if (s[i] < ed_l[i])
+			return 1;
+		if (s[i] > ed_l[i])
+			return 0;
+	}
+	return 0;
+}
+
+/* Work buffer layout for vb2_ed25519_verify() */
+struct ed25519_verify_work {
+	gf a[4];	/* -A, the negated public key */
+	gf b[4];	/* Base point */
+	gf ab[4];	/* -A + B */
+	gf r[4];	/* Result */
+	struct vb2_sha512_context sha;
+};
+
+int vb2_ed25519_verify(const uint8_t *public_key,
+		       const uint8_t *sig,
+		       const uint8_t *msg,
+		       uint32_t size,
+		       const struct vb2_workbuf *wb)
+{
+	struct vb2_workbuf wblocal = *wb;
+	struct ed25519_verify_work *w;
+	uint8_t h[VB2_SHA512_DIGEST_SIZE];
+	uint8_t check[32];
+	int i, hb, sb;
+
+	w = vb2_workbuf_alloc(&wblocal, sizeof(*w));
+	if (!w)
+		return VB2_ERROR_ED25519_WORKBUF;
+
+	/* S >= L would let the same signature be written several ways */
+	if (!scalar_is_canonical(sig + 32))
+		return VB2_ERROR_ED25519_SIG;
+
+	if (point_unpack_neg(w->a, public_key))
+		return VB2_ERROR_ED25519_KEY;
+
+	/* h = SHA-512(R || A || message) mod L */
+	vb2_sha512_init(&w->sha);
+	vb2_sha512_update(&w->sha, sig, 32);
+	vb2_sha512_update(&w->sha, public_key, VB2_ED25519_PUBLIC_KEY_SIZE);
+	vb2_sha512_update(&w->sha, msg, size);
+	vb2_sha512_finalize(&w->sha, h);
+	vb2_ed25519_reduce(h, h);
+
+	/*
+	 * Compute [S]B - [h]A a bit at a time from the top, adding both
+	 * points in one go when both bits are set.  Everything here is
+	 * public, so this needn't be constant time.
+	 */
+	point_set_base(w->b);
+	point_copy(w->ab, w->a);
+	point_add(w->ab, w->b);
+	point_set_zero(w->r);
+	for (i = 255; i >= 0; i--) {
+		hb = (h[i / 8] >> (i & 7)) & 1;
+		sb = (sig[32 + i / 8] >> (i & 7)) & 1;
+		point_add(w->r, w->r);
+		if (hb && sb)
+			point_add(w->r, w->ab);
+		else if (hb)
+			point_add(w->r, w->a);
+		else if (sb)
+			point_add(w->r, w->b);
+	}
+
+	/* That's R if the signature is good */
+	point_pack(check, w->r);
+	if (vb2_safe_memcmp(check, sig, 32))
+		return VB2_ERROR_ED25519_VERIFY;
+
+	return VB2_SUCCESS;
+}
@@ -31,6 +31,56 @@ void vb2_workbuf_from_ctx(struct vb2_context *ctx, struct vb2_workbuf *wb)
 			 ctx->workbuf_size - ctx->workbuf_used);
 }
 
+void vb2_read_vblock_prefix(struct vb2_context *ctx, struct vb2_workbuf *wb)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	uint32_t size = ctx->vblock_prefix_size;
+	uint8_t *buf;
+
+	sd->workbuf_vblock_prefix_size = 0;
+
+	if (!size)
+		return;
+
+	buf = vb2_workbuf_alloc(wb, size);
+	if (!buf)
+		return;
+
+	/* If this fails, the callers will read what they need as usual */
+	if (vb2ex_read_resource(ctx, VB2_RES_FW_VBLOCK, 0, buf, size)) {
+		vb2_workbuf_free(wb, size);
+		return;
+	}
+
+	sd->workbuf_vblock_prefix_offset = vb2_offset_of(ctx->workbuf, buf);
+	sd->workbuf_vblock_prefix_size = size;
+}
+
+void *vb2_vblock_prefix(struct vb2_context *ctx,
+			uint32_t offset,
+			uint32_t size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+
+	if (offset > sd->workbuf_vblock_prefix_size ||
+	    size > sd->workbuf_vblock_prefix_size - offset)
+		return NULL;
+
+	return ctx->workbuf + sd->workbuf_vblock_prefix_offset + offset;
+}
+
+void vb2_free_vblock_prefix(struct vb2_context *ctx)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+
+	if (!sd->workbuf_vblock_prefix_size)
+		return;
+
+	sd->workbuf_vblock_prefix_size = 0;
+	ctx->workbuf_used = sd->workbuf_data_key_offset +
+		sd->workbuf_data_key_size;
+}
+
 int vb2_read_gbb_header(struct vb2_context *ctx, struct vb2_gbb_header *gbb)
 {
 	int rv;
@@ -136,6 +186,22 @@ int vb2_init_context(struct vb2_context *ctx)
 	return VB2_SUCCESS;
 }
 
+void vb2_record_timestamp(struct vb2_context *ctx, enum vb2_timestamp_id id)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	struct vb2_timestamp *ts;
+
+	if (ctx->workbuf_used < sizeof(*sd))
+		return;
+
+	ts = sd->timestamps +
+		(sd->timestamp_count++ & (VB2_MAX_TIMESTAMPS - 1));
+	ts->time = vb2ex_get_timer();
+	ts->id = id;
+
+	vb2_crypto_stats_flush(&sd->crypto_stats);
+}
+
 void vb2_check_recovery(struct vb2_context *ctx)
 {
 	struct vb2_shared_data *sd = vb2_get_sd(ctx);
@@ -18,6 +18,30 @@ static void vb2_nv_regen_crc(struct vb2_context *ctx)
 	ctx->flags |= VB2_CONTEXT_NVDATA_CHANGED;
 }
 
+/**
+ * Remember what the caller has stored, before the first change to it.
+ *
+ * If the changed flag is clear, nvdata[] is what the caller has stored.
+ */
+static void vb2_nv_save_stored(struct vb2_context *ctx)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+
+	if (!(ctx->flags & VB2_CONTEXT_NVDATA_CHANGED))
+		memcpy(sd->nvdata_stored, ctx->nvdata, VB2_NVDATA_SIZE);
+}
+
+/**
+ * Clear the changed flag if nvdata[] is back to what the caller has stored.
+ */
+static void vb2_nv_check_stored(struct vb2_context *ctx)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+
+	if (!memcmp(sd->nvdata_stored, ctx->nvdata, VB2_NVDATA_SIZE))
+		ctx->flags &= ~VB2_CONTEXT_NVDATA_CHANGED;
+}
+
 /**
  * Check the CRC of the non-volatile storage context.
  *
@@ -69,237 +93,70 @@ void vb2_nv_init(struct vb2_context *ctx)
 	sd->status |= VB2_SD_STATUS_NV_INIT;
 }
 
-/* Macro for vb2_nv_get() single-bit settings to reduce duplicate code. */
-#define GETBIT(offs, mask) (p[offs] & mask ? 1 : 0)
-
-uint32_t vb2_nv_get(struct vb2_context *ctx, enum vb2_nv_param param)
+/* Where each param lives; params not in the table have size 0 */
+static const struct vb2_nv_field vb2_nv_fields[] = {
+	[VB2_NV_FIRMWARE_SETTINGS_RESET] =
+		VB2_NV_FIELD_FIRMWARE_SETTINGS_RESET,
+	[VB2_NV_KERNEL_SETTINGS_RESET] = VB2_NV_FIELD_KERNEL_SETTINGS_RESET,
+	[VB2_NV_DEBUG_RESET_MODE] = VB2_NV_FIELD_DEBUG_RESET_MODE,
+	[VB2_NV_TRY_NEXT] = VB2_NV_FIELD_TRY_NEXT,
+	[VB2_NV_TRY_COUNT] = VB2_NV_FIELD_TRY_COUNT,
+	[VB2_NV_RECOVERY_REQUEST] = VB2_NV_FIELD_RECOVERY_REQUEST,
+	[VB2_NV_LOCALIZATION_INDEX] = VB2_NV_FIELD_LOCALIZATION_INDEX,
+	[VB2_NV_KERNEL_FIELD] = VB2_NV_FIELD_KERNEL_FIELD,
+	[VB2_NV_DEV_BOOT_USB] = VB2_NV_FIELD_DEV_BOOT_USB,
+	[VB2_NV_DEV_BOOT_LEGACY] = VB2_NV_FIELD_DEV_BOOT_LEGACY,
+	[VB2_NV_DEV_BOOT_SIGNED_ONLY] = VB2_NV_FIELD_DEV_BOOT_SIGNED_ONLY,
+	[VB2_NV_DISABLE_DEV_REQUEST] = VB2_NV_FIELD_DISABLE_DEV_REQUEST,
+	[VB2_NV_OPROM_NEEDED] = VB2_NV_FIELD_OPROM_NEEDED,
+	[VB2_NV_CLEAR_TPM_OWNER_REQUEST] =
+		VB2_NV_FIELD_CLEAR_TPM_OWNER_REQUEST,
+	[VB2_NV_CLEAR_TPM_OWNER_DONE] = VB2_NV_FIELD_CLEAR_TPM_OWNER_DONE,
+	[VB2_NV_RECOVERY_SUBCODE] = VB2_NV_FIELD_RECOVERY_SUBCODE,
+	[VB2_NV_BACKUP_NVRAM_REQUEST] = VB2_NV_FIELD_BACKUP_NVRAM_REQUEST,
+	[VB2_NV_FW_TRIED] = VB2_NV_FIELD_FW_TRIED,
+	[VB2_NV_FW_RESULT] = VB2_NV_FIELD_FW_RESULT,
+	[VB2_NV_FW_PREV_TRIED] = VB2_NV_FIELD_FW_PREV_TRIED,
+	[VB2_NV_FW_PREV_RESULT] = VB2_NV_FIELD_FW_PREV_RESULT,
+};
+
+static const struct vb2_nv_field *vb2_nv_field(enum vb2_nv_param param)
 {
-	const uint8_t *p = ctx->nvdata;
-
-	/*
-	 * TODO: We could reduce the binary size for this code by #ifdef'ing
-	 * out the params not used by firmware verification.
-	 */
-	switch (param) {
-	case VB2_NV_FIRMWARE_SETTINGS_RESET:
-		return GETBIT(VB2_NV_OFFS_HEADER,
-			      VB2_NV_HEADER_FW_SETTINGS_RESET);
-
-	case VB2_NV_KERNEL_SETTINGS_RESET:
-		return GETBIT(VB2_NV_OFFS_HEADER,
-			      VB2_NV_HEADER_KERNEL_SETTINGS_RESET);
-
-	case VB2_NV_DEBUG_RESET_MODE:
-		return GETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_DEBUG_RESET);
-
-	case VB2_NV_TRY_NEXT:
-		return GETBIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_TRY_NEXT);
-
-	case VB2_NV_TRY_COUNT:
-		return p[VB2_NV_OFFS_BOOT] & VB2_NV_BOOT_TRY_COUNT_MASK;
-
-	case VB2_NV_FW_TRIED:
-		return GETBIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_TRIED);
-
-	case VB2_NV_FW_RESULT:
-		return p[VB2_NV_OFFS_BOOT2] & VB2_NV_BOOT2_RESULT_MASK;
-
-	case VB2_NV_FW_PREV_TRIED:
-		return GETBIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_PREV_TRIED);
-
-	case VB2_NV_FW_PREV_RESULT:
-		return (p[VB2_NV_OFFS_BOOT2] & VB2_NV_BOOT2_PREV_RESULT_MASK)
-			>> VB2_NV_BOOT2_PREV_RESULT_SHIFT;
-
-	case VB2_NV_RECOVERY_REQUEST:
-		return p[VB2_NV_OFFS_RECOVERY];
-
-	case VB2_NV_RECOVERY_SUBCODE:
-		return p[VB2_NV_OFFS_RECOVERY_SUBCODE];
-
-	case VB2_NV_LOCALIZATION_INDEX:
-		return p[VB2_NV_OFFS_LOCALIZATION];
-
-	case VB2_NV_KERNEL_FIELD:
-		return (p[VB2_NV_OFFS_KERNEL]
-			| (p[VB2_NV_OFFS_KERNEL + 1] << 8)
-			| (p[VB2_NV_OFFS_KERNEL + 2] << 16)
-			| (p[VB2_NV_OFFS_KERNEL + 3] << 24));
-
-	case VB2_NV_DEV_BOOT_USB:
-		return GETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_USB);
-
-	case VB2_NV_DEV_BOOT_LEGACY:
-		return GETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_LEGACY);
-
-	case VB2_NV_DEV_BOOT_SIGNED_ONLY:
-		return GETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_SIGNED_ONLY);
-
-	case VB2_NV_DISABLE_DEV_REQUEST:
-		return GETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_DISABLE_DEV);
-
-	case VB2_NV_OPROM_NEEDED:
-		return GETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_OPROM_NEEDED);
+	const struct vb2_nv_field *f;
 
-	case VB2_NV_BACKUP_NVRAM_REQUEST:
-		return GETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_BACKUP_NVRAM);
+	if ((unsigned)param >= ARRAY_SIZE(vb2_nv_fields))
+		return NULL;
 
-	case VB2_NV_CLEAR_TPM_OWNER_REQUEST:
-		return GETBIT(VB2_NV_OFFS_TPM, VB2_NV_TPM_CLEAR_OWNER_REQUEST);
-
-	case VB2_NV_CLEAR_TPM_OWNER_DONE:
-		return GETBIT(VB2_NV_OFFS_TPM, VB2_NV_TPM_CLEAR_OWNER_DONE);
-	}
-
-	/*
-	 * Put default return outside the switch() instead of in default:, so
-	 * that adding a new param will cause a compiler warning.
-	 */
-	return 0;
+	f = vb2_nv_fields + param;
+	return f->size ? f : NULL;
 }
 
-#undef GETBIT
+uint32_t vb2_nv_get(struct vb2_context *ctx, enum vb2_nv_param param)
+{
+	const struct vb2_nv_field *f = vb2_nv_field(param);
 
-/* Macro for vb2_nv_set() single-bit settings to reduce duplicate code. */
-#define SETBIT(offs, mask)					\
-	{ if (value) p[offs] |= mask; else p[offs] &= ~mask; }
+	return f ? vb2_nv_field_get(ctx->nvdata, f) : 0;
+}
 
 void vb2_nv_set(struct vb2_context *ctx,
 		enum vb2_nv_param param,
 		uint32_t value)
 {
-	uint8_t *p = ctx->nvdata;
+	const struct vb2_nv_field *f = vb2_nv_field(param);
 
-	/* If not changing the value, don't regenerate the CRC. */
-	if (vb2_nv_get(ctx, param) == value)
+	if (!f)
 		return;
 
-	/*
-	 * TODO: We could reduce the binary size for this code by #ifdef'ing
-	 * out the params not used by firmware verification.
-	 */
-	switch (param) {
-	case VB2_NV_FIRMWARE_SETTINGS_RESET:
-		SETBIT(VB2_NV_OFFS_HEADER, VB2_NV_HEADER_FW_SETTINGS_RESET);
-		break;
-
-	case VB2_NV_KERNEL_SETTINGS_RESET:
-		SETBIT(VB2_NV_OFFS_HEADER, VB2_NV_HEADER_KERNEL_SETTINGS_RESET);
-		break;
-
-	case VB2_NV_DEBUG_RESET_MODE:
-		SETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_DEBUG_RESET);
-		break;
-
-	case VB2_NV_TRY_NEXT:
-		SETBIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_TRY_NEXT);
-		break;
-
-	case VB2_NV_TRY_COUNT:
-		/* Clip to valid range. */
-		if (value > VB2_NV_BOOT_TRY_COUNT_MASK)
-			value = VB2_NV_BOOT_TRY_COUNT_MASK;
-
-		p[VB2_NV_OFFS_BOOT] &= ~VB2_NV_BOOT_TRY_COUNT_MASK;
-		p[VB2_NV_OFFS_BOOT] |= (uint8_t)value;
-		break;
-
-	case VB2_NV_FW_TRIED:
-		SETBIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_TRIED);
-		break;
-
-	case VB2_NV_FW_RESULT:
-		/* Map out of range values to unknown */
-		if (value > VB2_NV_BOOT2_RESULT_MASK)
-			value = VB2_FW_RESULT_UNKNOWN;
-
-		p[VB2_NV_OFFS_BOOT2] &= ~VB2_NV_BOOT2_RESULT_MASK;
-		p[VB2_NV_OFFS_BOOT2] |= (uint8_t)value;
-		break;
-
-	case VB2_NV_FW_PREV_TRIED:
-		SETBIT(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_PREV_TRIED);
-		break;
-
-	case VB2_NV_FW_PREV_RESULT:
-		/* Map out of range values to unknown */
-		if (value > VB2_NV_BOOT2_RESULT_MASK)
-			value = VB2_FW_RESULT_UNKNOWN;
-
-		p[VB2_NV_OFFS_BOOT2] &= ~VB2_NV_BOOT2_PREV_RESULT_MASK;
-		p[VB2_NV_OFFS_BOOT2] |=
-			(uint8_t)(value << VB2_NV_BOOT2_PREV_RESULT_SHIFT);
-		break;
-
-	case VB2_NV_RECOVERY_REQUEST:
-		/*
-		 * Map values outside the valid range to the legacy reason,
-		 * since we can't determine if we're called from kernel or user
-		 * mode.
-		 */
-		if (value > 0xff)
-			value = VB2_RECOVERY_LEGACY;
-		p[VB2_NV_OFFS_RECOVERY] = (uint8_t)value;
-		break;
-
-	case VB2_NV_RECOVERY_SUBCODE:
-		p[VB2_NV_OFFS_RECOVERY_SUBCODE] = (uint8_t)value;
-		break;
-
-	case VB2_NV_LOCALIZATION_INDEX:
-		/* Map values outside the valid range to the default index. */
-		if (value > 0xFF)
-			value = 0;
-		p[VB2_NV_OFFS_LOCALIZATION] = (uint8_t)value;
-		break;
-
-	case VB2_NV_KERNEL_FIELD:
-		p[VB2_NV_OFFS_KERNEL] = (uint8_t)(value);
-		p[VB2_NV_OFFS_KERNEL + 1] = (uint8_t)(value >> 8);
-		p[VB2_NV_OFFS_KERNEL + 2] = (uint8_t)(value >> 16);
-		p[VB2_NV_OFFS_KERNEL + 3] = (uint8_t)(value >> 24);
-		break;
-
-	case VB2_NV_DEV_BOOT_USB:
-		SETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_USB);
-		break;
-
-	case VB2_NV_DEV_BOOT_LEGACY:
-		SETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_LEGACY);
-		break;
-
-	case VB2_NV_DEV_BOOT_SIGNED_ONLY:
-		SETBIT(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_SIGNED_ONLY);
-		break;
-
-	case VB2_NV_DISABLE_DEV_REQUEST:
-		SETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_DISABLE_DEV);
-		break;
-
-	case VB2_NV_OPROM_NEEDED:
-		SETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_OPROM_NEEDED);
-		break;
-
-	case VB2_NV_BACKUP_NVRAM_REQUEST:
-		SETBIT(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_BACKUP_NVRAM);
-		break;
-
-	case VB2_NV_CLEAR_TPM_OWNER_REQUEST:
-		SETBIT(VB2_NV_OFFS_TPM, VB2_NV_TPM_CLEAR_OWNER_REQUEST);
-		break;
-
-	case VB2_NV_CLEAR_TPM_OWNER_DONE:
-		SETBIT(VB2_NV_OFFS_TPM, VB2_NV_TPM_CLEAR_OWNER_DONE);
-		break;
-	}
+	/* If not changing the value, don't regenerate the CRC. */
+	if (vb2_nv_field_get(ctx->nvdata, f) == value)
+		return;
 
-	/*
-	 * Note there is no default case.  This causes a compiler warning if
-	 * a new param is added to the enum without adding support here.
-	 */
+	vb2_nv_save_stored(ctx);
+	vb2_nv_field_set(ctx->nvdata, f, value);
 
 	/* Need to regenerate CRC, since the value changed. */
 	vb2_nv_regen_crc(ctx);
-}
 
-#undef SETBIT
+	/* But if it's changed back, there's nothing new to save. */
+	vb2_nv_check_stored(ctx);
+}
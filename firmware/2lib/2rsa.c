@@ -14,20 +14,131 @@
 #include "2rsa.h"
 #include "2sha.h"
 
+/*
+ * Limb size for the Montgomery arithmetic below.  Targets with a native
+ * 64x64->128 bit multiply use 64-bit limbs, which halves the number of inner
+ * loop iterations; everything else uses 32-bit limbs with a 64-bit
+ * accumulator.  Build with -DVB2_RSA_LIMB_BITS=32 or 64 to force one or the
+ * other.
+ *
+ * Either way, the public key keeps its 32-bit little endian n[] and rr[]
+ * arrays and 32-bit n0inv; 64-bit limbs are assembled from word pairs as they
+ * are needed.
+ */
+#ifndef VB2_RSA_LIMB_BITS
+#if defined(__SIZEOF_INT128__) && (defined(__x86_64__) || defined(__aarch64__))
+#define VB2_RSA_LIMB_BITS 64
+#else
+#define VB2_RSA_LIMB_BITS 32
+#endif
+#endif
+
+#if VB2_RSA_LIMB_BITS == 64
+typedef uint64_t vb2_limb_t;
+typedef unsigned __int128 vb2_dlimb_t;
+typedef __int128 vb2_sdlimb_t;
+#elif VB2_RSA_LIMB_BITS == 32
+typedef uint32_t vb2_limb_t;
+typedef uint64_t vb2_dlimb_t;
+typedef int64_t vb2_sdlimb_t;
+#else
+#error "VB2_RSA_LIMB_BITS must be 32 or 64"
+#endif
+
+/*
+ * Key sizes to specialize the Montgomery arithmetic for; see mont_ops_for().
+ * Build with -DVB2_RSA_FIXED_2048=1 and so on to turn them on.
+ */
+#ifndef VB2_RSA_FIXED_1024
+#define VB2_RSA_FIXED_1024 0
+#endif
+#ifndef VB2_RSA_FIXED_2048
+#define VB2_RSA_FIXED_2048 0
+#endif
+#ifndef VB2_RSA_FIXED_4096
+#define VB2_RSA_FIXED_4096 0
+#endif
+#ifndef VB2_RSA_FIXED_8192
+#define VB2_RSA_FIXED_8192 0
+#endif
+
+#define LIMB_BITS VB2_RSA_LIMB_BITS
+#define LIMB_BYTES (VB2_RSA_LIMB_BITS / 8)
+#define WORDS_PER_LIMB (VB2_RSA_LIMB_BITS / 32)
+
+/* Montgomery parameters for one key, in limbs */
+struct mont_ctx {
+	const struct vb2_public_key *key;
+	uint32_t len;		/* Length of the modulus in limbs */
+	vb2_limb_t n0inv;	/* -1 / n[0] mod 2^LIMB_BITS */
+};
+
 /**
- * a[] -= mod
+ * Return limb i of a little endian array of 32-bit words.
  */
-static void subM(const struct vb2_public_key *key, uint32_t *a)
+static inline vb2_limb_t get_limb(const uint32_t *words, uint32_t i)
 {
-	int64_t A = 0;
+#if VB2_RSA_LIMB_BITS == 64
+	return ((uint64_t)words[2 * i + 1] << 32) | words[2 * i];
+#else
+	return words[i];
+#endif
+}
+
+/**
+ * Initialize Montgomery parameters for a key.
+ *
+ * The key only stores -1 / n[0] mod 2^32.  For wider limbs, extend it with
+ * Newton's iteration: if x = 1 / n mod 2^k, then x * (2 - n * x) is
+ * 1 / n mod 2^2k.
+ */
+static void mont_init(struct mont_ctx *m, const struct vb2_public_key *key)
+{
+	m->key = key;
+	m->len = key->arrsize / WORDS_PER_LIMB;
+#if VB2_RSA_LIMB_BITS == 64
+	{
+		uint64_t n0 = get_limb(key->n, 0);
+		uint64_t x = (uint32_t)-key->n0inv;
+
+		x *= 2 - n0 * x;
+		m->n0inv = -x;
+	}
+#else
+	m->n0inv = key->n0inv;
+#endif
+}
+
+/*
+ * The Montgomery multiply below is written for a modulus [len] limbs long,
+ * and always inlined, so each caller which passes a constant gets its own
+ * copy with fixed loop bounds the compiler can unroll.
+ */
+#define MONT_INLINE static inline __attribute__((always_inline))
+
+/**
+ * a[] -= mod, for a modulus [len] limbs long
+ */
+MONT_INLINE void sub_mod_len(const struct mont_ctx *m, uint32_t len,
+			     vb2_limb_t *a)
+{
+	vb2_sdlimb_t A = 0;
 	uint32_t i;
-	for (i = 0; i < key->arrsize; ++i) {
-		A += (uint64_t)a[i] - key->n[i];
-		a[i] = (uint32_t)A;
-		A >>= 32;
+	for (i = 0; i < len; ++i) {
+		A += (vb2_dlimb_t)a[i] - get_limb(m->key->n, i);
+		a[i] = (vb2_limb_t)A;
+		A >>= LIMB_BITS;
 	}
 }
 
+/**
+ * a[] -= mod
+ */
+static void subM(const struct mont_ctx *m, vb2_limb_t *a)
+{
+	sub_mod_len(m, m->len, a);
+}
+
 /**
  * Return a[] >= mod
  */
@@ -44,115 +155,295 @@ int vb2_mont_ge(const struct vb2_public_key *key, uint32_t *a)
 	return 1;  /* equal */
 }
 
+/**
+ * Return a[] >= mod, for arrays of limbs
+ */
+static int mont_ge(const struct mont_ctx *m, const vb2_limb_t *a)
+{
+	uint32_t i;
+	for (i = m->len; i;) {
+		vb2_limb_t n;
+		--i;
+		n = get_limb(m->key->n, i);
+		if (a[i] < n)
+			return 0;
+		if (a[i] > n)
+			return 1;
+	}
+	return 1;  /* equal */
+}
+
 /**
  * Montgomery c[] += a * b[] / R % mod
  */
-static void montMulAdd(const struct vb2_public_key *key,
-                       uint32_t *c,
-                       const uint32_t a,
-                       const uint32_t *b)
+MONT_INLINE void montMulAdd(const struct mont_ctx *m,
+			    uint32_t len,
+			    vb2_limb_t *c,
+			    const vb2_limb_t a,
+			    const vb2_limb_t *b)
 {
-	uint64_t A = (uint64_t)a * b[0] + c[0];
-	uint32_t d0 = (uint32_t)A * key->n0inv;
-	uint64_t B = (uint64_t)d0 * key->n[0] + (uint32_t)A;
+	const uint32_t *n = m->key->n;
+	vb2_dlimb_t A = (vb2_dlimb_t)a * b[0] + c[0];
+	vb2_limb_t d0 = (vb2_limb_t)A * m->n0inv;
+	vb2_dlimb_t B = (vb2_dlimb_t)d0 * get_limb(n, 0) + (vb2_limb_t)A;
 	uint32_t i;
 
-	for (i = 1; i < key->arrsize; ++i) {
-		A = (A >> 32) + (uint64_t)a * b[i] + c[i];
-		B = (B >> 32) + (uint64_t)d0 * key->n[i] + (uint32_t)A;
-		c[i - 1] = (uint32_t)B;
+	for (i = 1; i < len; ++i) {
+		A = (A >> LIMB_BITS) + (vb2_dlimb_t)a * b[i] + c[i];
+		B = (B >> LIMB_BITS) + (vb2_dlimb_t)d0 * get_limb(n, i) +
+			(vb2_limb_t)A;
+		c[i - 1] = (vb2_limb_t)B;
 	}
 
-	A = (A >> 32) + (B >> 32);
+	A = (A >> LIMB_BITS) + (B >> LIMB_BITS);
 
-	c[i - 1] = (uint32_t)A;
+	c[i - 1] = (vb2_limb_t)A;
 
-	if (A >> 32) {
-		subM(key, c);
+	if (A >> LIMB_BITS) {
+		sub_mod_len(m, len, c);
 	}
 }
 
 /**
  * Montgomery c[] = a[] * b[] / R % mod
  */
-static void montMul(const struct vb2_public_key *key,
-                    uint32_t *c,
-                    const uint32_t *a,
-                    const uint32_t *b)
+MONT_INLINE void mont_mul_len(const struct mont_ctx *m,
+			      uint32_t len,
+			      vb2_limb_t *c,
+			      const vb2_limb_t *a,
+			      const vb2_limb_t *b)
 {
 	uint32_t i;
-	for (i = 0; i < key->arrsize; ++i) {
+	for (i = 0; i < len; ++i) {
 		c[i] = 0;
 	}
-	for (i = 0; i < key->arrsize; ++i) {
-		montMulAdd(key, c, a[i], b);
+	for (i = 0; i < len; ++i) {
+		montMulAdd(m, len, c, a[i], b);
 	}
 }
 
 /**
- * In-place public exponentiation. (65537}
+ * Montgomery t[] = x[]^2 / R % mod
+ *
+ * t[] is (2 * len) limbs long, and x[] is its upper half on entry; the
+ * result is left in the same place, so repeated squarings need no copies.
+ *
+ * Squaring first forms the full product, adding each cross product
+ * x[i] * x[j] once and doubling the column, which takes about half the
+ * multiplies of montMulAdd().  Each column is finished before its limb is
+ * stored, and by then the limb of x[] it overwrites isn't needed any more.
+ * The product is then reduced in place a limb at a time.
+ */
+MONT_INLINE void mont_sqr_len(const struct mont_ctx *m,
+			      uint32_t len,
+			      vb2_limb_t *t)
+{
+	const vb2_limb_t *x = t + len;
+	const uint32_t *n = m->key->n;
+	vb2_dlimb_t carry = 0;
+	vb2_limb_t top = 0;
+	uint32_t i, j, k;
+
+	for (k = 0; k < 2 * len - 1; ++k) {
+		/* Column sum, as a 3-limb number in (hi, A) */
+		vb2_dlimb_t A = 0, p;
+		vb2_limb_t hi = 0;
+
+		i = k < len ? 0 : k - len + 1;
+		for (j = k - i; i < j; ++i, --j) {
+			p = (vb2_dlimb_t)x[i] * x[j];
+			A += p;
+			hi += A < p;
+		}
+		hi = (hi << 1) | (vb2_limb_t)(A >> (2 * LIMB_BITS - 1));
+		A <<= 1;
+		if (i == j) {
+			p = (vb2_dlimb_t)x[i] * x[i];
+			A += p;
+			hi += A < p;
+		}
+		A += carry;
+		hi += A < carry;
+
+		t[k] = (vb2_limb_t)A;
+		carry = (A >> LIMB_BITS) | ((vb2_dlimb_t)hi << LIMB_BITS);
+	}
+	t[k] = (vb2_limb_t)carry;
+
+	/*
+	 * Each step clears t[i] by adding a multiple of the modulus, leaving
+	 * any carry out of t[i + len] in top for the next step.
+	 */
+	for (i = 0; i < len; ++i) {
+		vb2_limb_t d = t[i] * m->n0inv;
+		vb2_dlimb_t B = 0;
+
+		for (j = 0; j < len; ++j) {
+			B += (vb2_dlimb_t)d * get_limb(n, j) + t[i + j];
+			t[i + j] = (vb2_limb_t)B;
+			B >>= LIMB_BITS;
+		}
+		B += (vb2_dlimb_t)t[i + len] + top;
+		t[i + len] = (vb2_limb_t)B;
+		top = (vb2_limb_t)(B >> LIMB_BITS);
+	}
+
+	if (top) {
+		sub_mod_len(m, len, t + len);
+	}
+}
+
+typedef void (*mont_mul_func)(const struct mont_ctx *m, vb2_limb_t *c,
+			      const vb2_limb_t *a, const vb2_limb_t *b);
+typedef void (*mont_sqr_func)(const struct mont_ctx *m, vb2_limb_t *t);
+
+/* Montgomery multiply and square for one size of modulus */
+struct mont_ops {
+	mont_mul_func mul;
+	mont_sqr_func sqr;
+};
+
+/*
+ * Define a Montgomery multiply and square for a modulus [len] limbs long,
+ * and a struct mont_ops pointing at them.
+ */
+#define DEFINE_MONT_OPS(ops, mul_name, sqr_name, len)			\
+	static void mul_name(const struct mont_ctx *m, vb2_limb_t *c,	\
+			     const vb2_limb_t *a, const vb2_limb_t *b)	\
+	{								\
+		mont_mul_len(m, (len), c, a, b);			\
+	}								\
+	static void sqr_name(const struct mont_ctx *m, vb2_limb_t *t)	\
+	{								\
+		mont_sqr_len(m, (len), t);				\
+	}								\
+	static const struct mont_ops ops = { mul_name, sqr_name }
+
+/* Any size of key */
+DEFINE_MONT_OPS(mont_ops_any, montMul, montSqr, m->len);
+
+/*
+ * Builds for platforms which only use some sizes of key can ask for
+ * arithmetic specialized for each with VB2_RSA_FIXED_<bits>; other sizes
+ * still work, using the ones above.
+ */
+#if VB2_RSA_FIXED_1024
+DEFINE_MONT_OPS(mont_ops_1024, montMul1024, montSqr1024, 1024 / LIMB_BITS);
+#endif
+#if VB2_RSA_FIXED_2048
+DEFINE_MONT_OPS(mont_ops_2048, montMul2048, montSqr2048, 2048 / LIMB_BITS);
+#endif
+#if VB2_RSA_FIXED_4096
+DEFINE_MONT_OPS(mont_ops_4096, montMul4096, montSqr4096, 4096 / LIMB_BITS);
+#endif
+#if VB2_RSA_FIXED_8192
+DEFINE_MONT_OPS(mont_ops_8192, montMul8192, montSqr8192, 8192 / LIMB_BITS);
+#endif
+
+/**
+ * Return the Montgomery arithmetic to use for a key.
+ */
+static const struct mont_ops *mont_ops_for(const struct vb2_public_key *key)
+{
+	switch (key->arrsize * 32) {
+#if VB2_RSA_FIXED_1024
+	case 1024:
+		return &mont_ops_1024;
+#endif
+#if VB2_RSA_FIXED_2048
+	case 2048:
+		return &mont_ops_2048;
+#endif
+#if VB2_RSA_FIXED_4096
+	case 4096:
+		return &mont_ops_4096;
+#endif
+#if VB2_RSA_FIXED_8192
+	case 8192:
+		return &mont_ops_8192;
+#endif
+	default:
+		return &mont_ops_any;
+	}
+}
+
+/**
+ * Public exponentiation. (65537}
  *
  * @param key		Key to use in signing
- * @param inout		Input and output big-endian byte array
- * @param workbuf32	Work buffer; caller must verify this is
- *			(3 * key->arrsize) elements long.
+ * @param in		Input big-endian byte array
+ * @param out		Output big-endian byte array.  May be the same as in,
+ *			or the start of the work buffer, but must not
+ *			overlap the rest of the work buffer.
+ * @param workbuf	Work buffer; caller must verify this is
+ *			(3 * key->arrsize) 32-bit words long, and aligned
+ *			for vb2_limb_t.
  */
-static void modpowF4(const struct vb2_public_key *key, uint8_t *inout,
-		    uint32_t *workbuf32)
+static void modpowF4(const struct vb2_public_key *key, const uint8_t *in,
+		     uint8_t *out, void *workbuf)
 {
-	uint32_t *a = workbuf32;
-	uint32_t *aR = a + key->arrsize;
-	uint32_t *aaR = aR + key->arrsize;
-	uint32_t *aaa = aaR;  /* Re-use location. */
-	int i;
-
-	/* Convert from big endian byte array to little endian word array. */
-	for (i = 0; i < (int)key->arrsize; ++i) {
-		uint32_t tmp =
-			(inout[((key->arrsize - 1 - i) * 4) + 0] << 24) |
-			(inout[((key->arrsize - 1 - i) * 4) + 1] << 16) |
-			(inout[((key->arrsize - 1 - i) * 4) + 2] << 8) |
-			(inout[((key->arrsize - 1 - i) * 4) + 3] << 0);
+	struct mont_ctx m;
+	const struct mont_ops *ops = mont_ops_for(key);
+	vb2_limb_t *a = workbuf;
+	vb2_limb_t *t;	/* Double length, for squaring */
+	vb2_limb_t *aR;
+	vb2_limb_t *aaa;
+	int i, j;
+
+	mont_init(&m, key);
+	t = a + m.len;
+	aR = t + m.len;  /* Upper half of t, where squaring works */
+	aaa = t;  /* Re-use location. */
+
+	/* Convert from big endian byte array to little endian limb array. */
+	for (i = 0; i < (int)m.len; ++i) {
+		const uint8_t *p = in + (m.len - 1 - i) * LIMB_BYTES;
+		vb2_limb_t tmp = 0;
+		for (j = 0; j < LIMB_BYTES; j++)
+			tmp = (tmp << 8) | p[j];
 		a[i] = tmp;
 	}
 
-	montMul(key, aR, a, key->rr);  /* aR = a * RR / R mod M   */
-	for (i = 0; i < 16; i+=2) {
-		montMul(key, aaR, aR, aR);  /* aaR = aR * aR / R mod M */
-		montMul(key, aR, aaR, aaR);  /* aR = aaR * aaR / R mod M */
-	}
-	montMul(key, aaa, aR, a);  /* aaa = aR * a / R mod M */
+	/* RR is only needed once, so borrow t to hold it as limbs. */
+	for (i = 0; i < (int)m.len; ++i)
+		t[i] = get_limb(key->rr, i);
+
+	ops->mul(&m, aR, a, t);  /* aR = a * RR / R mod M   */
+	for (i = 0; i < 16; ++i)
+		ops->sqr(&m, t);  /* aR = aR * aR / R mod M */
+	ops->mul(&m, aaa, aR, a);  /* aaa = aR * a / R mod M */
 
 
 	/* Make sure aaa < mod; aaa is at most 1x mod too large. */
-	if (vb2_mont_ge(key, aaa)) {
-		subM(key, aaa);
+	if (mont_ge(&m, aaa)) {
+		subM(&m, aaa);
 	}
 
 	/* Convert to bigendian byte array */
-	for (i = (int)key->arrsize - 1; i >= 0; --i) {
-		uint32_t tmp = aaa[i];
-		*inout++ = (uint8_t)(tmp >> 24);
-		*inout++ = (uint8_t)(tmp >> 16);
-		*inout++ = (uint8_t)(tmp >>  8);
-		*inout++ = (uint8_t)(tmp >>  0);
+	for (i = (int)m.len - 1; i >= 0; --i) {
+		vb2_limb_t tmp = aaa[i];
+		for (j = LIMB_BYTES - 1; j >= 0; j--)
+			*out++ = (uint8_t)(tmp >> (8 * j));
 	}
 }
 
 
+/* Signature algorithm if it's supported, else VB2_SIG_INVALID */
+#define SIG_IF(supported, sig_alg) ((supported) ? (sig_alg) : VB2_SIG_INVALID)
+
 static const uint8_t crypto_to_sig[] = {
-	VB2_SIG_RSA1024,
-	VB2_SIG_RSA1024,
-	VB2_SIG_RSA1024,
-	VB2_SIG_RSA2048,
-	VB2_SIG_RSA2048,
-	VB2_SIG_RSA2048,
-	VB2_SIG_RSA4096,
-	VB2_SIG_RSA4096,
-	VB2_SIG_RSA4096,
-	VB2_SIG_RSA8192,
-	VB2_SIG_RSA8192,
-	VB2_SIG_RSA8192,
+	SIG_IF(VB2_SUPPORT_RSA1024, VB2_SIG_RSA1024),
+	SIG_IF(VB2_SUPPORT_RSA1024, VB2_SIG_RSA1024),
+	SIG_IF(VB2_SUPPORT_RSA1024, VB2_SIG_RSA1024),
+	SIG_IF(VB2_SUPPORT_RSA2048, VB2_SIG_RSA2048),
+	SIG_IF(VB2_SUPPORT_RSA2048, VB2_SIG_RSA2048),
+	SIG_IF(VB2_SUPPORT_RSA2048, VB2_SIG_RSA2048),
+	SIG_IF(VB2_SUPPORT_RSA4096, VB2_SIG_RSA4096),
+	SIG_IF(VB2_SUPPORT_RSA4096, VB2_SIG_RSA4096),
+	SIG_IF(VB2_SUPPORT_RSA4096, VB2_SIG_RSA4096),
+	SIG_IF(VB2_SUPPORT_RSA8192, VB2_SIG_RSA8192),
+	SIG_IF(VB2_SUPPORT_RSA8192, VB2_SIG_RSA8192),
+	SIG_IF(VB2_SUPPORT_RSA8192, VB2_SIG_RSA8192),
 };
 
 /**
@@ -175,14 +466,22 @@ enum vb2_signature_algorithm vb2_crypto_to_signature(uint32_t algorithm)
 uint32_t vb2_rsa_sig_size(enum vb2_signature_algorithm sig_alg)
 {
 	switch (sig_alg) {
+#if VB2_SUPPORT_RSA1024
 	case VB2_SIG_RSA1024:
 		return 1024 / 8;
+#endif
+#if VB2_SUPPORT_RSA2048
 	case VB2_SIG_RSA2048:
 		return 2048 / 8;
+#endif
+#if VB2_SUPPORT_RSA4096
 	case VB2_SIG_RSA4096:
 		return 4096 / 8;
+#endif
+#if VB2_SUPPORT_RSA8192
 	case VB2_SIG_RSA8192:
 		return 8192 / 8;
+#endif
 	default:
 		return 0;
 	}
@@ -192,6 +491,12 @@ uint32_t vb2_packed_key_size(enum vb2_signature_algorithm sig_alg)
 {
 	uint32_t sig_size = vb2_rsa_sig_size(sig_alg);
 
+#if VB2_SUPPORT_ED25519
+	/* Ed25519 keys are packed as they are */
+	if (sig_alg == VB2_SIG_ED25519)
+		return VB2_ED25519_PUBLIC_KEY_SIZE;
+#endif
+
 	if (!sig_size)
 		return 0;
 
@@ -223,22 +528,37 @@ uint32_t vb2_packed_key_size(enum vb2_signature_algorithm sig_alg)
  *
  * PS: octet string consisting of {Length(RSA Key) - Length(T) - 3} 0xFF
  */
+#if VB2_SUPPORT_SHA1
 static const uint8_t sha1_tail[] = {
 	0x00,0x30,0x21,0x30,0x09,0x06,0x05,0x2b,
 	0x0e,0x03,0x02,0x1a,0x05,0x00,0x04,0x14
 };
+#endif
 
+#if VB2_SUPPORT_SHA256
 static const uint8_t sha256_tail[] = {
 	0x00,0x30,0x31,0x30,0x0d,0x06,0x09,0x60,
 	0x86,0x48,0x01,0x65,0x03,0x04,0x02,0x01,
 	0x05,0x00,0x04,0x20
 };
+#endif
 
+#if VB2_SUPPORT_SHA512
 static const uint8_t sha512_tail[] = {
 	0x00,0x30,0x51,0x30,0x0d,0x06,0x09,0x60,
 	0x86,0x48,0x01,0x65,0x03,0x04,0x02,0x03,
 	0x05,0x00,0x04,0x40
 };
+#endif
+
+#if VB2_SUPPORT_BLAKE2S
+/* DigestInfo for OID 1.3.6.1.4.1.1722.12.2.2.8 (BLAKE2s-256, RFC 7693) */
+static const uint8_t blake2s_tail[] = {
+	0x00,0x30,0x33,0x30,0x0f,0x06,0x0b,0x2b,
+	0x06,0x01,0x04,0x01,0x8d,0x3a,0x0c,0x02,
+	0x02,0x08,0x05,0x00,0x04,0x20
+};
+#endif
 
 int vb2_check_padding(const uint8_t *sig, const struct vb2_public_key *key)
 {
@@ -248,25 +568,38 @@ int vb2_check_padding(const uint8_t *sig, const struct vb2_public_key *key)
 	uint32_t pad_size = sig_size - hash_size;
 	const uint8_t *tail;
 	uint32_t tail_size;
+	uint32_t ff_size;
+	vb2_limb_t ff_diff = 0;
 	int result = 0;
-	int i;
 
 	if (!sig_size || !hash_size || hash_size > sig_size)
 		return VB2_ERROR_RSA_PADDING_SIZE;
 
 	switch (key->hash_alg) {
+#if VB2_SUPPORT_SHA1
 	case VB2_HASH_SHA1:
 		tail = sha1_tail;
 		tail_size = sizeof(sha1_tail);
 		break;
+#endif
+#if VB2_SUPPORT_SHA256
 	case VB2_HASH_SHA256:
 		tail = sha256_tail;
 		tail_size = sizeof(sha256_tail);
 		break;
+#endif
+#if VB2_SUPPORT_SHA512
 	case VB2_HASH_SHA512:
 		tail = sha512_tail;
 		tail_size = sizeof(sha512_tail);
 		break;
+#endif
+#if VB2_SUPPORT_BLAKE2S
+	case VB2_HASH_BLAKE2S:
+		tail = blake2s_tail;
+		tail_size = sizeof(blake2s_tail);
+		break;
+#endif
 	default:
 		return VB2_ERROR_RSA_PADDING_ALGORITHM;
 	}
@@ -275,9 +608,24 @@ int vb2_check_padding(const uint8_t *sig, const struct vb2_public_key *key)
 	result |= *sig++ ^ 0x00;
 	result |= *sig++ ^ 0x01;
 
-	/* Then 0xff bytes until the tail */
-	for (i = 0; i < pad_size - tail_size - 2; i++)
-		result |= *sig++ ^ 0xff;
+	/*
+	 * Then 0xff bytes until the tail.  That run is most of the signature,
+	 * so check it a limb at a time; the loads go through memcpy() since
+	 * the signature needn't be aligned.  Differences are accumulated
+	 * rather than returned early, so the time taken doesn't depend on
+	 * where the first bad byte is.
+	 */
+	ff_size = pad_size - tail_size - 2;
+	for (; ff_size >= sizeof(vb2_limb_t); ff_size -= sizeof(vb2_limb_t)) {
+		vb2_limb_t w;
+
+		memcpy(&w, sig, sizeof(w));
+		ff_diff |= ~w;
+		sig += sizeof(w);
+	}
+	for (; ff_size; ff_size--)
+		ff_diff |= *sig++ ^ 0xff;
+	result |= (ff_diff != 0);
 
 	/*
 	 * Then the tail.  Even though there are probably no timing issues
@@ -288,13 +636,22 @@ int vb2_check_padding(const uint8_t *sig, const struct vb2_public_key *key)
 	return result ? VB2_ERROR_RSA_PADDING : VB2_SUCCESS;
 }
 
+/* Routines to use instead of the ones here, if any */
+static const struct vb2_rsa_ops *rsa_ops;
+
+void vb2_rsa_set_ops(const struct vb2_rsa_ops *ops)
+{
+	rsa_ops = ops;
+}
+
 int vb2_rsa_verify_digest(const struct vb2_public_key *key,
-			  uint8_t *sig,
+			  const uint8_t *sig,
 			  const uint8_t *digest,
 			  const struct vb2_workbuf *wb)
 {
 	struct vb2_workbuf wblocal = *wb;
-	uint32_t *workbuf32;
+	void *workbuf;
+	uint8_t *padded;
 	uint32_t key_bytes;
 	int sig_size;
 	int pad_size;
@@ -316,20 +673,32 @@ int vb2_rsa_verify_digest(const struct vb2_public_key *key,
 		return VB2_ERROR_RSA_VERIFY_SIG_LEN;
 	}
 
-	workbuf32 = vb2_workbuf_alloc(&wblocal, 3 * key_bytes);
-	if (!workbuf32)
+	workbuf = vb2_workbuf_alloc(&wblocal, 3 * key_bytes);
+	if (!workbuf)
 		return VB2_ERROR_RSA_VERIFY_WORKBUF;
 
-	modpowF4(key, sig, workbuf32);
+	VB2_CRYPTO_STATS_ADD(rsa_verifies[key->sig_alg - VB2_SIG_RSA1024], 1);
+
+	if (rsa_ops) {
+		rv = rsa_ops->verify_digest(key, sig, digest);
+		if (rv != VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED)
+			return rv;
+	}
 
-	vb2_workbuf_free(&wblocal, 3 * key_bytes);
+	/*
+	 * Decrypt into the first third of the work buffer, which modpowF4()
+	 * is done with by then, so the signature itself is left alone and
+	 * can be verified where it sits in read-only memory.
+	 */
+	padded = workbuf;
+	modpowF4(key, sig, padded, workbuf);
 
 	/*
 	 * Check padding.  Only fail immediately if the padding size is bad.
 	 * Otherwise, continue on to check the digest to reduce the risk of
 	 * timing based attacks.
 	 */
-	rv = vb2_check_padding(sig, key);
+	rv = vb2_check_padding(padded, key);
 	if (rv == VB2_ERROR_RSA_PADDING_SIZE)
 		return rv;
 
@@ -339,7 +708,7 @@ int vb2_rsa_verify_digest(const struct vb2_public_key *key,
 	 * we don't return before this check if the padding check failed.)
 	 */
 	pad_size = sig_size - vb2_digest_size(key->hash_alg);
-	if (vb2_safe_memcmp(sig + pad_size, digest, key_bytes - pad_size)) {
+	if (vb2_safe_memcmp(padded + pad_size, digest, key_bytes - pad_size)) {
 		VB2_DEBUG("Digest check failed!\n");
 		if (!rv)
 			rv = VB2_ERROR_RSA_VERIFY_DIGEST;
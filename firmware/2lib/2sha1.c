@@ -10,6 +10,9 @@
 #include "2common.h"
 #include "2sha.h"
 
+/* Leave the whole implementation out when the algorithm is disabled */
+#if VB2_SUPPORT_SHA1
+
 /*
  * Some machines lack byteswap.h and endian.h. These have to use the
  * slower code, even if they're little-endian.
@@ -162,7 +165,7 @@ void vb2_sha1_update(struct vb2_sha1_context *ctx,
 
 uint8_t *vb2_sha1_finalize(struct vb2_sha1_context *ctx)
 {
-	uint32_t cnt = ctx->count * 8;
+	uint64_t cnt = ctx->count * 8;
 	int i;
 
 	vb2_sha1_update(ctx, (uint8_t*)"\x80", 1);
@@ -258,7 +261,7 @@ void vb2_sha1_update(struct vb2_sha1_context *ctx,
 
 void vb2_sha1_finalize(struct vb2_sha1_context *ctx, uint8_t *digest)
 {
-	uint32_t cnt = ctx->count << 3;
+	uint64_t cnt = ctx->count << 3;
 	int i;
 
 	vb2_sha1_update(ctx, (uint8_t*)"\x80", 1);
@@ -266,7 +269,7 @@ void vb2_sha1_finalize(struct vb2_sha1_context *ctx, uint8_t *digest)
 		vb2_sha1_update(ctx, (uint8_t*)"\0", 1);
 	}
 	for (i = 0; i < 8; ++i) {
-		uint8_t tmp = (uint8_t)((uint64_t)cnt >> ((7 - i) * 8));
+		uint8_t tmp = (uint8_t)(cnt >> ((7 - i) * 8));
 		vb2_sha1_update(ctx, &tmp, 1);
 	}
 
@@ -290,3 +293,5 @@ void vb2_sha1_init(struct vb2_sha1_context *ctx)
 	ctx->state[4] = 0xc3d2e1f0;
 	ctx->count = 0;
 }
+
+#endif  /* VB2_SUPPORT_SHA1 */
@@ -38,6 +38,8 @@
 #include "2sysincludes.h"
 #include "2common.h"
 #include "2sha.h"
+#include "2sha256_simd.h"
+#include "2sha_private.h"
 
 #define SHFR(x, n)    (x >> n)
 #define ROTR(x, n)   ((x >> n) | (x << ((sizeof(x) << 3) - n)))
@@ -77,7 +79,7 @@
 #define SHA256_EXP(a, b, c, d, e, f, g, h, j)				\
 	{								\
 		t1 = wv[h] + SHA256_F2(wv[e]) + CH(wv[e], wv[f], wv[g]) \
-			+ sha256_k[j] + w[j];				\
+			+ vb2_sha256_k[j] + w[j];			\
 		t2 = SHA256_F1(wv[a]) + MAJ(wv[a], wv[b], wv[c]);       \
 		wv[d] += t1;                                            \
 		wv[h] = t1 + t2;                                        \
@@ -88,7 +90,7 @@ static const uint32_t sha256_h0[8] = {
 	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
 };
 
-static const uint32_t sha256_k[64] = {
+const uint32_t vb2_sha256_k[64] = {
 	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
 	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
 	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
@@ -126,9 +128,9 @@ void vb2_sha256_init(struct vb2_sha256_context *ctx)
 	ctx->total_size = 0;
 }
 
-static void vb2_sha256_transform(struct vb2_sha256_context *ctx,
-				 const uint8_t *message,
-				 unsigned int block_nb)
+static void vb2_sha256_transform_c(struct vb2_sha256_context *ctx,
+				   const uint8_t *message,
+				   unsigned int block_nb)
 {
 	/* Note that these arrays use 72*4=288 bytes of stack */
 	uint32_t w[64];
@@ -159,7 +161,7 @@ static void vb2_sha256_transform(struct vb2_sha256_context *ctx,
 
 		for (j = 0; j < 64; j++) {
 			t1 = wv[7] + SHA256_F2(wv[4]) + CH(wv[4], wv[5], wv[6])
-				+ sha256_k[j] + w[j];
+				+ vb2_sha256_k[j] + w[j];
 			t2 = SHA256_F1(wv[0]) + MAJ(wv[0], wv[1], wv[2]);
 			wv[7] = wv[6];
 			wv[6] = wv[5];
@@ -243,6 +245,83 @@ static void vb2_sha256_transform(struct vb2_sha256_context *ctx,
 	}
 }
 
+#if VB2_SHA256_SIMD
+/* Block transform in use; VB2_SHA256_IMPL_AUTO until first picked */
+static enum vb2_sha256_impl sha256_impl = VB2_SHA256_IMPL_AUTO;
+#endif
+
+int vb2_sha256_select_impl(enum vb2_sha256_impl impl)
+{
+	switch (impl) {
+	case VB2_SHA256_IMPL_AUTO:
+	case VB2_SHA256_IMPL_C:
+		break;
+#if VB2_SHA256_SIMD
+	case VB2_SHA256_IMPL_X86_SHA:
+		if (!vb2_sha256_x86_sha_supported())
+			return VB2_ERROR_SHA_IMPL_UNSUPPORTED;
+		break;
+	case VB2_SHA256_IMPL_ARMV8_CE:
+		if (!vb2_sha256_armv8_ce_supported())
+			return VB2_ERROR_SHA_IMPL_UNSUPPORTED;
+		break;
+#endif
+	default:
+		return VB2_ERROR_SHA_IMPL_UNSUPPORTED;
+	}
+
+#if VB2_SHA256_SIMD
+	if (impl == VB2_SHA256_IMPL_AUTO) {
+		if (vb2_sha256_x86_sha_supported())
+			impl = VB2_SHA256_IMPL_X86_SHA;
+		else if (vb2_sha256_armv8_ce_supported())
+			impl = VB2_SHA256_IMPL_ARMV8_CE;
+		else
+			impl = VB2_SHA256_IMPL_C;
+	}
+	sha256_impl = impl;
+#endif
+	return VB2_SUCCESS;
+}
+
+int vb2_sha256_using_cpu_insns(void)
+{
+#if VB2_SHA256_SIMD
+	if (sha256_impl == VB2_SHA256_IMPL_AUTO)
+		vb2_sha256_select_impl(VB2_SHA256_IMPL_AUTO);
+
+	return sha256_impl != VB2_SHA256_IMPL_C;
+#else
+	return 0;
+#endif
+}
+
+static void vb2_sha256_transform(struct vb2_sha256_context *ctx,
+				 const uint8_t *message,
+				 unsigned int block_nb)
+{
+	if (!block_nb)
+		return;
+
+#if VB2_SHA256_SIMD
+	if (sha256_impl == VB2_SHA256_IMPL_AUTO)
+		vb2_sha256_select_impl(VB2_SHA256_IMPL_AUTO);
+
+	switch (sha256_impl) {
+	case VB2_SHA256_IMPL_X86_SHA:
+		vb2_sha256_transform_x86_sha(ctx->h, message, block_nb);
+		return;
+	case VB2_SHA256_IMPL_ARMV8_CE:
+		vb2_sha256_transform_armv8_ce(ctx->h, message, block_nb);
+		return;
+	default:
+		break;
+	}
+#endif
+
+	vb2_sha256_transform_c(ctx, message, block_nb);
+}
+
 void vb2_sha256_update(struct vb2_sha256_context *ctx,
 		       const uint8_t *data,
 		       uint32_t size)
@@ -0,0 +1,241 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * SHA-256 block transforms using the x86 SHA extensions and the ARMv8 crypto
+ * extensions.  These are selected at runtime by 2sha256.c.
+ *
+ * This is one of the few places in firmware/ which includes system headers
+ * directly, since the vector intrinsics come from the compiler.
+ */
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
+#include "2sha256_simd.h"
+#include "2sha_private.h"
+
+#if VB2_SHA256_SIMD && (defined(__x86_64__) || defined(__i386__))
+#define VB2_SHA256_X86_SHA 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if VB2_SHA256_SIMD && defined(__aarch64__)
+#define VB2_SHA256_ARMV8_CE 1
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+#ifdef VB2_SHA256_X86_SHA
+
+int vb2_sha256_x86_sha_supported(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx) || eax < 7)
+		return 0;
+
+	/* SSSE3 and SSE4.1 for the byte swap and blend */
+	__cpuid(1, eax, ebx, ecx, edx);
+	if (!(ecx & (1 << 9)) || !(ecx & (1 << 19)))
+		return 0;
+
+	/* SHA extensions are leaf 7, EBX bit 29 */
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx & (1 << 29)) ? 1 : 0;
+}
+
+/*
+ * Four rounds, using the message words in cur.  If do_msg2, finish the
+ * schedule for the words after cur into next.  If do_msg1, start the schedule
+ * for the words 3 groups after cur by mixing cur into prev.
+ */
+#define X86_ROUND4(g, cur, next, prev, do_msg2, do_msg1)		\
+	do {								\
+		msg = _mm_add_epi32(cur, _mm_loadu_si128(		\
+			(const __m128i *)&vb2_sha256_k[4 * (g)]));	\
+		state1 = _mm_sha256rnds2_epu32(state1, state0, msg);	\
+		if (do_msg2) {						\
+			tmp = _mm_alignr_epi8(cur, prev, 4);		\
+			next = _mm_add_epi32(next, tmp);		\
+			next = _mm_sha256msg2_epu32(next, cur);		\
+		}							\
+		msg = _mm_shuffle_epi32(msg, 0x0e);			\
+		state0 = _mm_sha256rnds2_epu32(state0, state1, msg);	\
+		if (do_msg1)						\
+			prev = _mm_sha256msg1_epu32(prev, cur);		\
+	} while (0)
+
+__attribute__((target("sha,sse4.1")))
+void vb2_sha256_transform_x86_sha(uint32_t *h, const uint8_t *message,
+				  unsigned int block_nb)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+					     0x0405060700010203ULL);
+	__m128i state0, state1, msg, tmp;
+	__m128i msg0, msg1, msg2, msg3;
+	__m128i abef_save, cdgh_save;
+
+	/* The instructions want the state as ABEF and CDGH */
+	tmp = _mm_loadu_si128((const __m128i *)&h[0]);
+	state1 = _mm_loadu_si128((const __m128i *)&h[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xb1);		/* CDAB */
+	state1 = _mm_shuffle_epi32(state1, 0x1b);	/* EFGH */
+	state0 = _mm_alignr_epi8(tmp, state1, 8);	/* ABEF */
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);	/* CDGH */
+
+	while (block_nb--) {
+		abef_save = state0;
+		cdgh_save = state1;
+
+		msg0 = _mm_shuffle_epi8(_mm_loadu_si128(
+			(const __m128i *)(message + 0)), bswap);
+		msg1 = _mm_shuffle_epi8(_mm_loadu_si128(
+			(const __m128i *)(message + 16)), bswap);
+		msg2 = _mm_shuffle_epi8(_mm_loadu_si128(
+			(const __m128i *)(message + 32)), bswap);
+		msg3 = _mm_shuffle_epi8(_mm_loadu_si128(
+			(const __m128i *)(message + 48)), bswap);
+
+		X86_ROUND4( 0, msg0, msg1, msg3, 0, 0);
+		X86_ROUND4( 1, msg1, msg2, msg0, 0, 1);
+		X86_ROUND4( 2, msg2, msg3, msg1, 0, 1);
+		X86_ROUND4( 3, msg3, msg0, msg2, 1, 1);
+		X86_ROUND4( 4, msg0, msg1, msg3, 1, 1);
+		X86_ROUND4( 5, msg1, msg2, msg0, 1, 1);
+		X86_ROUND4( 6, msg2, msg3, msg1, 1, 1);
+		X86_ROUND4( 7, msg3, msg0, msg2, 1, 1);
+		X86_ROUND4( 8, msg0, msg1, msg3, 1, 1);
+		X86_ROUND4( 9, msg1, msg2, msg0, 1, 1);
+		X86_ROUND4(10, msg2, msg3, msg1, 1, 1);
+		X86_ROUND4(11, msg3, msg0, msg2, 1, 1);
+		X86_ROUND4(12, msg0, msg1, msg3, 1, 1);
+		X86_ROUND4(13, msg1, msg2, msg0, 1, 0);
+		X86_ROUND4(14, msg2, msg3, msg1, 1, 0);
+		X86_ROUND4(15, msg3, msg0, msg2, 0, 0);
+
+		state0 = _mm_add_epi32(state0, abef_save);
+		state1 = _mm_add_epi32(state1, cdgh_save);
+		message += VB2_SHA256_BLOCK_SIZE;
+	}
+
+	/* Back to ABCD and EFGH */
+	tmp = _mm_shuffle_epi32(state0, 0x1b);		/* FEBA */
+	state1 = _mm_shuffle_epi32(state1, 0xb1);	/* DCHG */
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0);	/* DCBA */
+	state1 = _mm_alignr_epi8(state1, tmp, 8);	/* HGFE */
+	_mm_storeu_si128((__m128i *)&h[0], state0);
+	_mm_storeu_si128((__m128i *)&h[4], state1);
+}
+
+#else
+
+int vb2_sha256_x86_sha_supported(void)
+{
+	return 0;
+}
+
+void vb2_sha256_transform_x86_sha(uint32_t *h, const uint8_t *message,
+				  unsigned int block_nb)
+{
+}
+
+#endif  /* VB2_SHA256_X86_SHA */
+
+#ifdef VB2_SHA256_ARMV8_CE
+
+#if defined(__clang__)
+#define ARMV8_CE_TARGET __attribute__((target("crypto")))
+#else
+#define ARMV8_CE_TARGET __attribute__((target("+crypto")))
+#endif
+
+int vb2_sha256_armv8_ce_supported(void)
+{
+#if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+	return 1;
+#elif defined(__linux__) && defined(HWCAP_SHA2)
+	return (getauxval(AT_HWCAP) & HWCAP_SHA2) ? 1 : 0;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Four rounds, using the message words in cur.  If do_sched, compute the
+ * words 4 groups after cur in place, from cur and the 3 following groups.
+ */
+#define ARMV8_ROUND4(g, cur, m1, m2, m3, do_sched)			\
+	do {								\
+		tmp0 = vaddq_u32(cur, vld1q_u32(&vb2_sha256_k[4 * (g)])); \
+		if (do_sched)						\
+			cur = vsha256su0q_u32(cur, m1);			\
+		tmp1 = state0;						\
+		state0 = vsha256hq_u32(state0, state1, tmp0);		\
+		state1 = vsha256h2q_u32(state1, tmp1, tmp0);		\
+		if (do_sched)						\
+			cur = vsha256su1q_u32(cur, m2, m3);		\
+	} while (0)
+
+ARMV8_CE_TARGET
+void vb2_sha256_transform_armv8_ce(uint32_t *h, const uint8_t *message,
+				   unsigned int block_nb)
+{
+	uint32x4_t state0 = vld1q_u32(&h[0]);
+	uint32x4_t state1 = vld1q_u32(&h[4]);
+	uint32x4_t msg0, msg1, msg2, msg3;
+	uint32x4_t tmp0, tmp1;
+	uint32x4_t abcd_save, efgh_save;
+
+	while (block_nb--) {
+		abcd_save = state0;
+		efgh_save = state1;
+
+		msg0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(message)));
+		msg1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(message + 16)));
+		msg2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(message + 32)));
+		msg3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(message + 48)));
+
+		ARMV8_ROUND4( 0, msg0, msg1, msg2, msg3, 1);
+		ARMV8_ROUND4( 1, msg1, msg2, msg3, msg0, 1);
+		ARMV8_ROUND4( 2, msg2, msg3, msg0, msg1, 1);
+		ARMV8_ROUND4( 3, msg3, msg0, msg1, msg2, 1);
+		ARMV8_ROUND4( 4, msg0, msg1, msg2, msg3, 1);
+		ARMV8_ROUND4( 5, msg1, msg2, msg3, msg0, 1);
+		ARMV8_ROUND4( 6, msg2, msg3, msg0, msg1, 1);
+		ARMV8_ROUND4( 7, msg3, msg0, msg1, msg2, 1);
+		ARMV8_ROUND4( 8, msg0, msg1, msg2, msg3, 1);
+		ARMV8_ROUND4( 9, msg1, msg2, msg3, msg0, 1);
+		ARMV8_ROUND4(10, msg2, msg3, msg0, msg1, 1);
+		ARMV8_ROUND4(11, msg3, msg0, msg1, msg2, 1);
+		ARMV8_ROUND4(12, msg0, msg1, msg2, msg3, 0);
+		ARMV8_ROUND4(13, msg1, msg2, msg3, msg0, 0);
+		ARMV8_ROUND4(14, msg2, msg3, msg0, msg1, 0);
+		ARMV8_ROUND4(15, msg3, msg0, msg1, msg2, 0);
+
+		state0 = vaddq_u32(state0, abcd_save);
+		state1 = vaddq_u32(state1, efgh_save);
+		message += VB2_SHA256_BLOCK_SIZE;
+	}
+
+	vst1q_u32(&h[0], state0);
+	vst1q_u32(&h[4], state1);
+}
+
+#else
+
+int vb2_sha256_armv8_ce_supported(void)
+{
+	return 0;
+}
+
+void vb2_sha256_transform_armv8_ce(uint32_t *h, const uint8_t *message,
+				   unsigned int block_nb)
+{
+}
+
+#endif  /* VB2_SHA256_ARMV8_CE */
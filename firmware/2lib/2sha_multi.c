@@ -0,0 +1,465 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Multi-buffer SHA-256 and SHA-512.
+ *
+ * Each lane of a vector hashes a different buffer, so one pass through the
+ * rounds moves several digests forward by a block.  The lanes are written
+ * with the compiler's generic vector extensions, which become NEON on ARM; on
+ * x86 they are built a second time for AVX2 and picked at runtime.
+ */
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
+#include "2sha_private.h"
+
+#if VB2_SHA256_SIMD && defined(__GNUC__)
+#define VB2_SHA_MULTI 1
+#if defined(__x86_64__) || defined(__i386__)
+#define VB2_SHA_MULTI_AVX2 1
+#endif
+#endif
+
+/* Hash a single buffer */
+static int digest_one(enum vb2_hash_algorithm hash_alg,
+		      const uint8_t *buf,
+		      uint32_t size,
+		      uint8_t *digest,
+		      uint32_t digest_size)
+{
+	struct vb2_digest_context dc;
+	int rv;
+
+	rv = vb2_digest_init(&dc, hash_alg);
+	if (rv)
+		return rv;
+
+	rv = vb2_digest_extend(&dc, buf, size);
+	if (rv)
+		return rv;
+
+	return vb2_digest_finalize(&dc, digest, digest_size);
+}
+
+#ifdef VB2_SHA_MULTI
+
+#define SHA256_LANES 8
+#define SHA512_LANES 4
+
+typedef uint32_t vb2_v32 __attribute__((vector_size(4 * SHA256_LANES)));
+typedef uint64_t vb2_v64 __attribute__((vector_size(8 * SHA512_LANES)));
+
+#define SHFR(x, n)     ((x) >> (n))
+#define ROTR32(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+#define ROTR64(x, n)   (((x) >> (n)) | ((x) << (64 - (n))))
+#define CH(x, y, z)    (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z)   (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+#define SHA256_F1(x) (ROTR32(x,  2) ^ ROTR32(x, 13) ^ ROTR32(x, 22))
+#define SHA256_F2(x) (ROTR32(x,  6) ^ ROTR32(x, 11) ^ ROTR32(x, 25))
+#define SHA256_F3(x) (ROTR32(x,  7) ^ ROTR32(x, 18) ^ SHFR(x,  3))
+#define SHA256_F4(x) (ROTR32(x, 17) ^ ROTR32(x, 19) ^ SHFR(x, 10))
+
+#define SHA512_F1(x) (ROTR64(x, 28) ^ ROTR64(x, 34) ^ ROTR64(x, 39))
+#define SHA512_F2(x) (ROTR64(x, 14) ^ ROTR64(x, 18) ^ ROTR64(x, 41))
+#define SHA512_F3(x) (ROTR64(x,  1) ^ ROTR64(x,  8) ^ SHFR(x,  7))
+#define SHA512_F4(x) (ROTR64(x, 19) ^ ROTR64(x, 61) ^ SHFR(x,  6))
+
+/* Hash state of every lane; word i of lane l is h[i][l] */
+struct sha256_lanes {
+	vb2_v32 h[8];
+};
+
+struct sha512_lanes {
+	vb2_v64 h[8];
+};
+
+/* How to drive the lanes for one algorithm */
+struct multi_ops {
+	int lanes;
+	uint32_t block_size;
+
+	/* Reset a lane to the initial hash value */
+	void (*lane_init)(void *state, int lane);
+
+	/* Hash block_nb blocks from each lane, starting at p[lane] */
+	void (*blocks)(void *state, const uint8_t * const *p,
+		       uint32_t block_nb);
+	/* The same, built for AVX2; NULL if not built */
+	void (*blocks_avx2)(void *state, const uint8_t * const *p,
+			    uint32_t block_nb);
+
+	/*
+	 * Finish the buffer in a lane, done bytes of which have been hashed,
+	 * and store its digest.
+	 */
+	void (*lane_final)(void *state, int lane, const uint8_t *buf,
+			   uint32_t size, uint32_t done, uint8_t *digest);
+};
+
+static inline uint32_t load_be32(const uint8_t *b)
+{
+	return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) |
+		((uint32_t)b[2] << 8) | (uint32_t)b[3];
+}
+
+static inline uint64_t load_be64(const uint8_t *b)
+{
+	return ((uint64_t)load_be32(b) << 32) | load_be32(b + 4);
+}
+
+static inline __attribute__((always_inline))
+void sha256_lanes_body(struct sha256_lanes *s, const uint8_t * const *p,
+		       uint32_t block_nb)
+{
+	vb2_v32 w[16], wv[8], t1, t2;
+	uint32_t off;
+	int i, l;
+
+	for (off = 0; block_nb--; off += VB2_SHA256_BLOCK_SIZE) {
+		for (i = 0; i < 16; i++)
+			for (l = 0; l < SHA256_LANES; l++)
+				w[i][l] = load_be32(p[l] + off + (i << 2));
+
+		for (i = 0; i < 8; i++)
+			wv[i] = s->h[i];
+
+		for (i = 0; i < 64; i++) {
+			if (i >= 16)
+				w[i & 15] += SHA256_F4(w[(i - 2) & 15]) +
+					w[(i - 7) & 15] +
+					SHA256_F3(w[(i - 15) & 15]);
+
+			t1 = wv[7] + SHA256_F2(wv[4]) + CH(wv[4], wv[5], wv[6])
+				+ vb2_sha256_k[i] + w[i & 15];
+			t2 = SHA256_F1(wv[0]) + MAJ(wv[0], wv[1], wv[2]);
+			wv[7] = wv[6];
+			wv[6] = wv[5];
+			wv[5] = wv[4];
+			wv[4] = wv[3] + t1;
+			wv[3] = wv[2];
+			wv[2] = wv[1];
+			wv[1] = wv[0];
+			wv[0] = t1 + t2;
+		}
+
+		for (i = 0; i < 8; i++)
+			s->h[i] += wv[i];
+	}
+}
+
+#if VB2_SUPPORT_SHA512
+static inline __attribute__((always_inline))
+void sha512_lanes_body(struct sha512_lanes *s, const uint8_t * const *p,
+		       uint32_t block_nb)
+{
+	vb2_v64 w[16], wv[8], t1, t2;
+	uint32_t off;
+	int i, l;
+
+	for (off = 0; block_nb--; off += VB2_SHA512_BLOCK_SIZE) {
+		for (i = 0; i < 16; i++)
+			for (l = 0; l < SHA512_LANES; l++)
+				w[i][l] = load_be64(p[l] + off + (i << 3));
+
+		for (i = 0; i < 8; i++)
+			wv[i] = s->h[i];
+
+		for (i = 0; i < 80; i++) {
+			if (i >= 16)
+				w[i & 15] += SHA512_F4(w[(i - 2) & 15]) +
+					w[(i - 7) & 15] +
+					SHA512_F3(w[(i - 15) & 15]);
+
+			t1 = wv[7] + SHA512_F2(wv[4]) + CH(wv[4], wv[5], wv[6])
+				+ vb2_sha512_k[i] + w[i & 15];
+			t2 = SHA512_F1(wv[0]) + MAJ(wv[0], wv[1], wv[2]);
+			wv[7] = wv[6];
+			wv[6] = wv[5];
+			wv[5] = wv[4];
+			wv[4] = wv[3] + t1;
+			wv[3] = wv[2];
+			wv[2] = wv[1];
+			wv[1] = wv[0];
+			wv[0] = t1 + t2;
+		}
+
+		for (i = 0; i < 8; i++)
+			s->h[i] += wv[i];
+	}
+}
+#endif
+
+static void sha256_lanes_blocks(void *state, const uint8_t * const *p,
+				uint32_t block_nb)
+{
+	sha256_lanes_body(state, p, block_nb);
+}
+
+#if VB2_SUPPORT_SHA512
+static void sha512_lanes_blocks(void *state, const uint8_t * const *p,
+				uint32_t block_nb)
+{
+	sha512_lanes_body(state, p, block_nb);
+}
+#endif
+
+#ifdef VB2_SHA_MULTI_AVX2
+__attribute__((target("avx2")))
+static void sha256_lanes_blocks_avx2(void *state, const uint8_t * const *p,
+				     uint32_t block_nb)
+{
+	sha256_lanes_body(state, p, block_nb);
+}
+
+#if VB2_SUPPORT_SHA512
+__attribute__((target("avx2")))
+static void sha512_lanes_blocks_avx2(void *state, const uint8_t * const *p,
+				     uint32_t block_nb)
+{
+	sha512_lanes_body(state, p, block_nb);
+}
+#endif
+#else
+#define sha256_lanes_blocks_avx2 NULL
+#define sha512_lanes_blocks_avx2 NULL
+#endif
+
+static void sha256_lane_init(void *state, int lane)
+{
+	struct sha256_lanes *s = state;
+	struct vb2_sha256_context ctx;
+	int i;
+
+	vb2_sha256_init(&ctx);
+	for (i = 0; i < 8; i++)
+		s->h[i][lane] = ctx.h[i];
+}
+
+#if VB2_SUPPORT_SHA512
+static void sha512_lane_init(void *state, int lane)
+{
+	struct sha512_lanes *s = state;
+	struct vb2_sha512_context ctx;
+	int i;
+
+	vb2_sha512_init(&ctx);
+	for (i = 0; i < 8; i++)
+		s->h[i][lane] = ctx.h[i];
+}
+#endif
+
+static void sha256_lane_final(void *state, int lane, const uint8_t *buf,
+			      uint32_t size, uint32_t done, uint8_t *digest)
+{
+	struct sha256_lanes *s = state;
+	struct vb2_sha256_context ctx;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		ctx.h[i] = s->h[i][lane];
+	ctx.total_size = done;
+	ctx.size = 0;
+
+	vb2_sha256_update(&ctx, buf + done, size - done);
+	vb2_sha256_finalize(&ctx, digest);
+}
+
+#if VB2_SUPPORT_SHA512
+static void sha512_lane_final(void *state, int lane, const uint8_t *buf,
+			      uint32_t size, uint32_t done, uint8_t *digest)
+{
+	struct sha512_lanes *s = state;
+	struct vb2_sha512_context ctx;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		ctx.h[i] = s->h[i][lane];
+	ctx.total_size = done;
+	ctx.size = 0;
+
+	vb2_sha512_update(&ctx, buf + done, size - done);
+	vb2_sha512_finalize(&ctx, digest);
+}
+#endif
+
+static const struct multi_ops sha256_ops = {
+	.lanes = SHA256_LANES,
+	.block_size = VB2_SHA256_BLOCK_SIZE,
+	.lane_init = sha256_lane_init,
+	.blocks = sha256_lanes_blocks,
+	.blocks_avx2 = sha256_lanes_blocks_avx2,
+	.lane_final = sha256_lane_final,
+};
+
+#if VB2_SUPPORT_SHA512
+static const struct multi_ops sha512_ops = {
+	.lanes = SHA512_LANES,
+	.block_size = VB2_SHA512_BLOCK_SIZE,
+	.lane_init = sha512_lane_init,
+	.blocks = sha512_lanes_blocks,
+	.blocks_avx2 = sha512_lanes_blocks_avx2,
+	.lane_final = sha512_lane_final,
+};
+#endif
+
+/*
+ * Feed the buffers through the lanes.  Each pass hashes as many blocks as the
+ * shortest busy lane has left, then lanes whose buffer is down to a partial
+ * block finish it one at a time and pick up the next buffer.
+ */
+static void multi_run(const struct multi_ops *ops, void *state,
+		      uint32_t count,
+		      const uint8_t * const *bufs,
+		      const uint32_t *sizes,
+		      uint8_t * const *digests)
+{
+	void (*blocks)(void *state, const uint8_t * const *p,
+		       uint32_t block_nb) = ops->blocks;
+	const uint8_t *p[VB2_DIGEST_MULTI_LANES];
+	uint32_t done[VB2_DIGEST_MULTI_LANES];
+	int64_t job[VB2_DIGEST_MULTI_LANES];
+	uint32_t next = 0;
+	uint32_t block_nb, left;
+	int active, busy, l;
+
+#ifdef VB2_SHA_MULTI_AVX2
+	if (ops->blocks_avx2 && __builtin_cpu_supports("avx2"))
+		blocks = ops->blocks_avx2;
+#endif
+
+	for (l = 0; l < ops->lanes; l++)
+		job[l] = -1;
+
+	for (;;) {
+		active = 0;
+		busy = 0;
+		block_nb = 0;
+
+		for (l = 0; l < ops->lanes; l++) {
+			/* Give an idle lane a buffer with a whole block */
+			while (job[l] < 0 && next < count) {
+				ops->lane_init(state, l);
+				if (sizes[next] < ops->block_size) {
+					ops->lane_final(state, l, bufs[next],
+							sizes[next], 0,
+							digests[next]);
+				} else {
+					job[l] = next;
+					done[l] = 0;
+				}
+				next++;
+			}
+
+			if (job[l] < 0)
+				continue;
+
+			left = (sizes[job[l]] - done[l]) / ops->block_size;
+			if (!active || left < block_nb)
+				block_nb = left;
+			busy = l;
+			active++;
+		}
+
+		if (!active)
+			return;
+
+		/*
+		 * Once the other buffers are used up, a pass for only one or
+		 * two lanes costs more than hashing those on their own.
+		 */
+		if (active * 4 <= ops->lanes) {
+			for (l = 0; l < ops->lanes; l++) {
+				if (job[l] < 0)
+					continue;
+				ops->lane_final(state, l, bufs[job[l]],
+						sizes[job[l]], done[l],
+						digests[job[l]]);
+			}
+			return;
+		}
+
+		/* Idle lanes just hash a busy lane's data again */
+		for (l = 0; l < ops->lanes; l++) {
+			if (job[l] < 0)
+				p[l] = bufs[job[busy]] + done[busy];
+			else
+				p[l] = bufs[job[l]] + done[l];
+		}
+
+		blocks(state, p, block_nb);
+
+		for (l = 0; l < ops->lanes; l++) {
+			if (job[l] < 0)
+				continue;
+
+			done[l] += block_nb * ops->block_size;
+			if (sizes[job[l]] - done[l] >= ops->block_size)
+				continue;
+
+			ops->lane_final(state, l, bufs[job[l]], sizes[job[l]],
+					done[l], digests[job[l]]);
+			job[l] = -1;
+		}
+	}
+}
+
+#endif  /* VB2_SHA_MULTI */
+
+int vb2_digest_multi(enum vb2_hash_algorithm hash_alg,
+		     uint32_t count,
+		     const uint8_t * const *bufs,
+		     const uint32_t *sizes,
+		     uint8_t * const *digests,
+		     uint32_t digest_size)
+{
+	uint32_t i;
+	int rv;
+
+	if (digest_size < vb2_digest_size(hash_alg))
+		return VB2_ERROR_SHA_FINALIZE_DIGEST_SIZE;
+
+#ifdef VB2_SHA_MULTI
+	/*
+	 * Routines from vb2_digest_set_ops() are faster than the lanes, one
+	 * buffer at a time.
+	 */
+	switch (vb2_digest_using_ops() ? VB2_HASH_INVALID : hash_alg) {
+#if VB2_SUPPORT_SHA256
+	case VB2_HASH_SHA256:
+		/*
+		 * The SHA instructions on one buffer at a time are faster
+		 * than all the lanes together.
+		 */
+		if (vb2_sha256_using_cpu_insns())
+			break;
+		{
+			struct sha256_lanes s;
+			multi_run(&sha256_ops, &s, count, bufs, sizes, digests);
+		}
+		return VB2_SUCCESS;
+#endif
+#if VB2_SUPPORT_SHA512
+	case VB2_HASH_SHA512:
+		{
+			struct sha512_lanes s;
+			multi_run(&sha512_ops, &s, count, bufs, sizes, digests);
+		}
+		return VB2_SUCCESS;
+#endif
+	default:
+		break;
+	}
+#endif
+
+	for (i = 0; i < count; i++) {
+		rv = digest_one(hash_alg, bufs[i], sizes[i], digests[i],
+				digest_size);
+		if (rv)
+			return rv;
+	}
+
+	return VB2_SUCCESS;
+}
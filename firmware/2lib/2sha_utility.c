@@ -9,6 +9,7 @@
 #include "2common.h"
 #include "2rsa.h"
 #include "2sha.h"
+#include "2sha_private.h"
 
 #if VB2_SUPPORT_SHA1
 #define CTH_SHA1 VB2_HASH_SHA1
@@ -52,6 +53,19 @@ static const uint8_t crypto_to_hash[] = {
  * the crypto algorithm or its corresponding hash algorithm is invalid or not
  * supported.
  */
+/* Routines to use instead of the ones here, if any */
+static const struct vb2_digest_ops *digest_ops;
+
+void vb2_digest_set_ops(const struct vb2_digest_ops *ops)
+{
+	digest_ops = ops;
+}
+
+int vb2_digest_using_ops(void)
+{
+	return digest_ops ? 1 : 0;
+}
+
 enum vb2_hash_algorithm vb2_crypto_to_hash(uint32_t algorithm)
 {
 	if (algorithm < ARRAY_SIZE(crypto_to_hash))
@@ -74,6 +88,10 @@ int vb2_digest_size(enum vb2_hash_algorithm hash_alg)
 #if VB2_SUPPORT_SHA512
 	case VB2_HASH_SHA512:
 		return VB2_SHA512_DIGEST_SIZE;
+#endif
+#if VB2_SUPPORT_BLAKE2S
+	case VB2_HASH_BLAKE2S:
+		return VB2_BLAKE2S_DIGEST_SIZE;
 #endif
 	default:
 		return 0;
@@ -85,6 +103,17 @@ int vb2_digest_init(struct vb2_digest_context *dc,
 {
 	dc->hash_alg = hash_alg;
 	dc->using_hwcrypto = 0;
+	dc->ops = NULL;
+
+	if (digest_ops && vb2_digest_size(hash_alg)) {
+		int rv = digest_ops->init(dc);
+
+		if (rv != VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED) {
+			if (!rv)
+				dc->ops = digest_ops;
+			return rv;
+		}
+	}
 
 	switch (dc->hash_alg) {
 #if VB2_SUPPORT_SHA1
@@ -101,6 +130,11 @@ int vb2_digest_init(struct vb2_digest_context *dc,
 	case VB2_HASH_SHA512:
 		vb2_sha512_init(&dc->sha512);
 		return VB2_SUCCESS;
+#endif
+#if VB2_SUPPORT_BLAKE2S
+	case VB2_HASH_BLAKE2S:
+		vb2_blake2s_init(&dc->blake2s);
+		return VB2_SUCCESS;
 #endif
 	default:
 		return VB2_ERROR_SHA_INIT_ALGORITHM;
@@ -111,6 +145,12 @@ int vb2_digest_extend(struct vb2_digest_context *dc,
 		      const uint8_t *buf,
 		      uint32_t size)
 {
+	if (dc->hash_alg < VB2_CRYPTO_STATS_HASH_ALGS)
+		VB2_CRYPTO_STATS_ADD(hash_bytes[dc->hash_alg], size);
+
+	if (dc->ops)
+		return dc->ops->extend(dc, buf, size);
+
 	switch (dc->hash_alg) {
 #if VB2_SUPPORT_SHA1
 	case VB2_HASH_SHA1:
@@ -126,6 +166,11 @@ int vb2_digest_extend(struct vb2_digest_context *dc,
 	case VB2_HASH_SHA512:
 		vb2_sha512_update(&dc->sha512, buf, size);
 		return VB2_SUCCESS;
+#endif
+#if VB2_SUPPORT_BLAKE2S
+	case VB2_HASH_BLAKE2S:
+		vb2_blake2s_update(&dc->blake2s, buf, size);
+		return VB2_SUCCESS;
 #endif
 	default:
 		return VB2_ERROR_SHA_EXTEND_ALGORITHM;
@@ -139,6 +184,9 @@ int vb2_digest_finalize(struct vb2_digest_context *dc,
 	if (digest_size < vb2_digest_size(dc->hash_alg))
 		return VB2_ERROR_SHA_FINALIZE_DIGEST_SIZE;
 
+	if (dc->ops)
+		return dc->ops->finalize(dc, digest);
+
 	switch (dc->hash_alg) {
 #if VB2_SUPPORT_SHA1
 	case VB2_HASH_SHA1:
@@ -154,6 +202,11 @@ int vb2_digest_finalize(struct vb2_digest_context *dc,
 	case VB2_HASH_SHA512:
 		vb2_sha512_finalize(&dc->sha512, digest);
 		return VB2_SUCCESS;
+#endif
+#if VB2_SUPPORT_BLAKE2S
+	case VB2_HASH_BLAKE2S:
+		vb2_blake2s_finalize(&dc->blake2s, digest);
+		return VB2_SUCCESS;
 #endif
 	default:
 		return VB2_ERROR_SHA_FINALIZE_ALGORITHM;
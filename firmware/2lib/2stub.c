@@ -21,6 +21,12 @@ void vb2ex_printf(const char *func, const char *fmt, ...)
 	va_end(ap);
 }
 
+__attribute__((weak))
+uint64_t vb2ex_get_timer(void)
+{
+	return 0;
+}
+
 __attribute__((weak))
 int vb2ex_tpm_clear_owner(struct vb2_context *ctx)
 {
@@ -37,6 +43,16 @@ int vb2ex_read_resource(struct vb2_context *ctx,
 	return VB2_ERROR_EX_READ_RESOURCE_UNIMPLEMENTED;
 }
 
+__attribute__((weak))
+int vb2ex_map_resource(struct vb2_context *ctx,
+		       enum vb2_resource_index index,
+		       uint32_t offset,
+		       const void **ptr,
+		       uint32_t *size)
+{
+	return VB2_ERROR_EX_MAP_RESOURCE_UNSUPPORTED;
+}
+
 __attribute__((weak))
 int vb2ex_hwcrypto_digest_init(enum vb2_hash_algorithm hash_alg,
 			       uint32_t data_size)
@@ -51,9 +67,36 @@ int vb2ex_hwcrypto_digest_extend(const uint8_t *buf,
 	return VB2_ERROR_SHA_EXTEND_ALGORITHM;	/* Should not be called. */
 }
 
+__attribute__((weak))
+int vb2ex_hwcrypto_digest_region(struct vb2_context *ctx,
+				 const struct vb2_region *regions,
+				 uint32_t count)
+{
+	return VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+}
+
 __attribute__((weak))
 int vb2ex_hwcrypto_digest_finalize(uint8_t *digest,
 				   uint32_t digest_size)
 {
 	return VB2_ERROR_SHA_FINALIZE_ALGORITHM; /* Should not be called. */
 }
+
+__attribute__((weak))
+int vb2ex_hwcrypto_rsa_verify(const struct vb2_public_key *key,
+			      const uint8_t *sig,
+			      const uint8_t *digest)
+{
+	return VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+}
+
+__attribute__((weak))
+int vb2ex_digest_multi(enum vb2_hash_algorithm hash_alg,
+		       uint32_t count,
+		       const uint8_t * const *bufs,
+		       const uint32_t *sizes,
+		       uint8_t * const *digests,
+		       uint32_t digest_size)
+{
+	return VB2_ERROR_EX_DIGEST_MULTI_UNSUPPORTED;
+}
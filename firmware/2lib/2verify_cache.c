@@ -0,0 +1,131 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Cache of firmware keyblock and preamble verification results
+ */
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2crc8.h"
+#include "2misc.h"
+#include "2sha.h"
+#include "2verify_cache.h"
+
+int vb2_verify_cache_digest(const void *buf1, uint32_t size1,
+			    const void *buf2, uint32_t size2,
+			    uint8_t *digest,
+			    const struct vb2_workbuf *wb)
+{
+	struct vb2_workbuf wblocal = *wb;
+	struct vb2_digest_context *dc;
+	int rv;
+
+	dc = vb2_workbuf_alloc(&wblocal, sizeof(*dc));
+	if (!dc)
+		return VB2_ERROR_VERIFY_CACHE_WORKBUF;
+
+	rv = vb2_digest_init(dc, VB2_HASH_SHA256);
+	if (!rv)
+		rv = vb2_digest_extend(dc, buf1, size1);
+	if (!rv && size2)
+		rv = vb2_digest_extend(dc, buf2, size2);
+	if (!rv)
+		rv = vb2_digest_finalize(dc, digest, VB2_SHA256_DIGEST_SIZE);
+
+	return rv;
+}
+
+/* Check the cache is enabled and valid, and is for this slot */
+static int check_cache(struct vb2_context *ctx)
+{
+	const struct vb2_verify_cache *vc =
+		(const struct vb2_verify_cache *)ctx->verify_cache;
+
+	if (!(ctx->flags & VB2_CONTEXT_VERIFY_CACHE))
+		return VB2_ERROR_VERIFY_CACHE_DISABLED;
+
+	if (vc->magic != VB2_VERIFY_CACHE_MAGIC ||
+	    vc->struct_version != VB2_VERIFY_CACHE_VERSION ||
+	    vc->crc8 != vb2_crc8(vc, offsetof(struct vb2_verify_cache, crc8)))
+		return VB2_ERROR_VERIFY_CACHE_INVALID;
+
+	if (vc->fw_slot != vb2_get_sd(ctx)->fw_slot)
+		return VB2_ERROR_VERIFY_CACHE_MISS;
+
+	return VB2_SUCCESS;
+}
+
+int vb2_verify_cache_check_keyblock(struct vb2_context *ctx,
+				    const uint8_t *digest)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	const struct vb2_verify_cache *vc =
+		(const struct vb2_verify_cache *)ctx->verify_cache;
+	int rv;
+
+	memcpy(sd->verify_cache_keyblock_digest, digest,
+	       VB2_SHA256_DIGEST_SIZE);
+	sd->status &= ~VB2_SD_STATUS_KEYBLOCK_CACHED;
+
+	rv = check_cache(ctx);
+	if (rv)
+		return rv;
+
+	if (vb2_safe_memcmp(vc->keyblock_digest, digest,
+			    VB2_SHA256_DIGEST_SIZE))
+		return VB2_ERROR_VERIFY_CACHE_MISS;
+
+	sd->status |= VB2_SD_STATUS_KEYBLOCK_CACHED;
+	return VB2_SUCCESS;
+}
+
+int vb2_verify_cache_check_preamble(struct vb2_context *ctx,
+				    const uint8_t *digest)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	const struct vb2_verify_cache *vc =
+		(const struct vb2_verify_cache *)ctx->verify_cache;
+	int rv;
+
+	sd->status &= ~VB2_SD_STATUS_PREAMBLE_CACHED;
+
+	if (!(sd->status & VB2_SD_STATUS_KEYBLOCK_CACHED))
+		return VB2_ERROR_VERIFY_CACHE_MISS;
+
+	rv = check_cache(ctx);
+	if (rv)
+		return rv;
+
+	if (vb2_safe_memcmp(vc->preamble_digest, digest,
+			    VB2_SHA256_DIGEST_SIZE))
+		return VB2_ERROR_VERIFY_CACHE_MISS;
+
+	sd->status |= VB2_SD_STATUS_PREAMBLE_CACHED;
+	return VB2_SUCCESS;
+}
+
+void vb2_verify_cache_save(struct vb2_context *ctx, const uint8_t *digest)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	struct vb2_verify_cache vc;
+
+	if (!(ctx->flags & VB2_CONTEXT_VERIFY_CACHE))
+		return;
+
+	memset(&vc, 0, sizeof(vc));
+	vc.magic = VB2_VERIFY_CACHE_MAGIC;
+	vc.struct_version = VB2_VERIFY_CACHE_VERSION;
+	vc.fw_slot = sd->fw_slot;
+	vc.fw_version = sd->fw_version;
+	memcpy(vc.keyblock_digest, sd->verify_cache_keyblock_digest,
+	       VB2_SHA256_DIGEST_SIZE);
+	memcpy(vc.preamble_digest, digest, VB2_SHA256_DIGEST_SIZE);
+	vc.crc8 = vb2_crc8(&vc, offsetof(struct vb2_verify_cache, crc8));
+
+	/* Only make the caller write it back if it changed */
+	if (memcmp(ctx->verify_cache, &vc, sizeof(vc))) {
+		memcpy(ctx->verify_cache, &vc, sizeof(vc));
+		ctx->flags |= VB2_CONTEXT_VERIFY_CACHE_CHANGED;
+	}
+}
@@ -28,12 +28,17 @@
 #include "2recovery_reasons.h"
 #include "2return_codes.h"
 
+struct vb2_public_key;
+
 /* Size of non-volatile data used by vboot */
 #define VB2_NVDATA_SIZE 16
 
 /* Size of secure data used by vboot */
 #define VB2_SECDATA_SIZE 10
 
+/* Size of firmware verification cache; see struct vb2_verify_cache */
+#define VB2_VERIFY_CACHE_SIZE 80
+
 /*
  * Recommended size of work buffer.
  *
@@ -87,6 +92,20 @@ enum vb2_context_flags {
 
 	/* RAM should be cleared by caller this boot */
 	VB2_CONTEXT_CLEAR_RAM = (1 << 7),
+
+	/*
+	 * Caller filled verify_cache[] from trusted storage which survives
+	 * warm reboot and S3, so the firmware keyblock and preamble need not
+	 * be verified again if they haven't changed.  Caller may set this
+	 * flag when initializing the context.
+	 */
+	VB2_CONTEXT_VERIFY_CACHE = (1 << 8),
+
+	/*
+	 * Verified boot has changed verify_cache[].  Caller must save
+	 * verify_cache[] back to its trusted storage, then clear this flag.
+	 */
+	VB2_CONTEXT_VERIFY_CACHE_CHANGED = (1 << 9),
 };
 
 /*
@@ -148,6 +167,30 @@ struct vb2_context {
 	 * copied when relocating the work buffer.
 	 */
 	uint32_t workbuf_used;
+
+	/**********************************************************************
+	 * Fields added since, which caller must initialize like the ones at
+	 * the top.  New fields go at the end, so the ones above stay where
+	 * callers built against an older version of this struct expect them.
+	 */
+
+	/*
+	 * Firmware verification cache.  Only used if the
+	 * VB2_CONTEXT_VERIFY_CACHE flag is set.  Caller must fill this from
+	 * storage which only trusted firmware can write, and save it back if
+	 * the VB2_CONTEXT_VERIFY_CACHE_CHANGED flag is set.
+	 */
+	uint8_t verify_cache[VB2_VERIFY_CACHE_SIZE];
+
+	/*
+	 * Number of bytes at the start of the verified boot block to read in
+	 * one go, or 0 to read only what each step needs.  If the keyblock
+	 * and preamble both fit, vb2api_fw_phase3() reads the vblock once
+	 * instead of three or four times.  Pick a size which covers the
+	 * platform's usual keyblock and preamble without running past the end
+	 * of the resource; this much work buffer is needed while it's in use.
+	 */
+	uint32_t vblock_prefix_size;
 };
 
 enum vb2_resource_index {
@@ -161,6 +204,21 @@ enum vb2_resource_index {
 	 * set that flag to the proper state before reading the vblock.
 	 */
 	VB2_RES_FW_VBLOCK,
+
+	/*
+	 * Firmware body.  As with VB2_RES_FW_VBLOCK, VB2_CONTEXT_FW_SLOT_B
+	 * says which slot.  Only read by vb2api_hash_regions().
+	 */
+	VB2_RES_FW_BODY,
+};
+
+/* Part of a resource, for vb2api_hash_regions() */
+struct vb2_region {
+	/* Byte offset within the resource */
+	uint32_t offset;
+
+	/* Size in bytes */
+	uint32_t size;
 };
 
 /* Digest ID for vbapi_get_pcr_digest() */
@@ -350,6 +408,123 @@ int vb2api_extend_hash(struct vb2_context *ctx,
  */
 int vb2api_check_hash(struct vb2_context *ctx);
 
+/**
+ * Extend the hash started by vb2api_init_hash() with parts of the body.
+ *
+ * Instead of reading the body and passing it to vb2api_extend_hash(), the
+ * caller can describe where it is as a list of regions of VB2_RES_FW_BODY,
+ * in the order they should be hashed.  If the hash is running on the hardware
+ * crypto engine, the whole list goes to vb2ex_hwcrypto_digest_region() in one
+ * call, so a platform can DMA straight from flash to the engine.  Otherwise
+ * (or if that returns VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED), the regions are read
+ * with vb2ex_read_resource() into the free part of the work buffer, as much at
+ * a time as fits, and hashed in software.
+ *
+ * @param ctx		Vboot context
+ * @param regions	Regions to hash
+ * @param count		Number of regions
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb2api_hash_regions(struct vb2_context *ctx,
+			const struct vb2_region *regions,
+			uint32_t count);
+
+/**
+ * Verify a firmware slot without booting it.
+ *
+ * This checks the keyblock, preamble and body of the given slot, the same way
+ * vb2api_fw_phase3() and the hash calls would, so an updater can find out
+ * whether a slot is bootable before rebooting into it.  Call it in place of
+ * vb2api_fw_phase2(), after vb2api_fw_phase1().  The context can only verify
+ * one slot; to check both slots at once, set up one context (and work
+ * buffer) per slot and call this for each from its own thread.  In that case
+ * vb2ex_read_resource() must be safe to call from several threads, and can
+ * serve both from a single read of the flash image.
+ *
+ * Verification may change nvdata and secdata (for example, to request
+ * recovery when a slot is bad).  The caller should discard those changes
+ * instead of saving them.  The verification cache is not used.
+ *
+ * @param ctx		Vboot context
+ * @param slot		Slot to verify (0=A, 1=B)
+ * @param body		Firmware body for the slot
+ * @param body_size	Size of body in bytes; must be at least the size
+ *			signed in the preamble.
+ * @return VB2_SUCCESS if the slot is bootable, or error code on error.
+ */
+int vb2api_verify_fw_slot(struct vb2_context *ctx,
+			  int slot,
+			  const void *body,
+			  uint32_t body_size);
+
+/*
+ * A new-style preamble may hash a component in blocks, by listing several
+ * hashes with the component's GUID.  The first covers the start of the
+ * component, and each one after that covers the data following the last.
+ * Since the preamble signature covers all the hashes, each block can be
+ * checked on its own, as it's needed, instead of hashing the whole component
+ * up front.  vb2api_init_hash2() refuses components hashed in blocks, since
+ * it would only check the first block.
+ */
+
+/**
+ * Find where a block of a component hashed in blocks is.
+ *
+ * @param ctx		Vboot context
+ * @param guid		Component GUID
+ * @param block		Block number (0...N-1)
+ * @param offset	Offset of the block in the component is stored here
+ * @param size		Size of the block in bytes is stored here
+ * @return VB2_SUCCESS, or VB2_ERROR_API_HASH_BLOCK_NUM if the component
+ *	   doesn't have that many blocks.
+ */
+int vb2api_get_hash_block(struct vb2_context *ctx,
+			  const struct vb2_guid *guid,
+			  uint32_t block,
+			  uint32_t *offset,
+			  uint32_t *size);
+
+/**
+ * Check one block of a component hashed in blocks.
+ *
+ * This doesn't touch the hash started by vb2api_init_hash2(), so blocks can
+ * be checked in any order, in between calls to vb2api_extend_hash().
+ *
+ * @param ctx		Vboot context
+ * @param guid		Component GUID
+ * @param block		Block number (0...N-1)
+ * @param buf		Block data
+ * @param size		Size of block data in bytes
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb2api_check_hash_block(struct vb2_context *ctx,
+			    const struct vb2_guid *guid,
+			    uint32_t block,
+			    const void *buf,
+			    uint32_t size);
+
+/**
+ * Check every block of a component hashed in blocks.
+ *
+ * The blocks don't depend on each other, so they're all handed to
+ * vb2ex_digest_multi() at once, for a platform to spread across whatever
+ * cores it has running.  If that returns VB2_ERROR_EX_DIGEST_MULTI_UNSUPPORTED,
+ * they're hashed on this core with vb2_digest_multi().  Nothing is compared
+ * until all the digests are in.  Like vb2api_check_hash_block(), this doesn't
+ * touch the hash started by vb2api_init_hash2().
+ *
+ * @param ctx		Vboot context
+ * @param guid		Component GUID
+ * @param buf		Component data
+ * @param size		Size of component data in bytes; must be the total
+ *			size of its blocks.
+ * @return VB2_SUCCESS, or error code on error.
+ */
+int vb2api_check_hash_blocks(struct vb2_context *ctx,
+			     const struct vb2_guid *guid,
+			     const void *buf,
+			     uint32_t size);
+
 /**
  * Get a PCR digest
  *
@@ -366,6 +541,42 @@ int vb2api_get_pcr_digest(struct vb2_context *ctx,
 			  uint8_t *dest,
 			  uint32_t *dest_size);
 
+/**
+ * Get the digest of the data last verified by vb2api_check_hash()
+ *
+ * For measured boot, this lets the caller extend the digest vboot already
+ * computed for the firmware body, instead of hashing the body again.
+ *
+ * @param ctx		Vboot context
+ * @param hash_alg	Hash algorithm of the digest is stored here
+ * @param dest		Destination where the digest is copied.
+ *			VB2_SHA512_DIGEST_SIZE is always large enough.
+ * @param dest_size	IN: size of the buffer pointed by dest
+ *			OUT: size of the copied digest
+ * @return VB2_SUCCESS, VB2_ERROR_API_BODY_DIGEST if vb2api_check_hash() hasn't
+ * succeeded, or VB2_ERROR_API_BODY_DIGEST_BUF if dest is too small.
+ */
+int vb2api_get_body_digest(struct vb2_context *ctx,
+			   enum vb2_hash_algorithm *hash_alg,
+			   uint8_t *dest,
+			   uint32_t *dest_size);
+
+/**
+ * Find out whether the body last verified by vb2api_check_hash() is
+ * compressed.
+ *
+ * If the preamble has VB2_FIRMWARE_PREAMBLE_BODY_COMPRESSED, the body is
+ * stored as an LZMA1 stream, and hashed and verified that way, so less of it
+ * is read from flash.  The caller decompresses it only after verification,
+ * which is why this fails until the body has been verified.
+ *
+ * @param ctx		Vboot context
+ * @param compressed	Non-zero is stored here if the body is compressed
+ * @return VB2_SUCCESS, or VB2_ERROR_API_BODY_COMPRESSION if
+ * vb2api_check_hash() hasn't succeeded.
+ */
+int vb2api_get_body_compression(struct vb2_context *ctx, int *compressed);
+
 /*****************************************************************************/
 /* APIs provided by the caller to verified boot */
 
@@ -393,8 +604,42 @@ int vb2ex_read_resource(struct vb2_context *ctx,
 			void *buf,
 			uint32_t size);
 
+/**
+ * Map a verified boot resource into memory, if the platform can.
+ *
+ * Where firmware storage is memory-mapped, such as SPI flash on x86, this lets
+ * keyblocks and preambles be verified in place instead of being read into the
+ * work buffer first.  Mapped data is only read.  Its contents must not change
+ * until the vb2api_fw_phase*() call which mapped it returns, so only map
+ * storage which nothing else can write during boot.
+ *
+ * @param ctx		Vboot context
+ * @param index		Resource index to map
+ * @param offset	Byte offset within resource to start at
+ * @param ptr		Destination for pointer to the data at offset
+ * @param size		Destination for number of bytes mapped at ptr
+ * @return VB2_SUCCESS, VB2_ERROR_EX_MAP_RESOURCE_UNSUPPORTED if the resource
+ * should be read with vb2ex_read_resource() instead, or other non-zero error
+ * code on error.
+ */
+int vb2ex_map_resource(struct vb2_context *ctx,
+		       enum vb2_resource_index index,
+		       uint32_t offset,
+		       const void **ptr,
+		       uint32_t *size);
+
 void vb2ex_printf(const char *func, const char *fmt, ...);
 
+/**
+ * Read a high-resolution timer, for timing boot phases.
+ *
+ * This should use the same timer as VbExGetTimer(), so vboot1 and vboot2
+ * timestamps can be compared.
+ *
+ * @return The current timer value, in arbitrary units.
+ */
+uint64_t vb2ex_get_timer(void);
+
 /**
  * Initialize the hardware crypto engine to calculate a block-style digest.
  *
@@ -414,6 +659,23 @@ int vb2ex_hwcrypto_digest_init(enum vb2_hash_algorithm hash_alg,
  */
 int vb2ex_hwcrypto_digest_extend(const uint8_t *buf, uint32_t size);
 
+/**
+ * Extend the hash in the hardware crypto engine with parts of the body.
+ *
+ * This takes the data straight from firmware storage, for platforms which can
+ * feed the engine from flash themselves.  Regions are hashed in list order.
+ *
+ * @param ctx		Vboot context; VB2_CONTEXT_FW_SLOT_B gives the slot
+ * @param regions	Regions of VB2_RES_FW_BODY to hash
+ * @param count		Number of regions
+ * @return VB2_SUCCESS, VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED if the platform
+ * can't (so the regions are read and extended instead), or another non-zero
+ * error code.
+ */
+int vb2ex_hwcrypto_digest_region(struct vb2_context *ctx,
+				 const struct vb2_region *regions,
+				 uint32_t count);
+
 /**
  * Finalize the digest in the hardware crypto engine and extract the result.
  *
@@ -423,4 +685,49 @@ int vb2ex_hwcrypto_digest_extend(const uint8_t *buf, uint32_t size);
  */
 int vb2ex_hwcrypto_digest_finalize(uint8_t *digest, uint32_t digest_size);
 
+/**
+ * Verify an RSA signature of a digest using the hardware crypto engine.
+ *
+ * This is tried before verifying the signature in software.  It must check
+ * the PKCS #1 v1.5 padding as well as the digest inside it, and must not
+ * modify the signature.
+ *
+ * @param key		Key to use; key->sig_alg gives the modulus size
+ * @param sig		Signature, vb2_rsa_sig_size(key->sig_alg) bytes
+ * @param digest	Digest of the signed data, using key->hash_alg
+ * @return VB2_SUCCESS if the signature is good, VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED
+ * if the engine can't handle the key (so it's verified in software), or
+ * another non-zero error code if the signature is bad.
+ */
+int vb2ex_hwcrypto_rsa_verify(const struct vb2_public_key *key,
+			      const uint8_t *sig,
+			      const uint8_t *digest);
+
+/**
+ * Calculate the digests of several independent buffers on other CPU cores.
+ *
+ * This takes the same arguments as vb2_digest_multi(), and must give the same
+ * results.  A platform which has brought up secondary cores can split the
+ * buffers between them (and this one), for example by having each core call
+ * vb2_digest_multi() on its share, and return once every digest is written.
+ * Hash in software; the hardware crypto engine may be in the middle of the
+ * body hash.
+ *
+ * @param hash_alg	Hash algorithm
+ * @param count		Number of buffers
+ * @param bufs		Data to hash, one pointer per buffer
+ * @param sizes		Length of each buffer in bytes
+ * @param digests	Destination for each digest
+ * @param digest_size	Length of each digest buffer in bytes
+ * @return VB2_SUCCESS, VB2_ERROR_EX_DIGEST_MULTI_UNSUPPORTED if there are no
+ * other cores (so the buffers are hashed on this one instead), or another
+ * non-zero error code.
+ */
+int vb2ex_digest_multi(enum vb2_hash_algorithm hash_alg,
+		       uint32_t count,
+		       const uint8_t * const *bufs,
+		       const uint32_t *sizes,
+		       uint8_t * const *digests,
+		       uint32_t digest_size);
+
 #endif  /* VBOOT_2_API_H_ */
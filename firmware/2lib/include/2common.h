@@ -9,6 +9,7 @@
 #define VBOOT_REFERENCE_VBOOT_2COMMON_H_
 
 #include "2api.h"
+#include "2ed25519.h"
 #include "2return_codes.h"
 #include "2sha.h"
 #include "2struct.h"
@@ -119,6 +120,48 @@ void *vb2_workbuf_realloc(struct vb2_workbuf *wb,
  */
 void vb2_workbuf_free(struct vb2_workbuf *wb, uint32_t size);
 
+#ifdef VB2_WORKBUF_STATS
+/*
+ * Instrumented builds (WORKBUF_STATS=1) track the highest address
+ * vb2_workbuf_alloc() has handed out, so host tools can measure how much of
+ * a work buffer a call really needs.
+ */
+
+/**
+ * Forget the high-water mark.
+ */
+void vb2_workbuf_stats_reset(void);
+
+/**
+ * Return the high-water mark since the last reset.
+ *
+ * @param buf		Start of the work buffer being measured
+ * @return Bytes from buf to the high-water mark, or 0 if none were used.
+ */
+uint32_t vb2_workbuf_stats_peak(const void *buf);
+#endif
+
+#ifdef VB2_CRYPTO_STATS
+/*
+ * Instrumented builds (CRYPTO_STATS=1) count the crypto work done here, until
+ * vb2_crypto_stats_flush() moves it into the shared data.
+ */
+extern struct vb2_crypto_stats vb2_crypto_stats;
+#define VB2_CRYPTO_STATS_ADD(field, n) (vb2_crypto_stats.field += (n))
+#else
+#define VB2_CRYPTO_STATS_ADD(field, n) do {} while (0)
+#endif
+
+/**
+ * Add the crypto work counted since the last flush to a struct, and start
+ * counting again from zero.
+ *
+ * Does nothing in builds without VB2_CRYPTO_STATS.
+ *
+ * @param dest		Counts to add to
+ */
+void vb2_crypto_stats_flush(struct vb2_crypto_stats *dest);
+
 /* Check if a pointer is aligned on an align-byte boundary */
 #define vb2_aligned(ptr, align) (!(((uintptr_t)(ptr)) & ((align) - 1)))
 
@@ -180,7 +223,9 @@ uint32_t vb2_sig_size(enum vb2_signature_algorithm sig_alg,
 const struct vb2_guid *vb2_hash_guid(enum vb2_hash_algorithm hash_alg);
 
 /* Size of work buffer sufficient for vb2_verify_digest() worst case. */
-#define VB2_VERIFY_DIGEST_WORKBUF_BYTES VB2_VERIFY_RSA_DIGEST_WORKBUF_BYTES
+#define VB2_VERIFY_DIGEST_WORKBUF_BYTES				\
+	VB2_MAX(VB2_VERIFY_RSA_DIGEST_WORKBUF_BYTES,			\
+		VB2_VERIFY_ED25519_WORKBUF_BYTES)
 
 /* Size of work buffer sufficient for vb2_verify_data() worst case. */
 #define VB2_VERIFY_DATA_WORKBUF_BYTES					\
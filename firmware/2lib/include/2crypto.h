@@ -44,6 +44,12 @@ enum vb2_signature_algorithm {
 	VB2_SIG_RSA2048 = 3,
 	VB2_SIG_RSA4096 = 4,
 	VB2_SIG_RSA8192 = 5,
+
+	/*
+	 * Ed25519 (RFC 8032) signature of the digest.  Keys are 32 bytes and
+	 * signatures 64 bytes.
+	 */
+	VB2_SIG_ED25519 = 6,
 };
 
 /* Algorithm types for hash digests */
@@ -57,6 +63,12 @@ enum vb2_hash_algorithm {
 	/* SHA-256 and SHA-512 */
 	VB2_HASH_SHA256 = 2,
 	VB2_HASH_SHA512 = 3,
+
+	/*
+	 * BLAKE2s-256 (RFC 7693).  Much faster than SHA-256 in software on
+	 * CPUs without SHA instructions, for signing large bodies.
+	 */
+	VB2_HASH_BLAKE2S = 4,
 };
 
 #endif /* VBOOT_REFERENCE_VBOOT_2CRYPTO_H_ */
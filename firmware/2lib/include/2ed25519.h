@@ -0,0 +1,51 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Ed25519 signatures (RFC 8032)
+ */
+
+#ifndef VBOOT_REFERENCE_2ED25519_H_
+#define VBOOT_REFERENCE_2ED25519_H_
+
+#include "2sha.h"
+
+struct vb2_workbuf;
+
+/* Ed25519 hashes with SHA-512, so needs that too */
+#ifndef VB2_SUPPORT_ED25519
+#define VB2_SUPPORT_ED25519 VB2_SUPPORT_SHA512
+#endif
+
+#define VB2_ED25519_PUBLIC_KEY_SIZE 32
+#define VB2_ED25519_SIG_SIZE 64
+
+/*
+ * Size of work buffer sufficient for vb2_ed25519_verify(): four points of
+ * four 16-limb field elements and a SHA-512 context, rounded up the way
+ * vb2_workbuf_alloc() does.
+ */
+#define VB2_VERIFY_ED25519_WORKBUF_BYTES				\
+	((4 * 4 * 16 * sizeof(int64_t) + sizeof(struct vb2_sha512_context) + \
+	  VB2_WORKBUF_ALIGN - 1) & ~(VB2_WORKBUF_ALIGN - 1))
+
+/**
+ * Verify an Ed25519 signature.
+ *
+ * vboot signs the digest of the data rather than the data itself, so [msg]
+ * is normally a digest; it's hashed again with SHA-512 as RFC 8032 requires.
+ *
+ * @param public_key	Public key, VB2_ED25519_PUBLIC_KEY_SIZE bytes
+ * @param sig		Signature, VB2_ED25519_SIG_SIZE bytes
+ * @param msg		Signed message
+ * @param size		Size of message in bytes
+ * @param wb		Work buffer
+ * @return VB2_SUCCESS, or non-zero if error.
+ */
+int vb2_ed25519_verify(const uint8_t *public_key,
+		       const uint8_t *sig,
+		       const uint8_t *msg,
+		       uint32_t size,
+		       const struct vb2_workbuf *wb);
+
+#endif  /* VBOOT_REFERENCE_2ED25519_H_ */
@@ -0,0 +1,36 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Ed25519 internals which the host library needs for signing.  Firmware
+ * only verifies, so doesn't call these.
+ */
+
+#ifndef VBOOT_REFERENCE_2ED25519_PRIVATE_H_
+#define VBOOT_REFERENCE_2ED25519_PRIVATE_H_
+
+/**
+ * Encode the point [scalar]B, where B is the base point.  Constant time.
+ *
+ * @param out		Destination for encoded point; 32 bytes
+ * @param scalar	Little endian scalar; 32 bytes
+ */
+void vb2_ed25519_scalarmult_base(uint8_t *out, const uint8_t *scalar);
+
+/**
+ * Reduce a 64-byte little endian number mod L, the order of the group.
+ *
+ * @param out		Destination for result; 32 bytes.  May be in.
+ * @param in		Number to reduce; 64 bytes
+ */
+void vb2_ed25519_reduce(uint8_t *out, const uint8_t *in);
+
+/**
+ * Compute (a * b + c) mod L, all 32-byte little endian numbers.
+ *
+ * @param out		Destination for result; 32 bytes
+ */
+void vb2_ed25519_muladd(uint8_t *out, const uint8_t *a, const uint8_t *b,
+			const uint8_t *c);
+
+#endif  /* VBOOT_REFERENCE_2ED25519_PRIVATE_H_ */
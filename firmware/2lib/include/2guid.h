@@ -39,4 +39,7 @@ struct vb2_guid {
 #define VB2_GUID_NONE_SHA512 \
 	{{{0x1c695960,0x6093,0x11e4,0x82,0x63,{0xdb,0xee,0xe9,0x3c,0xcd,0x7e}}}}
 
+#define VB2_GUID_NONE_BLAKE2S \
+	{{{0x2bc9052c,0xa08f,0x4a26,0xbf,0x73,{0xf3,0xd4,0x93,0x48,0x86,0x9e}}}}
+
 #endif  /* VBOOT_REFERENCE_VBOOT_2GUID_H_ */
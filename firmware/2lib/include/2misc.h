@@ -50,6 +50,42 @@ void vb2_workbuf_from_ctx(struct vb2_context *ctx, struct vb2_workbuf *wb);
  */
 int vb2_read_gbb_header(struct vb2_context *ctx, struct vb2_gbb_header *gbb);
 
+/**
+ * Read the start of the vblock in one go, if the caller asked for that.
+ *
+ * Reads ctx->vblock_prefix_size bytes into a buffer allocated from the work
+ * buffer, so later reads of the keyblock and preamble can be served from it
+ * with vb2_vblock_prefix().  If that's 0, there isn't enough work buffer, or
+ * the read fails, no prefix is kept and callers just read what they need.
+ *
+ * @param ctx		Vboot context
+ * @param wb		Work buffer to allocate the prefix from
+ */
+void vb2_read_vblock_prefix(struct vb2_context *ctx, struct vb2_workbuf *wb);
+
+/**
+ * Find part of the vblock in the prefix read by vb2_read_vblock_prefix().
+ *
+ * @param ctx		Vboot context
+ * @param offset	Byte offset within the vblock
+ * @param size		Number of bytes needed
+ * @return A pointer to the data in the work buffer, or NULL if it isn't all
+ * in the prefix.
+ */
+void *vb2_vblock_prefix(struct vb2_context *ctx,
+			uint32_t offset,
+			uint32_t size);
+
+/**
+ * Forget the vblock prefix and give its work buffer space back.
+ *
+ * The prefix must be the last thing in the work buffer, directly after the
+ * data key.
+ *
+ * @param ctx		Vboot context
+ */
+void vb2_free_vblock_prefix(struct vb2_context *ctx);
+
 /**
  * Handle vboot failure.
  *
@@ -76,6 +112,16 @@ void vb2_fail(struct vb2_context *ctx, uint8_t reason, uint8_t subcode);
  */
 int vb2_init_context(struct vb2_context *ctx);
 
+/**
+ * Record the time a boot phase boundary was reached.
+ *
+ * Does nothing if the context hasn't been initialized yet.
+ *
+ * @param ctx		Vboot context
+ * @param id		Which boundary was reached
+ */
+void vb2_record_timestamp(struct vb2_context *ctx, enum vb2_timestamp_id id);
+
 /**
  * Check for recovery reasons we can determine early in the boot process.
  *
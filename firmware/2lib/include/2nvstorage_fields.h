@@ -13,10 +13,8 @@
  * the data format is consistent across platforms and compilers.  Total NV
  * storage size is VB2_NVDATA_SIZE = 16 bytes.
  *
- * These constants must match the equivalent constants in
- * lib/vboot_nvstorage.c.  (We currently don't share a common header file
- * because we're tring to keep the two libs independent, and we hope to
- * deprecate that one.)
+ * lib/vboot_nvstorage.c uses the same layout, from this header.  Neither lib
+ * needs anything else from the other to do so.
  */
 
 enum vb2_nv_offset {
@@ -64,4 +62,146 @@ enum vb2_nv_offset {
 #define VB2_NV_TPM_CLEAR_OWNER_REQUEST         0x01
 #define VB2_NV_TPM_CLEAR_OWNER_DONE            0x02
 
+/*
+ * Descriptors for each field, so getting and setting a field is a table
+ * lookup instead of code per field.
+ */
+
+/* What storing a value too big for a field does */
+enum vb2_nv_range {
+	/* Store the largest value the field can hold (so any non-zero value
+	 * sets a single-bit flag) */
+	VB2_NV_RANGE_CLIP = 0,
+	/* Store the field's invalid value instead */
+	VB2_NV_RANGE_INVALID,
+	/* Store the low bits of the value */
+	VB2_NV_RANGE_TRUNCATE,
+};
+
+struct vb2_nv_field {
+	uint8_t offs;		/* Offset of the (first) byte of the field */
+	uint8_t mask;		/* Bits of the field in that byte */
+	uint8_t shift;		/* Bit position of the low bit of the field */
+	uint8_t size;		/* 1, or 4 for a 32-bit little-endian field */
+	uint8_t range;		/* enum vb2_nv_range */
+	uint8_t invalid;	/* Value for VB2_NV_RANGE_INVALID */
+};
+
+/* Position of the low bit of a one-byte mask, as a constant expression */
+#define VB2_NV_SHIFT(mask)						\
+	((mask) & 0x01 ? 0 : (mask) & 0x02 ? 1 : (mask) & 0x04 ? 2 :	\
+	 (mask) & 0x08 ? 3 : (mask) & 0x10 ? 4 : (mask) & 0x20 ? 5 :	\
+	 (mask) & 0x40 ? 6 : 7)
+
+#define VB2_NV_FIELD(offs, mask, range, invalid)			\
+	{ offs, mask, VB2_NV_SHIFT(mask), 1, range, invalid }
+#define VB2_NV_FLAG(offs, mask)						\
+	VB2_NV_FIELD(offs, mask, VB2_NV_RANGE_CLIP, 0)
+
+/* The fields, for the tables of both libs */
+#define VB2_NV_FIELD_FIRMWARE_SETTINGS_RESET				\
+	VB2_NV_FLAG(VB2_NV_OFFS_HEADER, VB2_NV_HEADER_FW_SETTINGS_RESET)
+#define VB2_NV_FIELD_KERNEL_SETTINGS_RESET				\
+	VB2_NV_FLAG(VB2_NV_OFFS_HEADER, VB2_NV_HEADER_KERNEL_SETTINGS_RESET)
+#define VB2_NV_FIELD_DEBUG_RESET_MODE					\
+	VB2_NV_FLAG(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_DEBUG_RESET)
+#define VB2_NV_FIELD_TRY_COUNT						\
+	VB2_NV_FIELD(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_TRY_COUNT_MASK,	\
+		     VB2_NV_RANGE_CLIP, 0)
+#define VB2_NV_FIELD_BACKUP_NVRAM_REQUEST				\
+	VB2_NV_FLAG(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_BACKUP_NVRAM)
+#define VB2_NV_FIELD_OPROM_NEEDED					\
+	VB2_NV_FLAG(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_OPROM_NEEDED)
+#define VB2_NV_FIELD_DISABLE_DEV_REQUEST				\
+	VB2_NV_FLAG(VB2_NV_OFFS_BOOT, VB2_NV_BOOT_DISABLE_DEV)
+/* Out of range values become the legacy reason, since we can't tell if
+ * we're called from kernel or user mode. */
+#define VB2_NV_FIELD_RECOVERY_REQUEST					\
+	VB2_NV_FIELD(VB2_NV_OFFS_RECOVERY, 0xff, VB2_NV_RANGE_INVALID,	\
+		     0x01 /* VB2_RECOVERY_LEGACY */)
+#define VB2_NV_FIELD_RECOVERY_SUBCODE					\
+	VB2_NV_FIELD(VB2_NV_OFFS_RECOVERY_SUBCODE, 0xff,		\
+		     VB2_NV_RANGE_TRUNCATE, 0)
+/* Out of range values become the default index */
+#define VB2_NV_FIELD_LOCALIZATION_INDEX					\
+	VB2_NV_FIELD(VB2_NV_OFFS_LOCALIZATION, 0xff, VB2_NV_RANGE_INVALID, 0)
+#define VB2_NV_FIELD_DEV_BOOT_USB					\
+	VB2_NV_FLAG(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_USB)
+#define VB2_NV_FIELD_DEV_BOOT_SIGNED_ONLY				\
+	VB2_NV_FLAG(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_SIGNED_ONLY)
+#define VB2_NV_FIELD_DEV_BOOT_LEGACY					\
+	VB2_NV_FLAG(VB2_NV_OFFS_DEV, VB2_NV_DEV_FLAG_LEGACY)
+#define VB2_NV_FIELD_CLEAR_TPM_OWNER_REQUEST				\
+	VB2_NV_FLAG(VB2_NV_OFFS_TPM, VB2_NV_TPM_CLEAR_OWNER_REQUEST)
+#define VB2_NV_FIELD_CLEAR_TPM_OWNER_DONE				\
+	VB2_NV_FLAG(VB2_NV_OFFS_TPM, VB2_NV_TPM_CLEAR_OWNER_DONE)
+/* Out of range firmware results become unknown */
+#define VB2_NV_FIELD_FW_RESULT						\
+	VB2_NV_FIELD(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_RESULT_MASK,	\
+		     VB2_NV_RANGE_INVALID, 0 /* VB2_FW_RESULT_UNKNOWN */)
+#define VB2_NV_FIELD_FW_TRIED						\
+	VB2_NV_FLAG(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_TRIED)
+#define VB2_NV_FIELD_TRY_NEXT						\
+	VB2_NV_FLAG(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_TRY_NEXT)
+#define VB2_NV_FIELD_FW_PREV_RESULT					\
+	VB2_NV_FIELD(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_PREV_RESULT_MASK,	\
+		     VB2_NV_RANGE_INVALID, 0 /* VB2_FW_RESULT_UNKNOWN */)
+#define VB2_NV_FIELD_FW_PREV_TRIED					\
+	VB2_NV_FLAG(VB2_NV_OFFS_BOOT2, VB2_NV_BOOT2_PREV_TRIED)
+#define VB2_NV_FIELD_KERNEL_FIELD					\
+	{ VB2_NV_OFFS_KERNEL, 0xff, 0, 4, VB2_NV_RANGE_TRUNCATE, 0 }
+
+/**
+ * Read a field from NV storage data.
+ *
+ * @param p		NV storage data
+ * @param f		Field to read
+ * @return The field's value.
+ */
+static __inline uint32_t vb2_nv_field_get(const uint8_t *p,
+					  const struct vb2_nv_field *f)
+{
+	p += f->offs;
+	if (f->size == 4)
+		return p[0] | (p[1] << 8) | (p[2] << 16) |
+			((uint32_t)p[3] << 24);
+
+	return (p[0] & f->mask) >> f->shift;
+}
+
+/**
+ * Write a field to NV storage data.
+ *
+ * Values too big for the field are handled as the field's range says.
+ *
+ * @param p		NV storage data
+ * @param f		Field to write
+ * @param value		New value
+ */
+static __inline void vb2_nv_field_set(uint8_t *p,
+				      const struct vb2_nv_field *f,
+				      uint32_t value)
+{
+	uint32_t max = f->mask >> f->shift;
+
+	p += f->offs;
+	if (f->size == 4) {
+		p[0] = (uint8_t)value;
+		p[1] = (uint8_t)(value >> 8);
+		p[2] = (uint8_t)(value >> 16);
+		p[3] = (uint8_t)(value >> 24);
+		return;
+	}
+
+	if (value > max) {
+		if (f->range == VB2_NV_RANGE_CLIP)
+			value = max;
+		else if (f->range == VB2_NV_RANGE_INVALID)
+			value = f->invalid;
+		else
+			value &= max;
+	}
+	p[0] = (p[0] & ~f->mask) | (uint8_t)(value << f->shift);
+}
+
 #endif  /* VBOOT_REFERENCE_VBOOT_2NVSTORAGE_FIELDS_H_ */
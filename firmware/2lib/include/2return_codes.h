@@ -45,6 +45,9 @@ enum vb2_return_code {
 	/* Digest size buffer too small in vb2_digest_finalize() */
 	VB2_ERROR_SHA_FINALIZE_DIGEST_SIZE,
 
+	/* Implementation not supported in vb2_sha256_select_impl() */
+	VB2_ERROR_SHA_IMPL_UNSUPPORTED,
+
         /**********************************************************************
 	 * RSA errors
 	 */
@@ -376,6 +379,18 @@ enum vb2_return_code {
 	/* Not enough space in work buffer for resource object */
 	VB2_ERROR_READ_RESOURCE_OBJECT_BUF,
 
+	/* Verification cache not enabled by caller */
+	VB2_ERROR_VERIFY_CACHE_DISABLED,
+
+	/* Verification cache contents are not valid */
+	VB2_ERROR_VERIFY_CACHE_INVALID,
+
+	/* Verification cache is for something else */
+	VB2_ERROR_VERIFY_CACHE_MISS,
+
+	/* Not enough space in work buffer for verification cache digest */
+	VB2_ERROR_VERIFY_CACHE_WORKBUF,
+
         /**********************************************************************
 	 * API-level errors
 	 */
@@ -435,6 +450,54 @@ enum vb2_return_code {
 	/* Buffer size for the digest is too small for vb2api_get_pcr_digest */
 	VB2_ERROR_API_PCR_DIGEST_BUF,
 
+	/* Component is hashed in blocks in vb2api_init_hash2() */
+	VB2_ERROR_API_INIT_HASH_BLOCKS,
+
+	/* Preamble not present in vb2api_check_hash_block() */
+	VB2_ERROR_API_HASH_BLOCK_PREAMBLE,
+
+	/* No such block in vb2api_check_hash_block() */
+	VB2_ERROR_API_HASH_BLOCK_NUM,
+
+	/* Wrong amount of data in vb2api_check_hash_block() */
+	VB2_ERROR_API_HASH_BLOCK_SIZE,
+
+	/* Work buffer too small in vb2api_check_hash_block() */
+	VB2_ERROR_API_HASH_BLOCK_WORKBUF,
+
+	/* Hash mismatch in vb2api_check_hash_block() */
+	VB2_ERROR_API_HASH_BLOCK_SIG,
+
+	/* Blocks use different hash algorithms in vb2api_check_hash_blocks() */
+	VB2_ERROR_API_HASH_BLOCKS_ALG,
+
+	/* Bad slot number in vb2api_verify_fw_slot() */
+	VB2_ERROR_API_VERIFY_SLOT_NUM,
+
+	/* Slot already chosen or verified in vb2api_verify_fw_slot() */
+	VB2_ERROR_API_VERIFY_SLOT_STATE,
+
+	/* Body smaller than the preamble says in vb2api_verify_fw_slot() */
+	VB2_ERROR_API_VERIFY_SLOT_BODY_SIZE,
+
+	/* Hash not initialized in vb2api_hash_regions() */
+	VB2_ERROR_API_HASH_REGIONS_WORKBUF,
+
+	/* Regions add up to more than is left to hash in vb2api_hash_regions() */
+	VB2_ERROR_API_HASH_REGIONS_SIZE,
+
+	/* No room in work buffer to read regions in vb2api_hash_regions() */
+	VB2_ERROR_API_HASH_REGIONS_BUF,
+
+	/* No verified digest for vb2api_get_body_digest() */
+	VB2_ERROR_API_BODY_DIGEST,
+
+	/* Buffer size for the digest is too small for vb2api_get_body_digest() */
+	VB2_ERROR_API_BODY_DIGEST_BUF,
+
+	/* No verified body for vb2api_get_body_compression() */
+	VB2_ERROR_API_BODY_COMPRESSION,
+
         /**********************************************************************
 	 * Errors which may be generated by implementations of vb2ex functions.
 	 * Implementation may also return its own specific errors, which should
@@ -461,6 +524,58 @@ enum vb2_return_code {
 	/* Hardware crypto engine doesn't support this algorithm (non-fatal) */
 	VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED,
 
+	/* Resource can't be mapped, so read it instead (non-fatal) */
+	VB2_ERROR_EX_MAP_RESOURCE_UNSUPPORTED,
+
+	/* No other cores to hash on, so hash on this one (non-fatal) */
+	VB2_ERROR_EX_DIGEST_MULTI_UNSUPPORTED,
+
+        /**********************************************************************
+	 * Ed25519 errors
+	 */
+	VB2_ERROR_ED25519 = VB2_ERROR_BASE + 0x0b0000,
+
+	/* Work buffer too small in vb2_ed25519_verify() */
+	VB2_ERROR_ED25519_WORKBUF,
+
+	/* Public key isn't a point on the curve in vb2_ed25519_verify() */
+	VB2_ERROR_ED25519_KEY,
+
+	/* Signature scalar out of range in vb2_ed25519_verify() */
+	VB2_ERROR_ED25519_SIG,
+
+	/* Signature mismatch in vb2_ed25519_verify() */
+	VB2_ERROR_ED25519_VERIFY,
+
+        /**********************************************************************
+	 * Key table errors
+	 */
+	VB2_ERROR_KEY_TABLE = VB2_ERROR_BASE + 0x0c0000,
+
+	/* Bad magic number in vb2_verify_key_table() */
+	VB2_ERROR_KEY_TABLE_MAGIC,
+
+	/* Incompatible struct version in vb2_verify_key_table() */
+	VB2_ERROR_KEY_TABLE_HEADER_VERSION,
+
+	/* Header too small in vb2_verify_key_table() */
+	VB2_ERROR_KEY_TABLE_SIZE,
+
+	/* Entries outside table in vb2_verify_key_table() */
+	VB2_ERROR_KEY_TABLE_ENTRIES,
+
+	/* Entries not sorted, or duplicated, in vb2_verify_key_table() */
+	VB2_ERROR_KEY_TABLE_ORDER,
+
+	/* No key with the GUID in vb2_key_table_find() (non-fatal) */
+	VB2_ERROR_KEY_TABLE_NOT_FOUND,
+
+	/* Key outside table in vb2_key_table_find() */
+	VB2_ERROR_KEY_TABLE_KEY_OUTSIDE,
+
+	/* Key GUID doesn't match its entry in vb2_key_table_find() */
+	VB2_ERROR_KEY_TABLE_KEY_GUID,
+
 
         /**********************************************************************
 	 * Errors generated by host library (non-firmware) start here.
@@ -496,6 +611,27 @@ enum vb2_return_code {
 	/* Unable to convert struct vb_guid to string */
 	VB2_ERROR_GUID_TO_STR,
 
+	/* Unable to open file in vb2_map_file() */
+	VB2_ERROR_MAP_FILE_OPEN,
+
+	/* Unable to stat file in vb2_map_fd() */
+	VB2_ERROR_MAP_FILE_STAT,
+
+	/* Bad size in vb2_map_fd() */
+	VB2_ERROR_MAP_FILE_SIZE,
+
+	/* Unable to map file in vb2_map_fd() */
+	VB2_ERROR_MAP_FILE_MMAP,
+
+	/* Unable to write changes back in vb2_unmap_file() */
+	VB2_ERROR_UNMAP_FILE_MSYNC,
+
+	/* Unable to unmap file in vb2_unmap_file() */
+	VB2_ERROR_UNMAP_FILE_MUNMAP,
+
+	/* Unknown mode in vb2_host_crypto_select() */
+	VB2_ERROR_HOST_CRYPTO_MODE,
+
         /**********************************************************************
 	 * Errors generated by host library key functions
 	 */
@@ -582,6 +718,27 @@ enum vb2_return_code {
 	/* Bad hash algorithm in vb2_public_key_hash() */
 	VB2_ERROR_PUBLIC_KEY_HASH,
 
+	/* Unable to allocate key store in vb2_private_key_store_create() */
+	VB2_ERROR_PRIVATE_KEY_STORE_ALLOC,
+
+	/* Unable to keep key in vb2_private_key_store_read() */
+	VB2_ERROR_PRIVATE_KEY_STORE_KEEP,
+
+	/* Bad Ed25519 seed in vb2_private_key_unpack() */
+	VB2_ERROR_UNPACK_PRIVATE_KEY_ED25519,
+
+	/* Not an Ed25519 key in vb2_public_key_from_ed25519() */
+	VB2_ERROR_PUBLIC_KEY_ED25519,
+
+	/* Unable to allocate key in vb2_public_key_from_ed25519() */
+	VB2_ERROR_PUBLIC_KEY_ED25519_ALLOC,
+
+	/* Two keys with the same GUID in vb2_key_table_create() */
+	VB2_ERROR_KEY_TABLE_CREATE_DUPLICATE,
+
+	/* Unable to allocate buffer in vb2_key_table_create() */
+	VB2_ERROR_KEY_TABLE_CREATE_ALLOC,
+
         /**********************************************************************
 	 * Errors generated by host library signature functions
 	 */
@@ -623,6 +780,15 @@ enum vb2_return_code {
 	/* Not enough buffer space to hold signature in vb2_sign_object() */
 	VB2_SIGN_OBJECT_OVERFLOW,
 
+	/* No key for a signature in vb2_verify_object_multiple() */
+	VB2_VERIFY_OBJECT_NO_KEY,
+
+	/* Unable to allocate buffers in vb2_verify_object_multiple() */
+	VB2_VERIFY_OBJECT_ALLOC,
+
+	/* Unable to allocate buffers in vb2_sign_object_multiple() */
+	VB2_SIGN_OBJECT_ALLOC,
+
         /**********************************************************************
 	 * Errors generated by host library keyblock functions
 	 */
@@ -654,6 +820,15 @@ enum vb2_return_code {
 	/* Unable to sign preamble in vb2_create_fw_preamble() */
 	VB2_FW_PREAMBLE_CREATE_SIGN,
 
+	/* Bad block size in vb2_fw_preamble_hash_blocks() */
+	VB2_FW_PREAMBLE_HASH_BLOCKS_SIZE,
+
+	/* Unable to allocate hash list in vb2_fw_preamble_hash_blocks() */
+	VB2_FW_PREAMBLE_HASH_BLOCKS_ALLOC,
+
+	/* Unable to hash a block in vb2_fw_preamble_hash_blocks() */
+	VB2_FW_PREAMBLE_HASH_BLOCKS_HASH,
+
         /**********************************************************************
 	 * Highest non-zero error generated inside vboot library.  Note that
 	 * error codes passed through vboot when it calls external APIs may
@@ -11,12 +11,45 @@
 
 struct vb2_workbuf;
 
+/*
+ * RSA key sizes may be disabled individually to save space.  Keys and
+ * signatures of a disabled size are rejected as unsupported.
+ */
+
+#ifndef VB2_SUPPORT_RSA1024
+#define VB2_SUPPORT_RSA1024 1
+#endif
+
+#ifndef VB2_SUPPORT_RSA2048
+#define VB2_SUPPORT_RSA2048 1
+#endif
+
+#ifndef VB2_SUPPORT_RSA4096
+#define VB2_SUPPORT_RSA4096 1
+#endif
+
+#ifndef VB2_SUPPORT_RSA8192
+#define VB2_SUPPORT_RSA8192 1
+#endif
+
+/* Size of the biggest supported signature, in bytes */
+#if VB2_SUPPORT_RSA8192
+#define VB2_MAX_RSA_SIG_BYTES (8192 / 8)
+#elif VB2_SUPPORT_RSA4096
+#define VB2_MAX_RSA_SIG_BYTES (4096 / 8)
+#elif VB2_SUPPORT_RSA2048
+#define VB2_MAX_RSA_SIG_BYTES (2048 / 8)
+#else
+#define VB2_MAX_RSA_SIG_BYTES (1024 / 8)
+#endif
+
 /* Public key structure in RAM */
 struct vb2_public_key {
 	uint32_t arrsize;    /* Length of n[] and rr[] in number of uint32_t */
 	uint32_t n0inv;      /* -1 / n[0] mod 2^32 */
 	const uint32_t *n;   /* Modulus as little endian array */
 	const uint32_t *rr;  /* R^2 as little endian array */
+	const uint8_t *ed25519_key;  /* Ed25519 public key, if sig_alg is that */
 	enum vb2_signature_algorithm sig_alg;  /* Signature algorithm */
 	enum vb2_hash_algorithm hash_alg;      /* Hash algorithm */
 	const char *desc;            /* Description */
@@ -60,20 +93,49 @@ uint32_t vb2_packed_key_size(enum vb2_signature_algorithm sig_alg);
  */
 int vb2_check_padding(const uint8_t *sig, const struct vb2_public_key *key);
 
+/**
+ * RSA routines to use in place of the ones here.
+ *
+ * Host tools use these to verify with a library which has faster
+ * implementations; firmware never sets them.
+ */
+struct vb2_rsa_ops {
+	/*
+	 * Same as vb2_rsa_verify_digest(), called once it has checked the key
+	 * and signature sizes and the work buffer.  Returns
+	 * VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED to have the signature verified
+	 * here instead.
+	 */
+	int (*verify_digest)(const struct vb2_public_key *key,
+			     const uint8_t *sig,
+			     const uint8_t *digest);
+};
+
+/**
+ * Set the routines vb2_rsa_verify_digest() uses.
+ *
+ * @param ops		Routines to use, or NULL for the ones here
+ */
+void vb2_rsa_set_ops(const struct vb2_rsa_ops *ops);
+
 /* Size of work buffer sufficient for vb2_rsa_verify_digest() worst case */
-#define VB2_VERIFY_RSA_DIGEST_WORKBUF_BYTES (3 * 1024)
+#define VB2_VERIFY_RSA_DIGEST_WORKBUF_BYTES (3 * VB2_MAX_RSA_SIG_BYTES)
 
 /**
  * Verify a RSA PKCS1.5 signature against an expected hash digest.
  *
+ * The signature isn't changed; it's decrypted into the start of the work
+ * buffer, where it's left when this returns (unless vb2_rsa_set_ops() routines
+ * verified it instead).
+ *
  * @param key		Key to use in signature verification
- * @param sig		Signature to verify (destroyed in process)
+ * @param sig		Signature to verify
  * @param digest	Digest of signed data
  * @param wb		Work buffer
  * @return VB2_SUCCESS, or non-zero if error.
  */
 int vb2_rsa_verify_digest(const struct vb2_public_key *key,
-			  uint8_t *sig,
+			  const uint8_t *sig,
 			  const uint8_t *digest,
 			  const struct vb2_workbuf *wb);
 
@@ -9,19 +9,53 @@
 #include "2crypto.h"
 #include "2struct.h"
 
-/* Hash algorithms may be disabled individually to save code space */
+/*
+ * Hash algorithms may be disabled individually to save code space.  The EC
+ * only ever uses SHA-256.
+ */
 
 #ifndef VB2_SUPPORT_SHA1
+#ifdef CHROMEOS_EC
+#define VB2_SUPPORT_SHA1 0
+#else
 #define VB2_SUPPORT_SHA1 1
 #endif
+#endif
 
 #ifndef VB2_SUPPORT_SHA256
 #define VB2_SUPPORT_SHA256 1
 #endif
 
 #ifndef VB2_SUPPORT_SHA512
+#ifdef CHROMEOS_EC
+#define VB2_SUPPORT_SHA512 0
+#else
 #define VB2_SUPPORT_SHA512 1
 #endif
+#endif
+
+#ifndef VB2_SUPPORT_BLAKE2S
+#ifdef CHROMEOS_EC
+#define VB2_SUPPORT_BLAKE2S 0
+#else
+#define VB2_SUPPORT_BLAKE2S 1
+#endif
+#endif
+
+/*
+ * Use the CPU's SHA-256 instructions (x86 SHA extensions, ARMv8 crypto
+ * extensions) when they are present, falling back to the C implementation
+ * otherwise.  This is on by default only for host builds; firmware may not
+ * have the vector registers enabled when vboot runs, and the selected
+ * implementation is kept in a global.
+ */
+#ifndef VB2_SHA256_SIMD
+#ifdef CHROMEOS_ENVIRONMENT
+#define VB2_SHA256_SIMD 1
+#else
+#define VB2_SHA256_SIMD 0
+#endif
+#endif
 
 #define VB2_SHA1_DIGEST_SIZE 20
 #define VB2_SHA1_BLOCK_SIZE 64
@@ -29,7 +63,7 @@
 /* Context structs for hash algorithms */
 
 struct vb2_sha1_context {
-	uint32_t count;
+	uint64_t count;  /* Bytes hashed so far */
 	uint32_t state[5];
 #if defined(HAVE_ENDIAN_H) && defined(HAVE_LITTLE_ENDIAN)
 	union {
@@ -61,6 +95,16 @@ struct vb2_sha512_context {
 	uint8_t block[2 * VB2_SHA512_BLOCK_SIZE];
 };
 
+#define VB2_BLAKE2S_DIGEST_SIZE 32
+#define VB2_BLAKE2S_BLOCK_SIZE 64
+
+struct vb2_blake2s_context {
+	uint32_t h[8];
+	uint64_t total_size;
+	uint32_t size;
+	uint8_t block[VB2_BLAKE2S_BLOCK_SIZE];
+};
+
 /* Hash algorithm independent digest context; includes all of the above. */
 struct vb2_digest_context {
 	/* Context union for all algorithms */
@@ -73,6 +117,9 @@ struct vb2_digest_context {
 #endif
 #if VB2_SUPPORT_SHA512
 		struct vb2_sha512_context sha512;
+#endif
+#if VB2_SUPPORT_BLAKE2S
+		struct vb2_blake2s_context blake2s;
 #endif
 	};
 
@@ -81,6 +128,31 @@ struct vb2_digest_context {
 
 	/* 1 if digest is computed with vb2ex_hwcrypto routines, else 0 */
 	int using_hwcrypto;
+
+	/* Set if digest is computed by vb2_digest_set_ops() routines */
+	const struct vb2_digest_ops *ops;
+};
+
+/**
+ * Digest routines to use in place of the ones here.
+ *
+ * Host tools use these to hash with a library which has faster
+ * implementations; firmware never sets them.  The routines keep their state in
+ * the context union, which is at least as big as the biggest enabled hash
+ * context.  Only algorithms enabled here are passed to init().
+ */
+struct vb2_digest_ops {
+	/*
+	 * Start a digest of dc->hash_alg.  Returns VB2_SUCCESS,
+	 * VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED to have it computed here instead,
+	 * or another non-zero error code.
+	 */
+	int (*init)(struct vb2_digest_context *dc);
+	int (*extend)(struct vb2_digest_context *dc,
+		      const uint8_t *buf,
+		      uint32_t size);
+	/* Digest buffer is always at least vb2_digest_size(dc->hash_alg) */
+	int (*finalize)(struct vb2_digest_context *dc, uint8_t *digest);
 };
 
 /**
@@ -91,6 +163,7 @@ struct vb2_digest_context {
 void vb2_sha1_init(struct vb2_sha1_context *ctx);
 void vb2_sha256_init(struct vb2_sha256_context *ctx);
 void vb2_sha512_init(struct vb2_sha512_context *ctx);
+void vb2_blake2s_init(struct vb2_blake2s_context *ctx);
 
 /**
  * Update (extend) a hash.
@@ -108,16 +181,57 @@ void vb2_sha256_update(struct vb2_sha256_context *ctx,
 void vb2_sha512_update(struct vb2_sha512_context *ctx,
 		       const uint8_t *data,
 		       uint32_t size);
+void vb2_blake2s_update(struct vb2_blake2s_context *ctx,
+			const uint8_t *data,
+			uint32_t size);
 
 /**
  * Finalize a hash digest.
  *
  * @param ctx		Hash context
- * @param digest	Destination for hash; must be VB_SHA*_DIGEST_SIZE bytes
+ * @param digest	Destination for hash; must be VB_SHA*_DIGEST_SIZE or
+ *			VB2_BLAKE2S_DIGEST_SIZE bytes
  */
 void vb2_sha1_finalize(struct vb2_sha1_context *ctx, uint8_t *digest);
 void vb2_sha256_finalize(struct vb2_sha256_context *ctx, uint8_t *digest);
 void vb2_sha512_finalize(struct vb2_sha512_context *ctx, uint8_t *digest);
+void vb2_blake2s_finalize(struct vb2_blake2s_context *ctx, uint8_t *digest);
+
+/* SHA-256 block transform implementations */
+enum vb2_sha256_impl {
+	/* Fastest implementation supported by this CPU */
+	VB2_SHA256_IMPL_AUTO = 0,
+
+	/* Portable C */
+	VB2_SHA256_IMPL_C,
+
+	/* x86 SHA extensions (SHA-NI) */
+	VB2_SHA256_IMPL_X86_SHA,
+
+	/* ARMv8 crypto extensions */
+	VB2_SHA256_IMPL_ARMV8_CE,
+};
+
+/**
+ * Select the SHA-256 block transform implementation.
+ *
+ * This is normally not needed, since the fastest supported implementation is
+ * picked automatically.  Tests and benchmarks use it to compare them.
+ *
+ * @param impl		Implementation to use
+ * @return VB2_SUCCESS, or VB2_ERROR_SHA_IMPL_UNSUPPORTED if the implementation
+ * is not built in or not supported by this CPU.
+ */
+int vb2_sha256_select_impl(enum vb2_sha256_impl impl);
+
+/**
+ * Set the routines vb2_digest_init() and friends use.
+ *
+ * Digests already started keep the routines they started with.
+ *
+ * @param ops		Routines to use, or NULL for the ones here
+ */
+void vb2_digest_set_ops(const struct vb2_digest_ops *ops);
 
 /**
  * Convert vb2_crypto_algorithm to vb2_hash_algorithm.
@@ -174,4 +288,32 @@ int vb2_digest_finalize(struct vb2_digest_context *dc,
 			uint8_t *digest,
 			uint32_t digest_size);
 
+/* Most buffers hashed side by side by vb2_digest_multi() */
+#define VB2_DIGEST_MULTI_LANES 8
+
+/**
+ * Calculate the digests of several independent buffers.
+ *
+ * This gives the same results as calling vb2_digest_init(), extend() and
+ * finalize() on each buffer in turn.  When VB2_SHA256_SIMD is enabled, the
+ * SHA-256 and SHA-512 blocks of up to VB2_DIGEST_MULTI_LANES buffers are run
+ * together through the vector unit, so this is much faster for batches of
+ * similarly sized buffers.  Other algorithms are hashed one at a time.
+ *
+ * @param hash_alg	Hash algorithm
+ * @param count		Number of buffers
+ * @param bufs		Data to hash, one pointer per buffer
+ * @param sizes		Length of each buffer in bytes
+ * @param digests	Destination for each digest
+ * @param digest_size	Length of each digest buffer in bytes; must be at
+ *			least vb2_digest_size(hash_alg).
+ * @return VB2_SUCCESS, or non-zero on error.
+ */
+int vb2_digest_multi(enum vb2_hash_algorithm hash_alg,
+		     uint32_t count,
+		     const uint8_t * const *bufs,
+		     const uint32_t *sizes,
+		     uint8_t * const *digests,
+		     uint32_t digest_size);
+
 #endif  /* VBOOT_REFERENCE_2SHA_H_ */
@@ -0,0 +1,34 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * SHA-256 block transforms using CPU instructions.  Internal to 2sha256.c.
+ */
+
+#ifndef VBOOT_REFERENCE_2SHA256_SIMD_H_
+#define VBOOT_REFERENCE_2SHA256_SIMD_H_
+
+/**
+ * Check whether a transform is usable on this CPU.
+ *
+ * @return 1 if the CPU supports the instructions, 0 if not (or if the
+ * transform is not built for this architecture).
+ */
+int vb2_sha256_x86_sha_supported(void);
+int vb2_sha256_armv8_ce_supported(void);
+
+/**
+ * Run the SHA-256 compression function over whole blocks.
+ *
+ * Only call these if the matching *_supported() function returned 1.
+ *
+ * @param h		Hash state (8 words, A..H)
+ * @param message	Message blocks
+ * @param block_nb	Number of VB2_SHA256_BLOCK_SIZE byte blocks
+ */
+void vb2_sha256_transform_x86_sha(uint32_t *h, const uint8_t *message,
+				  unsigned int block_nb);
+void vb2_sha256_transform_armv8_ce(uint32_t *h, const uint8_t *message,
+				   unsigned int block_nb);
+
+#endif  /* VBOOT_REFERENCE_2SHA256_SIMD_H_ */
@@ -0,0 +1,30 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Internals shared between the SHA implementations in 2lib.
+ */
+
+#ifndef VBOOT_REFERENCE_2SHA_PRIVATE_H_
+#define VBOOT_REFERENCE_2SHA_PRIVATE_H_
+
+/* Round constants */
+extern const uint32_t vb2_sha256_k[64];
+extern const uint64_t vb2_sha512_k[80];
+
+/**
+ * Check whether SHA-256 blocks are run with CPU instructions.
+ *
+ * @return 1 if the selected block transform uses the SHA instructions of the
+ * CPU, 0 if it is the C implementation.
+ */
+int vb2_sha256_using_cpu_insns(void);
+
+/**
+ * Check whether digests are computed by routines from vb2_digest_set_ops().
+ *
+ * @return 1 if they are, 0 if they are computed here.
+ */
+int vb2_digest_using_ops(void);
+
+#endif  /* VBOOT_REFERENCE_2SHA_PRIVATE_H_ */
@@ -33,6 +33,9 @@ enum vb2_shared_data_flags {
 	/* Developer mode is enabled */
 	VB2_SD_DEV_MODE_ENABLED = (1 << 1),
 
+	/* The body vb2api_check_hash() verified is compressed */
+	VB2_SD_FLAG_BODY_COMPRESSED = (1 << 2),
+
 	/*
 	 * TODO: might be nice to add flags for why dev mode is enabled - via
 	 * gbb, virtual dev switch, or forced on for testing.
@@ -52,8 +55,89 @@ enum vb2_shared_data_status {
 
 	/* Chose a firmware slot */
 	VB2_SD_STATUS_CHOSE_SLOT = (1 << 3),
+
+	/* Firmware keyblock / preamble matched the verification cache */
+	VB2_SD_STATUS_KEYBLOCK_CACHED = (1 << 4),
+	VB2_SD_STATUS_PREAMBLE_CACHED = (1 << 5),
 };
 
+/*
+ * Boot phase boundaries recorded in vb2_shared_data.timestamps.  These match
+ * the VBSD_TS_* values in vboot_struct.h, so firmware can copy the timestamps
+ * into VbSharedDataHeader for the OS as they are.
+ */
+enum vb2_timestamp_id {
+	VB2_TS_NONE = 0,
+
+	/* vb2api_fw_phase1() enter/exit */
+	VB2_TS_FW_PHASE1_ENTER = 1,
+	VB2_TS_FW_PHASE1_EXIT = 2,
+
+	/* vb2api_fw_phase2() enter/exit */
+	VB2_TS_FW_PHASE2_ENTER = 3,
+	VB2_TS_FW_PHASE2_EXIT = 4,
+
+	/* vb2api_fw_phase3() enter, which starts vb2_load_fw_keyblock() */
+	VB2_TS_FW_PHASE3_ENTER = 5,
+
+	/* vb2_load_fw_keyblock() exit, which starts vb2_load_fw_preamble() */
+	VB2_TS_FW_KEYBLOCK_EXIT = 6,
+
+	/* vb2_load_fw_preamble() exit, which ends vb2api_fw_phase3() */
+	VB2_TS_FW_PREAMBLE_EXIT = 7,
+
+	/* vb2api_init_hash() enter; the body is hashed until check_hash */
+	VB2_TS_FW_INIT_HASH = 8,
+
+	/* vb2api_check_hash() enter/exit */
+	VB2_TS_FW_CHECK_HASH_ENTER = 9,
+	VB2_TS_FW_CHECK_HASH_EXIT = 10,
+};
+
+/* One boot phase boundary */
+struct vb2_timestamp {
+	/* Time from vb2ex_get_timer() */
+	uint64_t time;
+
+	/* What happened (enum vb2_timestamp_id) */
+	uint32_t id;
+
+	/* Reserved for padding */
+	uint32_t reserved0;
+} __attribute__((packed));
+
+/* Number of timestamps kept in vb2_shared_data.  Must be power of 2. */
+#define VB2_MAX_TIMESTAMPS 32
+
+/* Buckets in struct vb2_crypto_stats */
+#define VB2_CRYPTO_STATS_HASH_ALGS 8   /* By enum vb2_hash_algorithm */
+#define VB2_CRYPTO_STATS_RSA_SIZES 4   /* 1024, 2048, 4096 and 8192 bits */
+
+/*
+ * Crypto work done during boot, so a board's boot time can be put down to
+ * hashing, RSA or decompression.  Only counted by builds with
+ * VB2_CRYPTO_STATS; see vb2_crypto_stats_flush().  Same layout as
+ * VbSharedDataCryptoStats.
+ */
+struct vb2_crypto_stats {
+	/* Bytes passed to vb2_digest_extend(), by hash algorithm */
+	uint64_t hash_bytes[VB2_CRYPTO_STATS_HASH_ALGS];
+
+	/* Calls to vb2_rsa_verify_digest(), by key size from 1024 bits up */
+	uint32_t rsa_verifies[VB2_CRYPTO_STATS_RSA_SIZES];
+
+	/* Bytes passed to Crc32() */
+	uint64_t crc32_bytes;
+
+	/* Images decompressed, and their compressed and original sizes */
+	uint32_t decompress_calls;
+	uint32_t reserved0;
+	uint64_t decompress_in_bytes;
+	uint64_t decompress_out_bytes;
+} __attribute__((packed));
+
+#define EXPECTED_VB2_CRYPTO_STATS_SIZE 112
+
 /*
  * Data shared between vboot API calls.  Stored at the start of the work
  * buffer.
@@ -97,6 +181,12 @@ struct vb2_shared_data {
 	 */
 	uint32_t status;
 
+	/*
+	 * Copy of nvdata[] from before the first change since the caller last
+	 * saved it, so changes which cancel out don't need saving.
+	 */
+	uint8_t nvdata_stored[16];
+
 	/**********************************************************************
 	 * Temporary variables used during firmware verification.  These don't
 	 * really need to persist through to the OS, but there's nowhere else
@@ -127,6 +217,13 @@ struct vb2_shared_data {
 	uint32_t workbuf_preamble_offset;
 	uint32_t workbuf_preamble_size;
 
+	/*
+	 * Offset and size of the start of the vblock in work buffer, read
+	 * ahead by vb2_read_vblock_prefix().  Size is 0 if there is none.
+	 */
+	uint32_t workbuf_vblock_prefix_offset;
+	uint32_t workbuf_vblock_prefix_size;
+
 	/*
 	 * Offset and size of hash context in work buffer.  Size if 0 if
 	 * hash context is not stored in the work buffer.
@@ -148,6 +245,37 @@ struct vb2_shared_data {
 	/* Amount of data we still expect to hash */
 	uint32_t hash_remaining_size;
 
+	/*
+	 * Digest of the data last verified by vb2api_check_hash(), and its
+	 * hash algorithm (enum vb2_hash_algorithm), so it can be measured
+	 * without hashing the data again.  Algorithm is VB2_HASH_INVALID if
+	 * nothing has been verified.  Large enough for SHA-512.
+	 */
+	uint32_t body_hash_alg;
+	uint8_t body_digest[64];
+
+	/* SHA-256 of root key and firmware keyblock, for the verify cache */
+	uint8_t verify_cache_keyblock_digest[32];
+
+	/**********************************************************************
+	 * Boot phase timing; see vb2_record_timestamp().
+	 */
+
+	/*
+	 * Number of timestamps recorded.  This keeps counting once the ring
+	 * is full, so timestamp N is at timestamps[N % VB2_MAX_TIMESTAMPS] and
+	 * only the last VB2_MAX_TIMESTAMPS are kept.
+	 */
+	uint32_t timestamp_count;
+
+	/* Reserved for padding */
+	uint32_t reserved0;
+
+	struct vb2_timestamp timestamps[VB2_MAX_TIMESTAMPS];
+
+	/* Crypto work done, as of the last timestamp */
+	struct vb2_crypto_stats crypto_stats;
+
 } __attribute__((packed));
 
 /****************************************************************************/
@@ -0,0 +1,105 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Cache of firmware keyblock and preamble verification results
+ */
+
+#ifndef VBOOT_REFERENCE_VBOOT_2VERIFY_CACHE_H_
+#define VBOOT_REFERENCE_VBOOT_2VERIFY_CACHE_H_
+
+#include "2sha.h"
+
+struct vb2_context;
+struct vb2_workbuf;
+
+/* Expected value of vb2_verify_cache.magic ("V2VC") */
+#define VB2_VERIFY_CACHE_MAGIC 0x43563256
+
+/* Expected value of vb2_verify_cache.struct_version */
+#define VB2_VERIFY_CACHE_VERSION 1
+
+/*
+ * What the last boot verified, kept in vb2_context.verify_cache[].
+ *
+ * The digests are SHA-256, and cover exactly the bytes which the signatures
+ * were checked over: the root key data followed by the keyblock, and the
+ * preamble.  If both still match, the signatures would verify the same way
+ * again, so there's no need to redo the RSA.
+ */
+struct vb2_verify_cache {
+	/* Magic number; see VB2_VERIFY_CACHE_MAGIC */
+	uint32_t magic;
+
+	/* Struct version; see VB2_VERIFY_CACHE_VERSION */
+	uint8_t struct_version;
+
+	/* Firmware slot the vblock was read from (0=A, 1=B) */
+	uint8_t fw_slot;
+
+	/* Reserved for padding */
+	uint8_t reserved0[2];
+
+	/* Version from the vblock (key version << 16 | firmware version) */
+	uint32_t fw_version;
+
+	/* Digest of the root key data and keyblock */
+	uint8_t keyblock_digest[VB2_SHA256_DIGEST_SIZE];
+
+	/* Digest of the preamble */
+	uint8_t preamble_digest[VB2_SHA256_DIGEST_SIZE];
+
+	/* Reserved for future expansion */
+	uint8_t reserved1[3];
+
+	/* CRC; must be last field in struct */
+	uint8_t crc8;
+} __attribute__((packed));
+
+/**
+ * Calculate the SHA-256 digest of [size1] bytes at [buf1] followed by [size2]
+ * bytes at [buf2], into [digest], which must be VB2_SHA256_DIGEST_SIZE bytes.
+ *
+ * @return VB2_SUCCESS, or non-zero error code.
+ */
+int vb2_verify_cache_digest(const void *buf1, uint32_t size1,
+			    const void *buf2, uint32_t size2,
+			    uint8_t *digest,
+			    const struct vb2_workbuf *wb);
+
+/**
+ * Check whether the keyblock for this slot was verified last boot.
+ *
+ * [digest] is from vb2_verify_cache_digest() over the root key data and
+ * keyblock.  It's saved in vb2_shared_data for vb2_verify_cache_save().
+ *
+ * @return VB2_SUCCESS if the keyblock matches what was verified last boot,
+ * so its signature need not be checked again, or non-zero error code if it
+ * must be.
+ */
+int vb2_verify_cache_check_keyblock(struct vb2_context *ctx,
+				    const uint8_t *digest);
+
+/**
+ * Check whether the preamble for this slot was verified last boot.  Only
+ * succeeds if vb2_verify_cache_check_keyblock() did.
+ *
+ * @return VB2_SUCCESS if the preamble matches what was verified last boot,
+ * so its signature need not be checked again, or non-zero error code if it
+ * must be.
+ */
+int vb2_verify_cache_check_preamble(struct vb2_context *ctx,
+				    const uint8_t *digest);
+
+/**
+ * Record that the keyblock and preamble for this slot have been verified.
+ *
+ * Call after the preamble has been verified and vb2_shared_data.fw_version
+ * set.  Sets VB2_CONTEXT_VERIFY_CACHE_CHANGED if the cache changes.  Does
+ * nothing unless the caller set VB2_CONTEXT_VERIFY_CACHE.
+ *
+ * @param digest	Preamble digest from vb2_verify_cache_digest()
+ */
+void vb2_verify_cache_save(struct vb2_context *ctx, const uint8_t *digest);
+
+#endif  /* VBOOT_REFERENCE_VBOOT_2VERIFY_CACHE_H_ */
@@ -126,8 +126,48 @@ typedef enum ImageFormat {
 	FORMAT_INVALID = 0,
 	FORMAT_BMP,
 	FORMAT_FONT,
+	FORMAT_RAW,		/* Pixels to blit; see RawImageHeader */
 } ImageFormat;
 
+#define RAW_IMAGE_SIGNATURE      "$RAW"
+#define RAW_IMAGE_SIGNATURE_SIZE (4)
+
+/*
+ * Header of a FORMAT_RAW image, which bmpblk_utility converts from a BMP
+ * ahead of time in the pixel format of the panel, so the firmware needn't
+ * decode and convert it at boot.  The rows of pixels follow, top row first,
+ * each starting stride bytes after the one before.  The header is a multiple
+ * of every pixel size, so run-length encoding can work a pixel at a time.
+ */
+typedef struct RawImageHeader {
+	uint8_t  signature[RAW_IMAGE_SIGNATURE_SIZE]; /* RAW_IMAGE_SIGNATURE */
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;           /* Bytes from one row to the next */
+	uint32_t pixel_format;     /* RAW_PIXEL_... */
+	uint32_t reserved;
+} __attribute__((packed)) RawImageHeader;
+
+/* Constants for RawImageHeader.pixel_format; all are little-endian */
+typedef enum RawPixelFormat {
+	RAW_PIXEL_INVALID = 0,
+	RAW_PIXEL_XRGB8888,	/* 32 bits: blue, green, red, unused bytes */
+	RAW_PIXEL_RGB888,	/* 24 bits: blue, green, red bytes */
+	RAW_PIXEL_RGB565,	/* 16 bits: 5 red, 6 green and 5 blue bits */
+} RawPixelFormat;
+
+/*
+ * COMPRESS_RLE images are run-length encoded.  The first byte is the size of
+ * the units being encoded, from 1 to RLE_MAX_UNIT bytes; raw images use their
+ * pixel size.  Each packet after that starts with a control byte c.  Below
+ * RLE_RUN, c + 1 units follow and are copied as they are.  Otherwise one unit
+ * follows, and is repeated c - RLE_RUN + 2 times.
+ */
+#define RLE_MAX_UNIT    (4)
+#define RLE_RUN         (0x80)
+#define RLE_MAX_LITERAL (RLE_RUN)
+#define RLE_MAX_RUN     (0xff - RLE_RUN + 2)
+
 /*
  * These magic image names can be used in the .yaml file to indicate that the
  * ASCII HWID should be displayed. For RENDER_HWID, the image coordinates
@@ -49,6 +49,19 @@ VbError_t VbGbbReadRootKey(VbCommonParams *cparams,
 VbError_t VbGbbReadRecoveryKey(VbCommonParams *cparams,
 			       struct VbPublicKey **keyp);
 
+/**
+ * Get the recovery key, reading it from the GBB only the first time.  It's
+ * kept in cparams until VbApiKernelFree(), so every LoadKernel() in a
+ * recovery boot uses the same copy.
+ *
+ * @param cparams	Vboot common parameters
+ * @param keyp		Returns a pointer to the key, which the caller must
+ *			not free
+ * @return VBERROR_... error, VBERROR_SUCCESS on success,
+ */
+VbError_t VbGbbGetRecoveryKey(VbCommonParams *cparams,
+			      const struct VbPublicKey **keyp);
+
 /**
  * Read the bitmap block header from the GBB
  *
@@ -59,6 +72,23 @@ VbError_t VbGbbReadRecoveryKey(VbCommonParams *cparams,
 VbError_t VbGbbReadBmpHeader(VbCommonParams *cparams,
 			     struct BmpBlockHeader *hdr);
 
+/**
+ * Read the layout and header of an image from the GBB, without its data
+ *
+ * @param cparams	Vboot common parameters
+ * @param localization	Localization/language number
+ * @param screen_index	Index of screen to display (VB_SCREEN_...)
+ * @param image_num	Image number within the screen
+ * @param layout	Returns layout information (x, y position)
+ * @param image_info	Returns information about the image (format, size)
+ * @return VBERROR_NO_IMAGE_PRESENT if the screen has no such image, other
+ * VBERROR_... error, VBERROR_SUCCESS on success.
+ */
+VbError_t VbGbbReadImageInfo(VbCommonParams *cparams,
+			     uint32_t localization, uint32_t screen_index,
+			     uint32_t image_num, struct ScreenLayout *layout,
+			     struct ImageInfo *image_info);
+
 /**
  * Read a image from the GBB
  *
@@ -80,4 +110,39 @@ VbError_t VbGbbReadImage(VbCommonParams *cparams,
 			 struct ImageInfo *image_info, char **image_datap,
 			 uint32_t *image_data_sizep);
 
+/**
+ * Check whether an image should be passed to VbGbbStreamImage() rather than
+ * read with VbGbbReadImage().  Images which VbGbbReadImage() would keep, and
+ * run-length encoded ones, which vboot decodes itself, aren't streamed.
+ * Only built with DECOMPRESS_STREAM.
+ *
+ * @param cparams	Vboot common parameters
+ * @param image_info	Image information from VbGbbReadImageInfo()
+ * @return 1 if the image should be streamed, 0 if not.
+ */
+int VbGbbCanStreamImage(VbCommonParams *cparams,
+			const struct ImageInfo *image_info);
+
+/**
+ * Decode a bitmap from the GBB straight to the display, a piece at a time,
+ * with VbExDecompressStreamOpen().  Only built with DECOMPRESS_STREAM.
+ *
+ * @param cparams	Vboot common parameters
+ * @param layout	Layout from VbGbbReadImageInfo()
+ * @param image_num	Image number within the screen
+ * @param image_info	Image information from VbGbbReadImageInfo()
+ * @return VBERROR_... error, VBERROR_SUCCESS on success.
+ */
+VbError_t VbGbbStreamImage(VbCommonParams *cparams,
+			   const struct ScreenLayout *layout,
+			   uint32_t image_num,
+			   const struct ImageInfo *image_info);
+
+/**
+ * Free the images kept by VbGbbReadImage()
+ *
+ * @param cparams	Vboot common parameters
+ */
+void VbGbbFreeImageCache(VbCommonParams *cparams);
+
 #endif
@@ -64,6 +64,32 @@ enum {
 
 /* If this bit is 1, the GPT is stored in another from the streaming data */
 #define GPT_FLAG_EXTERNAL	0x1
+/*
+ * If this bit is 1, a valid primary GPT is used without reading or checking
+ * the secondary GPT at the far end of the drive.  The OS is expected to check
+ * the secondary later (for example, with "cgpt repair -c").
+ */
+#define GPT_FLAG_LAZY_SECONDARY	0x2
+/*
+ * If this bit is 1 and the secondary GPT wasn't read, changes to the entries
+ * are only written to the primary GPT.  The OS brings the secondary up to
+ * date (with "cgpt repair"), which saves a seek to the end of the drive on
+ * every boot that tries a new kernel.
+ */
+#define GPT_FLAG_LAZY_SECONDARY_WRITE	0x4
+
+/* Most kernel entries GptData keeps an index of (the most GPT entries) */
+#define GPT_MAX_KERNELS 128
+
+/* What kernel selection needs to know about a kernel entry */
+typedef struct {
+	/* Zero-based index of the entry in the partition table */
+	uint8_t entry;
+	/* Attribute fields, as GetEntryPriority() etc. return them */
+	uint8_t priority;
+	uint8_t tries;
+	uint8_t successful;
+} GptKernelInfo;
 
 /*
  * A note about stored_on_device and gpt_drive_sectors:
@@ -80,19 +106,19 @@ enum {
  */
 typedef struct {
 	/* Fill in the following fields before calling GptInit() */
-	/* GPT primary header, from sector 1 of disk (size: 512 bytes) */
+	/* GPT primary header, from sector 1 of disk (size: 1 sector) */
 	uint8_t *primary_header;
-	/* GPT secondary header, from last sector of disk (size: 512 bytes) */
+	/* GPT secondary header, from last sector of disk (size: 1 sector) */
 	uint8_t *secondary_header;
 	/* Primary GPT table, follows primary header (size: 16 KB) */
 	uint8_t *primary_entries;
 	/* Secondary GPT table, precedes secondary header (size: 16 KB) */
 	uint8_t *secondary_entries;
-	/* Size of a LBA sector, in bytes */
+	/* Size of a LBA sector, in bytes; 512 or 4096 */
 	uint32_t sector_bytes;
 	/* Size of drive (that the partitions are on) in LBA sectors */
 	uint64_t streaming_drive_sectors;
-	/* Size of the device that holds the GPT structures, 512-byte sectors */
+	/* Size of the device that holds the GPT structures, in LBA sectors */
 	uint64_t gpt_drive_sectors;
 	/* Flags */
 	uint32_t flags;
@@ -100,16 +126,58 @@ typedef struct {
 	/* Outputs */
 	/* Which inputs have been modified?  GPT_MODIFIED_* */
 	uint8_t modified;
+	/*
+	 * Copies of the entries (GPT_MODIFIED_ENTRIES1 and 2) of which only
+	 * some sectors have changed since they were read: sectors
+	 * [entries_first, entries_end) from the start of the primary (0) and
+	 * secondary (1) entries.  Only honored where the GPT_MODIFIED_* bit is
+	 * also set; anything which changes a whole copy clears its bit here.
+	 */
+	uint8_t entries_partial;
+	uint32_t entries_first[2];
+	uint32_t entries_end[2];
+	/*
+	 * Copies of the entries (GPT_MODIFIED_ENTRIES*) which were read from
+	 * where their header puts them, so a repair can tell which sectors
+	 * differ from what's on the drive.  Zero makes repairs write the
+	 * whole copy.
+	 */
+	uint8_t entries_loaded;
 	/*
 	 * The current chromeos kernel index in partition table.  -1 means not
 	 * found on drive. Note that GPT partition numbers are traditionally
 	 * 1-based, but we're using a zero-based index here.
 	 */
 	int current_kernel;
+	/* Disk reads done by AllocAndReadGptData() */
+	uint32_t read_calls;
+	uint64_t read_bytes;
+	/* VbExGetTimer() ticks spent in those reads */
+	uint64_t read_ticks;
+	/*
+	 * Set by AllocAndReadGptData() if it trusted the primary GPT without
+	 * reading the secondary (see GPT_FLAG_LAZY_SECONDARY).  GptInit()
+	 * then leaves the secondary alone instead of repairing it, and with
+	 * GPT_FLAG_LAZY_SECONDARY_WRITE so does GptUpdateKernelEntry().
+	 */
+	uint8_t secondary_unread;
 
 	/* Internal variables */
 	uint32_t valid_headers, valid_entries;
 	int current_priority;
+
+	/*
+	 * Kernel entries of the primary table in partition order, and their
+	 * positions in kernels[] from highest to lowest priority.  Built by
+	 * GptInit() so kernel selection walks these few cache lines instead of
+	 * all the 128-byte partition entries.
+	 */
+	GptKernelInfo kernels[GPT_MAX_KERNELS];
+	uint8_t kernels_by_priority[GPT_MAX_KERNELS];
+	uint32_t num_kernels;
+	uint8_t kernels_indexed;
+	/* Next position in kernels_by_priority[] for GptNextKernelEntry() */
+	uint32_t next_kernel;
 } GptData;
 
 /**
@@ -149,12 +217,24 @@ GptEntry *GptFindNthEntry(GptData *gpt, const Guid *guid, unsigned int n);
 /**
  * Allocate and read GPT data from the drive.  The sector_bytes and
  * drive_sectors fields should be filled on input.  The primary and secondary
- * header and entries are filled on output.
+ * header and entries are filled on output, and the read_* fields count the
+ * disk reads it took, whether or not it succeeded.
+ *
+ * Each header and its entries share one buffer, so they must only be freed by
+ * WriteAndFreeGptData().
  *
  * Returns 0 if successful, 1 if error.
  */
 int AllocAndReadGptData(VbExDiskHandle_t disk_handle, GptData *gptdata);
 
+/**
+ * Start the disk reads AllocAndReadGptData() will most likely do, with
+ * VbExDiskReadStart(), so they can go on while other drives are looked at.
+ * The same fields of gptdata should be filled in.  Does nothing unless the
+ * firmware library is built with DISK_READ_ASYNC.
+ */
+void StartReadGptData(VbExDiskHandle_t disk_handle, const GptData *gptdata);
+
 /**
  * Write any changes for the GPT data back to the drive, then free the buffers.
  */
@@ -36,6 +36,21 @@ uint32_t TlclLibClose(void);
 uint32_t TlclSendReceive(const uint8_t *request, uint8_t *response,
                          int max_length);
 
+/**
+ * Start a raw TPM request, without waiting for the response.  Only one
+ * request may be outstanding; starting another command finishes this one
+ * first and discards its response.  If the firmware is built with TPM_ASYNC,
+ * the TPM runs the command while the caller does other work; otherwise the
+ * whole transaction happens here.  Returns 0 if the request was started.
+ */
+uint32_t TlclSubmit(const uint8_t *request);
+
+/**
+ * Wait for the request started by TlclSubmit() and get its response, like
+ * TlclSendReceive().
+ */
+uint32_t TlclComplete(uint8_t *response, int max_length);
+
 /**
  * Return the size of a TPM request or response packet.
  */
@@ -86,12 +101,41 @@ uint32_t TlclDefineSpace(uint32_t index, uint32_t perm, uint32_t size);
  */
 uint32_t TlclWrite(uint32_t index, const void *data, uint32_t length);
 
+/**
+ * Start a TlclWrite(), TlclSetGlobalLock() or TlclLockPhysicalPresence()
+ * without waiting for it.  Call TlclFinish() to get the TPM error code.
+ */
+uint32_t TlclWriteStart(uint32_t index, const void *data, uint32_t length);
+uint32_t TlclSetGlobalLockStart(void);
+uint32_t TlclLockPhysicalPresenceStart(void);
+
+/**
+ * Start a TlclContinueSelfTest() without waiting for it, so with TPM_ASYNC
+ * the TPM can take the command while the firmware does other work, even if
+ * ContinueSelfTest blocks.  Call TlclFinish() to get the TPM error code.
+ */
+uint32_t TlclContinueSelfTestStart(void);
+
+/**
+ * Finish the command started by one of the functions above.  The TPM error
+ * code is returned.
+ */
+uint32_t TlclFinish(void);
+
 /**
  * Read [length] bytes from space at [index] into [data].  The TPM error code
  * is returned.
  */
 uint32_t TlclRead(uint32_t index, void *data, uint32_t length);
 
+/**
+ * Start a TlclRead() of [length] bytes from space at [index], without waiting
+ * for it.  Call TlclReadFinish() with the same [length] to get the data and
+ * the TPM error code.
+ */
+uint32_t TlclReadStart(uint32_t index, uint32_t length);
+uint32_t TlclReadFinish(void *data, uint32_t length);
+
 /**
  * Read PCR at [index] into [data].  [length] must be TPM_PCR_DIGEST or
  * larger. The TPM error code is returned.
@@ -185,6 +229,13 @@ uint32_t TlclExtend(int pcr_num, const uint8_t *in_digest, uint8_t *out_digest);
  */
 uint32_t TlclGetPermissions(uint32_t index, uint32_t *permissions);
 
+/**
+ * Get the permission bits and the size in bytes of the NVRAM space with
+ * |index|.
+ */
+uint32_t TlclGetSpaceInfo(uint32_t index, uint32_t *permissions,
+			  uint32_t *size);
+
 /**
  * Get the entire set of permanent flags.
  */
@@ -117,6 +117,36 @@ enum VbErrorPredefined_t {
 	/* VbExEcGetExpectedRWHash() may return the following codes */
 	/* Compute expected RW hash from the EC image; BIOS doesn't have it */
 	VBERROR_EC_GET_EXPECTED_HASH_FROM_IMAGE = 0x20000,
+
+	/* VbExEcHashRWStart() may return the following codes */
+	/* EC can't hash in the background; VbExEcHashRW() will do it */
+	VBERROR_EC_HASH_START_UNSUPPORTED     = 0x20001,
+
+	/* VbExDiskWaitForChange() may return the following codes */
+	/* No disk came or went before the timeout */
+	VBERROR_DISK_NO_CHANGE                = 0x20002,
+	/* Platform can't tell when disks come and go; poll them instead */
+	VBERROR_DISK_WAIT_UNSUPPORTED         = 0x20003,
+
+	/* VbExStreamReadChunks() may return the following codes */
+	/* Stream can't read in chunks; VbExStreamRead() will be used */
+	VBERROR_STREAM_CHUNKS_UNSUPPORTED     = 0x20004,
+
+	/* VbExKeyboardWait() may return the following codes */
+	/* Platform can't wait for keys; poll VbExKeyboardRead() instead */
+	VBERROR_KEYBOARD_WAIT_UNSUPPORTED     = 0x20005,
+
+	/* VbExBeepNotes() may return the following codes */
+	/* Platform can't play a tune; VbExBeep() will play it a note at a time */
+	VBERROR_BEEP_NOTES_UNSUPPORTED        = 0x20006,
+
+	/* VbExKernelBufferResolve() may return the following codes */
+	/* Platform has no final address; the body goes in kernel_buffer */
+	VBERROR_KERNEL_BUFFER_UNSUPPORTED     = 0x20007,
+
+	/* VbExDecompressStreamOpenMemory() may return the following codes */
+	/* Platform can't decompress as it goes; VbExDecompress() will be used */
+	VBERROR_DECOMPRESS_STREAM_UNSUPPORTED = 0x20008,
 };
 
 
@@ -132,6 +162,13 @@ enum VbErrorPredefined_t {
 #define VB_SHARED_DATA_MIN_SIZE 3072
 #define VB_SHARED_DATA_REC_SIZE 16384
 
+/*
+ * Work buffer size which holds everything LoadKernel() needs at once for a
+ * GPT of 128 entries and kernel headers up to 64 KB, signed with keys of up
+ * to 8192 bits.  Screen images need more, depending on the GBB.
+ */
+#define VB_KERNEL_WORKBUF_RECOMMENDED_SIZE (128 * 1024)
+
 /*
  * Data passed by firmware to VbInit(), VbSelectFirmware() and
  * VbSelectAndLoadKernel().
@@ -177,9 +214,47 @@ typedef struct VbCommonParams {
 	 */
 	void *caller_context;
 
+	/*
+	 * Most bytes of decompressed screen images to keep in memory during
+	 * VbSelectAndLoadKernel(), so redrawing a screen doesn't read and
+	 * decompress its images again.  0 to not keep any.
+	 */
+	uint32_t image_cache_size;
+
+	/*
+	 * Optional work buffer for VbSelectAndLoadKernel().  If set, the
+	 * buffers it needs while reading the GPT, loading and verifying
+	 * kernels and drawing screens come from here instead of VbExMalloc(),
+	 * which is only used if it runs out.  Screen layouts and cached images
+	 * are kept for the whole call, so they still use VbExMalloc().  The
+	 * buffer should be at least VB_KERNEL_WORKBUF_RECOMMENDED_SIZE bytes.
+	 */
+	void *workbuf;
+	uint32_t workbuf_size;
+
+	/*
+	 * Optional context of the vboot2 firmware verification which ran
+	 * earlier in this boot.  Its nvdata[] and secdata[] have already been
+	 * read and checked, so if this is set, VbInit() and
+	 * VbSelectAndLoadKernel() use them instead of reading NV storage and
+	 * the TPM firmware space again.  NV storage changes are still written
+	 * with VbExNvStorageWrite(), and copied back to the context.
+	 */
+	struct vb2_context *vb2_ctx;
+
 	/* For internal use of Vboot - do not examine or modify! */
 	struct GoogleBinaryBlockHeader *gbb;
 	struct BmpBlockHeader *bmp;
+	/* Screen layouts for one localization, so redraws needn't read them */
+	struct ScreenLayout *layouts;
+	uint32_t layouts_localization;
+	/* Decompressed images, most recently used first */
+	struct VbImageCacheEntry *image_cache;
+	uint32_t image_cache_used;
+	/* Parts of the debug info screen which don't change during a boot */
+	struct VbDebugInfoCache *debug_info;
+	/* Recovery key, read from the GBB once for all LoadKernel() calls */
+	struct VbPublicKey *recovery_key;
 } VbCommonParams;
 
 /* Flags for VbInitParams.flags */
@@ -229,6 +304,31 @@ typedef struct VbCommonParams {
 #define VB_INIT_FLAG_VIRTUAL_REC_SWITCH  0x00001000
 /* Set when we are calling VbInit() before loading Option ROMs */
 #define VB_INIT_FLAG_BEFORE_OPROM_LOAD   0x00002000
+/*
+ * The OS checks kernel body blocks as it uses them, so in normal and
+ * developer mode LoadKernel() need only check the body blocks needed to boot,
+ * if the kernel preamble has body block hashes.
+ */
+#define VB_INIT_FLAG_PARTIAL_KERNEL_CHECK 0x00004000
+/*
+ * The OS checks and repairs the secondary GPT, so in normal and developer
+ * mode LoadKernel() may boot from a valid primary GPT without reading the
+ * secondary one at the end of the drive.
+ */
+#define VB_INIT_FLAG_LAZY_SECONDARY_GPT  0x00008000
+/*
+ * With VB_INIT_FLAG_LAZY_SECONDARY_GPT, LoadKernel() may also write changes
+ * to the kernel entries (such as the tries count) to the primary GPT only,
+ * and leave the unread secondary GPT for the OS to repair.
+ */
+#define VB_INIT_FLAG_LAZY_SECONDARY_GPT_WRITE 0x00010000
+/*
+ * In developer mode with self-signed kernels allowed, LoadKernel() accepts a
+ * key block by its SHA-512 hash without first trying the signature.  Key
+ * blocks accepted that way count as self-signed, so they don't roll forward
+ * the kernel version in the TPM.
+ */
+#define VB_INIT_FLAG_DEV_KEY_BLOCK_HASH_FIRST 0x00020000
 
 /*
  * Output flags for VbInitParams.out_flags.  Used to indicate potential boot
@@ -301,6 +401,16 @@ typedef struct VbSelectFirmwareParams {
 	uint32_t verification_size_A;
 	/* Verification block B size in bytes */
 	uint32_t verification_size_B;
+	/*
+	 * Optional firmware bodies already in memory, or NULL.  If a slot's
+	 * body is set, VbSelectFirmware() hashes it directly in one pass
+	 * instead of calling VbExHashFirmwareBody() for that slot.
+	 */
+	const void *body_A;
+	const void *body_B;
+	/* Body sizes in bytes */
+	uint32_t body_size_A;
+	uint32_t body_size_B;
 
 	/* Outputs from VbSelectFirmware(); valid only if it returns success. */
 	/* Main firmware to run; see VB_SELECT_FIRMWARE_*. */
@@ -337,6 +447,17 @@ typedef struct VbSelectAndLoadKernelParams {
 	uint8_t partition_guid[16];
 	/* Flags passed in by signer */
 	uint32_t flags;
+	/*
+	 * Offset of bootloader image from the start of kernel_buffer, or
+	 * (uint64_t)-1 if the preamble puts it outside the kernel body
+	 */
+	uint64_t bootloader_offset;
+	/*
+	 * Offset and size of the 16-bit vmlinuz header in kernel_buffer; size
+	 * is 0 if the kernel has no header inside its body
+	 */
+	uint64_t vmlinuz_header_offset;
+	uint64_t vmlinuz_header_size;
 	/*
 	 * TODO: in H2C, all that pretty much just gets passed to the
 	 * bootloader as KernelBootloaderOptions, though the disk handle is
@@ -383,6 +504,19 @@ void VbUpdateFirmwareBodyHash(VbCommonParams *cparams,
 VbError_t VbSelectAndLoadKernel(VbCommonParams *cparams,
                                 VbSelectAndLoadKernelParams *kparams);
 
+/**
+ * Encode the shared data blob compactly into [buf], to hand to the OS in
+ * place of the whole blob.  Only what verified boot filled in is kept, so
+ * this is usually a fraction of shared_data_size.  On input, [size] is the
+ * size of [buf]; on output, it's the size of the encoding.
+ *
+ * Returns VBERROR_SUCCESS if success, or VBERROR_INVALID_PARAMETER if the
+ * shared data isn't valid or [buf] is too small; [size] is then set to the
+ * size needed, if it's known.
+ */
+VbError_t VbSharedDataEncode(VbCommonParams *cparams, void *buf,
+                             uint32_t *size);
+
 /*****************************************************************************/
 /* Debug output (from utility.h) */
 
@@ -461,6 +595,26 @@ void VbExSleepMs(uint32_t msec);
  */
 VbError_t VbExBeep(uint32_t msec, uint32_t frequency);
 
+/* One note of a tune for VbExBeepNotes() */
+typedef struct VbBeepNote {
+	uint16_t msec;		/* How long to play it */
+	uint16_t frequency;	/* Frequency in Hz, or 0 to be silent */
+} __attribute__((packed)) VbBeepNote;
+
+/**
+ * Play a whole tune of [count] notes in the background, starting now, and
+ * return immediately.  VbExBeep(0, 0) stops it, even if it isn't finished.
+ *
+ * The notes are only valid until VbExBeep(0, 0) is called, so the platform
+ * must copy any it hasn't played yet if it needs them longer.
+ *
+ * Returns VBERROR_SUCCESS if the tune is playing, or
+ * VBERROR_BEEP_NOTES_UNSUPPORTED if the platform can't do this; vboot will
+ * then play it a note at a time with VbExBeep().  This is only called if
+ * VbExBeep() can make sound in the background.
+ */
+VbError_t VbExBeepNotes(const VbBeepNote *notes, uint32_t count);
+
 /*****************************************************************************/
 /* TPM (from tlcl_stub.h) */
 
@@ -484,6 +638,19 @@ VbError_t VbExTpmOpen(void);
 VbError_t VbExTpmSendReceive(const uint8_t *request, uint32_t request_length,
                              uint8_t *response, uint32_t *response_length);
 
+/**
+ * Split version of VbExTpmSendReceive(), so the TPM can run a command while
+ * vboot does something else (like hashing the RW firmware body).
+ * VbExTpmSubmit() sends the request_length-byte request and returns without
+ * waiting for the TPM.  VbExTpmComplete() waits for the command to finish and
+ * receives its response the same way VbExTpmSendReceive() does.  Only one
+ * command is outstanding at a time.
+ *
+ * These are only called if the firmware library is built with TPM_ASYNC.
+ */
+VbError_t VbExTpmSubmit(const uint8_t *request, uint32_t request_length);
+VbError_t VbExTpmComplete(uint8_t *response, uint32_t *response_length);
+
 /*****************************************************************************/
 /* Non-volatile storage */
 
@@ -504,7 +671,8 @@ VbError_t VbExNvStorageWrite(const uint8_t *buf);
 
 /**
  * Calculate the hash of the firmware body data for [firmware_index], which is
- * either VB_SELECT_FIRMWARE_A or VB_SELECT_FIRMWARE B.
+ * either VB_SELECT_FIRMWARE_A or VB_SELECT_FIRMWARE B.  Not called for slots
+ * whose body the caller supplied in VbSelectFirmwareParams.
  *
  * This function must call VbUpdateFirmwareBodyHash() before returning, to
  * update the secure hash for the firmware image.  For best performance, the
@@ -626,6 +794,19 @@ VbError_t VbExDiskGetInfo(VbDiskInfo **infos_ptr, uint32_t *count,
 VbError_t VbExDiskFreeInfo(VbDiskInfo *infos,
                            VbExDiskHandle_t preserve_handle);
 
+/**
+ * Wait up to timeout_ms for a disk with the disk_flags (as for
+ * VbExDiskGetInfo()) to be attached or removed.  This lets platforms with
+ * hotplug interrupts tell vboot as soon as recovery media appears, instead of
+ * it calling VbExDiskGetInfo() over and over.
+ *
+ * Returns VBERROR_SUCCESS as soon as a disk comes or goes, or
+ * VBERROR_DISK_NO_CHANGE after timeout_ms if none did.  Returns
+ * VBERROR_DISK_WAIT_UNSUPPORTED at once if the platform can't tell; vboot
+ * then sleeps and calls VbExDiskGetInfo() every so often instead.
+ */
+VbError_t VbExDiskWaitForChange(uint32_t disk_flags, uint32_t timeout_ms);
+
 /**
  * Read lba_count LBA sectors, starting at sector lba_start, from the disk,
  * into the buffer.
@@ -640,6 +821,19 @@ VbError_t VbExDiskFreeInfo(VbDiskInfo *infos,
 VbError_t VbExDiskRead(VbExDiskHandle_t handle, uint64_t lba_start,
                        uint64_t lba_count, void *buffer);
 
+/**
+ * Start reading lba_count LBA sectors, starting at sector lba_start, from the
+ * disk in the background, and return without waiting.  A later
+ * VbExDiskRead() of the same sectors then returns that data, waiting only for
+ * whatever is left of the read.  Reads may be started on several disks at
+ * once, and some may never be asked for; VbExDiskFreeInfo() abandons any
+ * that are left.
+ *
+ * This is only called if the firmware library is built with DISK_READ_ASYNC.
+ */
+VbError_t VbExDiskReadStart(VbExDiskHandle_t handle, uint64_t lba_start,
+                            uint64_t lba_count);
+
 /**
  * Write lba_count LBA sectors, starting at sector lba_start, to the disk, from
  * the buffer.
@@ -689,6 +883,43 @@ VbError_t VbExStreamOpen(VbExDiskHandle_t handle, uint64_t lba_start,
  */
 VbError_t VbExStreamRead(VbExStream_t stream, uint32_t bytes, void *buffer);
 
+/**
+ * Called by VbExStreamReadChunks() as each chunk of the buffer is filled
+ *
+ * @param ctx		Context passed to VbExStreamReadChunks()
+ * @param chunk		Start of the chunk, inside the buffer being read
+ * @param bytes		Size of the chunk
+ */
+typedef void (*VbExStreamChunkDone_t)(void *ctx, const void *chunk,
+				      uint32_t bytes);
+
+/**
+ * Read from a stream on a disk, as a series of chunks
+ *
+ * @param stream	Stream to read from
+ * @param bytes		Number of bytes to read
+ * @param buffer	Destination to read into
+ * @param chunk_bytes	Size of each chunk; a multiple of the sector size
+ * @param done		Function to call as each chunk is read
+ * @param ctx		Context to pass to done()
+ *
+ * @return Error code, or VBERROR_SUCCESS.  Returns
+ * VBERROR_STREAM_CHUNKS_UNSUPPORTED, without reading anything, if the stream
+ * can't do this; VbExStreamRead() will then be called a chunk at a time
+ * instead.
+ *
+ * This reads the same data a single VbExStreamRead() of [bytes] would, but
+ * the platform may keep as many chunks in flight at once as its storage
+ * can queue; the whole buffer is available from the start.  done() must be
+ * called once for each chunk, in order, from the first, as soon as that
+ * chunk and all the ones before it have been read.  All but the last chunk
+ * are [chunk_bytes] long.  Reading may go on while done() runs, but done()
+ * must not be called again until it returns.
+ */
+VbError_t VbExStreamReadChunks(VbExStream_t stream, uint32_t bytes,
+			       void *buffer, uint32_t chunk_bytes,
+			       VbExStreamChunkDone_t done, void *ctx);
+
 /**
  * Close a stream
  *
@@ -696,6 +927,45 @@ VbError_t VbExStreamRead(VbExStream_t stream, uint32_t bytes, void *buffer);
  */
 void VbExStreamClose(VbExStream_t stream);
 
+/**
+ * Hint that the next bytes of a stream will be read soon
+ *
+ * @param stream	Stream which will be read
+ * @param bytes		Number of bytes likely to be read next
+ *
+ * @return Error code, or VBERROR_SUCCESS.  Errors are ignored; a later
+ * VbExStreamRead() must still work whether or not the hint was taken.
+ *
+ * The platform may start reading these bytes in the background, so a
+ * following VbExStreamRead() only waits for whatever is left.  They aren't
+ * always all read; the stream may be closed early.
+ *
+ * This is only called if the firmware library is built with DISK_READ_ASYNC.
+ */
+VbError_t VbExStreamPrefetch(VbExStream_t stream, uint64_t bytes);
+
+/**
+ * Find where a kernel body should be loaded
+ *
+ * @param load_address	Body load address from the kernel preamble
+ * @param size		Size of the kernel body in bytes
+ * @param buffer	Destination for a pointer to where the body goes
+ *
+ * @return Error code, or VBERROR_SUCCESS.  Returns
+ * VBERROR_KERNEL_BUFFER_UNSUPPORTED if the platform has nowhere better than
+ * the kernel_buffer passed to VbSelectAndLoadKernel(); the body is then read
+ * there, as before.
+ *
+ * On success, [buffer] must point at [size] bytes of memory the body can be
+ * run from, normally wherever [load_address] is on this platform.  The body
+ * is read straight into it and verified in place, and kernel_buffer is
+ * returned pointing at it, so the platform doesn't have to copy the kernel
+ * again before jumping to it.  The memory is written even if the body then
+ * doesn't verify, in which case a later kernel may be loaded over it.
+ */
+VbError_t VbExKernelBufferResolve(uint64_t load_address, uint64_t size,
+				  void **buffer);
+
 
 /*****************************************************************************/
 /* Display */
@@ -759,11 +1029,65 @@ VbError_t VbExDisplayScreen(uint32_t screen_type);
  * pixel coordinates.  The bitmap buffer is a pointer to the platform-dependent
  * uncompressed binary blob with dimensions and format specified internally
  * (for example, a raw BMP, GIF, PNG, whatever). We pass the size just for
- * convenience.
+ * convenience.  FORMAT_RAW images start with a RawImageHeader (see
+ * bmpblk_header.h) and are already in the pixel format of the display, so
+ * they can be copied to it directly.
  */
 VbError_t VbExDisplayImage(uint32_t x, uint32_t y,
                            void *buffer, uint32_t buffersize);
 
+/* One image of a run passed to VbExDisplayImageRun() */
+typedef struct VbDisplayImage {
+	uint32_t x;
+	uint32_t y;
+	void *buffer;
+	uint32_t buffersize;
+} VbDisplayImage;
+
+/**
+ * Write a run of images to the display, as if VbExDisplayImage() were called
+ * for each in turn.  Text is drawn this way, one run per line of glyphs, so
+ * the display provider can blit the whole line at once.
+ *
+ * This is only called if the firmware library is built with
+ * DISPLAY_IMAGE_RUN.
+ */
+VbError_t VbExDisplayImageRun(const VbDisplayImage *images, uint32_t count);
+
+/**
+ * Display the images of a screen layout together.  The result should be the
+ * same as calling VbExDisplayImage() for each in turn, but the display
+ * provider can compose them in a back buffer and show it all at once, to
+ * avoid flicker and drawing to the frame buffer once per image.  Text is
+ * passed as one image per glyph, after the images under it.  The images may
+ * overlap, and later ones go on top.  When only part of a screen changed,
+ * this is given just the images which need drawing again.
+ *
+ * This is only called if the firmware library is built with DISPLAY_LAYOUT.
+ */
+VbError_t VbExDisplayLayout(const VbDisplayImage *images, uint32_t count);
+
+/* One piece of an image passed to VbExDisplayImageRects() */
+typedef struct VbDisplayRect {
+	uint32_t x;		/* Where to put it on the display */
+	uint32_t y;
+	uint32_t src_x;		/* Its upper left corner in the image */
+	uint32_t src_y;
+	uint32_t width;
+	uint32_t height;
+} VbDisplayRect;
+
+/**
+ * Copy rectangles of a FORMAT_RAW image to the display, in turn.  Text in a
+ * font atlas (see bmpblk_font.h) is drawn this way, one call per line of
+ * glyphs, all cut from the same image.  The rectangles are inside the image.
+ *
+ * This is only called if the firmware library is built with
+ * DISPLAY_FONT_ATLAS.
+ */
+VbError_t VbExDisplayImageRects(void *buffer, uint32_t buffersize,
+				const VbDisplayRect *rects, uint32_t count);
+
 /**
  * Display a string containing debug information on the screen, rendered in a
  * platform-dependent font.  Should be able to handle newlines '\n' in the
@@ -830,6 +1154,17 @@ uint32_t VbExKeyboardRead(void);
  */
 uint32_t VbExKeyboardReadWithFlags(uint32_t *flags_ptr);
 
+/**
+ * Wait until a key is pressed, or [timeout_ms] have passed, whichever comes
+ * first.  The key is left in the keyboard buffer for VbExKeyboardRead().
+ *
+ * Returns VBERROR_SUCCESS in either case, or
+ * VBERROR_KEYBOARD_WAIT_UNSUPPORTED without waiting if the platform can't
+ * tell when a key is pressed; vboot then sleeps a little at a time with
+ * VbExSleepMs() and polls the keyboard instead.
+ */
+VbError_t VbExKeyboardWait(uint32_t timeout_ms);
+
 /**
  * Return the current state of the switches specified in request_mask
  */
@@ -878,6 +1213,15 @@ VbError_t VbExEcDisableJump(int devidx);
  */
 VbError_t VbExEcHashRW(int devidx, const uint8_t **hash, int *hash_size);
 
+/**
+ * Ask the EC to start hashing its rewriteable image in the background, and
+ * return without waiting.  A later VbExEcHashRW() then returns that hash,
+ * waiting only for whatever is left of the computation.
+ *
+ * Returns VBERROR_EC_HASH_START_UNSUPPORTED if the EC can't do this.
+ */
+VbError_t VbExEcHashRWStart(int devidx);
+
 /**
  * Get the expected contents of the EC image associated with the main firmware
  * specified by the "select" argument.
@@ -897,6 +1241,26 @@ VbError_t VbExEcGetExpectedRWHash(int devidx, enum VbSelectFirmware_t select,
  */
 VbError_t VbExEcUpdateRW(int devidx, const uint8_t *image, int image_size);
 
+/**
+ * Get the size of the chunks the EC can hash and update its rewritable image
+ * in, normally its flash erase size.  Sets *chunk_size to 0 if the EC can only
+ * be updated as a whole by VbExEcUpdateRW().
+ */
+VbError_t VbExEcGetRWChunkSize(int devidx, int *chunk_size);
+
+/**
+ * Read the SHA-256 hash of the current contents of part of the rewritable EC
+ * image.
+ */
+VbError_t VbExEcHashRWChunk(int devidx, int offset, int size,
+			    const uint8_t **hash, int *hash_size);
+
+/**
+ * Update part of the EC rewritable image.
+ */
+VbError_t VbExEcUpdateRWChunk(int devidx, int offset, const uint8_t *data,
+			      int size);
+
 /**
  * Lock the EC code to prevent updates until the EC is rebooted.
  * Subsequent calls to VbExEcUpdateRW() this boot will fail.
@@ -964,9 +1328,90 @@ enum {
 	COMPRESS_NONE = 0,
 	COMPRESS_EFIv1,           /* The x86 BIOS only supports this */
 	COMPRESS_LZMA1,           /* The ARM BIOS supports LZMA1 */
+	/*
+	 * Run-length encoding, for raw images; see bmpblk_header.h.  Vboot
+	 * decodes this itself, so it's never passed to VbExDecompress().
+	 */
+	COMPRESS_RLE,
 	MAX_COMPRESS,
 };
 
+/* Streaming decompression interface */
+typedef void *VbExDecompressStream_t;
+
+/**
+ * Start decoding an image straight to the display
+ *
+ * @param compression_type	Compression of the data (COMPRESS_...); may
+ *				be COMPRESS_NONE, but never COMPRESS_RLE
+ * @param original_size		Size of the image once decoded
+ * @param x			Left edge of the image on the screen
+ * @param y			Top edge of the image on the screen
+ * @param stream		out-parameter for the generated stream
+ *
+ * @return Error code, or VBERROR_SUCCESS.
+ *
+ * The compressed data is then passed in pieces to
+ * VbExDecompressStreamWrite(), as it's read from the GBB.  The platform can
+ * decode it a band at a time into its frame buffer or blit path instead of
+ * decoding the whole image into memory first.  The result should be the same
+ * as VbExDecompress() followed by VbExDisplayImage() at (x, y).
+ *
+ * This is only called if the firmware library is built with
+ * DECOMPRESS_STREAM.
+ */
+VbError_t VbExDecompressStreamOpen(uint32_t compression_type,
+				   uint32_t original_size, uint32_t x,
+				   uint32_t y, VbExDecompressStream_t *stream);
+
+/**
+ * Start decoding a compressed kernel body into memory as it's read
+ *
+ * @param compression_type	Compression of the body (COMPRESS_...); never
+ *				COMPRESS_NONE or COMPRESS_RLE
+ * @param outbuf		Where the body goes once decompressed
+ * @param out_size		Size of the body once decompressed
+ * @param stream		out-parameter for the generated stream
+ *
+ * @return Error code, or VBERROR_SUCCESS.  Platforms which can't decompress
+ * a piece at a time return VBERROR_DECOMPRESS_STREAM_UNSUPPORTED, and the body
+ * is read whole and passed to VbExDecompress() once it's verified.
+ *
+ * The compressed body is then passed in pieces to VbExDecompressStreamWrite()
+ * as it's read from disk, and decompressed while the rest is still being
+ * read.  The body hasn't been verified yet when it's decompressed, so the
+ * decoder must cope with any data without writing past [out_size] bytes at
+ * [outbuf]; LoadKernel() uses none of it unless the body signature is good.
+ * VbExDecompressStreamClose() fails unless the body decoded to exactly
+ * [out_size] bytes.
+ */
+VbError_t VbExDecompressStreamOpenMemory(uint32_t compression_type,
+					 void *outbuf, uint32_t out_size,
+					 VbExDecompressStream_t *stream);
+
+/**
+ * Pass the next piece of compressed data to a stream
+ *
+ * @param stream	Stream to decode with
+ * @param inbuf		Compressed data; only valid until this returns
+ * @param in_size	Size of the data in bytes
+ *
+ * @return Error code, or VBERROR_SUCCESS.
+ */
+VbError_t VbExDecompressStreamWrite(VbExDecompressStream_t stream,
+				    const void *inbuf, uint32_t in_size);
+
+/**
+ * Finish drawing an image and close its stream
+ *
+ * @param stream	Stream to close
+ *
+ * @return Error code, or VBERROR_SUCCESS.  It's an error if the data didn't
+ * decode to the whole image.  This is called once for every stream opened,
+ * even if a write failed.
+ */
+VbError_t VbExDecompressStreamClose(VbExDecompressStream_t stream);
+
 /**
  * Execute legacy boot option.
  */
@@ -16,8 +16,9 @@ typedef struct VbNvContext {
 	uint8_t raw[VBNV_BLOCK_SIZE];
 	/*
 	 * Flag indicating whether raw data has changed.  Set by VbNvTeardown()
-	 * if the raw data has changed and needs to be stored to the underlying
-	 * non-volatile data store.
+	 * if the raw data is different from what was last stored (that is,
+	 * from what VbNvSetup() or the last VbNvTeardown() saw) and needs to
+	 * be stored to the underlying non-volatile data store.
 	 */
 	int raw_changed;
 
@@ -26,6 +27,8 @@ typedef struct VbNvContext {
 	 * these fields.
 	 */
 	int regenerate_crc;
+	/* Raw data as last stored, so changes which cancel out aren't */
+	uint8_t raw_stored[VBNV_BLOCK_SIZE];
 } VbNvContext;
 
 /* Parameter type for VbNvGet(), VbNvSet(). */
@@ -280,6 +283,9 @@ int VbNvSetup(VbNvContext *context);
  * Proper calling procedure:
  *    1) Call VbNvExit().
  *    2) If context.raw_changed, write data back to underlying storage.
+ *       This may be done more than once between VbNvSetup() and freeing
+ *       the context, to store changes early; raw_changed is only set again
+ *       if something changed since the last call.
  *    3) Release any lock you acquired before calling VbNvSetup().
  *    4) Free the context struct.
  *
@@ -328,4 +334,23 @@ int RestoreNvFromBackup(VbNvContext *vnc);
  */
 int SaveNvToBackup(VbNvContext *vnc);
 
+struct VbCommonParams;
+
+/**
+ * Load NV storage for a vboot API call.
+ *
+ * If cparams has a vboot2 context, this takes the NV data that it's already
+ * checked.  Otherwise this reads it with VbExNvStorageRead() and calls
+ * VbNvSetup().
+ */
+void VbNvLoad(struct VbCommonParams *cparams, VbNvContext *vnc);
+
+/**
+ * Tear down NV storage at the end of a vboot API call, and write it with
+ * VbExNvStorageWrite() if it's changed.
+ *
+ * If cparams has a vboot2 context, its copy of the NV data is kept up to date.
+ */
+void VbNvSave(struct VbCommonParams *cparams, VbNvContext *vnc);
+
 #endif  /* VBOOT_REFERENCE_NVSTORAGE_H_ */
@@ -93,6 +93,8 @@ typedef struct VbKeyBlockHeader {
 
 #define FIRMWARE_PREAMBLE_HEADER_VERSION_MAJOR 2
 #define FIRMWARE_PREAMBLE_HEADER_VERSION_MINOR 1
+/* Minor version for preambles which carry an EC-RW hash */
+#define FIRMWARE_PREAMBLE_HEADER_VERSION_MINOR_EC_RW_HASH 2
 
 /*
  * Preamble block for rewritable firmware, version 2.0.  All 2.x versions of
@@ -131,6 +133,12 @@ typedef struct VbFirmwarePreambleHeader2_0 {
  * verifying the body signature.
  */
 #define VB_FIRMWARE_PREAMBLE_USE_RO_NORMAL 0x00000001
+/*
+ * The body is compressed with LZMA1, and signed as it's stored.  This is the
+ * same as VB2_FIRMWARE_PREAMBLE_BODY_COMPRESSED; the firmware which loads the
+ * body decompresses it once the signature checks out.
+ */
+#define VB_FIRMWARE_PREAMBLE_BODY_COMPRESSED 0x00000004
 
 /* Premable block for rewritable firmware, version 2.1.
  *
@@ -173,14 +181,26 @@ typedef struct VbFirmwarePreambleHeader {
 	 * header version < 2.1.
 	 */
 	uint32_t flags;
+
+	/*
+	 * Fields added in header version 2.2.  You must verify the header
+	 * version before reading these fields!
+	 */
+	/*
+	 * SHA-256 digest of the EC-RW image which goes with this firmware, so
+	 * EC software sync doesn't need to hash the image itself.  sig_size is
+	 * 0 if there isn't one; data_size is the size of the EC-RW image.
+	 */
+	VbSignature ec_rw_hash;
 } __attribute__((packed)) VbFirmwarePreambleHeader;
 
 #define EXPECTED_VBFIRMWAREPREAMBLEHEADER2_1_SIZE 108
+#define EXPECTED_VBFIRMWAREPREAMBLEHEADER2_2_SIZE 132
 
 /****************************************************************************/
 
 #define KERNEL_PREAMBLE_HEADER_VERSION_MAJOR 2
-#define KERNEL_PREAMBLE_HEADER_VERSION_MINOR 2
+#define KERNEL_PREAMBLE_HEADER_VERSION_MINOR 4
 
 /* Preamble block for kernel, version 2.0
  *
@@ -226,6 +246,13 @@ typedef struct VbKernelPreambleHeader2_0 {
  *      data), pointed to by preamble_signature.sig_offset.
  *   3) The 16-bit vmlinuz header, which is used for reconstruction of
  *      vmlinuz image.
+ *
+ * For header version 2.3 with body_hash_count != 0, the body block hashes,
+ * pointed to by body_hash_offset, sit between the body signature data and
+ * the preamble signature, so they're covered by the preamble signature.
+ *
+ * For header version 2.4 with body_compression != COMPRESS_NONE, the body on
+ * disk is compressed, and body_signature covers the compressed bytes.
  */
 typedef struct VbKernelPreambleHeader {
 	/*
@@ -267,10 +294,49 @@ typedef struct VbKernelPreambleHeader {
 	 * [1:0]  - Kernel image type (0b00 - CrOS, 0b01 - bootimg)
 	 */
 	uint32_t flags;
+	/*
+	 * Fields added in header version 2.3.  Readers should treat
+	 * body_hash_count as 0 for header version < 2.3.
+	 *
+	 * The body is split into blocks of body_hash_block_size bytes (the
+	 * last one may be short), and each block is hashed with the hash
+	 * algorithm of the data key.  That lets the firmware check only the
+	 * blocks it needs to boot and leave the rest to the OS, which can check
+	 * them against the same signed hashes as it pages them in.
+	 */
+	/* Offset of the body block hashes from the start of this preamble */
+	uint32_t body_hash_offset;
+	/* Number of body block hashes; 0 if the body isn't hashed in blocks */
+	uint32_t body_hash_count;
+	/* Size of each body block in bytes */
+	uint32_t body_hash_block_size;
+	/*
+	 * The firmware must check the first body_hash_head_size bytes of the
+	 * body (the decompressor) and everything from body_hash_tail_offset to
+	 * the end of the body (the command line and bootloader) before booting.
+	 */
+	uint32_t body_hash_head_size;
+	uint32_t body_hash_tail_offset;
+	/*
+	 * Fields added in header version 2.4.  Readers should treat
+	 * body_compression as COMPRESS_NONE for header version < 2.4.
+	 *
+	 * A compressed body is smaller on disk, so less of it is read at boot.
+	 * It's decompressed to body_load_size bytes at body_load_address, and
+	 * bootloader_address and vmlinuz_header_address are in the
+	 * decompressed body.  A compressed body isn't hashed in blocks, since
+	 * the OS only ever sees it decompressed.
+	 */
+	/* Compression of the body on disk (COMPRESS_*; see vboot_api.h) */
+	uint32_t body_compression;
+	/* Size of the body in bytes once decompressed */
+	uint32_t body_load_size;
 } __attribute__((packed)) VbKernelPreambleHeader;
 
 #define EXPECTED_VBKERNELPREAMBLEHEADER2_1_SIZE 112
 #define EXPECTED_VBKERNELPREAMBLEHEADER2_2_SIZE 116
+#define EXPECTED_VBKERNELPREAMBLEHEADER2_3_SIZE 136
+#define EXPECTED_VBKERNELPREAMBLEHEADER2_4_SIZE 144
 
 /****************************************************************************/
 
@@ -322,6 +388,14 @@ typedef struct VbKernelPreambleHeader {
 #define VBSD_OPROM_MATTERS               0x00010000
 /* Firmware has loaded the VGA Option ROM */
 #define VBSD_OPROM_LOADED                0x00020000
+/* VbInit() was told the OS checks kernel body blocks the firmware skips */
+#define VBSD_PARTIAL_KERNEL_CHECK        0x00040000
+/* VbInit() was told the OS checks the secondary GPT */
+#define VBSD_LAZY_SECONDARY_GPT          0x00080000
+/* VbInit() was told the OS repairs a secondary GPT the firmware didn't write */
+#define VBSD_LAZY_SECONDARY_GPT_WRITE    0x00100000
+/* VbInit() was told to check dev mode key block hashes before signatures */
+#define VBSD_DEV_KEY_BLOCK_HASH_FIRST    0x00200000
 
 /*
  * Supported flags by header version.  It's ok to add new flags while keeping
@@ -358,6 +432,13 @@ typedef struct VbKernelPreambleHeader {
 
 /* Flags for VbSharedDataKernelPart.flags */
 #define VBSD_LKP_FLAG_KEY_BLOCK_VALID   0x01
+/*
+ * Only the body blocks needed to boot were checked; the OS must check the
+ * rest against the body block hashes in the preamble.
+ */
+#define VBSD_LKP_FLAG_BODY_PARTIAL      0x02
+/* The body was stored compressed, and was decompressed into the buffer */
+#define VBSD_LKP_FLAG_BODY_COMPRESSED   0x04
 
 /* Result codes for VbSharedDataKernelPart.check_result */
 #define VBSD_LKP_CHECK_NOT_DONE           0
@@ -384,6 +465,7 @@ typedef struct VbKernelPreambleHeader {
 #define VBSD_LKP_CHECK_READ_DATA          17
 #define VBSD_LKP_CHECK_VERIFY_DATA        18
 #define VBSD_LKP_CHECK_KERNEL_GOOD        19
+#define VBSD_LKP_CHECK_DECOMPRESS         20
 
 /* Information about a single kernel partition check in LoadKernel() */
 typedef struct VbSharedDataKernelPart {
@@ -441,6 +523,92 @@ typedef struct VbSharedDataKernelCall {
 /* Number of kernel calls to track.  Must be power of 2. */
 #define VBSD_MAX_KERNEL_CALLS 4
 
+/* Disk reads done for one part of a LoadKernel() call */
+typedef struct VbSharedDataIoStats {
+	uint64_t read_ticks;       /* VbExGetTimer() ticks spent reading */
+	uint32_t read_bytes;       /* Bytes read */
+	uint32_t read_calls;       /* Number of VbExDiskRead/StreamRead calls */
+} __attribute__((packed)) VbSharedDataIoStats;
+
+/* Disk reads done by a single call to LoadKernel() */
+typedef struct VbSharedDataKernelCallIo {
+	/* Reading the GPT */
+	VbSharedDataIoStats gpt;
+	/* Reading each kernel partition; matches VbSharedDataKernelCall */
+	VbSharedDataIoStats parts[VBSD_MAX_KERNEL_PARTS];
+} __attribute__((packed)) VbSharedDataKernelCallIo;
+
+/*
+ * Boot phase boundaries for VbSharedDataTimestamp.id.  Values 1-10 are
+ * the vboot2 firmware phases, and match enum vb2_timestamp_id so firmware
+ * can copy them from vb2_shared_data as they are.
+ */
+#define VBSD_TS_NONE                    0
+#define VBSD_TS_FW_PHASE1_ENTER         1
+#define VBSD_TS_FW_PHASE1_EXIT          2
+#define VBSD_TS_FW_PHASE2_ENTER         3
+#define VBSD_TS_FW_PHASE2_EXIT          4
+#define VBSD_TS_FW_PHASE3_ENTER         5
+#define VBSD_TS_FW_KEYBLOCK_EXIT        6
+#define VBSD_TS_FW_PREAMBLE_EXIT        7
+#define VBSD_TS_FW_INIT_HASH            8
+#define VBSD_TS_FW_CHECK_HASH_ENTER     9
+#define VBSD_TS_FW_CHECK_HASH_EXIT      10
+#define VBSD_TS_LOAD_KERNEL_ENTER       11
+#define VBSD_TS_LOAD_KERNEL_EXIT        12
+#define VBSD_TS_EC_SOFTWARE_SYNC_ENTER  13
+#define VBSD_TS_EC_SOFTWARE_SYNC_EXIT   14
+
+/* One boot phase boundary; same layout as struct vb2_timestamp */
+typedef struct VbSharedDataTimestamp {
+	uint64_t time;             /* Time from VbExGetTimer() */
+	uint32_t id;               /* Boundary; see VBSD_TS_* */
+	uint32_t reserved0;        /* Reserved for padding */
+} __attribute__((packed)) VbSharedDataTimestamp;
+
+/* Number of timestamps to track.  Must be power of 2. */
+#define VBSD_MAX_TIMESTAMPS 32
+
+/* What was measured, for VbSharedDataMeasurement.event */
+#define VBSD_MEASURE_NONE               0
+#define VBSD_MEASURE_BOOT_MODE          1  /* Boot mode digest */
+#define VBSD_MEASURE_HWID               2  /* GBB HWID digest */
+#define VBSD_MEASURE_FW_KEYBLOCK        3  /* SHA-1 of the RW keyblock */
+#define VBSD_MEASURE_FW_PREAMBLE        4  /* SHA-1 of the RW preamble */
+#define VBSD_MEASURE_FW_BODY            5  /* SHA-1 of the RW body digest */
+
+/* VbSharedDataMeasurement.pcr for measurements which are only logged */
+#define VBSD_MEASURE_NO_PCR 0xff
+
+/* One measurement in the event log; digest is what was extended */
+typedef struct VbSharedDataMeasurement {
+	uint8_t digest[20];        /* SHA-1 digest */
+	uint8_t pcr;               /* PCR, or VBSD_MEASURE_NO_PCR */
+	uint8_t event;             /* What was measured; see VBSD_MEASURE_* */
+	uint8_t reserved0[2];      /* Reserved for padding */
+} __attribute__((packed)) VbSharedDataMeasurement;
+
+/* Number of measurements the event log can hold */
+#define VBSD_MAX_MEASUREMENTS 8
+
+/* Buckets in VbSharedDataCryptoStats */
+#define VBSD_CRYPTO_STATS_HASH_ALGS 8  /* By hash algorithm (VB2_HASH_*) */
+#define VBSD_CRYPTO_STATS_RSA_SIZES 4  /* 1024, 2048, 4096 and 8192 bits */
+
+/*
+ * Crypto work done during boot; same layout as struct vb2_crypto_stats.  All
+ * zeros unless the firmware was built with CRYPTO_STATS=1.
+ */
+typedef struct VbSharedDataCryptoStats {
+	uint64_t hash_bytes[VBSD_CRYPTO_STATS_HASH_ALGS];  /* Bytes hashed */
+	uint32_t rsa_verifies[VBSD_CRYPTO_STATS_RSA_SIZES];  /* Verifications */
+	uint64_t crc32_bytes;           /* Bytes passed to Crc32() */
+	uint32_t decompress_calls;      /* Images decompressed */
+	uint32_t reserved0;             /* Reserved for padding */
+	uint64_t decompress_in_bytes;   /* Compressed size of those images */
+	uint64_t decompress_out_bytes;  /* Decompressed size of those images */
+} __attribute__((packed)) VbSharedDataCryptoStats;
+
 /*
  * Data shared between LoadFirmware(), LoadKernel(), and OS.
  *
@@ -552,6 +720,47 @@ typedef struct VbSharedDataHeader {
 	 * all the fields it knows about are present.  Newer firmware needs to
 	 * use reasonable defaults when accessing older structs.
 	 */
+
+	/*
+	 * Fields added in version 3.  Before accessing, make sure that
+	 * struct_version >= 3
+	 */
+	/*
+	 * Number of timestamps recorded.  This keeps counting once the ring
+	 * is full, so timestamp N is at timestamps[N % VBSD_MAX_TIMESTAMPS]
+	 * and only the last VBSD_MAX_TIMESTAMPS are kept.
+	 */
+	uint32_t timestamp_count;
+	/* Reserved for padding */
+	uint32_t reserved3;
+	/* Boot phase boundaries; see VbSharedDataRecordTimestamp() */
+	VbSharedDataTimestamp timestamps[VBSD_MAX_TIMESTAMPS];
+	/*
+	 * SHA-256 digest of the EC-RW image, from the preamble of the firmware
+	 * LoadFirmware() picked.  ec_rw_hash_size is 0 if it didn't have one.
+	 */
+	uint8_t ec_rw_hash[32];
+	uint32_t ec_rw_hash_size;
+	/* Reserved for padding */
+	uint32_t reserved4;
+	/*
+	 * Measured boot event log.  Entries from measurement_flushed up to
+	 * measurement_count are queued and haven't been extended into the TPM
+	 * yet; see VbSharedDataQueueMeasurement().
+	 */
+	uint32_t measurement_count;
+	uint32_t measurement_flushed;
+	VbSharedDataMeasurement measurements[VBSD_MAX_MEASUREMENTS];
+	/*
+	 * The rest of the version 3 fields are only there if struct_size is
+	 * sizeof(VbSharedDataHeader).  VbSharedDataInit() leaves them out of
+	 * a buffer without room for them as well as a kernel subkey, so
+	 * check struct_size before accessing them.
+	 */
+	/* Disk reads for each call in lk_calls[], at the same index */
+	VbSharedDataKernelCallIo lk_call_io[VBSD_MAX_KERNEL_CALLS];
+	/* Crypto work done; see VbSharedDataFlushCryptoStats() */
+	VbSharedDataCryptoStats crypto_stats;
 } __attribute__((packed)) VbSharedDataHeader;
 
 /*
@@ -562,7 +771,50 @@ typedef struct VbSharedDataHeader {
  */
 #define VB_SHARED_DATA_HEADER_SIZE_V1 1072
 #define VB_SHARED_DATA_HEADER_SIZE_V2 1096
+#define VB_SHARED_DATA_HEADER_SIZE_V3 2544
+/* Version 3 without lk_call_io[] and crypto_stats */
+#define VB_SHARED_DATA_HEADER_SIZE_V3_MIN 1856
+
+#define VB_SHARED_DATA_VERSION 3      /* Version for struct_version */
+
+/*
+ * Compact encoding of VbSharedData, for handing it to the OS.  The blob is a
+ * VbSharedDataCompactHeader followed by records, each a VbSharedDataRecord
+ * and its data, padded to a multiple of 4 bytes.  Only what was filled in is
+ * kept: the LoadKernel() calls and partitions which were tried, the
+ * timestamps and measurements which were recorded, any crypto stats, and the
+ * kernel subkey.
+ * Anything else decodes as zeros, and records with unknown tags are skipped.
+ */
+/* Magic number for recognizing VbSharedDataCompactHeader ("VbSC") */
+#define VB_SHARED_DATA_COMPACT_MAGIC 0x43536256
+#define VB_SHARED_DATA_COMPACT_VERSION 1
 
-#define VB_SHARED_DATA_VERSION 2      /* Version for struct_version */
+typedef struct VbSharedDataCompactHeader {
+	/* Magic number for struct (VB_SHARED_DATA_COMPACT_MAGIC) */
+	uint32_t magic;
+	/* Version of the encoding */
+	uint16_t version;
+	/* Number of records which follow */
+	uint16_t record_count;
+	/* Size of the whole encoding in bytes, this header included */
+	uint32_t size;
+	/* Reserved for padding */
+	uint32_t reserved0;
+} __attribute__((packed)) VbSharedDataCompactHeader;
+
+/* Tags for VbSharedDataRecord.tag */
+/*
+ * Part of the VbSharedDataHeader; the data is a uint32_t offset from the start
+ * of the header, then the bytes found there.
+ */
+#define VBSD_REC_HEADER_SPAN  1
+/* The kernel subkey data, which goes with header->kernel_subkey */
+#define VBSD_REC_KERNEL_SUBKEY 2
+
+typedef struct VbSharedDataRecord {
+	uint16_t tag;              /* What the data is; see VBSD_REC_* */
+	uint16_t size;             /* Size of the data, before padding */
+} __attribute__((packed)) VbSharedDataRecord;
 
 #endif  /* VBOOT_REFERENCE_VBOOT_STRUCT_H_ */
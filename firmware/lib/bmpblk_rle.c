@@ -0,0 +1,57 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Run-length decoding of screen images.
+ */
+
+#include "sysincludes.h"
+
+#include "bmpblk_header.h"
+#include "bmpblk_rle.h"
+#include "utility.h"
+
+VbError_t VbRleDecode(const uint8_t *in, uint32_t in_size,
+		      uint8_t *out, uint32_t *out_size)
+{
+	uint32_t in_pos = 1, out_pos = 0;
+	uint32_t unit, bytes, done, n;
+
+	if (!in_size || in[0] < 1 || in[0] > RLE_MAX_UNIT)
+		return VBERROR_INVALID_BMPFV;
+	unit = in[0];
+
+	while (in_pos < in_size) {
+		uint8_t c = in[in_pos++];
+
+		if (c < RLE_RUN) {
+			bytes = (c + 1) * unit;
+			if (bytes > in_size - in_pos ||
+			    bytes > *out_size - out_pos)
+				return VBERROR_INVALID_BMPFV;
+			Memcpy(out + out_pos, in + in_pos, bytes);
+			in_pos += bytes;
+			out_pos += bytes;
+			continue;
+		}
+
+		bytes = (c - RLE_RUN + 2) * unit;
+		if (unit > in_size - in_pos || bytes > *out_size - out_pos)
+			return VBERROR_INVALID_BMPFV;
+		if (unit == 1) {
+			Memset(out + out_pos, in[in_pos], bytes);
+		} else {
+			/* Copy what's been repeated so far, doubling it */
+			Memcpy(out + out_pos, in + in_pos, unit);
+			for (done = unit; done < bytes; done += n) {
+				n = done < bytes - done ? done : bytes - done;
+				Memcpy(out + out_pos + done, out + out_pos, n);
+			}
+		}
+		in_pos += unit;
+		out_pos += bytes;
+	}
+
+	*out_size = out_pos;
+	return VBERROR_SUCCESS;
+}
@@ -17,8 +17,10 @@ int GptInit(GptData *gpt)
 	int retval;
 
 	gpt->modified = 0;
+	gpt->entries_partial = 0;
 	gpt->current_kernel = CGPT_KERNEL_ENTRY_NOT_FOUND;
 	gpt->current_priority = 999;
+	gpt->kernels_indexed = 0;
 
 	retval = GptSanityCheck(gpt);
 	if (GPT_SUCCESS != retval) {
@@ -26,90 +28,71 @@ int GptInit(GptData *gpt)
 		return retval;
 	}
 
-	GptRepair(gpt);
+	/*
+	 * Don't "repair" a secondary GPT which was never read; the OS checks
+	 * it.  It's still rebuilt from the primary if the entries change.
+	 */
+	if (gpt->secondary_unread)
+		VBDEBUG(("GptInit() leaving secondary GPT unchecked\n"));
+	else
+		GptRepair(gpt);
+
+	GptIndexKernels(gpt);
 	return GPT_SUCCESS;
 }
 
+/* Find a kernel's index entry, or NULL if it's not a kernel */
+static GptKernelInfo *FindKernel(GptData *gpt, uint32_t entry)
+{
+	uint32_t i;
+
+	for (i = 0; i < gpt->num_kernels; i++) {
+		if (gpt->kernels[i].entry == entry)
+			return gpt->kernels + i;
+	}
+	return NULL;
+}
+
 int GptNextKernelEntry(GptData *gpt, uint64_t *start_sector, uint64_t *size)
 {
-	GptHeader *header = (GptHeader *)gpt->primary_header;
 	GptEntry *entries = (GptEntry *)gpt->primary_entries;
+	GptKernelInfo *k;
 	GptEntry *e;
-	int new_kernel = CGPT_KERNEL_ENTRY_NOT_FOUND;
-	int new_prio = 0;
-	uint32_t i;
 
-	/*
-	 * If we already found a kernel, continue the scan at the current
-	 * kernel's priority, in case there is another kernel with the same
-	 * priority.
-	 */
-	if (gpt->current_kernel != CGPT_KERNEL_ENTRY_NOT_FOUND) {
-		for (i = gpt->current_kernel + 1;
-		     i < header->number_of_entries; i++) {
-			e = entries + i;
-			if (!IsKernelEntry(e))
-				continue;
-			VBDEBUG(("GptNextKernelEntry looking at same prio "
-				 "partition %d\n", i+1));
-			VBDEBUG(("GptNextKernelEntry s%d t%d p%d\n",
-				 GetEntrySuccessful(e), GetEntryTries(e),
-				 GetEntryPriority(e)));
-			if (!(GetEntrySuccessful(e) || GetEntryTries(e)))
-				continue;
-			if (GetEntryPriority(e) == gpt->current_priority) {
-				gpt->current_kernel = i;
-				*start_sector = e->starting_lba;
-				*size = e->ending_lba - e->starting_lba + 1;
-				VBDEBUG(("GptNextKernelEntry likes it\n"));
-				return GPT_SUCCESS;
-			}
-		}
-	}
+	if (!gpt->kernels_indexed)
+		GptIndexKernels(gpt);
 
 	/*
-	 * We're still here, so scan for the remaining kernel with the highest
-	 * priority less than the previous attempt.
+	 * The index is sorted by priority, then partition number, which is
+	 * the order kernels are tried in.  So just carry on from the last one
+	 * returned, skipping kernels which can't be booted.  Kernels already
+	 * returned may have been marked bad since, but they're behind us.
 	 */
-	for (i = 0, e = entries; i < header->number_of_entries; i++, e++) {
-		int current_prio = GetEntryPriority(e);
-		if (!IsKernelEntry(e))
-			continue;
-		VBDEBUG(("GptNextKernelEntry looking at new prio "
-			 "partition %d\n", i+1));
+	while (gpt->next_kernel < gpt->num_kernels) {
+		k = gpt->kernels +
+			gpt->kernels_by_priority[gpt->next_kernel++];
+		VBDEBUG(("GptNextKernelEntry looking at partition %d\n",
+			 k->entry + 1));
 		VBDEBUG(("GptNextKernelEntry s%d t%d p%d\n",
-			 GetEntrySuccessful(e), GetEntryTries(e),
-			 GetEntryPriority(e)));
-		if (!(GetEntrySuccessful(e) || GetEntryTries(e)))
+			 k->successful, k->tries, k->priority));
+		if (!(k->successful || k->tries) || !k->priority)
 			continue;
-		if (current_prio >= gpt->current_priority) {
-			/* Already returned this kernel in a previous call */
-			continue;
-		}
-		if (current_prio > new_prio) {
-			new_kernel = i;
-			new_prio = current_prio;
-		}
-	}
 
-	/*
-	 * Save what we found.  Note that if we didn't find a new kernel,
-	 * new_prio will still be -1, so future calls to this function will
-	 * also fail.
-	 */
-	gpt->current_kernel = new_kernel;
-	gpt->current_priority = new_prio;
-
-	if (CGPT_KERNEL_ENTRY_NOT_FOUND == new_kernel) {
-		VBDEBUG(("GptNextKernelEntry no more kernels\n"));
-		return GPT_ERROR_NO_VALID_KERNEL;
+		gpt->current_kernel = k->entry;
+		gpt->current_priority = k->priority;
+		VBDEBUG(("GptNextKernelEntry likes partition %d\n",
+			 k->entry + 1));
+		e = entries + k->entry;
+		*start_sector = e->starting_lba;
+		*size = e->ending_lba - e->starting_lba + 1;
+		return GPT_SUCCESS;
 	}
 
-	VBDEBUG(("GptNextKernelEntry likes partition %d\n", new_kernel + 1));
-	e = entries + new_kernel;
-	*start_sector = e->starting_lba;
-	*size = e->ending_lba - e->starting_lba + 1;
-	return GPT_SUCCESS;
+	/* So future calls to this function will also fail */
+	gpt->current_kernel = CGPT_KERNEL_ENTRY_NOT_FOUND;
+	gpt->current_priority = 0;
+	VBDEBUG(("GptNextKernelEntry no more kernels\n"));
+	return GPT_ERROR_NO_VALID_KERNEL;
 }
 
 /*
@@ -119,11 +102,15 @@ int GptNextKernelEntry(GptData *gpt, uint64_t *start_sector, uint64_t *size)
  */
 int GptUpdateKernelWithEntry(GptData *gpt, GptEntry *e, uint32_t update_type)
 {
+	GptEntry old;
 	int modified = 0;
 
 	if (!IsKernelEntry(e))
 		return GPT_ERROR_INVALID_UPDATE_TYPE;
 
+	/* So only what changed has to go into the CRCs */
+	Memcpy(&old, e, sizeof(old));
+
 	switch (update_type) {
 	case GPT_UPDATE_ENTRY_TRY: {
 		/* Used up a try */
@@ -184,7 +171,15 @@ int GptUpdateKernelWithEntry(GptData *gpt, GptEntry *e, uint32_t update_type)
 	}
 
 	if (modified) {
-		GptModified(gpt);
+		GptModifiedEntry(gpt, e, &old);
+
+		/* Keep the kernel index in step */
+		if (gpt->kernels_indexed) {
+			GptKernelInfo *k = FindKernel(
+				gpt, e - (GptEntry *)gpt->primary_entries);
+			if (k)
+				GptRefreshKernel(gpt, k);
+		}
 	}
 
 	return GPT_SUCCESS;
@@ -214,11 +209,20 @@ int GptUpdateKernelEntry(GptData *gpt, uint32_t update_type)
  */
 GptEntry *GptFindNthEntry(GptData *gpt, const Guid *guid, unsigned int n)
 {
+	static const Guid chromeos_kernel = GPT_ENT_TYPE_CHROMEOS_KERNEL;
 	GptHeader *header = (GptHeader *)gpt->primary_header;
 	GptEntry *entries = (GptEntry *)gpt->primary_entries;
 	GptEntry *e;
 	int i;
 
+	/* Kernels are in the index, in partition order */
+	if (gpt->kernels_indexed &&
+	    !Memcmp(guid, &chromeos_kernel, sizeof(*guid))) {
+		if (n >= gpt->num_kernels)
+			return NULL;
+		return entries + gpt->kernels[n].entry;
+	}
+
 	for (i = 0, e = entries; i < header->number_of_entries; i++, e++) {
 		if (!Memcmp(&e->type, guid, sizeof(*guid))) {
 			if (n == 0)
@@ -12,18 +12,17 @@
 #include "gpt_misc.h"
 #include "utility.h"
 
-const static int SECTOR_SIZE = 512;
-
-size_t CalculateEntriesSectors(GptHeader* h) {
+size_t CalculateEntriesSectors(GptHeader* h, uint32_t sector_bytes) {
   size_t bytes = h->number_of_entries * h->size_of_entry;
-  size_t ret = (bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+  size_t ret = (bytes + sector_bytes - 1) / sector_bytes;
   return ret;
 }
 
 int CheckParameters(GptData *gpt)
 {
-	/* Currently, we only support 512-byte sectors. */
-	if (gpt->sector_bytes != SECTOR_SIZE)
+	/* We support 512-byte sectors, and native 4K drives. */
+	if (gpt->sector_bytes != GPT_SECTOR_SIZE &&
+	    gpt->sector_bytes != GPT_SECTOR_SIZE_4K)
 		return GPT_ERROR_INVALID_SECTOR_SIZE;
 
 	/*
@@ -44,7 +43,7 @@ int CheckParameters(GptData *gpt)
 	 */
 	if (gpt->gpt_drive_sectors <
 		(1 + 2 * (1 + MIN_NUMBER_OF_ENTRIES /
-				(SECTOR_SIZE / sizeof(GptEntry)))))
+				(gpt->sector_bytes / sizeof(GptEntry)))))
 		return GPT_ERROR_INVALID_SECTOR_NUMBER;
 
 	return GPT_SUCCESS;
@@ -65,7 +64,8 @@ uint32_t HeaderCrc(GptHeader *h)
 
 int CheckHeader(GptHeader *h, int is_secondary,
 		uint64_t streaming_drive_sectors,
-		uint64_t gpt_drive_sectors, uint32_t flags)
+		uint64_t gpt_drive_sectors, uint32_t flags,
+		uint32_t sector_bytes)
 {
 	if (!h)
 		return 1;
@@ -114,7 +114,8 @@ int CheckHeader(GptHeader *h, int is_secondary,
 	if (is_secondary) {
 		if (h->my_lba != gpt_drive_sectors - GPT_HEADER_SECTORS)
 			return 1;
-		if (h->entries_lba != h->my_lba - CalculateEntriesSectors(h))
+		if (h->entries_lba != h->my_lba -
+		    CalculateEntriesSectors(h, sector_bytes))
 			return 1;
 	} else {
 		if (h->my_lba != GPT_PMBR_SECTORS)
@@ -140,10 +141,11 @@ int CheckHeader(GptHeader *h, int is_secondary,
 	 * array.
 	 */
 	/* TODO(namnguyen): Also check for padding between header & entries. */
-	if (h->first_usable_lba < 2 + CalculateEntriesSectors(h))
+	if (h->first_usable_lba <
+	    2 + CalculateEntriesSectors(h, sector_bytes))
 		return 1;
-	if (h->last_usable_lba >=
-			streaming_drive_sectors - 1 - CalculateEntriesSectors(h))
+	if (h->last_usable_lba >= streaming_drive_sectors - 1 -
+	    CalculateEntriesSectors(h, sector_bytes))
 		return 1;
 
 	/* Success */
@@ -252,12 +254,14 @@ int GptSanityCheck(GptData *gpt)
 
 	/* Check both headers; we need at least one valid header. */
 	if (0 == CheckHeader(header1, 0, gpt->streaming_drive_sectors,
-			     gpt->gpt_drive_sectors, gpt->flags)) {
+			     gpt->gpt_drive_sectors, gpt->flags,
+			     gpt->sector_bytes)) {
 		gpt->valid_headers |= MASK_PRIMARY;
 		goodhdr = header1;
 	}
 	if (0 == CheckHeader(header2, 1, gpt->streaming_drive_sectors,
-			     gpt->gpt_drive_sectors, gpt->flags)) {
+			     gpt->gpt_drive_sectors, gpt->flags,
+			     gpt->sector_bytes)) {
 		gpt->valid_headers |= MASK_SECONDARY;
 		if (!goodhdr)
 			goodhdr = header2;
@@ -312,12 +316,102 @@ int GptSanityCheck(GptData *gpt)
 	return GPT_SUCCESS;
 }
 
+void GptEntriesModified(GptData *gpt, uint8_t copy, uint32_t first,
+			uint32_t end)
+{
+	int i = (copy == GPT_MODIFIED_ENTRIES2);
+
+	if (!(gpt->modified & copy)) {
+		gpt->entries_partial |= copy;
+		gpt->entries_first[i] = first;
+		gpt->entries_end[i] = end;
+	} else if ((gpt->entries_partial & copy) && first < end) {
+		if (gpt->entries_first[i] == gpt->entries_end[i]) {
+			gpt->entries_first[i] = first;
+			gpt->entries_end[i] = end;
+		} else {
+			if (first < gpt->entries_first[i])
+				gpt->entries_first[i] = first;
+			if (end > gpt->entries_end[i])
+				gpt->entries_end[i] = end;
+		}
+	}
+	gpt->modified |= copy;
+}
+
+void GptCopyEntries(GptData *gpt, uint8_t copy, uint32_t entries_size)
+{
+	uint8_t *dest = gpt->primary_entries;
+	const uint8_t *src = gpt->secondary_entries;
+	uint32_t offset, sector, first = 0, end = 0;
+
+	if (copy == GPT_MODIFIED_ENTRIES2) {
+		dest = gpt->secondary_entries;
+		src = gpt->primary_entries;
+	}
+
+	if (!(gpt->entries_loaded & copy)) {
+		Memcpy(dest, src, entries_size);
+		gpt->modified |= copy;
+		gpt->entries_partial &= ~copy;
+		return;
+	}
+
+	/*
+	 * Usually the copies differ in an entry or two, after a torn write
+	 * or the firmware updating only the primary.  Then only the sectors
+	 * around those need to go back to the drive.
+	 */
+	for (offset = 0, sector = 0; offset < entries_size;
+	     offset += gpt->sector_bytes, sector++) {
+		uint32_t len = entries_size - offset;
+
+		if (len > gpt->sector_bytes)
+			len = gpt->sector_bytes;
+		if (!Memcmp(dest + offset, src + offset, len))
+			continue;
+		Memcpy(dest + offset, src + offset, len);
+		if (!end)
+			first = sector;
+		end = sector + 1;
+	}
+
+	GptEntriesModified(gpt, copy, first, end);
+}
+
+void GptEntriesMoved(GptData *gpt, uint8_t copy)
+{
+	gpt->entries_loaded &= ~copy;
+	gpt->entries_partial &= ~copy;
+}
+
+int GptEntriesToWrite(const GptData *gptdata, uint8_t copy,
+		      uint64_t entries_sectors, uint64_t *first,
+		      uint64_t *count)
+{
+	int i = (copy == GPT_MODIFIED_ENTRIES2);
+	uint64_t end = entries_sectors;
+
+	*first = 0;
+	*count = 0;
+	if (!(gptdata->modified & copy))
+		return 0;
+	if (gptdata->entries_partial & copy) {
+		if (end > gptdata->entries_end[i])
+			end = gptdata->entries_end[i];
+		if (gptdata->entries_first[i] >= end)
+			return 0;
+		*first = gptdata->entries_first[i];
+	}
+	*count = end - *first;
+	return 1;
+}
+
 void GptRepair(GptData *gpt)
 {
 	GptHeader *header1 = (GptHeader *)(gpt->primary_header);
 	GptHeader *header2 = (GptHeader *)(gpt->secondary_header);
-	GptEntry *entries1 = (GptEntry *)(gpt->primary_entries);
-	GptEntry *entries2 = (GptEntry *)(gpt->secondary_entries);
+	uint64_t old_entries_lba;
 	int entries_size;
 
 	/* Need at least one good header and one good set of entries. */
@@ -327,15 +421,20 @@ void GptRepair(GptData *gpt)
 	/* Repair headers if necessary */
 	if (MASK_PRIMARY == gpt->valid_headers) {
 		/* Primary is good, secondary is bad */
+		old_entries_lba = header2->entries_lba;
 		Memcpy(header2, header1, sizeof(GptHeader));
 		header2->my_lba = gpt->gpt_drive_sectors - GPT_HEADER_SECTORS;
 		header2->alternate_lba = GPT_PMBR_SECTORS;  /* Second sector. */
-		header2->entries_lba = header2->my_lba - CalculateEntriesSectors(header1);
+		header2->entries_lba = header2->my_lba -
+			CalculateEntriesSectors(header1, gpt->sector_bytes);
 		header2->header_crc32 = HeaderCrc(header2);
 		gpt->modified |= GPT_MODIFIED_HEADER2;
+		if (header2->entries_lba != old_entries_lba)
+			GptEntriesMoved(gpt, GPT_MODIFIED_ENTRIES2);
 	}
 	else if (MASK_SECONDARY == gpt->valid_headers) {
 		/* Secondary is good, primary is bad */
+		old_entries_lba = header1->entries_lba;
 		Memcpy(header1, header2, sizeof(GptHeader));
 		header1->my_lba = GPT_PMBR_SECTORS;  /* Second sector. */
 		header1->alternate_lba =
@@ -344,6 +443,8 @@ void GptRepair(GptData *gpt)
 		header1->entries_lba = header1->my_lba + 1;
 		header1->header_crc32 = HeaderCrc(header1);
 		gpt->modified |= GPT_MODIFIED_HEADER1;
+		if (header1->entries_lba != old_entries_lba)
+			GptEntriesMoved(gpt, GPT_MODIFIED_ENTRIES1);
 	}
 	gpt->valid_headers = MASK_BOTH;
 
@@ -351,17 +452,57 @@ void GptRepair(GptData *gpt)
 	entries_size = header1->size_of_entry * header1->number_of_entries;
 	if (MASK_PRIMARY == gpt->valid_entries) {
 		/* Primary is good, secondary is bad */
-		Memcpy(entries2, entries1, entries_size);
-		gpt->modified |= GPT_MODIFIED_ENTRIES2;
+		GptCopyEntries(gpt, GPT_MODIFIED_ENTRIES2, entries_size);
 	}
 	else if (MASK_SECONDARY == gpt->valid_entries) {
 		/* Secondary is good, primary is bad */
-		Memcpy(entries1, entries2, entries_size);
-		gpt->modified |= GPT_MODIFIED_ENTRIES1;
+		GptCopyEntries(gpt, GPT_MODIFIED_ENTRIES1, entries_size);
 	}
 	gpt->valid_entries = MASK_BOTH;
 }
 
+void GptIndexKernels(GptData *gpt)
+{
+	GptHeader *header = (GptHeader *)gpt->primary_header;
+	GptEntry *entries = (GptEntry *)gpt->primary_entries;
+	uint8_t *order = gpt->kernels_by_priority;
+	GptKernelInfo *k;
+	uint32_t i, j;
+
+	gpt->num_kernels = 0;
+	for (i = 0; i < header->number_of_entries &&
+		     gpt->num_kernels < GPT_MAX_KERNELS; i++) {
+		if (!IsKernelEntry(entries + i))
+			continue;
+
+		k = gpt->kernels + gpt->num_kernels;
+		k->entry = i;
+		GptRefreshKernel(gpt, k);
+
+		/*
+		 * Insertion sort, keeping partition order within a priority.
+		 * There are only ever a handful of kernels.
+		 */
+		for (j = gpt->num_kernels;
+		     j && gpt->kernels[order[j - 1]].priority < k->priority;
+		     j--)
+			order[j] = order[j - 1];
+		order[j] = gpt->num_kernels++;
+	}
+
+	gpt->next_kernel = 0;
+	gpt->kernels_indexed = 1;
+}
+
+void GptRefreshKernel(GptData *gpt, GptKernelInfo *k)
+{
+	const GptEntry *e = (GptEntry *)gpt->primary_entries + k->entry;
+
+	k->priority = GetEntryPriority(e);
+	k->tries = GetEntryTries(e);
+	k->successful = GetEntrySuccessful(e);
+}
+
 int GetEntrySuccessful(const GptEntry *e)
 {
 	return (e->attrs.fields.gpt_att & CGPT_ATTRIBUTE_SUCCESSFUL_MASK) >>
@@ -419,6 +560,12 @@ void GptModified(GptData *gpt) {
 				      header->number_of_entries);
 	header->header_crc32 = HeaderCrc(header);
 	gpt->modified |= GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1;
+	gpt->entries_partial &= ~GPT_MODIFIED_ENTRIES1;
+
+	/* Leave a secondary which was never read for the OS to repair */
+	if (gpt->secondary_unread &&
+	    (gpt->flags & GPT_FLAG_LAZY_SECONDARY_WRITE))
+		return;
 
 	/*
 	 * Use the repair function to update the other copy of the GPT.  This
@@ -430,6 +577,70 @@ void GptModified(GptData *gpt) {
 	GptRepair(gpt);
 }
 
+void GptModifiedEntry(GptData *gpt, const GptEntry *e, const GptEntry *old)
+{
+	GptHeader *header1 = (GptHeader *)gpt->primary_header;
+	GptHeader *header2 = (GptHeader *)gpt->secondary_header;
+	uint32_t entries_size = header1->size_of_entry *
+		header1->number_of_entries;
+	const uint8_t *start = gpt->primary_entries;
+	uint32_t offset;
+	GptEntry *e2;
+
+	/*
+	 * With only the primary copy going back to the drive, only its CRCs
+	 * need patching.
+	 */
+	if (gpt->secondary_unread &&
+	    (gpt->flags & GPT_FLAG_LAZY_SECONDARY_WRITE) &&
+	    (MASK_PRIMARY & gpt->valid_headers) &&
+	    (MASK_PRIMARY & gpt->valid_entries) &&
+	    (const uint8_t *)e >= start &&
+	    (const uint8_t *)(e + 1) <= start + entries_size) {
+		offset = (const uint8_t *)e - start;
+		header1->entries_crc32 = Crc32Patch(header1->entries_crc32,
+						    entries_size, offset, old,
+						    e, sizeof(GptEntry));
+		header1->header_crc32 = HeaderCrc(header1);
+		gpt->modified |= GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1;
+		gpt->entries_partial &= ~GPT_MODIFIED_ENTRIES1;
+		return;
+	}
+
+	/*
+	 * Only patch the CRCs if the secondary copy is known to match the
+	 * primary one, so patching both gives the same answer.
+	 */
+	if (MASK_BOTH != gpt->valid_headers ||
+	    MASK_BOTH != gpt->valid_entries ||
+	    header1->entries_crc32 != header2->entries_crc32 ||
+	    (const uint8_t *)e < start ||
+	    (const uint8_t *)(e + 1) > start + entries_size) {
+		GptModified(gpt);
+		return;
+	}
+
+	offset = (const uint8_t *)e - start;
+	e2 = (GptEntry *)(gpt->secondary_entries + offset);
+	if (Memcmp(e2, old, sizeof(GptEntry))) {
+		GptModified(gpt);
+		return;
+	}
+
+	header1->entries_crc32 = Crc32Patch(header1->entries_crc32,
+					    entries_size, offset, old, e,
+					    sizeof(GptEntry));
+	header1->header_crc32 = HeaderCrc(header1);
+
+	Memcpy(e2, e, sizeof(GptEntry));
+	header2->entries_crc32 = header1->entries_crc32;
+	header2->header_crc32 = HeaderCrc(header2);
+
+	gpt->modified |= GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1 |
+		GPT_MODIFIED_HEADER2 | GPT_MODIFIED_ENTRIES2;
+	gpt->entries_partial = 0;
+}
+
 
 const char *GptErrorText(int error_code)
 {
@@ -54,6 +54,10 @@
 #define MIN_NUMBER_OF_ENTRIES 16
 #define MAX_NUMBER_OF_ENTRIES 128
 
+/* Sector sizes supported, in bytes */
+#define GPT_SECTOR_SIZE 512
+#define GPT_SECTOR_SIZE_4K 4096
+
 /* Defines GPT sizes */
 #define GPT_PMBR_SECTORS 1  /* size (in sectors) of PMBR */
 #define GPT_HEADER_SECTORS 1
@@ -87,7 +91,8 @@ int CheckParameters(GptData* gpt);
  */
 int CheckHeader(GptHeader *h, int is_secondary,
                 uint64_t streaming_drive_sectors,
-                uint64_t gpt_drive_sectors, uint32_t flags);
+                uint64_t gpt_drive_sectors, uint32_t flags,
+                uint32_t sector_bytes);
 
 /**
  * Calculate and return the header CRC.
@@ -128,12 +133,65 @@ int GptSanityCheck(GptData *gpt);
  */
 void GptRepair(GptData *gpt);
 
+/**
+ * Mark sectors [first, end) of one copy of the entries as modified, where
+ * [copy] is GPT_MODIFIED_ENTRIES1 or GPT_MODIFIED_ENTRIES2.  Adds to sectors
+ * already marked; does nothing more to a copy already wholly modified.
+ */
+void GptEntriesModified(GptData *gpt, uint8_t copy, uint32_t first,
+			uint32_t end);
+
+/**
+ * Copy [entries_size] bytes of entries from the other copy over [copy]
+ * (GPT_MODIFIED_ENTRIES1 or GPT_MODIFIED_ENTRIES2) a sector at a time, and
+ * mark only the sectors which differed as modified.  A copy which wasn't
+ * read from the drive (see GptData.entries_loaded) is marked all modified.
+ */
+void GptCopyEntries(GptData *gpt, uint8_t copy, uint32_t entries_size);
+
+/**
+ * Called when the header of [copy] moves its entries on the drive, so that
+ * they're all written to the new place.
+ */
+void GptEntriesMoved(GptData *gpt, uint8_t copy);
+
+/**
+ * Which sectors of one copy of the entries ([copy] as above) need writing:
+ * all [entries_sectors] of them, or only those marked modified.  The first,
+ * from the start of the entries, is put in [first] and the number of them in
+ * [count].
+ *
+ * Returns 1 if the copy needs writing, 0 if not.
+ */
+int GptEntriesToWrite(const GptData *gptdata, uint8_t copy,
+		      uint64_t entries_sectors, uint64_t *first,
+		      uint64_t *count);
+
+/**
+ * Build the index of kernel entries in gpt->kernels[], from the primary
+ * entries.  Assumes GptSanityCheck() has found them valid.
+ */
+void GptIndexKernels(GptData *gpt);
+
+/**
+ * Update a kernel's attributes in the index from its partition entry.
+ */
+void GptRefreshKernel(GptData *gpt, GptKernelInfo *k);
+
 /**
  * Called when the primary entries are modified and the CRCs need to be
  * recalculated and propagated to the secondary entries
  */
 void GptModified(GptData *gpt);
 
+/**
+ * Like GptModified(), when only the primary entry [e] has changed, from
+ * [old].  If both copies of the GPT were already good and in sync, this
+ * updates the CRCs from just the changed bytes, and copies only that entry to
+ * the secondary entries.  Otherwise it falls back to GptModified().
+ */
+void GptModifiedEntry(GptData *gpt, const GptEntry *e, const GptEntry *old);
+
 /* Getters and setters for partition attribute fields. */
 
 int GetEntrySuccessful(const GptEntry *e);
@@ -159,8 +217,9 @@ void GetCurrentKernelUniqueGuid(GptData *gpt, void *dest);
 const char *GptErrorText(int error_code);
 
 /**
- * Return number of 512-byte sectors required to store the entries table.
+ * Return number of [sector_bytes]-byte sectors required to store the entries
+ * table.
  */
-size_t CalculateEntriesSectors(GptHeader* h);
+size_t CalculateEntriesSectors(GptHeader* h, uint32_t sector_bytes);
 
 #endif /* VBOOT_REFERENCE_CGPTLIB_INTERNAL_H_ */
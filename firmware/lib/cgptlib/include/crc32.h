@@ -9,4 +9,45 @@
 
 uint32_t Crc32(const void *buffer, uint32_t len);
 
+/**
+ * Update a CRC after changing part of the buffer it covers.
+ *
+ * [crc] is Crc32() of a buffer of [len] bytes.  [size] bytes of it starting at
+ * [offset] have changed from [old_data] to [new_data].  Returns Crc32() of the
+ * changed buffer, without having to look at the rest of it.  This works since
+ * the CRC of the XOR of two buffers is the XOR of their CRCs (plus that of zeros
+ * the same length).
+ */
+uint32_t Crc32Patch(uint32_t crc, uint32_t len, uint32_t offset,
+		    const void *old_data, const void *new_data, uint32_t size);
+
+/* Crc32() implementations */
+enum crc32_impl {
+	/* Fastest implementation supported by this CPU */
+	CRC32_IMPL_AUTO = 0,
+
+	/* One byte per table lookup */
+	CRC32_IMPL_BYTEWISE,
+
+	/* Eight bytes per step, using eight tables */
+	CRC32_IMPL_SLICE_BY_8,
+
+	/* x86 carry-less multiply (PCLMULQDQ) */
+	CRC32_IMPL_PCLMUL,
+
+	/* ARMv8 CRC32 instructions */
+	CRC32_IMPL_ARMV8,
+};
+
+/**
+ * Select the implementation used by Crc32().
+ *
+ * This is normally not needed, since the fastest supported implementation is
+ * picked automatically.  Tests and benchmarks use it to compare them.
+ *
+ * Returns 0 if successful, non-zero if the implementation is not built in or
+ * not supported by this CPU.
+ */
+int Crc32SelectImpl(enum crc32_impl impl);
+
 #endif  /* VBOOT_REFERENCE_GPT_CRC32_H_ */
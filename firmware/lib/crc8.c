@@ -8,23 +8,20 @@
 #include "crc8.h"
 
 /**
- * Return CRC-8 of the data, using x^8 + x^2 + x + 1 polynomial.  A table-based
- * algorithm would be faster, but for only a few bytes it isn't worth the code
- * size. */
+ * Return CRC-8 of the data, using x^8 + x^2 + x + 1 polynomial.  This works a
+ * byte at a time without a table; see vb2_crc8() for how. */
 uint8_t Crc8(const void *vptr, int len)
 {
 	const uint8_t *data = vptr;
 	unsigned crc = 0;
-	int i, j;
+	unsigned t;
 
-	for (j = len; j; j--, data++) {
-		crc ^= (*data << 8);
-		for(i = 8; i; i--) {
-			if (crc & 0x8000)
-				crc ^= (0x1070 << 3);
-			crc <<= 1;
-		}
+	for (; len > 0; len--, data++) {
+		t = crc ^ *data;
+		t ^= (t << 1) ^ (t << 2);
+		t ^= (t >> 8) ^ ((t >> 8) << 1) ^ ((t >> 8) << 2);
+		crc = t & 0xff;
 	}
 
-	return (uint8_t)(crc >> 8);
+	return (uint8_t)crc;
 }
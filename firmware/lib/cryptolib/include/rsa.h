@@ -91,5 +91,16 @@ void RSAPublicKeyFree(RSAPublicKey* key);
  */
 RSAPublicKey* RSAPublicKeyFromBuf(const uint8_t* buf, uint64_t len);
 
+/* Version of RSAPublicKeyFromBuf() which fills in [key] instead of
+ * allocating it, with its n and rr arrays in [storage], of [storage_size]
+ * bytes; [len] bytes is always enough.  Nothing is allocated, so [key] must
+ * not be passed to RSAPublicKeyFree().
+ *
+ * Returns 0 on success, non-zero if the key is invalid or doesn't fit.
+ */
+int RSAPublicKeyFromBufInto(const uint8_t* buf, uint64_t len,
+                            RSAPublicKey* key, uint32_t* storage,
+                            uint64_t storage_size);
+
 
 #endif  /* VBOOT_REFERENCE_RSA_H_ */
@@ -14,6 +14,8 @@
 
 #include "sysincludes.h"
 
+#include "2sha.h"
+
 #define SHA1_DIGEST_SIZE 20
 #define SHA1_BLOCK_SIZE 64
 
@@ -23,32 +25,25 @@
 #define SHA512_DIGEST_SIZE 64
 #define SHA512_BLOCK_SIZE 128
 
+/* Big enough for a digest from any of them. */
+#define MAX_DIGEST_SIZE SHA512_DIGEST_SIZE
+
+/*
+ * The hashing itself is done by the vboot2 library; these wrap its contexts
+ * so both APIs share one implementation.
+ */
 typedef struct SHA1_CTX {
-  uint64_t count;
-  uint32_t state[5];
-#if defined(HAVE_ENDIAN_H) && defined(HAVE_LITTLE_ENDIAN)
-  union {
-    uint8_t b[64];
-    uint32_t w[16];
-  } buf;
-#else
-  uint8_t buf[64];
-#endif
+  struct vb2_sha1_context vb2;
+  uint8_t buf[SHA1_DIGEST_SIZE];  /* Used for storing the final digest. */
 } SHA1_CTX;
 
 typedef struct {
-  uint32_t h[8];
-  uint32_t tot_len;
-  uint32_t len;
-  uint8_t block[2 * SHA256_BLOCK_SIZE];
+  struct vb2_sha256_context vb2;
   uint8_t buf[SHA256_DIGEST_SIZE];  /* Used for storing the final digest. */
 } VB_SHA256_CTX;
 
 typedef struct {
-  uint64_t h[8];
-  uint32_t tot_len;
-  uint32_t len;
-  uint8_t block[2 * SHA512_BLOCK_SIZE];
+  struct vb2_sha512_context vb2;
   uint8_t buf[SHA512_DIGEST_SIZE];  /* Used for storing the final digest. */
 } VB_SHA512_CTX;
 
@@ -94,9 +89,7 @@ uint8_t* internal_SHA512(const uint8_t* data, uint64_t len, uint8_t* digest);
  * the SHA*_CTX for multiple digest algorithms.
  */
 typedef struct DigestContext {
-  SHA1_CTX* sha1_ctx;
-  VB_SHA256_CTX* sha256_ctx;
-  VB_SHA512_CTX* sha512_ctx;
+  struct vb2_digest_context vb2;
   int algorithm;  /* Hashing algorithm to use. */
 } DigestContext;
 
@@ -112,6 +105,14 @@ void DigestUpdate(DigestContext* ctx, const uint8_t* data, uint32_t len);
 /* Caller owns the returned digest and must free it. */
 uint8_t* DigestFinal(DigestContext* ctx);
 
+/* Version of DigestFinal() which stores the digest in [digest], of [size]
+ * bytes, instead of allocating it.  MAX_DIGEST_SIZE is always enough.
+ *
+ * Returns 0 on success, non-zero if the algorithm is unsupported or [size]
+ * is too small.
+ */
+int DigestFinalInto(DigestContext* ctx, uint8_t* digest, uint32_t size);
+
 /* Returns the appropriate digest for the data in [input_file]
  * based on the signature [algorithm].
  * Caller owns the returned digest and must free it.
@@ -124,5 +125,13 @@ uint8_t* DigestFile(char* input_file, int sig_algorithm);
  */
 uint8_t* DigestBuf(const uint8_t* buf, uint64_t len, int sig_algorithm);
 
+/* Version of DigestBuf() which stores the digest in [digest], of [size]
+ * bytes, instead of allocating it.
+ *
+ * Returns 0 on success, non-zero on error, as DigestFinalInto().
+ */
+int DigestBufInto(const uint8_t* buf, uint64_t len, int sig_algorithm,
+                  uint8_t* digest, uint32_t size);
+
 
 #endif  /* VBOOT_REFERENCE_SHA_H_ */
@@ -11,6 +11,7 @@
 #include "stateful_util.h"
 #include "utility.h"
 #include "vboot_api.h"
+#include "vboot_workbuf.h"
 
 uint64_t RSAProcessedKeySize(uint64_t algorithm, uint64_t* out_size) {
   int key_len; /* Key length in bytes.  (int type matches siglen_map) */
@@ -27,7 +28,7 @@ uint64_t RSAProcessedKeySize(uint64_t algorithm, uint64_t* out_size) {
 }
 
 RSAPublicKey* RSAPublicKeyNew(void) {
-  RSAPublicKey* key = (RSAPublicKey*) VbExMalloc(sizeof(RSAPublicKey));
+  RSAPublicKey* key = (RSAPublicKey*) VbWorkbufAlloc(sizeof(RSAPublicKey));
   key->n = NULL;
   key->rr = NULL;
   key->len = 0;
@@ -37,57 +38,105 @@ RSAPublicKey* RSAPublicKeyNew(void) {
 
 void RSAPublicKeyFree(RSAPublicKey* key) {
   if (key) {
-    if (key->n)
-      VbExFree(key->n);
-    if (key->rr)
-      VbExFree(key->rr);
-    VbExFree(key);
+    /* Keys from RSAPublicKeyFromBuf() hold their own arrays. */
+    if (key->n != (uint32_t*)(key + 1)) {
+      VbWorkbufFree(key->n);
+      VbWorkbufFree(key->rr);
+    }
+    VbWorkbufFree(key);
   }
 }
 
-RSAPublicKey* RSAPublicKeyFromBuf(const uint8_t* buf, uint64_t len) {
-  RSAPublicKey* key = RSAPublicKeyNew();
-  MemcpyState st;
+/* Returns the size of the n and rr arrays of the key in [buf], or 0 if its
+ * length is invalid. */
+static uint64_t RSAKeyArraysSize(const uint8_t* buf, uint64_t len) {
+  uint32_t words;
   uint64_t key_len;
 
-  StatefulInit(&st, (void*)buf, len);
-
-  StatefulMemcpy(&st, &key->len, sizeof(key->len));
+  if (len < sizeof(words))
+    return 0;
+  Memcpy(&words, buf, sizeof(words));
   /* key length in bytes (avoiding possible 32-bit rollover) */
-  key_len = key->len;
+  key_len = words;
   key_len *= sizeof(uint32_t);
 
   /* Sanity Check the key length. */
   if (RSA1024NUMBYTES != key_len &&
       RSA2048NUMBYTES != key_len &&
       RSA4096NUMBYTES != key_len &&
-      RSA8192NUMBYTES != key_len) {
-    RSAPublicKeyFree(key);
-    return NULL;
-  }
+      RSA8192NUMBYTES != key_len)
+    return 0;
 
-  key->n = (uint32_t*) VbExMalloc(key_len);
-  key->rr = (uint32_t*) VbExMalloc(key_len);
+  return 2 * key_len;
+}
+
+int RSAPublicKeyFromBufInto(const uint8_t* buf, uint64_t len,
+                            RSAPublicKey* key, uint32_t* storage,
+                            uint64_t storage_size) {
+  uint64_t arrays_size = RSAKeyArraysSize(buf, len);
+  MemcpyState st;
+
+  if (!arrays_size || storage_size < arrays_size)
+    return 1;
+
+  StatefulInit(&st, (void*)buf, len);
+
+  StatefulMemcpy(&st, &key->len, sizeof(key->len));
+  key->n = storage;
+  key->rr = storage + key->len;
+  key->algorithm = kNumAlgorithms;
 
   StatefulMemcpy(&st, &key->n0inv, sizeof(key->n0inv));
-  StatefulMemcpy(&st, key->n, key_len);
-  StatefulMemcpy(&st, key->rr, key_len);
-  if (st.overrun || st.remaining_len != 0) {  /* Underrun or overrun. */
-    RSAPublicKeyFree(key);
+  StatefulMemcpy(&st, key->n, arrays_size / 2);
+  StatefulMemcpy(&st, key->rr, arrays_size / 2);
+  if (st.overrun || st.remaining_len != 0)  /* Underrun or overrun. */
+    return 1;
+
+  return 0;
+}
+
+RSAPublicKey* RSAPublicKeyFromBuf(const uint8_t* buf, uint64_t len) {
+  uint64_t arrays_size = RSAKeyArraysSize(buf, len);
+  RSAPublicKey* key;
+
+  if (!arrays_size)
+    return NULL;
+
+  /* One allocation holds the key and its arrays, right after it. */
+  key = (RSAPublicKey*) VbWorkbufAlloc(sizeof(*key) + arrays_size);
+  if (RSAPublicKeyFromBufInto(buf, len, key, (uint32_t*)(key + 1),
+                              arrays_size)) {
+    VbWorkbufFree(key);
     return NULL;
   }
 
   return key;
 }
 
+/* Set up [key] from the [key_size]-byte [key_blob], with its arrays in
+ * *[storage] from the work buffer.  Returns [key], or NULL if it's invalid,
+ * in which case *[storage] is already freed. */
+static RSAPublicKey* RSAKeyFromBlob(const uint8_t* key_blob, uint64_t key_size,
+                                    RSAPublicKey* key, uint32_t** storage) {
+  *storage = (uint32_t*) VbWorkbufAlloc((uint32_t)key_size);
+  if (RSAPublicKeyFromBufInto(key_blob, key_size, key, *storage, key_size)) {
+    VbWorkbufFree(*storage);
+    *storage = NULL;
+    return NULL;
+  }
+  return key;
+}
+
 int RSAVerifyBinary_f(const uint8_t* key_blob,
                       const RSAPublicKey* key,
                       const uint8_t* buf,
                       uint64_t len,
                       const uint8_t* sig,
                       unsigned int algorithm) {
+  RSAPublicKey blob_key;
   RSAPublicKey* verification_key = NULL;
-  uint8_t* digest = NULL;
+  uint32_t* storage = NULL;
+  uint8_t digest[MAX_DIGEST_SIZE];
   uint64_t key_size;
   int sig_size;
   int success;
@@ -99,7 +148,8 @@ int RSAVerifyBinary_f(const uint8_t* key_blob,
   sig_size = siglen_map[algorithm];
 
   if (key_blob && !key)
-    verification_key = RSAPublicKeyFromBuf(key_blob, key_size);
+    verification_key = RSAKeyFromBlob(key_blob, key_size, &blob_key,
+                                      &storage);
   else if (!key_blob && key)
     verification_key = (RSAPublicKey*) key;  /* Supress const warning. */
   else
@@ -109,13 +159,13 @@ int RSAVerifyBinary_f(const uint8_t* key_blob,
   if (!verification_key)
     return 0;
 
-  digest = DigestBuf(buf, len, algorithm);
-  success = RSAVerify(verification_key, sig, (uint32_t)sig_size,
-                      (uint8_t)algorithm, digest);
+  if (DigestBufInto(buf, len, algorithm, digest, sizeof(digest)))
+    success = 0;
+  else
+    success = RSAVerify(verification_key, sig, (uint32_t)sig_size,
+                        (uint8_t)algorithm, digest);
 
-  VbExFree(digest);
-  if (!key)
-    RSAPublicKeyFree(verification_key);  /* Only free if we allocated it. */
+  VbWorkbufFree(storage);  /* Only set if we allocated it. */
   return success;
 }
 
@@ -126,7 +176,9 @@ int RSAVerifyBinaryWithDigest_f(const uint8_t* key_blob,
                                 const uint8_t* digest,
                                 const uint8_t* sig,
                                 unsigned int algorithm) {
+  RSAPublicKey blob_key;
   RSAPublicKey* verification_key = NULL;
+  uint32_t* storage = NULL;
   uint64_t key_size;
   int sig_size;
   int success;
@@ -138,7 +190,8 @@ int RSAVerifyBinaryWithDigest_f(const uint8_t* key_blob,
   sig_size = siglen_map[algorithm];
 
   if (key_blob && !key)
-    verification_key = RSAPublicKeyFromBuf(key_blob, key_size);
+    verification_key = RSAKeyFromBlob(key_blob, key_size, &blob_key,
+                                      &storage);
   else if (!key_blob && key)
     verification_key = (RSAPublicKey*) key;  /* Supress const warning. */
   else
@@ -151,7 +204,6 @@ int RSAVerifyBinaryWithDigest_f(const uint8_t* key_blob,
   success = RSAVerify(verification_key, sig, (uint32_t)sig_size,
                       (uint8_t)algorithm, digest);
 
-  if (!key)
-    RSAPublicKeyFree(verification_key);  /* Only free if we allocated it. */
+  VbWorkbufFree(storage);  /* Only set if we allocated it. */
   return success;
 }
@@ -11,39 +11,107 @@
 #include "gpt.h"
 #include "utility.h"
 #include "vboot_api.h"
+#include "vboot_workbuf.h"
 
 
+/**
+ * Read sectors from the drive, counting the read in [gptdata].
+ *
+ * Returns 0 if successful, non-zero if error.
+ */
+static VbError_t GptRead(VbExDiskHandle_t disk_handle, GptData *gptdata,
+			 uint64_t lba_start, uint64_t lba_count, void *buffer)
+{
+	uint64_t start = VbExGetTimer();
+	VbError_t rv = VbExDiskRead(disk_handle, lba_start, lba_count, buffer);
+
+	gptdata->read_ticks += VbExGetTimer() - start;
+	gptdata->read_bytes += lba_count * gptdata->sector_bytes;
+	gptdata->read_calls++;
+	return rv;
+}
+
+void StartReadGptData(VbExDiskHandle_t disk_handle, const GptData *gptdata)
+{
+#ifdef DISK_READ_ASYNC
+	uint64_t max_entries_bytes = MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry);
+	uint64_t copy_sectors = GPT_HEADER_SECTORS +
+		max_entries_bytes / gptdata->sector_bytes;
+
+	/* Small drives are read a piece at a time, and aren't worth it */
+	if (gptdata->gpt_drive_sectors < GPT_PMBR_SECTORS + 2 * copy_sectors)
+		return;
+
+	VbExDiskReadStart(disk_handle, GPT_PMBR_SECTORS, copy_sectors);
+
+	/* The secondary is skipped if the primary's good, so don't bother */
+	if (!(gptdata->flags & GPT_FLAG_LAZY_SECONDARY))
+		VbExDiskReadStart(disk_handle,
+				  gptdata->gpt_drive_sectors - copy_sectors,
+				  copy_sectors);
+#endif
+}
+
 /**
  * Allocate and read GPT data from the drive.
  *
  * The sector_bytes and gpt_drive_sectors fields should be filled on input.  The
  * primary and secondary header and entries are filled on output.
  *
+ * Each header is normally right next to its entries, so each copy is read
+ * with a single disk read, into a single buffer.  The primary header starts
+ * its buffer, and the secondary header ends its buffer.
+ *
+ * With GPT_FLAG_LAZY_SECONDARY, the secondary isn't read at all if the primary
+ * header and entries are good; its buffers are zeroed and secondary_unread is
+ * set.
+ *
  * Returns 0 if successful, 1 if error.
  */
 int AllocAndReadGptData(VbExDiskHandle_t disk_handle, GptData *gptdata)
 {
 	uint64_t max_entries_bytes = MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry);
+	uint64_t max_entries_sectors = max_entries_bytes / gptdata->sector_bytes;
+	uint64_t copy_sectors = GPT_HEADER_SECTORS + max_entries_sectors;
+	uint64_t copy_bytes = gptdata->sector_bytes + max_entries_bytes;
+	uint64_t secondary_lba;
+	uint8_t *primary, *secondary;
 	int primary_valid = 0, secondary_valid = 0;
+	int coalesce;
 
 	/* No data to be written yet */
 	gptdata->modified = 0;
+	gptdata->entries_partial = 0;
+	gptdata->entries_loaded = 0;
+	gptdata->read_calls = 0;
+	gptdata->read_bytes = 0;
+	gptdata->read_ticks = 0;
+	gptdata->secondary_unread = 0;
 
 	/* Allocate all buffers */
-	gptdata->primary_header = (uint8_t *)VbExMalloc(gptdata->sector_bytes);
-	gptdata->secondary_header =
-		(uint8_t *)VbExMalloc(gptdata->sector_bytes);
-	gptdata->primary_entries = (uint8_t *)VbExMalloc(max_entries_bytes);
-	gptdata->secondary_entries = (uint8_t *)VbExMalloc(max_entries_bytes);
-
-	if (gptdata->primary_header == NULL ||
-	    gptdata->secondary_header == NULL ||
-	    gptdata->primary_entries == NULL ||
-	    gptdata->secondary_entries == NULL)
+	primary = (uint8_t *)VbWorkbufAlloc(copy_bytes);
+	secondary = (uint8_t *)VbWorkbufAlloc(copy_bytes);
+	gptdata->primary_header = primary;
+	gptdata->primary_entries = primary ?
+		primary + gptdata->sector_bytes : NULL;
+	gptdata->secondary_entries = secondary;
+	gptdata->secondary_header = secondary ?
+		secondary + max_entries_bytes : NULL;
+
+	if (primary == NULL || secondary == NULL)
 		return 1;
 
+	/*
+	 * Read the entries along with the headers, unless the drive is so
+	 * small that would take the two copies past each other.
+	 */
+	coalesce = gptdata->gpt_drive_sectors >=
+		GPT_PMBR_SECTORS + 2 * copy_sectors;
+
 	/* Read primary header from the drive, skipping the protective MBR */
-	if (0 != VbExDiskRead(disk_handle, 1, 1, gptdata->primary_header))
+	if (0 != GptRead(disk_handle, gptdata, GPT_PMBR_SECTORS,
+			 coalesce ? copy_sectors : GPT_HEADER_SECTORS,
+			 primary))
 		return 1;
 
 	/* Only read primary GPT if the primary header is valid */
@@ -51,24 +119,43 @@ int AllocAndReadGptData(VbExDiskHandle_t disk_handle, GptData *gptdata)
 	if (0 == CheckHeader(primary_header, 0,
 			gptdata->streaming_drive_sectors,
 			gptdata->gpt_drive_sectors,
-			gptdata->flags)) {
+			gptdata->flags, gptdata->sector_bytes)) {
 		primary_valid = 1;
-		uint64_t entries_bytes = primary_header->number_of_entries
-				* primary_header->size_of_entry;
-		uint64_t entries_sectors = entries_bytes
-					/ gptdata->sector_bytes;
-		if (0 != VbExDiskRead(disk_handle,
-				      primary_header->entries_lba,
-				      entries_sectors,
-				      gptdata->primary_entries))
-			return 1;
+		uint64_t entries_sectors = CalculateEntriesSectors(
+			primary_header, gptdata->sector_bytes);
+		if (!coalesce || primary_header->entries_lba !=
+		    GPT_PMBR_SECTORS + GPT_HEADER_SECTORS) {
+			if (0 != GptRead(disk_handle, gptdata,
+					 primary_header->entries_lba,
+					 entries_sectors,
+					 gptdata->primary_entries))
+				return 1;
+		}
+		gptdata->entries_loaded |= GPT_MODIFIED_ENTRIES1;
 	} else {
 		VBDEBUG(("Primary GPT header invalid!\n"));
 	}
 
+	/*
+	 * A good primary GPT is all that's needed to boot; in fast-boot mode,
+	 * skip the seek to the end of the drive and leave the secondary to
+	 * the OS.
+	 */
+	if (primary_valid && (gptdata->flags & GPT_FLAG_LAZY_SECONDARY) &&
+	    0 == CheckEntries((GptEntry *)gptdata->primary_entries,
+			      primary_header)) {
+		VBDEBUG(("Not reading secondary GPT\n"));
+		Memset(secondary, 0, copy_bytes);
+		gptdata->secondary_unread = 1;
+		return 0;
+	}
+
 	/* Read secondary header from the end of the drive */
-	if (0 != VbExDiskRead(disk_handle, gptdata->gpt_drive_sectors - 1, 1,
-			      gptdata->secondary_header))
+	secondary_lba = gptdata->gpt_drive_sectors -
+		(coalesce ? copy_sectors : GPT_HEADER_SECTORS);
+	if (0 != GptRead(disk_handle, gptdata, secondary_lba,
+			 coalesce ? copy_sectors : GPT_HEADER_SECTORS,
+			 coalesce ? secondary : gptdata->secondary_header))
 		return 1;
 
 	/* Only read secondary GPT if the secondary header is valid */
@@ -76,17 +163,19 @@ int AllocAndReadGptData(VbExDiskHandle_t disk_handle, GptData *gptdata)
 	if (0 == CheckHeader(secondary_header, 1,
 			gptdata->streaming_drive_sectors,
 			gptdata->gpt_drive_sectors,
-			gptdata->flags)) {
+			gptdata->flags, gptdata->sector_bytes)) {
 		secondary_valid = 1;
-		uint64_t entries_bytes = secondary_header->number_of_entries
-				* secondary_header->size_of_entry;
-		uint64_t entries_sectors = entries_bytes
-				/ gptdata->sector_bytes;
-		if (0 != VbExDiskRead(disk_handle,
-				      secondary_header->entries_lba,
-				      entries_sectors,
-				      gptdata->secondary_entries))
-			return 1;
+		uint64_t entries_sectors = CalculateEntriesSectors(
+			secondary_header, gptdata->sector_bytes);
+		if (!coalesce || secondary_header->entries_lba !=
+		    secondary_lba) {
+			if (0 != GptRead(disk_handle, gptdata,
+					 secondary_header->entries_lba,
+					 entries_sectors,
+					 gptdata->secondary_entries))
+				return 1;
+		}
+		gptdata->entries_loaded |= GPT_MODIFIED_ENTRIES2;
 	} else {
 		VBDEBUG(("Secondary GPT header invalid!\n"));
 	}
@@ -104,9 +193,10 @@ int WriteAndFreeGptData(VbExDiskHandle_t disk_handle, GptData *gptdata)
 {
 	int legacy = 0;
 	GptHeader *header = (GptHeader *)gptdata->primary_header;
-	uint64_t entries_bytes = header->number_of_entries
-				* header->size_of_entry;
-	uint64_t entries_sectors = entries_bytes / gptdata->sector_bytes;
+	uint64_t entries_sectors = CalculateEntriesSectors(header,
+						gptdata->sector_bytes);
+	uint64_t first, count;
+	int write_entries;
 	int ret = 1;
 
 	/*
@@ -114,6 +204,8 @@ int WriteAndFreeGptData(VbExDiskHandle_t disk_handle, GptData *gptdata)
 	 * its entries.
 	 */
 	uint64_t entries_lba = GPT_PMBR_SECTORS + GPT_HEADER_SECTORS;
+	write_entries = GptEntriesToWrite(gptdata, GPT_MODIFIED_ENTRIES1,
+					  entries_sectors, &first, &count);
 	if (gptdata->primary_header) {
 		GptHeader *h = (GptHeader *)(gptdata->primary_header);
 		entries_lba = h->entries_lba;
@@ -127,7 +219,22 @@ int WriteAndFreeGptData(VbExDiskHandle_t disk_handle, GptData *gptdata)
 			legacy = !Memcmp(h->signature, GPT_HEADER_SIGNATURE2,
 					GPT_HEADER_SIGNATURE_SIZE);
 		}
-		if (gptdata->modified & GPT_MODIFIED_HEADER1) {
+		/*
+		 * A header and entries which are next to each other on the
+		 * drive and in memory go out in one write.
+		 */
+		if ((gptdata->modified & GPT_MODIFIED_HEADER1) &&
+		    write_entries && !first && !legacy &&
+		    entries_lba == GPT_PMBR_SECTORS + GPT_HEADER_SECTORS &&
+		    gptdata->primary_entries == gptdata->primary_header +
+		    gptdata->sector_bytes) {
+			VBDEBUG(("Updating GPT header and entries 1\n"));
+			if (0 != VbExDiskWrite(disk_handle, 1,
+					       GPT_HEADER_SECTORS + count,
+					       gptdata->primary_header))
+				goto fail;
+			write_entries = 0;
+		} else if (gptdata->modified & GPT_MODIFIED_HEADER1) {
 			if (legacy) {
 				VBDEBUG(("Not updating GPT header 1: "
 					 "legacy mode is enabled.\n"));
@@ -140,27 +247,40 @@ int WriteAndFreeGptData(VbExDiskHandle_t disk_handle, GptData *gptdata)
 		}
 	}
 
-	if (gptdata->primary_entries) {
-		if (gptdata->modified & GPT_MODIFIED_ENTRIES1) {
-			if (legacy) {
-				VBDEBUG(("Not updating GPT entries 1: "
-					 "legacy mode is enabled.\n"));
-			} else {
-				VBDEBUG(("Updating GPT entries 1\n"));
-				if (0 != VbExDiskWrite(disk_handle, entries_lba,
-						entries_sectors,
-						gptdata->primary_entries))
-					goto fail;
-			}
+	if (gptdata->primary_entries && write_entries) {
+		if (legacy) {
+			VBDEBUG(("Not updating GPT entries 1: "
+				 "legacy mode is enabled.\n"));
+		} else {
+			VBDEBUG(("Updating GPT entries 1\n"));
+			if (0 != VbExDiskWrite(disk_handle, entries_lba + first,
+					count, gptdata->primary_entries +
+					first * gptdata->sector_bytes))
+				goto fail;
 		}
 	}
 
 	entries_lba = (gptdata->gpt_drive_sectors - entries_sectors -
 		GPT_HEADER_SECTORS);
+	write_entries = GptEntriesToWrite(gptdata, GPT_MODIFIED_ENTRIES2,
+					  entries_sectors, &first, &count);
 	if (gptdata->secondary_header) {
 		GptHeader *h = (GptHeader *)(gptdata->secondary_header);
 		entries_lba = h->entries_lba;
-		if (gptdata->modified & GPT_MODIFIED_HEADER2) {
+		if ((gptdata->modified & GPT_MODIFIED_HEADER2) &&
+		    write_entries && first + count == entries_sectors &&
+		    entries_lba + entries_sectors ==
+		    gptdata->gpt_drive_sectors - GPT_HEADER_SECTORS &&
+		    gptdata->secondary_header == gptdata->secondary_entries +
+		    entries_sectors * gptdata->sector_bytes) {
+			VBDEBUG(("Updating GPT entries and header 2\n"));
+			if (0 != VbExDiskWrite(disk_handle, entries_lba + first,
+					       count + GPT_HEADER_SECTORS,
+					       gptdata->secondary_entries +
+					       first * gptdata->sector_bytes))
+				goto fail;
+			write_entries = 0;
+		} else if (gptdata->modified & GPT_MODIFIED_HEADER2) {
 			VBDEBUG(("Updating GPT entries 2\n"));
 			if (0 != VbExDiskWrite(disk_handle,
 					       gptdata->gpt_drive_sectors - 1, 1,
@@ -169,28 +289,23 @@ int WriteAndFreeGptData(VbExDiskHandle_t disk_handle, GptData *gptdata)
 		}
 	}
 
-	if (gptdata->secondary_entries) {
-		if (gptdata->modified & GPT_MODIFIED_ENTRIES2) {
-			VBDEBUG(("Updating GPT header 2\n"));
-			if (0 != VbExDiskWrite(disk_handle,
-				entries_lba, entries_sectors,
-				gptdata->secondary_entries))
-				goto fail;
-		}
+	if (gptdata->secondary_entries && write_entries) {
+		VBDEBUG(("Updating GPT header 2\n"));
+		if (0 != VbExDiskWrite(disk_handle, entries_lba + first, count,
+				       gptdata->secondary_entries +
+				       first * gptdata->sector_bytes))
+			goto fail;
 	}
 
 	ret = 0;
 
 fail:
-	/* Avoid leaking memory on disk write failure */
-	if (gptdata->primary_header)
-		VbExFree(gptdata->primary_header);
-	if (gptdata->primary_entries)
-		VbExFree(gptdata->primary_entries);
-	if (gptdata->secondary_entries)
-		VbExFree(gptdata->secondary_entries);
-	if (gptdata->secondary_header)
-		VbExFree(gptdata->secondary_header);
+	/*
+	 * Avoid leaking memory on disk write failure.  Each header shares a
+	 * buffer with its entries; see AllocAndReadGptData().
+	 */
+	VbWorkbufFree(gptdata->primary_header);
+	VbWorkbufFree(gptdata->secondary_entries);
 
 	/* Success */
 	return ret;
@@ -32,6 +32,22 @@
  * The FontArrayHeader describes how many characters will be encoded.
  * Each character encoding consists of a FontArrayEntryHeader followed
  * immediately by the raw image data for that character.
+ *
+ * A font can also be packed as an atlas, with all the glyphs in one image:
+ *
+ *   +-------------------------+
+ *   | FontAtlasHeader         |
+ *   +-------------------------+
+ *   | FontAtlasGlyph[0]       |
+ *   |   ...                   |
+ *   | FontAtlasGlyph[n]       |
+ *   +-------------------------+
+ *   | FORMAT_RAW image        |
+ *   +-------------------------+
+ *
+ * The table has an entry for each character code from 0 up, saying where its
+ * glyph is in the image, so text is drawn by copying pieces of one image
+ * which is already in the pixel format of the panel.
  */
 
 #ifndef VBOOT_REFERENCE_BMPBLK_FONT_H_
@@ -60,4 +76,25 @@ typedef struct FontArrayEntryHeader {
 	 */
 } __attribute__((packed)) FontArrayEntryHeader;
 
+#define FONT_ATLAS_SIGNATURE "FATL"
+
+/* Most character codes in an atlas */
+#define FONT_ATLAS_MAX_GLYPHS 256
+
+typedef struct FontAtlasHeader {
+	uint8_t  signature[FONT_SIGNATURE_SIZE];  /* FONT_ATLAS_SIGNATURE */
+	uint32_t num_glyphs;     /* Entries in the table, one per char code */
+	uint32_t default_glyph;  /* Char code shown for ones it doesn't have */
+	uint32_t line_height;    /* Pixels from one line of text to the next */
+	uint32_t image_size;     /* Bytes in the image after the table */
+} __attribute__((packed)) FontAtlasHeader;
+
+/* Where a glyph is in the atlas image; width is 0 if there's no glyph */
+typedef struct FontAtlasGlyph {
+	uint16_t x;
+	uint16_t y;
+	uint16_t width;
+	uint16_t height;
+} __attribute__((packed)) FontAtlasGlyph;
+
 #endif  /* VBOOT_REFERENCE_BMPBLK_FONT_H_ */
@@ -0,0 +1,27 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Run-length decoding of screen images.
+ */
+
+#ifndef VBOOT_REFERENCE_BMPBLK_RLE_H_
+#define VBOOT_REFERENCE_BMPBLK_RLE_H_
+
+#include "vboot_api.h"
+
+/**
+ * Decode COMPRESS_RLE data (see bmpblk_header.h).
+ *
+ * @param in		Encoded data
+ * @param in_size	Size of the encoded data in bytes
+ * @param out		Where to put the decoded data
+ * @param out_size	On entry, the size of the out buffer; on return, how
+ *			much of it was filled in
+ * @return VBERROR_INVALID_BMPFV if the data is corrupt or doesn't fit,
+ * VBERROR_SUCCESS on success.
+ */
+VbError_t VbRleDecode(const uint8_t *in, uint32_t in_size,
+		      uint8_t *out, uint32_t *out_size);
+
+#endif  /* VBOOT_REFERENCE_BMPBLK_RLE_H_ */
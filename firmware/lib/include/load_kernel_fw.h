@@ -21,6 +21,27 @@
 #define BOOT_FLAG_RECOVERY     (0x02ULL)
 /* GPT is external */
 #define BOOT_FLAG_EXTERNAL_GPT (0x04ULL)
+/*
+ * Check only the kernel body blocks needed to boot, if the preamble has body
+ * block hashes; the OS checks the rest.  Ignored in recovery mode.
+ */
+#define BOOT_FLAG_PARTIAL_BODY_CHECK (0x08ULL)
+/*
+ * Boot from a valid primary GPT without reading the secondary GPT; the OS
+ * checks and repairs it.  Ignored in recovery mode.
+ */
+#define BOOT_FLAG_LAZY_SECONDARY_GPT (0x10ULL)
+/*
+ * With BOOT_FLAG_LAZY_SECONDARY_GPT, write GPT changes to the primary only
+ * if the secondary wasn't read.  Ignored in recovery mode.
+ */
+#define BOOT_FLAG_LAZY_SECONDARY_GPT_WRITE (0x20ULL)
+/*
+ * In developer mode with self-signed kernels allowed, accept a key block by
+ * its hash without first trying the signature.  Such key blocks count as
+ * self-signed, so don't roll forward the kernel version.
+ */
+#define BOOT_FLAG_DEV_KEY_BLOCK_HASH_FIRST (0x40ULL)
 
 typedef struct LoadKernelParams {
 	/* Inputs to LoadKernel() */
@@ -57,6 +78,14 @@ typedef struct LoadKernelParams {
 	 * VbNvSetup() and VbNvTeardown() on the context.
 	 */
 	VbNvContext *nv_context;
+	/*
+	 * Bytes to read from the start of each kernel partition to get its key
+	 * block and preamble; rounded up to whole sectors.  If 0, LoadKernel()
+	 * reads 64 KB from the first partition, then only as much as the
+	 * headers it has seen need.  Either way, more is read if a partition's
+	 * headers don't fit.
+	 */
+	uint64_t header_read_size;
 
 	/*
 	 * Outputs from LoadKernel(); valid only if LoadKernel() returns
@@ -72,6 +101,17 @@ typedef struct LoadKernelParams {
 	uint8_t  partition_guid[16];
 	/* Flags passed in by signer */
 	uint32_t flags;
+	/*
+	 * Offset of bootloader image from the start of kernel_buffer, or
+	 * (uint64_t)-1 if the preamble puts it outside the kernel body
+	 */
+	uint64_t bootloader_offset;
+	/*
+	 * Offset and size of the 16-bit vmlinuz header in kernel_buffer; size
+	 * is 0 if the kernel has no header inside its body
+	 */
+	uint64_t vmlinuz_header_offset;
+	uint64_t vmlinuz_header_size;
 } LoadKernelParams;
 
 /**
@@ -80,6 +80,14 @@ typedef struct RollbackSpaceFirmware {
 
 uint32_t RollbackS3Resume(void);
 
+/**
+ * Start the TPM and its self test as early as possible on a normal boot, so
+ * the self test runs while VbInit() reads the GBB and NV storage.  No other
+ * TPM commands may be sent before RollbackFirmwareSetup(), which finishes
+ * the setup started here and reports any error from it.
+ */
+uint32_t RollbackSelfTestStart(void);
+
 /*
  * These functions are callable from VbSelectFirmware().  They cannot use
  * global variables.
@@ -104,6 +112,14 @@ uint32_t RollbackFirmwareWrite(uint32_t version);
  */
 uint32_t RollbackFirmwareLock(void);
 
+/**
+ * Start the lock without waiting for the TPM, so it can run while the
+ * firmware body is hashed.  RollbackFirmwareLock() must still be called, and
+ * finishes the lock started here.  No other TPM commands may be sent in
+ * between, and RollbackFirmwareWrite() can't be called after this.
+ */
+uint32_t RollbackFirmwareLockStart(void);
+
 /*
  * These functions are callable from VbSelectAndLoadKernel().  They may use
  * global variables.
@@ -141,6 +157,12 @@ uint32_t RollbackKernelLock(int recovery_mode);
  * only.
  */
 
+/**
+ * Forget the copies of the TPM spaces kept from earlier reads and writes, so
+ * the next read goes to the TPM.  SetupTPM() and RollbackS3Resume() call this.
+ */
+void RollbackClearCache(void);
+
 /**
  * Issue a TPM_Clear and reenable/reactivate the TPM.
  */
@@ -10,10 +10,24 @@
 
 #include "gbb_header.h"
 #include "sysincludes.h"
+#include "vboot_struct.h"
+
+/**
+ * Extend the measurements queued in the event log of [shared] into the TPM,
+ * in the order they were queued, and mark them as done.
+ *
+ * Returns: TPM_SUCCESS if all the TPM extend operations succeed.
+ */
+uint32_t VbFlushMeasurements(VbSharedDataHeader *shared);
 
 /**
  * Update TPM PCR State with the boot path status.
  *
+ * The measurements are added to the event log in [shared], and then
+ * everything queued there is flushed to the TPM.  If [shared] is NULL or
+ * can't hold them, they're extended right away instead.
+ *
+ *  [shared]: Shared data holding the event log, or NULL.
  *  [developer_mode]: State of the developer switch.
  *  [recovery_mode]: State of the recovery mode.
  *  [fw_keyblock_flags]: Keyblock flags of the to-be-booted
@@ -22,7 +36,8 @@
  *
  * Returns: TPM_SUCCESS if the TPM extend operation succeeds.
  */
-uint32_t SetTPMBootModeState(int developer_mode, int recovery_mode,
+uint32_t SetTPMBootModeState(VbSharedDataHeader *shared,
+			     int developer_mode, int recovery_mode,
 			     uint64_t fw_keyblock_flags,
 			     GoogleBinaryBlockHeader *gbb);
 
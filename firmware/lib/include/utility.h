@@ -81,6 +81,15 @@ void *Memset(void *dest, const uint8_t c, uint64_t n);
  */
 int SafeMemcmp(const void *s1, const void *s2, size_t n);
 
+/**
+ * Versions of Memcpy() and Memset() which move a word at a time where the
+ * buffers allow, or use the string instructions on x86.  If the firmware
+ * library is built with FAST_MEMORY_OPS, these are its Memcpy() and
+ * Memset(), and the platform doesn't need to provide them.
+ */
+void *FastMemcpy(void *dest, const void *src, uint64_t n);
+void *FastMemset(void *dest, const uint8_t c, uint64_t n);
+
 /*
  * Buffer size required to hold the longest possible output of Uint64ToString()
  * - that is, Uint64ToString(~0, 2).
@@ -18,10 +18,17 @@ typedef struct VbAudioContext VbAudioContext;
 VbAudioContext *VbAudioOpen(VbCommonParams *cparams);
 
 /**
- * Caller should loop without extra delay until this returns false.
+ * Caller should loop until this returns false, waiting no longer than
+ * VbAudioWaitMs() between calls.
  */
 int VbAudioLooping(VbAudioContext *audio);
 
+/**
+ * Return how many msecs the caller can wait before calling VbAudioLooping()
+ * again, without a note starting or the delay ending late.
+ */
+uint32_t VbAudioWaitMs(VbAudioContext *audio);
+
 /**
  * Caller should call this prior to booting.
  */
@@ -11,10 +11,8 @@
 #include "vboot_api.h"
 #include "vboot_audio.h"
 
-typedef struct VbDevMusicNote {
-	uint16_t msec;
-	uint16_t frequency;
-} __attribute__((packed)) VbDevMusicNote;
+/* Notes are stored in flash the way VbExBeepNotes() takes them */
+typedef VbBeepNote VbDevMusicNote;
 
 typedef struct VbDevMusic {
 	uint8_t sig[4];			/* "$SND" */
@@ -30,9 +28,13 @@ struct VbAudioContext {
 	uint32_t note_count;
 	uint32_t next_note;
 
+	/* VbExGetTimer() ticks at which each note ends */
+	uint64_t *note_ends;
+
 	/* implementation flags */
 	int background_beep;
 	int free_notes_when_done;
+	int playing_notes;		/* VbExBeepNotes() is playing them */
 
 	/* sound tracking */
 	uint16_t current_frequency;
@@ -43,6 +43,12 @@ enum {
 	VBOOT_SHARED_DATA_INVALID,
 	/* Kernel Preamble does not contain flags */
 	VBOOT_KERNEL_PREAMBLE_NO_FLAGS,
+	/* Kernel Preamble does not contain body block hashes */
+	VBOOT_KERNEL_PREAMBLE_NO_BODY_HASHES,
+	/* Key block flags don't allow it in this boot mode */
+	VBOOT_KEY_BLOCK_FLAGS,
+	/* Key block data key version is out of range or rolled back */
+	VBOOT_KEY_BLOCK_VERSION,
 	VBOOT_ERROR_MAX,
 };
 extern const char *kVbootErrors[VBOOT_ERROR_MAX];
@@ -97,6 +103,62 @@ int PublicKeyCopy(VbPublicKey *dest, const VbPublicKey *src);
  */
 RSAPublicKey *PublicKeyToRSA(const VbPublicKey *key);
 
+/**
+ * Convert a public key to RsaPublicKey format without copying it: [rsa]'s
+ * arrays point into [key]'s data, which must be 32-bit aligned and stay put
+ * for as long as [rsa] is used.  Don't call RSAPublicKeyFree() on [rsa].
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+int PublicKeyToRSAInPlace(const VbPublicKey *key, RSAPublicKey *rsa);
+
+/* Number of converted keys a PublicKeyCache remembers */
+#define PUBLIC_KEY_CACHE_SIZE 4
+
+/*
+ * Keys already converted by PublicKeyCacheGet().  Zero it before first use,
+ * and call PublicKeyCacheFree() when done with it.
+ */
+typedef struct PublicKeyCache {
+	RSAPublicKey *keys[PUBLIC_KEY_CACHE_SIZE];
+	int count;
+	/* The first [lent] keys belong to the caller; see PublicKeyCacheLend() */
+	int lent;
+} PublicKeyCache;
+
+/**
+ * Like PublicKeyToRSA(), but if [cache] already holds a conversion of the same
+ * key, return that instead of parsing and allocating it again.  Keys are
+ * matched on their contents, not their address.  If [cache] is NULL, this is
+ * the same as PublicKeyToRSA().
+ *
+ * Release the returned key with PublicKeyCacheRelease().  Keys held by the
+ * cache stay valid until PublicKeyCacheFree().
+ *
+ * Returns NULL if error.
+ */
+RSAPublicKey *PublicKeyCacheGet(PublicKeyCache *cache, const VbPublicKey *key);
+
+/**
+ * Release a key returned by PublicKeyCacheGet().  Frees it unless it belongs
+ * to [cache].
+ */
+void PublicKeyCacheRelease(PublicKeyCache *cache, RSAPublicKey *rsa);
+
+/**
+ * Give [cache] a key the caller has already converted, such as with
+ * PublicKeyToRSAInPlace(), so PublicKeyCacheGet() on the same key returns it.
+ * The key stays the caller's: PublicKeyCacheFree() leaves it alone, and it
+ * must last until then.  Does nothing if the cache is full or already holds
+ * other keys of its own.
+ */
+void PublicKeyCacheLend(PublicKeyCache *cache, RSAPublicKey *rsa);
+
+/**
+ * Free all the keys held by [cache].
+ */
+void PublicKeyCacheFree(PublicKeyCache *cache);
+
 /**
  * Verify [data] matches signature [sig] using [key].  [size] is the size of
  * the data buffer; the amount of data to be validated is contained in
@@ -121,6 +183,28 @@ int VerifyDigest(const uint8_t *digest, const VbSignature *sig,
 int KeyBlockVerify(const VbKeyBlockHeader *block, uint64_t size,
 		   const VbPublicKey *key, int hash_only);
 
+/**
+ * Like KeyBlockVerify(), but converts [key] through [cache], so checking many
+ * key blocks against the same key only converts it once.
+ */
+int KeyBlockVerifyCached(const VbKeyBlockHeader *block, uint64_t size,
+			 const VbPublicKey *key, int hash_only,
+			 PublicKeyCache *cache);
+
+/**
+ * Check the parts of a key block of size [size] bytes which don't need its
+ * signature, so a key block which would be rejected anyway can be rejected
+ * before paying for an RSA verify.  The key block flags must include all of
+ * [flags], and the data key version must be at least [min_key_version] and
+ * fit in 16 bits.  Passing this says nothing about whether the key block is
+ * genuine; KeyBlockVerify() still needs to be called.
+ *
+ * Returns VBOOT_SUCCESS if it passes, VBOOT_KEY_BLOCK_FLAGS if the flags are
+ * wrong, or VBOOT_KEY_BLOCK_VERSION if only the version is.
+ */
+int KeyBlockPreVerify(const VbKeyBlockHeader *block, uint64_t size,
+		      uint64_t flags, uint64_t min_key_version);
+
 
 /**
  * Check the sanity of a firmware preamble of size [size] bytes, using public
@@ -140,6 +224,14 @@ int VerifyFirmwarePreamble(const VbFirmwarePreambleHeader *preamble,
  */
 uint32_t VbGetFirmwarePreambleFlags(const VbFirmwarePreambleHeader *preamble);
 
+/**
+ * Return the SHA-256 digest of the EC-RW image from a firmware preamble, or
+ * NULL if it doesn't have one.  Assumes the preamble has already been verified
+ * via VerifyFirmwarePreamble().
+ */
+const uint8_t *VbGetFirmwarePreambleEcRwHash(
+		const VbFirmwarePreambleHeader *preamble);
+
 /**
  * Check the sanity of a kernel preamble of size [size] bytes, using public key
  * [key].
@@ -171,6 +263,40 @@ int VbGetKernelVmlinuzHeader(const VbKernelPreambleHeader *preamble,
  */
 int VbKernelHasFlags(const VbKernelPreambleHeader *preamble);
 
+/**
+ * Checks if the kernel preamble has body block hashes.  These are available
+ * only if the Kernel Preamble Header version >= 2.3, and even then are
+ * optional.
+ *
+ * Returns VBOOT_SUCCESS if it has them, VBOOT_KERNEL_PREAMBLE_NO_BODY_HASHES
+ * if not.
+ */
+int VbKernelHasBodyHashes(const VbKernelPreambleHeader *preamble);
+
+/**
+ * Retrieve the compression of the kernel body on disk (COMPRESS_*), and the
+ * size of the body once decompressed.  Only Kernel Preamble Header version
+ * >= 2.4 can have a compressed body.  If the body isn't compressed, sets the
+ * compression to COMPRESS_NONE and the size to that of the body on disk.
+ *
+ * Returns VBOOT_SUCCESS if successful.
+ */
+int VbGetKernelBodyCompression(const VbKernelPreambleHeader *preamble,
+			       uint32_t *compression, uint64_t *load_size);
+
+/**
+ * Check the body blocks covering [size] bytes at [offset] into the kernel
+ * [body] against the body block hashes in [preamble], which must already have
+ * been checked by VerifyKernelPreamble() with the same [key].  The body must
+ * be the whole body_signature.data_size bytes long, since the last block
+ * covering the range may run past it.
+ *
+ * Returns 0 if they match, non-zero if error.
+ */
+int VerifyKernelBodyBlocks(const VbKernelPreambleHeader *preamble,
+			   const uint8_t *body, uint64_t offset,
+			   uint64_t size, const RSAPublicKey *key);
+
 /**
  * Verify that the Vmlinuz Header is contained inside of the kernel blob.
  *
@@ -191,6 +317,30 @@ int VbSharedDataInit(VbSharedDataHeader *header, uint64_t size);
  */
 uint64_t VbSharedDataReserve(VbSharedDataHeader *header, uint64_t size);
 
+/**
+ * Record the time a boot phase boundary (VBSD_TS_*) was reached.  Does
+ * nothing if [header] is too old a version to hold timestamps.
+ */
+void VbSharedDataRecordTimestamp(VbSharedDataHeader *header, uint32_t id);
+
+/**
+ * Add the crypto work counted since the last flush to [header].  Does nothing
+ * if [header] is too old to hold it, or the firmware wasn't built with
+ * VB2_CRYPTO_STATS.
+ */
+void VbSharedDataFlushCryptoStats(VbSharedDataHeader *header);
+
+/**
+ * Add a measurement (VBSD_MEASURE_*) of SHA-1 [digest] to the event log, to be
+ * extended into [pcr] by VbFlushMeasurements().  Use VBSD_MEASURE_NO_PCR to
+ * only log it.
+ *
+ * Returns 0 if success, non-zero if [header] is too old a version to hold the
+ * log or the log is full.
+ */
+int VbSharedDataQueueMeasurement(VbSharedDataHeader *header, uint32_t event,
+				 uint32_t pcr, const uint8_t *digest);
+
 /**
  * Copy the kernel subkey into the shared data.
  *
@@ -199,4 +349,15 @@ uint64_t VbSharedDataReserve(VbSharedDataHeader *header, uint64_t size);
 int VbSharedDataSetKernelKey(VbSharedDataHeader *header,
                              const VbPublicKey *src);
 
+/**
+ * Encode the shared data in [header] compactly into [buf]; see
+ * VbSharedDataCompactHeader.  On input, [size] is the size of [buf]; it's set
+ * to the size of the encoding, even if that didn't fit.
+ *
+ * Returns 0 if success, non-zero if [header] isn't valid or [buf] is too
+ * small.
+ */
+int VbSharedDataCompact(const VbSharedDataHeader *header, uint8_t *buf,
+			uint32_t *size);
+
 #endif  /* VBOOT_REFERENCE_VBOOT_COMMON_H_ */
@@ -17,17 +17,41 @@ VbError_t VbDisplayScreenFromGBB(VbCommonParams *cparams, uint32_t screen,
 VbError_t VbDisplayScreen(VbCommonParams *cparams, uint32_t screen, int force,
                           VbNvContext *vncptr);
 VbError_t VbDisplayDebugInfo(VbCommonParams *cparams, VbNvContext *vncptr);
+/**
+ * Display debug text over the current screen.  Use this rather than calling
+ * VbExDisplayDebugInfo() directly, so the next redraw covers the text up.
+ */
+VbError_t VbDisplayDebugText(const char *text);
 VbError_t VbCheckDisplayKey(VbCommonParams *cparams, uint32_t key,
                             VbNvContext *vncptr);
 
 /* Internal functions, for unit testing */
 
-typedef FontArrayHeader VbFont_t;
+/* Number of character codes looked up directly in VbFont_t.glyphs[] */
+#define VB_FONT_DIRECT_GLYPHS 256
+
+typedef struct VbFont {
+	/* Font data from the GBB */
+	FontArrayHeader *fonthdr;
+	/* Glyph for each character code, or NULL if the font doesn't have it */
+	FontArrayEntryHeader *glyphs[VB_FONT_DIRECT_GLYPHS];
+	/* The font data if it's an atlas, which has a table of its own */
+	FontAtlasHeader *atlas;
+} VbFont_t;
 
+/**
+ * Build a glyph table for the font data, so finding a glyph doesn't search
+ * the font.  The font data must stay around until VbDoneWithFontForNow().
+ * Font atlases already have a table, and can only be drawn by firmware built
+ * with DISPLAY_FONT_ATLAS.
+ *
+ * Returns NULL if error.
+ */
 VbFont_t *VbInternalizeFontData(FontArrayHeader *fonthdr);
 
 void VbDoneWithFontForNow(VbFont_t *ptr);
 
+/* Not for font atlases */
 ImageInfo *VbFindFontGlyph(VbFont_t *font, uint32_t ascii,
 			   void **bufferptr, uint32_t *buffersize);
 
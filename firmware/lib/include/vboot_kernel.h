@@ -25,6 +25,13 @@ VbNvContext *VbApiKernelGetVnc(void);
  */
 void VbApiKernelFree(VbCommonParams *cparams);
 
+/**
+ * Forget which disks VbTryLoadKernel() has failed to load a kernel from.  If
+ * [enable] is non-zero, it then remembers them again, and doesn't try them
+ * again unless their GPT header sector or size changes.
+ */
+void VbTryLoadKernelCache(int enable);
+
 /**
  * Try to load a kernel.
  */
@@ -67,7 +74,19 @@ VbError_t VbBootDeveloper(VbCommonParams *cparams, LoadKernelParams *p);
 VbError_t VbBootRecovery(VbCommonParams *cparams, LoadKernelParams *p);
 
 /**
- * Sync EC device <devidx> firmware to expected version.
+ * Start EC software sync for device <devidx>, by having the EC hash its RW
+ * image in the background.
+ *
+ * Returns VBERROR_SUCCESS if the EC is now hashing, so the caller can do other
+ * work before VbEcSoftwareSync() finishes the sync.  Otherwise the sync must
+ * be finished before anything which depends on it.
+ */
+VbError_t VbEcSoftwareSyncStart(int devidx, VbCommonParams *cparams);
+
+/**
+ * Sync EC device <devidx> firmware to expected version.  If
+ * VbEcSoftwareSyncStart() was called first, this uses the hash the EC has been
+ * computing since then.
  */
 VbError_t VbEcSoftwareSync(int devidx, VbCommonParams *cparams);
 
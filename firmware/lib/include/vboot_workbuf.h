@@ -0,0 +1,57 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Work buffer for short-lived allocations while selecting a kernel.
+ */
+
+#ifndef VBOOT_REFERENCE_VBOOT_WORKBUF_H_
+#define VBOOT_REFERENCE_VBOOT_WORKBUF_H_
+
+#include "2sysincludes.h"
+#include "2common.h"
+
+/*
+ * While a work buffer is set, VbWorkbufAlloc() hands out space from it like
+ * a vb2_workbuf, falling back to VbExMalloc() only if it's full.  Freeing
+ * work buffer space doesn't reclaim it; instead, code which allocates saves
+ * the work buffer with VbWorkbufSave() and puts it back with
+ * VbWorkbufRestore() when done, which frees everything allocated since at
+ * once.
+ *
+ * Without a work buffer, VbWorkbufAlloc() and VbWorkbufFree() are just
+ * VbExMalloc() and VbExFree().
+ */
+
+/**
+ * Start allocating from [buf], or stop if [buf] is NULL.
+ */
+void VbWorkbufInit(void *buf, uint32_t size);
+
+/**
+ * Allocate [size] bytes.  Returns NULL if error.
+ */
+void *VbWorkbufAlloc(uint32_t size);
+
+/**
+ * Free a buffer from VbWorkbufAlloc().  Work buffer space is reclaimed by
+ * VbWorkbufRestore().
+ */
+void VbWorkbufFree(void *ptr);
+
+/**
+ * Save the work buffer state in [saved].
+ */
+void VbWorkbufSave(struct vb2_workbuf *saved);
+
+/**
+ * Reclaim work buffer space allocated since VbWorkbufSave([saved]).
+ */
+void VbWorkbufRestore(const struct vb2_workbuf *saved);
+
+/**
+ * Return the most work buffer space in use at once since VbWorkbufInit().
+ */
+uint32_t VbWorkbufPeak(void);
+
+#endif  /* VBOOT_REFERENCE_VBOOT_WORKBUF_H_ */
@@ -19,6 +19,10 @@ uint32_t SetVirtualDevMode(int val) {
 }
 
 
+void RollbackClearCache(void) {
+}
+
+
 uint32_t TPMClearAndReenable(void) {
   return TPM_SUCCESS;
 }
@@ -30,6 +34,11 @@ uint32_t SetupTPM(int developer_mode, int disable_dev_request,
 }
 
 
+uint32_t RollbackSelfTestStart(void) {
+  return TPM_SUCCESS;
+}
+
+
 uint32_t RollbackS3Resume(void) {
   return TPM_SUCCESS;
 }
@@ -54,6 +63,11 @@ uint32_t RollbackFirmwareLock(void) {
 }
 
 
+uint32_t RollbackFirmwareLockStart(void) {
+  return TPM_SUCCESS;
+}
+
+
 uint32_t RollbackKernelRead(uint32_t* version) {
   *version = 0;
   return TPM_SUCCESS;
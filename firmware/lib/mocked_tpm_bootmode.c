@@ -61,7 +61,8 @@ const char* kBootStateSHA1Digests[] = {
 };
 
 
-uint32_t SetTPMBootModeState(int developer_mode, int recovery_mode,
+uint32_t SetTPMBootModeState(VbSharedDataHeader *shared,
+			     int developer_mode, int recovery_mode,
 			     uint64_t fw_keyblock_flags,
 			     GoogleBinaryBlockHeader *gbb)
 {
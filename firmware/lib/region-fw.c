@@ -16,9 +16,14 @@
 #include "utility.h"
 #include "vboot_api.h"
 #include "vboot_struct.h"
+#include "vboot_workbuf.h"
 
+/*
+ * Read a key from the GBB.  If [keep] is set it's allocated with VbExMalloc(),
+ * not from the work buffer, so it can outlive a VbWorkbufRestore().
+ */
 static VbError_t VbGbbReadKey(VbCommonParams *cparams, uint32_t offset,
-			      VbPublicKey **keyp)
+			      VbPublicKey **keyp, int keep)
 {
 	VbPublicKey hdr, *key;
 	VbError_t ret;
@@ -33,10 +38,13 @@ static VbError_t VbGbbReadKey(VbCommonParams *cparams, uint32_t offset,
 	size = hdr.key_offset + hdr.key_size;
 	if (size < sizeof(hdr))
 		size = sizeof(hdr);
-	key = VbExMalloc(size);
+	key = keep ? VbExMalloc(size) : VbWorkbufAlloc(size);
 	ret = VbRegionReadData(cparams, VB_REGION_GBB, offset, size, key);
 	if (ret) {
-		VbExFree(key);
+		if (keep)
+			VbExFree(key);
+		else
+			VbWorkbufFree(key);
 		return ret;
 	}
 
@@ -46,10 +54,27 @@ static VbError_t VbGbbReadKey(VbCommonParams *cparams, uint32_t offset,
 
 VbError_t VbGbbReadRootKey(VbCommonParams *cparams, VbPublicKey **keyp)
 {
-	return VbGbbReadKey(cparams, cparams->gbb->rootkey_offset, keyp);
+	return VbGbbReadKey(cparams, cparams->gbb->rootkey_offset, keyp, 0);
 }
 
 VbError_t VbGbbReadRecoveryKey(VbCommonParams *cparams, VbPublicKey **keyp)
 {
-	return VbGbbReadKey(cparams, cparams->gbb->recovery_key_offset, keyp);
+	return VbGbbReadKey(cparams, cparams->gbb->recovery_key_offset, keyp,
+			    0);
+}
+
+VbError_t VbGbbGetRecoveryKey(VbCommonParams *cparams,
+			      const VbPublicKey **keyp)
+{
+	VbError_t ret;
+
+	if (!cparams->recovery_key) {
+		ret = VbGbbReadKey(cparams, cparams->gbb->recovery_key_offset,
+				   &cparams->recovery_key, 1);
+		if (ret)
+			return ret;
+	}
+
+	*keyp = cparams->recovery_key;
+	return VBERROR_SUCCESS;
 }
@@ -8,7 +8,10 @@
 
 #include "sysincludes.h"
 
+#include "2sysincludes.h"
+#include "2common.h"
 #include "bmpblk_header.h"
+#include "bmpblk_rle.h"
 #include "region.h"
 #include "gbb_access.h"
 #include "gbb_header.h"
@@ -16,6 +19,7 @@
 #include "utility.h"
 #include "vboot_api.h"
 #include "vboot_struct.h"
+#include "vboot_workbuf.h"
 
 static VbError_t VbRegionReadGbb(VbCommonParams *cparams, uint32_t offset,
 				  uint32_t size, void *buf)
@@ -62,6 +66,135 @@ VbError_t VbGbbReadBmpHeader(VbCommonParams *cparams, BmpBlockHeader *hdr_ret)
 	return VBERROR_SUCCESS;
 }
 
+/*
+ * A decompressed image kept by VbGbbReadImage(), up to
+ * cparams->image_cache_size bytes of them.  The image data follows.
+ */
+typedef struct VbImageCacheEntry {
+	struct VbImageCacheEntry *next;
+	uint32_t localization;
+	uint32_t screen_index;
+	uint32_t image_num;
+	ImageInfo image_info;
+	uint32_t data_size;
+} VbImageCacheEntry;
+
+/* Find a kept image, and make it the most recently used */
+static VbImageCacheEntry *VbImageCacheFind(VbCommonParams *cparams,
+					   uint32_t localization,
+					   uint32_t screen_index,
+					   uint32_t image_num)
+{
+	VbImageCacheEntry **entryp;
+
+	for (entryp = &cparams->image_cache; *entryp;
+	     entryp = &(*entryp)->next) {
+		VbImageCacheEntry *entry = *entryp;
+
+		if (entry->localization != localization ||
+		    entry->screen_index != screen_index ||
+		    entry->image_num != image_num)
+			continue;
+
+		*entryp = entry->next;
+		entry->next = cparams->image_cache;
+		cparams->image_cache = entry;
+		return entry;
+	}
+
+	return NULL;
+}
+
+/* Keep a copy of an image, dropping the least recently used to make room */
+static void VbImageCacheAdd(VbCommonParams *cparams, uint32_t localization,
+			    uint32_t screen_index, uint32_t image_num,
+			    const ImageInfo *image_info, const void *data,
+			    uint32_t data_size)
+{
+	VbImageCacheEntry *entry, **entryp;
+	uint32_t used = data_size;
+
+	if (data_size > cparams->image_cache_size)
+		return;
+
+	entry = VbExMalloc(sizeof(*entry) + data_size);
+	entry->localization = localization;
+	entry->screen_index = screen_index;
+	entry->image_num = image_num;
+	entry->image_info = *image_info;
+	entry->data_size = data_size;
+	Memcpy(entry + 1, data, data_size);
+	entry->next = cparams->image_cache;
+	cparams->image_cache = entry;
+
+	/* Images past the size limit are the least recently used ones */
+	for (entryp = &entry->next; *entryp; ) {
+		if (used + (*entryp)->data_size > cparams->image_cache_size) {
+			VbImageCacheEntry *drop = *entryp;
+
+			*entryp = drop->next;
+			VbExFree(drop);
+		} else {
+			used += (*entryp)->data_size;
+			entryp = &(*entryp)->next;
+		}
+	}
+	cparams->image_cache_used = used;
+}
+
+void VbGbbFreeImageCache(VbCommonParams *cparams)
+{
+	while (cparams->image_cache) {
+		VbImageCacheEntry *entry = cparams->image_cache;
+
+		cparams->image_cache = entry->next;
+		VbExFree(entry);
+	}
+	cparams->image_cache_used = 0;
+}
+
+/*
+ * Read the layout of a screen.  The layouts of all the screens for the
+ * localization are read at once and kept in cparams, since each image of a
+ * screen needs its layout and screens are redrawn often.
+ */
+static VbError_t VbGbbReadLayout(VbCommonParams *cparams,
+				 const BmpBlockHeader *hdr,
+				 uint32_t localization, uint32_t screen_index,
+				 ScreenLayout *layout)
+{
+	GoogleBinaryBlockHeader *gbb = cparams->gbb;
+	uint32_t count = hdr->number_of_screenlayouts;
+	uint32_t offset = gbb->bmpfv_offset + sizeof(BmpBlockHeader) +
+		localization * count * sizeof(ScreenLayout);
+	VbError_t ret;
+
+	/* Not in the table; read just that layout, as we always have */
+	if (screen_index >= count)
+		return VbRegionReadGbb(cparams,
+				       offset + screen_index * sizeof(*layout),
+				       sizeof(*layout), layout);
+
+	if (!cparams->layouts ||
+	    cparams->layouts_localization != localization) {
+		if (cparams->layouts)
+			VbExFree(cparams->layouts);
+		cparams->layouts = VbExMalloc(count * sizeof(ScreenLayout));
+		ret = VbRegionReadGbb(cparams, offset,
+				      count * sizeof(ScreenLayout),
+				      cparams->layouts);
+		if (ret) {
+			VbExFree(cparams->layouts);
+			cparams->layouts = NULL;
+			return ret;
+		}
+		cparams->layouts_localization = localization;
+	}
+
+	*layout = cparams->layouts[screen_index];
+	return VBERROR_SUCCESS;
+}
+
 VbError_t VbRegionReadHWID(VbCommonParams *cparams, char *hwid,
 			   uint32_t max_size)
 {
@@ -93,16 +226,14 @@ VbError_t VbRegionReadHWID(VbCommonParams *cparams, char *hwid,
 	return VBERROR_SUCCESS;
 }
 
-VbError_t VbGbbReadImage(VbCommonParams *cparams,
-			       uint32_t localization, uint32_t screen_index,
-			       uint32_t image_num, ScreenLayout *layout,
-			       ImageInfo *image_info, char **image_datap,
-			       uint32_t *image_data_sizep)
+VbError_t VbGbbReadImageInfo(VbCommonParams *cparams,
+			     uint32_t localization, uint32_t screen_index,
+			     uint32_t image_num, ScreenLayout *layout,
+			     ImageInfo *image_info)
 {
-	uint32_t layout_offset, image_offset, data_offset, data_size;
 	GoogleBinaryBlockHeader *gbb;
 	BmpBlockHeader hdr;
-	void *data = NULL;
+	VbImageCacheEntry *entry;
 	VbError_t ret;
 
 	if (!cparams)
@@ -113,60 +244,151 @@ VbError_t VbGbbReadImage(VbCommonParams *cparams,
 		return ret;
 
 	gbb = cparams->gbb;
-	layout_offset = gbb->bmpfv_offset + sizeof(BmpBlockHeader) +
-		localization * hdr.number_of_screenlayouts *
-			sizeof(ScreenLayout) +
-		screen_index * sizeof(ScreenLayout);
-	ret = VbRegionReadGbb(cparams, layout_offset, sizeof(*layout), layout);
+	ret = VbGbbReadLayout(cparams, &hdr, localization, screen_index,
+			      layout);
 	if (ret)
 		return ret;
 
 	if (!layout->images[image_num].image_info_offset)
 		return VBERROR_NO_IMAGE_PRESENT;
 
-	image_offset = gbb->bmpfv_offset +
-			layout->images[image_num].image_info_offset;
-	ret = VbRegionReadGbb(cparams, image_offset, sizeof(*image_info),
-			      image_info);
+	entry = VbImageCacheFind(cparams, localization, screen_index,
+				 image_num);
+	if (entry) {
+		*image_info = entry->image_info;
+		return VBERROR_SUCCESS;
+	}
+
+	return VbRegionReadGbb(cparams, gbb->bmpfv_offset +
+			       layout->images[image_num].image_info_offset,
+			       sizeof(*image_info), image_info);
+}
+
+VbError_t VbGbbReadImage(VbCommonParams *cparams,
+			       uint32_t localization, uint32_t screen_index,
+			       uint32_t image_num, ScreenLayout *layout,
+			       ImageInfo *image_info, char **image_datap,
+			       uint32_t *image_data_sizep)
+{
+	uint32_t data_offset, data_size;
+	VbImageCacheEntry *entry;
+	void *data = NULL;
+	VbError_t ret;
+
+	ret = VbGbbReadImageInfo(cparams, localization, screen_index,
+				 image_num, layout, image_info);
 	if (ret)
 		return ret;
 
-	data_offset = image_offset + sizeof(*image_info);
+	entry = VbImageCacheFind(cparams, localization, screen_index,
+				 image_num);
+	if (entry) {
+		*image_datap = VbWorkbufAlloc(entry->data_size);
+		Memcpy(*image_datap, entry + 1, entry->data_size);
+		*image_data_sizep = entry->data_size;
+		return VBERROR_SUCCESS;
+	}
+
+	data_offset = cparams->gbb->bmpfv_offset +
+		layout->images[image_num].image_info_offset +
+		sizeof(*image_info);
 	data_size = image_info->compressed_size;
 	if (data_size) {
 		void *orig_data;
 
-		data = VbExMalloc(image_info->compressed_size);
+		data = VbWorkbufAlloc(image_info->compressed_size);
 		ret = VbRegionReadGbb(cparams, data_offset,
 				      image_info->compressed_size, data);
 		if (ret) {
-			VbExFree(data);
+			VbWorkbufFree(data);
 			return ret;
 		}
 		if (image_info->compression != COMPRESS_NONE) {
 			uint32_t inoutsize = image_info->original_size;
 
-			orig_data = VbExMalloc(image_info->original_size);
-			ret = VbExDecompress(data,
-					     image_info->compressed_size,
-					     image_info->compression,
-					     orig_data, &inoutsize);
+			orig_data = VbWorkbufAlloc(image_info->original_size);
+			/* Run-length encoding is cheap enough to undo here */
+			if (image_info->compression == COMPRESS_RLE)
+				ret = VbRleDecode(data, data_size, orig_data,
+						  &inoutsize);
+			else
+				ret = VbExDecompress(data, data_size,
+						     image_info->compression,
+						     orig_data, &inoutsize);
+			VB2_CRYPTO_STATS_ADD(decompress_calls, 1);
+			VB2_CRYPTO_STATS_ADD(decompress_in_bytes, data_size);
+			VB2_CRYPTO_STATS_ADD(decompress_out_bytes, inoutsize);
 			data_size = inoutsize;
-			VbExFree(data);
+			VbWorkbufFree(data);
 			data = orig_data;
 			if (ret) {
-				VbExFree(data);
+				VbWorkbufFree(data);
 				return ret;
 			}
 		}
 	}
 
+	if (data)
+		VbImageCacheAdd(cparams, localization, screen_index, image_num,
+				image_info, data, data_size);
+
 	*image_datap = data;
 	*image_data_sizep = data_size;
 
 	return VBERROR_SUCCESS;
 }
 
+#ifdef DECOMPRESS_STREAM
+/* Compressed image data is passed to the platform this many bytes at a time */
+#define STREAM_CHUNK_SIZE 16384
+
+int VbGbbCanStreamImage(VbCommonParams *cparams, const ImageInfo *image_info)
+{
+	return image_info->compressed_size &&
+		image_info->compression != COMPRESS_RLE &&
+		image_info->original_size > cparams->image_cache_size;
+}
+
+VbError_t VbGbbStreamImage(VbCommonParams *cparams, const ScreenLayout *layout,
+			   uint32_t image_num, const ImageInfo *image_info)
+{
+	VbExDecompressStream_t stream;
+	uint32_t data_offset, done, size;
+	uint8_t *chunk;
+	VbError_t ret, close_ret;
+
+	data_offset = cparams->gbb->bmpfv_offset +
+		layout->images[image_num].image_info_offset +
+		sizeof(*image_info);
+
+	ret = VbExDecompressStreamOpen(image_info->compression,
+				       image_info->original_size,
+				       layout->images[image_num].x,
+				       layout->images[image_num].y, &stream);
+	if (ret)
+		return ret;
+
+	/* Only one piece of the compressed data is in memory at a time */
+	chunk = VbWorkbufAlloc(STREAM_CHUNK_SIZE);
+	for (done = 0; !ret && done < image_info->compressed_size;
+	     done += size) {
+		size = image_info->compressed_size - done;
+		if (size > STREAM_CHUNK_SIZE)
+			size = STREAM_CHUNK_SIZE;
+		ret = VbRegionReadGbb(cparams, data_offset + done, size, chunk);
+		if (!ret)
+			ret = VbExDecompressStreamWrite(stream, chunk, size);
+	}
+	VbWorkbufFree(chunk);
+
+	close_ret = VbExDecompressStreamClose(stream);
+	VB2_CRYPTO_STATS_ADD(decompress_calls, 1);
+	VB2_CRYPTO_STATS_ADD(decompress_in_bytes, done);
+	VB2_CRYPTO_STATS_ADD(decompress_out_bytes, image_info->original_size);
+	return ret ? ret : close_ret;
+}
+#endif
+
 #define OUTBUF_LEN 128
 
 void VbRegionCheckVersion(VbCommonParams *cparams)
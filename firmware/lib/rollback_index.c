@@ -47,10 +47,31 @@ uint32_t WriteSpaceKernel(RollbackSpaceKernel *rsk);
 		}							\
 	} while (0)
 
+/*
+ * Copies of the TPM spaces as last read from or written to the TPM.  Only
+ * vboot writes them during boot, so reading them again can use these copies
+ * instead of going back to the TPM.
+ */
+static struct {
+	RollbackSpaceFirmware rsf;
+	RollbackSpaceKernel rsk;
+	uint8_t backup[BACKUP_NV_SIZE];
+	uint32_t kernel_perms;
+	int have_rsf;
+	int have_rsk;
+	int have_backup;
+	int have_kernel_perms;
+} cache;
+
+void RollbackClearCache(void)
+{
+	Memset(&cache, 0, sizeof(cache));
+}
 
 uint32_t TPMClearAndReenable(void)
 {
 	VBDEBUG(("TPM: Clear and re-enable\n"));
+	RollbackClearCache();
 	RETURN_ON_FAILURE(TlclForceClear());
 	RETURN_ON_FAILURE(TlclSetEnable());
 	RETURN_ON_FAILURE(TlclSetDeactivated(0));
@@ -86,6 +107,11 @@ uint32_t ReadSpaceFirmware(RollbackSpaceFirmware *rsf)
 	uint32_t r;
 	int attempts = 3;
 
+	if (cache.have_rsf) {
+		Memcpy(rsf, &cache.rsf, sizeof(*rsf));
+		return TPM_SUCCESS;
+	}
+
 	while (attempts--) {
 		r = TlclRead(FIRMWARE_NV_INDEX, rsf,
 			     sizeof(RollbackSpaceFirmware));
@@ -102,7 +128,7 @@ uint32_t ReadSpaceFirmware(RollbackSpaceFirmware *rsf)
 		if (rsf->struct_version < 2) {
 			/* Danger Will Robinson! Danger! */
 			rsf->struct_version = 2;
-			return TPM_SUCCESS;
+			break;
 		}
 
 		/*
@@ -112,13 +138,21 @@ uint32_t ReadSpaceFirmware(RollbackSpaceFirmware *rsf)
 		 */
 		if (rsf->crc8 == Crc8(rsf,
 				      offsetof(RollbackSpaceFirmware, crc8)))
-			return TPM_SUCCESS;
+			break;
 
 		VBDEBUG(("TPM: %s() - bad CRC\n", __func__));
+		r = TPM_E_CORRUPTED_STATE;
 	}
 
-	VBDEBUG(("TPM: %s() - too many bad CRCs, giving up\n", __func__));
-	return TPM_E_CORRUPTED_STATE;
+	if (r != TPM_SUCCESS) {
+		VBDEBUG(("TPM: %s() - too many bad CRCs, giving up\n",
+			 __func__));
+		return r;
+	}
+
+	Memcpy(&cache.rsf, rsf, sizeof(*rsf));
+	cache.have_rsf = 1;
+	return TPM_SUCCESS;
 }
 
 uint32_t WriteSpaceFirmware(RollbackSpaceFirmware *rsf)
@@ -132,6 +166,9 @@ uint32_t WriteSpaceFirmware(RollbackSpaceFirmware *rsf)
 		rsf->struct_version = 2;
 	rsf->crc8 = Crc8(rsf, offsetof(RollbackSpaceFirmware, crc8));
 
+	/* Read-back below must come from the TPM, and will refill the cache */
+	cache.have_rsf = 0;
+
 	while (attempts--) {
 		r = SafeWrite(FIRMWARE_NV_INDEX, rsf,
 			      sizeof(RollbackSpaceFirmware));
@@ -183,6 +220,11 @@ uint32_t ReadSpaceKernel(RollbackSpaceKernel *rsk)
 	uint32_t r;
 	int attempts = 3;
 
+	if (cache.have_rsk) {
+		Memcpy(rsk, &cache.rsk, sizeof(*rsk));
+		return TPM_SUCCESS;
+	}
+
 	while (attempts--) {
 		r = TlclRead(KERNEL_NV_INDEX, rsk, sizeof(RollbackSpaceKernel));
 		if (r != TPM_SUCCESS)
@@ -198,7 +240,7 @@ uint32_t ReadSpaceKernel(RollbackSpaceKernel *rsk)
 		if (rsk->struct_version < 2) {
 			/* Danger Will Robinson! Danger! */
 			rsk->struct_version = 2;
-			return TPM_SUCCESS;
+			break;
 		}
 
 		/*
@@ -207,13 +249,21 @@ uint32_t ReadSpaceKernel(RollbackSpaceKernel *rsk)
 		 * could just be noise.
 		 */
 		if (rsk->crc8 == Crc8(rsk, offsetof(RollbackSpaceKernel, crc8)))
-			return TPM_SUCCESS;
+			break;
 
 		VBDEBUG(("TPM: %s() - bad CRC\n", __func__));
+		r = TPM_E_CORRUPTED_STATE;
 	}
 
-	VBDEBUG(("TPM: %s() - too many bad CRCs, giving up\n", __func__));
-	return TPM_E_CORRUPTED_STATE;
+	if (r != TPM_SUCCESS) {
+		VBDEBUG(("TPM: %s() - too many bad CRCs, giving up\n",
+			 __func__));
+		return r;
+	}
+
+	Memcpy(&cache.rsk, rsk, sizeof(*rsk));
+	cache.have_rsk = 1;
+	return TPM_SUCCESS;
 }
 
 uint32_t WriteSpaceKernel(RollbackSpaceKernel *rsk)
@@ -227,6 +277,9 @@ uint32_t WriteSpaceKernel(RollbackSpaceKernel *rsk)
 		rsk->struct_version = 2;
 	rsk->crc8 = Crc8(rsk, offsetof(RollbackSpaceKernel, crc8));
 
+	/* Read-back below must come from the TPM, and will refill the cache */
+	cache.have_rsk = 0;
+
 	while (attempts--) {
 		r = SafeWrite(KERNEL_NV_INDEX, rsk,
 			      sizeof(RollbackSpaceKernel));
@@ -247,6 +300,34 @@ uint32_t WriteSpaceKernel(RollbackSpaceKernel *rsk)
 	return TPM_E_CORRUPTED_STATE;
 }
 
+/*
+ * Returns non-zero if the space at [index] is already defined with [perm] and
+ * [size].
+ */
+static int SpaceIsDefined(uint32_t index, uint32_t perm, uint32_t size)
+{
+	uint32_t got_perm, got_size;
+
+	if (TlclGetSpaceInfo(index, &got_perm, &got_size) != TPM_SUCCESS)
+		return 0;
+	VBDEBUG(("TPM: space 0x%x has permissions 0x%x, size %d\n",
+		 index, got_perm, got_size));
+	return got_perm == perm && got_size == size;
+}
+
+/*
+ * Returns non-zero if the space at [index] already holds the [size] bytes at
+ * [data].
+ */
+static int SpaceHolds(uint32_t index, const void *data, uint32_t size)
+{
+	uint8_t buf[32];
+
+	if (size > sizeof(buf) || TlclRead(index, buf, size) != TPM_SUCCESS)
+		return 0;
+	return !Memcmp(buf, data, size);
+}
+
 uint32_t OneTimeInitializeTPM(RollbackSpaceFirmware *rsf,
                               RollbackSpaceKernel *rsk)
 {
@@ -258,6 +339,8 @@ uint32_t OneTimeInitializeTPM(RollbackSpaceFirmware *rsf,
 		.uid = ROLLBACK_SPACE_KERNEL_UID,
 	};
 	TPM_PERMANENT_FLAGS pflags;
+	uint8_t owned = 1;
+	int have_backup, have_kernel, have_firmware;
 	uint32_t result;
 
 	VBDEBUG(("TPM: One-time initialization\n"));
@@ -300,33 +383,102 @@ uint32_t OneTimeInitializeTPM(RollbackSpaceFirmware *rsf,
 		RETURN_ON_FAILURE(TlclSetNvLocked());
 	}
 
-	/* Clear TPM owner, in case the TPM is already owned for some reason. */
-	VBDEBUG(("TPM: Clearing owner\n"));
-	RETURN_ON_FAILURE(TPMClearAndReenable());
+	/*
+	 * Clear TPM owner, in case the TPM is already owned for some reason.
+	 * That also enables and activates the TPM.  A TPM fresh from the
+	 * factory needs none of that, so don't spend the time on it there;
+	 * SafeDefineSpace() and SafeWrite() still clear the TPM if they hit
+	 * the write limit.
+	 */
+	TlclGetOwnership(&owned);
+	VBDEBUG(("TPM: owned=%d disable=%d deactivated=%d\n", owned,
+		 pflags.disable, pflags.deactivated));
+	if (owned || pflags.disable || pflags.deactivated) {
+		VBDEBUG(("TPM: Clearing owner\n"));
+		RETURN_ON_FAILURE(TPMClearAndReenable());
+	}
 
 	/* Initializes the firmware and kernel spaces */
 	Memcpy(rsf, &rsf_init, sizeof(RollbackSpaceFirmware));
 	Memcpy(rsk, &rsk_init, sizeof(RollbackSpaceKernel));
 
+	/*
+	 * See which spaces an earlier try already got to, so they aren't
+	 * defined and written again.  A space with the wrong permissions or
+	 * size is redefined, which replaces it.
+	 */
+	have_backup = SpaceIsDefined(BACKUP_NV_INDEX, TPM_NV_PER_PPWRITE,
+				     BACKUP_NV_SIZE);
+	have_kernel = SpaceIsDefined(KERNEL_NV_INDEX, TPM_NV_PER_PPWRITE,
+				     sizeof(RollbackSpaceKernel));
+	have_firmware = SpaceIsDefined(
+			FIRMWARE_NV_INDEX,
+			TPM_NV_PER_GLOBALLOCK | TPM_NV_PER_PPWRITE,
+			sizeof(RollbackSpaceFirmware));
+
 	/* Define the backup space. No need to initialize it, though. */
-	RETURN_ON_FAILURE(SafeDefineSpace(
+	if (!have_backup)
+		RETURN_ON_FAILURE(SafeDefineSpace(
 			BACKUP_NV_INDEX, TPM_NV_PER_PPWRITE, BACKUP_NV_SIZE));
 
-	/* Define and initialize the kernel space */
-	RETURN_ON_FAILURE(SafeDefineSpace(KERNEL_NV_INDEX, TPM_NV_PER_PPWRITE,
-					  sizeof(RollbackSpaceKernel)));
-	RETURN_ON_FAILURE(WriteSpaceKernel(rsk));
+	/*
+	 * Define and initialize the kernel space.  The CRC is filled in here
+	 * the same way WriteSpaceKernel() would, to compare what's there.
+	 */
+	rsk->crc8 = Crc8(rsk, offsetof(RollbackSpaceKernel, crc8));
+	if (!have_kernel)
+		RETURN_ON_FAILURE(SafeDefineSpace(
+			KERNEL_NV_INDEX, TPM_NV_PER_PPWRITE,
+			sizeof(RollbackSpaceKernel)));
+	if (!have_kernel ||
+	    !SpaceHolds(KERNEL_NV_INDEX, rsk, sizeof(RollbackSpaceKernel)))
+		RETURN_ON_FAILURE(WriteSpaceKernel(rsk));
 
 	/* Do the firmware space last, so we retry if we don't get this far. */
-	RETURN_ON_FAILURE(SafeDefineSpace(
+	rsf->crc8 = Crc8(rsf, offsetof(RollbackSpaceFirmware, crc8));
+	if (!have_firmware)
+		RETURN_ON_FAILURE(SafeDefineSpace(
 			FIRMWARE_NV_INDEX,
 			TPM_NV_PER_GLOBALLOCK | TPM_NV_PER_PPWRITE,
 			sizeof(RollbackSpaceFirmware)));
-	RETURN_ON_FAILURE(WriteSpaceFirmware(rsf));
+	if (!have_firmware ||
+	    !SpaceHolds(FIRMWARE_NV_INDEX, rsf, sizeof(RollbackSpaceFirmware)))
+		RETURN_ON_FAILURE(WriteSpaceFirmware(rsf));
 
 	return TPM_SUCCESS;
 }
 
+/*
+ * Set by RollbackSelfTestStart() once it has started the TPM, along with the
+ * result of doing so, for SetupTPM() to pick up instead of starting it again.
+ */
+static int tpm_started;
+static uint32_t tpm_start_result;
+
+/*
+ * Start the TPM, and its self test if the TPM doesn't do that by itself.  The
+ * self test is only started here; the next TPM command waits for it, so
+ * whatever the firmware does before then overlaps with it.
+ */
+static uint32_t StartTPM(void)
+{
+	RETURN_ON_FAILURE(TlclLibInit());
+	RETURN_ON_FAILURE(TlclStartup());
+
+  /*
+   * Some TPMs start the self test automatically at power on.  In that case we
+   * don't need to call ContinueSelfTest.  On some (other) TPMs,
+   * ContinueSelfTest may block.  In that case, starting it here at least lets
+   * TPM_ASYNC platforms keep going while it runs.
+   */
+#ifdef TPM_MANUAL_SELFTEST
+#if defined(TPM_BLOCKING_CONTINUESELFTEST) && !defined(TPM_ASYNC)
+#warning "lousy TPM!"
+#endif
+	RETURN_ON_FAILURE(TlclContinueSelfTestStart());
+#endif
+	return TPM_SUCCESS;
+}
 
 /*
  * SetupTPM starts the TPM and establishes the root of trust for the
@@ -357,10 +509,14 @@ uint32_t SetupTPM(int developer_mode, int disable_dev_request,
 	uint32_t result;
 	uint32_t versions;
 
-	RETURN_ON_FAILURE(TlclLibInit());
+	/* New boot, so nothing read from the TPM before is still good */
+	RollbackClearCache();
+
+	/* Unless RollbackSelfTestStart() already did */
+	result = tpm_started ? tpm_start_result : StartTPM();
+	tpm_started = 0;
 
 #ifdef TEGRA_SOFT_REBOOT_WORKAROUND
-	result = TlclStartup();
 	if (result == TPM_E_INVALID_POSTINIT) {
 		/*
 		 * Some prototype hardware doesn't reset the TPM on a CPU
@@ -368,32 +524,14 @@ uint32_t SetupTPM(int developer_mode, int disable_dev_request,
 		 */
 		VBDEBUG(("TPM: soft reset detected\n", result));
 		return TPM_E_MUST_REBOOT;
-	} else if (result != TPM_SUCCESS) {
-		VBDEBUG(("TPM: TlclStartup returned %08x\n", result));
-		return result;
 	}
-#else
-	RETURN_ON_FAILURE(TlclStartup());
 #endif
-
-  /*
-   * Some TPMs start the self test automatically at power on.  In that case we
-   * don't need to call ContinueSelfTest.  On some (other) TPMs,
-   * ContinueSelfTest may block.  In that case, we definitely don't want to
-   * call it here.  For TPMs in the intersection of these two sets, we're
-   * screwed.  (In other words: TPMs that require manually starting the
-   * self-test AND block will have poor performance until we split
-   * TlclSendReceive() into Send() and Receive(), and have a state machine to
-   * control setup.)
-   *
-   * This comment is likely to become obsolete in the near future, so don't
-   * trust it.  It may have not been updated.
-   */
+	if (result != TPM_SUCCESS) {
+		VBDEBUG(("TPM: starting the TPM returned %08x\n", result));
+		return result;
+	}
 #ifdef TPM_MANUAL_SELFTEST
-#ifdef TPM_BLOCKING_CONTINUESELFTEST
-#warning "lousy TPM!"
-#endif
-	RETURN_ON_FAILURE(TlclContinueSelfTest());
+	RETURN_ON_FAILURE(TlclFinish());
 #endif
 	result = TlclAssertPhysicalPresence();
 	if (result != TPM_SUCCESS) {
@@ -485,6 +623,11 @@ uint32_t SetupTPM(int developer_mode, int disable_dev_request,
 #ifdef DISABLE_ROLLBACK_TPM
 /* Dummy implementations which don't support TPM rollback protection */
 
+uint32_t RollbackSelfTestStart(void)
+{
+	return TPM_SUCCESS;
+}
+
 uint32_t RollbackS3Resume(void)
 {
 #ifndef CHROMEOS_ENVIRONMENT
@@ -527,6 +670,11 @@ uint32_t RollbackFirmwareLock(void)
 	return TPM_SUCCESS;
 }
 
+uint32_t RollbackFirmwareLockStart(void)
+{
+	return TPM_SUCCESS;
+}
+
 uint32_t RollbackKernelRead(uint32_t* version)
 {
 	*version = 0;
@@ -555,9 +703,17 @@ uint32_t RollbackKernelLock(int recovery_mode)
 
 #else
 
+uint32_t RollbackSelfTestStart(void)
+{
+	tpm_start_result = StartTPM();
+	tpm_started = 1;
+	return tpm_start_result;
+}
+
 uint32_t RollbackS3Resume(void)
 {
 	uint32_t result;
+	RollbackClearCache();
 	RETURN_ON_FAILURE(TlclLibInit());
 	result = TlclResume();
 	if (result == TPM_E_INVALID_POSTINIT) {
@@ -601,11 +757,27 @@ uint32_t RollbackFirmwareWrite(uint32_t version)
 	return WriteSpaceFirmware(&rsf);
 }
 
+/* Set by RollbackFirmwareLockStart(), for RollbackFirmwareLock() */
+static int firmware_lock_started;
+
 uint32_t RollbackFirmwareLock(void)
 {
+	if (firmware_lock_started) {
+		firmware_lock_started = 0;
+		return TlclFinish();
+	}
 	return TlclSetGlobalLock();
 }
 
+uint32_t RollbackFirmwareLockStart(void)
+{
+	uint32_t result = TlclSetGlobalLockStart();
+
+	/* If it didn't start, RollbackFirmwareLock() will try again */
+	firmware_lock_started = (result == TPM_SUCCESS);
+	return result;
+}
+
 uint32_t RollbackKernelRead(uint32_t* version)
 {
 	RollbackSpaceKernel rsk;
@@ -620,7 +792,12 @@ uint32_t RollbackKernelRead(uint32_t* version)
 	 * PP-protected space (but not write to it).
 	 */
 	RETURN_ON_FAILURE(ReadSpaceKernel(&rsk));
-	RETURN_ON_FAILURE(TlclGetPermissions(KERNEL_NV_INDEX, &perms));
+	if (!cache.have_kernel_perms) {
+		RETURN_ON_FAILURE(TlclGetPermissions(KERNEL_NV_INDEX,
+						     &cache.kernel_perms));
+		cache.have_kernel_perms = 1;
+	}
+	perms = cache.kernel_perms;
 	Memcpy(&uid, &rsk.uid, sizeof(uid));
 	if (TPM_NV_PER_PPWRITE != perms || ROLLBACK_SPACE_KERNEL_UID != uid)
 		return TPM_E_CORRUPTED_STATE;
@@ -638,6 +815,12 @@ uint32_t RollbackKernelWrite(uint32_t version)
 	Memcpy(&old_version, &rsk.kernel_versions, sizeof(old_version));
 	VBDEBUG(("TPM: RollbackKernelWrite %x --> %x\n",
 		 (int)old_version, (int)version));
+	/*
+	 * The cache holds what the TPM has, so writing the same version again
+	 * would only wear the NVRAM and hold up the lock which follows.
+	 */
+	if (old_version == version)
+		return TPM_SUCCESS;
 	Memcpy(&rsk.kernel_versions, &version, sizeof(version));
 	return WriteSpaceKernel(&rsk);
 }
@@ -652,16 +835,32 @@ uint32_t RollbackKernelWrite(uint32_t version)
 uint32_t RollbackBackupRead(uint8_t *raw)
 {
 	uint32_t r;
+
+	if (cache.have_backup) {
+		Memcpy(raw, cache.backup, BACKUP_NV_SIZE);
+		return TPM_SUCCESS;
+	}
+
 	r = TlclRead(BACKUP_NV_INDEX, raw, BACKUP_NV_SIZE);
 	VBDEBUG(("TPM: %s returning 0x%x\n", __func__, r));
+	if (r == TPM_SUCCESS) {
+		Memcpy(cache.backup, raw, BACKUP_NV_SIZE);
+		cache.have_backup = 1;
+	}
 	return r;
 }
 
 uint32_t RollbackBackupWrite(uint8_t *raw)
 {
 	uint32_t r;
+
+	cache.have_backup = 0;
 	r = TlclWrite(BACKUP_NV_INDEX, raw, BACKUP_NV_SIZE);
 	VBDEBUG(("TPM: %s returning 0x%x\n", __func__, r));
+	if (r == TPM_SUCCESS) {
+		Memcpy(cache.backup, raw, BACKUP_NV_SIZE);
+		cache.have_backup = 1;
+	}
 	return r;
 }
 
@@ -11,6 +11,7 @@
 #include "tpm_bootmode.h"
 #include "utility.h"
 #include "vboot_api.h"
+#include "vboot_common.h"
 
 /* TPM PCRs to use for storing boot mode measurements. */
 #define BOOT_MODE_PCR 0
@@ -134,13 +135,61 @@ static int GetBootStateIndex(int dev_mode, int rec_mode,
 	return index;
 }
 
-uint32_t SetTPMBootModeState(int developer_mode, int recovery_mode,
+uint32_t VbFlushMeasurements(VbSharedDataHeader *shared)
+{
+	uint32_t result = 0, r;
+	uint8_t out_digest[20];  /* For PCR extend output. */
+
+	if (!shared || shared->struct_version < 3)
+		return 0;
+
+	/*
+	 * TPM 1.2 has no command to extend several PCRs at once, so this is
+	 * still one TlclExtend() per measurement.  Doing them together after
+	 * verification keeps the TPM out of the verification path.
+	 */
+	while (shared->measurement_flushed < shared->measurement_count) {
+		const VbSharedDataMeasurement *m =
+			shared->measurements + shared->measurement_flushed++;
+
+		if (m->pcr == VBSD_MEASURE_NO_PCR)
+			continue;
+		r = TlclExtend(m->pcr, m->digest, out_digest);
+		VBDEBUG(("TPM: measurement %d PCR%d result %d\n",
+			 m->event, m->pcr, r));
+		if (r)
+			result = r;
+	}
+
+	return result;
+}
+
+/**
+ * Queue a measurement in the event log, or extend it right away if there's
+ * no room there.
+ */
+static uint32_t Measure(VbSharedDataHeader *shared, uint32_t event,
+			uint32_t pcr, const uint8_t *digest)
+{
+	uint8_t out_digest[20];  /* For PCR extend output. */
+	uint32_t result;
+
+	if (0 == VbSharedDataQueueMeasurement(shared, event, pcr, digest))
+		return 0;
+
+	result = TlclExtend(pcr, digest, out_digest);
+	VBDEBUG(("TPM: measurement %d PCR%d result %d\n",
+		 (int)event, (int)pcr, result));
+	return result;
+}
+
+uint32_t SetTPMBootModeState(VbSharedDataHeader *shared,
+			     int developer_mode, int recovery_mode,
 			     uint64_t fw_keyblock_flags,
 			     GoogleBinaryBlockHeader *gbb)
 {
-	uint32_t result0, result1 = 0;
+	uint32_t result0, result1 = 0, result2;
 	const uint8_t *in_digest = NULL;
-	uint8_t out_digest[20];  /* For PCR extend output. */
 	int digest_index = GetBootStateIndex(developer_mode, recovery_mode,
 					     fw_keyblock_flags);
 
@@ -152,18 +201,16 @@ uint32_t SetTPMBootModeState(int developer_mode, int recovery_mode,
 		in_digest = kBootInvalidSHA1Digest;
 	}
 
-	result0 = TlclExtend(BOOT_MODE_PCR, in_digest, out_digest);
-	VBDEBUG(("TPM: SetTPMBootModeState boot mode PCR%d result %d\n",
-		 BOOT_MODE_PCR, result0));
+	result0 = Measure(shared, VBSD_MEASURE_BOOT_MODE, BOOT_MODE_PCR,
+			  in_digest);
 
 	/* Extend the HWID Digest into PCR1 (GBB v1.2 and later only) */
-	if (gbb && gbb->minor_version >= 2) {
-		result1 = TlclExtend(HWID_DIGEST_PCR, gbb->hwid_digest,
-				     out_digest);
-		VBDEBUG(("TPM: SetTPMBootModeState HWID PCR%d result %d\n",
-			 HWID_DIGEST_PCR, result1));
-	}
+	if (gbb && gbb->minor_version >= 2)
+		result1 = Measure(shared, VBSD_MEASURE_HWID, HWID_DIGEST_PCR,
+				  gbb->hwid_digest);
+
+	result2 = VbFlushMeasurements(shared);
 
 	/* The caller only looks for nonzero results, not error codes. */
-	return result0 || result1;
+	return result0 || result1 || result2;
 }
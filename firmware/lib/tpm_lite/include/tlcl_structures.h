@@ -136,3 +136,4 @@ const struct s_tpm_nv_definespace_cmd{
 
 const int kWriteInfoLength = 12;
 const int kNvDataPublicPermissionsOffset = 60;
+const int kNvDataPublicDataSizeOffset = 67;
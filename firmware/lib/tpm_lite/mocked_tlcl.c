@@ -46,11 +46,28 @@ uint32_t TlclWrite(uint32_t index, const void* data, uint32_t length) {
   return TPM_SUCCESS;
 }
 
+uint32_t TlclWriteStart(uint32_t index, const void* data, uint32_t length) {
+  return TPM_SUCCESS;
+}
+
+uint32_t TlclFinish(void) {
+  return TPM_SUCCESS;
+}
+
 uint32_t TlclRead(uint32_t index, void* data, uint32_t length) {
   Memset(data, '\0', length);
   return TPM_SUCCESS;
 }
 
+uint32_t TlclReadStart(uint32_t index, uint32_t length) {
+  return TPM_SUCCESS;
+}
+
+uint32_t TlclReadFinish(void* data, uint32_t length) {
+  Memset(data, '\0', length);
+  return TPM_SUCCESS;
+}
+
 uint32_t TlclPCRRead(uint32_t index, void* data, uint32_t length) {
   Memset(data, '\0', length);
   return TPM_SUCCESS;
@@ -84,6 +101,14 @@ uint32_t TlclLockPhysicalPresence(void) {
   return TPM_SUCCESS;
 }
 
+uint32_t TlclLockPhysicalPresenceStart(void) {
+  return TPM_SUCCESS;
+}
+
+uint32_t TlclContinueSelfTestStart(void) {
+  return TPM_SUCCESS;
+}
+
 uint32_t TlclSetNvLocked(void) {
   return TPM_SUCCESS;
 }
@@ -127,6 +152,10 @@ uint32_t TlclGetFlags(uint8_t* disable,
   return TPM_SUCCESS;
 }
 
+uint32_t TlclSetGlobalLockStart(void) {
+  return TPM_SUCCESS;
+}
+
 uint32_t TlclSetGlobalLock(void) {
   return TPM_SUCCESS;
 }
@@ -142,6 +171,13 @@ uint32_t TlclGetPermissions(uint32_t index, uint32_t* permissions) {
   return TPM_SUCCESS;
 }
 
+uint32_t TlclGetSpaceInfo(uint32_t index, uint32_t* permissions,
+                          uint32_t* size) {
+  *permissions = 0;
+  *size = 0;
+  return TPM_SUCCESS;
+}
+
 uint32_t TlclGetOwnership(uint8_t* owned) {
   *owned = 0;
   return TPM_SUCCESS;
@@ -166,3 +202,13 @@ uint32_t TlclSendReceive(const uint8_t* request, uint8_t* response,
 {
   return TPM_SUCCESS;
 }
+
+uint32_t TlclSubmit(const uint8_t* request)
+{
+  return TPM_SUCCESS;
+}
+
+uint32_t TlclComplete(uint8_t* response, int max_length)
+{
+  return TPM_SUCCESS;
+}
@@ -57,6 +57,52 @@ static inline int TpmReturnCode(const uint8_t* buffer) {
   return TpmCommandCode(buffer);
 }
 
+/* How long TlclRetrySelfTest() waits between tries while the self test is
+ * still running, and how many tries it makes.  The wait doubles each time up
+ * to the maximum, so it gives up after about a second. */
+#define SELFTEST_FIRST_WAIT_MS 1
+#define SELFTEST_MAX_WAIT_MS 128
+#if defined(TPM_BLOCKING_CONTINUESELFTEST) || defined(VB_RECOVERY_MODE)
+/* Retry only once */
+#define SELFTEST_TRIES 1
+#else
+#define SELFTEST_TRIES 14
+#endif
+
+/* Command started by TlclSubmit() and not yet finished by TlclComplete().
+ * The request is kept so a self test error can be handled by resending it.
+ */
+static uint8_t pending_request[TPM_LARGE_ENOUGH_COMMAND_SIZE];
+static int pending;
+#ifndef TPM_ASYNC
+/* Without TPM_ASYNC, TlclSubmit() does the whole transaction and keeps the
+ * response here for TlclComplete(). */
+static uint8_t pending_response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
+static uint32_t pending_response_length;
+static uint32_t pending_result;
+#endif
+
+#ifndef CHROMEOS_ENVIRONMENT
+/* Permanent flags from the last TlclGetPermanentFlags().  In the firmware
+ * nothing but this library talks to the TPM, so they stay good until a
+ * command which might change them is sent. */
+static TPM_PERMANENT_FLAGS cached_pflags;
+static int have_pflags;
+#endif
+
+static void TlclDrain(void);
+
+/* Forgets the cached flags if [request] might change them. */
+static void TlclCheckCache(const uint8_t* request) {
+#ifndef CHROMEOS_ENVIRONMENT
+  int code = TpmCommandCode(request);
+  if (code != TpmCommandCode(tpm_getflags_cmd.buffer) &&
+      code != TpmCommandCode(tpm_nv_read_cmd.buffer) &&
+      code != TpmCommandCode(tpm_pcr_read_cmd.buffer))
+    have_pflags = 0;
+#endif
+}
+
 /* Like TlclSendReceive below, but do not retry if NEEDS_SELFTEST or
  * DOING_SELFTEST errors are returned.
  */
@@ -66,6 +112,10 @@ static uint32_t TlclSendReceiveNoRetry(const uint8_t* request,
   uint32_t response_length = max_length;
   uint32_t result;
 
+  /* Only one command can be in the TPM at once */
+  TlclDrain();
+  TlclCheckCache(request);
+
 #ifdef EXTRA_LOGGING
   VBDEBUG(("TPM: command: %x%x %x%x%x%x %x%x%x%x\n",
            request[0], request[1],
@@ -102,40 +152,147 @@ static uint32_t TlclSendReceiveNoRetry(const uint8_t* request,
 }
 
 
-/* Sends a TPM command and gets a response.  Returns 0 if success or the TPM
- * error code if error. In the firmware, waits for the self test to complete
- * if needed. In the host, reports the first error without retries. */
-uint32_t TlclSendReceive(const uint8_t* request, uint8_t* response,
-                         int max_length) {
-  uint32_t result = TlclSendReceiveNoRetry(request, response, max_length);
+/* Handles a [result] of [request] which failed because the self test has not
+ * run or completed, by waiting for the self test and resending [request].
+ * Any other result is returned unchanged. */
+static uint32_t TlclRetrySelfTest(const uint8_t* request, uint8_t* response,
+                                  int max_length, uint32_t result) {
   /* When compiling for the firmware, hide command failures due to the self
    * test not having run or completed. */
 #ifndef CHROMEOS_ENVIRONMENT
   /* If the command fails because the self test has not completed, try it
    * again after attempting to ensure that the self test has completed. */
   if (result == TPM_E_NEEDS_SELFTEST || result == TPM_E_DOING_SELFTEST) {
+    uint32_t wait_ms = SELFTEST_FIRST_WAIT_MS;
+    int tries;
+
     result = TlclContinueSelfTest();
     if (result != TPM_SUCCESS) {
       return result;
     }
-#if defined(TPM_BLOCKING_CONTINUESELFTEST) || defined(VB_RECOVERY_MODE)
-    /* Retry only once */
-    result = TlclSendReceiveNoRetry(request, response, max_length);
-#else
-    /* This needs serious testing.  The TPM specification says: "iii. The
-     * caller MUST wait for the actions of TPM_ContinueSelfTest to complete
-     * before reissuing the command C1."  But, if ContinueSelfTest is
-     * non-blocking, how do we know that the actions have completed other than
-     * trying again? */
-    do {
+    /* The TPM specification says: "iii. The caller MUST wait for the actions
+     * of TPM_ContinueSelfTest to complete before reissuing the command C1."
+     * But, if ContinueSelfTest is non-blocking, how do we know that the
+     * actions have completed other than trying again?  So try again, backing
+     * off so a slow self test isn't flooded with commands, and give up with
+     * TPM_E_DOING_SELFTEST if it never finishes. */
+    for (tries = 0; tries < SELFTEST_TRIES; tries++) {
+      if (tries > 0) {
+        VbExSleepMs(wait_ms);
+        if (wait_ms < SELFTEST_MAX_WAIT_MS)
+          wait_ms *= 2;
+      }
       result = TlclSendReceiveNoRetry(request, response, max_length);
-    } while (result == TPM_E_DOING_SELFTEST);
-#endif
+      if (result != TPM_E_DOING_SELFTEST)
+        break;
+    }
   }
 #endif  /* ! defined(CHROMEOS_ENVIRONMENT) */
   return result;
 }
 
+/* Sends a TPM command and gets a response.  Returns 0 if success or the TPM
+ * error code if error. In the firmware, waits for the self test to complete
+ * if needed. In the host, reports the first error without retries. */
+uint32_t TlclSendReceive(const uint8_t* request, uint8_t* response,
+                         int max_length) {
+  uint32_t result = TlclSendReceiveNoRetry(request, response, max_length);
+  return TlclRetrySelfTest(request, response, max_length, result);
+}
+
+/* Starts a command in the buffer TlclSubmitRequest() sends it from, by
+ * copying the first [length] bytes of [template].  The caller fills in the
+ * rest, so commands aren't built on the stack and then copied again. */
+static uint8_t* TlclStartRequest(const uint8_t* template, uint32_t length) {
+  TlclDrain();
+  Memcpy(pending_request, template, length);
+  return pending_request;
+}
+
+/* Submits the command built by TlclStartRequest(). */
+static uint32_t TlclSubmitRequest(void) {
+  uint32_t request_length = TpmCommandSize(pending_request);
+
+  TlclCheckCache(pending_request);
+
+  if (request_length > sizeof(pending_request))
+    return TPM_E_INPUT_TOO_SMALL;
+  pending = 1;
+
+#ifdef TPM_ASYNC
+  {
+    uint32_t result = VbExTpmSubmit(pending_request, request_length);
+    if (0 != result) {
+      VBDEBUG(("TPM: command 0x%x submit failed: 0x%x\n",
+               TpmCommandCode(request), result));
+      pending = 0;
+      return result;
+    }
+  }
+#else
+  pending_response_length = sizeof(pending_response);
+  pending_result = VbExTpmSendReceive(pending_request, request_length,
+                                      pending_response,
+                                      &pending_response_length);
+#endif
+  return TPM_SUCCESS;
+}
+
+uint32_t TlclSubmit(const uint8_t* request) {
+  uint32_t request_length = TpmCommandSize(request);
+
+  if (request_length > sizeof(pending_request)) {
+    TlclDrain();
+    return TPM_E_INPUT_TOO_SMALL;
+  }
+  TlclStartRequest(request, request_length);
+  return TlclSubmitRequest();
+}
+
+uint32_t TlclComplete(uint8_t* response, int max_length) {
+  uint32_t response_length = max_length;
+  uint32_t result;
+
+  if (!pending)
+    return TPM_E_INTERNAL_INCONSISTENCY;
+  pending = 0;
+
+#ifdef TPM_ASYNC
+  result = VbExTpmComplete(response, &response_length);
+#else
+  result = pending_result;
+  if (0 == result && pending_response_length > response_length)
+    result = TPM_E_RESPONSE_TOO_LARGE;
+  if (0 == result)
+    Memcpy(response, pending_response,
+           response_length < sizeof(pending_response) ?
+           response_length : sizeof(pending_response));
+#endif
+  if (0 != result) {
+    /* Communication with TPM failed, so response is garbage */
+    VBDEBUG(("TPM: command 0x%x send/receive failed: 0x%x\n",
+             TpmCommandCode(pending_request), result));
+    return result;
+  }
+  result = TpmReturnCode(response);
+
+  VBDEBUG(("TPM: command 0x%x returned 0x%x\n",
+           TpmCommandCode(pending_request), result));
+
+  return TlclRetrySelfTest(pending_request, response, max_length, result);
+}
+
+/* Finishes any command left pending by TlclSubmit(), discarding its
+ * response, so another command can be sent. */
+static void TlclDrain(void) {
+  uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
+  if (pending) {
+    VBDEBUG(("TPM: discarding pending command 0x%x\n",
+             TpmCommandCode(pending_request)));
+    TlclComplete(response, sizeof(response));
+  }
+}
+
 /* Sends a command and returns the error code. */
 static uint32_t Send(const uint8_t* command) {
   uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
@@ -145,6 +302,9 @@ static uint32_t Send(const uint8_t* command) {
 /* Exported functions. */
 
 uint32_t TlclLibInit(void) {
+#ifndef CHROMEOS_ENVIRONMENT
+  have_pflags = 0;
+#endif
   return VbExTpmInit();
 }
 
@@ -180,6 +340,11 @@ uint32_t TlclContinueSelfTest(void) {
                                 response, sizeof(response));
 }
 
+uint32_t TlclContinueSelfTestStart(void) {
+  VBDEBUG(("TPM: Continue self test\n"));
+  return TlclSubmit(tpm_continueselftest_cmd.buffer);
+}
+
 uint32_t TlclDefineSpace(uint32_t index, uint32_t perm, uint32_t size) {
   struct s_tpm_nv_definespace_cmd cmd;
   VBDEBUG(("TPM: TlclDefineSpace(0x%x, 0x%x, %d)\n", index, perm, size));
@@ -190,46 +355,74 @@ uint32_t TlclDefineSpace(uint32_t index, uint32_t perm, uint32_t size) {
   return Send(cmd.buffer);
 }
 
-uint32_t TlclWrite(uint32_t index, const void* data, uint32_t length) {
-  struct s_tpm_nv_write_cmd cmd;
+uint32_t TlclFinish(void) {
   uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
+  return TlclComplete(response, sizeof(response));
+}
+
+uint32_t TlclWriteStart(uint32_t index, const void* data, uint32_t length) {
+  uint8_t* request;
   const int total_length =
     kTpmRequestHeaderLength + kWriteInfoLength + length;
 
   VBDEBUG(("TPM: TlclWrite(0x%x, %d)\n", index, length));
-  Memcpy(&cmd, &tpm_nv_write_cmd, sizeof(cmd));
   VbAssert(total_length <= TPM_LARGE_ENOUGH_COMMAND_SIZE);
-  SetTpmCommandSize(cmd.buffer, total_length);
 
-  ToTpmUint32(cmd.buffer + tpm_nv_write_cmd.index, index);
-  ToTpmUint32(cmd.buffer + tpm_nv_write_cmd.length, length);
-  Memcpy(cmd.buffer + tpm_nv_write_cmd.data, data, length);
+  /* Only the header comes from the template; the data goes straight in */
+  request = TlclStartRequest(tpm_nv_write_cmd.buffer, tpm_nv_write_cmd.data);
+  SetTpmCommandSize(request, total_length);
+  ToTpmUint32(request + tpm_nv_write_cmd.index, index);
+  ToTpmUint32(request + tpm_nv_write_cmd.length, length);
+  Memcpy(request + tpm_nv_write_cmd.data, data, length);
 
-  return TlclSendReceive(cmd.buffer, response, sizeof(response));
+  return TlclSubmitRequest();
 }
 
-uint32_t TlclRead(uint32_t index, void* data, uint32_t length) {
-  struct s_tpm_nv_read_cmd cmd;
+uint32_t TlclWrite(uint32_t index, const void* data, uint32_t length) {
+  uint32_t result = TlclWriteStart(index, data, length);
+  if (result != TPM_SUCCESS)
+    return result;
+  return TlclFinish();
+}
+
+uint32_t TlclReadStart(uint32_t index, uint32_t length) {
+  uint8_t* request;
+
+  VBDEBUG(("TPM: TlclRead(0x%x, %d)\n", index, length));
+  request = TlclStartRequest(tpm_nv_read_cmd.buffer,
+                             sizeof(tpm_nv_read_cmd.buffer));
+  ToTpmUint32(request + tpm_nv_read_cmd.index, index);
+  ToTpmUint32(request + tpm_nv_read_cmd.length, length);
+
+  return TlclSubmitRequest();
+}
+
+uint32_t TlclReadFinish(void* data, uint32_t length) {
   uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
   uint32_t result_length;
   uint32_t result;
 
-  VBDEBUG(("TPM: TlclRead(0x%x, %d)\n", index, length));
-  Memcpy(&cmd, &tpm_nv_read_cmd, sizeof(cmd));
-  ToTpmUint32(cmd.buffer + tpm_nv_read_cmd.index, index);
-  ToTpmUint32(cmd.buffer + tpm_nv_read_cmd.length, length);
-
-  result = TlclSendReceive(cmd.buffer, response, sizeof(response));
+  result = TlclComplete(response, sizeof(response));
   if (result == TPM_SUCCESS && length > 0) {
     uint8_t* nv_read_cursor = response + kTpmResponseHeaderLength;
     FromTpmUint32(nv_read_cursor, &result_length);
     nv_read_cursor += sizeof(uint32_t);
+    /* Don't let a bad response overrun the caller's buffer */
+    if (result_length > length)
+      result_length = length;
     Memcpy(data, nv_read_cursor, result_length);
   }
 
   return result;
 }
 
+uint32_t TlclRead(uint32_t index, void* data, uint32_t length) {
+  uint32_t result = TlclReadStart(index, length);
+  if (result != TPM_SUCCESS)
+    return result;
+  return TlclReadFinish(data, length);
+}
+
 uint32_t TlclPCRRead(uint32_t index, void* data, uint32_t length) {
   struct s_tpm_pcr_read_cmd cmd;
   uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
@@ -281,9 +474,16 @@ uint32_t TlclAssertPhysicalPresenceResult(void) {
   return TlclSendReceive(tpm_ppassert_cmd.buffer, response, sizeof(response));
 }
 
-uint32_t TlclLockPhysicalPresence(void) {
+uint32_t TlclLockPhysicalPresenceStart(void) {
   VBDEBUG(("TPM: Lock physical presence\n"));
-  return Send(tpm_pplock_cmd.buffer);
+  return TlclSubmit(tpm_pplock_cmd.buffer);
+}
+
+uint32_t TlclLockPhysicalPresence(void) {
+  uint32_t result = TlclLockPhysicalPresenceStart();
+  if (result != TPM_SUCCESS)
+    return result;
+  return TlclFinish();
 }
 
 uint32_t TlclSetNvLocked(void) {
@@ -325,8 +525,14 @@ uint32_t TlclSetDeactivated(uint8_t flag) {
 uint32_t TlclGetPermanentFlags(TPM_PERMANENT_FLAGS* pflags) {
   uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
   uint32_t size;
-  uint32_t result =
-    TlclSendReceive(tpm_getflags_cmd.buffer, response, sizeof(response));
+  uint32_t result;
+#ifndef CHROMEOS_ENVIRONMENT
+  if (have_pflags) {
+    Memcpy(pflags, &cached_pflags, sizeof(TPM_PERMANENT_FLAGS));
+    return TPM_SUCCESS;
+  }
+#endif
+  result = TlclSendReceive(tpm_getflags_cmd.buffer, response, sizeof(response));
   if (result != TPM_SUCCESS)
     return result;
   FromTpmUint32(response + kTpmResponseHeaderLength, &size);
@@ -336,6 +542,10 @@ uint32_t TlclGetPermanentFlags(TPM_PERMANENT_FLAGS* pflags) {
   Memcpy(pflags,
          response + kTpmResponseHeaderLength + sizeof(size),
          sizeof(TPM_PERMANENT_FLAGS));
+#ifndef CHROMEOS_ENVIRONMENT
+  Memcpy(&cached_pflags, pflags, sizeof(TPM_PERMANENT_FLAGS));
+  have_pflags = 1;
+#endif
   return result;
 }
 
@@ -375,10 +585,17 @@ uint32_t TlclGetFlags(uint8_t* disable,
   return result;
 }
 
-uint32_t TlclSetGlobalLock(void) {
+uint32_t TlclSetGlobalLockStart(void) {
   uint32_t x;
   VBDEBUG(("TPM: Set global lock\n"));
-  return TlclWrite(TPM_NV_INDEX0, (uint8_t*) &x, 0);
+  return TlclWriteStart(TPM_NV_INDEX0, (uint8_t*) &x, 0);
+}
+
+uint32_t TlclSetGlobalLock(void) {
+  uint32_t result = TlclSetGlobalLockStart();
+  if (result != TPM_SUCCESS)
+    return result;
+  return TlclFinish();
 }
 
 uint32_t TlclExtend(int pcr_num, const uint8_t* in_digest,
@@ -417,6 +634,26 @@ uint32_t TlclGetPermissions(uint32_t index, uint32_t* permissions) {
   return result;
 }
 
+uint32_t TlclGetSpaceInfo(uint32_t index, uint32_t* permissions,
+                          uint32_t* size) {
+  struct s_tpm_getpermissions_cmd cmd;
+  uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
+  uint8_t* nvdata;
+  uint32_t result;
+  uint32_t nvdata_size;
+
+  Memcpy(&cmd, &tpm_getpermissions_cmd, sizeof(cmd));
+  ToTpmUint32(cmd.buffer + tpm_getpermissions_cmd.index, index);
+  result = TlclSendReceive(cmd.buffer, response, sizeof(response));
+  if (result != TPM_SUCCESS)
+    return result;
+
+  nvdata = response + kTpmResponseHeaderLength + sizeof(nvdata_size);
+  FromTpmUint32(nvdata + kNvDataPublicPermissionsOffset, permissions);
+  FromTpmUint32(nvdata + kNvDataPublicDataSizeOffset, size);
+  return result;
+}
+
 uint32_t TlclGetOwnership(uint8_t* owned) {
   uint8_t response[TPM_LARGE_ENOUGH_COMMAND_SIZE];
   uint32_t size;
@@ -9,14 +9,43 @@
 
 #include "utility.h"
 
+/* Machine words, which may alias the bytes they're copied from */
+typedef uintptr_t __attribute__((__may_alias__)) mem_word_t;
+#define WORD_BYTES sizeof(mem_word_t)
+#define WORD_OFFSET(p) ((uintptr_t)(p) & (WORD_BYTES - 1))
+
+/* Below this, copies and fills go a byte at a time */
+#define FAST_MEMORY_MIN_BYTES 32
+/* From this on, x86 string instructions beat word loops */
+#define FAST_STRING_MIN_BYTES 256
+
 int SafeMemcmp(const void *s1, const void *s2, size_t n) {
 	const unsigned char *us1 = s1;
 	const unsigned char *us2 = s2;
+	mem_word_t word_result = 0;
 	int result = 0;
 
 	if (0 == n)
 		return 0;
 
+	/*
+	 * Compare a word at a time if the buffers line up.  This only
+	 * branches on their addresses and size, never on their contents.
+	 */
+	if (WORD_OFFSET(us1) == WORD_OFFSET(us2)) {
+		while (n && WORD_OFFSET(us1)) {
+			result |= *us1++ ^ *us2++;
+			n--;
+		}
+		while (n >= WORD_BYTES) {
+			word_result |= *(const mem_word_t *)us1 ^
+				*(const mem_word_t *)us2;
+			us1 += WORD_BYTES;
+			us2 += WORD_BYTES;
+			n -= WORD_BYTES;
+		}
+	}
+
 	/*
 	 * Code snippet without data-dependent branch due to Nate Lawson
 	 * (nate@root.org) of Root Labs.
@@ -24,5 +53,108 @@ int SafeMemcmp(const void *s1, const void *s2, size_t n) {
 	while (n--)
 		result |= *us1++ ^ *us2++;
 
-	return result != 0;
+	return (result | (word_result != 0)) != 0;
+}
+
+void *FastMemcpy(void *dest, const void *src, uint64_t n)
+{
+	uint8_t *d = dest;
+	const uint8_t *s = src;
+
+#if defined(__i386__) || defined(__x86_64__)
+	if (n >= FAST_STRING_MIN_BYTES) {
+		/* The string microcode takes care of alignment itself */
+		size_t count = (size_t)n;
+
+		__asm__ __volatile__("rep movsb"
+				     : "+D" (d), "+S" (s), "+c" (count)
+				     : : "memory");
+		return dest;
+	}
+#endif
+
+	if (n >= FAST_MEMORY_MIN_BYTES && WORD_OFFSET(d) == WORD_OFFSET(s)) {
+		mem_word_t *dw;
+		const mem_word_t *sw;
+
+		while (WORD_OFFSET(d)) {
+			*d++ = *s++;
+			n--;
+		}
+
+		/* Four words at a time, so ARM can use ldm/stm */
+		dw = (mem_word_t *)d;
+		sw = (const mem_word_t *)s;
+		for (; n >= 4 * WORD_BYTES; n -= 4 * WORD_BYTES) {
+			dw[0] = sw[0];
+			dw[1] = sw[1];
+			dw[2] = sw[2];
+			dw[3] = sw[3];
+			dw += 4;
+			sw += 4;
+		}
+		for (; n >= WORD_BYTES; n -= WORD_BYTES)
+			*dw++ = *sw++;
+		d = (uint8_t *)dw;
+		s = (const uint8_t *)sw;
+	}
+
+	while (n--)
+		*d++ = *s++;
+	return dest;
+}
+
+void *FastMemset(void *dest, const uint8_t c, uint64_t n)
+{
+	uint8_t *d = dest;
+
+#if defined(__i386__) || defined(__x86_64__)
+	if (n >= FAST_STRING_MIN_BYTES) {
+		size_t count = (size_t)n;
+
+		__asm__ __volatile__("rep stosb"
+				     : "+D" (d), "+c" (count)
+				     : "a" (c) : "memory");
+		return dest;
+	}
+#endif
+
+	if (n >= FAST_MEMORY_MIN_BYTES) {
+		/* c in every byte of a word */
+		mem_word_t w = (mem_word_t)c * ((mem_word_t)-1 / 0xff);
+		mem_word_t *dw;
+
+		while (WORD_OFFSET(d)) {
+			*d++ = c;
+			n--;
+		}
+
+		dw = (mem_word_t *)d;
+		for (; n >= 4 * WORD_BYTES; n -= 4 * WORD_BYTES) {
+			dw[0] = w;
+			dw[1] = w;
+			dw[2] = w;
+			dw[3] = w;
+			dw += 4;
+		}
+		for (; n >= WORD_BYTES; n -= WORD_BYTES)
+			*dw++ = w;
+		d = (uint8_t *)dw;
+	}
+
+	while (n--)
+		*d++ = c;
+	return dest;
+}
+
+#ifdef FAST_MEMORY_OPS
+void *Memcpy(void *dest, const void *src, uint64_t n)
+{
+	return FastMemcpy(dest, src, n);
+}
+
+void *Memset(void *dest, const uint8_t c, uint64_t n)
+{
+	return FastMemset(dest, c, n);
 }
+#endif
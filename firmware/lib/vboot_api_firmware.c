@@ -30,13 +30,14 @@ VbError_t VbSelectFirmware(VbCommonParams *cparams,
 
 	cparams->gbb = NULL;
 	cparams->bmp = NULL;
+	cparams->layouts = NULL;
+	cparams->image_cache = NULL;
 
 	/* Start timer */
 	shared->timer_vb_select_firmware_enter = VbExGetTimer();
 
 	/* Load NV storage */
-	VbExNvStorageRead(vnc.raw);
-	VbNvSetup(&vnc);
+	VbNvLoad(cparams, &vnc);
 
 	if (is_rec) {
 		/*
@@ -108,7 +109,7 @@ VbError_t VbSelectFirmware(VbCommonParams *cparams,
 	 * At this point, we have a good idea of how we are going to
 	 * boot. Update the TPM with this state information.
 	 */
-	tpm_status = SetTPMBootModeState(is_dev, is_rec,
+	tpm_status = SetTPMBootModeState(shared, is_dev, is_rec,
 					 shared->fw_keyblock_flags,
 					 cparams->gbb);
 	if (0 != tpm_status) {
@@ -132,12 +133,11 @@ VbError_t VbSelectFirmware(VbCommonParams *cparams,
 	}
 
 	/* Save NV storage */
-	VbNvTeardown(&vnc);
-	if (vnc.raw_changed)
-		VbExNvStorageWrite(vnc.raw);
+	VbNvSave(cparams, &vnc);
 
 	/* Stop timer */
 	shared->timer_vb_select_firmware_exit = VbExGetTimer();
+	VbSharedDataFlushCryptoStats(shared);
 
 	/* Should always have a known error code */
 	VbAssert(VBERROR_UNKNOWN != retval);
@@ -7,6 +7,10 @@
 
 #include "sysincludes.h"
 
+#include "2sysincludes.h"
+#include "2api.h"
+#include "2misc.h"
+#include "2secdata.h"
 #include "region.h"
 #include "gbb_access.h"
 #include "gbb_header.h"
@@ -43,6 +47,15 @@ VbError_t VbInit(VbCommonParams *cparams, VbInitParams *iparams)
 	/* Initialize output flags */
 	iparams->out_flags = 0;
 
+	/*
+	 * Get the TPM self test going before anything else, so it's done by
+	 * the time RollbackFirmwareSetup() needs the TPM.  Not on S3 resume,
+	 * which resumes the TPM instead, nor when vboot2 has set it up.  Any
+	 * error shows up in RollbackFirmwareSetup().
+	 */
+	if (!cparams->vb2_ctx && !(iparams->flags & VB_INIT_FLAG_S3_RESUME))
+		RollbackSelfTestStart();
+
 	retval = VbGbbReadHeader_static(cparams, &gbb);
 	if (retval)
 		return retval;
@@ -51,9 +64,12 @@ VbError_t VbInit(VbCommonParams *cparams, VbInitParams *iparams)
 		 gbb.flags));
 
 	/* Set up NV storage */
-	VbExNvStorageRead(vnc.raw);
-	VbNvSetup(&vnc);
-	lost_nvram = vnc.regenerate_crc;
+	VbNvLoad(cparams, &vnc);
+	if (cparams->vb2_ctx)
+		lost_nvram = !!(vb2_get_sd(cparams->vb2_ctx)->status &
+				VB2_SD_STATUS_NV_REINIT);
+	else
+		lost_nvram = vnc.regenerate_crc;
 
 	/* Initialize shared data structure */
 	if (0 != VbSharedDataInit(shared, cparams->shared_data_size)) {
@@ -86,6 +102,14 @@ VbError_t VbInit(VbCommonParams *cparams, VbInitParams *iparams)
 		shared->flags |= VBSD_OPROM_MATTERS;
 	if (iparams->flags & VB_INIT_FLAG_OPROM_LOADED)
 		shared->flags |= VBSD_OPROM_LOADED;
+	if (iparams->flags & VB_INIT_FLAG_PARTIAL_KERNEL_CHECK)
+		shared->flags |= VBSD_PARTIAL_KERNEL_CHECK;
+	if (iparams->flags & VB_INIT_FLAG_LAZY_SECONDARY_GPT)
+		shared->flags |= VBSD_LAZY_SECONDARY_GPT;
+	if (iparams->flags & VB_INIT_FLAG_LAZY_SECONDARY_GPT_WRITE)
+		shared->flags |= VBSD_LAZY_SECONDARY_GPT_WRITE;
+	if (iparams->flags & VB_INIT_FLAG_DEV_KEY_BLOCK_HASH_FIRST)
+		shared->flags |= VBSD_DEV_KEY_BLOCK_HASH_FIRST;
 
 	is_s3_resume = (iparams->flags & VB_INIT_FLAG_S3_RESUME ? 1 : 0);
 
@@ -191,13 +215,27 @@ VbError_t VbInit(VbCommonParams *cparams, VbInitParams *iparams)
 		 * TPM space is initialized by this call, the virtual
 		 * dev-switch will be disabled by default)
 		 */
-		VBDEBUG(("TPM: Call RollbackFirmwareSetup(r%d, d%d)\n",
-			 recovery, is_hw_dev));
-		tpm_status = RollbackFirmwareSetup(is_hw_dev,
-						   disable_dev_request,
-						   clear_tpm_owner_request,
-						   /* two outputs on success */
-						   &is_virt_dev, &tpm_version);
+		if (cparams->vb2_ctx) {
+			/*
+			 * vboot2 has already set up the TPM, handled those
+			 * requests and read the firmware space.
+			 */
+			const struct vb2_secdata *sec = (const struct
+				vb2_secdata *)cparams->vb2_ctx->secdata;
+
+			is_virt_dev = (sec->flags & VB2_SECDATA_FLAG_DEV_MODE) ?
+				1 : 0;
+			tpm_version = sec->fw_versions;
+			tpm_status = TPM_SUCCESS;
+		} else {
+			VBDEBUG(("TPM: Call RollbackFirmwareSetup(r%d, d%d)\n",
+				 recovery, is_hw_dev));
+			tpm_status = RollbackFirmwareSetup(
+				is_hw_dev, disable_dev_request,
+				clear_tpm_owner_request,
+				/* two outputs on success */
+				&is_virt_dev, &tpm_version);
+		}
 
 		if (0 != tpm_status) {
 			VBDEBUG(("Unable to setup TPM and read "
@@ -359,13 +397,12 @@ VbInit_exit:
 		SaveNvToBackup(&vnc);
 
 	/* Tear down NV storage */
-	VbNvTeardown(&vnc);
-	if (vnc.raw_changed)
-		VbExNvStorageWrite(vnc.raw);
+	VbNvSave(cparams, &vnc);
 
 	VBDEBUG(("VbInit() output flags 0x%x\n", iparams->out_flags));
 
 	shared->timer_vb_init_exit = VbExGetTimer();
+	VbSharedDataFlushCryptoStats(shared);
 
 	VBDEBUG(("VbInit() returning 0x%x\n", retval));
 
@@ -7,6 +7,7 @@
 
 #include "sysincludes.h"
 
+#include "crc32.h"
 #include "gbb_access.h"
 #include "gbb_header.h"
 #include "load_kernel_fw.h"
@@ -19,6 +20,7 @@
 #include "vboot_display.h"
 #include "vboot_kernel.h"
 #include "vboot_nvstorage.h"
+#include "vboot_workbuf.h"
 
 /* Global variables */
 static VbNvContext vnc;
@@ -68,12 +70,94 @@ static int VbWantShutdown(uint32_t gbb_flags)
  *
  * May return other VBERROR_ codes for other failures.
  */
+/**
+ * Return non-zero if LoadKernel() can be tried on the disk.
+ */
+static int VbDiskUsable(const VbDiskInfo *info, uint32_t get_info_flags)
+{
+	/*
+	 * Sanity-check what we can. FWIW, VbTryLoadKernel() is always
+	 * called with only a single bit set in get_info_flags.
+	 *
+	 * Ensure 512-byte or native 4K sectors and non-trivially sized
+	 * disk (for cgptlib) and that we got a partition with only the
+	 * flags we asked for.
+	 */
+	if ((512 != info->bytes_per_lba && 4096 != info->bytes_per_lba) ||
+	    16 > info->lba_count ||
+	    get_info_flags != (info->flags & ~VB_DISK_FLAG_EXTERNAL_GPT)) {
+		VBDEBUG(("  skipping: bytes_per_lba=%" PRIu64
+			 " lba_count=%" PRIu64 " flags=0x%x\n",
+			 info->bytes_per_lba,
+			 info->lba_count,
+			 info->flags));
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Disks LoadKernel() has failed on since VbTryLoadKernelCache() was last
+ * called, so they needn't be tried again until they change.  A disk is known
+ * by its handle, its size, and the CRC of its GPT header sector.
+ */
+#define VB_FAILED_DISKS 8
+static struct VbFailedDisk {
+	VbExDiskHandle_t handle;
+	uint64_t lba_count;
+	uint32_t header_crc;
+	VbError_t retval;
+} failed_disks[VB_FAILED_DISKS];
+static uint32_t failed_disk_count;
+static int failed_disks_enabled;
+
+void VbTryLoadKernelCache(int enable)
+{
+	Memset(failed_disks, 0, sizeof(failed_disks));
+	failed_disk_count = 0;
+	failed_disks_enabled = enable;
+}
+
+/**
+ * Work out the CRC of the disk's GPT header sector.  Returns 0 if successful.
+ */
+static int VbDiskHeaderCrc(const VbDiskInfo *info, uint32_t *crc)
+{
+	uint8_t *buf = VbWorkbufAlloc(info->bytes_per_lba);
+	int rv = 1;
+
+	if (buf && VBERROR_SUCCESS ==
+	    VbExDiskRead(info->handle, 1, 1, buf)) {
+		*crc = Crc32(buf, (uint32_t)info->bytes_per_lba);
+		rv = 0;
+	}
+	VbWorkbufFree(buf);
+	return rv;
+}
+
+static struct VbFailedDisk *VbFindFailedDisk(const VbDiskInfo *info,
+					     uint32_t header_crc)
+{
+	uint32_t i;
+
+	for (i = 0; i < failed_disk_count && i < VB_FAILED_DISKS; i++) {
+		if (failed_disks[i].handle == info->handle &&
+		    failed_disks[i].lba_count == info->lba_count &&
+		    failed_disks[i].header_crc == header_crc)
+			return failed_disks + i;
+	}
+	return NULL;
+}
+
 uint32_t VbTryLoadKernel(VbCommonParams *cparams, LoadKernelParams *p,
                          uint32_t get_info_flags)
 {
 	VbError_t retval = VBERROR_UNKNOWN;
 	VbDiskInfo* disk_info = NULL;
 	uint32_t disk_count = 0;
+	struct VbFailedDisk *failed;
+	uint32_t header_crc = 0;
+	int have_crc;
 	uint32_t i;
 
 	VBDEBUG(("VbTryLoadKernel() start, get_info_flags=0x%x\n",
@@ -92,27 +176,47 @@ uint32_t VbTryLoadKernel(VbCommonParams *cparams, LoadKernelParams *p,
 		return VBERROR_NO_DISK_FOUND;
 	}
 
+#ifdef DISK_READ_ASYNC
+	/*
+	 * Start reading the GPTs of all the disks at once, so a disk that
+	 * turns out to be no good doesn't hold up reading the next one.  The
+	 * disks are still tried in the same order.
+	 */
+	if (disk_count > 1) {
+		for (i = 0; i < disk_count; i++) {
+			GptData gpt;
+
+			if (!VbDiskUsable(&disk_info[i], get_info_flags))
+				continue;
+			Memset(&gpt, 0, sizeof(gpt));
+			gpt.sector_bytes = (uint32_t)disk_info[i].bytes_per_lba;
+			gpt.gpt_drive_sectors = disk_info[i].lba_count;
+			/* As LoadKernel() does; recovery reads both copies */
+			if ((p->boot_flags & BOOT_FLAG_LAZY_SECONDARY_GPT) &&
+			    !(p->boot_flags & BOOT_FLAG_RECOVERY))
+				gpt.flags |= GPT_FLAG_LAZY_SECONDARY;
+			StartReadGptData(disk_info[i].handle, &gpt);
+		}
+	}
+#endif
+
 	/* Loop over disks */
 	for (i = 0; i < disk_count; i++) {
 		VBDEBUG(("VbTryLoadKernel() trying disk %d\n", (int)i));
-		/*
-		 * Sanity-check what we can. FWIW, VbTryLoadKernel() is always
-		 * called with only a single bit set in get_info_flags.
-		 *
-		 * Ensure 512-byte sectors and non-trivially sized disk (for
-		 * cgptlib) and that we got a partition with only the flags we
-		 * asked for.
-		 */
-		if (512 != disk_info[i].bytes_per_lba ||
-		    16 > disk_info[i].lba_count ||
-		    get_info_flags != (disk_info[i].flags & ~VB_DISK_FLAG_EXTERNAL_GPT)) {
-			VBDEBUG(("  skipping: bytes_per_lba=%" PRIu64
-				 " lba_count=%" PRIu64 " flags=0x%x\n",
-				 disk_info[i].bytes_per_lba,
-				 disk_info[i].lba_count,
-				 disk_info[i].flags));
+		if (!VbDiskUsable(&disk_info[i], get_info_flags))
+			continue;
+
+		/* Don't check a disk again if it hasn't changed */
+		have_crc = failed_disks_enabled &&
+			0 == VbDiskHeaderCrc(&disk_info[i], &header_crc);
+		failed = have_crc ?
+			VbFindFailedDisk(&disk_info[i], header_crc) : NULL;
+		if (failed) {
+			VBDEBUG(("  already failed: %d\n", failed->retval));
+			retval = failed->retval;
 			continue;
 		}
+
 		p->disk_handle = disk_info[i].handle;
 		p->bytes_per_lba = disk_info[i].bytes_per_lba;
 		p->gpt_lba_count = disk_info[i].lba_count;
@@ -132,6 +236,16 @@ uint32_t VbTryLoadKernel(VbCommonParams *cparams, LoadKernelParams *p,
 		 */
 		if (VBERROR_SUCCESS == retval)
 			break;
+
+		/* Forget the oldest if there are too many to remember */
+		if (have_crc) {
+			failed = failed_disks +
+				failed_disk_count++ % VB_FAILED_DISKS;
+			failed->handle = disk_info[i].handle;
+			failed->lba_count = disk_info[i].lba_count;
+			failed->header_crc = header_crc;
+			failed->retval = retval;
+		}
 	}
 
 	/* If we didn't find any good kernels, don't return a disk handle. */
@@ -150,6 +264,36 @@ uint32_t VbTryLoadKernel(VbCommonParams *cparams, LoadKernelParams *p,
 }
 
 #define CONFIRM_KEY_DELAY 20  /* Check confirm screen keys every 20ms */
+#define UI_MAX_WAIT 100  /* Check for shutdown requests every 100ms */
+
+/* Cleared if the platform can't wait for keys */
+static int ui_key_wait_supported = 1;
+
+/**
+ * Wait up to [max_ms] for a key, so a screen loop only wakes up when it has
+ * something to do.
+ *
+ * Returns as soon as a key is pressed, if the platform can tell; otherwise
+ * sleeps no more than CONFIRM_KEY_DELAY, so keys are still seen promptly.
+ * Never waits more than UI_MAX_WAIT, so shutdown requests are still noticed.
+ */
+static void VbUiWait(uint32_t max_ms)
+{
+	if (max_ms > UI_MAX_WAIT)
+		max_ms = UI_MAX_WAIT;
+	if (!max_ms)
+		return;
+
+	if (ui_key_wait_supported) {
+		if (VbExKeyboardWait(max_ms) !=
+		    VBERROR_KEYBOARD_WAIT_UNSUPPORTED)
+			return;
+		VBDEBUG(("%s() polling for keys\n", __func__));
+		ui_key_wait_supported = 0;
+	}
+
+	VbExSleepMs(max_ms < CONFIRM_KEY_DELAY ? max_ms : CONFIRM_KEY_DELAY);
+}
 
 int VbUserConfirms(VbCommonParams *cparams, uint32_t confirm_flags)
 {
@@ -210,7 +354,10 @@ int VbUserConfirms(VbCommonParams *cparams, uint32_t confirm_flags)
 			}
 			VbCheckDisplayKey(cparams, key, &vnc);
 		}
-		VbExSleepMs(CONFIRM_KEY_DELAY);
+
+		/* A physical recovery button has to be polled */
+		VbUiWait(shared->flags & VBSD_BOOT_REC_SWITCH_VIRTUAL ?
+			 UI_MAX_WAIT : CONFIRM_KEY_DELAY);
 	}
 
 	/* Not reached, but compiler will complain without it */
@@ -234,6 +381,10 @@ VbError_t VbBootDeveloper(VbCommonParams *cparams, LoadKernelParams *p)
 
 	VBDEBUG(("Entering %s()\n", __func__));
 
+	/* Bad disks stay bad until they change */
+	VbTryLoadKernelCache(1);
+	ui_key_wait_supported = 1;
+
 	/* Check if USB booting is allowed */
 	VbNvGet(&vnc, VBNV_DEV_BOOT_USB, &allow_usb);
 	VbNvGet(&vnc, VBNV_DEV_BOOT_LEGACY, &allow_legacy);
@@ -275,8 +426,6 @@ VbError_t VbBootDeveloper(VbCommonParams *cparams, LoadKernelParams *p)
 				 __func__, shared->flags));
 			if (shared->flags & VBSD_HONOR_VIRT_DEV_SWITCH &&
 			    shared->flags & VBSD_BOOT_DEV_SWITCH_ON) {
-				/* Stop the countdown while we go ask... */
-				VbAudioClose(audio);
 				if (gbb->flags & GBB_FLAG_FORCE_DEV_SWITCH_ON) {
 					/*
 					 * TONORM won't work (only for
@@ -285,12 +434,14 @@ VbError_t VbBootDeveloper(VbCommonParams *cparams, LoadKernelParams *p)
 					VBDEBUG(("%s() - TONORM rejected by "
 						 "FORCE_DEV_SWITCH_ON\n",
 						 __func__));
-					VbExDisplayDebugInfo(
+					VbDisplayDebugText(
 						"WARNING: TONORM prohibited by "
 						"GBB FORCE_DEV_SWITCH_ON.\n\n");
 					VbExBeep(120, 400);
 					break;
 				}
+				/* Stop the countdown while we go ask... */
+				VbAudioClose(audio);
 				VbDisplayScreen(cparams,
 						VB_SCREEN_DEVELOPER_TO_NORM,
 						0, &vnc);
@@ -372,7 +523,7 @@ VbError_t VbBootDeveloper(VbCommonParams *cparams, LoadKernelParams *p)
 			if (!allow_usb) {
 				VBDEBUG(("VbBootDeveloper() - "
 					 "USB booting is disabled\n"));
-				VbExDisplayDebugInfo(
+				VbDisplayDebugText(
 					"WARNING: Booting from external media "
 					"(USB/SD) has not been enabled. Refer "
 					"to the developer-mode documentation "
@@ -420,6 +571,9 @@ VbError_t VbBootDeveloper(VbCommonParams *cparams, LoadKernelParams *p)
 			VbCheckDisplayKey(cparams, key, &vnc);
 			break;
 		}
+
+		/* Sleep until the next note, unless a key comes first */
+		VbUiWait(VbAudioWaitMs(audio));
 	} while(VbAudioLooping(audio));
 
  fallout:
@@ -447,16 +601,62 @@ VbError_t VbBootDeveloper(VbCommonParams *cparams, LoadKernelParams *p)
 #define REC_KEY_DELAY        20       /* Check keys every 20ms */
 #define REC_MEDIA_INIT_DELAY 500      /* Check removable media every 500ms */
 
+/* Cleared once VbExDiskWaitForChange() says it can't tell us anything */
+static int rec_disk_wait_supported;
+
+/**
+ * Wait until it's time to check the keyboard again, REC_KEY_DELAY from now.
+ *
+ * Returns non-zero if it's also time to look at the removable disks again.
+ * That's as soon as a disk comes or goes, if the platform can tell us;
+ * otherwise it's every REC_DISK_DELAY, which [waited] counts towards.
+ * Setting [waited] to REC_DISK_DELAY makes it time either way.
+ */
+static int VbRecoveryWait(uint32_t *waited)
+{
+	if (rec_disk_wait_supported) {
+		switch (VbExDiskWaitForChange(VB_DISK_FLAG_REMOVABLE,
+					      REC_KEY_DELAY)) {
+		case VBERROR_SUCCESS:
+			*waited = 0;
+			return 1;
+		case VBERROR_DISK_NO_CHANGE:
+			if (*waited < REC_DISK_DELAY)
+				return 0;
+			*waited = 0;
+			return 1;
+		default:
+			VBDEBUG(("VbBootRecovery() polling for disks\n"));
+			rec_disk_wait_supported = 0;
+			break;
+		}
+	}
+
+	VbExSleepMs(REC_KEY_DELAY);
+	*waited += REC_KEY_DELAY;
+	if (*waited < REC_DISK_DELAY)
+		return 0;
+	*waited = 0;
+	return 1;
+}
+
 VbError_t VbBootRecovery(VbCommonParams *cparams, LoadKernelParams *p)
 {
 	VbSharedDataHeader *shared =
 		(VbSharedDataHeader *)cparams->shared_data_blob;
 	uint32_t retval;
 	uint32_t key;
-	int i;
+	uint32_t waited = 0;
 
 	VBDEBUG(("VbBootRecovery() start\n"));
 
+	/* Until the platform says otherwise */
+	rec_disk_wait_supported = 1;
+	ui_key_wait_supported = 1;
+
+	/* Bad disks stay bad until they change */
+	VbTryLoadKernelCache(1);
+
 	/*
 	 * If the dev-mode switch is off and the user didn't press the recovery
 	 * button, require removal of all external media.
@@ -475,8 +675,15 @@ VbError_t VbBootRecovery(VbCommonParams *cparams, LoadKernelParams *p)
 			disk_count = 0;
 
 		VbExDiskFreeInfo(disk_info, NULL);
-		if (0 == disk_count)
-			VbExSleepMs(REC_MEDIA_INIT_DELAY);
+		if (0 == disk_count) {
+			retval = VbExDiskWaitForChange(VB_DISK_FLAG_REMOVABLE,
+						       REC_MEDIA_INIT_DELAY);
+			if (VBERROR_SUCCESS != retval &&
+			    VBERROR_DISK_NO_CHANGE != retval) {
+				rec_disk_wait_supported = 0;
+				VbExSleepMs(REC_MEDIA_INIT_DELAY);
+			}
+		}
 
 		while (1) {
 			disk_info = NULL;
@@ -505,17 +712,17 @@ VbError_t VbBootRecovery(VbCommonParams *cparams, LoadKernelParams *p)
 			 * Scan keyboard more frequently than media, since x86
 			 * platforms don't like to scan USB too rapidly.
 			 */
-			for (i = 0; i < REC_DISK_DELAY; i += REC_KEY_DELAY) {
+			do {
 				VbCheckDisplayKey(cparams, VbExKeyboardRead(),
 						  &vnc);
 				if (VbWantShutdown(cparams->gbb->flags))
 					return VBERROR_SHUTDOWN_REQUESTED;
-				VbExSleepMs(REC_KEY_DELAY);
-			}
+			} while (!VbRecoveryWait(&waited));
 		}
 	}
 
 	/* Loop and wait for a recovery image */
+	waited = 0;
 	while (1) {
 		VBDEBUG(("VbBootRecovery() attempting to load kernel2\n"));
 		retval = VbTryLoadKernel(cparams, p, VB_DISK_FLAG_REMOVABLE);
@@ -538,9 +745,11 @@ VbError_t VbBootRecovery(VbCommonParams *cparams, LoadKernelParams *p)
 
 		/*
 		 * Scan keyboard more frequently than media, since x86
-		 * platforms don't like to scan USB too rapidly.
+		 * platforms don't like to scan USB too rapidly.  If nothing
+		 * was found, there's no need to look again until the disks
+		 * change.
 		 */
-		for (i = 0; i < REC_DISK_DELAY; i += REC_KEY_DELAY) {
+		do {
 			key = VbExKeyboardRead();
 			/*
 			 * We might want to enter dev-mode from the Insert
@@ -599,7 +808,7 @@ VbError_t VbBootRecovery(VbCommonParams *cparams, LoadKernelParams *p)
 					 * Jump out of the outer loop to
 					 * refresh the display quickly.
 					 */
-					i = 4;
+					waited = REC_DISK_DELAY;
 					break;
 				}
 			} else {
@@ -607,8 +816,7 @@ VbError_t VbBootRecovery(VbCommonParams *cparams, LoadKernelParams *p)
 			}
 			if (VbWantShutdown(cparams->gbb->flags))
 				return VBERROR_SHUTDOWN_REQUESTED;
-			VbExSleepMs(REC_KEY_DELAY);
-		}
+		} while (!VbRecoveryWait(&waited));
 	}
 
 	return VBERROR_SUCCESS;
@@ -630,7 +838,57 @@ static VbError_t EcProtectRW(int devidx)
 	return rv;
 }
 
-VbError_t VbEcSoftwareSync(int devidx, VbCommonParams *cparams)
+/**
+ * Update EC-RW, a chunk at a time if the EC supports that.
+ *
+ * Chunks which already match the EC flash are skipped, so only the sectors
+ * which changed are rewritten, and an update interrupted partway through picks
+ * up where it left off on the next boot instead of starting over.
+ */
+static VbError_t EcUpdateRW(int devidx, const uint8_t *image, int image_size)
+{
+	uint8_t hash[SHA256_DIGEST_SIZE];
+	const uint8_t *ec_hash;
+	int ec_hash_size;
+	int chunk_size = 0;
+	int offset, size;
+	int written = 0;
+	VbError_t rv;
+
+	rv = VbExEcGetRWChunkSize(devidx, &chunk_size);
+	if (rv != VBERROR_SUCCESS || chunk_size <= 0)
+		return VbExEcUpdateRW(devidx, image, image_size);
+
+	for (offset = 0; offset < image_size; offset += chunk_size) {
+		size = image_size - offset;
+		if (size > chunk_size)
+			size = chunk_size;
+
+		/* If the EC can't hash this chunk, just rewrite it */
+		rv = VbExEcHashRWChunk(devidx, offset, size,
+				       &ec_hash, &ec_hash_size);
+		if (rv == VBERROR_SUCCESS &&
+		    ec_hash_size == SHA256_DIGEST_SIZE) {
+			internal_SHA256(image + offset, size, hash);
+			if (!SafeMemcmp(ec_hash, hash, SHA256_DIGEST_SIZE))
+				continue;
+		}
+
+		rv = VbExEcUpdateRWChunk(devidx, offset, image + offset, size);
+		if (rv != VBERROR_SUCCESS) {
+			VBDEBUG(("EcUpdateRW() - chunk at 0x%x returned %d\n",
+				 offset, rv));
+			return rv;
+		}
+		written++;
+	}
+
+	VBDEBUG(("EcUpdateRW() rewrote %d of %d chunks\n", written,
+		 (image_size + chunk_size - 1) / chunk_size));
+	return VBERROR_SUCCESS;
+}
+
+static VbError_t EcSoftwareSync(int devidx, VbCommonParams *cparams)
 {
 	VbSharedDataHeader *shared =
 		(VbSharedDataHeader *)cparams->shared_data_blob;
@@ -741,6 +999,19 @@ VbError_t VbEcSoftwareSync(int devidx, VbCommonParams *cparams)
 				 VB_SELECT_FIRMWARE_B : VB_SELECT_FIRMWARE_A,
 				 &rw_hash, &rw_hash_size);
 
+	/*
+	 * If the BIOS doesn't have the hash but the firmware preamble did,
+	 * use that instead of hashing the whole image below.
+	 */
+	if (rv == VBERROR_EC_GET_EXPECTED_HASH_FROM_IMAGE && devidx == 0 &&
+	    shared->struct_version >= 3 &&
+	    shared->ec_rw_hash_size == SHA256_DIGEST_SIZE) {
+		VBDEBUG(("VbEcSoftwareSync() - using preamble EC-RW hash\n"));
+		rw_hash = shared->ec_rw_hash;
+		rw_hash_size = shared->ec_rw_hash_size;
+		rv = VBERROR_SUCCESS;
+	}
+
 	if (rv == VBERROR_EC_GET_EXPECTED_HASH_FROM_IMAGE) {
 		/*
 		 * BIOS has verified EC image but doesn't have a precomputed
@@ -867,11 +1138,11 @@ VbError_t VbEcSoftwareSync(int devidx, VbCommonParams *cparams)
 			VbDisplayScreen(cparams, VB_SCREEN_WAIT, 0, &vnc);
 		}
 
-		rv = VbExEcUpdateRW(devidx, expected, expected_size);
+		rv = EcUpdateRW(devidx, expected, expected_size);
 
 		if (rv != VBERROR_SUCCESS) {
 			VBDEBUG(("VbEcSoftwareSync() - "
-				 "VbExEcUpdateRW() returned %d\n", rv));
+				 "EcUpdateRW() returned %d\n", rv));
 
 			/*
 			 * The EC may know it needs a reboot.  It may need to
@@ -950,18 +1221,104 @@ VbError_t VbEcSoftwareSync(int devidx, VbCommonParams *cparams)
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbEcSoftwareSyncStart(int devidx, VbCommonParams *cparams)
+{
+	VbError_t rv = VbExEcHashRWStart(devidx);
+
+	if (rv != VBERROR_SUCCESS)
+		VBDEBUG(("VbExEcHashRWStart(%d) returned 0x%x\n",
+			 devidx, (int)rv));
+	return rv;
+}
+
+VbError_t VbEcSoftwareSync(int devidx, VbCommonParams *cparams)
+{
+	VbSharedDataHeader *shared =
+		(VbSharedDataHeader *)cparams->shared_data_blob;
+	VbError_t rv;
+
+	VbSharedDataRecordTimestamp(shared, VBSD_TS_EC_SOFTWARE_SYNC_ENTER);
+	rv = EcSoftwareSync(devidx, cparams);
+	VbSharedDataRecordTimestamp(shared, VBSD_TS_EC_SOFTWARE_SYNC_EXIT);
+	return rv;
+}
+
 /* This function is also used by tests */
 void VbApiKernelFree(VbCommonParams *cparams)
 {
 	/* VbSelectAndLoadKernel() always allocates this, tests don't */
 	if (cparams->gbb) {
-		VbExFree(cparams->gbb);
+		VbWorkbufFree(cparams->gbb);
 		cparams->gbb = NULL;
 	}
 	if (cparams->bmp) {
 		VbExFree(cparams->bmp);
 		cparams->bmp = NULL;
 	}
+	if (cparams->layouts) {
+		VbExFree(cparams->layouts);
+		cparams->layouts = NULL;
+	}
+	if (cparams->debug_info) {
+		VbExFree(cparams->debug_info);
+		cparams->debug_info = NULL;
+	}
+	if (cparams->recovery_key) {
+		VbExFree(cparams->recovery_key);
+		cparams->recovery_key = NULL;
+	}
+	VbGbbFreeImageCache(cparams);
+}
+
+/**
+ * Start software sync for the EC, and the PD if it's synced too.  Returns
+ * non-zero if the EC can't hash in the background, so sync should be finished
+ * right away.
+ */
+static VbError_t EcSyncStart(VbCommonParams *cparams)
+{
+	VbError_t rv = VbEcSoftwareSyncStart(0, cparams);
+
+#ifdef PD_SYNC
+	/* The PD sync just waits for its hash if it can't hash in parallel */
+	if (rv == VBERROR_SUCCESS &&
+	    !(cparams->gbb->flags & GBB_FLAG_DISABLE_PD_SOFTWARE_SYNC))
+		VbEcSoftwareSyncStart(1, cparams);
+#endif
+
+	return rv;
+}
+
+/**
+ * Finish software sync for the EC, and the PD if it's synced too.
+ */
+static VbError_t EcSyncFinish(VbCommonParams *cparams)
+{
+	int oprom_mismatch = 0;
+	VbError_t retval;
+
+	retval = VbEcSoftwareSync(0, cparams);
+	/* Save reboot requested until after possible PD sync */
+	if (retval == VBERROR_VGA_OPROM_MISMATCH)
+		oprom_mismatch = 1;
+	else if (retval != VBERROR_SUCCESS)
+		return retval;
+
+#ifdef PD_SYNC
+	if (!(cparams->gbb->flags & GBB_FLAG_DISABLE_PD_SOFTWARE_SYNC)) {
+		retval = VbEcSoftwareSync(1, cparams);
+		if (retval == VBERROR_VGA_OPROM_MISMATCH)
+			oprom_mismatch = 1;
+		else if (retval != VBERROR_SUCCESS)
+			return retval;
+	}
+#endif
+
+	/* Request reboot to unload VGA Option ROM */
+	if (oprom_mismatch)
+		return VBERROR_VGA_OPROM_MISMATCH;
+
+	return VBERROR_SUCCESS;
 }
 
 VbError_t VbSelectAndLoadKernel(VbCommonParams *cparams,
@@ -972,12 +1329,12 @@ VbError_t VbSelectAndLoadKernel(VbCommonParams *cparams,
 	VbError_t retval = VBERROR_SUCCESS;
 	LoadKernelParams p;
 	uint32_t tpm_status = 0;
+	int ec_sync_pending = 0;
 
 	/* Start timer */
 	shared->timer_vb_select_and_load_kernel_enter = VbExGetTimer();
 
-	VbExNvStorageRead(vnc.raw);
-	VbNvSetup(&vnc);
+	VbNvLoad(cparams, &vnc);
 
 	/* Clear output params in case we fail */
 	kparams->disk_handle = NULL;
@@ -985,10 +1342,18 @@ VbError_t VbSelectAndLoadKernel(VbCommonParams *cparams,
 	kparams->bootloader_address = 0;
 	kparams->bootloader_size = 0;
 	kparams->flags = 0;
+	kparams->bootloader_offset = (uint64_t)-1;
+	kparams->vmlinuz_header_offset = 0;
+	kparams->vmlinuz_header_size = 0;
 	Memset(kparams->partition_guid, 0, sizeof(kparams->partition_guid));
 
 	cparams->bmp = NULL;
-	cparams->gbb = VbExMalloc(sizeof(*cparams->gbb));
+	cparams->layouts = NULL;
+	cparams->image_cache = NULL;
+	cparams->image_cache_used = 0;
+	cparams->recovery_key = NULL;
+	VbWorkbufInit(cparams->workbuf, cparams->workbuf_size);
+	cparams->gbb = VbWorkbufAlloc(sizeof(*cparams->gbb));
 	retval = VbGbbReadHeader_static(cparams, cparams->gbb);
 	if (VBERROR_SUCCESS != retval)
 		goto VbSelectAndLoadKernel_exit;
@@ -996,31 +1361,22 @@ VbError_t VbSelectAndLoadKernel(VbCommonParams *cparams,
 	/* Do EC software sync if necessary */
 	if ((shared->flags & VBSD_EC_SOFTWARE_SYNC) &&
 	    !(cparams->gbb->flags & GBB_FLAG_DISABLE_EC_SOFTWARE_SYNC)) {
-		int oprom_mismatch = 0;
-
-		retval = VbEcSoftwareSync(0, cparams);
-		/* Save reboot requested until after possible PD sync */
-		if (retval == VBERROR_VGA_OPROM_MISMATCH)
-			oprom_mismatch = 1;
-		else if (retval != VBERROR_SUCCESS)
-			goto VbSelectAndLoadKernel_exit;
-
-#ifdef PD_SYNC
-		if (!(cparams->gbb->flags &
-		      GBB_FLAG_DISABLE_PD_SOFTWARE_SYNC)) {
-			retval = VbEcSoftwareSync(1, cparams);
-			if (retval == VBERROR_VGA_OPROM_MISMATCH)
-				oprom_mismatch = 1;
-			else if (retval != VBERROR_SUCCESS)
+		/*
+		 * On a normal boot, let the EC hash its RW image while we look
+		 * for a kernel, and finish the sync once we've found one.
+		 * Recovery, developer and RO-normal boots don't gain from it,
+		 * and may show screens which should see the EC already synced.
+		 */
+		if (!shared->recovery_reason &&
+		    !(shared->flags & (VBSD_BOOT_DEV_SWITCH_ON |
+				       VBSD_LF_USE_RO_NORMAL)) &&
+		    EcSyncStart(cparams) == VBERROR_SUCCESS) {
+			ec_sync_pending = 1;
+		} else {
+			retval = EcSyncFinish(cparams);
+			if (retval != VBERROR_SUCCESS)
 				goto VbSelectAndLoadKernel_exit;
 		}
-#endif
-
-		/* Request reboot to unload VGA Option ROM */
-		if (oprom_mismatch) {
-			retval = VBERROR_VGA_OPROM_MISMATCH;
-			goto VbSelectAndLoadKernel_exit;
-		}
 	}
 
 	/* Read kernel version from the TPM.  Ignore errors in recovery mode. */
@@ -1053,6 +1409,14 @@ VbError_t VbSelectAndLoadKernel(VbCommonParams *cparams,
 	p.boot_flags = 0;
 	if (shared->flags & VBSD_BOOT_DEV_SWITCH_ON)
 		p.boot_flags |= BOOT_FLAG_DEVELOPER;
+	if (shared->flags & VBSD_PARTIAL_KERNEL_CHECK)
+		p.boot_flags |= BOOT_FLAG_PARTIAL_BODY_CHECK;
+	if (shared->flags & VBSD_LAZY_SECONDARY_GPT)
+		p.boot_flags |= BOOT_FLAG_LAZY_SECONDARY_GPT;
+	if (shared->flags & VBSD_LAZY_SECONDARY_GPT_WRITE)
+		p.boot_flags |= BOOT_FLAG_LAZY_SECONDARY_GPT_WRITE;
+	if (shared->flags & VBSD_DEV_KEY_BLOCK_HASH_FIRST)
+		p.boot_flags |= BOOT_FLAG_DEV_KEY_BLOCK_HASH_FIRST;
 
 	/* Handle separate normal and developer firmware builds. */
 #if defined(VBOOT_FIRMWARE_TYPE_NORMAL)
@@ -1093,9 +1457,23 @@ VbError_t VbSelectAndLoadKernel(VbCommonParams *cparams,
 
 	} else {
 		/* Normal boot */
-		VbExEcEnteringMode(0, VB_EC_NORMAL);
+		if (!ec_sync_pending)
+			VbExEcEnteringMode(0, VB_EC_NORMAL);
 		retval = VbBootNormal(cparams, &p);
 
+		/*
+		 * Meet up with the EC before touching the TPM.  If there's no
+		 * kernel, leave the EC in RO for whatever boot comes next.
+		 */
+		if (ec_sync_pending) {
+			if (retval == VBERROR_SUCCESS) {
+				retval = EcSyncFinish(cparams);
+				if (retval != VBERROR_SUCCESS)
+					goto VbSelectAndLoadKernel_exit;
+			}
+			VbExEcEnteringMode(0, VB_EC_NORMAL);
+		}
+
 		if ((1 == shared->firmware_index) &&
 		    (shared->flags & VBSD_FWB_TRIED)) {
 			/*
@@ -1154,6 +1532,9 @@ VbError_t VbSelectAndLoadKernel(VbCommonParams *cparams,
 	kparams->bootloader_address = p.bootloader_address;
 	kparams->bootloader_size = (uint32_t)p.bootloader_size;
 	kparams->flags = p.flags;
+	kparams->bootloader_offset = p.bootloader_offset;
+	kparams->vmlinuz_header_offset = p.vmlinuz_header_offset;
+	kparams->vmlinuz_header_size = p.vmlinuz_header_size;
 	Memcpy(kparams->partition_guid, p.partition_guid,
 	       sizeof(kparams->partition_guid));
 
@@ -1170,14 +1551,17 @@ VbError_t VbSelectAndLoadKernel(VbCommonParams *cparams,
 
  VbSelectAndLoadKernel_exit:
 
+	VbTryLoadKernelCache(0);
 	VbApiKernelFree(cparams);
 
-	VbNvTeardown(&vnc);
-	if (vnc.raw_changed)
-		VbExNvStorageWrite(vnc.raw);
+	VBDEBUG(("Work buffer peak use %d bytes\n", (int)VbWorkbufPeak()));
+	VbWorkbufInit(NULL, 0);
+
+	VbNvSave(cparams, &vnc);
 
 	/* Stop timer */
 	shared->timer_vb_select_and_load_kernel_exit = VbExGetTimer();
+	VbSharedDataFlushCryptoStats(shared);
 
 	kparams->kernel_buffer = p.kernel_buffer;
 	kparams->kernel_buffer_size = p.kernel_buffer_size;
@@ -1187,3 +1571,20 @@ VbError_t VbSelectAndLoadKernel(VbCommonParams *cparams,
 	/* Pass through return value from boot path */
 	return retval;
 }
+
+VbError_t VbSharedDataEncode(VbCommonParams *cparams, void *buf,
+                             uint32_t *size)
+{
+	VbSharedDataHeader *shared =
+		(VbSharedDataHeader *)cparams->shared_data_blob;
+
+	if (!shared || cparams->shared_data_size < sizeof(*shared) ||
+	    !buf || !size)
+		return VBERROR_INVALID_PARAMETER;
+
+	if (VbSharedDataCompact(shared, buf, size)) {
+		VBDEBUG(("Unable to encode shared data\n"));
+		return VBERROR_INVALID_PARAMETER;
+	}
+	return VBERROR_SUCCESS;
+}
@@ -212,6 +212,7 @@ VbAudioContext *VbAudioOpen(VbCommonParams *cparams)
 	VbAudioContext *audio = &au;
 	int use_short = 0;
 	uint64_t a, b;
+	uint32_t i;
 
 	/* Note: may need to allocate things here in future */
 
@@ -247,11 +248,33 @@ VbAudioContext *VbAudioOpen(VbCommonParams *cparams)
 	VbGetDevMusicNotes(audio, use_short);
 	VBDEBUG(("VbAudioOpen() - note count %d\n", audio->note_count));
 
+	/*
+	 * Work out when each note ends, so looping only has to compare.
+	 * Start the clock again, since a tune from flash may take a while to
+	 * check.
+	 */
+	b = VbExGetTimer();
+	audio->play_until = b;
+	audio->note_ends = VbExMalloc(audio->note_count * sizeof(uint64_t));
+	for (i = 0; i < audio->note_count; i++) {
+		b += VbMsecToTicks(audio->music_notes[i].msec);
+		audio->note_ends[i] = b;
+	}
+
+	/* If the platform can play the whole tune itself, let it */
+	if (audio->background_beep &&
+	    VBERROR_SUCCESS == VbExBeepNotes(audio->music_notes,
+					     audio->note_count)) {
+		VBDEBUG(("VbAudioOpen() - VbExBeepNotes() is playing\n"));
+		audio->playing_notes = 1;
+	}
+
 	return audio;
 }
 
 /**
- * Caller should loop without extra delay until this returns false.
+ * Caller should loop until this returns false, waiting no longer than
+ * VbAudioWaitMs() between calls.
  */
 int VbAudioLooping(VbAudioContext *audio)
 {
@@ -265,7 +288,7 @@ int VbAudioLooping(VbAudioContext *audio)
 	       now >= audio->play_until) {
 		freq = audio->music_notes[audio->next_note].frequency;
 		msec = audio->music_notes[audio->next_note].msec;
-		audio->play_until += VbMsecToTicks(msec);
+		audio->play_until = audio->note_ends[audio->next_note];
 		audio->next_note++;
 	}
 
@@ -275,7 +298,9 @@ int VbAudioLooping(VbAudioContext *audio)
 	}
 
 	/* Do action here. */
-	if (audio->background_beep) {
+	if (audio->playing_notes) {
+		/* The platform's playing them already */
+	} else if (audio->background_beep) {
 		if (audio->current_frequency != freq) {
 			VbExBeep(0, freq);
 			audio->current_frequency = freq;
@@ -289,12 +314,30 @@ int VbAudioLooping(VbAudioContext *audio)
 	return looping;
 }
 
+/**
+ * How long until the next note starts, or the delay ends.
+ */
+uint32_t VbAudioWaitMs(VbAudioContext *audio)
+{
+	uint64_t now = VbExGetTimer();
+	uint64_t msec;
+
+	/* With an uncalibrated timer, there's no telling; don't wait */
+	if (!ticks_per_msec || now >= audio->play_until)
+		return 0;
+
+	msec = (audio->play_until - now) / ticks_per_msec;
+	return msec > UINT_MAX ? UINT_MAX : (uint32_t)msec;
+}
+
 /**
  * Caller should call this prior to booting.
  */
 void VbAudioClose(VbAudioContext *audio)
 {
 	VbExBeep(0,0);
+	VbExFree(audio->note_ends);
+	audio->note_ends = NULL;
 	if (audio->free_notes_when_done)
 		VbExFree(audio->music_notes);
 }
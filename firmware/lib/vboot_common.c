@@ -8,9 +8,12 @@
 
 #include "sysincludes.h"
 
+#include "2sysincludes.h"
+#include "2common.h"
 #include "vboot_api.h"
 #include "vboot_common.h"
 #include "utility.h"
+#include "vboot_workbuf.h"
 
 const char *kVbootErrors[VBOOT_ERROR_MAX] = {
 	"Success.",
@@ -20,7 +23,11 @@ const char *kVbootErrors[VBOOT_ERROR_MAX] = {
 	"Public key invalid.",
 	"Preamble invalid.",
 	"Preamble signature check failed.",
-	"Shared data invalid."
+	"Shared data invalid.",
+	"Kernel preamble has no flags.",
+	"Kernel preamble has no body block hashes.",
+	"Key block flags mismatch.",
+	"Key block version rejected."
 };
 
 uint64_t OffsetOf(const void *base, const void *ptr)
@@ -143,6 +150,113 @@ RSAPublicKey *PublicKeyToRSA(const VbPublicKey *key)
 	return rsa;
 }
 
+int PublicKeyToRSAInPlace(const VbPublicKey *key, RSAPublicKey *rsa)
+{
+	const uint8_t *data = GetPublicKeyDataC(key);
+	uint32_t *words = (uint32_t *)data;
+	uint64_t key_size;
+
+	if (kNumAlgorithms <= key->algorithm ||
+	    !RSAProcessedKeySize(key->algorithm, &key_size) ||
+	    key_size != key->key_size) {
+		VBDEBUG(("Wrong key size for algorithm\n"));
+		return 1;
+	}
+	if ((uintptr_t)data & (sizeof(uint32_t) - 1)) {
+		VBDEBUG(("Key data not aligned\n"));
+		return 1;
+	}
+
+	/* The key data is len, n0inv, n[len], rr[len] */
+	if ((2 * (uint64_t)words[0] + 2) * sizeof(uint32_t) != key_size) {
+		VBDEBUG(("Wrong key length for algorithm\n"));
+		return 1;
+	}
+	rsa->len = words[0];
+	rsa->n0inv = words[1];
+	rsa->n = words + 2;
+	rsa->rr = rsa->n + rsa->len;
+	rsa->algorithm = (unsigned int)key->algorithm;
+	return 0;
+}
+
+/* Return non-zero if [rsa] was converted from [key]. */
+static int RSAKeyMatches(const RSAPublicKey *rsa, const VbPublicKey *key)
+{
+	const uint8_t *data = GetPublicKeyDataC(key);
+	uint64_t bytes = (uint64_t)rsa->len * sizeof(uint32_t);
+	uint32_t head[2];
+
+	if (rsa->algorithm != key->algorithm ||
+	    key->key_size != sizeof(head) + 2 * bytes)
+		return 0;
+
+	/* Converted in place from this very key; nothing to compare */
+	if ((const uint8_t *)rsa->n == data + sizeof(head))
+		return 1;
+
+	/* The key data is len, n0inv, n[len], rr[len] */
+	Memcpy(head, data, sizeof(head));
+	return head[0] == rsa->len && head[1] == rsa->n0inv &&
+		!Memcmp(data + sizeof(head), rsa->n, bytes) &&
+		!Memcmp(data + sizeof(head) + bytes, rsa->rr, bytes);
+}
+
+RSAPublicKey *PublicKeyCacheGet(PublicKeyCache *cache, const VbPublicKey *key)
+{
+	RSAPublicKey *rsa;
+	int i;
+
+	if (cache) {
+		for (i = 0; i < cache->count; i++) {
+			if (RSAKeyMatches(cache->keys[i], key))
+				return cache->keys[i];
+		}
+	}
+
+	rsa = PublicKeyToRSA(key);
+
+	/* If the cache is full, the caller gets a key of its own */
+	if (rsa && cache && cache->count < PUBLIC_KEY_CACHE_SIZE)
+		cache->keys[cache->count++] = rsa;
+
+	return rsa;
+}
+
+void PublicKeyCacheRelease(PublicKeyCache *cache, RSAPublicKey *rsa)
+{
+	int i;
+
+	if (cache) {
+		for (i = 0; i < cache->count; i++) {
+			if (cache->keys[i] == rsa)
+				return;
+		}
+	}
+
+	RSAPublicKeyFree(rsa);
+}
+
+void PublicKeyCacheLend(PublicKeyCache *cache, RSAPublicKey *rsa)
+{
+	if (cache->count != cache->lent ||
+	    cache->count >= PUBLIC_KEY_CACHE_SIZE)
+		return;
+
+	cache->keys[cache->count++] = rsa;
+	cache->lent++;
+}
+
+void PublicKeyCacheFree(PublicKeyCache *cache)
+{
+	int i;
+
+	for (i = cache->lent; i < cache->count; i++)
+		RSAPublicKeyFree(cache->keys[i]);
+	cache->count = 0;
+	cache->lent = 0;
+}
+
 int VerifyData(const uint8_t *data, uint64_t size, const VbSignature *sig,
                const RSAPublicKey *key)
 {
@@ -186,6 +300,35 @@ int VerifyDigest(const uint8_t *digest, const VbSignature *sig,
 
 int KeyBlockVerify(const VbKeyBlockHeader *block, uint64_t size,
                    const VbPublicKey *key, int hash_only)
+{
+	return KeyBlockVerifyCached(block, size, key, hash_only, NULL);
+}
+
+int KeyBlockPreVerify(const VbKeyBlockHeader *block, uint64_t size,
+		      uint64_t flags, uint64_t min_key_version)
+{
+	if (size < sizeof(VbKeyBlockHeader)) {
+		VBDEBUG(("Not enough space for key block header.\n"));
+		return VBOOT_KEY_BLOCK_INVALID;
+	}
+	if ((block->key_block_flags & flags) != flags) {
+		VBDEBUG(("Key block flags mismatch.\n"));
+		return VBOOT_KEY_BLOCK_FLAGS;
+	}
+
+	/* Key version is stored in 16 bits in the TPM */
+	if (block->data_key.key_version < min_key_version ||
+	    block->data_key.key_version > 0xFFFF) {
+		VBDEBUG(("Key block version rejected.\n"));
+		return VBOOT_KEY_BLOCK_VERSION;
+	}
+
+	return VBOOT_SUCCESS;
+}
+
+int KeyBlockVerifyCached(const VbKeyBlockHeader *block, uint64_t size,
+			 const VbPublicKey *key, int hash_only,
+			 PublicKeyCache *cache)
 {
 	const VbSignature *sig;
 
@@ -219,7 +362,7 @@ int KeyBlockVerify(const VbKeyBlockHeader *block, uint64_t size,
 	 */
 	if (hash_only) {
 		/* Check hash */
-		uint8_t *header_checksum = NULL;
+		uint8_t header_checksum[SHA512_DIGEST_SIZE];
 		int rv;
 
 		sig = &block->key_block_checksum;
@@ -240,12 +383,14 @@ int KeyBlockVerify(const VbKeyBlockHeader *block, uint64_t size,
 		}
 
 		VBDEBUG(("Checking key block hash only...\n"));
-		header_checksum = DigestBuf((const uint8_t *)block,
-					    sig->data_size,
-					    SHA512_DIGEST_ALGORITHM);
+		if (DigestBufInto((const uint8_t *)block, sig->data_size,
+				  SHA512_DIGEST_ALGORITHM, header_checksum,
+				  sizeof(header_checksum))) {
+			VBDEBUG(("SHA-512 not supported.\n"));
+			return VBOOT_KEY_BLOCK_HASH;
+		}
 		rv = SafeMemcmp(header_checksum, GetSignatureDataC(sig),
 				SHA512_DIGEST_SIZE);
-		VbExFree(header_checksum);
 		if (rv) {
 			VBDEBUG(("Invalid key block hash.\n"));
 			return VBOOT_KEY_BLOCK_HASH;
@@ -262,7 +407,7 @@ int KeyBlockVerify(const VbKeyBlockHeader *block, uint64_t size,
 			return VBOOT_KEY_BLOCK_INVALID;
 		}
 
-		rsa = PublicKeyToRSA(key);
+		rsa = PublicKeyCacheGet(cache, key);
 		if (!rsa) {
 			VBDEBUG(("Invalid public key\n"));
 			return VBOOT_PUBLIC_KEY_INVALID;
@@ -271,13 +416,13 @@ int KeyBlockVerify(const VbKeyBlockHeader *block, uint64_t size,
 		/* Make sure advertised signature data sizes are sane. */
 		if (block->key_block_size < sig->data_size) {
 			VBDEBUG(("Signature calculated past end of block\n"));
-			RSAPublicKeyFree(rsa);
+			PublicKeyCacheRelease(cache, rsa);
 			return VBOOT_KEY_BLOCK_INVALID;
 		}
 
 		VBDEBUG(("Checking key block signature...\n"));
 		rv = VerifyData((const uint8_t *)block, size, sig, rsa);
-		RSAPublicKeyFree(rsa);
+		PublicKeyCacheRelease(cache, rsa);
 		if (rv) {
 			VBDEBUG(("Invalid key block signature.\n"));
 			return VBOOT_KEY_BLOCK_SIGNATURE;
@@ -374,6 +519,20 @@ int VerifyFirmwarePreamble(const VbFirmwarePreambleHeader *preamble,
 		}
 	}
 
+	/* Likewise for 2.2, and check the EC-RW hash is signed */
+	if (preamble->header_version_minor >= 2) {
+		if(size < EXPECTED_VBFIRMWAREPREAMBLEHEADER2_2_SIZE) {
+			VBDEBUG(("Not enough data for preamble header 2.2.\n"));
+			return VBOOT_PREAMBLE_INVALID;
+		}
+		if (preamble->ec_rw_hash.sig_size &&
+		    VerifySignatureInside(preamble, sig->data_size,
+					  &preamble->ec_rw_hash)) {
+			VBDEBUG(("EC-RW hash off end of preamble\n"));
+			return VBOOT_PREAMBLE_INVALID;
+		}
+	}
+
 	/* Success */
 	return VBOOT_SUCCESS;
 }
@@ -392,6 +551,16 @@ uint32_t VbGetFirmwarePreambleFlags(const VbFirmwarePreambleHeader *preamble)
 	return preamble->flags;
 }
 
+const uint8_t *VbGetFirmwarePreambleEcRwHash(
+		const VbFirmwarePreambleHeader *preamble)
+{
+	if (preamble->header_version_minor < 2 ||
+	    preamble->ec_rw_hash.sig_size != SHA256_DIGEST_SIZE)
+		return NULL;
+
+	return GetSignatureDataC(&preamble->ec_rw_hash);
+}
+
 int VerifyKernelPreamble(const VbKernelPreambleHeader *preamble,
                          uint64_t size, const RSAPublicKey *key)
 {
@@ -451,6 +620,62 @@ int VerifyKernelPreamble(const VbKernelPreambleHeader *preamble,
 			VBDEBUG(("Not enough data for preamble header 2.2.\n"));
 			return VBOOT_PREAMBLE_INVALID;
 		}
+
+		if((preamble->header_version_minor == 3) &&
+		   (size < EXPECTED_VBKERNELPREAMBLEHEADER2_3_SIZE)) {
+			VBDEBUG(("Not enough data for preamble header 2.3.\n"));
+			return VBOOT_PREAMBLE_INVALID;
+		}
+
+		if((preamble->header_version_minor >= 4) &&
+		   (size < EXPECTED_VBKERNELPREAMBLEHEADER2_4_SIZE)) {
+			VBDEBUG(("Not enough data for preamble header 2.4.\n"));
+			return VBOOT_PREAMBLE_INVALID;
+		}
+	}
+
+	/*
+	 * A compressed body must be in a form the firmware can decompress, and
+	 * can't also be hashed in blocks.
+	 */
+	if (preamble->header_version_minor >= 4 &&
+	    preamble->body_compression != COMPRESS_NONE) {
+		if (preamble->body_compression >= MAX_COMPRESS ||
+		    preamble->body_compression == COMPRESS_RLE ||
+		    !preamble->body_load_size ||
+		    preamble->body_hash_count) {
+			VBDEBUG(("Bad kernel body compression\n"));
+			return VBOOT_PREAMBLE_INVALID;
+		}
+	}
+
+	/*
+	 * If the body is hashed in blocks, verify there's one hash per block
+	 * and the hashes are inside the signed data.
+	 */
+	if (VbKernelHasBodyHashes(preamble) == VBOOT_SUCCESS) {
+		uint64_t body_size = preamble->body_signature.data_size;
+		uint64_t block_size = preamble->body_hash_block_size;
+		uint64_t hash_size = hash_size_map[key->algorithm];
+
+		if (!block_size || preamble->body_hash_count !=
+		    body_size / block_size + (body_size % block_size ? 1 : 0)) {
+			VBDEBUG(("Wrong number of kernel body block hashes\n"));
+			return VBOOT_PREAMBLE_INVALID;
+		}
+		if (preamble->body_hash_offset > sig->data_size ||
+		    preamble->body_hash_count * hash_size >
+		    sig->data_size - preamble->body_hash_offset) {
+			VBDEBUG(("Kernel body block hashes off end of "
+				 "signed data\n"));
+			return VBOOT_PREAMBLE_INVALID;
+		}
+		if (preamble->body_hash_head_size > body_size ||
+		    preamble->body_hash_tail_offset > body_size) {
+			VBDEBUG(("Kernel body blocks to check off end of "
+				 "body\n"));
+			return VBOOT_PREAMBLE_INVALID;
+		}
 	}
 
 	/* Success */
@@ -484,6 +709,74 @@ int VbKernelHasFlags(const VbKernelPreambleHeader *preamble)
 	return VBOOT_KERNEL_PREAMBLE_NO_FLAGS;
 }
 
+int VbKernelHasBodyHashes(const VbKernelPreambleHeader *preamble)
+{
+	if (preamble->header_version_minor > 2 && preamble->body_hash_count)
+		return VBOOT_SUCCESS;
+
+	return VBOOT_KERNEL_PREAMBLE_NO_BODY_HASHES;
+}
+
+int VbGetKernelBodyCompression(const VbKernelPreambleHeader *preamble,
+			       uint32_t *compression, uint64_t *load_size)
+{
+	if (preamble->header_version_minor > 3 &&
+	    preamble->body_compression != COMPRESS_NONE) {
+		*compression = preamble->body_compression;
+		*load_size = preamble->body_load_size;
+	} else {
+		*compression = COMPRESS_NONE;
+		*load_size = preamble->body_signature.data_size;
+	}
+
+	return VBOOT_SUCCESS;
+}
+
+int VerifyKernelBodyBlocks(const VbKernelPreambleHeader *preamble,
+			   const uint8_t *body, uint64_t offset,
+			   uint64_t size, const RSAPublicKey *key)
+{
+	uint64_t body_size = preamble->body_signature.data_size;
+	uint64_t block_size = preamble->body_hash_block_size;
+	int hash_size = hash_size_map[key->algorithm];
+	const uint8_t *hashes;
+	uint64_t block, last;
+
+	if (VbKernelHasBodyHashes(preamble) != VBOOT_SUCCESS) {
+		VBDEBUG(("Kernel preamble has no body block hashes.\n"));
+		return 1;
+	}
+	if (offset > body_size || size > body_size - offset) {
+		VBDEBUG(("Kernel body blocks off end of body.\n"));
+		return 1;
+	}
+	if (!size)
+		return 0;
+
+	hashes = (const uint8_t *)preamble + preamble->body_hash_offset;
+	last = (offset + size - 1) / block_size;
+	for (block = offset / block_size; block <= last; block++) {
+		uint64_t start = block * block_size;
+		uint64_t len = body_size - start;
+		uint8_t digest[MAX_DIGEST_SIZE];
+
+		if (len > block_size)
+			len = block_size;
+
+		if (DigestBufInto(body + start, len, key->algorithm, digest,
+				  sizeof(digest)))
+			return 1;
+		if (SafeMemcmp(digest, hashes + block * hash_size,
+			       hash_size)) {
+			VBDEBUG(("Kernel body block %d hash mismatch.\n",
+				 (int)block));
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 int VerifyVmlinuzInsideKBlob(uint64_t kblob, uint64_t kblob_size,
 			     uint64_t header, uint64_t header_size)
 {
@@ -512,6 +805,50 @@ uint64_t VbSharedDataReserve(VbSharedDataHeader *header, uint64_t size)
 	return offs;
 }
 
+void VbSharedDataRecordTimestamp(VbSharedDataHeader *header, uint32_t id)
+{
+	VbSharedDataTimestamp *ts;
+
+	/* Older read-only firmware may have set up a struct without them */
+	if (!header || header->struct_version < 3)
+		return;
+
+	ts = header->timestamps +
+		(header->timestamp_count++ & (VBSD_MAX_TIMESTAMPS - 1));
+	ts->time = VbExGetTimer();
+	ts->id = id;
+}
+
+void VbSharedDataFlushCryptoStats(VbSharedDataHeader *header)
+{
+	/* Version 3 structs from older firmware, or short ones, end before */
+	if (!header || header->struct_version < 3 ||
+	    header->struct_size < sizeof(*header))
+		return;
+
+	vb2_crypto_stats_flush((struct vb2_crypto_stats *)
+			       &header->crypto_stats);
+}
+
+int VbSharedDataQueueMeasurement(VbSharedDataHeader *header, uint32_t event,
+				 uint32_t pcr, const uint8_t *digest)
+{
+	VbSharedDataMeasurement *m;
+
+	if (!header || header->struct_version < 3)
+		return VBOOT_SHARED_DATA_INVALID;
+	if (header->measurement_count >= VBSD_MAX_MEASUREMENTS) {
+		VBDEBUG(("Measurement log full.\n"));
+		return VBOOT_SHARED_DATA_INVALID;
+	}
+
+	m = header->measurements + header->measurement_count++;
+	Memcpy(m->digest, digest, sizeof(m->digest));
+	m->pcr = (uint8_t)pcr;
+	m->event = (uint8_t)event;
+	return VBOOT_SUCCESS;
+}
+
 int VbSharedDataSetKernelKey(VbSharedDataHeader *header, const VbPublicKey *src)
 {
 	VbPublicKey *kdest;
@@ -542,3 +879,151 @@ int VbSharedDataSetKernelKey(VbSharedDataHeader *header, const VbPublicKey *src)
 
 	return PublicKeyCopy(kdest, src);
 }
+
+/* The encoding VbSharedDataCompact() is building */
+struct compact_state {
+	const VbSharedDataHeader *header;
+	uint8_t *buf;
+	uint32_t buf_size;
+	uint32_t used;
+	uint16_t count;
+};
+
+/* Adds a record, or just counts its size if it doesn't fit */
+static void AddRecord(struct compact_state *st, uint16_t tag,
+		      const void *prefix, uint32_t prefix_size,
+		      const void *data, uint32_t size)
+{
+	VbSharedDataRecord rec;
+	uint32_t rec_size = sizeof(rec) + ((prefix_size + size + 3) & ~3);
+	uint8_t *p = st->buf + st->used;
+
+	if (st->used + rec_size <= st->buf_size) {
+		rec.tag = tag;
+		rec.size = prefix_size + size;
+		Memset(p, 0, rec_size);
+		Memcpy(p, &rec, sizeof(rec));
+		if (prefix_size)
+			Memcpy(p + sizeof(rec), prefix, prefix_size);
+		Memcpy(p + sizeof(rec) + prefix_size, data, size);
+	}
+	st->used += rec_size;
+	st->count++;
+}
+
+/* Adds the header from [start] to [end], as much of it as the struct has */
+static void AddSpan(struct compact_state *st, const void *start,
+		    const void *end)
+{
+	uint32_t offset = (const uint8_t *)start - (const uint8_t *)st->header;
+	uint32_t limit = (uint32_t)st->header->struct_size;
+	uint32_t size = (const uint8_t *)end - (const uint8_t *)start;
+
+	if (offset >= limit)
+		return;
+	if (size > limit - offset)
+		size = limit - offset;
+	if (size)
+		AddRecord(st, VBSD_REC_HEADER_SPAN, &offset, sizeof(offset),
+			  start, size);
+}
+
+int VbSharedDataCompact(const VbSharedDataHeader *header, uint8_t *buf,
+			uint32_t *size)
+{
+	VbSharedDataCompactHeader h;
+	struct compact_state st;
+	const uint8_t *p;
+	uint32_t calls, parts, n, i;
+
+	if (!header || header->magic != VB_SHARED_DATA_MAGIC ||
+	    header->struct_size < VB_SHARED_DATA_HEADER_SIZE_V1 ||
+	    header->struct_size > sizeof(*header))
+		return VBOOT_SHARED_DATA_INVALID;
+
+	Memset(&st, 0, sizeof(st));
+	st.header = header;
+	st.buf = buf;
+	st.buf_size = *size;
+	st.used = sizeof(h);
+
+	/* The fields which are always there, for the struct's version */
+	AddSpan(&st, header, header->lk_calls);
+	AddSpan(&st, &header->kernel_supplemental_offset, header->timestamps);
+	AddSpan(&st, &header->ec_rw_hash_size, header->measurements);
+
+	/* The LoadKernel() calls, and the partitions each one tried */
+	calls = header->lk_call_count;
+	if (calls > VBSD_MAX_KERNEL_CALLS)
+		calls = VBSD_MAX_KERNEL_CALLS;
+	for (i = 0; i < calls; i++) {
+		const VbSharedDataKernelCall *call = header->lk_calls + i;
+		const VbSharedDataKernelCallIo *io = header->lk_call_io + i;
+
+		parts = call->kernel_parts_found;
+		if (parts > VBSD_MAX_KERNEL_PARTS)
+			parts = VBSD_MAX_KERNEL_PARTS;
+		AddSpan(&st, call, call->parts + parts);
+		AddSpan(&st, io, io->parts + parts);
+	}
+
+	/* Version 3 fields; AddSpan() leaves them out of older structs */
+	if (header->struct_version >= 3) {
+		n = header->timestamp_count;
+		if (n > VBSD_MAX_TIMESTAMPS)
+			n = VBSD_MAX_TIMESTAMPS;
+		AddSpan(&st, header->timestamps, header->timestamps + n);
+
+		n = header->ec_rw_hash_size;
+		if (n > sizeof(header->ec_rw_hash))
+			n = sizeof(header->ec_rw_hash);
+		AddSpan(&st, header->ec_rw_hash, header->ec_rw_hash + n);
+
+		n = header->measurement_count;
+		if (n > VBSD_MAX_MEASUREMENTS)
+			n = VBSD_MAX_MEASUREMENTS;
+		AddSpan(&st, header->measurements, header->measurements + n);
+
+		/*
+		 * Short structs don't have them, and firmware which doesn't
+		 * count them leaves them zero.
+		 */
+		p = (const uint8_t *)&header->crypto_stats;
+		n = 0;
+		if (header->struct_size >= sizeof(*header))
+			n = sizeof(header->crypto_stats);
+		for (i = 0; i < n; i++) {
+			if (p[i]) {
+				AddSpan(&st, p, p + sizeof(header->crypto_stats));
+				break;
+			}
+		}
+	}
+
+	if (header->kernel_subkey_data_size) {
+		if (header->kernel_subkey_data_offset > header->data_used ||
+		    header->kernel_subkey_data_size > header->data_used -
+		    header->kernel_subkey_data_offset ||
+		    header->kernel_subkey_data_size > 0xffff)
+			return VBOOT_SHARED_DATA_INVALID;
+		AddRecord(&st, VBSD_REC_KERNEL_SUBKEY, NULL, 0,
+			  (const uint8_t *)header +
+			  header->kernel_subkey_data_offset,
+			  header->kernel_subkey_data_size);
+	}
+
+	*size = st.used;
+	if (st.used > st.buf_size) {
+		VBDEBUG(("Compact shared data needs %d bytes.\n",
+			 (int)st.used));
+		return VBOOT_SHARED_DATA_INVALID;
+	}
+
+	Memset(&h, 0, sizeof(h));
+	h.magic = VB_SHARED_DATA_COMPACT_MAGIC;
+	h.version = VB_SHARED_DATA_COMPACT_VERSION;
+	h.record_count = st.count;
+	h.size = st.used;
+	Memcpy(buf, &h, sizeof(h));
+	return VBOOT_SUCCESS;
+}
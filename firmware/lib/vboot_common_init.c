@@ -8,12 +8,17 @@
 
 #include "sysincludes.h"
 
+#include "2sysincludes.h"
+#include "2api.h"
 #include "vboot_api.h"
 #include "vboot_common.h"
+#include "vboot_nvstorage.h"
 #include "utility.h"
 
 int VbSharedDataInit(VbSharedDataHeader *header, uint64_t size)
 {
+	uint64_t struct_size = sizeof(VbSharedDataHeader);
+
 	VBDEBUG(("VbSharedDataInit, %d bytes, header %d bytes\n", (int)size,
 		 (int)sizeof(VbSharedDataHeader)));
 
@@ -29,17 +34,63 @@ int VbSharedDataInit(VbSharedDataHeader *header, uint64_t size)
 	if (!header)
 		return VBOOT_SHARED_DATA_INVALID;
 
+	/*
+	 * Leave out the optional version 3 fields at the end unless there's
+	 * still as much room left for the kernel subkey as a minimum size
+	 * buffer has without them.
+	 */
+	if (size - struct_size <
+	    VB_SHARED_DATA_MIN_SIZE - VB_SHARED_DATA_HEADER_SIZE_V3_MIN)
+		struct_size = VB_SHARED_DATA_HEADER_SIZE_V3_MIN;
+
 	/* Zero the header */
-	Memset(header, 0, sizeof(VbSharedDataHeader));
+	Memset(header, 0, struct_size);
 
 	/* Initialize fields */
 	header->magic = VB_SHARED_DATA_MAGIC;
 	header->struct_version = VB_SHARED_DATA_VERSION;
-	header->struct_size = sizeof(VbSharedDataHeader);
+	header->struct_size = struct_size;
 	header->data_size = size;
-	header->data_used = sizeof(VbSharedDataHeader);
+	header->data_used = struct_size;
 	header->firmware_index = 0xFF;
 
 	/* Success */
 	return VBOOT_SUCCESS;
 }
+
+void VbNvLoad(VbCommonParams *cparams, VbNvContext *vnc)
+{
+	struct vb2_context *ctx = cparams->vb2_ctx;
+
+	if (!ctx) {
+		VbExNvStorageRead(vnc->raw);
+		VbNvSetup(vnc);
+		return;
+	}
+
+	/*
+	 * vb2_nv_init() has already checked the header and CRC, and reset it
+	 * if need be, so there's nothing to check again.  It may not have
+	 * been written back yet, but VbNvSave() will if anything changes.
+	 */
+	Memcpy(vnc->raw, ctx->nvdata, VBNV_BLOCK_SIZE);
+	Memcpy(vnc->raw_stored, ctx->nvdata, VBNV_BLOCK_SIZE);
+	vnc->raw_changed = 0;
+	vnc->regenerate_crc = 0;
+}
+
+void VbNvSave(VbCommonParams *cparams, VbNvContext *vnc)
+{
+	struct vb2_context *ctx = cparams->vb2_ctx;
+
+	VbNvTeardown(vnc);
+	if (!vnc->raw_changed)
+		return;
+
+	VbExNvStorageWrite(vnc->raw);
+	if (ctx) {
+		/* That wrote any changes the context had pending, too */
+		Memcpy(ctx->nvdata, vnc->raw, VBNV_BLOCK_SIZE);
+		ctx->flags &= ~VB2_CONTEXT_NVDATA_CHANGED;
+	}
+}
@@ -16,10 +16,29 @@
 #include "vboot_common.h"
 #include "vboot_display.h"
 #include "vboot_nvstorage.h"
+#include "vboot_workbuf.h"
 
 static uint32_t disp_current_screen = VB_SCREEN_BLANK;
 static uint32_t disp_width = 0, disp_height = 0;
 
+/* What is drawn on the display for one image of the current screen */
+typedef struct VbDrawnImage {
+	uint32_t image_info_offset;	/* 0 if there's no image */
+	uint32_t x, y;
+	uint32_t width, height;
+	uint32_t format;
+} VbDrawnImage;
+
+static VbDrawnImage disp_drawn[MAX_IMAGE_IN_LAYOUT];
+/* Set if disp_drawn[] is all that's on the display */
+static int disp_drawn_valid = 0;
+
+#define DEBUG_INFO_SIZE 512
+
+/* The debug info last shown, and whether it's still on top of the screen */
+static char disp_debug_info[DEBUG_INFO_SIZE];
+static int disp_debug_info_shown = 0;
+
 VbError_t VbGetLocalizationCount(VbCommonParams *cparams, uint32_t *count)
 {
 	BmpBlockHeader hdr;
@@ -44,58 +63,111 @@ VbError_t VbGetLocalizationCount(VbCommonParams *cparams, uint32_t *count)
 
 VbFont_t *VbInternalizeFontData(FontArrayHeader *fonthdr)
 {
-	/* Just return the raw data pointer for now. */
-	return (VbFont_t *)fonthdr;
-}
-
-void VbDoneWithFontForNow(VbFont_t *ptr)
-{
-	/* Nothing. */
-}
-
-ImageInfo *VbFindFontGlyph(VbFont_t *font, uint32_t ascii,
-			   void **bufferptr, uint32_t *buffersize)
-{
-	uint8_t *ptr, *firstptr;
-	uint32_t max;
+	VbFont_t *font;
+	uint8_t *ptr;
 	uint32_t i;
-	FontArrayEntryHeader *entry;
 
-	ptr = (uint8_t *)font;
-	max = ((FontArrayHeader *)ptr)->num_entries;
-	ptr += sizeof(FontArrayHeader);
-	firstptr = ptr;
+	if (!fonthdr || !fonthdr->num_entries)
+		return NULL;
+
+	if (!Memcmp(fonthdr->signature, FONT_ATLAS_SIGNATURE,
+		    FONT_SIGNATURE_SIZE)) {
+#ifdef DISPLAY_FONT_ATLAS
+		FontAtlasHeader *atlas = (FontAtlasHeader *)fonthdr;
+
+		if (atlas->num_glyphs > FONT_ATLAS_MAX_GLYPHS ||
+		    atlas->default_glyph >= atlas->num_glyphs)
+			return NULL;
+		font = VbWorkbufAlloc(sizeof(*font));
+		Memset(font, 0, sizeof(*font));
+		font->fonthdr = fonthdr;
+		font->atlas = atlas;
+		return font;
+#else
+		VBDEBUG(("VbInternalizeFontData: can't draw font atlases\n"));
+		return NULL;
+#endif
+	}
+
+	font = VbWorkbufAlloc(sizeof(*font));
+	Memset(font, 0, sizeof(*font));
+	font->fonthdr = fonthdr;
 
 	/*
-	 * Simple linear search.
-	 *
 	 * Note: We're assuming glpyhs are uncompressed. That's true because
 	 * the bmpblk_font tool doesn't compress anything. The bmpblk_utility
 	 * does, but it compresses the entire font blob at once, and we've
 	 * already uncompressed that before we got here.
 	 */
-	for(i=0; i<max; i++) {
-		entry = (FontArrayEntryHeader *)ptr;
-		if (entry->ascii == ascii) {
-			*bufferptr = ptr + sizeof(FontArrayEntryHeader);
-			*buffersize = entry->info.original_size;
-			return &(entry->info);
-		}
-		ptr += sizeof(FontArrayEntryHeader)+entry->info.compressed_size;
+	ptr = (uint8_t *)fonthdr + sizeof(FontArrayHeader);
+	for (i = 0; i < fonthdr->num_entries; i++) {
+		FontArrayEntryHeader *entry = (FontArrayEntryHeader *)ptr;
+
+		/* If a character is there twice, the first one wins */
+		if (entry->ascii < VB_FONT_DIRECT_GLYPHS &&
+		    !font->glyphs[entry->ascii])
+			font->glyphs[entry->ascii] = entry;
+		ptr += sizeof(FontArrayEntryHeader) + entry->info.compressed_size;
 	}
 
+	return font;
+}
+
+void VbDoneWithFontForNow(VbFont_t *ptr)
+{
+	VbWorkbufFree(ptr);
+}
+
+ImageInfo *VbFindFontGlyph(VbFont_t *font, uint32_t ascii,
+			   void **bufferptr, uint32_t *buffersize)
+{
+	FontArrayEntryHeader *entry = NULL;
+
+	if (ascii < VB_FONT_DIRECT_GLYPHS)
+		entry = font->glyphs[ascii];
+
 	/*
 	 * We must return something valid. We'll just use the first glyph in
 	 * the font structure (so it should be something distinct).
 	 */
-	entry = (FontArrayEntryHeader *)firstptr;
-	*bufferptr = firstptr + sizeof(FontArrayEntryHeader);
+	if (!entry)
+		entry = (FontArrayEntryHeader *)(font->fonthdr + 1);
+
+	*bufferptr = (uint8_t *)entry + sizeof(FontArrayEntryHeader);
 	*buffersize = entry->info.original_size;
 	return &(entry->info);
 }
 
-void VbRenderTextAtPos(const char *text, int right_to_left,
-		       uint32_t x, uint32_t y, VbFont_t *font)
+/* Most glyphs drawn at once */
+#define MAX_GLYPH_RUN 64
+
+static void VbFlushGlyphRun(VbDisplayImage *run, uint32_t *count)
+{
+#ifdef DISPLAY_IMAGE_RUN
+	if (*count && VBERROR_SUCCESS != VbExDisplayImageRun(run, *count))
+		VBDEBUG(("  VbRenderTextAtPos: can't display text\n"));
+#else
+	uint32_t i;
+
+	for (i = 0; i < *count; i++) {
+		if (VBERROR_SUCCESS != VbExDisplayImage(run[i].x, run[i].y,
+							run[i].buffer,
+							run[i].buffersize))
+			VBDEBUG(("  VbRenderTextAtPos: can't display glyph\n"));
+	}
+#endif
+	*count = 0;
+}
+
+/*
+ * Add the glyphs of some text to images[], starting at images[*count].  If
+ * flush is non-zero, the glyphs are drawn at the end of each line and
+ * whenever images[] fills up; if not, glyphs which don't fit are dropped.
+ */
+static void VbPlaceText(const char *text, int right_to_left,
+			uint32_t x, uint32_t y, VbFont_t *font,
+			VbDisplayImage *images, uint32_t max, uint32_t *count,
+			int flush)
 {
 	int i;
 	ImageInfo *image_info = 0;
@@ -109,27 +181,36 @@ void VbRenderTextAtPos(const char *text, int right_to_left,
 	}
 
 	for (i=0; text[i]; i++) {
+		uint8_t c = (uint8_t)text[i];
 
-		if (text[i] == '\n') {
+		if (c == '\n') {
 			if (!image_info)
-				image_info = VbFindFontGlyph(font, text[i],
+				image_info = VbFindFontGlyph(font, c,
 							     &buffer,
 							     &buffersize);
 			cur_x = x;
 			cur_y += image_info->height;
+			if (flush)
+				VbFlushGlyphRun(images, count);
 			continue;
 		}
 
-		image_info = VbFindFontGlyph(font, text[i], &buffer,
-					     &buffersize);
+		image_info = VbFindFontGlyph(font, c, &buffer, &buffersize);
 
 		if (right_to_left)
 			cur_x -= image_info->width;
 
-		if (VBERROR_SUCCESS != VbExDisplayImage(cur_x, cur_y, buffer,
-							buffersize)) {
+		if (*count == max && flush)
+			VbFlushGlyphRun(images, count);
+		if (*count < max) {
+			images[*count].x = cur_x;
+			images[*count].y = cur_y;
+			images[*count].buffer = buffer;
+			images[*count].buffersize = buffersize;
+			(*count)++;
+		} else {
 			VBDEBUG(("  VbRenderTextAtPos: "
-				 "can't display ascii 0x%x\n", text[i]));
+				 "no room for ascii 0x%x\n", c));
 		}
 
 		if (!right_to_left)
@@ -137,9 +218,211 @@ void VbRenderTextAtPos(const char *text, int right_to_left,
 	}
 }
 
+#ifdef DISPLAY_FONT_ATLAS
+/* Draw text a line at a time, each glyph a piece of the atlas image */
+static void VbRenderAtlasText(const char *text, int right_to_left,
+			      uint32_t x, uint32_t y, VbFont_t *font)
+{
+	FontAtlasHeader *atlas = font->atlas;
+	FontAtlasGlyph *glyphs = (FontAtlasGlyph *)(atlas + 1);
+	void *image = glyphs + atlas->num_glyphs;
+	VbDisplayRect run[MAX_GLYPH_RUN];
+	uint32_t count = 0;
+	uint32_t cur_x = x, cur_y = y;
+	int i;
+
+	for (i = 0; ; i++) {
+		uint8_t c = (uint8_t)text[i];
+		const FontAtlasGlyph *g;
+
+		if ((!c || c == '\n' || count == MAX_GLYPH_RUN) && count) {
+			if (VBERROR_SUCCESS !=
+			    VbExDisplayImageRects(image, atlas->image_size,
+						  run, count))
+				VBDEBUG(("  VbRenderTextAtPos: "
+					 "can't display text\n"));
+			count = 0;
+		}
+		if (!c)
+			break;
+		if (c == '\n') {
+			cur_x = x;
+			cur_y += atlas->line_height;
+			continue;
+		}
+
+		if (c >= atlas->num_glyphs || !glyphs[c].width)
+			c = atlas->default_glyph;
+		g = glyphs + c;
+
+		if (right_to_left)
+			cur_x -= g->width;
+		run[count].x = cur_x;
+		run[count].y = cur_y;
+		run[count].src_x = g->x;
+		run[count].src_y = g->y;
+		run[count].width = g->width;
+		run[count].height = g->height;
+		count++;
+		if (!right_to_left)
+			cur_x += g->width;
+	}
+}
+#endif
+
+void VbRenderTextAtPos(const char *text, int right_to_left,
+		       uint32_t x, uint32_t y, VbFont_t *font)
+{
+	VbDisplayImage run[MAX_GLYPH_RUN];
+	uint32_t run_count = 0;
+
+#ifdef DISPLAY_FONT_ATLAS
+	if (text && font && font->atlas) {
+		VbRenderAtlasText(text, right_to_left, x, y, font);
+		return;
+	}
+#endif
+
+	VbPlaceText(text, right_to_left, x, y, font, run, MAX_GLYPH_RUN,
+		    &run_count, 1);
+	VbFlushGlyphRun(run, &run_count);
+}
+
+/* Whether an image is a bitmap, covering all of its width and height */
+static int VbIsBitmap(uint32_t format)
+{
+	return format == FORMAT_BMP || format == FORMAT_RAW;
+}
+
+static int VbDrawnOverlap(const VbDrawnImage *a, const VbDrawnImage *b)
+{
+	return a->x < b->x + b->width && b->x < a->x + a->width &&
+	       a->y < b->y + b->height && b->y < a->y + a->height;
+}
+
+static int VbDrawnCovers(const VbDrawnImage *a, const VbDrawnImage *b)
+{
+	return a->x <= b->x && a->y <= b->y &&
+	       a->x + a->width >= b->x + b->width &&
+	       a->y + a->height >= b->y + b->height;
+}
+
+/*
+ * Work out which images of a screen need drawing to turn the display into
+ * it.  Fills in drawn[] with the images of the screen, and sets redraw[] for
+ * the ones to draw.  Returns non-zero if the whole screen needs drawing.
+ *
+ * An image which is the same and in the same place as what's already there
+ * is left alone.  One which changed can be drawn by itself only if it's a
+ * bitmap covering what was there before, since nothing else can be erased
+ * without drawing the background again.  Text has no known size, so changing
+ * text draws everything.
+ */
+static int VbPlanRedraw(VbCommonParams *cparams, uint32_t localization,
+			uint32_t screen_index, VbDrawnImage *drawn,
+			uint8_t *redraw)
+{
+	int any = 0;
+	uint32_t i, j;
+
+	for (i = 0; i < MAX_IMAGE_IN_LAYOUT; i++) {
+		ScreenLayout layout;
+		ImageInfo image_info;
+		VbError_t ret;
+
+		Memset(drawn + i, 0, sizeof(*drawn));
+		redraw[i] = 0;
+
+		ret = VbGbbReadImageInfo(cparams, localization, screen_index,
+					 i, &layout, &image_info);
+		if (ret == VBERROR_NO_IMAGE_PRESENT)
+			continue;
+		else if (ret)
+			return 1;
+
+		drawn[i].image_info_offset =
+			layout.images[i].image_info_offset;
+		drawn[i].x = layout.images[i].x;
+		drawn[i].y = layout.images[i].y;
+		drawn[i].width = image_info.width;
+		drawn[i].height = image_info.height;
+		drawn[i].format = image_info.format;
+	}
+
+	if (!disp_drawn_valid)
+		return 1;
+
+	for (i = 0; i < MAX_IMAGE_IN_LAYOUT; i++) {
+		const VbDrawnImage *old = disp_drawn + i;
+		const VbDrawnImage *new = drawn + i;
+
+		if (old->image_info_offset == new->image_info_offset &&
+		    old->x == new->x && old->y == new->y)
+			continue;
+
+		/* The first image is the background */
+		if (i == 0)
+			return 1;
+		if (old->image_info_offset &&
+		    (!VbIsBitmap(old->format) || !VbIsBitmap(new->format) ||
+		     !VbDrawnCovers(new, old)))
+			return 1;
+
+		redraw[i] = 1;
+		any = 1;
+	}
+
+	/* Later images go on top, so draw them again where they overlap */
+	for (i = 0; any && i < MAX_IMAGE_IN_LAYOUT; i++) {
+		if (!redraw[i])
+			continue;
+		for (j = i + 1; j < MAX_IMAGE_IN_LAYOUT; j++) {
+			if (drawn[j].image_info_offset && !redraw[j] &&
+			    (!VbIsBitmap(drawn[j].format) ||
+			     VbDrawnOverlap(drawn + i, drawn + j)))
+				redraw[j] = 1;
+		}
+	}
+
+	return 0;
+}
+
+#ifdef DISPLAY_LAYOUT
+/*
+ * Most images passed to VbExDisplayLayout() at once, counting each glyph of
+ * text as an image.  There's always room for the bitmaps.
+ */
+#define MAX_LAYOUT_IMAGES (MAX_IMAGE_IN_LAYOUT + 240)
+#endif
+
+/*
+ * In current version GBB bitmaps, first image is always the background, so
+ * it sets the size of the screen.
+ */
+static void VbSetBackgroundDimension(const ImageInfo *image_info)
+{
+	VbError_t ret;
+
+	ret = VbExDisplaySetDimension(image_info->width, image_info->height);
+	if (ret) {
+		VBDEBUG(("VbExDisplaySetDimension(%d,%d): failed (%#x).\n",
+			 image_info->width, image_info->height, ret));
+	}
+}
+
 VbError_t VbDisplayScreenFromGBB(VbCommonParams *cparams, uint32_t screen,
                                  VbNvContext *vncptr)
 {
+#ifdef DISPLAY_LAYOUT
+	VbDisplayImage *batch = NULL;
+	uint32_t batch_count = 0;
+	/* Image data to keep until the batch has been displayed */
+	char *batch_data[MAX_IMAGE_IN_LAYOUT];
+	uint32_t batch_data_count = 0;
+#endif
+	VbDrawnImage drawn[MAX_IMAGE_IN_LAYOUT];
+	uint8_t redraw[MAX_IMAGE_IN_LAYOUT];
+	int full;
 	char *fullimage = NULL;
 	BmpBlockHeader hdr;
 	uint32_t screen_index;
@@ -150,8 +433,11 @@ VbError_t VbDisplayScreenFromGBB(VbCommonParams *cparams, uint32_t screen,
 	VbFont_t *font;
 	const char *text_to_show;
 	int rtol = 0;
+	struct vb2_workbuf wb_saved;
 	VbError_t ret;
 
+	VbWorkbufSave(&wb_saved);
+
 	ret = VbGbbReadBmpHeader(cparams, &hdr);
 	if (ret)
 		return ret;
@@ -214,12 +500,45 @@ VbError_t VbDisplayScreenFromGBB(VbCommonParams *cparams, uint32_t screen,
 		VbNvSet(vncptr, VBNV_BACKUP_NVRAM_REQUEST, 1);
 	}
 
-	/* Display all bitmaps for the image */
+	/* Display the bitmaps for the image which aren't already there */
+	full = VbPlanRedraw(cparams, localization, screen_index, drawn,
+			    redraw);
+	VBDEBUG(("VbDisplayScreenFromGBB(): %s redraw\n",
+		 full ? "full" : "partial"));
+	disp_drawn_valid = 0;
+#ifdef DISPLAY_LAYOUT
+	batch = VbWorkbufAlloc(MAX_LAYOUT_IMAGES * sizeof(*batch));
+#endif
 	for (i = 0; i < MAX_IMAGE_IN_LAYOUT; i++) {
 		ScreenLayout layout;
 		ImageInfo image_info;
 		char hwid[256];
 
+		if (!full && !redraw[i])
+			continue;
+
+#if defined(DECOMPRESS_STREAM) && !defined(DISPLAY_LAYOUT)
+		/* Big bitmaps go from the GBB straight to the display */
+		ret = VbGbbReadImageInfo(cparams, localization, screen_index,
+					 i, &layout, &image_info);
+		if (ret == VBERROR_NO_IMAGE_PRESENT) {
+			continue;
+		} else if (ret) {
+			retval = ret;
+			goto VbDisplayScreenFromGBB_exit;
+		}
+		if (VbIsBitmap(image_info.format) &&
+		    VbGbbCanStreamImage(cparams, &image_info)) {
+			if (i == 0)
+				VbSetBackgroundDimension(&image_info);
+			retval = VbGbbStreamImage(cparams, &layout, i,
+						  &image_info);
+			if (VBERROR_SUCCESS != retval)
+				goto VbDisplayScreenFromGBB_exit;
+			continue;
+		}
+#endif
+
 		ret = VbGbbReadImage(cparams, localization, screen_index,
 				    i, &layout, &image_info,
 				    &fullimage, &inoutsize);
@@ -232,25 +551,22 @@ VbError_t VbDisplayScreenFromGBB(VbCommonParams *cparams, uint32_t screen,
 
 		switch(image_info.format) {
 		case FORMAT_BMP:
-			if (i == 0) {
-				/**
-				 * In current version GBB bitmaps, first image
-				 * is always the background.
-				 */
-				ret = VbExDisplaySetDimension(
-						image_info.width,
-						image_info.height);
-				if (ret) {
-					VBDEBUG(("VbExDisplaySetDimension"
-						 "(%d,%d): failed (%#x).\n",
-						 image_info.width,
-						 image_info.height, ret));
-				}
-			}
-
+		case FORMAT_RAW:
+			if (i == 0)
+				VbSetBackgroundDimension(&image_info);
+
+#ifdef DISPLAY_LAYOUT
+			batch[batch_count].x = layout.images[i].x;
+			batch[batch_count].y = layout.images[i].y;
+			batch[batch_count].buffer = fullimage;
+			batch[batch_count].buffersize = inoutsize;
+			batch_count++;
+			retval = VBERROR_SUCCESS;
+#else
 			retval = VbExDisplayImage(layout.images[i].x,
 						  layout.images[i].y,
 						  fullimage, inoutsize);
+#endif
 			break;
 
 		case FORMAT_FONT:
@@ -272,11 +588,43 @@ VbError_t VbDisplayScreenFromGBB(VbCommonParams *cparams, uint32_t screen,
 				rtol = 0;
 			}
 
+#if defined(DISPLAY_LAYOUT) && defined(DISPLAY_FONT_ATLAS)
+			/*
+			 * Atlas text can't go in the batch, so show what's
+			 * under it first.
+			 */
+			if (font && font->atlas) {
+				if (batch_count) {
+					retval = VbExDisplayLayout(batch,
+								   batch_count);
+					batch_count = 0;
+					if (VBERROR_SUCCESS != retval) {
+						VbDoneWithFontForNow(font);
+						break;
+					}
+				}
+				VbRenderTextAtPos(text_to_show, rtol,
+						  layout.images[i].x,
+						  layout.images[i].y, font);
+				VbDoneWithFontForNow(font);
+				retval = VBERROR_SUCCESS;
+				break;
+			}
+#endif
+#ifdef DISPLAY_LAYOUT
+			/* Leave room for the bitmaps which are still to come */
+			VbPlaceText(text_to_show, rtol, layout.images[i].x,
+				    layout.images[i].y, font, batch,
+				    MAX_LAYOUT_IMAGES - MAX_IMAGE_IN_LAYOUT +
+				    i + 1, &batch_count, 0);
+#else
 			VbRenderTextAtPos(text_to_show, rtol,
 					  layout.images[i].x,
 					  layout.images[i].y, font);
+#endif
 
 			VbDoneWithFontForNow(font);
+			retval = VBERROR_SUCCESS;
 			break;
 
 		default:
@@ -286,18 +634,42 @@ VbError_t VbDisplayScreenFromGBB(VbCommonParams *cparams, uint32_t screen,
 			retval = VBERROR_INVALID_GBB;
 		}
 
-		VbExFree(fullimage);
+#ifdef DISPLAY_LAYOUT
+		/* Glyphs point into font data, so keep that too */
+		batch_data[batch_data_count++] = fullimage;
+#else
+		VbWorkbufFree(fullimage);
+		/* Reclaim the work buffer space used by the image */
+		VbWorkbufRestore(&wb_saved);
+#endif
 
 		if (VBERROR_SUCCESS != retval)
 			goto VbDisplayScreenFromGBB_exit;
 	}
 
+#ifdef DISPLAY_LAYOUT
+	/* Let the platform compose the images and show them together */
+	if (batch_count) {
+		retval = VbExDisplayLayout(batch, batch_count);
+		if (VBERROR_SUCCESS != retval)
+			goto VbDisplayScreenFromGBB_exit;
+	}
+#endif
+
 	/* Successful if all bitmaps displayed */
 	retval = VBERROR_SUCCESS;
+	Memcpy(disp_drawn, drawn, sizeof(disp_drawn));
+	disp_drawn_valid = 1;
 
 	VbRegionCheckVersion(cparams);
 
  VbDisplayScreenFromGBB_exit:
+#ifdef DISPLAY_LAYOUT
+	while (batch_data_count)
+		VbWorkbufFree(batch_data[--batch_data_count]);
+	VbWorkbufFree(batch);
+#endif
+	VbWorkbufRestore(&wb_saved);
 	VBDEBUG(("leaving VbDisplayScreenFromGBB() with %d\n",retval));
 	return retval;
 }
@@ -323,6 +695,7 @@ VbError_t VbDisplayScreen(VbCommonParams *cparams, uint32_t screen,
 
 	/* Request the screen */
 	disp_current_screen = screen;
+	disp_debug_info_shown = 0;
 
 	/* Look in the GBB first */
 	if (VBERROR_SUCCESS == VbDisplayScreenFromGBB(cparams, screen,
@@ -330,6 +703,7 @@ VbError_t VbDisplayScreen(VbCommonParams *cparams, uint32_t screen,
 		return VBERROR_SUCCESS;
 
 	/* If screen wasn't in the GBB bitmaps, fall back to a default */
+	disp_drawn_valid = 0;
 	return VbExDisplayScreen(screen);
 }
 
@@ -340,18 +714,26 @@ static void Uint8ToString(char *buf, uint8_t val)
 	*buf = trans[val & 0xF];
 }
 
-static void FillInSha1Sum(char *outbuf, VbPublicKey *key)
+static void FillInSha1Sum(char *outbuf, const VbPublicKey *key)
 {
-	uint8_t *buf = ((uint8_t *)key) + key->key_offset;
+	const uint8_t *buf = GetPublicKeyDataC(key);
 	uint64_t buflen = key->key_size;
-	uint8_t *digest = DigestBuf(buf, buflen, SHA1_DIGEST_ALGORITHM);
+	uint8_t digest[SHA1_DIGEST_SIZE];
 	int i;
+
+	/* SHA-1 support may be left out of the build */
+	if (DigestBufInto(buf, buflen, SHA1_DIGEST_ALGORITHM, digest,
+			  sizeof(digest))) {
+		*outbuf = '\0';
+		StrnAppend(outbuf, "(unavailable)", 2 * SHA1_DIGEST_SIZE + 1);
+		return;
+	}
+
 	for (i = 0; i < SHA1_DIGEST_SIZE; i++) {
 		Uint8ToString(outbuf, digest[i]);
 		outbuf += 2;
 	}
 	*outbuf = '\0';
-	VbExFree(digest);
 }
 
 const char *RecoveryReasonString(uint8_t code)
@@ -498,127 +880,180 @@ const char *RecoveryReasonString(uint8_t code)
 	return "We have no idea what this means";
 }
 
-#define DEBUG_INFO_SIZE 512
+/* Text built up a piece at a time, cut short if it doesn't fit */
+typedef struct VbTextBuf {
+	char *buf;
+	uint32_t size;
+	uint32_t used;
+} VbTextBuf;
+
+static void VbTextAdd(VbTextBuf *t, const char *str)
+{
+	while (*str && t->used < t->size - 1)
+		t->buf[t->used++] = *str++;
+	t->buf[t->used] = '\0';
+}
+
+static void VbTextAddNum(VbTextBuf *t, uint64_t value, uint32_t radix,
+			 uint32_t zero_pad_width)
+{
+	t->used += Uint64ToString(t->buf + t->used, t->size - t->used, value,
+				  radix, zero_pad_width);
+}
+
+/*
+ * The HWID and key digests, which are the slow parts of the debug info, are
+ * only found once per boot.  A digest is empty if its key can't be read.
+ */
+typedef struct VbDebugInfoCache {
+	char hwid[VB_REGION_HWID_LEN];
+	char rootkey_sha1[SHA1_DIGEST_SIZE * 2 + 1];
+	char recovery_key_sha1[SHA1_DIGEST_SIZE * 2 + 1];
+	char kernel_subkey_sha1[SHA1_DIGEST_SIZE * 2 + 1];
+} VbDebugInfoCache;
+
+static const VbDebugInfoCache *VbGetDebugInfoCache(VbCommonParams *cparams)
+{
+	VbSharedDataHeader *shared =
+		(VbSharedDataHeader *)cparams->shared_data_blob;
+	VbDebugInfoCache *cache = cparams->debug_info;
+	const VbPublicKey *recovery_key;
+	VbPublicKey *key;
+
+	if (cache)
+		return cache;
+
+	cache = VbExMalloc(sizeof(*cache));
+	Memset(cache, 0, sizeof(*cache));
+
+	VbRegionReadHWID(cparams, cache->hwid, sizeof(cache->hwid));
+
+	if (!VbGbbReadRootKey(cparams, &key)) {
+		FillInSha1Sum(cache->rootkey_sha1, key);
+		VbWorkbufFree(key);
+	}
+
+	/* The same copy LoadKernel() verifies recovery kernels with */
+	if (!VbGbbGetRecoveryKey(cparams, &recovery_key))
+		FillInSha1Sum(cache->recovery_key_sha1, recovery_key);
+
+	FillInSha1Sum(cache->kernel_subkey_sha1, &shared->kernel_subkey);
+
+	cparams->debug_info = cache;
+	return cache;
+}
 
 VbError_t VbDisplayDebugInfo(VbCommonParams *cparams, VbNvContext *vncptr)
 {
 	VbSharedDataHeader *shared =
 		(VbSharedDataHeader *)cparams->shared_data_blob;
 	GoogleBinaryBlockHeader *gbb = cparams->gbb;
-	char buf[DEBUG_INFO_SIZE] = "";
-	char sha1sum[SHA1_DIGEST_SIZE * 2 + 1];
-	char hwid[256];
-	uint32_t used = 0;
-	VbPublicKey *key;
+	const VbDebugInfoCache *cache = VbGetDebugInfoCache(cparams);
+	char buf[DEBUG_INFO_SIZE];
+	VbTextBuf t = { buf, sizeof(buf), 0 };
 	VbError_t ret;
 	uint32_t i;
 
-	/* Redisplay current screen to overwrite any previous debug output */
-	VbDisplayScreen(cparams, disp_current_screen, 1, vncptr);
-
 	/* Add hardware ID */
-	VbRegionReadHWID(cparams, hwid, sizeof(hwid));
-	used += StrnAppend(buf + used, "HWID: ", DEBUG_INFO_SIZE - used);
-	used += StrnAppend(buf + used, hwid, DEBUG_INFO_SIZE - used);
+	VbTextAdd(&t, "HWID: ");
+	VbTextAdd(&t, cache->hwid);
 
 	/* Add recovery reason and subcode */
 	VbNvGet(vncptr, VBNV_RECOVERY_SUBCODE, &i);
-	used += StrnAppend(buf + used,
-			"\nrecovery_reason: 0x", DEBUG_INFO_SIZE - used);
-	used += Uint64ToString(buf + used, DEBUG_INFO_SIZE - used,
-			       shared->recovery_reason, 16, 2);
-	used += StrnAppend(buf + used, " / 0x", DEBUG_INFO_SIZE - used);
-	used += Uint64ToString(buf + used, DEBUG_INFO_SIZE - used, i, 16, 2);
-	used += StrnAppend(buf + used, "  ", DEBUG_INFO_SIZE - used);
-	used += StrnAppend(buf + used,
-			RecoveryReasonString(shared->recovery_reason),
-			DEBUG_INFO_SIZE - used);
+	VbTextAdd(&t, "\nrecovery_reason: 0x");
+	VbTextAddNum(&t, shared->recovery_reason, 16, 2);
+	VbTextAdd(&t, " / 0x");
+	VbTextAddNum(&t, i, 16, 2);
+	VbTextAdd(&t, "  ");
+	VbTextAdd(&t, RecoveryReasonString(shared->recovery_reason));
 
 	/* Add VbSharedData flags */
-	used += StrnAppend(buf + used, "\nVbSD.flags: 0x", DEBUG_INFO_SIZE - used);
-	used += Uint64ToString(buf + used, DEBUG_INFO_SIZE - used,
-			       shared->flags, 16, 8);
+	VbTextAdd(&t, "\nVbSD.flags: 0x");
+	VbTextAddNum(&t, shared->flags, 16, 8);
 
 	/* Add raw contents of VbNvStorage */
-	used += StrnAppend(buf + used, "\nVbNv.raw:", DEBUG_INFO_SIZE - used);
+	VbTextAdd(&t, "\nVbNv.raw:");
 	for (i = 0; i < VBNV_BLOCK_SIZE; i++) {
-		used += StrnAppend(buf + used, " ", DEBUG_INFO_SIZE - used);
-		used += Uint64ToString(buf + used, DEBUG_INFO_SIZE - used,
-				       vncptr->raw[i], 16, 2);
+		VbTextAdd(&t, " ");
+		VbTextAddNum(&t, vncptr->raw[i], 16, 2);
 	}
 
 	/* Add dev_boot_usb flag */
 	VbNvGet(vncptr, VBNV_DEV_BOOT_USB, &i);
-	used += StrnAppend(buf + used, "\ndev_boot_usb: ", DEBUG_INFO_SIZE - used);
-	used += Uint64ToString(buf + used, DEBUG_INFO_SIZE - used, i, 10, 0);
+	VbTextAdd(&t, "\ndev_boot_usb: ");
+	VbTextAddNum(&t, i, 10, 0);
 
 	/* Add dev_boot_legacy flag */
 	VbNvGet(vncptr, VBNV_DEV_BOOT_LEGACY, &i);
-	used += StrnAppend(buf + used,
-			"\ndev_boot_legacy: ", DEBUG_INFO_SIZE - used);
-	used += Uint64ToString(buf + used, DEBUG_INFO_SIZE - used, i, 10, 0);
+	VbTextAdd(&t, "\ndev_boot_legacy: ");
+	VbTextAddNum(&t, i, 10, 0);
 
 	/* Add dev_boot_signed_only flag */
 	VbNvGet(vncptr, VBNV_DEV_BOOT_SIGNED_ONLY, &i);
-	used += StrnAppend(buf + used, "\ndev_boot_signed_only: ",
-			DEBUG_INFO_SIZE - used);
-	used += Uint64ToString(buf + used, DEBUG_INFO_SIZE - used, i, 10, 0);
+	VbTextAdd(&t, "\ndev_boot_signed_only: ");
+	VbTextAddNum(&t, i, 10, 0);
 
 	/* Add TPM versions */
-	used += StrnAppend(buf + used, "\nTPM: fwver=0x", DEBUG_INFO_SIZE - used);
-	used += Uint64ToString(buf + used, DEBUG_INFO_SIZE - used,
-			       shared->fw_version_tpm, 16, 8);
-	used += StrnAppend(buf + used, " kernver=0x", DEBUG_INFO_SIZE - used);
-	used += Uint64ToString(buf + used, DEBUG_INFO_SIZE - used,
-			       shared->kernel_version_tpm, 16, 8);
+	VbTextAdd(&t, "\nTPM: fwver=0x");
+	VbTextAddNum(&t, shared->fw_version_tpm, 16, 8);
+	VbTextAdd(&t, " kernver=0x");
+	VbTextAddNum(&t, shared->kernel_version_tpm, 16, 8);
 
 	/* Add GBB flags */
-	used += StrnAppend(buf + used, "\ngbb.flags: 0x", DEBUG_INFO_SIZE - used);
-	if (gbb->major_version == GBB_MAJOR_VER && gbb->minor_version >= 1) {
-		used += Uint64ToString(buf + used, DEBUG_INFO_SIZE - used,
-				       gbb->flags, 16, 8);
-	} else {
-		used += StrnAppend(buf + used,
-				"0 (default)", DEBUG_INFO_SIZE - used);
-	}
+	VbTextAdd(&t, "\ngbb.flags: 0x");
+	if (gbb->major_version == GBB_MAJOR_VER && gbb->minor_version >= 1)
+		VbTextAddNum(&t, gbb->flags, 16, 8);
+	else
+		VbTextAdd(&t, "0 (default)");
 
 	/* Add sha1sum for Root & Recovery keys */
-	ret = VbGbbReadRootKey(cparams, &key);
-	if (!ret) {
-		FillInSha1Sum(sha1sum, key);
-		VbExFree(key);
-		used += StrnAppend(buf + used, "\ngbb.rootkey: ",
-				   DEBUG_INFO_SIZE - used);
-		used += StrnAppend(buf + used, sha1sum,
-				   DEBUG_INFO_SIZE - used);
+	if (*cache->rootkey_sha1) {
+		VbTextAdd(&t, "\ngbb.rootkey: ");
+		VbTextAdd(&t, cache->rootkey_sha1);
 	}
-
-	ret = VbGbbReadRecoveryKey(cparams, &key);
-	if (!ret) {
-		FillInSha1Sum(sha1sum, key);
-		VbExFree(key);
-		used += StrnAppend(buf + used, "\ngbb.recovery_key: ",
-				   DEBUG_INFO_SIZE - used);
-		used += StrnAppend(buf + used, sha1sum,
-				   DEBUG_INFO_SIZE - used);
+	if (*cache->recovery_key_sha1) {
+		VbTextAdd(&t, "\ngbb.recovery_key: ");
+		VbTextAdd(&t, cache->recovery_key_sha1);
 	}
 
 	/* If we're in dev-mode, show the kernel subkey that we expect, too. */
 	if (0 == shared->recovery_reason) {
-		FillInSha1Sum(sha1sum, &shared->kernel_subkey);
-		used += StrnAppend(buf + used,
-				"\nkernel_subkey: ", DEBUG_INFO_SIZE - used);
-		used += StrnAppend(buf + used, sha1sum, DEBUG_INFO_SIZE - used);
+		VbTextAdd(&t, "\nkernel_subkey: ");
+		VbTextAdd(&t, cache->kernel_subkey_sha1);
 	}
 
 	/* Make sure we finish with a newline */
-	used += StrnAppend(buf + used, "\n", DEBUG_INFO_SIZE - used);
+	VbTextAdd(&t, "\n");
 
 	/* TODO: add more interesting data:
 	 * - Information on current disks */
 
-	buf[DEBUG_INFO_SIZE - 1] = '\0';
-	return VbExDisplayDebugInfo(buf);
+	/* Nothing to do if the same text is still showing */
+	if (disp_debug_info_shown &&
+	    !Memcmp(buf, disp_debug_info, t.used + 1))
+		return VBERROR_SUCCESS;
+
+	/*
+	 * Redisplay current screen to overwrite any previous debug output.
+	 * If there isn't any, what's there is already the screen.
+	 */
+	if (!disp_drawn_valid)
+		VbDisplayScreen(cparams, disp_current_screen, 1, vncptr);
+
+	ret = VbDisplayDebugText(buf);
+	if (ret)
+		return ret;
+	Memcpy(disp_debug_info, buf, t.used + 1);
+	disp_debug_info_shown = 1;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbDisplayDebugText(const char *text)
+{
+	/* The next redraw has to cover the text up */
+	disp_drawn_valid = 0;
+	disp_debug_info_shown = 0;
+	return VbExDisplayDebugInfo(text);
 }
 
 #define MAGIC_WORD_LEN 5
@@ -658,9 +1093,7 @@ VbError_t VbCheckDisplayKey(VbCommonParams *cparams, uint32_t key,
 		VbNvSet(vncptr, VBNV_BACKUP_NVRAM_REQUEST, 1);
 
 #ifdef SAVE_LOCALE_IMMEDIATELY
-		VbNvTeardown(vncptr);  /* really only computes checksum */
-		if (vncptr->raw_changed)
-			VbExNvStorageWrite(vncptr->raw);
+		VbNvSave(cparams, vncptr);
 #endif
 
 		/* Force redraw of current screen */
@@ -12,10 +12,12 @@
 #include "gbb_access.h"
 #include "gbb_header.h"
 #include "load_firmware_fw.h"
+#include "rollback_index.h"
 #include "utility.h"
 #include "vboot_api.h"
 #include "vboot_common.h"
 #include "vboot_nvstorage.h"
+#include "vboot_workbuf.h"
 
 /*
  * Static variables for UpdateFirmwareBodyHash().  It's less than optimal to
@@ -38,6 +40,36 @@ void VbUpdateFirmwareBodyHash(VbCommonParams *cparams, uint8_t *data,
 	lfi->body_size_accum += size;
 }
 
+/**
+ * Add the keyblock, preamble and body of the firmware we're booting to the
+ * measurement log.  These are only logged, not extended into the TPM, so the
+ * boot mode PCRs keep the values attestation already expects.
+ * [body_measurement] is NULL if there was no body to hash.  The log uses
+ * SHA-1 digests, so nothing is logged if SHA-1 support is left out.
+ */
+static void MeasureFirmware(VbSharedDataHeader *shared,
+			    const VbKeyBlockHeader *key_block,
+			    const VbFirmwarePreambleHeader *preamble,
+			    const uint8_t *body_measurement)
+{
+#if VB2_SUPPORT_SHA1
+	uint8_t digest[SHA1_DIGEST_SIZE];
+
+	internal_SHA1((const uint8_t *)key_block, key_block->key_block_size,
+		      digest);
+	VbSharedDataQueueMeasurement(shared, VBSD_MEASURE_FW_KEYBLOCK,
+				     VBSD_MEASURE_NO_PCR, digest);
+	internal_SHA1((const uint8_t *)preamble, preamble->preamble_size,
+		      digest);
+	VbSharedDataQueueMeasurement(shared, VBSD_MEASURE_FW_PREAMBLE,
+				     VBSD_MEASURE_NO_PCR, digest);
+	if (body_measurement)
+		VbSharedDataQueueMeasurement(shared, VBSD_MEASURE_FW_BODY,
+					     VBSD_MEASURE_NO_PCR,
+					     body_measurement);
+#endif
+}
+
 int LoadFirmware(VbCommonParams *cparams, VbSelectFirmwareParams *fparams,
                  VbNvContext *vnc)
 {
@@ -45,11 +77,15 @@ int LoadFirmware(VbCommonParams *cparams, VbSelectFirmwareParams *fparams,
 		(VbSharedDataHeader *)cparams->shared_data_blob;
 	GoogleBinaryBlockHeader *gbb = cparams->gbb;
 	VbPublicKey *root_key = NULL;
+	RSAPublicKey root_rsa;
+	PublicKeyCache key_cache;
 	VbLoadFirmwareInternal *lfi;
+	const uint8_t *ec_rw_hash;
 
 	uint32_t try_b_count;
 	uint32_t lowest_version = 0xFFFFFFFF;
 	int good_index = -1;
+	int lock_started = 0;
 	int is_dev;
 	int index;
 	int i;
@@ -63,6 +99,7 @@ int LoadFirmware(VbCommonParams *cparams, VbSelectFirmwareParams *fparams,
 	VBDEBUG(("LoadFirmware started...\n"));
 
 	/* Must have a root key from the GBB */
+	Memset(&key_cache, 0, sizeof(key_cache));
 	retval = VbGbbReadRootKey(cparams, &root_key);
 	if (retval) {
 		VBDEBUG(("No GBB\n"));
@@ -70,6 +107,10 @@ int LoadFirmware(VbCommonParams *cparams, VbSelectFirmwareParams *fparams,
 		goto LoadFirmwareExit;
 	}
 
+	/* Both key blocks are checked against it where it was read */
+	if (!PublicKeyToRSAInPlace(root_key, &root_rsa))
+		PublicKeyCacheLend(&key_cache, &root_rsa);
+
 	/* Parse flags */
 	is_dev = (shared->flags & VBSD_BOOT_DEV_SWITCH_ON ? 1 : 0);
 	if (is_dev)
@@ -93,9 +134,12 @@ int LoadFirmware(VbCommonParams *cparams, VbSelectFirmwareParams *fparams,
 		uint32_t vblock_size;
 		VbFirmwarePreambleHeader *preamble;
 		RSAPublicKey *data_key;
+		const uint8_t *body;
+		uint32_t body_size;
 		uint64_t key_version;
 		uint32_t combined_version;
-		uint8_t *body_digest;
+		uint8_t body_digest[MAX_DIGEST_SIZE];
+		uint8_t body_measurement[SHA1_DIGEST_SIZE];
 		uint8_t *check_result;
 
 		/* If try B count is non-zero try firmware B first */
@@ -104,11 +148,15 @@ int LoadFirmware(VbCommonParams *cparams, VbSelectFirmwareParams *fparams,
 			key_block = (VbKeyBlockHeader *)
 				fparams->verification_block_A;
 			vblock_size = fparams->verification_size_A;
+			body = fparams->body_A;
+			body_size = fparams->body_size_A;
 			check_result = &shared->check_fw_a_result;
 		} else {
 			key_block = (VbKeyBlockHeader *)
 				fparams->verification_block_B;
 			vblock_size = fparams->verification_size_B;
+			body = fparams->body_B;
+			body_size = fparams->body_size_B;
 			check_result = &shared->check_fw_b_result;
 		}
 
@@ -133,8 +181,8 @@ int LoadFirmware(VbCommonParams *cparams, VbSelectFirmwareParams *fparams,
 		}
 
 		/* Verify the key block */
-		if ((0 != KeyBlockVerify(key_block, vblock_size,
-					 root_key, 0))) {
+		if ((0 != KeyBlockVerifyCached(key_block, vblock_size,
+					       root_key, 0, &key_cache))) {
 			VBDEBUG(("Key block verification failed.\n"));
 			*check_result = VBSD_LF_CHECK_VERIFY_KEYBLOCK;
 			continue;
@@ -228,14 +276,41 @@ int LoadFirmware(VbCommonParams *cparams, VbSelectFirmwareParams *fparams,
 		} else {
 			VbError_t rv;
 
-			/* Read the firmware data */
+			/*
+			 * This header is already counted in lowest_version,
+			 * so if it's no newer than the TPM, nothing will
+			 * write the firmware space before VbSelectFirmware()
+			 * locks it, whichever slot we end up booting.  So
+			 * have the TPM set the lock while we hash the body.
+			 * If no slot is good, recovery reboots, which clears
+			 * the lock.
+			 */
+			if (!lock_started &&
+			    combined_version <= shared->fw_version_tpm) {
+				VBDEBUG(("Locking TPM while hashing body\n"));
+				RollbackFirmwareLockStart();
+				lock_started = 1;
+			}
+
+			/*
+			 * Hash the firmware data, in one go if the caller
+			 * already has it in memory, or else as the caller
+			 * reads it.
+			 */
 			DigestInit(&lfi->body_digest_context,
 				   data_key->algorithm);
 			lfi->body_size_accum = 0;
-			rv = VbExHashFirmwareBody(
+			if (body) {
+				DigestUpdate(&lfi->body_digest_context,
+					     body, body_size);
+				lfi->body_size_accum = body_size;
+				rv = VBERROR_SUCCESS;
+			} else {
+				rv = VbExHashFirmwareBody(
 					cparams,
 					(index ? VB_SELECT_FIRMWARE_B :
 					 VB_SELECT_FIRMWARE_A));
+			}
 			if (VBERROR_SUCCESS != rv) {
 				VBDEBUG(("VbExHashFirmwareBody() failed for "
 					 "index %d\n", index));
@@ -254,17 +329,22 @@ int LoadFirmware(VbCommonParams *cparams, VbSelectFirmwareParams *fparams,
 			}
 
 			/* Verify firmware data */
-			body_digest = DigestFinal(&lfi->body_digest_context);
-			if (0 != VerifyDigest(body_digest,
+			if (0 != DigestFinalInto(&lfi->body_digest_context,
+						 body_digest,
+						 sizeof(body_digest)) ||
+			    0 != VerifyDigest(body_digest,
 					      &preamble->body_signature,
 					      data_key)) {
 				VBDEBUG(("FW body verification failed.\n"));
 				*check_result = VBSD_LF_CHECK_VERIFY_BODY;
 				RSAPublicKeyFree(data_key);
-				VbExFree(body_digest);
 				continue;
 			}
-			VbExFree(body_digest);
+#if VB2_SUPPORT_SHA1
+			internal_SHA1(body_digest,
+				      hash_size_map[data_key->algorithm],
+				      body_measurement);
+#endif
 		}
 
 		/* Done with the data key, so can free it now */
@@ -295,6 +375,23 @@ int LoadFirmware(VbCommonParams *cparams, VbSelectFirmwareParams *fparams,
 			shared->firmware_index = (uint8_t)index;
 			shared->fw_keyblock_flags = key_block->key_block_flags;
 
+			/*
+			 * Log what we're booting; VbSelectFirmware() flushes
+			 * the log along with the boot mode measurements.
+			 */
+			MeasureFirmware(shared, key_block, preamble,
+					(shared->flags & VBSD_LF_USE_RO_NORMAL) ?
+					NULL : body_measurement);
+
+			/* Save the EC-RW hash for software sync, if any */
+			ec_rw_hash = VbGetFirmwarePreambleEcRwHash(preamble);
+			if (ec_rw_hash) {
+				Memcpy(shared->ec_rw_hash, ec_rw_hash,
+				       sizeof(shared->ec_rw_hash));
+				shared->ec_rw_hash_size =
+					sizeof(shared->ec_rw_hash);
+			}
+
 			/*
 			 * If the good firmware's key version is the same as
 			 * the tpm, then the TPM doesn't need updating; we can
@@ -346,7 +443,8 @@ int LoadFirmware(VbCommonParams *cparams, VbSelectFirmwareParams *fparams,
 	}
 
  LoadFirmwareExit:
-	VbExFree(root_key);
+	PublicKeyCacheFree(&key_cache);
+	VbWorkbufFree(root_key);
 
 	/* Store recovery request, if any */
 	VbNvSet(vnc, VBNV_RECOVERY_REQUEST, VBERROR_SUCCESS != retval ?
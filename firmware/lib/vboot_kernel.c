@@ -19,8 +19,11 @@
 #include "vboot_api.h"
 #include "vboot_common.h"
 #include "vboot_kernel.h"
+#include "vboot_workbuf.h"
 
 #define KBUF_SIZE 65536  /* Bytes to read at start of kernel partition */
+#define KBUF_MAX_SIZE (1024 * 1024)  /* Largest key block + preamble */
+#define KBODY_CHUNK_SIZE 65536  /* Bytes of kernel body to read per hash */
 #define LOWEST_TPM_VERSION 0xffffffff
 
 typedef enum BootMode {
@@ -29,32 +32,239 @@ typedef enum BootMode {
 	kBootDev = 2        /* Developer boot - self-signed kernel ok */
 } BootMode;
 
+/**
+ * Read from a kernel partition, counting the read in [io] if it's not NULL.
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+static VbError_t StreamRead(VbExStream_t stream, uint32_t bytes, void *buffer,
+			    VbSharedDataIoStats *io)
+{
+	uint64_t start;
+	VbError_t rv;
+
+	if (!io)
+		return VbExStreamRead(stream, bytes, buffer);
+
+	start = VbExGetTimer();
+	rv = VbExStreamRead(stream, bytes, buffer);
+	io->read_ticks += VbExGetTimer() - start;
+	io->read_bytes += bytes;
+	io->read_calls++;
+	return rv;
+}
+
+/* Where each chunk of kernel body goes once it's read */
+typedef struct BodySink {
+	/* Hash to add it to, or NULL */
+	DigestContext *ctx;
+	/* Stream decompressing it, or NULL */
+	VbExDecompressStream_t decompress;
+	/* First error from the decompress stream */
+	VbError_t decompress_rv;
+} BodySink;
+
+/* Pass a chunk of kernel body on to the hash and decompressor in [sink] */
+static void BodyChunkDone(void *sink, const void *chunk, uint32_t bytes)
+{
+	BodySink *s = (BodySink *)sink;
+
+	if (s->ctx)
+		DigestUpdate(s->ctx, (const uint8_t *)chunk, bytes);
+	if (s->decompress && !s->decompress_rv)
+		s->decompress_rv = VbExDecompressStreamWrite(s->decompress,
+							     chunk, bytes);
+}
+
+/**
+ * Read [bytes] of kernel body, a chunk at a time, into [buffer], passing
+ * each chunk on to [sink] and counting the reads in [io] if it's not NULL.
+ *
+ * If the stream can read the chunks itself, with several in flight, each is
+ * hashed as it arrives; the read ticks then include that hashing.
+ * Otherwise, each chunk is read and hashed in turn.
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+static VbError_t ReadBody(VbExStream_t stream, uint32_t bytes, uint8_t *buffer,
+			  BodySink *sink, VbSharedDataIoStats *io)
+{
+	uint64_t start = io ? VbExGetTimer() : 0;
+	VbError_t rv;
+
+	rv = VbExStreamReadChunks(stream, bytes, buffer, KBODY_CHUNK_SIZE,
+				  BodyChunkDone, sink);
+	if (rv != VBERROR_STREAM_CHUNKS_UNSUPPORTED) {
+		if (io) {
+			io->read_ticks += VbExGetTimer() - start;
+			io->read_bytes += bytes;
+			io->read_calls++;
+		}
+		return rv;
+	}
+
+	while (bytes) {
+		uint32_t chunk = bytes;
+
+		if (chunk > KBODY_CHUNK_SIZE)
+			chunk = KBODY_CHUNK_SIZE;
+
+		rv = StreamRead(stream, chunk, buffer, io);
+		if (rv)
+			return rv;
+
+		BodyChunkDone(sink, buffer, chunk);
+		bytes -= chunk;
+		buffer += chunk;
+	}
+
+	return VBERROR_SUCCESS;
+}
+
+/**
+ * Make sure the first [need] bytes of a kernel partition are in the header
+ * buffer, growing the buffer and reading more of the stream if needed.
+ *
+ * Headers bigger than KBUF_MAX_SIZE are left for verification to reject.
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+static int ReadMoreHeader(VbExStream_t stream, uint64_t blba, uint64_t need,
+			  uint8_t **kbuf, uint32_t *kbuf_size,
+			  uint32_t *kbuf_read, VbSharedDataIoStats *io)
+{
+	uint8_t *newbuf;
+
+	if (need <= *kbuf_read || need > KBUF_MAX_SIZE)
+		return 0;
+
+	/* Streams read whole sectors */
+	need = (need + blba - 1) / blba * blba;
+
+	if (need > *kbuf_size) {
+		newbuf = (uint8_t *)VbWorkbufAlloc(need);
+		if (!newbuf)
+			return 1;
+		Memcpy(newbuf, *kbuf, *kbuf_read);
+		VbWorkbufFree(*kbuf);
+		*kbuf = newbuf;
+		*kbuf_size = (uint32_t)need;
+	}
+
+	if (0 != StreamRead(stream, (uint32_t)need - *kbuf_read,
+			    *kbuf + *kbuf_read, io))
+		return 1;
+
+	*kbuf_read = (uint32_t)need;
+	return 0;
+}
+
+#ifdef DISK_READ_ASYNC
+/**
+ * Tell the platform how much more of a kernel partition is about to be read,
+ * so the body can be on its way while the headers are verified.
+ *
+ * This needs the preamble header in [kbuf]; if it isn't there yet, nothing is
+ * done and 0 is returned, so it can be tried again once more has been read.
+ * The sizes it uses haven't been verified, but they're only a hint, and are
+ * kept inside the partition.  Returns 1 once the hint has been given, or
+ * there's nothing left to give it for.
+ */
+static int PrefetchBody(VbExStream_t stream, const uint8_t *kbuf,
+			uint32_t kbuf_read, uint64_t part_bytes, uint64_t blba)
+{
+	const VbKernelPreambleHeader *preamble;
+	uint64_t offset = ((const VbKeyBlockHeader *)kbuf)->key_block_size;
+	uint64_t end;
+
+	if (offset > part_bytes)
+		return 1;
+	if (offset + sizeof(VbKernelPreambleHeader) > kbuf_read)
+		return 0;
+
+	preamble = (const VbKernelPreambleHeader *)(kbuf + offset);
+	end = part_bytes;
+	if (preamble->preamble_size <= part_bytes - offset &&
+	    preamble->body_signature.data_size <=
+	    part_bytes - offset - preamble->preamble_size)
+		end = offset + preamble->preamble_size +
+			preamble->body_signature.data_size;
+
+	/* Streams read whole sectors */
+	end = (end + blba - 1) / blba * blba;
+	if (end > kbuf_read)
+		VbExStreamPrefetch(stream, end - kbuf_read);
+	return 1;
+}
+#endif
+
+/**
+ * Find where [size] bytes the preamble places at [address] are in the kernel
+ * body, which is loaded at body_load_address.
+ *
+ * Returns their offset in the body, or (uint64_t)-1 if they aren't all in it.
+ */
+static uint64_t BodyOffset(const VbKernelPreambleHeader *preamble,
+			   uint64_t address, uint64_t size)
+{
+	uint32_t compression;
+	uint64_t body_size;
+	uint64_t offset;
+
+	VbGetKernelBodyCompression(preamble, &compression, &body_size);
+
+	if (address < preamble->body_load_address)
+		return (uint64_t)-1;
+	offset = address - preamble->body_load_address;
+	if (offset > body_size || size > body_size - offset)
+		return (uint64_t)-1;
+	return offset;
+}
+
 VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 {
 	VbSharedDataHeader *shared =
 		(VbSharedDataHeader *)params->shared_data_blob;
 	VbSharedDataKernelCall *shcall = NULL;
+	VbSharedDataKernelCallIo *shcall_io = NULL;
 	VbNvContext* vnc = params->nv_context;
-	VbPublicKey* kernel_subkey = NULL;
-	int free_kernel_subkey = 0;
+	const VbPublicKey *kernel_subkey = NULL;
+	RSAPublicKey kernel_rsa;
+	PublicKeyCache key_cache;
 	GptData gpt;
 	uint64_t part_start, part_size;
 	uint64_t blba;
-	uint64_t kbuf_sectors;
 	uint8_t* kbuf = NULL;
+	uint32_t kbuf_size;
+	uint32_t kbuf_read_size;
 	int found_partitions = 0;
 	int good_partition = -1;
 	int good_partition_key_block_valid = 0;
 	uint32_t lowest_version = LOWEST_TPM_VERSION;
 	int rec_switch, dev_switch;
+	uint64_t dev_flag;
 	BootMode boot_mode;
 	uint32_t require_official_os = 0;
+	int hash_first = 0;
 	uint32_t body_toread;
 	uint8_t *body_readptr;
+	uint8_t *body_buffer;
+	uint64_t body_buffer_size;
+	uint64_t body_load_size;
+	uint32_t body_compression;
+	void *resolved;
+	DigestContext body_ctx;
+	BodySink body_sink;
+	uint8_t body_digest[MAX_DIGEST_SIZE];
+	struct vb2_workbuf wb_saved;
+	int rv;
 
 	VbError_t retval = VBERROR_UNKNOWN;
 	int recovery = VBNV_RECOVERY_LK_UNSPECIFIED;
 
+	VbSharedDataRecordTimestamp(shared, VBSD_TS_LOAD_KERNEL_ENTER);
+	VbWorkbufSave(&wb_saved);
+
 	/* Sanity Checks */
 	if (!params->bytes_per_lba ||
 	    !params->streaming_lba_count) {
@@ -68,15 +278,23 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 	params->bootloader_address = 0;
 	params->bootloader_size = 0;
 	params->flags = 0;
+	params->bootloader_offset = (uint64_t)-1;
+	params->vmlinuz_header_offset = 0;
+	params->vmlinuz_header_size = 0;
 
 	/* Calculate switch positions and boot mode */
 	rec_switch = (BOOT_FLAG_RECOVERY & params->boot_flags ? 1 : 0);
 	dev_switch = (BOOT_FLAG_DEVELOPER & params->boot_flags ? 1 : 0);
+	dev_flag = (dev_switch ? KEY_BLOCK_FLAG_DEVELOPER_1 :
+		    KEY_BLOCK_FLAG_DEVELOPER_0);
 	if (rec_switch) {
 		boot_mode = kBootRecovery;
 	} else if (dev_switch) {
 		boot_mode = kBootDev;
 		VbNvGet(vnc, VBNV_DEV_BOOT_SIGNED_ONLY, &require_official_os);
+		hash_first = !require_official_os &&
+			(params->boot_flags &
+			 BOOT_FLAG_DEV_KEY_BLOCK_HASH_FIRST ? 1 : 0);
 	} else {
 		boot_mode = kBootNormal;
 	}
@@ -92,35 +310,77 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 	shcall->boot_mode = boot_mode;
 	shcall->sector_size = (uint32_t)params->bytes_per_lba;
 	shcall->sector_count = params->streaming_lba_count;
+	if (shared->struct_version >= 3 &&
+	    shared->struct_size >= sizeof(VbSharedDataHeader)) {
+		/* Older or short structs have no room to count disk reads */
+		shcall_io = shared->lk_call_io + (shared->lk_call_count
+					& (VBSD_MAX_KERNEL_CALLS - 1));
+		Memset(shcall_io, 0, sizeof(VbSharedDataKernelCallIo));
+	}
 	shared->lk_call_count++;
 
 	/* Initialization */
 	blba = params->bytes_per_lba;
-	kbuf_sectors = KBUF_SIZE / blba;
-	if (0 == kbuf_sectors) {
+	if (0 == blba || blba > KBUF_SIZE) {
 		VBDEBUG(("LoadKernel() called with sector size > KBUF_SIZE\n"));
 		retval = VBERROR_INVALID_PARAMETER;
 		goto LoadKernelExit;
 	}
 
+	/*
+	 * Remember converted keys, so the kernel subkey (and a data key
+	 * shared by several partitions) is only converted once.
+	 */
+	Memset(&key_cache, 0, sizeof(key_cache));
+
+	/* Read whole sectors of header from each partition */
+	kbuf_read_size = KBUF_SIZE;
+	if (params->header_read_size) {
+		kbuf_read_size = KBUF_MAX_SIZE;
+		if (params->header_read_size < KBUF_MAX_SIZE)
+			kbuf_read_size = (uint32_t)
+				((params->header_read_size + blba - 1) /
+				 blba * blba);
+	}
+
 	if (kBootRecovery == boot_mode) {
 		/* Use the recovery key to verify the kernel */
-		retval = VbGbbReadRecoveryKey(cparams, &kernel_subkey);
+		retval = VbGbbGetRecoveryKey(cparams, &kernel_subkey);
 		if (VBERROR_SUCCESS != retval)
 			goto LoadKernelExit;
-		free_kernel_subkey = 1;
 	} else {
 		/* Use the kernel subkey passed from LoadFirmware(). */
 		kernel_subkey = &shared->kernel_subkey;
 	}
 
+	/*
+	 * Either key already holds n0inv and R^2, so verify with it where it
+	 * is instead of converting a copy.  If it can't be used in place, the
+	 * cache converts it as usual, and reports a bad key the same way.
+	 */
+	if (!PublicKeyToRSAInPlace(kernel_subkey, &kernel_rsa))
+		PublicKeyCacheLend(&key_cache, &kernel_rsa);
+
 	/* Read GPT data */
 	gpt.sector_bytes = (uint32_t)blba;
 	gpt.streaming_drive_sectors = params->streaming_lba_count;
 	gpt.gpt_drive_sectors = params->gpt_lba_count;
 	gpt.flags = params->boot_flags & BOOT_FLAG_EXTERNAL_GPT
 			? GPT_FLAG_EXTERNAL : 0;
-	if (0 != AllocAndReadGptData(params->disk_handle, &gpt)) {
+	/* Recovery always checks both copies of the GPT */
+	if ((params->boot_flags & BOOT_FLAG_LAZY_SECONDARY_GPT) &&
+	    kBootRecovery != boot_mode) {
+		gpt.flags |= GPT_FLAG_LAZY_SECONDARY;
+		if (params->boot_flags & BOOT_FLAG_LAZY_SECONDARY_GPT_WRITE)
+			gpt.flags |= GPT_FLAG_LAZY_SECONDARY_WRITE;
+	}
+	rv = AllocAndReadGptData(params->disk_handle, &gpt);
+	if (shcall_io) {
+		shcall_io->gpt.read_ticks = gpt.read_ticks;
+		shcall_io->gpt.read_bytes = (uint32_t)gpt.read_bytes;
+		shcall_io->gpt.read_calls = gpt.read_calls;
+	}
+	if (0 != rv) {
 		VBDEBUG(("Unable to read GPT data\n"));
 		shcall->check_result = VBSD_LKC_CHECK_GPT_READ_ERROR;
 		goto bad_gpt;
@@ -134,7 +394,8 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 	}
 
 	/* Allocate kernel header buffers */
-	kbuf = (uint8_t*)VbExMalloc(KBUF_SIZE);
+	kbuf_size = kbuf_read_size;
+	kbuf = (uint8_t*)VbWorkbufAlloc(kbuf_size);
 	if (!kbuf)
 		goto bad_gpt;
 
@@ -142,14 +403,27 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
         while (GPT_SUCCESS ==
 	       GptNextKernelEntry(&gpt, &part_start, &part_size)) {
 		VbSharedDataKernelPart *shpart = NULL;
+		VbSharedDataIoStats *shio = NULL;
 		VbKeyBlockHeader *key_block;
 		VbKernelPreambleHeader *preamble;
 		RSAPublicKey *data_key = NULL;
 		VbExStream_t stream = NULL;
+		/* Compressed body as read, and its buffer if it has one */
+		uint8_t *body_data = NULL;
+		uint8_t *body_data_alloc = NULL;
 		uint64_t key_version;
 		uint32_t combined_version;
 		uint64_t body_offset;
+		uint32_t kbuf_read;
 		int key_block_valid = 1;
+		int body_partial;
+#ifdef DISK_READ_ASYNC
+		/*
+		 * Only the best partition's body is read; the rest are just
+		 * checked for rollback, so there's no point fetching theirs.
+		 */
+		int prefetched = (-1 != good_partition);
+#endif
 
 		VBDEBUG(("Found kernel entry at %" PRIu64 " size %" PRIu64 "\n",
 			 part_start, part_size));
@@ -169,6 +443,11 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 		 * 0.  Adjust here, until cgptlib is fixed.
 		 */
 		shpart->gpt_index = (uint8_t)(gpt.current_kernel + 1);
+		if (shcall_io) {
+			shio = shcall_io->parts + (shcall->kernel_parts_found
+					& (VBSD_MAX_KERNEL_PARTS - 1));
+			Memset(shio, 0, sizeof(VbSharedDataIoStats));
+		}
 		shcall->kernel_parts_found++;
 
 		/* Found at least one kernel partition. */
@@ -182,18 +461,97 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 			goto bad_kernel;
 		}
 
-		if (0 != VbExStreamRead(stream, KBUF_SIZE, kbuf)) {
+		kbuf_read = kbuf_read_size;
+		if (0 != StreamRead(stream, kbuf_read, kbuf, shio) ||
+		    0 != ReadMoreHeader(stream, blba,
+				((VbKeyBlockHeader *)kbuf)->key_block_size,
+				&kbuf, &kbuf_size, &kbuf_read, shio)) {
 			VBDEBUG(("Unable to read start of partition.\n"));
 			shpart->check_result = VBSD_LKP_CHECK_READ_START;
 			goto bad_kernel;
 		}
 
-		/* Verify the key block. */
+#ifdef DISK_READ_ASYNC
+		/*
+		 * The partitions are tried best first, so this one's body is
+		 * most likely the one booted.  Start reading it now, so it's
+		 * on its way while the signatures are checked.
+		 */
+		if (!prefetched)
+			prefetched = PrefetchBody(stream, kbuf, kbuf_read,
+						  part_size * blba, blba);
+#endif
+
+		/*
+		 * Check the key block flags against the current boot mode,
+		 * and the key version for rollback except in recovery mode.
+		 * Neither needs the signature, so check them first; unless in
+		 * developer mode, a key block which fails them is rejected
+		 * without spending time verifying its signature.
+		 */
 		key_block = (VbKeyBlockHeader*)kbuf;
-		if (0 != KeyBlockVerify(key_block, KBUF_SIZE,
-					kernel_subkey, 0)) {
+		rv = KeyBlockPreVerify(key_block, kbuf_read,
+				       dev_flag | (rec_switch ?
+						   KEY_BLOCK_FLAG_RECOVERY_1 :
+						   KEY_BLOCK_FLAG_RECOVERY_0),
+				       kBootRecovery == boot_mode ? 0 :
+				       shared->kernel_version_tpm >> 16);
+		key_version = key_block->data_key.key_version;
+		if (rv == VBOOT_KEY_BLOCK_FLAGS ||
+		    rv == VBOOT_KEY_BLOCK_VERSION) {
+			/*
+			 * Work out which check failed.  When several did, the
+			 * later ones here take precedence in check_result.
+			 */
+			if (!(key_block->key_block_flags & dev_flag)) {
+				VBDEBUG(("Key block developer flag "
+					 "mismatch.\n"));
+				shpart->check_result =
+					VBSD_LKP_CHECK_DEV_MISMATCH;
+				key_block_valid = 0;
+			}
+			if (!(key_block->key_block_flags &
+			      (rec_switch ? KEY_BLOCK_FLAG_RECOVERY_1 :
+			       KEY_BLOCK_FLAG_RECOVERY_0))) {
+				VBDEBUG(("Key block recovery flag "
+					 "mismatch.\n"));
+				shpart->check_result =
+					VBSD_LKP_CHECK_REC_MISMATCH;
+				key_block_valid = 0;
+			}
+			if (kBootRecovery != boot_mode &&
+			    (key_version < (shared->kernel_version_tpm >> 16) ||
+			     key_version > 0xFFFF)) {
+				VBDEBUG(("Key version too old or too big.\n"));
+				shpart->check_result =
+					VBSD_LKP_CHECK_KEY_ROLLBACK;
+				key_block_valid = 0;
+			}
+		}
+
+		/* If not in developer mode, key block required to be valid. */
+		if (kBootDev != boot_mode && !key_block_valid) {
+			VBDEBUG(("Key block is invalid.\n"));
+			goto bad_kernel;
+		}
+
+		/*
+		 * Verify the key block.  If asked to, a developer mode boot
+		 * which allows self-signed kernels takes a good hash without
+		 * spending time on a signature self-signed kernels will fail.
+		 */
+		if (hash_first && 0 == KeyBlockVerify(key_block, kbuf_read,
+						      kernel_subkey, 1)) {
+			VBDEBUG(("Key block hash good; sig not checked.\n"));
+			key_block_valid = 0;
+		} else if (0 != KeyBlockVerifyCached(key_block, kbuf_read,
+						     kernel_subkey, 0,
+						     &key_cache)) {
 			VBDEBUG(("Verifying key block signature failed.\n"));
-			shpart->check_result = VBSD_LKP_CHECK_KEY_BLOCK_SIG;
+			/* Keep the reason from the checks above, if any */
+			if (key_block_valid)
+				shpart->check_result =
+					VBSD_LKP_CHECK_KEY_BLOCK_SIG;
 			key_block_valid = 0;
 
 			/* If not in developer mode, this kernel is bad. */
@@ -215,7 +573,7 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 			 * Allow the kernel if the SHA-512 hash of the key
 			 * block is valid.
 			 */
-			if (0 != KeyBlockVerify(key_block, KBUF_SIZE,
+			if (0 != KeyBlockVerify(key_block, kbuf_read,
 						kernel_subkey, 1)) {
 				VBDEBUG(("Verifying key block hash failed.\n"));
 				shpart->check_result =
@@ -224,64 +582,47 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 			}
 		}
 
-		/* Check the key block flags against the current boot mode. */
-		if (!(key_block->key_block_flags &
-		      (dev_switch ? KEY_BLOCK_FLAG_DEVELOPER_1 :
-		       KEY_BLOCK_FLAG_DEVELOPER_0))) {
-			VBDEBUG(("Key block developer flag mismatch.\n"));
-			shpart->check_result = VBSD_LKP_CHECK_DEV_MISMATCH;
-			key_block_valid = 0;
-		}
-		if (!(key_block->key_block_flags &
-		      (rec_switch ? KEY_BLOCK_FLAG_RECOVERY_1 :
-		       KEY_BLOCK_FLAG_RECOVERY_0))) {
-			VBDEBUG(("Key block recovery flag mismatch.\n"));
-			shpart->check_result = VBSD_LKP_CHECK_REC_MISMATCH;
-			key_block_valid = 0;
-		}
-
-		/* Check for rollback of key version except in recovery mode. */
-		key_version = key_block->data_key.key_version;
-		if (kBootRecovery != boot_mode) {
-			if (key_version < (shared->kernel_version_tpm >> 16)) {
-				VBDEBUG(("Key version too old.\n"));
-				shpart->check_result =
-					VBSD_LKP_CHECK_KEY_ROLLBACK;
-				key_block_valid = 0;
-			}
-			if (key_version > 0xFFFF) {
-				/*
-				 * Key version is stored in 16 bits in the TPM,
-				 * so key versions greater than 0xFFFF can't be
-				 * stored properly.
-				 */
-				VBDEBUG(("Key version > 0xFFFF.\n"));
-				shpart->check_result =
-					VBSD_LKP_CHECK_KEY_ROLLBACK;
-				key_block_valid = 0;
-			}
-		}
-
-		/* If not in developer mode, key block required to be valid. */
-		if (kBootDev != boot_mode && !key_block_valid) {
-			VBDEBUG(("Key block is invalid.\n"));
-			goto bad_kernel;
-		}
-
 		/* Get key for preamble/data verification from the key block. */
-		data_key = PublicKeyToRSA(&key_block->data_key);
+		data_key = PublicKeyCacheGet(&key_cache, &key_block->data_key);
 		if (!data_key) {
 			VBDEBUG(("Data key bad.\n"));
 			shpart->check_result = VBSD_LKP_CHECK_DATA_KEY_PARSE;
 			goto bad_kernel;
 		}
 
-		/* Verify the preamble, which follows the key block */
+		/*
+		 * Read the rest of the preamble, which follows the key block,
+		 * if it didn't all fit.  Its size isn't verified yet, but
+		 * it's only used to decide how much to read.
+		 */
+		body_offset = key_block->key_block_size;
+		if (0 != ReadMoreHeader(stream, blba,
+				body_offset + sizeof(VbKernelPreambleHeader),
+				&kbuf, &kbuf_size, &kbuf_read, shio) ||
+		    (body_offset + sizeof(VbKernelPreambleHeader) <= kbuf_read &&
+		     0 != ReadMoreHeader(stream, blba, body_offset +
+				((VbKernelPreambleHeader *)
+				 (kbuf + body_offset))->preamble_size,
+				&kbuf, &kbuf_size, &kbuf_read, shio))) {
+			VBDEBUG(("Unable to read kernel preamble.\n"));
+			shpart->check_result = VBSD_LKP_CHECK_READ_START;
+			goto bad_kernel;
+		}
+		key_block = (VbKeyBlockHeader*)kbuf;
+
+#ifdef DISK_READ_ASYNC
+		/* If the preamble didn't fit before, it's been read now */
+		if (!prefetched)
+			prefetched = PrefetchBody(stream, kbuf, kbuf_read,
+						  part_size * blba, blba);
+#endif
+
+		/* Verify the preamble */
 		preamble = (VbKernelPreambleHeader *)
 			(kbuf + key_block->key_block_size);
 		if ((0 != VerifyKernelPreamble(
 					preamble,
-					KBUF_SIZE - key_block->key_block_size,
+					kbuf_read - key_block->key_block_size,
 					data_key))) {
 			VBDEBUG(("Preamble verification failed.\n"));
 			shpart->check_result = VBSD_LKP_CHECK_VERIFY_PREAMBLE;
@@ -313,6 +654,20 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 		VBDEBUG(("Kernel preamble is good.\n"));
 		shpart->check_result = VBSD_LKP_CHECK_PREAMBLE_VALID;
 
+		/*
+		 * Later partitions are almost always signed the same way, so
+		 * unless told otherwise, read only as much as these headers
+		 * took.  That skips reading body data we'd throw away when
+		 * just checking versions, and lets a body stream straight
+		 * into the kernel buffer.
+		 */
+		body_offset = key_block->key_block_size +
+			preamble->preamble_size;
+		if (!params->header_read_size && body_offset &&
+		    body_offset <= kbuf_read)
+			kbuf_read_size = (uint32_t)
+				((body_offset + blba - 1) / blba * blba);
+
 		/* Check for lowest version from a valid header. */
 		if (key_block_valid && lowest_version > combined_version)
 			lowest_version = combined_version;
@@ -330,37 +685,48 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 		if (-1 != good_partition) {
 			VbExStreamClose(stream);
 			stream = NULL;
+			PublicKeyCacheRelease(&key_cache, data_key);
+			data_key = NULL;
 			continue;
 		}
 
-		body_offset = key_block->key_block_size +
-			preamble->preamble_size;
-
 		/*
 		 * Make sure the kernel starts at or before what we already
-		 * read into kbuf.
-		 *
-		 * We could deal with a larger offset by reading and discarding
-		 * the data in between the vblock and the kernel data.
+		 * read into kbuf.  We read the whole preamble, so this only
+		 * fails if the preamble size is bogus.
 		 */
-		if (body_offset > KBUF_SIZE) {
+		if (body_offset > kbuf_read) {
 			shpart->check_result = VBSD_LKP_CHECK_BODY_OFFSET;
-			VBDEBUG(("Kernel body offset is %d > 64KB.\n",
-				 (int)body_offset));
+			VBDEBUG(("Kernel body offset is %d > %d.\n",
+				 (int)body_offset, (int)kbuf_read));
 			goto bad_kernel;
 		}
 
-		if (!params->kernel_buffer) {
+		/*
+		 * If the platform can say where the body will run from, read
+		 * it straight there, so it doesn't have to be copied again.
+		 * Only the buffer of a good kernel is passed back.
+		 */
+		VbGetKernelBodyCompression(preamble, &body_compression,
+					   &body_load_size);
+		resolved = NULL;
+		if (VBERROR_SUCCESS == VbExKernelBufferResolve(
+			    preamble->body_load_address,
+			    body_load_size, &resolved) &&
+		    resolved) {
+			body_buffer = resolved;
+			body_buffer_size = body_load_size;
+		} else if (!params->kernel_buffer) {
 			/* Get kernel load address and size from the header. */
-			params->kernel_buffer =
-				(void *)((long)preamble->body_load_address);
-			params->kernel_buffer_size =
-				preamble->body_signature.data_size;
-		} else if (preamble->body_signature.data_size >
-			   params->kernel_buffer_size) {
+			body_buffer = (uint8_t *)((long)preamble->body_load_address);
+			body_buffer_size = body_load_size;
+		} else if (body_load_size > params->kernel_buffer_size) {
 			VBDEBUG(("Kernel body doesn't fit in memory.\n"));
 			shpart->check_result = VBSD_LKP_CHECK_BODY_EXCEEDS_MEM;
 			goto bad_kernel;
+		} else {
+			body_buffer = params->kernel_buffer;
+			body_buffer_size = params->kernel_buffer_size;
 		}
 
 		/*
@@ -371,27 +737,88 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 		 * to verify it.
 		 */
 		body_toread = preamble->body_signature.data_size;
-		body_readptr = params->kernel_buffer;
+		body_readptr = body_buffer;
+		Memset(&body_sink, 0, sizeof(body_sink));
+
+		/*
+		 * A compressed body is read in after the space it decompresses
+		 * to, if the kernel buffer has room, or into a buffer of its
+		 * own if not.  The platform may decompress it as it's read;
+		 * otherwise it's decompressed once it's verified.
+		 */
+		if (COMPRESS_NONE != body_compression) {
+			if (body_buffer_size - body_load_size >= body_toread) {
+				body_data = body_buffer +
+					body_buffer_size - body_toread;
+			} else {
+				body_data_alloc = VbExMalloc(body_toread);
+				body_data = body_data_alloc;
+			}
+			body_readptr = body_data;
+
+			rv = VbExDecompressStreamOpenMemory(
+				body_compression, body_buffer,
+				(uint32_t)body_load_size,
+				&body_sink.decompress);
+			if (VBERROR_DECOMPRESS_STREAM_UNSUPPORTED == rv) {
+				body_sink.decompress = NULL;
+			} else if (rv) {
+				VBDEBUG(("Can't decompress kernel body.\n"));
+				shpart->check_result =
+					VBSD_LKP_CHECK_DECOMPRESS;
+				goto bad_kernel;
+			}
+		}
 
 		/*
-		 * If we've already read part of the kernel, copy that to the
-		 * beginning of the kernel buffer.
+		 * If the OS will check the body blocks as it uses them, only
+		 * the blocks needed to boot are checked here, once the whole
+		 * body is read.  Recovery kernels are always checked in full.
 		 */
-		if (body_offset < KBUF_SIZE) {
-			uint32_t body_copied = KBUF_SIZE - body_offset;
+		body_partial = (params->boot_flags &
+				BOOT_FLAG_PARTIAL_BODY_CHECK) &&
+			kBootRecovery != boot_mode &&
+			VbKernelHasBodyHashes(preamble) == VBOOT_SUCCESS;
+
+		/*
+		 * Otherwise, hash the body as it arrives, a chunk at a time, so
+		 * each chunk is hashed while it's still in the cache instead
+		 * of going back over the whole body after reading it.
+		 */
+		if (!body_partial) {
+			DigestInit(&body_ctx, data_key->algorithm);
+			body_sink.ctx = &body_ctx;
+		}
+
+		/*
+		 * If we've already read part of the kernel, hash it where it
+		 * is and copy it to where the rest will be read.
+		 */
+		if (body_offset < kbuf_read) {
+			uint32_t body_copied = kbuf_read - body_offset;
 
 			/* If the kernel is tiny, don't over-copy */
 			if (body_copied > body_toread)
 				body_copied = body_toread;
 
+			BodyChunkDone(&body_sink, kbuf + body_offset,
+				      body_copied);
 			Memcpy(body_readptr, kbuf + body_offset, body_copied);
 			body_toread -= body_copied;
 			body_readptr += body_copied;
 		}
 
-		/* Read the kernel data */
-		if (body_toread &&
-		    0 != VbExStreamRead(stream, body_toread, body_readptr)) {
+		/* Read and hash the kernel data */
+		rv = body_toread ? ReadBody(stream, body_toread, body_readptr,
+					    &body_sink, shio) : 0;
+		if (body_sink.decompress) {
+			VbError_t close_rv =
+				VbExDecompressStreamClose(body_sink.decompress);
+
+			if (!body_sink.decompress_rv)
+				body_sink.decompress_rv = close_rv;
+		}
+		if (0 != rv) {
 			VBDEBUG(("Unable to read kernel data.\n"));
 			shpart->check_result = VBSD_LKP_CHECK_READ_DATA;
 			goto bad_kernel;
@@ -401,17 +828,65 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 		VbExStreamClose(stream);
 		stream = NULL;
 
-		/* Verify kernel data */
-		if (0 != VerifyData((const uint8_t *)params->kernel_buffer,
-				    params->kernel_buffer_size,
-				    &preamble->body_signature, data_key)) {
+		if (body_partial) {
+			/* Check the decompressor, cmdline and bootloader */
+			uint64_t tail = preamble->body_hash_tail_offset;
+
+			rv = VerifyKernelBodyBlocks(
+				preamble, body_buffer, 0,
+				preamble->body_hash_head_size, data_key);
+			if (0 == rv)
+				rv = VerifyKernelBodyBlocks(
+					preamble, body_buffer, tail,
+					preamble->body_signature.data_size -
+					tail, data_key);
+		} else {
+			/* Verify kernel data; all that's left is the sig */
+			rv = DigestFinalInto(&body_ctx, body_digest,
+					     sizeof(body_digest));
+			if (0 == rv)
+				rv = VerifyDigest(body_digest,
+						  &preamble->body_signature,
+						  data_key);
+		}
+		if (0 != rv) {
 			VBDEBUG(("Kernel data verification failed.\n"));
 			shpart->check_result = VBSD_LKP_CHECK_VERIFY_DATA;
 			goto bad_kernel;
 		}
 
+		/* Now it's verified, decompress the body if it wasn't already */
+		if (COMPRESS_NONE != body_compression) {
+			uint32_t body_size = preamble->body_signature.data_size;
+			uint32_t out_size = (uint32_t)body_load_size;
+
+			if (body_sink.decompress) {
+				rv = body_sink.decompress_rv;
+			} else {
+				rv = VbExDecompress(body_data, body_size,
+						    body_compression,
+						    body_buffer, &out_size);
+				if (!rv && out_size != body_load_size)
+					rv = VBERROR_UNKNOWN;
+			}
+			VB2_CRYPTO_STATS_ADD(decompress_calls, 1);
+			VB2_CRYPTO_STATS_ADD(decompress_in_bytes, body_size);
+			VB2_CRYPTO_STATS_ADD(decompress_out_bytes, out_size);
+			if (body_data_alloc) {
+				VbExFree(body_data_alloc);
+				body_data_alloc = NULL;
+			}
+			if (0 != rv) {
+				VBDEBUG(("Kernel data won't decompress.\n"));
+				shpart->check_result =
+					VBSD_LKP_CHECK_DECOMPRESS;
+				goto bad_kernel;
+			}
+			shpart->flags |= VBSD_LKP_FLAG_BODY_COMPRESSED;
+		}
+
 		/* Done with the kernel signing key, so can free it now */
-		RSAPublicKeyFree(data_key);
+		PublicKeyCacheRelease(&key_cache, data_key);
 		data_key = NULL;
 
 		/*
@@ -422,6 +897,8 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 		shpart->check_result = VBSD_LKP_CHECK_KERNEL_GOOD;
 		if (key_block_valid)
 			shpart->flags |= VBSD_LKP_FLAG_KEY_BLOCK_VALID;
+		if (body_partial)
+			shpart->flags |= VBSD_LKP_FLAG_BODY_PARTIAL;
 
 		good_partition_key_block_valid = key_block_valid;
 		/*
@@ -436,8 +913,23 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 		 * size, or the dest should be a struct, so we know it's big
 		 * enough.
 		 */
+		params->kernel_buffer = body_buffer;
+		params->kernel_buffer_size = body_buffer_size;
 		params->bootloader_address = preamble->bootloader_address;
 		params->bootloader_size = preamble->bootloader_size;
+		params->bootloader_offset = BodyOffset(
+			preamble, preamble->bootloader_address,
+			preamble->bootloader_size);
+		VbGetKernelVmlinuzHeader(preamble,
+					 &params->vmlinuz_header_offset,
+					 &params->vmlinuz_header_size);
+		params->vmlinuz_header_offset = BodyOffset(
+			preamble, params->vmlinuz_header_offset,
+			params->vmlinuz_header_size);
+		if (params->vmlinuz_header_offset == (uint64_t)-1) {
+			params->vmlinuz_header_offset = 0;
+			params->vmlinuz_header_size = 0;
+		}
 		if (VbKernelHasFlags(preamble) == VBOOT_SUCCESS)
 			params->flags = preamble->flags;
 
@@ -474,7 +966,9 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 		if (NULL != stream)
 			VbExStreamClose(stream);
 		if (NULL != data_key)
-			RSAPublicKeyFree(data_key);
+			PublicKeyCacheRelease(&key_cache, data_key);
+		if (NULL != body_data_alloc)
+			VbExFree(body_data_alloc);
 
 		VBDEBUG(("Marking kernel as invalid.\n"));
 		GptUpdateKernelEntry(&gpt, GPT_UPDATE_ENTRY_BAD);
@@ -485,8 +979,10 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
  bad_gpt:
 
 	/* Free kernel buffer */
-	if (kbuf)
-		VbExFree(kbuf);
+	VbWorkbufFree(kbuf);
+
+	/* Free converted keys */
+	PublicKeyCacheFree(&key_cache);
 
 	/* Write and free GPT data */
 	WriteAndFreeGptData(params->disk_handle, &gpt);
@@ -535,11 +1031,13 @@ VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 	if (good_partition_key_block_valid)
 		shared->flags |= VBSD_KERNEL_KEY_VERIFIED;
 
+	VbSharedDataRecordTimestamp(shared, VBSD_TS_LOAD_KERNEL_EXIT);
+
 	/* Store how much shared data we used, if any */
 	params->shared_data_size = shared->data_used;
 
-	if (free_kernel_subkey)
-		VbExFree(kernel_subkey);
+	/* Reclaim everything allocated from the work buffer */
+	VbWorkbufRestore(&wb_saved);
 
 	return retval;
 }
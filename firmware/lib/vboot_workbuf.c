@@ -0,0 +1,75 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Work buffer for short-lived allocations while selecting a kernel.
+ */
+
+#include "sysincludes.h"
+
+#include "utility.h"
+#include "vboot_api.h"
+#include "vboot_workbuf.h"
+
+/* Unused part of the work buffer, and where the whole of it starts and ends */
+static struct vb2_workbuf workbuf;
+static uint8_t *workbuf_start;
+static uint8_t *workbuf_end;
+static uint32_t workbuf_peak;
+
+static int WorkbufOwns(const void *ptr)
+{
+	return workbuf_start && (const uint8_t *)ptr >= workbuf_start &&
+		(const uint8_t *)ptr < workbuf_end;
+}
+
+void VbWorkbufInit(void *buf, uint32_t size)
+{
+	vb2_workbuf_init(&workbuf, buf, buf ? size : 0);
+	workbuf_start = workbuf.size ? workbuf.buf : NULL;
+	workbuf_end = workbuf.buf + workbuf.size;
+	workbuf_peak = 0;
+}
+
+void *VbWorkbufAlloc(uint32_t size)
+{
+	void *ptr;
+
+	if (workbuf_start) {
+		/* Take at least a byte, so the pointer is inside the buffer */
+		ptr = vb2_workbuf_alloc(&workbuf, size ? size : 1);
+		if (ptr) {
+			if (workbuf.buf - workbuf_start > workbuf_peak)
+				workbuf_peak = workbuf.buf - workbuf_start;
+			return ptr;
+		}
+		VBDEBUG(("Work buffer full; using VbExMalloc(%d)\n",
+			 (int)size));
+	}
+
+	return VbExMalloc(size);
+}
+
+void VbWorkbufFree(void *ptr)
+{
+	if (ptr && !WorkbufOwns(ptr))
+		VbExFree(ptr);
+}
+
+void VbWorkbufSave(struct vb2_workbuf *saved)
+{
+	*saved = workbuf;
+}
+
+void VbWorkbufRestore(const struct vb2_workbuf *saved)
+{
+	/* Ignore states saved from some other work buffer, or none */
+	if (WorkbufOwns(saved->buf) || (workbuf_start &&
+					saved->buf == workbuf_end))
+		workbuf = *saved;
+}
+
+uint32_t VbWorkbufPeak(void)
+{
+	return workbuf_peak;
+}
@@ -19,8 +19,11 @@ int vb2api_fw_phase3(struct vb2_context *ctx)
 {
 	int rv;
 
+	vb2_record_timestamp(ctx, VB2_TS_FW_PHASE3_ENTER);
+
 	/* Verify firmware keyblock */
 	rv = vb2_load_fw_keyblock(ctx);
+	vb2_record_timestamp(ctx, VB2_TS_FW_KEYBLOCK_EXIT);
 	if (rv) {
 		vb2_fail(ctx, VB2_RECOVERY_RO_INVALID_RW, rv);
 		return rv;
@@ -28,6 +31,7 @@ int vb2api_fw_phase3(struct vb2_context *ctx)
 
 	/* Verify firmware preamble */
 	rv = vb2_load_fw_preamble(ctx);
+	vb2_record_timestamp(ctx, VB2_TS_FW_PREAMBLE_EXIT);
 	if (rv) {
 		vb2_fail(ctx, VB2_RECOVERY_RO_INVALID_RW, rv);
 		return rv;
@@ -45,6 +49,8 @@ int vb2api_init_hash(struct vb2_context *ctx, uint32_t tag, uint32_t *size)
 	struct vb2_workbuf wb;
 	int rv;
 
+	vb2_record_timestamp(ctx, VB2_TS_FW_INIT_HASH);
+
 	vb2_workbuf_from_ctx(ctx, &wb);
 
 	if (tag == VB2_HASH_TAG_INVALID)
@@ -121,7 +127,7 @@ int vb2api_init_hash(struct vb2_context *ctx, uint32_t tag, uint32_t *size)
 	return vb2_digest_init(dc, key.hash_alg);
 }
 
-int vb2api_check_hash(struct vb2_context *ctx)
+static int check_hash(struct vb2_context *ctx)
 {
 	struct vb2_shared_data *sd = vb2_get_sd(ctx);
 	struct vb2_digest_context *dc = (struct vb2_digest_context *)
@@ -135,6 +141,9 @@ int vb2api_check_hash(struct vb2_context *ctx)
 	struct vb2_public_key key;
 	int rv;
 
+	sd->body_hash_alg = VB2_HASH_INVALID;
+	sd->flags &= ~VB2_SD_FLAG_BODY_COMPRESSED;
+
 	vb2_workbuf_from_ctx(ctx, &wb);
 
 	/* Get preamble pointer */
@@ -183,13 +192,77 @@ int vb2api_check_hash(struct vb2_context *ctx)
 	if (rv)
 		return rv;
 
-	/*
-	 * Check digest vs. signature.  Note that this destroys the signature.
-	 * That's ok, because we only check each signature once per boot.
-	 */
+	/* Check digest vs. signature */
 	rv = vb2_verify_digest(&key, &pre->body_signature, digest, &wb);
-	if (rv)
+	if (rv) {
 		vb2_fail(ctx, VB2_RECOVERY_FW_BODY, rv);
+		return rv;
+	}
+
+	/* Keep the digest for measurement */
+	sd->body_hash_alg = dc->hash_alg;
+	memcpy(sd->body_digest, digest, digest_size);
+
+	if (pre->flags & VB2_FIRMWARE_PREAMBLE_BODY_COMPRESSED)
+		sd->flags |= VB2_SD_FLAG_BODY_COMPRESSED;
 
+	return VB2_SUCCESS;
+}
+
+int vb2api_check_hash(struct vb2_context *ctx)
+{
+	int rv;
+
+	vb2_record_timestamp(ctx, VB2_TS_FW_CHECK_HASH_ENTER);
+	rv = check_hash(ctx);
+	vb2_record_timestamp(ctx, VB2_TS_FW_CHECK_HASH_EXIT);
 	return rv;
 }
+
+int vb2api_verify_fw_slot(struct vb2_context *ctx,
+			  int slot,
+			  const void *body,
+			  uint32_t body_size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	uint32_t size;
+	int rv;
+
+	if (slot != 0 && slot != 1)
+		return VB2_ERROR_API_VERIFY_SLOT_NUM;
+
+	/* Only a fresh context knows nothing about the slot */
+	if ((sd->status & VB2_SD_STATUS_CHOSE_SLOT) ||
+	    sd->workbuf_data_key_size || sd->workbuf_preamble_size)
+		return VB2_ERROR_API_VERIFY_SLOT_STATE;
+
+	/* A cached result would just say the slot was good last time */
+	ctx->flags &= ~VB2_CONTEXT_VERIFY_CACHE;
+
+	sd->fw_slot = slot;
+	if (slot)
+		ctx->flags |= VB2_CONTEXT_FW_SLOT_B;
+	else
+		ctx->flags &= ~VB2_CONTEXT_FW_SLOT_B;
+
+	rv = vb2_load_fw_keyblock(ctx);
+	if (rv)
+		return rv;
+
+	rv = vb2_load_fw_preamble(ctx);
+	if (rv)
+		return rv;
+
+	rv = vb2api_init_hash(ctx, VB2_HASH_TAG_FW_BODY, &size);
+	if (rv)
+		return rv;
+
+	if (body_size < size)
+		return VB2_ERROR_API_VERIFY_SLOT_BODY_SIZE;
+
+	rv = vb2api_extend_hash(ctx, body, size);
+	if (rv)
+		return rv;
+
+	return vb2api_check_hash(ctx);
+}
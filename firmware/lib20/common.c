@@ -70,6 +70,7 @@ int vb2_verify_digest(const struct vb2_public_key *key,
 		      const struct vb2_workbuf *wb)
 {
 	uint8_t *sig_data = vb2_signature_data(sig);
+	int rv;
 
 	if (sig->sig_size != vb2_rsa_sig_size(key->sig_alg)) {
 		VB2_DEBUG("Wrong data signature size for algorithm, "
@@ -79,6 +80,10 @@ int vb2_verify_digest(const struct vb2_public_key *key,
 		return VB2_ERROR_VDATA_SIG_SIZE;
 	}
 
+	rv = vb2ex_hwcrypto_rsa_verify(key, sig_data, digest);
+	if (rv != VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED)
+		return rv;
+
 	return vb2_rsa_verify_digest(key, sig_data, digest, wb);
 }
 
@@ -96,7 +96,7 @@ int vb2_unpack_key(struct vb2_public_key *key,
  * Verify a signature against an expected hash digest.
  *
  * @param key		Key to use in signature verification
- * @param sig		Signature to verify (may be destroyed in process)
+ * @param sig		Signature to verify
  * @param digest	Digest of signed data
  * @param wb		Work buffer
  * @return VB2_SUCCESS, or non-zero if error.
@@ -112,7 +112,7 @@ int vb2_verify_digest(const struct vb2_public_key *key,
  * @param data		Data to verify
  * @param size		Size of data buffer.  Note that amount of data to
  *			actually validate is contained in sig->data_size.
- * @param sig		Signature of data (destroyed in process)
+ * @param sig		Signature of data
  * @param key		Key to use to validate signature
  * @param wb		Work buffer
  * @return VB2_SUCCESS, or non-zero error code if error.
@@ -127,7 +127,7 @@ int vb2_verify_data(const uint8_t *data,
  * Check the sanity of a key block using a public key.
  *
  * Header fields are also checked for sanity.  Does not verify key index or key
- * block flags.  Signature inside block is destroyed during check.
+ * block flags.
  *
  * @param block		Key block to verify
  * @param size		Size of key block buffer
@@ -143,8 +143,6 @@ int vb2_verify_keyblock(struct vb2_keyblock *block,
 /**
  * Check the sanity of a firmware preamble using a public key.
  *
- * The signature in the preamble is destroyed during the check.
- *
  * @param preamble     	Preamble to verify
  * @param size		Size of preamble buffer
  * @param key		Key to use to verify preamble
@@ -126,6 +126,11 @@ struct vb2_keyblock {
 #define VB2_FIRMWARE_PREAMBLE_RESERVED0 0x00000001
 /* Do not allow use of any hardware crypto accelerators. */
 #define VB2_FIRMWARE_PREAMBLE_DISALLOW_HWCRYPTO 0x00000002
+/*
+ * The firmware body is stored as an LZMA1 (.lzma) stream, and the body hash
+ * covers the compressed bytes.  See vb2api_get_body_compression().
+ */
+#define VB2_FIRMWARE_PREAMBLE_BODY_COMPRESSED 0x00000004
 
 /* Premable block for rewritable firmware, vboot1 version 2.1.
  *
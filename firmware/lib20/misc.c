@@ -12,6 +12,7 @@
 #include "2secdata.h"
 #include "2sha.h"
 #include "2rsa.h"
+#include "2verify_cache.h"
 #include "vb2_common.h"
 
 int vb2_load_fw_keyblock(struct vb2_context *ctx)
@@ -24,9 +25,13 @@ int vb2_load_fw_keyblock(struct vb2_context *ctx)
 	struct vb2_packed_key *packed_key;
 	struct vb2_public_key root_key;
 
-	struct vb2_keyblock *kb;
+	struct vb2_keyblock *kb = NULL;
 	uint32_t block_size;
+	uint32_t map_size;
 
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+	int cached = 0;
+	int version_rv = VB2_SUCCESS;
 	int rv;
 
 	vb2_workbuf_from_ctx(ctx, &wb);
@@ -47,50 +52,108 @@ int vb2_load_fw_keyblock(struct vb2_context *ctx)
 	if (rv)
 		return rv;
 
-	/* Load the firmware keyblock header after the root key */
-	kb = vb2_workbuf_alloc(&wb, sizeof(*kb));
-	if (!kb)
-		return VB2_ERROR_FW_KEYBLOCK_WORKBUF_HEADER;
-
-	rv = vb2ex_read_resource(ctx, VB2_RES_FW_VBLOCK, 0, kb, sizeof(*kb));
-	if (rv)
+	/*
+	 * Use the keyblock in place if the platform can map all of it.  It's
+	 * only read from here on, and nothing in it is needed after we return
+	 * except the data key, which is copied out below.
+	 */
+	rv = vb2ex_map_resource(ctx, VB2_RES_FW_VBLOCK, 0,
+				(const void **)&kb, &map_size);
+	if (rv == VB2_ERROR_EX_MAP_RESOURCE_UNSUPPORTED) {
+		rv = VB2_SUCCESS;
+		kb = NULL;
+	} else if (rv) {
 		return rv;
+	} else if (map_size < sizeof(*kb) || map_size < kb->keyblock_size) {
+		kb = NULL;
+	}
 
-	block_size = kb->keyblock_size;
+	/* Otherwise, use it from the start of the vblock if that's read ahead */
+	if (!kb) {
+		vb2_read_vblock_prefix(ctx, &wb);
+		kb = vb2_vblock_prefix(ctx, 0, sizeof(*kb));
+		if (kb && !vb2_vblock_prefix(ctx, 0, kb->keyblock_size))
+			kb = NULL;
+	}
+
+	if (kb) {
+		block_size = kb->keyblock_size;
+	} else {
+		/* The preamble won't be in the prefix either */
+		sd->workbuf_vblock_prefix_size = 0;
+
+		/* Load the firmware keyblock header after the root key */
+		kb = vb2_workbuf_alloc(&wb, sizeof(*kb));
+		if (!kb)
+			return VB2_ERROR_FW_KEYBLOCK_WORKBUF_HEADER;
+
+		rv = vb2ex_read_resource(ctx, VB2_RES_FW_VBLOCK, 0,
+					 kb, sizeof(*kb));
+		if (rv)
+			return rv;
+
+		block_size = kb->keyblock_size;
+
+		/*
+		 * Load the entire keyblock, now that we know how big it is.
+		 * Note that we're loading the entire keyblock instead of just
+		 * the piece after the header.  That means we re-read the
+		 * header.  But that's a tiny amount of data, and it makes the
+		 * code much more straightforward.
+		 */
+		kb = vb2_workbuf_realloc(&wb, sizeof(*kb), block_size);
+		if (!kb)
+			return VB2_ERROR_FW_KEYBLOCK_WORKBUF;
+
+		rv = vb2ex_read_resource(ctx, VB2_RES_FW_VBLOCK, 0,
+					 kb, block_size);
+		if (rv)
+			return rv;
+	}
 
 	/*
-	 * Load the entire keyblock, now that we know how big it is.  Note that
-	 * we're loading the entire keyblock instead of just the piece after
-	 * the header.  That means we re-read the header.  But that's a tiny
-	 * amount of data, and it makes the code much more straightforward.
+	 * Key version is the upper 16 bits of the composite firmware version.
+	 * Checking it doesn't need the signature, but the version of a
+	 * keyblock which doesn't verify can't be trusted.  So only report a
+	 * rollback once the signature has been checked below.
 	 */
-	kb = vb2_workbuf_realloc(&wb, sizeof(*kb), block_size);
-	if (!kb)
-		return VB2_ERROR_FW_KEYBLOCK_WORKBUF;
+	if (kb->data_key.key_version > 0xffff)
+		version_rv = VB2_ERROR_FW_KEYBLOCK_VERSION_RANGE;
+	else if (kb->data_key.key_version < (sd->fw_version_secdata >> 16))
+		version_rv = VB2_ERROR_FW_KEYBLOCK_VERSION_ROLLBACK;
 
-	rv = vb2ex_read_resource(ctx, VB2_RES_FW_VBLOCK, 0, kb, block_size);
-	if (rv)
-		return rv;
+	/*
+	 * If this root key and keyblock are the same ones verified last boot,
+	 * they'd verify the same way again.
+	 */
+	if (ctx->flags & VB2_CONTEXT_VERIFY_CACHE &&
+	    !vb2_verify_cache_digest(key_data, key_size, kb, block_size,
+				     digest, &wb))
+		cached = !vb2_verify_cache_check_keyblock(ctx, digest);
 
 	/* Verify the keyblock */
-	rv = vb2_verify_keyblock(kb, block_size, &root_key, &wb);
-	if (rv) {
-		vb2_fail(ctx, VB2_RECOVERY_FW_KEYBLOCK, rv);
-		return rv;
+	if (!cached) {
+		rv = vb2_verify_keyblock(kb, block_size, &root_key, &wb);
+		if (rv) {
+			vb2_fail(ctx, VB2_RECOVERY_FW_KEYBLOCK, rv);
+			return rv;
+		}
 	}
 
-	/* Key version is the upper 16 bits of the composite firmware version */
-	if (kb->data_key.key_version > 0xffff)
-		rv = VB2_ERROR_FW_KEYBLOCK_VERSION_RANGE;
-	if (!rv && kb->data_key.key_version < (sd->fw_version_secdata >> 16))
-		rv = VB2_ERROR_FW_KEYBLOCK_VERSION_ROLLBACK;
-	if (rv) {
-		vb2_fail(ctx, VB2_RECOVERY_FW_KEY_ROLLBACK, rv);
-		return rv;
+	if (version_rv) {
+		vb2_fail(ctx, VB2_RECOVERY_FW_KEY_ROLLBACK, version_rv);
+		return version_rv;
 	}
 
 	sd->fw_version = kb->data_key.key_version << 16;
 
+	/*
+	 * Preamble follows the keyblock in the vblock.  Save that now, since
+	 * moving the data key below can overwrite the keyblock if the data key
+	 * is bigger than the root key.
+	 */
+	sd->vblock_preamble_offset = kb->keyblock_size;
+
 	/*
 	 * Save the data key in the work buffer.  This overwrites the root key
 	 * we read above.  That's ok, because now that we have the data key we
@@ -98,15 +161,18 @@ int vb2_load_fw_keyblock(struct vb2_context *ctx)
 	 */
 	packed_key = (struct vb2_packed_key *)key_data;
 
+	/* If the keyblock was mapped, nothing has checked the key fits yet */
+	if (packed_key->key_offset + kb->data_key.key_size >
+	    vb2_offset_of(key_data, wb.buf) + wb.size)
+		return VB2_ERROR_FW_KEYBLOCK_WORKBUF;
+
 	packed_key->algorithm = kb->data_key.algorithm;
 	packed_key->key_version = kb->data_key.key_version;
 	packed_key->key_size = kb->data_key.key_size;
 
 	/*
-	 * Use memmove() instead of memcpy().  In theory, the destination will
-	 * never overlap because with the source because the root key is likely
-	 * to be at least as large as the data key, but there's no harm here in
-	 * being paranoid.
+	 * Use memmove() instead of memcpy(), since the destination overlaps
+	 * the keyblock if the data key is bigger than the root key.
 	 */
 	memmove(key_data + packed_key->key_offset,
 		(uint8_t*)&kb->data_key + kb->data_key.key_offset,
@@ -117,13 +183,18 @@ int vb2_load_fw_keyblock(struct vb2_context *ctx)
 	sd->workbuf_data_key_size =
 		packed_key->key_offset + packed_key->key_size;
 
-	/* Preamble follows the keyblock in the vblock */
-	sd->vblock_preamble_offset = kb->keyblock_size;
-
 	/* Data key will persist in the workbuf after we return */
 	ctx->workbuf_used = sd->workbuf_data_key_offset +
 		sd->workbuf_data_key_size;
 
+	/*
+	 * So will the vblock prefix, for the preamble.  The keyblock came from
+	 * it, so the data key can't have run past its end.
+	 */
+	if (sd->workbuf_vblock_prefix_size)
+		ctx->workbuf_used = sd->workbuf_vblock_prefix_offset +
+			sd->workbuf_vblock_prefix_size;
+
 	return VB2_SUCCESS;
 }
 
@@ -140,10 +211,12 @@ int vb2_load_fw_preamble(struct vb2_context *ctx)
 	struct vb2_fw_preamble *pre;
 	uint32_t pre_size;
 
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+	int from_prefix = 0;
+	int have_digest = 0;
+	int cached = 0;
 	int rv;
 
-	vb2_workbuf_from_ctx(ctx, &wb);
-
 	/* Unpack the firmware data key */
 	if (!sd->workbuf_data_key_size)
 		return VB2_ERROR_FW_PREAMBLE2_DATA_KEY;
@@ -152,37 +225,77 @@ int vb2_load_fw_preamble(struct vb2_context *ctx)
 	if (rv)
 		return rv;
 
-	/* Load the firmware preamble header */
-	pre = vb2_workbuf_alloc(&wb, sizeof(*pre));
-	if (!pre)
-		return VB2_ERROR_FW_PREAMBLE2_WORKBUF_HEADER;
+	/*
+	 * Use the preamble from the vblock prefix if it's all there.  If not,
+	 * free the prefix so the preamble is read right after the data key.
+	 */
+	pre = vb2_vblock_prefix(ctx, sd->vblock_preamble_offset, sizeof(*pre));
+	if (pre && vb2_vblock_prefix(ctx, sd->vblock_preamble_offset,
+				     pre->preamble_size)) {
+		pre_size = pre->preamble_size;
+		from_prefix = 1;
+	} else {
+		vb2_free_vblock_prefix(ctx);
+	}
 
-	rv = vb2ex_read_resource(ctx, VB2_RES_FW_VBLOCK,
-				 sd->vblock_preamble_offset,
-				 pre, sizeof(*pre));
-	if (rv)
-		return rv;
+	vb2_workbuf_from_ctx(ctx, &wb);
 
-	pre_size = pre->preamble_size;
+	if (!from_prefix) {
+		/* Load the firmware preamble header */
+		pre = vb2_workbuf_alloc(&wb, sizeof(*pre));
+		if (!pre)
+			return VB2_ERROR_FW_PREAMBLE2_WORKBUF_HEADER;
 
-	/* Load the entire firmware preamble, now that we know how big it is */
-	pre = vb2_workbuf_realloc(&wb, sizeof(*pre), pre_size);
-	if (!pre)
-		return VB2_ERROR_FW_PREAMBLE2_WORKBUF;
+		rv = vb2ex_read_resource(ctx, VB2_RES_FW_VBLOCK,
+					 sd->vblock_preamble_offset,
+					 pre, sizeof(*pre));
+		if (rv)
+			return rv;
 
-	rv = vb2ex_read_resource(ctx, VB2_RES_FW_VBLOCK,
-				 sd->vblock_preamble_offset,
-				 pre, pre_size);
-	if (rv)
-		return rv;
+		pre_size = pre->preamble_size;
+
+		/*
+		 * Load the entire firmware preamble, now that we know how big
+		 * it is.
+		 */
+		pre = vb2_workbuf_realloc(&wb, sizeof(*pre), pre_size);
+		if (!pre)
+			return VB2_ERROR_FW_PREAMBLE2_WORKBUF;
+
+		rv = vb2ex_read_resource(ctx, VB2_RES_FW_VBLOCK,
+					 sd->vblock_preamble_offset,
+					 pre, pre_size);
+		if (rv)
+			return rv;
+	}
 
 	/* Work buffer now contains the data subkey data and the preamble */
 
+	/* Skip verifying the preamble if it was verified last boot */
+	if (ctx->flags & VB2_CONTEXT_VERIFY_CACHE &&
+	    !vb2_verify_cache_digest(pre, pre_size, NULL, 0, digest, &wb)) {
+		have_digest = 1;
+		cached = !vb2_verify_cache_check_preamble(ctx, digest);
+	}
+
 	/* Verify the preamble */
-	rv = vb2_verify_fw_preamble(pre, pre_size, &data_key, &wb);
-	if (rv) {
-		vb2_fail(ctx, VB2_RECOVERY_FW_PREAMBLE, rv);
-		return rv;
+	if (!cached) {
+		rv = vb2_verify_fw_preamble(pre, pre_size, &data_key, &wb);
+		if (rv) {
+			vb2_fail(ctx, VB2_RECOVERY_FW_PREAMBLE, rv);
+			return rv;
+		}
+	}
+
+	/*
+	 * Move a preamble verified in the prefix down next to the data key,
+	 * where it would have been read to.  That's never further up.
+	 */
+	if (from_prefix) {
+		vb2_free_vblock_prefix(ctx);
+		vb2_workbuf_from_ctx(ctx, &wb);
+		memmove(wb.buf, pre, pre_size);
+		pre = (struct vb2_fw_preamble *)wb.buf;
 	}
 
 	/*
@@ -200,6 +313,10 @@ int vb2_load_fw_preamble(struct vb2_context *ctx)
 		return rv;
 	}
 
+	/* Remember what was verified, so next boot can skip it */
+	if (have_digest)
+		vb2_verify_cache_save(ctx, digest);
+
 	/*
 	 * If this is a newer version than in secure storage, and we
 	 * successfully booted the same slot last boot, roll forward the
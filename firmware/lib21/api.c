@@ -20,8 +20,11 @@ int vb2api_fw_phase3(struct vb2_context *ctx)
 {
 	int rv;
 
+	vb2_record_timestamp(ctx, VB2_TS_FW_PHASE3_ENTER);
+
 	/* Verify firmware keyblock */
 	rv = vb2_load_fw_keyblock(ctx);
+	vb2_record_timestamp(ctx, VB2_TS_FW_KEYBLOCK_EXIT);
 	if (rv) {
 		vb2_fail(ctx, VB2_RECOVERY_RO_INVALID_RW, rv);
 		return rv;
@@ -29,6 +32,7 @@ int vb2api_fw_phase3(struct vb2_context *ctx)
 
 	/* Verify firmware preamble */
 	rv = vb2_load_fw_preamble(ctx);
+	vb2_record_timestamp(ctx, VB2_TS_FW_PREAMBLE_EXIT);
 	if (rv) {
 		vb2_fail(ctx, VB2_RECOVERY_RO_INVALID_RW, rv);
 		return rv;
@@ -46,9 +50,11 @@ int vb2api_init_hash2(struct vb2_context *ctx,
 	const struct vb2_signature *sig = NULL;
 	struct vb2_digest_context *dc;
 	struct vb2_workbuf wb;
-	uint32_t hash_offset;
+	uint32_t hash_offset, offset;
 	int i, rv;
 
+	vb2_record_timestamp(ctx, VB2_TS_FW_INIT_HASH);
+
 	vb2_workbuf_from_ctx(ctx, &wb);
 
 	/* Get preamble pointer */
@@ -71,6 +77,18 @@ int vb2api_init_hash2(struct vb2_context *ctx,
 	if (i >= pre->hash_count)
 		return VB2_ERROR_API_INIT_HASH_GUID;  /* No match */
 
+	/* That must be the only hash for it, or it's hashed in blocks */
+	for (i++, offset = hash_offset + sig->c.total_size;
+	     i < pre->hash_count; i++) {
+		const struct vb2_signature *more =
+			(const struct vb2_signature *)((uint8_t *)pre + offset);
+
+		if (!memcmp(guid, &more->guid, sizeof(*guid)))
+			return VB2_ERROR_API_INIT_HASH_BLOCKS;
+
+		offset += more->c.total_size;
+	}
+
 	/* Allocate workbuf space for the hash */
 	if (sd->workbuf_hash_size) {
 		dc = (struct vb2_digest_context *)
@@ -113,7 +131,7 @@ int vb2api_init_hash2(struct vb2_context *ctx,
 	return vb2_digest_init(dc, sig->hash_alg);
 }
 
-int vb2api_check_hash(struct vb2_context *ctx)
+static int check_hash(struct vb2_context *ctx)
 {
 	struct vb2_shared_data *sd = vb2_get_sd(ctx);
 	struct vb2_digest_context *dc = (struct vb2_digest_context *)
@@ -123,10 +141,14 @@ int vb2api_check_hash(struct vb2_context *ctx)
 	uint8_t *digest;
 	uint32_t digest_size = vb2_digest_size(dc->hash_alg);
 
+	const struct vb2_fw_preamble *pre;
 	const struct vb2_signature *sig;
 
 	int rv;
 
+	sd->body_hash_alg = VB2_HASH_INVALID;
+	sd->flags &= ~VB2_SD_FLAG_BODY_COMPRESSED;
+
 	vb2_workbuf_from_ctx(ctx, &wb);
 
 	/* Get signature pointer */
@@ -160,8 +182,252 @@ int vb2api_check_hash(struct vb2_context *ctx)
 			    digest_size))
 		return VB2_ERROR_API_CHECK_HASH_SIG;
 
+	/* Keep the digest for measurement */
+	sd->body_hash_alg = dc->hash_alg;
+	memcpy(sd->body_digest, digest, digest_size);
+
+	pre = (const struct vb2_fw_preamble *)
+		(ctx->workbuf + sd->workbuf_preamble_offset);
+	if (sd->workbuf_preamble_size &&
+	    (pre->flags & VB2_FIRMWARE_PREAMBLE_BODY_COMPRESSED))
+		sd->flags |= VB2_SD_FLAG_BODY_COMPRESSED;
+
 	// TODO: the old check-hash function called vb2_fail() on any mismatch.
 	// I don't think it should do that; the caller should.
 
 	return VB2_SUCCESS;
 }
+
+int vb2api_check_hash(struct vb2_context *ctx)
+{
+	int rv;
+
+	vb2_record_timestamp(ctx, VB2_TS_FW_CHECK_HASH_ENTER);
+	rv = check_hash(ctx);
+	vb2_record_timestamp(ctx, VB2_TS_FW_CHECK_HASH_EXIT);
+	return rv;
+}
+
+/**
+ * Find the hash for a block of a component hashed in blocks.
+ *
+ * @param pre		Preamble
+ * @param guid		Component GUID
+ * @param block		Block number
+ * @param sig_ptr	Hash for the block is stored here
+ * @param offset_ptr	Offset of the block in the component is stored here
+ * @return VB2_SUCCESS, or VB2_ERROR_API_HASH_BLOCK_NUM if not found.
+ */
+static int find_hash_block(const struct vb2_fw_preamble *pre,
+			   const struct vb2_guid *guid,
+			   uint32_t block,
+			   const struct vb2_signature **sig_ptr,
+			   uint32_t *offset_ptr)
+{
+	const struct vb2_signature *sig;
+	uint32_t hash_offset = pre->hash_offset;
+	uint32_t offset = 0;
+	int i;
+
+	for (i = 0; i < pre->hash_count; i++) {
+		sig = (const struct vb2_signature *)
+			((uint8_t *)pre + hash_offset);
+
+		if (!memcmp(guid, &sig->guid, sizeof(*guid))) {
+			if (!block--) {
+				*sig_ptr = sig;
+				*offset_ptr = offset;
+				return VB2_SUCCESS;
+			}
+			offset += sig->data_size;
+		}
+
+		hash_offset += sig->c.total_size;
+	}
+
+	return VB2_ERROR_API_HASH_BLOCK_NUM;
+}
+
+int vb2api_get_hash_block(struct vb2_context *ctx,
+			  const struct vb2_guid *guid,
+			  uint32_t block,
+			  uint32_t *offset,
+			  uint32_t *size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	const struct vb2_signature *sig;
+	int rv;
+
+	if (!sd->workbuf_preamble_size)
+		return VB2_ERROR_API_HASH_BLOCK_PREAMBLE;
+
+	rv = find_hash_block((const struct vb2_fw_preamble *)
+			     (ctx->workbuf + sd->workbuf_preamble_offset),
+			     guid, block, &sig, offset);
+	if (rv)
+		return rv;
+
+	*size = sig->data_size;
+	return VB2_SUCCESS;
+}
+
+int vb2api_check_hash_block(struct vb2_context *ctx,
+			    const struct vb2_guid *guid,
+			    uint32_t block,
+			    const void *buf,
+			    uint32_t size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	const struct vb2_signature *sig;
+	struct vb2_digest_context *dc;
+	struct vb2_workbuf wb;
+	uint8_t *digest;
+	uint32_t digest_size, offset;
+	int rv;
+
+	vb2_workbuf_from_ctx(ctx, &wb);
+
+	if (!sd->workbuf_preamble_size)
+		return VB2_ERROR_API_HASH_BLOCK_PREAMBLE;
+
+	rv = find_hash_block((const struct vb2_fw_preamble *)
+			     (ctx->workbuf + sd->workbuf_preamble_offset),
+			     guid, block, &sig, &offset);
+	if (rv)
+		return rv;
+
+	if (size != sig->data_size)
+		return VB2_ERROR_API_HASH_BLOCK_SIZE;
+
+	/*
+	 * Hash in software, since the hardware engine may be in the middle of
+	 * the hash started by vb2api_init_hash2().
+	 */
+	digest_size = vb2_digest_size(sig->hash_alg);
+	dc = vb2_workbuf_alloc(&wb, sizeof(*dc));
+	digest = vb2_workbuf_alloc(&wb, digest_size);
+	if (!dc || !digest)
+		return VB2_ERROR_API_HASH_BLOCK_WORKBUF;
+
+	rv = vb2_digest_init(dc, sig->hash_alg);
+	if (rv)
+		return rv;
+
+	rv = vb2_digest_extend(dc, buf, size);
+	if (rv)
+		return rv;
+
+	rv = vb2_digest_finalize(dc, digest, digest_size);
+	if (rv)
+		return rv;
+
+	/* The preamble signature already covered the hash, so just compare */
+	if (vb2_safe_memcmp(digest, (const uint8_t *)sig + sig->sig_offset,
+			    digest_size))
+		return VB2_ERROR_API_HASH_BLOCK_SIG;
+
+	return VB2_SUCCESS;
+}
+
+int vb2api_check_hash_blocks(struct vb2_context *ctx,
+			     const struct vb2_guid *guid,
+			     const void *buf,
+			     uint32_t size)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(ctx);
+	enum vb2_hash_algorithm hash_alg = VB2_HASH_INVALID;
+	const struct vb2_fw_preamble *pre;
+	const struct vb2_signature *sig;
+	const struct vb2_signature **sigs;
+	const uint8_t **bufs;
+	uint32_t *sizes;
+	uint8_t **digests;
+	uint8_t *digest;
+	struct vb2_workbuf wb;
+	uint32_t hash_offset, offset = 0, count = 0, digest_size;
+	int i, n, rv;
+
+	vb2_workbuf_from_ctx(ctx, &wb);
+
+	if (!sd->workbuf_preamble_size)
+		return VB2_ERROR_API_HASH_BLOCK_PREAMBLE;
+
+	pre = (const struct vb2_fw_preamble *)
+		(ctx->workbuf + sd->workbuf_preamble_offset);
+
+	/* Count the blocks, and make sure they cover the data */
+	hash_offset = pre->hash_offset;
+	for (i = 0; i < pre->hash_count; i++) {
+		sig = (const struct vb2_signature *)
+			((uint8_t *)pre + hash_offset);
+		hash_offset += sig->c.total_size;
+
+		if (memcmp(guid, &sig->guid, sizeof(*guid)))
+			continue;
+
+		if (count && sig->hash_alg != hash_alg)
+			return VB2_ERROR_API_HASH_BLOCKS_ALG;
+		if (sig->data_size > size - offset)
+			return VB2_ERROR_API_HASH_BLOCK_SIZE;
+
+		hash_alg = sig->hash_alg;
+		offset += sig->data_size;
+		count++;
+	}
+
+	if (!count)
+		return VB2_ERROR_API_HASH_BLOCK_NUM;
+	if (offset != size)
+		return VB2_ERROR_API_HASH_BLOCK_SIZE;
+
+	digest_size = vb2_digest_size(hash_alg);
+	if (!digest_size)
+		return VB2_ERROR_SHA_INIT_ALGORITHM;
+
+	sigs = vb2_workbuf_alloc(&wb, count * sizeof(*sigs));
+	bufs = vb2_workbuf_alloc(&wb, count * sizeof(*bufs));
+	sizes = vb2_workbuf_alloc(&wb, count * sizeof(*sizes));
+	digests = vb2_workbuf_alloc(&wb, count * sizeof(*digests));
+	digest = vb2_workbuf_alloc(&wb, count * digest_size);
+	if (!sigs || !bufs || !sizes || !digests || !digest)
+		return VB2_ERROR_API_HASH_BLOCK_WORKBUF;
+
+	/* List the blocks, in order */
+	hash_offset = pre->hash_offset;
+	offset = 0;
+	for (i = 0, n = 0; i < pre->hash_count; i++) {
+		sig = (const struct vb2_signature *)
+			((uint8_t *)pre + hash_offset);
+		hash_offset += sig->c.total_size;
+
+		if (memcmp(guid, &sig->guid, sizeof(*guid)))
+			continue;
+
+		sigs[n] = sig;
+		bufs[n] = (const uint8_t *)buf + offset;
+		sizes[n] = sig->data_size;
+		digests[n] = digest + n * digest_size;
+		offset += sig->data_size;
+		n++;
+	}
+
+	/* Spread them across the cores the platform has, if it has any */
+	rv = vb2ex_digest_multi(hash_alg, count, bufs, sizes, digests,
+				digest_size);
+	if (rv == VB2_ERROR_EX_DIGEST_MULTI_UNSUPPORTED)
+		rv = vb2_digest_multi(hash_alg, count, bufs, sizes, digests,
+				      digest_size);
+	if (rv)
+		return rv;
+
+	/* The preamble signature already covered the hashes, so just compare */
+	for (n = 0; n < count; n++) {
+		if (vb2_safe_memcmp(digests[n],
+				    (const uint8_t *)sigs[n] +
+				    sigs[n]->sig_offset,
+				    digest_size))
+			return VB2_ERROR_API_HASH_BLOCK_SIG;
+	}
+
+	return VB2_SUCCESS;
+}
@@ -6,6 +6,7 @@
  */
 
 #include "2sysincludes.h"
+#include "2api.h"
 #include "2common.h"
 #include "2rsa.h"
 #include "2sha.h"
@@ -139,20 +140,25 @@ uint32_t vb2_sig_size(enum vb2_signature_algorithm sig_alg,
 	if (sig_alg == VB2_SIG_NONE)
 		return digest_size;
 
+#if VB2_SUPPORT_ED25519
+	if (sig_alg == VB2_SIG_ED25519)
+		return VB2_ED25519_SIG_SIZE;
+#endif
+
 	return vb2_rsa_sig_size(sig_alg);
 }
 
 const struct vb2_guid *vb2_hash_guid(enum vb2_hash_algorithm hash_alg)
 {
 	switch(hash_alg) {
-#ifdef VB2_SUPPORT_SHA1
+#if VB2_SUPPORT_SHA1
 	case VB2_HASH_SHA1:
 		{
 			static const struct vb2_guid guid = VB2_GUID_NONE_SHA1;
 			return &guid;
 		}
 #endif
-#ifdef VB2_SUPPORT_SHA256
+#if VB2_SUPPORT_SHA256
 	case VB2_HASH_SHA256:
 		{
 			static const struct vb2_guid guid =
@@ -160,13 +166,21 @@ const struct vb2_guid *vb2_hash_guid(enum vb2_hash_algorithm hash_alg)
 			return &guid;
 		}
 #endif
-#ifdef VB2_SUPPORT_SHA512
+#if VB2_SUPPORT_SHA512
 	case VB2_HASH_SHA512:
 		{
 			static const struct vb2_guid guid =
 				VB2_GUID_NONE_SHA512;
 			return &guid;
 		}
+#endif
+#if VB2_SUPPORT_BLAKE2S
+	case VB2_HASH_BLAKE2S:
+		{
+			static const struct vb2_guid guid =
+				VB2_GUID_NONE_BLAKE2S;
+			return &guid;
+		}
 #endif
 	default:
 		return NULL;
@@ -249,8 +263,21 @@ int vb2_verify_digest(const struct vb2_public_key *key,
 			return VB2_ERROR_VDATA_VERIFY_DIGEST;
 
 		return VB2_SUCCESS;
+#if VB2_SUPPORT_ED25519
+	} else if (key->sig_alg == VB2_SIG_ED25519) {
+		/* Ed25519 signature over the digest */
+		return vb2_ed25519_verify(key->ed25519_key,
+					  vb2_signature_data(sig), digest,
+					  vb2_digest_size(key->hash_alg), wb);
+#endif
 	} else {
-		/* RSA-signed digest */
+		/* RSA-signed digest; try the hardware crypto engine first */
+		int rv = vb2ex_hwcrypto_rsa_verify(key,
+						   vb2_signature_data(sig),
+						   digest);
+		if (rv != VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED)
+			return rv;
+
 		return vb2_rsa_verify_digest(key,
 					     vb2_signature_data(sig),
 					     digest, wb);
@@ -305,13 +332,149 @@ int vb2_verify_data(const void *data,
 	return vb2_verify_digest(key, sig, digest, &wblocal);
 }
 
-int vb2_verify_keyblock(struct vb2_keyblock *block,
-			uint32_t size,
-			const struct vb2_public_key *key,
-			const struct vb2_workbuf *wb)
+/*
+ * Rough relative cost of checking a signature.  RSA time grows with the square
+ * of the modulus size and swamps the hash, so the digest size only breaks ties
+ * between signatures with the same RSA size.  A bare hash has no RSA cost.
+ * Checking an Ed25519 signature takes about as long as RSA-4096.
+ */
+static uint32_t vb2_sig_cost(const struct vb2_signature *sig)
+{
+	uint32_t rsa_size = sig->sig_alg == VB2_SIG_ED25519 ? 4096 / 8 :
+		vb2_rsa_sig_size(sig->sig_alg);
+
+	return rsa_size * rsa_size + vb2_digest_size(sig->hash_alg);
+}
+
+/* Return the key in the list matching the signature GUID, or NULL if none */
+static const struct vb2_public_key *vb2_sig_key(
+		const struct vb2_signature *sig,
+		const struct vb2_public_key *keys,
+		int key_count)
+{
+	int i;
+
+	for (i = 0; i < key_count; i++) {
+		if (!memcmp(&sig->guid, keys[i].guid, GUID_SIZE))
+			return keys + i;
+	}
+
+	return NULL;
+}
+
+int vb2_verify_key_table(const struct vb2_key_table *table, uint32_t size)
+{
+	const struct vb2_key_table_entry *entries;
+	uint32_t min_offset = 0;
+	uint32_t i;
+	int rv;
+
+	/* Check magic number */
+	if (table->c.magic != VB2_MAGIC_KEY_TABLE)
+		return VB2_ERROR_KEY_TABLE_MAGIC;
+
+	/* Make sure common header is good */
+	rv = vb2_verify_common_header(table, size);
+	if (rv)
+		return rv;
+
+	/* No need to check minor version; no fields have been added */
+	if (table->c.struct_version_major != VB2_KEY_TABLE_VERSION_MAJOR)
+		return VB2_ERROR_KEY_TABLE_HEADER_VERSION;
+
+	/* Make sure header is big enough */
+	if (table->c.fixed_size < sizeof(*table))
+		return VB2_ERROR_KEY_TABLE_SIZE;
+
+	/* Make sure entries are inside, without overflowing the size */
+	if (table->key_count > table->c.total_size / sizeof(*entries) ||
+	    vb2_verify_common_member(table, &min_offset, table->entry_offset,
+				     table->key_count * sizeof(*entries)))
+		return VB2_ERROR_KEY_TABLE_ENTRIES;
+
+	/* Binary search needs the GUIDs strictly increasing */
+	entries = (const struct vb2_key_table_entry *)
+		((const uint8_t *)table + table->entry_offset);
+	for (i = 1; i < table->key_count; i++) {
+		if (memcmp(&entries[i - 1].guid, &entries[i].guid,
+			   GUID_SIZE) >= 0)
+			return VB2_ERROR_KEY_TABLE_ORDER;
+	}
+
+	return VB2_SUCCESS;
+}
+
+/* Return the key table entry with a GUID, or NULL if none */
+static const struct vb2_key_table_entry *vb2_key_table_entry(
+		const struct vb2_key_table *table,
+		const struct vb2_guid *guid)
+{
+	const struct vb2_key_table_entry *entries =
+		(const struct vb2_key_table_entry *)
+		((const uint8_t *)table + table->entry_offset);
+	uint32_t lo = 0, hi = table->key_count;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		int cmp = memcmp(guid, &entries[mid].guid, GUID_SIZE);
+
+		if (!cmp)
+			return entries + mid;
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
+}
+
+int vb2_key_table_find(struct vb2_public_key *key,
+		       const struct vb2_key_table *table,
+		       const struct vb2_guid *guid)
+{
+	const struct vb2_key_table_entry *entry;
+	const struct vb2_packed_key *pkey;
+	uint32_t min_offset = 0;
+	int rv;
+
+	entry = vb2_key_table_entry(table, guid);
+	if (!entry)
+		return VB2_ERROR_KEY_TABLE_NOT_FOUND;
+
+	/* Keys may be shared between entries, so only check this one */
+	if (vb2_verify_common_subobject(table, &min_offset, entry->key_offset))
+		return VB2_ERROR_KEY_TABLE_KEY_OUTSIDE;
+
+	pkey = (const struct vb2_packed_key *)
+		((const uint8_t *)table + entry->key_offset);
+	rv = vb2_unpack_key(key, (const uint8_t *)pkey,
+			    table->c.total_size - entry->key_offset);
+	if (rv)
+		return rv;
+
+	/* Don't let a table entry vouch for a key with another GUID */
+	if (memcmp(key->guid, guid, GUID_SIZE))
+		return VB2_ERROR_KEY_TABLE_KEY_GUID;
+
+	return VB2_SUCCESS;
+}
+
+/*
+ * Verify a keyblock against either an array of keys or, if table is
+ * non-NULL, a key table.
+ */
+static int vb2_verify_keyblock_sigs(struct vb2_keyblock *block,
+				    uint32_t size,
+				    const struct vb2_public_key *keys,
+				    int key_count,
+				    const struct vb2_key_table *table,
+				    const struct vb2_workbuf *wb)
 {
 	uint32_t min_offset = 0, sig_offset;
-	int rv, i;
+	uint32_t last_cost = 0, last_offset = 0;
+	int last_rv = VB2_ERROR_KEYBLOCK_SIG_GUID;
+	int rv, i, tried;
 
 	/* Check magic number */
 	if (block->c.magic != VB2_MAGIC_KEYBLOCK)
@@ -339,12 +502,11 @@ int vb2_verify_keyblock(struct vb2_keyblock *block,
 	if (rv)
 		return rv;
 
-	/* Loop over signatures */
+	/* Make sure all the signatures are inside the keyblock and sane */
 	sig_offset = block->sig_offset;
 	for (i = 0; i < block->sig_count; i++, sig_offset = min_offset) {
 		struct vb2_signature *sig;
 
-		/* Make sure signature is inside keyblock */
 		rv = vb2_verify_common_subobject(block, &min_offset,
 						 sig_offset);
 		if (rv)
@@ -352,25 +514,119 @@ int vb2_verify_keyblock(struct vb2_keyblock *block,
 
 		sig = (struct vb2_signature *)((uint8_t *)block + sig_offset);
 
-		/* Verify the signature integrity */
 		rv = vb2_verify_signature(sig,
 					  block->c.total_size - sig_offset);
 		if (rv)
 			return rv;
+	}
 
-		/* Skip signature if it doesn't match the key GUID */
-		if (memcmp(&sig->guid, key->guid, GUID_SIZE))
-			continue;
+	/*
+	 * Try the signatures from trusted keys, cheapest first, until one
+	 * verifies.  Taking them in (cost, offset) order means each pass only
+	 * needs to remember the last one it tried.
+	 */
+	for (tried = 0; tried < block->sig_count; tried++) {
+		const struct vb2_public_key *key = NULL;
+		struct vb2_public_key table_key;
+		struct vb2_signature *best = NULL;
+		uint32_t best_cost = 0, best_offset = 0;
+		struct vb2_signature *sig;
+
+		sig_offset = block->sig_offset;
+		for (i = 0; i < block->sig_count;
+		     i++, sig_offset += sig->c.total_size) {
+			const struct vb2_public_key *k;
+			uint32_t cost;
+
+			sig = (struct vb2_signature *)
+				((uint8_t *)block + sig_offset);
+			cost = vb2_sig_cost(sig);
+
+			/* Skip signatures already tried */
+			if (tried && (cost < last_cost ||
+				      (cost == last_cost &&
+				       sig_offset <= last_offset)))
+				continue;
+
+			/* On a tie, the earlier signature wins */
+			if (best && cost >= best_cost)
+				continue;
+
+			if (table) {
+				k = NULL;
+				if (!vb2_key_table_entry(table, &sig->guid))
+					continue;
+			} else {
+				k = vb2_sig_key(sig, keys, key_count);
+				if (!k)
+					continue;
+			}
+
+			best = sig;
+			best_cost = cost;
+			best_offset = sig_offset;
+			key = k;
+		}
+
+		/* No more signatures match a trusted key */
+		if (!best)
+			break;
+
+		last_cost = best_cost;
+		last_offset = best_offset;
 
 		/* Make sure we signed the right amount of data */
-		if (sig->data_size != block->sig_offset)
-			return VB2_ERROR_KEYBLOCK_SIGNED_SIZE;
+		if (best->data_size != block->sig_offset) {
+			last_rv = VB2_ERROR_KEYBLOCK_SIGNED_SIZE;
+			continue;
+		}
 
-		return vb2_verify_data(block, block->sig_offset, sig, key, wb);
+		/* Unpack only the table key we're going to use */
+		if (table) {
+			last_rv = vb2_key_table_find(&table_key, table,
+						     &best->guid);
+			if (last_rv)
+				continue;
+			key = &table_key;
+		}
+
+		last_rv = vb2_verify_data(block, block->sig_offset, best, key,
+					  wb);
+		if (!last_rv)
+			return VB2_SUCCESS;
+
+		VB2_DEBUG("Keyblock signature %d failed (0x%x); trying next\n",
+			  tried, last_rv);
 	}
 
-	/* If we're still here, no signature matched the key GUID */
-	return VB2_ERROR_KEYBLOCK_SIG_GUID;
+	/* If nothing matched a key GUID, this is still KEYBLOCK_SIG_GUID */
+	return last_rv;
+}
+
+int vb2_verify_keyblock_keys(struct vb2_keyblock *block,
+			     uint32_t size,
+			     const struct vb2_public_key *keys,
+			     int key_count,
+			     const struct vb2_workbuf *wb)
+{
+	return vb2_verify_keyblock_sigs(block, size, keys, key_count, NULL,
+					wb);
+}
+
+int vb2_verify_keyblock_table(struct vb2_keyblock *block,
+			      uint32_t size,
+			      const struct vb2_key_table *table,
+			      const struct vb2_workbuf *wb)
+{
+	return vb2_verify_keyblock_sigs(block, size, NULL, 0, table, wb);
+}
+
+int vb2_verify_keyblock(struct vb2_keyblock *block,
+			uint32_t size,
+			const struct vb2_public_key *key,
+			const struct vb2_workbuf *wb)
+{
+	return vb2_verify_keyblock_keys(block, size, key, 1, wb);
 }
 
 int vb2_verify_fw_preamble(struct vb2_fw_preamble *preamble,
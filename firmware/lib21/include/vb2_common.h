@@ -116,7 +116,7 @@ int vb2_verify_signature(const struct vb2_signature *sig,
  * Verify a signature against an expected hash digest.
  *
  * @param key		Key to use in signature verification
- * @param sig		Signature to verify (may be destroyed in process)
+ * @param sig		Signature to verify
  * @param digest	Digest of signed data
  * @param wb		Work buffer
  * @return VB2_SUCCESS, or non-zero if error.
@@ -132,7 +132,7 @@ int vb2_verify_digest(const struct vb2_public_key *key,
  * @param data		Data to verify
  * @param size		Size of data buffer.  Note that amount of data to
  *			actually validate is contained in sig->data_size.
- * @param sig		Signature of data (destroyed in process)
+ * @param sig		Signature of data
  * @param key		Key to use to validate signature
  * @param wb		Work buffer
  * @return VB2_SUCCESS, or non-zero error code if error.
@@ -147,7 +147,7 @@ int vb2_verify_data(const void *data,
  * Check the sanity of a key block using a public key.
  *
  * Header fields are also checked for sanity.  Does not verify key index or key
- * block flags.  Signature inside block is destroyed during check.
+ * block flags.
  *
  * @param block		Key block to verify
  * @param size		Size of key block buffer
@@ -161,9 +161,77 @@ int vb2_verify_keyblock(struct vb2_keyblock *block,
 			const struct vb2_workbuf *wb);
 
 /**
- * Check the sanity of a firmware preamble using a public key.
+ * Check the sanity of a key block against a set of trusted public keys.
+ *
+ * Like vb2_verify_keyblock(), but the block passes if any of its signatures
+ * verifies with the matching key from the list.  Signatures are tried
+ * cheapest first (smallest RSA key, then shortest digest), and checking stops
+ * at the first one which verifies, so a block dual-signed during a key
+ * rotation costs no more than one signed only with the cheaper key.  Every
+ * signature header is checked for sanity.
+ *
+ * @param block		Key block to verify
+ * @param size		Size of key block buffer
+ * @param keys		Array of trusted keys
+ * @param key_count	Number of keys in the array
+ * @param wb		Work buffer
+ * @return VB2_SUCCESS, or non-zero error code if error.  If every signature
+ * matching a trusted key failed, this is the error from the last one tried.
+ */
+int vb2_verify_keyblock_keys(struct vb2_keyblock *block,
+			     uint32_t size,
+			     const struct vb2_public_key *keys,
+			     int key_count,
+			     const struct vb2_workbuf *wb);
+
+/**
+ * Check the sanity of a key table.
+ *
+ * Checks the header, that the entries are inside the table, and that they
+ * are sorted by GUID with no duplicates.  The keys themselves are checked
+ * when vb2_key_table_find() returns them.
+ *
+ * @param table		Key table to verify
+ * @param size		Size of key table buffer
+ * @return VB2_SUCCESS, or non-zero error code if error.
+ */
+int vb2_verify_key_table(const struct vb2_key_table *table, uint32_t size);
+
+/**
+ * Find and unpack the key with a GUID in a key table.
  *
- * The signature in the preamble is destroyed during the check.
+ * Binary searches the table, which must have passed vb2_verify_key_table().
+ *
+ * @param key		Destination for unpacked key
+ * @param table		Key table to search
+ * @param guid		GUID of key to find
+ * @return VB2_SUCCESS, VB2_ERROR_KEY_TABLE_NOT_FOUND if no key has the GUID,
+ * or another non-zero error code if the key is bad.
+ */
+int vb2_key_table_find(struct vb2_public_key *key,
+		       const struct vb2_key_table *table,
+		       const struct vb2_guid *guid);
+
+/**
+ * Check the sanity of a key block against a table of trusted public keys.
+ *
+ * Like vb2_verify_keyblock_keys(), but each signature's key is looked up in
+ * the table by GUID, so the cost doesn't grow with the number of keys.
+ *
+ * @param block		Key block to verify
+ * @param size		Size of key block buffer
+ * @param table		Key table, which must have passed
+ *			vb2_verify_key_table()
+ * @param wb		Work buffer
+ * @return VB2_SUCCESS, or non-zero error code if error.
+ */
+int vb2_verify_keyblock_table(struct vb2_keyblock *block,
+			      uint32_t size,
+			      const struct vb2_key_table *table,
+			      const struct vb2_workbuf *wb);
+
+/**
+ * Check the sanity of a firmware preamble using a public key.
  *
  * @param preamble     	Preamble to verify
  * @param size		Size of preamble buffer
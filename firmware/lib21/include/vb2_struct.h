@@ -40,6 +40,9 @@ enum vb2_struct_common_magic {
 
 	/* "Vb2S" = vb2_signature.c.magic */
 	VB2_MAGIC_SIGNATURE		= 0x53326256,
+
+	/* "Vb2T" = vb2_key_table.c.magic */
+	VB2_MAGIC_KEY_TABLE		= 0x54326256,
 };
 
 
@@ -144,6 +147,46 @@ struct vb2_packed_key {
 #define EXPECTED_VB2_PACKED_KEY_SIZE					\
 	(EXPECTED_VB2_STRUCT_COMMON_SIZE + EXPECTED_GUID_SIZE + 16)
 
+/* Current version of vb2_key_table struct */
+#define VB2_KEY_TABLE_VERSION_MAJOR 3
+#define VB2_KEY_TABLE_VERSION_MINOR 0
+
+/* Entry in a vb2_key_table */
+struct vb2_key_table_entry {
+	/* GUID of the key; must match the packed key's own GUID */
+	struct vb2_guid guid;
+
+	/* Offset of key (struct vb2_packed_key) from start of the table */
+	uint32_t key_offset;
+} __attribute__((packed));
+
+#define EXPECTED_VB2_KEY_TABLE_ENTRY_SIZE (EXPECTED_GUID_SIZE + 4)
+
+/*
+ * Table of trusted public keys, looked up by GUID.  This lets the firmware
+ * trust several root keys (for rotation, or one per OEM) and go straight to
+ * the one a keyblock signature names, instead of trying each in turn.
+ *
+ * The table data must be arranged like this:
+ *     1) vb2_key_table header struct h
+ *     2) Table description (pointed to by h.c.fixed_size)
+ *     3) Entries (pointed to by h.entry_offset), sorted by GUID in memcmp()
+ *        order, with no duplicates
+ *     4) Packed keys (pointed to by the entries)
+ */
+struct vb2_key_table {
+	/* Common header fields */
+	struct vb2_struct_common c;
+
+	/* Number of entries */
+	uint32_t key_count;
+
+	/* Offset of first entry (struct vb2_key_table_entry) from start */
+	uint32_t entry_offset;
+} __attribute__((packed));
+
+#define EXPECTED_VB2_KEY_TABLE_SIZE (EXPECTED_VB2_STRUCT_COMMON_SIZE + 8)
+
 /* Current version of vb2_packed_private_key struct */
 #define VB2_PACKED_PRIVATE_KEY_VERSION_MAJOR 3
 #define VB2_PACKED_PRIVATE_KEY_VERSION_MINOR 0
@@ -296,6 +339,11 @@ struct vb2_keyblock {
 #define VB2_FIRMWARE_PREAMBLE_RESERVED0 0x00000001
 /* Do not allow use of any hardware crypto accelerators. */
 #define VB2_FIRMWARE_PREAMBLE_DISALLOW_HWCRYPTO 0x00000002
+/*
+ * The firmware body is stored as an LZMA1 (.lzma) stream, and the body hash
+ * covers the compressed bytes.  See vb2api_get_body_compression().
+ */
+#define VB2_FIRMWARE_PREAMBLE_BODY_COMPRESSED 0x00000004
 
 /*
  * Firmware preamble
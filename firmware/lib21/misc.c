@@ -18,9 +18,11 @@
 /**
  * Read an object with a common struct header from a verified boot resource.
  *
- * On success, an object buffer will be allocated in the work buffer, the
- * object will be stored into the buffer, and *buf_ptr will point to the
- * object.
+ * On success, *buf_ptr will point to the object.  If the platform can map the
+ * resource, that is where the object sits in the mapping, and it must not be
+ * modified.  If the object is in the vblock prefix, that is where it sits in
+ * the prefix.  Otherwise, an object buffer will be allocated in the work
+ * buffer and the object will be stored into the buffer.
  *
  * @param ctx		Vboot context
  * @param index		Resource index to read
@@ -35,11 +37,34 @@ int vb2_read_resource_object(struct vb2_context *ctx,
 			     void **buf_ptr)
 {
 	struct vb2_struct_common c;
+	const struct vb2_struct_common *mc;
+	uint32_t map_size;
 	void *buf;
 	int rv;
 
 	*buf_ptr = NULL;
 
+	/* Use the object in place if the platform can map all of it */
+	rv = vb2ex_map_resource(ctx, index, offset, (const void **)&mc,
+				&map_size);
+	if (rv == VB2_SUCCESS) {
+		if (map_size >= sizeof(*mc) && map_size >= mc->total_size) {
+			*buf_ptr = (void *)mc;
+			return VB2_SUCCESS;
+		}
+	} else if (rv != VB2_ERROR_EX_MAP_RESOURCE_UNSUPPORTED) {
+		return rv;
+	}
+
+	/* Or if it's all in the start of the vblock we've already read */
+	if (index == VB2_RES_FW_VBLOCK) {
+		mc = vb2_vblock_prefix(ctx, offset, sizeof(*mc));
+		if (mc && vb2_vblock_prefix(ctx, offset, mc->total_size)) {
+			*buf_ptr = (void *)mc;
+			return VB2_SUCCESS;
+		}
+	}
+
 	/* Read the common header */
 	rv = vb2ex_read_resource(ctx, index, offset, &c, sizeof(c));
 	if (rv)
@@ -71,8 +96,10 @@ int vb2_load_fw_keyblock(struct vb2_context *ctx)
 	uint32_t key_size;
 	struct vb2_packed_key *packed_key;
 	struct vb2_public_key root_key;
+	struct vb2_key_table *root_table;
 	struct vb2_keyblock *kb;
 
+	int version_rv = VB2_SUCCESS;
 	int rv;
 
 	vb2_workbuf_from_ctx(ctx, &wb);
@@ -88,42 +115,73 @@ int vb2_load_fw_keyblock(struct vb2_context *ctx)
 	if (rv)
 		return rv;
 
-	/* Unpack the root key */
-	rv = vb2_unpack_key(&root_key, key_data, key_size);
+	/*
+	 * Unpack the root key.  The GBB may instead hold a table of trusted
+	 * root keys, in which case the keyblock signature picks one.
+	 */
+	root_table = (struct vb2_key_table *)key_data;
+	if (key_size >= sizeof(*root_table) &&
+	    root_table->c.magic == VB2_MAGIC_KEY_TABLE) {
+		rv = vb2_verify_key_table(root_table, key_size);
+	} else {
+		root_table = NULL;
+		rv = vb2_unpack_key(&root_key, key_data, key_size);
+	}
 	if (rv)
 		return rv;
 
 	/*
 	 * Load the firmware keyblock common header into the work buffer after
-	 * the root key.
+	 * the root key, reading ahead into the preamble if the caller wants.
 	 */
+	vb2_read_vblock_prefix(ctx, &wb);
 	rv = vb2_read_resource_object(ctx, VB2_RES_FW_VBLOCK, 0, &wb,
 				      (void **)&kb);
 	if (rv)
 		return rv;
 
+	/* If the keyblock didn't come from the prefix, the preamble won't */
+	if ((void *)kb != vb2_vblock_prefix(ctx, 0, 0))
+		sd->workbuf_vblock_prefix_size = 0;
+
+	/*
+	 * Key version is the upper 16 bits of the composite firmware version.
+	 * Checking it doesn't need the signature, but the version of a
+	 * keyblock which doesn't verify can't be trusted.  So only report a
+	 * rollback once the signature has been checked below.  If the data
+	 * key header isn't inside the keyblock, vb2_verify_keyblock() will
+	 * reject it.
+	 */
+	packed_key = (struct vb2_packed_key *)((uint8_t *)kb + kb->key_offset);
+	if (kb->c.total_size >= sizeof(*kb) &&
+	    kb->key_offset <= kb->c.total_size - sizeof(*packed_key)) {
+		if (packed_key->key_version > 0xffff)
+			version_rv = VB2_ERROR_FW_KEYBLOCK_VERSION_RANGE;
+		else if (packed_key->key_version <
+			 (sd->fw_version_secdata >> 16))
+			version_rv = VB2_ERROR_FW_KEYBLOCK_VERSION_ROLLBACK;
+	}
+
 	/* Verify the keyblock */
-	rv = vb2_verify_keyblock(kb, kb->c.total_size, &root_key, &wb);
+	if (root_table)
+		rv = vb2_verify_keyblock_table(kb, kb->c.total_size,
+					       root_table, &wb);
+	else
+		rv = vb2_verify_keyblock(kb, kb->c.total_size, &root_key,
+					 &wb);
 	if (rv) {
 		vb2_fail(ctx, VB2_RECOVERY_FW_KEYBLOCK, rv);
 		return rv;
 	}
 
+	if (version_rv) {
+		vb2_fail(ctx, VB2_RECOVERY_FW_KEY_ROLLBACK, version_rv);
+		return version_rv;
+	}
+
 	/* Preamble follows the keyblock in the vblock */
 	sd->vblock_preamble_offset = kb->c.total_size;
 
-	packed_key = (struct vb2_packed_key *)((uint8_t *)kb + kb->key_offset);
-
-	/* Key version is the upper 16 bits of the composite firmware version */
-	if (packed_key->key_version > 0xffff)
-		rv = VB2_ERROR_FW_KEYBLOCK_VERSION_RANGE;
-	if (!rv && packed_key->key_version < (sd->fw_version_secdata >> 16))
-		rv = VB2_ERROR_FW_KEYBLOCK_VERSION_ROLLBACK;
-	if (rv) {
-		vb2_fail(ctx, VB2_RECOVERY_FW_KEY_ROLLBACK, rv);
-		return rv;
-	}
-
 	sd->fw_version = packed_key->key_version << 16;
 
 	/*
@@ -134,8 +192,12 @@ int vb2_load_fw_keyblock(struct vb2_context *ctx)
 	 * Use memmove() instead of memcpy().  In theory, the destination will
 	 * never overlap with the source because the root key is likely to be
 	 * at least as large as the data key, but there's no harm here in being
-	 * paranoid.
+	 * paranoid.  If the keyblock was mapped, nothing has checked the data
+	 * key fits yet.
 	 */
+	if (packed_key->c.total_size >
+	    vb2_offset_of(key_data, wb.buf) + wb.size)
+		return VB2_ERROR_FW_KEYBLOCK_WORKBUF;
 	memmove(key_data, packed_key, packed_key->c.total_size);
 	packed_key = (struct vb2_packed_key *)key_data;
 
@@ -147,6 +209,14 @@ int vb2_load_fw_keyblock(struct vb2_context *ctx)
 	ctx->workbuf_used = sd->workbuf_data_key_offset +
 		sd->workbuf_data_key_size;
 
+	/*
+	 * So will the vblock prefix, for the preamble.  The keyblock came from
+	 * it, so the data key can't have run past its end.
+	 */
+	if (sd->workbuf_vblock_prefix_size)
+		ctx->workbuf_used = sd->workbuf_vblock_prefix_offset +
+			sd->workbuf_vblock_prefix_size;
+
 	return VB2_SUCCESS;
 }
 
@@ -164,8 +234,6 @@ int vb2_load_fw_preamble(struct vb2_context *ctx)
 
 	int rv;
 
-	vb2_workbuf_from_ctx(ctx, &wb);
-
 	/* Unpack the firmware data key */
 	if (!sd->workbuf_data_key_size)
 		return VB2_ERROR_FW_PREAMBLE2_DATA_KEY;
@@ -174,6 +242,17 @@ int vb2_load_fw_preamble(struct vb2_context *ctx)
 	if (rv)
 		return rv;
 
+	/*
+	 * If the preamble isn't all in the vblock prefix, free the prefix so
+	 * the preamble is read right after the data key.
+	 */
+	pre = vb2_vblock_prefix(ctx, sd->vblock_preamble_offset, sizeof(*pre));
+	if (!pre || !vb2_vblock_prefix(ctx, sd->vblock_preamble_offset,
+				       pre->c.total_size))
+		vb2_free_vblock_prefix(ctx);
+
+	vb2_workbuf_from_ctx(ctx, &wb);
+
 	/* Load the firmware preamble */
 	rv = vb2_read_resource_object(ctx, VB2_RES_FW_VBLOCK,
 				      sd->vblock_preamble_offset, &wb,
@@ -190,12 +269,19 @@ int vb2_load_fw_preamble(struct vb2_context *ctx)
 		return rv;
 	}
 
-	/* Move the preamble down now that the data key is no longer used */
+	/*
+	 * Move the preamble down now that the data key is no longer used.  If
+	 * the preamble was mapped, this is where it's copied into the work
+	 * buffer, so make sure it fits.
+	 */
+	if (pre->c.total_size > vb2_offset_of(key_data, wb.buf) + wb.size)
+		return VB2_ERROR_FW_PREAMBLE2_WORKBUF;
 	memmove(key_data, pre, pre->c.total_size);
 	pre = (struct vb2_fw_preamble *)key_data;
 
-	/* Data key is now gone */
+	/* Data key is now gone, and so is the vblock prefix if it was kept */
 	sd->workbuf_data_key_offset = sd->workbuf_data_key_size = 0;
+	sd->workbuf_vblock_prefix_size = 0;
 
 	/*
 	 * Firmware version is the lower 16 bits of the composite firmware
@@ -23,6 +23,12 @@ int vb2_unpack_key_data(struct vb2_public_key *key,
 		return VB2_ERROR_UNPACK_KEY_SIZE;
 	}
 
+	/* Ed25519 keys are used as they are */
+	if (key->sig_alg == VB2_SIG_ED25519) {
+		key->ed25519_key = key_data;
+		return VB2_SUCCESS;
+	}
+
 	/* Check for alignment */
 	if (!vb2_aligned(buf32, sizeof(uint32_t)))
 		return VB2_ERROR_UNPACK_KEY_ALIGN;
@@ -81,7 +87,7 @@ int vb2_unpack_key(struct vb2_public_key *key,
 
 	key->sig_alg = pkey->sig_alg;
 	if (key->sig_alg != VB2_SIG_NONE) {
-		sig_size = vb2_rsa_sig_size(key->sig_alg);
+		sig_size = vb2_sig_size(key->sig_alg, key->hash_alg);
 		if (!sig_size)
 			return VB2_ERROR_UNPACK_KEY_SIG_ALGORITHM;
 		rv = vb2_unpack_key_data(
@@ -39,7 +39,7 @@ int main(void)
 	RollbackKernelLock(0);
 
 	/* tpm_bootmode.c */
-	SetTPMBootModeState(0, 0, 0, 0);
+	SetTPMBootModeState(0, 0, 0, 0, 0);
 
 	/* tlcl.h */
 	TlclStartup();
@@ -62,12 +62,14 @@ int main(void)
 	TlclSetGlobalLock();
 	TlclExtend(0, 0, 0);
 	TlclGetPermissions(0, 0);
+	TlclGetSpaceInfo(0, 0, 0);
 
 	/* vboot_api.h - entry points INTO vboot_reference */
 	VbInit(0, 0);
 	VbSelectFirmware(0, 0);
 	VbUpdateFirmwareBodyHash(0, 0, 0);
 	VbSelectAndLoadKernel(0, 0);
+	VbSharedDataEncode(0, 0, 0);
 
 	/* vboot_common.h */
 	OffsetOf(0, 0);
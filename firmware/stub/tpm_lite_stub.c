@@ -20,14 +20,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <time.h>
 #include <unistd.h>
 
 
 #define TPM_DEVICE_PATH "/dev/tpm0"
+/* TPM_DEVICE_PATH values with this prefix name a Unix socket, such as a TPM
+ * resource manager's, to use instead of the device. */
+#define TPM_SOCKET_PREFIX "unix:"
 /* Retry failed open()s for 5 seconds in 10ms polling intervals. */
 #define OPEN_RETRY_DELAY_NS (10 * 1000 * 1000)
 #define OPEN_RETRY_MAX_NUM  500
@@ -37,9 +42,23 @@
  * remove the wrappers and call us directly. */
 
 
-/* The file descriptor for the TPM device.
+/* How commands get to the TPM.
+ */
+typedef struct TpmTransport {
+  const char* name;
+  /* Returns a file descriptor, or -1 with errno set. */
+  int (*Open)(const char* path);
+  /* Writes a whole command; returns bytes written, or -1 with errno set. */
+  int (*Write)(int fd, const uint8_t* buf, int size);
+  /* Reads one whole response of at most |size| bytes; returns its length,
+   * 0 at end of file, or -1 with errno set. */
+  int (*Read)(int fd, uint8_t* buf, int size);
+} TpmTransport;
+
+/* The file descriptor for the TPM device, and the transport it uses.
  */
 static int tpm_fd = -1;
+static const TpmTransport* tpm_transport;
 /* If the library should exit during an OS-level TPM failure.
  */
 static int exit_on_failure = 1;
@@ -74,11 +93,100 @@ __attribute__((unused)) static void PrintBytes(const uint8_t* a, int n) {
 }
 
 
-/* Executes a command on the TPM.
+static int DeviceOpen(const char* path) {
+  return open(path, O_RDWR);
+}
+
+
+static int DeviceWrite(int fd, const uint8_t* buf, int size) {
+  return write(fd, buf, size);
+}
+
+
+/* The device driver hands back a whole response per read(). */
+static int DeviceRead(int fd, uint8_t* buf, int size) {
+  return read(fd, buf, size);
+}
+
+
+static int SocketOpen(const char* path) {
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  Memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+  return fd;
+}
+
+
+/* Don't let a resource manager going away kill us with SIGPIPE. */
+static int SocketWrite(int fd, const uint8_t* buf, int size) {
+  int done = 0;
+
+  while (done < size) {
+    int n = send(fd, buf + done, size - done, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return -1;
+    done += n;
+  }
+  return done;
+}
+
+
+/* A stream has no message boundaries, so read the response header to find
+ * out how much more there is. */
+static int SocketRead(int fd, uint8_t* buf, int size) {
+  const int header_size = sizeof(uint16_t) + sizeof(uint32_t);
+  uint32_t want = header_size;
+  int got = 0;
+
+  while (got < want) {
+    int n = read(fd, buf + got, want - got);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return got ? -1 : n;
+    got += n;
+    if (got == header_size) {
+      FromTpmUint32(buf + sizeof(uint16_t), &want);
+      if (want < header_size || want > size) {
+        errno = EMSGSIZE;
+        return -1;
+      }
+    }
+  }
+  return got;
+}
+
+
+static const TpmTransport device_transport = {
+  "device", DeviceOpen, DeviceWrite, DeviceRead
+};
+static const TpmTransport socket_transport = {
+  "socket", SocketOpen, SocketWrite, SocketRead
+};
+
+
+/* Sends a command to the TPM, without waiting for the response.
  */
-static VbError_t TpmExecute(const uint8_t *in, const uint32_t in_len,
-                uint8_t *out, uint32_t *pout_len) {
-  uint8_t response[TPM_MAX_COMMAND_SIZE];
+static VbError_t TpmWrite(const uint8_t *in, const uint32_t in_len) {
   if (in_len <= 0) {
     return DoError(TPM_E_INPUT_TOO_SMALL,
                    "invalid command length %d for command 0x%x\n",
@@ -88,31 +196,47 @@ static VbError_t TpmExecute(const uint8_t *in, const uint32_t in_len,
                    "the TPM device was not opened.  " \
                    "Forgot to call TlclLibInit?\n");
   } else {
-    int n = write(tpm_fd, in, in_len);
+    int n = tpm_transport->Write(tpm_fd, in, in_len);
     if (n != in_len) {
       return DoError(TPM_E_WRITE_FAILURE,
                      "write failure to TPM device: %s\n", strerror(errno));
     }
-    n = read(tpm_fd, response, sizeof(response));
-    if (n == 0) {
-      return DoError(TPM_E_READ_EMPTY, "null read from TPM device\n");
-    } else if (n < 0) {
-      return DoError(TPM_E_READ_FAILURE, "read failure from TPM device: %s\n",
-                     strerror(errno));
-    } else {
-      if (n > *pout_len) {
-        return DoError(TPM_E_RESPONSE_TOO_LARGE,
-                       "TPM response too long for output buffer\n");
-      } else {
-        *pout_len = n;
-        Memcpy(out, response, n);
-      }
-    }
   }
   return VBERROR_SUCCESS;
 }
 
 
+/* Waits for the response to the command sent by TpmWrite().
+ */
+static VbError_t TpmRead(uint8_t *out, uint32_t *pout_len) {
+  uint8_t response[TPM_MAX_COMMAND_SIZE];
+  int n = tpm_transport->Read(tpm_fd, response, sizeof(response));
+  if (n == 0) {
+    return DoError(TPM_E_READ_EMPTY, "null read from TPM device\n");
+  } else if (n < 0) {
+    return DoError(TPM_E_READ_FAILURE, "read failure from TPM device: %s\n",
+                   strerror(errno));
+  } else if (n > *pout_len) {
+    return DoError(TPM_E_RESPONSE_TOO_LARGE,
+                   "TPM response too long for output buffer\n");
+  }
+  *pout_len = n;
+  Memcpy(out, response, n);
+  return VBERROR_SUCCESS;
+}
+
+
+/* Executes a command on the TPM.
+ */
+static VbError_t TpmExecute(const uint8_t *in, const uint32_t in_len,
+                uint8_t *out, uint32_t *pout_len) {
+  VbError_t result = TpmWrite(in, in_len);
+  if (result != VBERROR_SUCCESS)
+    return result;
+  return TpmRead(out, pout_len);
+}
+
+
 /* Gets the tag field of a TPM command.
  */
 __attribute__((unused))
@@ -162,11 +286,17 @@ VbError_t VbExTpmOpen(void) {
   if (device_path == NULL) {
     device_path = TPM_DEVICE_PATH;
   }
+  if (!strncmp(device_path, TPM_SOCKET_PREFIX, strlen(TPM_SOCKET_PREFIX))) {
+    tpm_transport = &socket_transport;
+    device_path += strlen(TPM_SOCKET_PREFIX);
+  } else {
+    tpm_transport = &device_transport;
+  }
 
   /* Retry TPM opens on EBUSY failures. */
   for (retries = 0; retries < OPEN_RETRY_MAX_NUM; ++ retries) {
     errno = 0;
-    tpm_fd = open(device_path, O_RDWR);
+    tpm_fd = tpm_transport->Open(device_path);
     saved_errno = errno;
     if (tpm_fd >= 0)
       return VBERROR_SUCCESS;
@@ -180,8 +310,8 @@ VbError_t VbExTpmOpen(void) {
      delay.tv_nsec = OPEN_RETRY_DELAY_NS;
      nanosleep(&delay, NULL);
   }
-  return DoError(TPM_E_NO_DEVICE, "TPM: Cannot open TPM device %s: %s\n",
-                 device_path, strerror(saved_errno));
+  return DoError(TPM_E_NO_DEVICE, "TPM: Cannot open TPM %s %s: %s\n",
+                 tpm_transport->name, device_path, strerror(saved_errno));
 }
 
 
@@ -248,3 +378,16 @@ VbError_t VbExTpmSendReceive(const uint8_t* request, uint32_t request_length,
 
   return VBERROR_SUCCESS;
 }
+
+
+VbError_t VbExTpmSubmit(const uint8_t* request, uint32_t request_length) {
+  /* The TPM device driver queues the command; the response is read later */
+  return TpmWrite(request, request_length);
+}
+
+
+VbError_t VbExTpmComplete(uint8_t* response, uint32_t* response_length) {
+  if (tpm_fd < 0)
+    return DoError(TPM_E_NO_DEVICE, "the TPM device was not opened.\n");
+  return TpmRead(response, response_length);
+}
@@ -22,6 +22,7 @@ int Memcmp(const void *src1, const void *src2, size_t n)
 	return memcmp(src1, src2, n);
 }
 
+#ifndef FAST_MEMORY_OPS
 void *Memcpy(void *dest, const void *src, uint64_t n)
 {
 	return memcpy(dest, src, (size_t)n);
@@ -31,5 +32,6 @@ void *Memset(void *d, const uint8_t c, uint64_t n)
 {
 	return memset(d, c, n);
 }
+#endif
 
 
@@ -28,6 +28,11 @@ VbError_t VbExBeep(uint32_t msec, uint32_t frequency)
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbExBeepNotes(const VbBeepNote *notes, uint32_t count)
+{
+	return VBERROR_BEEP_NOTES_UNSUPPORTED;
+}
+
 VbError_t VbExDisplayInit(uint32_t *width, uint32_t *height)
 {
 	return VBERROR_SUCCESS;
@@ -54,6 +59,22 @@ VbError_t VbExDisplayImage(uint32_t x, uint32_t y,
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbExDisplayImageRun(const VbDisplayImage *images, uint32_t count)
+{
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDisplayLayout(const VbDisplayImage *images, uint32_t count)
+{
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDisplayImageRects(void *buffer, uint32_t buffersize,
+				const VbDisplayRect *rects, uint32_t count)
+{
+	return VBERROR_SUCCESS;
+}
+
 VbError_t VbExDisplayDebugInfo(const char *info_str)
 {
 	return VBERROR_SUCCESS;
@@ -69,6 +90,11 @@ uint32_t VbExKeyboardReadWithFlags(uint32_t *flags_ptr)
 	return 0;
 }
 
+VbError_t VbExKeyboardWait(uint32_t timeout_ms)
+{
+	return VBERROR_KEYBOARD_WAIT_UNSUPPORTED;
+}
+
 uint32_t VbExGetSwitches(uint32_t mask)
 {
 	return 0;
@@ -86,6 +112,33 @@ VbError_t VbExDecompress(void *inbuf, uint32_t in_size,
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbExDecompressStreamOpen(uint32_t compression_type,
+				   uint32_t original_size, uint32_t x,
+				   uint32_t y, VbExDecompressStream_t *stream)
+{
+	*stream = NULL;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDecompressStreamOpenMemory(uint32_t compression_type,
+					 void *outbuf, uint32_t out_size,
+					 VbExDecompressStream_t *stream)
+{
+	*stream = NULL;
+	return VBERROR_DECOMPRESS_STREAM_UNSUPPORTED;
+}
+
+VbError_t VbExDecompressStreamWrite(VbExDecompressStream_t stream,
+				    const void *inbuf, uint32_t in_size)
+{
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDecompressStreamClose(VbExDecompressStream_t stream)
+{
+	return VBERROR_SUCCESS;
+}
+
 int VbExTrustEC(int devidx)
 {
 	return 1;
@@ -124,6 +177,11 @@ VbError_t VbExEcHashRW(int devidx, const uint8_t **hash, int *hash_size)
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbExEcHashRWStart(int devidx)
+{
+	return VBERROR_EC_HASH_START_UNSUPPORTED;
+}
+
 VbError_t VbExEcGetExpectedRW(int devidx, enum VbSelectFirmware_t select,
                               const uint8_t **image, int *image_size)
 {
@@ -148,6 +206,28 @@ VbError_t VbExEcUpdateRW(int devidx, const uint8_t *image, int image_size)
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbExEcGetRWChunkSize(int devidx, int *chunk_size)
+{
+	*chunk_size = 0;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExEcHashRWChunk(int devidx, int offset, int size,
+			    const uint8_t **hash, int *hash_size)
+{
+	static const uint8_t fake_hash[32] = {1, 2, 3, 4};
+
+	*hash = fake_hash;
+	*hash_size = sizeof(fake_hash);
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExEcUpdateRWChunk(int devidx, int offset, const uint8_t *data,
+			      int size)
+{
+	return VBERROR_SUCCESS;
+}
+
 VbError_t VbExEcProtectRW(int devidx)
 {
 	return VBERROR_SUCCESS;
@@ -32,12 +32,23 @@ VbError_t VbExDiskFreeInfo(VbDiskInfo* infos_ptr,
 }
 
 
+VbError_t VbExDiskWaitForChange(uint32_t disk_flags, uint32_t timeout_ms) {
+  return VBERROR_DISK_WAIT_UNSUPPORTED;
+}
+
+
 VbError_t VbExDiskRead(VbExDiskHandle_t handle, uint64_t lba_start,
                        uint64_t lba_count, void* buffer) {
   return VBERROR_SUCCESS;
 }
 
 
+VbError_t VbExDiskReadStart(VbExDiskHandle_t handle, uint64_t lba_start,
+                            uint64_t lba_count) {
+  return VBERROR_SUCCESS;
+}
+
+
 VbError_t VbExDiskWrite(VbExDiskHandle_t handle, uint64_t lba_start,
                         uint64_t lba_count, const void* buffer) {
   return VBERROR_SUCCESS;
@@ -6,6 +6,7 @@
  */
 
 #include <execinfo.h>
+#include <pthread.h>
 #include <stdint.h>
 
 #define _STUB_IMPLEMENTATION_
@@ -32,6 +33,9 @@ struct alloc_node {
 
 static struct alloc_node *alloc_head;
 
+/* Host code allocates from several threads at once */
+static pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static void print_stacktrace(void)
 {
 	void *buffer[MAX_STACK_LEVELS];
@@ -54,15 +58,19 @@ void *VbExMalloc(size_t size)
 	node = malloc(sizeof(*node));
 	if (!node)
 		abort();
-	node->next = alloc_head;
 	node->ptr = p;
 	node->size = size;
 	node->bt_levels = backtrace(node->bt_buffer, MAX_STACK_LEVELS);
+
+	pthread_mutex_lock(&alloc_lock);
+	node->next = alloc_head;
 	alloc_head = node;
+	pthread_mutex_unlock(&alloc_lock);
 
 	return p;
 }
 
+/* Caller must hold alloc_lock */
 static struct alloc_node **find_node(void *ptr)
 {
 	struct alloc_node **nodep;
@@ -76,13 +84,18 @@ static struct alloc_node **find_node(void *ptr)
 
 void VbExFree(void *ptr)
 {
-	struct alloc_node **nodep, *next;
+	struct alloc_node **nodep, *node = NULL;
 
+	pthread_mutex_lock(&alloc_lock);
 	nodep = find_node(ptr);
 	if (nodep) {
-		next = (*nodep)->next;
-		free(*nodep);
-		*nodep = next;
+		node = *nodep;
+		*nodep = node->next;
+	}
+	pthread_mutex_unlock(&alloc_lock);
+
+	if (node) {
+		free(node);
 	} else {
 		fprintf(stderr, "\n>>>>>> Invalid VbExFree() %p\n", ptr);
 		fflush(stderr);
@@ -106,7 +119,12 @@ int vboot_api_stub_check_memory(void)
 {
 	struct alloc_node *node, *next;
 
-	if (!alloc_head)
+	pthread_mutex_lock(&alloc_lock);
+	node = alloc_head;
+	alloc_head = NULL;
+	pthread_mutex_unlock(&alloc_lock);
+
+	if (!node)
 		return 0;
 
 	/*
@@ -114,7 +132,7 @@ int vboot_api_stub_check_memory(void)
 	 * about leaked memory.
 	 */
 	fprintf(stderr, "\nWarning, some allocations not freed:");
-	for (node = alloc_head; node; node = next) {
+	for (; node; node = next) {
 		next = node->next;
 		fprintf(stderr, "\nptr=%p, size=%zd\n", node->ptr, node->size);
 		fflush(stderr);
@@ -74,6 +74,30 @@ VbError_t VbExStreamRead(VbExStream_t stream, uint32_t bytes, void *buffer)
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbExStreamReadChunks(VbExStream_t stream, uint32_t bytes,
+			       void *buffer, uint32_t chunk_bytes,
+			       VbExStreamChunkDone_t done, void *ctx)
+{
+	/* Reads here are synchronous, so chunks wouldn't be any faster */
+	return VBERROR_STREAM_CHUNKS_UNSUPPORTED;
+}
+
+VbError_t VbExKernelBufferResolve(uint64_t load_address, uint64_t size,
+				  void **buffer)
+{
+	/* Host memory has nothing at the load address; use kernel_buffer */
+	return VBERROR_KERNEL_BUFFER_UNSUPPORTED;
+}
+
+VbError_t VbExStreamPrefetch(VbExStream_t stream, uint64_t bytes)
+{
+	/* Reads here are synchronous, so there's nothing to start early */
+	if (!stream)
+		return VBERROR_UNKNOWN;
+
+	return VBERROR_SUCCESS;
+}
+
 void VbExStreamClose(VbExStream_t stream)
 {
 	struct disk_stream *s = (struct disk_stream *)stream;
@@ -56,7 +56,7 @@ static void print_help(const char *progname)
 	printf("\n"
 "Usage:  " MYNAME " %s [options] <INFILE> [<BASENAME>]\n", progname);
 	printf("\n"
-"Create a keypair from an RSA key (.pem file).\n"
+"Create a keypair from an RSA or Ed25519 (vb21 only) key (.pem file).\n"
 "\n"
 "Options:\n"
 "\n"
@@ -106,6 +106,13 @@ static int vb1_make_keypair()
 		goto done;
 	}
 
+	/* vb1 algorithms only pair RSA with SHA-1, SHA-256 or SHA-512 */
+	if (opt_hash_alg > VB2_HASH_SHA512) {
+		fprintf(stderr, "Hash algorithm %d needs a vb21 key\n",
+			opt_hash_alg);
+		goto done;
+	}
+
 	/* combine the sig_alg with the hash_alg to get the vb1 algorithm */
 	vb1_algorithm = (sig_alg - VB2_SIG_RSA1024) * 3
 		+ opt_hash_alg - VB2_HASH_SHA1;
@@ -156,6 +163,56 @@ done:
 	return ret;
 }
 
+/* An Ed25519 .pem has everything for both halves of the keypair */
+static int vb2_make_ed25519_keypair(struct vb2_private_key *privkey)
+{
+	struct vb2_public_key *pubkey = 0;
+	int ret = 1;
+
+	privkey->hash_alg = opt_hash_alg;
+	privkey->guid = opt_guid;
+	if (opt_desc && vb2_private_key_set_desc(privkey, opt_desc)) {
+		fprintf(stderr, "Unable to set the private key description\n");
+		goto done;
+	}
+
+	/* Write it out */
+	strcpy(outext, ".vbprik2");
+	if (vb2_private_key_write(privkey, outfile)) {
+		fprintf(stderr, "unable to write private key\n");
+		goto done;
+	}
+	fprintf(stderr, "wrote %s\n", outfile);
+
+	/* Create the public key */
+	if (vb2_public_key_from_ed25519(&pubkey, privkey)) {
+		fprintf(stderr, "Couldn't extract the public key\n");
+		goto done;
+	}
+
+	pubkey->hash_alg = opt_hash_alg;
+	pubkey->version = opt_version;
+	memcpy((struct vb2_guid *)pubkey->guid, &opt_guid, sizeof(opt_guid));
+	if (opt_desc && vb2_public_key_set_desc(pubkey, opt_desc)) {
+		fprintf(stderr, "Unable to set pubkey description\n");
+		goto done;
+	}
+
+	/* Write it out */
+	strcpy(outext, ".vbpubk2");
+	if (vb2_public_key_write(pubkey, outfile)) {
+		fprintf(stderr, "unable to write public key\n");
+		goto done;
+	}
+	fprintf(stderr, "wrote %s\n", outfile);
+
+	ret = 0;
+
+done:
+	vb2_public_key_free(pubkey);
+	return ret;
+}
+
 static int vb2_make_keypair()
 {
 	struct vb2_private_key *privkey = 0;
@@ -179,6 +236,12 @@ static int vb2_make_keypair()
 	fclose(fp);
 
 	if (!rsa_key) {
+		/* Maybe it's Ed25519 */
+		if (!vb2_private_key_read_pem(&privkey, infile) &&
+		    privkey->sig_alg == VB2_SIG_ED25519) {
+			ret = vb2_make_ed25519_keypair(privkey);
+			goto done;
+		}
 		fprintf(stderr, "Unable to read RSA key from %s\n", infile);
 		goto done;
 	}
@@ -397,5 +460,5 @@ static int do_create(int argc, char *argv[])
 
 DECLARE_FUTIL_COMMAND(create, do_create,
 		      VBOOT_VERSION_ALL,
-		      "Create a keypair from an RSA .pem file",
+		      "Create a keypair from an RSA or Ed25519 .pem file",
 		      print_help);
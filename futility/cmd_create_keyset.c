@@ -0,0 +1,506 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Create a whole vb1 keyset, like scripts/keygeneration/create_new_keys.sh,
+ * but without running openssl and vbutil_* for each key. The RSA keys take
+ * nearly all the time, so they're generated side by side on a pool of
+ * threads.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+#include <openssl/rsa.h>
+
+#include "cryptolib.h"
+#include "futility.h"
+#include "host_common.h"
+#include "util_misc.h"
+#include "vboot_common.h"
+
+/* vb1 algorithm ids, as in scripts/keygeneration/common.sh */
+#define RSA2048_SHA256 4
+#define RSA4096_SHA256 7
+#define RSA4096_SHA512 8
+#define RSA8192_SHA512 11
+
+/* Keyblock flags, likewise */
+#define EC_KEYBLOCK_MODE		7
+#define FIRMWARE_KEYBLOCK_MODE		7
+#define DEV_FIRMWARE_KEYBLOCK_MODE	6
+#define RECOVERY_KERNEL_KEYBLOCK_MODE	11
+#define KERNEL_KEYBLOCK_MODE		7
+#define INSTALLER_KERNEL_KEYBLOCK_MODE	10
+
+#define VERSION_FILE "key.versions"
+
+struct keypair_s {
+	const char *name;
+	uint64_t algorithm;
+	const char *version_name;	/* in key.versions, or NULL for 1 */
+	int dev_only;			/* only with --devkeyblock */
+
+	/* Filled in by the workers */
+	uint32_t version;
+	VbPrivateKey *privkey;
+	VbPublicKey *pubkey;
+	int failed;
+};
+
+enum {
+	EC_ROOT_KEY,
+	EC_DATA_KEY,
+	ROOT_KEY,
+	FIRMWARE_DATA_KEY,
+	DEV_FIRMWARE_DATA_KEY,
+	KERNEL_SUBKEY,
+	KERNEL_DATA_KEY,
+	RECOVERY_KEY,
+	RECOVERY_KERNEL_DATA_KEY,
+	INSTALLER_KERNEL_DATA_KEY,
+	NUM_KEYPAIRS
+};
+
+static struct keypair_s keypair[NUM_KEYPAIRS] = {
+	[EC_ROOT_KEY] = {"ec_root_key", RSA4096_SHA256},
+	[EC_DATA_KEY] = {"ec_data_key", RSA4096_SHA256, "ec_key_version"},
+	[ROOT_KEY] = {"root_key", RSA8192_SHA512},
+	[FIRMWARE_DATA_KEY] = {"firmware_data_key", RSA4096_SHA256,
+			       "firmware_key_version"},
+	[DEV_FIRMWARE_DATA_KEY] = {"dev_firmware_data_key", RSA4096_SHA256,
+				   "firmware_key_version", 1},
+	/* Firmware version is the kernel subkey version. */
+	[KERNEL_SUBKEY] = {"kernel_subkey", RSA4096_SHA256,
+			   "firmware_version"},
+	/* Kernel data key version is the kernel key version. */
+	[KERNEL_DATA_KEY] = {"kernel_data_key", RSA2048_SHA256,
+			     "kernel_key_version"},
+	[RECOVERY_KEY] = {"recovery_key", RSA8192_SHA512},
+	[RECOVERY_KERNEL_DATA_KEY] = {"recovery_kernel_data_key",
+				      RSA8192_SHA512},
+	[INSTALLER_KERNEL_DATA_KEY] = {"installer_kernel_data_key",
+				       RSA8192_SHA512},
+};
+
+static const struct keyblock_s {
+	const char *name;
+	uint64_t flags;
+	int data_key;
+	int sign_key;
+	int dev_only;
+} keyblock[] = {
+	{"firmware", FIRMWARE_KEYBLOCK_MODE, FIRMWARE_DATA_KEY, ROOT_KEY},
+	{"ec", EC_KEYBLOCK_MODE, EC_DATA_KEY, EC_ROOT_KEY},
+	{"dev_firmware", DEV_FIRMWARE_KEYBLOCK_MODE, DEV_FIRMWARE_DATA_KEY,
+	 ROOT_KEY, 1},
+	{"recovery_kernel", RECOVERY_KERNEL_KEYBLOCK_MODE,
+	 RECOVERY_KERNEL_DATA_KEY, RECOVERY_KEY},
+	{"kernel", KERNEL_KEYBLOCK_MODE, KERNEL_DATA_KEY, KERNEL_SUBKEY},
+	{"installer_kernel", INSTALLER_KERNEL_KEYBLOCK_MODE,
+	 INSTALLER_KERNEL_DATA_KEY, RECOVERY_KEY},
+};
+
+enum {
+	OPT_DEVKEYBLOCK = 1000,
+	OPT_4K,
+	OPT_4K_ROOT,
+	OPT_4K_RECOVERY,
+	OPT_4K_RECOVERY_KERNEL,
+	OPT_4K_INSTALLER_KERNEL,
+};
+
+static const struct option long_opts[] = {
+	{"devkeyblock",         0, 0, OPT_DEVKEYBLOCK},
+	{"4k",                  0, 0, OPT_4K},
+	{"4k-root",             0, 0, OPT_4K_ROOT},
+	{"4k-recovery",         0, 0, OPT_4K_RECOVERY},
+	{"4k-recovery-kernel",  0, 0, OPT_4K_RECOVERY_KERNEL},
+	{"4k-installer-kernel", 0, 0, OPT_4K_INSTALLER_KERNEL},
+	{"jobs",                1, 0, 'j'},
+	{NULL, 0, 0, 0}
+};
+
+static void print_help(const char *progname)
+{
+	printf("\n"
+"Usage:  " MYNAME " %s [options] [<DIR>]\n"
+"\n"
+"Create the .vbpubk, .vbprivk and .keyblock files of a vb1 keyset in DIR\n"
+"(default is the current directory), like create_new_keys.sh does. Key\n"
+"versions are read from DIR/" VERSION_FILE ", which is created if needed.\n"
+"\n"
+"Options:\n"
+"\n"
+"  --devkeyblock          Also generate developer firmware keyblock and\n"
+"                           data key\n"
+"  --4k                   Use 4k keys instead of 8k (enables options below)\n"
+"  --4k-root              Use 4k key size for the root key\n"
+"  --4k-recovery          Use 4k key size for the recovery key\n"
+"  --4k-recovery-kernel   Use 4k key size for the recovery kernel data\n"
+"  --4k-installer-kernel  Use 4k key size for the installer kernel data\n"
+"  -j|--jobs NUM          Number of keys to generate at once (default is\n"
+"                           the number of CPUs)\n"
+"\n", progname);
+}
+
+/* Return the bit length of the RSA key for a vb1 algorithm */
+static int alg_to_keylen(uint64_t algorithm)
+{
+	return 1 << (10 + algorithm / 3);
+}
+
+/* Look up |name| in |versions| (the contents of key.versions). */
+static uint32_t get_version(const char *versions, const char *name)
+{
+	size_t len = strlen(name);
+	const char *line;
+
+	for (line = versions; line && *line; line = strchr(line, '\n')) {
+		if (*line == '\n')
+			line++;
+		if (!strncmp(line, name, len) && line[len] == '=')
+			return strtoul(line + len + 1, NULL, 0);
+	}
+	return 1;
+}
+
+static char *read_versions(const char *dir)
+{
+	char *path, *buf = NULL;
+	long size;
+	FILE *fp;
+
+	if (asprintf(&path, "%s/" VERSION_FILE, dir) < 0)
+		return NULL;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		printf("No version file found. Creating default %s.\n", path);
+		fp = fopen(path, "w+");
+		if (fp)
+			fprintf(fp, "firmware_key_version=1\n"
+				"firmware_version=1\n"
+				"kernel_key_version=1\n"
+				"kernel_version=1\n");
+	}
+	if (fp && fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) >= 0 &&
+	    fseek(fp, 0, SEEK_SET) == 0 && (buf = calloc(1, size + 1)) &&
+	    size && fread(buf, size, 1, fp) != 1) {
+		free(buf);
+		buf = NULL;
+	}
+	if (!fp || !buf)
+		fprintf(stderr, "Unable to read %s\n", path);
+	if (fp)
+		fclose(fp);
+	free(path);
+	return buf;
+}
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+/* Older OpenSSL needs these before it can be used from several threads. */
+static pthread_mutex_t *ssl_locks;
+
+static void ssl_lock(int mode, int n, const char *file, int line)
+{
+	if (mode & CRYPTO_LOCK)
+		pthread_mutex_lock(&ssl_locks[n]);
+	else
+		pthread_mutex_unlock(&ssl_locks[n]);
+}
+
+static unsigned long ssl_thread_id(void)
+{
+	return (unsigned long)pthread_self();
+}
+
+static void ssl_threads_init(void)
+{
+	int i;
+
+	ssl_locks = calloc(CRYPTO_num_locks(), sizeof(*ssl_locks));
+	if (!ssl_locks)
+		return;
+	for (i = 0; i < CRYPTO_num_locks(); i++)
+		pthread_mutex_init(&ssl_locks[i], NULL);
+	CRYPTO_set_id_callback(ssl_thread_id);
+	CRYPTO_set_locking_callback(ssl_lock);
+}
+
+static void ssl_threads_done(void)
+{
+	int i;
+
+	if (!ssl_locks)
+		return;
+	CRYPTO_set_locking_callback(NULL);
+	CRYPTO_set_id_callback(NULL);
+	for (i = 0; i < CRYPTO_num_locks(); i++)
+		pthread_mutex_destroy(&ssl_locks[i]);
+	free(ssl_locks);
+	ssl_locks = NULL;
+}
+#else
+static void ssl_threads_init(void) {}
+static void ssl_threads_done(void) {}
+#endif
+
+/* Generate one keypair and write its .vbprivk and .vbpubk files. */
+static int make_pair(struct keypair_s *kp, const char *dir)
+{
+	RSA *rsa_key = NULL;
+	BIGNUM *e = NULL;
+	uint8_t *keyb_data = NULL;
+	uint32_t keyb_size;
+	char *path = NULL;
+	int ret = 1;
+
+	rsa_key = RSA_new();
+	e = BN_new();
+	if (!rsa_key || !e || !BN_set_word(e, RSA_F4) ||
+	    !RSA_generate_key_ex(rsa_key, alg_to_keylen(kp->algorithm), e,
+				 NULL)) {
+		fprintf(stderr, "Unable to generate %s\n", kp->name);
+		goto done;
+	}
+
+	kp->privkey = malloc(sizeof(*kp->privkey));
+	if (!kp->privkey)
+		goto done;
+	kp->privkey->rsa_private_key = rsa_key;
+	kp->privkey->algorithm = kp->algorithm;
+	rsa_key = NULL;
+
+	if (vb_keyb_from_rsa(kp->privkey->rsa_private_key,
+			     &keyb_data, &keyb_size)) {
+		fprintf(stderr, "Couldn't extract the %s public key\n",
+			kp->name);
+		goto done;
+	}
+	kp->pubkey = PublicKeyAlloc(keyb_size, kp->algorithm, kp->version);
+	if (!kp->pubkey)
+		goto done;
+	memcpy(GetPublicKeyData(kp->pubkey), keyb_data, keyb_size);
+
+	if (asprintf(&path, "%s/%s.vbprivk", dir, kp->name) < 0) {
+		path = NULL;
+		goto done;
+	}
+	if (PrivateKeyWrite(path, kp->privkey)) {
+		fprintf(stderr, "Unable to write %s\n", path);
+		goto done;
+	}
+	strcpy(path + strlen(path) - strlen("vbprivk"), "vbpubk");
+	if (PublicKeyWrite(path, kp->pubkey)) {
+		fprintf(stderr, "Unable to write %s\n", path);
+		goto done;
+	}
+	ret = 0;
+
+done:
+	free(path);
+	free(keyb_data);
+	BN_free(e);
+	RSA_free(rsa_key);
+	return ret;
+}
+
+struct pool_s {
+	pthread_mutex_t lock;
+	const char *dir;
+	int order[NUM_KEYPAIRS];	/* keypairs to make, biggest first */
+	int count;
+	int next;
+};
+
+static void *worker(void *arg)
+{
+	struct pool_s *pool = arg;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		i = pool->next < pool->count ? pool->order[pool->next++] : -1;
+		pthread_mutex_unlock(&pool->lock);
+		if (i < 0)
+			return NULL;
+		keypair[i].failed = make_pair(&keypair[i], pool->dir);
+	}
+}
+
+/* Create, write and check one keyblock. */
+static int make_keyblock(const struct keyblock_s *kb, const char *dir)
+{
+	const struct keypair_s *data_key = &keypair[kb->data_key];
+	const struct keypair_s *sign_key = &keypair[kb->sign_key];
+	VbKeyBlockHeader *block;
+	char *path;
+	int ret = 1;
+
+	printf("creating %s keyblock...\n", kb->name);
+
+	block = KeyBlockCreate(data_key->pubkey, sign_key->privkey, kb->flags);
+	if (!block) {
+		fprintf(stderr, "Unable to create the %s keyblock\n", kb->name);
+		return 1;
+	}
+	if (KeyBlockVerify(block, block->key_block_size, sign_key->pubkey, 0)) {
+		fprintf(stderr, "The %s keyblock doesn't verify\n", kb->name);
+	} else if (asprintf(&path, "%s/%s.keyblock", dir, kb->name) >= 0) {
+		if (KeyBlockWrite(path, block))
+			fprintf(stderr, "Unable to write %s\n", path);
+		else
+			ret = 0;
+		free(path);
+	}
+	free(block);
+	return ret;
+}
+
+static int do_create_keyset(int argc, char *argv[])
+{
+	struct pool_s pool;
+	pthread_t *thread;
+	long jobs = futil_default_jobs();
+	int dev_keyblock = 0;
+	int errorcnt = 0;
+	char *versions;
+	char *e;
+	int i, j;
+
+	while ((i = getopt_long(argc, argv, ":j:", long_opts, NULL)) != -1) {
+		switch (i) {
+		case OPT_DEVKEYBLOCK:
+			printf("Will also generate developer firmware keyblock"
+			       " and data key.\n");
+			dev_keyblock = 1;
+			break;
+		case OPT_4K:
+			keypair[ROOT_KEY].algorithm = RSA4096_SHA512;
+			keypair[RECOVERY_KEY].algorithm = RSA4096_SHA512;
+			keypair[RECOVERY_KERNEL_DATA_KEY].algorithm =
+				RSA4096_SHA512;
+			keypair[INSTALLER_KERNEL_DATA_KEY].algorithm =
+				RSA4096_SHA512;
+			break;
+		case OPT_4K_ROOT:
+			keypair[ROOT_KEY].algorithm = RSA4096_SHA512;
+			break;
+		case OPT_4K_RECOVERY:
+			keypair[RECOVERY_KEY].algorithm = RSA4096_SHA512;
+			break;
+		case OPT_4K_RECOVERY_KERNEL:
+			keypair[RECOVERY_KERNEL_DATA_KEY].algorithm =
+				RSA4096_SHA512;
+			break;
+		case OPT_4K_INSTALLER_KERNEL:
+			keypair[INSTALLER_KERNEL_DATA_KEY].algorithm =
+				RSA4096_SHA512;
+			break;
+		case 'j':
+			jobs = strtol(optarg, &e, 0);
+			if (!*optarg || (e && *e) || jobs < 1) {
+				fprintf(stderr,
+					"Invalid --jobs \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case '?':
+			if (optopt)
+				fprintf(stderr, "Unrecognized option: -%c\n",
+					optopt);
+			else
+				fprintf(stderr, "Unrecognized option\n");
+			errorcnt++;
+			break;
+		case ':':
+			fprintf(stderr, "Missing argument to -%c\n", optopt);
+			errorcnt++;
+			break;
+		default:
+			DIE;
+		}
+	}
+
+	if (argc - optind > 1) {
+		fprintf(stderr, "Too many arguments\n");
+		errorcnt++;
+	}
+	if (errorcnt) {
+		print_help(argv[0]);
+		return 1;
+	}
+	pool.dir = argc > optind ? argv[optind] : ".";
+
+	versions = read_versions(pool.dir);
+	if (!versions)
+		return 1;
+
+	/* Queue the keypairs, biggest first so the pool finishes together */
+	pool.count = 0;
+	pool.next = 0;
+	for (i = 0; i < NUM_KEYPAIRS; i++) {
+		if (keypair[i].dev_only && !dev_keyblock)
+			continue;
+		keypair[i].version = keypair[i].version_name ?
+			get_version(versions, keypair[i].version_name) : 1;
+		printf("creating %s keypair (version = %u)...\n",
+		       keypair[i].name, keypair[i].version);
+		for (j = pool.count++; j > 0 &&
+			     keypair[pool.order[j - 1]].algorithm / 3 <
+			     keypair[i].algorithm / 3; j--)
+			pool.order[j] = pool.order[j - 1];
+		pool.order[j] = i;
+	}
+	free(versions);
+
+	if (jobs > pool.count)
+		jobs = pool.count;
+	thread = calloc(jobs, sizeof(*thread));
+	if (!thread) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	/* This thread is the last worker; any that won't start are skipped */
+	ssl_threads_init();
+	pthread_mutex_init(&pool.lock, NULL);
+	for (i = 0; i < jobs - 1; i++)
+		if (pthread_create(&thread[i], NULL, worker, &pool))
+			break;
+	worker(&pool);
+	for (j = 0; j < i; j++)
+		pthread_join(thread[j], NULL);
+	pthread_mutex_destroy(&pool.lock);
+	ssl_threads_done();
+	free(thread);
+
+	for (i = 0; i < pool.count; i++)
+		errorcnt += keypair[pool.order[i]].failed;
+
+	if (!errorcnt)
+		for (i = 0; i < ARRAY_SIZE(keyblock); i++)
+			if (dev_keyblock || !keyblock[i].dev_only)
+				errorcnt += make_keyblock(&keyblock[i],
+							  pool.dir);
+
+	for (i = 0; i < NUM_KEYPAIRS; i++) {
+		PrivateKeyFree(keypair[i].privkey);
+		free(keypair[i].pubkey);
+	}
+
+	return !!errorcnt;
+}
+
+DECLARE_FUTIL_COMMAND(create_keyset, do_create_keyset,
+		      VBOOT_VERSION_1_0,
+		      "Create a vb1 keyset, generating its keys in parallel",
+		      print_help);
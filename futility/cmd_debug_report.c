@@ -0,0 +1,722 @@
+/*
+ * Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Collects what dev_debug_vboot does about verified boot, reading the flash
+ * and each disk only once and checking everything in-process.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+
+#include "cgptlib_internal.h"
+#include "crossystem.h"
+#include "fmap.h"
+#include "futility.h"
+#include "gbb_header.h"
+#include "host_common.h"
+#include "host_io.h"
+#include "json_writer.h"
+#include "vboot_common.h"
+
+/* The root key sha1sum that means it's signed with the developer keys */
+static const char dev_root_key_sha1[] =
+	"b11d74edd286c144e1135b49e7f0bc20cf041f10";
+
+/* Enough of a kernel partition to find out how much more to read */
+#define KERNEL_VBLOCK_READ 65536
+
+/* Size of one copy of the GPT entries */
+#define ENTRIES_SIZE (MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry))
+
+static struct json_writer report;
+
+/* Keys the firmware would check kernels with */
+enum {
+	KEY_KERNEL_SUBKEY_A,
+	KEY_KERNEL_SUBKEY_B,
+	KEY_RECOVERY,
+
+	NUM_KERNEL_KEYS
+};
+static const char * const kernel_key_name[NUM_KERNEL_KEYS] = {
+	"kernel_subkey_A",
+	"kernel_subkey_B",
+	"recovery_key",
+};
+static VbPublicKey *kernel_key[NUM_KERNEL_KEYS];
+
+/* The BIOS image those keys are in, which stays mapped until the end */
+static uint8_t *bios_buf;
+static uint32_t bios_len;
+
+static const char usage[] = "\n"
+	"Usage:  " MYNAME " %s [OPTIONS]\n"
+	"\n"
+	"Reports as much as it can about verified boot on this device, as one\n"
+	"line of JSON. The flash is read once (or the BIOS image given), and\n"
+	"its root key is used to check both firmware slots. Their kernel\n"
+	"subkeys and the recovery key are then used to check every kernel\n"
+	"partition on each disk (or on the image or kernel given).\n"
+	"\n"
+	"Options:\n"
+	"  -b|--bios    FILE      Use this BIOS image instead of the flash\n"
+	"  -i|--image   FILE      Look at this disk image or device\n"
+	"  -k|--kernel  FILE      Look at this kernel partition\n"
+	"\n";
+
+static void print_help(const char *prog)
+{
+	printf(usage, prog);
+}
+
+static const struct option long_opts[] = {
+	/* name    hasarg *flag  val */
+	{"bios",     1, NULL, 'b'},
+	{"image",    1, NULL, 'i'},
+	{"kernel",   1, NULL, 'k'},
+	{"debug",    0, &debugging_enabled, 1},
+	{NULL,       0, NULL, 0},
+};
+
+static char *key_sha1sum(VbPublicKey *pubkey, char *hex)
+{
+	uint8_t digest[SHA1_DIGEST_SIZE];
+	int i;
+
+	if (DigestBufInto(GetPublicKeyData(pubkey), pubkey->key_size,
+			  SHA1_DIGEST_ALGORITHM, digest, sizeof(digest)))
+		return NULL;
+	for (i = 0; i < SHA1_DIGEST_SIZE; i++)
+		sprintf(hex + 2 * i, "%02x", digest[i]);
+	return hex;
+}
+
+static void report_key(const char *name, VbPublicKey *pubkey)
+{
+	char hex[2 * SHA1_DIGEST_SIZE + 1];
+
+	json_begin_object(&report, name);
+	json_uint(&report, "algorithm", pubkey->algorithm);
+	json_uint(&report, "key_version", pubkey->key_version);
+	if (key_sha1sum(pubkey, hex))
+		json_string(&report, "sha1sum", hex);
+	json_end_object(&report);
+}
+
+/* What crossystem knows about the versions and the current boot */
+static void report_system(void)
+{
+	static const char * const int_props[] = {
+		"tpm_fwver", "tpm_kernver", "devsw_boot", "recovery_reason",
+	};
+	static const char * const str_props[] = {
+		"mainfw_act", "mainfw_type", "fwid", "ro_fwid", "kernkey_vfy",
+	};
+	char buf[VB_MAX_STRING_PROPERTY];
+	int i, val;
+
+	json_begin_object(&report, "system");
+	for (i = 0; i < ARRAY_SIZE(int_props); i++) {
+		val = VbGetSystemPropertyInt(int_props[i]);
+		if (val >= 0)
+			json_uint(&report, int_props[i], val);
+	}
+	for (i = 0; i < ARRAY_SIZE(str_props); i++)
+		if (VbGetSystemPropertyString(str_props[i], buf, sizeof(buf)))
+			json_string(&report, str_props[i], buf);
+	json_end_object(&report);
+}
+
+/* Find an FMAP area by either its name or its really old name */
+static uint8_t *find_area(const struct fmap_index *index, uint32_t len,
+			  const char *name, const char *old_name,
+			  uint32_t *size)
+{
+	FmapAreaHeader *ah;
+	uint8_t *area;
+
+	area = fmap_index_find(index, name, &ah);
+	if (!area)
+		area = fmap_index_find(index, old_name, &ah);
+	if (!area || ah->area_offset > len)
+		return NULL;
+
+	*size = ah->area_size;
+	if (*size > len - ah->area_offset)
+		*size = len - ah->area_offset;
+	return area;
+}
+
+/* Returns the root key, if it looks okay */
+static VbPublicKey *report_gbb(uint8_t *gbb_buf, uint32_t gbb_len)
+{
+	GoogleBinaryBlockHeader *gbb = (GoogleBinaryBlockHeader *)gbb_buf;
+	VbPublicKey *rootkey, *recovery_key;
+	char hex[2 * SHA1_DIGEST_SIZE + 1];
+	uint32_t maxlen = 0;
+
+	json_begin_object(&report, "gbb");
+	if (!futil_valid_gbb_header(gbb, gbb_len, &maxlen) ||
+	    maxlen > gbb_len) {
+		json_string(&report, "error", "invalid header");
+		json_end_object(&report);
+		return NULL;
+	}
+
+	json_uint(&report, "flags", gbb->flags);
+	json_string(&report, "hwid", (char *)gbb_buf + gbb->hwid_offset);
+
+	rootkey = (VbPublicKey *)(gbb_buf + gbb->rootkey_offset);
+	if (PublicKeyLooksOkay(rootkey, gbb->rootkey_size)) {
+		report_key("root_key", rootkey);
+		json_bool(&report, "dev_keys", key_sha1sum(rootkey, hex) &&
+			  !strcmp(hex, dev_root_key_sha1));
+	} else {
+		json_string(&report, "error", "invalid root key");
+		rootkey = NULL;
+	}
+
+	recovery_key = (VbPublicKey *)(gbb_buf + gbb->recovery_key_offset);
+	if (PublicKeyLooksOkay(recovery_key, gbb->recovery_key_size)) {
+		report_key("recovery_key", recovery_key);
+		kernel_key[KEY_RECOVERY] = recovery_key;
+	}
+
+	json_end_object(&report);
+	return rootkey;
+}
+
+/* Check one firmware slot with the root key */
+static void report_fw_slot(const char *slot, VbPublicKey *rootkey,
+			   uint8_t *vblock, uint32_t vblock_len,
+			   uint8_t *fw_main, uint32_t fw_main_len,
+			   VbPublicKey **kernel_subkey)
+{
+	VbKeyBlockHeader *key_block = (VbKeyBlockHeader *)vblock;
+	VbFirmwarePreambleHeader *preamble;
+	RSAPublicKey *rsa = NULL;
+	uint32_t more;
+
+	json_begin_object(&report, NULL);
+	json_string(&report, "slot", slot);
+
+	if (!vblock || !fw_main) {
+		json_string(&report, "error", "missing");
+		goto done;
+	}
+
+	if (VBOOT_SUCCESS != KeyBlockVerify(key_block, vblock_len, rootkey,
+					    !rootkey)) {
+		json_string(&report, "error", "invalid keyblock");
+		goto done;
+	}
+	json_bool(&report, "keyblock_signed", !!rootkey);
+	json_uint(&report, "keyblock_flags", key_block->key_block_flags);
+	report_key("data_key", &key_block->data_key);
+
+	rsa = PublicKeyToRSA(&key_block->data_key);
+	if (!rsa) {
+		json_string(&report, "error", "invalid data key");
+		goto done;
+	}
+	more = key_block->key_block_size;
+	preamble = (VbFirmwarePreambleHeader *)(vblock + more);
+	if (VBOOT_SUCCESS != VerifyFirmwarePreamble(preamble,
+						    vblock_len - more, rsa)) {
+		json_string(&report, "error", "invalid preamble");
+		goto done;
+	}
+
+	json_uint(&report, "firmware_version", preamble->firmware_version);
+	/* The way it's stored in the TPM */
+	json_uint(&report, "version",
+		  (key_block->data_key.key_version << 16) |
+		  (preamble->firmware_version & 0xffff));
+	json_uint(&report, "preamble_flags",
+		  VbGetFirmwarePreambleFlags(preamble));
+	report_key("kernel_subkey", &preamble->kernel_subkey);
+
+	if (VbGetFirmwarePreambleFlags(preamble) &
+	    VB_FIRMWARE_PREAMBLE_USE_RO_NORMAL) {
+		json_string(&report, "body", "use_ro_normal");
+	} else if (VBOOT_SUCCESS != VerifyData(fw_main, fw_main_len,
+					       &preamble->body_signature,
+					       rsa)) {
+		json_string(&report, "body", "invalid");
+		json_string(&report, "error", "invalid body");
+		goto done;
+	} else {
+		json_string(&report, "body", "verified");
+	}
+
+	/* Only trust the kernel subkey if everything up to here is signed */
+	if (rootkey)
+		*kernel_subkey = &preamble->kernel_subkey;
+	json_bool(&report, "valid", !!rootkey);
+
+ done:
+	if (rsa)
+		RSAPublicKeyFree(rsa);
+	json_end_object(&report);
+}
+
+/* Everything about the firmware in a BIOS image */
+static void report_firmware(const char *name, uint8_t *buf, uint32_t len)
+{
+	struct fmap_index index;
+	uint8_t *gbb, *vblock[2], *fw_main[2];
+	uint32_t gbb_len = 0, vblock_len[2] = {0, 0}, fw_main_len[2] = {0, 0};
+	VbPublicKey *rootkey;
+
+	json_string(&report, "file", name);
+	if (fmap_index_init(&index, buf, len)) {
+		json_string(&report, "error", "no FMAP");
+		return;
+	}
+
+	gbb = find_area(&index, len, "GBB", "GBB Area", &gbb_len);
+	vblock[0] = find_area(&index, len, "VBLOCK_A", "Firmware A Key",
+			      &vblock_len[0]);
+	vblock[1] = find_area(&index, len, "VBLOCK_B", "Firmware B Key",
+			      &vblock_len[1]);
+	fw_main[0] = find_area(&index, len, "FW_MAIN_A", "Firmware A Data",
+			       &fw_main_len[0]);
+	fw_main[1] = find_area(&index, len, "FW_MAIN_B", "Firmware B Data",
+			       &fw_main_len[1]);
+	fmap_index_free(&index);
+
+	if (!gbb) {
+		json_string(&report, "error", "no GBB");
+		return;
+	}
+	rootkey = report_gbb(gbb, gbb_len);
+
+	json_begin_array(&report, "slots");
+	report_fw_slot("A", rootkey, vblock[0], vblock_len[0],
+		       fw_main[0], fw_main_len[0],
+		       &kernel_key[KEY_KERNEL_SUBKEY_A]);
+	report_fw_slot("B", rootkey, vblock[1], vblock_len[1],
+		       fw_main[1], fw_main_len[1],
+		       &kernel_key[KEY_KERNEL_SUBKEY_B]);
+	json_end_array(&report);
+}
+
+/* Read the flash with flashrom into a temporary file. Returns its name. */
+static char *read_flash(void)
+{
+	static char tmpname[] = "/tmp/debug_report_XXXXXX";
+	pid_t pid;
+	int status;
+	int fd;
+
+	fd = mkstemp(tmpname);
+	if (fd < 0)
+		return NULL;
+	close(fd);
+
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if (pid == 0) {
+		/* flashrom is chatty; the report goes on stdout */
+		dup2(STDERR_FILENO, STDOUT_FILENO);
+		execlp("flashrom", "flashrom", "-p", "host", "-r", tmpname,
+		       NULL);
+		_exit(127);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) != pid ||
+	    !WIFEXITED(status) || WEXITSTATUS(status)) {
+		unlink(tmpname);
+		return NULL;
+	}
+	return tmpname;
+}
+
+static void report_bios(const char *bios_file)
+{
+	char *flash_file = NULL;
+
+	json_begin_object(&report, "firmware");
+
+	if (!bios_file) {
+		flash_file = read_flash();
+		if (!flash_file) {
+			json_string(&report, "error", "can't read the flash");
+			json_end_object(&report);
+			return;
+		}
+		bios_file = flash_file;
+	}
+
+	if (VB2_SUCCESS != vb2_map_file(bios_file, VB2_MAP_RO, &bios_buf,
+					&bios_len)) {
+		json_string(&report, "file", bios_file);
+		json_string(&report, "error", strerror(errno));
+		bios_buf = NULL;
+	} else {
+		report_firmware(flash_file ? "flash" : bios_file, bios_buf,
+				bios_len);
+	}
+
+	/* Still mapped, even once it's gone */
+	if (flash_file)
+		unlink(flash_file);
+	json_end_object(&report);
+}
+
+/* Check a kernel partition with each key the firmware has */
+static void report_kernel(uint8_t *buf, uint32_t len)
+{
+	VbKeyBlockHeader *key_block = (VbKeyBlockHeader *)buf;
+	VbKernelPreambleHeader *preamble;
+	RSAPublicKey *rsa = NULL;
+	uint64_t more, body_offset;
+	int preamble_ok = 0, body_ok = 0;
+	int i;
+
+	if (VBOOT_SUCCESS != KeyBlockVerify(key_block, len, NULL, 1)) {
+		json_string(&report, "error", "invalid keyblock");
+		return;
+	}
+	json_uint(&report, "keyblock_flags", key_block->key_block_flags);
+	report_key("data_key", &key_block->data_key);
+
+	/* The preamble and body only depend on the data key */
+	more = key_block->key_block_size;
+	preamble = (VbKernelPreambleHeader *)(buf + more);
+	rsa = PublicKeyToRSA(&key_block->data_key);
+	if (rsa && VBOOT_SUCCESS == VerifyKernelPreamble(preamble, len - more,
+							 rsa)) {
+		preamble_ok = 1;
+		json_uint(&report, "kernel_version", preamble->kernel_version);
+		json_uint(&report, "version",
+			  (key_block->data_key.key_version << 16) |
+			  (preamble->kernel_version & 0xffff));
+
+		body_offset = more + preamble->preamble_size;
+		body_ok = body_offset <= len &&
+			VBOOT_SUCCESS == VerifyData(buf + body_offset,
+						    len - body_offset,
+						    &preamble->body_signature,
+						    rsa);
+		json_string(&report, "body", body_ok ? "verified" : "invalid");
+	} else {
+		json_string(&report, "error", "invalid preamble");
+	}
+	if (rsa)
+		RSAPublicKeyFree(rsa);
+
+	json_begin_array(&report, "checks");
+	for (i = 0; i < NUM_KERNEL_KEYS; i++) {
+		if (!kernel_key[i])
+			continue;
+		json_begin_object(&report, NULL);
+		json_string(&report, "key", kernel_key_name[i]);
+		json_bool(&report, "valid", preamble_ok && body_ok &&
+			  VBOOT_SUCCESS == KeyBlockVerify(key_block, len,
+							  kernel_key[i], 0));
+		json_end_object(&report);
+	}
+	json_end_array(&report);
+}
+
+static void report_kernel_file(const char *kernel_file)
+{
+	uint8_t *buf;
+	uint32_t len;
+
+	json_begin_object(&report, NULL);
+	json_string(&report, "name", kernel_file);
+	if (VB2_SUCCESS != vb2_map_file(kernel_file, VB2_MAP_RO, &buf, &len)) {
+		json_string(&report, "error", strerror(errno));
+	} else {
+		report_kernel(buf, len);
+		vb2_unmap_file(buf, len, VB2_MAP_RO);
+	}
+	json_end_object(&report);
+}
+
+/*
+ * Read the rest of the body of a kernel partition, after the [*len] bytes of
+ * its vblock in [buf], but not all the empty space after it.  Returns NULL if
+ * it can't be read.
+ */
+static uint8_t *read_kernel_body(int fd, uint64_t start, uint64_t size,
+				 uint8_t *buf, uint32_t *len)
+{
+	VbKeyBlockHeader *key_block;
+	VbKernelPreambleHeader *preamble;
+	uint64_t want = *len, more;
+	uint8_t *b;
+
+	/* Anything that doesn't add up is left for report_kernel() to find */
+	key_block = (VbKeyBlockHeader *)buf;
+	if (want < sizeof(*key_block) + EXPECTED_VBKERNELPREAMBLEHEADER2_0_SIZE ||
+	    key_block->key_block_size > want -
+	    EXPECTED_VBKERNELPREAMBLEHEADER2_0_SIZE)
+		return buf;
+	more = key_block->key_block_size;
+	preamble = (VbKernelPreambleHeader *)(buf + more);
+	if (preamble->preamble_size > size - more ||
+	    preamble->body_signature.data_size >
+	    size - more - preamble->preamble_size)
+		return buf;
+
+	want = more + preamble->preamble_size +
+		preamble->body_signature.data_size;
+	if (want <= *len || want > UINT32_MAX)
+		return buf;
+
+	b = realloc(buf, want);
+	if (!b || pread(fd, b + *len, want - *len, start + *len) !=
+	    want - *len) {
+		free(b ? b : buf);
+		return NULL;
+	}
+	*len = want;
+	return b;
+}
+
+/* Every kernel partition on a disk image or device */
+static void report_disk(const char *disk)
+{
+	/* The start of every kernel partition is read at once */
+	struct read_request reqs[MAX_NUMBER_OF_ENTRIES];
+	uint32_t parts[MAX_NUMBER_OF_ENTRIES];
+	uint32_t nparts = 0;
+	GptData gpt;
+	GptEntry *entries;
+	uint8_t *primary = NULL, *secondary = NULL;
+	uint8_t *buf;
+	uint64_t start, size, gpt_size;
+	uint32_t len;
+	off_t disk_size;
+	char name[32];
+	uint32_t i, n;
+	int fd, rv;
+
+	json_begin_object(&report, NULL);
+	json_string(&report, "disk", disk);
+
+	fd = open(disk, O_RDONLY);
+	if (fd < 0) {
+		json_string(&report, "error", strerror(errno));
+		goto done;
+	}
+
+	/* Just the GPT headers and entries, each next to the other */
+	gpt_size = (GPT_HEADER_SECTORS * DISK_SECTOR_SIZE) + ENTRIES_SIZE;
+	disk_size = lseek(fd, 0, SEEK_END);
+	primary = malloc(gpt_size);
+	secondary = malloc(gpt_size);
+	memset(reqs, 0, sizeof(reqs));
+	reqs[0].fd = reqs[1].fd = fd;
+	reqs[0].buf = primary;
+	reqs[1].buf = secondary;
+	reqs[0].size = reqs[1].size = gpt_size;
+	reqs[0].offset = GPT_PMBR_SECTORS * DISK_SECTOR_SIZE;
+	reqs[1].offset = disk_size - gpt_size;
+	if (disk_size < (off_t)(GPT_PMBR_SECTORS * DISK_SECTOR_SIZE +
+				2 * gpt_size) || !primary || !secondary ||
+	    ReadBatch(reqs, 2)) {
+		json_string(&report, "error", "can't read the GPT");
+		goto done;
+	}
+
+	memset(&gpt, 0, sizeof(gpt));
+	gpt.sector_bytes = DISK_SECTOR_SIZE;
+	gpt.streaming_drive_sectors = disk_size / DISK_SECTOR_SIZE;
+	gpt.gpt_drive_sectors = gpt.streaming_drive_sectors;
+	gpt.primary_header = primary;
+	gpt.primary_entries = primary + GPT_HEADER_SECTORS * DISK_SECTOR_SIZE;
+	gpt.secondary_entries = secondary;
+	gpt.secondary_header = secondary + ENTRIES_SIZE;
+	rv = GptSanityCheck(&gpt);
+	if (GPT_SUCCESS != rv) {
+		json_string(&report, "error", GptErrorText(rv));
+		goto done;
+	}
+	entries = (GptEntry *)((gpt.valid_entries & MASK_PRIMARY) ?
+			       gpt.primary_entries : gpt.secondary_entries);
+
+	/* Partitions which don't fit on the disk have nothing to read */
+	memset(reqs, 0, sizeof(reqs));
+	for (i = 0; i < MAX_NUMBER_OF_ENTRIES; i++) {
+		if (!IsKernelEntry(entries + i))
+			continue;
+		start = entries[i].starting_lba * DISK_SECTOR_SIZE;
+		size = (entries[i].ending_lba - entries[i].starting_lba + 1) *
+			DISK_SECTOR_SIZE;
+		reqs[nparts].fd = fd;
+		reqs[nparts].offset = start;
+		if (start <= disk_size && size <= disk_size - start) {
+			reqs[nparts].size = size < KERNEL_VBLOCK_READ ?
+				size : KERNEL_VBLOCK_READ;
+			reqs[nparts].buf = malloc(reqs[nparts].size);
+			if (!reqs[nparts].buf)
+				reqs[nparts].size = 0;
+		}
+		parts[nparts++] = i;
+	}
+	ReadBatch(reqs, nparts);
+
+	json_begin_array(&report, "kernels");
+	for (n = 0; n < nparts; n++) {
+		i = parts[n];
+		start = entries[i].starting_lba * DISK_SECTOR_SIZE;
+		size = (entries[i].ending_lba - entries[i].starting_lba + 1) *
+			DISK_SECTOR_SIZE;
+
+		json_begin_object(&report, NULL);
+		snprintf(name, sizeof(name), "partition %d", i + 1);
+		json_string(&report, "name", name);
+		json_uint(&report, "priority", GetEntryPriority(entries + i));
+		json_uint(&report, "tries", GetEntryTries(entries + i));
+		json_bool(&report, "successful",
+			  GetEntrySuccessful(entries + i));
+
+		buf = NULL;
+		if (reqs[n].buf && reqs[n].result == (ssize_t)reqs[n].size) {
+			len = reqs[n].size;
+			buf = read_kernel_body(fd, start, size, reqs[n].buf,
+					       &len);
+		} else {
+			free(reqs[n].buf);
+		}
+		if (buf)
+			report_kernel(buf, len);
+		else
+			json_string(&report, "error", "can't read it");
+		free(buf);
+		json_end_object(&report);
+	}
+	json_end_array(&report);
+
+ done:
+	free(primary);
+	free(secondary);
+	if (fd >= 0)
+		close(fd);
+	json_end_object(&report);
+}
+
+/* With nothing else to look at, try all the fixed disks, as cgpt would */
+static void report_all_disks(void)
+{
+	FILE *fp;
+	char line[256], dev[64], path[80];
+	size_t n;
+
+	fp = fopen("/proc/partitions", "r");
+	if (!fp)
+		return;
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, " %*u %*u %*u %63s", dev) != 1)
+			continue;
+		n = strlen(dev);
+		/* mmcblkN or sdX, but not their partitions */
+		if ((!strncmp(dev, "mmcblk", 6) && n == 7 &&
+		     dev[6] >= '0' && dev[6] <= '9') ||
+		    (!strncmp(dev, "sd", 2) && n == 3 &&
+		     dev[2] >= 'a' && dev[2] <= 'z')) {
+			snprintf(path, sizeof(path), "/dev/%s", dev);
+			report_disk(path);
+		}
+	}
+	fclose(fp);
+}
+
+static int do_debug_report(int argc, char *argv[])
+{
+	const char *bios_file = NULL, *image_file = NULL, *kernel_file = NULL;
+	int errorcnt = 0;
+	int i;
+
+	opterr = 0;		/* quiet, you */
+	while ((i = getopt_long(argc, argv, ":b:i:k:", long_opts,
+				NULL)) != -1) {
+		switch (i) {
+		case 'b':
+			bios_file = optarg;
+			break;
+		case 'i':
+			image_file = optarg;
+			break;
+		case 'k':
+			kernel_file = optarg;
+			break;
+		case '?':
+			if (optopt)
+				fprintf(stderr, "Unrecognized option: -%c\n",
+					optopt);
+			else
+				fprintf(stderr, "Unrecognized option: %s\n",
+					argv[optind - 1]);
+			errorcnt++;
+			break;
+		case ':':
+			fprintf(stderr, "Missing argument to -%c\n", optopt);
+			errorcnt++;
+			break;
+		case 0:				/* handled option */
+			break;
+		default:
+			DIE;
+		}
+	}
+
+	if (argc - optind > 0) {
+		fprintf(stderr, "Unexpected argument: %s\n", argv[optind]);
+		errorcnt++;
+	}
+	if (errorcnt) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	json_init(&report);
+	json_begin_object(&report, NULL);
+	report_system();
+	report_bios(bios_file);
+
+	json_begin_array(&report, "disks");
+	if (image_file)
+		report_disk(image_file);
+	if (kernel_file) {
+		json_begin_object(&report, NULL);
+		json_begin_array(&report, "kernels");
+		report_kernel_file(kernel_file);
+		json_end_array(&report);
+		json_end_object(&report);
+	}
+	if (!image_file && !kernel_file)
+		report_all_disks();
+	json_end_array(&report);
+	json_end_object(&report);
+
+	errorcnt = json_flush(&report, stdout);
+	if (errorcnt)
+		fprintf(stderr, "Error writing the report\n");
+	json_free(&report);
+	if (bios_buf)
+		vb2_unmap_file(bios_buf, bios_len, VB2_MAP_RO);
+	return !!errorcnt;
+}
+
+DECLARE_FUTIL_COMMAND(debug_report, do_debug_report,
+		      VBOOT_VERSION_ALL,
+		      "Report everything about verified boot on this device",
+		      print_help);
@@ -0,0 +1,660 @@
+/*
+ * Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Deltas between firmware images, a changed FMAP area at a time.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fmap.h"
+#include "futility.h"
+#include "gbb_header.h"
+#include "host_common.h"
+#include "vboot_common.h"
+
+/*
+ * A delta file is a header, a table with an entry for each piece of the
+ * image, and then the new contents of just the pieces which changed, in table
+ * order.  The pieces are the areas of the new image's FMAP, split where areas
+ * nest or overlap, plus whatever isn't in any area, so together they cover
+ * the whole image exactly once.
+ */
+#define DELTA_MAGIC "VBDELTA\0"
+#define DELTA_MAGIC_SIZE 8
+#define DELTA_VERSION 1
+
+#define DELTA_DIGEST_ALGORITHM SHA256_DIGEST_ALGORITHM
+#define DELTA_DIGEST_SIZE SHA256_DIGEST_SIZE
+
+struct delta_header {
+	char magic[DELTA_MAGIC_SIZE];
+	uint32_t version;
+	uint32_t image_size;
+	uint32_t num_pieces;
+	uint32_t num_changed;
+} __attribute__((packed));
+
+struct delta_piece {
+	/* Smallest FMAP area the piece is in, or empty if none */
+	char name[FMAP_NAMELEN];
+	uint32_t offset;
+	uint32_t size;
+	uint32_t changed;
+	uint32_t reserved;
+	uint8_t base_digest[DELTA_DIGEST_SIZE];
+	uint8_t new_digest[DELTA_DIGEST_SIZE];
+} __attribute__((packed));
+
+static const char usage[] = "\n"
+	"Usage:  " MYNAME " %s [OPTIONS] BASE NEW DELTA\n"
+	"        " MYNAME " %s --apply [OPTIONS] BASE DELTA OUTFILE\n"
+	"\n"
+	"The first form writes the FMAP areas of firmware image NEW which\n"
+	"differ from those of BASE to the file DELTA.\n"
+	"\n"
+	"The second form makes the new image again from BASE and DELTA. BASE\n"
+	"must be the image the delta was made against, and the result must\n"
+	"match the image it was made from, or nothing is written. The\n"
+	"signatures of the firmware VBLOCKs in the result are checked against\n"
+	"its GBB root key, too.\n"
+	"\n"
+	"Options:\n"
+	"  -a|--apply           Apply DELTA to BASE\n"
+	"  -j|--jobs NUM        Number of threads hashing (default one per CPU)\n"
+	"     --no-verify       Don't check the VBLOCKs of the result\n"
+	"\n";
+
+static void print_help(const char *prog)
+{
+	printf(usage, prog, prog);
+}
+
+enum no_short_opts {
+	OPT_NO_VERIFY = 1000,
+};
+
+static const struct option long_opts[] = {
+	/* name    hasarg *flag  val */
+	{"apply",      0, NULL, 'a'},
+	{"jobs",       1, NULL, 'j'},
+	{"no-verify",  0, NULL, OPT_NO_VERIFY},
+	{NULL,         0, NULL, 0},
+};
+static char *short_opts = ":aj:";
+
+/* Pieces to hash, shared by the hashing threads */
+struct hash_job_s {
+	struct delta_piece *piece;
+	uint32_t count;
+	/* Hash each piece of this image into base_digest or new_digest */
+	const uint8_t *image;
+	int into_new;
+	volatile uint32_t next;
+	volatile int errors;
+};
+
+static void *hash_worker(void *arg)
+{
+	struct hash_job_s *job = arg;
+	struct delta_piece *p;
+	uint32_t i;
+
+	while ((i = __sync_fetch_and_add(&job->next, 1)) < job->count) {
+		p = job->piece + i;
+		if (DigestBufInto(job->image + p->offset, p->size,
+				  DELTA_DIGEST_ALGORITHM,
+				  job->into_new ? p->new_digest :
+				  p->base_digest, DELTA_DIGEST_SIZE))
+			__sync_fetch_and_add(&job->errors, 1);
+	}
+	return NULL;
+}
+
+/* Hash the pieces of an image on [jobs] threads. Returns the error count. */
+static int hash_pieces(struct delta_piece *piece, uint32_t count,
+		       const uint8_t *image, int into_new, long jobs)
+{
+	struct hash_job_s job = {piece, count, image, into_new, 0, 0};
+	pthread_t *thread;
+	int *started;
+	long i;
+
+	if (jobs > count)
+		jobs = count;
+	if (jobs < 2) {
+		hash_worker(&job);
+		return job.errors;
+	}
+
+	thread = calloc(jobs - 1, sizeof(*thread));
+	started = calloc(jobs - 1, sizeof(*started));
+	if (!thread || !started) {
+		free(thread);
+		free(started);
+		hash_worker(&job);
+		return job.errors;
+	}
+	for (i = 0; i < jobs - 1; i++)
+		started[i] = !pthread_create(&thread[i], NULL, hash_worker,
+					     &job);
+	/* This thread works too, and picks up for any that didn't start */
+	hash_worker(&job);
+	for (i = 0; i < jobs - 1; i++)
+		if (started[i])
+			pthread_join(thread[i], NULL);
+	free(thread);
+	free(started);
+	return job.errors;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Split an image into the pieces described above, using its FMAP. Returns
+ * the pieces, which the caller must free(), or NULL if there's no FMAP.
+ */
+static struct delta_piece *split_image(uint8_t *buf, uint32_t len,
+				       uint32_t *count)
+{
+	FmapHeader *fmap = fmap_find(buf, len);
+	FmapAreaHeader *ah;
+	struct delta_piece *piece;
+	uint32_t *edge;
+	uint32_t nedges = 0, n = 0;
+	uint32_t i, j, best;
+
+	if (!fmap)
+		return NULL;
+	ah = (FmapAreaHeader *)(fmap + 1);
+	/* The areas that fit in the buffer, that is */
+	if (fmap->fmap_nareas >
+	    (len - ((uint8_t *)ah - buf)) / sizeof(FmapAreaHeader))
+		return NULL;
+
+	/* Every place a piece can start or end */
+	edge = malloc((2 * fmap->fmap_nareas + 2) * sizeof(*edge));
+	if (!edge)
+		return NULL;
+	edge[nedges++] = 0;
+	edge[nedges++] = len;
+	for (i = 0; i < fmap->fmap_nareas; i++) {
+		if (ah[i].area_offset >= len || !ah[i].area_size)
+			continue;
+		edge[nedges++] = ah[i].area_offset;
+		edge[nedges++] = ah[i].area_size > len - ah[i].area_offset ?
+			len : ah[i].area_offset + ah[i].area_size;
+	}
+	qsort(edge, nedges, sizeof(*edge), compare_u32);
+
+	piece = calloc(nedges, sizeof(*piece));
+	if (!piece) {
+		free(edge);
+		return NULL;
+	}
+	for (i = 0; i + 1 < nedges; i++) {
+		if (edge[i] == edge[i + 1])
+			continue;
+		piece[n].offset = edge[i];
+		piece[n].size = edge[i + 1] - edge[i];
+
+		/* Named after the smallest area it's in */
+		best = fmap->fmap_nareas;
+		for (j = 0; j < fmap->fmap_nareas; j++) {
+			if (ah[j].area_offset > edge[i] ||
+			    ah[j].area_offset + (uint64_t)ah[j].area_size <
+			    edge[i + 1])
+				continue;
+			if (best == fmap->fmap_nareas ||
+			    ah[j].area_size < ah[best].area_size)
+				best = j;
+		}
+		if (best < fmap->fmap_nareas)
+			memcpy(piece[n].name, ah[best].area_name,
+			       FMAP_NAMELEN);
+		n++;
+	}
+
+	free(edge);
+	*count = n;
+	return piece;
+}
+
+static const char *piece_name(const struct delta_piece *p)
+{
+	static char name[FMAP_NAMELEN + 1];
+
+	if (!p->name[0])
+		return "(not in any area)";
+	memcpy(name, p->name, FMAP_NAMELEN);
+	name[FMAP_NAMELEN] = '\0';
+	return name;
+}
+
+/* Open and map a file read-only. Returns the fd, or -1 after complaining. */
+static int map_image(const char *filename, uint8_t **buf, uint32_t *len)
+{
+	int fd = open(filename, O_RDONLY);
+
+	if (fd < 0) {
+		fprintf(stderr, "Can't open %s: %s\n", filename,
+			strerror(errno));
+		return -1;
+	}
+	if (FILE_ERR_NONE != futil_map_file(fd, MAP_RO, buf, len)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void unmap_image(int fd, uint8_t *buf, uint32_t len)
+{
+	if (fd < 0)
+		return;
+	futil_unmap_file(fd, MAP_RO, buf, len);
+	close(fd);
+}
+
+/* Write [len] bytes to [fp]. Returns the number of errors. */
+static int write_or_complain(FILE *fp, const void *buf, size_t len,
+			     const char *filename)
+{
+	if (len && fwrite(buf, len, 1, fp) != 1) {
+		fprintf(stderr, "Can't write %s: %s\n", filename,
+			strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+static int create_delta(const char *base_name, const char *new_name,
+			const char *delta_name, long jobs)
+{
+	uint8_t *base = NULL, *image = NULL;
+	uint32_t base_len, len;
+	int base_fd, image_fd = -1;
+	struct delta_piece *piece = NULL;
+	struct delta_header hdr;
+	uint64_t delta_size;
+	uint32_t count, i;
+	FILE *fp = NULL;
+	int errorcnt = 0;
+
+	base_fd = map_image(base_name, &base, &base_len);
+	if (base_fd < 0)
+		return 1;
+	image_fd = map_image(new_name, &image, &len);
+	if (image_fd < 0) {
+		errorcnt++;
+		goto done;
+	}
+	if (base_len != len) {
+		fprintf(stderr, "%s and %s aren't the same size\n",
+			base_name, new_name);
+		errorcnt++;
+		goto done;
+	}
+
+	piece = split_image(image, len, &count);
+	if (!piece) {
+		fprintf(stderr, "Can't find an FMAP in %s\n", new_name);
+		errorcnt++;
+		goto done;
+	}
+	Debug("hashing %d pieces with %ld jobs\n", count, jobs);
+	errorcnt += hash_pieces(piece, count, base, 0, jobs);
+	errorcnt += hash_pieces(piece, count, image, 1, jobs);
+	if (errorcnt) {
+		fprintf(stderr, "Can't hash the images\n");
+		goto done;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, DELTA_MAGIC, DELTA_MAGIC_SIZE);
+	hdr.version = DELTA_VERSION;
+	hdr.image_size = len;
+	hdr.num_pieces = count;
+	delta_size = sizeof(hdr) + count * sizeof(*piece);
+	for (i = 0; i < count; i++) {
+		piece[i].changed = !!memcmp(piece[i].base_digest,
+					    piece[i].new_digest,
+					    DELTA_DIGEST_SIZE);
+		if (!piece[i].changed)
+			continue;
+		hdr.num_changed++;
+		delta_size += piece[i].size;
+		printf("%s: 0x%08x bytes at 0x%08x changed\n",
+		       piece_name(piece + i), piece[i].size, piece[i].offset);
+	}
+
+	fp = fopen(delta_name, "wb");
+	if (!fp) {
+		fprintf(stderr, "Can't open %s: %s\n", delta_name,
+			strerror(errno));
+		errorcnt++;
+		goto done;
+	}
+	errorcnt += write_or_complain(fp, &hdr, sizeof(hdr), delta_name);
+	errorcnt += write_or_complain(fp, piece, count * sizeof(*piece),
+				      delta_name);
+	for (i = 0; i < count && !errorcnt; i++)
+		if (piece[i].changed)
+			errorcnt += write_or_complain(fp,
+						      image + piece[i].offset,
+						      piece[i].size,
+						      delta_name);
+	if (fclose(fp)) {
+		fprintf(stderr, "Can't write %s: %s\n", delta_name,
+			strerror(errno));
+		errorcnt++;
+	}
+	if (!errorcnt)
+		printf("%d of %d pieces changed; delta is %" PRIu64
+		       " bytes, image is %d bytes\n",
+		       hdr.num_changed, count, delta_size, len);
+
+done:
+	free(piece);
+	unmap_image(image_fd, image, len);
+	unmap_image(base_fd, base, base_len);
+	return errorcnt;
+}
+
+/*
+ * Check a VBLOCK and the firmware body it signs against the GBB root key.
+ * Returns the number of errors.
+ */
+static int verify_vblock(uint8_t *buf, uint32_t len,
+			 const VbPublicKey *rootkey, const char *vblock_name,
+			 const char *fw_main_name)
+{
+	FmapAreaHeader *vblock_ah, *fw_main_ah;
+	uint8_t *vblock, *fw_main;
+	VbKeyBlockHeader *key_block;
+	VbFirmwarePreambleHeader *preamble;
+	RSAPublicKey *data_key;
+	uint32_t size;
+	int errorcnt = 0;
+
+	vblock = fmap_find_by_name(buf, len, NULL, vblock_name, &vblock_ah);
+	fw_main = fmap_find_by_name(buf, len, NULL, fw_main_name,
+				    &fw_main_ah);
+	if (!vblock || !fw_main)
+		return 0;
+	if (vblock_ah->area_offset > len ||
+	    vblock_ah->area_size > len - vblock_ah->area_offset ||
+	    fw_main_ah->area_offset > len ||
+	    fw_main_ah->area_size > len - fw_main_ah->area_offset) {
+		fprintf(stderr, "%s or %s is outside the image\n",
+			vblock_name, fw_main_name);
+		return 1;
+	}
+
+	key_block = (VbKeyBlockHeader *)vblock;
+	size = vblock_ah->area_size;
+	if (VBOOT_SUCCESS != KeyBlockVerify(key_block, size, rootkey, 0)) {
+		fprintf(stderr, "%s: key block doesn't verify\n", vblock_name);
+		return 1;
+	}
+
+	data_key = PublicKeyToRSA(&key_block->data_key);
+	if (!data_key) {
+		fprintf(stderr, "%s: bad data key\n", vblock_name);
+		return 1;
+	}
+	preamble = (VbFirmwarePreambleHeader *)
+		(vblock + key_block->key_block_size);
+	if (VBOOT_SUCCESS !=
+	    VerifyFirmwarePreamble(preamble, size - key_block->key_block_size,
+				   data_key)) {
+		fprintf(stderr, "%s: preamble doesn't verify\n", vblock_name);
+		errorcnt++;
+	} else if (preamble->body_signature.data_size >
+		   fw_main_ah->area_size ||
+		   VBOOT_SUCCESS != VerifyData(fw_main, fw_main_ah->area_size,
+					       &preamble->body_signature,
+					       data_key)) {
+		fprintf(stderr, "%s: body doesn't verify\n", fw_main_name);
+		errorcnt++;
+	}
+	RSAPublicKeyFree(data_key);
+	return errorcnt;
+}
+
+/* Check the firmware VBLOCKs of an image. Returns the number of errors. */
+static int verify_image(uint8_t *buf, uint32_t len)
+{
+	GoogleBinaryBlockHeader *gbb;
+	FmapAreaHeader *ah;
+	VbPublicKey *rootkey;
+	uint32_t maxlen;
+	int errorcnt = 0;
+
+	gbb = (GoogleBinaryBlockHeader *)
+		fmap_find_by_name(buf, len, NULL, "GBB", &ah);
+	if (!gbb || !fmap_find_by_name(buf, len, NULL, "VBLOCK_A", NULL)) {
+		printf("No firmware VBLOCKs to check\n");
+		return 0;
+	}
+	if (ah->area_offset > len || ah->area_size > len - ah->area_offset ||
+	    !futil_valid_gbb_header(gbb, ah->area_size, &maxlen) ||
+	    maxlen > ah->area_size) {
+		fprintf(stderr, "The GBB isn't valid\n");
+		return 1;
+	}
+	rootkey = (VbPublicKey *)((uint8_t *)gbb + gbb->rootkey_offset);
+	if (!PublicKeyLooksOkay(rootkey, gbb->rootkey_size)) {
+		fprintf(stderr, "The GBB root key isn't valid\n");
+		return 1;
+	}
+
+	errorcnt += verify_vblock(buf, len, rootkey, "VBLOCK_A", "FW_MAIN_A");
+	errorcnt += verify_vblock(buf, len, rootkey, "VBLOCK_B", "FW_MAIN_B");
+	if (!errorcnt)
+		printf("Firmware VBLOCKs verified\n");
+	return errorcnt;
+}
+
+static int apply_delta(const char *base_name, const char *delta_name,
+		       const char *out_name, long jobs, int verify)
+{
+	uint8_t *base = NULL, *delta = NULL, *image = NULL;
+	uint32_t base_len, delta_len;
+	int base_fd = -1, delta_fd;
+	struct delta_header *hdr;
+	struct delta_piece *piece, *check = NULL;
+	uint64_t expect, used;
+	uint32_t count, i, n;
+	int errorcnt = 0;
+
+	delta_fd = map_image(delta_name, &delta, &delta_len);
+	if (delta_fd < 0)
+		return 1;
+
+	/* Check the delta hangs together before looking at the base */
+	hdr = (struct delta_header *)delta;
+	piece = (struct delta_piece *)(hdr + 1);
+	if (delta_len < sizeof(*hdr) ||
+	    memcmp(hdr->magic, DELTA_MAGIC, DELTA_MAGIC_SIZE) ||
+	    hdr->version != DELTA_VERSION ||
+	    hdr->num_pieces >
+	    (delta_len - sizeof(*hdr)) / sizeof(struct delta_piece)) {
+		fprintf(stderr, "%s isn't a firmware delta\n", delta_name);
+		errorcnt++;
+		goto done;
+	}
+	count = hdr->num_pieces;
+	expect = 0;
+	used = sizeof(*hdr) + count * sizeof(*piece);
+	n = 0;
+	for (i = 0; i < count; i++) {
+		if (piece[i].offset != expect)
+			break;
+		expect += piece[i].size;
+		if (piece[i].changed) {
+			used += piece[i].size;
+			n++;
+		}
+	}
+	if (i < count || expect != hdr->image_size || used != delta_len ||
+	    n != hdr->num_changed) {
+		fprintf(stderr, "%s is damaged\n", delta_name);
+		errorcnt++;
+		goto done;
+	}
+
+	base_fd = map_image(base_name, &base, &base_len);
+	if (base_fd < 0) {
+		errorcnt++;
+		goto done;
+	}
+	if (base_len != hdr->image_size) {
+		fprintf(stderr, "%s isn't the image %s was made against\n",
+			base_name, delta_name);
+		errorcnt++;
+		goto done;
+	}
+
+	/* Every piece of the base has to be what the delta expects */
+	check = malloc(count * sizeof(*check));
+	image = malloc(base_len);
+	if (!check || !image) {
+		fprintf(stderr, "Can't allocate memory\n");
+		errorcnt++;
+		goto done;
+	}
+	memcpy(check, piece, count * sizeof(*check));
+	errorcnt += hash_pieces(check, count, base, 0, jobs);
+	for (i = 0; i < count && !errorcnt; i++) {
+		if (memcmp(check[i].base_digest, piece[i].base_digest,
+			   DELTA_DIGEST_SIZE)) {
+			fprintf(stderr, "%s: %s isn't the image %s was made"
+				" against\n", piece_name(piece + i),
+				base_name, delta_name);
+			errorcnt++;
+		}
+	}
+	if (errorcnt)
+		goto done;
+
+	/* Put in the new pieces, and check they came out right */
+	memcpy(image, base, base_len);
+	used = sizeof(*hdr) + count * sizeof(*piece);
+	for (i = 0; i < count; i++) {
+		if (!piece[i].changed)
+			continue;
+		memcpy(image + piece[i].offset, delta + used, piece[i].size);
+		used += piece[i].size;
+	}
+	errorcnt += hash_pieces(check, count, image, 1, jobs);
+	for (i = 0; i < count && !errorcnt; i++) {
+		if (memcmp(check[i].new_digest, piece[i].new_digest,
+			   DELTA_DIGEST_SIZE)) {
+			fprintf(stderr, "%s: the result doesn't match\n",
+				piece_name(piece + i));
+			errorcnt++;
+		}
+	}
+	if (errorcnt)
+		goto done;
+
+	if (verify)
+		errorcnt += verify_image(image, base_len);
+	if (errorcnt) {
+		fprintf(stderr, "Not writing %s\n", out_name);
+		goto done;
+	}
+
+	if (WriteFile(out_name, image, base_len)) {
+		fprintf(stderr, "Can't write %s\n", out_name);
+		errorcnt++;
+	}
+
+done:
+	free(check);
+	free(image);
+	unmap_image(base_fd, base, base_len);
+	unmap_image(delta_fd, delta, delta_len);
+	return errorcnt;
+}
+
+static int do_delta(int argc, char *argv[])
+{
+	long jobs = futil_default_jobs();
+	int apply = 0, verify = 1;
+	int errorcnt = 0;
+	char *e = 0;
+	int i;
+
+	opterr = 0;		/* quiet, you */
+	while ((i = getopt_long(argc, argv, short_opts, long_opts, 0)) != -1) {
+		switch (i) {
+		case 'a':
+			apply = 1;
+			break;
+		case 'j':
+			jobs = strtol(optarg, &e, 0);
+			if (!*optarg || (e && *e) || jobs < 1) {
+				fprintf(stderr, "Invalid --jobs \"%s\"\n",
+					optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_NO_VERIFY:
+			verify = 0;
+			break;
+		case '?':
+			if (optopt)
+				fprintf(stderr, "Unrecognized option: -%c\n",
+					optopt);
+			else
+				fprintf(stderr, "Unrecognized option\n");
+			errorcnt++;
+			break;
+		case ':':
+			fprintf(stderr, "Missing argument to -%c\n", optopt);
+			errorcnt++;
+			break;
+		default:
+			DIE;
+		}
+	}
+
+	if (argc - optind != 3) {
+		fprintf(stderr, "You must give exactly three files\n");
+		errorcnt++;
+	}
+	if (errorcnt) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	if (apply)
+		errorcnt = apply_delta(argv[optind], argv[optind + 1],
+				       argv[optind + 2], jobs, verify);
+	else
+		errorcnt = create_delta(argv[optind], argv[optind + 1],
+					argv[optind + 2], jobs);
+	return !!errorcnt;
+}
+
+DECLARE_FUTIL_COMMAND(delta, do_delta,
+		      VBOOT_VERSION_ALL,
+		      "Make or apply a delta between firmware images",
+		      print_help);
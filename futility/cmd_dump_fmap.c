@@ -10,13 +10,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "2sysincludes.h"
+#include "2return_codes.h"
 #include "fmap.h"
 #include "futility.h"
+#include "host_common.h"
 
 enum { FMT_NORMAL, FMT_PRETTY, FMT_FLASHROM, FMT_HUMAN };
 
@@ -25,6 +26,7 @@ static int opt_extract;
 static int opt_format = FMT_NORMAL;
 static int opt_overlap;
 static char *progname;
+static int rom_fd = -1;
 static void *base_of_rom;
 static size_t size_of_rom;
 static int opt_gaps;
@@ -117,8 +119,9 @@ static int dump_fmap(const FmapHeader *fmh, int argc, char *argv[])
 						*s = '_';
 				outname = buf;
 			}
-			FILE *fp = fopen(outname, "wb");
-			if (!fp) {
+			int fd = open(outname, O_WRONLY | O_CREAT | O_TRUNC,
+				      0666);
+			if (fd < 0) {
 				fprintf(stderr, "%s: can't open %s: %s\n",
 					progname, outname, strerror(errno));
 				retval = 1;
@@ -131,8 +134,9 @@ static int dump_fmap(const FmapHeader *fmh, int argc, char *argv[])
 				fprintf(stderr, "%s: section %s is larger"
 					" than the image\n", progname, buf);
 				retval = 1;
-			} else if (1 != fwrite(base_of_rom + ah->area_offset,
-					       ah->area_size, 1, fp)) {
+			} else if ((ssize_t)ah->area_size !=
+				   CopyFileRange(rom_fd, ah->area_offset,
+						    fd, 0, ah->area_size)) {
 				fprintf(stderr, "%s: can't write %s: %s\n",
 					progname, buf, strerror(errno));
 				retval = 1;
@@ -140,7 +144,8 @@ static int dump_fmap(const FmapHeader *fmh, int argc, char *argv[])
 				if (FMT_NORMAL == opt_format)
 					printf("saved as \"%s\"\n", outname);
 			}
-			fclose(fp);
+			if (fd >= 0)
+				close(fd);
 		}
 	}
 
@@ -150,42 +155,7 @@ static int dump_fmap(const FmapHeader *fmh, int argc, char *argv[])
 /****************************************************************************/
 /* Stuff for human-readable form */
 
-struct dup_s {
-	char *name;
-	struct dup_s *next;
-};
-
-struct node_s {
-	char *name;
-	uint32_t start;
-	uint32_t size;
-	uint32_t end;
-	struct node_s *parent;
-	int num_children;
-	struct node_s **child;
-	struct dup_s *alias;
-};
-
-static struct node_s *all_nodes;
-
-static void sort_nodes(int num, struct node_s *ary[])
-{
-	int i, j;
-	struct node_s *tmp;
-
-	/* bubble-sort is quick enough with only a few entries */
-	for (i = 0; i < num; i++) {
-		for (j = i + 1; j < num; j++) {
-			if (ary[j]->start > ary[i]->start) {
-				tmp = ary[i];
-				ary[i] = ary[j];
-				ary[j] = tmp;
-			}
-		}
-	}
-}
-
-static void line(int indent, char *name,
+static void line(int indent, const char *name,
 		 uint32_t start, uint32_t end, uint32_t size, char *append)
 {
 	int i;
@@ -196,7 +166,7 @@ static void line(int indent, char *name,
 }
 
 static int gapcount;
-static void empty(int indent, uint32_t start, uint32_t end, char *name)
+static void empty(int indent, uint32_t start, uint32_t end, const char *name)
 {
 	char buf[80];
 	if (opt_gaps) {
@@ -206,187 +176,77 @@ static void empty(int indent, uint32_t start, uint32_t end, char *name)
 	gapcount++;
 }
 
-static void show(struct node_s *p, int indent, int show_first)
+static const char *node_name(const struct fmap_node *p)
 {
+	return p->ah ? p->name : "-entire flash-";
+}
+
+/* Show [p] and its children, from the highest offset down */
+static void show(const struct fmap_node *p, int indent, int show_first)
+{
+	const struct fmap_node *alias, *c, *next;
 	int i;
-	struct dup_s *alias;
 	if (show_first) {
-		line(indent, p->name, p->start, p->end, p->size, 0);
-		for (alias = p->alias; alias; alias = alias->next)
+		line(indent, node_name(p), p->start, p->end, p->size, 0);
+		for (alias = p->alias; alias; alias = alias->alias)
 			line(indent, alias->name, p->start, p->end, p->size,
 			     "  // DUPLICATE");
 	}
-	sort_nodes(p->num_children, p->child);
-	for (i = 0; i < p->num_children; i++) {
-		if (i == 0 && p->end != p->child[i]->end)
-			empty(indent, p->child[i]->end, p->end, p->name);
-		show(p->child[i], indent + show_first, 1);
-		if (i < p->num_children - 1
-		    && p->child[i]->start != p->child[i + 1]->end)
-			empty(indent, p->child[i + 1]->end, p->child[i]->start,
-			      p->name);
-		if (i == p->num_children - 1 && p->child[i]->start != p->start)
-			empty(indent, p->start, p->child[i]->start, p->name);
+	for (i = p->num_children - 1; i >= 0; i--) {
+		c = p->child[i];
+		next = i ? p->child[i - 1] : NULL;
+		if (i == p->num_children - 1 && p->end != c->end)
+			empty(indent, c->end, p->end, node_name(p));
+		show(c, indent + show_first, 1);
+		if (next && c->start != next->end)
+			empty(indent, next->end, c->start, node_name(p));
+		if (!next && c->start != p->start)
+			empty(indent, p->start, c->start, node_name(p));
 	}
 }
 
-static int overlaps(int i, int j)
+static int human_fmap(void)
 {
-	struct node_s *a = all_nodes + i;
-	struct node_s *b = all_nodes + j;
-
-	return ((a->start < b->start) && (b->start < a->end) &&
-		(b->start < a->end) && (a->end < b->end));
-}
-
-static int encloses(int i, int j)
-{
-	struct node_s *a = all_nodes + i;
-	struct node_s *b = all_nodes + j;
-
-	return ((a->start <= b->start) && (a->end >= b->end));
-}
-
-static int duplicates(int i, int j)
-{
-	struct node_s *a = all_nodes + i;
-	struct node_s *b = all_nodes + j;
-
-	return ((a->start == b->start) && (a->end == b->end));
-}
-
-static void add_dupe(int i, int j, int numnodes)
-{
-	int k;
-	struct dup_s *alias;
-
-	alias = (struct dup_s *) malloc(sizeof(struct dup_s));
-	alias->name = all_nodes[j].name;
-	alias->next = all_nodes[i].alias;
-	all_nodes[i].alias = alias;
-	for (k = j; k < numnodes; k++)
-		all_nodes[k] = all_nodes[k + 1];
-}
-
-static void add_child(struct node_s *p, int n)
-{
-	int i;
-	if (p->num_children && !p->child) {
-		p->child =
-		    (struct node_s **)calloc(p->num_children,
-					     sizeof(struct node_s *));
-		if (!p->child) {
-			perror("calloc failed");
-			exit(1);
-		}
-	}
-	for (i = 0; i < p->num_children; i++)
-		if (!p->child[i]) {
-			p->child[i] = all_nodes + n;
-			return;
-		}
-}
-
-static int human_fmap(const FmapHeader *fmh)
-{
-	FmapAreaHeader *ah;
-	int i, j, errorcnt = 0;
-	int numnodes;
-
-	ah = (FmapAreaHeader *) (fmh + 1);
-
-	/* The challenge here is to generate a directed graph from the
-	 * arbitrarily-ordered FMAP entries, and then to prune it until it's as
-	 * simple (and deep) as possible. Overlapping regions are not allowed.
-	 * Duplicate regions are okay, but may require special handling. */
-
-	/* Convert the FMAP info into our format. */
-	numnodes = fmh->fmap_nareas;
-
-	/* plus one for the all-enclosing "root" */
-	all_nodes = (struct node_s *) calloc(numnodes + 1,
-					     sizeof(struct node_s));
-	if (!all_nodes) {
-		perror("calloc failed");
+	struct fmap_tree tree;
+	const struct fmap_overlap *o;
+	int i, errorcnt = 0;
+
+	/*
+	 * Work out how the arbitrarily-ordered FMAP entries nest, as a tree
+	 * which is as deep as possible. Overlapping regions are not allowed.
+	 * Duplicate regions are okay, but may require special handling.
+	 */
+	if (fmap_build_tree(&tree, base_of_rom, size_of_rom)) {
+		perror("Can't build FMAP tree");
 		exit(1);
 	}
-	for (i = 0; i < numnodes; i++) {
-		char buf[FMAP_NAMELEN + 1];
-		strncpy(buf, ah[i].area_name, FMAP_NAMELEN);
-		buf[FMAP_NAMELEN] = '\0';
-		all_nodes[i].name = strdup(buf);
-		if (!all_nodes[i].name) {
-			perror("strdup failed");
-			exit(1);
-		}
-		all_nodes[i].start = ah[i].area_offset;
-		all_nodes[i].size = ah[i].area_size;
-		all_nodes[i].end = ah[i].area_offset + ah[i].area_size;
-	}
-	/* Now add the root node */
-	all_nodes[numnodes].name = strdup("-entire flash-");
-	all_nodes[numnodes].start = fmh->fmap_base;
-	all_nodes[numnodes].size = fmh->fmap_size;
-	all_nodes[numnodes].end = fmh->fmap_base + fmh->fmap_size;
-
-	/* First, coalesce any duplicates */
-	for (i = 0; i < numnodes; i++) {
-		for (j = i + 1; j < numnodes; j++) {
-			if (duplicates(i, j)) {
-				add_dupe(i, j, numnodes);
-				numnodes--;
-			}
-		}
-	}
 
-	/* Each node should have at most one parent, which is the smallest
-	 * enclosing node. Duplicate nodes "enclose" each other, but if there's
-	 * already a relationship in one direction, we won't create another.
-	 */
-	for (i = 0; i < numnodes; i++) {
-		/* Find the smallest parent, which might be the root node. */
-		int k = numnodes;
-		for (j = 0; j < numnodes; j++) { /* full O(N^2) comparison */
-			if (i == j)
-				continue;
-			if (overlaps(i, j)) {
-				printf("ERROR: %s and %s overlap\n",
-				       all_nodes[i].name, all_nodes[j].name);
-				printf("  %s: 0x%x - 0x%x\n", all_nodes[i].name,
-				       all_nodes[i].start, all_nodes[i].end);
-				printf("  %s: 0x%x - 0x%x\n", all_nodes[j].name,
-				       all_nodes[j].start, all_nodes[j].end);
-				if (opt_overlap < 2) {
-					printf("Use more -h args to ignore"
-					       " this error\n");
-					errorcnt++;
-				}
-				continue;
-			}
-			if (encloses(j, i)
-			    && all_nodes[j].size < all_nodes[k].size)
-				k = j;
+	for (i = 0; i < tree.num_overlaps; i++) {
+		o = tree.overlap + i;
+		printf("ERROR: %s and %s overlap\n",
+		       o->first->name, o->second->name);
+		printf("  %s: 0x%x - 0x%x\n", o->first->name,
+		       o->first->start, o->first->end);
+		printf("  %s: 0x%x - 0x%x\n", o->second->name,
+		       o->second->start, o->second->end);
+		if (opt_overlap < 2) {
+			printf("Use more -h args to ignore this error\n");
+			errorcnt++;
 		}
-		all_nodes[i].parent = all_nodes + k;
 	}
-	if (errorcnt)
+	if (errorcnt) {
+		fmap_free_tree(&tree);
 		return 1;
-
-	/* Force those deadbeat parents to recognize their children */
-	for (i = 0; i < numnodes; i++)	/* how many */
-		if (all_nodes[i].parent)
-			all_nodes[i].parent->num_children++;
-	for (i = 0; i < numnodes; i++)	/* here they are */
-		if (all_nodes[i].parent)
-			add_child(all_nodes[i].parent, i);
+	}
 
 	/* Ready to go */
 	printf("# name                     start       end         size\n");
-	show(all_nodes + numnodes, 0, opt_gaps);
+	show(tree.root, 0, opt_gaps);
 
 	if (gapcount && !opt_gaps)
 		printf("\nWARNING: unused regions found. Use -H to see them\n");
 
+	fmap_free_tree(&tree);
 	return 0;
 }
 
@@ -416,8 +276,8 @@ static int do_dump_fmap(int argc, char *argv[])
 {
 	int c;
 	int errorcnt = 0;
-	struct stat sb;
-	int fd;
+	uint8_t *rom;
+	uint32_t rom_size;
 	const FmapHeader *fmap;
 	int retval = 1;
 
@@ -463,35 +323,24 @@ static int do_dump_fmap(int argc, char *argv[])
 		return 1;
 	}
 
-	if (0 != stat(argv[optind], &sb)) {
-		fprintf(stderr, "%s: can't stat %s: %s\n",
-			progname, argv[optind], strerror(errno));
-		return 1;
-	}
-
-	fd = open(argv[optind], O_RDONLY);
-	if (fd < 0) {
-		fprintf(stderr, "%s: can't open %s: %s\n",
-			progname, argv[optind], strerror(errno));
-		return 1;
-	}
-
-	base_of_rom =
-	    mmap(0, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
-	if (base_of_rom == (char *)-1) {
-		fprintf(stderr, "%s: can't mmap %s: %s\n",
+	/* Areas are extracted from the file, so keep it open */
+	rom_fd = open(argv[optind], O_RDONLY);
+	if (rom_fd < 0 ||
+	    VB2_SUCCESS != vb2_map_fd(rom_fd, VB2_MAP_COW, &rom, &rom_size)) {
+		fprintf(stderr, "%s: can't map %s: %s\n",
 			progname, argv[optind], strerror(errno));
-		close(fd);
+		if (rom_fd >= 0)
+			close(rom_fd);
 		return 1;
 	}
-	close(fd);		/* done with this now */
-	size_of_rom = sb.st_size;
+	base_of_rom = rom;
+	size_of_rom = rom_size;
 
 	fmap = fmap_find(base_of_rom, size_of_rom);
 	if (fmap) {
 		switch (opt_format) {
 		case FMT_HUMAN:
-			retval = human_fmap(fmap);
+			retval = human_fmap();
 			break;
 		case FMT_NORMAL:
 			printf("hit at 0x%08x\n",
@@ -504,11 +353,13 @@ static int do_dump_fmap(int argc, char *argv[])
 		}
 	}
 
-	if (0 != munmap(base_of_rom, sb.st_size)) {
+	if (VB2_SUCCESS != vb2_unmap_file(rom, rom_size, VB2_MAP_COW)) {
 		fprintf(stderr, "%s: can't munmap %s: %s\n",
 			progname, argv[optind], strerror(errno));
+		close(rom_fd);
 		return 1;
 	}
+	close(rom_fd);
 
 	return retval;
 }
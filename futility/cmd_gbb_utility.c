@@ -4,6 +4,7 @@
  * found in the LICENSE file.
  */
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
 #include <stddef.h>
@@ -15,8 +16,11 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "2sysincludes.h"
+#include "2return_codes.h"
 #include "futility.h"
 #include "gbb_header.h"
+#include "host_common.h"
 
 static void print_help(const char *prog)
 {
@@ -196,58 +200,23 @@ static uint8_t *create_gbb(const char *desc, off_t *sizeptr)
 	return buf;
 }
 
-static uint8_t *read_entire_file(const char *filename, off_t *sizeptr)
+/*
+ * Map the whole file read-only, or with private changes for VB2_MAP_COW;
+ * release it with vb2_unmap_file()
+ */
+static uint8_t *map_entire_file(const char *filename, enum vb2_map_mode mode,
+				uint32_t *sizeptr)
 {
-	FILE *fp = NULL;
-	uint8_t *buf = NULL;
-	struct stat sb;
-
-	fp = fopen(filename, "rb");
-	if (!fp) {
-		fprintf(stderr, "ERROR: Unable to open %s for reading: %s\n",
-			filename, strerror(errno));
-		goto fail;
-	}
-
-	if (0 != fstat(fileno(fp), &sb)) {
-		fprintf(stderr, "ERROR: can't fstat %s: %s\n",
-			filename, strerror(errno));
-		goto fail;
-	}
-	if (sizeptr)
-		*sizeptr = sb.st_size;
-
-	buf = (uint8_t *) malloc(sb.st_size);
-	if (!buf) {
-		fprintf(stderr, "ERROR: can't malloc %" PRIi64 " bytes: %s\n",
-			sb.st_size, strerror(errno));
-		goto fail;
-	}
-
-	if (1 != fread(buf, sb.st_size, 1, fp)) {
-		fprintf(stderr, "ERROR: Unable to read from %s: %s\n",
-			filename, strerror(errno));
-		goto fail;
-	}
+	uint8_t *buf;
 
-	if (fp && 0 != fclose(fp)) {
-		fprintf(stderr, "ERROR: Unable to close %s: %s\n",
+	if (VB2_SUCCESS != vb2_map_file(filename, mode, &buf, sizeptr)) {
+		fprintf(stderr, "ERROR: Unable to read %s: %s\n",
 			filename, strerror(errno));
-		goto fail;
+		errorcnt++;
+		return NULL;
 	}
 
 	return buf;
-
-fail:
-	errorcnt++;
-
-	if (buf)
-		free(buf);
-
-	if (fp && 0 != fclose(fp))
-		fprintf(stderr, "ERROR: Unable to close %s: %s\n",
-			filename, strerror(errno));
-	return NULL;
 }
 
 static int write_to_file(const char *msg, const char *filename,
@@ -286,6 +255,78 @@ static int write_to_file(const char *msg, const char *filename,
 	return r;
 }
 
+/* Returns true if both names refer to the same existing file or device */
+static int same_file(const char *name1, const char *name2)
+{
+	struct stat sb1, sb2;
+
+	if (stat(name1, &sb1) || stat(name2, &sb2))
+		return 0;
+
+	return sb1.st_dev == sb2.st_dev && sb1.st_ino == sb2.st_ino;
+}
+
+/* How many bytes from the start of the GBB header its contents cover */
+static uint32_t gbb_extent(GoogleBinaryBlockHeader *gbb)
+{
+	uint32_t end = gbb->header_size;
+
+	if (end < gbb->hwid_offset + gbb->hwid_size)
+		end = gbb->hwid_offset + gbb->hwid_size;
+	if (end < gbb->rootkey_offset + gbb->rootkey_size)
+		end = gbb->rootkey_offset + gbb->rootkey_size;
+	if (end < gbb->bmpfv_offset + gbb->bmpfv_size)
+		end = gbb->bmpfv_offset + gbb->bmpfv_size;
+	if (end < gbb->recovery_key_offset + gbb->recovery_key_size)
+		end = gbb->recovery_key_offset + gbb->recovery_key_size;
+
+	return end;
+}
+
+/*
+ * Write back the pages of [image] (a private mapping of [fd]) between
+ * [start] and [end] that differ from [orig], the same bytes as they were
+ * before being changed. Nothing else in the file is touched.
+ */
+static int write_dirty_pages(const char *msg, const char *filename, int fd,
+			     const uint8_t *image, uint32_t image_size,
+			     uint32_t start, uint32_t end, const uint8_t *orig)
+{
+	uint32_t page = sysconf(_SC_PAGESIZE);
+	uint32_t pos, len, count = 0;
+
+	for (pos = start - start % page; pos < end; pos += len) {
+		uint32_t lo = pos < start ? start : pos;
+		uint32_t hi = pos + page < end ? pos + page : end;
+
+		len = page;
+		if (len > image_size - pos)
+			len = image_size - pos;
+		if (!memcmp(image + lo, orig + lo - start, hi - lo))
+			continue;
+
+		if (len != pwrite(fd, image + pos, len, pos)) {
+			fprintf(stderr, "ERROR: Unable to write to %s: %s\n",
+				filename, strerror(errno));
+			errorcnt++;
+			return 1;
+		}
+		count++;
+	}
+
+	if (count && 0 != fsync(fd)) {
+		fprintf(stderr, "ERROR: Unable to sync %s: %s\n",
+			filename, strerror(errno));
+		errorcnt++;
+		return 1;
+	}
+
+	Debug("wrote %d dirty page(s) to %s\n", count, filename);
+	if (msg)
+		printf("%s %s\n", msg, filename);
+	return 0;
+}
+
 static int read_from_file(const char *msg, const char *filename,
 			  uint8_t *start, uint32_t size)
 {
@@ -361,7 +402,12 @@ static int do_gbb_utility(int argc, char *argv[])
 	int sel_hwid = 0;
 	int sel_digest = 0;
 	int sel_flags = 0;
+	int in_place = 0;
+	int fd = -1;
 	uint8_t *inbuf = NULL;
+	uint8_t *gbb_orig = NULL;
+	uint32_t insize = 0;
+	uint32_t gbb_start = 0, gbb_end = 0;
 	off_t filesize;
 	uint8_t *outbuf = NULL;
 	GoogleBinaryBlockHeader *gbb;
@@ -464,11 +510,11 @@ static int do_gbb_utility(int argc, char *argv[])
 		    && !sel_flags && !sel_digest)
 			sel_hwid = 1;
 
-		inbuf = read_entire_file(infile, &filesize);
+		inbuf = map_entire_file(infile, VB2_MAP_RO, &insize);
 		if (!inbuf)
 			break;
 
-		gbb = FindGbbHeader(inbuf, filesize);
+		gbb = FindGbbHeader(inbuf, insize);
 		if (!gbb) {
 			fprintf(stderr, "ERROR: No GBB found in %s\n", infile);
 			break;
@@ -523,36 +569,53 @@ static int do_gbb_utility(int argc, char *argv[])
 			return 1;
 		}
 
-		/* With no args, we'll either copy it unchanged or do nothing */
-		inbuf = read_entire_file(infile, &filesize);
-		if (!inbuf)
-			break;
+		/*
+		 * Make the changes in a private mapping of the input. When
+		 * the output is the input (an image file, a flash dump, or a
+		 * block device), only the pages of the GBB that were changed
+		 * are written back.
+		 */
+		in_place = same_file(infile, outfile);
+		if (in_place) {
+			fd = open(infile, O_RDWR);
+			if (fd < 0 || VB2_SUCCESS !=
+			    vb2_map_fd(fd, VB2_MAP_COW, &inbuf, &insize)) {
+				fprintf(stderr,
+					"ERROR: Unable to read %s: %s\n",
+					infile, strerror(errno));
+				errorcnt++;
+				inbuf = NULL;
+				break;
+			}
+		} else {
+			inbuf = map_entire_file(infile, VB2_MAP_COW, &insize);
+			if (!inbuf)
+				break;
+		}
 
-		gbb = FindGbbHeader(inbuf, filesize);
+		gbb = FindGbbHeader(inbuf, insize);
 		if (!gbb) {
 			fprintf(stderr, "ERROR: No GBB found in %s\n", infile);
 			break;
 		}
 		gbb_base = (uint8_t *) gbb;
 
-		outbuf = (uint8_t *) malloc(filesize);
-		if (!outbuf) {
-			errorcnt++;
-			fprintf(stderr,
-				"ERROR: can't malloc %" PRIi64 " bytes: %s\n",
-				filesize, strerror(errno));
-			break;
-		}
-
-		/* Switch pointers to outbuf */
-		memcpy(outbuf, inbuf, filesize);
-		gbb = FindGbbHeader(outbuf, filesize);
-		if (!gbb) {
-			fprintf(stderr,
-				"INTERNAL ERROR: No GBB found in outbuf\n");
-			exit(1);
+		/* Keep what the GBB used to hold, to see what changed */
+		if (in_place) {
+			gbb_start = gbb_base - inbuf;
+			gbb_end = gbb_start + gbb_extent(gbb);
+			if (gbb_end > insize || gbb_end < gbb_start)
+				gbb_end = insize;
+			gbb_orig = malloc(gbb_end - gbb_start);
+			if (!gbb_orig) {
+				errorcnt++;
+				fprintf(stderr,
+					"ERROR: can't malloc %u bytes: %s\n",
+					gbb_end - gbb_start, strerror(errno));
+				break;
+			}
+			memcpy(gbb_orig, gbb_base, gbb_end - gbb_start);
 		}
-		gbb_base = (uint8_t *) gbb;
 
 		if (opt_hwid) {
 			if (strlen(opt_hwid) + 1 > gbb->hwid_size) {
@@ -599,9 +662,15 @@ static int do_gbb_utility(int argc, char *argv[])
 				       gbb->recovery_key_size);
 
 		/* Write it out if there are no problems. */
-		if (!errorcnt)
+		if (errorcnt)
+			break;
+		if (in_place)
+			write_dirty_pages("successfully saved new image to:",
+					  outfile, fd, inbuf, insize,
+					  gbb_start, gbb_end, gbb_orig);
+		else
 			write_to_file("successfully saved new image to:",
-				      outfile, outbuf, filesize);
+				      outfile, inbuf, insize);
 
 		break;
 
@@ -631,9 +700,13 @@ static int do_gbb_utility(int argc, char *argv[])
 	}
 
 	if (inbuf)
-		free(inbuf);
+		vb2_unmap_file(inbuf, insize, VB2_MAP_RO);
+	if (fd >= 0)
+		close(fd);
 	if (outbuf)
 		free(outbuf);
+	if (gbb_orig)
+		free(gbb_orig);
 	return !!errorcnt;
 }
 
@@ -0,0 +1,246 @@
+/*
+ * Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Packs key files into a key bundle, or lists what's in one.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
+#include "futility.h"
+#include "host_common.h"
+#include "host_key_bundle.h"
+
+static const char usage[] = "\n"
+	"Usage:  " MYNAME " %s BUNDLE FILE [FILE ...]\n"
+	"        " MYNAME " %s --list BUNDLE\n"
+	"\n"
+	"Packs the key FILEs into one BUNDLE, which is read once and mapped,\n"
+	"instead of opening and parsing a file per key. Any command that takes\n"
+	"a key file takes BUNDLE:NAME instead, where NAME is the name of the\n"
+	"FILE without its directory, or the SHA-1 of its contents, as listed.\n"
+	"\n"
+	"Options:\n"
+	"  -l|--list            List the keys in BUNDLE\n"
+	"\n"
+	"Example:\n"
+	"\n"
+	"  " MYNAME " %s keys.bundle tests/devkeys/*\n"
+	"  " MYNAME " vbutil_kernel --keyblock keys.bundle:kernel.keyblock \\\n"
+	"      --signprivate keys.bundle:kernel_data_key.vbprivk ...\n"
+	"\n";
+
+static void print_help(const char *prog)
+{
+	printf(usage, prog, prog, prog);
+}
+
+static const struct option long_opts[] = {
+	/* name    hasarg *flag  val */
+	{"list",     0, NULL, 'l'},
+	{"debug",    0, &debugging_enabled, 1},
+	{NULL,       0, NULL, 0},
+};
+
+struct key_file {
+	struct key_bundle_entry entry;
+	uint8_t *data;
+};
+
+static int compare_key_file(const void *a, const void *b)
+{
+	return strcmp(((const struct key_file *)a)->entry.name,
+		      ((const struct key_file *)b)->entry.name);
+}
+
+static uint32_t align_up(uint32_t offset)
+{
+	return (offset + KEY_BUNDLE_ALIGN - 1) & ~(KEY_BUNDLE_ALIGN - 1);
+}
+
+static int list_bundle(const char *filename)
+{
+	const struct key_bundle_entry *e;
+	uint8_t *buf;
+	uint64_t size;
+	uint32_t count, i, j;
+
+	buf = ReadFile(filename, &size);
+	if (!buf) {
+		fprintf(stderr, "Can't read %s\n", filename);
+		return 1;
+	}
+	e = KeyBundleEntries(buf, size, &count);
+	if (!e) {
+		fprintf(stderr, "%s is not a key bundle\n", filename);
+		free(buf);
+		return 1;
+	}
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < KEY_BUNDLE_ID_SIZE; j++)
+			printf("%02x", e[i].id[j]);
+		printf("  0x%08x  %8d  %s\n", e[i].offset, e[i].size,
+		       e[i].name);
+	}
+
+	free(buf);
+	return 0;
+}
+
+static int create_bundle(const char *filename, int count, char *files[])
+{
+	struct key_bundle_header *h;
+	struct key_bundle_entry *entries;
+	struct key_file *keys;
+	struct vb2_digest_context dc;
+	uint8_t *buf = NULL;
+	uint64_t size;
+	uint32_t offset;
+	int errorcnt = 0;
+	int i;
+
+	keys = calloc(count, sizeof(*keys));
+	if (!keys) {
+		fprintf(stderr, "Can't allocate memory\n");
+		return 1;
+	}
+
+	offset = align_up(sizeof(*h) + count * sizeof(*entries));
+	for (i = 0; i < count; i++) {
+		struct key_bundle_entry *e = &keys[i].entry;
+		char *path = strdup(files[i]);
+		const char *name = path ? basename(path) : "";
+
+		if (strlen(name) >= sizeof(e->name)) {
+			fprintf(stderr, "Name of %s is too long\n", files[i]);
+			errorcnt++;
+		} else if (!*name || strchr(name, ':')) {
+			/* The last ':' in BUNDLE:NAME starts the name */
+			fprintf(stderr, "Can't name a key %s\n", files[i]);
+			errorcnt++;
+		}
+		strncpy(e->name, name, sizeof(e->name) - 1);
+		free(path);
+
+		keys[i].data = ReadFile(files[i], &size);
+		if (!keys[i].data || size > UINT32_MAX - offset) {
+			fprintf(stderr, "Can't read %s\n", files[i]);
+			errorcnt++;
+			continue;
+		}
+		e->size = size;
+		if (vb2_digest_init(&dc, VB2_HASH_SHA1) ||
+		    vb2_digest_extend(&dc, keys[i].data, e->size) ||
+		    vb2_digest_finalize(&dc, e->id, sizeof(e->id))) {
+			fprintf(stderr, "Can't digest %s\n", files[i]);
+			errorcnt++;
+		}
+	}
+	if (errorcnt)
+		goto done;
+
+	/* Sorted, so a key is found by name without reading the whole index */
+	qsort(keys, count, sizeof(*keys), compare_key_file);
+	for (i = 0; i < count; i++) {
+		if (i && !strcmp(keys[i].entry.name, keys[i - 1].entry.name)) {
+			fprintf(stderr, "Two keys are called %s\n",
+				keys[i].entry.name);
+			errorcnt++;
+			goto done;
+		}
+		keys[i].entry.offset = offset;
+		offset = align_up(offset + keys[i].entry.size);
+	}
+
+	buf = calloc(1, offset);
+	if (!buf) {
+		fprintf(stderr, "Can't allocate memory\n");
+		errorcnt++;
+		goto done;
+	}
+	h = (struct key_bundle_header *)buf;
+	memcpy(h->magic, KEY_BUNDLE_MAGIC, KEY_BUNDLE_MAGIC_SIZE);
+	h->version = KEY_BUNDLE_VERSION;
+	h->header_size = sizeof(*h);
+	h->entry_size = sizeof(*entries);
+	h->entry_count = count;
+	h->entries_offset = sizeof(*h);
+	entries = (struct key_bundle_entry *)(buf + h->entries_offset);
+	for (i = 0; i < count; i++) {
+		entries[i] = keys[i].entry;
+		memcpy(buf + keys[i].entry.offset, keys[i].data,
+		       keys[i].entry.size);
+	}
+
+	if (WriteFile(filename, buf, offset)) {
+		fprintf(stderr, "Can't write %s\n", filename);
+		errorcnt++;
+	}
+
+done:
+	for (i = 0; i < count; i++)
+		free(keys[i].data);
+	free(keys);
+	free(buf);
+	return !!errorcnt;
+}
+
+static int do_key_bundle(int argc, char *argv[])
+{
+	int list = 0;
+	int errorcnt = 0;
+	int i;
+
+	opterr = 0;		/* quiet, you */
+	while ((i = getopt_long(argc, argv, ":l", long_opts, NULL)) != -1) {
+		switch (i) {
+		case 'l':
+			list = 1;
+			break;
+		case '?':
+			if (optopt)
+				fprintf(stderr, "Unrecognized option: -%c\n",
+					optopt);
+			else
+				fprintf(stderr, "Unrecognized option: %s\n",
+					argv[optind - 1]);
+			errorcnt++;
+			break;
+		case 0:				/* handled option */
+			break;
+		default:
+			DIE;
+		}
+	}
+
+	if (list ? argc - optind != 1 : argc - optind < 2) {
+		fprintf(stderr, list ? "Give one bundle\n" :
+			"Give a bundle and the keys to put in it\n");
+		errorcnt++;
+	}
+	if (errorcnt) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	if (list)
+		return list_bundle(argv[optind]);
+	return create_bundle(argv[optind], argc - optind - 1,
+			     argv + optind + 1);
+}
+
+DECLARE_FUTIL_COMMAND(key_bundle, do_key_bundle,
+		      VBOOT_VERSION_ALL,
+		      "Pack key files into an indexed key bundle",
+		      print_help);
@@ -19,6 +19,7 @@
 
 #include "fmap.h"
 #include "futility.h"
+#include "host_common.h"
 
 
 static const char usage[] = "\n"
@@ -51,36 +52,81 @@ static const struct option long_opts[] = {
 static char *short_opts = ":o:";
 
 
-static int copy_to_area(char *file, uint8_t *buf, uint32_t len, char *area)
+/* One AREA:file argument */
+struct area_file {
+	char *area;
+	char *file;
+	uint32_t offset;
+	uint32_t size;
+	int order;		/* Position on the command line */
+};
+
+static int compare_offset(const void *a, const void *b)
+{
+	const struct area_file *x = a;
+	const struct area_file *y = b;
+
+	if (x->offset != y->offset)
+		return x->offset > y->offset ? 1 : -1;
+	return x->order - y->order;
+}
+
+static int compare_order(const void *a, const void *b)
+{
+	const struct area_file *x = a;
+	const struct area_file *y = b;
+
+	return x->order - y->order;
+}
+
+/*
+ * Sort the areas to fill them in one pass through the image.  If any of them
+ * overlap, the last one on the command line has to win, so leave them be.
+ */
+static void sort_areas(struct area_file *areas, int nareas)
+{
+	int i;
+
+	qsort(areas, nareas, sizeof(*areas), compare_offset);
+	for (i = 1; i < nareas; i++) {
+		if (areas[i].offset < areas[i - 1].offset + areas[i - 1].size) {
+			qsort(areas, nareas, sizeof(*areas), compare_order);
+			return;
+		}
+	}
+}
+
+static int copy_to_area(const struct area_file *a, int fd)
 {
-	FILE *fp;
 	int retval = 0;
-	int n;
+	ssize_t n;
+	int src;
 
-	fp = fopen(file, "r");
-	if (!fp) {
+	src = open(a->file, O_RDONLY);
+	if (src < 0) {
 		fprintf(stderr, "area %s: can't open %s for reading: %s\n",
-			area, file, strerror(errno));
+			a->area, a->file, strerror(errno));
 		return 1;
 	}
 
-	n = fread(buf, 1, len, fp);
-	if (n == 0) {
-		if (feof(fp))
-			fprintf(stderr, "area %s: unexpected EOF on %s\n",
-				area, file);
-		if (ferror(fp))
-			fprintf(stderr, "area %s: can't read from %s: %s\n",
-				area, file, strerror(errno));
+	/* Straight from the file into the image, without a bounce buffer */
+	n = CopyFileRange(src, -1, fd, a->offset, a->size);
+	if (n < 0) {
+		fprintf(stderr, "area %s: can't read from %s: %s\n",
+			a->area, a->file, strerror(errno));
+		retval = 1;
+	} else if (n == 0) {
+		fprintf(stderr, "area %s: unexpected EOF on %s\n",
+			a->area, a->file);
 		retval = 1;
-	} else if (n < len) {
-		fprintf(stderr, "Warning on area %s: only read %d "
-			"(not %d) from %s\n", area, n, len, file);
+	} else if (n < a->size) {
+		fprintf(stderr, "Warning on area %s: only read %zd "
+			"(not %d) from %s\n", a->area, n, a->size, a->file);
 	}
 
-	if (0 != fclose(fp)) {
+	if (0 != close(src)) {
 		fprintf(stderr, "area %s: error closing %s: %s\n",
-			area, file, strerror(errno));
+			a->area, a->file, strerror(errno));
 		retval = 1;
 	}
 
@@ -94,8 +140,10 @@ static int do_load_fmap(int argc, char *argv[])
 	char *outfile = 0;
 	uint8_t *buf;
 	uint32_t len;
-	FmapHeader *fmap;
+	struct fmap_index index;
 	FmapAreaHeader *ah;
+	struct area_file *areas;
+	int nareas = 0;
 	int errorcnt = 0;
 	int fd, i;
 
@@ -154,13 +202,20 @@ static int do_load_fmap(int argc, char *argv[])
 	if (errorcnt)
 		goto done_file;
 
-	fmap = fmap_find(buf, len);
-	if (!fmap) {
+	if (0 != fmap_index_init(&index, buf, len)) {
 		fprintf(stderr, "Can't find an FMAP in %s\n", infile);
 		errorcnt++;
 		goto done_map;
 	}
 
+	areas = calloc(argc - optind, sizeof(*areas));
+	if (!areas) {
+		fprintf(stderr, "Can't allocate area list\n");
+		errorcnt++;
+		goto done_map;
+	}
+
+	/* Check all the arguments before touching the image */
 	for (i = optind; i < argc; i++) {
 		char *a = argv[i];
 		char *f = strchr(a, ':');
@@ -168,23 +223,42 @@ static int do_load_fmap(int argc, char *argv[])
 		if (!f || a == f || *(f+1) == '\0') {
 			fprintf(stderr, "argument \"%s\" is bogus\n", a);
 			errorcnt++;
-			break;
+			goto done_areas;
 		}
 		*f++ = '\0';
-		uint8_t *area_buf = fmap_find_by_name(buf, len, fmap, a, &ah);
-		if (!area_buf) {
+		if (!fmap_index_find(&index, a, &ah)) {
 			fprintf(stderr, "Can't find area \"%s\" in FMAP\n", a);
 			errorcnt++;
-			break;
+			goto done_areas;
 		}
+		if (ah->area_offset > len ||
+		    ah->area_size > len - ah->area_offset) {
+			fprintf(stderr, "Area \"%s\" is larger than the image\n",
+				a);
+			errorcnt++;
+			goto done_areas;
+		}
+
+		areas[nareas].area = a;
+		areas[nareas].file = f;
+		areas[nareas].offset = ah->area_offset;
+		areas[nareas].size = ah->area_size;
+		areas[nareas].order = nareas;
+		nareas++;
+	}
 
-		if (0 != copy_to_area(f, area_buf, ah->area_size, a)) {
+	sort_areas(areas, nareas);
+	for (i = 0; i < nareas; i++) {
+		if (0 != copy_to_area(&areas[i], fd)) {
 			errorcnt++;
 			break;
 		}
 	}
 
+done_areas:
+	free(areas);
 done_map:
+	fmap_index_free(&index);
 	errorcnt |= futil_unmap_file(fd, 1, buf, len);
 
 done_file:
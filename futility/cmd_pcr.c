@@ -5,15 +5,18 @@
  */
 
 #include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "futility.h"
 
 static const char usage[] = "\n"
 	"Usage:  " MYNAME " %s [OPTIONS] DIGEST [...]\n"
+	"        " MYNAME " %s -l LOGFILE\n"
 	"\n"
 	"This simulates a TPM PCR extension, to determine the expected output\n"
 	"\n"
@@ -25,6 +28,9 @@ static const char usage[] = "\n"
 	"  -i      Initialize the PCR with the first DIGEST argument\n"
 	"            (the default is to start with all zeros)\n"
 	"  -2      Use sha256 DIGESTS (the default is sha1)\n"
+	"  -l      Replay a measured boot event log, as printed by\n"
+	"            \"crossystem vdat_measurements\", and show the\n"
+	"            resulting value of each PCR it extends\n"
 	"\n"
 	"Examples:\n"
 	"\n"
@@ -35,7 +41,7 @@ static const char usage[] = "\n"
 
 static void help_and_quit(const char *prog)
 {
-	printf(usage, prog, prog, prog);
+	printf(usage, prog, prog, prog, prog);
 }
 
 static int parse_hex(uint8_t *val, const char *str)
@@ -97,20 +103,114 @@ static void print_digest(const uint8_t *buf, int len)
 }
 
 
-static int do_pcr(int argc, char *argv[])
+/* Extend [pcr] with [digest], both [digest_size] bytes */
+static int extend(uint8_t *pcr, const uint8_t *digest, int digest_size,
+		  int digest_alg)
 {
 	uint8_t accum[SHA256_DIGEST_SIZE * 2];
+
+	memcpy(accum, pcr, digest_size);
+	memcpy(accum + digest_size, digest, digest_size);
+	if (DigestBufInto(accum, digest_size * 2, digest_alg, pcr,
+			  digest_size)) {
+		fprintf(stderr, "Error computing digest!\n");
+		return 1;
+	}
+	return 0;
+}
+
+/* Measured boot logs only use the low PCRs */
+#define MAX_LOG_PCRS 24
+
+static int replay_log(const char *filename)
+{
+	uint8_t pcrs[MAX_LOG_PCRS][SHA1_DIGEST_SIZE];
+	uint8_t digest[SHA1_DIGEST_SIZE];
+	int used[MAX_LOG_PCRS];
+	char line[256], pcr_str[16], event[64], hex[128];
+	FILE *fp;
+	int lineno = 0;
+	int pcr, i;
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		fprintf(stderr, "Can't open %s: %s\n", filename,
+			strerror(errno));
+		return 1;
+	}
+
+	memset(pcrs, 0, sizeof(pcrs));
+	memset(used, 0, sizeof(used));
+
+	while (fgets(line, sizeof(line), fp)) {
+		lineno++;
+		if (3 != sscanf(line, "%15s %63s %127s", pcr_str, event, hex)) {
+			/* Skip blank lines, complain about anything else */
+			if (1 == sscanf(line, "%15s", pcr_str)) {
+				fprintf(stderr, "%s:%d: bad log line\n",
+					filename, lineno);
+				fclose(fp);
+				return 1;
+			}
+			continue;
+		}
+		parse_digest_or_die(digest, sizeof(digest), hex);
+
+		if (!strcmp(pcr_str, "-")) {
+			printf("log:  %s ", event);
+			print_digest(digest, sizeof(digest));
+			printf("\n");
+			continue;
+		}
+
+		pcr = atoi(pcr_str);
+		if (!isdigit(pcr_str[0]) || pcr >= MAX_LOG_PCRS) {
+			fprintf(stderr, "%s:%d: bad PCR \"%s\"\n",
+				filename, lineno, pcr_str);
+			fclose(fp);
+			return 1;
+		}
+
+		printf("PCR%d + %s ", pcr, event);
+		print_digest(digest, sizeof(digest));
+		printf("\n");
+		if (extend(pcrs[pcr], digest, sizeof(digest),
+			   SHA1_DIGEST_ALGORITHM)) {
+			fclose(fp);
+			return 1;
+		}
+		used[pcr] = 1;
+	}
+	fclose(fp);
+
+	for (i = 0; i < MAX_LOG_PCRS; i++) {
+		if (!used[i])
+			continue;
+		printf("PCR%d: ", i);
+		print_digest(pcrs[i], sizeof(pcrs[i]));
+		printf("\n");
+	}
+
+	return 0;
+}
+
+static int do_pcr(int argc, char *argv[])
+{
+	uint8_t digest[SHA256_DIGEST_SIZE];
 	uint8_t pcr[SHA256_DIGEST_SIZE];
 	int digest_alg = SHA1_DIGEST_ALGORITHM;
 	int digest_size = SHA1_DIGEST_SIZE;
 	int opt_init = 0;
+	const char *opt_log = NULL;
 	int errorcnt = 0;
-	uint8_t *digest;
 	int i;
 
 	opterr = 0;		/* quiet, you */
-	while ((i = getopt(argc, argv, ":i2")) != -1) {
+	while ((i = getopt(argc, argv, ":i2l:")) != -1) {
 		switch (i) {
+		case 'l':
+			opt_log = optarg;
+			break;
 		case 'i':
 			opt_init = 1;
 			break;
@@ -140,6 +240,16 @@ static int do_pcr(int argc, char *argv[])
 		return 1;
 	}
 
+	if (opt_log) {
+		if (opt_init || digest_alg != SHA1_DIGEST_ALGORITHM ||
+		    argc > optind) {
+			fprintf(stderr, "-l can't be used with other args\n");
+			help_and_quit(argv[0]);
+			return 1;
+		}
+		return replay_log(opt_log);
+	}
+
 	if (argc - optind < 1 + opt_init) {
 		fprintf(stderr, "You must extend at least one DIGEST\n");
 		help_and_quit(argv[0]);
@@ -158,20 +268,14 @@ static int do_pcr(int argc, char *argv[])
 	printf("\n");
 
 	for (i = optind; i < argc; i++) {
-		memcpy(accum, pcr, sizeof(pcr));
-		parse_digest_or_die(accum + digest_size, digest_size, argv[i]);
+		parse_digest_or_die(digest, digest_size, argv[i]);
 
 		printf("   + ");
-		print_digest(accum + digest_size, digest_size);
+		print_digest(digest, digest_size);
 		printf("\n");
 
-		digest = DigestBuf(accum, digest_size * 2, digest_alg);
-		if (!digest) {
-			fprintf(stderr, "Error computing digest!\n");
+		if (extend(pcr, digest, digest_size, digest_alg))
 			return 1;
-		}
-		memcpy(pcr, digest, digest_size);
-		free(digest);
 
 		printf("PCR: ");
 		print_digest(pcr, digest_size);
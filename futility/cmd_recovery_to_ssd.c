@@ -0,0 +1,431 @@
+/*
+ * Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Converts a recovery image into an SSD image, the way
+ * convert_recovery_to_ssd.sh and convert_recovery_to_full_ssd.sh do, without
+ * going through dd. Partitions are copied within the kernel where it can, and
+ * holes in the source stay holes in the image.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "cgptlib_internal.h"
+#include "futility.h"
+#include "host_common.h"
+
+/* Partitions of a Chrome OS image, counting from 1 */
+#define KERN_A 2
+#define ROOT_A 3
+#define KERN_B 4
+
+/* Size of one copy of the GPT entries */
+#define ENTRIES_SIZE (MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry))
+
+/* Biggest single copy or write; also the size of the bounce buffer */
+#define COPY_CHUNK (1 << 20)
+
+struct image_s {
+	const char *name;
+	int fd;
+	uint64_t size;
+	GptEntry entries[MAX_NUMBER_OF_ENTRIES];
+};
+
+static const char usage[] = "\n"
+	"Usage:  " MYNAME " %s [OPTIONS] IMAGE\n"
+	"\n"
+	"Converts a recovery IMAGE into an SSD image in place: KERN-B is\n"
+	"copied over KERN-A, and KERN-B is then zeroed.\n"
+	"\n"
+	"Options:\n"
+	"  -v|--vblock FILE     Write this vblock (vmlinuz_hd.vblock from the\n"
+	"                         stateful partition) over the start of KERN-A.\n"
+	"                         Otherwise, resign KERN-A afterwards with\n"
+	"                         \"" MYNAME " sign --partition 2\".\n"
+	"  -r|--recovery FILE   IMAGE is an SSD image instead; ROOT-A and KERN-B\n"
+	"                         of the recovery image FILE go to its ROOT-A and\n"
+	"                         KERN-A, keeping IMAGE's stateful partition.\n"
+	"\n"
+	"Holes in the partitions copied, and KERN-B afterwards, are left as\n"
+	"holes in IMAGE where its file system allows.\n"
+	"\n";
+
+static void print_help(const char *prog)
+{
+	printf(usage, prog);
+}
+
+static const struct option long_opts[] = {
+	/* name    hasarg *flag  val */
+	{"vblock",   1, NULL, 'v'},
+	{"recovery", 1, NULL, 'r'},
+	{"debug",    0, &debugging_enabled, 1},
+	{NULL,       0, NULL, 0},
+};
+
+/* Write all of [len] bytes at [offset]. Returns nonzero on error. */
+static int write_at(int fd, const uint8_t *buf, uint64_t len, uint64_t offset)
+{
+	ssize_t done;
+
+	while (len) {
+		done = pwrite(fd, buf, len, offset);
+		if (done < 0 && errno == EINTR)
+			continue;
+		if (done <= 0)
+			return 1;
+		buf += done;
+		offset += done;
+		len -= done;
+	}
+	return 0;
+}
+
+/* Read the GPT and keep its entries. Returns nonzero on error. */
+static int open_image(struct image_s *image, const char *name, int writeable)
+{
+	uint64_t gpt_size = GPT_HEADER_SECTORS * DISK_SECTOR_SIZE +
+		ENTRIES_SIZE;
+	uint8_t *primary = NULL, *secondary = NULL;
+	GptData gpt;
+	off_t size;
+	int rv = 1;
+
+	image->name = name;
+	image->fd = open(name, writeable ? O_RDWR : O_RDONLY);
+	if (image->fd < 0) {
+		fprintf(stderr, "Can't open %s: %s\n", name, strerror(errno));
+		return 1;
+	}
+
+	/* Just the GPT headers and entries, each next to the other */
+	size = lseek(image->fd, 0, SEEK_END);
+	primary = malloc(gpt_size);
+	secondary = malloc(gpt_size);
+	if (size < (off_t)(GPT_PMBR_SECTORS * DISK_SECTOR_SIZE +
+			   2 * gpt_size) || !primary || !secondary ||
+	    pread(image->fd, primary, gpt_size,
+		  GPT_PMBR_SECTORS * DISK_SECTOR_SIZE) != (ssize_t)gpt_size ||
+	    pread(image->fd, secondary, gpt_size,
+		  size - gpt_size) != (ssize_t)gpt_size) {
+		fprintf(stderr, "Can't read the GPT of %s\n", name);
+		goto done;
+	}
+	image->size = size;
+
+	memset(&gpt, 0, sizeof(gpt));
+	gpt.sector_bytes = DISK_SECTOR_SIZE;
+	gpt.streaming_drive_sectors = size / DISK_SECTOR_SIZE;
+	gpt.gpt_drive_sectors = gpt.streaming_drive_sectors;
+	gpt.primary_header = primary;
+	gpt.primary_entries = primary + GPT_HEADER_SECTORS * DISK_SECTOR_SIZE;
+	gpt.secondary_entries = secondary;
+	gpt.secondary_header = secondary + ENTRIES_SIZE;
+	rv = GptSanityCheck(&gpt);
+	if (GPT_SUCCESS != rv) {
+		fprintf(stderr, "The GPT of %s is invalid: %s\n", name,
+			GptErrorText(rv));
+		rv = 1;
+		goto done;
+	}
+	memcpy(image->entries, (gpt.valid_entries & MASK_PRIMARY) ?
+	       gpt.primary_entries : gpt.secondary_entries,
+	       sizeof(image->entries));
+
+done:
+	free(primary);
+	free(secondary);
+	if (rv) {
+		close(image->fd);
+		image->fd = -1;
+	}
+	return rv;
+}
+
+/* Where partition [n] is, in bytes. Returns nonzero if it's no good. */
+static int find_partition(const struct image_s *image, int n, int kernel,
+			  uint64_t *start, uint64_t *size)
+{
+	const GptEntry *e = &image->entries[n - 1];
+
+	if (kernel ? !IsKernelEntry(e) : IsUnusedEntry(e)) {
+		fprintf(stderr, "Partition %d of %s isn't a %s\n", n,
+			image->name, kernel ? "kernel" : "partition");
+		return 1;
+	}
+	*start = e->starting_lba * DISK_SECTOR_SIZE;
+	*size = (e->ending_lba - e->starting_lba + 1) * DISK_SECTOR_SIZE;
+	if (*start > image->size || *size > image->size - *start) {
+		fprintf(stderr, "Partition %d is past the end of %s\n", n,
+			image->name);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Zero [len] bytes at [offset], punching a hole if the file system can. The
+ * zeros are only written where it can't.
+ */
+static int zero_range(int fd, uint64_t offset, uint64_t len)
+{
+	uint8_t *zeros;
+	uint64_t n;
+	int rv = 0;
+
+	if (!len)
+		return 0;
+	Debug("zero 0x%" PRIx64 " bytes at 0x%" PRIx64 "\n", len, offset);
+#ifdef FALLOC_FL_PUNCH_HOLE
+	if (!fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		       offset, len))
+		return 0;
+#endif
+
+	zeros = calloc(1, COPY_CHUNK);
+	if (!zeros)
+		return 1;
+	for (; len && !rv; offset += n, len -= n) {
+		n = len < COPY_CHUNK ? len : COPY_CHUNK;
+		rv = write_at(fd, zeros, n, offset);
+	}
+	free(zeros);
+	return rv;
+}
+
+/* Copy [len] bytes of data, within the kernel if it'll do it */
+static int copy_data(int in_fd, uint64_t in_offset,
+		     int out_fd, uint64_t out_offset, uint64_t len)
+{
+	uint8_t *buf;
+	ssize_t n;
+	int rv = 0;
+
+	Debug("copy 0x%" PRIx64 " bytes from 0x%" PRIx64 " to 0x%" PRIx64
+	      "\n", len, in_offset, out_offset);
+#ifdef SYS_copy_file_range
+	while (len) {
+		loff_t in_off = in_offset, out_off = out_offset;
+
+		n = syscall(SYS_copy_file_range, in_fd, &in_off, out_fd,
+			    &out_off, len < COPY_CHUNK ? len : COPY_CHUNK, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		/* Not between these two, so do it the long way */
+		if (n <= 0)
+			break;
+		in_offset += n;
+		out_offset += n;
+		len -= n;
+	}
+#endif
+	if (!len)
+		return 0;
+
+	buf = malloc(COPY_CHUNK);
+	if (!buf)
+		return 1;
+	while (len && !rv) {
+		n = pread(in_fd, buf, len < COPY_CHUNK ? len : COPY_CHUNK,
+			  in_offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0 || write_at(out_fd, buf, n, out_offset)) {
+			rv = 1;
+			break;
+		}
+		in_offset += n;
+		out_offset += n;
+		len -= n;
+	}
+	free(buf);
+	return rv;
+}
+
+/* Copy [len] bytes, leaving the source's holes as holes */
+static int copy_range(int in_fd, uint64_t in_offset,
+		      int out_fd, uint64_t out_offset, uint64_t len)
+{
+	uint64_t pos = 0, data, hole;
+	off_t found;
+
+	while (pos < len) {
+		/* Anything which can't say where its holes are is all data */
+		found = lseek(in_fd, in_offset + pos, SEEK_DATA);
+		if (found < 0)
+			data = errno == ENXIO ? len : pos;
+		else
+			data = found - in_offset;
+		if (data > len)
+			data = len;
+		if (zero_range(out_fd, out_offset + pos, data - pos))
+			return 1;
+		pos = data;
+		if (pos == len)
+			break;
+
+		found = lseek(in_fd, in_offset + pos, SEEK_HOLE);
+		hole = found < 0 ? len : found - in_offset;
+		if (hole > len)
+			hole = len;
+		if (copy_data(in_fd, in_offset + pos, out_fd, out_offset + pos,
+			      hole - pos))
+			return 1;
+		pos = hole;
+	}
+	return 0;
+}
+
+/* Copy partition [from] of [src] over partition [to] of [dst], like dd */
+static int copy_partition(const struct image_s *src, int from,
+			  const struct image_s *dst, int to, int kernel)
+{
+	uint64_t src_start, src_size, dst_start, dst_size;
+
+	if (find_partition(src, from, kernel, &src_start, &src_size) ||
+	    find_partition(dst, to, kernel, &dst_start, &dst_size))
+		return 1;
+
+	/* Whatever's past the end of a smaller source is left alone */
+	if (copy_range(src->fd, src_start, dst->fd, dst_start,
+		       src_size < dst_size ? src_size : dst_size)) {
+		fprintf(stderr, "Can't copy partition %d to %d: %s\n",
+			from, to, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+static int write_vblock(const struct image_s *image, const char *vblock)
+{
+	uint64_t start, size;
+	uint8_t *buf;
+	uint64_t len;
+	int rv = 0;
+
+	if (find_partition(image, KERN_A, 1, &start, &size))
+		return 1;
+	buf = ReadFile(vblock, &len);
+	if (!buf) {
+		fprintf(stderr, "Can't read %s\n", vblock);
+		return 1;
+	}
+	if (len > size) {
+		fprintf(stderr, "%s doesn't fit in partition %d\n", vblock,
+			KERN_A);
+		rv = 1;
+	} else if (write_at(image->fd, buf, len, start)) {
+		fprintf(stderr, "Can't write %s: %s\n", image->name,
+			strerror(errno));
+		rv = 1;
+	}
+	free(buf);
+	return rv;
+}
+
+static int do_recovery_to_ssd(int argc, char *argv[])
+{
+	struct image_s image = { .fd = -1 }, recovery = { .fd = -1 };
+	const struct image_s *src = &image;
+	char *vblock = NULL, *recovery_file = NULL;
+	uint64_t start, size;
+	int errorcnt = 0;
+	int i;
+
+	opterr = 0;		/* quiet, you */
+	while ((i = getopt_long(argc, argv, ":v:r:", long_opts,
+				NULL)) != -1) {
+		switch (i) {
+		case 'v':
+			vblock = optarg;
+			break;
+		case 'r':
+			recovery_file = optarg;
+			break;
+		case '?':
+			if (optopt)
+				fprintf(stderr, "Unrecognized option: -%c\n",
+					optopt);
+			else
+				fprintf(stderr, "Unrecognized option: %s\n",
+					argv[optind - 1]);
+			errorcnt++;
+			break;
+		case ':':
+			fprintf(stderr, "Missing argument to -%c\n", optopt);
+			errorcnt++;
+			break;
+		case 0:				/* handled option */
+			break;
+		default:
+			DIE;
+		}
+	}
+
+	if (argc - optind != 1) {
+		fprintf(stderr, "Give one image\n");
+		errorcnt++;
+	}
+	if (errorcnt) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	if (open_image(&image, argv[optind], 1))
+		return 1;
+	if (recovery_file) {
+		if (open_image(&recovery, recovery_file, 0)) {
+			errorcnt++;
+			goto done;
+		}
+		src = &recovery;
+		if (copy_partition(src, ROOT_A, &image, ROOT_A, 0)) {
+			errorcnt++;
+			goto done;
+		}
+	}
+
+	if (copy_partition(src, KERN_B, &image, KERN_A, 1) ||
+	    (vblock && write_vblock(&image, vblock)) ||
+	    find_partition(&image, KERN_B, 1, &start, &size)) {
+		errorcnt++;
+		goto done;
+	}
+	if (zero_range(image.fd, start, size)) {
+		fprintf(stderr, "Can't zero partition %d: %s\n", KERN_B,
+			strerror(errno));
+		errorcnt++;
+		goto done;
+	}
+
+	if (fsync(image.fd)) {
+		fprintf(stderr, "Can't sync %s: %s\n", image.name,
+			strerror(errno));
+		errorcnt++;
+	}
+
+done:
+	if (recovery.fd >= 0)
+		close(recovery.fd);
+	if (image.fd >= 0)
+		close(image.fd);
+	return !!errorcnt;
+}
+
+DECLARE_FUTIL_COMMAND(recovery_to_ssd, do_recovery_to_ssd,
+		      VBOOT_VERSION_ALL,
+		      "Convert a recovery image into an SSD image",
+		      print_help);
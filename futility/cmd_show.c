@@ -5,26 +5,40 @@
  */
 #include <errno.h>
 #include <fcntl.h>
+#include <ftw.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
+
 #include "bmpblk_header.h"
+#include "crossystem.h"
+#include "crossystem_arch.h"
 #include "file_type.h"
 #include "fmap.h"
 #include "futility.h"
 #include "gbb_header.h"
 #include "host_common.h"
+#include "host_crypto.h"
+#include "json_writer.h"
 #include "traversal.h"
 #include "util_misc.h"
 #include "vb1_helper.h"
+#include "verify_cache.h"
 #include "vboot_common.h"
 
 /* Local values for cb_area_s._flags */
@@ -36,14 +50,355 @@ enum callback_flags {
 static struct local_data_s {
 	VbPublicKey *k;
 	uint8_t *fv;
-	uint64_t fv_size;
+	uint32_t fv_size;
 	uint32_t padding;
 	int strict;
 	int t_flag;
+	int batch;
+	int json;
+	char *cache;
+	int recheck;
+	int keys_summary;
 } option = {
 	.padding = 65536,
 };
 
+/*
+ * In --batch mode several files are mapped at once, and their firmware and
+ * kernel bodies are all hashed together by vb2_digest_multi() before any of
+ * them are shown.  Verifying a body then only has to check the signature.
+ */
+#define BATCH_FILES 16
+
+static struct batch_digest_s {
+	const uint8_t *data;
+	uint32_t size;
+	enum vb2_hash_algorithm hash_alg;
+	uint8_t digest[VB2_SHA512_DIGEST_SIZE];
+} batch_digest[2 * BATCH_FILES];
+static int batch_count;
+
+static struct batch_digest_s *batch_find(const uint8_t *data, uint64_t size,
+					 enum vb2_hash_algorithm hash_alg)
+{
+	int i;
+
+	for (i = 0; i < batch_count; i++)
+		if (batch_digest[i].data == data &&
+		    batch_digest[i].size == size &&
+		    batch_digest[i].hash_alg == hash_alg)
+			return &batch_digest[i];
+
+	return NULL;
+}
+
+/* Queue up the body that sig covers, if it's all there */
+static void batch_add(const uint8_t *data, uint64_t size,
+		      const VbSignature *sig, uint64_t algorithm)
+{
+	struct batch_digest_s *bd;
+	enum vb2_hash_algorithm hash_alg;
+
+	if (!data || algorithm >= kNumAlgorithms ||
+	    sig->data_size > size || sig->data_size > UINT32_MAX)
+		return;
+
+	hash_alg = vb2_crypto_to_hash(algorithm);
+	if (hash_alg == VB2_HASH_INVALID ||
+	    batch_find(data, sig->data_size, hash_alg) ||
+	    batch_count >= ARRAY_SIZE(batch_digest))
+		return;
+
+	bd = &batch_digest[batch_count++];
+	bd->data = data;
+	bd->size = sig->data_size;
+	bd->hash_alg = hash_alg;
+}
+
+/*
+ * Look for a keyblock followed by a preamble of at least min_size bytes.
+ * Nothing is trusted yet; this just tells us what to hash.
+ */
+static void *batch_preamble(uint8_t *buf, uint32_t len, uint32_t min_size,
+			    VbKeyBlockHeader **key_block)
+{
+	*key_block = (VbKeyBlockHeader *)buf;
+
+	if (VBOOT_SUCCESS != KeyBlockVerify(*key_block, len, NULL, 1) ||
+	    len - (*key_block)->key_block_size < min_size)
+		return NULL;
+
+	return buf + (*key_block)->key_block_size;
+}
+
+static void batch_scan_fw(uint8_t *buf, uint32_t len,
+			  const uint8_t *fv_data, uint64_t fv_size)
+{
+	VbKeyBlockHeader *key_block;
+	VbFirmwarePreambleHeader *preamble;
+
+	preamble = batch_preamble(buf, len,
+				  sizeof(VbFirmwarePreambleHeader2_0),
+				  &key_block);
+	if (preamble)
+		batch_add(fv_data, fv_size, &preamble->body_signature,
+			  key_block->data_key.algorithm);
+}
+
+static void batch_scan_bios(uint8_t *buf, uint32_t len,
+			    const struct fmap_index *index,
+			    const char *vblock_name, const char *fw_main_name)
+{
+	FmapAreaHeader *vblock = 0, *fw_main = 0;
+
+	if (!fmap_index_find(index, vblock_name, &vblock) ||
+	    !fmap_index_find(index, fw_main_name, &fw_main))
+		return;
+
+	/* The traversal ignores areas which run off the end of the file */
+	if (vblock->area_offset + vblock->area_size < vblock->area_size ||
+	    vblock->area_offset + vblock->area_size > len ||
+	    fw_main->area_offset + fw_main->area_size < fw_main->area_size ||
+	    fw_main->area_offset + fw_main->area_size > len)
+		return;
+
+	batch_scan_fw(buf + vblock->area_offset, vblock->area_size,
+		      buf + fw_main->area_offset, fw_main->area_size);
+}
+
+static void batch_scan_kernel(uint8_t *buf, uint32_t len)
+{
+	VbKeyBlockHeader *key_block;
+	VbKernelPreambleHeader *preamble;
+
+	preamble = batch_preamble(buf, len,
+				  sizeof(VbKernelPreambleHeader2_0),
+				  &key_block);
+	if (!preamble)
+		return;
+
+	/* Same place futil_cb_show_kernel_preamble() will look */
+	if (option.fv)
+		batch_add(option.fv, option.fv_size,
+			  &preamble->body_signature,
+			  key_block->data_key.algorithm);
+	else if (len > option.padding)
+		batch_add(buf + option.padding, len - option.padding,
+			  &preamble->body_signature,
+			  key_block->data_key.algorithm);
+}
+
+static void batch_scan(uint8_t *buf, uint32_t len)
+{
+	struct fmap_index index;
+
+	switch (futil_file_type_buf(buf, len)) {
+	case FILE_TYPE_BIOS_IMAGE:
+		if (0 == fmap_index_init(&index, buf, len)) {
+			batch_scan_bios(buf, len, &index,
+					"VBLOCK_A", "FW_MAIN_A");
+			batch_scan_bios(buf, len, &index,
+					"VBLOCK_B", "FW_MAIN_B");
+		}
+		fmap_index_free(&index);
+		break;
+	case FILE_TYPE_OLD_BIOS_IMAGE:
+		if (0 == fmap_index_init(&index, buf, len)) {
+			batch_scan_bios(buf, len, &index,
+					"Firmware A Key", "Firmware A Data");
+			batch_scan_bios(buf, len, &index,
+					"Firmware B Key", "Firmware B Data");
+		}
+		fmap_index_free(&index);
+		break;
+	case FILE_TYPE_FW_PREAMBLE:
+		batch_scan_fw(buf, len, option.fv, option.fv_size);
+		break;
+	case FILE_TYPE_KERN_PREAMBLE:
+		batch_scan_kernel(buf, len);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Hash everything batch_scan() found, a hash algorithm at a time */
+static void batch_hash(void)
+{
+	static const enum vb2_hash_algorithm hash_algs[] = {
+		VB2_HASH_SHA1,
+		VB2_HASH_SHA256,
+		VB2_HASH_SHA512,
+	};
+	const uint8_t *bufs[ARRAY_SIZE(batch_digest)];
+	uint32_t sizes[ARRAY_SIZE(batch_digest)];
+	uint8_t *digests[ARRAY_SIZE(batch_digest)];
+	int i, j, count;
+
+	for (i = 0; i < ARRAY_SIZE(hash_algs); i++) {
+		count = 0;
+		for (j = 0; j < batch_count; j++) {
+			if (batch_digest[j].hash_alg != hash_algs[i])
+				continue;
+			bufs[count] = batch_digest[j].data;
+			sizes[count] = batch_digest[j].size;
+			digests[count] = batch_digest[j].digest;
+			count++;
+		}
+
+		if (count && VB2_SUCCESS !=
+		    vb2_digest_multi(hash_algs[i], count, bufs, sizes, digests,
+				     VB2_SHA512_DIGEST_SIZE)) {
+			/* Let VerifyData() do these the slow way */
+			for (j = 0; j < batch_count; j++)
+				if (batch_digest[j].hash_alg == hash_algs[i])
+					batch_digest[j].data = NULL;
+		}
+	}
+}
+
+/*
+ * KeyBlockVerify() with a key, skipping the RSA if the cache says the same
+ * key block was good before. The hash must already have been checked.
+ */
+static int verify_keyblock(VbKeyBlockHeader *block, uint64_t size,
+			   const VbPublicKey *key)
+{
+	struct verify_cache_entry entry;
+	int cached = verify_cache_enabled() && block->key_block_size <= size &&
+		!verify_cache_entry(&entry, VERIFY_CACHE_KEYBLOCK,
+				    (uint8_t *)block, block->key_block_size,
+				    key);
+
+	if (cached && verify_cache_lookup(&entry))
+		return VBOOT_SUCCESS;
+
+	if (VBOOT_SUCCESS != KeyBlockVerify(block, size, key, 0))
+		return 1;
+
+	if (cached)
+		verify_cache_add(&entry);
+	return VBOOT_SUCCESS;
+}
+
+/* The same for VerifyFirmwarePreamble() and VerifyKernelPreamble() */
+static int verify_preamble(enum verify_cache_kind kind, void *preamble,
+			   uint64_t preamble_size, uint64_t size,
+			   const VbPublicKey *pubkey, const RSAPublicKey *key)
+{
+	struct verify_cache_entry entry;
+	int cached = verify_cache_enabled() && preamble_size <= size &&
+		!verify_cache_entry(&entry, kind, preamble, preamble_size,
+				    pubkey);
+	int rv;
+
+	if (cached && verify_cache_lookup(&entry))
+		return VBOOT_SUCCESS;
+
+	if (kind == VERIFY_CACHE_FW_PREAMBLE)
+		rv = VerifyFirmwarePreamble(preamble, size, key);
+	else
+		rv = VerifyKernelPreamble(preamble, size, key);
+	if (VBOOT_SUCCESS != rv)
+		return rv;
+
+	if (cached)
+		verify_cache_add(&entry);
+	return VBOOT_SUCCESS;
+}
+
+/*
+ * VerifyData(), using the digest from batch_hash() if there is one. If the
+ * cache says the same digest and signature were good before with the same
+ * key, there's no need for the RSA.
+ */
+static int verify_body(const uint8_t *data, uint64_t size,
+		       const VbSignature *sig, const VbPublicKey *pubkey,
+		       const RSAPublicKey *key,
+		       const struct batch_digest_s *prepared)
+{
+	const struct batch_digest_s *bd = NULL;
+	enum vb2_hash_algorithm hash_alg = VB2_HASH_INVALID;
+	struct verify_cache_entry entry;
+	uint8_t buf[VB2_SHA512_DIGEST_SIZE + 1024];
+	uint32_t digest_size;
+	int cached = 0;
+	int rv;
+
+	if (sig->data_size <= size && key->algorithm < kNumAlgorithms) {
+		hash_alg = vb2_crypto_to_hash(key->algorithm);
+		bd = batch_find(data, sig->data_size, hash_alg);
+		/* Or futil_cb_show_fw_prepare() may have hashed it */
+		if (!bd && prepared && prepared->data == data &&
+		    prepared->size == sig->data_size &&
+		    prepared->hash_alg == hash_alg)
+			bd = prepared;
+	}
+
+	if (!verify_cache_enabled() || hash_alg == VB2_HASH_INVALID ||
+	    sig->sig_size > sizeof(buf) - VB2_SHA512_DIGEST_SIZE) {
+		if (bd)
+			return VerifyDigest(bd->digest, sig, key);
+		return VerifyData(data, size, sig, key);
+	}
+
+	/* The entry covers the body digest and its signature */
+	digest_size = vb2_digest_size(hash_alg);
+	if (bd) {
+		memcpy(buf, bd->digest, digest_size);
+	} else {
+		if (DigestBufInto(data, sig->data_size, key->algorithm, buf,
+				  digest_size))
+			return 1;
+	}
+	memcpy(buf + digest_size, GetSignatureDataC(sig), sig->sig_size);
+	cached = !verify_cache_entry(&entry, VERIFY_CACHE_BODY, buf,
+				     digest_size + sig->sig_size, pubkey);
+	if (cached && verify_cache_lookup(&entry))
+		return 0;
+
+	rv = VerifyDigest(buf, sig, key);
+	if (!rv && cached)
+		verify_cache_add(&entry);
+	return rv;
+}
+
+/*
+ * With --json, everything shown about a file is collected here and written
+ * out as one line when the traversal is done, instead of printed as text.
+ */
+static struct json_writer json_buf;
+static struct json_writer *json;
+
+static void json_key(const char *name, VbPublicKey *pubkey)
+{
+	uint8_t digest[SHA1_DIGEST_SIZE];
+	int have_digest = !DigestBufInto((uint8_t *)pubkey + pubkey->key_offset,
+					 pubkey->key_size,
+					 SHA1_DIGEST_ALGORITHM, digest,
+					 sizeof(digest));
+
+	json_begin_object(json, name);
+	json_uint(json, "algorithm", pubkey->algorithm);
+	json_string(json, "algorithm_name",
+		    pubkey->algorithm < kNumAlgorithms ?
+		    algo_strings[pubkey->algorithm] : "(invalid)");
+	json_uint(json, "key_version", pubkey->key_version);
+	if (have_digest)
+		json_hex(json, "sha1sum", digest, SHA1_DIGEST_SIZE);
+	json_end_object(json);
+}
+
+/* In JSON, say what went wrong; otherwise print the text */
+static void show_error(const char *error, const char *format,
+		       const char *name)
+{
+	if (json)
+		json_string(json, "error", error);
+	else
+		printf(format, name);
+}
+
 static void show_key(VbPublicKey *pubkey, const char *sp)
 {
 	printf("%sAlgorithm:           %" PRIu64 " %s\n", sp, pubkey->algorithm,
@@ -58,6 +413,17 @@ static void show_key(VbPublicKey *pubkey, const char *sp)
 static void show_keyblock(VbKeyBlockHeader *key_block, const char *name,
 			  int sign_key, int good_sig)
 {
+	if (json) {
+		json_begin_object(json, "keyblock");
+		json_string(json, "signature", sign_key ?
+			    (good_sig ? "valid" : "invalid") : "ignored");
+		json_uint(json, "size", key_block->key_block_size);
+		json_uint(json, "flags", key_block->key_block_flags);
+		json_key("data_key", &key_block->data_key);
+		json_end_object(json);
+		return;
+	}
+
 	if (name)
 		printf("Key block:               %s\n", name);
 	else
@@ -89,33 +455,255 @@ static void show_keyblock(VbKeyBlockHeader *key_block, const char *name,
 	printf("\n");
 }
 
-int futil_cb_show_pubkey(struct futil_traverse_state_s *state)
+/*
+ * With --keys-summary, each file just gets a line for every key in it, with
+ * the key's sha1sum, the way vbutil_what_keys lists them. Nothing is checked
+ * beyond the keyblock hashes. The text for each file is collected here, so
+ * that files done by separate workers can still be printed in order.
+ */
+#define KEYS_TEXT_SIZE 4096
+
+struct keys_text_s {
+	int errors;
+	int done;
+	uint32_t len;
+	char text[KEYS_TEXT_SIZE];
+};
+static struct keys_text_s *keys_text;
+
+static void keys_printf(const char *format, ...)
+{
+	uint32_t room = sizeof(keys_text->text) - keys_text->len;
+	va_list ap;
+	int n;
+
+	va_start(ap, format);
+	n = vsnprintf(keys_text->text + keys_text->len, room, format, ap);
+	va_end(ap);
+
+	/* Anything that doesn't fit is lost */
+	if (n > 0)
+		keys_text->len += (uint32_t)n < room ? (uint32_t)n : room - 1;
+}
+
+/* Start a line for the [what] key in [name] */
+static void keys_label(const char *name, const char *what)
+{
+	char label[64];
+
+	snprintf(label, sizeof(label), "%s %s:", name, what);
+	keys_printf("  %-32s", label);
+}
+
+/* The sha1sum of a key and [extra], if there is one. Returns 1 if not. */
+static int keys_sha1sum(VbPublicKey *pubkey, const char *extra)
+{
+	uint8_t digest[SHA1_DIGEST_SIZE];
+	int i;
+
+	if (!pubkey ||
+	    DigestBufInto((uint8_t *)pubkey + pubkey->key_offset,
+			  pubkey->key_size, SHA1_DIGEST_ALGORITHM, digest,
+			  sizeof(digest))) {
+		keys_printf(" --invalid--\n");
+		return 1;
+	}
+
+	keys_printf(" ");
+	for (i = 0; i < SHA1_DIGEST_SIZE; i++)
+		keys_printf("%02x", digest[i]);
+	keys_printf("%s\n", extra);
+	return 0;
+}
+
+static int keys_keyblock(const char *name, VbKeyBlockHeader *key_block,
+			 uint32_t len)
+{
+	/* In the order of the KEY_BLOCK_FLAG_* bits */
+	static const char * const flag_name[] = {"!DEV", "DEV", "!REC", "REC"};
+	char extra[32] = "  (";
+	int i, n = 0;
+
+	keys_label(name, "data key");
+	if (VBOOT_SUCCESS != KeyBlockVerify(key_block, len, NULL, 1))
+		return keys_sha1sum(NULL, "");
+
+	for (i = 0; i < ARRAY_SIZE(flag_name); i++) {
+		if (!(key_block->key_block_flags & (1ULL << i)))
+			continue;
+		if (n++)
+			strcat(extra, " ");
+		strcat(extra, flag_name[i]);
+	}
+	strcat(extra, ")");
+	return keys_sha1sum(&key_block->data_key, extra);
+}
+
+/* A firmware preamble, after its keyblock, has the kernel subkey */
+static int keys_fw_preamble(const char *name, VbKeyBlockHeader *key_block,
+			    uint32_t len)
+{
+	VbFirmwarePreambleHeader *preamble;
+	uint32_t more = key_block->key_block_size;
+
+	keys_label(name, "kernel subkey");
+	if (len - more < EXPECTED_VBFIRMWAREPREAMBLEHEADER2_0_SIZE)
+		return keys_sha1sum(NULL, "");
+	preamble = (VbFirmwarePreambleHeader *)((uint8_t *)key_block + more);
+	if (preamble->preamble_size > len - more ||
+	    VerifyPublicKeyInside(preamble, preamble->preamble_size,
+				  &preamble->kernel_subkey))
+		return keys_sha1sum(NULL, "");
+	return keys_sha1sum(&preamble->kernel_subkey, "");
+}
+
+static int keys_gbb(const char *name, uint8_t *buf, uint32_t len)
+{
+	GoogleBinaryBlockHeader *gbb = (GoogleBinaryBlockHeader *)buf;
+	uint32_t maxlen = 0;
+	int retval = 0;
+
+	if (!len || !futil_valid_gbb_header(gbb, len, &maxlen) ||
+	    maxlen > len) {
+		keys_label(name, "header");
+		keys_printf(" --invalid--\n");
+		return 1;
+	}
+
+	keys_label(name, "hwid");
+	keys_printf(" %.*s\n", (int)strnlen((char *)buf + gbb->hwid_offset,
+					   gbb->hwid_size),
+		    buf + gbb->hwid_offset);
+
+	keys_label(name, "root key");
+	retval |= keys_sha1sum(PublicKeyLooksOkay(
+			(VbPublicKey *)(buf + gbb->rootkey_offset),
+			gbb->rootkey_size) ?
+		(VbPublicKey *)(buf + gbb->rootkey_offset) : NULL, "");
+
+	keys_label(name, "recovery key");
+	retval |= keys_sha1sum(PublicKeyLooksOkay(
+			(VbPublicKey *)(buf + gbb->recovery_key_offset),
+			gbb->recovery_key_size) ?
+		(VbPublicKey *)(buf + gbb->recovery_key_offset) : NULL, "");
+
+	return retval;
+}
+
+static int keys_summary(struct futil_traverse_state_s *state)
+{
+	uint8_t *buf = state->my_area->buf;
+	uint32_t len = state->my_area->len;
+	int retval;
+
+	switch (state->component) {
+	case CB_FMAP_GBB:
+	case CB_GBB:
+		return keys_gbb(state->name, buf, len);
+
+	case CB_PUBKEY:
+		keys_label(state->name, "key");
+		return keys_sha1sum(PublicKeyLooksOkay((VbPublicKey *)buf,
+						       len) ?
+				    (VbPublicKey *)buf : NULL, "");
+
+	case CB_KEYBLOCK:
+	case CB_KERN_PREAMBLE:
+		return keys_keyblock(state->name, (VbKeyBlockHeader *)buf,
+				     len);
+
+	case CB_FMAP_VBLOCK_A:
+	case CB_FMAP_VBLOCK_B:
+	case CB_FW_PREAMBLE:
+		retval = keys_keyblock(state->name, (VbKeyBlockHeader *)buf,
+				       len);
+		if (!retval)
+			retval = keys_fw_preamble(state->name,
+						  (VbKeyBlockHeader *)buf,
+						  len);
+		return retval;
+
+	default:
+		/* There aren't any keys to speak of in the rest */
+		return 0;
+	}
+}
+
+/*
+ * Each callback below is wrapped by show_component(), which gives it an
+ * object of its own in JSON and records whether it was valid.
+ */
+static int show_component(struct futil_traverse_state_s *state,
+			  const char *component,
+			  int (*show)(struct futil_traverse_state_s *state))
+{
+	int retval;
+
+	if (option.keys_summary)
+		return keys_summary(state);
+
+	if (json) {
+		json_begin_object(json, NULL);
+		json_string(json, "component", component);
+		json_string(json, "name", state->name);
+		json_uint(json, "offset", state->my_area->offset);
+		json_uint(json, "size", state->my_area->len);
+	}
+
+	retval = show(state);
+
+	if (json) {
+		json_bool(json, "valid", !retval);
+		json_end_object(json);
+	}
+
+	return retval;
+}
+
+static int show_pubkey(struct futil_traverse_state_s *state)
 {
 	VbPublicKey *pubkey = (VbPublicKey *)state->my_area->buf;
 
 	if (!PublicKeyLooksOkay(pubkey, state->my_area->len)) {
-		printf("%s looks bogus\n", state->name);
+		show_error("bogus", "%s looks bogus\n", state->name);
 		return 1;
 	}
 
-	printf("Public Key file:       %s\n", state->in_filename);
-	show_key(pubkey, "  ");
+	if (json) {
+		json_key("key", pubkey);
+	} else {
+		printf("Public Key file:       %s\n", state->in_filename);
+		show_key(pubkey, "  ");
+	}
 
 	state->my_area->_flags |= AREA_IS_VALID;
 	return 0;
 }
 
-int futil_cb_show_privkey(struct futil_traverse_state_s *state)
+int futil_cb_show_pubkey(struct futil_traverse_state_s *state)
+{
+	return show_component(state, "pubkey", show_pubkey);
+}
+
+static int show_privkey(struct futil_traverse_state_s *state)
 {
 	VbPrivateKey key;
 	int alg_okay;
 
 	key.algorithm = *(typeof(key.algorithm) *)state->my_area->buf;
-
-	printf("Private Key file:      %s\n", state->in_filename);
 	alg_okay = key.algorithm < kNumAlgorithms;
-	printf("  Algorithm:           %" PRIu64 " %s\n", key.algorithm,
-	       alg_okay ? algo_strings[key.algorithm] : "(unknown)");
+
+	if (json) {
+		json_uint(json, "algorithm", key.algorithm);
+		json_string(json, "algorithm_name",
+			    alg_okay ? algo_strings[key.algorithm] :
+			    "(unknown)");
+	} else {
+		printf("Private Key file:      %s\n", state->in_filename);
+		printf("  Algorithm:           %" PRIu64 " %s\n",
+		       key.algorithm,
+		       alg_okay ? algo_strings[key.algorithm] : "(unknown)");
+	}
 
 	if (alg_okay)
 		state->my_area->_flags |= AREA_IS_VALID;
@@ -123,7 +711,196 @@ int futil_cb_show_privkey(struct futil_traverse_state_s *state)
 	return 0;
 }
 
-int futil_cb_show_gbb(struct futil_traverse_state_s *state)
+int futil_cb_show_privkey(struct futil_traverse_state_s *state)
+{
+	return show_component(state, "privkey", show_privkey);
+}
+
+/* The counts as numbers, with hash_bytes[] indexed by VB2_HASH_* */
+static void json_crypto_stats(const VbSharedDataCryptoStats *cs)
+{
+	int i;
+
+	json_begin_object(json, "crypto_stats");
+	json_begin_array(json, "hash_bytes");
+	for (i = 0; i < VBSD_CRYPTO_STATS_HASH_ALGS; i++)
+		json_uint(json, NULL, cs->hash_bytes[i]);
+	json_end_array(json);
+	json_begin_array(json, "rsa_verifies");
+	for (i = 0; i < VBSD_CRYPTO_STATS_RSA_SIZES; i++)
+		json_uint(json, NULL, cs->rsa_verifies[i]);
+	json_end_array(json);
+	json_uint(json, "crc32_bytes", cs->crc32_bytes);
+	json_uint(json, "decompress_calls", cs->decompress_calls);
+	json_uint(json, "decompress_in_bytes", cs->decompress_in_bytes);
+	json_uint(json, "decompress_out_bytes", cs->decompress_out_bytes);
+	json_end_object(json);
+}
+
+static int show_vb_shared_data(struct futil_traverse_state_s *state)
+{
+	VbSharedDataHeader *sh = (VbSharedDataHeader *)state->my_area->buf;
+	VbSharedDataHeader *expanded = NULL;
+	char buf[VB_MAX_STRING_PROPERTY];
+
+	/* It has all the fields for its version or we wouldn't be called. */
+	if (VbSharedDataIsCompact(state->my_area->buf, state->my_area->len)) {
+		expanded = VbSharedDataExpand(state->my_area->buf,
+					      state->my_area->len, NULL);
+		if (!expanded)
+			return 1;
+		sh = expanded;
+	}
+	if (json) {
+		json_uint(json, "version", sh->struct_version);
+		json_uint(json, "struct_size", sh->struct_size);
+		json_uint(json, "data_used", sh->data_used);
+		json_uint(json, "flags", sh->flags);
+		json_uint(json, "firmware_index", sh->firmware_index);
+		if (sh->struct_version >= 2)
+			json_uint(json, "recovery_reason",
+				  sh->recovery_reason);
+		if (GetVdatLoadKernelDebug(buf, sizeof(buf), sh))
+			json_string(json, "load_kernel_debug", buf);
+		if (sh->struct_version >= 3 &&
+		    GetVdatTimestamps(buf, sizeof(buf), sh))
+			json_string(json, "timestamps", buf);
+		if (sh->struct_version >= 3 && sh->struct_size >= sizeof(*sh))
+			json_crypto_stats(&sh->crypto_stats);
+		json_bool(json, "compact", expanded != NULL);
+		state->my_area->_flags |= AREA_IS_VALID;
+		free(expanded);
+		return 0;
+	}
+
+	printf("VbSharedData:            %s\n", state->in_filename);
+	if (expanded)
+		printf("  Compact size:          0x%x\n", state->my_area->len);
+	printf("  Version:               %d\n", sh->struct_version);
+	printf("  Size:                  0x%" PRIx64 "\n", sh->struct_size);
+	printf("  Data used:             0x%" PRIx64 "\n", sh->data_used);
+	printf("  Flags:                 0x%08x\n", sh->flags);
+	printf("  Firmware index:        %d\n", sh->firmware_index);
+	if (sh->struct_version >= 2)
+		printf("  Recovery reason:       %d\n", sh->recovery_reason);
+
+	if (GetVdatLoadKernelDebug(buf, sizeof(buf), sh))
+		printf("LoadKernel() debug info:\n%s", buf);
+
+	if (sh->struct_version >= 3 &&
+	    GetVdatTimestamps(buf, sizeof(buf), sh))
+		printf("Timestamps:\n%s", buf);
+
+	if (GetVdatCryptoStats(buf, sizeof(buf), sh))
+		printf("Crypto stats:\n%s", buf);
+
+	state->my_area->_flags |= AREA_IS_VALID;
+	free(expanded);
+
+	return 0;
+}
+
+int futil_cb_show_vb_shared_data(struct futil_traverse_state_s *state)
+{
+	return show_component(state, "vb_shared_data", show_vb_shared_data);
+}
+
+/* Remember where a GBB key is, if it looks okay */
+static int gbb_key(struct futil_traverse_state_s *state, struct cb_area_s *area,
+		   uint32_t offset, uint32_t size)
+{
+	uint8_t *buf = state->my_area->buf;
+
+	if (!PublicKeyLooksOkay((VbPublicKey *)(buf + offset), size))
+		return 0;
+
+	area->offset = state->my_area->offset + offset;
+	area->buf = buf + offset;
+	area->len = size;
+	area->_flags |= AREA_IS_VALID;
+	return 1;
+}
+
+static void json_region(const char *name, uint32_t offset, uint32_t size)
+{
+	json_begin_object(json, name);
+	json_uint(json, "offset", offset);
+	json_uint(json, "size", size);
+	json_end_object(json);
+}
+
+/* The JSON version of show_gbb(), once the header has been checked */
+static int json_gbb(struct futil_traverse_state_s *state,
+		    GoogleBinaryBlockHeader *gbb, uint32_t maxlen, int retval)
+{
+	uint8_t *buf = (uint8_t *)gbb;
+	BmpBlockHeader *bmp;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	char *hwid;
+
+	json_uint(json, "major_version", gbb->major_version);
+	json_uint(json, "minor_version", gbb->minor_version);
+	json_uint(json, "flags", gbb->flags);
+	json_begin_object(json, "regions");
+	json_region("hwid", gbb->hwid_offset, gbb->hwid_size);
+	json_region("bmpfv", gbb->bmpfv_offset, gbb->bmpfv_size);
+	json_region("rootkey", gbb->rootkey_offset, gbb->rootkey_size);
+	json_region("recovery_key", gbb->recovery_key_offset,
+		    gbb->recovery_key_size);
+	json_end_object(json);
+	json_uint(json, "min_size", maxlen);
+
+	if (retval) {
+		json_string(json, "error", "invalid header");
+		return 1;
+	}
+
+	hwid = (char *)(buf + gbb->hwid_offset);
+	json_string(json, "hwid", hwid);
+	if (gbb->minor_version >= 2) {
+		json_hex(json, "hwid_digest", gbb->hwid_digest,
+			 SHA256_DIGEST_SIZE);
+		json_bool(json, "hwid_digest_valid",
+			  !DigestBufInto(buf + gbb->hwid_offset, strlen(hwid),
+					 SHA256_DIGEST_ALGORITHM, digest,
+					 sizeof(digest)) &&
+			  !memcmp(digest, gbb->hwid_digest,
+				  SHA256_DIGEST_SIZE));
+	}
+
+	if (gbb_key(state, &state->rootkey, gbb->rootkey_offset,
+		    gbb->rootkey_size))
+		json_key("root_key", (VbPublicKey *)state->rootkey.buf);
+	else
+		retval = 1;
+
+	if (gbb_key(state, &state->recovery_key, gbb->recovery_key_offset,
+		    gbb->recovery_key_size))
+		json_key("recovery_key",
+			 (VbPublicKey *)state->recovery_key.buf);
+	else
+		retval = 1;
+
+	bmp = (BmpBlockHeader *)(buf + gbb->bmpfv_offset);
+	if (0 == memcmp(bmp, BMPBLOCK_SIGNATURE, BMPBLOCK_SIGNATURE_SIZE)) {
+		json_begin_object(json, "bmpblock");
+		json_uint(json, "major_version", bmp->major_version);
+		json_uint(json, "minor_version", bmp->minor_version);
+		json_uint(json, "localizations",
+			  bmp->number_of_localizations);
+		json_uint(json, "screen_layouts",
+			  bmp->number_of_screenlayouts);
+		json_uint(json, "image_infos", bmp->number_of_imageinfos);
+		json_end_object(json);
+	}
+
+	if (!retval)
+		state->my_area->_flags |= AREA_IS_VALID;
+
+	return retval;
+}
+
+static int show_gbb(struct futil_traverse_state_s *state)
 {
 	uint8_t *buf = state->my_area->buf;
 	uint32_t len = state->my_area->len;
@@ -134,9 +911,9 @@ int futil_cb_show_gbb(struct futil_traverse_state_s *state)
 	uint32_t maxlen = 0;
 
 	if (!len) {
-		printf("GBB header:              %s <invalid>\n",
-		       state->component == CB_GBB ?
-		       state->in_filename : state->name);
+		show_error("missing", "GBB header:              %s <invalid>\n",
+			   state->component == CB_GBB ?
+			   state->in_filename : state->name);
 		return 1;
 	}
 
@@ -144,6 +921,9 @@ int futil_cb_show_gbb(struct futil_traverse_state_s *state)
 	if (!futil_valid_gbb_header(gbb, len, &maxlen))
 		retval = 1;
 
+	if (json)
+		return json_gbb(state, gbb, maxlen, retval);
+
 	printf("GBB header:              %s\n",
 	       state->component == CB_GBB ? state->in_filename : state->name);
 	printf("  Version:               %d.%d\n",
@@ -172,12 +952,8 @@ int futil_cb_show_gbb(struct futil_traverse_state_s *state)
 	print_hwid_digest(gbb, "     digest:             ", "\n");
 
 	pubkey = (VbPublicKey *)(buf + gbb->rootkey_offset);
-	if (PublicKeyLooksOkay(pubkey, gbb->rootkey_size)) {
-		state->rootkey.offset = state->my_area->offset +
-			gbb->rootkey_offset;
-		state->rootkey.buf = buf + gbb->rootkey_offset;
-		state->rootkey.len = gbb->rootkey_size;
-		state->rootkey._flags |= AREA_IS_VALID;
+	if (gbb_key(state, &state->rootkey, gbb->rootkey_offset,
+		    gbb->rootkey_size)) {
 		printf("  Root Key:\n");
 		show_key(pubkey, "    ");
 	} else {
@@ -186,12 +962,8 @@ int futil_cb_show_gbb(struct futil_traverse_state_s *state)
 	}
 
 	pubkey = (VbPublicKey *)(buf + gbb->recovery_key_offset);
-	if (PublicKeyLooksOkay(pubkey, gbb->recovery_key_size)) {
-		state->recovery_key.offset = state->my_area->offset +
-			gbb->recovery_key_offset;
-		state->recovery_key.buf = buf + gbb->recovery_key_offset;
-		state->recovery_key.len = gbb->recovery_key_size;
-		state->recovery_key._flags |= AREA_IS_VALID;
+	if (gbb_key(state, &state->recovery_key, gbb->recovery_key_offset,
+		    gbb->recovery_key_size)) {
 		printf("  Recovery Key:\n");
 		show_key(pubkey, "    ");
 	} else {
@@ -222,7 +994,12 @@ int futil_cb_show_gbb(struct futil_traverse_state_s *state)
 	return retval;
 }
 
-int futil_cb_show_keyblock(struct futil_traverse_state_s *state)
+int futil_cb_show_gbb(struct futil_traverse_state_s *state)
+{
+	return show_component(state, "gbb", show_gbb);
+}
+
+static int show_keyblock_file(struct futil_traverse_state_s *state)
 {
 	VbKeyBlockHeader *block = (VbKeyBlockHeader *)state->my_area->buf;
 	VbPublicKey *sign_key = option.k;
@@ -231,13 +1008,13 @@ int futil_cb_show_keyblock(struct futil_traverse_state_s *state)
 
 	/* Check the hash only first */
 	if (0 != KeyBlockVerify(block, state->my_area->len, NULL, 1)) {
-		printf("%s is invalid\n", state->name);
+		show_error("invalid keyblock", "%s is invalid\n", state->name);
 		return 1;
 	}
 
 	/* Check the signature if we have one */
 	if (sign_key && VBOOT_SUCCESS ==
-	    KeyBlockVerify(block, state->my_area->len, sign_key, 0))
+	    verify_keyblock(block, state->my_area->len, sign_key))
 		good_sig = 1;
 
 	if (option.strict && (!sign_key || !good_sig))
@@ -250,30 +1027,108 @@ int futil_cb_show_keyblock(struct futil_traverse_state_s *state)
 	return retval;
 }
 
-/*
- * This handles FW_MAIN_A and FW_MAIN_B while processing a BIOS image.
- *
+int futil_cb_show_keyblock(struct futil_traverse_state_s *state)
+{
+	return show_component(state, "keyblock", show_keyblock_file);
+}
+
+/*
+ * This handles FW_MAIN_A and FW_MAIN_B while processing a BIOS image.
+ *
  * The data in state->my_area is just the RW firmware blob, so there's nothing
  * useful to show about it. We'll just mark it as present so when we encounter
  * corresponding VBLOCK area, we'll have this to verify.
  */
-int futil_cb_show_fw_main(struct futil_traverse_state_s *state)
+static int show_fw_main(struct futil_traverse_state_s *state)
 {
 	if (!state->my_area->len) {
-		printf("Firmware body:           %s <invalid>\n", state->name);
+		show_error("missing", "Firmware body:           %s <invalid>\n",
+			   state->name);
 		return 1;
 	}
 
-	printf("Firmware body:           %s\n", state->name);
-	printf("  Offset:                0x%08x\n", state->my_area->offset);
-	printf("  Size:                  0x%08x\n", state->my_area->len);
+	if (!json) {
+		printf("Firmware body:           %s\n", state->name);
+		printf("  Offset:                0x%08x\n",
+		       state->my_area->offset);
+		printf("  Size:                  0x%08x\n", state->my_area->len);
+	}
 
 	state->my_area->_flags |= AREA_IS_VALID;
 
 	return 0;
 }
 
-int futil_cb_show_fw_preamble(struct futil_traverse_state_s *state)
+int futil_cb_show_fw_main(struct futil_traverse_state_s *state)
+{
+	return show_component(state, "fw_main", show_fw_main);
+}
+
+/*
+ * In a parallel traversal, this hashes the firmware body for VBLOCK_A or
+ * VBLOCK_B, so both slots are hashed at once. Nothing is trusted yet;
+ * futil_cb_show_fw_preamble() still checks all of it before using the digest.
+ */
+void futil_cb_show_fw_prepare(struct futil_traverse_state_s *state,
+			      enum futil_cb_component c)
+{
+	struct cb_area_s *area = &state->cb_area[c];
+	struct cb_area_s *fw_body_area;
+	VbKeyBlockHeader *key_block;
+	VbFirmwarePreambleHeader *preamble;
+	const VbSignature *sig;
+	struct vb2_digest_context dc;
+	struct batch_digest_s *bd;
+	enum vb2_hash_algorithm hash_alg;
+	uint8_t *fv_data = option.fv;
+	uint64_t fv_size = option.fv_size;
+
+	preamble = batch_preamble(area->buf, area->len,
+				  sizeof(VbFirmwarePreambleHeader2_0),
+				  &key_block);
+	if (!preamble || key_block->data_key.algorithm >= kNumAlgorithms)
+		return;
+
+	/* The body won't be verified at all */
+	if (preamble->header_version_minor >= 1 &&
+	    area->len - key_block->key_block_size >=
+	    sizeof(VbFirmwarePreambleHeader) &&
+	    (preamble->flags & VB_FIRMWARE_PREAMBLE_USE_RO_NORMAL))
+		return;
+
+	/* Same place futil_cb_show_fw_preamble() will look */
+	fw_body_area = &state->cb_area[c == CB_FMAP_VBLOCK_A ?
+				       CB_FMAP_FW_MAIN_A : CB_FMAP_FW_MAIN_B];
+	if (fw_body_area->len) {
+		fv_data = fw_body_area->buf;
+		fv_size = fw_body_area->len;
+	}
+
+	sig = &preamble->body_signature;
+	hash_alg = vb2_crypto_to_hash(key_block->data_key.algorithm);
+	if (!fv_data || sig->data_size > fv_size ||
+	    hash_alg == VB2_HASH_INVALID)
+		return;
+
+	bd = malloc(sizeof(*bd));
+	if (!bd)
+		return;
+	bd->data = fv_data;
+	bd->size = sig->data_size;
+	bd->hash_alg = hash_alg;
+
+	if (VB2_SUCCESS != vb2_digest_init(&dc, hash_alg) ||
+	    VB2_SUCCESS != vb2_digest_extend(&dc, fv_data, bd->size) ||
+	    VB2_SUCCESS != vb2_digest_finalize(&dc, bd->digest,
+					       sizeof(bd->digest))) {
+		free(bd);
+		return;
+	}
+
+	area->_prepared = bd;
+}
+
+static int show_fw_preamble(struct futil_traverse_state_s *state)
 {
 	VbKeyBlockHeader *key_block = (VbKeyBlockHeader *)state->my_area->buf;
 	uint32_t len = state->my_area->len;
@@ -286,7 +1141,8 @@ int futil_cb_show_fw_preamble(struct futil_traverse_state_s *state)
 
 	/* Check the hash... */
 	if (VBOOT_SUCCESS != KeyBlockVerify(key_block, len, NULL, 1)) {
-		printf("%s keyblock component is invalid\n", state->name);
+		show_error("invalid keyblock",
+			   "%s keyblock component is invalid\n", state->name);
 		return 1;
 	}
 
@@ -314,7 +1170,7 @@ int futil_cb_show_fw_preamble(struct futil_traverse_state_s *state)
 
 	/* If we have a key, check the signature too */
 	if (sign_key && VBOOT_SUCCESS ==
-	    KeyBlockVerify(key_block, len, sign_key, 0))
+	    verify_keyblock(key_block, len, sign_key))
 		good_sig = 1;
 
 	show_keyblock(key_block,
@@ -334,13 +1190,43 @@ int futil_cb_show_fw_preamble(struct futil_traverse_state_s *state)
 	VbFirmwarePreambleHeader *preamble =
 		(VbFirmwarePreambleHeader *)(state->my_area->buf + more);
 
-	if (VBOOT_SUCCESS != VerifyFirmwarePreamble(preamble,
-						    len - more, rsa)) {
-		printf("%s is invalid\n", state->name);
+	if (VBOOT_SUCCESS != verify_preamble(VERIFY_CACHE_FW_PREAMBLE,
+					     preamble, preamble->preamble_size,
+					     len - more, &key_block->data_key,
+					     rsa)) {
+		show_error("invalid preamble", "%s is invalid\n", state->name);
 		return 1;
 	}
 
 	uint32_t flags = VbGetFirmwarePreambleFlags(preamble);
+	VbPublicKey *kernel_subkey = &preamble->kernel_subkey;
+	const uint8_t *ec_rw_hash = VbGetFirmwarePreambleEcRwHash(preamble);
+	if (kernel_subkey->algorithm >= kNumAlgorithms)
+		retval = 1;
+
+	if (json) {
+		json_begin_object(json, "preamble");
+		json_uint(json, "size", preamble->preamble_size);
+		json_uint(json, "header_version_major",
+			  preamble->header_version_major);
+		json_uint(json, "header_version_minor",
+			  preamble->header_version_minor);
+		json_uint(json, "firmware_version",
+			  preamble->firmware_version);
+		json_key("kernel_subkey", kernel_subkey);
+		json_uint(json, "body_size",
+			  preamble->body_signature.data_size);
+		json_uint(json, "flags", flags);
+		if (ec_rw_hash) {
+			json_uint(json, "ec_rw_size",
+				  preamble->ec_rw_hash.data_size);
+			json_hex(json, "ec_rw_sha256sum", ec_rw_hash,
+				 SHA256_DIGEST_SIZE);
+		}
+		json_end_object(json);
+		goto check_body;
+	}
+
 	printf("Firmware Preamble:\n");
 	printf("  Size:                  %" PRIu64 "\n",
 	       preamble->preamble_size);
@@ -348,13 +1234,10 @@ int futil_cb_show_fw_preamble(struct futil_traverse_state_s *state)
 	       preamble->header_version_major, preamble->header_version_minor);
 	printf("  Firmware version:      %" PRIu64 "\n",
 	       preamble->firmware_version);
-	VbPublicKey *kernel_subkey = &preamble->kernel_subkey;
 	printf("  Kernel key algorithm:  %" PRIu64 " %s\n",
 	       kernel_subkey->algorithm,
 	       (kernel_subkey->algorithm < kNumAlgorithms ?
 		algo_strings[kernel_subkey->algorithm] : "(invalid)"));
-	if (kernel_subkey->algorithm >= kNumAlgorithms)
-		retval = 1;
 	printf("  Kernel key version:    %" PRIu64 "\n",
 	       kernel_subkey->key_version);
 	printf("  Kernel key sha1sum:    ");
@@ -363,11 +1246,23 @@ int futil_cb_show_fw_preamble(struct futil_traverse_state_s *state)
 	printf("  Firmware body size:    %" PRIu64 "\n",
 	       preamble->body_signature.data_size);
 	printf("  Preamble flags:        %" PRIu32 "\n", flags);
+	if (ec_rw_hash) {
+		int i;
+		printf("  EC-RW size:            %" PRIu64 "\n",
+		       preamble->ec_rw_hash.data_size);
+		printf("  EC-RW sha256sum:       ");
+		for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+			printf("%02x", ec_rw_hash[i]);
+		printf("\n");
+	}
 
-
+check_body:
 	if (flags & VB_FIRMWARE_PREAMBLE_USE_RO_NORMAL) {
-		printf("Preamble requests USE_RO_NORMAL;"
-		       " skipping body verification.\n");
+		if (json)
+			json_string(json, "body", "use_ro_normal");
+		else
+			printf("Preamble requests USE_RO_NORMAL;"
+			       " skipping body verification.\n");
 		goto done;
 	}
 
@@ -378,28 +1273,44 @@ int futil_cb_show_fw_preamble(struct futil_traverse_state_s *state)
 	}
 
 	if (!fv_data) {
-		printf("No firmware body available to verify.\n");
+		if (json)
+			json_string(json, "body", "unavailable");
+		else
+			printf("No firmware body available to verify.\n");
 		if (option.strict)
 			return 1;
 		return 0;
 	}
 
 	if (VBOOT_SUCCESS !=
-	    VerifyData(fv_data, fv_size, &preamble->body_signature, rsa)) {
+	    verify_body(fv_data, fv_size, &preamble->body_signature,
+			&key_block->data_key, rsa,
+			state->my_area->_prepared)) {
+		if (json)
+			json_string(json, "body", "invalid");
 		fprintf(stderr, "Error verifying firmware body.\n");
 		return 1;
 	}
 
+	if (json)
+		json_string(json, "body", "verified");
+
 done:
 	/* Can't trust the BIOS unless everything is signed,
 	 * but standalone files are okay. */
 	if ((state->component == CB_FW_PREAMBLE) ||
 	    (sign_key && good_sig)) {
-		if (!(flags & VB_FIRMWARE_PREAMBLE_USE_RO_NORMAL))
+		if (json)
+			json_bool(json, "trusted", 1);
+		else if (!(flags & VB_FIRMWARE_PREAMBLE_USE_RO_NORMAL))
 			printf("Body verification succeeded.\n");
 		state->my_area->_flags |= AREA_IS_VALID;
 	} else {
-		printf("Seems legit, but the signature is unverified.\n");
+		if (json)
+			json_bool(json, "trusted", 0);
+		else
+			printf("Seems legit, but the signature is"
+			       " unverified.\n");
 		if (option.strict)
 			retval = 1;
 	}
@@ -407,7 +1318,113 @@ done:
 	return retval;
 }
 
-int futil_cb_show_kernel_preamble(struct futil_traverse_state_s *state)
+int futil_cb_show_fw_preamble(struct futil_traverse_state_s *state)
+{
+	return show_component(state, "fw_preamble", show_fw_preamble);
+}
+
+static void json_kernel_preamble(VbKernelPreambleHeader *preamble,
+				 uint64_t vmlinuz_header_address,
+				 uint64_t vmlinuz_header_size,
+				 uint32_t flags)
+{
+	uint32_t compression;
+	uint64_t load_size;
+
+	json_begin_object(json, "preamble");
+	json_uint(json, "size", preamble->preamble_size);
+	json_uint(json, "header_version_major",
+		  preamble->header_version_major);
+	json_uint(json, "header_version_minor",
+		  preamble->header_version_minor);
+	json_uint(json, "kernel_version", preamble->kernel_version);
+	json_uint(json, "body_load_address", preamble->body_load_address);
+	json_uint(json, "body_size", preamble->body_signature.data_size);
+	json_uint(json, "bootloader_address", preamble->bootloader_address);
+	json_uint(json, "bootloader_size", preamble->bootloader_size);
+	if (vmlinuz_header_size) {
+		json_uint(json, "vmlinuz_header_address",
+			  vmlinuz_header_address);
+		json_uint(json, "vmlinuz_header_size", vmlinuz_header_size);
+	}
+	json_uint(json, "flags", flags);
+	if (VbKernelHasBodyHashes(preamble) == VBOOT_SUCCESS) {
+		json_uint(json, "body_hash_count", preamble->body_hash_count);
+		json_uint(json, "body_hash_block_size",
+			  preamble->body_hash_block_size);
+		json_uint(json, "body_hash_head_size",
+			  preamble->body_hash_head_size);
+		json_uint(json, "body_hash_tail_offset",
+			  preamble->body_hash_tail_offset);
+	}
+	VbGetKernelBodyCompression(preamble, &compression, &load_size);
+	if (compression != COMPRESS_NONE) {
+		json_uint(json, "body_compression", compression);
+		json_uint(json, "body_load_size", load_size);
+	}
+	json_end_object(json);
+}
+
+/*
+ * In a parallel traversal of a disk image, this hashes the body of one kernel
+ * partition, so all of them are hashed at once. As with the firmware, nothing
+ * is trusted yet; show_kernel_preamble() still checks all of it.
+ */
+void futil_cb_show_kernel_prepare(struct futil_traverse_state_s *state,
+				  enum futil_cb_component c)
+{
+	struct cb_area_s *area = &state->cb_area[c];
+	VbKeyBlockHeader *key_block;
+	VbKernelPreambleHeader *preamble;
+	const VbSignature *sig;
+	struct vb2_digest_context dc;
+	struct batch_digest_s *bd;
+	enum vb2_hash_algorithm hash_alg;
+	uint8_t *kernel_blob;
+	uint64_t kernel_size;
+
+	preamble = batch_preamble(area->buf, area->len,
+				  sizeof(VbKernelPreambleHeader2_0),
+				  &key_block);
+	if (!preamble || key_block->data_key.algorithm >= kNumAlgorithms)
+		return;
+
+	/* Same place show_kernel_preamble() will look */
+	if (option.fv) {
+		kernel_blob = option.fv;
+		kernel_size = option.fv_size;
+	} else if (area->len > option.padding) {
+		kernel_blob = area->buf + option.padding;
+		kernel_size = area->len - option.padding;
+	} else {
+		return;
+	}
+
+	sig = &preamble->body_signature;
+	hash_alg = vb2_crypto_to_hash(key_block->data_key.algorithm);
+	if (sig->data_size > kernel_size || sig->data_size > UINT32_MAX ||
+	    hash_alg == VB2_HASH_INVALID)
+		return;
+
+	bd = malloc(sizeof(*bd));
+	if (!bd)
+		return;
+	bd->data = kernel_blob;
+	bd->size = sig->data_size;
+	bd->hash_alg = hash_alg;
+
+	if (VB2_SUCCESS != vb2_digest_init(&dc, hash_alg) ||
+	    VB2_SUCCESS != vb2_digest_extend(&dc, kernel_blob, bd->size) ||
+	    VB2_SUCCESS != vb2_digest_finalize(&dc, bd->digest,
+					       sizeof(bd->digest))) {
+		free(bd);
+		return;
+	}
+
+	area->_prepared = bd;
+}
+
+static int show_kernel_preamble(struct futil_traverse_state_s *state)
 {
 
 	VbKeyBlockHeader *key_block = (VbKeyBlockHeader *)state->my_area->buf;
@@ -420,19 +1437,29 @@ int futil_cb_show_kernel_preamble(struct futil_traverse_state_s *state)
 	uint64_t vmlinuz_header_size = 0;
 	uint64_t vmlinuz_header_address = 0;
 	uint32_t flags = 0;
+	uint32_t compression;
+	uint64_t load_size;
+	uint8_t *loaded_blob = NULL;
+	const char *config;
 
 	/* Check the hash... */
 	if (VBOOT_SUCCESS != KeyBlockVerify(key_block, len, NULL, 1)) {
-		printf("%s keyblock component is invalid\n", state->name);
+		show_error("invalid keyblock",
+			   "%s keyblock component is invalid\n", state->name);
 		return 1;
 	}
 
 	/* If we have a key, check the signature too */
 	if (sign_key && VBOOT_SUCCESS ==
-	    KeyBlockVerify(key_block, len, sign_key, 0))
+	    verify_keyblock(key_block, len, sign_key))
 		good_sig = 1;
 
-	printf("Kernel partition:        %s\n", state->in_filename);
+	/* A disk image has several */
+	if (!json && state->in_type == FILE_TYPE_CHROMIUMOS_DISK)
+		printf("Kernel partition:        %s (%s)\n",
+		       state->in_filename, state->name);
+	else if (!json)
+		printf("Kernel partition:        %s\n", state->in_filename);
 	show_keyblock(key_block, NULL, !!sign_key, good_sig);
 
 	if (option.strict && (!sign_key || !good_sig))
@@ -447,12 +1474,31 @@ int futil_cb_show_kernel_preamble(struct futil_traverse_state_s *state)
 	VbKernelPreambleHeader *preamble =
 		(VbKernelPreambleHeader *)(state->my_area->buf + more);
 
-	if (VBOOT_SUCCESS != VerifyKernelPreamble(preamble,
-						    len - more, rsa)) {
-		printf("%s is invalid\n", state->name);
+	if (VBOOT_SUCCESS != verify_preamble(VERIFY_CACHE_KERN_PREAMBLE,
+					     preamble, preamble->preamble_size,
+					     len - more, &key_block->data_key,
+					     rsa)) {
+		show_error("invalid preamble", "%s is invalid\n", state->name);
 		return 1;
 	}
 
+	if (VbGetKernelVmlinuzHeader(preamble,
+				     &vmlinuz_header_address,
+				     &vmlinuz_header_size)
+	    != VBOOT_SUCCESS) {
+		fprintf(stderr, "Unable to retrieve Vmlinuz Header!");
+		return 1;
+	}
+
+	if (VbKernelHasFlags(preamble) == VBOOT_SUCCESS)
+		flags = preamble->flags;
+
+	if (json) {
+		json_kernel_preamble(preamble, vmlinuz_header_address,
+				     vmlinuz_header_size, flags);
+		goto check_body;
+	}
+
 	printf("Kernel Preamble:\n");
 	printf("  Size:                  0x%" PRIx64 "\n",
 	       preamble->preamble_size);
@@ -470,13 +1516,6 @@ int futil_cb_show_kernel_preamble(struct futil_traverse_state_s *state)
 	printf("  Bootloader size:       0x%" PRIx64 "\n",
 	       preamble->bootloader_size);
 
-	if (VbGetKernelVmlinuzHeader(preamble,
-				     &vmlinuz_header_address,
-				     &vmlinuz_header_size)
-	    != VBOOT_SUCCESS) {
-		fprintf(stderr, "Unable to retrieve Vmlinuz Header!");
-		return 1;
-	}
 	if (vmlinuz_header_size) {
 		printf("  Vmlinuz_header address:    0x%" PRIx64 "\n",
 		       vmlinuz_header_address);
@@ -484,10 +1523,23 @@ int futil_cb_show_kernel_preamble(struct futil_traverse_state_s *state)
 		       vmlinuz_header_size);
 	}
 
-	if (VbKernelHasFlags(preamble) == VBOOT_SUCCESS)
-		flags = preamble->flags;
 	printf("  Flags:                 0x%" PRIx32 "\n", flags);
 
+	if (VbKernelHasBodyHashes(preamble) == VBOOT_SUCCESS) {
+		printf("  Body hash blocks:      %" PRIu32 " of 0x%" PRIx32
+		       " bytes\n", preamble->body_hash_count,
+		       preamble->body_hash_block_size);
+		printf("  Checked at boot:       0x0-0x%" PRIx32 ", 0x%" PRIx32
+		       "-end\n", preamble->body_hash_head_size,
+		       preamble->body_hash_tail_offset);
+	}
+
+	VbGetKernelBodyCompression(preamble, &compression, &load_size);
+	if (compression != COMPRESS_NONE)
+		printf("  Body compression:      %" PRIu32 ", 0x%" PRIx64
+		       " bytes loaded\n", compression, load_size);
+
+check_body:
 	/* Verify kernel body */
 	if (option.fv) {
 		/* It's in a separate file, which we've already read in */
@@ -501,25 +1553,115 @@ int futil_cb_show_kernel_preamble(struct futil_traverse_state_s *state)
 
 	if (!kernel_blob) {
 		/* TODO: Is this always a failure? The preamble is okay. */
+		if (json)
+			json_string(json, "body", "unavailable");
 		fprintf(stderr, "No kernel blob available to verify.\n");
 		return 1;
 	}
 
-	if (0 != VerifyData(kernel_blob, kernel_size,
-			    &preamble->body_signature, rsa)) {
+	if (0 != verify_body(kernel_blob, kernel_size,
+			     &preamble->body_signature,
+			     &key_block->data_key, rsa,
+			     state->my_area->_prepared)) {
+		if (json)
+			json_string(json, "body", "invalid");
 		fprintf(stderr, "Error verifying kernel body.\n");
 		return 1;
 	}
 
-	printf("Body verification succeeded.\n");
+	/* The config is in the body as the firmware loads it */
+	VbGetKernelBodyCompression(preamble, &compression, &load_size);
+	if (compression != COMPRESS_NONE) {
+		if (kernel_size > preamble->body_signature.data_size)
+			kernel_size = preamble->body_signature.data_size;
+		loaded_blob = DecompressKernelBlob(preamble, kernel_blob,
+						   kernel_size);
+		if (!loaded_blob) {
+			if (json)
+				json_string(json, "body", "invalid");
+			fprintf(stderr, "Error decompressing kernel body.\n");
+			return 1;
+		}
+		kernel_blob = loaded_blob;
+	}
+	config = (char *)kernel_blob + KernelCmdLineOffset(preamble);
 
-	printf("Config:\n%s\n", kernel_blob + KernelCmdLineOffset(preamble));
+	if (json) {
+		json_string(json, "body", "verified");
+		json_string(json, "config", config);
+	} else {
+		printf("Body verification succeeded.\n");
+		printf("Config:\n%s\n", config);
+	}
 
+	free(loaded_blob);
 	return retval;
 }
 
+int futil_cb_show_kernel_preamble(struct futil_traverse_state_s *state)
+{
+	return show_component(state, "kernel_preamble", show_kernel_preamble);
+}
+
+/* List all the FMAP areas of a BIOS image */
+static void json_fmap(uint8_t *buf, uint32_t len)
+{
+	FmapHeader *fmap = fmap_find(buf, len);
+	FmapAreaHeader *ah;
+	char name[FMAP_NAMELEN + 1];
+	int i;
+
+	if (!fmap)
+		return;
+
+	ah = (FmapAreaHeader *)(fmap + 1);
+	json_begin_array(json, "fmap");
+	for (i = 0; i < fmap->fmap_nareas; i++) {
+		/* Don't look past the end of the buffer */
+		if ((uint8_t *)(ah + i + 1) > buf + len)
+			break;
+		memcpy(name, ah[i].area_name, FMAP_NAMELEN);
+		name[FMAP_NAMELEN] = '\0';
+		json_begin_object(json, NULL);
+		json_string(json, "name", name);
+		json_uint(json, "offset", ah[i].area_offset);
+		json_uint(json, "size", ah[i].area_size);
+		json_uint(json, "flags", ah[i].area_flags);
+		json_end_object(json);
+	}
+	json_end_array(json);
+}
+
 int futil_cb_show_begin(struct futil_traverse_state_s *state)
 {
+	if (option.keys_summary) {
+		keys_printf("%s: %s\n", state->in_filename,
+			    futil_file_type_str(state->in_type));
+		if (state->in_type == FILE_TYPE_UNKNOWN) {
+			fprintf(stderr, "Unable to determine type of %s\n",
+				state->in_filename);
+			return 1;
+		}
+		return 0;
+	}
+
+	if (json) {
+		json_begin_object(json, NULL);
+		json_string(json, "file", state->in_filename);
+		json_string(json, "type",
+			    futil_file_type_str(state->in_type));
+		if (state->in_type == FILE_TYPE_BIOS_IMAGE ||
+		    state->in_type == FILE_TYPE_OLD_BIOS_IMAGE)
+			json_fmap(state->my_area->buf, state->my_area->len);
+		json_begin_array(json, "components");
+		if (state->in_type == FILE_TYPE_UNKNOWN) {
+			fprintf(stderr, "Unable to determine type of %s\n",
+				state->in_filename);
+			return 1;
+		}
+		return 0;
+	}
+
 	switch (state->in_type) {
 	case FILE_TYPE_UNKNOWN:
 		fprintf(stderr, "Unable to determine type of %s\n",
@@ -531,14 +1673,37 @@ int futil_cb_show_begin(struct futil_traverse_state_s *state)
 		printf("BIOS:                    %s\n", state->in_filename);
 		break;
 
+	case FILE_TYPE_CHROMIUMOS_DISK:
+		printf("Disk image:              %s\n", state->in_filename);
+		break;
+
 	default:
 		break;
 	}
 	return 0;
 }
 
+int futil_cb_show_end(struct futil_traverse_state_s *state)
+{
+	if (!json)
+		return 0;
+
+	json_end_array(json);
+	json_bool(json, "valid", !state->errors);
+	json_end_object(json);
+	if (json_flush(json, stdout)) {
+		fprintf(stderr, "Error writing JSON for %s\n",
+			state->in_filename);
+		return 1;
+	}
+	return 0;
+}
+
 enum no_short_opts {
 	OPT_PADDING = 1000,
+	OPT_LIST,
+	OPT_VERBOSE,
+	OPT_CACHE,
 };
 
 static const char usage[] = "\n"
@@ -551,6 +1716,7 @@ static const char usage[] = "\n"
 	"  firmware preamble signature (VBLOCK_A/B)\n"
 	"  firmware image (bios.bin)\n"
 	"  kernel partition (/dev/sda2, /dev/mmcblk0p2)\n"
+	"  VbSharedData (a saved copy of VDAT)\n"
 	"\n"
 	"Options:\n"
 	"  -t                               Just show the type of each file\n"
@@ -558,6 +1724,18 @@ static const char usage[] = "\n"
 	"            Use this public key for validation\n"
 	"  -f|--fv          FILE            Verify this payload (FW_MAIN_A/B)\n"
 	"  --pad            NUM             Kernel vblock padding size\n"
+	"  --batch                          Hash the bodies of several files\n"
+	"                                     at once (faster for many files)\n"
+	"  --json                           Print one line of JSON per file\n"
+	"  --cache          FILE            Remember good signatures in FILE,\n"
+	"                                     and don't check them again\n"
+	"  --recheck                        Check everything, but still\n"
+	"                                     update the --cache\n"
+	"  --keys-summary                   Just list the sha1sums of the keys\n"
+	"                                     in each file\n"
+	"  -j|--jobs        NUM             With --keys-summary, the number of\n"
+	"                                     files done at once (default is\n"
+	"                                     the number of CPUs)\n"
 	"%s"
 	"\n";
 
@@ -578,11 +1756,17 @@ static const struct option long_opts[] = {
 	{"publickey",   1, 0, 'k'},
 	{"fv",          1, 0, 'f'},
 	{"pad",         1, NULL, OPT_PADDING},
+	{"batch",       0, &option.batch, 1},
+	{"json",        0, &option.json, 1},
+	{"cache",       1, NULL, OPT_CACHE},
+	{"recheck",     0, &option.recheck, 1},
 	{"verify",      0, &option.strict, 1},
+	{"keys-summary", 0, &option.keys_summary, 1},
+	{"jobs",        1, NULL, 'j'},
 	{"debug",       0, &debugging_enabled, 1},
 	{NULL, 0, NULL, 0},
 };
-static char *short_opts = ":f:k:t";
+static char *short_opts = ":f:j:k:t";
 
 
 static void show_type(char *filename)
@@ -611,22 +1795,173 @@ static void show_type(char *filename)
 	}
 }
 
+/* A file being shown */
+struct show_file_s {
+	char *name;
+	int fd;
+	uint8_t *buf;
+	uint32_t len;
+};
+
+/* Open and map a file. Returns the number of errors. */
+static int open_file(struct show_file_s *file, char *infile)
+{
+	file->name = infile;
+	file->buf = 0;
+	file->fd = open(infile, O_RDONLY);
+	if (file->fd < 0) {
+		fprintf(stderr, "Can't open %s: %s\n",
+			infile, strerror(errno));
+		return 1;
+	}
+
+	if (0 != futil_map_file(file->fd, MAP_RO, &file->buf, &file->len)) {
+		file->buf = 0;
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Unmap and close a file opened by open_file(). Returns the error count. */
+static int close_file(struct show_file_s *file)
+{
+	int errorcnt = 0;
+
+	if (file->fd < 0)
+		return 0;
+
+	if (file->buf)
+		errorcnt += futil_unmap_file(file->fd, MAP_RO,
+					     file->buf, file->len);
+
+	if (close(file->fd)) {
+		errorcnt++;
+		fprintf(stderr, "Error when closing %s: %s\n",
+			file->name, strerror(errno));
+	}
+
+	return errorcnt;
+}
+
+/* Shared with the --keys-summary workers */
+struct keys_shared_s {
+	int next;
+	struct keys_text_s file[];
+};
+
+static void keys_one(char *name, struct keys_text_s *text)
+{
+	struct show_file_s file;
+	struct futil_traverse_state_s state;
+
+	keys_text = text;
+	text->errors = open_file(&file, name);
+	if (file.buf) {
+		/* Not parallel; there's nothing to hash */
+		memset(&state, 0, sizeof(state));
+		state.in_filename = name;
+		state.op = FUTIL_OP_SHOW;
+		text->errors += futil_traverse(file.buf, file.len, &state,
+					       FILE_TYPE_UNKNOWN);
+	}
+	text->errors += close_file(&file);
+	text->done = 1;
+}
+
+/* Takes files from the shared counter until there aren't any left */
+static void keys_worker(struct keys_shared_s *shared, char **name, int count)
+{
+	int i;
+
+	while ((i = __sync_fetch_and_add(&shared->next, 1)) < count)
+		keys_one(name[i], &shared->file[i]);
+
+	fflush(stderr);
+}
+
+/*
+ * Like verify_tree, this forks workers that share the files to do, since the
+ * traversal keeps its state in globals. Each file's summary is printed in
+ * order once they're all done. Returns the number of errors.
+ */
+static int show_keys_summary(char **name, int count, long jobs)
+{
+	struct keys_shared_s *shared;
+	size_t shared_size;
+	pid_t *pid;
+	int errorcnt = 0;
+	int started = 0;
+	int i;
+
+	if (jobs > count)
+		jobs = count;
+
+	shared_size = sizeof(*shared) + count * sizeof(shared->file[0]);
+	shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	pid = calloc(jobs + 1, sizeof(*pid));
+	if (shared == MAP_FAILED || !pid) {
+		fprintf(stderr, "Out of memory\n");
+		if (shared != MAP_FAILED)
+			munmap(shared, shared_size);
+		free(pid);
+		return 1;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	for (i = 0; jobs > 1 && i < jobs; i++) {
+		pid[i] = fork();
+		if (pid[i] == 0) {
+			keys_worker(shared, name, count);
+			_exit(0);
+		}
+		if (pid[i] > 0)
+			started++;
+	}
+
+	/* If there aren't any workers, do it all here */
+	if (!started)
+		keys_worker(shared, name, count);
+
+	for (i = 0; i < jobs; i++)
+		if (pid[i] > 0)
+			waitpid(pid[i], NULL, 0);
+
+	for (i = 0; i < count; i++) {
+		if (!shared->file[i].done) {
+			fprintf(stderr, "Nothing shown for %s\n", name[i]);
+			errorcnt++;
+			continue;
+		}
+		fwrite(shared->file[i].text, 1, shared->file[i].len, stdout);
+		errorcnt += shared->file[i].errors;
+	}
+
+	munmap(shared, shared_size);
+	free(pid);
+	return errorcnt;
+}
+
 static int do_show(int argc, char *argv[])
 {
-	char *infile = 0;
-	int ifd, i;
+	struct show_file_s file[BATCH_FILES];
+	int i, j, nfiles;
 	int errorcnt = 0;
 	struct futil_traverse_state_s state;
-	uint8_t *buf;
-	uint32_t buf_len;
+	long jobs = futil_default_jobs();
 	char *e = 0;
 
+	vb2_host_crypto_select_env();
+
 	opterr = 0;		/* quiet, you */
 	while ((i = getopt_long(argc, argv, short_opts, long_opts, 0)) != -1) {
 		switch (i) {
 		case 'f':
-			option.fv = ReadFile(optarg, &option.fv_size);
-			if (!option.fv) {
+			if (VB2_SUCCESS != vb2_map_file(optarg, VB2_MAP_RO,
+							&option.fv,
+							&option.fv_size)) {
 				fprintf(stderr, "Error reading %s: %s\n",
 					optarg, strerror(errno));
 				errorcnt++;
@@ -642,6 +1977,14 @@ static int do_show(int argc, char *argv[])
 		case 't':
 			option.t_flag = 1;
 			break;
+		case 'j':
+			jobs = strtol(optarg, &e, 0);
+			if (!*optarg || (e && *e) || jobs < 1) {
+				fprintf(stderr,
+					"Invalid --jobs \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
 		case OPT_PADDING:
 			option.padding = strtoul(optarg, &e, 0);
 			if (!*optarg || (e && *e)) {
@@ -650,6 +1993,9 @@ static int do_show(int argc, char *argv[])
 				errorcnt++;
 			}
 			break;
+		case OPT_CACHE:
+			option.cache = optarg;
+			break;
 
 		case '?':
 			if (optopt)
@@ -687,44 +2033,70 @@ static int do_show(int argc, char *argv[])
 		goto done;
 	}
 
-	for (i = optind; i < argc; i++) {
-		infile = argv[i];
-		ifd = open(infile, O_RDONLY);
-		if (ifd < 0) {
+	if (option.keys_summary) {
+		if (option.json || option.batch) {
+			fprintf(stderr, "--keys-summary can't be used with"
+				" --json or --batch\n");
 			errorcnt++;
-			fprintf(stderr, "Can't open %s: %s\n",
-				infile, strerror(errno));
-			continue;
+		} else {
+			errorcnt += show_keys_summary(argv + optind,
+						      argc - optind, jobs);
 		}
+		goto done;
+	}
 
-		if (0 != futil_map_file(ifd, MAP_RO, &buf, &buf_len)) {
-			errorcnt++;
-			goto boo;
-		}
+	if (option.json) {
+		json_init(&json_buf);
+		json = &json_buf;
+	}
 
-		memset(&state, 0, sizeof(state));
-		state.in_filename = infile ? infile : "<none>";
-		state.op = FUTIL_OP_SHOW;
+	if (option.cache && verify_cache_open(option.cache, option.recheck)) {
+		errorcnt++;
+		goto done;
+	}
 
-		errorcnt += futil_traverse(buf, buf_len, &state,
-					   FILE_TYPE_UNKNOWN);
+	for (i = optind; i < argc; i += nfiles) {
+		nfiles = option.batch ? BATCH_FILES : 1;
+		if (nfiles > argc - i)
+			nfiles = argc - i;
 
+		for (j = 0; j < nfiles; j++)
+			errorcnt += open_file(&file[j], argv[i + j]);
 
-		errorcnt += futil_unmap_file(ifd, MAP_RO, buf, buf_len);
+		if (option.batch) {
+			batch_count = 0;
+			for (j = 0; j < nfiles; j++)
+				if (file[j].buf)
+					batch_scan(file[j].buf, file[j].len);
+			batch_hash();
+		}
 
-boo:
-		if (close(ifd)) {
-			errorcnt++;
-			fprintf(stderr, "Error when closing %s: %s\n",
-				infile, strerror(errno));
+		for (j = 0; j < nfiles; j++) {
+			if (file[j].buf) {
+				memset(&state, 0, sizeof(state));
+				state.in_filename = file[j].name;
+				state.op = FUTIL_OP_SHOW;
+				/* --batch has already hashed everything */
+				state.parallel = !option.batch;
+
+				errorcnt += futil_traverse(file[j].buf,
+							   file[j].len, &state,
+							   FILE_TYPE_UNKNOWN);
+			}
+			errorcnt += close_file(&file[j]);
 		}
 	}
 
 done:
+	verify_cache_close();
+	if (json) {
+		json_free(json);
+		json = NULL;
+	}
 	if (option.k)
 		free(option.k);
 	if (option.fv)
-		free(option.fv);
+		vb2_unmap_file(option.fv, option.fv_size, VB2_MAP_RO);
 
 	return !!errorcnt;
 }
@@ -744,3 +2116,418 @@ DECLARE_FUTIL_COMMAND(verify, do_verify,
 		      VBOOT_VERSION_ALL,
 		      "Verify the signatures of various binary components",
 		      print_help);
+
+/****************************************************************************/
+/*
+ * verify_tree checks a lot of files at once.  The show callbacks keep their
+ * state in globals and print as they go, so rather than threads it forks a
+ * pool of workers that inherit the parsed options (and -k key) and take the
+ * next file from a counter in shared memory.  The results go back to the
+ * parent in the same shared mapping, which prints a JSON summary.
+ */
+static struct tree_s {
+	char **name;
+	int count;
+	int alloc;
+} tree;
+
+/* What happened to one file */
+struct tree_result_s {
+	enum futil_file_type type;
+	int errors;
+	int done;
+	double seconds;
+};
+
+/* Shared with the workers */
+struct tree_shared_s {
+	int next;
+	struct tree_result_s result[];
+};
+
+static const char usage_tree[] = "\n"
+	"Usage:  " MYNAME " %s [OPTIONS] DIR|FILE [...]\n"
+	"\n"
+	"Verifies every file under each DIR (and each FILE) that " MYNAME "\n"
+	"recognizes, the same way as \"" MYNAME " verify\" does, using a pool\n"
+	"of worker processes.  A JSON summary with the result and time taken\n"
+	"for each file is printed on stdout.\n"
+	"\n"
+	"Options:\n"
+	"  -k|--publickey   FILE"
+	"            Use this public key for validation\n"
+	"  --pad            NUM             Kernel vblock padding size\n"
+	"  -j|--jobs        NUM             Number of workers (default is the\n"
+	"                                     number of CPUs)\n"
+	"  --list           FILE            Also verify the files named in\n"
+	"                                     FILE, one per line (- for stdin)\n"
+	"  --verbose                        Don't hide what each file shows\n"
+	"  --cache          FILE            Remember good signatures in FILE,\n"
+	"                                     and don't check them again\n"
+	"  --recheck                        Check everything, but still\n"
+	"                                     update the --cache\n"
+	"\n";
+
+static void print_help_tree(const char *prog)
+{
+	printf(usage_tree, prog);
+}
+
+static int tree_add(const char *name)
+{
+	char **n;
+
+	if (tree.count == tree.alloc) {
+		tree.alloc = tree.alloc ? 2 * tree.alloc : 256;
+		n = realloc(tree.name, tree.alloc * sizeof(*tree.name));
+		if (!n) {
+			fprintf(stderr, "Out of memory\n");
+			return 1;
+		}
+		tree.name = n;
+	}
+
+	tree.name[tree.count] = strdup(name);
+	if (!tree.name[tree.count]) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	tree.count++;
+	return 0;
+}
+
+static int tree_walk_cb(const char *fpath, const struct stat *sb,
+			int typeflag, struct FTW *ftwbuf)
+{
+	if (typeflag == FTW_F && S_ISREG(sb->st_mode))
+		return tree_add(fpath);
+	if (typeflag == FTW_DNR || typeflag == FTW_NS)
+		fprintf(stderr, "Can't read %s\n", fpath);
+	return 0;
+}
+
+/* Adds DIR recursively, or just FILE. Returns the number of errors. */
+static int tree_add_arg(const char *name)
+{
+	struct stat sb;
+
+	if (stat(name, &sb)) {
+		fprintf(stderr, "Can't stat %s: %s\n", name, strerror(errno));
+		return 1;
+	}
+
+	if (!S_ISDIR(sb.st_mode))
+		return tree_add(name);
+
+	if (nftw(name, tree_walk_cb, 32, FTW_PHYS)) {
+		fprintf(stderr, "Can't walk %s\n", name);
+		return 1;
+	}
+	return 0;
+}
+
+/* Adds each line of the list file. Returns the number of errors. */
+static int tree_add_list(const char *listfile)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	int errorcnt = 0;
+
+	fp = strcmp(listfile, "-") ? fopen(listfile, "r") : stdin;
+	if (!fp) {
+		fprintf(stderr, "Can't open %s: %s\n",
+			listfile, strerror(errno));
+		return 1;
+	}
+
+	while ((len = getline(&line, &size, fp)) > 0 && !errorcnt) {
+		if (line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (len)
+			errorcnt += tree_add_arg(line);
+	}
+
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+	return errorcnt;
+}
+
+static int tree_name_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static double tree_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Verifies one file, if it's something we know about */
+static void tree_verify_one(const char *name, struct tree_result_s *result)
+{
+	struct show_file_s file;
+	struct futil_traverse_state_s state;
+	double start = tree_now();
+
+	result->type = FILE_TYPE_UNKNOWN;
+	result->errors = open_file(&file, (char *)name);
+	if (file.buf) {
+		result->type = futil_file_type_buf(file.buf, file.len);
+		if (result->type != FILE_TYPE_UNKNOWN) {
+			memset(&state, 0, sizeof(state));
+			state.in_filename = name;
+			state.op = FUTIL_OP_SHOW;
+			state.parallel = 1;
+			result->errors += futil_traverse(file.buf, file.len,
+							 &state,
+							 result->type);
+		}
+	}
+	result->errors += close_file(&file);
+	result->seconds = tree_now() - start;
+	result->done = 1;
+}
+
+/* Takes files from the shared counter until there aren't any left */
+static void tree_worker(struct tree_shared_s *shared, int verbose)
+{
+	int devnull;
+	int i;
+
+	if (!verbose) {
+		fflush(stdout);
+		fflush(stderr);
+		devnull = open("/dev/null", O_WRONLY);
+		if (devnull >= 0) {
+			dup2(devnull, STDOUT_FILENO);
+			dup2(devnull, STDERR_FILENO);
+			close(devnull);
+		}
+	}
+
+	while ((i = __sync_fetch_and_add(&shared->next, 1)) < tree.count)
+		tree_verify_one(tree.name[i], &shared->result[i]);
+
+	fflush(stdout);
+}
+
+static void tree_json_string(FILE *fp, const char *str)
+{
+	const unsigned char *s;
+
+	fputc('"', fp);
+	for (s = (const unsigned char *)str; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(fp, "\\%c", *s);
+		else if (*s < 0x20)
+			fprintf(fp, "\\u%04x", *s);
+		else
+			fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+static const struct option long_opts_tree[] = {
+	/* name    hasarg *flag val */
+	{"publickey",   1, 0, 'k'},
+	{"pad",         1, NULL, OPT_PADDING},
+	{"jobs",        1, NULL, 'j'},
+	{"list",        1, NULL, OPT_LIST},
+	{"verbose",     0, NULL, OPT_VERBOSE},
+	{"cache",       1, NULL, OPT_CACHE},
+	{"recheck",     0, &option.recheck, 1},
+	{"debug",       0, &debugging_enabled, 1},
+	{NULL, 0, NULL, 0},
+};
+
+static int do_verify_tree(int argc, char *argv[])
+{
+	struct tree_shared_s *shared;
+	size_t shared_size;
+	pid_t *pid;
+	FILE *out;
+	long jobs = futil_default_jobs();
+	int verbose = 0;
+	int passed = 0, failed = 0, skipped = 0;
+	int errorcnt = 0;
+	int started = 0;
+	double start;
+	char *e = 0;
+	int i;
+
+	vb2_host_crypto_select_env();
+
+	opterr = 0;		/* quiet, you */
+	while ((i = getopt_long(argc, argv, ":j:k:", long_opts_tree,
+				0)) != -1) {
+		switch (i) {
+		case 'k':
+			option.k = PublicKeyRead(optarg);
+			if (!option.k) {
+				fprintf(stderr, "Error reading %s\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case 'j':
+			jobs = strtol(optarg, &e, 0);
+			if (!*optarg || (e && *e) || jobs < 1) {
+				fprintf(stderr,
+					"Invalid --jobs \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_PADDING:
+			option.padding = strtoul(optarg, &e, 0);
+			if (!*optarg || (e && *e)) {
+				fprintf(stderr,
+					"Invalid --padding \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_CACHE:
+			option.cache = optarg;
+			break;
+		case OPT_LIST:
+			errorcnt += tree_add_list(optarg);
+			break;
+		case OPT_VERBOSE:
+			verbose = 1;
+			break;
+
+		case '?':
+			if (optopt)
+				fprintf(stderr, "Unrecognized option: -%c\n",
+					optopt);
+			else
+				fprintf(stderr, "Unrecognized option\n");
+			errorcnt++;
+			break;
+		case ':':
+			fprintf(stderr, "Missing argument to -%c\n", optopt);
+			errorcnt++;
+			break;
+		case 0:				/* handled option */
+			break;
+		default:
+			DIE;
+		}
+	}
+
+	for (i = optind; i < argc && !errorcnt; i++)
+		errorcnt += tree_add_arg(argv[i]);
+
+	if (errorcnt) {
+		print_help_tree(argv[0]);
+		return 1;
+	}
+
+	if (!tree.count && argc - optind < 1) {
+		fprintf(stderr, "ERROR: missing input directory\n");
+		print_help_tree(argv[0]);
+		return 1;
+	}
+
+	qsort(tree.name, tree.count, sizeof(*tree.name), tree_name_cmp);
+
+	/* The workers share the file, and whatever was in it already */
+	if (option.cache && verify_cache_open(option.cache, option.recheck))
+		return 1;
+
+	/* Same as futility verify */
+	option.strict = 1;
+
+	if (jobs > tree.count)
+		jobs = tree.count;
+
+	shared_size = sizeof(*shared) + tree.count * sizeof(shared->result[0]);
+	shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	pid = calloc(jobs + 1, sizeof(*pid));
+	if (shared == MAP_FAILED || !pid) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	/* Keep the real stdout for the summary; the workers may hide theirs */
+	fflush(stdout);
+	fflush(stderr);
+	out = fdopen(dup(STDOUT_FILENO), "w");
+	if (!out) {
+		fprintf(stderr, "Can't dup stdout: %s\n", strerror(errno));
+		return 1;
+	}
+
+	start = tree_now();
+	for (i = 0; i < jobs; i++) {
+		pid[i] = fork();
+		if (pid[i] == 0) {
+			fclose(out);
+			tree_worker(shared, verbose);
+			_exit(0);
+		}
+		if (pid[i] > 0)
+			started++;
+	}
+
+	/* If there aren't any workers, do it all here */
+	if (!started && tree.count)
+		tree_worker(shared, verbose);
+
+	for (i = 0; i < jobs; i++)
+		if (pid[i] > 0)
+			waitpid(pid[i], NULL, 0);
+
+	fprintf(out, "{\n  \"files\": [");
+	for (i = 0; i < tree.count; i++) {
+		struct tree_result_s *r = &shared->result[i];
+		const char *result;
+
+		if (r->done && r->type == FILE_TYPE_UNKNOWN && !r->errors) {
+			skipped++;
+			continue;
+		}
+		if (r->done && !r->errors) {
+			result = "pass";
+			passed++;
+		} else {
+			result = r->done ? "fail" : "crash";
+			failed++;
+		}
+
+		fprintf(out, "%s\n    {\"name\": ",
+			passed + failed > 1 ? "," : "");
+		tree_json_string(out, tree.name[i]);
+		fprintf(out, ", \"type\": \"%s\", \"result\": \"%s\","
+			" \"seconds\": %.6f}", futil_file_type_str(r->type),
+			result, r->seconds);
+	}
+	fprintf(out, "\n  ],\n");
+	fprintf(out, "  \"summary\": {\"files\": %d, \"passed\": %d,"
+		" \"failed\": %d, \"skipped\": %d, \"jobs\": %d,"
+		" \"seconds\": %.6f}\n}\n", tree.count, passed, failed,
+		skipped, started ? started : 1, tree_now() - start);
+	if (fclose(out))
+		failed++;
+
+	verify_cache_close();
+	munmap(shared, shared_size);
+	free(pid);
+	for (i = 0; i < tree.count; i++)
+		free(tree.name[i]);
+	free(tree.name);
+	if (option.k)
+		free(option.k);
+
+	return !!failed;
+}
+
+DECLARE_FUTIL_COMMAND(verify_tree, do_verify_tree,
+		      VBOOT_VERSION_ALL,
+		      "Verify all the binary components in directory trees",
+		      print_help_tree);
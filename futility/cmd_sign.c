@@ -15,6 +15,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "bmpblk_header.h"
@@ -32,6 +33,7 @@
 /* Local values for cb_area_s._flags */
 enum callback_flags {
 	AREA_IS_VALID =     0x00000001,
+	AREA_IS_COMPRESSED = 0x00000002,
 };
 
 /* Local structure for args, etc. */
@@ -45,6 +47,8 @@ static struct local_data_s {
 	int version_specified;
 	uint32_t flags;
 	int flags_specified;
+	VbSignature *ec_rw_hash;
+	int ec_rw_hash_specified;
 	char *loemdir;
 	char *loemid;
 	uint8_t *bootloader_data;
@@ -55,6 +59,9 @@ static struct local_data_s {
 	int fv_specified;
 	uint32_t kloadaddr;
 	uint32_t padding;
+	uint32_t hash_block_size;
+	int hash_block_size_specified;
+	int compress;
 	int vblockonly;
 	char *outfile;
 	int create_new_outfile;
@@ -62,6 +69,7 @@ static struct local_data_s {
 	int pem_algo_specified;
 	uint32_t pem_algo;
 	char *pem_external;
+	uint32_t disk_partition;
 } option = {
 	.version = 1,
 	.arch = ARCH_UNSPECIFIED,
@@ -69,6 +77,147 @@ static struct local_data_s {
 	.padding = 65536,
 };
 
+/* The PEM signing key, once futil_cb_sign_pubkey() has read it */
+static VbPrivateKey *pem_signprivate;
+
+/*
+ * A kernel partition resigned in place isn't mapped, which would read all of
+ * it through the page cache to change its first few sectors. It's read as
+ * far as it's needed instead, with O_DIRECT if it's a block device, and only
+ * the blocks which change are written back.
+ */
+
+/* Good enough alignment for O_DIRECT on any disk */
+#define DIRECT_ALIGN 4096
+
+/* Biggest single read of the kernel body */
+#define KPART_READ_CHUNK (1 << 20)
+
+struct kpart_file {
+	int fd;
+	const char *name;
+	uint8_t *buf;		/* aligned for O_DIRECT */
+	uint8_t *orig;		/* the same, as it was read */
+	uint64_t size;
+	uint64_t len;		/* how much has been read */
+};
+
+/* The one being resigned, if any */
+static struct kpart_file *kpart_file;
+
+/* Turn off O_DIRECT. Returns nonzero if it was on, so it's worth a retry. */
+static int kpart_no_direct(struct kpart_file *kf)
+{
+#ifdef O_DIRECT
+	int flags = fcntl(kf->fd, F_GETFL);
+
+	if (flags >= 0 && (flags & O_DIRECT) &&
+	    !fcntl(kf->fd, F_SETFL, flags & ~O_DIRECT))
+		return 1;
+#endif
+	return 0;
+}
+
+/* Read the partition up to at least |end|. Returns nonzero on error. */
+static int kpart_read(struct kpart_file *kf, uint64_t end)
+{
+	ssize_t got;
+	size_t want;
+
+	if (end > kf->size) {
+		fprintf(stderr, "The kernel blob runs past the end of %s\n",
+			kf->name);
+		return 1;
+	}
+	end = (end + DIRECT_ALIGN - 1) & ~(uint64_t)(DIRECT_ALIGN - 1);
+	if (end > kf->size)
+		end = kf->size;
+	if (kf->len >= end)
+		return 0;
+
+	while (kf->len < end) {
+		want = end - kf->len;
+		if (want > KPART_READ_CHUNK)
+			want = KPART_READ_CHUNK;
+		got = pread(kf->fd, kf->buf + kf->len, want, kf->len);
+		if (got < 0 && (errno == EINTR ||
+				(errno == EINVAL && kpart_no_direct(kf))))
+			continue;
+		if (got <= 0) {
+			fprintf(stderr, "Can't read %s: %s\n", kf->name,
+				got ? strerror(errno) : "unexpected EOF");
+			return 1;
+		}
+		memcpy(kf->orig + kf->len, kf->buf + kf->len, got);
+		kf->len += got;
+	}
+
+	Debug("%s: read 0x%" PRIx64 " bytes\n", kf->name, kf->len);
+	return 0;
+}
+
+/* Where the block at |pos| ends, in what's been read */
+static uint64_t kpart_block_end(const struct kpart_file *kf, uint64_t pos)
+{
+	return kf->len - pos > DIRECT_ALIGN ? pos + DIRECT_ALIGN : kf->len;
+}
+
+static int kpart_block_changed(const struct kpart_file *kf, uint64_t pos)
+{
+	return memcmp(kf->buf + pos, kf->orig + pos,
+		      kpart_block_end(kf, pos) - pos);
+}
+
+/* Write back the blocks which changed. Returns nonzero on error. */
+static int kpart_write(struct kpart_file *kf)
+{
+	uint64_t start = 0, end;
+	ssize_t done;
+
+	while (start < kf->len) {
+		if (!kpart_block_changed(kf, start)) {
+			start = kpart_block_end(kf, start);
+			continue;
+		}
+		end = start;
+		while (end < kf->len && kpart_block_changed(kf, end))
+			end = kpart_block_end(kf, end);
+		Debug("%s: write 0x%" PRIx64 " bytes at 0x%" PRIx64 "\n",
+		      kf->name, end - start, start);
+
+		while (start < end) {
+			done = pwrite(kf->fd, kf->buf + start, end - start,
+				      start);
+			if (done < 0 && (errno == EINTR ||
+					 (errno == EINVAL &&
+					  kpart_no_direct(kf))))
+				continue;
+			if (done <= 0) {
+				fprintf(stderr, "Can't write %s: %s\n",
+					kf->name, strerror(errno));
+				return 1;
+			}
+			start += done;
+		}
+	}
+
+	if (fsync(kf->fd)) {
+		fprintf(stderr, "Can't sync %s: %s\n", kf->name,
+			strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+/* Read the rest of the kernel partition being resigned, if that's what it is */
+static int read_kernel_body(const uint8_t *kblob_data, uint64_t kblob_size)
+{
+	if (!kpart_file)
+		return 0;
+	return kpart_read(kpart_file,
+			  kblob_data - kpart_file->buf + kblob_size);
+}
+
 
 /* Helper to complain about invalid args. Returns num errors discovered */
 static int no_opt_if(int expr, const char *optname)
@@ -95,15 +244,17 @@ int futil_cb_sign_pubkey(struct futil_traverse_state_s *state)
 				option.pem_algo, option.flags,
 				option.pem_external);
 		} else {
-			option.signprivate = PrivateKeyReadPem(
-				option.pem_signpriv, option.pem_algo);
-			if (!option.signprivate) {
+			/* Only read it once, however many keys we sign */
+			if (!pem_signprivate)
+				pem_signprivate = PrivateKeyReadPem(
+					option.pem_signpriv, option.pem_algo);
+			if (!pem_signprivate) {
 				fprintf(stderr,
 					"Unable to read PEM signing key: %s\n",
 					strerror(errno));
 				return 1;
 			}
-			vblock = KeyBlockCreate(data_key, option.signprivate,
+			vblock = KeyBlockCreate(data_key, pem_signprivate,
 						option.flags);
 		}
 	} else {
@@ -171,6 +322,18 @@ int futil_cb_sign_fw_vblock(struct futil_traverse_state_s *state)
 		/* Preserve the flags if they're not specified */
 		if (!option.flags_specified)
 			option.flags = preamble->flags;
+		/* Likewise the EC-RW hash */
+		if (!option.ec_rw_hash_specified) {
+			free(option.ec_rw_hash);
+			option.ec_rw_hash = NULL;
+			if (VbGetFirmwarePreambleEcRwHash(preamble)) {
+				option.ec_rw_hash = SignatureAlloc(
+					preamble->ec_rw_hash.sig_size, 0);
+				if (option.ec_rw_hash)
+					SignatureCopy(option.ec_rw_hash,
+						      &preamble->ec_rw_hash);
+			}
+		}
 		break;
 	case CB_FMAP_VBLOCK_B:
 		fw_body_area = &state->cb_area[CB_FMAP_FW_MAIN_B];
@@ -188,6 +351,8 @@ int futil_cb_sign_fw_vblock(struct futil_traverse_state_s *state)
 
 	/* Update the firmware size */
 	fw_body_area->len = fw_size;
+	if (preamble->flags & VB_FIRMWARE_PREAMBLE_BODY_COMPRESSED)
+		fw_body_area->_flags |= AREA_IS_COMPRESSED;
 
 whatever:
 	state->my_area->_flags |= AREA_IS_VALID;
@@ -195,15 +360,83 @@ whatever:
 	return 0;
 }
 
+/*
+ * Without body hashes the blob is never laid out in one buffer: the kernel is
+ * hashed and written straight from the vmlinuz file, followed by the rest.
+ */
+static int create_kernel_part_in_parts(uint8_t *vmlinuz_data,
+				       uint64_t vmlinuz_size)
+{
+	uint8_t *kernel_data, *tail_data, *vblock_data;
+	uint64_t kernel_size, tail_size, vblock_size;
+	int rv;
+
+	tail_data = CreateKernelBlobTail(
+		vmlinuz_data, vmlinuz_size,
+		option.arch, option.kloadaddr,
+		option.config_data, option.config_size,
+		option.bootloader_data, option.bootloader_size,
+		&kernel_data, &kernel_size, &tail_size);
+	if (!tail_data) {
+		fprintf(stderr, "Unable to create kernel blob\n");
+		return 1;
+	}
+	Debug("kernel_size = 0x%" PRIx64 ", tail_size = 0x%" PRIx64 "\n",
+	      kernel_size, tail_size);
+
+	vblock_data = SignKernelParts(kernel_data, kernel_size,
+				      tail_data, tail_size, option.padding,
+				      option.version, option.kloadaddr,
+				      option.keyblock, option.signprivate,
+				      option.flags, &vblock_size);
+	if (!vblock_data) {
+		fprintf(stderr, "Unable to sign kernel blob\n");
+		free(tail_data);
+		return 1;
+	}
+	Debug("vblock_size = 0x%" PRIx64 "\n", vblock_size);
+
+	if (option.vblockonly)
+		rv = WriteKPart(option.outfile,
+				vblock_data, vblock_size,
+				NULL, 0);
+	else
+		rv = WriteKernelParts(option.outfile,
+				      vblock_data, vblock_size,
+				      kernel_data, kernel_size,
+				      tail_data, tail_size);
+
+	free(vblock_data);
+	free(tail_data);
+	return rv;
+}
+
 int futil_cb_create_kernel_part(struct futil_traverse_state_s *state)
 {
 	uint8_t *vmlinuz_data, *kblob_data, *vblock_data;
 	uint64_t vmlinuz_size, kblob_size, vblock_size;
+	uint8_t *zblob_data;
+	uint64_t zblob_size;
 	int rv;
 
 	vmlinuz_data = state->my_area->buf;
 	vmlinuz_size = state->my_area->len;
 
+	/* We should be creating a completely new output file.
+	 * If not, something's wrong. */
+	if (!option.create_new_outfile)
+		DIE;
+
+	/* The firmware can't check blocks of what it hasn't decompressed */
+	if (option.compress && option.hash_block_size) {
+		fprintf(stderr, "Can't use --compress with --hashblock\n");
+		return 1;
+	}
+
+	/* Body hashes and compression need the blob as laid out */
+	if (!option.hash_block_size && !option.compress)
+		return create_kernel_part_in_parts(vmlinuz_data, vmlinuz_size);
+
 	kblob_data = CreateKernelBlob(
 		vmlinuz_data, vmlinuz_size,
 		option.arch, option.kloadaddr,
@@ -216,10 +449,25 @@ int futil_cb_create_kernel_part(struct futil_traverse_state_s *state)
 	}
 	Debug("kblob_size = 0x%" PRIx64 "\n", kblob_size);
 
+	/* What's signed and written is the compressed blob */
+	if (option.compress) {
+		zblob_data = CompressKernelBlob(kblob_data, kblob_size,
+						&zblob_size);
+		free(kblob_data);
+		if (!zblob_data) {
+			fprintf(stderr, "Unable to compress kernel blob\n");
+			return 1;
+		}
+		kblob_data = zblob_data;
+		kblob_size = zblob_size;
+		Debug("compressed kblob_size = 0x%" PRIx64 "\n", kblob_size);
+	}
+
 	vblock_data = SignKernelBlob(kblob_data, kblob_size, option.padding,
 				     option.version, option.kloadaddr,
 				     option.keyblock, option.signprivate,
-				     option.flags, &vblock_size);
+				     option.flags, option.hash_block_size,
+				     &vblock_size);
 	if (!vblock_data) {
 		fprintf(stderr, "Unable to sign kernel blob\n");
 		free(kblob_data);
@@ -227,19 +475,14 @@ int futil_cb_create_kernel_part(struct futil_traverse_state_s *state)
 	}
 	Debug("vblock_size = 0x%" PRIx64 "\n", vblock_size);
 
-	/* We should be creating a completely new output file.
-	 * If not, something's wrong. */
-	if (!option.create_new_outfile)
-		DIE;
-
 	if (option.vblockonly)
-		rv = WriteSomeParts(option.outfile,
-				    vblock_data, vblock_size,
-				    NULL, 0);
+		rv = WriteKPart(option.outfile,
+				vblock_data, vblock_size,
+				NULL, 0);
 	else
-		rv = WriteSomeParts(option.outfile,
-				    vblock_data, vblock_size,
-				    kblob_data, kblob_size);
+		rv = WriteKPart(option.outfile,
+				vblock_data, vblock_size,
+				kblob_data, kblob_size);
 
 	free(vblock_data);
 	free(kblob_data);
@@ -248,12 +491,22 @@ int futil_cb_create_kernel_part(struct futil_traverse_state_s *state)
 
 int futil_cb_resign_kernel_part(struct futil_traverse_state_s *state)
 {
-	uint8_t *kpart_data, *kblob_data, *vblock_data;
+	uint8_t *kpart_data, *kblob_data, *vblock_data = NULL;
 	uint64_t kpart_size, kblob_size, vblock_size;
-	VbKeyBlockHeader *keyblock = NULL;
+	VbKeyBlockHeader *keyblock = NULL, *old_keyblock;
 	VbKernelPreambleHeader *preamble = NULL;
+	uint64_t kloadaddr;
+	uint32_t version = option.version;
+	uint32_t flags = option.flags;
+	uint32_t hash_block_size = option.hash_block_size;
 	int rv = 0;
 
+	/*
+	 * The kernels on a disk image are resigned side by side, so this
+	 * mustn't change the options; what it keeps from the old preamble
+	 * stays in locals.
+	 */
+
 	kpart_data = state->my_area->buf;
 	kpart_size = state->my_area->len;
 
@@ -273,7 +526,10 @@ int futil_cb_resign_kernel_part(struct futil_traverse_state_s *state)
 	 * it here either. To enable it, we'd need to update the zeropage
 	 * table's cmd_line_ptr as well as the preamble.
 	 */
-	option.kloadaddr = preamble->body_load_address;
+	kloadaddr = preamble->body_load_address;
+
+	if (option.config_data && read_kernel_body(kblob_data, kblob_size))
+		return 1;
 
 	/* Replace the config if asked */
 	if (option.config_data &&
@@ -286,23 +542,71 @@ int futil_cb_resign_kernel_part(struct futil_traverse_state_s *state)
 
 	/* Preserve the version unless a new one is given */
 	if (!option.version_specified)
-		option.version = preamble->kernel_version;
+		version = preamble->kernel_version;
 
 	/* Preserve the flags if not specified */
 	if (VbKernelHasFlags(preamble) == VBOOT_SUCCESS) {
 		if (option.flags_specified == 0)
-			option.flags = preamble->flags;
+			flags = preamble->flags;
+	}
+
+	/* Likewise the body hash block size */
+	if (VbKernelHasBodyHashes(preamble) == VBOOT_SUCCESS) {
+		if (option.hash_block_size_specified == 0)
+			hash_block_size = preamble->body_hash_block_size;
 	}
 
 	/* Replace the keyblock if asked */
+	old_keyblock = keyblock;
 	if (option.keyblock)
 		keyblock = option.keyblock;
 
-	/* Compute the new signature */
-	vblock_data = SignKernelBlob(kblob_data, kblob_size, option.padding,
-				     option.version, option.kloadaddr,
-				     keyblock, option.signprivate,
-				     option.flags, &vblock_size);
+	/* If the body is unchanged, sign its old digest without rehashing */
+	if (!option.config_data && !hash_block_size)
+		vblock_data = ResignKernelBlob(old_keyblock, preamble,
+					       option.padding, version,
+					       kloadaddr, keyblock,
+					       option.signprivate, flags,
+					       &vblock_size);
+
+	if (!vblock_data && read_kernel_body(kblob_data, kblob_size))
+		return 1;
+
+	/*
+	 * Otherwise compute the new signature. When modifying the file in
+	 * place, build the new vblock right where the old one is, if it's the
+	 * same size; the old one's no longer needed.
+	 */
+	vblock_size = kblob_data - kpart_data;
+	if (!vblock_data && !option.create_new_outfile &&
+	    vblock_size == KernelVblockSize(kblob_size, option.padding,
+					    keyblock, option.signprivate,
+					    hash_block_size)) {
+		/* The padding isn't written, so clear what the old one used */
+		uint64_t old_used = KernelVblockUsedSize(kpart_data,
+							 vblock_size);
+		uint64_t new_used;
+
+		if (SignKernelBlobInto(kpart_data, vblock_size, kblob_data,
+				       kblob_size, option.padding, version,
+				       kloadaddr, keyblock,
+				       option.signprivate, flags,
+				       hash_block_size)) {
+			fprintf(stderr, "Unable to sign kernel blob\n");
+			return 1;
+		}
+		new_used = KernelVblockUsedSize(kpart_data, vblock_size);
+		if (old_used > new_used)
+			Memset(kpart_data + new_used, 0, old_used - new_used);
+		Debug("vblock_size = 0x%" PRIx64 ", in place\n", vblock_size);
+		return 0;
+	}
+	if (!vblock_data)
+		vblock_data = SignKernelBlob(kblob_data, kblob_size,
+					     option.padding, version,
+					     kloadaddr, keyblock,
+					     option.signprivate, flags,
+					     hash_block_size, &vblock_size);
 	if (!vblock_data) {
 		fprintf(stderr, "Unable to sign kernel blob\n");
 		return 1;
@@ -312,18 +616,20 @@ int futil_cb_resign_kernel_part(struct futil_traverse_state_s *state)
 	if (option.create_new_outfile) {
 		/* Write out what we've been asked for */
 		if (option.vblockonly)
-			rv = WriteSomeParts(option.outfile,
-					    vblock_data, vblock_size,
-					    NULL, 0);
+			rv = WriteKPart(option.outfile,
+					vblock_data, vblock_size,
+					NULL, 0);
 		else
-			rv = WriteSomeParts(option.outfile,
-					    vblock_data, vblock_size,
-					    kblob_data, kblob_size);
+			rv = WriteKPart(option.outfile,
+					vblock_data, vblock_size,
+					kblob_data, kblob_size);
 	} else {
-		/* If we're modifying an existing file, it's mmap'ed so that
-		 * all our modifications to the buffer will get flushed to
-		 * disk when we close it. */
-		Memcpy(kpart_data, vblock_data, vblock_size);
+		/* If we're modifying an existing file, whatever we change in
+		 * the buffer gets written back when we're done. Only as much
+		 * of the padding as the old vblock used is touched. */
+		Memcpy(kpart_data, vblock_data,
+		       VblockOverwriteSize(kpart_data, vblock_data,
+					   vblock_size));
 	}
 
 	free(vblock_data);
@@ -348,7 +654,8 @@ int futil_cb_sign_raw_firmware(struct futil_traverse_state_s *state)
 					  option.kernel_subkey,
 					  body_sig,
 					  option.signprivate,
-					  option.flags);
+					  option.flags,
+					  option.ec_rw_hash);
 	if (!preamble) {
 		fprintf(stderr, "Error creating firmware preamble.\n");
 		free(body_sig);
@@ -395,7 +702,8 @@ static int write_new_preamble(struct cb_area_s *vblock,
 					  option.kernel_subkey,
 					  body_sig,
 					  signkey,
-					  option.flags);
+					  option.flags,
+					  option.ec_rw_hash);
 	if (!preamble) {
 		fprintf(stderr, "Error creating firmware preamble.\n");
 		free(body_sig);
@@ -404,6 +712,12 @@ static int write_new_preamble(struct cb_area_s *vblock,
 
 	/* Write the new keyblock */
 	uint32_t more = keyblock->key_block_size;
+	if (more + preamble->preamble_size > vblock->len) {
+		fprintf(stderr, "New keyblock and preamble don't fit\n");
+		free(preamble);
+		free(body_sig);
+		return 1;
+	}
 	memcpy(vblock->buf, keyblock, more);
 	/* and the new preamble */
 	memcpy(vblock->buf + more, preamble, preamble->preamble_size);
@@ -414,6 +728,65 @@ static int write_new_preamble(struct cb_area_s *vblock,
 	return 0;
 }
 
+/*
+ * Compress the firmware bodies in place, so they're signed as they're stored.
+ * Both are compressed before either is written, so a body which doesn't fit
+ * leaves the image as it was.
+ */
+static int compress_fw_bodies(struct cb_area_s *fw_a, struct cb_area_s *fw_b)
+{
+	struct cb_area_s *fw[2] = {fw_a, fw_b};
+	uint8_t *zbuf[2] = {NULL, NULL};
+	uint64_t zsize[2];
+	int retval = 0;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (fw[i]->_flags & AREA_IS_COMPRESSED)
+			continue;
+		zbuf[i] = CompressBody(fw[i]->buf, fw[i]->len, &zsize[i]);
+		if (!zbuf[i]) {
+			fprintf(stderr, "Unable to compress FW_MAIN_%c\n",
+				'A' + i);
+			retval = 1;
+		} else if (zsize[i] > fw[i]->len) {
+			fprintf(stderr, "FW_MAIN_%c doesn't get any smaller\n",
+				'A' + i);
+			retval = 1;
+		}
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (!retval && zbuf[i]) {
+			memcpy(fw[i]->buf, zbuf[i], zsize[i]);
+			memset(fw[i]->buf + zsize[i], 0xff,
+			       fw[i]->len - zsize[i]);
+			fw[i]->len = zsize[i];
+			fw[i]->_flags |= AREA_IS_COMPRESSED;
+		}
+		free(zbuf[i]);
+	}
+
+	return retval;
+}
+
+/* Copy the keyblock and preamble write_new_preamble() put in [src] */
+static int copy_new_vblock(struct cb_area_s *dst, const struct cb_area_s *src)
+{
+	const VbKeyBlockHeader *keyblock = (const VbKeyBlockHeader *)src->buf;
+	const VbFirmwarePreambleHeader *preamble =
+		(const VbFirmwarePreambleHeader *)
+		(src->buf + keyblock->key_block_size);
+	uint32_t size = keyblock->key_block_size + preamble->preamble_size;
+
+	if (size > dst->len) {
+		fprintf(stderr, "New keyblock and preamble don't fit\n");
+		return 1;
+	}
+	memcpy(dst->buf, src->buf, size);
+	return 0;
+}
+
 static int write_loem(const char *ab, struct cb_area_s *vblock)
 {
 	char filename[PATH_MAX];
@@ -466,6 +839,13 @@ static int sign_bios_at_end(struct futil_traverse_state_s *state)
 		return 1;
 	}
 
+	/* Bodies which are already compressed are signed as they are */
+	if (option.compress && compress_fw_bodies(fw_a, fw_b))
+		return 1;
+	/* and stay that way, whatever --flags says */
+	if (fw_a->_flags & fw_b->_flags & AREA_IS_COMPRESSED)
+		option.flags |= VB_FIRMWARE_PREAMBLE_BODY_COMPRESSED;
+
 	/* Do A & B differ ? */
 	if (fw_a->len != fw_b->len ||
 	    memcmp(fw_a->buf, fw_b->buf, fw_a->len)) {
@@ -478,20 +858,20 @@ static int sign_bios_at_end(struct futil_traverse_state_s *state)
 		retval |= write_new_preamble(vblock_a, fw_a,
 					     option.devsignprivate,
 					     option.devkeyblock);
+		/* FW B is always normal keys */
+		retval |= write_new_preamble(vblock_b, fw_b,
+					     option.signprivate,
+					     option.keyblock);
 	} else {
+		/* No, so B gets the same keyblock and preamble as A, and the
+		 * body only needs hashing and signing once. */
 		retval |= write_new_preamble(vblock_a, fw_a,
 					     option.signprivate,
 					     option.keyblock);
+		if (!retval)
+			retval |= copy_new_vblock(vblock_b, vblock_a);
 	}
 
-	/* FW B is always normal keys */
-	retval |= write_new_preamble(vblock_b, fw_b,
-				     option.signprivate,
-				     option.keyblock);
-
-
-
-
 	if (option.loemid) {
 		retval |= write_loem("A", vblock_a);
 		retval |= write_loem("B", vblock_b);
@@ -524,7 +904,16 @@ static const char usage[] = "\n"
 	"  raw firmware blob (FW_MAIN_A/B); OUTFILE is a VBLOCK_A/B\n"
 	"  complete firmware image (bios.bin)\n"
 	"  raw linux kernel; OUTFILE is a kernel partition image\n"
-	"  kernel partition image (/dev/sda2, /dev/mmcblk0p2)\n";
+	"  kernel partition image (/dev/sda2, /dev/mmcblk0p2)\n"
+	"  Chrome OS disk image (chromiumos_image.bin)\n"
+	"\n"
+	"To sign many files with the same PARAMS, reading the keys only once:\n"
+	"\n"
+	"        " MYNAME " %s [PARAMS] --batch MANIFEST [--jobs N]\n"
+	"\n"
+	"Each line of MANIFEST is \"INFILE [OUTFILE]\". Blank lines and lines\n"
+	"starting with '#' are ignored. N processes (default 1, or 0 for one\n"
+	"per CPU) share the files between them.\n";
 
 static const char usage_pubkey[] = "\n"
 	"-----------------------------------------------------------------\n"
@@ -547,7 +936,10 @@ static const char usage_pubkey[] = "\n"
 	"  -f|--flags       NUM             Flags specifying use conditions\n"
 	"  --pem_external   PROGRAM"
 	"         External program to compute the signature\n"
-	"                                     (requires a PEM signing key)\n";
+	"                                     (requires a PEM signing key)\n"
+	"                                   Or the socket of a signing daemon,\n"
+	"                                     which is passed the PEM file\n"
+	"                                     name as a key handle\n";
 
 static const char usage_fw_main[] = "\n"
 	"-----------------------------------------------------------------\n"
@@ -565,7 +957,9 @@ static const char usage_fw_main[] = "\n"
 	"\n"
 	"Optional PARAMS:\n"
 	"  -f|--flags       NUM             The preamble flags value"
-	" (default is 0)\n";
+	" (default is 0)\n"
+	"  --ecrw           FILE            EC-RW image whose SHA-256 digest\n"
+	"                                     goes in the preamble\n";
 
 static const char usage_bios[] = "\n"
 	"-----------------------------------------------------------------\n"
@@ -592,6 +986,11 @@ static const char usage_bios[] = "\n"
 	"                                     unchanged, or 0 if unknown)\n"
 	"  -d|--loemdir     DIR             Local OEM output vblock directory\n"
 	"  -l|--loemid      STRING          Local OEM vblock suffix\n"
+	"  --ecrw           FILE            EC-RW image whose SHA-256 digest\n"
+	"                                     goes in the preambles (default\n"
+	"                                     is unchanged)\n"
+	"  --compress                       Compress FW_MAIN_A/B with LZMA1,\n"
+	"                                     unless they already are\n"
 	"  [--outfile]      OUTFILE         Output firmware image\n";
 
 static const char usage_new_kpart[] = "\n"
@@ -619,7 +1018,14 @@ static const char usage_new_kpart[] = "\n"
 	"                                     (default 0x%x)\n"
 	" --vblockonly                      Emit just the vblock (requires a\n"
 	"                                     distinct outfile)\n"
-	"  -f|--flags       NUM             The preamble flags value\n";
+	"  -f|--flags       NUM             The preamble flags value\n"
+	"  --hashblock      NUM             Also hash the kernel body in blocks\n"
+	"                                     of NUM bytes, so the firmware\n"
+	"                                     can leave most of it to the OS\n"
+	"  --compress                       Compress the kernel body with\n"
+	"                                     LZMA, so less of the disk is\n"
+	"                                     read at boot (not with\n"
+	"                                     --hashblock)\n";
 
 static const char usage_old_kpart[] = "\n"
 	"-----------------------------------------------------------------\n"
@@ -642,16 +1048,72 @@ static const char usage_old_kpart[] = "\n"
 	"  --vblockonly                     Emit just the vblock (requires a\n"
 	"                                     distinct OUTFILE)\n"
 	"  -f|--flags       NUM             The preamble flags value\n"
+	"  --hashblock      NUM             Body hash block size (default is\n"
+	"                                     unchanged; 0 to stop hashing\n"
+	"                                     the body in blocks)\n"
+	"\n";
+
+static const char usage_disk[] = "\n"
+	"-----------------------------------------------------------------\n"
+	"To resign all the kernel partitions in a disk image:\n"
+	"\n"
+	"Required PARAMS:\n"
+	"  -s|--signprivate FILE.vbprivk"
+	"    The private key to sign the kernel blobs\n"
+	"  [--infile]       INFILE          Input disk image (modified\n"
+	"                                     in place if no OUTFILE given)\n"
+	"\n"
+	"Optional PARAMS:\n"
+	"  -b|--keyblock    FILE.keyblock   The keyblock containing the public\n"
+	"                                     key to verify the kernel blobs\n"
+	"  -v|--version     NUM             The kernel version number\n"
+	"  --config         FILE            The kernel commandline file\n"
+	"  --pad            NUM             The vblock padding size in bytes\n"
+	"                                     (default 0x%x)\n"
+	"  [--outfile]      OUTFILE         Output disk image\n"
+	"  -f|--flags       NUM             The preamble flags value\n"
+	"  --hashblock      NUM             Body hash block size\n"
+	"  --partition      NUM             Only resign this partition\n"
+	"\n"
+	"The kernel partitions are found using the GPT, and resigned in place\n"
+	"side by side, keeping each one's version, flags and hash block size\n"
+	"unless told otherwise.  Partitions without a signed kernel are left\n"
+	"alone.  Use --partition to give one kernel its own keys or config\n"
+	"without copying it out of the image and back.\n"
 	"\n";
 
+/* Hash the EC-RW image to go in firmware preambles. Returns 0 on error. */
+static int read_ec_rw_hash(const char *filename)
+{
+	uint8_t *ec_rw;
+	uint64_t ec_rw_size;
+
+	ec_rw = ReadFile(filename, &ec_rw_size);
+	if (!ec_rw) {
+		fprintf(stderr, "Error reading %s\n", filename);
+		return 0;
+	}
+
+	free(option.ec_rw_hash);
+	option.ec_rw_hash = CalculateSha256(ec_rw, ec_rw_size);
+	free(ec_rw);
+	if (!option.ec_rw_hash) {
+		fprintf(stderr, "Error hashing %s\n", filename);
+		return 0;
+	}
+
+	return 1;
+}
+
 static void print_help(const char *prog)
 {
-	printf(usage, prog);
+	printf(usage, prog, prog);
 	printf(usage_pubkey, kNumAlgorithms - 1);
 	puts(usage_fw_main);
 	printf(usage_bios, option.version);
 	printf(usage_new_kpart, option.kloadaddr, option.padding);
 	printf(usage_old_kpart, option.padding);
+	printf(usage_disk, option.padding);
 }
 
 enum no_short_opts {
@@ -663,9 +1125,14 @@ enum no_short_opts {
 	OPT_ARCH,
 	OPT_KLOADADDR,
 	OPT_PADDING,
+	OPT_HASHBLOCK,
 	OPT_PEM_SIGNPRIV,
 	OPT_PEM_ALGO,
 	OPT_PEM_EXTERNAL,
+	OPT_BATCH,
+	OPT_JOBS,
+	OPT_ECRW,
+	OPT_PARTITION,
 };
 
 static const struct option long_opts[] = {
@@ -689,219 +1156,101 @@ static const struct option long_opts[] = {
 	{"arch",         1, NULL, OPT_ARCH},
 	{"kloadaddr",    1, NULL, OPT_KLOADADDR},
 	{"pad",          1, NULL, OPT_PADDING},
+	{"hashblock",    1, NULL, OPT_HASHBLOCK},
 	{"pem_signpriv", 1, NULL, OPT_PEM_SIGNPRIV},
 	{"pem_algo",     1, NULL, OPT_PEM_ALGO},
 	{"pem_external", 1, NULL, OPT_PEM_EXTERNAL},
+	{"batch",        1, NULL, OPT_BATCH},
+	{"jobs",         1, NULL, OPT_JOBS},
+	{"ecrw",         1, NULL, OPT_ECRW},
+	{"partition",    1, NULL, OPT_PARTITION},
 	{"vblockonly",   0, &option.vblockonly, 1},
+	{"compress",     0, &option.compress, 1},
 	{"debug",        0, &debugging_enabled, 1},
 	{NULL,           0, NULL, 0},
 };
 static char *short_opts = ":s:b:k:S:B:v:f:d:l:";
 
-static int do_sign(int argc, char *argv[])
+/* Resign the kernel partition open on |fd| in place */
+static int resign_kpart_file(int fd, struct futil_traverse_state_s *state)
+{
+	struct kpart_file kf = {
+		.fd = fd,
+		.name = state->in_filename,
+	};
+	struct stat sb;
+	off_t size;
+	int errorcnt = 0;
+
+	/* Works for block devices too, unlike fstat() */
+	size = lseek(fd, 0, SEEK_END);
+	if (size < 0 || fstat(fd, &sb)) {
+		fprintf(stderr, "Can't stat %s: %s\n", kf.name,
+			strerror(errno));
+		return 1;
+	}
+	/* Everything that uses images counts bytes in 32 bits */
+	if (size > UINT32_MAX) {
+		fprintf(stderr, "Image size is unreasonable\n");
+		return 1;
+	}
+	kf.size = size;
+
+#ifdef O_DIRECT
+	/* A kernel partition on a live disk isn't worth caching */
+	if (S_ISBLK(sb.st_mode)) {
+		int flags = fcntl(fd, F_GETFL);
+
+		if (flags >= 0)
+			fcntl(fd, F_SETFL, flags | O_DIRECT);
+	}
+#endif
+
+	if (posix_memalign((void **)&kf.buf, DIRECT_ALIGN,
+			   kf.size ? kf.size : 1) ||
+	    !(kf.orig = malloc(kf.size ? kf.size : 1))) {
+		fprintf(stderr, "Can't allocate %" PRIu64 " bytes\n", kf.size);
+		free(kf.buf);
+		return 1;
+	}
+
+	/* The vblock fits in the padding; the body is read if it's needed */
+	if (kpart_read(&kf, option.padding < kf.size ?
+		       option.padding : kf.size)) {
+		errorcnt++;
+		goto done;
+	}
+
+	kpart_file = &kf;
+	errorcnt += futil_traverse(kf.buf, kf.size, state,
+				   FILE_TYPE_KERN_PREAMBLE);
+	kpart_file = NULL;
+
+	if (!errorcnt)
+		errorcnt += kpart_write(&kf);
+
+done:
+	free(kf.orig);
+	free(kf.buf);
+	return errorcnt;
+}
+
+/* Sign one file with the keys and args we've already read */
+static int sign_one(char *infile, int inout_file_count)
 {
-	char *infile = 0;
-	int i;
 	int ifd = -1;
 	int errorcnt = 0;
 	struct futil_traverse_state_s state;
 	uint8_t *buf;
 	uint32_t buf_len;
-	char *e = 0;
 	enum futil_file_type type;
-	int inout_file_count = 0;
 	int mapping;
 
-	opterr = 0;		/* quiet, you */
-	while ((i = getopt_long(argc, argv, short_opts, long_opts, 0)) != -1) {
-		switch (i) {
-		case 's':
-			option.signprivate = PrivateKeyRead(optarg);
-			if (!option.signprivate) {
-				fprintf(stderr, "Error reading %s\n", optarg);
-				errorcnt++;
-			}
-			break;
-		case 'b':
-			option.keyblock = KeyBlockRead(optarg);
-			if (!option.keyblock) {
-				fprintf(stderr, "Error reading %s\n", optarg);
-				errorcnt++;
-			}
-			break;
-		case 'k':
-			option.kernel_subkey = PublicKeyRead(optarg);
-			if (!option.kernel_subkey) {
-				fprintf(stderr, "Error reading %s\n", optarg);
-				errorcnt++;
-			}
-			break;
-		case 'S':
-			option.devsignprivate = PrivateKeyRead(optarg);
-			if (!option.devsignprivate) {
-				fprintf(stderr, "Error reading %s\n", optarg);
-				errorcnt++;
-			}
-			break;
-		case 'B':
-			option.devkeyblock = KeyBlockRead(optarg);
-			if (!option.devkeyblock) {
-				fprintf(stderr, "Error reading %s\n", optarg);
-				errorcnt++;
-			}
-			break;
-		case 'v':
-			option.version_specified = 1;
-			option.version = strtoul(optarg, &e, 0);
-			if (!*optarg || (e && *e)) {
-				fprintf(stderr,
-					"Invalid --version \"%s\"\n", optarg);
-				errorcnt++;
-			}
-			break;
-
-		case 'f':
-			option.flags_specified = 1;
-			option.flags = strtoul(optarg, &e, 0);
-			if (!*optarg || (e && *e)) {
-				fprintf(stderr,
-					"Invalid --flags \"%s\"\n", optarg);
-				errorcnt++;
-			}
-			break;
-		case 'd':
-			option.loemdir = optarg;
-			break;
-		case 'l':
-			option.loemid = optarg;
-			break;
-		case OPT_FV:
-			option.fv_specified = 1;
-			/* fallthrough */
-		case OPT_INFILE:		/* aka "--vmlinuz" */
-			inout_file_count++;
-			infile = optarg;
-			break;
-		case OPT_OUTFILE:
-			inout_file_count++;
-			option.outfile = optarg;
-			break;
-		case OPT_BOOTLOADER:
-			option.bootloader_data = ReadFile(
-				optarg, &option.bootloader_size);
-			if (!option.bootloader_data) {
-				fprintf(stderr,
-					"Error reading bootloader file: %s\n",
-					strerror(errno));
-				errorcnt++;
-			}
-			Debug("bootloader file size=0x%" PRIx64 "\n",
-			      option.bootloader_size);
-			break;
-		case OPT_CONFIG:
-			option.config_data = ReadConfigFile(
-				optarg, &option.config_size);
-			if (!option.config_data) {
-				fprintf(stderr,
-					"Error reading config file: %s\n",
-					strerror(errno));
-				errorcnt++;
-			}
-			break;
-		case OPT_ARCH:
-			/* check the first 3 characters to also match x86_64 */
-			if ((!strncasecmp(optarg, "x86", 3)) ||
-			    (!strcasecmp(optarg, "amd64")))
-				option.arch = ARCH_X86;
-			else if ((!strcasecmp(optarg, "arm")) ||
-				 (!strcasecmp(optarg, "aarch64")))
-				option.arch = ARCH_ARM;
-			else if (!strcasecmp(optarg, "mips"))
-				option.arch = ARCH_MIPS;
-			else {
-				fprintf(stderr,
-					"Unknown architecture: \"%s\"\n",
-					optarg);
-				errorcnt++;
-			}
-			break;
-		case OPT_KLOADADDR:
-			option.kloadaddr = strtoul(optarg, &e, 0);
-			if (!*optarg || (e && *e)) {
-				fprintf(stderr,
-					"Invalid --kloadaddr \"%s\"\n", optarg);
-				errorcnt++;
-			}
-			break;
-		case OPT_PADDING:
-			option.padding = strtoul(optarg, &e, 0);
-			if (!*optarg || (e && *e)) {
-				fprintf(stderr,
-					"Invalid --padding \"%s\"\n", optarg);
-				errorcnt++;
-			}
-			break;
-		case OPT_PEM_SIGNPRIV:
-			option.pem_signpriv = optarg;
-			break;
-		case OPT_PEM_ALGO:
-			option.pem_algo_specified = 1;
-			option.pem_algo = strtoul(optarg, &e, 0);
-			if (!*optarg || (e && *e) ||
-			    (option.pem_algo >= kNumAlgorithms)) {
-				fprintf(stderr,
-					"Invalid --pem_algo \"%s\"\n", optarg);
-				errorcnt++;
-			}
-			break;
-		case OPT_PEM_EXTERNAL:
-			option.pem_external = optarg;
-			break;
-
-		case '?':
-			if (optopt)
-				fprintf(stderr, "Unrecognized option: -%c\n",
-					optopt);
-			else
-				fprintf(stderr, "Unrecognized option: %s\n",
-					argv[optind - 1]);
-			errorcnt++;
-			break;
-		case ':':
-			fprintf(stderr, "Missing argument to -%c\n", optopt);
-			errorcnt++;
-			break;
-		case 0:				/* handled option */
-			break;
-		default:
-			Debug("i=%d\n", i);
-			DIE;
-		}
-	}
-
-	/* If we don't have an input file already, we need one */
-	if (!infile) {
-		if (argc - optind <= 0) {
-			errorcnt++;
-			fprintf(stderr, "ERROR: missing input filename\n");
-			goto done;
-		} else {
-			inout_file_count++;
-			infile = argv[optind++];
-		}
-	}
-
-	/* Look for an output file if we don't have one, just in case. */
-	if (!option.outfile && argc - optind > 0) {
-		inout_file_count++;
-		option.outfile = argv[optind++];
-	}
-
-	/* What are we looking at? */
-	if (futil_file_type(infile, &type)) {
-		errorcnt++;
-		goto done;
-	}
+	/* What are we looking at? */
+	if (futil_file_type(infile, &type)) {
+		errorcnt++;
+		goto done;
+	}
 
 	/* We may be able to infer the type based on the other args */
 	if (type == FILE_TYPE_UNKNOWN) {
@@ -974,6 +1323,12 @@ static int do_sign(int argc, char *argv[])
 		errorcnt += no_opt_if(!option.keyblock, "keyblock");
 		errorcnt += no_opt_if(!option.kernel_subkey, "kernelkey");
 		errorcnt += no_opt_if(!option.version_specified, "version");
+		/* Only the vblock is written, not a compressed body */
+		if (option.compress) {
+			fprintf(stderr, "--compress doesn't apply to a %s\n",
+				futil_file_type_str(type));
+			errorcnt++;
+		}
 		break;
 	case FILE_TYPE_RAW_KERNEL:
 		option.create_new_outfile = 1;
@@ -985,14 +1340,23 @@ static int do_sign(int argc, char *argv[])
 		errorcnt += no_opt_if(option.arch == ARCH_UNSPECIFIED, "arch");
 		break;
 	case FILE_TYPE_CHROMIUMOS_DISK:
-		fprintf(stderr, "Signing a %s is not yet supported\n",
-			futil_file_type_str(type));
-		errorcnt++;
+		errorcnt += no_opt_if(!option.signprivate, "signprivate");
+		if (option.vblockonly) {
+			fprintf(stderr, "--vblockonly doesn't apply to a %s\n",
+				futil_file_type_str(type));
+			errorcnt++;
+		}
 		break;
 	default:
 		DIE;
 	}
 
+	if (option.disk_partition && type != FILE_TYPE_CHROMIUMOS_DISK) {
+		fprintf(stderr, "--partition only applies to a %s\n",
+			futil_file_type_str(FILE_TYPE_CHROMIUMOS_DISK));
+		errorcnt++;
+	}
+
 	Debug("infile=%s\n", infile);
 	Debug("inout_file_count=%d\n", inout_file_count);
 	Debug("option.create_new_outfile=%d\n", option.create_new_outfile);
@@ -1010,16 +1374,14 @@ static int do_sign(int argc, char *argv[])
 
 	Debug("option.outfile=%s\n", option.outfile);
 
-	if (argc - optind > 0) {
-		errorcnt++;
-		fprintf(stderr, "ERROR: too many arguments left over\n");
-	}
-
 	if (errorcnt)
 		goto done;
 
 	memset(&state, 0, sizeof(state));
 	state.op = FUTIL_OP_SIGN;
+	/* Resign all the kernels on a disk image at once */
+	state.parallel = (type == FILE_TYPE_CHROMIUMOS_DISK);
+	state.disk_partition = option.disk_partition;
 
 	if (option.create_new_outfile) {
 		/* The input is read-only, the output is write-only. */
@@ -1049,6 +1411,11 @@ static int do_sign(int argc, char *argv[])
 		}
 	}
 
+	if (type == FILE_TYPE_KERN_PREAMBLE && !option.create_new_outfile) {
+		errorcnt += resign_kpart_file(ifd, &state);
+		goto done;
+	}
+
 	if (0 != futil_map_file(ifd, mapping, &buf, &buf_len)) {
 		errorcnt++;
 		goto done;
@@ -1056,7 +1423,7 @@ static int do_sign(int argc, char *argv[])
 
 	errorcnt += futil_traverse(buf, buf_len, &state, type);
 
-	errorcnt += futil_unmap_file(ifd, MAP_RW, buf, buf_len);
+	errorcnt += futil_unmap_file(ifd, mapping, buf, buf_len);
 
 done:
 	if (ifd >= 0 && close(ifd)) {
@@ -1065,12 +1432,427 @@ done:
 			strerror(errno));
 	}
 
+	return errorcnt;
+}
+
+/* One line of a --batch manifest */
+struct batch_entry {
+	char *infile;
+	char *outfile;
+};
+
+/* Read a --batch manifest. Returns the number of entries, or -1 if error. */
+static int read_manifest(const char *filename, struct batch_entry **entries)
+{
+	FILE *fp;
+	char *line = NULL;
+	size_t line_size = 0;
+	struct batch_entry *ent = NULL;
+	int count = 0;
+	int lineno = 0;
+	int errorcnt = 0;
+	char *name[2];
+	char *tok, *save;
+	int n;
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		fprintf(stderr, "Can't open %s for reading: %s\n",
+			filename, strerror(errno));
+		return -1;
+	}
+
+	while (getline(&line, &line_size, fp) >= 0) {
+		lineno++;
+		if (line[0] == '#')
+			continue;
+
+		n = 0;
+		tok = strtok_r(line, " \t\r\n", &save);
+		for (; tok; tok = strtok_r(NULL, " \t\r\n", &save))
+			if (n++ < 2)
+				name[n - 1] = tok;
+		if (!n)
+			continue;
+		if (n > 2) {
+			fprintf(stderr, "%s:%d: expected INFILE [OUTFILE]\n",
+				filename, lineno);
+			errorcnt++;
+			continue;
+		}
+
+		ent = realloc(ent, (count + 1) * sizeof(*ent));
+		if (!ent) {
+			fprintf(stderr, "Can't allocate manifest\n");
+			count = 0;
+			errorcnt++;
+			break;
+		}
+		ent[count].infile = strdup(name[0]);
+		ent[count].outfile = n > 1 ? strdup(name[1]) : NULL;
+		count++;
+	}
+
+	free(line);
+	fclose(fp);
+
+	*entries = ent;
+	return errorcnt ? -1 : count;
+}
+
+/*
+ * Sign every [step]th file in the manifest, starting with [first]. Each one
+ * starts from the same args, since signing changes some of them to match
+ * the file. Returns the number of files that failed.
+ */
+static int sign_share(const struct local_data_s *args,
+		      const struct batch_entry *entries, int count,
+		      int first, int step)
+{
+	int failed = 0;
+	int i;
+
+	for (i = first; i < count; i += step) {
+		option = *args;
+		option.outfile = entries[i].outfile;
+		if (sign_one(entries[i].infile,
+			     entries[i].outfile ? 2 : 1)) {
+			fprintf(stderr, "Failed to sign %s\n",
+				entries[i].infile);
+			failed++;
+		}
+	}
+
+	return failed;
+}
+
+/*
+ * Sign everything in a manifest, sharing it between [jobs] processes. The
+ * callbacks keep their state in globals, so the workers are forked rather
+ * than threads. They inherit the keys we've already read.
+ */
+static int sign_batch(const char *filename, long jobs)
+{
+	struct local_data_s args = option;
+	struct batch_entry *entries = NULL;
+	pid_t *pids;
+	int count, i, status;
+	int errorcnt = 0;
+
+	count = read_manifest(filename, &entries);
+	if (count < 0)
+		return 1;
+
+	if (!jobs)
+		jobs = futil_default_jobs();
+	if (jobs > count)
+		jobs = count;
+	if (jobs < 1)
+		jobs = 1;
+	Debug("signing %d files with %ld jobs\n", count, jobs);
+
+	pids = calloc(jobs, sizeof(*pids));
+	if (!pids)
+		jobs = 1;
+
+	/* Don't let the workers repeat anything that's still buffered */
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 1; i < jobs; i++) {
+		pids[i] = fork();
+		if (pids[i] == 0)
+			exit(!!sign_share(&args, entries, count, i, jobs));
+		if (pids[i] < 0)
+			Debug("can't fork worker %d: %s\n", i,
+			      strerror(errno));
+	}
+
+	/* Do our own share, and that of any workers that didn't start */
+	errorcnt += sign_share(&args, entries, count, 0, jobs);
+	for (i = 1; i < jobs; i++)
+		if (pids[i] < 0)
+			errorcnt += sign_share(&args, entries, count, i, jobs);
+
+	for (i = 1; i < jobs; i++) {
+		if (pids[i] <= 0)
+			continue;
+		if (waitpid(pids[i], &status, 0) < 0 ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			errorcnt++;
+	}
+
+	option = args;
+	free(pids);
+	for (i = 0; i < count; i++) {
+		free(entries[i].infile);
+		free(entries[i].outfile);
+	}
+	free(entries);
+
+	return errorcnt;
+}
+
+static int do_sign(int argc, char *argv[])
+{
+	char *infile = 0;
+	char *batchfile = 0;
+	long jobs = 1;
+	int i;
+	int errorcnt = 0;
+	char *e = 0;
+	int inout_file_count = 0;
+
+	opterr = 0;		/* quiet, you */
+	while ((i = getopt_long(argc, argv, short_opts, long_opts, 0)) != -1) {
+		switch (i) {
+		case 's':
+			option.signprivate = PrivateKeyRead(optarg);
+			if (!option.signprivate) {
+				fprintf(stderr, "Error reading %s\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case 'b':
+			option.keyblock = KeyBlockRead(optarg);
+			if (!option.keyblock) {
+				fprintf(stderr, "Error reading %s\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case 'k':
+			option.kernel_subkey = PublicKeyRead(optarg);
+			if (!option.kernel_subkey) {
+				fprintf(stderr, "Error reading %s\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case 'S':
+			option.devsignprivate = PrivateKeyRead(optarg);
+			if (!option.devsignprivate) {
+				fprintf(stderr, "Error reading %s\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case 'B':
+			option.devkeyblock = KeyBlockRead(optarg);
+			if (!option.devkeyblock) {
+				fprintf(stderr, "Error reading %s\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case 'v':
+			option.version_specified = 1;
+			option.version = strtoul(optarg, &e, 0);
+			if (!*optarg || (e && *e)) {
+				fprintf(stderr,
+					"Invalid --version \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+
+		case 'f':
+			option.flags_specified = 1;
+			option.flags = strtoul(optarg, &e, 0);
+			if (!*optarg || (e && *e)) {
+				fprintf(stderr,
+					"Invalid --flags \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case 'd':
+			option.loemdir = optarg;
+			break;
+		case 'l':
+			option.loemid = optarg;
+			break;
+		case OPT_FV:
+			option.fv_specified = 1;
+			/* fallthrough */
+		case OPT_INFILE:		/* aka "--vmlinuz" */
+			inout_file_count++;
+			infile = optarg;
+			break;
+		case OPT_OUTFILE:
+			inout_file_count++;
+			option.outfile = optarg;
+			break;
+		case OPT_ECRW:
+			option.ec_rw_hash_specified = 1;
+			if (!read_ec_rw_hash(optarg))
+				errorcnt++;
+			break;
+		case OPT_BOOTLOADER:
+			option.bootloader_data = ReadFile(
+				optarg, &option.bootloader_size);
+			if (!option.bootloader_data) {
+				fprintf(stderr,
+					"Error reading bootloader file: %s\n",
+					strerror(errno));
+				errorcnt++;
+			}
+			Debug("bootloader file size=0x%" PRIx64 "\n",
+			      option.bootloader_size);
+			break;
+		case OPT_CONFIG:
+			option.config_data = ReadConfigFile(
+				optarg, &option.config_size);
+			if (!option.config_data) {
+				fprintf(stderr,
+					"Error reading config file: %s\n",
+					strerror(errno));
+				errorcnt++;
+			}
+			break;
+		case OPT_ARCH:
+			/* check the first 3 characters to also match x86_64 */
+			if ((!strncasecmp(optarg, "x86", 3)) ||
+			    (!strcasecmp(optarg, "amd64")))
+				option.arch = ARCH_X86;
+			else if ((!strcasecmp(optarg, "arm")) ||
+				 (!strcasecmp(optarg, "aarch64")))
+				option.arch = ARCH_ARM;
+			else if (!strcasecmp(optarg, "mips"))
+				option.arch = ARCH_MIPS;
+			else {
+				fprintf(stderr,
+					"Unknown architecture: \"%s\"\n",
+					optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_KLOADADDR:
+			option.kloadaddr = strtoul(optarg, &e, 0);
+			if (!*optarg || (e && *e)) {
+				fprintf(stderr,
+					"Invalid --kloadaddr \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_PARTITION:
+			option.disk_partition = strtoul(optarg, &e, 0);
+			if (!*optarg || (e && *e) || !option.disk_partition) {
+				fprintf(stderr,
+					"Invalid --partition \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_PADDING:
+			option.padding = strtoul(optarg, &e, 0);
+			if (!*optarg || (e && *e)) {
+				fprintf(stderr,
+					"Invalid --padding \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_HASHBLOCK:
+			option.hash_block_size_specified = 1;
+			option.hash_block_size = strtoul(optarg, &e, 0);
+			if (!*optarg || (e && *e)) {
+				fprintf(stderr,
+					"Invalid --hashblock \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_PEM_SIGNPRIV:
+			option.pem_signpriv = optarg;
+			break;
+		case OPT_PEM_ALGO:
+			option.pem_algo_specified = 1;
+			option.pem_algo = strtoul(optarg, &e, 0);
+			if (!*optarg || (e && *e) ||
+			    (option.pem_algo >= kNumAlgorithms)) {
+				fprintf(stderr,
+					"Invalid --pem_algo \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+		case OPT_PEM_EXTERNAL:
+			option.pem_external = optarg;
+			break;
+		case OPT_BATCH:
+			batchfile = optarg;
+			break;
+		case OPT_JOBS:
+			jobs = strtol(optarg, &e, 0);
+			if (!*optarg || (e && *e) || jobs < 0) {
+				fprintf(stderr,
+					"Invalid --jobs \"%s\"\n", optarg);
+				errorcnt++;
+			}
+			break;
+
+		case '?':
+			if (optopt)
+				fprintf(stderr, "Unrecognized option: -%c\n",
+					optopt);
+			else
+				fprintf(stderr, "Unrecognized option: %s\n",
+					argv[optind - 1]);
+			errorcnt++;
+			break;
+		case ':':
+			fprintf(stderr, "Missing argument to -%c\n", optopt);
+			errorcnt++;
+			break;
+		case 0:				/* handled option */
+			break;
+		default:
+			Debug("i=%d\n", i);
+			DIE;
+		}
+	}
+
+	/* The manifest names all the files */
+	if (batchfile) {
+		if (infile || option.outfile || argc - optind > 0) {
+			errorcnt++;
+			fprintf(stderr,
+				"ERROR: --batch takes file names from the"
+				" manifest\n");
+		}
+		if (!errorcnt)
+			errorcnt += sign_batch(batchfile, jobs);
+		goto done;
+	}
+
+	/* If we don't have an input file already, we need one */
+	if (!infile) {
+		if (argc - optind <= 0) {
+			errorcnt++;
+			fprintf(stderr, "ERROR: missing input filename\n");
+			goto done;
+		} else {
+			inout_file_count++;
+			infile = argv[optind++];
+		}
+	}
+
+	/* Look for an output file if we don't have one, just in case. */
+	if (!option.outfile && argc - optind > 0) {
+		inout_file_count++;
+		option.outfile = argv[optind++];
+	}
+
+	if (argc - optind > 0) {
+		errorcnt++;
+		fprintf(stderr, "ERROR: too many arguments left over\n");
+	}
+
+	if (!errorcnt)
+		errorcnt += sign_one(infile, inout_file_count);
+
+done:
 	if (option.signprivate)
 		free(option.signprivate);
 	if (option.keyblock)
 		free(option.keyblock);
 	if (option.kernel_subkey)
 		free(option.kernel_subkey);
+	if (option.ec_rw_hash)
+		free(option.ec_rw_hash);
+	if (pem_signprivate)
+		free(pem_signprivate);
 
 	if (errorcnt)
 		fprintf(stderr, "Use --help for usage instructions\n");
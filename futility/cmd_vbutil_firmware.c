@@ -12,9 +12,13 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "2sysincludes.h"
+#include "2return_codes.h"
 #include "cryptolib.h"
 #include "futility.h"
 #include "host_common.h"
+#include "host_crypto.h"
+#include "host_key_bundle.h"
 #include "kernel_blob.h"
 #include "util_misc.h"
 #include "vboot_common.h"
@@ -30,6 +34,7 @@ enum {
 	OPT_FV,
 	OPT_KERNELKEY,
 	OPT_FLAGS,
+	OPT_ECRW,
 };
 
 static const struct option long_opts[] = {
@@ -42,6 +47,7 @@ static const struct option long_opts[] = {
 	{"fv", 1, 0, OPT_FV},
 	{"kernelkey", 1, 0, OPT_KERNELKEY},
 	{"flags", 1, 0, OPT_FLAGS},
+	{"ecrw", 1, 0, OPT_ECRW},
 	{NULL, 0, 0, 0}
 };
 
@@ -61,6 +67,8 @@ static void print_help(const char *prog)
 	       "\n"
 	       "optional OPTIONS are:\n"
 	       "  --flags <number>            Preamble flags (defaults to 0)\n"
+	       "  --ecrw <file>               EC-RW image to put the SHA-256\n"
+	       "                                digest of in the preamble\n"
 	       "\n"
 	       "For '--verify <file>', required OPTIONS are:\n"
 	       "\n"
@@ -78,17 +86,18 @@ static void print_help(const char *prog)
 static int Vblock(const char *outfile, const char *keyblock_file,
 		  const char *signprivate, uint64_t version,
 		  const char *fv_file, const char *kernelkey_file,
-		  uint32_t preamble_flags)
+		  uint32_t preamble_flags, const char *ecrw_file)
 {
 
 	VbPrivateKey *signing_key;
 	VbPublicKey *kernel_subkey;
 	VbSignature *body_sig;
+	VbSignature *ec_rw_hash = NULL;
 	VbFirmwarePreambleHeader *preamble;
 	VbKeyBlockHeader *key_block;
 	uint64_t key_block_size;
 	uint8_t *fv_data;
-	uint64_t fv_size;
+	uint32_t fv_size;
 	FILE *f;
 	uint64_t i;
 
@@ -107,7 +116,7 @@ static int Vblock(const char *outfile, const char *keyblock_file,
 
 	/* Read the key block and keys */
 	key_block =
-	    (VbKeyBlockHeader *) ReadFile(keyblock_file, &key_block_size);
+	    (VbKeyBlockHeader *) ReadKeyFile(keyblock_file, &key_block_size);
 	if (!key_block) {
 		VbExError("Error reading key block.\n");
 		return 1;
@@ -126,9 +135,11 @@ static int Vblock(const char *outfile, const char *keyblock_file,
 	}
 
 	/* Read and sign the firmware volume */
-	fv_data = ReadFile(fv_file, &fv_size);
-	if (!fv_data)
+	if (VB2_SUCCESS != vb2_map_file(fv_file, VB2_MAP_RO,
+					&fv_data, &fv_size)) {
+		VbExError("Error reading firmware volume\n");
 		return 1;
+	}
 	if (!fv_size) {
 		VbExError("Empty firmware volume file\n");
 		return 1;
@@ -138,13 +149,31 @@ static int Vblock(const char *outfile, const char *keyblock_file,
 		VbExError("Error calculating body signature\n");
 		return 1;
 	}
-	free(fv_data);
+	vb2_unmap_file(fv_data, fv_size, VB2_MAP_RO);
+
+	/* Hash the EC-RW image, if any */
+	if (ecrw_file) {
+		uint8_t *ec_rw;
+		uint64_t ec_rw_size;
+
+		ec_rw = ReadFile(ecrw_file, &ec_rw_size);
+		if (!ec_rw) {
+			VbExError("Error reading EC-RW image\n");
+			return 1;
+		}
+		ec_rw_hash = CalculateSha256(ec_rw, ec_rw_size);
+		free(ec_rw);
+		if (!ec_rw_hash) {
+			VbExError("Error hashing EC-RW image\n");
+			return 1;
+		}
+	}
 
 	/* Create preamble */
 	preamble = CreateFirmwarePreamble(version,
 					  kernel_subkey,
 					  body_sig,
-					  signing_key, preamble_flags);
+					  signing_key, preamble_flags, ec_rw_hash);
 	if (!preamble) {
 		VbExError("Error creating preamble.\n");
 		return 1;
@@ -182,9 +211,11 @@ static int Verify(const char *infile, const char *signpubkey,
 	uint8_t *blob;
 	uint64_t blob_size;
 	uint8_t *fv_data;
-	uint64_t fv_size;
+	uint32_t fv_size;
 	uint64_t now = 0;
 	uint32_t flags;
+	const uint8_t *ec_rw_hash;
+	int i;
 
 	if (!infile || !signpubkey || !fv_file) {
 		VbExError("Must specify filename, signpubkey, and fv\n");
@@ -206,8 +237,8 @@ static int Verify(const char *infile, const char *signpubkey,
 	}
 
 	/* Read firmware volume */
-	fv_data = ReadFile(fv_file, &fv_size);
-	if (!fv_data) {
+	if (VB2_SUCCESS != vb2_map_file(fv_file, VB2_MAP_RO,
+					&fv_data, &fv_size)) {
 		VbExError("Error reading firmware volume\n");
 		return 1;
 	}
@@ -271,6 +302,15 @@ static int Verify(const char *infile, const char *signpubkey,
 	printf("  Firmware body size:    %" PRIu64 "\n",
 	       preamble->body_signature.data_size);
 	printf("  Preamble flags:        %" PRIu32 "\n", flags);
+	ec_rw_hash = VbGetFirmwarePreambleEcRwHash(preamble);
+	if (ec_rw_hash) {
+		printf("  EC-RW size:            %" PRIu64 "\n",
+		       preamble->ec_rw_hash.data_size);
+		printf("  EC-RW sha256sum:       ");
+		for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+			printf("%02x", ec_rw_hash[i]);
+		printf("\n");
+	}
 
 	/* TODO: verify body size same as signature size */
 
@@ -288,6 +328,7 @@ static int Verify(const char *infile, const char *signpubkey,
 		}
 		printf("Body verification succeeded.\n");
 	}
+	vb2_unmap_file(fv_data, fv_size, VB2_MAP_RO);
 
 	if (kernelkey_file) {
 		if (0 != PublicKeyWrite(kernelkey_file, kernel_subkey)) {
@@ -310,11 +351,14 @@ static int do_vbutil_firmware(int argc, char *argv[])
 	char *fv_file = NULL;
 	char *kernelkey_file = NULL;
 	uint32_t preamble_flags = 0;
+	char *ecrw_file = NULL;
 	int mode = 0;
 	int parse_error = 0;
 	char *e;
 	int i;
 
+	vb2_host_crypto_select_env();
+
 	while ((i = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
 		switch (i) {
 		case '?':
@@ -364,6 +408,10 @@ static int do_vbutil_firmware(int argc, char *argv[])
 				parse_error = 1;
 			}
 			break;
+
+		case OPT_ECRW:
+			ecrw_file = optarg;
+			break;
 		}
 	}
 
@@ -375,7 +423,8 @@ static int do_vbutil_firmware(int argc, char *argv[])
 	switch (mode) {
 	case OPT_MODE_VBLOCK:
 		return Vblock(filename, key_block_file, signprivate, version,
-			      fv_file, kernelkey_file, preamble_flags);
+			      fv_file, kernelkey_file, preamble_flags,
+			      ecrw_file);
 	case OPT_MODE_VERIFY:
 		return Verify(filename, signpubkey, fv_file, kernelkey_file);
 	default:
@@ -10,22 +10,24 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>		/* For PRIu64 */
-#ifndef HAVE_MACOS
-#include <linux/fs.h>		/* For BLKGETSIZE64 */
-#endif
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "2sysincludes.h"
+#include "2return_codes.h"
 #include "file_type.h"
 #include "futility.h"
 #include "host_common.h"
+#include "host_crypto.h"
+#include "host_key_bundle.h"
 #include "kernel_blob.h"
 #include "traversal.h"
 #include "vb1_helper.h"
+#include "vboot_host.h"
 
 static void Fatal(const char *format, ...)
 {
@@ -128,6 +130,9 @@ static const char usage[] =
 	"    --kloadaddr <address>     Assign kernel body load address\n"
 	"    --pad <number>            Verification blob size in bytes\n"
 	"    --vblockonly              Emit just the verification blob\n"
+	"\n"
+	"  If <file> is the old blob, only its verification blob and config\n"
+	"  are rewritten.\n"
 	"\nOR\n\n"
 	"Usage:  " MYNAME " %s --verify <file> [PARAMETERS]\n"
 	"\n"
@@ -155,63 +160,42 @@ static void print_help(const char *progname)
 }
 
 
-/* Return an explanation when fread() fails. */
-static const char *error_fread(FILE *fp)
-{
-	const char *retval = "beats me why";
-	if (feof(fp))
-		retval = "EOF";
-	else if (ferror(fp))
-		retval = strerror(errno);
-	clearerr(fp);
-	return retval;
-}
-
-
-/* This reads a complete kernel partition into a buffer */
-static uint8_t *ReadOldKPartFromFileOrDie(const char *filename,
+/*
+ * This maps a complete kernel partition, writable but private, since the
+ * config can be changed in place before repacking.
+ */
+static uint8_t *MapOldKPartFromFileOrDie(const char *filename,
 					 uint64_t *size_ptr)
 {
-	FILE *fp = NULL;
-	struct stat statbuf;
 	uint8_t *buf;
-	uint64_t file_size = 0;
+	uint32_t file_size;
 
-	if (0 != stat(filename, &statbuf))
-		Fatal("Unable to stat %s: %s\n", filename, strerror(errno));
+	Debug("Mapping %s\n", filename);
+	if (VB2_SUCCESS != vb2_map_file(filename, VB2_MAP_COW,
+					&buf, &file_size))
+		Fatal("Unable to read %s: %s\n", filename, strerror(errno));
 
-	if (S_ISBLK(statbuf.st_mode)) {
-#ifndef HAVE_MACOS
-		int fd = open(filename, O_RDONLY);
-		if (fd >= 0) {
-			ioctl(fd, BLKGETSIZE64, &file_size);
-			close(fd);
-		}
-#endif
-	} else {
-		file_size = statbuf.st_size;
-	}
-	Debug("%s size is 0x%" PRIx64 "\n", filename, file_size);
+	Debug("%s size is 0x%x\n", filename, file_size);
 	if (file_size < opt_pad)
 		Fatal("%s is too small to be a valid kernel blob\n");
 
-	Debug("Reading %s\n", filename);
-	fp = fopen(filename, "rb");
-	if (!fp)
-		Fatal("Unable to open file %s: %s\n", filename,
-		      strerror(errno));
-
-	buf = malloc(file_size);
-	if (1 != fread(buf, file_size, 1, fp))
-		Fatal("Unable to read entirety of %s: %s\n", filename,
-		      error_fread(fp));
-
 	if (size_ptr)
 		*size_ptr = file_size;
 
 	return buf;
 }
 
+/* Returns true if both names refer to the same existing file or device */
+static int IsSameFile(const char *name1, const char *name2)
+{
+	struct stat sb1, sb2;
+
+	if (stat(name1, &sb1) || stat(name2, &sb2))
+		return 0;
+
+	return sb1.st_dev == sb2.st_dev && sb1.st_ino == sb2.st_ino;
+}
+
 /****************************************************************************/
 
 static int do_vbutil_kernel(int argc, char *argv[])
@@ -234,7 +218,6 @@ static int do_vbutil_kernel(int argc, char *argv[])
 	uint64_t min_version = 0;
 	char *e;
 	int i = 0;
-	int errcount = 0;
 	int rv;
 	VbKeyBlockHeader *keyblock = NULL;
 	VbKeyBlockHeader *t_keyblock = NULL;
@@ -242,22 +225,25 @@ static int do_vbutil_kernel(int argc, char *argv[])
 	VbPublicKey *signpub_key = NULL;
 	uint8_t *kpart_data = NULL;
 	uint64_t kpart_size = 0;
+	uint8_t *kpart_copy;
 	uint8_t *vmlinuz_buf = NULL;
-	uint64_t vmlinuz_size = 0;
+	uint32_t vmlinuz_size = 0;
 	uint8_t *t_config_data;
 	uint64_t t_config_size;
 	uint8_t *t_bootloader_data;
 	uint64_t t_bootloader_size;
-	uint64_t vmlinuz_header_size = 0;
-	uint64_t vmlinuz_header_address = 0;
-	uint64_t vmlinuz_header_offset = 0;
 	VbKernelPreambleHeader *preamble = NULL;
 	uint8_t *kblob_data = NULL;
 	uint64_t kblob_size = 0;
+	uint8_t *kernel_data = NULL;
+	uint64_t kernel_size = 0;
 	uint8_t *vblock_data = NULL;
 	uint64_t vblock_size = 0;
 	uint32_t flags = 0;
-	FILE *f;
+	int in_place = 0;
+	int in_fd, out_fd;
+
+	vb2_host_crypto_select_env();
 
 	while (((i = getopt_long(argc, argv, ":", long_opts, NULL)) != -1) &&
 	       !parse_error) {
@@ -392,7 +378,7 @@ static int do_vbutil_kernel(int argc, char *argv[])
 		if (!keyblock_file)
 			Fatal("Missing required keyblock file.\n");
 
-		t_keyblock = (VbKeyBlockHeader *)ReadFile(keyblock_file, 0);
+		t_keyblock = (VbKeyBlockHeader *)ReadKeyFile(keyblock_file, 0);
 		if (!t_keyblock)
 			Fatal("Error reading key block.\n");
 
@@ -426,42 +412,46 @@ static int do_vbutil_kernel(int argc, char *argv[])
 		if (!vmlinuz_file)
 			Fatal("Missing required vmlinuz file.\n");
 		Debug("Reading %s\n", vmlinuz_file);
-		vmlinuz_buf = ReadFile(vmlinuz_file, &vmlinuz_size);
-		if (!vmlinuz_buf)
+		if (VB2_SUCCESS != vb2_map_file(vmlinuz_file, VB2_MAP_RO,
+						&vmlinuz_buf, &vmlinuz_size))
 			Fatal("Error reading vmlinuz file.\n");
-		Debug(" vmlinuz file size=0x%" PRIx64 "\n",
-		      vmlinuz_size);
+		Debug(" vmlinuz file size=0x%x\n", vmlinuz_size);
 		if (!vmlinuz_size)
 			Fatal("Empty vmlinuz file\n");
 
-		kblob_data = CreateKernelBlob(
+		/* Hash and write the kernel straight from the vmlinuz file */
+		kblob_data = CreateKernelBlobTail(
 			vmlinuz_buf, vmlinuz_size,
 			arch, kernel_body_load_address,
 			t_config_data, t_config_size,
 			t_bootloader_data, t_bootloader_size,
-			&kblob_size);
+			&kernel_data, &kernel_size, &kblob_size);
 		if (!kblob_data)
 			Fatal("Unable to create kernel blob\n");
 
-		Debug("kblob_size = 0x%" PRIx64 "\n", kblob_size);
+		Debug("kernel_size = 0x%" PRIx64 ", tail_size = 0x%" PRIx64
+		      "\n", kernel_size, kblob_size);
 
-		vblock_data = SignKernelBlob(kblob_data, kblob_size, opt_pad,
-					     version, kernel_body_load_address,
-					     t_keyblock, signpriv_key, flags,
-					     &vblock_size);
+		vblock_data = SignKernelParts(kernel_data, kernel_size,
+					      kblob_data, kblob_size, opt_pad,
+					      version, kernel_body_load_address,
+					      t_keyblock, signpriv_key, flags,
+					      &vblock_size);
 		if (!vblock_data)
 			Fatal("Unable to sign kernel blob\n");
 
 		Debug("vblock_size = 0x%" PRIx64 "\n", vblock_size);
 
 		if (opt_vblockonly)
-			rv = WriteSomeParts(filename,
-					    vblock_data, vblock_size,
-					    NULL, 0);
+			rv = WriteKPart(filename,
+					vblock_data, vblock_size,
+					NULL, 0);
 		else
-			rv = WriteSomeParts(filename,
-					    vblock_data, vblock_size,
-					    kblob_data, kblob_size);
+			rv = WriteKernelParts(filename,
+					      vblock_data, vblock_size,
+					      kernel_data, kernel_size,
+					      kblob_data, kblob_size);
+		vb2_unmap_file(vmlinuz_buf, vmlinuz_size, VB2_MAP_RO);
 		return rv;
 
 	case OPT_MODE_REPACK:
@@ -479,7 +469,24 @@ static int do_vbutil_kernel(int argc, char *argv[])
 			Fatal("Missing previously packed blob.\n");
 
 		/* Load the kernel partition */
-		kpart_data = ReadOldKPartFromFileOrDie(oldfile, &kpart_size);
+		kpart_data = MapOldKPartFromFileOrDie(oldfile, &kpart_size);
+
+		/*
+		 * Repacking over the old blob only needs to rewrite the parts
+		 * that change, which is much quicker for a whole partition.
+		 * Otherwise the new partition may still be written over the
+		 * old one, which mustn't be mapped then, so repack a copy.
+		 */
+		in_place = !opt_vblockonly && IsSameFile(filename, oldfile);
+		if (!in_place) {
+			kpart_copy = malloc(kpart_size);
+			if (!kpart_copy)
+				Fatal("Unable to allocate 0x%" PRIx64
+				      " bytes\n", kpart_size);
+			memcpy(kpart_copy, kpart_data, kpart_size);
+			vb2_unmap_file(kpart_data, kpart_size, VB2_MAP_COW);
+			kpart_data = kpart_copy;
+		}
 
 		/* Make sure we have a kernel partition */
 		if (FILE_TYPE_KERN_PREAMBLE !=
@@ -515,27 +522,43 @@ static int do_vbutil_kernel(int argc, char *argv[])
 
 		if (keyblock_file) {
 			t_keyblock =
-				(VbKeyBlockHeader *)ReadFile(keyblock_file, 0);
+				(VbKeyBlockHeader *)ReadKeyFile(keyblock_file, 0);
 			if (!t_keyblock)
 				Fatal("Error reading key block.\n");
 		}
 
-		/* Reuse previous body size */
-		vblock_data = SignKernelBlob(kblob_data, kblob_size, opt_pad,
-					     version, kernel_body_load_address,
-					     t_keyblock ? t_keyblock : keyblock,
-					     signpriv_key, flags, &vblock_size);
+		/* If the body is unchanged, sign its old digest again */
+		if (!config_file)
+			vblock_data = ResignKernelBlob(
+				keyblock, preamble, opt_pad,
+				version, kernel_body_load_address,
+				t_keyblock ? t_keyblock : keyblock,
+				signpriv_key, flags, &vblock_size);
+
+		/* Otherwise reuse previous body size */
+		if (!vblock_data)
+			vblock_data = SignKernelBlob(
+				kblob_data, kblob_size, opt_pad,
+				version, kernel_body_load_address,
+				t_keyblock ? t_keyblock : keyblock,
+				signpriv_key, flags, 0, &vblock_size);
 		if (!vblock_data)
 			Fatal("Unable to sign kernel blob\n");
 
-		if (opt_vblockonly)
-			rv = WriteSomeParts(filename,
-					    vblock_data, vblock_size,
-					    NULL, 0);
-		else
-			rv = WriteSomeParts(filename,
-					    vblock_data, vblock_size,
-					    kblob_data, kblob_size);
+		if (in_place) {
+			rv = WriteKPartInPlace(filename, kpart_data,
+					       vblock_data, vblock_size,
+					       config_file != NULL);
+			vb2_unmap_file(kpart_data, kpart_size, VB2_MAP_COW);
+		} else if (opt_vblockonly) {
+			rv = WriteKPart(filename,
+					vblock_data, vblock_size,
+					NULL, 0);
+		} else {
+			rv = WriteKPart(filename,
+					vblock_data, vblock_size,
+					kblob_data, kblob_size);
+		}
 		return rv;
 
 	case OPT_MODE_VERIFY:
@@ -551,7 +574,7 @@ static int do_vbutil_kernel(int argc, char *argv[])
 		/* Do it */
 
 		/* Load the kernel partition */
-		kpart_data = ReadOldKPartFromFileOrDie(filename, &kpart_size);
+		kpart_data = MapOldKPartFromFileOrDie(filename, &kpart_size);
 
 		kblob_data = UnpackKPart(kpart_data, kpart_size, opt_pad,
 					 0, 0, &kblob_size);
@@ -573,70 +596,37 @@ static int do_vbutil_kernel(int argc, char *argv[])
 			return 1;
 		}
 
-		kpart_data = ReadOldKPartFromFileOrDie(filename, &kpart_size);
-
-		kblob_data = UnpackKPart(kpart_data, kpart_size, opt_pad,
-					 &keyblock, &preamble, &kblob_size);
-
-		if (!kblob_data)
-			Fatal("Unable to unpack kernel partition\n");
+		/* The vmlinuz is copied straight from the kernel partition,
+		 * without reading all of it in */
+		in_fd = open(filename, O_RDONLY);
+		if (in_fd < 0)
+			Fatal("Unable to read %s: %s\n", filename,
+			      strerror(errno));
 
-		f = fopen(vmlinuz_out_file, "wb");
-		if (!f) {
+		out_fd = open(vmlinuz_out_file, O_WRONLY | O_CREAT | O_TRUNC,
+			      0666);
+		if (out_fd < 0) {
 			VbExError("Can't open output file %s\n",
 				  vmlinuz_out_file);
+			close(in_fd);
 			return 1;
 		}
 
-		/* Now stick 16-bit header followed by kernel block into
-		   output */
-		if (VbGetKernelVmlinuzHeader(preamble,
-					     &vmlinuz_header_address,
-					     &vmlinuz_header_size)
-		    != VBOOT_SUCCESS) {
-			Fatal("Unable to retrieve Vmlinuz Header!");
-		}
-
-		if (vmlinuz_header_size) {
-			// verify that the 16-bit header is included in the
-			// kblob (to make sure that it's included in the
-			// signature)
-			if (VerifyVmlinuzInsideKBlob(preamble->body_load_address,
-						     kblob_size,
-						     vmlinuz_header_address,
-						     vmlinuz_header_size)) {
-				VbExError("Vmlinuz header not signed!\n");
-				fclose(f);
-				unlink(vmlinuz_out_file);
-				return 1;
-			}
-			// calculate the vmlinuz_header offset from
-			// the beginning of the kpart_data.  The kblob doesn't
-			// include the body_load_offset, but does include
-			// the keyblock and preamble sections.
-			vmlinuz_header_offset = vmlinuz_header_address -
-				preamble->body_load_address +
-				keyblock->key_block_size +
-				preamble->preamble_size;
-			errcount |=
-				(1 != fwrite(kpart_data + vmlinuz_header_offset,
-					     vmlinuz_header_size,
-					     1,
-					     f));
+		rv = ExtractVmlinuzFromFd(in_fd, out_fd, NULL);
+		close(in_fd);
+		if (rv) {
+			VbExError("Unable to extract vmlinuz from %s\n",
+				  filename);
+			close(out_fd);
+			unlink(vmlinuz_out_file);
+			return 1;
 		}
-		errcount |= (1 != fwrite(kblob_data,
-					 kblob_size,
-					 1,
-					 f));
-		if (errcount) {
+		if (close(out_fd)) {
 			VbExError("Can't write output file %s\n",
 				  vmlinuz_out_file);
-			fclose(f);
 			unlink(vmlinuz_out_file);
 			return 1;
 		}
-
-		fclose(f);
 		return 0;
 	}
 
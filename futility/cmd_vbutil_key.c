@@ -46,10 +46,12 @@ static void print_help(const char *progname)
 	       "Usage:  " MYNAME " %s --pack <outfile> [PARAMETERS]\n"
 	       "\n"
 	       "  Required parameters:\n"
-	       "    --key <infile>              RSA key file (.keyb or .pem)\n"
+	       "    --key <infile>              RSA key file (.keyb or .pem;\n"
+	       "                                  a .pem packed into a .vbpubk\n"
+	       "                                  gives its public half)\n"
 	       "    --version <number>          Key version number "
-	       "(required for .keyb,\n"
-	       "                                  ignored for .pem)\n"
+	       "(required for .vbpubk,\n"
+	       "                                  ignored for .vbprivk)\n"
 	       "    --algorithm <number>        "
 	       "Signing algorithm to use with key:\n", progname);
 
@@ -66,12 +68,24 @@ static void print_help(const char *progname)
 	       "Write a copy of the key to this file.\n\n", progname);
 }
 
-/* Pack a .keyb file into a .vbpubk, or a .pem into a .vbprivk */
+/* Return non-zero if |name| ends in |ext|. */
+static int has_ext(const char *name, const char *ext)
+{
+	size_t len = strlen(name), ext_len = strlen(ext);
+
+	return len >= ext_len && !strcmp(name + len - ext_len, ext);
+}
+
+/*
+ * Pack a .keyb file into a .vbpubk, or a .pem into a .vbprivk. A .pem holding
+ * a certificate or public key, or any .pem packed into a .vbpubk, gives the
+ * .vbpubk directly, without needing dumpRSAPublicKey to make a .keyb first.
+ */
 static int Pack(const char *infile, const char *outfile, uint64_t algorithm,
 		uint64_t version)
 {
 	VbPublicKey *pubkey;
-	VbPrivateKey *privkey;
+	VbPrivateKey *privkey = NULL;
 
 	if (!infile || !outfile) {
 		fprintf(stderr, "vbutil_key: Must specify --in and --out\n");
@@ -79,6 +93,11 @@ static int Pack(const char *infile, const char *outfile, uint64_t algorithm,
 	}
 
 	pubkey = PublicKeyReadKeyb(infile, algorithm, version);
+	if (!pubkey && !has_ext(outfile, ".vbpubk"))
+		privkey = PrivateKeyReadPem(infile, algorithm);
+	if (!pubkey && !privkey)
+		pubkey = PublicKeyReadPem(infile, algorithm, version);
+
 	if (pubkey) {
 		if (0 != PublicKeyWrite(outfile, pubkey)) {
 			fprintf(stderr, "vbutil_key: Error writing key.\n");
@@ -88,7 +107,6 @@ static int Pack(const char *infile, const char *outfile, uint64_t algorithm,
 		return 0;
 	}
 
-	privkey = PrivateKeyReadPem(infile, algorithm);
 	if (privkey) {
 		if (0 != PrivateKeyWrite(outfile, privkey)) {
 			fprintf(stderr, "vbutil_key: Error writing key.\n");
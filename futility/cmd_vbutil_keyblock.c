@@ -14,6 +14,7 @@
 #include "cryptolib.h"
 #include "futility.h"
 #include "host_common.h"
+#include "host_crypto.h"
 #include "util_misc.h"
 #include "vboot_common.h"
 
@@ -63,6 +64,7 @@ static const char usage[] =
 	"  --flags <number>            Specifies allowed use conditions.\n"
 	"  --externalsigner \"cmd\""
 	"        Use an external program cmd to calculate the signatures.\n"
+	"                                Or the socket of a signing daemon.\n"
 	"\n"
 	"For '--unpack <file>', optional OPTIONS are:\n"
 	"  --signpubkey <file>"
@@ -237,6 +239,8 @@ static int do_vbutil_keyblock(int argc, char *argv[])
 	char *e;
 	int i;
 
+	vb2_host_crypto_select_env();
+
 	while ((i = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
 		switch (i) {
 		case '?':
@@ -0,0 +1,666 @@
+/*
+ * Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Checks a rootfs against the dm-verity hash tree stored after it, using the
+ * verity parameters from a kernel command line.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
+
+#include "futility.h"
+#include "host_common.h"
+#include "vboot_host.h"
+
+/* The hash tree layout matches the Chrome OS dm-bht code */
+#define VERITY_BLOCK_SIZE 4096
+#define VERITY_SECTORS_PER_BLOCK (VERITY_BLOCK_SIZE / 512)
+#define VERITY_SALT_SIZE 32
+#define VERITY_MAX_DEPTH 8
+
+/* Most mismatching data blocks each job lists; the rest are just counted */
+#define MAX_REPORTED 20
+
+struct verity_tree_s {
+	/* From the kernel command line */
+	enum vb2_hash_algorithm alg;
+	uint64_t block_count;
+	uint64_t hash_start;			/* in bytes */
+	uint8_t root_digest[VB2_SHA512_DIGEST_SIZE];
+	uint8_t salt[VERITY_SALT_SIZE];
+	int have_salt;
+
+	/* Shape of the tree */
+	uint32_t digest_size;
+	uint32_t node_shift;			/* log2(digests per block) */
+	int depth;
+	uint64_t level_count[VERITY_MAX_DEPTH];	/* level 0 is the root block */
+	uint64_t level_offset[VERITY_MAX_DEPTH];
+
+	/* The rootfs itself */
+	const uint8_t *buf;
+	uint64_t len;
+};
+
+struct leaf_job_s {
+	const struct verity_tree_s *tree;
+	uint64_t first;				/* leaf hash blocks to check */
+	uint64_t end;
+	pthread_t thread;
+	int started;
+	uint64_t bad_count;
+	uint64_t bad[MAX_REPORTED];
+};
+
+static const char usage[] = "\n"
+	"Usage:  " MYNAME " %s [OPTIONS] ROOTFS\n"
+	"\n"
+	"Checks a rootfs partition (or a copy of one) against the dm-verity\n"
+	"hash tree stored after it, using the verity parameters from the\n"
+	"kernel command line, and lists any blocks which don't match.\n"
+	"\n"
+	"Options (one of --kernel or --config is required):\n"
+	"  -k|--kernel FILE     Kernel partition to take the command line from\n"
+	"  -c|--config FILE     File holding the kernel command line\n"
+	"  -j|--jobs NUM        Number of threads hashing (default one per CPU)\n"
+	"\n";
+
+static void print_help(const char *prog)
+{
+	printf(usage, prog);
+}
+
+static const struct option long_opts[] = {
+	/* name    hasarg *flag  val */
+	{"kernel",   1, NULL, 'k'},
+	{"config",   1, NULL, 'c'},
+	{"jobs",     1, NULL, 'j'},
+	{"debug",    0, &debugging_enabled, 1},
+	{NULL,       0, NULL, 0},
+};
+
+/* Parse up to [max] bytes of hex from [str]. Returns the number of bytes, or
+ * -1 if there's anything other than pairs of hex digits. */
+static int parse_hex(uint8_t *dst, int max, const char *str, size_t len)
+{
+	char byte[3] = {0, 0, 0};
+	int count = 0;
+
+	if (len % 2)
+		return -1;
+	for (; len; len -= 2, str += 2) {
+		if (!isxdigit(str[0]) || !isxdigit(str[1]))
+			return -1;
+		if (count < max) {
+			byte[0] = str[0];
+			byte[1] = str[1];
+			dst[count++] = strtoul(byte, NULL, 16);
+		}
+	}
+	return count;
+}
+
+static int parse_alg(struct verity_tree_s *tree, const char *str, size_t len)
+{
+	if (len == 4 && !strncmp(str, "sha1", len))
+		tree->alg = VB2_HASH_SHA1;
+	else if (len == 6 && !strncmp(str, "sha256", len))
+		tree->alg = VB2_HASH_SHA256;
+	else if (len == 6 && !strncmp(str, "sha512", len))
+		tree->alg = VB2_HASH_SHA512;
+	else if (len == 11 && !strncmp(str, "blake2s-256", len))
+		tree->alg = VB2_HASH_BLAKE2S;
+	else {
+		fprintf(stderr, "Unsupported verity algorithm \"%.*s\"\n",
+			(int)len, str);
+		return 1;
+	}
+	tree->digest_size = vb2_digest_size(tree->alg);
+	return 0;
+}
+
+static int parse_root_digest(struct verity_tree_s *tree, const char *str,
+			     size_t len)
+{
+	if (!tree->digest_size ||
+	    parse_hex(tree->root_digest, sizeof(tree->root_digest), str, len) !=
+	    tree->digest_size) {
+		fprintf(stderr, "Invalid verity root digest\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int parse_u64(uint64_t *val, const char *str, size_t len)
+{
+	char num[24];
+	char *e;
+
+	if (!len || len >= sizeof(num))
+		return 1;
+	memcpy(num, str, len);
+	num[len] = 0;
+	*val = strtoull(num, &e, 10);
+	return *e != 0;
+}
+
+/*
+ * Find the verity target in the dm="..." part of [config], which looks like
+ *
+ *   dm="1 vroot none ro 1,0 2506752 verity payload=ROOT_DEV
+ *       hashtree=HASH_DEV hashstart=2506752 alg=sha1 root_hexdigest=...
+ *       salt=..."
+ *
+ * or in the old positional form,
+ *
+ *   dm="0 2097152 verity ROOT_DEV HASH_DEV 2097152 0 sha1 63b7ad16..."
+ *
+ * The hash tree is assumed to be on the same device as the payload, as the
+ * signing scripts put it.
+ */
+static int parse_verity_args(struct verity_tree_s *tree, const char *config)
+{
+	const char *dm, *dm_end, *target, *p, *e, *tok;
+	uint64_t sectors = 0, hash_start = 0;
+	int have_digest = 0, have_start = 0;
+	int positional = -1;
+	size_t len;
+
+	dm = strstr(config, "dm=\"");
+	if (!dm) {
+		fprintf(stderr, "No dm= in the kernel command line\n");
+		return 1;
+	}
+	dm += 4;
+	dm_end = strchr(dm, '"');
+	if (!dm_end)
+		dm_end = dm + strlen(dm);
+
+	/* "verity" follows the target's start and length */
+	for (target = dm; target < dm_end; target++) {
+		if (!strncmp(target, " verity ", 8))
+			break;
+	}
+	if (target >= dm_end) {
+		fprintf(stderr, "No verity target in dm=\"%.*s\"\n",
+			(int)(dm_end - dm), dm);
+		return 1;
+	}
+	for (p = target; p > dm && p[-1] != ','; p--)
+		;
+	/* The first number is the start; the length comes second */
+	if (sscanf(p, "%*u %" SCNu64, &sectors) != 1) {
+		fprintf(stderr, "Can't find the verity target length\n");
+		return 1;
+	}
+
+	/* Walk the arguments, up to the next target or the closing quote */
+	p = target + 8;
+	e = memchr(p, ',', dm_end - p);
+	if (!e)
+		e = dm_end;
+	while (p < e) {
+		while (p < e && *p == ' ')
+			p++;
+		tok = p;
+		while (p < e && *p != ' ')
+			p++;
+		len = p - tok;
+		if (!len)
+			break;
+
+		if (positional < 0)
+			positional = !memchr(tok, '=', len);
+
+		if (positional) {
+			/* payload hashtree hashstart depth alg digest */
+			positional++;
+			if (positional == 4) {
+				if (parse_u64(&hash_start, tok, len))
+					return 1;
+				have_start = 1;
+			} else if (positional == 6) {
+				if (parse_alg(tree, tok, len))
+					return 1;
+			} else if (positional == 7) {
+				if (parse_root_digest(tree, tok, len))
+					return 1;
+				have_digest = 1;
+			}
+		} else if (len > 10 && !strncmp(tok, "hashstart=", 10)) {
+			if (parse_u64(&hash_start, tok + 10, len - 10))
+				return 1;
+			have_start = 1;
+		} else if (len > 4 && !strncmp(tok, "alg=", 4)) {
+			if (parse_alg(tree, tok + 4, len - 4))
+				return 1;
+		} else if (len > 15 && !strncmp(tok, "root_hexdigest=", 15)) {
+			if (parse_root_digest(tree, tok + 15, len - 15))
+				return 1;
+			have_digest = 1;
+		} else if (len > 5 && !strncmp(tok, "salt=", 5)) {
+			/* Shorter salts are padded with zeros, as dm-bht
+			 * does */
+			memset(tree->salt, 0, sizeof(tree->salt));
+			if (parse_hex(tree->salt, sizeof(tree->salt),
+				      tok + 5, len - 5) < 0) {
+				fprintf(stderr, "Invalid verity salt\n");
+				return 1;
+			}
+			tree->have_salt = 1;
+		}
+	}
+
+	if (!tree->digest_size || !have_digest || !have_start) {
+		fprintf(stderr, "Incomplete verity arguments\n");
+		return 1;
+	}
+	if (sectors % VERITY_SECTORS_PER_BLOCK ||
+	    hash_start % VERITY_SECTORS_PER_BLOCK) {
+		fprintf(stderr, "Verity sizes aren't a whole number of "
+			"blocks\n");
+		return 1;
+	}
+	tree->block_count = sectors / VERITY_SECTORS_PER_BLOCK;
+	tree->hash_start = hash_start * 512;
+	return 0;
+}
+
+/* Index of the highest set bit, counting from 1; 0 if none */
+static int fls64(uint64_t x)
+{
+	int bit = 0;
+
+	while (x) {
+		bit++;
+		x >>= 1;
+	}
+	return bit;
+}
+
+/* Work out where each level of the tree is, the way dm-bht does */
+static int lay_out_tree(struct verity_tree_s *tree)
+{
+	uint64_t node_count, last_index, offset;
+	int bits, d;
+
+	tree->node_shift = fls64(VERITY_BLOCK_SIZE / tree->digest_size) - 1;
+	node_count = 1ULL << tree->node_shift;
+
+	if (tree->block_count < 2) {
+		fprintf(stderr, "The rootfs is too small for a hash tree\n");
+		return 1;
+	}
+	bits = fls64(tree->block_count - 1);
+	tree->depth = (bits + tree->node_shift - 1) / tree->node_shift;
+	if (tree->depth > VERITY_MAX_DEPTH) {
+		fprintf(stderr, "The rootfs is too big\n");
+		return 1;
+	}
+
+	/* Levels are stored root first */
+	last_index = ((tree->block_count + node_count - 1) & ~(node_count - 1))
+		- 1;
+	offset = tree->hash_start;
+	for (d = 0; d < tree->depth; d++) {
+		tree->level_count[d] = (last_index >>
+			((tree->depth - d) * tree->node_shift)) + 1;
+		tree->level_offset[d] = offset;
+		offset += tree->level_count[d] * VERITY_BLOCK_SIZE;
+	}
+
+	if (tree->hash_start < tree->block_count * VERITY_BLOCK_SIZE ||
+	    offset > tree->len) {
+		fprintf(stderr, "The hash tree isn't inside the rootfs "
+			"(needs %" PRIu64 " bytes, have %" PRIu64 ")\n",
+			offset, tree->len);
+		return 1;
+	}
+	return 0;
+}
+
+/* Hash one block, with the salt after it if there is one */
+static void hash_block(const struct verity_tree_s *tree, const uint8_t *block,
+		       uint8_t *digest)
+{
+	struct vb2_digest_context dc;
+
+	vb2_digest_init(&dc, tree->alg);
+	vb2_digest_extend(&dc, block, VERITY_BLOCK_SIZE);
+	if (tree->have_salt)
+		vb2_digest_extend(&dc, tree->salt, sizeof(tree->salt));
+	vb2_digest_finalize(&dc, digest, tree->digest_size);
+}
+
+/* Stored digest [index] in level [d] */
+static const uint8_t *stored_digest(const struct verity_tree_s *tree, int d,
+				    uint64_t index)
+{
+	uint64_t block = index >> tree->node_shift;
+	uint64_t node = index & ((1ULL << tree->node_shift) - 1);
+
+	return tree->buf + tree->level_offset[d] + block * VERITY_BLOCK_SIZE +
+		node * tree->digest_size;
+}
+
+static void note_bad(struct leaf_job_s *job, uint64_t block)
+{
+	if (job->bad_count < MAX_REPORTED)
+		job->bad[job->bad_count] = block;
+	job->bad_count++;
+}
+
+/* Check the data blocks covered by leaf hash blocks [first, end) */
+static void *leaf_thread(void *arg)
+{
+	struct leaf_job_s *job = arg;
+	const struct verity_tree_s *tree = job->tree;
+	int leaf = tree->depth - 1;
+	uint64_t per_leaf = 1ULL << tree->node_shift;
+	uint64_t block = job->first * per_leaf;
+	uint64_t end = job->end * per_leaf;
+	uint8_t digests[VB2_DIGEST_MULTI_LANES][VB2_SHA512_DIGEST_SIZE];
+	const uint8_t *bufs[VB2_DIGEST_MULTI_LANES];
+	uint8_t *outs[VB2_DIGEST_MULTI_LANES];
+	uint32_t sizes[VB2_DIGEST_MULTI_LANES];
+	uint64_t ahead = block;
+	uint32_t count, i;
+
+	if (end > tree->block_count)
+		end = tree->block_count;
+
+	for (i = 0; i < VB2_DIGEST_MULTI_LANES; i++) {
+		outs[i] = digests[i];
+		sizes[i] = VERITY_BLOCK_SIZE;
+	}
+
+	while (block < end) {
+		/* Ask for the next leaf's worth of data while this one is
+		 * being hashed */
+		if (ahead <= block) {
+			ahead = block + per_leaf;
+			if (ahead < end)
+				madvise((void *)(((uintptr_t)tree->buf + ahead *
+						  VERITY_BLOCK_SIZE) &
+						 ~(uintptr_t)(getpagesize() - 1)),
+					(end - ahead < per_leaf ?
+					 end - ahead : per_leaf) *
+					VERITY_BLOCK_SIZE, MADV_WILLNEED);
+		}
+
+		count = end - block < VB2_DIGEST_MULTI_LANES ?
+			end - block : VB2_DIGEST_MULTI_LANES;
+		if (tree->have_salt) {
+			for (i = 0; i < count; i++)
+				hash_block(tree, tree->buf + (block + i) *
+					   VERITY_BLOCK_SIZE, digests[i]);
+		} else {
+			for (i = 0; i < count; i++)
+				bufs[i] = tree->buf + (block + i) *
+					VERITY_BLOCK_SIZE;
+			vb2_digest_multi(tree->alg, count, bufs, sizes, outs,
+					 sizeof(digests[0]));
+		}
+
+		for (i = 0; i < count; i++, block++)
+			if (memcmp(digests[i], stored_digest(tree, leaf, block),
+				   tree->digest_size))
+				note_bad(job, block);
+	}
+
+	return NULL;
+}
+
+/* Check every data block against the leaf level, on [jobs] threads. Returns
+ * the number of blocks that don't match. */
+static uint64_t verify_leaves(const struct verity_tree_s *tree, long jobs)
+{
+	uint64_t leaves = tree->level_count[tree->depth - 1];
+	struct leaf_job_s *job;
+	uint64_t bad = 0, each;
+	long i;
+	int j, listed = 0;
+
+	if (jobs > leaves)
+		jobs = leaves;
+	if (jobs < 1)
+		jobs = 1;
+	job = calloc(jobs, sizeof(*job));
+	if (!job) {
+		fprintf(stderr, "Out of memory\n");
+		return tree->block_count;
+	}
+
+	each = (leaves + jobs - 1) / jobs;
+	for (i = 0; i < jobs; i++) {
+		job[i].tree = tree;
+		job[i].first = i * each;
+		job[i].end = (i + 1) * each < leaves ? (i + 1) * each : leaves;
+	}
+	Debug("hashing %" PRIu64 " blocks with %ld jobs\n",
+	      tree->block_count, jobs);
+
+	/* The last one (and any that can't get a thread) runs here */
+	for (i = 0; i < jobs - 1; i++)
+		job[i].started = !pthread_create(&job[i].thread, NULL,
+						 leaf_thread, &job[i]);
+	for (i = 0; i < jobs; i++)
+		if (i == jobs - 1 || !job[i].started)
+			leaf_thread(&job[i]);
+
+	for (i = 0; i < jobs; i++) {
+		if (job[i].started)
+			pthread_join(job[i].thread, NULL);
+		for (j = 0; j < job[i].bad_count && j < MAX_REPORTED; j++)
+			if (listed++ < MAX_REPORTED)
+				printf("Block %" PRIu64 " doesn't match its "
+				       "hash\n", job[i].bad[j]);
+		bad += job[i].bad_count;
+	}
+	if (bad > listed)
+		printf("...and %" PRIu64 " more blocks\n", bad - listed);
+
+	free(job);
+	return bad;
+}
+
+/* Check each hash block above the leaves against its parent, and the root
+ * block against the root digest. Returns the number that don't match. */
+static uint64_t verify_upper_levels(const struct verity_tree_s *tree)
+{
+	uint8_t digest[VB2_SHA512_DIGEST_SIZE];
+	uint64_t bad = 0, i;
+	int d;
+
+	for (d = tree->depth - 1; d > 0; d--) {
+		for (i = 0; i < tree->level_count[d]; i++) {
+			hash_block(tree, tree->buf + tree->level_offset[d] +
+				   i * VERITY_BLOCK_SIZE, digest);
+			if (memcmp(digest, stored_digest(tree, d - 1, i),
+				   tree->digest_size)) {
+				printf("Hash block %" PRIu64 " at level %d "
+				       "doesn't match its hash\n", i, d);
+				bad++;
+			}
+		}
+	}
+
+	hash_block(tree, tree->buf + tree->level_offset[0], digest);
+	if (memcmp(digest, tree->root_digest, tree->digest_size)) {
+		printf("Root hash doesn't match\n");
+		bad++;
+	}
+
+	return bad;
+}
+
+static char *read_config(const char *kernel, const char *config_file)
+{
+	uint8_t *data;
+	uint64_t size;
+	char *config;
+
+	if (kernel)
+		return FindKernelConfig(kernel, USE_PREAMBLE_LOAD_ADDR);
+
+	data = ReadFile(config_file, &size);
+	if (!data)
+		return NULL;
+	config = malloc(size + 1);
+	if (config) {
+		memcpy(config, data, size);
+		config[size] = 0;
+	}
+	free(data);
+	return config;
+}
+
+static int do_verify_rootfs(int argc, char *argv[])
+{
+	struct verity_tree_s tree;
+	const char *kernel = NULL, *config_file = NULL;
+	char *config = NULL;
+	long jobs = futil_default_jobs();
+	uint64_t bad_blocks, bad_hashes;
+	void *map = MAP_FAILED;
+	off_t size;
+	int errorcnt = 0;
+	int fd = -1;
+	char *e;
+	int i;
+
+	opterr = 0;		/* quiet, you */
+	while ((i = getopt_long(argc, argv, ":k:c:j:", long_opts,
+				NULL)) != -1) {
+		switch (i) {
+		case 'k':
+			kernel = optarg;
+			break;
+		case 'c':
+			config_file = optarg;
+			break;
+		case 'j':
+			jobs = strtol(optarg, &e, 0);
+			if (!*optarg || (e && *e) || jobs < 1) {
+				fprintf(stderr, "Invalid --jobs \"%s\"\n",
+					optarg);
+				errorcnt++;
+			}
+			break;
+		case '?':
+			if (optopt)
+				fprintf(stderr, "Unrecognized option: -%c\n",
+					optopt);
+			else
+				fprintf(stderr, "Unrecognized option: %s\n",
+					argv[optind - 1]);
+			errorcnt++;
+			break;
+		case ':':
+			fprintf(stderr, "Missing argument to -%c\n", optopt);
+			errorcnt++;
+			break;
+		case 0:				/* handled option */
+			break;
+		default:
+			DIE;
+		}
+	}
+
+	if (!kernel == !config_file) {
+		fprintf(stderr, "Give one of --kernel or --config\n");
+		errorcnt++;
+	}
+	if (argc - optind != 1) {
+		fprintf(stderr, "Give one rootfs\n");
+		errorcnt++;
+	}
+	if (errorcnt) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	memset(&tree, 0, sizeof(tree));
+	config = read_config(kernel, config_file);
+	if (!config) {
+		fprintf(stderr, "Can't read the kernel command line\n");
+		return 1;
+	}
+	if (parse_verity_args(&tree, config)) {
+		free(config);
+		return 1;
+	}
+	free(config);
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Can't open %s: %s\n", argv[optind],
+			strerror(errno));
+		return 1;
+	}
+	/* Works for block devices too, unlike fstat() */
+	size = lseek(fd, 0, SEEK_END);
+	if (size <= 0 || (uint64_t)size > SIZE_MAX) {
+		fprintf(stderr, "Can't map %s\n", argv[optind]);
+		goto fail;
+	}
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Can't map %s: %s\n", argv[optind],
+			strerror(errno));
+		goto fail;
+	}
+	/* The data is read once, front to back within each job */
+	madvise(map, size, MADV_SEQUENTIAL);
+
+	tree.buf = map;
+	tree.len = size;
+	if (lay_out_tree(&tree))
+		goto fail;
+
+	printf("Verifying %" PRIu64 " blocks, hash tree at sector %" PRIu64
+	       ", depth %d\n", tree.block_count, tree.hash_start / 512,
+	       tree.depth);
+
+	bad_blocks = verify_leaves(&tree, jobs);
+	bad_hashes = verify_upper_levels(&tree);
+
+	munmap(map, size);
+	close(fd);
+
+	if (bad_blocks || bad_hashes) {
+		printf("FAILED: %" PRIu64 " data blocks and %" PRIu64
+		       " hash blocks don't match\n", bad_blocks, bad_hashes);
+		return 1;
+	}
+	printf("PASS: rootfs hash is correct\n");
+	return 0;
+
+ fail:
+	if (map != MAP_FAILED)
+		munmap(map, size);
+	close(fd);
+	return 1;
+}
+
+DECLARE_FUTIL_COMMAND(verify_rootfs, do_verify_rootfs,
+		      VBOOT_VERSION_ALL,
+		      "Check a rootfs against its dm-verity hash tree",
+		      print_help);
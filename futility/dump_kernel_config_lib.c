@@ -5,7 +5,10 @@
  * Exports the kernel commandline from a given partition/image.
  */
 
+#include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/fcntl.h>
@@ -24,32 +27,15 @@
 #include <mtdutils.h>
 #endif
 
+#ifdef USE_MTD
+/* MTD devices can only be read in order, so they skip along instead */
 typedef ssize_t (*ReadFullyFn)(void *ctx, void *buf, size_t count);
 
-static ssize_t ReadFullyWithRead(void *ctx, void *buf, size_t count)
-{
-	ssize_t nr_read = 0;
-	int fd = *((int*)ctx);
-	while (nr_read < count) {
-		ssize_t to_read = count - nr_read;
-		ssize_t chunk = read(fd, buf + nr_read, to_read);
-		if (chunk < 0) {
-			return -1;
-		} else if (chunk == 0) {
-			break;
-		}
-		nr_read += chunk;
-	}
-	return nr_read;
-}
-
-#ifdef USE_MTD
 static ssize_t ReadFullyWithMtdRead(void *ctx, void *buf, size_t count)
 {
 	MtdReadContext *mtd_ctx = (MtdReadContext*)ctx;
 	return mtd_read_data(mtd_ctx, buf, count);
 }
-#endif
 
 /* Skip the stream by calling |read_fn| many times. Return 0 on success. */
 static int SkipWithRead(void *ctx, ReadFullyFn read_fn, size_t count)
@@ -130,46 +116,178 @@ static char *FindKernelConfigFromStream(void *ctx, ReadFullyFn read_fn,
 	}
 	return ret;
 }
+#endif  /* USE_MTD */
+
+/* Good enough alignment for O_DIRECT on any disk */
+#define DIRECT_ALIGN 4096
+
+/*
+ * Read |count| bytes at |offset|, stopping short only at the end of the file.
+ * Returns the number of bytes read, or -1 on error.
+ */
+static ssize_t PreadFully(int fd, void *buf, size_t count, off_t offset)
+{
+	ssize_t nr_read = 0;
+	while (nr_read < count) {
+		ssize_t chunk = pread(fd, buf + nr_read, count - nr_read,
+				      offset + nr_read);
+		if (chunk < 0) {
+			return -1;
+		} else if (chunk == 0) {
+			break;
+		}
+		nr_read += chunk;
+	}
+	return nr_read;
+}
+
+/*
+ * Like PreadFully(), but if |fd| was opened with O_DIRECT, read whole
+ * aligned blocks through a bounce buffer instead. If the file system doesn't
+ * do O_DIRECT after all, turn it off and read normally.
+ */
+static ssize_t ReadAt(int fd, void *buf, size_t count, off_t offset)
+{
+#ifdef O_DIRECT
+	int flags = fcntl(fd, F_GETFL);
+	off_t start = offset & ~(off_t)(DIRECT_ALIGN - 1);
+	off_t end = (offset + count + DIRECT_ALIGN - 1) &
+		~(off_t)(DIRECT_ALIGN - 1);
+	void *bounce;
+	ssize_t nr_read;
+
+	if (flags >= 0 && (flags & O_DIRECT)) {
+		if (posix_memalign(&bounce, DIRECT_ALIGN, end - start))
+			return -1;
+		nr_read = PreadFully(fd, bounce, end - start, start);
+		if (nr_read < 0 && errno == EINVAL) {
+			free(bounce);
+			if (fcntl(fd, F_SETFL, flags & ~O_DIRECT))
+				return -1;
+			return PreadFully(fd, buf, count, offset);
+		}
+		if (nr_read >= 0) {
+			nr_read -= offset - start;
+			if (nr_read < 0)
+				nr_read = 0;
+			if (nr_read > count)
+				nr_read = count;
+			memcpy(buf, bounce + (offset - start), nr_read);
+		}
+		free(bounce);
+		return nr_read;
+	}
+#endif
+	return PreadFully(fd, buf, count, offset);
+}
+
+char *FindKernelConfigFromFd(int fd, uint64_t kernel_body_load_address)
+{
+	VbKeyBlockHeader key_block;
+	VbKernelPreambleHeader preamble;
+	uint64_t now, offset;
+	char *ret;
+
+	/* Only the headers and the config itself need to be read */
+	if (ReadAt(fd, &key_block, sizeof(key_block), 0) !=
+	    sizeof(key_block)) {
+		VbExError("not enough data to fill key block header\n");
+		return NULL;
+	}
+	if (key_block.key_block_size < sizeof(key_block)) {
+		VbExError("key_block_size advances past the end of the blob\n");
+		return NULL;
+	}
+	now = key_block.key_block_size;
+
+	if (ReadAt(fd, &preamble, sizeof(preamble), now) != sizeof(preamble)) {
+		VbExError("not enough data to fill preamble\n");
+		return NULL;
+	}
+	if (preamble.preamble_size < sizeof(preamble)) {
+		VbExError("preamble_size advances past the end of the blob\n");
+		return NULL;
+	}
+	now += preamble.preamble_size;
+
+	/* The config can't be read without decompressing the whole body */
+	if (preamble.header_version_minor >= 4 &&
+	    preamble.body_compression != COMPRESS_NONE) {
+		VbExError("kernel body is compressed\n");
+		return NULL;
+	}
+
+	/* Read body_load_address from preamble if no
+	 * kernel_body_load_address */
+	if (kernel_body_load_address == USE_PREAMBLE_LOAD_ADDR)
+		kernel_body_load_address = preamble.body_load_address;
+
+	/* The x86 kernels have a pointer to the kernel commandline in the
+	 * zeropage table, but that's irrelevant for ARM. Both types keep the
+	 * config blob in the same place, so just go find it. */
+	if (preamble.bootloader_address < kernel_body_load_address +
+	    CROS_PARAMS_SIZE + CROS_CONFIG_SIZE) {
+		VbExError("params are outside of the memory blob: %" PRIx64
+			  "\n", preamble.bootloader_address);
+		return NULL;
+	}
+	offset = preamble.bootloader_address -
+	    (kernel_body_load_address + CROS_PARAMS_SIZE +
+	     CROS_CONFIG_SIZE) + now;
+
+	ret = malloc(CROS_CONFIG_SIZE);
+	if (!ret) {
+		VbExError("No memory\n");
+		return NULL;
+	}
+	if (ReadAt(fd, ret, CROS_CONFIG_SIZE, offset) != CROS_CONFIG_SIZE) {
+		VbExError("Cannot read kernel config\n");
+		free(ret);
+		ret = NULL;
+	}
+	return ret;
+}
 
 char *FindKernelConfig(const char *infile, uint64_t kernel_body_load_address)
 {
 	char *newstr = NULL;
+	int fd = -1;
 
-	int fd = open(infile, O_RDONLY | O_CLOEXEC | O_LARGEFILE);
+#ifdef O_DIRECT
+	/* Keep a few KiB of a live disk from going through the page cache */
+	fd = open(infile, O_RDONLY | O_CLOEXEC | O_LARGEFILE | O_DIRECT);
+#endif
+	if (fd < 0)
+		fd = open(infile, O_RDONLY | O_CLOEXEC | O_LARGEFILE);
 	if (fd < 0) {
 		VbExError("Cannot open %s\n", infile);
 		return NULL;
 	}
 
-	void *ctx = &fd;
-	ReadFullyFn read_fn = ReadFullyWithRead;
-
 #ifdef USE_MTD
 	struct stat stat_buf;
 	if (fstat(fd, &stat_buf)) {
 		VbExError("Cannot stat %s\n", infile);
+		close(fd);
 		return NULL;
 	}
 
-	int is_mtd = (major(stat_buf.st_rdev) == MTD_CHAR_MAJOR);
-	if (is_mtd) {
-		ctx = mtd_read_descriptor(fd, infile);
+	if (major(stat_buf.st_rdev) == MTD_CHAR_MAJOR) {
+		void *ctx = mtd_read_descriptor(fd, infile);
 		if (!ctx) {
 			VbExError("Cannot read from MTD device %s\n", infile);
+			close(fd);
 			return NULL;
 		}
-		read_fn = ReadFullyWithMtdRead;
-	}
-#endif
-
-	newstr = FindKernelConfigFromStream(ctx, read_fn,
-					    kernel_body_load_address);
-
-#ifdef USE_MTD
-	if (is_mtd) {
+		newstr = FindKernelConfigFromStream(ctx, ReadFullyWithMtdRead,
+						    kernel_body_load_address);
 		mtd_read_close(ctx);
+		close(fd);
+		return newstr;
 	}
 #endif
+
+	newstr = FindKernelConfigFromFd(fd, kernel_body_load_address);
 	close(fd);
 
 	return newstr;
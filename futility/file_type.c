@@ -32,6 +32,7 @@ static const char * const type_strings[] = {
 	"raw kernel",
 	"chromiumos disk image",
 	"VbPrivateKey",
+	"VbSharedData",
 };
 BUILD_ASSERT(ARRAY_SIZE(type_strings) == NUM_FILE_TYPES);
 
@@ -48,6 +49,7 @@ enum futil_file_type (*recognizers[])(uint8_t *buf, uint32_t len) = {
 	&recognize_gpt,
 	&recognize_bios_image,
 	&recognize_gbb,
+	&recognize_vb_shared_data,
 	&recognize_vblock1,
 	&recognize_privkey,
 };
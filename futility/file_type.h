@@ -23,6 +23,7 @@ enum futil_file_type {
 
 	FILE_TYPE_CHROMIUMOS_DISK,		/* At least it has a GPT */
 	FILE_TYPE_PRIVKEY,			/* VbPrivateKey */
+	FILE_TYPE_VB_SHARED_DATA,		/* VbSharedDataHeader */
 
 	NUM_FILE_TYPES
 };
@@ -48,5 +49,6 @@ enum futil_file_type recognize_gbb(uint8_t *buf, uint32_t len);
 enum futil_file_type recognize_vblock1(uint8_t *buf, uint32_t len);
 enum futil_file_type recognize_gpt(uint8_t *buf, uint32_t len);
 enum futil_file_type recognize_privkey(uint8_t *buf, uint32_t len);
+enum futil_file_type recognize_vb_shared_data(uint8_t *buf, uint32_t len);
 
 #endif	/* VBOOT_REFERENCE_FUTILITY_FILE_TYPE_H_ */
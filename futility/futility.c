@@ -24,6 +24,9 @@
 /* File to use for logging, if present */
 #define LOGFILE "/tmp/futility.log"
 
+/* Environment variable naming a different file; if it's empty, don't log */
+#define LOGFILE_ENV "FUTILITY_LOGFILE"
+
 /* Normally logging will only happen if the logfile already exists. Uncomment
  * this to force log file creation (and thus logging) always. */
 
@@ -31,40 +34,55 @@
 
 static int log_fd = -1;
 
-/* Write the string and a newline. Silently give up on errors */
-static void log_str(char *prefix, char *str)
+/* Log entries are collected here, so each one takes a write() or two */
+static char log_buf[4096];
+static int log_len;
+
+/* Write out what's collected so far. Silently give up on errors */
+static void log_flush(void)
+{
+	int done, n;
+
+	for (done = 0; done < log_len; done += n) {
+		n = write(log_fd, log_buf + done, log_len - done);
+		if (n < 0)
+			break;
+	}
+	log_len = 0;
+}
+
+static void log_put(const char *str, int len)
 {
-	int len, done, n;
+	int n;
+
+	while (len > 0) {
+		if (log_len == sizeof(log_buf))
+			log_flush();
+		n = sizeof(log_buf) - log_len;
+		if (n > len)
+			n = len;
+		memcpy(log_buf + log_len, str, n);
+		log_len += n;
+		str += n;
+		len -= n;
+	}
+}
 
+/* Add the string and a newline */
+static void log_str(char *prefix, char *str)
+{
 	if (log_fd < 0)
 		return;
 
 	if (!str)
 		str = "(NULL)";
-
-	if (prefix && *prefix) {
-		len = strlen(prefix);
-		for (done = 0; done < len; done += n) {
-			n = write(log_fd, prefix + done, len - done);
-			if (n < 0)
-				return;
-		}
-	}
-
-	len = strlen(str);
-	if (len == 0) {
+	if (!*str)
 		str = "(EMPTY)";
-		len = strlen(str);
-	}
-
-	for (done = 0; done < len; done += n) {
-		n = write(log_fd, str + done, len - done);
-		if (n < 0)
-			return;
-	}
 
-	if (write(log_fd, "\n", 1) < 0)
-		return;
+	if (prefix)
+		log_put(prefix, strlen(prefix));
+	log_put(str, strlen(str));
+	log_put("\n", 1);
 }
 
 static void log_close(void)
@@ -72,6 +90,8 @@ static void log_close(void)
 	struct flock lock;
 
 	if (log_fd >= 0) {
+		log_flush();
+
 		memset(&lock, 0, sizeof(lock));
 		lock.l_type = F_UNLCK;
 		lock.l_whence = SEEK_SET;
@@ -86,12 +106,18 @@ static void log_close(void)
 static void log_open(void)
 {
 	struct flock lock;
+	const char *logfile = getenv(LOGFILE_ENV);
 	int ret;
 
+	if (!logfile)
+		logfile = LOGFILE;
+	else if (!*logfile)
+		return;
+
 #ifdef FORCE_LOGGING_ON
-	log_fd = open(LOGFILE, O_WRONLY | O_APPEND | O_CREAT, 0666);
+	log_fd = open(logfile, O_WRONLY | O_APPEND | O_CREAT, 0666);
 #else
-	log_fd = open(LOGFILE, O_WRONLY | O_APPEND);
+	log_fd = open(logfile, O_WRONLY | O_APPEND);
 #endif
 	if (log_fd < 0) {
 
@@ -100,7 +126,7 @@ static void log_open(void)
 
 		/* Permission problems should improve shortly ... */
 		sleep(1);
-		log_fd = open(LOGFILE, O_WRONLY | O_APPEND | O_CREAT, 0666);
+		log_fd = open(logfile, O_WRONLY | O_APPEND | O_CREAT, 0666);
 		if (log_fd < 0)	/* Nope, they didn't */
 			return;
 	}
@@ -129,6 +155,10 @@ static void log_args(int argc, char *argv[])
 
 	log_open();
 
+	/* Nothing to log to, so don't bother looking at our caller */
+	if (log_fd < 0)
+		return;
+
 	/* delimiter */
 	log_str(NULL, "##### LOG #####");
 
@@ -189,6 +219,10 @@ static const char *const usage = "\n"
 "When symlinked under the name of one of those previous tools, it should\n"
 "fully implement the original behavior. It can also be invoked directly\n"
 "as " MYNAME ", followed by the original name as the first argument.\n"
+"\n"
+"Each invocation is logged to " LOGFILE ", if that file exists.\n"
+"Set " LOGFILE_ENV " to log somewhere else, or to nothing to turn\n"
+"logging off.\n"
 "\n";
 
 static const char *const options =
@@ -198,12 +232,21 @@ static const char *const options =
 "  --vb21       Use only vboot v2.1 binary formats\n"
 "\n";
 
+/* Command names are C identifiers, so let '-' stand for '_' */
+static int command_matches(const char *cmd_name, const char *name)
+{
+	for (; *cmd_name && *name; cmd_name++, name++)
+		if (*cmd_name != *name && !(*cmd_name == '_' && *name == '-'))
+			return 0;
+	return *cmd_name == *name;
+}
+
 static const struct futil_cmd_t *find_command(const char *name)
 {
 	const struct futil_cmd_t *const *cmd;
 
 	for (cmd = futil_cmds; *cmd; cmd++)
-		if (0 == strcmp((*cmd)->name, name))
+		if (command_matches((*cmd)->name, name))
 			return *cmd;
 
 	return NULL;
@@ -136,6 +136,13 @@ enum futil_file_err futil_map_file(int fd, int writeable,
 enum futil_file_err futil_unmap_file(int fd, int writeable,
 				     uint8_t *buf, uint32_t len);
 
+/* How many jobs to run at once when the command line doesn't say: one per
+ * online CPU, and at least one. */
+long futil_default_jobs(void);
+
+/* Disk images use 512-byte sectors */
+#define DISK_SECTOR_SIZE 512
+
 /* The CPU architecture is occasionally important */
 enum arch_t {
 	ARCH_UNSPECIFIED,
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_writer.h"
+
+void json_init(struct json_writer *w)
+{
+	memset(w, 0, sizeof(*w));
+}
+
+void json_free(struct json_writer *w)
+{
+	free(w->buf);
+	json_init(w);
+}
+
+/* Make room for [more] bytes. Returns nonzero if there isn't any. */
+static int reserve(struct json_writer *w, size_t more)
+{
+	char *buf;
+	size_t size;
+
+	if (w->error)
+		return 1;
+	if (w->len + more <= w->size)
+		return 0;
+
+	size = w->size ? w->size : 4096;
+	while (size < w->len + more)
+		size *= 2;
+	buf = realloc(w->buf, size);
+	if (!buf) {
+		w->error = 1;
+		return 1;
+	}
+	w->buf = buf;
+	w->size = size;
+	return 0;
+}
+
+static void put(struct json_writer *w, const char *str, size_t len)
+{
+	if (reserve(w, len))
+		return;
+	memcpy(w->buf + w->len, str, len);
+	w->len += len;
+}
+
+static void put_string(struct json_writer *w, const char *str)
+{
+	static const char hex[] = "0123456789abcdef";
+	const unsigned char *s;
+	char esc[6] = {'\\', 'u', '0', '0'};
+
+	put(w, "\"", 1);
+	for (s = (const unsigned char *)str; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			esc[1] = *s;
+			put(w, esc, 2);
+		} else if (*s < 0x20) {
+			esc[1] = 'u';
+			esc[4] = hex[*s >> 4];
+			esc[5] = hex[*s & 0xf];
+			put(w, esc, 6);
+		} else {
+			put(w, (const char *)s, 1);
+		}
+	}
+	put(w, "\"", 1);
+}
+
+/* Separate this value from the one before it, and give it its key */
+static void begin_value(struct json_writer *w, const char *key)
+{
+	if (w->count[w->depth])
+		put(w, ",", 1);
+	w->count[w->depth] = 1;
+
+	if (key) {
+		put_string(w, key);
+		put(w, ":", 1);
+	}
+}
+
+static void begin_nested(struct json_writer *w, const char *key, char c)
+{
+	begin_value(w, key);
+	put(w, &c, 1);
+	if (w->depth + 1 >= JSON_MAX_DEPTH) {
+		w->error = 1;
+		return;
+	}
+	w->count[++w->depth] = 0;
+}
+
+static void end_nested(struct json_writer *w, char c)
+{
+	put(w, &c, 1);
+	if (w->depth)
+		w->depth--;
+}
+
+void json_begin_object(struct json_writer *w, const char *key)
+{
+	begin_nested(w, key, '{');
+}
+
+void json_end_object(struct json_writer *w)
+{
+	end_nested(w, '}');
+}
+
+void json_begin_array(struct json_writer *w, const char *key)
+{
+	begin_nested(w, key, '[');
+}
+
+void json_end_array(struct json_writer *w)
+{
+	end_nested(w, ']');
+}
+
+void json_string(struct json_writer *w, const char *key, const char *val)
+{
+	begin_value(w, key);
+	put_string(w, val);
+}
+
+void json_uint(struct json_writer *w, const char *key, uint64_t val)
+{
+	char num[24];
+
+	begin_value(w, key);
+	put(w, num, snprintf(num, sizeof(num), "%" PRIu64, val));
+}
+
+void json_bool(struct json_writer *w, const char *key, int val)
+{
+	begin_value(w, key);
+	if (val)
+		put(w, "true", 4);
+	else
+		put(w, "false", 5);
+}
+
+void json_hex(struct json_writer *w, const char *key,
+	      const uint8_t *data, size_t size)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t i;
+
+	begin_value(w, key);
+	if (reserve(w, 2 * size + 2))
+		return;
+	w->buf[w->len++] = '"';
+	for (i = 0; i < size; i++) {
+		w->buf[w->len++] = hex[data[i] >> 4];
+		w->buf[w->len++] = hex[data[i] & 0xf];
+	}
+	w->buf[w->len++] = '"';
+}
+
+int json_flush(struct json_writer *w, FILE *fp)
+{
+	int rv = w->error;
+
+	put(w, "\n", 1);
+	if (!w->error && w->len && 1 != fwrite(w->buf, w->len, 1, fp))
+		rv = 1;
+
+	w->len = 0;
+	w->depth = 0;
+	w->count[0] = 0;
+	w->error = 0;
+	return rv;
+}
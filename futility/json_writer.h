@@ -0,0 +1,56 @@
+/*
+ * Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+#ifndef VBOOT_REFERENCE_FUTILITY_JSON_WRITER_H_
+#define VBOOT_REFERENCE_FUTILITY_JSON_WRITER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * A small writer for compact JSON. Everything goes into one growing buffer,
+ * so a whole document only costs a single write when it's flushed.
+ */
+
+#define JSON_MAX_DEPTH 16
+
+struct json_writer {
+	char *buf;
+	size_t len;
+	size_t size;
+	int depth;
+	uint8_t count[JSON_MAX_DEPTH];		/* nonzero once used */
+	int error;				/* out of memory or depth */
+};
+
+/* Start with an empty buffer. */
+void json_init(struct json_writer *w);
+
+/* Free the buffer. */
+void json_free(struct json_writer *w);
+
+/*
+ * Each value takes a key, which must be NULL at the top level and inside
+ * arrays, and non-NULL inside objects.
+ */
+void json_begin_object(struct json_writer *w, const char *key);
+void json_end_object(struct json_writer *w);
+void json_begin_array(struct json_writer *w, const char *key);
+void json_end_array(struct json_writer *w);
+void json_string(struct json_writer *w, const char *key, const char *val);
+void json_uint(struct json_writer *w, const char *key, uint64_t val);
+void json_bool(struct json_writer *w, const char *key, int val);
+
+/* A string of lowercase hex digits for [size] bytes of [data]. */
+void json_hex(struct json_writer *w, const char *key,
+	      const uint8_t *data, size_t size);
+
+/*
+ * Write everything out to [fp], followed by a newline, and empty the buffer.
+ * Returns nonzero if there was an error here or since the last flush.
+ */
+int json_flush(struct json_writer *w, FILE *fp);
+
+#endif	/* VBOOT_REFERENCE_FUTILITY_JSON_WRITER_H_ */
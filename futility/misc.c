@@ -5,25 +5,23 @@
  */
 
 #include <errno.h>
-#ifndef HAVE_MACOS
-#include <linux/fs.h>		/* For BLKGETSIZE64 */
-#endif
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "2sysincludes.h"
+#include "2return_codes.h"
 #include "cgptlib_internal.h"
 #include "file_type.h"
 #include "futility.h"
 #include "gbb_header.h"
+#include "host_common.h"
 
 int debugging_enabled;
 void Debug(const char *format, ...)
@@ -139,10 +137,9 @@ int print_hwid_digest(GoogleBinaryBlockHeader *gbb,
 	uint8_t *buf = (uint8_t *)gbb;
 	char *hwid_str = (char *)(buf + gbb->hwid_offset);
 	int is_valid = 0;
-	uint8_t *digest = DigestBuf(buf + gbb->hwid_offset,
-				    strlen(hwid_str),
-				    SHA256_DIGEST_ALGORITHM);
-	if (digest) {
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	if (!DigestBufInto(buf + gbb->hwid_offset, strlen(hwid_str),
+			   SHA256_DIGEST_ALGORITHM, digest, sizeof(digest))) {
 		int i;
 		is_valid = 1;
 		/* print it, comparing as we go */
@@ -151,7 +148,6 @@ int print_hwid_digest(GoogleBinaryBlockHeader *gbb,
 			if (gbb->hwid_digest[i] != digest[i])
 				is_valid = 0;
 		}
-		free(digest);
 	}
 
 	printf("   %s", is_valid ? "valid" : "<invalid>");
@@ -168,11 +164,16 @@ void update_hwid_digest(GoogleBinaryBlockHeader *gbb)
 
 	uint8_t *buf = (uint8_t *)gbb;
 	char *hwid_str = (char *)(buf + gbb->hwid_offset);
-	uint8_t *digest = DigestBuf(buf + gbb->hwid_offset,
-				    strlen(hwid_str),
-				    SHA256_DIGEST_ALGORITHM);
-	memcpy(gbb->hwid_digest, digest, SHA256_DIGEST_SIZE);
-	free(digest);
+	DigestBufInto(buf + gbb->hwid_offset, strlen(hwid_str),
+		      SHA256_DIGEST_ALGORITHM, gbb->hwid_digest,
+		      SHA256_DIGEST_SIZE);
+}
+
+long futil_default_jobs(void)
+{
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return jobs < 1 ? 1 : jobs;
 }
 
 /*
@@ -229,75 +230,53 @@ void futil_copy_file_or_die(const char *infile, const char *outfile)
 	exit(1);
 }
 
+/*
+ * MAP_RO has always been a private writable mapping, so callers can scribble
+ * on the buffer without changing the file.
+ */
+static enum vb2_map_mode map_mode(int writeable)
+{
+	return writeable ? VB2_MAP_RW : VB2_MAP_COW;
+}
 
 enum futil_file_err futil_map_file(int fd, int writeable,
 				   uint8_t **buf, uint32_t *len)
 {
-	struct stat sb;
-	void *mmap_ptr;
-	uint32_t reasonable_len;
-
-	if (0 != fstat(fd, &sb)) {
+	switch (vb2_map_fd(fd, map_mode(writeable), buf, len)) {
+	case VB2_SUCCESS:
+		return FILE_ERR_NONE;
+	case VB2_ERROR_MAP_FILE_STAT:
 		fprintf(stderr, "Can't stat input file: %s\n",
 			strerror(errno));
 		return FILE_ERR_STAT;
-	}
-
-#ifndef HAVE_MACOS
-	if (S_ISBLK(sb.st_mode))
-		ioctl(fd, BLKGETSIZE64, &sb.st_size);
-#endif
-
-	/* If the image is larger than 2^32 bytes, it's wrong. */
-	if (sb.st_size < 0 || sb.st_size > UINT32_MAX) {
+	case VB2_ERROR_MAP_FILE_SIZE:
 		fprintf(stderr, "Image size is unreasonable\n");
 		return FILE_ERR_SIZE;
-	}
-	reasonable_len = (uint32_t)sb.st_size;
-
-	if (writeable)
-		mmap_ptr = mmap(0, sb.st_size,
-				PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
-	else
-		mmap_ptr = mmap(0, sb.st_size,
-				PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
-
-	if (mmap_ptr == (void *)-1) {
+	default:
 		fprintf(stderr, "Can't mmap %s file: %s\n",
 			writeable ? "output" : "input",
 			strerror(errno));
 		return FILE_ERR_MMAP;
 	}
-
-	*buf = (uint8_t *)mmap_ptr;
-	*len = reasonable_len;
-	return FILE_ERR_NONE;
 }
 
 enum futil_file_err futil_unmap_file(int fd, int writeable,
 				     uint8_t *buf, uint32_t len)
 {
-	void *mmap_ptr = buf;
-	enum futil_file_err err = FILE_ERR_NONE;
-
-	if (writeable &&
-	    (0 != msync(mmap_ptr, len, MS_SYNC|MS_INVALIDATE))) {
+	switch (vb2_unmap_file(buf, len, map_mode(writeable))) {
+	case VB2_SUCCESS:
+		return FILE_ERR_NONE;
+	case VB2_ERROR_UNMAP_FILE_MSYNC:
 		fprintf(stderr, "msync failed: %s\n", strerror(errno));
-		err = FILE_ERR_MSYNC;
-	}
-
-	if (0 != munmap(mmap_ptr, len)) {
+		return FILE_ERR_MSYNC;
+	default:
 		fprintf(stderr, "Can't munmap pointer: %s\n",
 			strerror(errno));
-		if (err == FILE_ERR_NONE)
-			err = FILE_ERR_MUNMAP;
+		return FILE_ERR_MUNMAP;
 	}
-
-	return err;
 }
 
 
-#define DISK_SECTOR_SIZE 512
 enum futil_file_type recognize_gpt(uint8_t *buf, uint32_t len)
 {
 	GptHeader *h;
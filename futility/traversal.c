@@ -4,9 +4,14 @@
  * found in the LICENSE file.
  */
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "cgptlib_internal.h"
 #include "file_type.h"
 #include "fmap.h"
 #include "futility.h"
@@ -17,7 +22,7 @@
 /* FUTIL_OP_SHOW */
 static int (* const cb_show_funcs[])(struct futil_traverse_state_s *state) = {
 	futil_cb_show_begin,		/* CB_BEGIN_TRAVERSAL */
-	NULL,				/* CB_END_TRAVERSAL */
+	futil_cb_show_end,		/* CB_END_TRAVERSAL */
 	futil_cb_show_gbb,		/* CB_FMAP_GBB */
 	futil_cb_show_fw_preamble,	/* CB_FMAP_VBLOCK_A */
 	futil_cb_show_fw_preamble,	/* CB_FMAP_VBLOCK_B */
@@ -31,6 +36,7 @@ static int (* const cb_show_funcs[])(struct futil_traverse_state_s *state) = {
 	NULL,				/* CB_RAW_FIRMWARE */
 	NULL,				/* CB_RAW_KERNEL */
 	futil_cb_show_privkey,		/* CB_PRIVKEY */
+	futil_cb_show_vb_shared_data,	/* CB_VB_SHARED_DATA */
 };
 BUILD_ASSERT(ARRAY_SIZE(cb_show_funcs) == NUM_CB_COMPONENTS);
 
@@ -51,6 +57,7 @@ static int (* const cb_sign_funcs[])(struct futil_traverse_state_s *state) = {
 	futil_cb_sign_raw_firmware,	/* CB_RAW_FIRMWARE */
 	futil_cb_create_kernel_part,	/* CB_RAW_KERNEL */
 	NULL,				/* CB_PRIVKEY */
+	NULL,				/* CB_VB_SHARED_DATA */
 };
 BUILD_ASSERT(ARRAY_SIZE(cb_sign_funcs) == NUM_CB_COMPONENTS);
 
@@ -60,6 +67,21 @@ static int (* const * const cb_func[])(struct futil_traverse_state_s *state) = {
 };
 BUILD_ASSERT(ARRAY_SIZE(cb_func) == NUM_FUTIL_OPS);
 
+/* Parallel traversal, FUTIL_OP_SHOW. Nothing to prepare for FUTIL_OP_SIGN. */
+static void (* const cb_show_prepare_funcs[NUM_CB_COMPONENTS])(
+	struct futil_traverse_state_s *state, enum futil_cb_component c) = {
+	[CB_FMAP_VBLOCK_A] = futil_cb_show_fw_prepare,
+	[CB_FMAP_VBLOCK_B] = futil_cb_show_fw_prepare,
+	[CB_KERN_PREAMBLE] = futil_cb_show_kernel_prepare,
+};
+
+static void (* const * const cb_prepare_func[])(
+	struct futil_traverse_state_s *state, enum futil_cb_component c) = {
+	cb_show_prepare_funcs,
+	NULL,
+};
+BUILD_ASSERT(ARRAY_SIZE(cb_prepare_func) == NUM_FUTIL_OPS);
+
 /*
  * File types that don't need iterating can use a lookup table to determine the
  * callback component and name. The index is the file type.
@@ -80,6 +102,7 @@ static const struct {
 	{CB_RAW_KERNEL,    "raw kernel"},	/* FILE_TYPE_RAW_KERNEL */
 	{0,                "chromiumos disk"},	/* FILE_TYPE_CHROMIUMOS_DISK */
 	{CB_PRIVKEY,       "VbPrivateKey"},	/* FILE_TYPE_PRIVKEY */
+	{CB_VB_SHARED_DATA, "VbSharedData"},	/* FILE_TYPE_VB_SHARED_DATA */
 };
 BUILD_ASSERT(ARRAY_SIZE(direct_callback) == NUM_FILE_TYPES);
 
@@ -112,12 +135,12 @@ static const struct bios_area_s old_bios_area[] = {
 	{0, 0}
 };
 
-static int has_all_areas(uint8_t *buf, uint32_t len, FmapHeader *fmap,
+static int has_all_areas(const struct fmap_index *index,
 			 const struct bios_area_s *area)
 {
 	/* We must have all the expected areas */
 	for (; area->name; area++)
-		if (!fmap_find_by_name(buf, len, fmap, area->name, 0))
+		if (!fmap_index_find(index, area->name, 0))
 			return 0;
 
 	/* Found 'em all */
@@ -126,14 +149,18 @@ static int has_all_areas(uint8_t *buf, uint32_t len, FmapHeader *fmap,
 
 enum futil_file_type recognize_bios_image(uint8_t *buf, uint32_t len)
 {
-	FmapHeader *fmap = fmap_find(buf, len);
-	if (fmap) {
-		if (has_all_areas(buf, len, fmap, bios_area))
-			return FILE_TYPE_BIOS_IMAGE;
-		if (has_all_areas(buf, len, fmap, old_bios_area))
-			return FILE_TYPE_OLD_BIOS_IMAGE;
+	enum futil_file_type type = FILE_TYPE_UNKNOWN;
+	struct fmap_index index;
+
+	if (0 == fmap_index_init(&index, buf, len)) {
+		if (has_all_areas(&index, bios_area))
+			type = FILE_TYPE_BIOS_IMAGE;
+		else if (has_all_areas(&index, old_bios_area))
+			type = FILE_TYPE_OLD_BIOS_IMAGE;
 	}
-	return FILE_TYPE_UNKNOWN;
+	fmap_index_free(&index);
+
+	return type;
 }
 
 static const char * const futil_cb_component_str[] = {
@@ -152,6 +179,7 @@ static const char * const futil_cb_component_str[] = {
 	"CB_RAW_FIRMWARE",
 	"CB_RAW_KERNEL",
 	"CB_PRIVKEY",
+	"CB_VB_SHARED_DATA",
 };
 BUILD_ASSERT(ARRAY_SIZE(futil_cb_component_str) == NUM_CB_COMPONENTS);
 
@@ -194,14 +222,325 @@ static void fmap_limit_area(FmapAreaHeader *ah, uint32_t len)
 	}
 }
 
+struct prepare_job_s {
+	struct futil_traverse_state_s *state;
+	enum futil_cb_component component;
+	pthread_t thread;
+	int started;
+};
+
+static void *prepare_thread(void *arg)
+{
+	struct prepare_job_s *job = arg;
+
+	cb_prepare_func[job->state->op][job->component](job->state,
+							 job->component);
+	return NULL;
+}
+
+/*
+ * Find all the areas, then run their prepare callbacks side by side. The
+ * last one (and any that can't get a thread) runs on this thread.
+ */
+static void prepare_bios_areas(uint8_t *buf, uint32_t len,
+			       const struct fmap_index *index,
+			       struct futil_traverse_state_s *state,
+			       const struct bios_area_s *area)
+{
+	struct prepare_job_s job[NUM_CB_COMPONENTS];
+	FmapAreaHeader *ah = 0;
+	int count = 0;
+	int i;
+
+	/* Threads won't help with only one CPU */
+	if (!cb_prepare_func[state->op] || futil_default_jobs() < 2)
+		return;
+
+	for (; area->name; area++) {
+		fmap_index_find(index, area->name, &ah);
+		fmap_limit_area(ah, len);
+		state->cb_area[area->component].offset = ah->area_offset;
+		state->cb_area[area->component].buf = buf + ah->area_offset;
+		state->cb_area[area->component].len = ah->area_size;
+
+		if (cb_prepare_func[state->op][area->component]) {
+			job[count].state = state;
+			job[count].component = area->component;
+			count++;
+		}
+	}
+
+	for (i = 0; i < count - 1; i++)
+		job[i].started = !pthread_create(&job[i].thread, NULL,
+						 prepare_thread, &job[i]);
+	for (i = 0; i < count; i++)
+		if (i == count - 1 || !job[i].started)
+			prepare_thread(&job[i]);
+	for (i = 0; i < count - 1; i++)
+		if (job[i].started)
+			pthread_join(job[i].thread, NULL);
+}
+
+static int traverse_bios(uint8_t *buf, uint32_t len,
+			 struct futil_traverse_state_s *state,
+			 const struct bios_area_s *area)
+{
+	struct fmap_index index;
+	FmapAreaHeader *ah = 0;
+	int retval = 0;
+
+	/* We've already checked, so this can only run out of memory. */
+	if (0 != fmap_index_init(&index, buf, len)) {
+		fprintf(stderr, "Can't index the FMAP\n");
+		fmap_index_free(&index);
+		return 1;
+	}
+
+	if (state->parallel)
+		prepare_bios_areas(buf, len, &index, state, area);
+
+	for (; area->name; area++) {
+		/* We know this will work, too */
+		fmap_index_find(&index, area->name, &ah);
+		/* But the file might be truncated */
+		fmap_limit_area(ah, len);
+		retval |= invoke_callback(state,
+					  area->component,
+					  area->name,
+					  ah->area_offset,
+					  buf + ah->area_offset,
+					  ah->area_size);
+		state->errors |= retval;
+	}
+
+	fmap_index_free(&index);
+	return retval;
+}
+
+/* Size of one copy of the GPT entries */
+#define ENTRIES_SIZE (MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry))
+
+/* Most we'll look at; a Chrome OS disk has three */
+#define MAX_DISK_KERNELS 16
+
+struct kernel_job_s {
+	struct futil_traverse_state_s state;	/* private copy */
+	char name[32];
+	uint32_t offset;
+	uint8_t *buf;
+	uint32_t len;
+	pthread_t thread;
+	int started;
+	int retval;
+};
+
+static void *kernel_thread(void *arg)
+{
+	struct kernel_job_s *job = arg;
+
+	job->retval = invoke_callback(&job->state, CB_KERN_PREAMBLE,
+				      job->name, job->offset, job->buf,
+				      job->len);
+	return NULL;
+}
+
+static void *kernel_prepare_thread(void *arg)
+{
+	struct kernel_job_s *job = arg;
+	struct cb_area_s *area = &job->state.cb_area[CB_KERN_PREAMBLE];
+
+	area->offset = job->offset;
+	area->buf = job->buf;
+	area->len = job->len;
+	cb_prepare_func[job->state.op][CB_KERN_PREAMBLE](&job->state,
+							  CB_KERN_PREAMBLE);
+	return NULL;
+}
+
+/*
+ * Find the kernel partitions on a disk image using its GPT. Partitions which
+ * don't hold a signed kernel (like an unused KERN-C) are skipped. If [only] is
+ * nonzero, that's the one partition wanted, and it has to be a signed kernel.
+ */
+static int find_disk_kernels(uint8_t *buf, uint32_t len, uint32_t only,
+			     struct kernel_job_s *job, int *count)
+{
+	GptData gpt;
+	GptEntry *entries;
+	uint64_t start, size;
+	uint32_t i;
+	int rv;
+
+	*count = 0;
+
+	/* Same layout cgpt expects: each header next to its entries */
+	memset(&gpt, 0, sizeof(gpt));
+	gpt.sector_bytes = DISK_SECTOR_SIZE;
+	gpt.streaming_drive_sectors = len / DISK_SECTOR_SIZE;
+	gpt.gpt_drive_sectors = gpt.streaming_drive_sectors;
+	if (gpt.gpt_drive_sectors < GPT_PMBR_SECTORS + 2 *
+	    (GPT_HEADER_SECTORS + ENTRIES_SIZE / DISK_SECTOR_SIZE)) {
+		fprintf(stderr, "Disk image is too small for a GPT\n");
+		return 1;
+	}
+	gpt.primary_header = buf + GPT_PMBR_SECTORS * DISK_SECTOR_SIZE;
+	gpt.primary_entries = gpt.primary_header +
+		GPT_HEADER_SECTORS * DISK_SECTOR_SIZE;
+	gpt.secondary_header = buf + (gpt.gpt_drive_sectors -
+				      GPT_HEADER_SECTORS) * DISK_SECTOR_SIZE;
+	gpt.secondary_entries = gpt.secondary_header - ENTRIES_SIZE;
+
+	rv = GptSanityCheck(&gpt);
+	if (GPT_SUCCESS != rv) {
+		fprintf(stderr, "GPT is invalid: %s\n", GptErrorText(rv));
+		return 1;
+	}
+	entries = (GptEntry *)((gpt.valid_entries & MASK_PRIMARY) ?
+			       gpt.primary_entries : gpt.secondary_entries);
+
+	for (i = 0; i < MAX_NUMBER_OF_ENTRIES; i++) {
+		if (only && i + 1 != only)
+			continue;
+		if (!IsKernelEntry(entries + i))
+			continue;
+
+		start = entries[i].starting_lba * DISK_SECTOR_SIZE;
+		size = (entries[i].ending_lba - entries[i].starting_lba + 1) *
+			DISK_SECTOR_SIZE;
+		if (start > len || size > len - start) {
+			fprintf(stderr, "Partition %d is past the end of the"
+				" image\n", i + 1);
+			return 1;
+		}
+		if (futil_file_type_buf(buf + start, size) !=
+		    FILE_TYPE_KERN_PREAMBLE) {
+			Debug("%s: partition %d isn't a kernel\n",
+			      __func__, i + 1);
+			continue;
+		}
+		if (*count >= MAX_DISK_KERNELS) {
+			fprintf(stderr, "Too many kernel partitions\n");
+			return 1;
+		}
+
+		snprintf(job[*count].name, sizeof(job[*count].name),
+			 "Kernel partition %d", i + 1);
+		job[*count].offset = start;
+		job[*count].buf = buf + start;
+		job[*count].len = size;
+		(*count)++;
+	}
+
+	if (only && !*count) {
+		fprintf(stderr, "Partition %d isn't a signed kernel\n", only);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Run [func] on each job side by side. The last one (and any that can't get a
+ * thread) runs on this thread.
+ */
+static void run_kernel_jobs(struct kernel_job_s *job, int count,
+			    void *(*func)(void *))
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		job[i].started = 0;
+	for (i = 0; i < count - 1; i++)
+		job[i].started = !pthread_create(&job[i].thread, NULL,
+						 func, &job[i]);
+	for (i = 0; i < count; i++)
+		if (i == count - 1 || !job[i].started)
+			func(&job[i]);
+	for (i = 0; i < count; i++)
+		if (job[i].started)
+			pthread_join(job[i].thread, NULL);
+}
+
+/*
+ * Show each kernel partition on a disk image. The prepare callbacks verify
+ * all the partitions at once, each with a copy of the state, then the
+ * results are shown in order so the output doesn't get mixed up.
+ */
+static int show_disk_kernels(struct kernel_job_s *job, int count,
+			     struct futil_traverse_state_s *state)
+{
+	struct cb_area_s *area;
+	int retval = 0;
+	int i;
+
+	for (i = 0; i < count; i++)
+		job[i].state = *state;
+	run_kernel_jobs(job, count, kernel_prepare_thread);
+
+	for (i = 0; i < count; i++) {
+		area = &job[i].state.cb_area[CB_KERN_PREAMBLE];
+		state->cb_area[CB_KERN_PREAMBLE]._prepared = area->_prepared;
+		retval |= invoke_callback(state, CB_KERN_PREAMBLE,
+					  job[i].name, job[i].offset,
+					  job[i].buf, job[i].len);
+		state->errors |= retval;
+		free(area->_prepared);
+		state->cb_area[CB_KERN_PREAMBLE]._prepared = NULL;
+	}
+
+	return retval;
+}
+
+/*
+ * Invoke the kernel callback for each kernel partition on a disk image. For a
+ * parallel traversal when signing, they each get a copy of the state and run
+ * side by side, since most of the work is hashing the kernel bodies.
+ */
+static int traverse_disk(uint8_t *buf, uint32_t len,
+			 struct futil_traverse_state_s *state)
+{
+	struct kernel_job_s job[MAX_DISK_KERNELS];
+	int count;
+	int threaded;
+	int retval = 0;
+	int i;
+
+	if (find_disk_kernels(buf, len, state->disk_partition, job, &count))
+		return 1;
+
+	threaded = state->parallel && futil_default_jobs() > 1;
+
+	if (threaded && cb_prepare_func[state->op])
+		return show_disk_kernels(job, count, state);
+
+	if (!threaded) {
+		for (i = 0; i < count; i++) {
+			retval |= invoke_callback(state, CB_KERN_PREAMBLE,
+						  job[i].name, job[i].offset,
+						  job[i].buf, job[i].len);
+			state->errors |= retval;
+		}
+		return retval;
+	}
+
+	for (i = 0; i < count; i++) {
+		job[i].state = *state;
+		job[i].retval = 0;
+	}
+	run_kernel_jobs(job, count, kernel_thread);
+	for (i = 0; i < count; i++)
+		retval |= job[i].retval;
+
+	state->errors |= retval;
+	return retval;
+}
+
 int futil_traverse(uint8_t *buf, uint32_t len,
 		   struct futil_traverse_state_s *state,
 		   enum futil_file_type type)
 {
-	FmapHeader *fmap;
-	FmapAreaHeader *ah = 0;
-	const struct bios_area_s *area;
 	int retval = 0;
+	int i;
 
 	if ((int) state->op < 0 || state->op >= NUM_FUTIL_OPS) {
 		fprintf(stderr, "Invalid op %d\n", state->op);
@@ -219,44 +558,19 @@ int futil_traverse(uint8_t *buf, uint32_t len,
 
 	switch (type) {
 	case FILE_TYPE_BIOS_IMAGE:
-		/* We've already checked, so we know this will work. */
-		fmap = fmap_find(buf, len);
-		for (area = bios_area; area->name; area++) {
-			/* We know this will work, too */
-			fmap_find_by_name(buf, len, fmap, area->name, &ah);
-			/* But the file might be truncated */
-			fmap_limit_area(ah, len);
-			retval |= invoke_callback(state,
-						  area->component,
-						  area->name,
-						  ah->area_offset,
-						  buf + ah->area_offset,
-						  ah->area_size);
-			state->errors = retval;
-		}
+		retval |= traverse_bios(buf, len, state, bios_area);
 		break;
 
 	case FILE_TYPE_OLD_BIOS_IMAGE:
-		/* We've already checked, so we know this will work. */
-		fmap = fmap_find(buf, len);
-		for (area = old_bios_area; area->name; area++) {
-			/* We know this will work, too */
-			fmap_find_by_name(buf, len, fmap, area->name, &ah);
-			/* But the file might be truncated */
-			fmap_limit_area(ah, len);
-			retval |= invoke_callback(state,
-						  area->component,
-						  area->name,
-						  ah->area_offset,
-						  buf + ah->area_offset,
-						  ah->area_size);
-			state->errors = retval;
-		}
+		retval |= traverse_bios(buf, len, state, old_bios_area);
 		break;
 
-	case FILE_TYPE_UNKNOWN:
 	case FILE_TYPE_CHROMIUMOS_DISK:
-		/* Nothing to do for these file types (yet) */
+		retval |= traverse_disk(buf, len, state);
+		break;
+
+	case FILE_TYPE_UNKNOWN:
+		/* Nothing to do for this file type */
 		break;
 
 	default:
@@ -271,5 +585,11 @@ int futil_traverse(uint8_t *buf, uint32_t len,
 
 	retval |= invoke_callback(state, CB_END_TRAVERSAL, "<end>",
 				  0, buf, len);
+
+	for (i = 0; i < NUM_CB_COMPONENTS; i++) {
+		free(state->cb_area[i]._prepared);
+		state->cb_area[i]._prepared = NULL;
+	}
+
 	return retval;
 }
@@ -36,6 +36,7 @@ enum futil_cb_component {
 	CB_RAW_FIRMWARE,
 	CB_RAW_KERNEL,
 	CB_PRIVKEY,
+	CB_VB_SHARED_DATA,
 
 	NUM_CB_COMPONENTS
 };
@@ -46,13 +47,16 @@ struct cb_area_s {
 	uint8_t *buf;
 	uint32_t len;
 	uint32_t _flags;			/* for callback use */
+	void *_prepared;			/* for prepare callback use */
 };
 
 /* What do we know at this point in time? */
 struct futil_traverse_state_s {
-	/* These two should be initialized by the caller as needed */
+	/* These should be initialized by the caller as needed */
 	const char *in_filename;
 	enum futil_op_type op;
+	int parallel;				/* prepare areas in threads */
+	uint32_t disk_partition;		/* only this one; 0 for all */
 	/* Current activity during traversal */
 	enum futil_cb_component component;
 	struct cb_area_s *my_area;
@@ -74,8 +78,23 @@ int futil_traverse(uint8_t *buf, uint32_t len,
 		   struct futil_traverse_state_s *state,
 		   enum futil_file_type type_hint);
 
+/*
+ * In a parallel traversal of a BIOS image, these are invoked first, all at
+ * once on separate threads, for the areas that have one. Each may only read
+ * the state and set the _prepared field of its own area, which the normal
+ * callback for that area can then use. Anything left in _prepared is freed at
+ * the end of the traversal. Failure just means there's nothing prepared.
+ * The kernel partitions of a disk image are prepared the same way, each with
+ * its own copy of the state.
+ */
+void futil_cb_show_fw_prepare(struct futil_traverse_state_s *state,
+			      enum futil_cb_component c);
+void futil_cb_show_kernel_prepare(struct futil_traverse_state_s *state,
+				  enum futil_cb_component c);
+
 /* These are invoked by the traversal. They also return nonzero on error. */
 int futil_cb_show_begin(struct futil_traverse_state_s *state);
+int futil_cb_show_end(struct futil_traverse_state_s *state);
 int futil_cb_show_pubkey(struct futil_traverse_state_s *state);
 int futil_cb_show_gbb(struct futil_traverse_state_s *state);
 int futil_cb_show_keyblock(struct futil_traverse_state_s *state);
@@ -83,6 +102,7 @@ int futil_cb_show_fw_main(struct futil_traverse_state_s *state);
 int futil_cb_show_fw_preamble(struct futil_traverse_state_s *state);
 int futil_cb_show_kernel_preamble(struct futil_traverse_state_s *state);
 int futil_cb_show_privkey(struct futil_traverse_state_s *state);
+int futil_cb_show_vb_shared_data(struct futil_traverse_state_s *state);
 
 int futil_cb_sign_pubkey(struct futil_traverse_state_s *state);
 int futil_cb_sign_fw_main(struct futil_traverse_state_s *state);
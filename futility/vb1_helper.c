@@ -8,7 +8,9 @@
 #include <inttypes.h>		/* For PRIu64 */
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <lzma.h>
 #include <openssl/rsa.h>
 
 #include "file_type.h"
@@ -29,26 +31,33 @@
  * The VbKernelPreambleHeader.preamble_size includes the padding.
  */
 
-/* The keyblock, preamble, and kernel blob are kept in separate places. */
-static VbKeyBlockHeader *g_keyblock;
-static VbKernelPreambleHeader *g_preamble;
-static uint8_t *g_kernel_blob_data;
-static uint64_t g_kernel_blob_size;
+/*
+ * The keyblock, preamble, and kernel blob are kept in separate places. These
+ * are per thread, so that several kernels can be unpacked and signed at once.
+ */
+static __thread VbKeyBlockHeader *g_keyblock;
+static __thread VbKernelPreambleHeader *g_preamble;
+static __thread uint8_t *g_kernel_blob_data;
+static __thread uint64_t g_kernel_blob_size;
 
 /* These refer to individual parts within the kernel blob. */
-static uint8_t *g_kernel_data;
-static uint64_t g_kernel_size;
-static uint8_t *g_config_data;
-static uint64_t g_config_size;
-static uint8_t *g_param_data;
-static uint64_t g_param_size;
-static uint8_t *g_bootloader_data;
-static uint64_t g_bootloader_size;
-static uint8_t *g_vmlinuz_header_data;
-static uint64_t g_vmlinuz_header_size;
+static __thread uint8_t *g_kernel_data;
+static __thread uint64_t g_kernel_size;
+static __thread uint8_t *g_config_data;
+static __thread uint64_t g_config_size;
+static __thread uint8_t *g_param_data;
+static __thread uint64_t g_param_size;
+static __thread uint8_t *g_bootloader_data;
+static __thread uint64_t g_bootloader_size;
+static __thread uint8_t *g_vmlinuz_header_data;
+static __thread uint64_t g_vmlinuz_header_size;
 
-static uint64_t g_ondisk_bootloader_addr;
-static uint64_t g_ondisk_vmlinuz_header_addr;
+static __thread uint64_t g_ondisk_bootloader_addr;
+static __thread uint64_t g_ondisk_vmlinuz_header_addr;
+
+/* How the blob is stored, if it isn't as it's loaded */
+static __thread uint32_t g_body_compression;
+static __thread uint64_t g_body_load_size;
 
 
 /*
@@ -204,8 +213,8 @@ static int PickApartVmlinuz(uint8_t *kernel_buf, uint64_t kernel_size,
 	Debug(" kernel32_start=0x%" PRIx64 "\n", kernel32_start);
 	Debug(" kernel32_size=0x%" PRIx64 "\n", kernel32_size);
 
-	/* Keep just the 32-bit kernel. */
-	if (kernel32_size) {
+	/* Keep just the 32-bit kernel, unless it's being left in place. */
+	if (kernel32_size && g_kernel_data) {
 		g_kernel_size = kernel32_size;
 		Memcpy(g_kernel_data, kernel_buf + kernel32_start,
 		       g_kernel_size);
@@ -287,6 +296,13 @@ int UpdateKernelBlobConfig(uint8_t *kblob_data, uint64_t kblob_size,
 		return -1;
 	}
 
+	/* The config is somewhere in the compressed data */
+	if (g_body_compression != COMPRESS_NONE) {
+		fprintf(stderr, "Can't update the config of a compressed "
+			"kernel\n");
+		return -1;
+	}
+
 	Memset(g_config_data, 0, g_config_size);
 	Memcpy(g_config_data, config_data, config_size);
 
@@ -355,6 +371,9 @@ uint8_t *UnpackKPart(uint8_t *kpart_data, uint64_t kpart_size,
 
 	g_preamble = preamble;
 	g_ondisk_bootloader_addr = g_preamble->bootloader_address;
+	VbGetKernelBodyCompression(preamble, &g_body_compression,
+				   &g_body_load_size);
+	Debug(" body_compression = %d\n", g_body_compression);
 
 	if (VbGetKernelVmlinuzHeader(preamble,
 				     &vmlinuz_header_address,
@@ -394,96 +413,482 @@ uint8_t *UnpackKPart(uint8_t *kpart_data, uint64_t kpart_size,
 	return g_kernel_blob_data;
 }
 
-uint8_t *SignKernelBlob(uint8_t *kernel_blob, uint64_t kernel_size,
-			uint64_t padding,
-			int version, uint64_t kernel_body_load_address,
-			VbKeyBlockHeader *keyblock, VbPrivateKey *signpriv_key,
-			uint32_t flags, uint64_t *vblock_size_ptr)
+/* Marks the preamble if the body it signs is compressed. */
+static int MarkBodyCompression(VbKernelPreambleHeader *preamble,
+			       VbPrivateKey *signpriv_key)
+{
+	if (g_body_compression == COMPRESS_NONE)
+		return 0;
+	return SetKernelPreambleCompression(preamble, g_body_compression,
+					    g_body_load_size, signpriv_key);
+}
+
+/* Puts the keyblock and a preamble with no body hashes into one vblock. */
+static uint8_t *CreateKernelVblock(VbSignature *body_sig, uint64_t padding,
+				   int version,
+				   uint64_t kernel_body_load_address,
+				   VbKeyBlockHeader *keyblock,
+				   VbPrivateKey *signpriv_key, uint32_t flags,
+				   uint64_t *vblock_size_ptr)
 {
-	VbSignature *body_sig;
-	VbKernelPreambleHeader *preamble;
 	uint64_t min_size = padding > keyblock->key_block_size
 		? padding - keyblock->key_block_size : 0;
-	void *outbuf;
+	uint8_t *outbuf;
 	uint64_t outsize;
 
-	/* Sign the kernel data */
-	body_sig = CalculateSignature(kernel_blob, kernel_size, signpriv_key);
+	outsize = keyblock->key_block_size +
+		KernelPreambleSize(body_sig->sig_size, body_sig->data_size, 0,
+				   min_size, signpriv_key);
+	outbuf = calloc(1, outsize);
+	if (!outbuf)
+		return NULL;
+
+	/* The preamble is built right after the keyblock */
+	Memcpy(outbuf, keyblock, keyblock->key_block_size);
+	if (CreateKernelPreambleInto(
+		    (VbKernelPreambleHeader *)
+		    (outbuf + keyblock->key_block_size),
+		    outsize - keyblock->key_block_size,
+		    version, kernel_body_load_address,
+		    g_ondisk_bootloader_addr, g_bootloader_size, body_sig,
+		    g_ondisk_vmlinuz_header_addr, g_vmlinuz_header_size,
+		    flags, min_size, signpriv_key) ||
+	    MarkBodyCompression((VbKernelPreambleHeader *)
+				(outbuf + keyblock->key_block_size),
+				signpriv_key)) {
+		fprintf(stderr, "Error creating preamble.\n");
+		free(outbuf);
+		return NULL;
+	}
+
+	if (vblock_size_ptr)
+		*vblock_size_ptr = outsize;
+	return outbuf;
+}
+
+uint8_t *SignKernelParts(uint8_t *kernel_data, uint64_t kernel_size,
+			 uint8_t *tail_data, uint64_t tail_size,
+			 uint64_t padding,
+			 int version, uint64_t kernel_body_load_address,
+			 VbKeyBlockHeader *keyblock, VbPrivateKey *signpriv_key,
+			 uint32_t flags, uint64_t *vblock_size_ptr)
+{
+	static const uint8_t zeros[CROS_ALIGN];
+	SignContext ctx;
+	VbSignature *body_sig;
+	uint8_t *outbuf;
+
+	/* Hash the blob as it will be laid out, without laying it out */
+	SignContextInit(&ctx, signpriv_key);
+	SignContextUpdate(&ctx, kernel_data, kernel_size);
+	SignContextUpdate(&ctx, zeros,
+			  roundup(kernel_size, CROS_ALIGN) - kernel_size);
+	SignContextUpdate(&ctx, tail_data, tail_size);
+	body_sig = SignContextFinal(&ctx);
+	if (!body_sig) {
+		fprintf(stderr, "Error calculating body signature\n");
+		return NULL;
+	}
+
+	outbuf = CreateKernelVblock(body_sig, padding, version,
+				    kernel_body_load_address, keyblock,
+				    signpriv_key, flags, vblock_size_ptr);
+	free(body_sig);
+	return outbuf;
+}
+
+uint8_t *ResignKernelBlob(VbKeyBlockHeader *old_keyblock,
+			  VbKernelPreambleHeader *old_preamble,
+			  uint64_t padding,
+			  int version, uint64_t kernel_body_load_address,
+			  VbKeyBlockHeader *keyblock,
+			  VbPrivateKey *signpriv_key,
+			  uint32_t flags, uint64_t *vblock_size_ptr)
+{
+	uint8_t digest[SHA512_DIGEST_SIZE];
+	VbSignature *body_sig;
+	RSAPublicKey *rsa;
+	uint8_t *outbuf;
+	int rv;
+
+	/* The old digest can only be signed with the same kind of hash */
+	rsa = PublicKeyToRSA(&old_keyblock->data_key);
+	if (!rsa || hash_type_map[rsa->algorithm] !=
+	    hash_type_map[signpriv_key->algorithm]) {
+		Debug("Old body signature can't be reused\n");
+		if (rsa)
+			RSAPublicKeyFree(rsa);
+		return NULL;
+	}
+
+	/* Check the old preamble, and take the digest from its signature */
+	rv = VerifyKernelPreamble(old_preamble, old_preamble->preamble_size,
+				  rsa);
+	if (!rv)
+		rv = SignatureRecoverDigest(&old_preamble->body_signature, rsa,
+					    digest);
+	RSAPublicKeyFree(rsa);
+	if (rv) {
+		Debug("Old body signature can't be reused\n");
+		return NULL;
+	}
+
+	body_sig = CalculateSignatureFromDigest(
+		digest, old_preamble->body_signature.data_size, signpriv_key);
 	if (!body_sig) {
 		fprintf(stderr, "Error calculating body signature\n");
 		return NULL;
 	}
 
-	/* Create preamble */
-	preamble = CreateKernelPreamble(version,
-					kernel_body_load_address,
-					g_ondisk_bootloader_addr,
-					g_bootloader_size,
-					body_sig,
-					g_ondisk_vmlinuz_header_addr,
-					g_vmlinuz_header_size,
-					flags,
-					min_size,
-					signpriv_key);
-	if (!preamble) {
+	outbuf = CreateKernelVblock(body_sig, padding, version,
+				    kernel_body_load_address, keyblock,
+				    signpriv_key, flags, vblock_size_ptr);
+	free(body_sig);
+	return outbuf;
+}
+
+uint64_t KernelVblockSize(uint64_t kernel_size, uint64_t padding,
+			  VbKeyBlockHeader *keyblock,
+			  VbPrivateKey *signpriv_key,
+			  uint32_t hash_block_size)
+{
+	uint64_t min_size = padding > keyblock->key_block_size
+		? padding - keyblock->key_block_size : 0;
+
+	return keyblock->key_block_size +
+		KernelPreambleSize(siglen_map[signpriv_key->algorithm],
+				   kernel_size, hash_block_size, min_size,
+				   signpriv_key);
+}
+
+int SignKernelBlobInto(uint8_t *vblock, uint64_t vblock_size,
+		       uint8_t *kernel_blob, uint64_t kernel_size,
+		       uint64_t padding,
+		       int version, uint64_t kernel_body_load_address,
+		       VbKeyBlockHeader *keyblock, VbPrivateKey *signpriv_key,
+		       uint32_t flags, uint32_t hash_block_size)
+{
+	uint64_t kb_size = keyblock->key_block_size;
+	uint64_t min_size = padding > kb_size ? padding - kb_size : 0;
+	uint64_t head_size = 0;
+	uint64_t tail_offset = 0;
+
+	/*
+	 * If hashing the body in blocks, the firmware needs to check the
+	 * first block (the decompressor) and the config, params, and
+	 * bootloader at the end before booting.  If the blob isn't laid out
+	 * that way, have it check everything.
+	 */
+	if (hash_block_size) {
+		head_size = hash_block_size < kernel_size
+			? hash_block_size : kernel_size;
+		if (g_ondisk_bootloader_addr >= kernel_body_load_address +
+		    CROS_CONFIG_SIZE + CROS_PARAMS_SIZE)
+			tail_offset = g_ondisk_bootloader_addr -
+				kernel_body_load_address -
+				CROS_CONFIG_SIZE - CROS_PARAMS_SIZE;
+		if (tail_offset > kernel_size)
+			tail_offset = 0;
+	}
+
+	if (vblock_size < kb_size) {
+		fprintf(stderr, "No room for the keyblock.\n");
+		return 1;
+	}
+
+	/* Only the firmware's decompressor could check a compressed body */
+	if (hash_block_size && g_body_compression != COMPRESS_NONE) {
+		fprintf(stderr, "Can't hash a compressed kernel in blocks.\n");
+		return 1;
+	}
+
+	/* The keyblock may already be there, if resigning in place */
+	memmove(vblock, keyblock, kb_size);
+
+	/* Sign the kernel data and hash its blocks in one pass, straight into
+	 * the preamble after the keyblock */
+	if (SignKernelBodyAndPreambleInto(
+		(VbKernelPreambleHeader *)(vblock + kb_size),
+		vblock_size - kb_size,
+		version,
+		kernel_body_load_address,
+		g_ondisk_bootloader_addr,
+		g_bootloader_size,
+		g_ondisk_vmlinuz_header_addr,
+		g_vmlinuz_header_size,
+		flags,
+		kernel_blob,
+		kernel_size,
+		signpriv_key,
+		hash_block_size,
+		head_size,
+		tail_offset,
+		min_size,
+		signpriv_key) ||
+	    MarkBodyCompression((VbKernelPreambleHeader *)(vblock + kb_size),
+				signpriv_key)) {
 		fprintf(stderr, "Error creating preamble.\n");
-		return 0;
+		return 1;
 	}
 
-	outsize = keyblock->key_block_size + preamble->preamble_size;
-	outbuf = malloc(outsize);
-	Memset(outbuf, 0, outsize);
-	Memcpy(outbuf, keyblock, keyblock->key_block_size);
-	Memcpy(outbuf + keyblock->key_block_size,
-	       preamble, preamble->preamble_size);
+	return 0;
+}
+
+uint8_t *SignKernelBlob(uint8_t *kernel_blob, uint64_t kernel_size,
+			uint64_t padding,
+			int version, uint64_t kernel_body_load_address,
+			VbKeyBlockHeader *keyblock, VbPrivateKey *signpriv_key,
+			uint32_t flags, uint32_t hash_block_size,
+			uint64_t *vblock_size_ptr)
+{
+	uint64_t outsize = KernelVblockSize(kernel_size, padding, keyblock,
+					    signpriv_key, hash_block_size);
+	uint8_t *outbuf;
+
+	outbuf = calloc(1, outsize);
+	if (!outbuf)
+		return NULL;
+
+	if (SignKernelBlobInto(outbuf, outsize, kernel_blob, kernel_size,
+			       padding, version, kernel_body_load_address,
+			       keyblock, signpriv_key, flags,
+			       hash_block_size)) {
+		free(outbuf);
+		return NULL;
+	}
 
 	if (vblock_size_ptr)
 		*vblock_size_ptr = outsize;
 	return outbuf;
 }
 
+uint64_t KernelVblockUsedSize(const uint8_t *vblock, uint64_t vblock_size)
+{
+	const VbKeyBlockHeader *keyblock = (const VbKeyBlockHeader *)vblock;
+	const VbKernelPreambleHeader *preamble;
+	const VbSignature *sig;
+	uint64_t used;
+
+	if (vblock_size < sizeof(*keyblock) ||
+	    keyblock->key_block_size > vblock_size ||
+	    vblock_size - keyblock->key_block_size <
+	    EXPECTED_VBKERNELPREAMBLEHEADER2_0_SIZE)
+		return vblock_size;
+
+	/* The preamble signature comes last, after everything it signs */
+	preamble = (const VbKernelPreambleHeader *)
+		(vblock + keyblock->key_block_size);
+	sig = &preamble->preamble_signature;
+	used = keyblock->key_block_size +
+		((const uint8_t *)sig - (const uint8_t *)preamble);
+	if (sig->sig_offset > vblock_size || sig->sig_size > vblock_size)
+		return vblock_size;
+	used += sig->sig_offset + sig->sig_size;
+
+	return used < vblock_size ? used : vblock_size;
+}
+
+uint64_t VblockOverwriteSize(const uint8_t *old_vblock,
+			     const uint8_t *new_vblock, uint64_t vblock_size)
+{
+	uint64_t old_used = KernelVblockUsedSize(old_vblock, vblock_size);
+	uint64_t new_used = KernelVblockUsedSize(new_vblock, vblock_size);
+
+	return old_used > new_used ? old_used : new_used;
+}
+
+/*
+ * The part of a kernel vblock to write out; the rest is zeros which can be
+ * left as a hole.
+ */
+static uint64_t VblockWriteSize(const uint8_t *vblock, uint64_t vblock_size)
+{
+	uint64_t used = KernelVblockUsedSize(vblock, vblock_size);
+	uint64_t i;
+
+	for (i = used; i < vblock_size; i++)
+		if (vblock[i])
+			return vblock_size;
+	return used;
+}
+
+/* Writes [size] zero bytes, for output which can't have holes */
+static int WriteZeros(FILE *f, uint64_t size)
+{
+	static const uint8_t zeros[4096];
+	uint64_t len;
+
+	for (; size; size -= len) {
+		len = size < sizeof(zeros) ? size : sizeof(zeros);
+		if (1 != fwrite(zeros, len, 1, f))
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Writes each of the parts in turn. A part with no data is that many zero
+ * bytes, which are left as a hole if the output is a regular file. Returns
+ * zero on success.
+ */
+static int WriteParts(const char *outfile, int count,
+		      const void **data, const uint64_t *size)
+{
+	struct stat sb;
+	uint64_t total = 0;
+	int sparse;
+	int rv = 0;
+	FILE *f;
+	int i;
+
+	f = fopen(outfile, "wb");
+	if (!f) {
+		fprintf(stderr, "Can't open output file %s: %s\n",
+			outfile, strerror(errno));
+		return -1;
+	}
+	sparse = !fstat(fileno(f), &sb) && S_ISREG(sb.st_mode);
+
+	for (i = 0; i < count && !rv; i++) {
+		if (!size[i])
+			continue;
+		if (data[i])
+			rv = 1 != fwrite(data[i], size[i], 1, f);
+		else if (sparse)
+			rv = fseeko(f, size[i], SEEK_CUR);
+		else
+			rv = WriteZeros(f, size[i]);
+		total += size[i];
+	}
+
+	/* A hole at the end needs the file to be made that long */
+	if (!rv && sparse)
+		rv = fflush(f) || ftruncate(fileno(f), total);
+
+	if (rv) {
+		fprintf(stderr, "Can't write output file %s: %s\n",
+			outfile, strerror(errno));
+		fclose(f);
+		unlink(outfile);
+		return -1;
+	}
+
+	if (fclose(f)) {
+		fprintf(stderr, "Can't write output file %s: %s\n",
+			outfile, strerror(errno));
+		unlink(outfile);
+		return -1;
+	}
+
+	/* Success */
+	return 0;
+}
+
 /* Returns zero on success */
 int WriteSomeParts(const char *outfile,
 		   void *part1_data, uint64_t part1_size,
 		   void *part2_data, uint64_t part2_size)
 {
-	FILE *f;
+	const void *data[] = { part1_data, part2_data };
+	uint64_t size[] = { part1_size, part2_size };
 
 	/* Write the output file */
 	Debug("writing %s with 0x%" PRIx64 ", 0x%" PRIx64 "\n",
 	      outfile, part1_size, part2_size);
 
-	f = fopen(outfile, "wb");
-	if (!f) {
-		fprintf(stderr, "Can't open output file %s: %s\n",
+	return WriteParts(outfile, ARRAY_SIZE(data), data, size);
+}
+
+/* Returns zero on success */
+int WriteKPart(const char *outfile,
+	       void *vblock_data, uint64_t vblock_size,
+	       void *kblob_data, uint64_t kblob_size)
+{
+	uint64_t used = VblockWriteSize(vblock_data, vblock_size);
+	const void *data[] = { vblock_data, NULL, kblob_data };
+	uint64_t size[] = { used, vblock_size - used, kblob_size };
+
+	Debug("writing %s with 0x%" PRIx64 " (0x%" PRIx64 " padding), 0x%"
+	      PRIx64 "\n", outfile, vblock_size, vblock_size - used,
+	      kblob_size);
+
+	return WriteParts(outfile, ARRAY_SIZE(data), data, size);
+}
+
+/* Returns zero on success */
+int WriteKernelParts(const char *outfile,
+		     void *vblock_data, uint64_t vblock_size,
+		     void *kernel_data, uint64_t kernel_size,
+		     void *tail_data, uint64_t tail_size)
+{
+	uint64_t used = VblockWriteSize(vblock_data, vblock_size);
+	const void *data[] = {
+		vblock_data, NULL, kernel_data, NULL, tail_data
+	};
+	uint64_t size[] = {
+		used,
+		vblock_size - used,
+		kernel_size,
+		roundup(kernel_size, CROS_ALIGN) - kernel_size,
+		tail_size,
+	};
+
+	Debug("writing %s with 0x%" PRIx64 ", 0x%" PRIx64 ", 0x%" PRIx64 "\n",
+	      outfile, vblock_size, kernel_size, tail_size);
+
+	return WriteParts(outfile, ARRAY_SIZE(data), data, size);
+}
+
+/* Writes [size] bytes of [data] at [offset] in the open file [f] */
+static int WriteAt(FILE *f, const char *outfile, uint64_t offset,
+		   const void *data, uint64_t size)
+{
+	if (fseeko(f, offset, SEEK_SET) || 1 != fwrite(data, size, 1, f)) {
+		fprintf(stderr, "Can't write output file %s: %s\n",
 			outfile, strerror(errno));
 		return -1;
 	}
+	return 0;
+}
 
-	if (part1_data && part1_size) {
-		if (1 != fwrite(part1_data, part1_size, 1, f)) {
-			fprintf(stderr, "Can't write output file %s: %s\n",
-				outfile, strerror(errno));
-			fclose(f);
-			unlink(outfile);
-			return -1;
-		}
+/* Returns zero on success */
+int WriteKPartInPlace(const char *outfile, uint8_t *kpart_data,
+		      void *vblock_data, uint64_t vblock_size,
+		      int config_changed)
+{
+	FILE *f;
+	int rv;
+
+	/* The kernel blob has to stay where it is */
+	if (vblock_size != g_kernel_blob_data - kpart_data) {
+		fprintf(stderr, "New vblock is 0x%" PRIx64 " bytes, but the"
+			" old one is 0x%" PRIx64 "\n", vblock_size,
+			(uint64_t)(g_kernel_blob_data - kpart_data));
+		return -1;
 	}
 
-	if (part2_data && part2_size) {
-		if (1 != fwrite(part2_data, part2_size, 1, f)) {
-			fprintf(stderr, "Can't write output file %s: %s\n",
-				outfile, strerror(errno));
-			fclose(f);
-			unlink(outfile);
-			return -1;
-		}
+	f = fopen(outfile, "r+b");
+	if (!f) {
+		fprintf(stderr, "Can't open output file %s: %s\n",
+			outfile, strerror(errno));
+		return -1;
 	}
 
-	fclose(f);
+	/* Most of the padding can keep the zeros it had */
+	rv = WriteAt(f, outfile, 0, vblock_data,
+		     VblockOverwriteSize(kpart_data, vblock_data,
+					 vblock_size));
+	if (!rv && config_changed)
+		rv = WriteAt(f, outfile, g_config_data - kpart_data,
+			     g_config_data, g_config_size);
 
-	/* Success */
-	return 0;
+	if (fclose(f) && !rv) {
+		fprintf(stderr, "Can't write output file %s: %s\n",
+			outfile, strerror(errno));
+		rv = -1;
+	}
+
+	return rv;
 }
 
 /* Returns 0 on success */
@@ -498,6 +903,7 @@ int VerifyKernelBlob(uint8_t *kernel_blob,
 	int rv = -1;
 	uint64_t vmlinuz_header_size = 0;
 	uint64_t vmlinuz_header_address = 0;
+	uint8_t *loaded_blob = kernel_blob;
 
 	if (0 != KeyBlockVerify(g_keyblock, g_keyblock->key_block_size,
 				signpub_key, (0 == signpub_key))) {
@@ -602,6 +1008,20 @@ int VerifyKernelBlob(uint8_t *kernel_blob,
 		printf("  Flags          :       0x%" PRIx32 "\n",
 		       g_preamble->flags);
 
+	if (VbKernelHasBodyHashes(g_preamble) == VBOOT_SUCCESS) {
+		printf("  Body hash blocks:    %" PRIu32 " of 0x%" PRIx32
+		       " bytes\n", g_preamble->body_hash_count,
+		       g_preamble->body_hash_block_size);
+		printf("  Checked at boot:     0x0-0x%" PRIx32 ", 0x%" PRIx32
+		       "-end\n", g_preamble->body_hash_head_size,
+		       g_preamble->body_hash_tail_offset);
+	}
+
+	if (g_body_compression != COMPRESS_NONE)
+		printf("  Body compression:    %" PRIu32 ", 0x%" PRIx64
+		       " bytes loaded\n", g_body_compression,
+		       g_body_load_size);
+
 	if (g_preamble->kernel_version < (min_version & 0xFFFF)) {
 		fprintf(stderr,
 			"Kernel version %" PRIu64 " is lower than minimum %"
@@ -616,29 +1036,58 @@ int VerifyKernelBlob(uint8_t *kernel_blob,
 		fprintf(stderr, "Error verifying kernel body.\n");
 		goto done;
 	}
+	if (VbKernelHasBodyHashes(g_preamble) == VBOOT_SUCCESS &&
+	    0 != VerifyKernelBodyBlocks(g_preamble, kernel_blob, 0,
+					g_preamble->body_signature.data_size,
+					rsa)) {
+		fprintf(stderr, "Error verifying kernel body blocks.\n");
+		goto done;
+	}
 	printf("Body verification succeeded.\n");
 
-	printf("Config:\n%s\n", kernel_blob + KernelCmdLineOffset(g_preamble));
+	if (g_body_compression != COMPRESS_NONE) {
+		loaded_blob = DecompressKernelBlob(g_preamble, kernel_blob,
+						   kernel_size);
+		if (!loaded_blob) {
+			fprintf(stderr, "Error decompressing kernel body.\n");
+			goto done;
+		}
+	}
+
+	printf("Config:\n%s\n", loaded_blob + KernelCmdLineOffset(g_preamble));
 
 	rv = 0;
 done:
+	if (loaded_blob != kernel_blob)
+		free(loaded_blob);
 	return rv;
 }
 
 
-uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint64_t vmlinuz_size,
-			  enum arch_t arch, uint64_t kernel_body_load_address,
-			  uint8_t *config_data, uint64_t config_size,
-			  uint8_t *bootloader_data, uint64_t bootloader_size,
-			  uint64_t *blob_size_ptr)
+/*
+ * Lays out the kernel blob from its parts. If kernel_in_place is set, the
+ * 32-bit kernel is left where it is in vmlinuz_buf, and the returned buffer
+ * holds only what follows it (padded to CROS_ALIGN) in the blob.
+ */
+static uint8_t *LayOutKernelBlob(uint8_t *vmlinuz_buf, uint64_t vmlinuz_size,
+				 enum arch_t arch,
+				 uint64_t kernel_body_load_address,
+				 uint8_t *config_data, uint64_t config_size,
+				 uint8_t *bootloader_data,
+				 uint64_t bootloader_size,
+				 int kernel_in_place, uint64_t *size_ptr)
 {
 	uint64_t now = 0;
+	uint64_t skip = 0;
+	uint8_t *buf;
 	int tmp;
 
 	/* We have all the parts. How much room do we need? */
 	tmp = KernelSize(vmlinuz_buf, vmlinuz_size, arch);
 	if (tmp < 0)
 		return NULL;
+	g_body_compression = COMPRESS_NONE;
+	g_body_load_size = 0;
 	g_kernel_size = tmp;
 	g_config_size = CROS_CONFIG_SIZE;
 	g_param_size = CROS_PARAMS_SIZE;
@@ -652,27 +1101,32 @@ uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint64_t vmlinuz_size,
 		g_vmlinuz_header_size;
 	Debug("g_kernel_blob_size  0x%" PRIx64 "\n", g_kernel_blob_size);
 
-	/* Allocate space for the blob. */
-	g_kernel_blob_data = malloc(g_kernel_blob_size);
-	Memset(g_kernel_blob_data, 0, g_kernel_blob_size);
+	if (kernel_in_place)
+		skip = roundup(g_kernel_size, CROS_ALIGN);
+
+	/* Allocate space for the blob, or the part of it after the kernel. */
+	buf = malloc(g_kernel_blob_size - skip);
+	if (!buf)
+		return NULL;
+	Memset(buf, 0, g_kernel_blob_size - skip);
 
 	/* Assign the sub-pointers */
-	g_kernel_data = g_kernel_blob_data + now;
+	g_kernel_data = kernel_in_place ? NULL : buf;
 	Debug("g_kernel_size       0x%" PRIx64 " ofs 0x%" PRIx64 "\n",
 	      g_kernel_size, now);
 	now += roundup(g_kernel_size, CROS_ALIGN);
 
-	g_config_data = g_kernel_blob_data + now;
+	g_config_data = buf + now - skip;
 	Debug("g_config_size       0x%" PRIx64 " ofs 0x%" PRIx64 "\n",
 	      g_config_size, now);
 	now += g_config_size;
 
-	g_param_data = g_kernel_blob_data + now;
+	g_param_data = buf + now - skip;
 	Debug("g_param_size        0x%" PRIx64 " ofs 0x%" PRIx64 "\n",
 	      g_param_size, now);
 	now += g_param_size;
 
-	g_bootloader_data = g_kernel_blob_data + now;
+	g_bootloader_data = buf + now - skip;
 	Debug("g_bootloader_size   0x%" PRIx64 " ofs 0x%" PRIx64 "\n",
 	      g_bootloader_size, now);
 	g_ondisk_bootloader_addr = kernel_body_load_address + now;
@@ -681,7 +1135,7 @@ uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint64_t vmlinuz_size,
 	now += g_bootloader_size;
 
 	if (g_vmlinuz_header_size) {
-		g_vmlinuz_header_data = g_kernel_blob_data + now;
+		g_vmlinuz_header_data = buf + now - skip;
 		Debug("g_vmlinuz_header_size 0x%" PRIx64 " ofs 0x%" PRIx64 "\n",
 		      g_vmlinuz_header_size, now);
 		g_ondisk_vmlinuz_header_addr = kernel_body_load_address + now;
@@ -695,9 +1149,7 @@ uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint64_t vmlinuz_size,
 	if (0 != PickApartVmlinuz(vmlinuz_buf, vmlinuz_size,
 				  arch, kernel_body_load_address)) {
 		fprintf(stderr, "Error picking apart kernel file.\n");
-		free(g_kernel_blob_data);
-		g_kernel_blob_data = NULL;
-		g_kernel_blob_size = 0;
+		free(buf);
 		return NULL;
 	}
 
@@ -710,11 +1162,147 @@ uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint64_t vmlinuz_size,
 		       g_vmlinuz_header_size);
 	}
 
-	if (blob_size_ptr)
-		*blob_size_ptr = g_kernel_blob_size;
+	if (size_ptr)
+		*size_ptr = g_kernel_blob_size - skip;
+	return buf;
+}
+
+uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint64_t vmlinuz_size,
+			  enum arch_t arch, uint64_t kernel_body_load_address,
+			  uint8_t *config_data, uint64_t config_size,
+			  uint8_t *bootloader_data, uint64_t bootloader_size,
+			  uint64_t *blob_size_ptr)
+{
+	g_kernel_blob_data = LayOutKernelBlob(vmlinuz_buf, vmlinuz_size, arch,
+					      kernel_body_load_address,
+					      config_data, config_size,
+					      bootloader_data, bootloader_size,
+					      0, blob_size_ptr);
+	if (!g_kernel_blob_data)
+		g_kernel_blob_size = 0;
 	return g_kernel_blob_data;
 }
 
+uint8_t *CreateKernelBlobTail(uint8_t *vmlinuz_buf, uint64_t vmlinuz_size,
+			      enum arch_t arch,
+			      uint64_t kernel_body_load_address,
+			      uint8_t *config_data, uint64_t config_size,
+			      uint8_t *bootloader_data,
+			      uint64_t bootloader_size,
+			      uint8_t **kernel_ptr, uint64_t *kernel_size_ptr,
+			      uint64_t *tail_size_ptr)
+{
+	uint8_t *tail;
+
+	tail = LayOutKernelBlob(vmlinuz_buf, vmlinuz_size, arch,
+				kernel_body_load_address,
+				config_data, config_size,
+				bootloader_data, bootloader_size,
+				1, tail_size_ptr);
+	if (!tail)
+		return NULL;
+
+	/* The 32-bit kernel is whatever follows the vmlinuz header */
+	*kernel_ptr = vmlinuz_buf + g_vmlinuz_header_size;
+	*kernel_size_ptr = g_kernel_size;
+	return tail;
+}
+
+uint8_t *CompressBody(const uint8_t *data, uint64_t size,
+		      uint64_t *compressed_size_ptr)
+{
+	lzma_stream stream = LZMA_STREAM_INIT;
+	lzma_options_lzma options;
+	uint8_t *buf;
+	uint64_t buf_size;
+	lzma_ret ret;
+
+	/* The firmware holds the size it decompresses to in 32 bits */
+	if (size > UINT32_MAX)
+		return NULL;
+
+	/* The same LZMA1 as bmpblk_utility, which the firmware can read */
+	lzma_lzma_preset(&options, 9);
+	if (lzma_alone_encoder(&stream, &options) != LZMA_OK)
+		return NULL;
+
+	/* Incompressible data grows a little */
+	buf_size = size + size / 64 + 4096;
+	buf = malloc(buf_size);
+	if (!buf) {
+		lzma_end(&stream);
+		return NULL;
+	}
+	stream.next_in = data;
+	stream.avail_in = size;
+	stream.next_out = buf;
+	stream.avail_out = buf_size;
+	ret = lzma_code(&stream, LZMA_FINISH);
+	lzma_end(&stream);
+	if (ret != LZMA_STREAM_END) {
+		free(buf);
+		return NULL;
+	}
+	Debug("compressed 0x%" PRIx64 " bytes to 0x%" PRIx64 "\n",
+	      size, (uint64_t)stream.total_out);
+
+	if (compressed_size_ptr)
+		*compressed_size_ptr = stream.total_out;
+	return buf;
+}
+
+uint8_t *CompressKernelBlob(uint8_t *kernel_blob, uint64_t kernel_size,
+			    uint64_t *compressed_size_ptr)
+{
+	uint8_t *buf;
+
+	buf = CompressBody(kernel_blob, kernel_size, compressed_size_ptr);
+	if (!buf)
+		return NULL;
+
+	g_body_compression = COMPRESS_LZMA1;
+	g_body_load_size = kernel_size;
+	return buf;
+}
+
+uint8_t *DecompressKernelBlob(VbKernelPreambleHeader *preamble,
+			      uint8_t *kernel_blob, uint64_t kernel_size)
+{
+	lzma_stream stream = LZMA_STREAM_INIT;
+	uint32_t compression;
+	uint64_t load_size;
+	uint8_t *buf;
+	lzma_ret ret;
+
+	VbGetKernelBodyCompression(preamble, &compression, &load_size);
+	if (compression != COMPRESS_LZMA1) {
+		fprintf(stderr, "Can't decompress type %" PRIu32 "\n",
+			compression);
+		return NULL;
+	}
+
+	buf = malloc(load_size);
+	if (!buf)
+		return NULL;
+	if (lzma_alone_decoder(&stream, UINT64_MAX) != LZMA_OK) {
+		free(buf);
+		return NULL;
+	}
+	stream.next_in = kernel_blob;
+	stream.avail_in = kernel_size;
+	stream.next_out = buf;
+	stream.avail_out = load_size;
+	ret = lzma_code(&stream, LZMA_FINISH);
+	lzma_end(&stream);
+
+	/* It has to come out exactly the size the firmware loads */
+	if (ret != LZMA_STREAM_END || stream.total_out != load_size) {
+		free(buf);
+		return NULL;
+	}
+	return buf;
+}
+
 enum futil_file_type recognize_vblock1(uint8_t *buf, uint32_t len)
 {
 	VbKeyBlockHeader *key_block = (VbKeyBlockHeader *)buf;
@@ -750,6 +1338,33 @@ enum futil_file_type recognize_vblock1(uint8_t *buf, uint32_t len)
 	return FILE_TYPE_UNKNOWN;
 }
 
+enum futil_file_type recognize_vb_shared_data(uint8_t *buf, uint32_t len)
+{
+	VbSharedDataHeader *sh = (VbSharedDataHeader *)buf;
+	uint64_t need = VB_SHARED_DATA_HEADER_SIZE_V1;
+
+	if (VbSharedDataIsCompact(buf, len)) {
+		sh = VbSharedDataExpand(buf, len, NULL);
+		if (!sh)
+			return FILE_TYPE_UNKNOWN;
+		free(sh);
+		return FILE_TYPE_VB_SHARED_DATA;
+	}
+
+	if (len < need || sh->magic != VB_SHARED_DATA_MAGIC)
+		return FILE_TYPE_UNKNOWN;
+
+	/* All the fields for its version must be there */
+	if (sh->struct_version >= 3)
+		need = VB_SHARED_DATA_HEADER_SIZE_V3_MIN;
+	else if (sh->struct_version == 2)
+		need = VB_SHARED_DATA_HEADER_SIZE_V2;
+	if (sh->struct_size < need || sh->struct_size > len)
+		return FILE_TYPE_UNKNOWN;
+
+	return FILE_TYPE_VB_SHARED_DATA;
+}
+
 enum futil_file_type recognize_privkey(uint8_t *buf, uint32_t len)
 {
 	VbPrivateKey key;
@@ -14,16 +14,137 @@ uint8_t *CreateKernelBlob(uint8_t *vmlinuz_buf, uint64_t vmlinuz_size,
 			  uint8_t *bootloader_data, uint64_t bootloader_size,
 			  uint64_t *blob_size_ptr);
 
+/*
+ * Like CreateKernelBlob(), but leaves the 32-bit kernel where it is in
+ * vmlinuz_buf. Returns the rest of the blob, which follows the kernel after
+ * padding it to CROS_ALIGN, and points kernel_ptr at the kernel.
+ */
+uint8_t *CreateKernelBlobTail(uint8_t *vmlinuz_buf, uint64_t vmlinuz_size,
+			      enum arch_t arch,
+			      uint64_t kernel_body_load_address,
+			      uint8_t *config_data, uint64_t config_size,
+			      uint8_t *bootloader_data,
+			      uint64_t bootloader_size,
+			      uint8_t **kernel_ptr, uint64_t *kernel_size_ptr,
+			      uint64_t *tail_size_ptr);
+
+/*
+ * Compresses [data] with LZMA1, the way the firmware can decompress it.
+ * Returns a buffer to free(), or NULL on error.
+ */
+uint8_t *CompressBody(const uint8_t *data, uint64_t size,
+		      uint64_t *compressed_size_ptr);
+
+/*
+ * Compresses the blob from CreateKernelBlob() with LZMA1. The blob signed
+ * after this is the compressed one, and its preamble says what the firmware
+ * decompresses it to. Returns a buffer to free(), or NULL on error.
+ */
+uint8_t *CompressKernelBlob(uint8_t *kernel_blob, uint64_t kernel_size,
+			    uint64_t *compressed_size_ptr);
+
+/*
+ * Decompresses a kernel blob which [preamble] says is compressed, to the size
+ * the preamble says it loads to. Returns a buffer to free(), or NULL on error.
+ */
+uint8_t *DecompressKernelBlob(VbKernelPreambleHeader *preamble,
+			      uint8_t *kernel_blob, uint64_t kernel_size);
+
 uint8_t *SignKernelBlob(uint8_t *kernel_blob, uint64_t kernel_size,
 			uint64_t padding,
 			int version, uint64_t kernel_body_load_address,
 			VbKeyBlockHeader *keyblock, VbPrivateKey *signpriv_key,
-			uint32_t flags, uint64_t *vblock_size_ptr);
+			uint32_t flags, uint32_t hash_block_size,
+			uint64_t *vblock_size_ptr);
+
+/* Size of the vblock SignKernelBlob() makes for these. */
+uint64_t KernelVblockSize(uint64_t kernel_size, uint64_t padding,
+			  VbKeyBlockHeader *keyblock,
+			  VbPrivateKey *signpriv_key,
+			  uint32_t hash_block_size);
+
+/*
+ * Like SignKernelBlob(), but builds the vblock in the [vblock_size] bytes at
+ * [vblock], which must be at least KernelVblockSize(), without allocating or
+ * copying it. The vblock can be the start of the mapped kernel partition
+ * itself, since [keyblock] may already be there; the padding isn't written.
+ * Returns zero on success.
+ */
+int SignKernelBlobInto(uint8_t *vblock, uint64_t vblock_size,
+		       uint8_t *kernel_blob, uint64_t kernel_size,
+		       uint64_t padding,
+		       int version, uint64_t kernel_body_load_address,
+		       VbKeyBlockHeader *keyblock, VbPrivateKey *signpriv_key,
+		       uint32_t flags, uint32_t hash_block_size);
+
+/*
+ * Like SignKernelBlob() with no hash_block_size, for the kernel and tail
+ * from CreateKernelBlobTail(). The blob is hashed a part at a time.
+ */
+uint8_t *SignKernelParts(uint8_t *kernel_data, uint64_t kernel_size,
+			 uint8_t *tail_data, uint64_t tail_size,
+			 uint64_t padding,
+			 int version, uint64_t kernel_body_load_address,
+			 VbKeyBlockHeader *keyblock, VbPrivateKey *signpriv_key,
+			 uint32_t flags, uint64_t *vblock_size_ptr);
+
+/*
+ * Like SignKernelBlob() with no hash_block_size, for a blob which hasn't
+ * changed since it was signed with old_keyblock and old_preamble. Once the
+ * old preamble checks out, the digest from its body signature is signed
+ * again without reading the blob. Returns NULL if the old signatures are bad
+ * or signpriv_key uses a different hash algorithm.
+ */
+uint8_t *ResignKernelBlob(VbKeyBlockHeader *old_keyblock,
+			  VbKernelPreambleHeader *old_preamble,
+			  uint64_t padding,
+			  int version, uint64_t kernel_body_load_address,
+			  VbKeyBlockHeader *keyblock,
+			  VbPrivateKey *signpriv_key,
+			  uint32_t flags, uint64_t *vblock_size_ptr);
 
 int WriteSomeParts(const char *outfile,
 		   void *part1_data, uint64_t part1_size,
 		   void *part2_data, uint64_t part2_size);
 
+/*
+ * How much of a kernel vblock is the keyblock and the signed preamble. The
+ * rest is padding, which nothing reads, so it's left as a hole when writing
+ * a new file, and mostly not written in an existing partition.
+ */
+uint64_t KernelVblockUsedSize(const uint8_t *vblock, uint64_t vblock_size);
+
+/*
+ * How much of [new_vblock] to write over [old_vblock] in an existing
+ * partition: what either of them uses. The padding past that is left alone.
+ */
+uint64_t VblockOverwriteSize(const uint8_t *old_vblock,
+			     const uint8_t *new_vblock, uint64_t vblock_size);
+
+/*
+ * Writes a kernel partition from a kernel vblock and the kernel blob, which
+ * may be NULL to write just the vblock.
+ */
+int WriteKPart(const char *outfile,
+	       void *vblock_data, uint64_t vblock_size,
+	       void *kblob_data, uint64_t kblob_size);
+
+/* Writes a kernel partition from the parts made by CreateKernelBlobTail(). */
+int WriteKernelParts(const char *outfile,
+		     void *vblock_data, uint64_t vblock_size,
+		     void *kernel_data, uint64_t kernel_size,
+		     void *tail_data, uint64_t tail_size);
+
+/*
+ * Rewrites just the vblock and, if [config_changed], the config of the
+ * kernel partition in [outfile], which was mapped at [kpart_data] and
+ * unpacked with UnpackKPart().  The rest of the partition is left alone, so
+ * the new vblock must be the same size as the old one.
+ */
+int WriteKPartInPlace(const char *outfile, uint8_t *kpart_data,
+		      void *vblock_data, uint64_t vblock_size,
+		      int config_changed);
+
 uint8_t *UnpackKPart(uint8_t *kpart_data, uint64_t kpart_size,
 		     uint64_t padding,
 		     VbKeyBlockHeader **keyblock_ptr,
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "2sysincludes.h"
+#include "2return_codes.h"
+#include "futility.h"
+#include "verify_cache.h"
+
+/* The file is this header followed by the entries */
+static const char cache_magic[8] = "VBVCACH1";
+
+/* Open-addressed hash set of entries; size is always a power of two */
+static struct {
+	int fd;
+	struct verify_cache_entry *entry;
+	uint8_t *used;
+	uint32_t count;
+	uint32_t size;
+} cache = {
+	.fd = -1,
+};
+
+static uint32_t slot_of(const struct verify_cache_entry *entry)
+{
+	uint32_t h;
+
+	/* The entries are digests already, so any four bytes will do */
+	memcpy(&h, entry->digest, sizeof(h));
+	return h & (cache.size - 1);
+}
+
+/* Adds an entry to the hash set. Returns nonzero if it was already there. */
+static int insert(const struct verify_cache_entry *entry)
+{
+	struct verify_cache_entry *old_entry = cache.entry;
+	uint8_t *old_used = cache.used;
+	uint32_t old_size = cache.size;
+	uint32_t i;
+
+	/* Keep it at most half full */
+	if (2 * (cache.count + 1) > cache.size) {
+		cache.size = cache.size ? 2 * cache.size : 1024;
+		cache.entry = calloc(cache.size, sizeof(*cache.entry));
+		cache.used = calloc(cache.size, 1);
+		if (!cache.entry || !cache.used) {
+			/* Just forget everything */
+			free(cache.entry);
+			free(cache.used);
+			cache.entry = old_entry;
+			cache.used = old_used;
+			cache.size = old_size;
+			return 0;
+		}
+		cache.count = 0;
+		for (i = 0; i < old_size; i++)
+			if (old_used[i])
+				insert(&old_entry[i]);
+		free(old_entry);
+		free(old_used);
+	}
+
+	for (i = slot_of(entry); cache.used[i]; i = (i + 1) & (cache.size - 1))
+		if (!memcmp(&cache.entry[i], entry, sizeof(*entry)))
+			return 1;
+
+	cache.entry[i] = *entry;
+	cache.used[i] = 1;
+	cache.count++;
+	return 0;
+}
+
+int verify_cache_lookup(const struct verify_cache_entry *entry)
+{
+	uint32_t i;
+
+	if (!cache.size)
+		return 0;
+
+	for (i = slot_of(entry); cache.used[i]; i = (i + 1) & (cache.size - 1))
+		if (!memcmp(&cache.entry[i], entry, sizeof(*entry)))
+			return 1;
+
+	return 0;
+}
+
+void verify_cache_add(const struct verify_cache_entry *entry)
+{
+	if (cache.fd < 0 || insert(entry))
+		return;
+
+	/* Appending a whole entry at once keeps concurrent writers apart */
+	if (sizeof(*entry) != write(cache.fd, entry, sizeof(*entry)))
+		fprintf(stderr, "Can't add to the verification cache: %s\n",
+			strerror(errno));
+}
+
+int verify_cache_open(const char *filename, int recheck)
+{
+	struct verify_cache_entry entry;
+	char magic[sizeof(cache_magic)];
+	struct stat sb;
+	FILE *fp;
+
+	cache.fd = open(filename, O_RDWR | O_APPEND | O_CREAT, 0600);
+	if (cache.fd < 0) {
+		fprintf(stderr, "Can't open %s: %s\n",
+			filename, strerror(errno));
+		return 1;
+	}
+
+	fp = fdopen(dup(cache.fd), "rb");
+	if (!fp) {
+		fprintf(stderr, "Can't read %s: %s\n",
+			filename, strerror(errno));
+		verify_cache_close();
+		return 1;
+	}
+
+	if (!fstat(cache.fd, &sb) && !sb.st_size) {
+		/* It's new, so start it off */
+		if (sizeof(cache_magic) !=
+		    write(cache.fd, cache_magic, sizeof(cache_magic))) {
+			fprintf(stderr, "Can't write %s: %s\n",
+				filename, strerror(errno));
+			fclose(fp);
+			verify_cache_close();
+			return 1;
+		}
+	} else if (1 != fread(magic, sizeof(magic), 1, fp) ||
+		   memcmp(magic, cache_magic, sizeof(magic))) {
+		fprintf(stderr, "%s is not a verification cache\n", filename);
+		fclose(fp);
+		verify_cache_close();
+		return 1;
+	} else {
+		/* Any partly written entry at the end is just ignored */
+		while (1 == fread(&entry, sizeof(entry), 1, fp))
+			if (!recheck)
+				insert(&entry);
+	}
+
+	Debug("%s has %d entries\n", filename, cache.count);
+	fclose(fp);
+	return 0;
+}
+
+void verify_cache_close(void)
+{
+	if (cache.fd >= 0)
+		close(cache.fd);
+	free(cache.entry);
+	free(cache.used);
+	memset(&cache, 0, sizeof(cache));
+	cache.fd = -1;
+}
+
+int verify_cache_enabled(void)
+{
+	return cache.fd >= 0;
+}
+
+int verify_cache_entry(struct verify_cache_entry *entry,
+		       enum verify_cache_kind kind,
+		       const uint8_t *data, uint32_t size,
+		       const VbPublicKey *key)
+{
+	const uint8_t *key_data = (const uint8_t *)key + key->key_offset;
+	struct vb2_digest_context dc;
+	uint8_t k = kind;
+
+	if (VB2_SUCCESS != vb2_digest_init(&dc, VB2_HASH_SHA256) ||
+	    VB2_SUCCESS != vb2_digest_extend(&dc, &k, sizeof(k)) ||
+	    VB2_SUCCESS != vb2_digest_extend(&dc, (uint8_t *)&size,
+					     sizeof(size)) ||
+	    VB2_SUCCESS != vb2_digest_extend(&dc, data, size) ||
+	    VB2_SUCCESS != vb2_digest_extend(&dc, (uint8_t *)&key->algorithm,
+					     sizeof(key->algorithm)) ||
+	    VB2_SUCCESS != vb2_digest_extend(&dc, key_data, key->key_size) ||
+	    VB2_SUCCESS != vb2_digest_finalize(&dc, entry->digest,
+					       sizeof(entry->digest)))
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+#ifndef VBOOT_REFERENCE_FUTILITY_VERIFY_CACHE_H_
+#define VBOOT_REFERENCE_FUTILITY_VERIFY_CACHE_H_
+
+#include <stdint.h>
+
+#include "2sysincludes.h"
+#include "2sha.h"
+#include "vboot_struct.h"
+
+/*
+ * A persistent record of signatures that have already been checked, so that
+ * verifying the same keyblock, preamble, or body with the same key again
+ * doesn't need any RSA.  Each entry is the SHA-256 digest of what was checked
+ * and the key it was checked with; only successes are recorded.
+ *
+ * Anyone who can write to the cache file can make anything verify, so it
+ * must be kept somewhere only trusted users can change.
+ */
+
+/* What kind of thing was verified */
+enum verify_cache_kind {
+	VERIFY_CACHE_KEYBLOCK = 1,
+	VERIFY_CACHE_FW_PREAMBLE,
+	VERIFY_CACHE_KERN_PREAMBLE,
+	VERIFY_CACHE_BODY,
+};
+
+struct verify_cache_entry {
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+};
+
+/*
+ * Opens the cache file, creating it if needed, and reads what's in it. If
+ * [recheck] is nonzero, the old entries are ignored, but new ones are still
+ * added. Returns zero on success.
+ */
+int verify_cache_open(const char *filename, int recheck);
+
+/* Closes the cache file, if it's open. */
+void verify_cache_close(void);
+
+/* Returns nonzero if the cache is open. */
+int verify_cache_enabled(void);
+
+/*
+ * Works out the entry for [kind], covering [size] bytes of [data] and the
+ * public [key] (which must already have been checked). [data] may itself be
+ * a digest of something bigger. Returns zero on success.
+ */
+int verify_cache_entry(struct verify_cache_entry *entry,
+		       enum verify_cache_kind kind,
+		       const uint8_t *data, uint32_t size,
+		       const VbPublicKey *key);
+
+/* Returns nonzero if the entry is in the cache. */
+int verify_cache_lookup(const struct verify_cache_entry *entry);
+
+/*
+ * Records a successful verification, both in memory and at the end of the
+ * cache file. Several processes can add to the same file at once.
+ */
+void verify_cache_add(const struct verify_cache_entry *entry);
+
+#endif	/* VBOOT_REFERENCE_FUTILITY_VERIFY_CACHE_H_ */
@@ -3,6 +3,7 @@
  * found in the LICENSE file.
  */
 
+#include <dirent.h>
 #include <stdio.h>
 #include <string.h>
 #include <stddef.h>
@@ -54,6 +55,18 @@ typedef struct PlatformFamily {
   const char* platform_string;   /* String to return */
 } PlatformFamily;
 
+/* An FDT property, read once and then served from memory */
+typedef struct FdtProperty {
+  char* name;   /* Name under FDT_BASE_PATH, or absolute path */
+  char* data;   /* Contents, followed by a 0 not counted in size */
+  size_t size;
+} FdtProperty;
+
+/* Every property under FDT_BASE_PATH, plus any absolute paths looked up */
+static FdtProperty* fdt_cache;
+static int fdt_cache_count;
+static int fdt_cache_loaded;
+
 /* Array of platform family names, terminated with a NULL entry */
 const PlatformFamily platform_family_array[] = {
   {"nvidia,tegra124", "Tegra5"},
@@ -86,23 +99,121 @@ static int FindEmmcDev(void) {
   return E_FAIL;
 }
 
-static int ReadFdtValue(const char *property, int *value) {
-  char filename[FNAME_SIZE];
+static int ReadFdtFile(const char *filename, char **data_out,
+                       size_t *size_out) {
   FILE *file;
-  int data = 0;
+  long property_size;
+  char *data;
 
-  snprintf(filename, sizeof(filename), FDT_BASE_PATH "/%s", property);
   file = fopen(filename, "rb");
-  if (!file) {
+  if (!file)
+    return E_FILEOP;
+
+  fseek(file, 0, SEEK_END);
+  property_size = ftell(file);
+  rewind(file);
+  if (property_size < 0) {
+    fclose(file);
+    return E_FILEOP;
+  }
+
+  data = malloc(property_size + 1);
+  if (!data) {
+    fclose(file);
+    return E_MEM;
+  }
+  data[property_size] = 0;
+
+  if (property_size && 1 != fread(data, property_size, 1, file)) {
+    fclose(file);
+    free(data);
+    return E_FILEOP;
+  }
+
+  fclose(file);
+  *data_out = data;
+  *size_out = property_size;
+  return 0;
+}
+
+/* Add [filename] to the cache under [name].  Returns the new entry, or NULL
+ * if the file can't be read. */
+static FdtProperty *AddFdtProperty(const char *name, const char *filename) {
+  FdtProperty *cache;
+  FdtProperty *p;
+
+  cache = realloc(fdt_cache, (fdt_cache_count + 1) * sizeof(*fdt_cache));
+  if (!cache)
+    return NULL;
+  fdt_cache = cache;
+
+  p = fdt_cache + fdt_cache_count;
+  if (ReadFdtFile(filename, &p->data, &p->size))
+    return NULL;
+  p->name = strdup(name);
+  if (!p->name) {
+    free(p->data);
+    return NULL;
+  }
+  fdt_cache_count++;
+  return p;
+}
+
+/* Read every property in FDT_BASE_PATH, so that each lookup after the first
+ * doesn't need its own open and read. */
+static void LoadFdtCache(void) {
+  char filename[FNAME_SIZE];
+  struct stat file_status;
+  struct dirent *entry;
+  DIR *dir;
+
+  fdt_cache_loaded = 1;
+  dir = opendir(FDT_BASE_PATH);
+  if (!dir)
+    return;
+  while ((entry = readdir(dir))) {
+    /* Child nodes are directories; only properties are files */
+    snprintf(filename, sizeof(filename), FDT_BASE_PATH "/%s", entry->d_name);
+    if (stat(filename, &file_status) || !S_ISREG(file_status.st_mode))
+      continue;
+    AddFdtProperty(entry->d_name, filename);
+  }
+  closedir(dir);
+}
+
+/* Find [property], which is either a name under FDT_BASE_PATH or an absolute
+ * path.  Returns NULL if it doesn't exist. */
+static const FdtProperty *FindFdtProperty(const char *property) {
+  int i;
+
+  if (!fdt_cache_loaded)
+    LoadFdtCache();
+
+  for (i = 0; i < fdt_cache_count; i++) {
+    if (!strcmp(fdt_cache[i].name, property))
+      return fdt_cache + i;
+  }
+
+  /* Anything outside FDT_BASE_PATH is read the first time it's asked for */
+  if (property[0] == '/')
+    return AddFdtProperty(property, property);
+  return NULL;
+}
+
+static int ReadFdtValue(const char *property, int *value) {
+  const FdtProperty *p = FindFdtProperty(property);
+  int data = 0;
+
+  if (!p) {
     fprintf(stderr, "Unable to open FDT property %s\n", property);
     return E_FILEOP;
   }
 
-  if (fread(&data, 1, sizeof(data), file) != sizeof(data)) {
+  if (p->size < sizeof(data)) {
     fprintf(stderr, "Unable to read FDT property %s\n", property);
     return E_FILEOP;
   }
-  fclose(file);
+  memcpy(&data, p->data, sizeof(data));
 
   if (value)
     *value = ntohl(data); /* FDT is network byte order */
@@ -117,62 +228,32 @@ static int ReadFdtInt(const char *property) {
   return value;
 }
 
-static void GetFdtPropertyPath(const char *property, char *path, size_t size) {
-  if (property[0] == '/')
-    StrCopy(path, property, size);
-  else
-    snprintf(path, size, FDT_BASE_PATH "/%s", property);
-}
-
 static int FdtPropertyExist(const char *property) {
-  char filename[FNAME_SIZE];
-  struct stat file_status;
-
-  GetFdtPropertyPath(property, filename, sizeof(filename));
-  if (!stat(filename, &file_status))
-    return 1; // It exists!
-  else
-    return 0; // It does not exist or some error happened.
+  return FindFdtProperty(property) != NULL;
 }
 
+/* Return a copy of [property] in [block], which the caller must free */
 static int ReadFdtBlock(const char *property, void **block, size_t *size) {
-  char filename[FNAME_SIZE];
-  FILE *file;
-  size_t property_size;
+  const FdtProperty *p;
   char *data;
 
   if (!block)
     return E_FAIL;
 
-  GetFdtPropertyPath(property, filename, sizeof(filename));
-  file = fopen(filename, "rb");
-  if (!file) {
+  p = FindFdtProperty(property);
+  if (!p) {
     fprintf(stderr, "Unable to open FDT property %s\n", property);
     return E_FILEOP;
   }
 
-  fseek(file, 0, SEEK_END);
-  property_size = ftell(file);
-  rewind(file);
-
-  data = malloc(property_size +1);
-  if (!data) {
-    fclose(file);
+  data = malloc(p->size + 1);
+  if (!data)
     return E_MEM;
-  }
-  data[property_size] = 0;
-
-  if (1 != fread(data, property_size, 1, file)) {
-    fprintf(stderr, "Unable to read from property %s\n", property);
-    fclose(file);
-    free(data);
-    return E_FILEOP;
-  }
+  memcpy(data, p->data, p->size + 1);
 
-  fclose(file);
   *block = data;
   if (size)
-    *size = property_size;
+    *size = p->size;
 
   return 0;
 }
@@ -505,16 +586,50 @@ int VbWriteNvStorage(VbNvContext* vnc) {
 VbSharedDataHeader *VbSharedDataRead(void) {
   void *block = NULL;
   size_t size = 0;
+  size_t expect_size;
+  VbSharedDataHeader *p;
+
+  /* The FDT node is already binary, so there's nothing to decode */
   if (ReadFdtBlock("vboot-shared-data", &block, &size))
     return NULL;
-  VbSharedDataHeader *p = (VbSharedDataHeader *)block;
+  /* Firmware may hand over the compact encoding instead */
+  if (VbSharedDataIsCompact(block, size)) {
+    uint64_t expanded_size;
+    void *expanded = VbSharedDataExpand(block, size, &expanded_size);
+    free(block);
+    if (!expanded)
+      return NULL;
+    block = expanded;
+    size = expanded_size;
+  }
+  p = (VbSharedDataHeader *)block;
+  if (size < offsetof(VbSharedDataHeader, struct_size)) {
+    free(block);
+    return NULL;
+  }
   if (p->magic != VB_SHARED_DATA_MAGIC) {
     fprintf(stderr,  "%s: failed to validate magic in "
             "VbSharedDataHeader (%x != %x)\n",
             __FUNCTION__, p->magic, VB_SHARED_DATA_MAGIC);
+    free(block);
     return NULL;
   }
-  return (VbSharedDataHeader *)block;
+
+  /* Same checks as the ACPI VDAT on x86 */
+  if (1 == p->struct_version)
+    expect_size = VB_SHARED_DATA_HEADER_SIZE_V1;
+  else if (2 == p->struct_version)
+    expect_size = VB_SHARED_DATA_HEADER_SIZE_V2;
+  else
+    expect_size = sizeof(VbSharedDataHeader);
+  if (size < expect_size) {
+    free(block);
+    return NULL;
+  }
+  if (p->data_size > size)
+    p->data_size = size;  /* Truncated read */
+
+  return p;
 }
 
 int VbGetArchPropertyInt(const char* name) {
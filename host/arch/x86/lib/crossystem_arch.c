@@ -7,6 +7,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <linux/nvram.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -257,6 +258,16 @@ static uint8_t* VbGetBuffer(const char* filename, int* buffer_size) {
       break;
     file_buffer[real_size] = '\0';
 
+    /* The compact VbSharedData encoding may be handed over in binary, and
+     * then there's nothing to decode */
+    if (VbSharedDataIsCompact((uint8_t*)file_buffer, real_size)) {
+      return_value = (uint8_t*)file_buffer;
+      file_buffer = NULL;
+      if (buffer_size)
+        *buffer_size = real_size;
+      break;
+    }
+
     /* Each byte in the output will replace two characters and a space
      * in the input, so the output size does not exceed input side/3
      * (a little less if account for newline characters). */
@@ -315,10 +326,23 @@ VbSharedDataHeader* VbSharedDataRead(void) {
   if (!sh)
     return NULL;
 
+  if (VbSharedDataIsCompact((uint8_t*)sh, got_size)) {
+    uint64_t size;
+    VbSharedDataHeader* expanded =
+        VbSharedDataExpand((uint8_t*)sh, got_size, &size);
+    free(sh);
+    if (!expanded)
+      return NULL;
+    sh = expanded;
+    got_size = size;
+  }
+
   /* Make sure the size is sufficient for the struct version we got.
    * Check supported old versions first. */
   if (1 == sh->struct_version)
     expect_size = VB_SHARED_DATA_HEADER_SIZE_V1;
+  else if (2 == sh->struct_version)
+    expect_size = VB_SHARED_DATA_HEADER_SIZE_V2;
   else {
     /* There'd better be enough data for the current header size. */
     expect_size = sizeof(VbSharedDataHeader);
@@ -649,18 +673,28 @@ static const struct GpioChipset *FindChipset(const char *name) {
   return NULL;
 }
 
-/* Read a GPIO of the specified signal type (see ACPI GPIO SignalType).
+/* Where each GPIO signal type lives in sysfs, found the first time it's read
+ * and kept for the life of the process.  Only the mapping is kept; the GPIO
+ * value itself is always read fresh. */
+static struct {
+  int found;
+  unsigned gpio;                /* Number under GPIO_BASE_PATH */
+  unsigned active_high;
+} gpio_map[GPIO_SIGNAL_TYPE_WP + 1];
+static pthread_mutex_t gpio_map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Find the sysfs GPIO of the specified signal type and whether it's active
+ * high.
  *
- * Returns 1 if the signal is asserted, 0 if not asserted, or -1 if error. */
-static int ReadGpio(unsigned signal_type) {
+ * Returns 0 if success, -1 if error. */
+static int FindGpio(unsigned signal_type, unsigned* gpio,
+                    unsigned* active_high) {
   char name[128];
   int index = 0;
   unsigned gpio_type;
-  unsigned active_high;
   unsigned controller_num;
   unsigned controller_offset = 0;
   char controller_name[128];
-  unsigned value;
   const struct GpioChipset *chipset;
 
   /* Scan GPIO.* to find a matching signal type */
@@ -674,7 +708,7 @@ static int ReadGpio(unsigned signal_type) {
 
   /* Read attributes and controller info for the GPIO */
   snprintf(name, sizeof(name), "%s.%d/GPIO.1", ACPI_GPIO_PATH, index);
-  if (ReadFileInt(name, &active_high) < 0)
+  if (ReadFileInt(name, active_high) < 0)
     return -1;
   snprintf(name, sizeof(name), "%s.%d/GPIO.2", ACPI_GPIO_PATH, index);
   if (ReadFileInt(name, &controller_num) < 0)
@@ -695,17 +729,44 @@ static int ReadGpio(unsigned signal_type) {
   if (!chipset->ChipOffsetAndGpioNumber(&controller_num, &controller_offset,
                                         chipset->name))
     return -1;
-  controller_offset += controller_num;
+  *gpio = controller_offset + controller_num;
+
+  return 0;
+}
+
+/* Read a GPIO of the specified signal type (see ACPI GPIO SignalType).
+ *
+ * Returns 1 if the signal is asserted, 0 if not asserted, or -1 if error. */
+static int ReadGpio(unsigned signal_type) {
+  char name[128];
+  unsigned gpio;
+  unsigned active_high;
+  unsigned value;
+  int retval = 0;
+
+  pthread_mutex_lock(&gpio_map_lock);
+  if (signal_type < ARRAY_SIZE(gpio_map) && gpio_map[signal_type].found) {
+    gpio = gpio_map[signal_type].gpio;
+    active_high = gpio_map[signal_type].active_high;
+  } else if (0 != FindGpio(signal_type, &gpio, &active_high)) {
+    retval = -1;
+  } else if (signal_type < ARRAY_SIZE(gpio_map)) {
+    gpio_map[signal_type].gpio = gpio;
+    gpio_map[signal_type].active_high = active_high;
+    gpio_map[signal_type].found = 1;
+  }
+  pthread_mutex_unlock(&gpio_map_lock);
+  if (retval)
+    return -1;
 
   /* Try reading the GPIO value */
-  snprintf(name, sizeof(name), "%s/gpio%d/value",
-           GPIO_BASE_PATH, controller_offset);
+  snprintf(name, sizeof(name), "%s/gpio%d/value", GPIO_BASE_PATH, gpio);
   if (ReadFileInt(name, &value) < 0) {
     /* Try exporting the GPIO */
     FILE* f = fopen(GPIO_EXPORT_PATH, "wt");
     if (!f)
       return -1;
-    fprintf(f, "%u", controller_offset);
+    fprintf(f, "%u", gpio);
     fclose(f);
 
     /* Try re-reading the GPIO value */
@@ -18,6 +18,7 @@ typedef struct CgptCreateParams {
   uint64_t drive_size;
   int zap;
   uint64_t padding;
+  uint32_t sector_bytes;
 } CgptCreateParams;
 
 typedef struct CgptAddParams {
@@ -53,12 +54,31 @@ typedef struct CgptShowParams {
   int single_item;
   int debug;
   int num_partitions;
+  // If num_drives is set, all of drive_names are shown instead of drive_name
+  char **drive_names;
+  int num_drives;
+  int json;
+  uint32_t fields;            // CGPT_SHOW_FIELD_*s for JSON, 0 for all
 } CgptShowParams;
 
+// The partition fields which "cgpt show -j" can give
+enum {
+  CGPT_SHOW_FIELD_START = 1 << 0,
+  CGPT_SHOW_FIELD_SIZE = 1 << 1,
+  CGPT_SHOW_FIELD_TYPE = 1 << 2,
+  CGPT_SHOW_FIELD_UUID = 1 << 3,
+  CGPT_SHOW_FIELD_LABEL = 1 << 4,
+  CGPT_SHOW_FIELD_ATTR = 1 << 5,
+  CGPT_SHOW_FIELD_PRIORITY = 1 << 6,
+  CGPT_SHOW_FIELD_TRIES = 1 << 7,
+  CGPT_SHOW_FIELD_SUCCESSFUL = 1 << 8,
+};
+
 typedef struct CgptRepairParams {
   char *drive_name;
   uint64_t drive_size;
   int verbose;
+  int check_only;
 } CgptRepairParams;
 
 typedef struct CgptBootParams {
@@ -76,9 +96,12 @@ typedef struct CgptPrioritizeParams {
   int set_friends;
   int max_priority;
   int orig_priority;
+  uint32_t *order;                      // partitions, highest priority first
+  int num_order;
 } CgptPrioritizeParams;
 
 struct CgptFindParams;
+struct find_cache;
 typedef void (*CgptFindShowFn)(struct CgptFindParams *params, char *filename,
                                int partnum, GptEntry *entry);
 typedef struct CgptFindParams {
@@ -93,7 +116,8 @@ typedef struct CgptFindParams {
   uint8_t *matchbuf;
   uint64_t matchlen;
   uint64_t matchoffset;
-  uint8_t *comparebuf;
+  uint64_t matchwindow;        /* search this many bytes at matchoffset */
+  uint8_t *comparebuf;         /* unused; each search has its own buffer */
   Guid unique_guid;
   Guid type_guid;
   char *label;
@@ -103,6 +127,8 @@ typedef struct CgptFindParams {
    * to print the device name. so this parameter is here to properly show the
    * correct device name in that special case. */
   CgptFindShowFn show_fn;
+  char *cache_file;            /* remember the tables here between runs */
+  struct find_cache *cache;
 } CgptFindParams;
 
 typedef struct CgptLegacyParams {
@@ -45,6 +45,32 @@ int VbSetSystemPropertyInt(const char* name, int value);
  * Returns 0 if success, -1 if error. */
 int VbSetSystemPropertyString(const char* name, const char* value);
 
+/* Start a batch of property writes.  Until the batch is committed or
+ * aborted, changes to non-volatile storage are collected in memory (and
+ * seen by reads), so several properties can be set with one read and one
+ * write of the storage.  Batches don't nest.
+ *
+ * Returns 0 if success, -1 if error. */
+int VbBeginSystemPropertyWrites(void);
+
+/* Write the non-volatile storage changes collected since
+ * VbBeginSystemPropertyWrites(), if any, and end the batch.
+ *
+ * Returns 0 if success, -1 if error. */
+int VbCommitSystemPropertyWrites(void);
+
+/* Discard the changes collected since VbBeginSystemPropertyWrites() and
+ * end the batch. */
+void VbAbortSystemPropertyWrites(void);
+
+/* Forget the cached non-volatile storage, so the next property lookup
+ * reads it again.  Values are cached for the life of the process, and
+ * writes through VbSetSystemProperty*() keep the cache current; long-running
+ * callers should call this before each batch of lookups if something else
+ * may write non-volatile storage meanwhile.  VbSharedData doesn't change
+ * until reboot, so it stays cached. */
+void VbInvalidateSystemPropertyCache(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -57,6 +57,11 @@ int GuidIsZero(const Guid *guid);
 char *FindKernelConfig(const char *filename,
                        uint64_t kernel_body_load_address);
 
+/* The same, but from a kernel partition that's already open. Only the key
+ * block and preamble headers and the config itself are read, with pread(),
+ * so this is cheap even on a live disk. */
+char *FindKernelConfigFromFd(int fd, uint64_t kernel_body_load_address);
+
 /****************************************************************************/
 /* Kernel partition */
 
@@ -67,5 +72,13 @@ char *FindKernelConfig(const char *filename,
 int ExtractVmlinuz(void *kpart_data, size_t kpart_size,
 		   void **vmlinuz_out, size_t *vmlinuz_size);
 
+/* The same, but reading the kernel partition from [kpart_fd] and writing the
+ * vmlinuz to the start of [vmlinuz_fd], without either being held in memory.
+ * Only the key block and preamble headers are read in; the rest is copied
+ * straight from one file to the other.  A kernel without a 16-bit header
+ * gives just the kernel blob.  The size written is stored in [vmlinuz_size]
+ * if it isn't NULL.  Returns zero if success. */
+int ExtractVmlinuzFromFd(int kpart_fd, int vmlinuz_fd, uint64_t *vmlinuz_size);
+
 
 #endif  /* VBOOT_HOST_H_ */
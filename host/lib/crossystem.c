@@ -3,6 +3,7 @@
  * found in the LICENSE file.
  */
 
+#include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
@@ -28,7 +29,10 @@ typedef enum VdatStringField {
   VDAT_STRING_TIMERS = 0,           /* Timer values */
   VDAT_STRING_LOAD_FIRMWARE_DEBUG,  /* LoadFirmware() debug information */
   VDAT_STRING_LOAD_KERNEL_DEBUG,    /* LoadKernel() debug information */
-  VDAT_STRING_MAINFW_ACT            /* Active main firmware */
+  VDAT_STRING_MAINFW_ACT,           /* Active main firmware */
+  VDAT_STRING_TIMESTAMPS,           /* Boot phase timestamps */
+  VDAT_STRING_MEASUREMENTS,         /* Measured boot event log */
+  VDAT_STRING_CRYPTO_STATS          /* Crypto work counts */
 } VdatStringField;
 
 
@@ -48,7 +52,8 @@ typedef enum VdatIntField {
   VDAT_INT_KERNEL_KEY_VERIFIED,      /* Kernel key verified using
                                       * signature, not just hash */
   VDAT_INT_RECOVERY_REASON,          /* Recovery reason for current boot */
-  VDAT_INT_FW_BOOT2                  /* Firmware selection by vboot2 */
+  VDAT_INT_FW_BOOT2,                 /* Firmware selection by vboot2 */
+  VDAT_INT_TIMESTAMP_COUNT           /* Boot phase timestamps recorded */
 } VdatIntField;
 
 
@@ -80,24 +85,77 @@ int FwidStartsWith(const char *start) {
   return 0 == strncmp(fwid, start, strlen(start));
 }
 
-static int vnc_read;
+/* Snapshot of the firmware state crossystem reports.  Each part is read
+ * the first time it's needed and kept for the life of the process, so
+ * dumping every property doesn't re-read and re-parse it each time.  The
+ * snapshot is shared by all threads; snapshot_lock guards it, and also
+ * serializes NVRAM reads and writes within the process. */
+static struct {
+  int vnc_read;
+  VbNvContext vnc;
+  int vdat_read;
+  VbSharedDataHeader* vdat;               /* NULL if it couldn't be read */
+} snapshot;
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* NV storage being changed by a batch of writes, if one is open.  Writes go
+ * here instead of to NVRAM until the batch is committed.  Each thread has its
+ * own batch. */
+static __thread struct {
+  int active;
+  int changed;                            /* Some write changed raw[] */
+  VbNvContext vnc;
+} nv_batch;
+
+/* Return the VbSharedData snapshot, or NULL if it isn't available.  It's
+ * never changed once read, so callers may use it without the lock. */
+static const VbSharedDataHeader* VbSharedDataSnapshot(void) {
+  VbSharedDataHeader* vdat;
+
+  pthread_mutex_lock(&snapshot_lock);
+  if (!snapshot.vdat_read) {
+    snapshot.vdat = VbSharedDataRead();
+    snapshot.vdat_read = 1;
+  }
+  vdat = snapshot.vdat;
+  pthread_mutex_unlock(&snapshot_lock);
+  return vdat;
+}
+
+/* Make [vnc] the freshest copy of NV storage.  Caller must hold
+ * snapshot_lock. */
+static void VbNvSnapshotUpdate(const VbNvContext* vnc) {
+  Memcpy(&snapshot.vnc, vnc, sizeof(*vnc));
+  snapshot.vnc.raw_changed = 0;
+  snapshot.vnc_read = 1;
+}
 
 int VbGetNvStorage(VbNvParam param) {
+  VbNvContext vnc;
   uint32_t value;
   int retval;
-  static VbNvContext cached_vnc;
 
-  /* TODO: locking around NV access */
-  if (!vnc_read) {
-    if (0 != VbReadNvStorage(&cached_vnc))
-      return -1;
-    vnc_read = 1;
+  if (nv_batch.active) {
+    /* Reflect writes earlier in the batch */
+    Memcpy(&vnc, &nv_batch.vnc, sizeof(vnc));
+  } else {
+    /* Work on a copy, so other threads can use the snapshot meanwhile */
+    pthread_mutex_lock(&snapshot_lock);
+    if (!snapshot.vnc_read) {
+      if (0 != VbReadNvStorage(&snapshot.vnc)) {
+        pthread_mutex_unlock(&snapshot_lock);
+        return -1;
+      }
+      snapshot.vnc_read = 1;
+    }
+    Memcpy(&vnc, &snapshot.vnc, sizeof(vnc));
+    pthread_mutex_unlock(&snapshot_lock);
   }
 
-  if (0 != VbNvSetup(&cached_vnc))
+  if (0 != VbNvSetup(&vnc))
     return -1;
-  retval = VbNvGet(&cached_vnc, param, &value);
-  if (0 != VbNvTeardown(&cached_vnc))
+  retval = VbNvGet(&vnc, param, &value);
+  if (0 != VbNvTeardown(&vnc))
     return -1;
   if (0 != retval)
     return -1;
@@ -110,13 +168,78 @@ int VbGetNvStorage(VbNvParam param) {
 }
 
 
+void VbInvalidateSystemPropertyCache(void) {
+  pthread_mutex_lock(&snapshot_lock);
+  snapshot.vnc_read = 0;
+  pthread_mutex_unlock(&snapshot_lock);
+}
+
+
+int VbBeginSystemPropertyWrites(void) {
+  int retval;
+
+  if (nv_batch.active)
+    return -1;
+
+  pthread_mutex_lock(&snapshot_lock);
+  retval = VbReadNvStorage(&nv_batch.vnc);
+  pthread_mutex_unlock(&snapshot_lock);
+  if (0 != retval)
+    return -1;
+  nv_batch.changed = 0;
+  nv_batch.active = 1;
+  return 0;
+}
+
+
+int VbCommitSystemPropertyWrites(void) {
+  int retval = 0;
+
+  if (!nv_batch.active)
+    return -1;
+  nv_batch.active = 0;
+
+  pthread_mutex_lock(&snapshot_lock);
+  if (nv_batch.changed) {
+    snapshot.vnc_read = 0;
+    nv_batch.vnc.raw_changed = 1;
+    if (0 != VbWriteNvStorage(&nv_batch.vnc))
+      retval = -1;
+  }
+  if (0 == retval)
+    VbNvSnapshotUpdate(&nv_batch.vnc);
+  pthread_mutex_unlock(&snapshot_lock);
+  return retval;
+}
+
+
+void VbAbortSystemPropertyWrites(void) {
+  nv_batch.active = 0;
+}
+
+
 int VbSetNvStorage(VbNvParam param, int value) {
   VbNvContext vnc;
   int retval = -1;
   int i;
 
+  /* In a batch, just change the pending copy */
+  if (nv_batch.active) {
+    if (0 != VbNvSetup(&nv_batch.vnc))
+      return -1;
+    i = VbNvSet(&nv_batch.vnc, param, (uint32_t)value);
+    if (0 != VbNvTeardown(&nv_batch.vnc))
+      return -1;
+    if (nv_batch.vnc.raw_changed)
+      nv_batch.changed = 1;
+    return (0 == i ? 0 : -1);
+  }
+
+  /* Hold the lock across the read-modify-write, so writes from other threads
+   * aren't lost */
+  pthread_mutex_lock(&snapshot_lock);
   if (0 != VbReadNvStorage(&vnc))
-    return -1;
+    goto VbSetNvCleanup;
 
   if (0 != VbNvSetup(&vnc))
     goto VbSetNvCleanup;
@@ -127,16 +250,19 @@ int VbSetNvStorage(VbNvParam param, int value) {
     goto VbSetNvCleanup;
 
   if (vnc.raw_changed) {
-    vnc_read = 0;
+    snapshot.vnc_read = 0;
     if (0 != VbWriteNvStorage(&vnc))
       goto VbSetNvCleanup;
   }
 
+  /* What we just read (and maybe wrote) is now the freshest copy */
+  VbNvSnapshotUpdate(&vnc);
+
   /* Success */
   retval = 0;
 
 VbSetNvCleanup:
-  /* TODO: release lock */
+  pthread_mutex_unlock(&snapshot_lock);
   return retval;
 }
 
@@ -250,6 +376,7 @@ char* GetVdatLoadKernelDebug(char* dest, int size,
   for (call = first_call_tracked; call < sh->lk_call_count; call++) {
     const VbSharedDataKernelCall* shc =
         sh->lk_calls + (call & (VBSD_MAX_KERNEL_CALLS - 1));
+    const VbSharedDataKernelCallIo* shio = NULL;
     int first_part_tracked = 0;
     int part;
 
@@ -278,6 +405,21 @@ char* GetVdatLoadKernelDebug(char* dest, int size,
     if (used > size)
       goto LoadKernelDebugExit;
 
+    /* Disk reads are only counted in full size version 3 structs */
+    if (sh->struct_version >= 3 && sh->struct_size >= sizeof(*sh)) {
+      shio = sh->lk_call_io + (call & (VBSD_MAX_KERNEL_CALLS - 1));
+      used += snprintf(
+          dest + used, size - used,
+          "  GPT read calls=%u\n"
+          "  GPT read bytes=%u\n"
+          "  GPT read ticks=%" PRIu64 "\n",
+          shio->gpt.read_calls,
+          shio->gpt.read_bytes,
+          shio->gpt.read_ticks);
+      if (used > size)
+        goto LoadKernelDebugExit;
+    }
+
     /* If we found too many partitions, only prints ones where the
      * structure has info. */
     if (shc->kernel_parts_found > VBSD_MAX_KERNEL_PARTS)
@@ -306,6 +448,22 @@ char* GetVdatLoadKernelDebug(char* dest, int size,
           shp->flags);
       if (used > size)
         goto LoadKernelDebugExit;
+
+      if (shio) {
+        const VbSharedDataIoStats* io =
+            shio->parts + (part & (VBSD_MAX_KERNEL_PARTS - 1));
+
+        used += snprintf(
+            dest + used, size - used,
+            "    Read calls=%u\n"
+            "    Read bytes=%u\n"
+            "    Read ticks=%" PRIu64 "\n",
+            io->read_calls,
+            io->read_bytes,
+            io->read_ticks);
+        if (used > size)
+          goto LoadKernelDebugExit;
+      }
     }
   }
 
@@ -319,9 +477,174 @@ LoadKernelDebugExit:
 }
 
 
+/* Names of boot phase boundaries, indexed by VBSD_TS_* */
+static const char* const timestamp_names[] = {
+  "none",
+  "fw_phase1_enter",
+  "fw_phase1_exit",
+  "fw_phase2_enter",
+  "fw_phase2_exit",
+  "fw_phase3_enter",
+  "fw_keyblock_exit",
+  "fw_preamble_exit",
+  "fw_init_hash",
+  "fw_check_hash_enter",
+  "fw_check_hash_exit",
+  "load_kernel_enter",
+  "load_kernel_exit",
+  "ec_software_sync_enter",
+  "ec_software_sync_exit",
+};
+
+char* GetVdatTimestamps(char* dest, int size,
+                        const VbSharedDataHeader* sh) {
+  int used = 0;
+  uint32_t first = 0;
+  uint32_t i;
+
+  /* Make sure we have space for truncation warning */
+  if (size < strlen(TRUNCATED) + 1)
+    return NULL;
+  size -= strlen(TRUNCATED) + 1;
+  dest[0] = '\0';
+
+  /* Report the ones still in the ring, oldest first */
+  if (sh->timestamp_count > VBSD_MAX_TIMESTAMPS)
+    first = sh->timestamp_count - VBSD_MAX_TIMESTAMPS;
+  for (i = first; i < sh->timestamp_count; i++) {
+    const VbSharedDataTimestamp* ts =
+        sh->timestamps + (i & (VBSD_MAX_TIMESTAMPS - 1));
+
+    if (ts->id < ARRAY_SIZE(timestamp_names))
+      used += snprintf(dest + used, size - used, "%s=%" PRIu64 "\n",
+                       timestamp_names[ts->id], ts->time);
+    else
+      used += snprintf(dest + used, size - used, "%d=%" PRIu64 "\n",
+                       ts->id, ts->time);
+    if (used > size)
+      break;
+  }
+
+  /* Warn if data was truncated; we left space for this above. */
+  if (used > size)
+    strcat(dest, TRUNCATED);
+
+  return dest;
+}
+
+
+/* Names of the hash_bytes[] buckets, indexed by VB2_HASH_* */
+static const char* const crypto_hash_names[] = {
+  "hash_other_bytes",
+  "hash_sha1_bytes",
+  "hash_sha256_bytes",
+  "hash_sha512_bytes",
+  "hash_blake2s_bytes",
+};
+
+char* GetVdatCryptoStats(char* dest, int size,
+                         const VbSharedDataHeader* sh) {
+  const VbSharedDataCryptoStats* cs = &sh->crypto_stats;
+  int used = 0;
+  int i;
+
+  /* Version 3 structs from older firmware, or short ones, end before */
+  if (sh->struct_version < 3 || sh->struct_size < sizeof(*sh))
+    return NULL;
+
+  /* Make sure we have space for truncation warning */
+  if (size < strlen(TRUNCATED) + 1)
+    return NULL;
+  size -= strlen(TRUNCATED) + 1;
+  dest[0] = '\0';
+
+  for (i = 0; i < VBSD_CRYPTO_STATS_HASH_ALGS && used <= size; i++) {
+    if (i < ARRAY_SIZE(crypto_hash_names))
+      used += snprintf(dest + used, size - used, "%s=%" PRIu64 "\n",
+                       crypto_hash_names[i], cs->hash_bytes[i]);
+    else if (cs->hash_bytes[i])
+      used += snprintf(dest + used, size - used, "hash_%d_bytes=%" PRIu64 "\n",
+                       i, cs->hash_bytes[i]);
+  }
+  for (i = 0; i < VBSD_CRYPTO_STATS_RSA_SIZES && used <= size; i++)
+    used += snprintf(dest + used, size - used, "rsa%d_verifies=%u\n",
+                     1024 << i, cs->rsa_verifies[i]);
+  if (used <= size)
+    used += snprintf(dest + used, size - used,
+                     "crc32_bytes=%" PRIu64 "\n"
+                     "decompress_calls=%u\n"
+                     "decompress_in_bytes=%" PRIu64 "\n"
+                     "decompress_out_bytes=%" PRIu64 "\n",
+                     cs->crc32_bytes, cs->decompress_calls,
+                     cs->decompress_in_bytes, cs->decompress_out_bytes);
+
+  /* Warn if data was truncated; we left space for this above. */
+  if (used > size)
+    strcat(dest, TRUNCATED);
+
+  return dest;
+}
+
+
+/* Names of measurements, indexed by VBSD_MEASURE_* */
+static const char* const measurement_names[] = {
+  "none",
+  "boot_mode",
+  "hwid",
+  "fw_keyblock",
+  "fw_preamble",
+  "fw_body",
+};
+
+/* Print the event log one "PCR EVENT DIGEST" line per measurement, with
+ * "-" for the PCR of ones which were only logged.  futility pcr -l replays
+ * this format. */
+char* GetVdatMeasurements(char* dest, int size,
+                          const VbSharedDataHeader* sh) {
+  int used = 0;
+  uint32_t count = sh->measurement_count;
+  uint32_t i;
+  int j;
+
+  /* Make sure we have space for truncation warning */
+  if (size < strlen(TRUNCATED) + 1)
+    return NULL;
+  size -= strlen(TRUNCATED) + 1;
+  dest[0] = '\0';
+
+  if (count > VBSD_MAX_MEASUREMENTS)
+    count = VBSD_MAX_MEASUREMENTS;
+  for (i = 0; i < count && used <= size; i++) {
+    const VbSharedDataMeasurement* m = sh->measurements + i;
+
+    if (m->pcr == VBSD_MEASURE_NO_PCR)
+      used += snprintf(dest + used, size - used, "-");
+    else
+      used += snprintf(dest + used, size - used, "%d", m->pcr);
+    if (used > size)
+      break;
+    if (m->event < ARRAY_SIZE(measurement_names))
+      used += snprintf(dest + used, size - used, " %s ",
+                       measurement_names[m->event]);
+    else
+      used += snprintf(dest + used, size - used, " %d ", m->event);
+    for (j = 0; j < sizeof(m->digest) && used <= size; j++)
+      used += snprintf(dest + used, size - used, "%02x", m->digest[j]);
+    if (used <= size)
+      used += snprintf(dest + used, size - used, "\n");
+  }
+
+  /* Warn if data was truncated; we left space for this above. */
+  if (used > size)
+    strcat(dest, TRUNCATED);
+
+  return dest;
+}
+
+
 char* GetVdatString(char* dest, int size, VdatStringField field)
 {
-  VbSharedDataHeader* sh = VbSharedDataRead();
+  const VbSharedDataHeader* sh = VbSharedDataSnapshot();
   char* value = dest;
 
   if (!sh)
@@ -349,6 +672,24 @@ char* GetVdatString(char* dest, int size, VdatStringField field)
       value = GetVdatLoadKernelDebug(dest, size, sh);
       break;
 
+    case VDAT_STRING_TIMESTAMPS:
+      if (sh->struct_version >= 3)
+        value = GetVdatTimestamps(dest, size, sh);
+      else
+        value = NULL;
+      break;
+
+    case VDAT_STRING_MEASUREMENTS:
+      if (sh->struct_version >= 3)
+        value = GetVdatMeasurements(dest, size, sh);
+      else
+        value = NULL;
+      break;
+
+    case VDAT_STRING_CRYPTO_STATS:
+      value = GetVdatCryptoStats(dest, size, sh);
+      break;
+
     case VDAT_STRING_MAINFW_ACT:
       switch(sh->firmware_index) {
         case 0:
@@ -370,13 +711,12 @@ char* GetVdatString(char* dest, int size, VdatStringField field)
       break;
   }
 
-  free(sh);
   return value;
 }
 
 
 int GetVdatInt(VdatIntField field) {
-  VbSharedDataHeader* sh = VbSharedDataRead();
+  const VbSharedDataHeader* sh = VbSharedDataSnapshot();
   int value = -1;
 
   if (!sh)
@@ -434,7 +774,17 @@ int GetVdatInt(VdatIntField field) {
     }
   }
 
-  free(sh);
+  /* Fields added in struct version 3 */
+  if (sh->struct_version >= 3) {
+    switch(field) {
+      case VDAT_INT_TIMESTAMP_COUNT:
+        value = (int)sh->timestamp_count;
+        break;
+      default:
+        break;
+    }
+  }
+
   return value;
 }
 
@@ -514,6 +864,8 @@ int VbGetSystemPropertyInt(const char* name) {
     value = GetVdatInt(VDAT_INT_SW_WPSW_BOOT);
   } else if (!strcasecmp(name,"vdat_flags")) {
     value = GetVdatInt(VDAT_INT_FLAGS);
+  } else if (!strcasecmp(name,"vdat_timestamp_count")) {
+    value = GetVdatInt(VDAT_INT_TIMESTAMP_COUNT);
   } else if (!strcasecmp(name,"tpm_fwver")) {
     value = GetVdatInt(VDAT_INT_FW_VERSION_TPM);
   } else if (!strcasecmp(name,"tpm_kernver")) {
@@ -553,6 +905,12 @@ const char* VbGetSystemPropertyString(const char* name, char* dest,
     return GetVdatString(dest, size, VDAT_STRING_LOAD_FIRMWARE_DEBUG);
   } else if (!strcasecmp(name, "vdat_lkdebug")) {
     return GetVdatString(dest, size, VDAT_STRING_LOAD_KERNEL_DEBUG);
+  } else if (!strcasecmp(name, "vdat_timestamps")) {
+    return GetVdatString(dest, size, VDAT_STRING_TIMESTAMPS);
+  } else if (!strcasecmp(name, "vdat_measurements")) {
+    return GetVdatString(dest, size, VDAT_STRING_MEASUREMENTS);
+  } else if (!strcasecmp(name, "vdat_crypto_stats")) {
+    return GetVdatString(dest, size, VDAT_STRING_CRYPTO_STATS);
   } else if (!strcasecmp(name, "ddr_type")) {
     return unknown_string;
   } else if (!strcasecmp(name, "fw_try_next")) {
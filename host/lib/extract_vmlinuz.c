@@ -2,73 +2,152 @@
  * Use of this source code is governed by a BSD-style license that can be
  * found in the LICENSE file.
  *
- * Exports a vmlinuz from a kernel partition in memory.
+ * Exports a vmlinuz from a kernel partition, in memory or in a file.
  */
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "host_common.h"
+#include "vboot_host.h"
+
+/* Where the 16-bit vmlinuz header and the kernel blob which follows it in the
+ * vmlinuz are, relative to the start of the kernel partition */
+struct vmlinuz_layout {
+	uint64_t header_offset;
+	uint64_t header_size;		/* 0 if there's no header */
+	uint64_t kblob_offset;
+	uint64_t kblob_size;
+};
+
+/* Find the parts of the vmlinuz in a [kpart_size]-byte kernel partition with
+ * [keyblock] and [preamble].  The header has to be inside the kernel blob, so
+ * that it's covered by the body signature.
+ *
+ * Returns 0 if everything is inside the partition, 1 if not. */
+static int FindVmlinuz(const VbKeyBlockHeader *keyblock,
+		       const VbKernelPreambleHeader *preamble,
+		       uint64_t kpart_size, struct vmlinuz_layout *layout)
+{
+	uint64_t now = keyblock->key_block_size;
+	uint64_t header_address = 0;
+
+	memset(layout, 0, sizeof(*layout));
+
+	if (now > kpart_size ||
+	    preamble->preamble_size < EXPECTED_VBKERNELPREAMBLEHEADER2_0_SIZE ||
+	    preamble->preamble_size > kpart_size - now)
+		return 1;
+	now += preamble->preamble_size;
+
+	/* A compressed kernel blob would have to be decompressed first */
+	if (preamble->header_version_minor >= 4 &&
+	    (preamble->preamble_size < EXPECTED_VBKERNELPREAMBLEHEADER2_4_SIZE ||
+	     preamble->body_compression != COMPRESS_NONE))
+		return 1;
+
+	layout->kblob_offset = now;
+	layout->kblob_size = preamble->body_signature.data_size;
+	if (layout->kblob_size > kpart_size - now)
+		return 1;
+
+	if (preamble->header_version_minor > 0) {
+		if (preamble->preamble_size <
+		    EXPECTED_VBKERNELPREAMBLEHEADER2_1_SIZE)
+			return 1;
+		header_address = preamble->vmlinuz_header_address;
+		layout->header_size = preamble->vmlinuz_header_size;
+	}
+	if (!layout->header_size)
+		return 0;
 
-#include "vboot_struct.h"
+	/* The kernel blob is loaded at body_load_address */
+	if (header_address < preamble->body_load_address)
+		return 1;
+	layout->header_offset = header_address - preamble->body_load_address;
+	if (layout->header_offset > layout->kblob_size ||
+	    layout->header_size > layout->kblob_size - layout->header_offset)
+		return 1;
+	layout->header_offset += layout->kblob_offset;
 
+	return 0;
+}
 
 int ExtractVmlinuz(void *kpart_data, size_t kpart_size,
 		   void **vmlinuz_out, size_t *vmlinuz_size) {
-	uint64_t now = 0;
 	VbKeyBlockHeader *keyblock = NULL;
 	VbKernelPreambleHeader *preamble = NULL;
-	uint8_t *kblob_data = NULL;
-	uint64_t kblob_size = 0;
-	uint64_t vmlinuz_header_size = 0;
-	uint64_t vmlinuz_header_address = 0;
-	uint64_t vmlinuz_header_offset = 0;
-	void *vmlinuz = NULL;
+	struct vmlinuz_layout layout;
+	uint8_t *vmlinuz = NULL;
 
 	keyblock = (VbKeyBlockHeader *)kpart_data;
-	now += keyblock->key_block_size;
-	if (now > kpart_size)
+	if (kpart_size < sizeof(*keyblock) ||
+	    keyblock->key_block_size > kpart_size -
+	    EXPECTED_VBKERNELPREAMBLEHEADER2_0_SIZE)
 		return 1;
+	preamble = (VbKernelPreambleHeader *)
+		((uint8_t *)kpart_data + keyblock->key_block_size);
 
-	preamble = (VbKernelPreambleHeader *)(kpart_data + now);
-	now += preamble->preamble_size;
-	if (now > kpart_size)
+	if (FindVmlinuz(keyblock, preamble, kpart_size, &layout) ||
+	    !layout.header_size)
 		return 1;
 
-	kblob_data = kpart_data + now;
-	kblob_size = preamble->body_signature.data_size;
-
-	if (!kblob_data || (now + kblob_size) > kpart_size)
+	vmlinuz = malloc(layout.header_size + layout.kblob_size);
+	if (vmlinuz == NULL)
 		return 1;
 
-	if (preamble->header_version_minor > 0) {
-		vmlinuz_header_address = preamble->vmlinuz_header_address;
-		vmlinuz_header_size = preamble->vmlinuz_header_size;
-	}
+	memcpy(vmlinuz, (uint8_t *)kpart_data + layout.header_offset,
+	       layout.header_size);
 
-	if (!vmlinuz_header_size ||
-	     kpart_data + vmlinuz_header_offset + vmlinuz_header_size > kpart_data) {
-		return 1;
-	}
+	memcpy(vmlinuz + layout.header_size,
+	       (uint8_t *)kpart_data + layout.kblob_offset, layout.kblob_size);
 
-	// calculate the vmlinuz_header offset from
-	// the beginning of the kpart_data.  The kblob doesn't
-	// include the body_load_offset, but does include
-	// the keyblock and preamble sections.
-	vmlinuz_header_offset = vmlinuz_header_address -
-		preamble->body_load_address +
-		keyblock->key_block_size +
-		preamble->preamble_size;
+	*vmlinuz_out = vmlinuz;
+	*vmlinuz_size = layout.header_size + layout.kblob_size;
 
-	vmlinuz = malloc(vmlinuz_header_size + kblob_size);
-	if (vmlinuz == NULL)
+	return 0;
+}
+
+int ExtractVmlinuzFromFd(int kpart_fd, int vmlinuz_fd, uint64_t *vmlinuz_size)
+{
+	VbKeyBlockHeader keyblock;
+	VbKernelPreambleHeader preamble;
+	struct vmlinuz_layout layout;
+	off_t kpart_size;
+	ssize_t n;
+
+	/* Works for block devices too, unlike fstat() */
+	kpart_size = lseek(kpart_fd, 0, SEEK_END);
+	if (kpart_size < 0)
 		return 1;
 
-	memcpy(vmlinuz, kpart_data + vmlinuz_header_offset,
-	       vmlinuz_header_size);
+	/* Only the headers are read in */
+	if (pread(kpart_fd, &keyblock, sizeof(keyblock), 0) !=
+	    sizeof(keyblock))
+		return 1;
+	/* Older preambles are shorter; FindVmlinuz() checks for that */
+	memset(&preamble, 0, sizeof(preamble));
+	n = pread(kpart_fd, &preamble, sizeof(preamble),
+		  keyblock.key_block_size);
+	if (n < EXPECTED_VBKERNELPREAMBLEHEADER2_0_SIZE)
+		return 1;
 
-	memcpy(vmlinuz + vmlinuz_header_size, kblob_data, kblob_size);
+	if (FindVmlinuz(&keyblock, &preamble, kpart_size, &layout))
+		return 1;
 
-	*vmlinuz_out = vmlinuz;
-	*vmlinuz_size = vmlinuz_header_size + kblob_size;
+	/* The rest goes from one file to the other */
+	if (layout.header_size &&
+	    CopyFileRange(kpart_fd, layout.header_offset, vmlinuz_fd, 0,
+			  layout.header_size) != layout.header_size)
+		return 1;
+	if (CopyFileRange(kpart_fd, layout.kblob_offset, vmlinuz_fd,
+			  layout.header_size, layout.kblob_size) !=
+	    layout.kblob_size)
+		return 1;
 
+	if (vmlinuz_size)
+		*vmlinuz_size = layout.header_size + layout.kblob_size;
 	return 0;
 }
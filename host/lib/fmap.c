@@ -5,6 +5,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "fmap.h"
@@ -27,20 +28,35 @@ static int is_fmap(uint8_t *ptr)
 /* Find and point to the FMAP header within the buffer */
 FmapHeader *fmap_find(uint8_t *ptr, size_t size)
 {
-	ssize_t offset, align;
 	ssize_t lim = size - sizeof(FmapHeader);
+	size_t offset, align, best_align = 0;
+	uint8_t *p, *best = NULL;
 
-	if (lim >= 0 && is_fmap(ptr))
+	if (lim < 0)
+		return NULL;
+	if (is_fmap(ptr))
 		return (FmapHeader *)ptr;
 
-	/* Search large alignments before small ones to find "right" FMAP. */
-	for (align = FMAP_SEARCH_STRIDE; align <= lim; align *= 2);
-	for (; align >= FMAP_SEARCH_STRIDE; align /= 2)
-		for (offset = align; offset <= lim; offset += align * 2)
-			if (is_fmap(ptr + offset))
-				return (FmapHeader *)(ptr + offset);
+	/*
+	 * Prefer large alignments to small ones to find the "right" FMAP.
+	 * The signature is rare, so rather than looking at every stride, let
+	 * memmem() find each one and keep the most aligned (then the first).
+	 */
+	for (p = ptr + 1;
+	     (p = memmem(p, ptr + lim + FMAP_SIGNATURE_SIZE - p,
+			 FMAP_SIGNATURE, FMAP_SIGNATURE_SIZE));
+	     p++) {
+		offset = p - ptr;
+		if (offset % FMAP_SEARCH_STRIDE)
+			continue;
+		align = offset & -offset;
+		if (align > best_align && is_fmap(p)) {
+			best = p;
+			best_align = align;
+		}
+	}
 
-	return NULL;
+	return (FmapHeader *)best;
 }
 
 /* Search for an area by name, return pointer to its beginning */
@@ -65,3 +81,226 @@ uint8_t *fmap_find_by_name(uint8_t *ptr, size_t size, FmapHeader *fmap,
 
 	return NULL;
 }
+
+/* FNV-1a of an area name, which may fill all FMAP_NAMELEN bytes */
+static uint32_t name_hash(const char *name)
+{
+	uint32_t hash = 2166136261U;
+	int i;
+
+	for (i = 0; i < FMAP_NAMELEN && name[i]; i++)
+		hash = (hash ^ (uint8_t)name[i]) * 16777619U;
+
+	return hash % FMAP_INDEX_BUCKETS;
+}
+
+int fmap_index_init(struct fmap_index *index, uint8_t *ptr, size_t size)
+{
+	size_t room;
+	uint32_t hash;
+	int i;
+
+	memset(index, 0, sizeof(*index));
+	index->ptr = ptr;
+	index->fmap = fmap_find(ptr, size);
+	if (!index->fmap)
+		return 1;
+
+	/* Don't trust the header to say how many areas fit */
+	index->ah = (FmapAreaHeader *)(index->fmap + 1);
+	room = (ptr + size - (uint8_t *)index->ah) / sizeof(FmapAreaHeader);
+	index->nareas = index->fmap->fmap_nareas;
+	if (index->nareas > room)
+		index->nareas = room;
+
+	index->chain = calloc(index->nareas + 1, sizeof(index->chain[0]));
+	if (!index->chain)
+		return 1;
+
+	/* Backwards, so the first of any duplicate names is found first */
+	for (i = index->nareas - 1; i >= 0; i--) {
+		hash = name_hash(index->ah[i].area_name);
+		index->chain[i] = index->bucket[hash];
+		index->bucket[hash] = i + 1;
+	}
+
+	return 0;
+}
+
+void fmap_index_free(struct fmap_index *index)
+{
+	free(index->chain);
+	index->chain = NULL;
+}
+
+uint8_t *fmap_index_find(const struct fmap_index *index, const char *name,
+			 FmapAreaHeader **ah_ptr)
+{
+	FmapAreaHeader *ah;
+	uint16_t i;
+
+	if (!index->chain)
+		return NULL;
+
+	for (i = index->bucket[name_hash(name)]; i; i = index->chain[i - 1]) {
+		ah = index->ah + i - 1;
+		if (!strncmp(ah->area_name, name, FMAP_NAMELEN)) {
+			if (ah_ptr)
+				*ah_ptr = ah;
+			return index->ptr + ah->area_offset;
+		}
+	}
+
+	return NULL;
+}
+
+/* By increasing start, then decreasing end, so enclosing areas come first */
+static int compare_nodes(const void *a, const void *b)
+{
+	const struct fmap_node *x = *(const struct fmap_node * const *)a;
+	const struct fmap_node *y = *(const struct fmap_node * const *)b;
+
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	if (x->end != y->end)
+		return x->end > y->end ? -1 : 1;
+	/* Then in FMAP order, so the first of any duplicates is kept */
+	return x < y ? -1 : x > y;
+}
+
+static int add_overlap(struct fmap_tree *tree, int *room,
+		       struct fmap_node *first, struct fmap_node *second)
+{
+	struct fmap_overlap *o;
+
+	if (tree->num_overlaps == *room) {
+		*room = *room ? 2 * *room : 8;
+		o = realloc(tree->overlap, *room * sizeof(*o));
+		if (!o)
+			return 1;
+		tree->overlap = o;
+	}
+
+	o = tree->overlap + tree->num_overlaps++;
+	o->first = first;
+	o->second = second;
+	return 0;
+}
+
+int fmap_build_tree(struct fmap_tree *tree, uint8_t *ptr, size_t size)
+{
+	struct fmap_node **sorted = NULL, **active = NULL, **child;
+	struct fmap_node *root, *n, *a, *prev = NULL;
+	FmapAreaHeader *ah;
+	size_t room;
+	int num_active = 0, overlap_room = 0;
+	int i, j, k, rv = 1;
+
+	memset(tree, 0, sizeof(*tree));
+	tree->fmap = fmap_find(ptr, size);
+	if (!tree->fmap)
+		return 1;
+
+	/* Don't trust the header to say how many areas fit */
+	ah = (FmapAreaHeader *)(tree->fmap + 1);
+	room = (ptr + size - (uint8_t *)ah) / sizeof(FmapAreaHeader);
+	tree->num_nodes = tree->fmap->fmap_nareas;
+	if ((size_t)tree->num_nodes > room)
+		tree->num_nodes = room;
+
+	/* Plus one for the root */
+	tree->node = calloc(tree->num_nodes + 1, sizeof(*tree->node));
+	tree->child_ptrs = calloc(tree->num_nodes + 1, sizeof(*child));
+	sorted = calloc(tree->num_nodes + 1, sizeof(*sorted));
+	active = calloc(tree->num_nodes + 1, sizeof(*active));
+	if (!tree->node || !tree->child_ptrs || !sorted || !active)
+		goto out;
+
+	for (i = 0; i < tree->num_nodes; i++) {
+		n = tree->node + i;
+		memcpy(n->name, ah[i].area_name, FMAP_NAMELEN);
+		n->start = ah[i].area_offset;
+		n->size = ah[i].area_size;
+		n->end = n->start + n->size;
+		n->ah = ah + i;
+		sorted[i] = n;
+	}
+	root = tree->root = tree->node + tree->num_nodes;
+	root->start = tree->fmap->fmap_base;
+	root->size = tree->fmap->fmap_size;
+	root->end = root->start + root->size;
+
+	qsort(sorted, tree->num_nodes, sizeof(*sorted), compare_nodes);
+
+	/*
+	 * Sweep through the areas in order, keeping those which reach this
+	 * far. Those are the only ones which can enclose or overlap the next
+	 * area, and unless the FMAP has overlaps they're just its ancestors.
+	 */
+	for (i = 0; i < tree->num_nodes; i++) {
+		n = sorted[i];
+
+		if (prev && n->start == prev->start && n->end == prev->end) {
+			n->alias = prev->alias;
+			prev->alias = n;
+			continue;
+		}
+		prev = n;
+
+		for (j = k = 0; j < num_active; j++)
+			if (active[j]->end >= n->start)
+				active[k++] = active[j];
+		num_active = k;
+
+		/* The smallest enclosing area, or the first of those */
+		n->parent = root;
+		for (j = 0; j < num_active; j++) {
+			a = active[j];
+			if (a->end >= n->end) {
+				if (a->size < n->parent->size ||
+				    (a->size == n->parent->size &&
+				     n->parent != root && a < n->parent))
+					n->parent = a;
+			} else if (a->start < n->start && a->end > n->start) {
+				if (add_overlap(tree, &overlap_room, a, n))
+					goto out;
+			}
+		}
+		active[num_active++] = n;
+	}
+
+	/* Give each node its share of child_ptrs, and fill them in order */
+	for (i = 0; i < tree->num_nodes; i++)
+		if (tree->node[i].parent)
+			tree->node[i].parent->num_children++;
+	child = tree->child_ptrs;
+	for (i = 0; i <= tree->num_nodes; i++) {
+		n = tree->node + i;
+		if (n->num_children)
+			n->child = child;
+		child += n->num_children;
+		n->num_children = 0;
+	}
+	for (i = 0; i < tree->num_nodes; i++) {
+		n = sorted[i];
+		if (n->parent)
+			n->parent->child[n->parent->num_children++] = n;
+	}
+
+	rv = 0;
+
+ out:
+	free(active);
+	free(sorted);
+	if (rv)
+		fmap_free_tree(tree);
+	return rv;
+}
+
+void fmap_free_tree(struct fmap_tree *tree)
+{
+	free(tree->overlap);
+	free(tree->child_ptrs);
+	free(tree->node);
+	memset(tree, 0, sizeof(*tree));
+}
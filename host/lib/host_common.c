@@ -14,35 +14,51 @@
 #include "utility.h"
 #include "vboot_common.h"
 
-VbFirmwarePreambleHeader *CreateFirmwarePreamble(
+uint64_t FirmwarePreambleSize(const VbPublicKey *kernel_subkey,
+			      const VbSignature *body_signature,
+			      const VbPrivateKey *signing_key,
+			      const VbSignature *ec_rw_hash)
+{
+	return (sizeof(VbFirmwarePreambleHeader) + kernel_subkey->key_size +
+		body_signature->sig_size +
+		(ec_rw_hash ? ec_rw_hash->sig_size : 0) +
+		siglen_map[signing_key->algorithm]);
+}
+
+int CreateFirmwarePreambleInto(
+	VbFirmwarePreambleHeader *h,
+	uint64_t buf_size,
 	uint64_t firmware_version,
 	const VbPublicKey *kernel_subkey,
 	const VbSignature *body_signature,
 	const VbPrivateKey *signing_key,
-	uint32_t flags)
+	uint32_t flags,
+	const VbSignature *ec_rw_hash)
 {
-	VbFirmwarePreambleHeader *h;
+	uint64_t ec_rw_hash_size = ec_rw_hash ? ec_rw_hash->sig_size : 0;
 	uint64_t signed_size = (sizeof(VbFirmwarePreambleHeader) +
 				kernel_subkey->key_size +
-				body_signature->sig_size);
+				body_signature->sig_size +
+				ec_rw_hash_size);
 	uint64_t block_size = signed_size + siglen_map[signing_key->algorithm];
 	uint8_t *kernel_subkey_dest;
 	uint8_t *body_sig_dest;
+	uint8_t *ec_rw_hash_dest;
 	uint8_t *block_sig_dest;
-	VbSignature *sigtmp;
 
-	/* Allocate key block */
-	h = (VbFirmwarePreambleHeader *)malloc(block_size);
-	if (!h)
-		return NULL;
+	if (buf_size < block_size)
+		return 1;
 
 	Memset(h, 0, block_size);
 	kernel_subkey_dest = (uint8_t *)(h + 1);
 	body_sig_dest = kernel_subkey_dest + kernel_subkey->key_size;
-	block_sig_dest = body_sig_dest + body_signature->sig_size;
+	ec_rw_hash_dest = body_sig_dest + body_signature->sig_size;
+	block_sig_dest = ec_rw_hash_dest + ec_rw_hash_size;
 
 	h->header_version_major = FIRMWARE_PREAMBLE_HEADER_VERSION_MAJOR;
-	h->header_version_minor = FIRMWARE_PREAMBLE_HEADER_VERSION_MINOR;
+	h->header_version_minor = (ec_rw_hash ?
+			FIRMWARE_PREAMBLE_HEADER_VERSION_MINOR_EC_RW_HASH :
+			FIRMWARE_PREAMBLE_HEADER_VERSION_MINOR);
 	h->preamble_size = block_size;
 	h->firmware_version = firmware_version;
 	h->flags = flags;
@@ -57,14 +73,44 @@ VbFirmwarePreambleHeader *CreateFirmwarePreamble(
 		      body_signature->sig_size, 0);
 	SignatureCopy(&h->body_signature, body_signature);
 
+	/* Copy EC-RW hash, if any */
+	SignatureInit(&h->ec_rw_hash, ec_rw_hash_dest, ec_rw_hash_size, 0);
+	if (ec_rw_hash)
+		SignatureCopy(&h->ec_rw_hash, ec_rw_hash);
+
 	/* Set up signature struct so we can calculate the signature */
 	SignatureInit(&h->preamble_signature, block_sig_dest,
 		      siglen_map[signing_key->algorithm], signed_size);
 
 	/* Calculate signature */
-	sigtmp = CalculateSignature((uint8_t *)h, signed_size, signing_key);
-	SignatureCopy(&h->preamble_signature, sigtmp);
-	free(sigtmp);
+	return CalculateSignatureInto(&h->preamble_signature, (uint8_t *)h,
+				      signed_size, signing_key);
+}
+
+VbFirmwarePreambleHeader *CreateFirmwarePreamble(
+	uint64_t firmware_version,
+	const VbPublicKey *kernel_subkey,
+	const VbSignature *body_signature,
+	const VbPrivateKey *signing_key,
+	uint32_t flags,
+	const VbSignature *ec_rw_hash)
+{
+	VbFirmwarePreambleHeader *h;
+	uint64_t block_size = FirmwarePreambleSize(kernel_subkey,
+						   body_signature,
+						   signing_key, ec_rw_hash);
+
+	/* Allocate key block */
+	h = (VbFirmwarePreambleHeader *)malloc(block_size);
+	if (!h)
+		return NULL;
+
+	if (CreateFirmwarePreambleInto(h, block_size, firmware_version,
+				       kernel_subkey, body_signature,
+				       signing_key, flags, ec_rw_hash)) {
+		free(h);
+		return NULL;
+	}
 
 	/* Return the header */
 	return h;
@@ -82,26 +128,123 @@ VbKernelPreambleHeader *CreateKernelPreamble(
 	uint64_t desired_size,
 	const VbPrivateKey *signing_key)
 {
-	VbKernelPreambleHeader *h;
-	uint64_t signed_size = (sizeof(VbKernelPreambleHeader) +
-				body_signature->sig_size);
-	uint64_t block_size = signed_size + siglen_map[signing_key->algorithm];
+	return CreateKernelPreambleWithBodyHashes(
+		kernel_version, body_load_address, bootloader_address,
+		bootloader_size, body_signature, vmlinuz_header_address,
+		vmlinuz_header_size, flags, NULL, 0, 0, 0, desired_size,
+		signing_key);
+}
+
+/*
+ * Hashes [body] in blocks of [hash_block_size] bytes with [algorithm] into
+ * [hashes], passing each block on to [body_ctx] too if it isn't NULL, so the
+ * body is only read once.  Returns 0 if success, non-zero if error.
+ */
+static int HashBodyBlocksInto(const uint8_t *body, uint64_t body_size,
+			      uint32_t hash_block_size, unsigned int algorithm,
+			      SignContext *body_ctx, uint8_t *hashes)
+{
+	uint64_t hash_count = (body_size + hash_block_size - 1) /
+		hash_block_size;
+	uint64_t hash_size = hash_size_map[algorithm];
+	uint64_t i;
+
+	for (i = 0; i < hash_count; i++) {
+		uint64_t start = i * hash_block_size;
+		uint64_t len = body_size - start;
+
+		if (len > hash_block_size)
+			len = hash_block_size;
+		if (body_ctx)
+			SignContextUpdate(body_ctx, body + start, len);
+		if (DigestBufInto(body + start, len, algorithm,
+				  hashes + i * hash_size, hash_size))
+			return 1;
+	}
+
+	return 0;
+}
+
+uint64_t KernelPreambleSize(uint64_t body_sig_size,
+			    uint64_t body_size,
+			    uint32_t hash_block_size,
+			    uint64_t desired_size,
+			    const VbPrivateKey *signing_key)
+{
+	uint64_t hash_count = 0;
+	uint64_t block_size;
+
+	if (hash_block_size)
+		hash_count = (body_size + hash_block_size - 1) /
+			hash_block_size;
+
+	block_size = (sizeof(VbKernelPreambleHeader) + body_sig_size +
+		      hash_count * hash_size_map[signing_key->algorithm] +
+		      siglen_map[signing_key->algorithm]);
+
+	/* If the block size is smaller than the desired size, pad it */
+	return block_size < desired_size ? desired_size : block_size;
+}
+
+/*
+ * Builds and signs a kernel preamble in the [buf_size] bytes at [h].  If
+ * [body_ctx] is NULL, the preamble holds [body_signature]; otherwise the body
+ * is passed to [body_ctx] and signed straight into the preamble.  If
+ * [hash_block_size] is non-zero, the [body_size]-byte [body] is also hashed
+ * in blocks into the preamble, on the same pass.
+ */
+static int BuildKernelPreambleInto(
+	VbKernelPreambleHeader *h,
+	uint64_t buf_size,
+	uint64_t kernel_version,
+	uint64_t body_load_address,
+	uint64_t bootloader_address,
+	uint64_t bootloader_size,
+	const VbSignature *body_signature,
+	SignContext *body_ctx,
+	uint64_t vmlinuz_header_address,
+	uint64_t vmlinuz_header_size,
+	uint32_t flags,
+	const uint8_t *body,
+	uint64_t body_size,
+	uint32_t hash_block_size,
+	uint64_t head_size,
+	uint64_t tail_offset,
+	uint64_t desired_size,
+	const VbPrivateKey *signing_key)
+{
+	uint64_t body_sig_size = body_ctx ?
+		siglen_map[body_ctx->key->algorithm] : body_signature->sig_size;
+	uint64_t hash_count = 0;
+	uint64_t hash_size = hash_size_map[signing_key->algorithm];
+	uint64_t signed_size;
+	uint64_t block_size;
 	uint8_t *body_sig_dest;
+	uint8_t *body_hash_dest;
 	uint8_t *block_sig_dest;
-	VbSignature *sigtmp;
 
-	/* If the block size is smaller than the desired size, pad it */
-	if (block_size < desired_size)
-		block_size = desired_size;
+	if (hash_block_size) {
+		/* The head and tail are stored in 32 bits */
+		if (!body || body_size > UINT32_MAX ||
+		    head_size > body_size || tail_offset > body_size)
+			return 1;
+		hash_count = (body_size + hash_block_size - 1) /
+			hash_block_size;
+	}
 
-	/* Allocate key block */
-	h = (VbKernelPreambleHeader *)malloc(block_size);
-	if (!h)
-		return NULL;
+	signed_size = (sizeof(VbKernelPreambleHeader) +
+		       body_sig_size + hash_count * hash_size);
+	block_size = KernelPreambleSize(body_sig_size, body_size,
+					hash_block_size, desired_size,
+					signing_key);
+	if (buf_size < block_size)
+		return 1;
 
-	Memset(h, 0, block_size);
+	/* Any padding past the signature is left as it is */
+	Memset(h, 0, signed_size + siglen_map[signing_key->algorithm]);
 	body_sig_dest = (uint8_t *)(h + 1);
-	block_sig_dest = body_sig_dest + body_signature->sig_size;
+	body_hash_dest = body_sig_dest + body_sig_size;
+	block_sig_dest = body_hash_dest + hash_count * hash_size;
 
 	h->header_version_major = KERNEL_PREAMBLE_HEADER_VERSION_MAJOR;
 	h->header_version_minor = KERNEL_PREAMBLE_HEADER_VERSION_MINOR;
@@ -114,20 +257,188 @@ VbKernelPreambleHeader *CreateKernelPreamble(
 	h->vmlinuz_header_size = vmlinuz_header_size;
 	h->flags = flags;
 
-	/* Copy body signature */
-	SignatureInit(&h->body_signature, body_sig_dest,
-		      body_signature->sig_size, 0);
-	SignatureCopy(&h->body_signature, body_signature);
+	/* Hash the body blocks, signing the body on the same pass */
+	if (hash_count) {
+		h->body_hash_offset = (uint32_t)(body_hash_dest - (uint8_t *)h);
+		h->body_hash_count = (uint32_t)hash_count;
+		h->body_hash_block_size = hash_block_size;
+		h->body_hash_head_size = (uint32_t)head_size;
+		h->body_hash_tail_offset = (uint32_t)tail_offset;
+		if (HashBodyBlocksInto(body, body_size, hash_block_size,
+				       signing_key->algorithm, body_ctx,
+				       body_hash_dest))
+			return 1;
+	} else if (body_ctx) {
+		SignContextUpdate(body_ctx, body, body_size);
+	}
+
+	/* Body signature */
+	SignatureInit(&h->body_signature, body_sig_dest, body_sig_size, 0);
+	if (body_ctx) {
+		if (SignContextFinalInto(body_ctx, &h->body_signature))
+			return 1;
+	} else {
+		SignatureCopy(&h->body_signature, body_signature);
+	}
 
 	/* Set up signature struct so we can calculate the signature */
 	SignatureInit(&h->preamble_signature, block_sig_dest,
 		      siglen_map[signing_key->algorithm], signed_size);
 
 	/* Calculate signature */
-	sigtmp = CalculateSignature((uint8_t *)h, signed_size, signing_key);
-	SignatureCopy(&h->preamble_signature, sigtmp);
-	free(sigtmp);
+	return CalculateSignatureInto(&h->preamble_signature, (uint8_t *)h,
+				      signed_size, signing_key);
+}
 
-	/* Return the header */
+int CreateKernelPreambleInto(
+	VbKernelPreambleHeader *h,
+	uint64_t buf_size,
+	uint64_t kernel_version,
+	uint64_t body_load_address,
+	uint64_t bootloader_address,
+	uint64_t bootloader_size,
+	const VbSignature *body_signature,
+	uint64_t vmlinuz_header_address,
+	uint64_t vmlinuz_header_size,
+	uint32_t flags,
+	uint64_t desired_size,
+	const VbPrivateKey *signing_key)
+{
+	return BuildKernelPreambleInto(h, buf_size, kernel_version,
+				       body_load_address, bootloader_address,
+				       bootloader_size, body_signature, NULL,
+				       vmlinuz_header_address,
+				       vmlinuz_header_size, flags, NULL,
+				       body_signature->data_size, 0, 0, 0,
+				       desired_size, signing_key);
+}
+
+VbKernelPreambleHeader *CreateKernelPreambleWithBodyHashes(
+	uint64_t kernel_version,
+	uint64_t body_load_address,
+	uint64_t bootloader_address,
+	uint64_t bootloader_size,
+	const VbSignature *body_signature,
+	uint64_t vmlinuz_header_address,
+	uint64_t vmlinuz_header_size,
+	uint32_t flags,
+	const uint8_t *body,
+	uint32_t hash_block_size,
+	uint64_t head_size,
+	uint64_t tail_offset,
+	uint64_t desired_size,
+	const VbPrivateKey *signing_key)
+{
+	VbKernelPreambleHeader *h;
+	uint64_t body_size = body_signature->data_size;
+	uint64_t block_size = KernelPreambleSize(body_signature->sig_size,
+						 body_size, hash_block_size,
+						 desired_size, signing_key);
+
+	h = (VbKernelPreambleHeader *)calloc(1, block_size);
+	if (!h)
+		return NULL;
+
+	if (BuildKernelPreambleInto(h, block_size, kernel_version,
+				    body_load_address, bootloader_address,
+				    bootloader_size, body_signature, NULL,
+				    vmlinuz_header_address,
+				    vmlinuz_header_size, flags, body,
+				    body_size, hash_block_size, head_size,
+				    tail_offset, desired_size, signing_key)) {
+		free(h);
+		return NULL;
+	}
+	return h;
+}
+
+int SignKernelBodyAndPreambleInto(
+	VbKernelPreambleHeader *h,
+	uint64_t buf_size,
+	uint64_t kernel_version,
+	uint64_t body_load_address,
+	uint64_t bootloader_address,
+	uint64_t bootloader_size,
+	uint64_t vmlinuz_header_address,
+	uint64_t vmlinuz_header_size,
+	uint32_t flags,
+	const uint8_t *body,
+	uint64_t body_size,
+	const VbPrivateKey *body_key,
+	uint32_t hash_block_size,
+	uint64_t head_size,
+	uint64_t tail_offset,
+	uint64_t desired_size,
+	const VbPrivateKey *signing_key)
+{
+	SignContext ctx;
+
+	SignContextInit(&ctx, body_key);
+	return BuildKernelPreambleInto(h, buf_size, kernel_version,
+				       body_load_address, bootloader_address,
+				       bootloader_size, NULL, &ctx,
+				       vmlinuz_header_address,
+				       vmlinuz_header_size, flags, body,
+				       body_size, hash_block_size, head_size,
+				       tail_offset, desired_size,
+				       signing_key);
+}
+
+VbKernelPreambleHeader *SignKernelBodyAndPreamble(
+	uint64_t kernel_version,
+	uint64_t body_load_address,
+	uint64_t bootloader_address,
+	uint64_t bootloader_size,
+	uint64_t vmlinuz_header_address,
+	uint64_t vmlinuz_header_size,
+	uint32_t flags,
+	const uint8_t *body,
+	uint64_t body_size,
+	const VbPrivateKey *body_key,
+	uint32_t hash_block_size,
+	uint64_t head_size,
+	uint64_t tail_offset,
+	uint64_t desired_size,
+	const VbPrivateKey *signing_key)
+{
+	VbKernelPreambleHeader *h;
+	uint64_t body_sig_size = siglen_map[body_key->algorithm];
+	uint64_t block_size = KernelPreambleSize(body_sig_size, body_size,
+						 hash_block_size, desired_size,
+						 signing_key);
+
+	h = (VbKernelPreambleHeader *)calloc(1, block_size);
+	if (!h)
+		return NULL;
+
+	if (SignKernelBodyAndPreambleInto(h, block_size, kernel_version,
+					  body_load_address,
+					  bootloader_address, bootloader_size,
+					  vmlinuz_header_address,
+					  vmlinuz_header_size, flags, body,
+					  body_size, body_key,
+					  hash_block_size, head_size,
+					  tail_offset, desired_size,
+					  signing_key)) {
+		free(h);
+		return NULL;
+	}
 	return h;
 }
+
+int SetKernelPreambleCompression(VbKernelPreambleHeader *h,
+				 uint32_t compression,
+				 uint64_t load_size,
+				 const VbPrivateKey *signing_key)
+{
+	/* The load size is stored in 32 bits */
+	if (h->header_version_minor < 4 || compression >= MAX_COMPRESS ||
+	    h->body_hash_count || load_size > UINT32_MAX)
+		return 1;
+
+	h->body_compression = compression;
+	h->body_load_size = (uint32_t)load_size;
+	return CalculateSignatureInto(&h->preamble_signature, (uint8_t *)h,
+				      h->preamble_signature.data_size,
+				      signing_key);
+}
@@ -0,0 +1,141 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * A pool of vboot 2.0 contexts.  The work buffers are allocated once, and a
+ * context is made ready again by copying back the initial one and clearing
+ * just the part of its work buffer that was kept, not the whole thing.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2api.h"
+#include "2common.h"
+#include "host_context_pool.h"
+
+struct vb2_context_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t freed;
+
+	struct vb2_context initial;
+	uint32_t count;
+	uint32_t workbuf_size;
+	uint32_t workbuf_stride;	/* rounded up to keep them aligned */
+	uint8_t *workbufs;
+	struct vb2_context *contexts;
+
+	/* Indexes of the contexts not in use, the first [free_count] */
+	uint32_t *free_list;
+	uint32_t free_count;
+};
+
+/* Put context [i] back the way it started */
+static void reset_context(const struct vb2_context_pool *pool, uint32_t i)
+{
+	struct vb2_context *ctx = &pool->contexts[i];
+	uint8_t *workbuf = pool->workbufs + (size_t)i * pool->workbuf_stride;
+	uint32_t used = ctx->workbuf_used;
+
+	if (used > pool->workbuf_size)
+		used = pool->workbuf_size;
+	memset(workbuf, 0, used);
+
+	memcpy(ctx, &pool->initial, sizeof(*ctx));
+	ctx->workbuf = workbuf;
+	ctx->workbuf_size = pool->workbuf_size;
+	ctx->workbuf_used = 0;
+}
+
+struct vb2_context_pool *vb2_context_pool_create(
+		uint32_t count,
+		uint32_t workbuf_size,
+		const struct vb2_context *initial)
+{
+	struct vb2_context_pool *pool;
+	uint32_t i;
+
+	if (!count || !workbuf_size)
+		return NULL;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->freed, NULL);
+
+	/* Each work buffer starts aligned, like the firmware's */
+	pool->count = count;
+	pool->workbuf_size = workbuf_size;
+	pool->workbuf_stride = (workbuf_size + VB2_WORKBUF_ALIGN - 1) &
+		~(VB2_WORKBUF_ALIGN - 1);
+	pool->contexts = calloc(count, sizeof(*pool->contexts));
+	pool->free_list = calloc(count, sizeof(*pool->free_list));
+	if (!pool->contexts || !pool->free_list || !pool->workbuf_stride ||
+	    (uint64_t)count * pool->workbuf_stride > SIZE_MAX ||
+	    posix_memalign((void **)&pool->workbufs, VB2_WORKBUF_ALIGN,
+			   (size_t)count * pool->workbuf_stride)) {
+		pool->workbufs = NULL;
+		vb2_context_pool_free(pool);
+		return NULL;
+	}
+	memset(pool->workbufs, 0, (size_t)count * pool->workbuf_stride);
+
+	if (initial)
+		memcpy(&pool->initial, initial, sizeof(pool->initial));
+	else
+		vb2api_secdata_create(&pool->initial);
+	pool->initial.workbuf = NULL;
+	pool->initial.workbuf_size = 0;
+	pool->initial.workbuf_used = 0;
+
+	for (i = 0; i < count; i++) {
+		reset_context(pool, i);
+		pool->free_list[i] = count - 1 - i;
+	}
+	pool->free_count = count;
+
+	return pool;
+}
+
+struct vb2_context *vb2_context_pool_get(struct vb2_context_pool *pool)
+{
+	struct vb2_context *ctx;
+
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->free_count)
+		pthread_cond_wait(&pool->freed, &pool->lock);
+	ctx = &pool->contexts[pool->free_list[--pool->free_count]];
+	pthread_mutex_unlock(&pool->lock);
+
+	return ctx;
+}
+
+void vb2_context_pool_put(struct vb2_context_pool *pool,
+			  struct vb2_context *ctx)
+{
+	uint32_t i = ctx - pool->contexts;
+
+	/* Outside the lock; nobody else has this one */
+	reset_context(pool, i);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->free_list[pool->free_count++] = i;
+	pthread_cond_signal(&pool->freed);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void vb2_context_pool_free(struct vb2_context_pool *pool)
+{
+	if (!pool)
+		return;
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->freed);
+	free(pool->workbufs);
+	free(pool->free_list);
+	free(pool->contexts);
+	free(pool);
+}
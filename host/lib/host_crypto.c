@@ -0,0 +1,319 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Digests and RSA verification for the vboot 2.0 library through OpenSSL,
+ * whose assembly implementations are several times faster on the host.  The
+ * firmware code stays the reference: OpenSSL only does the arithmetic, and the
+ * padding and digest checks on its result are the firmware's.
+ */
+
+#include <openssl/bn.h>
+#include <openssl/rsa.h>
+#include <openssl/sha.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2rsa.h"
+#include "2sha.h"
+#include "host_crypto.h"
+
+static enum vb2_host_crypto_mode crypto_mode = VB2_HOST_CRYPTO_REFERENCE;
+
+/* Set while cross-checking, so the vb2 calls run the firmware code */
+static __thread int in_reference;
+
+/* What's kept in the context union of a struct vb2_digest_context */
+struct host_digest {
+	union {
+		SHA_CTX sha1;
+		SHA256_CTX sha256;
+		SHA512_CTX sha512;
+	};
+
+	/*
+	 * When cross-checking, the same digest computed by the firmware.
+	 * Freed by finalize; only a test mode, so a digest which is given up
+	 * on may leak it.
+	 */
+	struct vb2_digest_context *ref;
+};
+
+static void crosscheck_failed(const char *what)
+{
+	fprintf(stderr, "%s: OpenSSL and firmware %s differ\n",
+		VB2_HOST_CRYPTO_ENV, what);
+	abort();
+}
+
+static int openssl_digest_init(struct vb2_digest_context *dc)
+{
+	struct host_digest *hd = (struct host_digest *)dc;
+
+	if (in_reference ||
+	    sizeof(*hd) > offsetof(struct vb2_digest_context, hash_alg))
+		return VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+
+	switch (dc->hash_alg) {
+	case VB2_HASH_SHA1:
+		SHA1_Init(&hd->sha1);
+		break;
+	case VB2_HASH_SHA256:
+		SHA256_Init(&hd->sha256);
+		break;
+	case VB2_HASH_SHA512:
+		SHA512_Init(&hd->sha512);
+		break;
+	default:
+		return VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+	}
+
+	hd->ref = NULL;
+	if (crypto_mode == VB2_HOST_CRYPTO_CROSSCHECK) {
+		hd->ref = malloc(sizeof(*hd->ref));
+		if (!hd->ref)
+			return VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+		in_reference = 1;
+		vb2_digest_init(hd->ref, dc->hash_alg);
+		in_reference = 0;
+	}
+
+	return VB2_SUCCESS;
+}
+
+static int openssl_digest_extend(struct vb2_digest_context *dc,
+				 const uint8_t *buf,
+				 uint32_t size)
+{
+	struct host_digest *hd = (struct host_digest *)dc;
+
+	switch (dc->hash_alg) {
+	case VB2_HASH_SHA1:
+		SHA1_Update(&hd->sha1, buf, size);
+		break;
+	case VB2_HASH_SHA256:
+		SHA256_Update(&hd->sha256, buf, size);
+		break;
+	case VB2_HASH_SHA512:
+		SHA512_Update(&hd->sha512, buf, size);
+		break;
+	default:
+		return VB2_ERROR_SHA_EXTEND_ALGORITHM;
+	}
+
+	if (hd->ref)
+		vb2_digest_extend(hd->ref, buf, size);
+
+	return VB2_SUCCESS;
+}
+
+static int openssl_digest_finalize(struct vb2_digest_context *dc,
+				   uint8_t *digest)
+{
+	struct host_digest *hd = (struct host_digest *)dc;
+	uint8_t ref_digest[VB2_SHA512_DIGEST_SIZE];
+	uint32_t digest_size = vb2_digest_size(dc->hash_alg);
+
+	switch (dc->hash_alg) {
+	case VB2_HASH_SHA1:
+		SHA1_Final(digest, &hd->sha1);
+		break;
+	case VB2_HASH_SHA256:
+		SHA256_Final(digest, &hd->sha256);
+		break;
+	case VB2_HASH_SHA512:
+		SHA512_Final(digest, &hd->sha512);
+		break;
+	default:
+		return VB2_ERROR_SHA_FINALIZE_ALGORITHM;
+	}
+
+	if (hd->ref) {
+		vb2_digest_finalize(hd->ref, ref_digest, sizeof(ref_digest));
+		free(hd->ref);
+		hd->ref = NULL;
+		if (memcmp(digest, ref_digest, digest_size))
+			crosscheck_failed("digests");
+	}
+
+	return VB2_SUCCESS;
+}
+
+static const struct vb2_digest_ops openssl_digest_ops = {
+	.init = openssl_digest_init,
+	.extend = openssl_digest_extend,
+	.finalize = openssl_digest_finalize,
+};
+
+/*
+ * Last key each thread verified with.  Building the RSA struct and its
+ * Montgomery values costs about as much as a verification.
+ */
+static __thread struct {
+	RSA *rsa;
+	uint32_t arrsize;
+	uint32_t n[VB2_MAX_RSA_SIG_BYTES / sizeof(uint32_t)];
+} key_cache;
+
+static RSA *get_rsa(const struct vb2_public_key *key)
+{
+	uint32_t sig_len = key->arrsize * sizeof(uint32_t);
+	uint8_t modulus[VB2_MAX_RSA_SIG_BYTES];
+	BIGNUM *n = NULL, *e = NULL;
+	RSA *rsa = NULL;
+	uint32_t i;
+
+	if (key_cache.rsa && key_cache.arrsize == key->arrsize &&
+	    !memcmp(key_cache.n, key->n, sig_len))
+		return key_cache.rsa;
+
+	/*
+	 * The key holds the modulus as little-endian words; OpenSSL wants it
+	 * as big-endian bytes.
+	 */
+	for (i = 0; i < key->arrsize; i++) {
+		uint32_t word = key->n[key->arrsize - 1 - i];
+		modulus[4 * i] = (uint8_t)(word >> 24);
+		modulus[4 * i + 1] = (uint8_t)(word >> 16);
+		modulus[4 * i + 2] = (uint8_t)(word >> 8);
+		modulus[4 * i + 3] = (uint8_t)word;
+	}
+
+	/* Vboot keys always use F4 as the public exponent */
+	n = BN_bin2bn(modulus, sig_len, NULL);
+	e = BN_new();
+	rsa = RSA_new();
+	if (!n || !e || !rsa || !BN_set_word(e, RSA_F4)) {
+		BN_free(n);
+		BN_free(e);
+		RSA_free(rsa);
+		return NULL;
+	}
+	rsa->n = n;
+	rsa->e = e;
+
+	RSA_free(key_cache.rsa);
+	key_cache.rsa = rsa;
+	key_cache.arrsize = key->arrsize;
+	memcpy(key_cache.n, key->n, sig_len);
+	return rsa;
+}
+
+static int openssl_rsa_verify(const struct vb2_public_key *key,
+			      const uint8_t *sig,
+			      const uint8_t *digest)
+{
+	uint8_t padded[VB2_MAX_RSA_SIG_BYTES];
+	uint32_t key_bytes = key->arrsize * sizeof(uint32_t);
+	int pad_size;
+	RSA *rsa;
+	int rv;
+
+	/* vb2_rsa_verify_digest() has checked the sizes */
+	rsa = get_rsa(key);
+	if (!rsa)
+		return VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+
+	/*
+	 * OpenSSL won't take a signature which isn't below the modulus.
+	 * Leave those to the firmware code, which reduces them first.
+	 */
+	if (RSA_public_decrypt(key_bytes, sig, padded, rsa, RSA_NO_PADDING) !=
+	    (int)key_bytes)
+		return VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+
+	/* The rest is what vb2_rsa_verify_digest() does, in the same order */
+	rv = vb2_check_padding(padded, key);
+	if (rv == VB2_ERROR_RSA_PADDING_SIZE)
+		return rv;
+
+	pad_size = key_bytes - vb2_digest_size(key->hash_alg);
+	if (vb2_safe_memcmp(padded + pad_size, digest, key_bytes - pad_size)) {
+		if (!rv)
+			rv = VB2_ERROR_RSA_VERIFY_DIGEST;
+	}
+
+	return rv;
+}
+
+static int openssl_rsa_verify_digest(const struct vb2_public_key *key,
+				     const uint8_t *sig,
+				     const uint8_t *digest)
+{
+	uint8_t workbuf[VB2_VERIFY_RSA_DIGEST_WORKBUF_BYTES]
+		__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	struct vb2_workbuf wb;
+	int rv, ref_rv;
+
+	if (in_reference)
+		return VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+
+	rv = openssl_rsa_verify(key, sig, digest);
+	if (crypto_mode != VB2_HOST_CRYPTO_CROSSCHECK ||
+	    rv == VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED)
+		return rv;
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+	in_reference = 1;
+	ref_rv = vb2_rsa_verify_digest(key, sig, digest, &wb);
+	in_reference = 0;
+	if (rv != ref_rv)
+		crosscheck_failed("RSA verifications");
+
+	return rv;
+}
+
+static const struct vb2_rsa_ops openssl_rsa_ops = {
+	.verify_digest = openssl_rsa_verify_digest,
+};
+
+int vb2_host_crypto_select(enum vb2_host_crypto_mode mode)
+{
+	switch (mode) {
+	case VB2_HOST_CRYPTO_REFERENCE:
+		vb2_digest_set_ops(NULL);
+		vb2_rsa_set_ops(NULL);
+		break;
+	case VB2_HOST_CRYPTO_OPENSSL:
+	case VB2_HOST_CRYPTO_CROSSCHECK:
+		vb2_digest_set_ops(&openssl_digest_ops);
+		vb2_rsa_set_ops(&openssl_rsa_ops);
+		break;
+	default:
+		return VB2_ERROR_HOST_CRYPTO_MODE;
+	}
+
+	crypto_mode = mode;
+	return VB2_SUCCESS;
+}
+
+int vb2_host_crypto_select_env(void)
+{
+	static const char * const names[] = {
+		[VB2_HOST_CRYPTO_REFERENCE] = "reference",
+		[VB2_HOST_CRYPTO_OPENSSL] = "openssl",
+		[VB2_HOST_CRYPTO_CROSSCHECK] = "crosscheck",
+	};
+	const char *s = getenv(VB2_HOST_CRYPTO_ENV);
+	int i;
+
+	if (s && *s) {
+		for (i = 0; i < ARRAY_SIZE(names); i++) {
+			if (!strcmp(s, names[i]))
+				return vb2_host_crypto_select(i);
+		}
+	}
+
+	vb2_host_crypto_select(VB2_HOST_CRYPTO_OPENSSL);
+	if (s && *s) {
+		fprintf(stderr, "Unknown %s \"%s\"; using openssl\n",
+			VB2_HOST_CRYPTO_ENV, s);
+		return VB2_ERROR_HOST_CRYPTO_MODE;
+	}
+	return VB2_SUCCESS;
+}
@@ -0,0 +1,210 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Host functions for reading many pieces of files or disks at once.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#include "host_io.h"
+
+/* Finish a request with pread(), from wherever it's got to */
+static void ReadRest(struct read_request *req)
+{
+	size_t done = req->result > 0 ? req->result : 0;
+	ssize_t n;
+
+	while (done < req->size) {
+		n = pread(req->fd, (char *)req->buf + done, req->size - done,
+			  req->offset + done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			req->result = -errno;
+			return;
+		}
+		if (n == 0)
+			break;
+		done += n;
+	}
+	req->result = done;
+}
+
+#ifdef USE_IO_URING
+/* An io_uring, with its rings mapped; see io_uring_setup(2) */
+struct ring {
+	int fd;
+	unsigned entries;
+	void *sq_ptr, *cq_ptr;
+	size_t sq_len, cq_len;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+};
+
+static void RingClose(struct ring *r)
+{
+	if (r->sqes)
+		munmap(r->sqes, r->entries * sizeof(*r->sqes));
+	if (r->cq_ptr)
+		munmap(r->cq_ptr, r->cq_len);
+	if (r->sq_ptr)
+		munmap(r->sq_ptr, r->sq_len);
+	close(r->fd);
+}
+
+/* Returns 0 if success, -1 if the kernel can't do this */
+static int RingOpen(struct ring *r, unsigned entries)
+{
+	struct io_uring_params p;
+	uint8_t *sq, *cq;
+
+	memset(r, 0, sizeof(*r));
+	memset(&p, 0, sizeof(p));
+	r->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0)
+		return -1;
+	r->entries = p.sq_entries;
+
+	r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(*r->cqes);
+	r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ptr == MAP_FAILED)
+		r->sq_ptr = NULL;
+	r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	if (r->cq_ptr == MAP_FAILED)
+		r->cq_ptr = NULL;
+	r->sqes = mmap(NULL, p.sq_entries * sizeof(*r->sqes),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		       r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		r->sqes = NULL;
+	if (!r->sq_ptr || !r->cq_ptr || !r->sqes) {
+		RingClose(r);
+		return -1;
+	}
+
+	sq = r->sq_ptr;
+	r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *)(sq + p.sq_off.array);
+	cq = r->cq_ptr;
+	r->cq_head = (unsigned *)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+}
+
+/*
+ * Queue up to r->entries of the requests at once, and wait for them.  Returns
+ * 0 if success, -1 if the ring stopped working.
+ */
+static int RingRead(struct ring *r, struct read_request *reqs, int count)
+{
+	struct iovec iov[READ_BATCH_MAX_IN_FLIGHT];
+	int next = 0;
+
+	while (next < count) {
+		unsigned tail = *r->sq_tail;
+		unsigned head;
+		int n = count - next;
+		int i, submitted = 0, done = 0;
+
+		if (n > (int)r->entries)
+			n = r->entries;
+		for (i = 0; i < n; i++) {
+			struct read_request *req = reqs + next + i;
+			unsigned idx = (tail + i) & *r->sq_mask;
+			struct io_uring_sqe *sqe = r->sqes + idx;
+
+			iov[i].iov_base = req->buf;
+			iov[i].iov_len = req->size;
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = IORING_OP_READV;
+			sqe->fd = req->fd;
+			sqe->addr = (unsigned long)(iov + i);
+			sqe->len = 1;
+			sqe->off = req->offset;
+			sqe->user_data = next + i;
+			r->sq_array[idx] = idx;
+		}
+		__atomic_store_n(r->sq_tail, tail + n, __ATOMIC_RELEASE);
+
+		while (done < n) {
+			int ret = syscall(__NR_io_uring_enter, r->fd,
+					  n - submitted, n - done,
+					  IORING_ENTER_GETEVENTS, NULL, 0);
+
+			if (ret < 0 && (errno == EINTR || errno == EAGAIN ||
+					errno == EBUSY))
+				continue;
+			if (ret < 0)
+				return -1;
+			submitted += ret;
+
+			head = *r->cq_head;
+			while (head != __atomic_load_n(r->cq_tail,
+						       __ATOMIC_ACQUIRE)) {
+				struct io_uring_cqe *cqe =
+					r->cqes + (head & *r->cq_mask);
+
+				reqs[cqe->user_data].result = cqe->res;
+				head++;
+				done++;
+			}
+			__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+		}
+		next += n;
+	}
+	return 0;
+}
+#endif
+
+int ReadBatch(struct read_request *reqs, int count)
+{
+	int i, rv = 0;
+
+	for (i = 0; i < count; i++)
+		reqs[i].result = 0;
+
+#ifdef USE_IO_URING
+	/* One read gains nothing from a ring */
+	if (count > 1) {
+		struct ring r;
+
+		if (!RingOpen(&r, count < READ_BATCH_MAX_IN_FLIGHT ?
+			      count : READ_BATCH_MAX_IN_FLIGHT)) {
+			RingRead(&r, reqs, count);
+			RingClose(&r);
+		}
+	}
+#endif
+
+	/*
+	 * Finish whatever the ring didn't, or only did part of.  Errors from
+	 * the ring are tried again, so an old kernel which can't do the read
+	 * opcode works too.
+	 */
+	for (i = 0; i < count; i++) {
+		if (reqs[i].result != (ssize_t)reqs[i].size)
+			ReadRest(reqs + i);
+		if (reqs[i].result != (ssize_t)reqs[i].size)
+			rv = -1;
+	}
+	return rv;
+}
@@ -0,0 +1,183 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Host functions for checking all the kernel partitions on a disk at once.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgptlib.h"
+#include "gpt_misc.h"
+#include "host_kernel_scan.h"
+#include "vboot_common.h"
+
+/* Read and check the headers of one partition; runs in its own thread. */
+static void *ScanPart(void *arg)
+{
+	KernelScanPart *part = (KernelScanPart *)arg;
+	KernelScan *scan = part->scan;
+	VbKeyBlockHeader *key_block;
+	VbKernelPreambleHeader *preamble;
+	RSAPublicKey *data_key;
+	uint64_t size;
+
+	part->header_sectors = KERNEL_SCAN_HEADER_BYTES / scan->bytes_per_lba;
+	if (part->header_sectors > part->sector_count)
+		part->header_sectors = part->sector_count;
+	size = part->header_sectors * scan->bytes_per_lba;
+
+	part->header = malloc(size);
+	if (!part->header ||
+	    scan->read_fn(scan->read_ctx, part->sector_start,
+			  part->header_sectors, part->header)) {
+		part->header_sectors = 0;
+		part->error = "can't read headers";
+		return NULL;
+	}
+
+	key_block = (VbKeyBlockHeader *)part->header;
+	if (0 != KeyBlockVerify(key_block, size, scan->subkey, 0)) {
+		if (0 != KeyBlockVerify(key_block, size, NULL, 1)) {
+			part->error = "bad key block";
+			return NULL;
+		}
+		part->self_signed = 1;
+	}
+	part->key_block_flags = key_block->key_block_flags;
+
+	data_key = PublicKeyToRSA(&key_block->data_key);
+	if (!data_key) {
+		part->error = "bad data key";
+		return NULL;
+	}
+
+	preamble = (VbKernelPreambleHeader *)
+		(part->header + key_block->key_block_size);
+	if (0 != VerifyKernelPreamble(preamble,
+				      size - key_block->key_block_size,
+				      data_key))
+		part->error = "bad preamble";
+	else
+		part->combined_version = (uint32_t)
+			((key_block->data_key.key_version << 16) |
+			 (preamble->kernel_version & 0xFFFF));
+
+	RSAPublicKeyFree(data_key);
+	return NULL;
+}
+
+int KernelScanDisk(KernelScan *scan, const LoadKernelParams *params,
+		   const VbPublicKey *subkey, KernelScanReadFn read_fn,
+		   void *read_ctx)
+{
+	pthread_t threads[KERNEL_SCAN_MAX_PARTS];
+	int started[KERNEL_SCAN_MAX_PARTS];
+	uint64_t part_start, part_size;
+	GptData gpt;
+	int i;
+
+	memset(scan, 0, sizeof(*scan));
+	scan->bytes_per_lba = params->bytes_per_lba;
+	scan->subkey = subkey;
+	scan->read_fn = read_fn;
+	scan->read_ctx = read_ctx;
+
+	/* Find the kernel partitions, in the order LoadKernel() tries them */
+	memset(&gpt, 0, sizeof(gpt));
+	gpt.sector_bytes = (uint32_t)params->bytes_per_lba;
+	gpt.streaming_drive_sectors = params->streaming_lba_count;
+	gpt.gpt_drive_sectors = params->gpt_lba_count;
+	gpt.flags = params->boot_flags & BOOT_FLAG_EXTERNAL_GPT
+			? GPT_FLAG_EXTERNAL : 0;
+	if (0 != AllocAndReadGptData(params->disk_handle, &gpt) ||
+	    GPT_SUCCESS != GptInit(&gpt)) {
+		gpt.modified = 0;
+		WriteAndFreeGptData(params->disk_handle, &gpt);
+		return 1;
+	}
+
+	while (scan->count < KERNEL_SCAN_MAX_PARTS &&
+	       GPT_SUCCESS == GptNextKernelEntry(&gpt, &part_start,
+						 &part_size)) {
+		KernelScanPart *part = scan->parts + scan->count++;
+
+		part->scan = scan;
+		part->sector_start = part_start;
+		part->sector_count = part_size;
+		part->gpt_index = gpt.current_kernel + 1;
+	}
+
+	/* Leave any GPT repairs to LoadKernel(); this just frees it */
+	gpt.modified = 0;
+	WriteAndFreeGptData(params->disk_handle, &gpt);
+
+	/* Check them all at once; if a thread can't start, check it here */
+	for (i = 0; i < scan->count; i++) {
+		started[i] = !pthread_create(threads + i, NULL, ScanPart,
+					     scan->parts + i);
+		if (!started[i])
+			ScanPart(scan->parts + i);
+	}
+	for (i = 0; i < scan->count; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+	}
+
+	return 0;
+}
+
+int KernelScanRead(const KernelScan *scan, uint64_t lba_start,
+		   uint64_t lba_count, void *buffer)
+{
+	int i;
+
+	for (i = 0; i < scan->count; i++) {
+		const KernelScanPart *part = scan->parts + i;
+
+		if (lba_start < part->sector_start ||
+		    lba_start + lba_count >
+		    part->sector_start + part->header_sectors)
+			continue;
+
+		memcpy(buffer, part->header + (lba_start - part->sector_start) *
+		       scan->bytes_per_lba, lba_count * scan->bytes_per_lba);
+		return 0;
+	}
+
+	return 1;
+}
+
+void KernelScanPrint(const KernelScan *scan)
+{
+	int i;
+
+	for (i = 0; i < scan->count; i++) {
+		const KernelScanPart *part = scan->parts + i;
+
+		printf("Kernel partition %d: ", part->gpt_index);
+		if (part->error)
+			printf("%s\n", part->error);
+		else
+			printf("headers good%s, flags 0x%" PRIx64
+			       ", version 0x%08x\n",
+			       part->self_signed ? " (self-signed)" : "",
+			       part->key_block_flags, part->combined_version);
+	}
+}
+
+void KernelScanFree(KernelScan *scan)
+{
+	int i;
+
+	for (i = 0; i < scan->count; i++) {
+		free(scan->parts[i].header);
+		scan->parts[i].header = NULL;
+		scan->parts[i].header_sectors = 0;
+	}
+	scan->count = 0;
+}
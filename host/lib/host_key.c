@@ -8,15 +8,20 @@
 /* TODO: change all 'return 0', 'return 1' into meaningful return codes */
 
 #include <openssl/pem.h>
+#include <openssl/rsa.h>
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "cryptolib.h"
 #include "host_common.h"
 #include "host_key.h"
+#include "host_key_bundle.h"
 #include "host_misc.h"
+#include "util_misc.h"
 #include "vboot_common.h"
 
 
@@ -32,7 +37,7 @@ VbPrivateKey* PrivateKeyReadPem(const char* filename, uint64_t algorithm) {
   }
 
   /* Read private key */
-  f = fopen(filename, "r");
+  f = OpenKeyFile(filename);
   if (!f) {
     VBDEBUG(("%s(): Couldn't open key file: %s\n", __FUNCTION__, filename));
     return NULL;
@@ -112,7 +117,7 @@ VbPrivateKey* PrivateKeyRead(const char* filename) {
   uint8_t *buffer;
   const unsigned char *start;
 
-  buffer = ReadFile(filename, &filelen);
+  buffer = ReadKeyFile(filename, &filelen);
   if (!buffer) {
     VbExError("unable to read from file %s\n", filename);
     return 0;
@@ -143,6 +148,129 @@ VbPrivateKey* PrivateKeyRead(const char* filename) {
 }
 
 
+int PrivateKeyPrepare(RSA* rsa) {
+  uint8_t in = 0;
+  uint8_t* out;
+  int rv;
+
+  /* Set up blinding now, rather than on the first signature */
+  if (!RSA_blinding_on(rsa, NULL))
+    return 1;
+
+  /* A throwaway signature sets up and caches the Montgomery forms of the
+   * CRT primes, which otherwise the first signatures from several threads
+   * would all wait on. */
+  out = malloc(RSA_size(rsa));
+  if (!out)
+    return 1;
+  rv = RSA_private_encrypt(1, &in, out, rsa, RSA_PKCS1_PADDING);
+  free(out);
+  return -1 == rv;
+}
+
+
+/* A key in a PrivateKeyStore, read from [filename] */
+typedef struct PrivateKeyStoreEntry {
+  struct PrivateKeyStoreEntry* next;
+  char* filename;
+  uint64_t pem_algorithm;  /* Algorithm for a .pem file, else kNumAlgorithms */
+  VbPrivateKey* key;
+} PrivateKeyStoreEntry;
+
+struct PrivateKeyStore {
+  pthread_mutex_t lock;
+  PrivateKeyStoreEntry* entries;
+};
+
+PrivateKeyStore* PrivateKeyStoreNew(void) {
+  PrivateKeyStore* store = (PrivateKeyStore*)calloc(1, sizeof(*store));
+
+  if (!store)
+    return NULL;
+  if (pthread_mutex_init(&store->lock, NULL)) {
+    free(store);
+    return NULL;
+  }
+  return store;
+}
+
+void PrivateKeyStoreFree(PrivateKeyStore* store) {
+  PrivateKeyStoreEntry* entry;
+
+  if (!store)
+    return;
+  while ((entry = store->entries)) {
+    store->entries = entry->next;
+    PrivateKeyFree(entry->key);
+    free(entry->filename);
+    free(entry);
+  }
+  pthread_mutex_destroy(&store->lock);
+  free(store);
+}
+
+static const VbPrivateKey* PrivateKeyStoreGet(PrivateKeyStore* store,
+                                              const char* filename,
+                                              uint64_t pem_algorithm) {
+  PrivateKeyStoreEntry* entry;
+  VbPrivateKey* key = NULL;
+
+  pthread_mutex_lock(&store->lock);
+
+  for (entry = store->entries; entry; entry = entry->next) {
+    if (entry->pem_algorithm == pem_algorithm &&
+        !strcmp(entry->filename, filename)) {
+      key = entry->key;
+      goto done;
+    }
+  }
+
+  /* Not read yet, so read it now.  Failures aren't kept. */
+  if (pem_algorithm < kNumAlgorithms)
+    key = PrivateKeyReadPem(filename, pem_algorithm);
+  else
+    key = PrivateKeyRead(filename);
+  if (!key)
+    goto done;
+
+  entry = (PrivateKeyStoreEntry*)calloc(1, sizeof(*entry));
+  if (entry)
+    entry->filename = strdup(filename);
+  if (!entry || !entry->filename || PrivateKeyPrepare(key->rsa_private_key)) {
+    VBDEBUG(("%s(): Unable to keep key from %s\n", __FUNCTION__, filename));
+    if (entry)
+      free(entry->filename);
+    free(entry);
+    PrivateKeyFree(key);
+    key = NULL;
+    goto done;
+  }
+  entry->pem_algorithm = pem_algorithm;
+  entry->key = key;
+  entry->next = store->entries;
+  store->entries = entry;
+
+ done:
+  pthread_mutex_unlock(&store->lock);
+  return key;
+}
+
+const VbPrivateKey* PrivateKeyStoreRead(PrivateKeyStore* store,
+                                        const char* filename) {
+  return PrivateKeyStoreGet(store, filename, kNumAlgorithms);
+}
+
+const VbPrivateKey* PrivateKeyStoreReadPem(PrivateKeyStore* store,
+                                           const char* filename,
+                                           uint64_t algorithm) {
+  if (algorithm >= kNumAlgorithms) {
+    VBDEBUG(("%s() called with invalid algorithm!\n", __FUNCTION__));
+    return NULL;
+  }
+  return PrivateKeyStoreGet(store, filename, algorithm);
+}
+
+
 /* Allocate a new public key with space for a [key_size] byte key. */
 VbPublicKey* PublicKeyAlloc(uint64_t key_size, uint64_t algorithm,
                             uint64_t version) {
@@ -157,6 +285,81 @@ VbPublicKey* PublicKeyAlloc(uint64_t key_size, uint64_t algorithm,
   return key;
 }
 
+/* Read the RSA key from a PEM certificate, public key or private key. */
+static RSA* ReadPemRSA(const char* filename) {
+  RSA* rsa_key = NULL;
+  X509* cert;
+  EVP_PKEY* pkey;
+  FILE* f;
+
+  f = OpenKeyFile(filename);
+  if (!f)
+    return NULL;
+
+  cert = PEM_read_X509(f, NULL, NULL, NULL);
+  if (cert) {
+    pkey = X509_get_pubkey(cert);
+    if (pkey) {
+      rsa_key = EVP_PKEY_get1_RSA(pkey);
+      EVP_PKEY_free(pkey);
+    }
+    X509_free(cert);
+  }
+  if (!rsa_key) {
+    rewind(f);
+    rsa_key = PEM_read_RSA_PUBKEY(f, NULL, NULL, NULL);
+  }
+  if (!rsa_key) {
+    rewind(f);
+    rsa_key = PEM_read_RSAPrivateKey(f, NULL, NULL, NULL);
+  }
+  fclose(f);
+  return rsa_key;
+}
+
+VbPublicKey* PublicKeyReadPem(const char* filename, uint64_t algorithm,
+                              uint64_t version) {
+  VbPublicKey* key = NULL;
+  uint64_t expected_key_size;
+  uint8_t* keyb_data;
+  uint32_t keyb_size;
+  RSA* rsa_key;
+
+  if (algorithm >= kNumAlgorithms) {
+    VBDEBUG(("%s() called with invalid algorithm!\n", __FUNCTION__));
+    return NULL;
+  }
+  if (version > 0xFFFF) {
+    /* Currently, TPM only supports 16-bit version */
+    VBDEBUG(("%s() called with invalid version!\n", __FUNCTION__));
+    return NULL;
+  }
+
+  rsa_key = ReadPemRSA(filename);
+  if (!rsa_key) {
+    VBDEBUG(("%s(): Couldn't read an RSA key from file: %s\n", __FUNCTION__,
+             filename));
+    return NULL;
+  }
+  if (vb_keyb_from_rsa(rsa_key, &keyb_data, &keyb_size)) {
+    RSA_free(rsa_key);
+    return NULL;
+  }
+  RSA_free(rsa_key);
+
+  if (!RSAProcessedKeySize(algorithm, &expected_key_size) ||
+      expected_key_size != keyb_size) {
+    VBDEBUG(("%s() wrong key size for algorithm\n", __FUNCTION__));
+  } else {
+    key = PublicKeyAlloc(keyb_size, algorithm, version);
+    if (key)
+      Memcpy(GetPublicKeyData(key), keyb_data, keyb_size);
+  }
+
+  free(keyb_data);
+  return key;
+}
+
 VbPublicKey* PublicKeyReadKeyb(const char* filename, uint64_t algorithm,
                                uint64_t version) {
   VbPublicKey* key;
@@ -174,7 +377,7 @@ VbPublicKey* PublicKeyReadKeyb(const char* filename, uint64_t algorithm,
     return NULL;
   }
 
-  key_data = ReadFile(filename, &key_size);
+  key_data = ReadKeyFile(filename, &key_size);
   if (!key_data)
     return NULL;
 
@@ -230,7 +433,7 @@ VbPublicKey* PublicKeyRead(const char* filename) {
   VbPublicKey* key;
   uint64_t file_size;
 
-  key = (VbPublicKey*)ReadFile(filename, &file_size);
+  key = (VbPublicKey*)ReadKeyFile(filename, &file_size);
   if (!key)
     return NULL;
 
@@ -0,0 +1,237 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Reading keys out of key bundles.
+ */
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
+#include "host_common.h"
+#include "host_key_bundle.h"
+#include "host_misc.h"
+
+/* Bundles mapped so far; they stay mapped until exit */
+struct mapped_bundle {
+	struct mapped_bundle *next;
+	char *path;
+	const uint8_t *buf;
+	const struct key_bundle_entry *entries;
+	uint32_t count;
+};
+
+static pthread_mutex_t bundles_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mapped_bundle *bundles;
+
+const struct key_bundle_entry *KeyBundleEntries(const uint8_t *buf,
+						uint64_t size,
+						uint32_t *count)
+{
+	const struct key_bundle_header *h = (const void *)buf;
+	const struct key_bundle_entry *e;
+	uint32_t i;
+
+	if (size < sizeof(*h) ||
+	    memcmp(h->magic, KEY_BUNDLE_MAGIC, KEY_BUNDLE_MAGIC_SIZE) ||
+	    h->version != KEY_BUNDLE_VERSION ||
+	    h->header_size < sizeof(*h) ||
+	    h->entry_size != sizeof(*e) ||
+	    h->entries_offset < h->header_size ||
+	    h->entries_offset > size ||
+	    (size - h->entries_offset) / sizeof(*e) < h->entry_count)
+		return NULL;
+
+	/* Names are looked up with bsearch(), so they must be in order */
+	e = (const void *)(buf + h->entries_offset);
+	for (i = 0; i < h->entry_count; i++) {
+		if (e[i].offset > size || e[i].size > size - e[i].offset ||
+		    !memchr(e[i].name, 0, sizeof(e[i].name)) ||
+		    (i && strcmp(e[i - 1].name, e[i].name) >= 0))
+			return NULL;
+	}
+
+	*count = h->entry_count;
+	return e;
+}
+
+/* Map the bundle at [path], or find it if it's already mapped */
+static struct mapped_bundle *get_bundle(const char *path)
+{
+	struct mapped_bundle *b;
+	struct stat sb;
+	void *buf;
+	int fd;
+
+	for (b = bundles; b; b = b->next) {
+		if (!strcmp(b->path, path))
+			return b;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &sb) || !S_ISREG(sb.st_mode) || !sb.st_size) {
+		close(fd);
+		return NULL;
+	}
+	buf = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED)
+		return NULL;
+
+	b = calloc(1, sizeof(*b));
+	if (b)
+		b->path = strdup(path);
+	if (!b || !b->path ||
+	    !(b->entries = KeyBundleEntries(buf, sb.st_size, &b->count))) {
+		if (b)
+			free(b->path);
+		free(b);
+		munmap(buf, sb.st_size);
+		return NULL;
+	}
+	b->buf = buf;
+	b->next = bundles;
+	bundles = b;
+	return b;
+}
+
+static int compare_name(const void *key, const void *entry)
+{
+	return strcmp(key, ((const struct key_bundle_entry *)entry)->name);
+}
+
+/* Parse a hex SHA-1; returns 0 if [str] is one */
+static int parse_id(const char *str, uint8_t *id)
+{
+	char hex[3] = {0};
+	int i;
+
+	if (strlen(str) != 2 * KEY_BUNDLE_ID_SIZE)
+		return 1;
+	for (i = 0; i < KEY_BUNDLE_ID_SIZE; i++) {
+		if (!isxdigit(str[2 * i]) || !isxdigit(str[2 * i + 1]))
+			return 1;
+		hex[0] = str[2 * i];
+		hex[1] = str[2 * i + 1];
+		id[i] = strtoul(hex, NULL, 16);
+	}
+	return 0;
+}
+
+/* Check that the data for [e] is what its id says it is */
+static int check_id(const struct mapped_bundle *b,
+		    const struct key_bundle_entry *e)
+{
+	struct vb2_digest_context dc;
+	uint8_t digest[KEY_BUNDLE_ID_SIZE];
+
+	if (vb2_digest_init(&dc, VB2_HASH_SHA1) ||
+	    vb2_digest_extend(&dc, b->buf + e->offset, e->size) ||
+	    vb2_digest_finalize(&dc, digest, sizeof(digest)))
+		return 1;
+	return memcmp(digest, e->id, sizeof(digest)) ? 1 : 0;
+}
+
+static const struct key_bundle_entry *find_entry(
+		const struct mapped_bundle *b,
+		const char *name)
+{
+	uint8_t id[KEY_BUNDLE_ID_SIZE];
+	uint32_t i;
+
+	/* Asking for a key by id promises those contents, so check them */
+	if (parse_id(name, id) == 0) {
+		for (i = 0; i < b->count; i++) {
+			if (memcmp(b->entries[i].id, id, sizeof(id)))
+				continue;
+			if (check_id(b, &b->entries[i])) {
+				VBDEBUG(("%s(): Key %s doesn't match its id\n",
+					 __FUNCTION__, b->entries[i].name));
+				return NULL;
+			}
+			return &b->entries[i];
+		}
+	}
+
+	return bsearch(name, b->entries, b->count, sizeof(*b->entries),
+		       compare_name);
+}
+
+const uint8_t *KeyBundleGet(const char *filename, uint64_t *size)
+{
+	const struct key_bundle_entry *e = NULL;
+	struct mapped_bundle *b;
+	const char *sep = strrchr(filename, ':');
+	char *path;
+
+	if (!sep || sep == filename || !sep[1])
+		return NULL;
+	path = strndup(filename, sep - filename);
+	if (!path)
+		return NULL;
+
+	pthread_mutex_lock(&bundles_lock);
+	b = get_bundle(path);
+	if (b)
+		e = find_entry(b, sep + 1);
+	pthread_mutex_unlock(&bundles_lock);
+	free(path);
+
+	if (!e) {
+		VBDEBUG(("%s(): No key %s\n", __FUNCTION__, filename));
+		return NULL;
+	}
+	*size = e->size;
+	return b->buf + e->offset;
+}
+
+uint8_t *ReadKeyFile(const char *filename, uint64_t *size)
+{
+	const uint8_t *data;
+	uint8_t *buf;
+	uint64_t len;
+
+	if (access(filename, F_OK) == 0)
+		return ReadFile(filename, size);
+
+	data = KeyBundleGet(filename, &len);
+	if (!data)
+		return ReadFile(filename, size);
+
+	/* Callers expect their own copy, which they may change */
+	buf = malloc(len ? len : 1);
+	if (!buf)
+		return NULL;
+	memcpy(buf, data, len);
+	if (size)
+		*size = len;
+	return buf;
+}
+
+FILE *OpenKeyFile(const char *filename)
+{
+	const uint8_t *data;
+	uint64_t len;
+
+	if (access(filename, F_OK) == 0)
+		return fopen(filename, "r");
+
+	data = KeyBundleGet(filename, &len);
+	if (!data || !len)
+		return fopen(filename, "r");
+
+	/* Read-only, so the mapping isn't written through */
+	return fmemopen((void *)data, len, "r");
+}
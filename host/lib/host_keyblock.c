@@ -8,28 +8,31 @@
 
 #include "cryptolib.h"
 #include "host_common.h"
+#include "host_key_bundle.h"
 #include "host_keyblock.h"
 #include "vboot_common.h"
 
 
-VbKeyBlockHeader* KeyBlockCreate(const VbPublicKey* data_key,
-                                 const VbPrivateKey* signing_key,
-                                 uint64_t flags) {
+uint64_t KeyBlockSize(const VbPublicKey* data_key,
+                      const VbPrivateKey* signing_key) {
+  return (sizeof(VbKeyBlockHeader) + data_key->key_size + SHA512_DIGEST_SIZE +
+          (signing_key ? siglen_map[signing_key->algorithm] : 0));
+}
+
+
+int KeyBlockCreateInto(VbKeyBlockHeader* h, uint64_t buf_size,
+                       const VbPublicKey* data_key,
+                       const VbPrivateKey* signing_key,
+                       uint64_t flags) {
 
-  VbKeyBlockHeader* h;
   uint64_t signed_size = sizeof(VbKeyBlockHeader) + data_key->key_size;
-  uint64_t block_size = (signed_size + SHA512_DIGEST_SIZE +
-                         (signing_key ?
-                          siglen_map[signing_key->algorithm] : 0));
+  uint64_t block_size = KeyBlockSize(data_key, signing_key);
   uint8_t* data_key_dest;
   uint8_t* block_sig_dest;
   uint8_t* block_chk_dest;
-  VbSignature *sigtmp;
 
-  /* Allocate key block */
-  h = (VbKeyBlockHeader*)malloc(block_size);
-  if (!h)
-    return NULL;
+  if (buf_size < block_size)
+    return 1;
   data_key_dest = (uint8_t*)(h + 1);
   block_chk_dest = data_key_dest + data_key->key_size;
   block_sig_dest = block_chk_dest + SHA512_DIGEST_SIZE;
@@ -53,16 +56,34 @@ VbKeyBlockHeader* KeyBlockCreate(const VbPublicKey* data_key,
   else
     Memset(&h->key_block_signature, 0, sizeof(VbSignature));
 
-  /* Calculate checksum */
-  sigtmp = CalculateChecksum((uint8_t*)h, signed_size);
-  SignatureCopy(&h->key_block_checksum, sigtmp);
-  free(sigtmp);
+  /* Calculate checksum and signature, straight into the block */
+  if (DigestBufInto((uint8_t*)h, signed_size, SHA512_DIGEST_ALGORITHM,
+                    block_chk_dest, SHA512_DIGEST_SIZE))
+    return 1;
+  if (signing_key &&
+      CalculateSignatureInto(&h->key_block_signature, (uint8_t*)h,
+                             signed_size, signing_key))
+    return 1;
 
-  /* Calculate signature */
-  if (signing_key) {
-    sigtmp = CalculateSignature((uint8_t*)h, signed_size, signing_key);
-    SignatureCopy(&h->key_block_signature, sigtmp);
-    free(sigtmp);
+  return 0;
+}
+
+
+VbKeyBlockHeader* KeyBlockCreate(const VbPublicKey* data_key,
+                                 const VbPrivateKey* signing_key,
+                                 uint64_t flags) {
+
+  uint64_t block_size = KeyBlockSize(data_key, signing_key);
+  VbKeyBlockHeader* h;
+
+  /* Allocate key block */
+  h = (VbKeyBlockHeader*)malloc(block_size);
+  if (!h)
+    return NULL;
+
+  if (KeyBlockCreateInto(h, block_size, data_key, signing_key, flags)) {
+    free(h);
+    return NULL;
   }
 
   /* Return the header */
@@ -138,7 +159,7 @@ VbKeyBlockHeader* KeyBlockRead(const char* filename) {
   VbKeyBlockHeader* block;
   uint64_t file_size;
 
-  block = (VbKeyBlockHeader*)ReadFile(filename, &file_size);
+  block = (VbKeyBlockHeader*)ReadKeyFile(filename, &file_size);
   if (!block) {
     VBDEBUG(("Error reading key block file: %s\n", filename));
     return NULL;
@@ -7,11 +7,22 @@
 
 /* TODO: change all 'return 0', 'return 1' into meaningful return codes */
 
+#include <errno.h>
+#include <fcntl.h>
+#ifndef HAVE_MACOS
+#include <linux/fs.h>		/* For BLKGETSIZE64 */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
+#include "2sysincludes.h"
+#include "2return_codes.h"
 #include "cryptolib.h"
 #include "host_common.h"
 #include "vboot_common.h"
@@ -59,6 +70,100 @@ uint8_t* ReadFile(const char* filename, uint64_t* sizeptr) {
 }
 
 
+int vb2_map_fd(int fd, enum vb2_map_mode mode,
+               uint8_t **data_ptr, uint32_t *size_ptr) {
+  /* mmap() refuses empty mappings, so empty files all get this */
+  static uint8_t empty;
+  struct stat sb;
+  uint64_t size;
+  void *ptr;
+
+  *data_ptr = NULL;
+  *size_ptr = 0;
+
+  if (0 != fstat(fd, &sb)) {
+    VBDEBUG(("Unable to stat file: %s\n", strerror(errno)));
+    return VB2_ERROR_MAP_FILE_STAT;
+  }
+  size = sb.st_size;
+
+#ifndef HAVE_MACOS
+  if (S_ISBLK(sb.st_mode) && 0 != ioctl(fd, BLKGETSIZE64, &size)) {
+    VBDEBUG(("Unable to get block device size: %s\n", strerror(errno)));
+    return VB2_ERROR_MAP_FILE_STAT;
+  }
+#endif
+
+  /* Everything that uses images counts bytes in 32 bits */
+  if (sb.st_size < 0 || size > UINT32_MAX) {
+    VBDEBUG(("File size is unreasonable\n"));
+    errno = EFBIG;
+    return VB2_ERROR_MAP_FILE_SIZE;
+  }
+
+  if (!size) {
+    *data_ptr = &empty;
+    return VB2_SUCCESS;
+  }
+
+  ptr = mmap(0, size,
+             mode == VB2_MAP_RO ? PROT_READ : PROT_READ | PROT_WRITE,
+             mode == VB2_MAP_RW ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  if (ptr == MAP_FAILED) {
+    VBDEBUG(("Unable to mmap file: %s\n", strerror(errno)));
+    return VB2_ERROR_MAP_FILE_MMAP;
+  }
+
+  *data_ptr = ptr;
+  *size_ptr = (uint32_t)size;
+  return VB2_SUCCESS;
+}
+
+
+int vb2_map_file(const char *filename, enum vb2_map_mode mode,
+                 uint8_t **data_ptr, uint32_t *size_ptr) {
+  int fd;
+  int rv;
+  int saved_errno;
+
+  fd = open(filename, mode == VB2_MAP_RW ? O_RDWR : O_RDONLY);
+  if (fd < 0) {
+    *data_ptr = NULL;
+    *size_ptr = 0;
+    VBDEBUG(("Unable to open file %s\n", filename));
+    return VB2_ERROR_MAP_FILE_OPEN;
+  }
+
+  /* The mapping holds its own reference, so the file can be closed now */
+  rv = vb2_map_fd(fd, mode, data_ptr, size_ptr);
+  saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return rv;
+}
+
+
+int vb2_unmap_file(uint8_t *data, uint32_t size, enum vb2_map_mode mode) {
+  int rv = VB2_SUCCESS;
+
+  if (!size)
+    return VB2_SUCCESS;
+
+  if (mode == VB2_MAP_RW && 0 != msync(data, size, MS_SYNC|MS_INVALIDATE)) {
+    VBDEBUG(("msync failed: %s\n", strerror(errno)));
+    rv = VB2_ERROR_UNMAP_FILE_MSYNC;
+  }
+
+  if (0 != munmap(data, size)) {
+    VBDEBUG(("Unable to munmap file: %s\n", strerror(errno)));
+    if (rv == VB2_SUCCESS)
+      rv = VB2_ERROR_UNMAP_FILE_MUNMAP;
+  }
+
+  return rv;
+}
+
+
 char* ReadFileString(char* dest, int size, const char* filename) {
   char* got;
   FILE* f;
@@ -114,3 +219,174 @@ int WriteFile(const char* filename, const void *data, uint64_t size) {
   fclose(f);
   return 0;
 }
+
+
+/* Let the kernel do the copy if it can; returns -1 and sets errno if not */
+static ssize_t KernelCopyRange(int in_fd, off_t* in_off,
+                               int out_fd, off_t* out_off, size_t len) {
+#ifdef __NR_copy_file_range
+  return syscall(__NR_copy_file_range, in_fd, in_off, out_fd, out_off,
+                 len, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+
+/* Copy with read() and write() through [buf], for files the kernel can't
+ * copy itself */
+static ssize_t UserCopyRange(int in_fd, off_t* in_off, int out_fd,
+                             off_t* out_off, size_t len,
+                             uint8_t* buf, size_t buf_size) {
+  ssize_t n, w, done;
+
+  if (len > buf_size)
+    len = buf_size;
+  n = in_off ? pread(in_fd, buf, len, *in_off) : read(in_fd, buf, len);
+  if (n <= 0)
+    return n;
+
+  for (done = 0; done < n; done += w) {
+    w = pwrite(out_fd, buf + done, n - done, *out_off + done);
+    if (w < 0)
+      return -1;
+  }
+  if (in_off)
+    *in_off += n;
+  *out_off += n;
+  return n;
+}
+
+
+ssize_t CopyFileRange(int in_fd, off_t in_off, int out_fd, off_t out_off,
+                      size_t len) {
+  static const size_t buf_size = 64 * 1024;
+  off_t* in_offp = in_off < 0 ? NULL : &in_off;
+  uint8_t* buf = NULL;
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < len) {
+    if (!buf) {
+      n = KernelCopyRange(in_fd, in_offp, out_fd, &out_off, len - done);
+      /* Devices like /dev/zero, and copies between filesystems on older
+       * kernels, still need doing.  If it's a real error, the fallback will
+       * say so. */
+      if (n < 0 && (errno == ENOSYS || errno == EINVAL || errno == EXDEV ||
+                    errno == EOPNOTSUPP || errno == EBADF)) {
+        buf = malloc(buf_size);
+        if (!buf)
+          return -1;
+        continue;
+      }
+    } else {
+      n = UserCopyRange(in_fd, in_offp, out_fd, &out_off, len - done,
+                        buf, buf_size);
+    }
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      free(buf);
+      return -1;
+    }
+    if (n == 0)
+      break;
+    done += n;
+  }
+
+  free(buf);
+  return done;
+}
+
+
+int VbSharedDataIsCompact(const uint8_t* buf, uint64_t size) {
+  const VbSharedDataCompactHeader* h = (const VbSharedDataCompactHeader*)buf;
+
+  return size >= sizeof(*h) && h->magic == VB_SHARED_DATA_COMPACT_MAGIC;
+}
+
+
+VbSharedDataHeader* VbSharedDataExpand(const uint8_t* buf, uint64_t size,
+                                       uint64_t* out_size) {
+  const VbSharedDataCompactHeader* h = (const VbSharedDataCompactHeader*)buf;
+  const uint8_t* subkey = NULL;
+  uint32_t subkey_size = 0;
+  VbSharedDataHeader* sh;
+  uint64_t pos, total;
+  int pass, i;
+
+  if (!VbSharedDataIsCompact(buf, size) ||
+      h->version != VB_SHARED_DATA_COMPACT_VERSION ||
+      h->size < sizeof(*h) || h->size > size)
+    return NULL;
+  size = h->size;
+
+  sh = (VbSharedDataHeader*)calloc(1, sizeof(*sh));
+  if (!sh)
+    return NULL;
+
+  /* Checks the records on the first pass, and copies them on the second */
+  for (pass = 0; pass < 2; pass++) {
+    pos = sizeof(*h);
+    for (i = 0; i < h->record_count; i++) {
+      VbSharedDataRecord rec;
+      const uint8_t* data;
+
+      if (size - pos < sizeof(rec))
+        goto bad;
+      memcpy(&rec, buf + pos, sizeof(rec));
+      data = buf + pos + sizeof(rec);
+      if (size - pos - sizeof(rec) < rec.size)
+        goto bad;
+      pos += sizeof(rec) + roundup32(rec.size);
+
+      if (rec.tag == VBSD_REC_HEADER_SPAN) {
+        uint32_t offset;
+
+        if (rec.size < sizeof(offset))
+          goto bad;
+        memcpy(&offset, data, sizeof(offset));
+        if (offset > sizeof(*sh) ||
+            rec.size - sizeof(offset) > sizeof(*sh) - offset)
+          goto bad;
+        if (pass)
+          memcpy((uint8_t*)sh + offset, data + sizeof(offset),
+                 rec.size - sizeof(offset));
+      } else if (rec.tag == VBSD_REC_KERNEL_SUBKEY) {
+        subkey = data;
+        subkey_size = rec.size;
+      }
+      /* Anything else is for a newer reader */
+    }
+  }
+  if (sh->magic != VB_SHARED_DATA_MAGIC ||
+      sh->struct_size < VB_SHARED_DATA_HEADER_SIZE_V1 ||
+      sh->struct_size > sizeof(*sh))
+    goto bad;
+
+  /* The subkey data follows the header now */
+  total = sizeof(*sh) + subkey_size;
+  if (subkey) {
+    VbSharedDataHeader* bigger = (VbSharedDataHeader*)realloc(sh, total);
+    if (!bigger)
+      goto bad;
+    sh = bigger;
+    memcpy((uint8_t*)sh + sizeof(*sh), subkey, subkey_size);
+    sh->kernel_subkey.key_offset =
+        sizeof(*sh) - offsetof(VbSharedDataHeader, kernel_subkey);
+    sh->kernel_subkey_data_offset = sizeof(*sh);
+  } else {
+    sh->kernel_subkey_data_offset = 0;
+  }
+  sh->kernel_subkey_data_size = subkey_size;
+  sh->data_size = sh->data_used = total;
+
+  if (out_size)
+    *out_size = total;
+  return sh;
+
+bad:
+  free(sh);
+  return NULL;
+}
@@ -7,17 +7,24 @@
 
 /* TODO: change all 'return 0', 'return 1' into meaningful return codes */
 
+#include <openssl/bn.h>
 #include <openssl/rsa.h>
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include "cryptolib.h"
 #include "file_keys.h"
 #include "host_common.h"
+#include "signature_digest.h"
 #include "vboot_common.h"
 
 
@@ -52,103 +59,102 @@ int SignatureCopy(VbSignature* dest, const VbSignature* src) {
 
 
 VbSignature* CalculateChecksum(const uint8_t* data, uint64_t size) {
+  VbSignature* sig = SignatureAlloc(SHA512_DIGEST_SIZE, 0);
 
-  uint8_t* header_checksum;
-  VbSignature* sig;
-
-  header_checksum = DigestBuf(data, size, SHA512_DIGEST_ALGORITHM);
-  if (!header_checksum)
-    return NULL;
-
-  sig = SignatureAlloc(SHA512_DIGEST_SIZE, 0);
-  if (!sig) {
-    VbExFree(header_checksum);
+  if (!sig)
     return NULL;
-  }
   sig->sig_offset = sizeof(VbSignature);
   sig->sig_size = SHA512_DIGEST_SIZE;
   sig->data_size = size;
 
   /* Signature data immediately follows the header */
-  Memcpy(GetSignatureData(sig), header_checksum, SHA512_DIGEST_SIZE);
-  VbExFree(header_checksum);
+  if (DigestBufInto(data, size, SHA512_DIGEST_ALGORITHM,
+                    GetSignatureData(sig), SHA512_DIGEST_SIZE)) {
+    free(sig);
+    return NULL;
+  }
+  return sig;
+}
+
+VbSignature* CalculateSha256(const uint8_t* data, uint64_t size) {
+  VbSignature* sig = SignatureAlloc(SHA256_DIGEST_SIZE, size);
+
+  if (!sig)
+    return NULL;
+
+  internal_SHA256(data, size, GetSignatureData(sig));
   return sig;
 }
 
 VbSignature* CalculateHash(const uint8_t* data, uint64_t size,
                            const VbPrivateKey* key) {
-  uint8_t* digest = NULL;
   int digest_size = hash_size_map[key->algorithm];
   VbSignature* sig = NULL;
 
-  /* Calculate the digest */
-  digest = DigestBuf(data, size, key->algorithm);
-  if (!digest)
-    return NULL;
-
   /* Allocate output signature */
   sig = SignatureAlloc(digest_size, size);
-  if (!sig) {
-    free(digest);
+  if (!sig)
     return NULL;
-  }
 
   /* The digest itself is the signature data */
-  Memcpy(GetSignatureData(sig), digest, digest_size);
-  free(digest);
+  if (DigestBufInto(data, size, key->algorithm, GetSignatureData(sig),
+                    digest_size)) {
+    free(sig);
+    return NULL;
+  }
 
   /* Return the signature */
   return sig;
 }
 
-VbSignature* CalculateSignature(const uint8_t* data, uint64_t size,
-                                const VbPrivateKey* key) {
+int SignatureFromDigestInto(VbSignature* sig, const uint8_t* digest,
+                            uint64_t data_size, const VbPrivateKey* key) {
 
-  uint8_t* digest;
   int digest_size = hash_size_map[key->algorithm];
-
-  const uint8_t* digestinfo = hash_digestinfo_map[key->algorithm];
   int digestinfo_size = digestinfo_size_map[key->algorithm];
 
-  uint8_t* signature_digest;
+  uint8_t signature_digest[MAX_SIGNATURE_DIGEST_SIZE];
   int signature_digest_len = digest_size + digestinfo_size;
 
-  VbSignature* sig;
   int rv;
 
-  /* Calculate the digest */
-  /* TODO: rename param 3 of DigestBuf to hash_type */
-  digest = DigestBuf(data, size, hash_type_map[key->algorithm]);
-  if (!digest)
-    return NULL;
-
-  /* Prepend the digest info to the digest */
-  signature_digest = malloc(signature_digest_len);
-  if (!signature_digest) {
-    VbExFree(digest);
-    return NULL;
+  if (sig->sig_size != siglen_map[key->algorithm]) {
+    VBDEBUG(("SignatureFromDigestInto(): wrong signature size.\n"));
+    return 1;
   }
-  Memcpy(signature_digest, digestinfo, digestinfo_size);
-  Memcpy(signature_digest + digestinfo_size, digest, digest_size);
-  VbExFree(digest);
 
-  /* Allocate output signature */
-  sig = SignatureAlloc(siglen_map[key->algorithm], size);
-  if (!sig) {
-    free(signature_digest);
-    return NULL;
-  }
+  /* Prepend the digest info to the digest */
+  if (PrependDigestInfoInto(key->algorithm, digest, signature_digest,
+                            sizeof(signature_digest)))
+    return 1;
 
-  /* Sign the signature_digest into our output buffer */
+  /* Sign the signature_digest into the signature's own buffer */
   rv = RSA_private_encrypt(signature_digest_len,   /* Input length */
                            signature_digest,       /* Input data */
                            GetSignatureData(sig),  /* Output sig */
                            key->rsa_private_key,   /* Key to use */
                            RSA_PKCS1_PADDING);     /* Padding to use */
-  free(signature_digest);
 
   if (-1 == rv) {
     VBDEBUG(("SignatureBuf(): RSA_private_encrypt() failed.\n"));
+    return 1;
+  }
+
+  sig->data_size = data_size;
+  return 0;
+}
+
+VbSignature* CalculateSignatureFromDigest(const uint8_t* digest,
+                                          uint64_t data_size,
+                                          const VbPrivateKey* key) {
+  VbSignature* sig;
+
+  /* Allocate output signature */
+  sig = SignatureAlloc(siglen_map[key->algorithm], data_size);
+  if (!sig)
+    return NULL;
+
+  if (SignatureFromDigestInto(sig, digest, data_size, key)) {
     free(sig);
     return NULL;
   }
@@ -157,9 +163,314 @@ VbSignature* CalculateSignature(const uint8_t* data, uint64_t size,
   return sig;
 }
 
+int SignatureRecoverDigest(const VbSignature* sig, const RSAPublicKey* key,
+                           uint8_t* digest) {
+  uint32_t sig_len = key->len * sizeof(uint32_t);
+  const uint8_t* digestinfo;
+  int digestinfo_size;
+  int digest_size;
+  uint8_t* modulus = NULL;
+  uint8_t* decrypted = NULL;
+  BIGNUM* n = NULL;
+  BIGNUM* e = NULL;
+  RSA* rsa = NULL;
+  int rv = 1;
+  int len;
+  uint32_t i;
+
+  if (key->algorithm >= kNumAlgorithms) {
+    VBDEBUG(("SignatureRecoverDigest(): invalid algorithm.\n"));
+    return 1;
+  }
+  digestinfo = hash_digestinfo_map[key->algorithm];
+  digestinfo_size = digestinfo_size_map[key->algorithm];
+  digest_size = hash_size_map[key->algorithm];
+
+  if (sig->sig_size != sig_len ||
+      sig->sig_size != siglen_map[key->algorithm]) {
+    VBDEBUG(("SignatureRecoverDigest(): wrong signature size.\n"));
+    return 1;
+  }
+
+  /* The key holds the modulus as little-endian words; OpenSSL wants it as
+   * big-endian bytes */
+  modulus = malloc(sig_len);
+  decrypted = malloc(sig_len);
+  if (!modulus || !decrypted)
+    goto done;
+  for (i = 0; i < key->len; i++) {
+    uint32_t word = key->n[key->len - 1 - i];
+    modulus[4 * i] = (uint8_t)(word >> 24);
+    modulus[4 * i + 1] = (uint8_t)(word >> 16);
+    modulus[4 * i + 2] = (uint8_t)(word >> 8);
+    modulus[4 * i + 3] = (uint8_t)word;
+  }
+
+  /* Vboot keys always use F4 as the public exponent */
+  n = BN_bin2bn(modulus, sig_len, NULL);
+  e = BN_new();
+  rsa = RSA_new();
+  if (!n || !e || !rsa || !BN_set_word(e, RSA_F4))
+    goto done;
+  rsa->n = n;
+  rsa->e = e;
+  n = e = NULL;
+
+  /* This checks the PKCS #1 padding too */
+  len = RSA_public_decrypt(sig_len, GetSignatureDataC(sig), decrypted, rsa,
+                           RSA_PKCS1_PADDING);
+  if (len != digestinfo_size + digest_size ||
+      Memcmp(decrypted, digestinfo, digestinfo_size)) {
+    VBDEBUG(("SignatureRecoverDigest(): signature check failed.\n"));
+    goto done;
+  }
+
+  Memcpy(digest, decrypted + digestinfo_size, digest_size);
+  rv = 0;
+
+ done:
+  if (rsa)
+    RSA_free(rsa);
+  BN_free(n);
+  BN_free(e);
+  free(decrypted);
+  free(modulus);
+  return rv;
+}
+
+void SignContextInit(SignContext* ctx, const VbPrivateKey* key) {
+  DigestInit(&ctx->digest, key->algorithm);
+  ctx->key = key;
+  ctx->data_size = 0;
+}
+
+void SignContextUpdate(SignContext* ctx, const uint8_t* data, uint64_t size) {
+  ctx->data_size += size;
+
+  /* DigestUpdate() takes 32-bit lengths, so hash large pieces in parts. */
+  while (size > UINT32_MAX) {
+    DigestUpdate(&ctx->digest, data, UINT32_MAX);
+    data += UINT32_MAX;
+    size -= UINT32_MAX;
+  }
+  DigestUpdate(&ctx->digest, data, (uint32_t)size);
+}
+
+VbSignature* SignContextFinal(SignContext* ctx) {
+  uint8_t digest[MAX_DIGEST_SIZE];
+
+  if (DigestFinalInto(&ctx->digest, digest, sizeof(digest)))
+    return NULL;
+
+  return CalculateSignatureFromDigest(digest, ctx->data_size, ctx->key);
+}
+
+int SignContextFinalInto(SignContext* ctx, VbSignature* sig) {
+  uint8_t digest[MAX_DIGEST_SIZE];
+
+  if (DigestFinalInto(&ctx->digest, digest, sizeof(digest)))
+    return 1;
+
+  return SignatureFromDigestInto(sig, digest, ctx->data_size, ctx->key);
+}
+
+VbSignature* CalculateSignature(const uint8_t* data, uint64_t size,
+                                const VbPrivateKey* key) {
+  SignContext ctx;
+
+  SignContextInit(&ctx, key);
+  SignContextUpdate(&ctx, data, size);
+  return SignContextFinal(&ctx);
+}
+
+int CalculateSignatureInto(VbSignature* sig, const uint8_t* data,
+                           uint64_t size, const VbPrivateKey* key) {
+  SignContext ctx;
+
+  SignContextInit(&ctx, key);
+  SignContextUpdate(&ctx, data, size);
+  return SignContextFinalInto(&ctx, sig);
+}
+
+/* Signing daemon protocol; see host_signature.h */
+#define SIGNER_REQUEST_MAGIC 0x56425331   /* "VBS1" */
+#define SIGNER_RESPONSE_MAGIC 0x56425352  /* "VBSR" */
+#define SIGNER_HEADER_SIZE 16
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* The connection to the signing daemon, kept open between signatures. */
+static struct {
+  char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+  int fd;
+  pid_t pid;
+  uint32_t next_id;
+} signer_daemon = { .fd = -1 };
+
+static void PutUint32(uint8_t* buf, uint32_t value) {
+  buf[0] = (uint8_t)(value >> 24);
+  buf[1] = (uint8_t)(value >> 16);
+  buf[2] = (uint8_t)(value >> 8);
+  buf[3] = (uint8_t)value;
+}
+
+static uint32_t GetUint32(const uint8_t* buf) {
+  return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) |
+      ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+/* Returns 0 if all [size] bytes were sent, -1 if error. */
+static int SendAll(int fd, const void* buf, size_t size) {
+  const uint8_t* p = buf;
+  ssize_t n;
+
+  while (size) {
+    n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    p += n;
+    size -= n;
+  }
+  return 0;
+}
+
+/* Returns 0 if all [size] bytes were received, -1 if error or EOF. */
+static int RecvAll(int fd, void* buf, size_t size) {
+  uint8_t* p = buf;
+  ssize_t n;
+
+  while (size) {
+    n = recv(fd, p, size, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    p += n;
+    size -= n;
+  }
+  return 0;
+}
+
+static void DisconnectSignerDaemon(void) {
+  if (signer_daemon.fd >= 0 && signer_daemon.pid == getpid())
+    close(signer_daemon.fd);
+  signer_daemon.fd = -1;
+}
+
+/* Returns a connection to the daemon on socket [path], or -1 if error. */
+static int ConnectSignerDaemon(const char* path) {
+  struct sockaddr_un addr;
+  int fd;
+
+  /* A forked child mustn't share its parent's connection */
+  if (signer_daemon.fd >= 0 && signer_daemon.pid == getpid() &&
+      !strcmp(signer_daemon.path, path))
+    return signer_daemon.fd;
+  DisconnectSignerDaemon();
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    VBDEBUG(("Signer socket path is too long: %s\n", path));
+    return -1;
+  }
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    VBDEBUG(("socket() error\n"));
+    return -1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    VBDEBUG(("Can't connect to signer at %s: %s\n", path, strerror(errno)));
+    close(fd);
+    return -1;
+  }
+
+  strcpy(signer_daemon.path, path);
+  signer_daemon.fd = fd;
+  signer_daemon.pid = getpid();
+  return fd;
+}
+
+/* Ask the daemon listening on [socket_path] to sign [inbuf] with the key
+ * called [key_handle]. The signature must fill [outbuf] exactly.
+ * Returns -1 on error, 0 on success.
+ */
+static int InvokeSignerDaemon(uint64_t size,
+                              const uint8_t* inbuf,
+                              uint8_t* outbuf,
+                              uint64_t outbufsize,
+                              const char* key_handle,
+                              const char* socket_path) {
+  uint8_t header[SIGNER_HEADER_SIZE];
+  uint32_t key_len = strlen(key_handle);
+  uint32_t id;
+  int fd;
+
+  if (size > UINT32_MAX) {
+    VBDEBUG(("Too much data for the signer\n"));
+    return -1;
+  }
+
+  fd = ConnectSignerDaemon(socket_path);
+  if (fd < 0)
+    return -1;
+
+  id = signer_daemon.next_id++;
+  PutUint32(header, SIGNER_REQUEST_MAGIC);
+  PutUint32(header + 4, id);
+  PutUint32(header + 8, key_len);
+  PutUint32(header + 12, (uint32_t)size);
+  if (SendAll(fd, header, sizeof(header)) ||
+      SendAll(fd, key_handle, key_len) ||
+      SendAll(fd, inbuf, size)) {
+    VBDEBUG(("Error sending request to signer\n"));
+    DisconnectSignerDaemon();
+    return -1;
+  }
+
+  if (RecvAll(fd, header, sizeof(header)) ||
+      GetUint32(header) != SIGNER_RESPONSE_MAGIC ||
+      GetUint32(header + 4) != id) {
+    VBDEBUG(("Bad response from signer\n"));
+    DisconnectSignerDaemon();
+    return -1;
+  }
+
+  if (GetUint32(header + 8)) {
+    VBDEBUG(("Signer failed with status %u\n", GetUint32(header + 8)));
+    /* A failure carries no signature; anything else is out of step */
+    if (GetUint32(header + 12))
+      DisconnectSignerDaemon();
+    return -1;
+  }
+
+  if (GetUint32(header + 12) != outbufsize) {
+    VBDEBUG(("Signer returned %u bytes, not %u\n",
+             GetUint32(header + 12), (uint32_t)outbufsize));
+    DisconnectSignerDaemon();
+    return -1;
+  }
+
+  if (RecvAll(fd, outbuf, outbufsize)) {
+    VBDEBUG(("Error reading signature from signer\n"));
+    DisconnectSignerDaemon();
+    return -1;
+  }
+
+  return 0;
+}
+
 /* Invoke [external_signer] command with [pem_file] as
  * an argument, contents of [inbuf] passed redirected to stdin,
  * and the stdout of the command is put back into [outbuf].
+ * If [external_signer] is a socket, ask the daemon there instead.
  * Returns -1 on error, 0 on success.
  */
 int InvokeExternalSigner(uint64_t size,
@@ -172,6 +483,12 @@ int InvokeExternalSigner(uint64_t size,
   int rv = 0, n;
   int p_to_c[2], c_to_p[2];  /* pipe descriptors */
   pid_t pid;
+  struct stat sb;
+
+  /* A socket is a signing daemon, which can sign over and over. */
+  if (0 == stat(external_signer, &sb) && S_ISSOCK(sb.st_mode))
+    return InvokeSignerDaemon(size, inbuf, outbuf, outbufsize,
+                              pem_file, external_signer);
 
   VBDEBUG(("Will invoke \"%s %s\" to perform signing.\n"
            "Input to the signer will be provided on standard in.\n"
@@ -249,40 +566,24 @@ VbSignature* CalculateSignature_external(const uint8_t* data, uint64_t size,
                                          const char* key_file,
                                          uint64_t key_algorithm,
                                          const char* external_signer) {
-  uint8_t* digest;
   uint64_t digest_size = hash_size_map[key_algorithm];
-
-  const uint8_t* digestinfo = hash_digestinfo_map[key_algorithm];
   uint64_t digestinfo_size = digestinfo_size_map[key_algorithm];
 
-  uint8_t* signature_digest;
+  uint8_t signature_digest[MAX_SIGNATURE_DIGEST_SIZE];
   uint64_t signature_digest_len = digest_size + digestinfo_size;
 
   VbSignature* sig;
   int rv;
 
-  /* Calculate the digest */
-  /* TODO: rename param 3 of DigestBuf to hash_type */
-  digest = DigestBuf(data, size, hash_type_map[key_algorithm]);
-  if (!digest)
+  /* Calculate the digest, with the digest info prepended */
+  if (SignatureDigestInto(data, size, key_algorithm, signature_digest,
+                          sizeof(signature_digest)))
     return NULL;
 
-  /* Prepend the digest info to the digest */
-  signature_digest = malloc(signature_digest_len);
-  if (!signature_digest) {
-    free(digest);
-    return NULL;
-  }
-  Memcpy(signature_digest, digestinfo, digestinfo_size);
-  Memcpy(signature_digest + digestinfo_size, digest, digest_size);
-  free(digest);
-
   /* Allocate output signature */
   sig = SignatureAlloc(siglen_map[key_algorithm], size);
-  if (!sig) {
-    free(signature_digest);
+  if (!sig)
     return NULL;
-  }
 
   /* Sign the signature_digest into our output buffer */
   rv = InvokeExternalSigner(signature_digest_len, /* Input length */
@@ -291,7 +592,6 @@ VbSignature* CalculateSignature_external(const uint8_t* data, uint64_t size,
                             siglen_map[key_algorithm], /* Max Output sig size */
                             key_file,             /* Key file to use */
                             external_signer);     /* External cmd to invoke */
-  free(signature_digest);
 
   if (-1 == rv) {
     VBDEBUG(("SignatureBuf(): RSA_private_encrypt() failed.\n"));
@@ -41,6 +41,30 @@ int FwidStartsWith(const char *start);
 /* Return version of VbSharedData struct or -1 if not found. */
 int VbSharedDataVersion(void);
 
+/* Format the LoadKernel() debug information in [sh] into a destination
+ * buffer of the specified size.  If the buffer is too small, the string
+ * ends with a truncation warning.
+ *
+ * Returns the passed buffer, or NULL if error. */
+char* GetVdatLoadKernelDebug(char* dest, int size,
+                             const VbSharedDataHeader* sh);
+
+/* Format the boot phase timestamps in [sh], one "name=time" per line.  Only
+ * valid for struct_version >= 3.
+ *
+ * Returns the passed buffer, or NULL if error. */
+char* GetVdatTimestamps(char* dest, int size,
+                        const VbSharedDataHeader* sh);
+
+/* Format the crypto work counted in [sh], one "name=count" per line: bytes
+ * hashed with each algorithm, RSA verifications with each key size, bytes
+ * CRC'd and images decompressed.
+ *
+ * Returns the passed buffer, or NULL if error or [sh] is too old to have the
+ * counts. */
+char* GetVdatCryptoStats(char* dest, int size,
+                         const VbSharedDataHeader* sh);
+
 /* Apis WITH ARCH-SPECIFIC IMPLEMENTATIONS */
 
 /* Read the non-volatile context from NVRAM.
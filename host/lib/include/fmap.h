@@ -46,4 +46,79 @@ uint8_t *fmap_find_by_name(uint8_t *ptr, size_t size,
 			   /* optional, return pointer to entry if not NULL */
 			   FmapAreaHeader **ah);
 
+/*
+ * An index of an image's FMAP, for looking up several areas. It finds the
+ * FMAP once and hashes the area names, so each lookup is O(1).
+ */
+#define FMAP_INDEX_BUCKETS 64
+struct fmap_index {
+	uint8_t *ptr;
+	FmapHeader *fmap;
+	FmapAreaHeader *ah;
+	uint16_t nareas;			/* that fit in the buffer */
+	uint16_t bucket[FMAP_INDEX_BUCKETS];	/* first area + 1, or 0 */
+	uint16_t *chain;			/* next area + 1, or 0 */
+};
+
+/*
+ * Find the FMAP in the buffer and index its areas. Returns 0 if successful,
+ * nonzero if there's no FMAP or no memory. Free it with fmap_index_free().
+ */
+int fmap_index_init(struct fmap_index *index, uint8_t *ptr, size_t size);
+
+/* Free the index (but not the image it points into) */
+void fmap_index_free(struct fmap_index *index);
+
+/* Like fmap_find_by_name(), using the index */
+uint8_t *fmap_index_find(const struct fmap_index *index, const char *name,
+			 /* optional, return pointer to entry if not NULL */
+			 FmapAreaHeader **ah);
+
+/*
+ * An area in the tree built by fmap_build_tree(). Its parent is the smallest
+ * area which encloses it, or the root, which stands for the whole flash.
+ * Areas with the same offset and size as an earlier one aren't in the tree,
+ * but are chained from it as aliases.
+ */
+struct fmap_node {
+	char name[FMAP_NAMELEN + 1];
+	uint32_t start;
+	uint32_t size;
+	uint32_t end;
+	const FmapAreaHeader *ah;		/* NULL for the root */
+	struct fmap_node *parent;		/* NULL for root and aliases */
+	struct fmap_node **child;		/* by increasing offset */
+	int num_children;
+	struct fmap_node *alias;		/* next one the same, latest in
+						 * the FMAP first, or NULL */
+};
+
+/* Two areas which overlap without either enclosing the other */
+struct fmap_overlap {
+	struct fmap_node *first;		/* the one starting first */
+	struct fmap_node *second;
+};
+
+struct fmap_tree {
+	FmapHeader *fmap;
+	struct fmap_node *node;			/* each area, in FMAP order */
+	int num_nodes;				/* that fit in the buffer */
+	struct fmap_node *root;
+	struct fmap_overlap *overlap;		/* in order of first->start */
+	int num_overlaps;
+	struct fmap_node **child_ptrs;		/* space for child[] arrays */
+};
+
+/*
+ * Find the FMAP in the buffer and work out how its areas nest, sorting them
+ * by offset and sweeping through once, instead of comparing every pair.
+ * Any overlaps are recorded in the tree, so a quick check that an FMAP is
+ * sane is !tree.num_overlaps. Returns 0 if successful, nonzero if there's no
+ * FMAP or no memory. Free it with fmap_free_tree().
+ */
+int fmap_build_tree(struct fmap_tree *tree, uint8_t *ptr, size_t size);
+
+/* Free the tree (but not the image it points into) */
+void fmap_free_tree(struct fmap_tree *tree);
+
 #endif  /* __FMAP_H__ */
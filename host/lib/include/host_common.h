@@ -24,7 +24,9 @@
 #include "vboot_struct.h"
 
 /**
- * Create a firmware preamble, signed with [signing_key].
+ * Create a firmware preamble, signed with [signing_key].  If [ec_rw_hash] is
+ * non-NULL, it's the SHA-256 digest of the EC-RW image to go with the
+ * firmware, from CalculateSha256().
  *
  * Caller owns the returned pointer, and must free it with Free().
  *
@@ -35,7 +37,34 @@ VbFirmwarePreambleHeader *CreateFirmwarePreamble(
 	const VbPublicKey *kernel_subkey,
 	const VbSignature *body_signature,
 	const VbPrivateKey *signing_key,
-	uint32_t flags);
+	uint32_t flags,
+	const VbSignature *ec_rw_hash);
+
+/**
+ * Size of the firmware preamble CreateFirmwarePreamble() makes from these.
+ */
+uint64_t FirmwarePreambleSize(const VbPublicKey *kernel_subkey,
+			      const VbSignature *body_signature,
+			      const VbPrivateKey *signing_key,
+			      const VbSignature *ec_rw_hash);
+
+/**
+ * Like CreateFirmwarePreamble(), but builds the preamble in the [buf_size]
+ * bytes at [h], which must be at least FirmwarePreambleSize().  No memory is
+ * allocated, so a whole vblock can be built in one buffer, or in a mapped
+ * file.
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+int CreateFirmwarePreambleInto(
+	VbFirmwarePreambleHeader *h,
+	uint64_t buf_size,
+	uint64_t firmware_version,
+	const VbPublicKey *kernel_subkey,
+	const VbSignature *body_signature,
+	const VbPrivateKey *signing_key,
+	uint32_t flags,
+	const VbSignature *ec_rw_hash);
 
 /**
  * Create a kernel preamble, signed with [signing_key].
@@ -56,4 +85,134 @@ VbKernelPreambleHeader *CreateKernelPreamble(
 	uint64_t desired_size,
 	const VbPrivateKey *signing_key);
 
+/**
+ * Create a kernel preamble like CreateKernelPreamble(), which also hashes the
+ * kernel [body] in blocks of [hash_block_size] bytes, so the firmware can
+ * check just the first [head_size] bytes of the body and everything from
+ * [tail_offset] on before booting.  The body must be
+ * body_signature->data_size bytes long.  If [hash_block_size] is 0, the body
+ * isn't hashed in blocks and [body] may be NULL.
+ *
+ * Caller owns the returned pointer, and must free it with Free().
+ *
+ * Returns NULL if error.
+ */
+VbKernelPreambleHeader *CreateKernelPreambleWithBodyHashes(
+	uint64_t kernel_version,
+	uint64_t body_load_address,
+	uint64_t bootloader_address,
+	uint64_t bootloader_size,
+	const VbSignature *body_signature,
+	uint64_t vmlinuz_header_address,
+	uint64_t vmlinuz_header_size,
+	uint32_t flags,
+	const uint8_t *body,
+	uint32_t hash_block_size,
+	uint64_t head_size,
+	uint64_t tail_offset,
+	uint64_t desired_size,
+	const VbPrivateKey *signing_key);
+
+/**
+ * Sign the kernel [body] of [body_size] bytes with [body_key] and create a
+ * preamble for it like CreateKernelPreambleWithBodyHashes().  The body
+ * signature and the block hashes are computed on a single pass over the
+ * body, so a large body is only read from memory (or disk) once.
+ *
+ * Caller owns the returned pointer, and must free it with Free().
+ *
+ * Returns NULL if error.
+ */
+VbKernelPreambleHeader *SignKernelBodyAndPreamble(
+	uint64_t kernel_version,
+	uint64_t body_load_address,
+	uint64_t bootloader_address,
+	uint64_t bootloader_size,
+	uint64_t vmlinuz_header_address,
+	uint64_t vmlinuz_header_size,
+	uint32_t flags,
+	const uint8_t *body,
+	uint64_t body_size,
+	const VbPrivateKey *body_key,
+	uint32_t hash_block_size,
+	uint64_t head_size,
+	uint64_t tail_offset,
+	uint64_t desired_size,
+	const VbPrivateKey *signing_key);
+
+/**
+ * Size of the kernel preamble the functions above make for a body signature
+ * of [body_sig_size] bytes over [body_size] bytes of body.  For
+ * SignKernelBodyAndPreamble(), the body signature is the size of a
+ * signature by its [body_key].
+ */
+uint64_t KernelPreambleSize(uint64_t body_sig_size,
+			    uint64_t body_size,
+			    uint32_t hash_block_size,
+			    uint64_t desired_size,
+			    const VbPrivateKey *signing_key);
+
+/**
+ * Like CreateKernelPreamble(), but builds the preamble in the [buf_size] bytes
+ * at [h], which must be at least KernelPreambleSize().  No memory is
+ * allocated.  Padding up to [desired_size] isn't written, so it should
+ * already be zero (or not matter, as in an existing partition).
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+int CreateKernelPreambleInto(
+	VbKernelPreambleHeader *h,
+	uint64_t buf_size,
+	uint64_t kernel_version,
+	uint64_t body_load_address,
+	uint64_t bootloader_address,
+	uint64_t bootloader_size,
+	const VbSignature *body_signature,
+	uint64_t vmlinuz_header_address,
+	uint64_t vmlinuz_header_size,
+	uint32_t flags,
+	uint64_t desired_size,
+	const VbPrivateKey *signing_key);
+
+/**
+ * Like SignKernelBodyAndPreamble(), but builds the preamble in the
+ * [buf_size] bytes at [h], which must be at least KernelPreambleSize().  The
+ * body signature and block hashes go straight into the preamble, and no
+ * memory is allocated.  As with CreateKernelPreambleInto(), padding isn't
+ * written.
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+int SignKernelBodyAndPreambleInto(
+	VbKernelPreambleHeader *h,
+	uint64_t buf_size,
+	uint64_t kernel_version,
+	uint64_t body_load_address,
+	uint64_t bootloader_address,
+	uint64_t bootloader_size,
+	uint64_t vmlinuz_header_address,
+	uint64_t vmlinuz_header_size,
+	uint32_t flags,
+	const uint8_t *body,
+	uint64_t body_size,
+	const VbPrivateKey *body_key,
+	uint32_t hash_block_size,
+	uint64_t head_size,
+	uint64_t tail_offset,
+	uint64_t desired_size,
+	const VbPrivateKey *signing_key);
+
+/**
+ * Mark the body of the kernel preamble [h] as compressed with [compression]
+ * (one of the COMPRESS_* types), decompressing to [load_size] bytes, and sign
+ * the preamble again with [signing_key].  The body signature must already be
+ * over the compressed body, and the preamble can't have body block hashes.
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+int SetKernelPreambleCompression(VbKernelPreambleHeader *h,
+				 uint32_t compression,
+				 uint64_t load_size,
+				 const VbPrivateKey *signing_key);
+
 #endif  /* VBOOT_REFERENCE_HOST_COMMON_H_ */
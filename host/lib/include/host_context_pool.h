@@ -0,0 +1,68 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * A pool of vboot 2.0 contexts for host programs which verify firmware over
+ * and over, possibly from several threads at once.
+ */
+
+#ifndef VBOOT_REFERENCE_HOST_CONTEXT_POOL_H_
+#define VBOOT_REFERENCE_HOST_CONTEXT_POOL_H_
+
+#include <stdint.h>
+
+#include "2api.h"
+
+struct vb2_context_pool;
+
+/**
+ * Create a pool of contexts, each with its own work buffer.
+ *
+ * Every context handed out starts as a copy of [initial], other than its work
+ * buffer: the same flags, nvdata, secdata, verify cache, vblock prefix size
+ * and non_vboot_context.  If [initial] is NULL, they start with new secdata,
+ * as vb2api_secdata_create() makes.
+ *
+ * @param count		Number of contexts; at most this many verifications
+ *			run at once
+ * @param workbuf_size	Size of each work buffer, such as
+ *			VB2_WORKBUF_RECOMMENDED_SIZE
+ * @param initial	What each context starts as, or NULL
+ * @return The pool, or NULL if there's not enough memory.
+ */
+struct vb2_context_pool *vb2_context_pool_create(
+		uint32_t count,
+		uint32_t workbuf_size,
+		const struct vb2_context *initial);
+
+/**
+ * Take a context from the pool, waiting for one if they're all in use.
+ *
+ * The context is ready for vb2api_fw_phase1().  Any thread may take one, and
+ * use it until it's put back.
+ *
+ * @param pool		Pool to take it from
+ * @return The context.
+ */
+struct vb2_context *vb2_context_pool_get(struct vb2_context_pool *pool);
+
+/**
+ * Put a context back in the pool, for the next verification.
+ *
+ * Whatever it kept in its work buffer is cleared, so nothing from this
+ * verification is seen by the next one; the rest of the buffer isn't touched.
+ *
+ * @param pool		Pool it came from
+ * @param ctx		Context to put back
+ */
+void vb2_context_pool_put(struct vb2_context_pool *pool,
+			  struct vb2_context *ctx);
+
+/**
+ * Free the pool.  All its contexts must have been put back.
+ *
+ * @param pool		Pool to free, or NULL
+ */
+void vb2_context_pool_free(struct vb2_context_pool *pool);
+
+#endif  /* VBOOT_REFERENCE_HOST_CONTEXT_POOL_H_ */
@@ -0,0 +1,54 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Host-side choice of the code which computes digests and verifies RSA
+ * signatures for the vboot 2.0 library.
+ */
+
+#ifndef VBOOT_REFERENCE_HOST_CRYPTO_H_
+#define VBOOT_REFERENCE_HOST_CRYPTO_H_
+
+/* Environment variable vb2_host_crypto_select_env() looks at */
+#define VB2_HOST_CRYPTO_ENV "VB2_HOST_CRYPTO"
+
+enum vb2_host_crypto_mode {
+	/* The firmware's own code, as firmware runs it */
+	VB2_HOST_CRYPTO_REFERENCE = 0,
+
+	/* OpenSSL, where it handles the algorithm */
+	VB2_HOST_CRYPTO_OPENSSL,
+
+	/*
+	 * Both, comparing the results; the process is aborted if they ever
+	 * differ.  For testing.
+	 */
+	VB2_HOST_CRYPTO_CROSSCHECK,
+};
+
+/**
+ * Select the code vb2_digest_*() and vb2_rsa_verify_digest() use.
+ *
+ * The firmware code is used until this is called.  SHA-1, SHA-256 and SHA-512
+ * digests and RSA signatures go to OpenSSL; other algorithms, and signatures
+ * OpenSSL won't take as they are, always use the firmware code.  Results are
+ * the same either way, down to the error codes.  Digests already started stay
+ * with the code they started with.
+ *
+ * @param mode		Code to use
+ * @return VB2_SUCCESS, or non-zero if the mode is unknown.
+ */
+int vb2_host_crypto_select(enum vb2_host_crypto_mode mode);
+
+/**
+ * Select the code from $VB2_HOST_CRYPTO.
+ *
+ * That's "reference", "openssl" or "crosscheck", the same as the modes above.
+ * OpenSSL is used if it's not set.
+ *
+ * @return VB2_SUCCESS, or non-zero if the variable holds something else (in
+ * which case that's reported on stderr and OpenSSL is used).
+ */
+int vb2_host_crypto_select_env(void);
+
+#endif  /* VBOOT_REFERENCE_HOST_CRYPTO_H_ */
@@ -0,0 +1,41 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Host functions for reading many pieces of files or disks at once.
+ */
+
+#ifndef VBOOT_REFERENCE_HOST_IO_H_
+#define VBOOT_REFERENCE_HOST_IO_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Most reads ReadBatch() has in flight together */
+#define READ_BATCH_MAX_IN_FLIGHT 64
+
+/* One read of a batch */
+struct read_request {
+	int fd;
+	void *buf;
+	size_t size;
+	off_t offset;
+	/* Filled in with the bytes read, or -errno */
+	ssize_t result;
+};
+
+/**
+ * Read each of [count] pieces of files into its buffer.
+ *
+ * Where the tools are built with USE_IO_URING and the kernel allows it, all
+ * the reads are queued with io_uring at once, so reads from one drive or
+ * many can overlap instead of waiting for each other.  Otherwise they're
+ * done one after another with pread().  Either way, each request's result is
+ * what a pread() would return, retried until the request is done or the end
+ * of the file.
+ *
+ * @return 0 if every request was read in full, -1 if not.
+ */
+int ReadBatch(struct read_request *reqs, int count);
+
+#endif  /* VBOOT_REFERENCE_HOST_IO_H_ */
@@ -0,0 +1,96 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Host functions for checking all the kernel partitions on a disk at once.
+ */
+
+#ifndef VBOOT_REFERENCE_HOST_KERNEL_SCAN_H_
+#define VBOOT_REFERENCE_HOST_KERNEL_SCAN_H_
+
+#include "load_kernel_fw.h"
+#include "vboot_struct.h"
+
+/* Most kernel partitions checked at once; later ones are left to LoadKernel */
+#define KERNEL_SCAN_MAX_PARTS 16
+
+/* Bytes read from the start of each partition; matches LoadKernel() */
+#define KERNEL_SCAN_HEADER_BYTES 65536
+
+/*
+ * Read sectors from the disk.  This is called from several threads at once,
+ * so it must not depend on a shared file position.
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+typedef int (*KernelScanReadFn)(void *ctx, uint64_t lba_start,
+				uint64_t lba_count, void *buffer);
+
+struct KernelScan;
+
+/* What was found in one kernel partition */
+typedef struct KernelScanPart {
+	struct KernelScan *scan;
+	/* Where the partition is, and its GPT entry number (1...N) */
+	uint64_t sector_start;
+	uint64_t sector_count;
+	int gpt_index;
+	/* First header_sectors of the partition */
+	uint8_t *header;
+	uint64_t header_sectors;
+	/* Why the headers are bad, or NULL if they verified */
+	const char *error;
+	/* Key block is only valid by its hash, not signed by the subkey */
+	int self_signed;
+	uint64_t key_block_flags;
+	/* Key version << 16 | kernel version, as LoadKernel() compares it */
+	uint32_t combined_version;
+} KernelScanPart;
+
+typedef struct KernelScan {
+	uint64_t bytes_per_lba;
+	const VbPublicKey *subkey;
+	KernelScanReadFn read_fn;
+	void *read_ctx;
+	/* Kernel partitions, in the order LoadKernel() tries them */
+	int count;
+	KernelScanPart parts[KERNEL_SCAN_MAX_PARTS];
+} KernelScan;
+
+/**
+ * Read and verify the headers of every kernel partition at once.
+ *
+ * The GPT is read through VbExDiskRead() using the disk fields of [params].
+ * Then one thread per kernel partition reads that partition's headers through
+ * [read_fn] and checks them against [subkey], so checking a disk takes about
+ * as long as checking its slowest partition rather than all of them in turn.
+ * Choosing which kernel to boot is still up to LoadKernel(), which can get
+ * the headers back from KernelScanRead() instead of the disk.
+ *
+ * Returns 0 if success, non-zero if the GPT can't be read.  Call
+ * KernelScanFree() when done with [scan] either way.
+ */
+int KernelScanDisk(KernelScan *scan, const LoadKernelParams *params,
+		   const VbPublicKey *subkey, KernelScanReadFn read_fn,
+		   void *read_ctx);
+
+/**
+ * Copy sectors from the headers read by KernelScanDisk(), if they're there.
+ *
+ * Returns 0 if the sectors were copied to [buffer], non-zero if they weren't
+ * read by the scan and need to come from the disk.
+ */
+int KernelScanRead(const KernelScan *scan, uint64_t lba_start,
+		   uint64_t lba_count, void *buffer);
+
+/**
+ * Print what KernelScanDisk() found in each kernel partition.
+ */
+void KernelScanPrint(const KernelScan *scan);
+
+/**
+ * Free the headers read by KernelScanDisk().
+ */
+void KernelScanFree(KernelScan *scan);
+
+#endif  /* VBOOT_REFERENCE_HOST_KERNEL_SCAN_H_ */
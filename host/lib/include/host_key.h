@@ -39,6 +39,44 @@ int PrivateKeyWrite(const char* filename, const VbPrivateKey* key);
 VbPrivateKey* PrivateKeyRead(const char* filename);
 
 
+/* Get an RSA private key ready for signing: set up its blinding, and cache
+ * what OpenSSL would otherwise work out on the first signature.
+ *
+ * Returns 0 if success, non-zero if error. */
+int PrivateKeyPrepare(RSA* rsa);
+
+
+/* A store of private keys, each read from its file and prepared with
+ * PrivateKeyPrepare() only the first time it is asked for.  This suits
+ * long-running signers, which would otherwise parse a key for every
+ * signature.  A store may be used from several threads at once, and its
+ * keys may be signed with from several threads at once. */
+typedef struct PrivateKeyStore PrivateKeyStore;
+
+/* Create an empty key store.  Caller must free it with
+ * PrivateKeyStoreFree().
+ *
+ * Returns NULL if error. */
+PrivateKeyStore* PrivateKeyStoreNew(void);
+
+/* Free a key store and all the keys in it. */
+void PrivateKeyStoreFree(PrivateKeyStore* store);
+
+/* Get the private key from a .vbprivk file, reading it if the store doesn't
+ * have it yet.  The store owns the returned key, which stays valid until
+ * the store is freed.
+ *
+ * Returns NULL if error. */
+const VbPrivateKey* PrivateKeyStoreRead(PrivateKeyStore* store,
+                                        const char* filename);
+
+/* Like PrivateKeyStoreRead(), but for a .pem file to be used with
+ * [algorithm]. */
+const VbPrivateKey* PrivateKeyStoreReadPem(PrivateKeyStore* store,
+                                           const char* filename,
+                                           uint64_t algorithm);
+
+
 
 /* Allocate a new public key with space for a [key_size] byte key. */
 VbPublicKey* PublicKeyAlloc(uint64_t key_size, uint64_t algorithm,
@@ -54,6 +92,14 @@ VbPublicKey* PublicKeyRead(const char* filename);
 /* Return true if the public key struct appears correct. */
 int PublicKeyLooksOkay(VbPublicKey *key, uint64_t file_size);
 
+/* Read a public key from a .pem file holding an X.509 certificate, an RSA
+ * public key or an RSA private key, computing its .keyb form in-process.
+ * Caller owns the returned pointer, and must free it with Free().
+ *
+ * Returns NULL if error. */
+VbPublicKey* PublicKeyReadPem(const char* filename, uint64_t algorithm,
+                              uint64_t version);
+
 /* Read a public key from a .keyb file.  Caller owns the returned
  * pointer, and must free it with Free().
  *
@@ -0,0 +1,96 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Key bundles: many key files packed into one, with an index up front, for
+ * signing servers which would otherwise open and parse a file per key.
+ *
+ * A key in a bundle is named as BUNDLE:NAME, where NAME is what the key file
+ * was called when it was packed, or the hex SHA-1 of its contents.  Anything
+ * which reads a key file through ReadKeyFile() or OpenKeyFile() takes either.
+ */
+
+#ifndef VBOOT_REFERENCE_HOST_KEY_BUNDLE_H_
+#define VBOOT_REFERENCE_HOST_KEY_BUNDLE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define KEY_BUNDLE_MAGIC "VBKEYSET"
+#define KEY_BUNDLE_MAGIC_SIZE 8
+#define KEY_BUNDLE_VERSION 1
+
+/* Every key starts on this boundary, so the structs in it are aligned */
+#define KEY_BUNDLE_ALIGN 64
+
+#define KEY_BUNDLE_NAME_SIZE 64
+#define KEY_BUNDLE_ID_SIZE 20
+
+struct key_bundle_header {
+	uint8_t magic[KEY_BUNDLE_MAGIC_SIZE];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t entry_size;
+	uint32_t entry_count;
+	/* Index of entries, sorted by name */
+	uint32_t entries_offset;
+	uint32_t reserved0;
+} __attribute__((packed));
+
+struct key_bundle_entry {
+	/* Name, NUL-terminated */
+	char name[KEY_BUNDLE_NAME_SIZE];
+	/* SHA-1 of the key data */
+	uint8_t id[KEY_BUNDLE_ID_SIZE];
+	/* Where the key data is, from the start of the bundle */
+	uint32_t offset;
+	uint32_t size;
+	uint32_t reserved0;
+} __attribute__((packed));
+
+/**
+ * Check a key bundle and find its index.
+ *
+ * @param buf		Bundle contents
+ * @param size		Size of bundle in bytes
+ * @param count		Number of entries in the index, on success
+ * @return The index, or NULL if [buf] isn't a good bundle.
+ */
+const struct key_bundle_entry *KeyBundleEntries(const uint8_t *buf,
+						uint64_t size,
+						uint32_t *count);
+
+/**
+ * Find a key in a bundle.
+ *
+ * The bundle is mapped the first time one of its keys is asked for, and stays
+ * mapped, so the data returned is good until the program exits.
+ *
+ * @param filename	BUNDLE:NAME
+ * @param size		Size of the key data, on success
+ * @return The key data, or NULL if [filename] isn't a key in a bundle.
+ */
+const uint8_t *KeyBundleGet(const char *filename, uint64_t *size);
+
+/**
+ * Read a key file, which may be in a bundle.
+ *
+ * A file called [filename] is read if there is one, so a ':' in the name of a
+ * plain key file doesn't make it look like a bundle.
+ *
+ * @param filename	Key file, or BUNDLE:NAME
+ * @param size		Size of the returned data
+ * @return The data, which the caller must free(), or NULL if error.
+ */
+uint8_t *ReadKeyFile(const char *filename, uint64_t *size);
+
+/**
+ * Open a key file for reading as a stream, such as a PEM file, which may be
+ * in a bundle.
+ *
+ * @param filename	Key file, or BUNDLE:NAME
+ * @return The stream, which the caller must fclose(), or NULL if error.
+ */
+FILE *OpenKeyFile(const char *filename);
+
+#endif  /* VBOOT_REFERENCE_HOST_KEY_BUNDLE_H_ */
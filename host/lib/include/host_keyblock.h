@@ -32,6 +32,22 @@ VbKeyBlockHeader* KeyBlockCreate(const VbPublicKey* data_key,
                                  uint64_t flags);
 
 
+/* Size of the key block KeyBlockCreate() makes from [data_key] and
+ * [signing_key], which may be NULL. */
+uint64_t KeyBlockSize(const VbPublicKey* data_key,
+                      const VbPrivateKey* signing_key);
+
+
+/* Like KeyBlockCreate(), but builds the key block in the [buf_size] bytes
+ * at [h], which must be at least KeyBlockSize().  No memory is allocated.
+ *
+ * Returns 0 if success, non-zero if error. */
+int KeyBlockCreateInto(VbKeyBlockHeader* h, uint64_t buf_size,
+                       const VbPublicKey* data_key,
+                       const VbPrivateKey* signing_key,
+                       uint64_t flags);
+
+
 /* Read a key block from a .keyblock file.  Caller owns the returned
  * pointer, and must free it with Free().
  *
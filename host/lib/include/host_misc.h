@@ -8,6 +8,8 @@
 #ifndef VBOOT_REFERENCE_HOST_MISC_H_
 #define VBOOT_REFERENCE_HOST_MISC_H_
 
+#include <sys/types.h>
+
 #include "utility.h"
 #include "vboot_struct.h"
 
@@ -43,6 +45,28 @@ int ReadFileBit(const char* filename, int bitmask);
  * Returns 0 if success, 1 if error. */
 int WriteFile(const char* filename, const void *data, uint64_t size);
 
+/* Copy up to [len] bytes from [in_fd] at [in_off] (or from its current
+ * position, if [in_off] is negative) to [out_fd] at [out_off].  Where it can,
+ * the kernel copies the data without it passing through this process, or
+ * just shares the blocks.  Returns the number of bytes copied, which is less
+ * than [len] only at the end of the input, or -1 with errno set on error. */
+ssize_t CopyFileRange(int in_fd, off_t in_off, int out_fd, off_t out_off,
+                      size_t len);
+
+/* Returns true if [buf] starts like a compact VbSharedData encoding, as made
+ * by VbSharedDataEncode(). */
+int VbSharedDataIsCompact(const uint8_t* buf, uint64_t size);
+
+/* Decodes the compact VbSharedData encoding of [size] bytes at [buf] into a
+ * whole VbSharedDataHeader, followed by the kernel subkey data if there is
+ * one.  Fields which weren't encoded are zero.  Sets [out_size] to the size
+ * of the result.
+ *
+ * Returns the result, which must be freed by the caller using free(), or NULL
+ * if error. */
+VbSharedDataHeader* VbSharedDataExpand(const uint8_t* buf, uint64_t size,
+                                       uint64_t* out_size);
+
 /**
  * Read data from a file into a newly allocated buffer.
  *
@@ -55,6 +79,54 @@ int WriteFile(const char* filename, const void *data, uint64_t size);
  */
 int vb2_read_file(const char *filename, uint8_t **data_ptr, uint32_t *size_ptr);
 
+/* How vb2_map_file() maps a file */
+enum vb2_map_mode {
+	/* Read-only */
+	VB2_MAP_RO,
+	/* Writable, but changes are private and never reach the file */
+	VB2_MAP_COW,
+	/* Writable, and changes are written back to the file */
+	VB2_MAP_RW,
+};
+
+/**
+ * Map a whole file into memory instead of reading it.
+ *
+ * Nothing is copied until it's used, and the pages are shared with the page
+ * cache, so this is much cheaper than vb2_read_file() for big images.  The
+ * file only needs to be open while it's being mapped.
+ *
+ * @param filename	Name of file to map
+ * @param mode		How to map it
+ * @param data_ptr	On exit, pointer to the data will be stored here.
+ *			Caller must vb2_unmap_file() it when done with it.
+ * @param size_ptr	On exit, size of data will be stored here.
+ * @return VB2_SUCCESS, or non-zero if error.
+ */
+int vb2_map_file(const char *filename, enum vb2_map_mode mode,
+		 uint8_t **data_ptr, uint32_t *size_ptr);
+
+/**
+ * Map the whole of an open file, or a block device, into memory.
+ *
+ * Like vb2_map_file(), but the caller supplies the file descriptor, which
+ * must have been opened for writing if [mode] is VB2_MAP_RW.
+ */
+int vb2_map_fd(int fd, enum vb2_map_mode mode,
+	       uint8_t **data_ptr, uint32_t *size_ptr);
+
+/**
+ * Release data from vb2_map_file() or vb2_map_fd().
+ *
+ * With VB2_MAP_RW, this waits for changes to be written to the file.
+ *
+ * @param data		Data to release
+ * @param size		Its size, as returned by the map call
+ * @param mode		How it was mapped
+ * @return VB2_SUCCESS, or non-zero if error.
+ */
+int vb2_unmap_file(uint8_t *data, uint32_t size, enum vb2_map_mode mode);
+
 /**
  * Write data to a file from a buffer.
  *
@@ -36,6 +36,13 @@ int SignatureCopy(VbSignature* dest, const VbSignature* src);
 VbSignature* CalculateChecksum(const uint8_t* data, uint64_t size);
 
 
+/* Calculates a SHA-256 digest, as used for the EC-RW image hash.
+ * Caller owns the returned pointer, and must free it with Free().
+ *
+ * Returns NULL on error. */
+VbSignature* CalculateSha256(const uint8_t* data, uint64_t size);
+
+
 /* Calculates a hash of the data using the algorithm from the specified key.
  * Caller owns the returned pointer, and must free it with Free().
  *
@@ -50,8 +57,86 @@ VbSignature* CalculateHash(const uint8_t* data, uint64_t size,
 VbSignature* CalculateSignature(const uint8_t* data, uint64_t size,
                                 const VbPrivateKey* key);
 
+/* Like CalculateSignature(), but signs into [sig], which must already be
+ * set up with SignatureInit() to hold a signature of the key's size.  No
+ * memory is allocated.
+ *
+ * Returns 0 if success, non-zero if error. */
+int CalculateSignatureInto(VbSignature* sig, const uint8_t* data,
+                           uint64_t size, const VbPrivateKey* key);
+
+/* Calculates a signature for [data_size] bytes of data whose digest,
+ * using the hash algorithm of the specified key, is [digest].
+ * Caller owns the returned pointer, and must free it with Free().
+ *
+ * Returns NULL on error. */
+VbSignature* CalculateSignatureFromDigest(const uint8_t* digest,
+                                          uint64_t data_size,
+                                          const VbPrivateKey* key);
+
+/* Like CalculateSignatureFromDigest(), but signs into [sig] the way
+ * CalculateSignatureInto() does.
+ *
+ * Returns 0 if success, non-zero if error. */
+int SignatureFromDigestInto(VbSignature* sig, const uint8_t* digest,
+                            uint64_t data_size, const VbPrivateKey* key);
+
+/* Recovers the digest signed by [sig], checking that it is a signature made
+ * with the private half of [key].  [digest] must have room for a digest of
+ * the key's hash algorithm.  The signed data itself is not needed.
+ *
+ * Returns 0 if success, non-zero if error. */
+int SignatureRecoverDigest(const VbSignature* sig, const RSAPublicKey* key,
+                           uint8_t* digest);
+
+/* Context for calculating a signature over data passed in pieces, so the
+ * data never needs to be assembled in one buffer. */
+typedef struct SignContext {
+  DigestContext digest;
+  const VbPrivateKey* key;  /* Must outlive the context */
+  uint64_t data_size;       /* Bytes passed to SignContextUpdate() so far */
+} SignContext;
+
+/* Starts a signature using the specified key. */
+void SignContextInit(SignContext* ctx, const VbPrivateKey* key);
+
+/* Adds the next [size] bytes of data to the signature. */
+void SignContextUpdate(SignContext* ctx, const uint8_t* data, uint64_t size);
+
+/* Signs all the data passed to SignContextUpdate(); the result is the same
+ * as CalculateSignature() on all of it at once.
+ * Caller owns the returned pointer, and must free it with Free().
+ *
+ * Returns NULL on error. */
+VbSignature* SignContextFinal(SignContext* ctx);
+
+/* Like SignContextFinal(), but signs into [sig] the way
+ * CalculateSignatureInto() does.
+ *
+ * Returns 0 if success, non-zero if error. */
+int SignContextFinalInto(SignContext* ctx, VbSignature* sig);
+
 /* Calculates a signature for the data using the specified key and
  * an external program.
+ *
+ * Normally [external_signer] is run once per signature, with [key_file] as
+ * its argument, the padded digest on its stdin, and the signature read back
+ * from its stdout.
+ *
+ * If [external_signer] is a unix socket instead, a signing daemon listening
+ * there is asked for the signature, and the connection is kept for the next
+ * one.  [key_file] is then just a handle naming the key to the daemon.  All
+ * integers are 32-bit big-endian.  Each request is
+ *
+ *   magic 0x56425331 ("VBS1"), id, key handle length, data length,
+ *   key handle, data
+ *
+ * and the daemon answers each request, in order, with
+ *
+ *   magic 0x56425352 ("VBSR"), id, status, signature length, signature
+ *
+ * where status is 0 on success.  A failure carries no signature.
+ *
  * Caller owns the returned pointer, and must free it with Free().
  *
  * Returns NULL on error. */
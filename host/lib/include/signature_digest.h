@@ -8,11 +8,25 @@
 
 #include <stdint.h>
 
+/* Big enough for DigestInfo || Digest with any algorithm; the longest
+ * DigestInfo is 19 bytes, and the longest digest is SHA-512's 64.
+ */
+#define MAX_SIGNATURE_DIGEST_SIZE (19 + 64)
+
 /* Returns a buffer with DigestInfo (which depends on [algorithm])
  * prepended to [digest].
  */
 uint8_t* PrependDigestInfo(unsigned int algorithm, uint8_t* digest);
 
+/* Version of PrependDigestInfo() which stores the result in [out], of
+ * [size] bytes, instead of allocating it.
+ *
+ * Returns 0 on success, non-zero if [algorithm] is invalid or [size] is too
+ * small.
+ */
+int PrependDigestInfoInto(unsigned int algorithm, const uint8_t* digest,
+                          uint8_t* out, uint32_t size);
+
 /* Function that outputs the message digest of the contents of a buffer in a
  * format that can be used as input to OpenSSL for an RSA signature.
  * Needed until the stable OpenSSL release supports SHA-256/512 digests for
@@ -25,6 +39,15 @@ uint8_t* PrependDigestInfo(unsigned int algorithm, uint8_t* digest);
 uint8_t* SignatureDigest(const uint8_t* buf, uint64_t len,
                          unsigned int algorithm);
 
+/* Version of SignatureDigest() which stores the result in [out], of [size]
+ * bytes, instead of allocating it; MAX_SIGNATURE_DIGEST_SIZE is always
+ * enough.
+ *
+ * Returns 0 on success, non-zero on error.
+ */
+int SignatureDigestInto(const uint8_t* buf, uint64_t len,
+                        unsigned int algorithm, uint8_t* out, uint32_t size);
+
 /* Calculates the signature on a buffer [buf] of length [len] using
  * the private RSA key file from [key_file] and signature algorithm
  * [algorithm].
@@ -27,13 +27,15 @@ void PrintPubKeySha1Sum(VbPublicKey* key);
  *   };
  *
  * This function allocates and extracts that binary structure directly
- * from the RSA private key, rather than from a file.
+ * from the RSA key, rather than from a file. Only the public half of the key
+ * is needed, and no subprocess or per-word BIGNUM arithmetic is involved.
  *
- * @param rsa_private_key     RSA private key (duh)
+ * @param rsa_private_key     RSA key (duh)
  * @param keyb_data	      Pointer to newly allocated binary blob
  * @param keyb_size	      Size of newly allocated binary blob
  *
- * @return 0 on success, non-zero if unable to allocate enough memory.
+ * @return 0 on success, non-zero if the key isn't a whole number of 32-bit
+ *         words or there isn't enough memory.
  */
 int vb_keyb_from_rsa(struct rsa_st *rsa_private_key,
 		     uint8_t **keyb_data, uint32_t *keyb_size);
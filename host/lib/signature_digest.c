@@ -14,27 +14,55 @@
 #include "signature_digest.h"
 
 
+int PrependDigestInfoInto(unsigned int algorithm, const uint8_t* digest,
+                          uint8_t* out, uint32_t size) {
+  int digest_size;
+  int digestinfo_size;
+
+  if (algorithm >= kNumAlgorithms)
+    return 1;
+  digest_size = hash_size_map[algorithm];
+  digestinfo_size = digestinfo_size_map[algorithm];
+  if (size < (uint32_t)(digestinfo_size + digest_size))
+    return 1;
+
+  Memcpy(out, hash_digestinfo_map[algorithm], digestinfo_size);
+  Memcpy(out + digestinfo_size, digest, digest_size);
+  return 0;
+}
+
 uint8_t* PrependDigestInfo(unsigned int algorithm, uint8_t* digest) {
-  const int digest_size = hash_size_map[algorithm];
-  const int digestinfo_size = digestinfo_size_map[algorithm];
-  const uint8_t* digestinfo = hash_digestinfo_map[algorithm];
-  uint8_t* p = malloc(digestinfo_size + digest_size);
-  Memcpy(p, digestinfo, digestinfo_size);
-  Memcpy(p + digestinfo_size, digest, digest_size);
+  const int size = hash_size_map[algorithm] + digestinfo_size_map[algorithm];
+  uint8_t* p = malloc(size);
+  if (p && PrependDigestInfoInto(algorithm, digest, p, size)) {
+    free(p);
+    return NULL;
+  }
   return p;
 }
 
-uint8_t* SignatureDigest(const uint8_t* buf, uint64_t len,
-                         unsigned int algorithm) {
-  uint8_t* info_digest  = NULL;
-  uint8_t* digest = NULL;
+int SignatureDigestInto(const uint8_t* buf, uint64_t len,
+                        unsigned int algorithm, uint8_t* out, uint32_t size) {
+  uint8_t digest[MAX_DIGEST_SIZE];
 
   if (algorithm >= kNumAlgorithms) {
     VBDEBUG(("SignatureDigest() called with invalid algorithm!\n"));
-  } else if ((digest = DigestBuf(buf, len, algorithm))) {
-    info_digest = PrependDigestInfo(algorithm, digest);
+    return 1;
+  }
+  if (DigestBufInto(buf, len, algorithm, digest, sizeof(digest)))
+    return 1;
+  return PrependDigestInfoInto(algorithm, digest, out, size);
+}
+
+uint8_t* SignatureDigest(const uint8_t* buf, uint64_t len,
+                         unsigned int algorithm) {
+  uint8_t* info_digest = malloc(MAX_SIGNATURE_DIGEST_SIZE);
+
+  if (info_digest && SignatureDigestInto(buf, len, algorithm, info_digest,
+                                         MAX_SIGNATURE_DIGEST_SIZE)) {
+    free(info_digest);
+    return NULL;
   }
-  free(digest);
   return info_digest;
 }
 
@@ -43,13 +71,17 @@ uint8_t* SignatureBuf(const uint8_t* buf, uint64_t len, const char* key_file,
   FILE* key_fp = NULL;
   RSA* key = NULL;
   uint8_t* signature = NULL;
-  uint8_t* signature_digest = SignatureDigest(buf, len, algorithm);
-  int signature_digest_len = (hash_size_map[algorithm] +
-                              digestinfo_size_map[algorithm]);
+  uint8_t signature_digest[MAX_SIGNATURE_DIGEST_SIZE];
+  int signature_digest_len;
+
+  if (SignatureDigestInto(buf, len, algorithm, signature_digest,
+                          sizeof(signature_digest)))
+    return NULL;
+  signature_digest_len = (hash_size_map[algorithm] +
+                          digestinfo_size_map[algorithm]);
   key_fp  = fopen(key_file, "r");
   if (!key_fp) {
     VBDEBUG(("SignatureBuf(): Couldn't open key file: %s\n", key_file));
-    free(signature_digest);
     return NULL;
   }
   if ((key = PEM_read_RSAPrivateKey(key_fp, NULL, NULL, NULL)))
@@ -68,6 +100,5 @@ uint8_t* SignatureBuf(const uint8_t* buf, uint64_t len, const char* key_file,
   fclose(key_fp);
   if (key)
     RSA_free(key);
-  free(signature_digest);
   return signature;
 }
@@ -22,122 +22,118 @@ void PrintPubKeySha1Sum(VbPublicKey *key)
 {
 	uint8_t *buf = ((uint8_t *)key) + key->key_offset;
 	uint64_t buflen = key->key_size;
-	uint8_t *digest = DigestBuf(buf, buflen, SHA1_DIGEST_ALGORITHM);
+	uint8_t digest[SHA1_DIGEST_SIZE];
 	int i;
+
+	if (DigestBufInto(buf, buflen, SHA1_DIGEST_ALGORITHM, digest,
+			  sizeof(digest)))
+		return;
 	for (i = 0; i < SHA1_DIGEST_SIZE; i++)
 		printf("%02x", digest[i]);
-	free(digest);
 }
 
-int vb_keyb_from_rsa(struct rsa_st *rsa_private_key,
-		     uint8_t **keyb_data, uint32_t *keyb_size)
+/* Return -1 / n0 mod 2^32, for odd n0. */
+static uint32_t compute_n0inv(uint32_t n0)
 {
-	uint32_t i, nwords;
-	BIGNUM *N = NULL;
-	BIGNUM *Big1 = NULL, *Big2 = NULL, *Big32 = NULL, *BigMinus1 = NULL;
-	BIGNUM *B = NULL;
-	BIGNUM *N0inv = NULL, *R = NULL, *RR = NULL;
-	BIGNUM *RRTemp = NULL, *NnumBits = NULL;
-	BIGNUM *n = NULL, *rr = NULL;
-	BN_CTX *bn_ctx = BN_CTX_new();
-	uint32_t n0invout;
-	uint32_t bufsize;
-	uint32_t *outbuf;
-	int retval = 1;
+	/* n0 is its own inverse mod 8; each Newton step doubles the bits */
+	uint32_t inv = n0;
+	int i;
 
-	/* Size of RSA key in 32-bit words */
-	nwords = BN_num_bits(rsa_private_key->n) / 32;
+	for (i = 0; i < 4; i++)
+		inv *= 2 - n0 * inv;
+	return -inv;
+}
 
-	bufsize = (2 + nwords + nwords) * sizeof(uint32_t);
-	outbuf = malloc(bufsize);
-	if (!outbuf)
-		goto done;
+/* Return non-zero if the nwords-long a >= b. */
+static int words_ge(const uint32_t *a, const uint32_t *b, uint32_t nwords)
+{
+	while (nwords--) {
+		if (a[nwords] != b[nwords])
+			return a[nwords] > b[nwords];
+	}
+	return 1;
+}
 
-	*keyb_data = (uint8_t *)outbuf;
-	*keyb_size = bufsize;
+/*
+ * Compute rr = R^2 mod n, where R = 2^(32 * nwords) and n's top bit is set.
+ * R mod n is just R - n; doubling that mod n another 32 * nwords times gives
+ * R^2 mod n, using nothing but shifts and subtractions.
+ */
+static void compute_rr(const uint32_t *n, uint32_t *rr, uint32_t nwords)
+{
+	uint32_t i, k;
+	uint64_t acc;
+
+	/* rr = R - n = ~n + 1 */
+	for (i = 0, acc = 1; i < nwords; i++, acc >>= 32) {
+		acc += (uint32_t)~n[i];
+		rr[i] = (uint32_t)acc;
+	}
 
-	*outbuf++ = nwords;
-
-	/* Initialize BIGNUMs */
-#define NEW_BIGNUM(x) do { x = BN_new(); if (!x) goto done; } while (0)
-	NEW_BIGNUM(N);
-	NEW_BIGNUM(Big1);
-	NEW_BIGNUM(Big2);
-	NEW_BIGNUM(Big32);
-	NEW_BIGNUM(BigMinus1);
-	NEW_BIGNUM(N0inv);
-	NEW_BIGNUM(R);
-	NEW_BIGNUM(RR);
-	NEW_BIGNUM(RRTemp);
-	NEW_BIGNUM(NnumBits);
-	NEW_BIGNUM(n);
-	NEW_BIGNUM(rr);
-	NEW_BIGNUM(B);
-#undef NEW_BIGNUM
-
-	BN_copy(N, rsa_private_key->n);
-	BN_set_word(Big1, 1L);
-	BN_set_word(Big2, 2L);
-	BN_set_word(Big32, 32L);
-	BN_sub(BigMinus1, Big1, Big2);
-
-	BN_exp(B, Big2, Big32, bn_ctx); /* B = 2^32 */
-
-	/* Calculate and output N0inv = -1 / N[0] mod 2^32 */
-	BN_mod_inverse(N0inv, N, B, bn_ctx);
-	BN_sub(N0inv, B, N0inv);
-	n0invout = BN_get_word(N0inv);
-
-	*outbuf++ = n0invout;
-
-	/* Calculate R = 2^(# of key bits) */
-	BN_set_word(NnumBits, BN_num_bits(N));
-	BN_exp(R, Big2, NnumBits, bn_ctx);
-
-	/* Calculate RR = R^2 mod N */
-	BN_copy(RR, R);
-	BN_mul(RRTemp, RR, R, bn_ctx);
-	BN_mod(RR, RRTemp, N, bn_ctx);
+	for (k = 0; k < 32 * nwords; k++) {
+		uint32_t carry = 0;
 
+		for (i = 0; i < nwords; i++) {
+			uint32_t w = rr[i];
 
-	/* Write out modulus as little endian array of integers. */
-	for (i = 0; i < nwords; ++i) {
-		uint32_t nout;
+			rr[i] = (w << 1) | carry;
+			carry = w >> 31;
+		}
+		if (carry || words_ge(rr, n, nwords)) {
+			uint64_t borrow = 0;
 
-		BN_mod(n, N, B, bn_ctx); /* n = N mod B */
-		nout = BN_get_word(n);
-		*outbuf++ = nout;
+			for (i = 0; i < nwords; i++) {
+				uint64_t d = (uint64_t)rr[i] - n[i] - borrow;
 
-		BN_rshift(N, N, 32); /*  N = N/B */
+				rr[i] = (uint32_t)d;
+				borrow = (d >> 32) & 1;
+			}
+		}
 	}
+}
 
-	/* Write R^2 as little endian array of integers. */
-	for (i = 0; i < nwords; ++i) {
-		uint32_t rrout;
+int vb_keyb_from_rsa(struct rsa_st *rsa_private_key,
+		     uint8_t **keyb_data, uint32_t *keyb_size)
+{
+	const BIGNUM *N = rsa_private_key->n;
+	uint32_t nwords = BN_num_bits(N) / 32;
+	uint32_t bufsize;
+	uint32_t *outbuf, *n, *rr;
+	uint8_t *be;
+	uint32_t i;
 
-		BN_mod(rr, RR, B, bn_ctx); /* rr = RR mod B */
-		rrout = BN_get_word(rr);
-		*outbuf++ = rrout;
+	/* Size of RSA key in 32-bit words; the key has to fill them */
+	if (!nwords || BN_num_bits(N) % 32 || !BN_is_odd(N))
+		return 1;
 
-		BN_rshift(RR, RR, 32); /* RR = RR/B */
+	bufsize = (2 + nwords + nwords) * sizeof(uint32_t);
+	outbuf = malloc(bufsize);
+	be = malloc(nwords * sizeof(uint32_t));
+	if (!outbuf || !be) {
+		free(outbuf);
+		free(be);
+		return 1;
 	}
 
-	outbuf = NULL;
-	retval = 0;
-
-done:
-	free(outbuf);
-	/* Free BIGNUMs. */
-	BN_free(Big1);
-	BN_free(Big2);
-	BN_free(Big32);
-	BN_free(BigMinus1);
-	BN_free(N0inv);
-	BN_free(R);
-	BN_free(RRTemp);
-	BN_free(NnumBits);
-	BN_free(n);
-	BN_free(rr);
-
-	return retval;
+	/* Write out modulus as little endian array of integers. */
+	n = outbuf + 2;
+	BN_bn2bin(N, be);
+	for (i = 0; i < nwords; i++) {
+		const uint8_t *p = be + (nwords - 1 - i) * sizeof(uint32_t);
+
+		n[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+			(uint32_t)p[2] << 8 | p[3];
+	}
+	free(be);
+
+	outbuf[0] = nwords;
+	outbuf[1] = compute_n0inv(n[0]);
+
+	/* Write R^2 as little endian array of integers. */
+	rr = n + nwords;
+	compute_rr(n, rr, nwords);
+
+	*keyb_data = (uint8_t *)outbuf;
+	*keyb_size = bufsize;
+	return 0;
 }
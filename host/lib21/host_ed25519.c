@@ -0,0 +1,71 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Host functions for Ed25519 (RFC 8032) signing.  The OpenSSL versions this
+ * library builds against don't have Ed25519, so this uses the firmware's
+ * curve arithmetic instead.
+ */
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2ed25519.h"
+#include "2ed25519_private.h"
+#include "2sha.h"
+#include "vb2_common.h"
+#include "host_key2.h"
+
+/* Hash the seed and clamp the low half into the secret scalar */
+static void ed25519_expand(uint8_t *expanded, const uint8_t *seed)
+{
+	struct vb2_sha512_context ctx;
+
+	vb2_sha512_init(&ctx);
+	vb2_sha512_update(&ctx, seed, 32);
+	vb2_sha512_finalize(&ctx, expanded);
+	expanded[0] &= 248;
+	expanded[31] &= 127;
+	expanded[31] |= 64;
+}
+
+void vb2_ed25519_keypair(uint8_t *key)
+{
+	uint8_t expanded[VB2_SHA512_DIGEST_SIZE];
+
+	ed25519_expand(expanded, key);
+	vb2_ed25519_scalarmult_base(key + 32, expanded);
+	memset(expanded, 0, sizeof(expanded));
+}
+
+void vb2_ed25519_sign(uint8_t *sig, const uint8_t *key,
+		      const uint8_t *msg, uint32_t size)
+{
+	struct vb2_sha512_context ctx;
+	uint8_t expanded[VB2_SHA512_DIGEST_SIZE];
+	uint8_t r[VB2_SHA512_DIGEST_SIZE];
+	uint8_t h[VB2_SHA512_DIGEST_SIZE];
+
+	ed25519_expand(expanded, key);
+
+	/* r = SHA-512(prefix || M) mod L, and R = [r]B */
+	vb2_sha512_init(&ctx);
+	vb2_sha512_update(&ctx, expanded + 32, 32);
+	vb2_sha512_update(&ctx, msg, size);
+	vb2_sha512_finalize(&ctx, r);
+	vb2_ed25519_reduce(r, r);
+	vb2_ed25519_scalarmult_base(sig, r);
+
+	/* h = SHA-512(R || A || M) mod L */
+	vb2_sha512_init(&ctx);
+	vb2_sha512_update(&ctx, sig, 32);
+	vb2_sha512_update(&ctx, key + 32, VB2_ED25519_PUBLIC_KEY_SIZE);
+	vb2_sha512_update(&ctx, msg, size);
+	vb2_sha512_finalize(&ctx, h);
+	vb2_ed25519_reduce(h, h);
+
+	/* S = (r + h * a) mod L */
+	vb2_ed25519_muladd(sig + 32, h, expanded, r);
+
+	memset(expanded, 0, sizeof(expanded));
+	memset(r, 0, sizeof(r));
+}
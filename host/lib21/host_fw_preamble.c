@@ -80,3 +80,61 @@ int vb2_fw_preamble_create(struct vb2_fw_preamble **fp_ptr,
 	*fp_ptr = (struct vb2_fw_preamble *)buf;
 	return VB2_SUCCESS;
 }
+
+int vb2_fw_preamble_hash_blocks(struct vb2_signature ***hash_list_ptr,
+				uint32_t *hash_count_ptr,
+				const uint8_t *data,
+				uint32_t size,
+				uint32_t block_size,
+				enum vb2_hash_algorithm hash_alg,
+				const struct vb2_guid *guid)
+{
+	const struct vb2_private_key *hash_key;
+	struct vb2_signature **hash_list;
+	uint32_t hash_count, i;
+
+	*hash_list_ptr = NULL;
+	*hash_count_ptr = 0;
+
+	if (!block_size || !size)
+		return VB2_FW_PREAMBLE_HASH_BLOCKS_SIZE;
+
+	if (vb2_private_key_hash(&hash_key, hash_alg))
+		return VB2_FW_PREAMBLE_HASH_BLOCKS_HASH;
+
+	hash_count = (size - 1) / block_size + 1;
+	hash_list = calloc(hash_count, sizeof(*hash_list));
+	if (!hash_list)
+		return VB2_FW_PREAMBLE_HASH_BLOCKS_ALLOC;
+
+	for (i = 0; i < hash_count; i++) {
+		uint32_t offset = i * block_size;
+		uint32_t len = size - offset < block_size ?
+			size - offset : block_size;
+
+		/* No description, since there may be a lot of these */
+		if (vb2_sign_data(hash_list + i, data + offset, len,
+				  hash_key, "")) {
+			vb2_fw_preamble_free_hash_blocks(hash_list, i);
+			return VB2_FW_PREAMBLE_HASH_BLOCKS_HASH;
+		}
+		memcpy(&hash_list[i]->guid, guid, sizeof(*guid));
+	}
+
+	*hash_list_ptr = hash_list;
+	*hash_count_ptr = hash_count;
+	return VB2_SUCCESS;
+}
+
+void vb2_fw_preamble_free_hash_blocks(struct vb2_signature **hash_list,
+				      uint32_t hash_count)
+{
+	uint32_t i;
+
+	if (!hash_list)
+		return;
+
+	for (i = 0; i < hash_count; i++)
+		free(hash_list[i]);
+	free(hash_list);
+}
@@ -5,12 +5,15 @@
  * Host functions for keys.
  */
 
+#include <pthread.h>
 #include <stdio.h>
 
 #include <openssl/pem.h>
+#include <openssl/rsa.h>
 
 #include "2sysincludes.h"
 #include "2common.h"
+#include "2ed25519.h"
 #include "2rsa.h"
 #include "2sha.h"
 #include "vb2_common.h"
@@ -18,6 +21,9 @@
 #include "host_key2.h"
 #include "host_misc.h"
 
+/* Size of an Ed25519 seed, which is all that's kept of a private key */
+#define ED25519_SEED_SIZE 32
+
 struct vb2_text_vs_enum vb2_text_vs_algorithm[] = {
 	{"RSA1024 SHA1",   VB2_ALG_RSA1024_SHA1},
 	{"RSA1024 SHA256", VB2_ALG_RSA1024_SHA256},
@@ -39,6 +45,7 @@ struct vb2_text_vs_enum vb2_text_vs_sig[] = {
 	{"RSA2048", VB2_SIG_RSA2048},
 	{"RSA4096", VB2_SIG_RSA4096},
 	{"RSA8192", VB2_SIG_RSA8192},
+	{"ED25519", VB2_SIG_ED25519},
 	{0, 0}
 };
 
@@ -46,6 +53,7 @@ struct vb2_text_vs_enum vb2_text_vs_hash[] = {
 	{"SHA1",   VB2_HASH_SHA1},
 	{"SHA256", VB2_HASH_SHA256},
 	{"SHA512", VB2_HASH_SHA512},
+	{"BLAKE2S", VB2_HASH_BLAKE2S},
 	{0, 0}
 };
 
@@ -80,6 +88,7 @@ void vb2_private_key_free(struct vb2_private_key *key)
 	if (key->desc)
 		free(key->desc);
 
+	memset(key->ed25519_key, 0, sizeof(key->ed25519_key));
 	free(key);
 }
 
@@ -136,6 +145,15 @@ int vb2_private_key_unpack(struct vb2_private_key **key_ptr,
 			free(key);
 			return VB2_ERROR_UNPACK_PRIVATE_KEY_HASH;
 		}
+	} else if (pkey->sig_alg == VB2_SIG_ED25519) {
+		/* Only the seed is stored; the public half is recomputed */
+		if (pkey->key_size != ED25519_SEED_SIZE) {
+			free(key);
+			return VB2_ERROR_UNPACK_PRIVATE_KEY_ED25519;
+		}
+		memcpy(key->ed25519_key, buf + pkey->key_offset,
+		       ED25519_SEED_SIZE);
+		vb2_ed25519_keypair(key->ed25519_key);
 	} else {
 		start = (const unsigned char *)(buf + pkey->key_offset);
 		key->rsa_private_key = d2i_RSAPrivateKey(0, &start,
@@ -179,6 +197,40 @@ int vb2_private_key_read(struct vb2_private_key **key_ptr,
 	return rv;
 }
 
+/*
+ * Read the seed of an Ed25519 key from a PKCS#8 "PRIVATE KEY" .pem file, as
+ * written by "openssl genpkey -algorithm ed25519".  Returns 1 if success.
+ */
+static int read_pem_ed25519(FILE *f, uint8_t *seed)
+{
+	/* DER for the key's algorithm and the start of its OCTET STRING */
+	static const uint8_t prefix[] = {
+		0x30, 0x2e, 0x02, 0x01, 0x00, 0x30, 0x05, 0x06,
+		0x03, 0x2b, 0x65, 0x70, 0x04, 0x22, 0x04, 0x20,
+	};
+	char *name = NULL, *header = NULL;
+	unsigned char *data = NULL;
+	long len = 0;
+	int ok = 0;
+
+	if (!PEM_read(f, &name, &header, &data, &len))
+		return 0;
+
+	if (!strcmp(name, "PRIVATE KEY") &&
+	    len == sizeof(prefix) + ED25519_SEED_SIZE &&
+	    !memcmp(data, prefix, sizeof(prefix))) {
+		memcpy(seed, data + sizeof(prefix), ED25519_SEED_SIZE);
+		ok = 1;
+	}
+
+	if (data)
+		OPENSSL_cleanse(data, len);
+	OPENSSL_free(name);
+	OPENSSL_free(header);
+	OPENSSL_free(data);
+	return ok;
+}
+
 int vb2_private_key_read_pem(struct vb2_private_key **key_ptr,
 			     const char *filename)
 {
@@ -200,17 +252,176 @@ int vb2_private_key_read_pem(struct vb2_private_key **key_ptr,
 	}
 
 	key->rsa_private_key = PEM_read_RSAPrivateKey(f, NULL, NULL, NULL);
-	fclose(f);
-
 	if (!key->rsa_private_key) {
-		free(key);
-		return VB2_ERROR_READ_PEM_RSA;
+		rewind(f);
+		if (!read_pem_ed25519(f, key->ed25519_key)) {
+			fclose(f);
+			free(key);
+			return VB2_ERROR_READ_PEM_RSA;
+		}
+		vb2_ed25519_keypair(key->ed25519_key);
+		key->sig_alg = VB2_SIG_ED25519;
 	}
+	fclose(f);
 
 	*key_ptr = key;
 	return VB2_SUCCESS;
 }
 
+/*
+ * Get an RSA key ready for signing from several threads: set up blinding, and
+ * make a throwaway signature so OpenSSL caches the Montgomery forms of the CRT
+ * primes before anyone waits on them.  Returns 0 if success.
+ */
+static int vb2_rsa_prepare(struct rsa_st *rsa)
+{
+	uint8_t in = 0;
+	uint8_t *out;
+	int rv;
+
+	if (!RSA_blinding_on(rsa, NULL))
+		return 1;
+
+	out = malloc(RSA_size(rsa));
+	if (!out)
+		return 1;
+	rv = RSA_private_encrypt(1, &in, out, rsa, RSA_PKCS1_PADDING);
+	free(out);
+	return rv == -1;
+}
+
+/* A key in a vb2_private_key_store, read from filename */
+struct vb2_private_key_store_entry {
+	struct vb2_private_key_store_entry *next;
+	char *filename;
+	int pem;
+	enum vb2_hash_algorithm pem_hash_alg;
+	struct vb2_private_key *key;
+};
+
+struct vb2_private_key_store {
+	pthread_mutex_t lock;
+	struct vb2_private_key_store_entry *entries;
+};
+
+int vb2_private_key_store_create(struct vb2_private_key_store **store_ptr)
+{
+	struct vb2_private_key_store *store;
+
+	*store_ptr = NULL;
+
+	store = calloc(1, sizeof(*store));
+	if (!store)
+		return VB2_ERROR_PRIVATE_KEY_STORE_ALLOC;
+
+	if (pthread_mutex_init(&store->lock, NULL)) {
+		free(store);
+		return VB2_ERROR_PRIVATE_KEY_STORE_ALLOC;
+	}
+
+	*store_ptr = store;
+	return VB2_SUCCESS;
+}
+
+void vb2_private_key_store_free(struct vb2_private_key_store *store)
+{
+	struct vb2_private_key_store_entry *entry;
+
+	if (!store)
+		return;
+
+	while ((entry = store->entries)) {
+		store->entries = entry->next;
+		vb2_private_key_free(entry->key);
+		free(entry->filename);
+		free(entry);
+	}
+
+	pthread_mutex_destroy(&store->lock);
+	free(store);
+}
+
+static int vb2_private_key_store_get(struct vb2_private_key_store *store,
+				     const struct vb2_private_key **key_ptr,
+				     const char *filename,
+				     int pem,
+				     enum vb2_hash_algorithm hash_alg)
+{
+	struct vb2_private_key_store_entry *entry;
+	struct vb2_private_key *key;
+	int rv;
+
+	*key_ptr = NULL;
+
+	pthread_mutex_lock(&store->lock);
+
+	for (entry = store->entries; entry; entry = entry->next) {
+		if (entry->pem == pem && (!pem || entry->pem_hash_alg ==
+					  hash_alg) &&
+		    !strcmp(entry->filename, filename)) {
+			*key_ptr = entry->key;
+			rv = VB2_SUCCESS;
+			goto done;
+		}
+	}
+
+	/* Not read yet, so read it now.  Failures aren't kept. */
+	if (pem) {
+		rv = vb2_private_key_read_pem(&key, filename);
+		if (!rv) {
+			key->hash_alg = hash_alg;
+			if (key->rsa_private_key)
+				key->sig_alg = vb2_rsa_sig_alg(
+					key->rsa_private_key);
+		}
+	} else {
+		rv = vb2_private_key_read(&key, filename);
+	}
+	if (rv)
+		goto done;
+
+	entry = calloc(1, sizeof(*entry));
+	if (entry)
+		entry->filename = strdup(filename);
+	if (!entry || !entry->filename ||
+	    (key->rsa_private_key &&
+	     vb2_rsa_prepare(key->rsa_private_key))) {
+		if (entry)
+			free(entry->filename);
+		free(entry);
+		vb2_private_key_free(key);
+		rv = VB2_ERROR_PRIVATE_KEY_STORE_KEEP;
+		goto done;
+	}
+	entry->pem = pem;
+	entry->pem_hash_alg = hash_alg;
+	entry->key = key;
+	entry->next = store->entries;
+	store->entries = entry;
+	*key_ptr = key;
+
+ done:
+	pthread_mutex_unlock(&store->lock);
+	return rv;
+}
+
+int vb2_private_key_store_read(struct vb2_private_key_store *store,
+			       const struct vb2_private_key **key_ptr,
+			       const char *filename)
+{
+	return vb2_private_key_store_get(store, key_ptr, filename, 0,
+					 VB2_HASH_INVALID);
+}
+
+int vb2_private_key_store_read_pem(struct vb2_private_key_store *store,
+				   const struct vb2_private_key **key_ptr,
+				   const char *filename,
+				   enum vb2_hash_algorithm hash_alg)
+{
+	return vb2_private_key_store_get(store, key_ptr, filename, 1,
+					 hash_alg);
+}
+
 int vb2_private_key_set_desc(struct vb2_private_key *key, const char *desc)
 {
 	if (key->desc)
@@ -248,7 +459,14 @@ int vb2_private_key_write(const struct vb2_private_key *key,
 
 	pkey.c.desc_size = vb2_desc_size(key->desc);
 
-	if (key->sig_alg != VB2_SIG_NONE) {
+	if (key->sig_alg == VB2_SIG_ED25519) {
+		/* Store just the seed */
+		rsabuf = malloc(ED25519_SEED_SIZE);
+		if (!rsabuf)
+			return VB2_ERROR_PRIVATE_KEY_WRITE_ALLOC;
+		memcpy(rsabuf, key->ed25519_key, ED25519_SEED_SIZE);
+		rsalen = ED25519_SEED_SIZE;
+	} else if (key->sig_alg != VB2_SIG_NONE) {
 		/* Pack RSA key */
 		rsalen = i2d_RSAPrivateKey(key->rsa_private_key, &rsabuf);
 		if (rsalen <= 0 || !rsabuf)
@@ -274,6 +492,7 @@ int vb2_private_key_write(const struct vb2_private_key *key,
 
 	if (rsabuf) {
 		memcpy(buf + pkey.key_offset, rsabuf, rsalen);
+		memset(rsabuf, 0, rsalen);
 		free(rsabuf);
 	}
 
@@ -327,6 +546,19 @@ int vb2_private_key_hash(const struct vb2_private_key **key_ptr,
 			*key_ptr = &key;
 			return VB2_SUCCESS;
 		}
+#endif
+#if VB2_SUPPORT_BLAKE2S
+	case VB2_HASH_BLAKE2S:
+		{
+			static const struct vb2_private_key key = {
+				.hash_alg = VB2_HASH_BLAKE2S,
+				.sig_alg = VB2_SIG_NONE,
+				.desc = "Unsigned BLAKE2s",
+				.guid = VB2_GUID_NONE_BLAKE2S,
+			};
+			*key_ptr = &key;
+			return VB2_SUCCESS;
+		}
 #endif
 	default:
 		return VB2_ERROR_PRIVATE_KEY_HASH;
@@ -498,7 +730,10 @@ int vb2_public_key_pack(struct vb2_packed_key **key_ptr,
 		buf[key.c.fixed_size + key.c.desc_size - 1] = 0;
 	}
 
-	if (pubk->sig_alg != VB2_SIG_NONE) {
+	if (pubk->sig_alg == VB2_SIG_ED25519) {
+		memcpy(buf + key.key_offset, pubk->ed25519_key,
+		       VB2_ED25519_PUBLIC_KEY_SIZE);
+	} else if (pubk->sig_alg != VB2_SIG_NONE) {
 		/* Re-pack the key arrays */
 		buf32 = (uint32_t *)(buf + key.key_offset);
 		buf32[0] = pubk->arrsize;
@@ -513,6 +748,99 @@ int vb2_public_key_pack(struct vb2_packed_key **key_ptr,
 	return VB2_SUCCESS;
 }
 
+/* Packed key and GUID sorted into a key table by vb2_key_table_create() */
+struct key_table_item {
+	const struct vb2_guid *guid;
+	struct vb2_packed_key *pkey;
+};
+
+static int key_table_item_cmp(const void *a, const void *b)
+{
+	const struct key_table_item *ia = a, *ib = b;
+
+	return memcmp(ia->guid, ib->guid, sizeof(*ia->guid));
+}
+
+int vb2_key_table_create(struct vb2_key_table **table_ptr,
+			 const struct vb2_public_key **keys,
+			 uint32_t key_count,
+			 const char *desc)
+{
+	struct vb2_key_table table = {
+		.c.magic = VB2_MAGIC_KEY_TABLE,
+		.c.struct_version_major = VB2_KEY_TABLE_VERSION_MAJOR,
+		.c.struct_version_minor = VB2_KEY_TABLE_VERSION_MINOR,
+		.c.fixed_size = sizeof(table),
+		.key_count = key_count,
+	};
+	struct vb2_key_table_entry *entries;
+	struct key_table_item *items;
+	uint32_t offset;
+	uint8_t *buf = NULL;
+	int rv = VB2_SUCCESS;
+	int i;
+
+	*table_ptr = NULL;
+
+	items = calloc(key_count ? key_count : 1, sizeof(*items));
+	if (!items)
+		return VB2_ERROR_KEY_TABLE_CREATE_ALLOC;
+
+	for (i = 0; i < key_count; i++) {
+		items[i].guid = keys[i]->guid;
+		rv = vb2_public_key_pack(&items[i].pkey, keys[i]);
+		if (rv)
+			goto done;
+	}
+
+	/* Firmware binary searches the entries, so sort them by GUID */
+	qsort(items, key_count, sizeof(*items), key_table_item_cmp);
+	for (i = 1; i < key_count; i++) {
+		if (!key_table_item_cmp(items + i - 1, items + i)) {
+			rv = VB2_ERROR_KEY_TABLE_CREATE_DUPLICATE;
+			goto done;
+		}
+	}
+
+	/* Keys follow the entries, in the same order */
+	table.c.desc_size = vb2_desc_size(desc);
+	table.entry_offset = table.c.fixed_size + table.c.desc_size;
+	offset = table.entry_offset + key_count * sizeof(*entries);
+	for (i = 0; i < key_count; i++)
+		offset += items[i].pkey->c.total_size;
+	table.c.total_size = offset;
+
+	buf = calloc(1, table.c.total_size);
+	if (!buf) {
+		rv = VB2_ERROR_KEY_TABLE_CREATE_ALLOC;
+		goto done;
+	}
+
+	memcpy(buf, &table, sizeof(table));
+
+	/* strcpy() is ok because we allocated buffer based on desc length */
+	if (desc)
+		strcpy((char *)buf + table.c.fixed_size, desc);
+
+	entries = (struct vb2_key_table_entry *)(buf + table.entry_offset);
+	offset = table.entry_offset + key_count * sizeof(*entries);
+	for (i = 0; i < key_count; i++) {
+		entries[i].guid = *items[i].guid;
+		entries[i].key_offset = offset;
+		memcpy(buf + offset, items[i].pkey,
+		       items[i].pkey->c.total_size);
+		offset += items[i].pkey->c.total_size;
+	}
+
+	*table_ptr = (struct vb2_key_table *)buf;
+
+ done:
+	for (i = 0; i < key_count; i++)
+		free(items[i].pkey);
+	free(items);
+	return rv;
+}
+
 int vb2_public_key_hash(struct vb2_public_key *key,
 			enum vb2_hash_algorithm hash_alg)
 {
@@ -531,6 +859,11 @@ int vb2_public_key_hash(struct vb2_public_key *key,
 	case VB2_HASH_SHA512:
 		key->desc = "Unsigned SHA-512";
 		break;
+#endif
+#if VB2_SUPPORT_BLAKE2S
+	case VB2_HASH_BLAKE2S:
+		key->desc = "Unsigned BLAKE2s";
+		break;
 #endif
 	default:
 		return VB2_ERROR_PUBLIC_KEY_HASH;
@@ -542,6 +875,33 @@ int vb2_public_key_hash(struct vb2_public_key *key,
 	return VB2_SUCCESS;
 }
 
+int vb2_public_key_from_ed25519(struct vb2_public_key **key_ptr,
+				const struct vb2_private_key *prik)
+{
+	struct vb2_public_key *key;
+	uint8_t *key_buf;
+
+	*key_ptr = NULL;
+
+	if (prik->sig_alg != VB2_SIG_ED25519)
+		return VB2_ERROR_PUBLIC_KEY_ED25519;
+
+	if (vb2_public_key_alloc(&key, VB2_SIG_ED25519))
+		return VB2_ERROR_PUBLIC_KEY_ED25519_ALLOC;
+
+	key_buf = vb2_public_key_packed_data(key);
+	memcpy(key_buf, prik->ed25519_key + ED25519_SEED_SIZE,
+	       VB2_ED25519_PUBLIC_KEY_SIZE);
+
+	if (vb2_unpack_key_data(key, key_buf, VB2_ED25519_PUBLIC_KEY_SIZE)) {
+		vb2_public_key_free(key);
+		return VB2_ERROR_PUBLIC_KEY_ED25519;
+	}
+
+	*key_ptr = key;
+	return VB2_SUCCESS;
+}
+
 enum vb2_signature_algorithm vb2_rsa_sig_alg(struct rsa_st *rsa)
 {
 	int bits = BN_num_bits(rsa->n);
@@ -6,6 +6,7 @@
  */
 
 #include <openssl/rsa.h>
+#include <pthread.h>
 
 #include "2sysincludes.h"
 #include "2common.h"
@@ -70,18 +71,57 @@ static int vb2_digest_info(enum vb2_hash_algorithm hash_alg,
 			*size_ptr = sizeof(info);
 			return VB2_SUCCESS;
 		}
+#endif
+#if VB2_SUPPORT_BLAKE2S
+	case VB2_HASH_BLAKE2S:
+		{
+			/* OID 1.3.6.1.4.1.1722.12.2.2.8, from RFC 7693 */
+			static const uint8_t info[] = {
+				0x30, 0x33, 0x30, 0x0f, 0x06, 0x0b, 0x2b, 0x06,
+				0x01, 0x04, 0x01, 0x8d, 0x3a, 0x0c, 0x02, 0x02,
+				0x08, 0x05, 0x00, 0x04, 0x20
+			};
+			*buf_ptr = info;
+			*size_ptr = sizeof(info);
+			return VB2_SUCCESS;
+		}
 #endif
 	default:
 		return VB2_ERROR_DIGEST_INFO;
 	}
 }
 
-int vb2_sign_data(struct vb2_signature **sig_ptr,
-		  const uint8_t *data,
-		  uint32_t size,
-		  const struct vb2_private_key *key,
-		  const char *desc)
+int vb2_sign_init(struct vb2_sign_context *sc,
+		  const struct vb2_private_key *key)
+{
+	sc->key = key;
+	sc->size = 0;
+
+	if (vb2_digest_init(&sc->dc, key->hash_alg))
+		return VB2_SIGN_DATA_DIGEST_INIT;
+
+	return VB2_SUCCESS;
+}
+
+int vb2_sign_extend(struct vb2_sign_context *sc,
+		    const uint8_t *data,
+		    uint32_t size)
+{
+	if (size > UINT32_MAX - sc->size)
+		return VB2_SIGN_DATA_DIGEST_EXTEND;
+
+	if (vb2_digest_extend(&sc->dc, data, size))
+		return VB2_SIGN_DATA_DIGEST_EXTEND;
+
+	sc->size += size;
+	return VB2_SUCCESS;
+}
+
+int vb2_sign_finalize(struct vb2_sign_context *sc,
+		      struct vb2_signature **sig_ptr,
+		      const char *desc)
 {
+	const struct vb2_private_key *key = sc->key;
 	struct vb2_signature s = {
 		.c.magic = VB2_MAGIC_SIGNATURE,
 		.c.struct_version_major = VB2_SIGNATURE_VERSION_MAJOR,
@@ -89,11 +129,10 @@ int vb2_sign_data(struct vb2_signature **sig_ptr,
 		.c.fixed_size = sizeof(s),
 		.sig_alg = key->sig_alg,
 		.hash_alg = key->hash_alg,
-		.data_size = size,
+		.data_size = sc->size,
 		.guid = key->guid,
 	};
 
-	struct vb2_digest_context dc;
 	uint32_t digest_size;
 	const uint8_t *info = NULL;
 	uint32_t info_size = 0;
@@ -117,7 +156,7 @@ int vb2_sign_data(struct vb2_signature **sig_ptr,
 	s.c.total_size = s.sig_offset + s.sig_size;
 
 	/* Determine digest size and allocate buffer */
-	if (s.sig_alg != VB2_SIG_NONE) {
+	if (s.sig_alg != VB2_SIG_NONE && s.sig_alg != VB2_SIG_ED25519) {
 		if (vb2_digest_info(s.hash_alg, &info, &info_size))
 			return VB2_SIGN_DATA_DIGEST_INFO;
 	}
@@ -135,18 +174,9 @@ int vb2_sign_data(struct vb2_signature **sig_ptr,
 	if (info_size)
 		memcpy(sig_digest, info, info_size);
 
-	/* Calculate hash digest */
-	if (vb2_digest_init(&dc, s.hash_alg)) {
-		free(sig_digest);
-		return VB2_SIGN_DATA_DIGEST_INIT;
-	}
-
-	if (vb2_digest_extend(&dc, data, size)) {
-		free(sig_digest);
-		return VB2_SIGN_DATA_DIGEST_EXTEND;
-	}
-
-	if (vb2_digest_finalize(&dc, sig_digest + info_size, digest_size)) {
+	/* Finish the hash digest */
+	if (vb2_digest_finalize(&sc->dc, sig_digest + info_size,
+				digest_size)) {
 		free(sig_digest);
 		return VB2_SIGN_DATA_DIGEST_FINALIZE;
 	}
@@ -162,6 +192,10 @@ int vb2_sign_data(struct vb2_signature **sig_ptr,
 	if (s.sig_alg == VB2_SIG_NONE) {
 		/* Bare hash signature is just the digest */
 		memcpy(buf + s.sig_offset, sig_digest, sig_digest_size);
+	} else if (s.sig_alg == VB2_SIG_ED25519) {
+		/* Ed25519 signs the digest itself, with no digest info */
+		vb2_ed25519_sign(buf + s.sig_offset, key->ed25519_key,
+				 sig_digest, sig_digest_size);
 	} else {
 		/* RSA-encrypt the signature */
 		if (RSA_private_encrypt(sig_digest_size,
@@ -180,6 +214,28 @@ int vb2_sign_data(struct vb2_signature **sig_ptr,
 	return VB2_SUCCESS;
 }
 
+int vb2_sign_data(struct vb2_signature **sig_ptr,
+		  const uint8_t *data,
+		  uint32_t size,
+		  const struct vb2_private_key *key,
+		  const char *desc)
+{
+	struct vb2_sign_context sc;
+	int rv;
+
+	*sig_ptr = NULL;
+
+	rv = vb2_sign_init(&sc, key);
+	if (rv)
+		return rv;
+
+	rv = vb2_sign_extend(&sc, data, size);
+	if (rv)
+		return rv;
+
+	return vb2_sign_finalize(&sc, sig_ptr, desc);
+}
+
 int vb2_sig_size_for_key(uint32_t *size_ptr,
 			 const struct vb2_private_key *key,
 			 const char *desc)
@@ -240,31 +296,212 @@ int vb2_sign_object(uint8_t *buf,
 	return VB2_SUCCESS;
 }
 
+/* One signature to make from a hashed object; made in its own thread */
+struct vb2_sign_job {
+	struct vb2_sign_context sc;
+	struct vb2_signature *sig;
+	int rv;
+};
+
+static void *vb2_sign_job_run(void *arg)
+{
+	struct vb2_sign_job *job = arg;
+
+	job->rv = vb2_sign_finalize(&job->sc, &job->sig, NULL);
+	return NULL;
+}
+
 int vb2_sign_object_multiple(uint8_t *buf,
 			     uint32_t sig_offset,
 			     const struct vb2_private_key **key_list,
 			     uint32_t key_count)
 {
 	struct vb2_struct_common *c = (struct vb2_struct_common *)buf;
+	struct vb2_sign_job *jobs;
+	pthread_t *threads;
+	int *started;
 	uint32_t sig_next = sig_offset;
-	int rv, i;
+	int rv = VB2_SUCCESS;
+	int i, j;
+
+	jobs = calloc(key_count, sizeof(*jobs));
+	threads = calloc(key_count, sizeof(*threads));
+	started = calloc(key_count, sizeof(*started));
+	if (key_count && (!jobs || !threads || !started)) {
+		rv = VB2_SIGN_OBJECT_ALLOC;
+		goto done;
+	}
+
+	/*
+	 * Hash the object once for each hash algorithm; keys sharing one
+	 * start from a copy of the same digest state.
+	 */
+	for (i = 0; i < key_count; i++) {
+		for (j = 0; j < i; j++) {
+			if (key_list[j]->hash_alg == key_list[i]->hash_alg)
+				break;
+		}
+		if (j < i) {
+			jobs[i].sc = jobs[j].sc;
+			jobs[i].sc.key = key_list[i];
+			continue;
+		}
 
-	for (i = 0; i < key_count; i++)	{
-		struct vb2_signature *sig = NULL;
+		rv = vb2_sign_init(&jobs[i].sc, key_list[i]);
+		if (!rv)
+			rv = vb2_sign_extend(&jobs[i].sc, buf, sig_offset);
+		if (rv)
+			goto done;
+	}
 
-		rv = vb2_sign_data(&sig, buf, sig_offset, key_list[i], NULL);
+	/* Make the signatures at once; if a thread can't start, sign here */
+	for (i = 0; i < key_count; i++) {
+		started[i] = !pthread_create(threads + i, NULL,
+					     vb2_sign_job_run, jobs + i);
+		if (!started[i])
+			vb2_sign_job_run(jobs + i);
+	}
+	for (i = 0; i < key_count; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+	}
+
+	/* Put them after the object in order */
+	for (i = 0; i < key_count; i++) {
+		struct vb2_signature *sig = jobs[i].sig;
+
+		rv = jobs[i].rv;
 		if (rv)
-			return rv;
+			goto done;
 
 		if (sig_next + sig->c.total_size > c->total_size) {
-			free(sig);
-			return VB2_SIGN_OBJECT_OVERFLOW;
+			rv = VB2_SIGN_OBJECT_OVERFLOW;
+			goto done;
 		}
 
 		memcpy(buf + sig_next, sig, sig->c.total_size);
 		sig_next += sig->c.total_size;
-		free(sig);
 	}
 
-	return VB2_SUCCESS;
+ done:
+	if (jobs) {
+		for (i = 0; i < key_count; i++)
+			free(jobs[i].sig);
+	}
+	free(started);
+	free(threads);
+	free(jobs);
+	return rv;
+}
+
+/* One signature to check, and the result; checked in its own thread */
+struct vb2_verify_job {
+	const uint8_t *buf;
+	uint32_t size;
+	const struct vb2_signature *sig;
+	const struct vb2_public_key *key;
+	int rv;
+};
+
+static void *vb2_verify_job_run(void *arg)
+{
+	struct vb2_verify_job *job = arg;
+	struct vb2_signature *sig;
+	struct vb2_workbuf wb;
+	uint8_t *workbuf;
+
+	/* Verifying destroys the signature, so work on a copy */
+	sig = malloc(job->sig->c.total_size);
+	workbuf = malloc(VB2_VERIFY_DATA_WORKBUF_BYTES);
+	if (!sig || !workbuf) {
+		job->rv = VB2_VERIFY_OBJECT_ALLOC;
+	} else {
+		memcpy(sig, job->sig, job->sig->c.total_size);
+		vb2_workbuf_init(&wb, workbuf, VB2_VERIFY_DATA_WORKBUF_BYTES);
+		job->rv = vb2_verify_data(job->buf, job->size, sig, job->key,
+					  &wb);
+	}
+
+	free(workbuf);
+	free(sig);
+	return NULL;
+}
+
+int vb2_verify_object_multiple(const uint8_t *buf,
+			       uint32_t sig_offset,
+			       uint32_t sig_count,
+			       const struct vb2_public_key **key_list,
+			       uint32_t key_count,
+			       int *results)
+{
+	struct vb2_verify_job *jobs;
+	pthread_t *threads;
+	int *started;
+	uint32_t min_offset = sig_offset, sig_next = sig_offset;
+	int rv = VB2_SUCCESS, verified = 0;
+	int i, j;
+
+	jobs = calloc(sig_count, sizeof(*jobs));
+	threads = calloc(sig_count, sizeof(*threads));
+	started = calloc(sig_count, sizeof(*started));
+	if (sig_count && (!jobs || !threads || !started)) {
+		rv = VB2_VERIFY_OBJECT_ALLOC;
+		goto done;
+	}
+
+	/* Check the signature headers, and find a key for each */
+	for (i = 0; i < sig_count; i++, sig_next = min_offset) {
+		const struct vb2_signature *sig =
+			(const struct vb2_signature *)(buf + sig_next);
+
+		rv = vb2_verify_common_subobject(buf, &min_offset, sig_next);
+		if (rv)
+			goto done;
+
+		rv = vb2_verify_signature(sig, min_offset - sig_next);
+		if (rv)
+			goto done;
+
+		jobs[i].buf = buf;
+		jobs[i].size = sig_offset;
+		jobs[i].sig = sig;
+		jobs[i].rv = VB2_VERIFY_OBJECT_NO_KEY;
+		for (j = 0; j < key_count; j++) {
+			if (!memcmp(&sig->guid, key_list[j]->guid, GUID_SIZE)) {
+				jobs[i].key = key_list[j];
+				break;
+			}
+		}
+	}
+
+	/* Check them all at once; if a thread can't start, check it here */
+	for (i = 0; i < sig_count; i++) {
+		if (!jobs[i].key)
+			continue;
+		started[i] = !pthread_create(threads + i, NULL,
+					     vb2_verify_job_run, jobs + i);
+		if (!started[i])
+			vb2_verify_job_run(jobs + i);
+	}
+
+	/* Succeed if any signature verified, else report the first failure */
+	rv = VB2_VERIFY_OBJECT_NO_KEY;
+	for (i = 0; i < sig_count; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		if (results)
+			results[i] = jobs[i].rv;
+		if (!jobs[i].rv)
+			verified = 1;
+		else if (rv == VB2_VERIFY_OBJECT_NO_KEY)
+			rv = jobs[i].rv;
+	}
+	if (verified)
+		rv = VB2_SUCCESS;
+
+ done:
+	free(started);
+	free(threads);
+	free(jobs);
+	return rv;
 }
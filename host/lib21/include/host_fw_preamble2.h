@@ -8,6 +8,7 @@
 #ifndef VBOOT_REFERENCE_HOST_FW_PREAMBLE2_H_
 #define VBOOT_REFERENCE_HOST_FW_PREAMBLE2_H_
 
+#include "2crypto.h"
 #include "vb2_struct.h"
 
 struct vb2_private_key;
@@ -33,4 +34,39 @@ int vb2_fw_preamble_create(struct vb2_fw_preamble **fp_ptr,
 			   uint32_t flags,
 			   const char *desc);
 
+/**
+ * Hash a firmware component in blocks, for vb2api_check_hash_block().
+ *
+ * Pass the hashes to vb2_fw_preamble_create() in order, in place of a single
+ * hash for the component.
+ *
+ * @param hash_list_ptr	On success, points to a newly allocated list of
+ *			hashes, one per block.  Caller is responsible for
+ *			calling vb2_fw_preamble_free_hash_blocks() on this.
+ * @param hash_count_ptr On success, the number of hashes is stored here
+ * @param data		Component data
+ * @param size		Size of component data in bytes
+ * @param block_size	Size of each block in bytes; the last block may be
+ *			smaller.
+ * @param hash_alg	Hash algorithm to use
+ * @param guid		Component GUID
+ * @return VB2_SUCCESS, or non-zero error code if failure.
+ */
+int vb2_fw_preamble_hash_blocks(struct vb2_signature ***hash_list_ptr,
+				uint32_t *hash_count_ptr,
+				const uint8_t *data,
+				uint32_t size,
+				uint32_t block_size,
+				enum vb2_hash_algorithm hash_alg,
+				const struct vb2_guid *guid);
+
+/**
+ * Free a list of hashes from vb2_fw_preamble_hash_blocks().
+ *
+ * @param hash_list	List of hashes
+ * @param hash_count	Number of hashes
+ */
+void vb2_fw_preamble_free_hash_blocks(struct vb2_signature **hash_list,
+				      uint32_t hash_count);
+
 #endif  /* VBOOT_REFERENCE_HOST_FW_PREAMBLE2_H_ */
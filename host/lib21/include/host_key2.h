@@ -15,6 +15,7 @@ struct vb2_public_key;
 /* Private key data, in-memory format for use in signing calls. */
 struct vb2_private_key {
 	struct rsa_st *rsa_private_key;		/* Private key data */
+	uint8_t ed25519_key[64];		/* Ed25519 seed and public key */
 	enum vb2_hash_algorithm hash_alg;	/* Hash algorithm */
 	enum vb2_signature_algorithm sig_alg;	/* Signature algorithm */
 	char *desc;				/* Description */
@@ -94,6 +95,62 @@ int vb2_private_key_read(struct vb2_private_key **key_ptr,
 int vb2_private_key_read_pem(struct vb2_private_key **key_ptr,
 			     const char *filename);
 
+/* Store of private keys read once; see vb2_private_key_store_create() */
+struct vb2_private_key_store;
+
+/**
+ * Create an empty private key store.
+ *
+ * Each key in the store is read from its file and prepared for signing only
+ * the first time it is asked for, which suits long-running signers.  A store
+ * may be used from several threads at once, and its keys may be signed with
+ * from several threads at once.
+ *
+ * @param store_ptr	Destination for newly allocated store; this must be
+ *			freed with vb2_private_key_store_free().
+ * @return VB2_SUCCESS, or non-zero error code if error.
+ */
+int vb2_private_key_store_create(struct vb2_private_key_store **store_ptr);
+
+/**
+ * Free a private key store and all the keys in it.
+ *
+ * @param store		Store to free
+ */
+void vb2_private_key_store_free(struct vb2_private_key_store *store);
+
+/**
+ * Get a private key in vb2_packed_private_key format from the store.
+ *
+ * @param store		Key store
+ * @param key_ptr	Destination for the key.  The store owns it, and it
+ *			stays valid until the store is freed.
+ * @param filename	File to read key data from, if not already read.
+ * @return VB2_SUCCESS, or non-zero error code if error.
+ */
+int vb2_private_key_store_read(struct vb2_private_key_store *store,
+			       const struct vb2_private_key **key_ptr,
+			       const char *filename);
+
+/**
+ * Get a private key from a .pem file from the store.
+ *
+ * Since the store's keys are shared, their fields can't be set afterwards
+ * as with vb2_private_key_read_pem().  The signature algorithm is taken from
+ * the key size, and the key has no description or GUID.
+ *
+ * @param store		Key store
+ * @param key_ptr	Destination for the key.  The store owns it, and it
+ *			stays valid until the store is freed.
+ * @param filename	File to read key data from, if not already read.
+ * @param hash_alg	Hash algorithm to sign with
+ * @return VB2_SUCCESS, or non-zero error code if error.
+ */
+int vb2_private_key_store_read_pem(struct vb2_private_key_store *store,
+				   const struct vb2_private_key **key_ptr,
+				   const char *filename,
+				   enum vb2_hash_algorithm hash_alg);
+
 /**
  * Set the description of a private key.
  *
@@ -222,6 +279,54 @@ int vb2_public_key_hash(struct vb2_public_key *key,
  */
 enum vb2_signature_algorithm vb2_rsa_sig_alg(struct rsa_st *rsa);
 
+/**
+ * Get the public half of an Ed25519 private key.
+ *
+ * Does not set the hash_alg, guid, or desc fields.
+ *
+ * @param key_ptr	Destination for newly allocated key; this must be
+ *			freed with vb2_public_key_free().
+ * @param prik		Ed25519 private key
+ * @return VB2_SUCCESS, or non-zero error code if error.
+ */
+int vb2_public_key_from_ed25519(struct vb2_public_key **key_ptr,
+				const struct vb2_private_key *prik);
+
+/**
+ * Fill in the public half of an Ed25519 key from its seed.
+ *
+ * @param key		Key buffer; the 32-byte seed is read from the start,
+ *			and the 32-byte public key written after it.
+ */
+void vb2_ed25519_keypair(uint8_t *key);
+
+/**
+ * Sign a message with an Ed25519 key.
+ *
+ * @param sig		Destination for signature; VB2_ED25519_SIG_SIZE bytes
+ * @param key		Key from vb2_ed25519_keypair()
+ * @param msg		Message to sign
+ * @param size		Size of message in bytes
+ */
+void vb2_ed25519_sign(uint8_t *sig, const uint8_t *key,
+		      const uint8_t *msg, uint32_t size);
+
+/**
+ * Create a table of trusted public keys, for firmware to look up by GUID.
+ *
+ * @param table_ptr	On success, points to a newly allocated key table.
+ *			Caller is responsible for calling free() on this.
+ * @param keys		Keys to put in the table, in any order.  Their GUIDs
+ *			must all differ.
+ * @param key_count	Number of keys
+ * @param desc		Description for table, or NULL if none.
+ * @return VB2_SUCCESS, or non-zero if error.
+ */
+int vb2_key_table_create(struct vb2_key_table **table_ptr,
+			 const struct vb2_public_key **keys,
+			 uint32_t key_count,
+			 const char *desc);
+
 /**
  * Write a public key to the vb2_packed_key format.
  *
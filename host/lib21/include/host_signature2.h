@@ -8,10 +8,55 @@
 #ifndef VBOOT_REFERENCE_HOST_SIGNATURE2_H_
 #define VBOOT_REFERENCE_HOST_SIGNATURE2_H_
 
+#include "2sha.h"
 #include "2struct.h"
 
 struct vb2_private_key;
 
+/* Context for signing data which is fed in pieces */
+struct vb2_sign_context {
+	struct vb2_digest_context dc;
+	const struct vb2_private_key *key;
+	uint32_t size;
+};
+
+/**
+ * Start signing data which will be passed to vb2_sign_extend() in pieces.
+ *
+ * @param sc		Sign context to initialize
+ * @param key		Private key to sign with; must outlive the context
+ * @return VB2_SUCCESS, or non-zero error code on failure.
+ */
+int vb2_sign_init(struct vb2_sign_context *sc,
+		  const struct vb2_private_key *key);
+
+/**
+ * Add the next piece of data to sign.
+ *
+ * @param sc		Sign context from vb2_sign_init()
+ * @param data		Pointer to data to sign
+ * @param size		Size of data in bytes
+ * @return VB2_SUCCESS, or non-zero error code on failure.
+ */
+int vb2_sign_extend(struct vb2_sign_context *sc,
+		    const uint8_t *data,
+		    uint32_t size);
+
+/**
+ * Sign all the data passed to vb2_sign_extend().  Gives the same signature
+ * as vb2_sign_data() on the whole of it.
+ *
+ * @param sc		Sign context from vb2_sign_init()
+ * @param sig_ptr	On success, points to a newly allocated signature.
+ *			Caller is responsible for calling free() on this.
+ * @param desc		Optional description for signature.  If NULL, the
+ *			key description will be used.
+ * @return VB2_SUCCESS, or non-zero error code on failure.
+ */
+int vb2_sign_finalize(struct vb2_sign_context *sc,
+		      struct vb2_signature **sig_ptr,
+		      const char *desc);
+
 /**
  * Sign data buffer
  *
@@ -85,4 +130,30 @@ int vb2_sign_object_multiple(uint8_t *buf,
 			     const struct vb2_private_key **key_list,
 			     uint32_t key_count);
 
+/**
+ * Verify all the signatures on an object.
+ *
+ * Each signature is checked in its own thread, with the key from the list
+ * whose GUID matches it.  The object is not modified.
+ *
+ * @param buf		Buffer containing signed object, starting with
+ *			common header
+ * @param sig_offset	Offset of the first signature.  All data before
+ *			this in the buffer is signed.
+ * @param sig_count	Number of signatures
+ * @param key_list	List of keys to verify with
+ * @param key_count	Number of keys in list
+ * @param results	If non-NULL, stores the result of checking each
+ *			signature; VB2_VERIFY_OBJECT_NO_KEY if no key in the
+ *			list matched it.
+ * @return VB2_SUCCESS if at least one signature verified, else the first
+ * failure, or non-zero error code if a signature header is bad.
+ */
+int vb2_verify_object_multiple(const uint8_t *buf,
+			       uint32_t sig_offset,
+			       uint32_t sig_count,
+			       const struct vb2_public_key **key_list,
+			       uint32_t key_count,
+			       int *results);
+
 #endif  /* VBOOT_REFERENCE_HOST_SIGNATURE2_H_ */
@@ -0,0 +1,60 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * This tests for the presence in libvboot_host.so of the functions apps use
+ * that neither of the other link tests cover.
+ */
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2rsa.h"
+#include "2sha.h"
+#include "vb2_common.h"
+
+#include "crossystem.h"
+#include "fmap.h"
+#include "host_common.h"
+#include "vboot_common.h"
+
+int main(void)
+{
+	/* crossystem.h */
+	VbSetSystemPropertyString(0, 0);
+	VbBeginSystemPropertyWrites();
+	VbCommitSystemPropertyWrites();
+	VbAbortSystemPropertyWrites();
+	VbInvalidateSystemPropertyCache();
+
+	/* fmap.h */
+	fmap_find(0, 0);
+	fmap_find_by_name(0, 0, 0, 0, 0);
+	fmap_build_tree(0, 0, 0);
+	fmap_free_tree(0);
+
+	/* host_signature.h */
+	SignContextInit(0, 0);
+	SignContextUpdate(0, 0, 0);
+	SignContextFinal(0);
+
+	/* vboot_common.h */
+	KeyBlockVerify(0, 0, 0, 0);
+	VerifyFirmwarePreamble(0, 0, 0);
+	VerifyKernelPreamble(0, 0, 0);
+	VerifyData(0, 0, 0, 0);
+
+	/* vb2_common.h */
+	vb2_unpack_key(0, 0, 0);
+	vb2_verify_data(0, 0, 0, 0, 0);
+	vb2_verify_keyblock(0, 0, 0, 0);
+	vb2_verify_fw_preamble(0, 0, 0, 0);
+
+	/* 2sha.h */
+	vb2_digest_init(0, 0);
+	vb2_digest_extend(0, 0, 0);
+	vb2_digest_finalize(0, 0, 0);
+
+	return 0;
+}
@@ -4,10 +4,9 @@
 # Use of this source code is governed by a BSD-style license that can be
 # found in the LICENSE file.
 
-# Script to generate padding.c containing PKCS 1.5 padding byte arrays for
-# various combinations of RSA key lengths and message digest algorithms. 
-
-Pad_Preamble="0x00,0x01"
+# Script to generate padding.c containing the PKCS 1.5 DigestInfo byte arrays
+# and the tables describing the various combinations of RSA key lengths and
+# message digest algorithms.
 
 SHA1_digestinfo="0x30,0x21,0x30,0x09,0x06,0x05,0x2b,0x0e,0x03,0x02,0x1a,0x05"\
 ",0x00,0x04,0x14"
@@ -16,42 +15,27 @@ SHA256_digestinfo="0x30,0x31,0x30,0x0d,0x06,0x09,0x60,0x86,0x48,0x01,0x65,0x03"\
 SHA512_digestinfo="0x30,0x51,0x30,0x0d,0x06,0x09,0x60,0x86,0x48,0x01,0x65,0x03"\
 ",0x04,0x02,0x03,0x05,0x00,0x04,0x40"
 
-RSA1024_Len=128
-RSA2048_Len=256
-RSA4096_Len=512
-RSA8192_Len=1024
-
-SHA1_T_Len=35
-SHA256_T_Len=51
-SHA512_T_Len=83
-
 HashAlgos=( SHA1 SHA256 SHA512 )
-RSAAlgos=( RSA1024 RSA2048 RSA4096 RSA8192 ) 
-
-function genFFOctets {
-  count=$1
-  while [ $count -gt 0 ]; do
-    echo -n "0xff,"
-    let count=count-1
-  done
-}
+RSAAlgos=( RSA1024 RSA2048 RSA4096 RSA8192 )
 
 
 cat <<EOF
 /*
  * DO NOT MODIFY THIS FILE DIRECTLY.
  *
- * This file is automatically generated by genpadding.sh and contains padding
- * arrays corresponding to various combinations of algorithms for RSA signatures.
+ * This file is automatically generated by genpadding.sh and contains the
+ * DigestInfo arrays and algorithm tables for RSA signatures.
  */
 
 EOF
 
 
+echo '#include "sysincludes.h"'
+echo
 echo '#include "cryptolib.h"'
 echo
 echo
-cat <<EOF 
+cat <<EOF
 /*
  * PKCS 1.5 padding (from the RSA PKCS#1 v2.1 standard)
  *
@@ -72,37 +56,31 @@ cat <<EOF
  *
  * PS: octet string consisting of {Length(RSA Key) - Length(T) - 3} 0xFF
  *
+ * vb2_rsa_verify_digest() checks the padding itself, so only the DigestInfo
+ * values are kept here, for signing.  Those of hash algorithms left out of
+ * the build (see VB2_SUPPORT_* in 2sha.h) are dropped too, and their entries
+ * in hash_digestinfo_map[] are NULL.
  */
 EOF
 echo
 echo
 
 
-# Generate padding arrays.
+# Count algorithms.
 algorithmcounter=0
 
 for rsaalgo in ${RSAAlgos[@]}
 do
   for hashalgo in ${HashAlgos[@]}
   do
-    echo "/* Algorithm Type $algorithmcounter */"
     let algorithmcounter=algorithmcounter+1
-    eval rsalen=${rsaalgo}_Len
-    eval hashlen=${hashalgo}_T_Len
-    let nums=rsalen-hashlen-3 
-    echo "const uint8_t padding${rsaalgo}_${hashalgo}[${rsaalgo}NUMBYTES - ${hashalgo}_DIGEST_SIZE] = {"
-    echo -n $Pad_Preamble,
-    genFFOctets $nums
-    echo -n "0x00,"
-    eval digestinfo=\$${hashalgo}_digestinfo
-    echo $digestinfo
-    echo "};"
-    echo
   done
 done
 
+echo "#ifndef CHROMEOS_EC"
 echo "const int kNumAlgorithms = $algorithmcounter;";
 echo "#define NUMALGORITHMS $algorithmcounter"
+echo "#endif /* !CHROMEOS_EC */"
 echo
 
 # Output DigestInfo field lengths.
@@ -110,19 +88,28 @@ cat <<EOF
 #define SHA1_DIGESTINFO_LEN 15
 #define SHA256_DIGESTINFO_LEN 19
 #define SHA512_DIGESTINFO_LEN 19
+
 EOF
 
 
-# Generate DigestInfo arrays.
+# Generate DigestInfo arrays for the supported hash algorithms.
 for hashalgo in ${HashAlgos[@]}
 do
+  echo "#if VB2_SUPPORT_${hashalgo}"
   echo "const uint8_t ${hashalgo}_digestinfo[] = {"
   eval digestinfo=\$${hashalgo}_digestinfo
   echo $digestinfo
   echo "};"
+  echo "#define ${hashalgo}_DIGESTINFO ${hashalgo}_digestinfo"
+  echo "#else"
+  echo "#define ${hashalgo}_DIGESTINFO NULL"
+  echo "#endif"
   echo
 done
 
+echo "#ifndef CHROMEOS_EC"
+echo
+
 # Generate DigestInfo to size map.
 echo "const int digestinfo_size_map[] = {"
 for rsaalgo in ${RSAAlgos[@]}
@@ -147,30 +134,6 @@ done
 echo "};"
 echo
 
-# Generate algorithm padding array map.
-echo "const uint8_t* padding_map[NUMALGORITHMS] = {"
-for rsaalgo in ${RSAAlgos[@]}
-do
-  for hashalgo in ${HashAlgos[@]}
-  do
-     echo padding${rsaalgo}_${hashalgo},
-  done
-done
-echo "};"
-echo
-
-# Generate algorithm padding size map.
-echo "const int padding_size_map[NUMALGORITHMS] = {"
-for rsaalgo in ${RSAAlgos[@]}
-do
-  for hashalgo in ${HashAlgos[@]}
-  do
-    echo ${rsaalgo}NUMBYTES - ${hashalgo}_DIGEST_SIZE,
-  done
-done
-echo "};"
-echo
-
 # Generate signature algorithm to messge digest algorithm map.
 echo "const int hash_type_map[] = {"
 for rsaalgo in ${RSAAlgos[@]}
@@ -208,12 +171,12 @@ echo "};"
 echo
 
 # Generate algorithm to message's digest ASN.1 DigestInfo map.
-echo "const uint8_t* hash_digestinfo_map[NUMALGORITHMS] = {"
+echo "const uint8_t* const hash_digestinfo_map[NUMALGORITHMS] = {"
 for rsaalgo in ${RSAAlgos[@]}
 do
   for hashalgo in ${HashAlgos[@]}
   do
-    echo ${hashalgo}_digestinfo,
+    echo ${hashalgo}_DIGESTINFO,
   done
 done
 echo "};"
@@ -221,7 +184,7 @@ echo
 
 
 # Generate algorithm description strings.
-echo "const char* algo_strings[NUMALGORITHMS] = {"
+echo "const char* const algo_strings[NUMALGORITHMS] = {"
 for rsaalgo in ${RSAAlgos[@]}
 do
   for hashalgo in ${HashAlgos[@]}
@@ -232,4 +195,4 @@ done
 echo "};"
 echo
 
-#echo "#endif  /* VBOOT_REFERENCE_PADDING_H_ */"
+echo "#endif /* !CHROMEOS_EC */"
@@ -43,33 +43,44 @@ unzip -o $IMAGE_ZIP chromiumos_base_image.bin -d ${work_dir}
 
 mv ${work_dir}/chromiumos_base_image.bin ${SSD_IMAGE}
 
-kerna_offset=$(partoffset ${RECOVERY_IMAGE} 2)
-kernb_offset=$(partoffset ${RECOVERY_IMAGE} 4)
-# Kernel partition sizes should be the same.
-kern_size=$(partsize ${RECOVERY_IMAGE} 2)
-
-rootfs=$(make_temp_file)
-echo "Replacing RootFS on the SSD with that of the RECOVERY image"
-extract_image_partition ${RECOVERY_IMAGE} 3 ${rootfs}
-replace_image_partition ${SSD_IMAGE} 3 ${rootfs}
-
-kerna=$(make_temp_file)
-echo "Replacing KernelA on the SSD with that of the RECOVERY image"
-extract_image_partition ${RECOVERY_IMAGE} 4 ${kerna}
-replace_image_partition ${SSD_IMAGE} 2 ${kerna}
-
-# Overwrite the kernel vblock on the created SSD image.
+# Get the SSD kernel vblock.
 stateful_dir=$(make_temp_dir)
 tmp_vblock=$(make_temp_file)
 mount_image_partition_ro ${RECOVERY_IMAGE} 1 ${stateful_dir}
 sudo cp ${stateful_dir}/vmlinuz_hd.vblock ${tmp_vblock}
-echo "Overwriting kernel vblock with SSD kernel vblock"
-sudo dd if=${tmp_vblock} of=${SSD_IMAGE} seek=${kerna_offset} bs=512 \
-  conv=notrunc
 sudo umount ${stateful_dir}
 
-# Zero out Kernel B partition.
-echo "Zeroing out Kernel partition B"
-sudo dd if=/dev/zero of=${SSD_IMAGE} seek=${kernb_offset} bs=512 \
-  count=${kern_size} conv=notrunc
+# futility does it all at once, without filling in the holes in the images.
+FUTILITY=$(type -P futility || true)
+if [ -n "${FUTILITY}" ]; then
+  echo "Replacing RootFS and KernelA on the SSD with those of the RECOVERY" \
+    "image"
+  sudo "${FUTILITY}" recovery_to_ssd --vblock ${tmp_vblock} \
+    --recovery ${RECOVERY_IMAGE} ${SSD_IMAGE}
+else
+  kerna_offset=$(partoffset ${RECOVERY_IMAGE} 2)
+  kernb_offset=$(partoffset ${RECOVERY_IMAGE} 4)
+  # Kernel partition sizes should be the same.
+  kern_size=$(partsize ${RECOVERY_IMAGE} 2)
+
+  rootfs=$(make_temp_file)
+  echo "Replacing RootFS on the SSD with that of the RECOVERY image"
+  extract_image_partition ${RECOVERY_IMAGE} 3 ${rootfs}
+  replace_image_partition ${SSD_IMAGE} 3 ${rootfs}
+
+  kerna=$(make_temp_file)
+  echo "Replacing KernelA on the SSD with that of the RECOVERY image"
+  extract_image_partition ${RECOVERY_IMAGE} 4 ${kerna}
+  replace_image_partition ${SSD_IMAGE} 2 ${kerna}
+
+  # Overwrite the kernel vblock on the created SSD image.
+  echo "Overwriting kernel vblock with SSD kernel vblock"
+  sudo dd if=${tmp_vblock} of=${SSD_IMAGE} seek=${kerna_offset} bs=512 \
+    conv=notrunc
+
+  # Zero out Kernel B partition.
+  echo "Zeroing out Kernel partition B"
+  sudo dd if=/dev/zero of=${SSD_IMAGE} seek=${kernb_offset} bs=512 \
+    count=${kern_size} conv=notrunc
+fi
 echo "${RECOVERY_IMAGE} was converted to a factory SSD image: ${SSD_IMAGE}"
@@ -55,28 +55,39 @@ if [ "${IS_FORCE}" != "--force" ]; then
   [ "${SURE}" != "y" ] && exit 1
 fi
 
-kerna_offset=$(partoffset ${IMAGE} 2)
-kernb_offset=$(partoffset ${IMAGE} 4)
-# Kernel partition sizes should be the same.
-kern_size=$(partsize ${IMAGE} 2)
-
-# Move Kernel B to Kernel A.
-kernb=$(make_temp_file)
-echo "Replacing Kernel partition A with Kernel partition B"
-extract_image_partition ${IMAGE} 4 ${kernb}
-replace_image_partition ${IMAGE} 2 ${kernb}
-
-# Overwrite the vblock.
+# Get the SSD vblock.
 stateful_dir=$(make_temp_dir)
 tmp_vblock=$(make_temp_file)
 mount_image_partition_ro ${IMAGE} 1 ${stateful_dir}
 sudo cp ${stateful_dir}/vmlinuz_hd.vblock ${tmp_vblock}
 # Unmount before overwriting image to avoid sync issues.
 sudo umount ${stateful_dir}
-echo "Overwriting kernel partition A vblock with SSD vblock"
-sudo dd if=${tmp_vblock} of=${IMAGE} seek=${kerna_offset} bs=512 conv=notrunc
 
-# Zero out Kernel B partition.
-echo "Zeroing out Kernel partition B"
-sudo dd if=/dev/zero of=${IMAGE} seek=${kernb_offset} bs=512 count=${kern_size} conv=notrunc
+# futility does it all at once, without filling in the holes in the image.
+FUTILITY=$(type -P futility || true)
+if [ -n "${FUTILITY}" ]; then
+  echo "Replacing Kernel partition A with Kernel partition B and SSD vblock"
+  sudo "${FUTILITY}" recovery_to_ssd --vblock ${tmp_vblock} ${IMAGE}
+else
+  kerna_offset=$(partoffset ${IMAGE} 2)
+  kernb_offset=$(partoffset ${IMAGE} 4)
+  # Kernel partition sizes should be the same.
+  kern_size=$(partsize ${IMAGE} 2)
+
+  # Move Kernel B to Kernel A.
+  kernb=$(make_temp_file)
+  echo "Replacing Kernel partition A with Kernel partition B"
+  extract_image_partition ${IMAGE} 4 ${kernb}
+  replace_image_partition ${IMAGE} 2 ${kernb}
+
+  # Overwrite the vblock.
+  echo "Overwriting kernel partition A vblock with SSD vblock"
+  sudo dd if=${tmp_vblock} of=${IMAGE} seek=${kerna_offset} bs=512 \
+    conv=notrunc
+
+  # Zero out Kernel B partition.
+  echo "Zeroing out Kernel partition B"
+  sudo dd if=/dev/zero of=${IMAGE} seek=${kernb_offset} bs=512 \
+    count=${kern_size} conv=notrunc
+fi
 echo "${IMAGE} was converted to an SSD image."
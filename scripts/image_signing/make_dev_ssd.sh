@@ -142,7 +142,6 @@ resign_ssd_kernel() {
 
   for kernel_index in $FLAGS_partitions; do
     local old_blob="$(make_temp_file)"
-    local new_blob="$(make_temp_file)"
     local name="$(cros_kernel_name $kernel_index)"
     local rootfs_index="$(($kernel_index + 1))"
 
@@ -205,25 +204,23 @@ resign_ssd_kernel() {
     local new_kernel_config_file="$(make_temp_file)"
     echo -n "$kernel_config"  >"$new_kernel_config_file"
 
-    debug_msg "Re-signing $name from $old_blob to $new_blob"
+    # Repacking over a copy of the old blob only rewrites the vblock and
+    # config, instead of reassembling the whole partition.
+    local new_kern="$(make_temp_file)"
+    cp "$old_blob" "$new_kern"
+    debug_msg "Re-signing $name from $old_blob in place to $new_kern"
     debug_msg "Using key: $KERNEL_DATAKEY"
     vbutil_kernel \
-      --repack "$new_blob" \
+      --repack "$new_kern" \
       --keyblock "$KERNEL_KEYBLOCK" \
       --config "$new_kernel_config_file" \
       --signprivate "$KERNEL_DATAKEY" \
-      --oldblob "$old_blob" >"$EXEC_LOG" 2>&1 ||
+      --oldblob "$new_kern" >"$EXEC_LOG" 2>&1 ||
       err_die "Failed to resign $name. Message: $(cat "$EXEC_LOG")"
 
-    debug_msg "Creating new kernel image (vboot+code+config)"
-    local new_kern="$(make_temp_file)"
-    cp "$old_blob" "$new_kern"
-    mydd if="$new_blob" of="$new_kern" conv=notrunc
-
     if is_debug_mode; then
       debug_msg "for debug purposes, check *.dbgbin"
       cp "$old_blob" old_blob.dbgbin
-      cp "$new_blob" new_blob.dbgbin
       cp "$new_kern" new_kern.dbgbin
     fi
 
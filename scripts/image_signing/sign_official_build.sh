@@ -297,8 +297,6 @@ update_rootfs_hash() {
   # Update kernel command lines
   local dm_args="${CALCULATED_DM_ARGS}"
   local temp_config=$(make_temp_file)
-  local temp_kimage=$(make_temp_file)
-  local updated_kimage=$(make_temp_file)
   local kernelpart=
   local keyblock=
   local priv_key=
@@ -316,7 +314,6 @@ update_rootfs_hash() {
       sed -e 's#\(.*dm="\)\([^"]*\)\(".*\)'"#\1${dm_args}\3#g")"
     echo "New config for kernel partition ${kernelpart} is:"
     echo "${new_kernel_config}" | tee "${temp_config}"
-    extract_image_partition "${image}" "${kernelpart}" "${temp_kimage}"
     # Re-calculate kernel partition signature and command line.
     if [[ "$kernelpart" == 2 ]]; then
       keyblock="${kern_a_keyblock}"
@@ -325,13 +322,14 @@ update_rootfs_hash() {
       keyblock="${kern_b_keyblock}"
       priv_key="${kern_b_privkey}"
     fi
-    vbutil_kernel --repack ${updated_kimage} \
+    # This resigns the partition in place, without copying it out and back.
+    futility sign \
       --keyblock ${keyblock} \
       --signprivate ${priv_key} \
       --version "${KERNEL_VERSION}" \
-      --oldblob ${temp_kimage} \
-      --config ${temp_config}
-    replace_image_partition ${image} ${kernelpart} ${updated_kimage}
+      --config ${temp_config} \
+      --partition ${kernelpart} \
+      ${image}
   done
 }
 
@@ -624,19 +622,14 @@ update_recovery_kernel_hash() {
   echo "New config for kernel partition 2 is"
   cat ${new_kerna_config}
 
-  local temp_kimagea=$(make_temp_file)
-  extract_image_partition ${image_bin} 2 ${temp_kimagea}
-
-  # Re-calculate kernel partition signature and command line.
-  local updated_kimagea=$(make_temp_file)
-  vbutil_kernel --repack ${updated_kimagea} \
+  # Re-calculate kernel partition signature and command line, in place.
+  futility sign \
     --keyblock ${KEY_DIR}/recovery_kernel.keyblock \
     --signprivate ${KEY_DIR}/recovery_kernel_data_key.vbprivk \
     --version "${KERNEL_VERSION}" \
-    --oldblob ${temp_kimagea} \
-    --config ${new_kerna_config}
-
-  replace_image_partition ${image_bin} 2 ${updated_kimagea}
+    --config ${new_kerna_config} \
+    --partition 2 \
+    ${image_bin}
 }
 
 # Sign an image file with proper keys.
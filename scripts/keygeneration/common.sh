@@ -64,16 +64,11 @@ function make_pair {
 
   # make the RSA keypair
   openssl genrsa -F4 -out "${base}_${len}.pem" $len
-  # create a self-signed certificate
-  openssl req -batch -new -x509 -key "${base}_${len}.pem" \
-    -out "${base}_${len}.crt"
-  # generate pre-processed RSA public key
-  dumpRSAPublicKey -cert "${base}_${len}.crt" > "${base}_${len}.keyb"
 
   # wrap the public key
   vbutil_key \
     --pack "${base}.vbpubk" \
-    --key "${base}_${len}.keyb" \
+    --key "${base}_${len}.pem" \
     --version  "${key_version}" \
     --algorithm $alg
 
@@ -84,7 +79,7 @@ function make_pair {
     --algorithm $alg
 
   # remove intermediate files
-  rm -f "${base}_${len}.pem" "${base}_${len}.crt" "${base}_${len}.keyb"
+  rm -f "${base}_${len}.pem"
 }
 
 
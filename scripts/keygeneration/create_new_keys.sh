@@ -39,6 +39,7 @@ main() {
   local recovery_key_algoid=${RECOVERY_KEY_ALGOID}
   local recovery_kernel_algoid=${RECOVERY_KERNEL_ALGOID}
   local installer_kernel_algoid=${INSTALLER_KERNEL_ALGOID}
+  local args=( "$@" )
 
   while [[ $# -gt 0 ]]; do
     case $1 in
@@ -76,6 +77,13 @@ main() {
     shift
   done
 
+  # A futility that can make the whole keyset generates the keys in parallel,
+  # without running openssl and vbutil_* for each one.
+  if futility help 2>/dev/null | grep -qw create_keyset; then
+    futility create_keyset "${args[@]}" .
+    return
+  fi
+
   if [[ ! -e "${VERSION_FILE}" ]]; then
     echo "No version file found. Creating default ${VERSION_FILE}."
     printf '%s_version=1\n' {firmware,kernel}{_key,} > "${VERSION_FILE}"
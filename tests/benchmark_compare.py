@@ -0,0 +1,100 @@
+#!/usr/bin/python2 -tt
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Compare benchmark results against a baseline.
+
+Reads the JSON printed by the benchmarks in tests/ (vb2_crypto_benchmark and
+friends), and compares the minimum and median time of each result with the
+same result in the baseline file. Exits with status 1 if any got slower by
+more than the threshold on both counts; a busy machine tends to slow down the
+median but not the minimum, so this keeps one-off noise from failing a run. Results missing from either side are reported but don't fail, so
+benchmarks of hardware-specific implementations can come and go.
+
+With --update, the baseline is rewritten from the results instead.
+"""
+
+from __future__ import print_function
+
+import json
+import optparse
+import sys
+
+
+def load_results(filenames):
+  """Return a list of (key, {ns_min, ns_p50}) from the benchmark output."""
+  results = []
+  seen = {}
+  for filename in filenames:
+    with open(filename) as f:
+      doc = json.load(f)
+    for r in doc['results']:
+      key = '%s@%d' % (r['name'], r.get('size', 0))
+      # The same benchmark on different inputs of the same size (such as
+      # bitmaps) is told apart by the order it ran in.
+      seen[key] = seen.get(key, 0) + 1
+      if seen[key] > 1:
+        key = '%s#%d' % (key, seen[key])
+      results.append((key, {'ns_min': r['ns_min'], 'ns_p50': r['ns_p50']}))
+  return results
+
+
+def main(argv):
+  parser = optparse.OptionParser(
+      usage='%prog [options] BASELINE RESULTS.json...')
+  parser.add_option('-t', '--threshold', type='float', default=25.0,
+                    help='percent slower which counts as a regression')
+  parser.add_option('-u', '--update', action='store_true',
+                    help='write the results to BASELINE instead')
+  opts, args = parser.parse_args(argv[1:])
+  if len(args) < 2:
+    parser.error('need a baseline and at least one results file')
+
+  baseline_file = args[0]
+  results = load_results(args[1:])
+
+  if opts.update:
+    with open(baseline_file, 'w') as f:
+      json.dump(dict(results), f, indent=2, sort_keys=True)
+      f.write('\n')
+    print('Wrote %d results to %s' % (len(results), baseline_file))
+    return 0
+
+  with open(baseline_file) as f:
+    baseline = json.load(f)
+
+  regressions = 0
+  for key, r in results:
+    if key not in baseline:
+      print('%-44s %14.1f ns                   (new)' % (key, r['ns_p50']))
+      continue
+    change = {}
+    for stat in ('ns_min', 'ns_p50'):
+      old = baseline[key][stat]
+      change[stat] = (r[stat] - old) * 100.0 / old
+    if min(change.values()) > opts.threshold:
+      status = 'REGRESSION'
+      regressions += 1
+    elif max(change.values()) < -opts.threshold:
+      status = 'faster'
+    else:
+      status = 'ok'
+    print('%-44s %14.1f ns %+7.1f%% (min %+7.1f%%)  %s' %
+          (key, r['ns_p50'], change['ns_p50'], change['ns_min'], status))
+
+  current = set(key for key, _ in results)
+  for key in sorted(set(baseline) - current):
+    print('%-44s %14s                   (not run)' % (key, '-'))
+
+  if regressions:
+    print('%d result(s) more than %g%% slower than %s' %
+          (regressions, opts.threshold, baseline_file))
+    return 1
+  print('No results more than %g%% slower than %s' %
+        (opts.threshold, baseline_file))
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main(sys.argv))
@@ -8,6 +8,7 @@
 """
 
 import os
+import struct
 import sys
 import subprocess
 import unittest
@@ -46,6 +47,12 @@ class TestFailures(unittest.TestCase):
     self.assertNotEqual(0, rc)
     self.assertTrue(err.count("compression type"))
 
+  def testBadPixelFormat(self):
+    """Unknown raw pixel formats should fail."""
+    rc, out, err = runprog(prog, '-r', 'cmyk', '-c', 'case_simple.yaml', 'FOO')
+    self.assertNotEqual(0, rc)
+    self.assertTrue(err.count("unknown pixel format"))
+
 
 class TestOverWrite(unittest.TestCase):
 
@@ -111,6 +118,36 @@ class TestPackUnpack(unittest.TestCase):
     """Create, unpack, recreate with LZMA compression"""
     self.doPackUnpackZ('2');
 
+  def testPackUnpackZ3(self):
+    """Create, unpack, recreate with run-length encoding"""
+    self.doPackUnpackZ('3');
+
+  def testPackUnpackRaw(self):
+    """Convert to raw pixels, unpack, recreate from the raw images"""
+    for fmt, size in (('xrgb8888', 4), ('rgb888', 3), ('rgb565', 2)):
+      rc, out, err = runprog('/bin/rm', '-rf', './FOO_DIR')
+      self.assertEqual(0, rc)
+      rc, out, err = runprog(prog, '-r', fmt, '-z', '3',
+                             '-c', 'case_simple.yaml', 'FOO')
+      self.assertEqual(0, rc)
+      rc, out, err = runprog(prog, '-x', '-d', './FOO_DIR', 'FOO')
+      self.assertEqual(0, rc)
+      os.chdir('./FOO_DIR')
+      raws = [f for f in os.listdir('.') if f.endswith('.raw')]
+      self.assertEqual(2, len(raws))
+      for f in raws:
+        data = open(f, 'rb').read()
+        self.assertEqual('$RAW', data[:4])
+      # The 800x600 background, a row every 4-byte aligned stride
+      stride = (800 * size + 3) // 4 * 4
+      self.assertEqual(1, len([f for f in raws if
+                               os.path.getsize(f) == 24 + stride * 600]))
+      rc, out, err = runprog(prog, '-c', 'config.yaml', 'BAR')
+      self.assertEqual(0, rc)
+      rc, out, err = runprog('/usr/bin/cmp', '../FOO', 'BAR')
+      self.assertEqual(0, rc)
+      os.chdir('..')
+
   def doPackUnpackImplicitZ(self, comp, noncomp):
     """Create with given compression, unpack, repack without specifying"""
     # create with the specified compression scheme
@@ -138,7 +175,7 @@ class TestPackUnpack(unittest.TestCase):
 
   def testPackUnpackImplicitZ(self):
     """Create, unpack, recreate with implicit compression"""
-    self._allowed = range(3)
+    self._allowed = range(4)
     for c in self._allowed:
       self.doPackUnpackImplicitZ(str(c), [x for x in self._allowed if x != c])
 
@@ -148,6 +185,28 @@ class TestPackUnpack(unittest.TestCase):
     self.assertEqual(0, rc)
 
 
+class TestStats(unittest.TestCase):
+
+  def setUp(self):
+    rc, out, err = runprog('/bin/rm', '-f', 'FOO')
+    self.assertEqual(0, rc)
+
+  def testStats(self):
+    """Stats should list every image and locale"""
+    rc, out, err = runprog(prog, '-z', '2', '-c', 'case_simple.yaml', 'FOO')
+    self.assertEqual(0, rc)
+    rc, out, err = runprog(prog, '-s', 'FOO')
+    self.assertEqual(0, rc)
+    lines = out.splitlines()
+    self.assertEqual(2, len([l for l in lines if l.startswith('  img_')]))
+    # One locale, with all four screens' two images
+    self.assertEqual(1, len([l for l in lines if l.split()[:2] == ['0', '8']]))
+
+  def tearDown(self):
+    rc, out, err = runprog('/bin/rm', '-f', 'FOO')
+    self.assertEqual(0, rc)
+
+
 class TestReproducable(unittest.TestCase):
 
   def setUp(self):
@@ -190,11 +249,157 @@ class TestReuse(unittest.TestCase):
     self.assertEqual(0, rc)
     os.chdir('..')
 
+  def testSharedContent(self):
+    """Differently named images with the same content are stored once"""
+    os.mkdir('./FOO_DIR')
+    background = open('Background.bmp', 'rb').read()
+    open('FOO_DIR/a.bmp', 'wb').write(background)
+    open('FOO_DIR/b.bmp', 'wb').write(background)
+    open('FOO_DIR/c.bmp', 'wb').write(open('Word.bmp', 'rb').read())
+    open('FOO_DIR/case.yaml', 'w').write(
+        'bmpblock: 2.0\n'
+        'images:\n'
+        '  a: a.bmp\n'
+        '  b: b.bmp\n'
+        '  c: c.bmp\n'
+        'screens:\n'
+        '  scr_1:\n'
+        '    - [0, 0, a]\n'
+        '    - [45, 45, c]\n'
+        '  scr_2:\n'
+        '    - [0, 0, b]\n'
+        '    - [45, 400, c]\n'
+        'localizations:\n'
+        '  - [ scr_1, scr_2 ]\n')
+    os.chdir('./FOO_DIR')
+    rc, out, err = runprog(prog, '-c', 'case.yaml', 'FOO')
+    self.assertEqual(0, rc)
+    rc, out, err = runprog(prog, 'FOO')
+    self.assertEqual(0, rc)
+    self.assertTrue('2 discrete images' in out)
+    self.assertTrue('4 image references to 2 images' in out)
+    self.assertFalse('sharing saves 0 bytes' in out)
+    os.chdir('..')
+
   def tearDown(self):
     rc, out, err = runprog('/bin/rm', '-rf', './FOO_DIR', 'FOO')
     self.assertEqual(0, rc)
 
 
+class TestCache(unittest.TestCase):
+
+  def setUp(self):
+    rc, out, err = runprog('/bin/rm', '-rf', './FOO_CACHE', 'FOO', 'BAR')
+    self.assertEqual(0, rc)
+    os.mkdir('./FOO_CACHE')
+
+  def testCache(self):
+    """Compressed images kept between runs should give the same output"""
+    rc, out, err = runprog(prog, '-z', '2', '-c', 'case_simple.yaml', 'FOO')
+    self.assertEqual(0, rc)
+    rc, out, err = runprog(prog, '-z', '2', '-C', './FOO_CACHE',
+                           '-c', 'case_simple.yaml', 'BAR')
+    self.assertEqual(0, rc)
+    self.assertNotEqual([], os.listdir('./FOO_CACHE'))
+    rc, out, err = runprog('/usr/bin/cmp', 'FOO', 'BAR')
+    self.assertEqual(0, rc)
+    # Second time around, everything should come from the cache
+    rc, out, err = runprog(prog, '-D', '-z', '2', '-C', './FOO_CACHE',
+                           '-c', 'case_simple.yaml', 'BAR')
+    self.assertEqual(0, rc)
+    self.assertTrue('using cached' in out)
+    rc, out, err = runprog('/usr/bin/cmp', 'FOO', 'BAR')
+    self.assertEqual(0, rc)
+
+  def testChangedSource(self):
+    """Only images whose source changed should be read again"""
+    yaml = open('case_simple.yaml').read()
+    open('FOO.yaml', 'w').write(yaml.replace('Background.bmp', 'FOO.bmp'))
+    open('FOO.bmp', 'wb').write(open('Background.bmp', 'rb').read())
+    # Files changed just now aren't trusted to the index
+    os.utime('FOO.bmp', (1000000000, 1000000000))
+    rc, out, err = runprog(prog, '-z', '2', '-C', './FOO_CACHE',
+                           '-c', 'FOO.yaml', 'BAR')
+    self.assertEqual(0, rc)
+    rc, out, err = runprog(prog, '-D', '-z', '2', '-C', './FOO_CACHE',
+                           '-c', 'FOO.yaml', 'BAR')
+    self.assertEqual(0, rc)
+    self.assertFalse('loading image' in out)
+    rc, out, err = runprog(prog, '-z', '2', '-c', 'case_simple.yaml', 'FOO')
+    self.assertEqual(0, rc)
+    rc, out, err = runprog('/usr/bin/cmp', 'FOO', 'BAR')
+    self.assertEqual(0, rc)
+
+    open('FOO.bmp', 'wb').write(open('Word.bmp', 'rb').read())
+    os.utime('FOO.bmp', (1000000001, 1000000001))
+    rc, out, err = runprog(prog, '-D', '-z', '2', '-C', './FOO_CACHE',
+                           '-c', 'FOO.yaml', 'BAR')
+    self.assertEqual(0, rc)
+    self.assertTrue('loading image "background"' in out)
+    self.assertFalse('loading image "text"' in out)
+    open('FOO.yaml', 'w').write(yaml.replace('Background.bmp', 'Word.bmp'))
+    rc, out, err = runprog(prog, '-z', '2', '-c', 'FOO.yaml', 'FOO')
+    self.assertEqual(0, rc)
+    rc, out, err = runprog('/usr/bin/cmp', 'FOO', 'BAR')
+    self.assertEqual(0, rc)
+
+  def tearDown(self):
+    rc, out, err = runprog('/bin/rm', '-rf', './FOO_CACHE', 'FOO', 'BAR',
+                           'FOO.yaml', 'FOO.bmp')
+    self.assertEqual(0, rc)
+
+
+@unittest.skipUnless('BMPFONT' in os.environ, 'needs $BMPFONT')
+class TestFontAtlas(unittest.TestCase):
+
+  def setUp(self):
+    self._font = os.environ.get('BMPFONT')
+    # Word.bmp is 192x81; Background.bmp is a different height
+    for c in ('41', '61', '100'):
+      open('glyph_%s.bmp' % c, 'wb').write(open('Word.bmp', 'rb').read())
+    open('glyph_20.bmp', 'wb').write(open('Background.bmp', 'rb').read())
+
+  def testAtlas(self):
+    """All the glyphs go in one raw image, with a table by character"""
+    rc, out, err = runprog(self._font, '--outfile', 'FOO', '--atlas',
+                           'rgb565', 'glyph_41.bmp', 'glyph_61.bmp',
+                           'glyph_20.bmp', 'glyph_41.bmp')
+    self.assertEqual(0, rc)
+    data = open('FOO', 'rb').read()
+    (sig, num, default, line_height, image_size) = struct.unpack(
+        '<4sIIII', data[:20])
+    self.assertEqual('FATL', sig)
+    self.assertEqual(0x62, num)
+    self.assertEqual(0x41, default)
+    self.assertEqual(600, line_height)
+    glyph = lambda c: struct.unpack('<HHHH', data[20 + 8 * c:28 + 8 * c])
+    self.assertEqual((0, 0, 192, 81), glyph(0x41))
+    self.assertEqual((192, 0, 192, 81), glyph(0x61))
+    self.assertEqual((384, 0, 800, 600), glyph(0x20))
+    self.assertEqual((0, 0, 0, 0), glyph(0x42))
+    image = data[20 + 8 * num:]
+    self.assertEqual(image_size, len(image))
+    self.assertEqual('$RAW', image[:4])
+    (width, height, stride, fmt) = struct.unpack('<IIII', image[4:20])
+    self.assertEqual((1184, 600, 2368, 3), (width, height, stride, fmt))
+    self.assertEqual(24 + stride * height, image_size)
+
+  def testBadAtlas(self):
+    """Atlases need a known pixel format and characters below 0x100"""
+    rc, out, err = runprog(self._font, '--outfile', 'FOO', '--atlas', 'cmyk',
+                           'glyph_41.bmp')
+    self.assertNotEqual(0, rc)
+    rc, out, err = runprog(self._font, '--outfile', 'FOO', '--atlas',
+                           'rgb565', 'glyph_100.bmp')
+    self.assertNotEqual(0, rc)
+    self.assertFalse(os.path.exists('FOO'))
+
+  def tearDown(self):
+    rc, out, err = runprog('/bin/rm', '-f', 'FOO', 'glyph_41.bmp',
+                           'glyph_61.bmp', 'glyph_100.bmp', 'glyph_20.bmp')
+    self.assertEqual(0, rc)
+
+
 # Run these tests
 if __name__ == '__main__':
   varname = 'BMPBLK'
@@ -0,0 +1,749 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Boot simulator: runs the vboot 2.0 firmware flow and the vboot kernel
+ * selection against a real BIOS image and disk image, and reports how long
+ * each phase would take with a simple model of the storage and TPM.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "2sysincludes.h"
+#include "2api.h"
+#include "2misc.h"
+#include "vb2_struct.h"
+
+#include "fmap.h"
+#include "gbb_header.h"
+#include "host_common.h"
+#include "rollback_index.h"
+#include "test_common.h"
+#include "vboot_api.h"
+#include "vboot_common.h"
+#include "vboot_struct.h"
+
+/* Where the modelled time goes, in the order the timeline prints it */
+enum sim_cost {
+	COST_FLASH,
+	COST_TPM,
+	COST_DISK,
+	COST_EC,
+	COST_NV,
+	COST_WAIT,
+	COST_COUNT
+};
+
+static const char * const cost_names[COST_COUNT] = {
+	"flash", "tpm", "disk", "ec", "nv", "wait"
+};
+
+enum sim_phase_index {
+	PHASE_TPM_INIT,
+	PHASE_FW_PHASE1,
+	PHASE_FW_PHASE2,
+	PHASE_FW_PHASE3,
+	PHASE_FW_BODY,
+	PHASE_FW_SAVE,
+	PHASE_VB_INIT,
+	PHASE_SELECT_KERNEL,
+	PHASE_COUNT
+};
+
+struct sim_phase {
+	const char *name;
+	int ran;
+	uint64_t cpu_us;
+	uint64_t cost_us[COST_COUNT];
+};
+
+static struct sim_phase phases[PHASE_COUNT] = {
+	[PHASE_TPM_INIT] = {"tpm_init"},
+	[PHASE_FW_PHASE1] = {"fw_phase1"},
+	[PHASE_FW_PHASE2] = {"fw_phase2"},
+	[PHASE_FW_PHASE3] = {"fw_phase3"},
+	[PHASE_FW_BODY] = {"fw_body"},
+	[PHASE_FW_SAVE] = {"fw_save"},
+	[PHASE_VB_INIT] = {"vb_init"},
+	[PHASE_SELECT_KERNEL] = {"select_kernel"},
+};
+
+static struct sim_phase *cur_phase;
+static struct timespec phase_start;
+
+/* Latency model; see print_help() for what each one means */
+static struct {
+	uint32_t flash_kb_us;
+	uint32_t tpm_cmd_us;
+	uint32_t disk_op_us;
+	uint32_t disk_kb_us;
+	uint32_t ec_hash_us;
+	uint32_t ec_jump_us;
+	uint32_t nv_write_us;
+} lat = {
+	.flash_kb_us = 40,
+	.tpm_cmd_us = 1000,
+	.disk_op_us = MOCK_DISK_OP_US,
+	.disk_kb_us = MOCK_DISK_KB_US,
+	.ec_hash_us = 20000,
+	.ec_jump_us = 5000,
+	.nv_write_us = MOCK_NV_WRITE_US,
+};
+
+/* Totals for the summary */
+static uint64_t flash_bytes;
+static uint64_t disk_reads, disk_read_bytes, disk_writes;
+static uint32_t tpm_cmds, nv_writes;
+
+/* BIOS image */
+static uint8_t *bios;
+static uint64_t bios_size;
+
+/* Disk image */
+static int disk_fd = -1;
+static VbDiskInfo disk_info;
+static int disk_load_failed;
+
+/* Firmware state, shared with the kernel stage through the mocks below */
+static struct vb2_context ctx;
+static uint8_t workbuf[16384] __attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+static int developer_key_sent;
+
+static uint8_t kernel_workbuf[VB_KERNEL_WORKBUF_RECOMMENDED_SIZE];
+static uint8_t shared_data[VB_SHARED_DATA_REC_SIZE];
+
+static uint64_t now_diff_us(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000ULL +
+		(now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void phase_begin(enum sim_phase_index index)
+{
+	cur_phase = phases + index;
+	cur_phase->ran = 1;
+	clock_gettime(CLOCK_MONOTONIC, &phase_start);
+}
+
+static void phase_end(void)
+{
+	cur_phase->cpu_us += now_diff_us(&phase_start);
+	cur_phase = NULL;
+}
+
+static void charge(enum sim_cost cost, uint64_t us)
+{
+	if (cur_phase)
+		cur_phase->cost_us[cost] += us;
+}
+
+static uint64_t kb_cost(uint64_t bytes, uint32_t kb_us)
+{
+	return (bytes * kb_us + 1023) / 1024;
+}
+
+static void charge_tpm(uint32_t commands)
+{
+	tpm_cmds += commands;
+	charge(COST_TPM, (uint64_t)commands * lat.tpm_cmd_us);
+}
+
+static void charge_nv_write(void)
+{
+	nv_writes++;
+	charge(COST_NV, lat.nv_write_us);
+}
+
+/**
+ * Find an FMAP area in the BIOS image, trying the old name if the new one
+ * isn't there.
+ */
+static uint8_t *find_area(const char *name, const char *old_name,
+			  uint32_t *size)
+{
+	FmapAreaHeader *ah;
+	uint8_t *ptr;
+
+	ptr = fmap_find_by_name(bios, bios_size, NULL, name, &ah);
+	if (!ptr && old_name)
+		ptr = fmap_find_by_name(bios, bios_size, NULL, old_name, &ah);
+	if (!ptr)
+		return NULL;
+
+	*size = ah->area_size;
+	return ptr;
+}
+
+/******************************************************************************/
+/* Firmware callbacks */
+
+int vb2ex_read_resource(struct vb2_context *ctx,
+			enum vb2_resource_index index,
+			uint32_t offset,
+			void *buf,
+			uint32_t size)
+{
+	int slot_b = vb2_get_sd(ctx)->fw_slot;
+	uint32_t area_size;
+	uint8_t *area;
+
+	switch (index) {
+	case VB2_RES_GBB:
+		area = find_area("GBB", NULL, &area_size);
+		break;
+	case VB2_RES_FW_VBLOCK:
+		area = slot_b ? find_area("VBLOCK_B", "Firmware B Key",
+					  &area_size) :
+			find_area("VBLOCK_A", "Firmware A Key", &area_size);
+		break;
+	default:
+		return VB2_ERROR_UNKNOWN;
+	}
+
+	if (!area || offset > area_size || size > area_size - offset)
+		return VB2_ERROR_UNKNOWN;
+
+	memcpy(buf, area + offset, size);
+	flash_bytes += size;
+	charge(COST_FLASH, kb_cost(size, lat.flash_kb_us));
+	return VB2_SUCCESS;
+}
+
+int vb2ex_tpm_clear_owner(struct vb2_context *ctx)
+{
+	charge_tpm(1);
+	return VB2_SUCCESS;
+}
+
+/******************************************************************************/
+/* Kernel stage callbacks */
+
+/*
+ * The kernel stage takes the NV data and firmware versions from the firmware
+ * stage's context, so only NV writes and the kernel space accesses cost
+ * anything here.
+ */
+VbError_t VbExNvStorageWrite(const uint8_t *buf)
+{
+	charge_nv_write();
+	return VBERROR_SUCCESS;
+}
+
+uint32_t RollbackKernelRead(uint32_t *version)
+{
+	charge_tpm(1);
+	*version = 0;
+	return TPM_SUCCESS;
+}
+
+uint32_t RollbackKernelWrite(uint32_t version)
+{
+	charge_tpm(1);
+	return TPM_SUCCESS;
+}
+
+uint32_t RollbackKernelLock(int recovery_mode)
+{
+	charge_tpm(1);
+	return TPM_SUCCESS;
+}
+
+VbError_t VbExDiskGetInfo(VbDiskInfo **infos_ptr, uint32_t *count,
+			  uint32_t disk_flags)
+{
+	/* The one disk image stands in for whichever kind of disk is asked */
+	disk_info.flags = disk_flags;
+	*infos_ptr = &disk_info;
+	*count = 1;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDiskFreeInfo(VbDiskInfo *infos_ptr,
+			   VbExDiskHandle_t preserve_handle)
+{
+	/* No handle kept means there was no kernel to boot on it */
+	if (!preserve_handle)
+		disk_load_failed = 1;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDiskRead(VbExDiskHandle_t handle, uint64_t lba_start,
+		       uint64_t lba_count, void *buffer)
+{
+	uint64_t size = lba_count * disk_info.bytes_per_lba;
+
+	if (handle != disk_info.handle ||
+	    lba_start >= disk_info.lba_count ||
+	    lba_count > disk_info.lba_count - lba_start)
+		return VBERROR_UNKNOWN;
+
+	if ((ssize_t)size != pread(disk_fd, buffer, size,
+				   lba_start * disk_info.bytes_per_lba))
+		return VBERROR_UNKNOWN;
+
+	disk_reads++;
+	disk_read_bytes += size;
+	charge(COST_DISK, lat.disk_op_us + kb_cost(size, lat.disk_kb_us));
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDiskWrite(VbExDiskHandle_t handle, uint64_t lba_start,
+			uint64_t lba_count, const void *buffer)
+{
+	if (handle != disk_info.handle ||
+	    lba_start >= disk_info.lba_count ||
+	    lba_count > disk_info.lba_count - lba_start)
+		return VBERROR_UNKNOWN;
+
+	/* Leave the image alone, but charge for the write */
+	disk_writes++;
+	charge(COST_DISK, lat.disk_op_us +
+	       kb_cost(lba_count * disk_info.bytes_per_lba, lat.disk_kb_us));
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExEcHashRW(int devidx, const uint8_t **hash, int *hash_size)
+{
+	static const uint8_t fake_hash[32] = {1, 2, 3, 4};
+
+	charge(COST_EC, lat.ec_hash_us);
+	*hash = fake_hash;
+	*hash_size = sizeof(fake_hash);
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExEcGetExpectedRWHash(int devidx, enum VbSelectFirmware_t select,
+				  const uint8_t **hash, int *hash_size)
+{
+	static const uint8_t fake_hash[32] = {1, 2, 3, 4};
+
+	*hash = fake_hash;
+	*hash_size = sizeof(fake_hash);
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExEcJumpToRW(int devidx)
+{
+	charge(COST_EC, lat.ec_jump_us);
+	return VBERROR_SUCCESS;
+}
+
+void VbExSleepMs(uint32_t msec)
+{
+	charge(COST_WAIT, (uint64_t)msec * 1000);
+}
+
+uint32_t VbExKeyboardRead(void)
+{
+	/* Dismiss the developer screen with Ctrl+D, the way most people do */
+	if ((ctx.flags & VB2_CONTEXT_DEVELOPER_MODE) && !developer_key_sent) {
+		developer_key_sent = 1;
+		return 0x04;
+	}
+	return 0;
+}
+
+uint32_t VbExIsShutdownRequested(void)
+{
+	/* Give up instead of waiting for a disk which will never come */
+	return disk_load_failed;
+}
+
+/******************************************************************************/
+
+/**
+ * Save non-volatile and/or secure data if needed, then lock the firmware
+ * space like the read-only firmware would.
+ */
+static void save_if_needed(struct vb2_context *ctx)
+{
+	if (ctx->flags & VB2_CONTEXT_NVDATA_CHANGED) {
+		charge_nv_write();
+		ctx->flags &= ~VB2_CONTEXT_NVDATA_CHANGED;
+	}
+
+	if (ctx->flags & VB2_CONTEXT_SECDATA_CHANGED) {
+		charge_tpm(1);
+		ctx->flags &= ~VB2_CONTEXT_SECDATA_CHANGED;
+	}
+
+	charge_tpm(1);
+}
+
+/**
+ * Hash the firmware body from FW_MAIN_A or FW_MAIN_B
+ */
+static int hash_body(struct vb2_context *ctx)
+{
+	int slot_b = vb2_get_sd(ctx)->fw_slot;
+	uint32_t expect_size, area_size;
+	uint8_t *body;
+	int rv;
+
+	body = slot_b ? find_area("FW_MAIN_B", "Firmware B Data", &area_size) :
+		find_area("FW_MAIN_A", "Firmware A Data", &area_size);
+	if (!body)
+		return VB2_ERROR_UNKNOWN;
+
+	rv = vb2api_init_hash(ctx, VB2_HASH_TAG_FW_BODY, &expect_size);
+	if (rv)
+		return rv;
+
+	if (expect_size > area_size)
+		return VB2_ERROR_UNKNOWN;
+
+	flash_bytes += expect_size;
+	charge(COST_FLASH, kb_cost(expect_size, lat.flash_kb_us));
+
+	rv = vb2api_extend_hash(ctx, body, expect_size);
+	if (rv)
+		return rv;
+
+	return vb2api_check_hash(ctx);
+}
+
+static void print_timeline(void)
+{
+	uint64_t start = 0, total, sums[COST_COUNT] = {0}, cpu = 0;
+	int i, j;
+
+	printf("\n%-14s %9s %9s", "phase", "start_us", "cpu_us");
+	for (j = 0; j < COST_COUNT; j++)
+		printf(" %8s", cost_names[j]);
+	printf(" %9s\n", "total_us");
+
+	for (i = 0; i < PHASE_COUNT; i++) {
+		struct sim_phase *p = phases + i;
+
+		if (!p->ran)
+			continue;
+
+		total = p->cpu_us;
+		for (j = 0; j < COST_COUNT; j++)
+			total += p->cost_us[j];
+
+		printf("%-14s %9" PRIu64 " %9" PRIu64,
+		       p->name, start, p->cpu_us);
+		for (j = 0; j < COST_COUNT; j++) {
+			printf(" %8" PRIu64, p->cost_us[j]);
+			sums[j] += p->cost_us[j];
+		}
+		printf(" %9" PRIu64 "\n", total);
+
+		cpu += p->cpu_us;
+		start += total;
+	}
+
+	printf("%-14s %9s %9" PRIu64, "total", "", cpu);
+	for (j = 0; j < COST_COUNT; j++)
+		printf(" %8" PRIu64, sums[j]);
+	printf(" %9" PRIu64 "\n\n", start);
+
+	printf("Flash read:         %" PRIu64 " bytes\n", flash_bytes);
+	printf("Disk reads:         %" PRIu64 " (%" PRIu64 " bytes)\n",
+	       disk_reads, disk_read_bytes);
+	printf("Disk writes:        %" PRIu64 "\n", disk_writes);
+	printf("TPM commands:       %u\n", tpm_cmds);
+	printf("NV writes:          %u\n", nv_writes);
+	printf("Firmware workbuf:   %u bytes\n", ctx.workbuf_used);
+}
+
+/**
+ * Run the vboot 2.0 firmware flow.  Returns 0 if it picked a slot and
+ * verified it, 1 if it wants recovery mode, or -1 if it wants a reboot.
+ */
+static int run_firmware(void)
+{
+	int rv;
+
+	phase_begin(PHASE_TPM_INIT);
+	/* Startup, self-test and reading the firmware space */
+	charge_tpm(3);
+	rv = vb2api_secdata_create(&ctx);
+	phase_end();
+	if (rv) {
+		fprintf(stderr, "vb2api_secdata_create() failed (0x%x)\n", rv);
+		return -1;
+	}
+
+	phase_begin(PHASE_FW_PHASE1);
+	rv = vb2api_fw_phase1(&ctx);
+	phase_end();
+	if (rv) {
+		printf("Phase 1 wants recovery mode (0x%x).\n", rv);
+		phase_begin(PHASE_FW_SAVE);
+		save_if_needed(&ctx);
+		phase_end();
+		return 1;
+	}
+
+	phase_begin(PHASE_FW_PHASE2);
+	rv = vb2api_fw_phase2(&ctx);
+	phase_end();
+	if (rv) {
+		printf("Phase 2 wants reboot (0x%x).\n", rv);
+		goto fail;
+	}
+
+	phase_begin(PHASE_FW_PHASE3);
+	rv = vb2api_fw_phase3(&ctx);
+	phase_end();
+	if (rv) {
+		printf("Phase 3 wants reboot (0x%x).\n", rv);
+		goto fail;
+	}
+
+	phase_begin(PHASE_FW_BODY);
+	rv = hash_body(&ctx);
+	phase_end();
+	if (rv) {
+		printf("Body hash wants reboot (0x%x).\n", rv);
+		vb2api_fail(&ctx, VB2_RECOVERY_FW_BODY, rv);
+		goto fail;
+	}
+
+	phase_begin(PHASE_FW_SAVE);
+	save_if_needed(&ctx);
+	phase_end();
+
+	printf("Firmware slot %c verified.\n",
+	       vb2_get_sd(&ctx)->fw_slot ? 'B' : 'A');
+	return 0;
+
+fail:
+	phase_begin(PHASE_FW_SAVE);
+	save_if_needed(&ctx);
+	phase_end();
+	return -1;
+}
+
+/**
+ * Hand off to the kernel stage and pick a kernel from the disk image.
+ */
+static int run_kernel(int ec_sync)
+{
+	struct vb2_shared_data *sd = vb2_get_sd(&ctx);
+	VbSharedDataHeader *shared = (VbSharedDataHeader *)shared_data;
+	VbSelectAndLoadKernelParams kparams;
+	VbCommonParams cparams;
+	VbInitParams iparams;
+	uint32_t area_size;
+	VbError_t rv;
+
+	memset(&cparams, 0, sizeof(cparams));
+	cparams.gbb_data = find_area("GBB", NULL, &area_size);
+	cparams.gbb_size = area_size;
+	cparams.shared_data_blob = shared_data;
+	cparams.shared_data_size = sizeof(shared_data);
+	cparams.workbuf = kernel_workbuf;
+	cparams.workbuf_size = sizeof(kernel_workbuf);
+	cparams.vb2_ctx = &ctx;
+
+	memset(&iparams, 0, sizeof(iparams));
+	if (ctx.flags & VB2_CONTEXT_RECOVERY_MODE)
+		iparams.flags |= VB_INIT_FLAG_REC_BUTTON_PRESSED;
+	if (ctx.flags & VB2_CONTEXT_DEVELOPER_MODE)
+		iparams.flags |= VB_INIT_FLAG_DEV_SWITCH_ON;
+	if (ec_sync)
+		iparams.flags |= VB_INIT_FLAG_EC_SOFTWARE_SYNC;
+
+	phase_begin(PHASE_VB_INIT);
+	rv = VbInit(&cparams, &iparams);
+	if (rv == VBERROR_SUCCESS && !shared->recovery_reason) {
+		/* What VbSelectFirmware() would have left behind */
+		struct vb2_fw_preamble *pre = (struct vb2_fw_preamble *)
+			(ctx.workbuf + sd->workbuf_preamble_offset);
+
+		shared->firmware_index = sd->fw_slot;
+		if (VbSharedDataSetKernelKey(
+			    shared, (VbPublicKey *)&pre->kernel_subkey))
+			rv = VBERROR_UNKNOWN;
+	}
+	phase_end();
+	if (rv != VBERROR_SUCCESS) {
+		fprintf(stderr, "VbInit() failed (0x%x)\n", rv);
+		return 1;
+	}
+
+	memset(&kparams, 0, sizeof(kparams));
+	kparams.kernel_buffer_size = 16 * 1024 * 1024;
+	kparams.kernel_buffer = malloc(kparams.kernel_buffer_size);
+	if (!kparams.kernel_buffer) {
+		fprintf(stderr, "Can't allocate kernel buffer\n");
+		return 1;
+	}
+
+	phase_begin(PHASE_SELECT_KERNEL);
+	rv = VbSelectAndLoadKernel(&cparams, &kparams);
+	phase_end();
+	free(kparams.kernel_buffer);
+	if (rv != VBERROR_SUCCESS) {
+		printf("VbSelectAndLoadKernel() failed (0x%x).\n", rv);
+		return 1;
+	}
+
+	printf("Booting kernel from partition %d%s.\n",
+	       (int)kparams.partition_number,
+	       shared->recovery_reason ? " in recovery mode" :
+	       (shared->flags & VBSD_BOOT_DEV_SWITCH_ON) ?
+	       " in developer mode" : "");
+	return 0;
+}
+
+static void print_help(const char *progname)
+{
+	printf("\nUsage: %s [options] <bios.bin> <disk_image>\n\n"
+	       "Boots the firmware in bios.bin and a kernel from disk_image,\n"
+	       "then prints how long each phase would take.\n\n"
+	       "Boot options:\n"
+	       "  --dev               Boot in developer mode\n"
+	       "  --recovery          Boot in recovery mode\n"
+	       "  --ec-sync           Do EC software sync\n\n"
+	       "Latency model (microseconds):\n"
+	       "  --flash-kb-us=N     Per KB read from SPI flash (%u)\n"
+	       "  --tpm-us=N          Per TPM command (%u)\n"
+	       "  --disk-op-us=N      Per disk read or write (%u)\n"
+	       "  --disk-kb-us=N      Per KB read from or written to disk (%u)\n"
+	       "  --ec-hash-us=N      For the EC to hash its RW image (%u)\n"
+	       "  --ec-jump-us=N      For the EC to jump to RW (%u)\n"
+	       "  --nv-us=N           Per NV storage write (%u)\n\n",
+	       progname, lat.flash_kb_us, lat.tpm_cmd_us, lat.disk_op_us,
+	       lat.disk_kb_us, lat.ec_hash_us, lat.ec_jump_us,
+	       lat.nv_write_us);
+}
+
+enum {
+	OPT_DEV = 1000,
+	OPT_RECOVERY,
+	OPT_EC_SYNC,
+	OPT_FLASH_KB_US,
+	OPT_TPM_US,
+	OPT_DISK_OP_US,
+	OPT_DISK_KB_US,
+	OPT_EC_HASH_US,
+	OPT_EC_JUMP_US,
+	OPT_NV_US,
+};
+
+static const struct option long_opts[] = {
+	{"dev",         0, NULL, OPT_DEV},
+	{"recovery",    0, NULL, OPT_RECOVERY},
+	{"ec-sync",     0, NULL, OPT_EC_SYNC},
+	{"flash-kb-us", 1, NULL, OPT_FLASH_KB_US},
+	{"tpm-us",      1, NULL, OPT_TPM_US},
+	{"disk-op-us",  1, NULL, OPT_DISK_OP_US},
+	{"disk-kb-us",  1, NULL, OPT_DISK_KB_US},
+	{"ec-hash-us",  1, NULL, OPT_EC_HASH_US},
+	{"ec-jump-us",  1, NULL, OPT_EC_JUMP_US},
+	{"nv-us",       1, NULL, OPT_NV_US},
+	{"help",        0, NULL, 'h'},
+	{NULL, 0, NULL, 0}
+};
+
+int main(int argc, char *argv[])
+{
+	uint32_t *latency;
+	int ec_sync = 0;
+	struct stat st;
+	char *e;
+	int rv;
+	int i;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.workbuf = workbuf;
+	ctx.workbuf_size = sizeof(workbuf);
+
+	while ((i = getopt_long(argc, argv, "h", long_opts, NULL)) != -1) {
+		latency = NULL;
+		switch (i) {
+		case OPT_DEV:
+			ctx.flags |= VB2_CONTEXT_FORCE_DEVELOPER_MODE;
+			break;
+		case OPT_RECOVERY:
+			ctx.flags |= VB2_CONTEXT_FORCE_RECOVERY_MODE;
+			break;
+		case OPT_EC_SYNC:
+			ec_sync = 1;
+			break;
+		case OPT_FLASH_KB_US:
+			latency = &lat.flash_kb_us;
+			break;
+		case OPT_TPM_US:
+			latency = &lat.tpm_cmd_us;
+			break;
+		case OPT_DISK_OP_US:
+			latency = &lat.disk_op_us;
+			break;
+		case OPT_DISK_KB_US:
+			latency = &lat.disk_kb_us;
+			break;
+		case OPT_EC_HASH_US:
+			latency = &lat.ec_hash_us;
+			break;
+		case OPT_EC_JUMP_US:
+			latency = &lat.ec_jump_us;
+			break;
+		case OPT_NV_US:
+			latency = &lat.nv_write_us;
+			break;
+		default:
+			print_help(argv[0]);
+			return i == 'h' ? 0 : 1;
+		}
+
+		if (latency) {
+			*latency = strtoul(optarg, &e, 0);
+			if (!*optarg || (e && *e)) {
+				fprintf(stderr, "Invalid latency \"%s\"\n",
+					optarg);
+				return 1;
+			}
+		}
+	}
+
+	if (argc - optind < 2) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	bios = ReadFile(argv[optind], &bios_size);
+	if (!bios) {
+		fprintf(stderr, "Can't read BIOS image %s\n", argv[optind]);
+		return 1;
+	}
+	if (!fmap_find(bios, bios_size)) {
+		fprintf(stderr, "No FMAP in %s\n", argv[optind]);
+		return 1;
+	}
+
+	disk_fd = open(argv[optind + 1], O_RDONLY);
+	if (disk_fd < 0 || fstat(disk_fd, &st)) {
+		fprintf(stderr, "Can't open disk image %s\n", argv[optind + 1]);
+		return 1;
+	}
+	disk_info.handle = (VbExDiskHandle_t)1;
+	disk_info.bytes_per_lba = 512;
+	disk_info.lba_count = st.st_size / 512;
+	disk_info.name = argv[optind + 1];
+
+	rv = run_firmware();
+	if (rv >= 0)
+		rv = run_kernel(ec_sync);
+
+	print_timeline();
+
+	close(disk_fd);
+	free(bios);
+	return rv != 0;
+}
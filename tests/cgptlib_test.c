@@ -156,6 +156,8 @@ static void BuildTestGptData(GptData *gpt)
 	gpt->valid_headers = MASK_BOTH;
 	gpt->valid_entries = MASK_BOTH;
 	gpt->modified = 0;
+	gpt->entries_partial = 0;
+	gpt->entries_loaded = 0;
 
 	/* Build primary */
 	header = (GptHeader *)gpt->primary_header;
@@ -202,6 +204,50 @@ static void BuildTestGptData(GptData *gpt)
 	RefreshCrc32(gpt);
 }
 
+/*
+ * Turn the layout from BuildTestGptData() into one for a native 4K drive:
+ *
+ *     LBA   Size  Usage
+ * ---------------------------------------------------------
+ *       0      1  PMBR
+ *       1      1  primary partition header
+ *       2      4  primary partition entries (128B * 128)
+ *       6     10  kernel A (index: 0)
+ *      16     10  root A (index: 1)
+ *      26     10  root B (index: 2)
+ *      36     10  kernel B (index: 3)
+ *      59      4  secondary partition entries
+ *      63      1  secondary partition header
+ *      64
+ */
+static void BuildTest4kGptData(GptData *gpt)
+{
+	GptHeader *header = (GptHeader *)gpt->primary_header;
+	GptHeader *header2 = (GptHeader *)gpt->secondary_header;
+	GptEntry *entries = (GptEntry *)gpt->primary_entries;
+	int i;
+
+	BuildTestGptData(gpt);
+	gpt->sector_bytes = MAX_SECTOR_SIZE;
+	gpt->streaming_drive_sectors = gpt->gpt_drive_sectors = 64;
+
+	header->alternate_lba = 63;
+	header->first_usable_lba = 6;
+	header->last_usable_lba = 58;
+	for (i = 0; i < 4; i++) {
+		entries[i].starting_lba = 6 + 10 * i;
+		entries[i].ending_lba = 15 + 10 * i;
+	}
+
+	Memcpy(header2, header, sizeof(GptHeader));
+	Memcpy(gpt->secondary_entries, entries, PARTITION_ENTRIES_SIZE);
+	header2->my_lba = 63;
+	header2->alternate_lba = 1;
+	header2->entries_lba = 59;
+
+	RefreshCrc32(gpt);
+}
+
 /*
  * Test if the structures are the expected size; if this fails, struct packing
  * is not working properly.
@@ -231,9 +277,8 @@ static int TestBuildTestGptData(void)
 
 /*
  * Test if wrong sector_bytes or drive_sectors is detected by GptInit().
- * Currently we only support 512 bytes per sector.  In the future, we may
- * support other sizes.  A too small drive_sectors should be rejected by
- * GptInit().
+ * Currently we support 512 and 4096 bytes per sector.  A too small
+ * drive_sectors should be rejected by GptInit().
  */
 static int ParameterTests(void)
 {
@@ -249,7 +294,12 @@ static int ParameterTests(void)
 		{512, 10, GPT_ERROR_INVALID_SECTOR_NUMBER},
 		{512, GPT_PMBR_SECTORS + GPT_HEADER_SECTORS * 2 +
 		 TOTAL_ENTRIES_SIZE / DEFAULT_SECTOR_SIZE * 2, GPT_SUCCESS},
-		{4096, DEFAULT_DRIVE_SECTORS, GPT_ERROR_INVALID_SECTOR_SIZE},
+		{4096, DEFAULT_DRIVE_SECTORS, GPT_SUCCESS},
+		{2048, DEFAULT_DRIVE_SECTORS, GPT_ERROR_INVALID_SECTOR_SIZE},
+		{8192, DEFAULT_DRIVE_SECTORS, GPT_ERROR_INVALID_SECTOR_SIZE},
+		{4096, 2, GPT_ERROR_INVALID_SECTOR_NUMBER},
+		{4096, GPT_PMBR_SECTORS + GPT_HEADER_SECTORS * 2 +
+		 TOTAL_ENTRIES_SIZE / MAX_SECTOR_SIZE * 2, GPT_SUCCESS},
 	};
 	int i;
 
@@ -353,15 +403,15 @@ static int SignatureTest(void)
 	GptHeader *h2 = (GptHeader *)gpt->secondary_header;
 	int i;
 
-	EXPECT(1 == CheckHeader(NULL, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(1 == CheckHeader(NULL, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 
 	for (i = 0; i < 8; ++i) {
 		BuildTestGptData(gpt);
 		h1->signature[i] ^= 0xff;
 		h2->signature[i] ^= 0xff;
 		RefreshCrc32(gpt);
-		EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
-		EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+		EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+		EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 	}
 
 	return TEST_OK;
@@ -395,9 +445,9 @@ static int RevisionTest(void)
 		h2->revision = cases[i].value_to_test;
 		RefreshCrc32(gpt);
 
-		EXPECT(CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0) ==
+		EXPECT(CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes) ==
 		       cases[i].expect_rv);
-		EXPECT(CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0) ==
+		EXPECT(CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes) ==
 		       cases[i].expect_rv);
 	}
 	return TEST_OK;
@@ -428,9 +478,9 @@ static int SizeTest(void)
 		h2->size = cases[i].value_to_test;
 		RefreshCrc32(gpt);
 
-		EXPECT(CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0) ==
+		EXPECT(CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes) ==
 		       cases[i].expect_rv);
-		EXPECT(CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0) ==
+		EXPECT(CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes) ==
 		       cases[i].expect_rv);
 	}
 	return TEST_OK;
@@ -447,12 +497,12 @@ static int CrcFieldTest(void)
 	/* Modify a field that the header verification doesn't care about */
 	h1->entries_crc32++;
 	h2->entries_crc32++;
-	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
-	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 	/* Refresh the CRC; should pass now */
 	RefreshCrc32(gpt);
-	EXPECT(0 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
-	EXPECT(0 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(0 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(0 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 
 	return TEST_OK;
 }
@@ -468,8 +518,8 @@ static int ReservedFieldsTest(void)
 	h1->reserved_zero ^= 0x12345678;  /* whatever random */
 	h2->reserved_zero ^= 0x12345678;  /* whatever random */
 	RefreshCrc32(gpt);
-	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
-	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 
 #ifdef PADDING_CHECKED
 	/* TODO: padding check is currently disabled */
@@ -477,8 +527,8 @@ static int ReservedFieldsTest(void)
 	h1->padding[12] ^= 0x34;  /* whatever random */
 	h2->padding[56] ^= 0x78;  /* whatever random */
 	RefreshCrc32(gpt);
-	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
-	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 #endif
 
 	return TEST_OK;
@@ -516,9 +566,9 @@ static int SizeOfPartitionEntryTest(void) {
 			cases[i].value_to_test;
 		RefreshCrc32(gpt);
 
-		EXPECT(CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0) ==
+		EXPECT(CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes) ==
 		       cases[i].expect_rv);
-		EXPECT(CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0) ==
+		EXPECT(CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes) ==
 		       cases[i].expect_rv);
 	}
 
@@ -539,13 +589,13 @@ static int NumberOfPartitionEntriesTest(void)
 	h1->number_of_entries--;
 	h2->number_of_entries /= 2;
 	/* Because we halved h2 entries, its entries_lba is going to change. */
-	h2->entries_lba = h2->my_lba - CalculateEntriesSectors(h2);
+	h2->entries_lba = h2->my_lba - CalculateEntriesSectors(h2, gpt->sector_bytes);
 	RefreshCrc32(gpt);
-	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
-	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 	/* But it's okay to have less if the GPT structs are stored elsewhere. */
-	EXPECT(0 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL));
-	EXPECT(0 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL));
+	EXPECT(0 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL, gpt->sector_bytes));
+	EXPECT(0 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL, gpt->sector_bytes));
 
 	return TEST_OK;
 }
@@ -560,37 +610,37 @@ static int MyLbaTest(void)
 
 	/* myLBA depends on primary vs secondary flag */
 	BuildTestGptData(gpt);
-	EXPECT(1 == CheckHeader(h1, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
-	EXPECT(1 == CheckHeader(h2, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(1 == CheckHeader(h1, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(1 == CheckHeader(h2, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 
 	BuildTestGptData(gpt);
 	h1->my_lba--;
 	h2->my_lba--;
 	RefreshCrc32(gpt);
-	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
-	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 
 	BuildTestGptData(gpt);
 	h1->my_lba = 2;
 	h2->my_lba--;
 	RefreshCrc32(gpt);
-	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
-	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 
 	/* We should ignore the alternate_lba field entirely */
 	BuildTestGptData(gpt);
 	h1->alternate_lba++;
 	h2->alternate_lba++;
 	RefreshCrc32(gpt);
-	EXPECT(0 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
-	EXPECT(0 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(0 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(0 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 
 	BuildTestGptData(gpt);
 	h1->alternate_lba--;
 	h2->alternate_lba--;
 	RefreshCrc32(gpt);
-	EXPECT(0 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
-	EXPECT(0 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(0 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(0 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 
 	BuildTestGptData(gpt);
 	h1->entries_lba++;
@@ -600,19 +650,19 @@ static int MyLbaTest(void)
 	 * We support a padding between primary GPT header and its entries. So
 	 * this still passes.
 	 */
-	EXPECT(0 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(0 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 	/*
 	 * But the secondary table should fail because it would overlap the
 	 * header, which is now lying after its entry array.
 	 */
-	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 
 	BuildTestGptData(gpt);
 	h1->entries_lba--;
 	h2->entries_lba--;
 	RefreshCrc32(gpt);
-	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
-	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0));
+	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 
 	return TEST_OK;
 }
@@ -661,9 +711,9 @@ static int FirstUsableLbaAndLastUsableLbaTest(void)
 		h2->last_usable_lba = cases[i].secondary_last_usable_lba;
 		RefreshCrc32(gpt);
 
-		EXPECT(CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0) ==
+		EXPECT(CheckHeader(h1, 0, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes) ==
 		       cases[i].primary_rv);
-		EXPECT(CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0) ==
+		EXPECT(CheckHeader(h2, 1, gpt->streaming_drive_sectors, gpt->gpt_drive_sectors, 0, gpt->sector_bytes) ==
 		       cases[i].secondary_rv);
 	}
 
@@ -1219,6 +1269,72 @@ static int GetNextTriesTest(void)
 	return TEST_OK;
 }
 
+/*
+ * Test the index GptInit() builds of kernel entries, and that it follows
+ * updates to them.
+ */
+static int KernelIndexTest(void)
+{
+	GptData *gpt = GetEmptyGptData();
+	GptEntry *e1 = (GptEntry *)(gpt->primary_entries);
+	Guid chromeos_kernel = GPT_ENT_TYPE_CHROMEOS_KERNEL;
+	Guid chromeos_rootfs = GPT_ENT_TYPE_CHROMEOS_ROOTFS;
+	uint64_t start, size;
+
+	BuildTestGptData(gpt);
+	FillEntry(e1 + KERNEL_A, 1, 3, 1, 0);
+	FillEntry(e1 + KERNEL_B, 1, 5, 0, 2);
+	FillEntry(e1 + KERNEL_X, 0, 9, 1, 0);
+	Memcpy(&e1[KERNEL_X].type, &chromeos_rootfs, sizeof(Guid));
+	FillEntry(e1 + KERNEL_Y, 1, 3, 0, 0);
+	RefreshCrc32(gpt);
+	EXPECT(GPT_SUCCESS == GptInit(gpt));
+
+	/* Only kernels are indexed, in partition order */
+	EXPECT(1 == gpt->kernels_indexed);
+	EXPECT(3 == gpt->num_kernels);
+	EXPECT(KERNEL_A == gpt->kernels[0].entry);
+	EXPECT(KERNEL_B == gpt->kernels[1].entry);
+	EXPECT(KERNEL_Y == gpt->kernels[2].entry);
+	EXPECT(5 == gpt->kernels[1].priority);
+	EXPECT(2 == gpt->kernels[1].tries);
+	EXPECT(0 == gpt->kernels[1].successful);
+	EXPECT(1 == gpt->kernels[0].successful);
+
+	/* Sorted by priority, then partition order */
+	EXPECT(1 == gpt->kernels_by_priority[0]);
+	EXPECT(0 == gpt->kernels_by_priority[1]);
+	EXPECT(2 == gpt->kernels_by_priority[2]);
+
+	/* Lookups of kernels come from the index */
+	EXPECT(e1 + KERNEL_A == GptFindNthEntry(gpt, &chromeos_kernel, 0));
+	EXPECT(e1 + KERNEL_Y == GptFindNthEntry(gpt, &chromeos_kernel, 2));
+	EXPECT(NULL == GptFindNthEntry(gpt, &chromeos_kernel, 3));
+	EXPECT(e1 + ROOTFS_A == GptFindNthEntry(gpt, &chromeos_rootfs, 0));
+
+	/* Updates to a kernel show up in the index */
+	EXPECT(GPT_SUCCESS == GptNextKernelEntry(gpt, &start, &size));
+	EXPECT(KERNEL_B == gpt->current_kernel);
+	EXPECT(GPT_SUCCESS == GptUpdateKernelEntry(gpt, GPT_UPDATE_ENTRY_TRY));
+	EXPECT(1 == gpt->kernels[1].tries);
+	EXPECT(GPT_SUCCESS == GptUpdateKernelEntry(gpt, GPT_UPDATE_ENTRY_BAD));
+	EXPECT(0 == gpt->kernels[1].priority);
+	EXPECT(0 == gpt->kernels[1].tries);
+
+	/* Which doesn't upset the order of the kernels still to try */
+	EXPECT(GPT_SUCCESS == GptNextKernelEntry(gpt, &start, &size));
+	EXPECT(KERNEL_A == gpt->current_kernel);
+	EXPECT(GPT_ERROR_NO_VALID_KERNEL ==
+	       GptNextKernelEntry(gpt, &start, &size));
+
+	/* A failed GptInit() leaves no index behind */
+	gpt->sector_bytes = 1024;
+	EXPECT(GPT_SUCCESS != GptInit(gpt));
+	EXPECT(0 == gpt->kernels_indexed);
+
+	return TEST_OK;
+}
+
 static int GptUpdateTest(void)
 {
 	GptData *gpt = GetEmptyGptData();
@@ -1274,6 +1390,10 @@ static int GptUpdateTest(void)
 	EXPECT(0 == GetEntryTries(e2 + KERNEL_B));
 	/* And that's caused the GPT to need updating */
 	EXPECT(0x0F == gpt->modified);
+	/* With CRCs that are still good for both copies */
+	EXPECT(GPT_SUCCESS == GptSanityCheck(gpt));
+	EXPECT(MASK_BOTH == gpt->valid_headers);
+	EXPECT(MASK_BOTH == gpt->valid_entries);
 
 	/* Another kernel with tries */
 	EXPECT(GPT_SUCCESS == GptNextKernelEntry(gpt, &start, &size));
@@ -1294,6 +1414,22 @@ static int GptUpdateTest(void)
 	EXPECT(0 == GetEntrySuccessful(e + KERNEL_X));
 	EXPECT(0 == GetEntryPriority(e + KERNEL_X));
 	EXPECT(0 == GetEntryTries(e + KERNEL_X));
+	EXPECT(GPT_SUCCESS == GptSanityCheck(gpt));
+	EXPECT(MASK_BOTH == gpt->valid_headers);
+	EXPECT(MASK_BOTH == gpt->valid_entries);
+
+	/* If the secondary entries are bad, they're all copied over */
+	FillEntry(e + KERNEL_X, 1, 2, 0, 2);
+	GptModified(gpt);
+	FillEntry(e2 + KERNEL_A, 1, 3, 1, 0);
+	gpt->valid_entries = MASK_PRIMARY;
+	gpt->modified = 0;
+	EXPECT(GPT_SUCCESS == GptUpdateKernelEntry(gpt, GPT_UPDATE_ENTRY_TRY));
+	EXPECT(1 == GetEntryTries(e + KERNEL_X));
+	EXPECT(0x0F == gpt->modified);
+	EXPECT(0 == Memcmp(e, e2, TOTAL_ENTRIES_SIZE));
+	EXPECT(GPT_SUCCESS == GptSanityCheck(gpt));
+	EXPECT(MASK_BOTH == gpt->valid_entries);
 
 	/* Can't update if entry isn't a kernel, or there isn't an entry */
 	Memcpy(&e[KERNEL_X].type, &guid_rootfs, sizeof(guid_rootfs));
@@ -1307,10 +1443,164 @@ static int GptUpdateTest(void)
 	return TEST_OK;
 }
 
+/*
+ * Test that repairs only mark the sectors of the entries which differ, where
+ * the copy repaired was read from the drive.
+ */
+static int PartialRepairTest(void)
+{
+	GptData *gpt = GetEmptyGptData();
+	GptHeader *h1 = (GptHeader *)gpt->primary_header;
+	GptEntry *e1 = (GptEntry *)gpt->primary_entries;
+	uint64_t first, count;
+
+	/* Entries which weren't read are all written */
+	BuildTestGptData(gpt);
+	gpt->secondary_entries[5 * DEFAULT_SECTOR_SIZE]++;
+	GptSanityCheck(gpt);
+	EXPECT(MASK_PRIMARY == gpt->valid_entries);
+	GptRepair(gpt);
+	EXPECT(GPT_MODIFIED_ENTRIES2 == gpt->modified);
+	EXPECT(1 == GptEntriesToWrite(gpt, GPT_MODIFIED_ENTRIES2, 32,
+				      &first, &count));
+	EXPECT(32 == count);
+	EXPECT(0 == first);
+
+	/* Otherwise just from the first to the last which differ */
+	BuildTestGptData(gpt);
+	gpt->entries_loaded = GPT_MODIFIED_ENTRIES1 | GPT_MODIFIED_ENTRIES2;
+	gpt->secondary_entries[5 * DEFAULT_SECTOR_SIZE]++;
+	gpt->secondary_entries[9 * DEFAULT_SECTOR_SIZE + 100]++;
+	GptSanityCheck(gpt);
+	GptRepair(gpt);
+	EXPECT(GPT_MODIFIED_ENTRIES2 == gpt->modified);
+	EXPECT(0 == Memcmp(gpt->primary_entries, gpt->secondary_entries,
+			   PARTITION_ENTRIES_SIZE));
+	EXPECT(1 == GptEntriesToWrite(gpt, GPT_MODIFIED_ENTRIES2, 32,
+				      &first, &count));
+	EXPECT(5 == count);
+	EXPECT(5 == first);
+	EXPECT(0 == GptEntriesToWrite(gpt, GPT_MODIFIED_ENTRIES1, 32,
+				      &first, &count));
+
+	/* More sectors add to those; a copy wholly modified stays so */
+	GptEntriesModified(gpt, GPT_MODIFIED_ENTRIES2, 20, 21);
+	EXPECT(1 == GptEntriesToWrite(gpt, GPT_MODIFIED_ENTRIES2, 32,
+				      &first, &count));
+	EXPECT(16 == count);
+	EXPECT(5 == first);
+	gpt->entries_partial = 0;
+	GptEntriesModified(gpt, GPT_MODIFIED_ENTRIES2, 1, 2);
+	EXPECT(1 == GptEntriesToWrite(gpt, GPT_MODIFIED_ENTRIES2, 32,
+				      &first, &count));
+	EXPECT(32 == count);
+
+	/* A repaired header which moves its entries writes them all */
+	BuildTestGptData(gpt);
+	gpt->entries_loaded = GPT_MODIFIED_ENTRIES1 | GPT_MODIFIED_ENTRIES2;
+	h1->entries_lba = 3;
+	gpt->primary_entries[0]++;
+	GptSanityCheck(gpt);
+	EXPECT(MASK_SECONDARY == gpt->valid_headers);
+	EXPECT(MASK_SECONDARY == gpt->valid_entries);
+	GptRepair(gpt);
+	EXPECT((GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1) ==
+	       gpt->modified);
+	EXPECT(1 == GptEntriesToWrite(gpt, GPT_MODIFIED_ENTRIES1, 32,
+				      &first, &count));
+	EXPECT(32 == count);
+
+	/* Changing an entry only rewrites its sector of the secondary */
+	BuildTestGptData(gpt);
+	gpt->entries_loaded = GPT_MODIFIED_ENTRIES1 | GPT_MODIFIED_ENTRIES2;
+	SetEntryTries(e1 + 10, 3);
+	GptModified(gpt);
+	EXPECT((GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1 |
+		GPT_MODIFIED_HEADER2 | GPT_MODIFIED_ENTRIES2) == gpt->modified);
+	EXPECT(1 == GptEntriesToWrite(gpt, GPT_MODIFIED_ENTRIES1, 32,
+				      &first, &count));
+	EXPECT(32 == count);
+	EXPECT(1 == GptEntriesToWrite(gpt, GPT_MODIFIED_ENTRIES2, 32,
+				      &first, &count));
+	EXPECT(1 == count);
+	EXPECT(2 == first);
+	EXPECT(GPT_SUCCESS == GptSanityCheck(gpt));
+	EXPECT(MASK_BOTH == gpt->valid_entries);
+
+	return TEST_OK;
+}
+
 /*
  * Give an invalid kernel type, and expect GptUpdateKernelEntry() returns
  * GPT_ERROR_INVALID_UPDATE_TYPE.
  */
+/*
+ * Test that GptInit() leaves alone a secondary GPT which wasn't read, and that
+ * changing an entry still rebuilds it from the primary.
+ */
+static int GptInitSecondaryUnreadTest(void)
+{
+	GptData *gpt = GetEmptyGptData();
+	GptEntry *e = (GptEntry *)(gpt->primary_entries);
+	GptEntry *e2 = (GptEntry *)(gpt->secondary_entries);
+	uint64_t start, size;
+
+	BuildTestGptData(gpt);
+	FillEntry(e + KERNEL_A, 1, 4, 0, 2);
+	RefreshCrc32(gpt);
+	Memset(gpt->secondary_header, 0, MAX_SECTOR_SIZE);
+	Memset(gpt->secondary_entries, 0, PARTITION_ENTRIES_SIZE);
+	gpt->secondary_unread = 1;
+	EXPECT(GPT_SUCCESS == GptInit(gpt));
+	EXPECT(0 == gpt->modified);
+	EXPECT(MASK_PRIMARY == gpt->valid_headers);
+	EXPECT(MASK_PRIMARY & gpt->valid_entries);
+	EXPECT(0 == e2[KERNEL_A].starting_lba);
+
+	/* Trying a kernel updates both copies */
+	EXPECT(GPT_SUCCESS == GptNextKernelEntry(gpt, &start, &size));
+	EXPECT(KERNEL_A == gpt->current_kernel);
+	EXPECT(GPT_SUCCESS == GptUpdateKernelEntry(gpt, GPT_UPDATE_ENTRY_TRY));
+	EXPECT(0x0F == gpt->modified);
+	EXPECT(1 == GetEntryTries(e + KERNEL_A));
+	EXPECT(1 == GetEntryTries(e2 + KERNEL_A));
+	EXPECT(GPT_SUCCESS == GptSanityCheck(gpt));
+	EXPECT(MASK_BOTH == gpt->valid_headers);
+	EXPECT(MASK_BOTH == gpt->valid_entries);
+
+	/* With the write flag too, only the primary is updated */
+	BuildTestGptData(gpt);
+	FillEntry(e + KERNEL_A, 1, 4, 0, 2);
+	FillEntry(e + KERNEL_B, 1, 3, 0, 2);
+	RefreshCrc32(gpt);
+	Memset(gpt->secondary_header, 0, MAX_SECTOR_SIZE);
+	Memset(gpt->secondary_entries, 0, PARTITION_ENTRIES_SIZE);
+	gpt->secondary_unread = 1;
+	gpt->flags = GPT_FLAG_LAZY_SECONDARY | GPT_FLAG_LAZY_SECONDARY_WRITE;
+	EXPECT(GPT_SUCCESS == GptInit(gpt));
+	EXPECT(GPT_SUCCESS == GptNextKernelEntry(gpt, &start, &size));
+	EXPECT(GPT_SUCCESS == GptUpdateKernelEntry(gpt, GPT_UPDATE_ENTRY_TRY));
+	EXPECT((GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1) ==
+	       gpt->modified);
+	EXPECT(1 == GetEntryTries(e + KERNEL_A));
+	EXPECT(0 == e2[KERNEL_A].starting_lba);
+	/* The CRCs were patched to match */
+	EXPECT(0 == CheckHeader((GptHeader *)gpt->primary_header, 0,
+				gpt->streaming_drive_sectors,
+				gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(0 == CheckEntries(e, (GptHeader *)gpt->primary_header));
+	gpt->flags = 0;
+
+	/* Without the flag, the secondary is repaired as usual */
+	BuildTestGptData(gpt);
+	Memset(gpt->secondary_header, 0, MAX_SECTOR_SIZE);
+	gpt->secondary_unread = 0;
+	EXPECT(GPT_SUCCESS == GptInit(gpt));
+	EXPECT(GPT_MODIFIED_HEADER2 == gpt->modified);
+
+	return TEST_OK;
+}
+
 static int UpdateInvalidKernelTypeTest(void)
 {
 	GptData *gpt = GetEmptyGptData();
@@ -1419,6 +1709,50 @@ static int ErrorTextTest(void)
 	return TEST_OK;
 }
 
+/* Test a GPT for a native 4K drive. */
+static int Sector4kTest(void)
+{
+	GptData *gpt = GetEmptyGptData();
+	GptHeader *h1 = (GptHeader *)gpt->primary_header;
+	GptHeader *h2 = (GptHeader *)gpt->secondary_header;
+	uint64_t start, size;
+
+	BuildTest4kGptData(gpt);
+	EXPECT(4 == CalculateEntriesSectors(h1, gpt->sector_bytes));
+	EXPECT(0 == CheckHeader(h1, 0, gpt->streaming_drive_sectors,
+		gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	EXPECT(0 == CheckHeader(h2, 1, gpt->streaming_drive_sectors,
+		gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+	/* The entries don't fit in the same space with 512-byte sectors */
+	EXPECT(1 == CheckHeader(h1, 0, gpt->streaming_drive_sectors,
+		gpt->gpt_drive_sectors, 0, DEFAULT_SECTOR_SIZE));
+	EXPECT(1 == CheckHeader(h2, 1, gpt->streaming_drive_sectors,
+		gpt->gpt_drive_sectors, 0, DEFAULT_SECTOR_SIZE));
+
+	FillEntry((GptEntry *)gpt->primary_entries + KERNEL_A, 1, 2, 1, 0);
+	FillEntry((GptEntry *)gpt->secondary_entries + KERNEL_A, 1, 2, 1, 0);
+	RefreshCrc32(gpt);
+	EXPECT(GPT_SUCCESS == GptInit(gpt));
+	EXPECT(MASK_BOTH == gpt->valid_headers);
+	EXPECT(MASK_BOTH == gpt->valid_entries);
+	EXPECT(0 == gpt->modified);
+	EXPECT(GPT_SUCCESS == GptNextKernelEntry(gpt, &start, &size));
+	EXPECT(6 == start);
+	EXPECT(10 == size);
+
+	/* The secondary header is rebuilt just before its 4 entries sectors */
+	BuildTest4kGptData(gpt);
+	Memset(h2, 0, MAX_SECTOR_SIZE);
+	EXPECT(GPT_SUCCESS == GptInit(gpt));
+	EXPECT(GPT_MODIFIED_HEADER2 == gpt->modified);
+	EXPECT(63 == h2->my_lba);
+	EXPECT(59 == h2->entries_lba);
+	EXPECT(0 == CheckHeader(h2, 1, gpt->streaming_drive_sectors,
+		gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
+
+	return TEST_OK;
+}
+
 static int CheckHeaderOffDevice()
 {
 	GptData* gpt = GetEmptyGptData();
@@ -1430,26 +1764,26 @@ static int CheckHeaderOffDevice()
 	// GPT is stored on the same device so first usable lba should not
 	// start at 0.
 	EXPECT(1 == CheckHeader(primary_header, 0, gpt->streaming_drive_sectors,
-		gpt->gpt_drive_sectors, 0));
+		gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 	// But off device, it is okay to accept this GPT header.
 	EXPECT(0 == CheckHeader(primary_header, 0, gpt->streaming_drive_sectors,
-		gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL));
+		gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL, gpt->sector_bytes));
 
 	BuildTestGptData(gpt);
 	primary_header->number_of_entries = 100;
 	RefreshCrc32(gpt);
 	// Normally, number of entries is 128. So this should fail.
 	EXPECT(1 == CheckHeader(primary_header, 0, gpt->streaming_drive_sectors,
-		gpt->gpt_drive_sectors, 0));
+		gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 	// But off device, it is okay.
 	EXPECT(0 == CheckHeader(primary_header, 0, gpt->streaming_drive_sectors,
-		gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL));
+		gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL, gpt->sector_bytes));
 
 	primary_header->number_of_entries = MIN_NUMBER_OF_ENTRIES - 1;
 	RefreshCrc32(gpt);
 	// However, too few entries is not good.
 	EXPECT(1 == CheckHeader(primary_header, 0, gpt->streaming_drive_sectors,
-		gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL));
+		gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL, gpt->sector_bytes));
 
 	// Repeat for secondary header.
 	BuildTestGptData(gpt);
@@ -1457,25 +1791,25 @@ static int CheckHeaderOffDevice()
 	secondary_header->first_usable_lba = 0;
 	RefreshCrc32(gpt);
 	EXPECT(1 == CheckHeader(secondary_header, 1, gpt->streaming_drive_sectors,
-		gpt->gpt_drive_sectors, 0));
+		gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 	EXPECT(0 == CheckHeader(secondary_header, 1, gpt->streaming_drive_sectors,
-		gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL));
+		gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL, gpt->sector_bytes));
 
 	BuildTestGptData(gpt);
 	secondary_header->number_of_entries = 100;
 	/* Because we change number of entries, we need to also update entrie_lba. */
 	secondary_header->entries_lba = secondary_header->my_lba -
-		CalculateEntriesSectors(secondary_header);
+		CalculateEntriesSectors(secondary_header, gpt->sector_bytes);
 	RefreshCrc32(gpt);
 	EXPECT(1 == CheckHeader(secondary_header, 1, gpt->streaming_drive_sectors,
-		gpt->gpt_drive_sectors, 0));
+		gpt->gpt_drive_sectors, 0, gpt->sector_bytes));
 	EXPECT(0 == CheckHeader(secondary_header, 1, gpt->streaming_drive_sectors,
-		gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL));
+		gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL, gpt->sector_bytes));
 
 	secondary_header->number_of_entries = MIN_NUMBER_OF_ENTRIES - 1;
 	RefreshCrc32(gpt);
 	EXPECT(1 == CheckHeader(secondary_header, 1, gpt->streaming_drive_sectors,
-		gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL));
+		gpt->gpt_drive_sectors, GPT_FLAG_EXTERNAL, gpt->sector_bytes));
 
 	return TEST_OK;
 }
@@ -1513,13 +1847,20 @@ int main(int argc, char *argv[])
 		{ TEST_CASE(GetNextNormalTest), },
 		{ TEST_CASE(GetNextPrioTest), },
 		{ TEST_CASE(GetNextTriesTest), },
+		{ TEST_CASE(KernelIndexTest), },
 		{ TEST_CASE(GptUpdateTest), },
+		{ TEST_CASE(GptInitSecondaryUnreadTest), },
+		{ TEST_CASE(PartialRepairTest), },
 		{ TEST_CASE(UpdateInvalidKernelTypeTest), },
 		{ TEST_CASE(DuplicateUniqueGuidTest), },
 		{ TEST_CASE(TestCrc32TestVectors), },
+		{ TEST_CASE(TestCrc32Implementations), },
+		{ TEST_CASE(TestCrc32Patch), },
+		{ TEST_CASE(TestCrc32Benchmark), },
 		{ TEST_CASE(GetKernelGuidTest), },
 		{ TEST_CASE(ErrorTextTest), },
 		{ TEST_CASE(CheckHeaderOffDevice), },
+		{ TEST_CASE(Sector4kTest), },
 	};
 
 	for (i = 0; i < sizeof(test_cases)/sizeof(test_cases[0]); ++i) {
@@ -7,10 +7,33 @@
 #include "cgptlib_test.h"
 #include "crc32.h"
 #include "test_common.h"
+#include "timer_utils.h"
 #include "utility.h"
 
 #define MAX_VECTOR_LEN 256
 
+/* Size of the GPT entries array, which is the common case */
+#define ENTRIES_LEN (128 * 128)
+
+static const struct {
+  enum crc32_impl impl;
+  const char *name;
+} impls[] = {
+  {CRC32_IMPL_BYTEWISE, "bytewise"},
+  {CRC32_IMPL_SLICE_BY_8, "slice-by-8"},
+  {CRC32_IMPL_PCLMUL, "pclmul"},
+  {CRC32_IMPL_ARMV8, "armv8"},
+};
+
+static uint8_t test_buf[ENTRIES_LEN + 64];
+
+static void FillTestBuf(void) {
+  int i;
+
+  for (i = 0; i < sizeof(test_buf); ++i)
+    test_buf[i] = (uint8_t)(i * 31 + (i >> 7));
+}
+
 int TestCrc32TestVectors() {
   struct {
     uint8_t vector[MAX_VECTOR_LEN];
@@ -46,3 +69,97 @@ int TestCrc32TestVectors() {
   }
   return TEST_OK;
 }
+
+/* Every implementation must match the bytewise one, whatever the alignment */
+int TestCrc32Implementations() {
+  uint32_t expect[ENTRIES_LEN / 64 + 1];
+  int i, len, offset;
+
+  FillTestBuf();
+
+  for (i = 0; i < ARRAY_SIZE(impls); ++i) {
+    if (Crc32SelectImpl(impls[i].impl)) {
+      printf("  %s not supported; skipping\n", impls[i].name);
+      continue;
+    }
+    printf("  %s\n", impls[i].name);
+    EXPECT(TEST_OK == TestCrc32TestVectors());
+
+    for (offset = 0; offset < 16; offset += 5) {
+      for (len = 0; len <= 300; ++len) {
+        Crc32SelectImpl(CRC32_IMPL_BYTEWISE);
+        expect[0] = Crc32(test_buf + offset, len);
+        Crc32SelectImpl(impls[i].impl);
+        EXPECT(Crc32(test_buf + offset, len) == expect[0]);
+      }
+
+      for (len = 0; len <= ENTRIES_LEN; len += 64) {
+        Crc32SelectImpl(CRC32_IMPL_BYTEWISE);
+        expect[len / 64] = Crc32(test_buf + offset, len + 3);
+      }
+      Crc32SelectImpl(impls[i].impl);
+      for (len = 0; len <= ENTRIES_LEN; len += 64)
+        EXPECT(Crc32(test_buf + offset, len + 3) == expect[len / 64]);
+    }
+  }
+
+  EXPECT(0 != Crc32SelectImpl(CRC32_IMPL_ARMV8 + 1));
+  EXPECT(0 == Crc32SelectImpl(CRC32_IMPL_AUTO));
+  return TEST_OK;
+}
+
+/* Patching the CRC must give the same answer as recalculating it */
+int TestCrc32Patch() {
+  static uint8_t old_data[128];
+  uint32_t crc, len, offset, size;
+  int i;
+
+  FillTestBuf();
+
+  for (len = 1; len <= ENTRIES_LEN; len = len * 3 + 5) {
+    crc = Crc32(test_buf, len);
+    for (i = 0; i < 20; ++i) {
+      size = 1 + (i * 37) % (len < 128 ? len : 128);
+      offset = ((i * 7919) % len) % (len - size + 1);
+      Memcpy(old_data, test_buf + offset, size);
+      test_buf[offset + (i % size)] ^= 1 << (i % 8);
+      test_buf[offset] += 3;
+      crc = Crc32Patch(crc, len, offset, old_data, test_buf + offset, size);
+      EXPECT(crc == Crc32(test_buf, len));
+    }
+  }
+
+  /* Changing nothing changes nothing */
+  crc = Crc32(test_buf, 100);
+  EXPECT(Crc32Patch(crc, 100, 50, test_buf + 50, test_buf + 50, 8) == crc);
+  EXPECT(Crc32Patch(crc, 100, 100, test_buf, test_buf, 0) == crc);
+  return TEST_OK;
+}
+
+static void TimedCrc32(void* arg) {
+  Crc32(test_buf, ENTRIES_LEN);
+}
+
+/* Not a pass/fail test; just shows how fast each implementation is */
+int TestCrc32Benchmark() {
+  TimerStats st;
+  int i;
+
+  FillTestBuf();
+
+  for (i = 0; i < ARRAY_SIZE(impls); ++i) {
+    if (Crc32SelectImpl(impls[i].impl))
+      continue;
+
+    if (TimeFunction(TimedCrc32, NULL, 3, 15, 1000000, &st))
+      continue;
+
+    /* Bytes per nanosecond is 1000 MB/s */
+    printf("  %-12s %9.1f ns per %d bytes (%.0f MB/s, stddev %.1f ns)\n",
+           impls[i].name, st.ns_p50, ENTRIES_LEN,
+           ENTRIES_LEN * 1e3 / st.ns_p50, st.ns_stddev);
+  }
+
+  Crc32SelectImpl(CRC32_IMPL_AUTO);
+  return TEST_OK;
+}
@@ -6,5 +6,8 @@
 #define VBOOT_REFERENCE_CRC32_TEST_H_
 
 int TestCrc32TestVectors();
+int TestCrc32Implementations();
+int TestCrc32Patch();
+int TestCrc32Benchmark();
 
 #endif  /* VBOOT_REFERENCE_CRC32_TEST_H_ */
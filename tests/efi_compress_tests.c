@@ -0,0 +1,199 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for the EFI 1.1 compressor and decompressors used for bmpblock images.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eficompress.h"
+#include "test_common.h"
+
+#define MAX_TEST_SIZE (256 * 1024)
+
+enum data_type {
+	DATA_RANDOM,
+	DATA_RUNS,
+	DATA_REPEATS,
+	DATA_CONSTANT,
+};
+
+static uint8_t src[MAX_TEST_SIZE];
+static uint8_t comp[2 * MAX_TEST_SIZE + 64];
+static uint8_t dst[MAX_TEST_SIZE];
+static uint8_t *scratch;
+static uint32_t scratch_size;
+
+/* Fill [src] with [size] bytes that compress like [type] */
+static void MakeData(enum data_type type, uint32_t size)
+{
+	uint32_t i;
+
+	srand(size);
+	for (i = 0; i < size; i++) {
+		switch (type) {
+		case DATA_RANDOM:
+			src[i] = (uint8_t)rand();
+			break;
+		case DATA_RUNS:
+			/* Like a bitmap with a few colors */
+			src[i] = (i && rand() % 16) ? src[i - 1] : rand() % 8;
+			break;
+		case DATA_REPEATS:
+			/* Copies from anywhere in the window, and past it */
+			src[i] = i >= 1024 && rand() % 8 ?
+				src[i - 1 - rand() % (i < 16384 ? i : 16384)] :
+				(uint8_t)rand();
+			break;
+		case DATA_CONSTANT:
+			src[i] = 0xaa;
+			break;
+		}
+	}
+}
+
+/* Compress [size] bytes of [src] at [level]; returns compressed size or 0 */
+static uint32_t Compress(uint32_t size, uint32_t level)
+{
+	uint32_t comp_size = sizeof(comp);
+
+	if (EfiCompressLevel(src, size, comp, &comp_size, level))
+		return 0;
+	return comp_size;
+}
+
+static void RoundTripTest(enum data_type type, uint32_t size)
+{
+	uint32_t level, comp_size, out_size, new_scratch_size;
+	char name[80];
+
+	MakeData(type, size);
+	for (level = EFI_COMPRESS_LEVEL_MIN; level <= EFI_COMPRESS_LEVEL_MAX;
+	     level++) {
+		sprintf(name, "type %d size %u level %u", type, size, level);
+
+		comp_size = Compress(size, level);
+		TEST_NEQ(comp_size, 0, name);
+		TEST_SUCC(EfiGetInfo(comp, comp_size, &out_size,
+				     &new_scratch_size), "  get info");
+		TEST_EQ(out_size, size, "  original size");
+		TEST_EQ(new_scratch_size, scratch_size, "  scratch size");
+
+		memset(dst, 0, sizeof(dst));
+		TEST_SUCC(EfiDecompress(comp, comp_size, dst, size, scratch,
+					scratch_size), "  decompress");
+		TEST_SUCC(memcmp(dst, src, size), "  data");
+
+		memset(dst, 0, sizeof(dst));
+		TEST_SUCC(EfiDecompressFast(comp, comp_size, dst, size,
+					    scratch, scratch_size),
+			  "  decompress fast");
+		TEST_SUCC(memcmp(dst, src, size), "  data fast");
+	}
+}
+
+static void CompressTest(void)
+{
+	uint32_t small_size, best_size, comp_size;
+	uint32_t needed = 0;
+
+	MakeData(DATA_RUNS, 65536);
+
+	/* Bad levels */
+	comp_size = sizeof(comp);
+	TEST_EQ(EfiCompressLevel(src, 65536, comp, &comp_size, 0),
+		EFI_INVALID_PARAMETER, "Level 0");
+	comp_size = sizeof(comp);
+	TEST_EQ(EfiCompressLevel(src, 65536, comp, &comp_size,
+				 EFI_COMPRESS_LEVEL_MAX + 1),
+		EFI_INVALID_PARAMETER, "Level too high");
+
+	/* Default level */
+	comp_size = sizeof(comp);
+	TEST_SUCC(EfiCompress(src, 65536, comp, &comp_size), "Default level");
+	TEST_EQ(comp_size, Compress(65536, EFI_COMPRESS_LEVEL_DEFAULT),
+		"  same as default level");
+
+	/* More effort shouldn't make it bigger */
+	small_size = Compress(65536, EFI_COMPRESS_LEVEL_MIN);
+	best_size = Compress(65536, EFI_COMPRESS_LEVEL_MAX);
+	TEST_TRUE(best_size <= small_size, "Max level is smallest");
+
+	/* Output buffer too small returns the size needed */
+	needed = 16;
+	TEST_EQ(EfiCompress(src, 65536, comp, &needed), EFI_BUFFER_TOO_SMALL,
+		"Buffer too small");
+	TEST_EQ(needed, best_size, "  size needed");
+}
+
+static void DecompressErrorTest(void)
+{
+	uint32_t comp_size, i;
+	int errors = 0;
+
+	MakeData(DATA_REPEATS, 65536);
+	comp_size = Compress(65536, EFI_COMPRESS_LEVEL_DEFAULT);
+
+	TEST_EQ(EfiDecompressFast(comp, 7, dst, 65536, scratch, scratch_size),
+		EFI_INVALID_PARAMETER, "Fast source too small for header");
+	TEST_EQ(EfiDecompressFast(comp, comp_size - 1, dst, 65536, scratch,
+				  scratch_size),
+		EFI_INVALID_PARAMETER, "Fast source truncated");
+	TEST_EQ(EfiDecompressFast(comp, comp_size, dst, 65535, scratch,
+				  scratch_size),
+		EFI_INVALID_PARAMETER, "Fast wrong destination size");
+	TEST_EQ(EfiDecompressFast(comp, comp_size, dst, 65536, scratch, 16),
+		EFI_INVALID_PARAMETER, "Fast scratch too small");
+
+	/*
+	 * Flipped bits must not make the fast decoder overrun its buffers.
+	 * Some of them break the code tables, which it should notice.
+	 */
+	MakeData(DATA_RUNS, 65536);
+	comp_size = Compress(65536, EFI_COMPRESS_LEVEL_DEFAULT);
+	for (i = 8; i < comp_size; i += 7) {
+		comp[i] ^= 0x10;
+		if (EfiDecompressFast(comp, comp_size, dst, 65536, scratch,
+				      scratch_size))
+			errors++;
+		comp[i] ^= 0x10;
+	}
+	TEST_NEQ(errors, 0, "Fast corrupt data");
+}
+
+int main(void)
+{
+	uint32_t out_size;
+
+	/* Every stream needs the same scratch size */
+	comp[0] = comp[1] = comp[2] = comp[3] = 0;
+	TEST_SUCC(EfiGetInfo(comp, 8, &out_size, &scratch_size), "Get info");
+	scratch = malloc(scratch_size);
+
+	/* Empty and incompressible input */
+	RoundTripTest(DATA_RANDOM, 0);
+	RoundTripTest(DATA_RANDOM, 1);
+	RoundTripTest(DATA_RANDOM, 3);
+	RoundTripTest(DATA_RANDOM, 4096);
+	RoundTripTest(DATA_RANDOM, 65536);
+	/* Highly repetitive input */
+	RoundTripTest(DATA_RUNS, 1000);
+	RoundTripTest(DATA_RUNS, MAX_TEST_SIZE);
+	RoundTripTest(DATA_CONSTANT, 257);
+	RoundTripTest(DATA_CONSTANT, MAX_TEST_SIZE);
+	/* Matches near the edge of the 8 KB window and beyond it */
+	RoundTripTest(DATA_REPEATS, 8192);
+	RoundTripTest(DATA_REPEATS, 8193);
+	RoundTripTest(DATA_REPEATS, 20000);
+	RoundTripTest(DATA_REPEATS, MAX_TEST_SIZE);
+	CompressTest();
+	DecompressErrorTest();
+
+	free(scratch);
+
+	return gTestSuccess ? 0 : 255;
+}
@@ -0,0 +1,196 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Benchmark of the reference and fast EFI 1.1 decompressors.
+ *
+ * Usage: efi_decompress_benchmark [runs [file ...]]
+ *
+ * Each file (or, with none, some made-up bitmap-like data) is compressed at
+ * the default level, then decompressed [runs] times with each decoder.  The
+ * median time and throughput of each are printed as JSON on stdout, in the
+ * same form as vb2_crypto_benchmark.  Progress goes to stderr.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eficompress.h"
+#include "timer_utils.h"
+
+#define DEFAULT_RUNS 15
+#define MAX_RUNS 1000
+#define WARMUP_RUNS 3
+
+/* Each run repeats the operation until it takes at least this long */
+#define MIN_RUN_NSECS 1000000ULL
+
+/* Sizes of the made-up images, like a small icon up to a full screen */
+static const uint32_t fake_sizes[] = {4096, 65536, 1024 * 1024};
+
+typedef EFI_STATUS (*decompress_fn)(VOID *Source, UINT32 SrcSize,
+				    VOID *Destination, UINT32 DstSize,
+				    VOID *Scratch, UINT32 ScratchSize);
+
+struct decompress_arg {
+	decompress_fn fn;
+	uint8_t *comp;
+	uint32_t comp_size;
+	uint8_t *out;
+	uint32_t out_size;
+	uint8_t *scratch;
+	uint32_t scratch_size;
+	int failed;
+};
+
+static int runs = DEFAULT_RUNS;
+static int results_printed;
+
+static void bench_decompress(void *arg)
+{
+	struct decompress_arg *a = (struct decompress_arg *)arg;
+
+	if (a->fn(a->comp, a->comp_size, a->out, a->out_size, a->scratch,
+		  a->scratch_size))
+		a->failed = 1;
+}
+
+/* Time one decoder on [a] and print a JSON result for it */
+static void bench(const char *name, struct decompress_arg *a)
+{
+	TimerStats st;
+
+	if (TimeFunction(bench_decompress, a, WARMUP_RUNS, runs,
+			 MIN_RUN_NSECS, &st)) {
+		fprintf(stderr, "Can't time %s\n", name);
+		a->failed = 1;
+		return;
+	}
+
+	printf("%s\n    {\"name\": \"%s\", \"size\": %u, "
+	       "\"compressed_size\": %u, \"iterations\": %" PRIu64 ", "
+	       "\"ns_min\": %.1f, \"ns_p50\": %.1f, \"ns_max\": %.1f, "
+	       "\"ns_mean\": %.1f, \"ns_stddev\": %.1f, "
+	       "\"mb_per_sec\": %.2f}",
+	       results_printed ? "," : "", name, a->out_size, a->comp_size,
+	       st.iterations, st.ns_min, st.ns_p50, st.ns_max, st.ns_mean,
+	       st.ns_stddev, a->out_size * 1e3 / st.ns_p50);
+	fflush(stdout);
+	results_printed++;
+
+	fprintf(stderr, "# %-24s %10u bytes: %12.1f ns median\n",
+		name, a->out_size, st.ns_p50);
+}
+
+/* Compress [data] and time both decoders on it; returns 0 if success */
+static int bench_data(const uint8_t *data, uint32_t size)
+{
+	struct decompress_arg a;
+	uint32_t info_size;
+	int rv = 1;
+
+	memset(&a, 0, sizeof(a));
+	a.comp_size = 2 * size + 64;
+	a.comp = malloc(a.comp_size);
+	a.out = malloc(size);
+	if (!a.comp || !a.out ||
+	    EfiCompress((uint8_t *)data, size, a.comp, &a.comp_size) ||
+	    EfiGetInfo(a.comp, a.comp_size, &info_size, &a.scratch_size)) {
+		fprintf(stderr, "Can't compress %u bytes\n", size);
+		goto out;
+	}
+	a.out_size = size;
+	a.scratch = malloc(a.scratch_size);
+	if (!a.scratch)
+		goto out;
+
+	a.fn = EfiDecompress;
+	bench("efi_decompress", &a);
+	a.fn = EfiDecompressFast;
+	bench("efi_decompress_fast", &a);
+
+	if (a.failed || memcmp(a.out, data, size)) {
+		fprintf(stderr, "Decompressed data doesn't match\n");
+		goto out;
+	}
+	rv = 0;
+
+ out:
+	free(a.scratch);
+	free(a.out);
+	free(a.comp);
+	return rv;
+}
+
+/* Some data that compresses like a bitmap: rows of runs of a few colors */
+static int bench_fake(uint32_t size)
+{
+	uint8_t *data = malloc(size);
+	uint32_t i;
+	int rv;
+
+	if (!data)
+		return 1;
+	srand(0);
+	for (i = 0; i < size; i++) {
+		if (i >= 640 && rand() % 4)
+			data[i] = data[i - 640];
+		else
+			data[i] = (i && rand() % 16) ? data[i - 1] : rand() % 8;
+	}
+	rv = bench_data(data, size);
+	free(data);
+	return rv;
+}
+
+static int bench_file(const char *filename)
+{
+	uint8_t *data = NULL;
+	FILE *f;
+	long size;
+	int rv = 1;
+
+	f = fopen(filename, "rb");
+	if (!f || fseek(f, 0, SEEK_END) || (size = ftell(f)) <= 0 ||
+	    fseek(f, 0, SEEK_SET) || !(data = malloc(size)) ||
+	    fread(data, size, 1, f) != 1)
+		fprintf(stderr, "Can't read %s\n", filename);
+	else
+		rv = bench_data(data, (uint32_t)size);
+
+	free(data);
+	if (f)
+		fclose(f);
+	return rv;
+}
+
+int main(int argc, char *argv[])
+{
+	int rv = 0;
+	int i;
+
+	if (argc >= 2) {
+		runs = atoi(argv[1]);
+		if (runs < 1 || runs > MAX_RUNS) {
+			fprintf(stderr, "Usage: %s [runs [file ...]]\n"
+				"Runs must be 1-%d\n", argv[0], MAX_RUNS);
+			return 1;
+		}
+	}
+
+	printf("{\n  \"runs\": %d,\n  \"results\": [", runs);
+	if (argc > 2) {
+		for (i = 2; i < argc; i++)
+			rv |= bench_file(argv[i]);
+	} else {
+		for (i = 0; i < (int)(sizeof(fake_sizes) /
+				      sizeof(fake_sizes[0])); i++)
+			rv |= bench_fake(fake_sizes[i]);
+	}
+	printf("\n  ]\n}\n");
+
+	return rv;
+}
@@ -0,0 +1,87 @@
+#!/usr/bin/python2 -tt
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""A signing daemon for testing futility's --pem_external SOCKET.
+
+Listens on a unix socket and signs each request with the PEM file named by
+its key handle, just like external_rsa_signer.sh. The protocol is described
+in host_signature.h. Each connection and request is noted in the log file,
+so tests can see whether connections were reused.
+"""
+
+import os
+import socket
+import struct
+import subprocess
+import sys
+
+REQUEST_MAGIC = 0x56425331
+RESPONSE_MAGIC = 0x56425352
+HEADER = '>IIII'
+
+
+def recv_all(conn, size):
+  data = b''
+  while len(data) < size:
+    chunk = conn.recv(size - len(data))
+    if not chunk:
+      return None
+    data += chunk
+  return data
+
+
+def sign(key_handle, data):
+  proc = subprocess.Popen(['openssl', 'rsautl', '-sign', '-inkey', key_handle],
+                          stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+  sig = proc.communicate(data)[0]
+  if proc.returncode:
+    return None
+  return sig
+
+
+def serve(conn, log):
+  log.write('connect\n')
+  log.flush()
+  while True:
+    header = recv_all(conn, struct.calcsize(HEADER))
+    if header is None:
+      return
+    magic, req_id, key_len, data_len = struct.unpack(HEADER, header)
+    if magic != REQUEST_MAGIC:
+      return
+    key_handle = recv_all(conn, key_len)
+    data = recv_all(conn, data_len)
+    if key_handle is None or data is None:
+      return
+    log.write('sign %s\n' % key_handle.decode())
+    log.flush()
+    sig = sign(key_handle.decode(), data)
+    if sig is None:
+      conn.sendall(struct.pack(HEADER, RESPONSE_MAGIC, req_id, 1, 0))
+    else:
+      conn.sendall(struct.pack(HEADER, RESPONSE_MAGIC, req_id, 0, len(sig)) +
+                   sig)
+
+
+def main(argv):
+  if len(argv) != 3:
+    sys.stderr.write('Usage: %s <socket> <logfile>\n' % argv[0])
+    return 1
+  if os.path.exists(argv[1]):
+    os.unlink(argv[1])
+  server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+  server.bind(argv[1])
+  server.listen(5)
+  log = open(argv[2], 'a')
+  while True:
+    conn = server.accept()[0]
+    try:
+      serve(conn, log)
+    finally:
+      conn.close()
+
+
+if __name__ == '__main__':
+  sys.exit(main(sys.argv))
@@ -0,0 +1,242 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for finding the FMAP and its areas in a BIOS image, and working out
+ * how the areas nest.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fmap.h"
+#include "test_common.h"
+
+#define BUF_SIZE 0x10000
+
+static uint8_t buf[BUF_SIZE];
+
+/* Put an FMAP header with version [major] at [offset] */
+static void PutFmap(uint32_t offset, uint8_t major)
+{
+	FmapHeader *fmap = (FmapHeader *)(buf + offset);
+
+	memcpy(fmap->fmap_signature, FMAP_SIGNATURE, FMAP_SIGNATURE_SIZE);
+	fmap->fmap_ver_major = major;
+}
+
+static void FindTest(void)
+{
+	uint32_t last = BUF_SIZE - sizeof(FmapHeader);
+
+	memset(buf, 0, sizeof(buf));
+	TEST_PTR_EQ(fmap_find(buf, sizeof(buf)), NULL, "No FMAP");
+	TEST_PTR_EQ(fmap_find(buf, sizeof(FmapHeader) - 1), NULL,
+		    "Too small for an FMAP");
+
+	/* Lots of underscores to trip over */
+	memset(buf, '_', sizeof(buf));
+	TEST_PTR_EQ(fmap_find(buf, sizeof(buf)), NULL, "Only underscores");
+
+	memset(buf, 0, sizeof(buf));
+	PutFmap(0, FMAP_VER_MAJOR);
+	PutFmap(0x8000, FMAP_VER_MAJOR);
+	TEST_PTR_EQ(fmap_find(buf, sizeof(buf)), buf, "At start");
+
+	memset(buf, 0, sizeof(buf));
+	PutFmap(last - last % FMAP_SEARCH_STRIDE, FMAP_VER_MAJOR);
+	TEST_PTR_EQ(fmap_find(buf, sizeof(buf)),
+		    buf + last - last % FMAP_SEARCH_STRIDE, "At end");
+	TEST_PTR_EQ(fmap_find(buf, last - last % FMAP_SEARCH_STRIDE +
+			      sizeof(FmapHeader) - 1), NULL,
+		    "Off the end");
+
+	memset(buf, 0, sizeof(buf));
+	PutFmap(0x1002, FMAP_VER_MAJOR);
+	TEST_PTR_EQ(fmap_find(buf, sizeof(buf)), NULL, "Not aligned");
+
+	/* The most aligned one wins, wherever it is */
+	memset(buf, 0, sizeof(buf));
+	PutFmap(0x0104, FMAP_VER_MAJOR);
+	PutFmap(0x3000, FMAP_VER_MAJOR);
+	PutFmap(0x5000, FMAP_VER_MAJOR);
+	PutFmap(0x9040, FMAP_VER_MAJOR);
+	TEST_PTR_EQ(fmap_find(buf, sizeof(buf)), buf + 0x3000,
+		    "Most aligned, first");
+
+	/* But not if it's the wrong version */
+	PutFmap(0x3000, FMAP_VER_MAJOR + 1);
+	TEST_PTR_EQ(fmap_find(buf, sizeof(buf)), buf + 0x5000,
+		    "Skip wrong version");
+	PutFmap(0x5000, FMAP_VER_MAJOR + 1);
+	TEST_PTR_EQ(fmap_find(buf, sizeof(buf)), buf + 0x9040,
+		    "Next most aligned");
+}
+
+/* Put an FMAP at [offset] with [count] areas, named by [names] */
+static void PutAreas(uint32_t offset, int count, const char * const *names)
+{
+	FmapHeader *fmap = (FmapHeader *)(buf + offset);
+	FmapAreaHeader *ah = (FmapAreaHeader *)(fmap + 1);
+	int i;
+
+	PutFmap(offset, FMAP_VER_MAJOR);
+	fmap->fmap_nareas = count;
+	for (i = 0; i < count; i++) {
+		ah[i].area_offset = 0x100 * (i + 1);
+		ah[i].area_size = 0x10;
+		strncpy(ah[i].area_name, names[i], FMAP_NAMELEN);
+	}
+}
+
+static void IndexTest(void)
+{
+	static const char * const names[] = {
+		"GBB", "FW_MAIN_A", "FW_MAIN_B", "VBLOCK_A", "VBLOCK_B",
+		"RW_SECTION_A", "RW_SECTION_B", "RO_VPD", "RW_VPD",
+		/* Exactly FMAP_NAMELEN, so not terminated */
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZ012345",
+		"GBB",
+	};
+	int count = sizeof(names) / sizeof(names[0]);
+	struct fmap_index index;
+	FmapAreaHeader *ah = NULL;
+	int i;
+
+	memset(buf, 0, sizeof(buf));
+	TEST_NEQ(fmap_index_init(&index, buf, sizeof(buf)), 0, "No FMAP");
+	TEST_PTR_EQ(fmap_index_find(&index, "GBB", &ah), NULL,
+		    "  find nothing");
+	fmap_index_free(&index);
+
+	PutAreas(0x1000, count, names);
+	TEST_SUCC(fmap_index_init(&index, buf, sizeof(buf)), "Index");
+	TEST_PTR_EQ(index.fmap, buf + 0x1000, "  FMAP location");
+	TEST_EQ(index.nareas, count, "  areas");
+
+	/* The last one is a duplicate, which is never found */
+	for (i = 0; i < count - 1; i++) {
+		TEST_PTR_EQ(fmap_index_find(&index, names[i], &ah),
+			    buf + 0x100 * (i + 1), names[i]);
+		TEST_PTR_EQ(ah, (FmapAreaHeader *)(index.fmap + 1) + i,
+			    "  area header");
+		TEST_PTR_EQ(fmap_index_find(&index, names[i], NULL),
+			    fmap_find_by_name(buf, sizeof(buf), NULL,
+					      names[i], NULL),
+			    "  same as fmap_find_by_name()");
+	}
+
+	TEST_PTR_EQ(fmap_index_find(&index, "FW_MAIN", NULL), NULL,
+		    "Prefix isn't found");
+	TEST_PTR_EQ(fmap_index_find(&index, "RW_VPD_", NULL), NULL,
+		    "Longer isn't found");
+	TEST_PTR_EQ(fmap_index_find(&index, names[count - 2], NULL),
+		    fmap_index_find(&index,
+				    "ABCDEFGHIJKLMNOPQRSTUVWXYZ012345_more",
+				    NULL),
+		    "Only FMAP_NAMELEN is compared");
+	fmap_index_free(&index);
+
+	/* More areas claimed than fit in the buffer */
+	memset(buf, 0, sizeof(buf));
+	PutAreas(0x1000, count, names);
+	TEST_SUCC(fmap_index_init(&index, buf, 0x1000 + sizeof(FmapHeader) +
+				  3 * sizeof(FmapAreaHeader) + 5), "Truncated");
+	TEST_EQ(index.nareas, 3, "  areas");
+	TEST_PTR_NEQ(fmap_index_find(&index, "FW_MAIN_B", NULL), NULL,
+		     "  last that fits");
+	TEST_PTR_EQ(fmap_index_find(&index, "VBLOCK_A", NULL), NULL,
+		    "  first that doesn't");
+	fmap_index_free(&index);
+}
+
+/* Set area [i] of the FMAP at 0x1000 */
+static void PutArea(int i, const char *name, uint32_t offset, uint32_t size)
+{
+	FmapHeader *fmap = (FmapHeader *)(buf + 0x1000);
+	FmapAreaHeader *ah = (FmapAreaHeader *)(fmap + 1);
+
+	ah[i].area_offset = offset;
+	ah[i].area_size = size;
+	strncpy(ah[i].area_name, name, FMAP_NAMELEN);
+}
+
+static void TreeTest(void)
+{
+	struct fmap_tree tree;
+	FmapHeader *fmap = (FmapHeader *)(buf + 0x1000);
+	struct fmap_node *n;
+
+	memset(buf, 0, sizeof(buf));
+	TEST_NEQ(fmap_build_tree(&tree, buf, sizeof(buf)), 0, "No FMAP");
+
+	/* Out of order, as FMAPs usually are */
+	PutFmap(0x1000, FMAP_VER_MAJOR);
+	fmap->fmap_size = 0x10000;
+	fmap->fmap_nareas = 7;
+	PutArea(0, "RW_B", 0xc000, 0x4000);
+	PutArea(1, "VBLOCK_A", 0x8000, 0x1000);
+	PutArea(2, "RO", 0x0000, 0x8000);
+	PutArea(3, "FW_A", 0x9000, 0x3000);
+	PutArea(4, "GBB", 0x2000, 0x1000);
+	PutArea(5, "RW_A", 0x8000, 0x4000);
+	PutArea(6, "GBB_DUP", 0x2000, 0x1000);
+
+	TEST_SUCC(fmap_build_tree(&tree, buf, sizeof(buf)), "Tree");
+	TEST_PTR_EQ(tree.fmap, fmap, "  FMAP location");
+	TEST_EQ(tree.num_nodes, 7, "  areas");
+	TEST_EQ(tree.num_overlaps, 0, "  no overlaps");
+	n = tree.root;
+	TEST_PTR_EQ(n->ah, NULL, "  root");
+	TEST_EQ(n->end, 0x10000, "  root end");
+	TEST_EQ(n->num_children, 3, "  root children");
+	TEST_PTR_EQ(n->child[0], tree.node + 2, "  RO");
+	TEST_PTR_EQ(n->child[1], tree.node + 5, "  RW_A");
+	TEST_PTR_EQ(n->child[2], tree.node + 0, "  RW_B");
+	TEST_EQ(tree.node[0].num_children, 0, "  RW_B is a leaf");
+
+	n = tree.node + 5;
+	TEST_EQ(strcmp(n->name, "RW_A"), 0, "  RW_A name");
+	TEST_EQ(n->num_children, 2, "  RW_A children");
+	TEST_PTR_EQ(n->child[0], tree.node + 1, "  VBLOCK_A");
+	TEST_PTR_EQ(n->child[1], tree.node + 3, "  FW_A");
+	TEST_PTR_EQ(tree.node[3].parent, n, "  FW_A parent");
+
+	n = tree.node + 2;
+	TEST_EQ(n->num_children, 1, "  RO children");
+	TEST_PTR_EQ(n->child[0], tree.node + 4, "  GBB");
+	TEST_PTR_EQ(tree.node[4].alias, tree.node + 6, "  GBB_DUP alias");
+	TEST_PTR_EQ(tree.node[6].parent, NULL, "  alias not in tree");
+	fmap_free_tree(&tree);
+	TEST_PTR_EQ(tree.node, NULL, "Free");
+
+	/* FW_A now runs into RW_B */
+	PutArea(3, "FW_A", 0x9000, 0x4000);
+	TEST_SUCC(fmap_build_tree(&tree, buf, sizeof(buf)), "Overlaps");
+	TEST_EQ(tree.num_overlaps, 2, "  count");
+	TEST_PTR_EQ(tree.overlap[0].first, tree.node + 5, "  RW_A");
+	TEST_PTR_EQ(tree.overlap[0].second, tree.node + 3, "  and FW_A");
+	TEST_PTR_EQ(tree.overlap[1].first, tree.node + 3, "  FW_A");
+	TEST_PTR_EQ(tree.overlap[1].second, tree.node + 0, "  and RW_B");
+	TEST_PTR_EQ(tree.node[3].parent, tree.root, "  FW_A in root");
+	TEST_EQ(tree.root->num_children, 4, "  root children");
+	fmap_free_tree(&tree);
+
+	/* More areas claimed than fit in the buffer */
+	TEST_SUCC(fmap_build_tree(&tree, buf, 0x1000 + sizeof(FmapHeader) +
+				  3 * sizeof(FmapAreaHeader) + 5), "Truncated");
+	TEST_EQ(tree.num_nodes, 3, "  areas");
+	TEST_EQ(tree.root->num_children, 3, "  root children");
+	TEST_PTR_EQ(tree.node[1].parent, tree.root, "  VBLOCK_A in root");
+	fmap_free_tree(&tree);
+}
+
+int main(int argc, char *argv[])
+{
+	FindTest();
+	IndexTest();
+	TreeTest();
+
+	return gTestSuccess ? 0 : 255;
+}
@@ -41,16 +41,27 @@ export OUTDIR
 # These are the scripts to run. Binaries are invoked directly by the Makefile.
 TESTS="
 ${SCRIPTDIR}/test_create.sh
+${SCRIPTDIR}/test_create_keyset.sh
+${SCRIPTDIR}/test_debug_report.sh
+${SCRIPTDIR}/test_delta.sh
 ${SCRIPTDIR}/test_dump_fmap.sh
+${SCRIPTDIR}/test_dump_kernel_config.sh
 ${SCRIPTDIR}/test_gbb_utility.sh
+${SCRIPTDIR}/test_key_bundle.sh
 ${SCRIPTDIR}/test_load_fmap.sh
 ${SCRIPTDIR}/test_main.sh
+${SCRIPTDIR}/test_recovery_to_ssd.sh
+${SCRIPTDIR}/test_show_keys_summary.sh
 ${SCRIPTDIR}/test_show_kernel.sh
 ${SCRIPTDIR}/test_show_vs_verify.sh
+${SCRIPTDIR}/test_sign_batch.sh
+${SCRIPTDIR}/test_sign_disk.sh
 ${SCRIPTDIR}/test_sign_firmware.sh
 ${SCRIPTDIR}/test_sign_fw_main.sh
 ${SCRIPTDIR}/test_sign_kernel.sh
 ${SCRIPTDIR}/test_sign_keyblocks.sh
+${SCRIPTDIR}/test_verify_rootfs.sh
+${SCRIPTDIR}/test_verify_tree.sh
 "
 
 # Get ready...
@@ -24,6 +24,21 @@ for sig in rsa1024 rsa2048 rsa4096 rsa8192; do
   done
 done
 
+# The .keyb precomputation matches what dumpRSAPublicKey has always written,
+# and the public keys can be packed straight from the .pem or .crt files.
+alg=1
+for sig in rsa1024 rsa2048 rsa4096 rsa8192; do
+  ${BUILD}/utility/dumpRSAPublicKey -cert "${TESTKEYS}/key_${sig}.crt" \
+    > "${TMP}_key_${sig}.keyb"
+  cmp "${TESTKEYS}/key_${sig}.keyb" "${TMP}_key_${sig}.keyb"
+  for ext in pem crt; do
+    ${FUTILITY} vbutil_key --pack "${TMP}_key_${sig}.${ext}.vbpubk" \
+      --key "${TESTKEYS}/key_${sig}.${ext}" --version 1 --algorithm ${alg}
+    cmp "${TESTKEYS}/key_${sig}.sha256.vbpubk" \
+      "${TMP}_key_${sig}.${ext}.vbpubk"
+  done
+  alg=$(( alg + 3 ))
+done
 
 # Demonstrate that we can create some vb21 keypairs. This doesn't prove
 # prove anything until we've used them to sign some stuff, though.
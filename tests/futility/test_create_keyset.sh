@@ -0,0 +1,76 @@
+#!/bin/bash -eux
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+rm -rf "${TMP}"
+mkdir -p "${TMP}"
+
+# Start from non-default versions to see that they're used.
+cat > "${TMP}/key.versions" <<END
+firmware_key_version=2
+firmware_version=3
+kernel_key_version=4
+kernel_version=5
+END
+
+# 4k keys keep this quick enough.
+${FUTILITY} create-keyset --4k --devkeyblock "${TMP}"
+
+# Every keyblock is signed by the right key and holds the right data key.
+check_keyblock() {
+  local base=$1
+  local flags=$2
+  local pubkey=$3
+  local signkey=$4
+
+  ${FUTILITY} vbutil_keyblock --unpack "${TMP}/${base}.keyblock" \
+    --signpubkey "${TMP}/${signkey}.vbpubk" \
+    --datapubkey "${TMP}/${base}.datakey" > "${TMP}/${base}.txt"
+  grep -q "Flags: *${flags} " "${TMP}/${base}.txt"
+  cmp "${TMP}/${pubkey}.vbpubk" "${TMP}/${base}.datakey"
+}
+
+check_keyblock firmware 7 firmware_data_key root_key
+check_keyblock ec 7 ec_data_key ec_root_key
+check_keyblock dev_firmware 6 dev_firmware_data_key root_key
+check_keyblock recovery_kernel 11 recovery_kernel_data_key recovery_key
+check_keyblock kernel 7 kernel_data_key kernel_subkey
+check_keyblock installer_kernel 10 installer_kernel_data_key recovery_key
+
+# Check the key sizes and versions.
+check_key() {
+  ${FUTILITY} show "${TMP}/$1.vbpubk" > "${TMP}/$1.txt"
+  grep -q "Algorithm: *$2 " "${TMP}/$1.txt"
+  grep -q "Key Version: *$3\$" "${TMP}/$1.txt"
+}
+
+check_key root_key 8 1
+check_key firmware_data_key 7 2
+check_key dev_firmware_data_key 7 2
+check_key kernel_subkey 7 3
+check_key kernel_data_key 4 4
+check_key ec_data_key 7 1
+
+# The private keys sign what the public keys verify.
+${FUTILITY} vbutil_keyblock --pack "${TMP}/test.keyblock" \
+  --datapubkey "${TMP}/kernel_data_key.vbpubk" \
+  --signprivate "${TMP}/recovery_kernel_data_key.vbprivk"
+${FUTILITY} vbutil_keyblock --unpack "${TMP}/test.keyblock" \
+  --signpubkey "${TMP}/recovery_kernel_data_key.vbpubk"
+
+# Without a version file, one is created.
+rm -rf "${TMP}"
+mkdir -p "${TMP}"
+${FUTILITY} create_keyset --4k -j 1 "${TMP}"
+grep -q "firmware_key_version=1" "${TMP}/key.versions"
+[ ! -e "${TMP}/dev_firmware.keyblock" ]
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
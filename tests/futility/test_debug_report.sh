@@ -0,0 +1,98 @@
+#!/bin/bash -eux
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+DEVKEYS=${SRCDIR}/tests/devkeys
+CGPT=${BINDIR}/cgpt
+
+# A BIOS with the developer root and recovery keys, signed with them
+cp ${SCRIPTDIR}/data/bios_peppy_mp.bin ${TMP}.bios.mp
+cp ${TMP}.bios.mp ${TMP}.bios
+${FUTILITY} gbb_utility -s --rootkey=${DEVKEYS}/root_key.vbpubk \
+  --recoverykey=${DEVKEYS}/recovery_key.vbpubk ${TMP}.bios
+${FUTILITY} sign \
+  -s ${DEVKEYS}/firmware_data_key.vbprivk \
+  -b ${DEVKEYS}/firmware.keyblock \
+  -k ${DEVKEYS}/kernel_subkey.vbpubk \
+  -v 3 \
+  ${TMP}.bios
+
+# A normal kernel in KERN-A, and a recovery kernel in KERN-B
+echo "hi there" > ${TMP}.config.txt
+dd if=/dev/urandom bs=512 count=1 of=${TMP}.bootloader.bin
+${FUTILITY} sign \
+  --keyblock ${DEVKEYS}/kernel.keyblock \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --version 2 \
+  --config ${TMP}.config.txt \
+  --bootloader ${TMP}.bootloader.bin \
+  --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+  --arch amd64 \
+  --outfile ${TMP}.kern
+dd if=/dev/zero bs=1M count=24 of=${TMP}.disk
+${CGPT} create ${TMP}.disk
+${CGPT} add -b 64 -s 16384 -t kernel -l KERN-A -P 2 -T 1 ${TMP}.disk
+${CGPT} add -b 16448 -s 16384 -t kernel -l KERN-B ${TMP}.disk
+dd if=${TMP}.kern of=${TMP}.disk bs=512 seek=64 conv=notrunc
+dd if=${SCRIPTDIR}/data/rec_kernel_part.bin of=${TMP}.disk bs=512 seek=16448 \
+  conv=notrunc
+
+NORMAL='"checks":[{"key":"kernel_subkey_A","valid":true},{"key":"kernel_subkey_B","valid":true},{"key":"recovery_key","valid":false}]'
+RECOVERY='"checks":[{"key":"kernel_subkey_A","valid":false},{"key":"kernel_subkey_B","valid":false},{"key":"recovery_key","valid":true}]'
+
+# Both slots verify, and each kernel with the right keys
+${FUTILITY} debug_report -b ${TMP}.bios -i ${TMP}.disk > ${TMP}.report
+grep -q '"dev_keys":true' ${TMP}.report
+grep -q '"hwid":"X86 PEPPY TEST 4211"' ${TMP}.report
+[ "$(grep -o '"firmware_version":3,"version":65539' ${TMP}.report |
+  wc -l)" = "2" ]
+[ "$(grep -o '"body":"verified","valid":true' ${TMP}.report | wc -l)" = "2" ]
+grep -q '"name":"partition 1","priority":2,"tries":1,"successful":false' \
+  ${TMP}.report
+grep -q '"kernel_version":2,"version":65538' ${TMP}.report
+grep -qF "${NORMAL}" ${TMP}.report
+grep -qF "${RECOVERY}" ${TMP}.report
+
+# Just one kernel is fine too
+${FUTILITY} debug_report -b ${TMP}.bios -k ${TMP}.kern > ${TMP}.report
+grep -q "\"name\":\"${TMP}.kern\"" ${TMP}.report
+grep -qF "${NORMAL}" ${TMP}.report
+
+# A bad firmware body only spoils its own slot
+cp ${TMP}.bios ${TMP}.bios.bad
+fw_main_b=$(${FUTILITY} dump_fmap -p ${TMP}.bios FW_MAIN_B |
+  awk '{print $2}')
+printf 'xyzzy' | dd of=${TMP}.bios.bad bs=1 seek=$((fw_main_b + 16)) \
+  conv=notrunc
+${FUTILITY} debug_report -b ${TMP}.bios.bad -i ${TMP}.disk > ${TMP}.report
+grep -q '"slot":"B",.*"body":"invalid","error":"invalid body"' ${TMP}.report
+[ "$(grep -o '"body":"verified","valid":true' ${TMP}.report | wc -l)" = "1" ]
+grep -q '{"key":"kernel_subkey_A","valid":true},{"key":"recovery_key"' \
+  ${TMP}.report
+
+# With the MP keys, nothing on the disk verifies
+${FUTILITY} debug_report -b ${TMP}.bios.mp -i ${TMP}.disk > ${TMP}.report
+grep -q '"dev_keys":false' ${TMP}.report
+if grep -q '"key":"[a-z_AB]*","valid":true' ${TMP}.report; then false; fi
+
+# Things that aren't there are reported, not fatal
+${FUTILITY} debug_report -b ${TMP}.nothing -k ${TMP}.config.txt \
+  > ${TMP}.report
+grep -q '"firmware":{"file":"[^"]*","error":' ${TMP}.report
+grep -q '"error":"invalid keyblock"' ${TMP}.report
+${FUTILITY} debug_report -b ${TMP}.bios -i ${TMP}.kern > ${TMP}.report
+grep -q '"disk":"[^"]*","error":' ${TMP}.report
+
+# But bad arguments are
+if ${FUTILITY} debug_report -b ${TMP}.bios extra; then false; fi
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
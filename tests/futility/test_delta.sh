@@ -0,0 +1,75 @@
+#!/bin/bash -eux
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+BASE=${SCRIPTDIR}/data/bios_peppy_mp.bin
+OTHER=${SCRIPTDIR}/data/bios_link_mp.bin
+
+# Change an area the signatures don't cover
+cp ${BASE} ${TMP}.new.bin
+${FUTILITY} dump_fmap -x ${TMP}.new.bin RO_VPD
+size=$(stat -c '%s' RO_VPD)
+dd if=/dev/urandom of=${TMP}.rand bs=$size count=1
+${FUTILITY} load_fmap ${TMP}.new.bin RO_VPD:${TMP}.rand
+
+# The delta has just that area in it, and gives back the same image
+${FUTILITY} delta ${BASE} ${TMP}.new.bin ${TMP}.delta > ${TMP}.create.txt
+grep -q "^RO_VPD: " ${TMP}.create.txt
+[ $(grep -c "changed$" ${TMP}.create.txt) -eq 1 ]
+[ $(stat -c '%s' ${TMP}.delta) -lt $(( size + 65536 )) ]
+${FUTILITY} delta --apply -j 3 ${BASE} ${TMP}.delta ${TMP}.out.bin \
+  > ${TMP}.apply.txt
+grep -q "Firmware VBLOCKs verified" ${TMP}.apply.txt
+cmp ${TMP}.new.bin ${TMP}.out.bin
+
+# No change at all is an empty delta
+${FUTILITY} delta -j 1 ${BASE} ${BASE} ${TMP}.same.delta
+${FUTILITY} delta -a ${BASE} ${TMP}.same.delta ${TMP}.same.bin
+cmp ${BASE} ${TMP}.same.bin
+
+# Applying to the wrong image fails, and writes nothing
+rm -f ${TMP}.out.bin
+if ${FUTILITY} delta --apply ${OTHER} ${TMP}.delta ${TMP}.out.bin; then
+  false
+fi
+[ ! -e ${TMP}.out.bin ]
+
+# So does applying to a changed base
+cp ${BASE} ${TMP}.base.bin
+${FUTILITY} load_fmap ${TMP}.base.bin RO_VPD:${TMP}.rand
+if ${FUTILITY} delta --apply ${TMP}.base.bin ${TMP}.delta ${TMP}.out.bin; then
+  false
+fi
+[ ! -e ${TMP}.out.bin ]
+
+# A result whose firmware doesn't verify isn't written, unless asked
+cp ${BASE} ${TMP}.bad.bin
+${FUTILITY} dump_fmap -x ${TMP}.bad.bin FW_MAIN_A
+dd if=/dev/urandom of=${TMP}.rand bs=$(stat -c '%s' FW_MAIN_A) count=1
+${FUTILITY} load_fmap ${TMP}.bad.bin FW_MAIN_A:${TMP}.rand
+${FUTILITY} delta ${BASE} ${TMP}.bad.bin ${TMP}.bad.delta
+if ${FUTILITY} delta --apply ${BASE} ${TMP}.bad.delta ${TMP}.out.bin; then
+  false
+fi
+[ ! -e ${TMP}.out.bin ]
+${FUTILITY} delta --apply --no-verify ${BASE} ${TMP}.bad.delta ${TMP}.out.bin
+cmp ${TMP}.bad.bin ${TMP}.out.bin
+
+# A damaged delta is refused
+head -c 100 ${TMP}.delta > ${TMP}.short.delta
+rm -f ${TMP}.out.bin
+if ${FUTILITY} delta --apply ${BASE} ${TMP}.short.delta ${TMP}.out.bin; then
+  false
+fi
+[ ! -e ${TMP}.out.bin ]
+
+# cleanup
+rm -f ${TMP}* RO_VPD FW_MAIN_A
+exit 0
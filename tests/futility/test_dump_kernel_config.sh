@@ -0,0 +1,36 @@
+#!/bin/bash -eux
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+KERN=${SCRIPTDIR}/data/rec_kernel_part.bin
+
+# The config is the same one vbutil_kernel finds
+expect=$(${FUTILITY} vbutil_kernel --verify ${KERN} --verbose |
+  sed -e '1,/^Config:$/d')
+${FUTILITY} dump_kernel_config ${KERN} > ${TMP}.got
+[ "$(cat ${TMP}.got)" = "${expect}" ]
+
+# Even when the partition is much bigger than the kernel
+cp ${KERN} ${TMP}.kern
+truncate -s 64M ${TMP}.kern
+${FUTILITY} dump_kernel_config ${TMP}.kern > ${TMP}.got.big
+cmp ${TMP}.got ${TMP}.got.big
+
+# But not when the config isn't there
+truncate -s 65536 ${TMP}.kern
+if ${FUTILITY} dump_kernel_config ${TMP}.kern; then false; fi
+
+# Or when there's nothing but zeros
+dd if=/dev/zero of=${TMP}.zero bs=4096 count=16 2>/dev/null
+if ${FUTILITY} dump_kernel_config ${TMP}.zero; then false; fi
+
+# cleanup
+rm -f ${TMP}*
+exit 0
@@ -230,6 +230,25 @@ ${FUTILITY} gbb_utility -g --digest ${TMP}.blob.bad | grep 'invalid'
 cat ${TMP}.blob | ${REPLACE} 0x84 0x70 0x71 0x72 > ${TMP}.blob.bad
 ${FUTILITY} gbb_utility -g --digest ${TMP}.blob.bad | grep 'invalid'
 
+# Changing an image in place gives the same result as writing a new one, and
+# leaves everything outside the GBB alone.
+cp ${SCRIPTDIR}/data/bios_peppy_mp.bin ${TMP}.image
+${FUTILITY} gbb_utility -s --flags=0x39 --hwid="IN PLACE" \
+  ${TMP}.image ${TMP}.image.copy
+ln -s ${TMP}.image ${TMP}.image.link
+${FUTILITY} gbb_utility -s --flags=0x39 ${TMP}.image ${TMP}.image.link
+${FUTILITY} gbb_utility -s --hwid="IN PLACE" ${TMP}.image
+cmp ${TMP}.image ${TMP}.image.copy
+${FUTILITY} gbb_utility -g --flags ${TMP}.image | grep -q 0x00000039
+[ "$(cmp -l ${SCRIPTDIR}/data/bios_peppy_mp.bin ${TMP}.image | wc -l)" -lt 4096 ]
+
+# Nothing is written if something's wrong
+cp ${TMP}.image ${TMP}.image.orig
+toolong=$(printf "%0300d" 0)
+if ${FUTILITY} gbb_utility -s --flags=0x1 --hwid="${toolong}" ${TMP}.image
+  then false; fi
+cmp ${TMP}.image ${TMP}.image.orig
+
 # cleanup
 rm -f ${TMP}*
 exit 0
@@ -0,0 +1,114 @@
+#!/bin/bash -eux
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+DEVKEYS=${SRCDIR}/tests/devkeys
+TESTKEYS=${SRCDIR}/tests/testkeys
+BUNDLE=${TMP}.bundle
+
+echo "hi there" > ${TMP}.config.txt
+dd if=/dev/urandom bs=512 count=1 of=${TMP}.bootloader.bin
+dd if=/dev/urandom bs=32768 count=1 of=${TMP}.fv.bin
+
+# Pack the dev keys, and a PEM key
+${FUTILITY} key_bundle ${BUNDLE} ${DEVKEYS}/*.vb* ${DEVKEYS}/*.keyblock \
+  ${TESTKEYS}/key_rsa4096.pem
+${FUTILITY} key_bundle --list ${BUNDLE} > ${TMP}.list
+grep -q ' kernel_data_key.vbprivk$' ${TMP}.list
+grep -q ' key_rsa4096.pem$' ${TMP}.list
+
+# Names are sorted, and every key is aligned
+awk '{print $4}' ${TMP}.list > ${TMP}.names
+LC_ALL=C sort -c ${TMP}.names
+while read id offset size name; do
+  [ $((offset % 64)) -eq 0 ]
+done < ${TMP}.list
+
+# Kernels signed from the bundle are the same as from the files
+sign_kernel () {
+  ${FUTILITY} vbutil_kernel --pack $1 \
+    --keyblock ${2}kernel.keyblock \
+    --signprivate ${2}kernel_data_key.vbprivk \
+    --version 1 \
+    --config ${TMP}.config.txt \
+    --bootloader ${TMP}.bootloader.bin \
+    --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+    --arch amd64
+}
+sign_kernel ${TMP}.kern.files ${DEVKEYS}/
+sign_kernel ${TMP}.kern.bundle ${BUNDLE}:
+cmp ${TMP}.kern.files ${TMP}.kern.bundle
+${FUTILITY} vbutil_kernel --verify ${TMP}.kern.bundle \
+  --signpubkey ${BUNDLE}:kernel_subkey.vbpubk
+
+# And firmware
+sign_firmware () {
+  ${FUTILITY} vbutil_firmware --vblock $1 \
+    --keyblock ${2}firmware.keyblock \
+    --signprivate ${2}firmware_data_key.vbprivk \
+    --version 1 \
+    --kernelkey ${2}kernel_subkey.vbpubk \
+    --fv ${TMP}.fv.bin
+}
+sign_firmware ${TMP}.fw.files ${DEVKEYS}/
+sign_firmware ${TMP}.fw.bundle ${BUNDLE}:
+cmp ${TMP}.fw.files ${TMP}.fw.bundle
+
+# And keyblocks, signed with the PEM key
+sign_keyblock () {
+  ${FUTILITY} vbutil_keyblock --pack $1 \
+    --datapubkey ${2}firmware_data_key.vbpubk \
+    --signprivate_pem ${3}key_rsa4096.pem \
+    --pem_algorithm 8 \
+    --flags 9
+}
+sign_keyblock ${TMP}.keyblock.files ${DEVKEYS}/ ${TESTKEYS}/
+sign_keyblock ${TMP}.keyblock.bundle ${BUNDLE}: ${BUNDLE}:
+cmp ${TMP}.keyblock.files ${TMP}.keyblock.bundle
+
+# A key can be named by its SHA-1 instead
+id=$(sha1sum ${DEVKEYS}/kernel_data_key.vbprivk | cut -d' ' -f1)
+${FUTILITY} vbutil_key --unpack ${BUNDLE}:${id} | grep -v 'file:' \
+  > ${TMP}.key.id
+${FUTILITY} vbutil_key --unpack ${DEVKEYS}/kernel_data_key.vbprivk \
+  | grep -v 'file:' > ${TMP}.key.files
+cmp ${TMP}.key.files ${TMP}.key.id
+
+# Keys which aren't there, and bundles which aren't bundles
+if ${FUTILITY} vbutil_key --unpack ${BUNDLE}:nope.vbpubk; then false; fi
+if ${FUTILITY} vbutil_key --unpack ${TMP}.config.txt:kernel_subkey.vbpubk; then
+  false
+fi
+if ${FUTILITY} key_bundle --list ${TMP}.config.txt; then false; fi
+
+# A key named by its SHA-1 must still match it
+read id offset size name < <(grep ' kernel_subkey.vbpubk$' ${TMP}.list)
+cp ${BUNDLE} ${TMP}.corrupt
+printf '\x55' | dd of=${TMP}.corrupt bs=1 seek=$((offset + size - 1)) \
+  conv=notrunc
+${FUTILITY} vbutil_key --unpack ${TMP}.corrupt:${name}
+if ${FUTILITY} vbutil_key --unpack ${TMP}.corrupt:${id}; then false; fi
+
+# Names must be in order, so they can be searched
+entries=$(od -An -t u4 -j 24 -N 4 ${BUNDLE})
+cp ${BUNDLE} ${TMP}.unsorted
+printf '\x01' | dd of=${TMP}.unsorted bs=1 seek=$((entries + 96)) \
+  conv=notrunc
+if ${FUTILITY} key_bundle --list ${TMP}.unsorted; then false; fi
+if ${FUTILITY} vbutil_key --unpack ${TMP}.unsorted:${id}; then false; fi
+
+# Names must be unique
+if ${FUTILITY} key_bundle ${TMP}.bad ${DEVKEYS}/root_key.vbpubk \
+  ${DEVKEYS}/root_key.vbpubk; then false; fi
+[ ! -e ${TMP}.bad ]
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
@@ -22,6 +22,15 @@ LOG="/tmp/futility.log"
 touch ${LOG}
 ${FUTILITY} help
 grep ${FUTILITY} ${LOG}
+
+# ...unless it's turned off, or pointed somewhere else.
+: > ${LOG}
+FUTILITY_LOGFILE= ${FUTILITY} help
+[ ! -s ${LOG} ]
+touch "$TMP.log"
+FUTILITY_LOGFILE="$TMP.log" ${FUTILITY} help
+grep ${FUTILITY} "$TMP.log"
+[ ! -s ${LOG} ]
 rm -f ${LOG}
 [ -f ${LOG}.backup ] && mv ${LOG}.backup ${LOG}
 
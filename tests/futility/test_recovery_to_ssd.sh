@@ -0,0 +1,113 @@
+#!/bin/bash -eux
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+DEVKEYS=${SRCDIR}/tests/devkeys
+CGPT=${BINDIR}/cgpt
+
+echo "hi there" > ${TMP}.config.txt
+dd if=/dev/urandom bs=512 count=1 of=${TMP}.bootloader.bin
+
+# The recovery kernel, and the SSD kernel with its own vblock
+sign_kernel () {
+  ${FUTILITY} vbutil_kernel --pack $1 \
+    --keyblock ${DEVKEYS}/$2.keyblock \
+    --signprivate ${DEVKEYS}/$2_data_key.vbprivk \
+    --version 1 \
+    --config ${TMP}.config.txt \
+    --bootloader ${TMP}.bootloader.bin \
+    --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+    --arch amd64 ${3:-}
+}
+sign_kernel ${TMP}.kern.recovery recovery_kernel
+sign_kernel ${TMP}.kern.ssd recovery_kernel
+sign_kernel ${TMP}.vblock kernel --vblockonly
+
+# Same layout as a real image: KERN-A, ROOT-A, KERN-B, then STATE
+make_image () {
+  rm -f $1
+  truncate -s 20M $1
+  ${CGPT} create $1
+  ${CGPT} add -i 2 -b 64 -s 8192 -t kernel -l KERN-A $1
+  ${CGPT} add -i 3 -b 8256 -s 16384 -t rootfs -l ROOT-A $1
+  ${CGPT} add -i 4 -b 24640 -s 8192 -t kernel -l KERN-B $1
+  ${CGPT} add -i 1 -b 32832 -s 2048 -t data -l STATE $1
+  dd if=/dev/urandom of=$1 bs=512 seek=32832 count=2048 conv=notrunc
+}
+part () {
+  dd if=$1 of=$1.p$2 bs=512 skip=$3 count=$4
+}
+
+# A recovery image whose rootfs is mostly a hole
+make_image ${TMP}.recovery
+dd if=${TMP}.kern.recovery of=${TMP}.recovery bs=512 seek=64 conv=notrunc
+dd if=/dev/urandom of=${TMP}.recovery bs=512 seek=8256 count=1024 conv=notrunc
+dd if=/dev/urandom of=${TMP}.recovery bs=512 seek=23616 count=1024 \
+  conv=notrunc
+dd if=${TMP}.kern.ssd of=${TMP}.recovery bs=512 seek=24640 conv=notrunc
+
+# Converted in place, KERN-B ends up in KERN-A, under the new vblock
+cp ${TMP}.recovery ${TMP}.ssd
+${FUTILITY} recovery_to_ssd --vblock ${TMP}.vblock ${TMP}.ssd
+part ${TMP}.recovery 4 24640 8192
+part ${TMP}.ssd 2 64 8192
+part ${TMP}.ssd 4 24640 8192
+vbsize=$(stat -c %s ${TMP}.vblock)
+cmp -n ${vbsize} ${TMP}.vblock ${TMP}.ssd.p2
+cmp -i ${vbsize} ${TMP}.recovery.p4 ${TMP}.ssd.p2
+cmp -n $(( 8192 * 512 )) /dev/zero ${TMP}.ssd.p4
+${FUTILITY} vbutil_kernel --verify ${TMP}.ssd.p2 \
+  --signpubkey ${DEVKEYS}/kernel_subkey.vbpubk
+
+# Nothing else changes, and KERN-B is a hole now
+cmp -n $(( 64 * 512 )) ${TMP}.recovery ${TMP}.ssd
+cmp -i $(( 8256 * 512 )) -n $(( 16384 * 512 )) ${TMP}.recovery ${TMP}.ssd
+cmp -i $(( 32832 * 512 )) ${TMP}.recovery ${TMP}.ssd
+[ $(stat -c %b ${TMP}.ssd) -lt $(stat -c %b ${TMP}.recovery) ]
+
+# Without a vblock, KERN-A can be resigned in place afterwards
+cp ${TMP}.recovery ${TMP}.ssd2
+${FUTILITY} recovery_to_ssd ${TMP}.ssd2
+${FUTILITY} sign --partition 2 \
+  --keyblock ${DEVKEYS}/kernel.keyblock \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  ${TMP}.ssd2
+part ${TMP}.ssd2 2 64 8192
+${FUTILITY} vbutil_kernel --verify ${TMP}.ssd2.p2 \
+  --signpubkey ${DEVKEYS}/kernel_subkey.vbpubk
+
+# A full SSD image keeps its own stateful partition, and takes the rootfs
+# from the recovery image, holes and all
+make_image ${TMP}.full
+dd if=/dev/urandom of=${TMP}.full bs=512 seek=64 count=8192 conv=notrunc
+dd if=/dev/urandom of=${TMP}.full bs=512 seek=8256 count=16384 conv=notrunc
+dd if=/dev/urandom of=${TMP}.full bs=512 seek=24640 count=8192 conv=notrunc
+cp ${TMP}.full ${TMP}.full.orig
+blocks=$(stat -c %b ${TMP}.full)
+${FUTILITY} recovery_to_ssd --vblock ${TMP}.vblock \
+  --recovery ${TMP}.recovery ${TMP}.full
+cmp -i $(( 8256 * 512 )) -n $(( 16384 * 512 )) ${TMP}.recovery ${TMP}.full
+cmp -i $(( 64 * 512 )) -n $(( 8192 * 512 )) ${TMP}.ssd ${TMP}.full
+cmp -i $(( 32832 * 512 )) ${TMP}.full.orig ${TMP}.full
+part ${TMP}.full 4 24640 8192
+cmp -n $(( 8192 * 512 )) /dev/zero ${TMP}.full.p4
+[ $(( blocks - $(stat -c %b ${TMP}.full) )) -gt $(( 10 * 1024 * 2 )) ]
+
+# KERN-B has to be a kernel
+cp ${TMP}.recovery ${TMP}.bad
+${CGPT} add -i 4 -t data ${TMP}.bad
+cp ${TMP}.bad ${TMP}.bad.orig
+if ${FUTILITY} recovery_to_ssd ${TMP}.bad 2> ${TMP}.bad.err; then false; fi
+grep -q "Partition 4 of ${TMP}.bad isn't a kernel" ${TMP}.bad.err
+cmp ${TMP}.bad ${TMP}.bad.orig
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
@@ -0,0 +1,91 @@
+#!/bin/bash -eux
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+DEVKEYS=${SRCDIR}/tests/devkeys
+CGPT=${BINDIR}/cgpt
+
+BIOSES="${SCRIPTDIR}/data/bios_link_mp.bin
+        ${SCRIPTDIR}/data/bios_mario_mp.bin
+        ${SCRIPTDIR}/data/bios_peppy_mp.bin
+        ${SCRIPTDIR}/data/bios_zgb_mp.bin"
+
+# The summary has the same sha1sums that show finds, in the same order
+for b in ${BIOSES} ${SCRIPTDIR}/data/rec_kernel_part.bin \
+    ${DEVKEYS}/firmware.keyblock ${DEVKEYS}/root_key.vbpubk; do
+  ${FUTILITY} show ${b} | grep 'sha1sum:' | awk '{print $NF}' > ${TMP}.want
+  ${FUTILITY} show --keys-summary ${b} > ${TMP}.got
+  head -n 1 ${TMP}.got | grep -q "^${b}: "
+  grep -o '[0-9a-f]\{40\}' ${TMP}.got > ${TMP}.sums
+  [ -s ${TMP}.sums ]
+  cmp ${TMP}.want ${TMP}.sums
+done
+
+# Including the HWID and the keyblock flags
+${FUTILITY} show --keys-summary ${SCRIPTDIR}/data/bios_zgb_mp.bin > ${TMP}.got
+grep -q 'GBB hwid: *{FA42644C-CF3A-4692-A9D3-1A667CB232E9}$' ${TMP}.got
+grep -q 'VBLOCK_A data key: *[0-9a-f]*  (DEV !REC)$' ${TMP}.got
+${FUTILITY} show --keys-summary ${SCRIPTDIR}/data/rec_kernel_part.bin |
+  grep -q 'data key: *e78ce746a037837155388a1096212ded04fb86eb  (!DEV DEV REC)'
+
+# Each kernel on a disk image is listed, but not an empty partition
+echo "hi there" > ${TMP}.config.txt
+dd if=/dev/urandom bs=512 count=1 of=${TMP}.bootloader.bin
+${FUTILITY} sign \
+  --keyblock ${DEVKEYS}/kernel.keyblock \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --version 1 \
+  --config ${TMP}.config.txt \
+  --bootloader ${TMP}.bootloader.bin \
+  --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+  --arch amd64 \
+  --outfile ${TMP}.kern
+dd if=/dev/zero bs=1M count=24 of=${TMP}.disk
+${CGPT} create ${TMP}.disk
+${CGPT} add -b 64 -s 16384 -t kernel -l KERN-A ${TMP}.disk
+${CGPT} add -b 16448 -s 16384 -t kernel -l KERN-B ${TMP}.disk
+${CGPT} add -b 32832 -s 1 -t kernel -l KERN-C ${TMP}.disk
+dd if=${TMP}.kern of=${TMP}.disk bs=512 seek=64 conv=notrunc
+dd if=${SCRIPTDIR}/data/rec_kernel_part.bin of=${TMP}.disk bs=512 seek=16448 \
+  conv=notrunc
+
+${FUTILITY} show --keys-summary ${TMP}.disk > ${TMP}.got
+kernel_key=$(${FUTILITY} show ${DEVKEYS}/kernel.keyblock |
+  grep 'sha1sum:' | awk '{print $NF}')
+grep -q "^  Kernel partition 1 data key: *${kernel_key}  (!DEV DEV !REC)$" \
+  ${TMP}.got
+grep -q "^  Kernel partition 2 data key: *e78ce746a037837155388a1096212ded04fb86eb" \
+  ${TMP}.got
+[ "$(grep -c 'Kernel partition' ${TMP}.got)" = "2" ]
+
+# Lots of files at once come out the same, and in order, however many jobs
+# there are
+FILES="${BIOSES} ${TMP}.disk ${SCRIPTDIR}/data/rec_kernel_part.bin ${BIOSES}"
+: > ${TMP}.one_at_a_time
+for f in ${FILES}; do
+  ${FUTILITY} show --keys-summary ${f} >> ${TMP}.one_at_a_time
+done
+${FUTILITY} show --keys-summary -j 1 ${FILES} > ${TMP}.j1
+${FUTILITY} show --keys-summary --jobs 4 ${FILES} > ${TMP}.j4
+cmp ${TMP}.one_at_a_time ${TMP}.j1
+cmp ${TMP}.one_at_a_time ${TMP}.j4
+
+# Files that aren't anything fail, but don't stop the others
+if ${FUTILITY} show --keys-summary -j 2 ${TMP}.config.txt \
+    ${SCRIPTDIR}/data/bios_peppy_mp.bin > ${TMP}.got; then false; fi
+grep -q "^${SCRIPTDIR}/data/bios_peppy_mp.bin: " ${TMP}.got
+
+# And the summary doesn't go with other output
+if ${FUTILITY} show --keys-summary --json ${TMP}.disk; then false; fi
+if ${FUTILITY} show --keys-summary -j 0 ${TMP}.disk; then false; fi
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
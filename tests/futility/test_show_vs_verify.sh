@@ -70,6 +70,128 @@ ${FUTILITY} verify ${SCRIPTDIR}/data/rec_kernel_part.bin \
   --publickey ${DEVKEYS}/recovery_key.vbpubk
 
 
+#### batch mode
+
+# Hashing the bodies up front shouldn't change anything we see.
+${FUTILITY} show ${SCRIPTDIR}/data/bios_*_mp.bin \
+  ${SCRIPTDIR}/data/rec_kernel_part.bin > ${TMP}.serial
+${FUTILITY} show --batch ${SCRIPTDIR}/data/bios_*_mp.bin \
+  ${SCRIPTDIR}/data/rec_kernel_part.bin > ${TMP}.batch
+cmp ${TMP}.serial ${TMP}.batch
+
+${FUTILITY} verify --batch ${SCRIPTDIR}/data/rec_kernel_part.bin \
+  --publickey ${DEVKEYS}/recovery_key.vbpubk
+
+if ${FUTILITY} verify --batch ${SCRIPTDIR}/data/rec_kernel_part.bin \
+  --publickey ${DEVKEYS}/kernel_subkey.vbpubk ; then false ; fi
+
+
+#### BIOS image
+
+# The A and B slots may be checked at the same time, but a bad body in
+# either one must still be noticed.
+${FUTILITY} verify ${SCRIPTDIR}/data/bios_peppy_mp.bin
+
+for area in FW_MAIN_A FW_MAIN_B; do
+  cp ${SCRIPTDIR}/data/bios_peppy_mp.bin ${TMP}.bios
+  offset=$(${FUTILITY} dump_fmap -p ${TMP}.bios ${area} | cut -d' ' -f2)
+  printf '\xff' | dd of=${TMP}.bios bs=1 seek=$((offset + 16)) conv=notrunc
+  if ${FUTILITY} verify ${TMP}.bios ; then false ; fi
+done
+
+
+#### JSON output
+
+# One line per file, with the same results as the text
+${FUTILITY} show --json ${SCRIPTDIR}/data/bios_peppy_mp.bin \
+  ${SCRIPTDIR}/data/rec_kernel_part.bin > ${TMP}.json
+[ "$(wc -l < ${TMP}.json)" = 2 ]
+head -1 ${TMP}.json | grep -q '"type":"Chrome OS BIOS image","fmap":\['
+head -1 ${TMP}.json | grep -q '{"name":"FW_MAIN_A","offset":2162688,'
+sha1=$(${FUTILITY} show ${SCRIPTDIR}/data/bios_peppy_mp.bin |
+  grep -m1 'Key sha1sum' | sed 's/.* //')
+head -1 ${TMP}.json | grep -q '"root_key":{[^}]*"sha1sum":"'${sha1}'"}'
+head -1 ${TMP}.json | grep -q '"valid":true}$'
+tail -1 ${TMP}.json | grep -q '"component":"kernel_preamble"'
+
+# Verification status is reported per component and per file
+if ${FUTILITY} verify --json ${SCRIPTDIR}/data/rec_kernel_part.bin \
+  --publickey ${DEVKEYS}/kernel_subkey.vbpubk > ${TMP}.json ; then false ; fi
+grep -q '"signature":"invalid"' ${TMP}.json
+grep -q '"valid":false}\],"valid":false}$' ${TMP}.json
+${FUTILITY} verify --json ${SCRIPTDIR}/data/rec_kernel_part.bin \
+  --publickey ${DEVKEYS}/recovery_key.vbpubk > ${TMP}.json
+grep -q '"signature":"valid".*"body":"verified"' ${TMP}.json
+grep -q '"valid":true}\],"valid":true}$' ${TMP}.json
+
+
+#### Verification cache
+
+# The first run fills it, the next ones use it, with the same results
+rm -f ${TMP}.cache
+${FUTILITY} verify --cache ${TMP}.cache ${SCRIPTDIR}/data/bios_peppy_mp.bin \
+  > ${TMP}.uncached
+[ -s ${TMP}.cache ]
+cp ${TMP}.cache ${TMP}.cache.1
+${FUTILITY} verify --cache ${TMP}.cache ${SCRIPTDIR}/data/bios_peppy_mp.bin \
+  > ${TMP}.cached
+cmp ${TMP}.uncached ${TMP}.cached
+cmp ${TMP}.cache ${TMP}.cache.1
+${FUTILITY} verify --cache ${TMP}.cache --recheck \
+  ${SCRIPTDIR}/data/bios_peppy_mp.bin > ${TMP}.cached
+cmp ${TMP}.uncached ${TMP}.cached
+
+# A good signature for one key isn't good for another
+${FUTILITY} verify --cache ${TMP}.cache ${SCRIPTDIR}/data/rec_kernel_part.bin \
+  --publickey ${DEVKEYS}/recovery_key.vbpubk
+if ${FUTILITY} verify --cache ${TMP}.cache \
+  ${SCRIPTDIR}/data/rec_kernel_part.bin \
+  --publickey ${DEVKEYS}/kernel_subkey.vbpubk ; then false ; fi
+
+# Nor is it good for a different body
+cp ${SCRIPTDIR}/data/rec_kernel_part.bin ${TMP}.kern
+printf 'x' | dd of=${TMP}.kern bs=1 seek=100000 conv=notrunc 2>/dev/null
+if ${FUTILITY} verify --cache ${TMP}.cache ${TMP}.kern \
+  --publickey ${DEVKEYS}/recovery_key.vbpubk ; then false ; fi
+
+# It has to be a cache file
+echo "not a cache" > ${TMP}.bogus
+if ${FUTILITY} verify --cache ${TMP}.bogus ${SCRIPTDIR}/data/bios_peppy_mp.bin
+  then false ; fi
+
+# verify_tree shares one between its workers
+rm -f ${TMP}.cache
+${FUTILITY} verify_tree --cache ${TMP}.cache -j 2 \
+  ${SCRIPTDIR}/data/bios_peppy_mp.bin ${SCRIPTDIR}/data/bios_zgb_mp.bin
+[ -s ${TMP}.cache ]
+
+
+#### Crypto backends
+
+# OpenSSL and the firmware code must agree on everything, good or bad.
+for mode in reference openssl crosscheck; do
+  VB2_HOST_CRYPTO=${mode} ${FUTILITY} show ${SCRIPTDIR}/data/bios_*_mp.bin \
+    ${SCRIPTDIR}/data/rec_kernel_part.bin > ${TMP}.${mode}
+  VB2_HOST_CRYPTO=${mode} ${FUTILITY} verify \
+    ${SCRIPTDIR}/data/rec_kernel_part.bin \
+    --publickey ${DEVKEYS}/recovery_key.vbpubk >> ${TMP}.${mode}
+  if VB2_HOST_CRYPTO=${mode} ${FUTILITY} verify \
+    ${SCRIPTDIR}/data/rec_kernel_part.bin \
+    --publickey ${DEVKEYS}/kernel_subkey.vbpubk >> ${TMP}.${mode}
+    then false ; fi
+  VB2_HOST_CRYPTO=${mode} ${FUTILITY} vbutil_kernel --verify \
+    ${SCRIPTDIR}/data/rec_kernel_part.bin \
+    --signpubkey ${DEVKEYS}/recovery_key.vbpubk >> ${TMP}.${mode}
+done
+cmp ${TMP}.reference ${TMP}.openssl
+cmp ${TMP}.reference ${TMP}.crosscheck
+
+# An unknown one is reported, and OpenSSL used
+VB2_HOST_CRYPTO=bogus ${FUTILITY} verify ${SCRIPTDIR}/data/bios_peppy_mp.bin \
+  2> ${TMP}.err
+grep -q 'Unknown VB2_HOST_CRYPTO "bogus"' ${TMP}.err
+
+
 # cleanup
 rm -rf ${TMP}*
 exit 0
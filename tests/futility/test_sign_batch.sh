@@ -0,0 +1,89 @@
+#!/bin/bash -eux
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+DEVKEYS=${SRCDIR}/tests/devkeys
+TESTKEYS=${SRCDIR}/tests/testkeys
+
+FW_ARGS="--signprivate ${DEVKEYS}/firmware_data_key.vbprivk
+  --keyblock ${DEVKEYS}/firmware.keyblock
+  --kernelkey ${DEVKEYS}/kernel_subkey.vbpubk
+  --version 12
+  --flags 42"
+
+# create some firmware blobs, and sign them one at a time
+: > ${TMP}.manifest
+for i in 1 2 3 4 5; do
+  dd bs=1024 count=16 if=/dev/urandom of=${TMP}.fw_main$i
+  ${FUTILITY} sign ${FW_ARGS} --fv ${TMP}.fw_main$i ${TMP}.vblock$i.one
+  echo "${TMP}.fw_main$i ${TMP}.vblock$i.batch" >> ${TMP}.manifest
+done
+
+# then all at once, with comments and blank lines in the manifest
+echo "# comment" >> ${TMP}.manifest
+echo "" >> ${TMP}.manifest
+${FUTILITY} sign ${FW_ARGS} --batch ${TMP}.manifest --jobs 3
+for i in 1 2 3 4 5; do
+  cmp ${TMP}.vblock$i.one ${TMP}.vblock$i.batch
+done
+
+# one job, or one per CPU, gives the same answer
+rm -f ${TMP}.vblock*.batch
+${FUTILITY} sign ${FW_ARGS} --batch ${TMP}.manifest
+for i in 1 2 3 4 5; do
+  cmp ${TMP}.vblock$i.one ${TMP}.vblock$i.batch
+done
+rm -f ${TMP}.vblock*.batch
+${FUTILITY} sign ${FW_ARGS} --batch ${TMP}.manifest --jobs 0
+for i in 1 2 3 4 5; do
+  cmp ${TMP}.vblock$i.one ${TMP}.vblock$i.batch
+done
+
+# PEM keys are only read once, but still sign every keyblock
+: > ${TMP}.manifest
+for key in firmware_data_key kernel_data_key recovery_key; do
+  ${FUTILITY} sign \
+    --pem_signpriv ${TESTKEYS}/key_rsa4096.pem \
+    --pem_algo 8 \
+    --flags 9 \
+    ${DEVKEYS}/$key.vbpubk ${TMP}.$key.keyblock.one
+  echo "${DEVKEYS}/$key.vbpubk ${TMP}.$key.keyblock.batch" >> ${TMP}.manifest
+done
+${FUTILITY} sign \
+  --pem_signpriv ${TESTKEYS}/key_rsa4096.pem \
+  --pem_algo 8 \
+  --flags 9 \
+  --batch ${TMP}.manifest --jobs 2
+for key in firmware_data_key kernel_data_key recovery_key; do
+  cmp ${TMP}.$key.keyblock.one ${TMP}.$key.keyblock.batch
+done
+
+# a bad entry fails the batch, but the others are still signed
+rm -f ${TMP}.vblock*.batch
+echo "${TMP}.fw_main1 ${TMP}.vblock1.batch" > ${TMP}.manifest
+echo "${TMP}.no_such_file ${TMP}.vblock2.batch" >> ${TMP}.manifest
+echo "${TMP}.fw_main3 ${TMP}.vblock3.batch" >> ${TMP}.manifest
+if ${FUTILITY} sign ${FW_ARGS} --batch ${TMP}.manifest --jobs 2; then false; fi
+cmp ${TMP}.vblock1.one ${TMP}.vblock1.batch
+cmp ${TMP}.vblock3.one ${TMP}.vblock3.batch
+
+# so does a badly formed manifest
+echo "${TMP}.fw_main1 ${TMP}.vblock1.batch extra" > ${TMP}.manifest
+if ${FUTILITY} sign ${FW_ARGS} --batch ${TMP}.manifest; then false; fi
+
+# and file names don't go on the command line
+echo "${TMP}.fw_main1 ${TMP}.vblock1.batch" > ${TMP}.manifest
+if ${FUTILITY} sign ${FW_ARGS} --batch ${TMP}.manifest ${TMP}.fw_main2; then
+  false
+fi
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
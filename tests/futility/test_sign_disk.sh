@@ -0,0 +1,130 @@
+#!/bin/bash -eux
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+DEVKEYS=${SRCDIR}/tests/devkeys
+CGPT=${BINDIR}/cgpt
+
+echo "hi there" > ${TMP}.config.txt
+dd if=/dev/urandom bs=512 count=1 of=${TMP}.bootloader.bin
+
+# Two kernels with different versions, signed with the recovery keys
+for v in 1 2; do
+  ${FUTILITY} sign \
+    --keyblock ${DEVKEYS}/recovery_kernel.keyblock \
+    --signprivate ${DEVKEYS}/recovery_kernel_data_key.vbprivk \
+    --version $v \
+    --config ${TMP}.config.txt \
+    --bootloader ${TMP}.bootloader.bin \
+    --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+    --arch amd64 \
+    --outfile ${TMP}.kern$v
+done
+
+# A disk image with them in KERN-A and KERN-B, and an empty KERN-C
+dd if=/dev/zero bs=1M count=24 of=${TMP}.disk
+${CGPT} create ${TMP}.disk
+${CGPT} add -b 64 -s 16384 -t kernel -l KERN-A ${TMP}.disk
+${CGPT} add -b 16448 -s 16384 -t kernel -l KERN-B ${TMP}.disk
+${CGPT} add -b 32832 -s 1 -t kernel -l KERN-C ${TMP}.disk
+dd if=${TMP}.kern1 of=${TMP}.disk bs=512 seek=64 conv=notrunc
+dd if=${TMP}.kern2 of=${TMP}.disk bs=512 seek=16448 conv=notrunc
+cp ${TMP}.disk ${TMP}.disk.orig
+
+# Resign each kernel on its own, for comparison
+for v in 1 2; do
+  ${FUTILITY} sign \
+    --keyblock ${DEVKEYS}/kernel.keyblock \
+    --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+    ${TMP}.kern$v ${TMP}.kern$v.resigned
+done
+
+# Resign the whole image in place
+${FUTILITY} sign \
+  --keyblock ${DEVKEYS}/kernel.keyblock \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  ${TMP}.disk
+
+# Each kernel matches, and keeps its version
+dd if=${TMP}.disk of=${TMP}.kernA bs=512 skip=64 count=16384
+dd if=${TMP}.disk of=${TMP}.kernB bs=512 skip=16448 count=16384
+cmp -n $(stat -c %s ${TMP}.kern1.resigned) ${TMP}.kernA ${TMP}.kern1.resigned
+cmp -n $(stat -c %s ${TMP}.kern2.resigned) ${TMP}.kernB ${TMP}.kern2.resigned
+${FUTILITY} vbutil_kernel --verify ${TMP}.kernB \
+  --signpubkey ${DEVKEYS}/kernel_subkey.vbpubk | grep -q 'Kernel version: *2'
+
+# The GPT and the empty KERN-C are untouched
+cmp -n 32768 ${TMP}.disk ${TMP}.disk.orig
+cmp -i 16809984 ${TMP}.disk ${TMP}.disk.orig
+
+# Writing a new image gives the same answer
+${FUTILITY} sign \
+  --keyblock ${DEVKEYS}/kernel.keyblock \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  ${TMP}.disk.orig ${TMP}.disk.new
+cmp ${TMP}.disk ${TMP}.disk.new
+
+# One partition can be resigned on its own, with its own config
+echo "new config" > ${TMP}.config2.txt
+cp ${TMP}.disk.orig ${TMP}.disk.part
+${FUTILITY} sign \
+  --keyblock ${DEVKEYS}/kernel.keyblock \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --config ${TMP}.config2.txt \
+  --partition 2 \
+  ${TMP}.disk.part
+${FUTILITY} sign \
+  --keyblock ${DEVKEYS}/kernel.keyblock \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --config ${TMP}.config2.txt \
+  ${TMP}.kern2 ${TMP}.kern2.config2
+dd if=${TMP}.disk.part of=${TMP}.kernB bs=512 skip=16448 count=16384
+cmp -n $(stat -c %s ${TMP}.kern2.config2) ${TMP}.kernB ${TMP}.kern2.config2
+${FUTILITY} dump_kernel_config ${TMP}.kernB | grep -q 'new config'
+
+# Nothing else changed
+cmp -n 8421376 ${TMP}.disk.part ${TMP}.disk.orig
+cmp -i 16809984 ${TMP}.disk.part ${TMP}.disk.orig
+
+# The empty KERN-C can't be resigned, and neither can a lone kernel
+if ${FUTILITY} sign \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --partition 3 ${TMP}.disk.part; then false; fi
+if ${FUTILITY} sign \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --partition 1 ${TMP}.kern1 ${TMP}.kern1.bad; then false; fi
+
+# Showing the disk verifies every kernel on it, and the config is the new one
+${FUTILITY} show --publickey ${DEVKEYS}/kernel_subkey.vbpubk \
+  ${TMP}.disk.part > ${TMP}.show.txt
+[ $(grep -c '^Kernel partition: .*(Kernel partition [12])' ${TMP}.show.txt) \
+  -eq 2 ]
+[ $(grep -c 'Body verification succeeded' ${TMP}.show.txt) -eq 2 ]
+grep -q 'new config' ${TMP}.show.txt
+${FUTILITY} verify --publickey ${DEVKEYS}/kernel_subkey.vbpubk ${TMP}.disk
+
+# Same answers one at a time (--batch doesn't prepare in parallel)
+${FUTILITY} show --batch \
+  --publickey ${DEVKEYS}/kernel_subkey.vbpubk \
+  ${TMP}.disk.part > ${TMP}.show1.txt
+cmp ${TMP}.show.txt ${TMP}.show1.txt
+
+# A damaged body is reported for just that partition
+cp ${TMP}.disk ${TMP}.disk.bad
+printf 'XXXX' | dd of=${TMP}.disk.bad bs=1 seek=$(( 64 * 512 + 65536 + 16 )) \
+  conv=notrunc
+if ${FUTILITY} verify --publickey ${DEVKEYS}/kernel_subkey.vbpubk \
+  ${TMP}.disk.bad > ${TMP}.bad.txt 2>&1; then false; fi
+[ $(grep -c 'Error verifying kernel body' ${TMP}.bad.txt) -eq 1 ]
+[ $(grep -c 'Body verification succeeded' ${TMP}.bad.txt) -eq 1 ]
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
@@ -116,6 +116,13 @@ for infile in $INFILES; do
   tail -4 ${SCRIPTDIR}/data_${base}_expect.txt > ${loemdir}/sha.expect
   cmp ${loemdir}/sha.expect ${loemdir}/loem.sha.new
 
+  # identical firmware bodies get identical vblocks (apart from whatever
+  # was in the rest of them before, which ONEMORE makes differ)
+  if [ "${infile}" != "${ONEMORE}" ] &&
+     cmp -s ${loemdir}/fw_main_A ${loemdir}/fw_main_B; then
+    cmp ${loemdir}/vblock_A.${loemid} ${loemdir}/vblock_B.${loemid}
+  fi
+
 done
 
 # Make sure that the BIOS with the good vblocks signed the right size.
@@ -175,6 +182,53 @@ m=$(${FUTILITY} verify --publickey ${KEYDIR}/root_key.vbpubk ${MORE_OUT}.3 \
 [ "$m" = "4" ]
 
 
+# Compressed bodies are signed as they're stored, and flagged as compressed.
+: $(( count++ ))
+echo -n "$count " 1>&3
+
+sign_compressed () {
+  ${FUTILITY} sign \
+    -s ${KEYDIR}/firmware_data_key.vbprivk \
+    -b ${KEYDIR}/firmware.keyblock \
+    -S ${KEYDIR}/dev_firmware_data_key.vbprivk \
+    -B ${KEYDIR}/dev_firmware.keyblock \
+    -k ${KEYDIR}/kernel_subkey.vbpubk \
+    "$@"
+}
+body_size () {
+  ${FUTILITY} verify --publickey ${KEYDIR}/root_key.vbpubk $1 \
+    | awk '/Firmware body size:/ {print $4}' | sort -u
+}
+
+ZFILE=${SCRIPTDIR}/data/bios_link_mp.bin
+sign_compressed --compress -f 0 ${ZFILE} ${TMP}.z
+m=$(${FUTILITY} verify --publickey ${KEYDIR}/root_key.vbpubk ${TMP}.z \
+  | egrep 'Preamble flags: +4$' | wc -l)
+[ "$m" = "2" ]
+zsize=$(body_size ${TMP}.z)
+[ "$zsize" -lt "$(body_size ${ZFILE})" ]
+
+# Resigning doesn't compress it again, or forget it's compressed
+sign_compressed --compress ${TMP}.z ${TMP}.z2
+[ "$(body_size ${TMP}.z2)" = "$zsize" ]
+sign_compressed -f 0 ${TMP}.z ${TMP}.z3
+[ "$(body_size ${TMP}.z3)" = "$zsize" ]
+m=$(${FUTILITY} verify --publickey ${KEYDIR}/root_key.vbpubk ${TMP}.z3 \
+  | egrep 'Preamble flags: +4$' | wc -l)
+[ "$m" = "2" ]
+
+# A body which won't compress leaves the image alone
+cp ${GOOD_VBLOCKS} ${TMP}.nz
+if sign_compressed --compress ${TMP}.nz; then false; fi
+cmp ${GOOD_VBLOCKS} ${TMP}.nz
+
+# and a raw FW_MAIN has nowhere to put a compressed body
+${FUTILITY} dump_fmap -x ${ZFILE} FW_MAIN_A:${TMP}.fw_main_A
+if ${FUTILITY} sign -s ${KEYDIR}/firmware_data_key.vbprivk \
+  -b ${KEYDIR}/firmware.keyblock -k ${KEYDIR}/kernel_subkey.vbpubk -v 1 \
+  --compress ${TMP}.fw_main_A ${TMP}.vblock; then false; fi
+
+
 # cleanup
 rm -rf ${TMP}* ${ONEMORE}
 exit 0
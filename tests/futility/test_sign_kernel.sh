@@ -43,6 +43,12 @@ try_arch () {
     --pad ${padding} \
     --signpubkey ${DEVKEYS}/recovery_key.vbpubk > ${TMP}.verify1
 
+  # the vmlinuz we get back starts with the one we put in
+  ${FUTILITY} vbutil_kernel --get-vmlinuz ${TMP}.blob1.${arch} \
+    --vmlinuz-out ${TMP}.vmlinuz1.${arch}
+  cmp -n $(stat -c %s ${SCRIPTDIR}/data/vmlinuz-${arch}.bin) \
+    ${TMP}.vmlinuz1.${arch} ${SCRIPTDIR}/data/vmlinuz-${arch}.bin
+
   # pack it up the new way
   ${FUTILITY} sign --debug \
     --keyblock ${DEVKEYS}/recovery_kernel.keyblock \
@@ -294,6 +300,81 @@ try_arch () {
   # And creating a new output file should only emit a blob's worth
   cmp ${TMP}.part6.${arch} ${TMP}.part6.${arch}.new2
 
+  # vbutil_kernel repacking over the old partition only rewrites what changed
+  cp ${TMP}.part1.${arch} ${TMP}.part6.${arch}.new3
+  ${FUTILITY} vbutil_kernel --debug \
+    --repack ${TMP}.part6.${arch}.new3 \
+    --oldblob ${TMP}.part6.${arch}.new3 \
+    --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+    --keyblock ${DEVKEYS}/kernel.keyblock \
+    --version 2 \
+    --pad ${padding} \
+    --config ${TMP}.config2.txt
+
+  # That should match the in-place futility sign, padding and all
+  cmp ${TMP}.part6.${arch}.new1 ${TMP}.part6.${arch}.new3
+
+  # resign without changing the body, which signs the old digest again
+  ${FUTILITY} vbutil_keyblock --pack ${TMP}.sha256.keyblock \
+    --datapubkey ${SRCDIR}/tests/testkeys/key_rsa2048.sha256.vbpubk \
+    --signprivate ${DEVKEYS}/kernel_subkey.vbprivk
+  ${FUTILITY} sign --debug \
+    --signprivate ${SRCDIR}/tests/testkeys/key_rsa2048.sha256.vbprivk \
+    --keyblock ${TMP}.sha256.keyblock \
+    --pad ${padding} \
+    ${TMP}.blob3.${arch} \
+    ${TMP}.blob7.${arch} > ${TMP}.resign7 2>&1
+  grep -q "Old body signature can't be reused" ${TMP}.resign7 && false
+  ${FUTILITY} vbutil_kernel --repack ${TMP}.blob8.${arch} \
+    --oldblob ${TMP}.blob3.${arch} \
+    --signprivate ${SRCDIR}/tests/testkeys/key_rsa2048.sha256.vbprivk \
+    --keyblock ${TMP}.sha256.keyblock \
+    --pad ${padding}
+
+  # doing that to a partition in place reads and writes only the vblock
+  cp ${TMP}.part6.${arch}.new1 ${TMP}.part11.${arch}
+  ${FUTILITY} sign --debug \
+    --signprivate ${SRCDIR}/tests/testkeys/key_rsa2048.sha256.vbprivk \
+    --keyblock ${TMP}.sha256.keyblock \
+    --pad ${padding} \
+    ${TMP}.part11.${arch} > ${TMP}.resign11 2>&1
+  [ "$(grep -c ": read 0x" ${TMP}.resign11)" = "1" ]
+  grep -q ": read $(printf 0x%x ${padding}) bytes" ${TMP}.resign11
+  ! grep ": write 0x" ${TMP}.resign11 | grep -v " bytes at 0x0$"
+  cmp -n ${padding} ${TMP}.blob7.${arch} ${TMP}.part11.${arch}
+  cmp -i ${padding} ${TMP}.part6.${arch}.new1 ${TMP}.part11.${arch}
+  ${FUTILITY} vbutil_kernel --verify ${TMP}.part11.${arch} \
+    --pad ${padding} \
+    --signpubkey ${DEVKEYS}/kernel_subkey.vbpubk
+
+  # replacing the config with the same one makes it rehash the body instead
+  ${FUTILITY} sign \
+    --signprivate ${SRCDIR}/tests/testkeys/key_rsa2048.sha256.vbprivk \
+    --keyblock ${TMP}.sha256.keyblock \
+    --pad ${padding} \
+    --config ${TMP}.config2.txt \
+    ${TMP}.blob3.${arch} \
+    ${TMP}.blob9.${arch}
+
+  # they should all be identical
+  cmp ${TMP}.blob7.${arch} ${TMP}.blob9.${arch}
+  cmp ${TMP}.blob8.${arch} ${TMP}.blob9.${arch}
+  ${FUTILITY} vbutil_kernel --verify ${TMP}.blob7.${arch} \
+    --pad ${padding} \
+    --signpubkey ${DEVKEYS}/kernel_subkey.vbpubk
+
+  # a key with a different hash can't sign the old digest, so rehashes
+  ${FUTILITY} sign --debug \
+    --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+    --keyblock ${DEVKEYS}/kernel.keyblock \
+    --pad ${padding} \
+    ${TMP}.blob1.${arch} \
+    ${TMP}.blob10.${arch} > ${TMP}.resign10 2>&1
+  grep -q "Old body signature can't be reused" ${TMP}.resign10
+  ${FUTILITY} vbutil_kernel --verify ${TMP}.blob10.${arch} \
+    --pad ${padding} \
+    --signpubkey ${DEVKEYS}/kernel_subkey.vbpubk
+
   # Note: We specifically do not test repacking with a different --kloadaddr,
   # because the old way has a bug and does not update params->cmd_line_ptr to
   # point at the new on-disk location. Apparently (and not surprisingly), no
@@ -303,6 +384,95 @@ try_arch () {
 try_arch amd64
 try_arch arm
 
+# A big pad is a hole in the file, not megabytes of zeros
+${FUTILITY} vbutil_kernel \
+  --pack ${TMP}.bigpad \
+  --keyblock ${DEVKEYS}/recovery_kernel.keyblock \
+  --signprivate ${DEVKEYS}/recovery_kernel_data_key.vbprivk \
+  --version 1 \
+  --config ${TMP}.config.txt \
+  --bootloader ${TMP}.bootloader.bin \
+  --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+  --arch amd64 \
+  --pad 0x1000000 \
+  --vblockonly
+[ $(stat -c %s ${TMP}.bigpad) -eq $(( 0x1000000 )) ]
+[ $(( $(stat -c '%b * %B' ${TMP}.bigpad) )) -lt $(( 0x100000 )) ]
+${FUTILITY} vbutil_kernel --pack ${TMP}.bigpad.full \
+  --keyblock ${DEVKEYS}/recovery_kernel.keyblock \
+  --signprivate ${DEVKEYS}/recovery_kernel_data_key.vbprivk \
+  --version 1 \
+  --config ${TMP}.config.txt \
+  --bootloader ${TMP}.bootloader.bin \
+  --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+  --arch amd64 \
+  --pad 0x1000000
+cmp -n $(( 0x1000000 )) ${TMP}.bigpad ${TMP}.bigpad.full
+${FUTILITY} vbutil_kernel --verify ${TMP}.bigpad.full --pad 0x1000000 \
+  --signpubkey ${DEVKEYS}/recovery_key.vbpubk
+
+# Piped output still gets the zeros
+${FUTILITY} vbutil_kernel \
+  --pack /dev/stdout \
+  --keyblock ${DEVKEYS}/recovery_kernel.keyblock \
+  --signprivate ${DEVKEYS}/recovery_kernel_data_key.vbprivk \
+  --version 1 \
+  --config ${TMP}.config.txt \
+  --bootloader ${TMP}.bootloader.bin \
+  --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+  --arch amd64 \
+  --pad 0x1000000 \
+  --vblockonly | cat > ${TMP}.bigpad.piped
+cmp ${TMP}.bigpad ${TMP}.bigpad.piped
+
+# A compressed kernel is smaller, and verifies as it is on disk
+sign_compressed () {
+  ${FUTILITY} sign \
+    --keyblock ${DEVKEYS}/recovery_kernel.keyblock \
+    --signprivate ${DEVKEYS}/recovery_kernel_data_key.vbprivk \
+    --version 1 \
+    --config ${TMP}.config.txt \
+    --bootloader ${TMP}.bootloader.bin \
+    --vmlinuz ${SCRIPTDIR}/data/vmlinuz-amd64.bin \
+    --arch amd64 \
+    "$@"
+}
+sign_compressed ${TMP}.plain
+sign_compressed --compress ${TMP}.zipped
+[ $(stat -c %s ${TMP}.zipped) -lt $(stat -c %s ${TMP}.plain) ]
+${FUTILITY} vbutil_kernel --verify ${TMP}.zipped \
+  --signpubkey ${DEVKEYS}/recovery_key.vbpubk > ${TMP}.zipped.verify
+grep -q 'Header version:      2.4' ${TMP}.zipped.verify
+grep -q 'Body compression:    2,' ${TMP}.zipped.verify
+grep -q 'hi there' ${TMP}.zipped.verify
+${FUTILITY} show ${TMP}.zipped > ${TMP}.zipped.show
+grep -q 'Body compression:      2,' ${TMP}.zipped.show
+grep -q 'hi there' ${TMP}.zipped.show
+${FUTILITY} show ${TMP}.plain > ${TMP}.plain.show
+if grep -q 'Body compression' ${TMP}.plain.show; then false; fi
+
+# Resigning keeps it compressed
+${FUTILITY} sign \
+  --keyblock ${DEVKEYS}/kernel.keyblock \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  ${TMP}.zipped ${TMP}.zipped.resigned
+${FUTILITY} vbutil_kernel --verify ${TMP}.zipped.resigned \
+  --signpubkey ${DEVKEYS}/kernel_subkey.vbpubk > ${TMP}.resigned.verify
+grep -q 'Body compression:    2,' ${TMP}.resigned.verify
+cmp -i 65536 ${TMP}.zipped ${TMP}.zipped.resigned
+
+# but its config can't be changed, or its body hashed in blocks
+if ${FUTILITY} sign \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --config ${TMP}.config2.txt \
+  ${TMP}.zipped ${TMP}.bad; then false; fi
+if ${FUTILITY} sign \
+  --signprivate ${DEVKEYS}/kernel_data_key.vbprivk \
+  --hashblock 4096 \
+  ${TMP}.zipped ${TMP}.bad; then false; fi
+if sign_compressed --compress --hashblock 4096 ${TMP}.bad; then false; fi
+if ${FUTILITY} dump_kernel_config ${TMP}.zipped; then false; fi
+
 # cleanup
 rm -rf ${TMP}*
 exit 0
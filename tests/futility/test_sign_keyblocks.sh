@@ -13,6 +13,7 @@ cd "$OUTDIR"
 DEVKEYS=${SRCDIR}/tests/devkeys
 TESTKEYS=${SRCDIR}/tests/testkeys
 SIGNER=${SRCDIR}/tests/external_rsa_signer.sh
+DAEMON=${SRCDIR}/tests/external_rsa_signer_daemon.py
 
 
 # Create a copy of an existing keyblock, using the old way
@@ -104,6 +105,72 @@ ${FUTILITY} sign --debug \
 
 cmp ${TMP}.keyblock4 ${TMP}.keyblock5
 
+# Try it with a signing daemon
+${DAEMON} ${TMP}.sock ${TMP}.daemon.log &
+daemon_pid=$!
+trap "kill ${daemon_pid} 2>/dev/null || true" EXIT
+for i in $(seq 50); do
+  [ -S ${TMP}.sock ] && break
+  sleep 0.1
+done
+
+${FUTILITY} vbutil_keyblock --pack ${TMP}.keyblock6 \
+  --datapubkey ${DEVKEYS}/firmware_data_key.vbpubk \
+  --signprivate_pem ${TESTKEYS}/key_rsa4096.pem \
+  --pem_algorithm 8 \
+  --flags 19 \
+  --externalsigner ${TMP}.sock
+
+cmp ${TMP}.keyblock4 ${TMP}.keyblock6
+
+${FUTILITY} sign \
+  --pem_signpriv ${TESTKEYS}/key_rsa4096.pem \
+  --pem_algo 8 \
+  --pem_external ${TMP}.sock \
+  --flags 19 \
+  ${DEVKEYS}/firmware_data_key.vbpubk \
+  ${TMP}.keyblock7
+
+cmp ${TMP}.keyblock4 ${TMP}.keyblock7
+
+# A batch of keyblocks should share one connection
+: > ${TMP}.daemon.log
+: > ${TMP}.manifest
+for key in firmware_data_key kernel_data_key recovery_kernel_data_key; do
+  ${FUTILITY} sign \
+    --pem_signpriv ${TESTKEYS}/key_rsa4096.pem \
+    --pem_algo 8 \
+    --pem_external ${SIGNER} \
+    --flags 19 \
+    ${DEVKEYS}/${key}.vbpubk \
+    ${TMP}.${key}.keyblock.exec
+  echo "${DEVKEYS}/${key}.vbpubk ${TMP}.${key}.keyblock" >> ${TMP}.manifest
+done
+${FUTILITY} sign \
+  --pem_signpriv ${TESTKEYS}/key_rsa4096.pem \
+  --pem_algo 8 \
+  --pem_external ${TMP}.sock \
+  --flags 19 \
+  --batch ${TMP}.manifest --jobs 1
+for key in firmware_data_key kernel_data_key recovery_kernel_data_key; do
+  cmp ${TMP}.${key}.keyblock.exec ${TMP}.${key}.keyblock
+done
+[ "$(grep -c connect ${TMP}.daemon.log)" = "1" ]
+[ "$(grep -c sign ${TMP}.daemon.log)" = "3" ]
+
+# A key the daemon can't use is an error
+if ${FUTILITY} sign \
+  --pem_signpriv ${TMP}.no_such_key.pem \
+  --pem_algo 8 \
+  --pem_external ${TMP}.sock \
+  --flags 19 \
+  ${DEVKEYS}/firmware_data_key.vbpubk \
+  ${TMP}.keyblock8 ; then false; fi
+
+kill ${daemon_pid}
+wait ${daemon_pid} || true
+trap - EXIT
+
 
 # cleanup
 rm -rf ${TMP}*
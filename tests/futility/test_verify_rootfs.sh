@@ -0,0 +1,138 @@
+#!/bin/bash -eux
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+BLOCKS=200
+SALT=5c9e0f3a1b2d4e6f708192a3b4c5d6e7f8091a2b3c4d5e6f708192a3b4c5d6e7
+
+# Write the binary form of a hex string
+unhex() {
+  printf "$(echo "$1" | sed 's/../\\x&/g')"
+}
+
+# Hash a 4096-byte block from stdin, with the salt after it if there is one
+hash_block() {
+  local sum=$1
+  local salt=$2
+  { cat; [ -z "$salt" ] || unhex "$salt"; } | ${sum} | cut -d' ' -f1
+}
+
+# Build a rootfs and the dm-verity hash tree after it, the way verity does for
+# a two-level tree, and write the kernel command line to ${TMP}.$1.config
+make_rootfs() {
+  local name=$1
+  local sum=$2
+  local alg=$3
+  local salt=$4
+  local per_page=$5
+  local img=${TMP}.${name}.img
+  local i page pages root
+
+  dd if=/dev/urandom of=${img} bs=4096 count=${BLOCKS} 2>/dev/null
+
+  # Leaf level: one digest per data block
+  pages=$(( (BLOCKS + per_page - 1) / per_page ))
+  rm -f ${TMP}.${name}.leaf.*
+  for ((i = 0; i < BLOCKS; i++)); do
+    page=$(( i / per_page ))
+    dd if=${img} bs=4096 skip=$i count=1 2>/dev/null |
+      hash_block ${sum} "$salt" > ${TMP}.hex
+    unhex "$(cat ${TMP}.hex)" >> ${TMP}.${name}.leaf.$page
+  done
+
+  # Root level: one digest per leaf page
+  : > ${TMP}.${name}.top
+  for ((page = 0; page < pages; page++)); do
+    truncate -s 4096 ${TMP}.${name}.leaf.$page
+    hash_block ${sum} "$salt" < ${TMP}.${name}.leaf.$page > ${TMP}.hex
+    unhex "$(cat ${TMP}.hex)" >> ${TMP}.${name}.top
+  done
+  truncate -s 4096 ${TMP}.${name}.top
+  root=$(hash_block ${sum} "$salt" < ${TMP}.${name}.top)
+
+  cat ${TMP}.${name}.top >> ${img}
+  for ((page = 0; page < pages; page++)); do
+    cat ${TMP}.${name}.leaf.$page >> ${img}
+  done
+
+  local sectors=$(( BLOCKS * 8 ))
+  echo "console= dm=\"1 vroot none ro 1,0 ${sectors} verity" \
+    "payload=ROOT_DEV hashtree=HASH_DEV hashstart=${sectors}" \
+    "alg=${alg} root_hexdigest=${root}${salt:+ salt=$salt}\" noinitrd" \
+    > ${TMP}.${name}.config
+}
+
+make_rootfs sha256 sha256sum sha256 "${SALT}" 128
+make_rootfs sha1 sha1sum sha1 "" 128
+
+# Changes the byte at offset $2 of file $1, which is random data, so it might
+# already be the one written
+corrupt() {
+  local byte
+  byte=$(dd if=$1 bs=1 skip=$2 count=1 2>/dev/null | od -An -tx1 | tr -d ' ')
+  if [ "${byte}" = "78" ]; then
+    printf 'y'
+  else
+    printf 'x'
+  fi | dd of=$1 bs=1 seek=$2 conv=notrunc 2>/dev/null
+}
+
+for name in sha256 sha1; do
+  img=${TMP}.${name}.img
+  cfg=${TMP}.${name}.config
+
+  # A good rootfs passes, however many jobs hash it
+  ${FUTILITY} verify_rootfs --config ${cfg} ${img} > ${TMP}.out
+  grep -q '^PASS' ${TMP}.out
+  ${FUTILITY} verify_rootfs -c ${cfg} -j 1 ${img}
+  ${FUTILITY} verify_rootfs -c ${cfg} --jobs 5 ${img}
+
+  # A changed data block is found
+  cp ${img} ${TMP}.bad
+  corrupt ${TMP}.bad $((150 * 4096 + 17))
+  if ${FUTILITY} verify_rootfs -c ${cfg} ${TMP}.bad > ${TMP}.out; then
+    false; fi
+  grep -q "^Block 150 doesn't match" ${TMP}.out
+  [ "$(grep -c '^Block' ${TMP}.out)" = "1" ]
+
+  # So is a changed hash block
+  cp ${img} ${TMP}.bad
+  corrupt ${TMP}.bad $(( (BLOCKS + 2) * 4096 + 5))
+  if ${FUTILITY} verify_rootfs -c ${cfg} ${TMP}.bad > ${TMP}.out; then
+    false; fi
+  grep -q "^Hash block 1 at level 1 doesn't match" ${TMP}.out
+
+  # And a wrong root digest
+  sed -e 's/root_hexdigest=./root_hexdigest=0/' ${cfg} > ${TMP}.cfg
+  if cmp -s ${cfg} ${TMP}.cfg; then
+    sed -e 's/root_hexdigest=./root_hexdigest=1/' ${cfg} > ${TMP}.cfg
+  fi
+  if ${FUTILITY} verify_rootfs -c ${TMP}.cfg ${img} > ${TMP}.out; then
+    false; fi
+  grep -q "^Root hash doesn't match" ${TMP}.out
+done
+
+# The old positional form of the arguments works too
+root=$(sed -e 's/.*root_hexdigest=\([0-9a-f]*\).*/\1/' ${TMP}.sha1.config)
+echo "dm=\"0 1600 verity ROOT_DEV HASH_DEV 1600 0 sha1 ${root}\"" > ${TMP}.cfg
+${FUTILITY} verify_rootfs -c ${TMP}.cfg ${TMP}.sha1.img
+
+# Things that aren't right
+if ${FUTILITY} verify_rootfs ${TMP}.sha1.img; then false; fi
+echo "console=tty0" > ${TMP}.cfg
+if ${FUTILITY} verify_rootfs -c ${TMP}.cfg ${TMP}.sha1.img; then false; fi
+sed -e 's/alg=sha1/alg=md5/' ${TMP}.sha1.config > ${TMP}.cfg
+if ${FUTILITY} verify_rootfs -c ${TMP}.cfg ${TMP}.sha1.img; then false; fi
+truncate -s $((BLOCKS * 4096 + 4096)) ${TMP}.bad
+if ${FUTILITY} verify_rootfs -c ${TMP}.sha1.config ${TMP}.bad; then false; fi
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
@@ -0,0 +1,57 @@
+#!/bin/bash -eux
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+me=${0##*/}
+TMP="$me.tmp"
+
+# Work in scratch directory
+cd "$OUTDIR"
+
+# some stuff we'll need
+DEVKEYS=${SRCDIR}/tests/devkeys
+
+# Set up a tree with good, bad, and unrelated files in it
+rm -rf ${TMP}.dir
+mkdir -p ${TMP}.dir/sub/deeper
+cp ${SCRIPTDIR}/data/bios_peppy_mp.bin ${TMP}.dir/good.bin
+cp ${SCRIPTDIR}/data/rec_kernel_part.bin ${TMP}.dir/sub/kern.bin
+cp ${SCRIPTDIR}/data/bios_peppy_mp.bin ${TMP}.dir/sub/deeper/bad.bin
+offset=$(${FUTILITY} dump_fmap -p ${TMP}.dir/sub/deeper/bad.bin FW_MAIN_A |
+  cut -d' ' -f2)
+printf '\xff' | dd of=${TMP}.dir/sub/deeper/bad.bin bs=1 \
+  seek=$((offset + 16)) conv=notrunc
+echo "not a firmware image" > ${TMP}.dir/sub/readme.txt
+
+# The bad image makes it fail, but everything is still reported.  Without a
+# public key the kernel can't be verified either.
+if ${FUTILITY} verify_tree -j 2 ${TMP}.dir > ${TMP}.json ; then false ; fi
+
+result() {
+  grep -q '"name": "'${TMP}.dir/$1'", "type": "[^"]*", "result": "'$2'"' $3
+}
+result good.bin pass ${TMP}.json
+result sub/kern.bin fail ${TMP}.json
+result sub/deeper/bad.bin fail ${TMP}.json
+grep -q 'readme' ${TMP}.json && false
+grep -q '"files": 4, "passed": 1, "failed": 2, "skipped": 1, "jobs": 2,' \
+  ${TMP}.json
+
+# The results don't depend on the number of workers
+${FUTILITY} verify_tree -j 1 ${TMP}.dir > ${TMP}.json1 || true
+${FUTILITY} verify_tree -j 4 ${TMP}.dir > ${TMP}.json4 || true
+sed 's/"seconds": [0-9.]*//g; s/"jobs": [0-9]*//' ${TMP}.json1 > ${TMP}.strip1
+sed 's/"seconds": [0-9.]*//g; s/"jobs": [0-9]*//' ${TMP}.json4 > ${TMP}.strip4
+cmp ${TMP}.strip1 ${TMP}.strip4
+
+# Files can be listed too, and the key is used for all of them
+find ${TMP}.dir -name 'kern*' | \
+  ${FUTILITY} verify_tree --publickey ${DEVKEYS}/recovery_key.vbpubk \
+    --list - > ${TMP}.list
+result sub/kern.bin pass ${TMP}.list
+grep -q '"files": 1, "passed": 1, "failed": 0, "skipped": 0,' ${TMP}.list
+
+# cleanup
+rm -rf ${TMP}*
+exit 0
@@ -0,0 +1,186 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Benchmark of the cost of starting futility, which signing scripts run
+ * thousands of times.
+ *
+ * Usage: futility_startup_benchmark <futility> <file> [runs [keys_dir]]
+ *
+ * Runs "futility show <file>" [runs] times with invocation logging turned
+ * off, then again logging to a scratch file, each after a few warm-up runs.
+ * If [keys_dir] is given, <file> is taken to be a BIOS image and re-signing
+ * it with the firmware keys from there is timed too.  The minimum, median,
+ * maximum, mean and standard deviation of the time per invocation are printed
+ * as JSON on stdout, in the same form as vb2_crypto_benchmark, with the name
+ * of <file> in each result name.  Progress goes to stderr.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "timer_utils.h"
+
+#define DEFAULT_RUNS 15
+#define MAX_RUNS 1000
+#define WARMUP_RUNS 3
+
+/* Each run repeats the operation until it takes at least this long */
+#define MIN_RUN_NSECS 1000000ULL
+
+static int runs = DEFAULT_RUNS;
+static int results_printed;
+static int failed;
+
+/* Run [argv] with its output thrown away, and wait for it */
+static void bench_run(void *arg)
+{
+	char *const *argv = (char *const *)arg;
+	pid_t pid;
+	int status;
+	int fd;
+
+	pid = fork();
+	if (pid == 0) {
+		fd = open("/dev/null", O_WRONLY);
+		if (fd >= 0) {
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+		}
+		execv(argv[0], argv);
+		_exit(127);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) != pid ||
+	    !WIFEXITED(status) || WEXITSTATUS(status))
+		failed = 1;
+}
+
+/* Time running [argv] and print a JSON result for it */
+static void bench(const char *name, char *const argv[])
+{
+	TimerStats st;
+
+	if (TimeFunction(bench_run, (void *)argv, WARMUP_RUNS, runs,
+			 MIN_RUN_NSECS, &st)) {
+		fprintf(stderr, "Can't time %s\n", name);
+		failed = 1;
+		return;
+	}
+
+	printf("%s\n    {\"name\": \"%s\", \"size\": 0, "
+	       "\"iterations\": %" PRIu64 ", "
+	       "\"ns_min\": %.1f, \"ns_p50\": %.1f, \"ns_max\": %.1f, "
+	       "\"ns_mean\": %.1f, \"ns_stddev\": %.1f}",
+	       results_printed ? "," : "", name, st.iterations, st.ns_min,
+	       st.ns_p50, st.ns_max, st.ns_mean, st.ns_stddev);
+	fflush(stdout);
+	results_printed++;
+
+	fprintf(stderr, "# %-24s %12.1f ns median\n", name, st.ns_p50);
+}
+
+int main(int argc, char *argv[])
+{
+	char logfile[] = "/tmp/futility_startup_benchmark.XXXXXX";
+	char signfile[] = "/tmp/futility_startup_benchmark.XXXXXX";
+	char keys[5][1024];
+	char name[256];
+	char *show_argv[4];
+	char *sign_argv[15];
+	const char *file_name;
+	int fd;
+
+	if (argc >= 4) {
+		runs = atoi(argv[3]);
+		if (runs < 1 || runs > MAX_RUNS) {
+			fprintf(stderr, "Runs must be 1-%d\n", MAX_RUNS);
+			return 1;
+		}
+	}
+	if (argc < 3 || argc > 5) {
+		fprintf(stderr,
+			"Usage: %s <futility> <file> [runs [keys_dir]]\n",
+			argv[0]);
+		return 1;
+	}
+	file_name = basename(strdup(argv[2]));
+
+	show_argv[0] = argv[1];
+	show_argv[1] = "show";
+	show_argv[2] = argv[2];
+	show_argv[3] = NULL;
+
+	/* Logging only happens if the log file already exists */
+	fd = mkstemp(logfile);
+	if (fd < 0) {
+		perror("Can't create log file");
+		return 1;
+	}
+	close(fd);
+
+	printf("{\n  \"runs\": %d,\n  \"results\": [", runs);
+
+	setenv("FUTILITY_LOGFILE", "", 1);
+	snprintf(name, sizeof(name), "futility_show/%s", file_name);
+	bench(name, show_argv);
+
+	if (argc == 5) {
+		fd = mkstemp(signfile);
+		if (fd < 0) {
+			perror("Can't create output file");
+			return 1;
+		}
+		close(fd);
+
+		snprintf(keys[0], sizeof(keys[0]), "%s/firmware_data_key.vbprivk",
+			 argv[4]);
+		snprintf(keys[1], sizeof(keys[1]), "%s/firmware.keyblock",
+			 argv[4]);
+		snprintf(keys[2], sizeof(keys[2]),
+			 "%s/dev_firmware_data_key.vbprivk", argv[4]);
+		snprintf(keys[3], sizeof(keys[3]), "%s/dev_firmware.keyblock",
+			 argv[4]);
+		snprintf(keys[4], sizeof(keys[4]), "%s/kernel_subkey.vbpubk",
+			 argv[4]);
+		/* Dev keys are needed for images whose RW A and B differ */
+		sign_argv[0] = argv[1];
+		sign_argv[1] = "sign";
+		sign_argv[2] = "-s";
+		sign_argv[3] = keys[0];
+		sign_argv[4] = "-b";
+		sign_argv[5] = keys[1];
+		sign_argv[6] = "-S";
+		sign_argv[7] = keys[2];
+		sign_argv[8] = "-B";
+		sign_argv[9] = keys[3];
+		sign_argv[10] = "-k";
+		sign_argv[11] = keys[4];
+		sign_argv[12] = argv[2];
+		sign_argv[13] = signfile;
+		sign_argv[14] = NULL;
+		snprintf(name, sizeof(name), "futility_sign/%s", file_name);
+		bench(name, sign_argv);
+		unlink(signfile);
+	}
+
+	setenv("FUTILITY_LOGFILE", logfile, 1);
+	snprintf(name, sizeof(name), "futility_show_logged/%s", file_name);
+	bench(name, show_argv);
+
+	printf("\n  ]\n}\n");
+
+	unlink(logfile);
+
+	if (failed) {
+		fprintf(stderr, "%s failed on %s\n", argv[1], argv[2]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,284 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for the OpenSSL digests and RSA verification in the host library,
+ * against the firmware code.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2rsa.h"
+#include "2sha.h"
+#include "vb2_common.h"
+
+#include "cryptolib.h"
+#include "file_keys.h"
+#include "host_common.h"
+#include "host_crypto.h"
+#include "test_common.h"
+
+static const enum vb2_hash_algorithm hash_algs[] = {
+	VB2_HASH_SHA1,
+	VB2_HASH_SHA256,
+	VB2_HASH_SHA512,
+	VB2_HASH_BLAKE2S,
+};
+
+/* Sizes around the block and padding boundaries, and a few bigger ones */
+static const uint32_t test_sizes[] = {
+	0, 1, 55, 56, 63, 64, 65, 111, 112, 127, 128, 129, 1000, 65537,
+};
+
+#define TEST_BUF_SIZE 65537
+
+static uint8_t test_buf[TEST_BUF_SIZE];
+
+/* Digest a buffer in uneven pieces */
+static int digest_pieces(enum vb2_hash_algorithm hash_alg,
+			 const uint8_t *buf,
+			 uint32_t size,
+			 uint8_t *digest)
+{
+	struct vb2_digest_context dc;
+	uint32_t piece = 1;
+	int rv;
+
+	rv = vb2_digest_init(&dc, hash_alg);
+	if (rv)
+		return rv;
+	while (size) {
+		uint32_t len = piece < size ? piece : size;
+
+		rv = vb2_digest_extend(&dc, buf, len);
+		if (rv)
+			return rv;
+		buf += len;
+		size -= len;
+		piece = piece * 3 + 1;
+	}
+	return vb2_digest_finalize(&dc, digest, VB2_SHA512_DIGEST_SIZE);
+}
+
+static void test_digests(void)
+{
+	uint8_t ref[VB2_SHA512_DIGEST_SIZE];
+	uint8_t digest[VB2_SHA512_DIGEST_SIZE];
+	const uint8_t *bufs[ARRAY_SIZE(test_sizes)];
+	uint8_t multi[ARRAY_SIZE(test_sizes)][VB2_SHA512_DIGEST_SIZE];
+	uint8_t *multi_ptrs[ARRAY_SIZE(test_sizes)];
+	int i, j, bad, bad_multi;
+
+	for (i = 0; i < ARRAY_SIZE(test_sizes); i++) {
+		bufs[i] = test_buf;
+		multi_ptrs[i] = multi[i];
+	}
+
+	for (i = 0; i < ARRAY_SIZE(hash_algs); i++) {
+		enum vb2_hash_algorithm alg = hash_algs[i];
+		int size = vb2_digest_size(alg);
+		char name[64];
+
+		if (!size)
+			continue;
+
+		bad = bad_multi = 0;
+		for (j = 0; j < ARRAY_SIZE(test_sizes); j++) {
+			vb2_host_crypto_select(VB2_HOST_CRYPTO_REFERENCE);
+			digest_pieces(alg, test_buf, test_sizes[j], ref);
+
+			vb2_host_crypto_select(VB2_HOST_CRYPTO_OPENSSL);
+			if (digest_pieces(alg, test_buf, test_sizes[j],
+					  digest) || memcmp(digest, ref, size))
+				bad++;
+
+			vb2_host_crypto_select(VB2_HOST_CRYPTO_CROSSCHECK);
+			if (digest_pieces(alg, test_buf, test_sizes[j],
+					  digest) || memcmp(digest, ref, size))
+				bad++;
+		}
+		snprintf(name, sizeof(name), "Digests match, alg %d", alg);
+		TEST_EQ(bad, 0, name);
+
+		/* Batches go one buffer at a time, through OpenSSL */
+		vb2_host_crypto_select(VB2_HOST_CRYPTO_OPENSSL);
+		TEST_SUCC(vb2_digest_multi(alg, ARRAY_SIZE(test_sizes), bufs,
+					   test_sizes, multi_ptrs,
+					   VB2_SHA512_DIGEST_SIZE),
+			  "  vb2_digest_multi()");
+		vb2_host_crypto_select(VB2_HOST_CRYPTO_REFERENCE);
+		for (j = 0; j < ARRAY_SIZE(test_sizes); j++) {
+			digest_pieces(alg, test_buf, test_sizes[j], ref);
+			if (memcmp(multi[j], ref, size))
+				bad_multi++;
+		}
+		TEST_EQ(bad_multi, 0, "  vb2_digest_multi() matches");
+	}
+
+	vb2_host_crypto_select(VB2_HOST_CRYPTO_OPENSSL);
+	TEST_EQ(digest_pieces(VB2_HASH_INVALID, test_buf, 1, digest),
+		VB2_ERROR_SHA_INIT_ALGORITHM, "Bad digest alg");
+}
+
+/* Verify in every mode; each must give the reference result */
+static int verify_all(const struct vb2_public_key *key,
+		      const uint8_t *sig,
+		      const uint8_t *digest,
+		      int *bad)
+{
+	uint8_t workbuf[VB2_VERIFY_RSA_DIGEST_WORKBUF_BYTES]
+		 __attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	struct vb2_workbuf wb;
+	int ref_rv, rv;
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+
+	vb2_host_crypto_select(VB2_HOST_CRYPTO_REFERENCE);
+	ref_rv = vb2_rsa_verify_digest(key, sig, digest, &wb);
+
+	vb2_host_crypto_select(VB2_HOST_CRYPTO_OPENSSL);
+	rv = vb2_rsa_verify_digest(key, sig, digest, &wb);
+	if (rv != ref_rv)
+		(*bad)++;
+
+	vb2_host_crypto_select(VB2_HOST_CRYPTO_CROSSCHECK);
+	rv = vb2_rsa_verify_digest(key, sig, digest, &wb);
+	if (rv != ref_rv)
+		(*bad)++;
+
+	return ref_rv;
+}
+
+static int test_algorithm(int key_algorithm, const char *keys_dir)
+{
+	uint8_t workbuf[VB2_VERIFY_RSA_DIGEST_WORKBUF_BYTES]
+		 __attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	uint8_t digest[VB2_SHA512_DIGEST_SIZE];
+	uint8_t sig[VB2_MAX_RSA_SIG_BYTES];
+	char filename[1024];
+	int rsa_len = siglen_map[key_algorithm] * 8;
+	VbPrivateKey *private_key = NULL;
+	struct vb2_signature *signature = NULL;
+	struct vb2_packed_key *packed = NULL;
+	struct vb2_public_key key;
+	struct vb2_workbuf wb;
+	uint32_t sig_size;
+	int bad = 0;
+	int i;
+
+	printf("***Testing algorithm: %s\n", algo_strings[key_algorithm]);
+
+	sprintf(filename, "%s/key_rsa%d.pem", keys_dir, rsa_len);
+	private_key = PrivateKeyReadPem(filename, key_algorithm);
+	sprintf(filename, "%s/key_rsa%d.keyb", keys_dir, rsa_len);
+	packed = (struct vb2_packed_key *)
+		PublicKeyReadKeyb(filename, key_algorithm, 1);
+	if (!private_key || !packed) {
+		fprintf(stderr, "Error reading keys for %s\n",
+			algo_strings[key_algorithm]);
+		return 1;
+	}
+
+	vb2_host_crypto_select(VB2_HOST_CRYPTO_REFERENCE);
+	signature = (struct vb2_signature *)
+		CalculateSignature(test_buf, 1000, private_key);
+	TEST_PTR_NEQ(signature, 0, "Calculate signature");
+	TEST_SUCC(vb2_unpack_key(&key, (uint8_t *)packed,
+				 packed->key_offset + packed->key_size),
+		  "Unpack key");
+	if (!signature)
+		return 1;
+	TEST_SUCC(digest_pieces(key.hash_alg, test_buf, 1000, digest),
+		  "Digest data");
+	sig_size = signature->sig_size;
+
+	memcpy(sig, vb2_signature_data(signature), sig_size);
+	TEST_SUCC(verify_all(&key, sig, digest, &bad), "Good signature");
+	TEST_EQ(bad, 0, "  same result");
+	TEST_EQ(memcmp(sig, vb2_signature_data(signature), sig_size), 0,
+		"  signature left alone");
+
+	/* Corrupt each byte in turn (some of them, for the big keys) */
+	for (i = 0; i < sig_size; i += (sig_size > 256 ? 7 : 1)) {
+		memcpy(sig, vb2_signature_data(signature), sig_size);
+		sig[i] ^= 0x5a;
+		if (!verify_all(&key, sig, digest, &bad))
+			bad++;
+	}
+	TEST_EQ(bad, 0, "Corrupt signatures fail the same way");
+
+	/* And the digest */
+	memcpy(sig, vb2_signature_data(signature), sig_size);
+	digest[3] ^= 0x01;
+	TEST_EQ(verify_all(&key, sig, digest, &bad),
+		VB2_ERROR_RSA_VERIFY_DIGEST, "Wrong digest");
+	TEST_EQ(bad, 0, "  same result");
+	digest[3] ^= 0x01;
+
+	/* Not below the modulus, which OpenSSL leaves to the firmware code */
+	memset(sig, 0xff, sig_size);
+	TEST_NEQ(verify_all(&key, sig, digest, &bad), 0, "Huge signature");
+	TEST_EQ(bad, 0, "  same result");
+
+	/* Size checks still come first */
+	vb2_host_crypto_select(VB2_HOST_CRYPTO_OPENSSL);
+	memcpy(sig, vb2_signature_data(signature), sig_size);
+	vb2_workbuf_init(&wb, workbuf, 3 * sig_size - 1);
+	TEST_EQ(vb2_rsa_verify_digest(&key, sig, digest, &wb),
+		VB2_ERROR_RSA_VERIFY_WORKBUF, "Small workbuf");
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+	key.arrsize--;
+	TEST_EQ(vb2_rsa_verify_digest(&key, sig, digest, &wb),
+		VB2_ERROR_RSA_VERIFY_SIG_LEN, "Bad sig len");
+	key.arrsize++;
+
+	free(signature);
+	free(packed);
+	free(private_key);
+	return 0;
+}
+
+/*
+ * The algorithms we use, plus one of each size and hash.  The two 4096-bit
+ * ones share a key, so the second finds it already set up.
+ */
+static const int key_algs[] = {
+	VB2_ALG_RSA1024_SHA1,
+	VB2_ALG_RSA2048_SHA256,
+	VB2_ALG_RSA4096_SHA256,
+	VB2_ALG_RSA4096_SHA512,
+	VB2_ALG_RSA8192_SHA512,
+};
+
+int main(int argc, char *argv[])
+{
+	uint32_t x = 1;
+	int i;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <keys_dir>\n", argv[0]);
+		return -1;
+	}
+
+	for (i = 0; i < TEST_BUF_SIZE; i++) {
+		x = x * 1103515245 + 12345;
+		test_buf[i] = (uint8_t)(x >> 16);
+	}
+
+	test_digests();
+
+	for (i = 0; i < ARRAY_SIZE(key_algs); i++) {
+		if (test_algorithm(key_algs[i], argv[1]))
+			return 1;
+	}
+
+	TEST_EQ(vb2_host_crypto_select(VB2_HOST_CRYPTO_CROSSCHECK + 1),
+		VB2_ERROR_HOST_CRYPTO_MODE, "Bad mode");
+
+	return gTestSuccess ? 0 : 255;
+}
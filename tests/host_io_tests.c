@@ -0,0 +1,92 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for batched host reads.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_io.h"
+#include "test_common.h"
+
+#define FILE_SIZE 100000
+#define NUM_READS 100
+
+static const char *testfile = "host_io_tests.dat";
+static uint8_t file_data[FILE_SIZE];
+
+static void FillRequest(struct read_request *req, int fd, void *buf,
+			size_t size, off_t offset)
+{
+	memset(req, 0, sizeof(*req));
+	req->fd = fd;
+	req->buf = buf;
+	req->size = size;
+	req->offset = offset;
+}
+
+static void ReadBatchTest(void)
+{
+	static uint8_t bufs[NUM_READS][1000];
+	struct read_request reqs[NUM_READS];
+	uint8_t small[16];
+	int fd, i, ok;
+
+	for (i = 0; i < FILE_SIZE; i++)
+		file_data[i] = i * 7 + (i >> 8);
+	fd = open(testfile, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	TEST_NEQ(fd < 0, 1, "Create file");
+	TEST_EQ(write(fd, file_data, FILE_SIZE), FILE_SIZE, "Write file");
+
+	TEST_EQ(ReadBatch(reqs, 0), 0, "Nothing to read");
+
+	FillRequest(reqs, fd, small, sizeof(small), 1234);
+	TEST_EQ(ReadBatch(reqs, 1), 0, "One read");
+	TEST_EQ(reqs[0].result, sizeof(small), "  result");
+	TEST_EQ(memcmp(small, file_data + 1234, sizeof(small)), 0, "  data");
+
+	/* More than are in flight at once, from all over, out of order */
+	for (i = 0; i < NUM_READS; i++)
+		FillRequest(reqs + i, fd, bufs[i], sizeof(bufs[i]),
+			    (NUM_READS - 1 - i) * 997);
+	TEST_EQ(ReadBatch(reqs, NUM_READS), 0, "Many reads");
+	ok = 1;
+	for (i = 0; i < NUM_READS; i++) {
+		if (reqs[i].result != sizeof(bufs[i]) ||
+		    memcmp(bufs[i], file_data + reqs[i].offset,
+			   sizeof(bufs[i])))
+			ok = 0;
+	}
+	TEST_EQ(ok, 1, "  all read");
+
+	/* Reading past the end fails, but the other reads still happen */
+	FillRequest(reqs, fd, bufs[0], sizeof(bufs[0]), FILE_SIZE - 10);
+	FillRequest(reqs + 1, fd, bufs[1], sizeof(bufs[1]), 0);
+	TEST_EQ(ReadBatch(reqs, 2), -1, "Read past end");
+	TEST_EQ(reqs[0].result, 10, "  short");
+	TEST_EQ(memcmp(bufs[0], file_data + FILE_SIZE - 10, 10), 0,
+		"  short data");
+	TEST_EQ(reqs[1].result, sizeof(bufs[1]), "  other read");
+	TEST_EQ(memcmp(bufs[1], file_data, sizeof(bufs[1])), 0, "  other data");
+
+	FillRequest(reqs, fd, small, sizeof(small), 0);
+	FillRequest(reqs + 1, -1, small, sizeof(small), 0);
+	TEST_EQ(ReadBatch(reqs, 2), -1, "Bad fd");
+	TEST_EQ(reqs[0].result, sizeof(small), "  other read");
+	TEST_EQ(reqs[1].result, -EBADF, "  error");
+
+	close(fd);
+	unlink(testfile);
+}
+
+int main(int argc, char *argv[])
+{
+	ReadBatchTest();
+
+	return gTestSuccess ? 0 : 255;
+}
@@ -0,0 +1,178 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Stress test for signing and verifying from several threads at once, the
+ * way a signing service using the host library would.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2rsa.h"
+#include "vb2_common.h"
+
+#include "cryptolib.h"
+#include "host_common.h"
+#include "test_common.h"
+#include "vboot_common.h"
+
+#define NUM_THREADS 8
+#define ITERATIONS 20
+
+/* Key algorithms the threads take turns with */
+static const int thread_algs[] = {
+	VB2_ALG_RSA2048_SHA256,
+	VB2_ALG_RSA4096_SHA256,
+	VB2_ALG_RSA2048_SHA1,
+	VB2_ALG_RSA4096_SHA512,
+};
+
+static const char *keys_dir;
+
+struct thread_state {
+	pthread_t thread;
+	int id;
+	int algorithm;
+	/* Counted here, since the TEST_* macros aren't thread-safe */
+	int runs;
+	int failures;
+};
+
+/* Sign and verify a buffer and a key block, with both vboot 1 and vboot 2.0
+ * verification.  Returns the number of checks that failed. */
+static int SignAndVerify(struct thread_state *ts,
+			 const VbPrivateKey *private_key,
+			 const VbPublicKey *public_key, uint8_t *data,
+			 uint32_t size)
+{
+	uint8_t workbuf[VB2_VERIFY_DATA_WORKBUF_BYTES]
+		__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	struct vb2_workbuf wb;
+	struct vb2_public_key key;
+	VbKeyBlockHeader *block;
+	VbSignature *sig;
+	RSAPublicKey *rsa;
+	int failures = 0;
+
+	sig = CalculateSignature(data, size, private_key);
+	rsa = PublicKeyToRSA(public_key);
+	block = KeyBlockCreate(public_key, private_key, 0x1234 + ts->id);
+	if (!sig || !rsa || !block) {
+		failures++;
+		goto done;
+	}
+
+	/* vboot 1 */
+	if (VerifyData(data, size, sig, rsa))
+		failures++;
+	data[size / 2] ^= 0x5a;
+	if (!VerifyData(data, size, sig, rsa))
+		failures++;
+	data[size / 2] ^= 0x5a;
+	if (KeyBlockVerify(block, block->key_block_size, public_key, 0))
+		failures++;
+
+	/* vboot 2.0, which checks signatures in place, so goes last */
+	if (vb2_unpack_key(&key, (const uint8_t *)public_key,
+			   public_key->key_offset + public_key->key_size)) {
+		failures++;
+		goto done;
+	}
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+	if (vb2_verify_data(data, size, (struct vb2_signature *)sig, &key,
+			    &wb))
+		failures++;
+	if (vb2_verify_keyblock((struct vb2_keyblock *)block,
+				block->key_block_size, &key, &wb))
+		failures++;
+
+ done:
+	if (rsa)
+		RSAPublicKeyFree(rsa);
+	free(block);
+	free(sig);
+	return failures;
+}
+
+static void *StressThread(void *arg)
+{
+	struct thread_state *ts = arg;
+	int rsa_len = siglen_map[ts->algorithm] * 8;
+	VbPrivateKey *private_key;
+	VbPublicKey *public_key;
+	char filename[1024];
+	uint8_t data[1000];
+	int i;
+
+	for (i = 0; i < ITERATIONS; i++) {
+		/* Each pass reads its own keys, the way a service would for
+		 * each request */
+		snprintf(filename, sizeof(filename), "%s/key_rsa%d.pem",
+			 keys_dir, rsa_len);
+		private_key = PrivateKeyReadPem(filename, ts->algorithm);
+		snprintf(filename, sizeof(filename), "%s/key_rsa%d.keyb",
+			 keys_dir, rsa_len);
+		public_key = PublicKeyReadKeyb(filename, ts->algorithm, 1);
+
+		if (private_key && public_key) {
+			memset(data, ts->id * ITERATIONS + i, sizeof(data));
+			ts->failures += SignAndVerify(ts, private_key,
+						      public_key, data,
+						      sizeof(data));
+		} else {
+			ts->failures++;
+		}
+
+		PrivateKeyFree(private_key);
+		free(public_key);
+		ts->runs++;
+	}
+
+	return NULL;
+}
+
+static void StressTest(void)
+{
+	struct thread_state ts[NUM_THREADS];
+	char name[64];
+	int i;
+
+	memset(ts, 0, sizeof(ts));
+	for (i = 0; i < NUM_THREADS; i++) {
+		ts[i].id = i;
+		ts[i].algorithm = thread_algs[i % ARRAY_SIZE(thread_algs)];
+		TEST_EQ(pthread_create(&ts[i].thread, NULL, StressThread,
+				       ts + i), 0, "Start thread");
+	}
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		pthread_join(ts[i].thread, NULL);
+		snprintf(name, sizeof(name), "Thread %d (%s) ran", i,
+			 algo_strings[ts[i].algorithm]);
+		TEST_EQ(ts[i].runs, ITERATIONS, name);
+		snprintf(name, sizeof(name), "Thread %d all checks passed", i);
+		TEST_EQ(ts[i].failures, 0, name);
+	}
+
+	/* Allocations from all the threads were tracked and freed */
+	TEST_EQ(vboot_api_stub_check_memory(), 0, "No leaks");
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <keys_dir>\n", argv[0]);
+		return -1;
+	}
+	keys_dir = argv[1];
+
+	StressTest();
+
+	return gTestSuccess ? 0 : 255;
+}
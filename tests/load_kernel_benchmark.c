@@ -0,0 +1,429 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Benchmark of LoadKernel() from a GPT disk image held in memory, so the
+ * time is all spent in the firmware library.
+ *
+ * Usage: load_kernel_benchmark <keys_dir> [runs]
+ *
+ * A disk image is built for each combination of key size and kernel body
+ * size below, with one kernel partition signed by keys from <keys_dir>.
+ * LoadKernel() is timed on each, as are the parts of it: GptInit() on the
+ * GPT, and verifying the key block, the preamble and the body.  Each result
+ * is named for the key size, with the body size as its size.  Each is timed
+ * [runs] times after a warm-up, and the results are printed as JSON on
+ * stdout, in the same form as vb2_crypto_benchmark.  Progress goes to stderr.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgptlib.h"
+#include "cgptlib_internal.h"
+#include "crc32.h"
+#include "gpt.h"
+#include "gpt_misc.h"
+#include "host_common.h"
+#include "timer_utils.h"
+#include "vboot_api.h"
+#include "vboot_common.h"
+#include "vboot_kernel.h"
+
+#define DEFAULT_RUNS 15
+#define MAX_RUNS 1000
+#define WARMUP_RUNS 3
+
+/* Each run repeats the operation until it takes at least this long */
+#define MIN_RUN_NSECS 1000000ULL
+
+/* Disk layout; the kernel partition is all that's between the GPTs */
+#define SECTOR_BYTES 512
+#define GPT_ENTRIES_SECTORS 32
+#define KERNEL_START_LBA (2 + GPT_ENTRIES_SECTORS)
+#define BODY_LOAD_ADDRESS 0x100000
+
+/* The preamble is padded so the body starts here, like vbutil_kernel does */
+#define BODY_OFFSET 65536
+
+/* Kernel subkey and data key sizes; the subkey and data key match */
+static const int key_bits[] = {2048, 4096, 8192};
+
+/* Kernel body sizes, from a tiny kernel to a big one */
+static const uint32_t body_sizes[] = {
+	64 * 1024,
+	1024 * 1024,
+	8 * 1024 * 1024,
+};
+
+static int runs = DEFAULT_RUNS;
+static int results_printed;
+static int failed;
+static VbError_t load_kernel_rv;
+
+static uint8_t *diskbuf;
+static uint64_t disk_lba_count;
+
+/* Big enough for an 8192-bit kernel subkey */
+static uint8_t shared_data[VB_SHARED_DATA_REC_SIZE];
+static VbSharedDataHeader *shared = (VbSharedDataHeader *)shared_data;
+static VbNvContext nvc;
+
+static LoadKernelParams params;
+static VbCommonParams cparams;
+
+/* What's in the kernel partition, and the keys to check it with */
+struct kernel_arg {
+	const VbKeyBlockHeader *keyblock;
+	const VbKernelPreambleHeader *preamble;
+	const uint8_t *body;
+	const VbPublicKey *subkey;
+	RSAPublicKey *data_key;
+};
+
+VbError_t VbExDiskRead(VbExDiskHandle_t handle, uint64_t lba_start,
+		       uint64_t lba_count, void *buffer)
+{
+	if (handle != (VbExDiskHandle_t)1)
+		return VBERROR_UNKNOWN;
+	if (lba_start >= disk_lba_count ||
+	    lba_start + lba_count > disk_lba_count)
+		return VBERROR_UNKNOWN;
+
+	memcpy(buffer, diskbuf + lba_start * SECTOR_BYTES,
+	       lba_count * SECTOR_BYTES);
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDiskWrite(VbExDiskHandle_t handle, uint64_t lba_start,
+			uint64_t lba_count, const void *buffer)
+{
+	if (handle != (VbExDiskHandle_t)1)
+		return VBERROR_UNKNOWN;
+	if (lba_start >= disk_lba_count ||
+	    lba_start + lba_count > disk_lba_count)
+		return VBERROR_UNKNOWN;
+
+	memcpy(diskbuf + lba_start * SECTOR_BYTES, buffer,
+	       lba_count * SECTOR_BYTES);
+	return VBERROR_SUCCESS;
+}
+
+static void bench_gpt_init(void *arg)
+{
+	if (GptInit((GptData *)arg))
+		failed = 1;
+}
+
+static void bench_keyblock(void *arg)
+{
+	struct kernel_arg *a = (struct kernel_arg *)arg;
+
+	if (KeyBlockVerify(a->keyblock, a->keyblock->key_block_size,
+			   a->subkey, 0))
+		failed = 1;
+}
+
+static void bench_preamble(void *arg)
+{
+	struct kernel_arg *a = (struct kernel_arg *)arg;
+
+	if (VerifyKernelPreamble(a->preamble, a->preamble->preamble_size,
+				 a->data_key))
+		failed = 1;
+}
+
+static void bench_body(void *arg)
+{
+	struct kernel_arg *a = (struct kernel_arg *)arg;
+
+	if (VerifyData(a->body, a->preamble->body_signature.data_size,
+		       &a->preamble->body_signature, a->data_key))
+		failed = 1;
+}
+
+static void bench_load_kernel(void *arg)
+{
+	load_kernel_rv = LoadKernel(&params, &cparams);
+	if (load_kernel_rv)
+		failed = 1;
+}
+
+/* Time [fn], print a JSON result for it and return the median time */
+static double bench(const char *name, uint32_t size, TimedFunction fn,
+		    void *arg)
+{
+	TimerStats st;
+
+	if (TimeFunction(fn, arg, WARMUP_RUNS, runs, MIN_RUN_NSECS, &st)) {
+		fprintf(stderr, "Can't time %s\n", name);
+		failed = 1;
+		return 0;
+	}
+
+	printf("%s\n    {\"name\": \"%s\", \"size\": %u, "
+	       "\"iterations\": %" PRIu64 ", "
+	       "\"ns_min\": %.1f, \"ns_p50\": %.1f, \"ns_max\": %.1f, "
+	       "\"ns_mean\": %.1f, \"ns_stddev\": %.1f}",
+	       results_printed ? "," : "", name, size, st.iterations,
+	       st.ns_min, st.ns_p50, st.ns_max, st.ns_mean, st.ns_stddev);
+	fflush(stdout);
+	results_printed++;
+
+	fprintf(stderr, "# %-24s %10u bytes: %12.1f ns median\n",
+		name, size, st.ns_p50);
+	return st.ns_p50;
+}
+
+/**
+ * Build a disk image in diskbuf, with one kernel partition holding [part].
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+static int build_disk(const uint8_t *part, uint64_t part_size)
+{
+	Guid kernel_type = GPT_ENT_TYPE_CHROMEOS_KERNEL;
+	uint64_t part_sectors = (part_size + SECTOR_BYTES - 1) / SECTOR_BYTES;
+	uint64_t entries_bytes = GPT_ENTRIES_SECTORS * SECTOR_BYTES;
+	GptHeader *header, *header2;
+	GptEntry *entries;
+
+	free(diskbuf);
+	disk_lba_count = KERNEL_START_LBA + part_sectors +
+		GPT_ENTRIES_SECTORS + 1;
+	diskbuf = calloc(disk_lba_count, SECTOR_BYTES);
+	if (!diskbuf)
+		return 1;
+
+	memcpy(diskbuf + KERNEL_START_LBA * SECTOR_BYTES, part, part_size);
+
+	/* Primary GPT */
+	header = (GptHeader *)(diskbuf + SECTOR_BYTES);
+	entries = (GptEntry *)(diskbuf + 2 * SECTOR_BYTES);
+	memcpy(header->signature, GPT_HEADER_SIGNATURE,
+	       GPT_HEADER_SIGNATURE_SIZE);
+	header->revision = GPT_HEADER_REVISION;
+	header->size = sizeof(GptHeader);
+	header->my_lba = 1;
+	header->alternate_lba = disk_lba_count - 1;
+	header->first_usable_lba = KERNEL_START_LBA;
+	header->last_usable_lba = KERNEL_START_LBA + part_sectors - 1;
+	header->entries_lba = 2;
+	header->number_of_entries = MAX_NUMBER_OF_ENTRIES;
+	header->size_of_entry = sizeof(GptEntry);
+
+	memcpy(&entries[0].type, &kernel_type, sizeof(kernel_type));
+	entries[0].unique.u.raw[0] = 1;
+	entries[0].starting_lba = KERNEL_START_LBA;
+	entries[0].ending_lba = KERNEL_START_LBA + part_sectors - 1;
+	SetEntryPriority(entries, 1);
+	SetEntrySuccessful(entries, 1);
+
+	header->entries_crc32 = Crc32((uint8_t *)entries, entries_bytes);
+	header->header_crc32 = HeaderCrc(header);
+
+	/* Secondary GPT, at the end of the disk */
+	header2 = (GptHeader *)(diskbuf + (disk_lba_count - 1) * SECTOR_BYTES);
+	memcpy(header2, header, sizeof(GptHeader));
+	header2->my_lba = disk_lba_count - 1;
+	header2->alternate_lba = 1;
+	header2->entries_lba = disk_lba_count - 1 - GPT_ENTRIES_SECTORS;
+	memcpy(diskbuf + header2->entries_lba * SECTOR_BYTES, entries,
+	       entries_bytes);
+	header2->header_crc32 = HeaderCrc(header2);
+
+	return 0;
+}
+
+/**
+ * Sign a [body_size]-byte kernel with [key] as both the kernel subkey and the
+ * data key, build a disk image holding it, and time loading it.
+ *
+ * Returns 0 if success, non-zero if error.
+ */
+static int bench_kernel(int bits, const VbPrivateKey *private_key,
+			VbPublicKey *public_key, uint32_t body_size)
+{
+	VbKeyBlockHeader *keyblock = NULL;
+	VbSignature *body_sig = NULL;
+	VbKernelPreambleHeader *preamble = NULL;
+	struct kernel_arg a;
+	uint8_t *body = NULL;
+	uint8_t *part = NULL;
+	uint64_t part_size;
+	GptData gpt;
+	char name[64];
+	double total, parts;
+	uint32_t i;
+	int rv = 1;
+
+	memset(&a, 0, sizeof(a));
+	memset(&gpt, 0, sizeof(gpt));
+
+	/* Random-looking data, but the same every time */
+	body = malloc(body_size);
+	if (!body)
+		goto out;
+	srand(body_size);
+	for (i = 0; i < body_size; i++)
+		body[i] = (uint8_t)rand();
+
+	keyblock = KeyBlockCreate(public_key, private_key,
+				  KEY_BLOCK_FLAG_DEVELOPER_0 |
+				  KEY_BLOCK_FLAG_RECOVERY_0);
+	body_sig = CalculateSignature(body, body_size, private_key);
+	if (!keyblock || !body_sig)
+		goto out;
+	preamble = CreateKernelPreamble(1, BODY_LOAD_ADDRESS,
+					BODY_LOAD_ADDRESS + body_size - 4096,
+					4096, body_sig, 0, 0, 0,
+					BODY_OFFSET - keyblock->key_block_size,
+					private_key);
+	if (!preamble)
+		goto out;
+
+	part_size = keyblock->key_block_size + preamble->preamble_size +
+		body_size;
+	part = malloc(part_size);
+	if (!part)
+		goto out;
+	memcpy(part, keyblock, keyblock->key_block_size);
+	memcpy(part + keyblock->key_block_size, preamble,
+	       preamble->preamble_size);
+	memcpy(part + keyblock->key_block_size + preamble->preamble_size,
+	       body, body_size);
+	if (build_disk(part, part_size))
+		goto out;
+
+	a.keyblock = keyblock;
+	a.preamble = preamble;
+	a.body = body;
+	a.subkey = public_key;
+	a.data_key = PublicKeyToRSA(&keyblock->data_key);
+	if (!a.data_key)
+		goto out;
+
+	/* The GPT is read once; GptInit() only looks at it in memory */
+	gpt.sector_bytes = SECTOR_BYTES;
+	gpt.streaming_drive_sectors = disk_lba_count;
+	gpt.gpt_drive_sectors = disk_lba_count;
+	if (AllocAndReadGptData((VbExDiskHandle_t)1, &gpt))
+		goto out;
+
+	if (VbSharedDataInit(shared, sizeof(shared_data)) ||
+	    VbSharedDataSetKernelKey(shared, public_key))
+		goto out;
+	params.streaming_lba_count = disk_lba_count;
+	params.gpt_lba_count = disk_lba_count;
+
+	/*
+	 * Time the parts before the whole, so a broken image shows up as a
+	 * failed part rather than just a failed LoadKernel().
+	 */
+	snprintf(name, sizeof(name), "lk_gpt_init/rsa%d", bits);
+	parts = bench(name, body_size, bench_gpt_init, &gpt);
+	snprintf(name, sizeof(name), "lk_keyblock/rsa%d", bits);
+	parts += bench(name, body_size, bench_keyblock, &a);
+	snprintf(name, sizeof(name), "lk_preamble/rsa%d", bits);
+	parts += bench(name, body_size, bench_preamble, &a);
+	snprintf(name, sizeof(name), "lk_body/rsa%d", bits);
+	parts += bench(name, body_size, bench_body, &a);
+	snprintf(name, sizeof(name), "load_kernel/rsa%d", bits);
+	total = bench(name, body_size, bench_load_kernel, NULL);
+
+	/* The rest is reading the partition and copying it around */
+	if (total)
+		fprintf(stderr, "# %-24s %10u bytes: %12.1f ns (%.0f%%) "
+			"outside the parts\n", name, body_size,
+			total - parts, 100.0 * (total - parts) / total);
+
+	rv = failed;
+
+ out:
+	if (rv)
+		fprintf(stderr, "Can't load a %u-byte rsa%d kernel "
+			"(LoadKernel() returned 0x%x, check result %d)\n",
+			body_size, bits, load_kernel_rv,
+			shared->lk_calls[(shared->lk_call_count - 1) &
+					 (VBSD_MAX_KERNEL_CALLS - 1)]
+			.parts[0].check_result);
+	WriteAndFreeGptData((VbExDiskHandle_t)1, &gpt);
+	if (a.data_key)
+		RSAPublicKeyFree(a.data_key);
+	free(part);
+	free(preamble);
+	free(body_sig);
+	free(keyblock);
+	free(body);
+	return rv;
+}
+
+int main(int argc, char *argv[])
+{
+	char filename[1024];
+	int rv = 0;
+	int i, j;
+
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "Usage: %s <keys_dir> [runs]\n", argv[0]);
+		return 1;
+	}
+	if (argc == 3) {
+		runs = atoi(argv[2]);
+		if (runs < 1 || runs > MAX_RUNS) {
+			fprintf(stderr, "Runs must be 1-%d\n", MAX_RUNS);
+			return 1;
+		}
+	}
+
+	VbNvSetup(&nvc);
+	params.shared_data_blob = shared_data;
+	params.shared_data_size = sizeof(shared_data);
+	params.disk_handle = (VbExDiskHandle_t)1;
+	params.bytes_per_lba = SECTOR_BYTES;
+	params.kernel_buffer_size = 16 * 1024 * 1024;
+	params.kernel_buffer = malloc(params.kernel_buffer_size);
+	params.nv_context = &nvc;
+	if (!params.kernel_buffer) {
+		fprintf(stderr, "Can't allocate kernel buffer\n");
+		return 1;
+	}
+
+	printf("{\n  \"runs\": %d,\n  \"results\": [", runs);
+	for (i = 0; i < ARRAY_SIZE(key_bits); i++) {
+		/* RSA*_SHA256 follows RSA*_SHA1 for each key size */
+		int alg = 3 * (i + 1) + 1;
+		VbPrivateKey *private_key;
+		VbPublicKey *public_key;
+
+		snprintf(filename, sizeof(filename), "%s/key_rsa%d.pem",
+			 argv[1], key_bits[i]);
+		private_key = PrivateKeyReadPem(filename, alg);
+		snprintf(filename, sizeof(filename), "%s/key_rsa%d.keyb",
+			 argv[1], key_bits[i]);
+		public_key = PublicKeyReadKeyb(filename, alg, 1);
+		if (!private_key || !public_key) {
+			fprintf(stderr, "Error reading rsa%d keys from %s\n",
+				key_bits[i], argv[1]);
+			rv = 1;
+		} else {
+			for (j = 0; j < ARRAY_SIZE(body_sizes); j++) {
+				if (bench_kernel(key_bits[i], private_key,
+						 public_key, body_sizes[j]))
+					rv = 1;
+			}
+		}
+
+		free(public_key);
+		if (private_key)
+			PrivateKeyFree(private_key);
+	}
+	printf("\n  ]\n}\n");
+
+	free(params.kernel_buffer);
+	free(diskbuf);
+	return rv;
+}
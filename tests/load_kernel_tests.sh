@@ -73,3 +73,39 @@ ${BUILD_RUN}/tests/verify_kernel disk.test \
     ${SCRIPT_DIR}/devkeys/kernel_subkey.vbpubk
 
 happy 'Image verification succeeded'
+
+# Check all the kernel partitions' headers at once first
+${BUILD_RUN}/tests/verify_kernel -p disk.test \
+    ${SCRIPT_DIR}/devkeys/kernel_subkey.vbpubk > verify_parallel.out
+grep -q "Kernel partition 1: headers good" verify_parallel.out
+grep -q "Partition number:   1" verify_parallel.out
+
+happy 'Parallel image verification succeeded'
+
+# Boot the whole thing, starting from a BIOS image which will accept it
+echo 'Simulating boot from test disk image'
+cp ${SCRIPT_DIR}/futility/data/bios_link_mp.bin bios.orig
+${FUTILITY} sign \
+    -s ${SCRIPT_DIR}/devkeys/firmware_data_key.vbprivk \
+    -b ${SCRIPT_DIR}/devkeys/firmware.keyblock \
+    -k ${SCRIPT_DIR}/devkeys/kernel_subkey.vbpubk \
+    -v 1 \
+    bios.orig bios.test
+${FUTILITY} gbb_utility -s --flags=0 \
+    --rootkey=${SCRIPT_DIR}/devkeys/root_key.vbpubk \
+    --recoverykey=${SCRIPT_DIR}/devkeys/recovery_key.vbpubk \
+    bios.test
+
+${BUILD_RUN}/tests/boot_sim --ec-sync --tpm-us=2000 bios.test disk.test \
+    > boot_sim.out
+grep -q "Firmware slot A verified" boot_sim.out
+grep -q "Booting kernel from partition 1\.$" boot_sim.out
+grep -q "^select_kernel " boot_sim.out
+grep -q "^TPM commands: *8$" boot_sim.out
+
+# The test kernel isn't signed for recovery mode
+if ${BUILD_RUN}/tests/boot_sim --recovery bios.test disk.test \
+    > boot_sim_rec.out; then false; fi
+grep -q "Phase 1 wants recovery mode" boot_sim_rec.out
+
+happy 'Boot simulation succeeded'
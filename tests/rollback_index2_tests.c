@@ -54,6 +54,8 @@ static TPM_PERMANENT_FLAGS mock_pflags;
 static RollbackSpaceFirmware mock_rsf;
 static RollbackSpaceKernel mock_rsk;
 static uint32_t mock_permissions;
+static uint32_t mock_wrong_size_index;
+static uint8_t mock_owned;
 
 /* Reset the variables for the Tlcl mock functions. */
 static void ResetMocks(int fail_on_call, uint32_t fail_with_err)
@@ -70,6 +72,10 @@ static void ResetMocks(int fail_on_call, uint32_t fail_with_err)
 	Memset(&mock_rsf, 0, sizeof(mock_rsf));
 	Memset(&mock_rsk, 0, sizeof(mock_rsk));
 	mock_permissions = 0;
+	mock_wrong_size_index = 0;
+	mock_owned = 0;
+
+	RollbackClearCache();
 }
 
 /****************************************************************************/
@@ -220,6 +226,18 @@ uint32_t TlclSetGlobalLock(void)
 	return (++mock_count == fail_at_count) ? fail_with_error : TPM_SUCCESS;
 }
 
+uint32_t TlclSetGlobalLockStart(void)
+{
+	mock_cnext += sprintf(mock_cnext, "TlclSetGlobalLockStart()\n");
+	return (++mock_count == fail_at_count) ? fail_with_error : TPM_SUCCESS;
+}
+
+uint32_t TlclFinish(void)
+{
+	mock_cnext += sprintf(mock_cnext, "TlclFinish()\n");
+	return (++mock_count == fail_at_count) ? fail_with_error : TPM_SUCCESS;
+}
+
 uint32_t TlclLockPhysicalPresence(void)
 {
 	mock_cnext += sprintf(mock_cnext, "TlclLockPhysicalPresence()\n");
@@ -233,6 +251,34 @@ uint32_t TlclGetPermissions(uint32_t index, uint32_t* permissions)
 	return (++mock_count == fail_at_count) ? fail_with_error : TPM_SUCCESS;
 }
 
+uint32_t TlclGetSpaceInfo(uint32_t index, uint32_t *permissions,
+			  uint32_t *size)
+{
+	mock_cnext += sprintf(mock_cnext, "TlclGetSpaceInfo(0x%x)\n", index);
+	*permissions = mock_permissions;
+	switch (index) {
+	case BACKUP_NV_INDEX:
+		*size = BACKUP_NV_SIZE;
+		break;
+	case KERNEL_NV_INDEX:
+		*size = sizeof(RollbackSpaceKernel);
+		break;
+	default:
+		*size = sizeof(RollbackSpaceFirmware);
+		break;
+	}
+	if (index == mock_wrong_size_index)
+		*size += 1;
+	return (++mock_count == fail_at_count) ? fail_with_error : TPM_SUCCESS;
+}
+
+uint32_t TlclGetOwnership(uint8_t *owned)
+{
+	mock_cnext += sprintf(mock_cnext, "TlclGetOwnership()\n");
+	*owned = mock_owned;
+	return (++mock_count == fail_at_count) ? fail_with_error : TPM_SUCCESS;
+}
+
 /****************************************************************************/
 /* Tests for CRC errors  */
 
@@ -277,6 +323,25 @@ static void CrcTestFirmware(void)
 		    "TlclRead(0x1007, 10)\n",
 		    "tlcl calls");
 
+	/* Once read, it comes from the cache until cleared */
+	mock_calls[0] = 0;
+	mock_cnext = mock_calls;
+	TEST_EQ(ReadSpaceFirmware(&rsf), 0, "ReadSpaceFirmware(), cached");
+	TEST_EQ(rsf.crc8, mock_rsf.crc8, "ReadSpaceFirmware(), cached data");
+	TEST_STR_EQ(mock_calls, "", "tlcl calls");
+	RollbackClearCache();
+	TEST_EQ(ReadSpaceFirmware(&rsf), 0, "ReadSpaceFirmware(), cleared");
+	TEST_STR_EQ(mock_calls, "TlclRead(0x1007, 10)\n", "tlcl calls");
+
+	/* A bad read isn't cached */
+	ResetMocks(0, 0);
+	mock_rsf.struct_version = 2;
+	ReadSpaceFirmware(&rsf);
+	mock_rsf.crc8 = Crc8(&mock_rsf, offsetof(RollbackSpaceFirmware, crc8));
+	TEST_EQ(ReadSpaceFirmware(&rsf), 0,
+		"ReadSpaceFirmware(), after bad CRC");
+	TEST_EQ(mock_count, 4, "  read again");
+
 	/* A write with version < 2 should convert to v2 and create the CRC */
 	ResetMocks(0, 0);
 	Memset(&rsf, 0, sizeof(rsf));
@@ -379,6 +444,16 @@ static void CrcTestKernel(void)
 		    "TlclRead(0x1008, 13)\n",
 		    "tlcl calls");
 
+	/* Once read, it comes from the cache until cleared */
+	mock_calls[0] = 0;
+	mock_cnext = mock_calls;
+	TEST_EQ(ReadSpaceKernel(&rsk), 0, "ReadSpaceKernel(), cached");
+	TEST_EQ(rsk.crc8, mock_rsk.crc8, "ReadSpaceKernel(), cached data");
+	TEST_STR_EQ(mock_calls, "", "tlcl calls");
+	RollbackClearCache();
+	TEST_EQ(ReadSpaceKernel(&rsk), 0, "ReadSpaceKernel(), cleared");
+	TEST_STR_EQ(mock_calls, "TlclRead(0x1008, 13)\n", "tlcl calls");
+
 	/* A write with version < 2 should convert to v2 and create the CRC */
 	ResetMocks(0, 0);
 	Memset(&rsk, 0, sizeof(rsk));
@@ -388,6 +463,11 @@ static void CrcTestKernel(void)
 		    "TlclWrite(0x1008, 13)\n"
 		    "TlclRead(0x1008, 13)\n",
 		    "tlcl calls");
+	TEST_EQ(ReadSpaceKernel(&rsk), 0, "ReadSpaceKernel(), after write");
+	TEST_STR_EQ(mock_calls,
+		    "TlclWrite(0x1008, 13)\n"
+		    "TlclRead(0x1008, 13)\n",
+		    "  from cache");
 
 	/* Same as above, but with some noise during the readback */
 	ResetMocks(0, 0);
@@ -517,9 +597,10 @@ static void OneTimeInitTest(void)
 		    "TlclGetPermanentFlags()\n"
 		    "TlclFinalizePhysicalPresence()\n"
 		    "TlclSetNvLocked()\n"
-		    "TlclForceClear()\n"
-		    "TlclSetEnable()\n"
-		    "TlclSetDeactivated(0)\n"
+		    "TlclGetOwnership()\n"
+		    "TlclGetSpaceInfo(0x1009)\n"
+		    "TlclGetSpaceInfo(0x1008)\n"
+		    "TlclGetSpaceInfo(0x1007)\n"
 		    /* backup space */
 		    "TlclDefineSpace(0x1009, 0x1, 16)\n"
 		    /* kernel space */
@@ -548,9 +629,10 @@ static void OneTimeInitTest(void)
 		    "TlclSelfTestFull()\n"
 		    "TlclGetPermanentFlags()\n"
 		    "TlclSetNvLocked()\n"
-		    "TlclForceClear()\n"
-		    "TlclSetEnable()\n"
-		    "TlclSetDeactivated(0)\n"
+		    "TlclGetOwnership()\n"
+		    "TlclGetSpaceInfo(0x1009)\n"
+		    "TlclGetSpaceInfo(0x1008)\n"
+		    "TlclGetSpaceInfo(0x1007)\n"
 		    /* backup space */
 		    "TlclDefineSpace(0x1009, 0x1, 16)\n"
 		    /* kernel space */
@@ -571,9 +653,38 @@ static void OneTimeInitTest(void)
 		    "TlclSelfTestFull()\n"
 		    "TlclGetPermanentFlags()\n"
 		    "TlclFinalizePhysicalPresence()\n"
+		    "TlclGetOwnership()\n"
+		    "TlclGetSpaceInfo(0x1009)\n"
+		    "TlclGetSpaceInfo(0x1008)\n"
+		    "TlclGetSpaceInfo(0x1007)\n"
+		    /* backup space */
+		    "TlclDefineSpace(0x1009, 0x1, 16)\n"
+		    /* kernel space */
+		    "TlclDefineSpace(0x1008, 0x1, 13)\n"
+		    "TlclWrite(0x1008, 13)\n"
+		    "TlclRead(0x1008, 13)\n"
+		    /* firmware space */
+		    "TlclDefineSpace(0x1007, 0x8001, 10)\n"
+		    "TlclWrite(0x1007, 10)\n"
+		    "TlclRead(0x1007, 10)\n",
+		    "tlcl calls");
+
+	/* Owned TPM is cleared first */
+	ResetMocks(0, 0);
+	mock_pflags.physicalPresenceLifetimeLock = 1;
+	mock_pflags.nvLocked = 1;
+	mock_owned = 1;
+	TEST_EQ(OneTimeInitializeTPM(&rsf, &rsk), 0, "OneTimeInitializeTPM()");
+	TEST_STR_EQ(mock_calls,
+		    "TlclSelfTestFull()\n"
+		    "TlclGetPermanentFlags()\n"
+		    "TlclGetOwnership()\n"
 		    "TlclForceClear()\n"
 		    "TlclSetEnable()\n"
 		    "TlclSetDeactivated(0)\n"
+		    "TlclGetSpaceInfo(0x1009)\n"
+		    "TlclGetSpaceInfo(0x1008)\n"
+		    "TlclGetSpaceInfo(0x1007)\n"
 		    /* backup space */
 		    "TlclDefineSpace(0x1009, 0x1, 16)\n"
 		    /* kernel space */
@@ -586,6 +697,83 @@ static void OneTimeInitTest(void)
 		    "TlclRead(0x1007, 10)\n",
 		    "tlcl calls");
 
+	/*
+	 * Picking up after the kernel space was done; only the firmware space
+	 * is defined and written
+	 */
+	ResetMocks(0, 0);
+	mock_pflags.physicalPresenceLifetimeLock = 1;
+	mock_pflags.nvLocked = 1;
+	mock_permissions = TPM_NV_PER_PPWRITE;
+	mock_rsk.struct_version = ROLLBACK_SPACE_KERNEL_VERSION;
+	mock_rsk.uid = ROLLBACK_SPACE_KERNEL_UID;
+	mock_rsk.crc8 = Crc8(&mock_rsk, offsetof(RollbackSpaceKernel, crc8));
+	TEST_EQ(OneTimeInitializeTPM(&rsf, &rsk), 0, "OneTimeInitializeTPM()");
+	TEST_STR_EQ(mock_calls,
+		    "TlclSelfTestFull()\n"
+		    "TlclGetPermanentFlags()\n"
+		    "TlclGetOwnership()\n"
+		    "TlclGetSpaceInfo(0x1009)\n"
+		    "TlclGetSpaceInfo(0x1008)\n"
+		    "TlclGetSpaceInfo(0x1007)\n"
+		    /* kernel space */
+		    "TlclRead(0x1008, 13)\n"
+		    /* firmware space */
+		    "TlclDefineSpace(0x1007, 0x8001, 10)\n"
+		    "TlclWrite(0x1007, 10)\n"
+		    "TlclRead(0x1007, 10)\n",
+		    "tlcl calls");
+	TEST_EQ(rsk.crc8, mock_rsk.crc8, "rsk crc");
+
+	/* Kernel space with the wrong contents is rewritten */
+	ResetMocks(0, 0);
+	mock_pflags.physicalPresenceLifetimeLock = 1;
+	mock_pflags.nvLocked = 1;
+	mock_permissions = TPM_NV_PER_PPWRITE;
+	mock_rsk.kernel_versions = 0x10001;
+	TEST_EQ(OneTimeInitializeTPM(&rsf, &rsk), 0, "OneTimeInitializeTPM()");
+	TEST_STR_EQ(mock_calls,
+		    "TlclSelfTestFull()\n"
+		    "TlclGetPermanentFlags()\n"
+		    "TlclGetOwnership()\n"
+		    "TlclGetSpaceInfo(0x1009)\n"
+		    "TlclGetSpaceInfo(0x1008)\n"
+		    "TlclGetSpaceInfo(0x1007)\n"
+		    /* kernel space */
+		    "TlclRead(0x1008, 13)\n"
+		    "TlclWrite(0x1008, 13)\n"
+		    "TlclRead(0x1008, 13)\n"
+		    /* firmware space */
+		    "TlclDefineSpace(0x1007, 0x8001, 10)\n"
+		    "TlclWrite(0x1007, 10)\n"
+		    "TlclRead(0x1007, 10)\n",
+		    "tlcl calls");
+	TEST_EQ(mock_rsk.kernel_versions, 0, "rsk kernel_versions");
+
+	/* Kernel space with the wrong size is redefined */
+	ResetMocks(0, 0);
+	mock_pflags.physicalPresenceLifetimeLock = 1;
+	mock_pflags.nvLocked = 1;
+	mock_permissions = TPM_NV_PER_PPWRITE;
+	mock_wrong_size_index = KERNEL_NV_INDEX;
+	TEST_EQ(OneTimeInitializeTPM(&rsf, &rsk), 0, "OneTimeInitializeTPM()");
+	TEST_STR_EQ(mock_calls,
+		    "TlclSelfTestFull()\n"
+		    "TlclGetPermanentFlags()\n"
+		    "TlclGetOwnership()\n"
+		    "TlclGetSpaceInfo(0x1009)\n"
+		    "TlclGetSpaceInfo(0x1008)\n"
+		    "TlclGetSpaceInfo(0x1007)\n"
+		    /* kernel space */
+		    "TlclDefineSpace(0x1008, 0x1, 13)\n"
+		    "TlclWrite(0x1008, 13)\n"
+		    "TlclRead(0x1008, 13)\n"
+		    /* firmware space */
+		    "TlclDefineSpace(0x1007, 0x8001, 10)\n"
+		    "TlclWrite(0x1007, 10)\n"
+		    "TlclRead(0x1007, 10)\n",
+		    "tlcl calls");
+
 	/* Self test error */
 	ResetMocks(1, TPM_E_IOERROR);
 	TEST_EQ(OneTimeInitializeTPM(&rsf, &rsk), TPM_E_IOERROR,
@@ -667,9 +855,10 @@ static void SetupTpmTest(void)
 		    /* Calls from one-time init */
 		    "TlclSelfTestFull()\n"
 		    "TlclGetPermanentFlags()\n"
-		    "TlclForceClear()\n"
-		    "TlclSetEnable()\n"
-		    "TlclSetDeactivated(0)\n"
+		    "TlclGetOwnership()\n"
+		    "TlclGetSpaceInfo(0x1009)\n"
+		    "TlclGetSpaceInfo(0x1008)\n"
+		    "TlclGetSpaceInfo(0x1007)\n"
 		    /* backup space */
 		    "TlclDefineSpace(0x1009, 0x1, 16)\n"
 		    "TlclDefineSpace(0x1008, 0x1, 13)\n"
@@ -692,6 +881,34 @@ static void SetupTpmTest(void)
 		    "TlclRead(0x1007, 10)\n",
 		    "tlcl calls");
 
+	/* Started early, so SetupTPM() doesn't start the TPM again */
+	ResetMocks(0, 0);
+	TEST_EQ(RollbackSelfTestStart(), 0, "RollbackSelfTestStart()");
+	TEST_EQ(SetupTPM(0, 0, 0, &rsf), 0, "  then SetupTPM()");
+	TEST_STR_EQ(mock_calls,
+		    "TlclLibInit()\n"
+		    "TlclStartup()\n"
+		    "TlclAssertPhysicalPresence()\n"
+		    "TlclGetPermanentFlags()\n"
+		    "TlclRead(0x1007, 10)\n",
+		    "tlcl calls");
+
+	/* Error starting early is reported by SetupTPM() */
+	ResetMocks(2, TPM_E_IOERROR);
+	TEST_EQ(RollbackSelfTestStart(), TPM_E_IOERROR,
+		"RollbackSelfTestStart() error");
+	TEST_EQ(SetupTPM(0, 0, 0, &rsf), TPM_E_IOERROR, "  from SetupTPM()");
+	TEST_STR_EQ(mock_calls,
+		    "TlclLibInit()\n"
+		    "TlclStartup()\n",
+		    "tlcl calls");
+
+	/* And only once; the next SetupTPM() starts the TPM itself */
+	ResetMocks(0, 0);
+	TEST_EQ(SetupTPM(0, 0, 0, &rsf), 0, "SetupTPM() after early start");
+	TEST_EQ(strncmp(mock_calls, "TlclLibInit()\nTlclStartup()\n", 28), 0,
+		"  starts TPM");
+
 	/* If developer flag has toggled, clear ownership and write new flag */
 	ResetMocks(0, 0);
 	TEST_EQ(SetupTPM(1, 0, 0, &rsf), 0, "SetupTPM() to dev");
@@ -879,6 +1096,30 @@ static void RollbackFirmwareTest(void)
 	ResetMocks(1, TPM_E_IOERROR);
 	TEST_EQ(RollbackFirmwareLock(), TPM_E_IOERROR,
 		"RollbackFirmwareLock() error");
+
+	/* Lock started early is finished by RollbackFirmwareLock() */
+	ResetMocks(0, 0);
+	TEST_EQ(RollbackFirmwareLockStart(), 0, "RollbackFirmwareLockStart()");
+	TEST_EQ(RollbackFirmwareLock(), 0, "RollbackFirmwareLock() finish");
+	TEST_STR_EQ(mock_calls,
+		    "TlclSetGlobalLockStart()\n"
+		    "TlclFinish()\n",
+		    "tlcl calls");
+
+	ResetMocks(2, TPM_E_IOERROR);
+	RollbackFirmwareLockStart();
+	TEST_EQ(RollbackFirmwareLock(), TPM_E_IOERROR,
+		"RollbackFirmwareLock() finish error");
+
+	/* If the lock didn't start, it's tried again */
+	ResetMocks(1, TPM_E_IOERROR);
+	TEST_EQ(RollbackFirmwareLockStart(), TPM_E_IOERROR,
+		"RollbackFirmwareLockStart() error");
+	TEST_EQ(RollbackFirmwareLock(), 0, "RollbackFirmwareLock() retry");
+	TEST_STR_EQ(mock_calls,
+		    "TlclSetGlobalLockStart()\n"
+		    "TlclSetGlobalLock()\n",
+		    "tlcl calls");
 }
 
 /****************************************************************************/
@@ -908,6 +1149,14 @@ static void RollbackKernelTest(void)
 		    "tlcl calls");
 	TEST_EQ(version, 0x87654321, "RollbackKernelRead() version");
 
+	/* Reading again doesn't go back to the TPM */
+	mock_calls[0] = 0;
+	mock_cnext = mock_calls;
+	version = 0;
+	TEST_EQ(RollbackKernelRead(&version), 0, "RollbackKernelRead() again");
+	TEST_STR_EQ(mock_calls, "", "tlcl calls");
+	TEST_EQ(version, 0x87654321, "RollbackKernelRead() again version");
+
 	/* Read error */
 	ResetMocks(1, TPM_E_IOERROR);
 	TEST_EQ(RollbackKernelRead(&version), TPM_E_IOERROR,
@@ -944,6 +1193,32 @@ static void RollbackKernelTest(void)
 	TEST_EQ(RollbackKernelWrite(123), TPM_E_IOERROR,
 		"RollbackKernelWrite() error");
 
+	/* After a read, writing the same version doesn't go to the TPM */
+	ResetMocks(0, 0);
+	mock_rsk.struct_version = 2;
+	mock_rsk.uid = ROLLBACK_SPACE_KERNEL_UID;
+	mock_rsk.kernel_versions = 0x87654321;
+	mock_rsk.crc8 = Crc8(&mock_rsk, offsetof(RollbackSpaceKernel, crc8));
+	mock_permissions = TPM_NV_PER_PPWRITE;
+	TEST_EQ(RollbackKernelRead(&version), 0, "RollbackKernelRead()");
+	*mock_calls = 0;
+	mock_cnext = mock_calls;
+	TEST_EQ(RollbackKernelWrite(0x87654321), 0,
+		"RollbackKernelWrite() same version");
+	TEST_STR_EQ(mock_calls, "", "  no tlcl calls");
+	TEST_EQ(RollbackKernelWrite(0x87654322), 0,
+		"RollbackKernelWrite() new version");
+	TEST_STR_EQ(mock_calls,
+		    "TlclWrite(0x1008, 13)\n"
+		    "TlclRead(0x1008, 13)\n",
+		    "  write and read back");
+	TEST_EQ(RollbackKernelRead(&version), 0, "  read again");
+	TEST_EQ(version, 0x87654322, "  from cache");
+	TEST_STR_EQ(mock_calls,
+		    "TlclWrite(0x1008, 13)\n"
+		    "TlclRead(0x1008, 13)\n",
+		    "  without tlcl calls");
+
 	/* Test lock (recovery off) */
 	ResetMocks(0, 0);
 	TEST_EQ(RollbackKernelLock(0), 0, "RollbackKernelLock()");
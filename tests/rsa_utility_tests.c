@@ -21,9 +21,10 @@
 static int mock_rsaverify_retval;
 
 /* Mock functions */
-uint8_t* DigestBuf(const uint8_t* buf, uint64_t len, int sig_algorithm) {
-  /* Just need to return something; it's only passed to the mock RSAVerify() */
-  return VbExMalloc(4);
+int DigestBufInto(const uint8_t* buf, uint64_t len, int sig_algorithm,
+                  uint8_t* digest, uint32_t size) {
+  /* The digest is only passed to the mock RSAVerify() */
+  return 0;
 }
 
 int RSAVerify(const RSAPublicKey *key,
@@ -108,6 +109,32 @@ static void TestKeyFromBuffer(void) {
             "RSAPublicKeyFromBuf() rr end");
     RSAPublicKeyFree(key);
 
+    /* Into caller storage, which must be big enough */
+    {
+      RSAPublicKey key_into;
+      uint32_t storage[2 * RSA8192NUMBYTES / sizeof(uint32_t)];
+
+      TEST_EQ(RSAPublicKeyFromBufInto(buf, 8 + key_len * 2, &key_into,
+                                      storage, 2 * key_len), 0,
+              "RSAPublicKeyFromBufInto()");
+      TEST_EQ(key_into.len, *buf_key_len, "RSAPublicKeyFromBufInto() len");
+      TEST_EQ(key_into.n0inv, 0xF00D2345,
+              "RSAPublicKeyFromBufInto() n0inv");
+      TEST_PTR_EQ(key_into.n, storage, "RSAPublicKeyFromBufInto() n ptr");
+      TEST_EQ(((uint8_t*)key_into.n)[key_len - 1], 101,
+              "RSAPublicKeyFromBufInto() n end");
+      TEST_PTR_EQ(key_into.rr, storage + *buf_key_len,
+                  "RSAPublicKeyFromBufInto() rr ptr");
+      TEST_EQ(((uint8_t*)key_into.rr)[key_len - 1], 121,
+              "RSAPublicKeyFromBufInto() rr end");
+      TEST_NEQ(RSAPublicKeyFromBufInto(buf, 8 + key_len * 2, &key_into,
+                                       storage, 2 * key_len - 1), 0,
+               "RSAPublicKeyFromBufInto() storage too small");
+      TEST_NEQ(RSAPublicKeyFromBufInto(buf, 8 + key_len * 2 - 1, &key_into,
+                                       storage, sizeof(storage)), 0,
+               "RSAPublicKeyFromBufInto() underflow");
+    }
+
     /* Underflow and overflow */
     TEST_PTR_EQ(RSAPublicKeyFromBuf(buf, 8 + key_len * 2 - 1), NULL,
                 "RSAPublicKeyFromBuf() underflow");
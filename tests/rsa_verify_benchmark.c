@@ -14,9 +14,25 @@
 
 #define FILE_NAME_SIZE 128
 #define NUM_OPERATIONS 100 /* Number of signature operations to time. */
+#define NUM_WARMUPS 5 /* Untimed verifications before those. */
+
+typedef struct VerifyArg {
+  RSAPublicKey* key;
+  uint8_t* signature;
+  uint64_t sig_len;
+  int algorithm;
+  uint8_t* digest;
+  int failed;
+} VerifyArg;
+
+static void TimedVerify(void* arg) {
+  VerifyArg* a = (VerifyArg*) arg;
+  if (!RSAVerify(a->key, a->signature, a->sig_len, a->algorithm, a->digest))
+    a->failed = 1;
+}
 
 int SpeedTestAlgorithm(int algorithm) {
-  int i, key_size;
+  int key_size;
   int error_code = 0;
   double speed, msecs;
   char file_name[FILE_NAME_SIZE];
@@ -24,7 +40,8 @@ int SpeedTestAlgorithm(int algorithm) {
   uint8_t* signature = NULL;
   uint64_t digest_len, sig_len;
   RSAPublicKey* key = NULL;
-  ClockTimerState ct;
+  TimerStats st;
+  VerifyArg a;
   char* sha_strings[] = {  /* Maps algorithm->SHA algorithm. */
     "sha1", "sha256", "sha512",  /* RSA-1024 */
     "sha1", "sha256", "sha512",  /* RSA-2048 */
@@ -62,19 +79,27 @@ int SpeedTestAlgorithm(int algorithm) {
     goto failure;
   }
 
-  StartTimer(&ct);
-  for (i = 0; i < NUM_OPERATIONS; i++) {
-    if (!RSAVerify(key, signature, sig_len, algorithm, digest))
-      VBDEBUG(("Warning: Signature Check Failed.\n"));
+  /* Each verification is timed on its own. */
+  a.key = key;
+  a.signature = signature;
+  a.sig_len = sig_len;
+  a.algorithm = algorithm;
+  a.digest = digest;
+  a.failed = 0;
+  if (TimeFunction(TimedVerify, &a, NUM_WARMUPS, NUM_OPERATIONS, 0, &st)) {
+    error_code = 1;
+    goto failure;
   }
-  StopTimer(&ct);
+  if (a.failed)
+    VBDEBUG(("Warning: Signature Check Failed.\n"));
 
-  msecs = (float) GetDurationMsecs(&ct) / NUM_OPERATIONS;
+  msecs = st.ns_p50 / 1e6;
   speed = 1000.0 / msecs ;
-  fprintf(stderr, "# rsa%d/%s:\tTime taken per verification = %.02f ms,"
+  fprintf(stderr, "# rsa%d/%s:\tTime taken per verification = %.03f ms"
+          " (min %.03f, mean %.03f, stddev %.03f),"
           " Speed = %.02f verifications/s\n", key_size, sha_strings[algorithm],
-          msecs, speed);
-  fprintf(stdout, "ms_rsa%d_%s:%.02f\n", key_size, sha_strings[algorithm],
+          msecs, st.ns_min / 1e6, st.ns_mean / 1e6, st.ns_stddev / 1e6, speed);
+  fprintf(stdout, "ms_rsa%d_%s:%.03f\n", key_size, sha_strings[algorithm],
           msecs);
 
 failure:
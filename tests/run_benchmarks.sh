@@ -0,0 +1,52 @@
+#!/bin/bash
+
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+#
+# Run the benchmarks and compare them with a baseline.
+#
+# Usage: run_benchmarks.sh [-u] [-t threshold_percent] [baseline.json]
+#
+# Fails if any result is more than the threshold (default 25%) slower than
+# the baseline.  With -u, the baseline is rewritten from this run instead.
+# Timings depend on the machine, so the checked-in baseline is only a
+# starting point; record one on the machine which will do the comparing.
+
+# Load common constants and variables.
+. "$(dirname "$0")/common.sh"
+
+set -e
+
+COMPARE_ARGS=
+while getopts "ut:" opt; do
+  case $opt in
+    u) COMPARE_ARGS="${COMPARE_ARGS} --update" ;;
+    t) COMPARE_ARGS="${COMPARE_ARGS} --threshold ${OPTARG}" ;;
+    *) exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+BASELINE=$(readlink -f "${1:-${SCRIPT_DIR}/benchmark_baseline.json}")
+
+DIR="${TEST_DIR}/benchmarks"
+[ -d "$DIR" ] || mkdir -p "$DIR"
+echo "Running benchmarks in $DIR"
+cd "$DIR"
+rm -f *.json
+
+${BUILD_RUN}/tests/vb2_crypto_benchmark ${TESTKEY_DIR} > crypto.json
+${BUILD_RUN}/tests/load_kernel_benchmark ${TESTKEY_DIR} > load_kernel.json
+${BUILD_RUN}/tests/efi_decompress_benchmark > efi_decompress.json
+${BUILD_RUN}/tests/efi_decompress_benchmark 15 \
+    ${SCRIPT_DIR}/bitmaps/*.bmp > efi_decompress_bmp.json
+${BUILD_RUN}/tests/futility_startup_benchmark ${FUTILITY} \
+    ${SCRIPT_DIR}/devkeys/kernel_subkey.vbpubk > futility_startup.json
+for bios in ${SCRIPT_DIR}/futility/data/bios_*.bin; do
+  ${BUILD_RUN}/tests/futility_startup_benchmark ${FUTILITY} "$bios" 15 \
+      ${SCRIPT_DIR}/devkeys > "futility_$(basename "$bios" .bin).json"
+done
+${BUILD_RUN}/tests/futility_startup_benchmark ${FUTILITY} \
+    ${SCRIPT_DIR}/futility/data/rec_kernel_part.bin > futility_kernel.json
+
+${SCRIPT_DIR}/benchmark_compare.py ${COMPARE_ARGS} "${BASELINE}" *.json
@@ -269,7 +269,213 @@ assert_pri 13 13 14 12 15 11 10 10  9  9  8  8 7 7 6 6 5 5 4 4 3 3 2 2 1 1 1 1 1
 $CGPT prioritize $MTD -i 1 -f ${DEV}
 assert_pri 15 15 13 12 14 11 10 10  9  9  8  8 7 7 6 6 5 5 4 4 3 3 2 2 1 1 1 1 1 1 0
 
-# Now make sure that we don't need write access if we're just looking.
+# an order puts all of its kernels on top at once
+make_pri   2 0 0
+$CGPT prioritize $MTD -o 2,1 ${DEV}
+assert_pri 1 2 0
+$CGPT prioritize $MTD -o 1 ${DEV}
+assert_pri 2 1 0
+
+# which is the same as raising each one in turn, last first
+make_pri   15 15 14 14 13 13 12 12 11 11 10 10 9 9 8 8 7 7 6 6 5 5 4 4 3 3 2 2 1 1 0
+$CGPT prioritize $MTD -o 5,3 ${DEV}
+assert_pri 13 13 14 12 15 11 10 10  9  9  8  8 7 7 6 6 5 5 4 4 3 3 2 2 1 1 1 1 1 1 0
+make_pri   1 1 2 2 3 3 4 4 5 5 0 6 7 7
+$CGPT prioritize $MTD -P 7 -o 3,11 ${DEV}
+assert_pri 1 1 7 1 1 1 2 2 3 3 6 4 5 5
+
+# an order that's already in place doesn't touch the drive
+cp ${DEV} order_orig.bin
+$CGPT prioritize $MTD -P 7 -o 3,11 ${DEV}
+cmp ${DEV} order_orig.bin || error "prioritize -o rewrote an unchanged drive"
+
+# bad orders are rejected without changing anything
+$CGPT prioritize $MTD -o 3,3 ${DEV} 2>/dev/null && error
+$CGPT prioritize $MTD -o 3,99 ${DEV} 2>/dev/null && error
+$CGPT prioritize $MTD -o 3, ${DEV} >/dev/null 2>&1 && error
+$CGPT prioritize $MTD -o 3 -i 4 ${DEV} >/dev/null 2>&1 && error
+cmp ${DEV} order_orig.bin || error "bad prioritize -o changed the drive"
+
+echo "Test the cgpt batch command..."
+# The same commands, one at a time or in a batch, should make the same disk.
+# (Partitions get random unique GUIDs unless they're given with -u.)
+batch_cmds() {
+  cat <<EOF
+# Comments and blank lines are skipped
+
+add $MTD -b ${DATA_START} -s ${DATA_SIZE} -t data -u ${DATA_GUID} \
+  -l "${DATA_LABEL}" $1
+add $MTD -b ${KERN_START} -s ${KERN_SIZE} -t kernel -u ${KERN_GUID} \
+  -l '${KERN_LABEL}' $1
+add $MTD -b ${ROOTFS_START} -s ${ROOTFS_SIZE} -t rootfs -u ${ROOTFS_GUID} \
+  -l rootfs\\ stuff $1
+add $MTD -i ${KERN_NUM} -P 5 -S 1 $1
+boot $MTD -p -i ${KERN_NUM} $1
+prioritize $MTD -i ${KERN_NUM} -P 3 $1
+show $MTD $1
+EOF
+}
+BATCH_DEV=batch_dev.bin
+dd if=/dev/zero of=${BATCH_DEV} bs=512 count=${NUM_SECTORS} 2>/dev/null
+$CGPT create $MTD ${BATCH_DEV}
+cp ${BATCH_DEV} ${DEV}
+batch_cmds ${DEV} | sed -e '/^#/d' -e '/^$/d' | while read -r line; do
+  eval "$CGPT ${line}" >/dev/null
+done
+batch_cmds ${BATCH_DEV} | $CGPT batch >/dev/null
+cmp ${DEV} ${BATCH_DEV} || error "batch and single commands differ"
+X=$($CGPT show $MTD -l -i ${ROOTFS_NUM} ${BATCH_DEV})
+[ "$X" = "${ROOTFS_LABEL}" ] || error
+
+# If any command fails, nothing is written.
+cp ${BATCH_DEV} batch_orig.bin
+cat > batch_bad.txt <<EOF
+add $MTD -i ${DATA_NUM} -l changed ${BATCH_DEV}
+boot $MTD -p ${BATCH_DEV}
+add $MTD -i 99 ${BATCH_DEV}
+EOF
+assert_fail $CGPT batch batch_bad.txt
+cmp ${BATCH_DEV} batch_orig.bin || error "failed batch changed the drive"
+assert_fail $CGPT batch no_such_file.txt
+echo "batch ${BATCH_DEV}" > batch_nested.txt
+assert_fail $CGPT batch batch_nested.txt
+
+echo "Test finding partitions by content..."
+printf 'some partition content' > find_content.bin
+dd if=find_content.bin of=${BATCH_DEV} bs=1 conv=notrunc \
+  seek=$((DATA_START * 512 + 5000)) 2>/dev/null
+X=$($CGPT find $MTD -t data -M find_content.bin -O 5000 ${BATCH_DEV})
+[ "$X" = "${BATCH_DEV}${DATA_NUM}" ] || error
+assert_fail $CGPT find $MTD -t data -M find_content.bin -O 4999 ${BATCH_DEV}
+# Or anywhere in a window
+X=$($CGPT find $MTD -t data -M find_content.bin -W $((DATA_SIZE * 512)) \
+  ${BATCH_DEV})
+[ "$X" = "${BATCH_DEV}${DATA_NUM}" ] || error
+$CGPT find $MTD -t data -M find_content.bin -O 4990 -W 33 ${BATCH_DEV} \
+  >/dev/null || error
+assert_fail $CGPT find $MTD -t data -M find_content.bin -O 4990 -W 31 \
+  ${BATCH_DEV}
+assert_fail $CGPT find $MTD -t data -M find_content.bin -O 5001 -W 1000000 \
+  ${BATCH_DEV}
+assert_fail $CGPT find $MTD -t data -W 100 ${BATCH_DEV}
+
+echo "Test cgpt show on many drives..."
+X=$($CGPT show $MTD -j -F start,size,priority -i ${KERN_NUM} ${BATCH_DEV} \
+  ${DEV})
+Y="{\"part\":${KERN_NUM},\"start\":${KERN_START},\"size\":${KERN_SIZE},\"priority\":3}"
+[ "$X" = "[{\"drive\":\"${BATCH_DEV}\",\"sector_bytes\":512,\"partitions\":[$Y]},{\"drive\":\"${DEV}\",\"sector_bytes\":512,\"partitions\":[$Y]}]" ] \
+  || error
+X=$($CGPT show $MTD -j -F label,uuid -i ${DATA_NUM} ${BATCH_DEV})
+[ "$X" = "[{\"drive\":\"${BATCH_DEV}\",\"sector_bytes\":512,\"partitions\":[{\"part\":${DATA_NUM},\"uuid\":\"$(echo ${DATA_GUID} | tr 'a-z' 'A-Z')\",\"label\":\"${DATA_LABEL}\"}]}]" ] \
+  || error
+# Every partition, and a drive that isn't there
+X=$($CGPT show $MTD -j -F start ${BATCH_DEV} no_such_dev.bin 2>/dev/null) && \
+  error
+[ "$X" = "[{\"drive\":\"${BATCH_DEV}\",\"sector_bytes\":512,\"partitions\":[{\"part\":1,\"start\":${DATA_START}},{\"part\":2,\"start\":${KERN_START}},{\"part\":3,\"start\":${ROOTFS_START}}]},{\"drive\":\"no_such_dev.bin\",\"error\":\"can't open drive\"}]" ] \
+  || error
+assert_fail $CGPT show $MTD -j -F start,bogus ${BATCH_DEV}
+assert_fail $CGPT show $MTD -j -b -i 1 ${BATCH_DEV}
+# Without -j, each drive is shown as it would be on its own
+X=$($CGPT show $MTD -q ${BATCH_DEV} ${DEV})
+[ "$X" = "$(printf '%s:\n%s\n\n%s:\n%s' ${BATCH_DEV} \
+  "$($CGPT show $MTD -q ${BATCH_DEV})" ${DEV} "$($CGPT show $MTD -q ${DEV})")" ] \
+  || error
+
+echo "Test cgpt find with a cache..."
+rm -f find.cache
+cp ${BATCH_DEV} cache_dev.bin
+X=$($CGPT find $MTD -C find.cache -u ${KERN_GUID} cache_dev.bin)
+[ "$X" = "cache_dev.bin${KERN_NUM}" ] || error
+# A changed header means the table is read again
+$CGPT add $MTD -i ${DATA_NUM} -l "new label" cache_dev.bin
+X=$($CGPT find $MTD -C find.cache -l "new label" cache_dev.bin)
+[ "$X" = "cache_dev.bin${DATA_NUM}" ] || error
+assert_fail $CGPT find $MTD -C find.cache -l "${DATA_LABEL}" cache_dev.bin
+if [ -z "$MTD" ]; then
+  # Otherwise only the header is read, so the tables can go and it's found
+  dd if=/dev/zero of=cache_dev.bin bs=512 seek=2 count=32 conv=notrunc \
+    2>/dev/null
+  dd if=/dev/zero of=cache_dev.bin bs=512 seek=$((NUM_SECTORS - 33)) \
+    count=33 conv=notrunc 2>/dev/null
+  assert_fail $CGPT find -t kernel cache_dev.bin
+  X=$($CGPT find -C find.cache -t kernel cache_dev.bin)
+  [ "$X" = "cache_dev.bin${KERN_NUM}" ] || error
+  # A cache anyone else can write is ignored
+  chmod 0666 find.cache
+  assert_fail $CGPT find -C find.cache -t kernel cache_dev.bin
+fi
+rm -f find.cache cache_dev.bin
+
+echo "Test cgpt repair -c..."
+$CGPT repair $MTD -c ${BATCH_DEV} >/dev/null || error
+cp ${BATCH_DEV} repair_dev.bin
+dd if=/dev/zero of=repair_dev.bin bs=512 seek=$((NUM_SECTORS - 1)) count=1 \
+  conv=notrunc 2>/dev/null
+cp repair_dev.bin repair_orig.bin
+X=$($CGPT repair $MTD -c repair_dev.bin 2>/dev/null) && error
+[ "$X" = "$(printf 'Secondary Entries needs repair.\nSecondary Header needs repair.')" ] \
+  || error
+cmp repair_dev.bin repair_orig.bin || error "repair -c changed the drive"
+$CGPT repair $MTD repair_dev.bin >/dev/null || error
+$CGPT repair $MTD -c repair_dev.bin >/dev/null || error
+
+if [ -z "$MTD" ]; then
+  # Only part of the secondary entries are out of date; once the sectors that
+  # differ are rewritten, both copies match again.
+  cp ${BATCH_DEV} repair_dev.bin
+  printf 'junk' | dd of=repair_dev.bin bs=1 \
+    seek=$(( (NUM_SECTORS - 30) * 512 + 40 )) conv=notrunc 2>/dev/null
+  X=$($CGPT repair -c repair_dev.bin 2>/dev/null) && error
+  [ "$X" = "Secondary Entries needs repair." ] || error
+  $CGPT repair repair_dev.bin >/dev/null || error
+  $CGPT repair -c repair_dev.bin >/dev/null || error
+  cmp repair_dev.bin ${BATCH_DEV} || error "partial repair mismatch"
+fi
+rm -f repair_dev.bin repair_orig.bin
+
+echo "Test cgpt on a sparse image..."
+# Only the GPT structures should ever get written, and only the parts of
+# them that aren't zeros, so a huge image stays sparse.
+rm -f sparse_dev.bin
+truncate -s 64G sparse_dev.bin
+if [ "$(stat -c %b sparse_dev.bin)" = "0" ]; then
+  $CGPT create sparse_dev.bin
+  $CGPT add -b 2048 -s 1024 -t kernel -P 3 sparse_dev.bin
+  $CGPT add -b 4096 -s 1024 -t kernel -P 2 sparse_dev.bin
+  $CGPT prioritize -o 2 sparse_dev.bin
+  $CGPT repair -c sparse_dev.bin >/dev/null || error
+  [ "$($CGPT show -i 2 -P sparse_dev.bin)" = "2" ] || error
+  # With 4K blocks, that's a block for each header and one for each table.
+  X=$(stat -c %b sparse_dev.bin)
+  [ "$(stat -f -c %S .)" -gt 4096 ] || [ "$X" -le 32 ] || \
+    error "sparse image grew to $X sectors"
+fi
+rm -f sparse_dev.bin
+
+echo "Test cgpt on a native 4K image..."
+rm -f dev4k.bin
+dd if=/dev/zero of=dev4k.bin bs=4096 count=256 2>/dev/null
+assert_fail $CGPT create -b 2048 dev4k.bin
+$CGPT create -b 4096 dev4k.bin 2>/dev/null
+# The header's in the second 4K sector, and 16K of entries is 4 sectors
+[ "$(dd if=dev4k.bin bs=1 skip=4096 count=8 2>/dev/null)" = "EFI PART" ] || \
+  error
+X=$($CGPT show dev4k.bin | grep "Pri GPT table" | awk '{print $1, $2}')
+[ "$X" = "2 4" ] || error
+X=$($CGPT show dev4k.bin | grep "Sec GPT table" | awk '{print $1, $2}')
+[ "$X" = "251 4" ] || error
+# Opened again, it's still taken to have 4K sectors
+$CGPT add -b 6 -s 10 -t kernel -P 3 dev4k.bin
+[ "$($CGPT show -i 1 -b dev4k.bin)" = "6" ] || error
+$CGPT repair -c dev4k.bin >/dev/null || error
+# Content is matched at 4K sector offsets
+printf needle > needle.bin
+printf needle | dd of=dev4k.bin bs=1 seek=$((6 * 4096 + 100)) conv=notrunc \
+  2>/dev/null
+$CGPT find -t kernel -M needle.bin -O 100 dev4k.bin >/dev/null || error
+assert_fail $CGPT find -t kernel -M needle.bin -O 99 dev4k.bin
+rm -f dev4k.bin needle.bin
+
 echo "Test read vs read-write access..."
 chmod 0444 ${DEV}
 
@@ -287,6 +493,7 @@ $CGPT boot $MTD -i 2 ${DEV} 2>/dev/null && error
 
 $CGPT boot $MTD ${DEV} >/dev/null
 $CGPT show $MTD ${DEV} >/dev/null
+$CGPT repair $MTD -c ${DEV} >/dev/null
 $CGPT find $MTD -t kernel ${DEV} >/dev/null
 
 # Enable write access again to test boundary in off device storage
@@ -0,0 +1,84 @@
+#!/bin/bash
+
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+#
+# Make a seed corpus for the in-process fuzz targets, and check that each
+# target accepts its seeds.
+
+# Load common constants and variables.
+. "$(dirname "$0")/common.sh"
+
+set -e
+
+FUZZ=${TEST_DIR}/vb20_fuzz_targets
+CGPT=${BIN_DIR}/cgpt
+KEYS=${SCRIPT_DIR}/devkeys
+
+DIR="${TEST_DIR}/fuzz_targets_dir"
+[ -d "$DIR" ] || mkdir -p "$DIR"
+echo "Making fuzz target seeds in $DIR"
+cd "$DIR"
+
+# Firmware vblock: keyblock followed by preamble
+dd if=/dev/urandom bs=4096 count=4 of=fw_body.bin
+${FUTILITY} vbutil_firmware --vblock fw.vblock \
+    --keyblock ${KEYS}/firmware.keyblock \
+    --signprivate ${KEYS}/firmware_data_key.vbprivk \
+    --version 1 \
+    --fv fw_body.bin \
+    --kernelkey ${KEYS}/kernel_subkey.vbpubk
+kb_size=$(stat -c %s ${KEYS}/firmware.keyblock)
+dd if=fw.vblock of=fw.preamble bs=1 skip=${kb_size}
+
+# Kernel partition: keyblock followed by preamble and body
+echo "hi there" > config.txt
+dd if=/dev/urandom bs=4096 count=4 of=vmlinuz.bin
+dd if=/dev/urandom bs=4096 count=1 of=bootloader.bin
+${FUTILITY} vbutil_kernel --pack kern.part \
+    --keyblock ${KEYS}/kernel.keyblock \
+    --signprivate ${KEYS}/kernel_data_key.vbprivk \
+    --version 1 \
+    --arch arm \
+    --vmlinuz vmlinuz.bin \
+    --bootloader bootloader.bin \
+    --config config.txt
+kb_size=$(stat -c %s ${KEYS}/kernel.keyblock)
+dd if=kern.part of=kern.preamble bs=1 skip=${kb_size} count=65536
+
+# Both ends of a GPT, laid out the way the GPT target wants them
+dd if=/dev/zero of=disk.bin bs=512 count=2048
+${CGPT} create disk.bin
+${CGPT} add -i 1 -S 1 -P 1 -b 64 -s 960 -t kernel -l kernelA disk.bin
+dd if=disk.bin of=gpt.bin bs=512 skip=1 count=33
+dd if=disk.bin bs=512 skip=$((2048 - 33)) count=33 >> gpt.bin
+
+check() {
+  local target=$1
+  shift
+  ${FUZZ} -n 100 "$@" > ${target}.out
+  cat ${target}.out
+  grep -q "^${target}: .* 100 accepted" ${target}.out
+}
+
+check vb2_verify_keyblock -k ${KEYS}/root_key.vbpubk \
+    vb2_verify_keyblock ${KEYS}/firmware.keyblock
+check vb2_verify_fw_preamble -k ${KEYS}/firmware_data_key.vbpubk \
+    vb2_verify_fw_preamble fw.preamble
+check KeyBlockVerify -k ${KEYS}/kernel_subkey.vbpubk \
+    KeyBlockVerify ${KEYS}/kernel.keyblock
+check VerifyKernelPreamble -k ${KEYS}/kernel_data_key.vbpubk \
+    VerifyKernelPreamble kern.preamble
+check GptSanityCheck GptSanityCheck gpt.bin
+check futil_file_type_buf futil_file_type_buf fw.vblock
+
+# Stdin gets one pass outside of AFL
+${FUZZ} GptSanityCheck < gpt.bin
+
+# And garbage is rejected
+dd if=/dev/urandom bs=4096 count=1 of=junk.bin
+${FUZZ} -n 100 -k ${KEYS}/root_key.vbpubk vb2_verify_keyblock junk.bin \
+    | grep -q " 0 accepted"
+
+happy 'Fuzz targets accept their seeds'
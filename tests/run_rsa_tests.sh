@@ -36,9 +36,42 @@ function test_signatures {
   ${TEST_DIR}/rsa_padding_test ${TESTKEY_DIR}/rsa_padding_test_pubkey.keyb
 }
 
+# Digests of a batch of files, more than one group's worth, should match
+# digesting each file on its own.
+function test_digest_manifest {
+  manifest=${TESTCASE_DIR}/digest_manifest
+  : > ${TESTCASE_DIR}/empty_file
+  ls ${TESTKEY_DIR}/key_rsa*.keyb ${TESTKEY_DIR}/key_rsa*.pem > ${manifest}
+  echo ${TEST_FILE} >> ${manifest}
+  echo ${TESTCASE_DIR}/empty_file >> ${manifest}
+  echo ${TEST_FILE} >> ${manifest}
+  algorithmcounter=0
+  for keylen in ${key_lengths[@]}
+  do
+    for hashalgo in ${hash_algos[@]}
+    do
+      for file in $(cat ${manifest})
+      do
+        ${BIN_DIR}/signature_digest_utility $algorithmcounter ${file}
+      done > ${manifest}.expect
+      ${BIN_DIR}/signature_digest_utility $algorithmcounter \
+        --manifest ${manifest} > ${manifest}.out
+      if ! cmp ${manifest}.expect ${manifest}.out
+      then
+        echo -e "${COL_RED}Manifest digests differ for" \
+          "RSA-$keylen and $hashalgo${COL_STOP}"
+        return_code=255
+      fi
+      let algorithmcounter=algorithmcounter+1
+    done
+  done
+}
+
 check_test_keys
 echo "Testing signature verification..."
 test_signatures
+echo "Testing batch signature digests..."
+test_digest_manifest
 
 exit $return_code
 
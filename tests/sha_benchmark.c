@@ -13,6 +13,10 @@
 
 #define NUM_HASH_ALGORITHMS 3
 #define TEST_BUFFER_SIZE 4000000
+#define NUM_SAMPLES 15
+#define NUM_WARMUPS 3
+#define MIN_SAMPLE_NSECS 1000000ULL  /* Small buffers are hashed in batches
+                                      * at least this long. */
 
 /* Table of hash function pointers and their description. */
 typedef uint8_t* (*Hashptr) (const uint8_t*, uint64_t, uint8_t*);
@@ -27,32 +31,60 @@ HashFxTable hash_functions[NUM_HASH_ALGORITHMS] = {
   {internal_SHA512, "sha512"}
 };
 
+/* Buffer sizes to hash, from a small struct up to a whole kernel. */
+static const uint64_t test_sizes[] = {64, 4096, TEST_BUFFER_SIZE};
+
+typedef struct HashArg {
+  Hashptr hash;
+  const uint8_t* buffer;
+  uint64_t size;
+  uint8_t* digest;
+} HashArg;
+
+static void TimedHash(void* arg) {
+  HashArg* a = (HashArg*) arg;
+  a->hash(a->buffer, a->size, a->digest);
+}
+
 int main(int argc, char* argv[]) {
-  int i;
+  int i, j;
   double speed;
-  uint32_t msecs;
-  uint8_t* buffer = (uint8_t*) malloc(TEST_BUFFER_SIZE);
+  uint8_t* buffer = (uint8_t*) calloc(1, TEST_BUFFER_SIZE);
   uint8_t* digest = (uint8_t*) malloc(SHA512_DIGEST_SIZE); /* Maximum size of
                                                             * the digest. */
-  ClockTimerState ct;
+  TimerStats st;
+  HashArg a;
+  int error_code = 0;
+
+  a.buffer = buffer;
+  a.digest = digest;
 
   /* Iterate through all the hash functions. */
   for(i = 0; i < NUM_HASH_ALGORITHMS; i++) {
-    StartTimer(&ct);
-    hash_functions[i].hash(buffer, TEST_BUFFER_SIZE, digest);
-    StopTimer(&ct);
-
-    msecs = GetDurationMsecs(&ct);
-    speed = ((TEST_BUFFER_SIZE / 10e6)
-             / (msecs / 10e3)); /* Mbytes/sec */
-
-    fprintf(stderr, "# %s Time taken = %u ms, Speed = %f Mbytes/sec\n",
-            hash_functions[i].description, msecs, speed);
-    fprintf(stdout, "mbytes_per_sec_%s:%f\n",
-            hash_functions[i].description, speed);
+    a.hash = hash_functions[i].hash;
+    for (j = 0; j < sizeof(test_sizes) / sizeof(test_sizes[0]); j++) {
+      a.size = test_sizes[j];
+      if (TimeFunction(TimedHash, &a, NUM_WARMUPS, NUM_SAMPLES,
+                       MIN_SAMPLE_NSECS, &st)) {
+        error_code = 1;
+        continue;
+      }
+
+      speed = a.size * 1e3 / st.ns_p50;  /* Mbytes/sec */
+      fprintf(stderr, "# %s %8" PRIu64 " bytes: median = %.1f ns, "
+              "mean = %.1f ns, stddev = %.1f ns, Speed = %f Mbytes/sec\n",
+              hash_functions[i].description, a.size, st.ns_p50,
+              st.ns_mean, st.ns_stddev, speed);
+      if (a.size == TEST_BUFFER_SIZE)
+        fprintf(stdout, "mbytes_per_sec_%s:%f\n",
+                hash_functions[i].description, speed);
+      else
+        fprintf(stdout, "ns_%s_%" PRIu64 ":%.1f\n",
+                hash_functions[i].description, a.size, st.ns_p50);
+    }
   }
 
   free(digest);
   free(buffer);
-  return 0;
+  return error_code;
 }
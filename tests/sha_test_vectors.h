@@ -3,7 +3,8 @@
  * found in the LICENSE file.
  */
 
-/* FIPS 180-2 test vectors for SHA-1, SHA-256 and SHA-512 */
+/* FIPS 180-2 test vectors for SHA-1, SHA-256 and SHA-512, and BLAKE2s
+ * digests of the same messages */
 
 #ifndef VBOOT_REFERENCE_SHA_TEST_VECTORS_H_
 #define VBOOT_REFERENCE_SHA_TEST_VECTORS_H_
@@ -90,4 +91,26 @@ uint8_t sha512_results[][SHA512_DIGEST_SIZE] = {
   }
 };
 
+/* From the RFC 7693 reference implementation */
+uint8_t blake2s_results[][32] = {
+  {
+    0x50,0x8c,0x5e,0x8c,0x32,0x7c,0x14,0xe2,
+    0xe1,0xa7,0x2b,0xa3,0x4e,0xeb,0x45,0x2f,
+    0x37,0x45,0x8b,0x20,0x9e,0xd6,0x3a,0x29,
+    0x4d,0x99,0x9b,0x4c,0x86,0x67,0x59,0x82
+  },
+  {
+    0x35,0x8d,0xd2,0xed,0x07,0x80,0xd4,0x05,
+    0x4e,0x76,0xcb,0x6f,0x3a,0x5b,0xce,0x28,
+    0x41,0xe8,0xe2,0xf5,0x47,0x43,0x1d,0x4d,
+    0x09,0xdb,0x21,0xb6,0x6d,0x94,0x1f,0xc7
+  },
+  {
+    0xbe,0xc0,0xc0,0xe6,0xcd,0xe5,0xb6,0x7a,
+    0xcb,0x73,0xb8,0x1f,0x79,0xa6,0x7a,0x40,
+    0x79,0xae,0x1c,0x60,0xda,0xc9,0xd2,0x66,
+    0x1a,0xf1,0x8e,0x9f,0x8b,0x50,0xdf,0xa5
+  }
+};
+
 #endif  /* VBOOT_REFERENCE_SHA_TEST_VECTORS_H_ */
@@ -35,6 +35,31 @@ int SHA1_tests(void) {
   return success;
 }
 
+/*
+ * The message length is padded into the last block in bits, so inputs over
+ * 512 MB need more than 32 bits of count.
+ */
+int SHA1_long_length_test(void) {
+  static const uint8_t expected[SHA1_DIGEST_SIZE] = {
+    0x56, 0xb0, 0x89, 0x4b, 0x2b, 0x96, 0x8f, 0x40, 0xe7, 0xa5,
+    0xe9, 0x24, 0x0d, 0x24, 0x2c, 0x19, 0xf7, 0xc5, 0x6b, 0x70
+  };
+  const uint64_t chunk = 1024 * 1024;
+  SHA1_CTX ctx;
+  uint8_t* zeros = (uint8_t*) calloc(chunk, 1);
+  int i, success;
+
+  /* SHA-1 of 513 MB of zeros */
+  SHA1_init(&ctx);
+  for (i = 0; i < 513; i++)
+    SHA1_update(&ctx, zeros, chunk);
+  success = !memcmp(SHA1_final(&ctx), expected, SHA1_DIGEST_SIZE);
+  fprintf(stderr, "Input over 512 MB %s for SHA-1\n",
+          success ? "PASSED" : "FAILED");
+  free(zeros);
+  return success;
+}
+
 int SHA256_tests(void) {
   int i, success = 1;
   uint8_t sha256_digest[SHA256_DIGEST_SIZE];
@@ -79,6 +104,53 @@ int SHA512_tests(void) {
   return success;
 }
 
+/* DigestBufInto() fills in the caller's buffer, as DigestBuf() allocates. */
+int DigestInto_tests(void) {
+  static const uint8_t* const results[3] = {
+    sha1_results[0], sha256_results[0], sha512_results[0]
+  };
+  static const int sizes[3] = {
+    SHA1_DIGEST_SIZE, SHA256_DIGEST_SIZE, SHA512_DIGEST_SIZE
+  };
+  const uint8_t* msg = (const uint8_t *) oneblock_msg;
+  uint8_t digest[MAX_DIGEST_SIZE];
+  uint8_t* allocated;
+  DigestContext ctx;
+  int i, success = 1;
+
+  /* Signature algorithms 0-2 use SHA-1, SHA-256 and SHA-512 */
+  for (i = 0; i < 3; i++) {
+    memset(digest, 0, sizeof(digest));
+    allocated = DigestBuf(msg, strlen(oneblock_msg), i);
+    if (DigestBufInto(msg, strlen(oneblock_msg), i, digest,
+                      sizes[i]) ||
+        memcmp(digest, results[i], sizes[i]) ||
+        !allocated || memcmp(allocated, digest, sizes[i])) {
+      fprintf(stderr, "DigestBufInto() FAILED for algorithm %d\n", i);
+      success = 0;
+    }
+    free(allocated);
+
+    DigestInit(&ctx, i);
+    DigestUpdate(&ctx, msg, strlen(oneblock_msg));
+    if (DigestFinalInto(&ctx, digest, sizeof(digest)) ||
+        memcmp(digest, results[i], sizes[i])) {
+      fprintf(stderr, "DigestFinalInto() FAILED for algorithm %d\n", i);
+      success = 0;
+    }
+
+    if (!DigestBufInto(msg, strlen(oneblock_msg), i, digest,
+                       sizes[i] - 1)) {
+      fprintf(stderr, "DigestBufInto() took a short buffer for "
+              "algorithm %d\n", i);
+      success = 0;
+    }
+  }
+  if (success)
+    fprintf(stderr, "DigestBufInto() tests PASSED\n");
+  return success;
+}
+
 int main(int argc, char* argv[]) {
   int success = 1;
   /* Initialize long_msg with 'a' x 1,000,000 */
@@ -88,10 +160,14 @@ int main(int argc, char* argv[]) {
 
   if (!SHA1_tests())
     success = 0;
+  if (!SHA1_long_length_test())
+    success = 0;
   if (!SHA256_tests())
     success = 0;
   if (!SHA512_tests())
     success = 0;
+  if (!DigestInto_tests())
+    success = 0;
 
   free(long_msg);
 
@@ -9,7 +9,9 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "cryptolib.h"
 #include "file_keys.h"
@@ -18,6 +20,9 @@
 /* Global test success flag. */
 int gTestSuccess = 1;
 
+/* Work done by mocks since the last MockCostReset(). */
+struct mock_cost mock_cost;
+
 int TEST_EQ(int result, int expected_result, const char* testname) {
   if (result == expected_result) {
     fprintf(stderr, "%s Test " COL_GREEN "PASSED\n" COL_STOP, testname);
@@ -125,3 +130,57 @@ int TEST_FALSE(int result, const char* testname) {
   }
   return !result;
 }
+
+int TEST_LE(uint64_t result, uint64_t limit, const char* testname) {
+  if (result <= limit) {
+    fprintf(stderr, "%s Test " COL_GREEN "PASSED\n" COL_STOP, testname);
+    return 1;
+  } else {
+    fprintf(stderr, "%s Test " COL_RED "FAILED\n" COL_STOP, testname);
+    fprintf(stderr, "  Expected at most %llu, got %llu\n",
+            (unsigned long long)limit, (unsigned long long)result);
+    gTestSuccess = 0;
+    return 0;
+  }
+}
+
+void MockCostReset(void) {
+  static const struct mock_cost none;
+
+  mock_cost = none;
+}
+
+static void MockCostWait(uint64_t us) {
+  static int real_latency = -1;
+
+  mock_cost.elapsed_us += us;
+
+  if (real_latency < 0) {
+    const char* env = getenv("VB_TEST_LATENCY");
+    real_latency = env && !strcmp(env, "1");
+  }
+  if (real_latency)
+    usleep(us);
+}
+
+void MockCostDiskRead(uint64_t bytes) {
+  mock_cost.disk_reads++;
+  mock_cost.disk_read_bytes += bytes;
+  MockCostWait(MOCK_DISK_OP_US + MOCK_DISK_KB_US * (bytes / 1024));
+}
+
+void MockCostDiskWrite(uint64_t bytes) {
+  mock_cost.disk_writes++;
+  mock_cost.disk_write_bytes += bytes;
+  MockCostWait(MOCK_DISK_OP_US + MOCK_DISK_KB_US * (bytes / 1024));
+}
+
+void MockCostRsa(void) {
+  mock_cost.rsa_ops++;
+  MockCostWait(MOCK_RSA_OP_US);
+}
+
+void MockCostNvWrite(void) {
+  mock_cost.nv_writes++;
+  MockCostWait(MOCK_NV_WRITE_US);
+}
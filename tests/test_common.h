@@ -7,6 +7,8 @@
 #ifndef VBOOT_REFERENCE_TEST_COMMON_H_
 #define VBOOT_REFERENCE_TEST_COMMON_H_
 
+#include <stdint.h>
+
 extern int gTestSuccess;
 
 /* Return 1 if result is equal to expected_result, else return 0.
@@ -46,6 +48,43 @@ int TEST_FALSE(int result, const char* testname);
  * Also update the global gTestSuccess flag if test fails. */
 int TEST_SUCC(int result, const char* testname);
 
+/* Pass if result <= limit; for bounding the mock costs below. */
+int TEST_LE(uint64_t result, uint64_t limit, const char* testname);
+
+/*
+ * Work done by mocked platform calls.  Mocks record what they're asked to do
+ * with the MockCost*() functions, and tests put upper bounds on the totals
+ * with TEST_LE(), so a change which makes a boot flow read more, verify more
+ * or write NV more often shows up as a failure.
+ *
+ * Each operation also adds a simulated latency to elapsed_us.  If the
+ * environment has VB_TEST_LATENCY=1, the mocks really sleep for it too, for
+ * soaking a flow with platform-like timing.
+ */
+struct mock_cost {
+  uint32_t disk_reads;
+  uint64_t disk_read_bytes;
+  uint32_t disk_writes;
+  uint64_t disk_write_bytes;
+  uint32_t rsa_ops;
+  uint32_t nv_writes;
+  uint64_t elapsed_us;
+};
+
+/* Simulated latencies, in microseconds */
+#define MOCK_DISK_OP_US 100        /* per read or write call */
+#define MOCK_DISK_KB_US 10         /* per KB read or written */
+#define MOCK_RSA_OP_US 5000        /* per signature verified */
+#define MOCK_NV_WRITE_US 10000     /* per NV storage write */
+
+extern struct mock_cost mock_cost;
+
+void MockCostReset(void);
+void MockCostDiskRead(uint64_t bytes);
+void MockCostDiskWrite(uint64_t bytes);
+void MockCostRsa(void);
+void MockCostNvWrite(void);
+
 /* ANSI Color coding sequences.
  *
  * Don't use \e as MSC does not recognize it as a valid escape sequence.
@@ -3,22 +3,147 @@
  * found in the LICENSE file.
  */
 
+#include <stdlib.h>
+
 #include "timer_utils.h"
 
+/* The raw clock isn't slewed by NTP, so short intervals are measured
+ * against the same tick rate. */
+#ifdef CLOCK_MONOTONIC_RAW
+#define TIMER_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define TIMER_CLOCK CLOCK_MONOTONIC
+#endif
+
+uint64_t ReadCycleCounter(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+#elif defined(__aarch64__)
+  uint64_t ticks;
+  __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r" (ticks));
+  return ticks;
+#else
+  return 0;
+#endif
+}
+
 void StartTimer(ClockTimerState* ct) {
-  clock_gettime(CLOCK_REALTIME, &ct->start_time);
+  clock_gettime(TIMER_CLOCK, &ct->start_time);
+  ct->start_cycles = ReadCycleCounter();
 }
 
 void StopTimer(ClockTimerState* ct) {
-  clock_gettime(CLOCK_REALTIME, &ct->end_time);
+  ct->end_cycles = ReadCycleCounter();
+  clock_gettime(TIMER_CLOCK, &ct->end_time);
 }
 
-uint32_t GetDurationMsecs(ClockTimerState* ct) {
+uint64_t GetDurationNsecs(ClockTimerState* ct) {
   uint64_t start = ((uint64_t) ct->start_time.tv_sec * 1000000000 +
                     (uint64_t) ct->start_time.tv_nsec);
   uint64_t end = ((uint64_t) ct->end_time.tv_sec * 1000000000 +
                   (uint64_t) ct->end_time.tv_nsec);
-  uint64_t duration_msecs = (end - start) / 1000000U;  /* Nanoseconds ->
-                                                        * Milliseconds. */
+  return end - start;
+}
+
+uint32_t GetDurationMsecs(ClockTimerState* ct) {
+  uint64_t duration_msecs = GetDurationNsecs(ct) / 1000000U;  /* Nanoseconds ->
+                                                               * Milliseconds. */
   return (uint32_t) duration_msecs;
 }
+
+uint64_t GetDurationCycles(ClockTimerState* ct) {
+  return ct->end_cycles - ct->start_cycles;
+}
+
+static int CompareDouble(const void* a, const void* b) {
+  double da = *(const double*) a;
+  double db = *(const double*) b;
+  return (da > db) - (da < db);
+}
+
+/* Nearest-rank percentile of [n] sorted values. */
+static double Percentile(const double* sorted, int n, int pct) {
+  int i = (pct * n + 99) / 100 - 1;
+  return sorted[i < 0 ? 0 : i];
+}
+
+/* Newton's method, so the tests don't all need libm. */
+static double SquareRoot(double x) {
+  double r = x;
+  int i;
+  if (x <= 0)
+    return 0;
+  for (i = 0; i < 64; i++)
+    r = (r + x / r) / 2;
+  return r;
+}
+
+/* Time one sample of [iterations] calls of [fn]. */
+static void TimeSample(TimedFunction fn, void* arg, uint64_t iterations,
+                       ClockTimerState* ct) {
+  uint64_t i;
+  StartTimer(ct);
+  for (i = 0; i < iterations; i++)
+    fn(arg);
+  StopTimer(ct);
+}
+
+int TimeFunction(TimedFunction fn, void* arg, int warmups, int samples,
+                 uint64_t min_sample_nsecs, TimerStats* stats) {
+  ClockTimerState ct;
+  double* ns;
+  double* cycles;
+  double sum = 0, sum_sq = 0, mean;
+  int r;
+
+  if (samples < 1)
+    return 1;
+  ns = malloc(samples * sizeof(*ns));
+  cycles = malloc(samples * sizeof(*cycles));
+  if (!ns || !cycles) {
+    free(ns);
+    free(cycles);
+    return 1;
+  }
+
+  for (r = 0; r < warmups; r++)
+    TimeSample(fn, arg, 1, &ct);
+
+  /* Find how many calls make a sample long enough to time accurately. */
+  stats->iterations = 1;
+  if (min_sample_nsecs) {
+    for (;;) {
+      TimeSample(fn, arg, stats->iterations, &ct);
+      if (GetDurationNsecs(&ct) >= min_sample_nsecs)
+        break;
+      stats->iterations *= 2;
+    }
+  }
+
+  for (r = 0; r < samples; r++) {
+    TimeSample(fn, arg, stats->iterations, &ct);
+    ns[r] = (double) GetDurationNsecs(&ct) / stats->iterations;
+    cycles[r] = (double) GetDurationCycles(&ct) / stats->iterations;
+    sum += ns[r];
+    sum_sq += ns[r] * ns[r];
+  }
+  qsort(ns, samples, sizeof(ns[0]), CompareDouble);
+  qsort(cycles, samples, sizeof(cycles[0]), CompareDouble);
+
+  mean = sum / samples;
+  stats->samples = samples;
+  stats->ns_min = ns[0];
+  stats->ns_p50 = Percentile(ns, samples, 50);
+  stats->ns_p90 = Percentile(ns, samples, 90);
+  stats->ns_p99 = Percentile(ns, samples, 99);
+  stats->ns_max = ns[samples - 1];
+  stats->ns_mean = mean;
+  stats->ns_stddev = SquareRoot(sum_sq / samples - mean * mean);
+  stats->cycles_p50 = Percentile(cycles, samples, 50);
+
+  free(ns);
+  free(cycles);
+  return 0;
+}
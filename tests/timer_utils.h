@@ -13,6 +13,8 @@
 typedef struct ClockTimer {
   struct timespec start_time;
   struct timespec end_time;
+  uint64_t start_cycles;
+  uint64_t end_cycles;
 } ClockTimerState;
 
 /* Start timer and update [ct]. */
@@ -24,4 +26,43 @@ void StopTimer(ClockTimerState* ct);
 /* Get duration in milliseconds. */
 uint32_t GetDurationMsecs(ClockTimerState* ct);
 
+/* Get duration in nanoseconds. */
+uint64_t GetDurationNsecs(ClockTimerState* ct);
+
+/* Get duration in cycle counter ticks, or 0 if there's no cycle counter. */
+uint64_t GetDurationCycles(ClockTimerState* ct);
+
+/* Read the cycle counter; TSC on x86, the virtual counter (which ticks at a
+ * fixed rate, not the CPU clock) on ARMv8.  Returns 0 on other
+ * architectures. */
+uint64_t ReadCycleCounter(void);
+
+/* Summary of timing a function; all times are per call. */
+typedef struct TimerStats {
+  int samples;                  /* Number of samples taken */
+  uint64_t iterations;          /* Calls per sample */
+  double ns_min;
+  double ns_p50;
+  double ns_p90;
+  double ns_p99;
+  double ns_max;
+  double ns_mean;
+  double ns_stddev;
+  double cycles_p50;            /* 0 if there's no cycle counter */
+} TimerStats;
+
+typedef void (*TimedFunction)(void* arg);
+
+/* Time calls of [fn]([arg]) and summarize them in [stats].
+ *
+ * [warmups] samples are run and thrown away first, to fill caches and let
+ * the CPU clock ramp up.  Each sample calls [fn] enough times to take at
+ * least [min_sample_nsecs]; pass 0 to time every call on its own.  Then
+ * [samples] samples are taken.
+ *
+ * Returns 0 if success, non-zero if [samples] is less than 1 or there's
+ * not enough memory. */
+int TimeFunction(TimedFunction fn, void* arg, int warmups, int samples,
+                 uint64_t min_sample_nsecs, TimerStats* stats);
+
 #endif  /* VBOOT_REFERENCE_TIMER_UTILS_H_ */
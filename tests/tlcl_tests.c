@@ -36,9 +36,11 @@ struct srcall
 	VbError_t retval;  /* Value to return */
 };
 
-#define MAXCALLS 8
+#define MAXCALLS 16
 static struct srcall calls[MAXCALLS];
 static int ncalls;
+static uint32_t slept_ms;
+static int nsleeps;
 
 /**
  * Reset mock data (for use before each test)
@@ -54,6 +56,11 @@ static void ResetMocks(void)
 	for (i = 0; i < MAXCALLS; i++)
 		calls[i].rsp = calls[i].rsp_buf;
 	ncalls = 0;
+	slept_ms = 0;
+	nsleeps = 0;
+
+	/* Forget flags cached by earlier tests */
+	TlclLibInit();
 }
 
 /**
@@ -102,6 +109,12 @@ VbError_t VbExTpmSendReceive(const uint8_t *request, uint32_t request_length,
 	return c->retval;
 }
 
+void VbExSleepMs(uint32_t msec)
+{
+	slept_ms += msec;
+	nsleeps++;
+}
+
 /**
  * Test assorted tlcl functions
  */
@@ -156,6 +169,8 @@ static void TlclTest(void)
  */
 static void SendCommandTest(void)
 {
+	int i;
+
 	ResetMocks();
 	TEST_EQ(TlclStartup(), 0, "SaveState");
 	TEST_EQ(calls[0].req_cmd, TPM_ORD_Startup, "  cmd");
@@ -176,6 +191,36 @@ static void SendCommandTest(void)
 	TEST_EQ(TlclContinueSelfTest(), 0, "ContinueSelfTest");
 	TEST_EQ(calls[0].req_cmd, TPM_ORD_ContinueSelfTest, "  cmd");
 
+	/* Commands which need the self test start it and try again */
+	ResetMocks();
+	SetResponse(0, TPM_E_NEEDS_SELFTEST, 10);
+	TEST_EQ(TlclForceClear(), 0, "Needs self test");
+	TEST_EQ(calls[1].req_cmd, TPM_ORD_ContinueSelfTest, "  cmd");
+	TEST_EQ(calls[2].req_cmd, TPM_ORD_ForceClear, "  retried");
+	TEST_EQ(ncalls, 3, "  three calls");
+	TEST_EQ(nsleeps, 0, "  no waiting");
+
+	/* While it's still running, back off between tries */
+	ResetMocks();
+	SetResponse(0, TPM_E_DOING_SELFTEST, 10);
+	for (i = 2; i < 5; i++)
+		SetResponse(i, TPM_E_DOING_SELFTEST, 10);
+	TEST_EQ(TlclForceClear(), 0, "Doing self test");
+	TEST_EQ(ncalls, 6, "  six calls");
+	TEST_EQ(calls[5].req_cmd, TPM_ORD_ForceClear, "  retried");
+	TEST_EQ(nsleeps, 3, "  waited between tries");
+	TEST_EQ(slept_ms, 1 + 2 + 4, "  for longer each time");
+
+	/* But not forever */
+	ResetMocks();
+	for (i = 0; i < MAXCALLS; i++)
+		SetResponse(i, TPM_E_DOING_SELFTEST, 10);
+	SetResponse(1, 0, 10);
+	TEST_EQ(TlclForceClear(), TPM_E_DOING_SELFTEST,
+		"Self test doesn't finish");
+	TEST_EQ(ncalls, 16, "  gives up");
+	TEST_EQ(slept_ms < 1000, 1, "  within a second");
+
 	ResetMocks();
 	TEST_EQ(TlclAssertPhysicalPresence(), 0,
 		"AssertPhysicalPresence");
@@ -243,8 +288,17 @@ static void ReadWriteTest(void)
 	TEST_EQ(calls[0].req_cmd, TPM_ORD_NV_DefineSpace, "  cmd");
 
 	ResetMocks();
+	buf[0] = 0x12;
+	buf[1] = 0x34;
+	buf[2] = 0x56;
 	TEST_EQ(TlclWrite(1, buf, 3), 0, "Write");
 	TEST_EQ(calls[0].req_cmd, TPM_ORD_NV_WriteValue, "  cmd");
+	/* Header, then index, offset and length, then the data */
+	TEST_EQ(calls[0].req_size, kTpmRequestHeaderLength + 12 + 3, "  size");
+	TEST_EQ(TlclPacketSize(calls[0].req), calls[0].req_size,
+		"  size field");
+	TEST_EQ(memcmp(calls[0].req + kTpmRequestHeaderLength + 12, buf, 3), 0,
+		"  data");
 
 	ResetMocks();
 	TEST_EQ(TlclRead(1, buf, 3), 0, "Read");
@@ -295,8 +349,9 @@ static void FlagsTest(void)
 	TPM_PERMANENT_FLAGS pflags;
 	TPM_STCLEAR_FLAGS vflags;
 	uint8_t disable = 0, deactivated = 0, nvlocked = 0;
-	uint32_t u;
+	uint32_t u, size;
 	uint8_t buf[32];
+	uint8_t nvinfo[96];
 
 	ResetMocks();
 	TEST_EQ(TlclGetPermanentFlags(&pflags), 0, "GetPermanentFlags");
@@ -312,10 +367,51 @@ static void FlagsTest(void)
 	ResetMocks();
 	TEST_EQ(TlclGetFlags(&disable, &deactivated, &nvlocked), 0, "GetFlags");
 
+	/* Permanent flags are cached until a command might change them */
+	ResetMocks();
+	TEST_EQ(TlclGetFlags(NULL, NULL, NULL), 0, "GetFlags");
+	TEST_EQ(TlclGetSTClearFlags(&vflags), 0, "  GetSTClearFlags");
+	TEST_EQ(TlclRead(1, buf, sizeof(buf)), 0, "  Read");
+	TEST_EQ(TlclGetFlags(NULL, NULL, NULL), 0, "  GetFlags again");
+	TEST_EQ(TlclGetPermanentFlags(&pflags), 0, "  GetPermanentFlags");
+	TEST_EQ(ncalls, 3, "  flags cached");
+	TEST_EQ(TlclForceClear(), 0, "  ForceClear");
+	TEST_EQ(TlclGetFlags(NULL, NULL, NULL), 0, "  GetFlags after clear");
+	TEST_EQ(ncalls, 5, "  flags read again");
+	TEST_EQ(calls[4].req_cmd, TPM_ORD_GetCapability, "  cmd");
+
+	ResetMocks();
+	SetResponse(0, TPM_E_IOERROR, 10);
+	TEST_EQ(TlclGetFlags(NULL, NULL, NULL), TPM_E_IOERROR,
+		"GetFlags error");
+	TEST_EQ(TlclGetFlags(NULL, NULL, NULL), 0, "  not cached");
+	TEST_EQ(ncalls, 2, "  flags read again");
+
+	ResetMocks();
+	TEST_EQ(TlclGetFlags(NULL, NULL, NULL), 0, "GetFlags");
+	TEST_EQ(TlclLibInit(), 0, "  LibInit");
+	TEST_EQ(TlclGetFlags(NULL, NULL, NULL), 0, "  GetFlags after init");
+	TEST_EQ(ncalls, 2, "  flags read again");
+
 	ResetMocks();
 	TEST_EQ(TlclGetPermissions(1, &u), 0, "GetPermissions");
 	TEST_EQ(calls[0].req_cmd, TPM_ORD_GetCapability, "  cmd");
 
+	/*
+	 * TPM_NV_DATA_PUBLIC follows the response header and its size; the
+	 * permissions are 60 bytes in and the data size 67 bytes in.
+	 */
+	ResetMocks();
+	memset(nvinfo, 0, sizeof(nvinfo));
+	ToTpmUint32(nvinfo + kTpmResponseHeaderLength + 4 + 60, 0x8001);
+	ToTpmUint32(nvinfo + kTpmResponseHeaderLength + 4 + 67, 13);
+	calls[0].rsp = nvinfo;
+	calls[0].rsp_size = sizeof(nvinfo);
+	TEST_EQ(TlclGetSpaceInfo(1, &u, &size), 0, "GetSpaceInfo");
+	TEST_EQ(calls[0].req_cmd, TPM_ORD_GetCapability, "  cmd");
+	TEST_EQ(u, 0x8001, "  permissions");
+	TEST_EQ(size, 13, "  size");
+
 	ResetMocks();
 	TEST_EQ(TlclGetOwnership(buf), 0, "GetOwnership");
 	TEST_EQ(calls[0].req_cmd, TPM_ORD_GetCapability, "  cmd");
@@ -339,11 +435,74 @@ static void RandomTest(void)
 	TEST_EQ(size, 0, "  size 0");
 }
 
+/**
+ * Test split submit/complete functions
+ */
+static void SplitTest(void)
+{
+	uint8_t buf[8];
+
+	ResetMocks();
+	TEST_EQ(TlclFinish(), TPM_E_INTERNAL_INCONSISTENCY,
+		"Finish without start");
+	TEST_EQ(ncalls, 0, "  no calls");
+
+	ResetMocks();
+	SetResponse(0, 0, 17);
+	ToTpmUint32(calls[0].rsp_buf + 10, 3);
+	memcpy(calls[0].rsp_buf + 14, "abc", 3);
+	memset(buf, 0, sizeof(buf));
+	TEST_EQ(TlclReadStart(1, 3), 0, "ReadStart");
+	TEST_EQ(calls[0].req_cmd, TPM_ORD_NV_ReadValue, "  cmd");
+	TEST_EQ(TlclReadFinish(buf, 3), 0, "ReadFinish");
+	TEST_EQ(memcmp(buf, "abc", 4), 0, "  data");
+	TEST_EQ(TlclFinish(), TPM_E_INTERNAL_INCONSISTENCY,
+		"  can't finish twice");
+
+	ResetMocks();
+	SetResponse(0, 0, 17);
+	ToTpmUint32(calls[0].rsp_buf + 10, 5);
+	memcpy(calls[0].rsp_buf + 14, "abcde", 5);
+	memset(buf, 0, sizeof(buf));
+	TlclReadStart(1, 3);
+	TEST_EQ(TlclReadFinish(buf, 3), 0, "ReadFinish too long");
+	TEST_EQ(memcmp(buf, "abc\0", 4), 0, "  data truncated");
+
+	ResetMocks();
+	SetResponse(0, 123, 10);
+	TEST_EQ(TlclWriteStart(1, buf, 3), 0, "WriteStart");
+	TEST_EQ(calls[0].req_cmd, TPM_ORD_NV_WriteValue, "  cmd");
+	TEST_EQ(TlclFinish(), 123, "  error response");
+
+	ResetMocks();
+	calls[0].retval = VBERROR_SIMULATED;
+	TEST_EQ(TlclSetGlobalLockStart(), 0, "SetGlobalLockStart");
+	TEST_EQ(calls[0].req_cmd, TPM_ORD_NV_WriteValue, "  cmd");
+	TEST_EQ(TlclFinish(), VBERROR_SIMULATED, "  fail");
+
+	ResetMocks();
+	TEST_EQ(TlclContinueSelfTestStart(), 0, "ContinueSelfTestStart");
+	TEST_EQ(calls[0].req_cmd, TPM_ORD_ContinueSelfTest, "  cmd");
+	TEST_EQ(TlclFinish(), 0, "  finish");
+
+	/* Another command finishes the pending one first */
+	ResetMocks();
+	TEST_EQ(TlclLockPhysicalPresenceStart(), 0,
+		"LockPhysicalPresenceStart");
+	TEST_EQ(calls[0].req_cmd, TSC_ORD_PhysicalPresence, "  cmd");
+	TEST_EQ(TlclStartup(), 0, "  then Startup");
+	TEST_EQ(calls[1].req_cmd, TPM_ORD_Startup, "  cmd");
+	TEST_EQ(TlclFinish(), TPM_E_INTERNAL_INCONSISTENCY,
+		"  lock already finished");
+	TEST_EQ(ncalls, 2, "  two calls");
+}
+
 int main(void)
 {
 	TlclTest();
 	SendCommandTest();
 	ReadWriteTest();
+	SplitTest();
 	PcrTest();
 	FlagsTest();
 	RandomTest();
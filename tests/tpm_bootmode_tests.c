@@ -15,6 +15,7 @@
 #include "test_common.h"
 #include "utility.h"
 #include "tpm_bootmode.h"
+#include "vboot_common.h"
 
 extern const char* kBootStateSHA1Digests[];
 
@@ -77,7 +78,7 @@ static void BootStateTest(void)
 			memset(last_in, 0, sizeof(last_in));
 			actual_extend_count = 0;
 			expected_extend_count = 1;
-			TEST_EQ(SetTPMBootModeState(recdev & 2, recdev & 1,
+			TEST_EQ(SetTPMBootModeState(NULL, recdev & 2, recdev & 1,
 						    flags, 0), 0,
 				"SetTPMBootModeState return (gbb0)");
 			snprintf(what, sizeof(what),
@@ -96,7 +97,7 @@ static void BootStateTest(void)
 			memset(last_in, 0, sizeof(last_in));
 			actual_extend_count = 0;
 			expected_extend_count = 1;
-			TEST_EQ(SetTPMBootModeState(recdev & 2, recdev & 1,
+			TEST_EQ(SetTPMBootModeState(NULL, recdev & 2, recdev & 1,
 						    flags, &gbb_v1), 0,
 				"SetTPMBootModeState return (gbb1)");
 			snprintf(what, sizeof(what),
@@ -115,7 +116,7 @@ static void BootStateTest(void)
 			memset(last_in, 0, sizeof(last_in));
 			actual_extend_count = 0;
 			expected_extend_count = 2;
-			TEST_EQ(SetTPMBootModeState(recdev & 2, recdev & 1,
+			TEST_EQ(SetTPMBootModeState(NULL, recdev & 2, recdev & 1,
 						    flags, &gbb_v2), 0,
 				"SetTPMBootModeState return (gbb2)");
 			snprintf(what, sizeof(what),
@@ -135,15 +136,90 @@ static void BootStateTest(void)
 	extend_returns = 1;
 	actual_extend_count = 0;
 	expected_extend_count = 1;
-	TEST_EQ(SetTPMBootModeState(0, 0, 0, 0), 1,
+	TEST_EQ(SetTPMBootModeState(NULL, 0, 0, 0, 0), 1,
 		"SetTPMBootModeState error");
 }
 
+/* Test queueing measurements in the shared data event log */
+static void MeasurementLogTest(void)
+{
+	static uint8_t shared_buf[VB_SHARED_DATA_MIN_SIZE];
+	VbSharedDataHeader *shared = (VbSharedDataHeader *)shared_buf;
+	const uint8_t digest[20] = {5, 6, 7, 8};
+	int i;
+
+	VbSharedDataInit(shared, sizeof(shared_buf));
+
+	/* Logged-only measurements are never extended */
+	TEST_EQ(VbSharedDataQueueMeasurement(shared, VBSD_MEASURE_FW_BODY,
+					     VBSD_MEASURE_NO_PCR, digest), 0,
+		"Queue log-only measurement");
+	TEST_EQ(shared->measurement_count, 1, "  count");
+	TEST_EQ(shared->measurement_flushed, 0, "  not flushed");
+
+	/* Boot mode state is queued, then all of it flushed in order */
+	extend_returns = 0;
+	actual_extend_count = 0;
+	memset(last_in, 0, sizeof(last_in));
+	TEST_EQ(SetTPMBootModeState(shared, 0, 0, 7, &gbb_v2), 0,
+		"SetTPMBootModeState with log");
+	TEST_EQ(actual_extend_count, 2, "  extends");
+	TEST_EQ(memcmp(last_in[0], kBootStateSHA1Digests[1], 20), 0,
+		"  boot mode digest");
+	TEST_EQ(memcmp(last_in[1], gbb_v2.hwid_digest, 20), 0,
+		"  HWID digest");
+	TEST_EQ(shared->measurement_count, 3, "  count");
+	TEST_EQ(shared->measurement_flushed, 3, "  flushed");
+	TEST_EQ(shared->measurements[0].event, VBSD_MEASURE_FW_BODY,
+		"  event 0");
+	TEST_EQ(shared->measurements[1].event, VBSD_MEASURE_BOOT_MODE,
+		"  event 1");
+	TEST_EQ(shared->measurements[1].pcr, 0, "  pcr 1");
+	TEST_EQ(shared->measurements[2].event, VBSD_MEASURE_HWID,
+		"  event 2");
+	TEST_EQ(shared->measurements[2].pcr, 1, "  pcr 2");
+
+	/* Flushing again does nothing */
+	actual_extend_count = 0;
+	TEST_EQ(VbFlushMeasurements(shared), 0, "Flush again");
+	TEST_EQ(actual_extend_count, 0, "  no extends");
+
+	/* Errors are reported, and the log is still marked as flushed */
+	extend_returns = 1;
+	actual_extend_count = 0;
+	TEST_EQ(SetTPMBootModeState(shared, 0, 0, 0, 0), 1,
+		"SetTPMBootModeState log error");
+	TEST_EQ(actual_extend_count, 1, "  extends");
+	TEST_EQ(shared->measurement_flushed, 4, "  flushed");
+
+	/* When the log is full, measurements are extended right away */
+	for (i = shared->measurement_count; i < VBSD_MAX_MEASUREMENTS; i++)
+		VbSharedDataQueueMeasurement(shared, VBSD_MEASURE_NONE,
+					     VBSD_MEASURE_NO_PCR, digest);
+	TEST_NEQ(VbSharedDataQueueMeasurement(shared, VBSD_MEASURE_NONE,
+					      VBSD_MEASURE_NO_PCR, digest), 0,
+		 "Queue to full log");
+	extend_returns = 0;
+	actual_extend_count = 0;
+	TEST_EQ(SetTPMBootModeState(shared, 0, 0, 7, &gbb_v2), 0,
+		"SetTPMBootModeState full log");
+	TEST_EQ(actual_extend_count, 2, "  extends");
+	TEST_PTR_EQ(last_in[1], gbb_v2.hwid_digest, "  HWID direct");
+	TEST_EQ(shared->measurement_count, VBSD_MAX_MEASUREMENTS, "  count");
+
+	/* Old structs have no log */
+	shared->struct_version = 2;
+	TEST_NEQ(VbSharedDataQueueMeasurement(shared, VBSD_MEASURE_NONE,
+					      VBSD_MEASURE_NO_PCR, digest), 0,
+		 "Queue to old struct");
+}
+
 int main(int argc, char *argv[])
 {
 	int error_code = 0;
 
 	BootStateTest();
+	MeasurementLogTest();
 
 	if (!gTestSuccess)
 		error_code = 255;
@@ -60,6 +60,59 @@ static void SafeMemcmpTest(void) {
 
   TEST_EQ(1, SafeMemcmp("APPLE", "TIGER", 5), "SafeMemcmp() unequal");
   TEST_EQ(1, SafeMemcmp("APPLE", "APPLe", 5), "SafeMemcmp() unequal 2");
+
+  /* A difference anywhere is found, whether or not the buffers line up */
+  {
+    uint8_t a[80], b[80];
+    int offs_a, offs_b, i, ok = 1;
+
+    for (i = 0; i < sizeof(a); i++)
+      a[i] = b[i] = i;
+    for (offs_a = 0; offs_a < 8; offs_a++) {
+      for (offs_b = 0; offs_b < 8; offs_b++) {
+        if (SafeMemcmp(a + offs_a, b + offs_a, 64))
+          ok = 0;
+        for (i = 0; i < 64; i++) {
+          b[offs_b + i] ^= 0x10;
+          if (!SafeMemcmp(a + offs_b, b + offs_b, 64))
+            ok = 0;
+          b[offs_b + i] ^= 0x10;
+        }
+      }
+    }
+    TEST_EQ(ok, 1, "SafeMemcmp() all offsets");
+  }
+}
+
+/* Test FastMemcpy() and FastMemset() */
+static void FastMemoryTest(void) {
+  uint8_t src[300], dest[300], expect[300];
+  int offs_s, offs_d, size, i;
+  int copy_ok = 1, set_ok = 1;
+
+  for (i = 0; i < sizeof(src); i++)
+    src[i] = i * 7 + 1;
+
+  /* Every alignment, sizes either side of where words are used */
+  for (offs_s = 0; offs_s < 8; offs_s++) {
+    for (offs_d = 0; offs_d < 8; offs_d++) {
+      for (size = 0; size < 280; size += (size < 80 ? 1 : 37)) {
+        memset(dest, 0xee, sizeof(dest));
+        memset(expect, 0xee, sizeof(expect));
+        memcpy(expect + offs_d, src + offs_s, size);
+        if (FastMemcpy(dest + offs_d, src + offs_s, size) !=
+            dest + offs_d || memcmp(dest, expect, sizeof(dest)))
+          copy_ok = 0;
+
+        memset(expect + offs_d, 0xa5, size);
+        if (FastMemset(dest + offs_d, 0xa5, size) != dest + offs_d ||
+            memcmp(dest, expect, sizeof(dest)))
+          set_ok = 0;
+      }
+    }
+  }
+  TEST_EQ(copy_ok, 1, "FastMemcpy()");
+  TEST_EQ(set_ok, 1, "FastMemset()");
 }
 
 
@@ -68,6 +121,7 @@ int main(int argc, char* argv[]) {
 
   MacrosTest();
   SafeMemcmpTest();
+  FastMemoryTest();
 
   if (!gTestSuccess)
     error_code = 255;
@@ -40,12 +40,22 @@ static int retval_vb2_load_fw_keyblock;
 static int retval_vb2_load_fw_preamble;
 static int retval_vb2_digest_finalize;
 static int retval_vb2_verify_digest;
+static uint32_t mock_preamble_size;
+static uint32_t mock_data_key_size;
+static int mock_keyblock_slot_b;
+static int retval_vb2ex_read_resource;
+static int retval_vb2ex_hwcrypto_digest_region;
+static int mock_read_count;
+static int mock_region_count;
+static uint32_t mock_extended_size;
+static uint32_t mock_read_max_size;
 
 /* Type of test to reset for */
 enum reset_type {
 	FOR_MISC,
 	FOR_EXTEND_HASH,
 	FOR_CHECK_HASH,
+	FOR_VERIFY_SLOT,
 };
 
 static void reset_common_data(enum reset_type t)
@@ -71,6 +81,11 @@ static void reset_common_data(enum reset_type t)
 	retval_vb2_load_fw_preamble = VB2_SUCCESS;
 	retval_vb2_digest_finalize = VB2_SUCCESS;
 	retval_vb2_verify_digest = VB2_SUCCESS;
+	retval_vb2ex_read_resource = VB2_SUCCESS;
+	retval_vb2ex_hwcrypto_digest_region = VB2_SUCCESS;
+	mock_read_count = 0;
+	mock_region_count = 0;
+	mock_read_max_size = 0;
 
 	sd->workbuf_preamble_offset = cc.workbuf_used;
 	sd->workbuf_preamble_size = sizeof(*pre);
@@ -93,22 +108,38 @@ static void reset_common_data(enum reset_type t)
 		(cc.workbuf + sd->workbuf_data_key_offset);
 	k->algorithm = mock_algorithm;
 
+	/* Let the mocked loaders fill in the preamble and data key */
+	mock_preamble_size = sd->workbuf_preamble_size;
+	mock_data_key_size = sd->workbuf_data_key_size;
+	mock_keyblock_slot_b = -1;
+	if (t == FOR_VERIFY_SLOT) {
+		sd->workbuf_preamble_size = 0;
+		sd->workbuf_data_key_size = 0;
+	}
+
 	if (t == FOR_EXTEND_HASH || t == FOR_CHECK_HASH)
 		vb2api_init_hash(&cc, VB2_HASH_TAG_FW_BODY, NULL);
 
 	if (t == FOR_CHECK_HASH)
 		vb2api_extend_hash(&cc, mock_body, mock_body_size);
+
+	mock_extended_size = 0;
 };
 
 /* Mocked functions */
 
 int vb2_load_fw_keyblock(struct vb2_context *ctx)
 {
+	mock_keyblock_slot_b = !!(ctx->flags & VB2_CONTEXT_FW_SLOT_B);
+	if (!retval_vb2_load_fw_keyblock)
+		sd->workbuf_data_key_size = mock_data_key_size;
 	return retval_vb2_load_fw_keyblock;
 }
 
 int vb2_load_fw_preamble(struct vb2_context *ctx)
 {
+	if (!retval_vb2_load_fw_preamble)
+		sd->workbuf_preamble_size = mock_preamble_size;
 	return retval_vb2_load_fw_preamble;
 }
 
@@ -150,15 +181,46 @@ int vb2ex_hwcrypto_digest_extend(const uint8_t *buf,
 	if (hwcrypto_state != HWCRYPTO_ENABLED)
 		return VB2_ERROR_UNKNOWN;
 
+	mock_extended_size += size;
 	return VB2_SUCCESS;
 }
 
+int vb2ex_hwcrypto_digest_region(struct vb2_context *ctx,
+				 const struct vb2_region *regions,
+				 uint32_t count)
+{
+	if (hwcrypto_state != HWCRYPTO_ENABLED)
+		return VB2_ERROR_UNKNOWN;
+
+	mock_region_count += count;
+	return retval_vb2ex_hwcrypto_digest_region;
+}
+
+int vb2ex_read_resource(struct vb2_context *ctx,
+			enum vb2_resource_index index,
+			uint32_t offset,
+			void *buf,
+			uint32_t size)
+{
+	if (index != VB2_RES_FW_BODY)
+		return VB2_ERROR_EX_READ_RESOURCE_INDEX;
+	if (offset + size > mock_body_size)
+		return VB2_ERROR_EX_READ_RESOURCE_SIZE;
+
+	mock_read_count++;
+	if (size > mock_read_max_size)
+		mock_read_max_size = size;
+	memcpy(buf, mock_body + offset, size);
+	return retval_vb2ex_read_resource;
+}
+
 int vb2ex_hwcrypto_digest_finalize(uint8_t *digest,
 				   uint32_t digest_size)
 {
 	if (hwcrypto_state != HWCRYPTO_ENABLED)
 		return VB2_ERROR_UNKNOWN;
 
+	memset(digest, 0x5a, digest_size);
 	return retval_vb2_digest_finalize;
 }
 
@@ -185,6 +247,7 @@ int vb2_digest_extend(struct vb2_digest_context *dc,
 	if (dc->hash_alg != mock_hash_alg)
 		return VB2_ERROR_SHA_EXTEND_ALGORITHM;
 
+	mock_extended_size += size;
 	return VB2_SUCCESS;
 }
 
@@ -194,6 +257,7 @@ int vb2_digest_finalize(struct vb2_digest_context *dc,
 {
 	if (hwcrypto_state == HWCRYPTO_ENABLED)
 		return VB2_ERROR_UNKNOWN;
+	memset(digest, 0x5a, digest_size);
 	return retval_vb2_digest_finalize;
 }
 
@@ -203,7 +267,7 @@ uint32_t vb2_rsa_sig_size(enum vb2_signature_algorithm sig_alg)
 }
 
 int vb2_rsa_verify_digest(const struct vb2_public_key *key,
-			  uint8_t *sig,
+			  const uint8_t *sig,
 			  const uint8_t *digest,
 			  const struct vb2_workbuf *wb)
 {
@@ -330,12 +394,111 @@ static void extend_hash_tests(void)
 	}
 }
 
+static void hash_regions_tests(void)
+{
+	struct vb2_region r[2] = {
+		{ .offset = 0, .size = 64 },
+		{ .offset = 64, .size = mock_body_size - 64 },
+	};
+	int hw = hwcrypto_state == HWCRYPTO_ENABLED;
+
+	reset_common_data(FOR_EXTEND_HASH);
+	TEST_SUCC(vb2api_hash_regions(&cc, r, 2), "hash regions good");
+	TEST_EQ(sd->hash_remaining_size, 0, "  remaining");
+	TEST_EQ(mock_region_count, hw ? 2 : 0, "  regions to hwcrypto");
+	TEST_EQ(mock_read_count, hw ? 0 : 2, "  reads");
+	TEST_EQ(mock_extended_size, hw ? 0 : mock_body_size, "  extended");
+	TEST_SUCC(vb2api_check_hash(&cc), "  check hash");
+
+	reset_common_data(FOR_EXTEND_HASH);
+	TEST_SUCC(vb2api_hash_regions(&cc, r, 1), "hash regions partial");
+	TEST_EQ(sd->hash_remaining_size, mock_body_size - 64, "  remaining");
+
+	reset_common_data(FOR_EXTEND_HASH);
+	TEST_SUCC(vb2api_hash_regions(&cc, r, 0), "hash regions none");
+	TEST_EQ(sd->hash_remaining_size, mock_body_size, "  remaining");
+
+	reset_common_data(FOR_EXTEND_HASH);
+	sd->workbuf_hash_size = 0;
+	TEST_EQ(vb2api_hash_regions(&cc, r, 2),
+		VB2_ERROR_API_HASH_REGIONS_WORKBUF, "hash regions no hash");
+
+	reset_common_data(FOR_EXTEND_HASH);
+	r[1].size++;
+	TEST_EQ(vb2api_hash_regions(&cc, r, 2),
+		VB2_ERROR_API_HASH_REGIONS_SIZE, "hash regions too much");
+	TEST_EQ(sd->hash_remaining_size, mock_body_size, "  nothing hashed");
+	TEST_EQ(mock_region_count + mock_read_count, 0, "  nothing read");
+	r[1].size--;
+
+	reset_common_data(FOR_EXTEND_HASH);
+	r[0].size = 0;
+	TEST_EQ(vb2api_hash_regions(&cc, r, 2),
+		VB2_ERROR_API_HASH_REGIONS_SIZE, "hash regions empty region");
+	r[0].size = 64;
+
+	if (hw) {
+		reset_common_data(FOR_EXTEND_HASH);
+		retval_vb2ex_hwcrypto_digest_region = VB2_ERROR_MOCK;
+		TEST_EQ(vb2api_hash_regions(&cc, r, 2),
+			VB2_ERROR_MOCK, "hash regions hwcrypto fail");
+
+		reset_common_data(FOR_EXTEND_HASH);
+		retval_vb2ex_hwcrypto_digest_region =
+			VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+		TEST_SUCC(vb2api_hash_regions(&cc, r, 2),
+			  "hash regions hwcrypto fallback");
+		TEST_EQ(mock_read_count, 2, "  reads");
+		TEST_EQ(mock_extended_size, mock_body_size, "  extended");
+		TEST_EQ(sd->hash_remaining_size, 0, "  remaining");
+		return;
+	}
+
+	/* Reads are limited to the free work buffer */
+	reset_common_data(FOR_EXTEND_HASH);
+	cc.workbuf_used = cc.workbuf_size - 100;
+	TEST_SUCC(vb2api_hash_regions(&cc, r, 2), "hash regions small buf");
+	TEST_EQ(mock_read_max_size, 96, "  read size");
+	TEST_EQ(mock_read_count, 1 + (mock_body_size - 64 + 95) / 96,
+		"  reads");
+	TEST_EQ(mock_extended_size, mock_body_size, "  extended");
+
+	reset_common_data(FOR_EXTEND_HASH);
+	cc.workbuf_used = cc.workbuf_size - 4;
+	TEST_EQ(vb2api_hash_regions(&cc, r, 2),
+		VB2_ERROR_API_HASH_REGIONS_BUF, "hash regions no buf");
+
+	reset_common_data(FOR_EXTEND_HASH);
+	retval_vb2ex_read_resource = VB2_ERROR_MOCK;
+	TEST_EQ(vb2api_hash_regions(&cc, r, 2),
+		VB2_ERROR_MOCK, "hash regions read fail");
+}
+
 static void check_hash_tests(void)
 {
 	struct vb2_fw_preamble *pre;
+	enum vb2_hash_algorithm hash_alg;
+	uint8_t digest[VB2_SHA512_DIGEST_SIZE];
+	uint8_t expect[VB2_SHA256_DIGEST_SIZE];
+	uint32_t digest_size;
+	int compressed;
+
+	memset(expect, 0x5a, sizeof(expect));
 
 	reset_common_data(FOR_CHECK_HASH);
+	digest_size = sizeof(digest);
+	TEST_EQ(vb2api_get_body_digest(&cc, &hash_alg, digest, &digest_size),
+		VB2_ERROR_API_BODY_DIGEST, "body digest before check");
 	TEST_SUCC(vb2api_check_hash(&cc), "check hash good");
+	TEST_SUCC(vb2api_get_body_digest(&cc, &hash_alg, digest,
+					 &digest_size), "  body digest");
+	TEST_EQ(hash_alg, mock_hash_alg, "  body digest alg");
+	TEST_EQ(digest_size, sizeof(expect), "  body digest size");
+	TEST_SUCC(memcmp(digest, expect, sizeof(expect)),
+		  "  body digest matches");
+	digest_size--;
+	TEST_EQ(vb2api_get_body_digest(&cc, &hash_alg, digest, &digest_size),
+		VB2_ERROR_API_BODY_DIGEST_BUF, "  body digest buffer too small");
 
 	reset_common_data(FOR_CHECK_HASH);
 	sd->workbuf_preamble_size = 0;
@@ -387,28 +550,124 @@ static void check_hash_tests(void)
 	retval_vb2_digest_finalize = VB2_ERROR_RSA_VERIFY_DIGEST;
 	TEST_EQ(vb2api_check_hash(&cc),
 		VB2_ERROR_RSA_VERIFY_DIGEST, "check hash finalize");
+
+	reset_common_data(FOR_CHECK_HASH);
+	TEST_SUCC(vb2api_check_hash(&cc), "check hash good");
+	retval_vb2_verify_digest = VB2_ERROR_MOCK;
+	TEST_EQ(vb2api_check_hash(&cc), VB2_ERROR_MOCK, "check hash again bad");
+	digest_size = sizeof(digest);
+	TEST_EQ(vb2api_get_body_digest(&cc, &hash_alg, digest, &digest_size),
+		VB2_ERROR_API_BODY_DIGEST, "  body digest forgotten");
+
+	/* Body compression */
+	reset_common_data(FOR_CHECK_HASH);
+	TEST_EQ(vb2api_get_body_compression(&cc, &compressed),
+		VB2_ERROR_API_BODY_COMPRESSION, "compression before check");
+	TEST_SUCC(vb2api_check_hash(&cc), "check hash uncompressed");
+	compressed = -1;
+	TEST_SUCC(vb2api_get_body_compression(&cc, &compressed),
+		  "  get compression");
+	TEST_EQ(compressed, 0, "  not compressed");
+
+	reset_common_data(FOR_CHECK_HASH);
+	pre = (struct vb2_fw_preamble *)
+		(cc.workbuf + sd->workbuf_preamble_offset);
+	pre->flags |= VB2_FIRMWARE_PREAMBLE_BODY_COMPRESSED;
+	TEST_SUCC(vb2api_check_hash(&cc), "check hash compressed");
+	TEST_SUCC(vb2api_get_body_compression(&cc, &compressed),
+		  "  get compression");
+	TEST_EQ(compressed, 1, "  compressed");
+	retval_vb2_verify_digest = VB2_ERROR_MOCK;
+	TEST_EQ(vb2api_check_hash(&cc), VB2_ERROR_MOCK,
+		"check hash compressed again bad");
+	TEST_EQ(vb2api_get_body_compression(&cc, &compressed),
+		VB2_ERROR_API_BODY_COMPRESSION, "  compression forgotten");
+}
+
+static void verify_slot_tests(void)
+{
+	struct vb2_fw_preamble *pre;
+
+	reset_common_data(FOR_VERIFY_SLOT);
+	TEST_SUCC(vb2api_verify_fw_slot(&cc, 0, mock_body, mock_body_size),
+		  "verify slot A good");
+	TEST_EQ(sd->fw_slot, 0, "  slot");
+	TEST_EQ(mock_keyblock_slot_b, 0, "  loaded slot A");
+	TEST_EQ(sd->hash_remaining_size, 0, "  hashed body");
+
+	reset_common_data(FOR_VERIFY_SLOT);
+	cc.flags |= VB2_CONTEXT_VERIFY_CACHE;
+	TEST_SUCC(vb2api_verify_fw_slot(&cc, 1, mock_body, mock_body_size + 8),
+		  "verify slot B good");
+	TEST_EQ(sd->fw_slot, 1, "  slot");
+	TEST_EQ(mock_keyblock_slot_b, 1, "  loaded slot B");
+	TEST_EQ(cc.flags & VB2_CONTEXT_VERIFY_CACHE, 0, "  no cache");
+
+	reset_common_data(FOR_VERIFY_SLOT);
+	TEST_EQ(vb2api_verify_fw_slot(&cc, 2, mock_body, mock_body_size),
+		VB2_ERROR_API_VERIFY_SLOT_NUM, "verify slot num");
+	TEST_EQ(mock_keyblock_slot_b, -1, "  not loaded");
+
+	reset_common_data(FOR_VERIFY_SLOT);
+	sd->status |= VB2_SD_STATUS_CHOSE_SLOT;
+	TEST_EQ(vb2api_verify_fw_slot(&cc, 0, mock_body, mock_body_size),
+		VB2_ERROR_API_VERIFY_SLOT_STATE, "verify slot chosen");
+
+	reset_common_data(FOR_MISC);
+	TEST_EQ(vb2api_verify_fw_slot(&cc, 0, mock_body, mock_body_size),
+		VB2_ERROR_API_VERIFY_SLOT_STATE, "verify slot already loaded");
+
+	reset_common_data(FOR_VERIFY_SLOT);
+	retval_vb2_load_fw_keyblock = VB2_ERROR_MOCK;
+	TEST_EQ(vb2api_verify_fw_slot(&cc, 0, mock_body, mock_body_size),
+		VB2_ERROR_MOCK, "verify slot keyblock");
+
+	reset_common_data(FOR_VERIFY_SLOT);
+	retval_vb2_load_fw_preamble = VB2_ERROR_MOCK;
+	TEST_EQ(vb2api_verify_fw_slot(&cc, 0, mock_body, mock_body_size),
+		VB2_ERROR_MOCK, "verify slot preamble");
+
+	reset_common_data(FOR_VERIFY_SLOT);
+	TEST_EQ(vb2api_verify_fw_slot(&cc, 0, mock_body, mock_body_size - 1),
+		VB2_ERROR_API_VERIFY_SLOT_BODY_SIZE, "verify slot body size");
+
+	reset_common_data(FOR_VERIFY_SLOT);
+	pre = (struct vb2_fw_preamble *)
+		(cc.workbuf + sd->workbuf_preamble_offset);
+	pre->body_signature.data_size = 0;
+	TEST_EQ(vb2api_verify_fw_slot(&cc, 0, mock_body, mock_body_size),
+		VB2_ERROR_API_EXTEND_HASH_SIZE, "verify slot empty body");
+
+	reset_common_data(FOR_VERIFY_SLOT);
+	retval_vb2_digest_finalize = VB2_ERROR_RSA_VERIFY_DIGEST;
+	TEST_EQ(vb2api_verify_fw_slot(&cc, 1, mock_body, mock_body_size),
+		VB2_ERROR_RSA_VERIFY_DIGEST, "verify slot body hash");
 }
 
 int main(int argc, char* argv[])
 {
 	phase3_tests();
+	verify_slot_tests();
 
 	fprintf(stderr, "Running hash API tests without hwcrypto support...\n");
 	hwcrypto_state = HWCRYPTO_DISABLED;
 	init_hash_tests();
 	extend_hash_tests();
+	hash_regions_tests();
 	check_hash_tests();
 
 	fprintf(stderr, "Running hash API tests with hwcrypto support...\n");
 	hwcrypto_state = HWCRYPTO_ENABLED;
 	init_hash_tests();
 	extend_hash_tests();
+	hash_regions_tests();
 	check_hash_tests();
 
 	fprintf(stderr, "Running hash API tests with forbidden hwcrypto...\n");
 	hwcrypto_state = HWCRYPTO_FORBIDDEN;
 	init_hash_tests();
 	extend_hash_tests();
+	hash_regions_tests();
 	check_hash_tests();
 
 	return gTestSuccess ? 0 : 255;
@@ -21,6 +21,20 @@
 static const uint8_t test_data[] = "This is some test data to sign.";
 static const uint32_t test_size = sizeof(test_data);
 
+/* Mock hardware crypto engine */
+static int hwcrypto_rsa_retval = VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+static int hwcrypto_rsa_calls;
+static const uint8_t *hwcrypto_rsa_sig;
+
+int vb2ex_hwcrypto_rsa_verify(const struct vb2_public_key *key,
+			      const uint8_t *sig,
+			      const uint8_t *digest)
+{
+	hwcrypto_rsa_calls++;
+	hwcrypto_rsa_sig = sig;
+	return hwcrypto_rsa_retval;
+}
+
 static void test_unpack_key(const struct vb2_packed_key *key1)
 {
 	struct vb2_public_key pubk;
@@ -131,6 +145,27 @@ static void test_verify_data(const struct vb2_packed_key *key1,
 	TEST_NEQ(vb2_verify_data(test_data, test_size, sig2, &pubk, &wb),
 		 0, "vb2_verify_data() wrong sig");
 
+	/* Hardware crypto engine is tried first */
+	memcpy(sig2, sig, sig_total_size);
+	hwcrypto_rsa_calls = 0;
+	TEST_EQ(vb2_verify_data(test_data, test_size, sig2, &pubk, &wb),
+		0, "vb2_verify_data() hwcrypto unsupported");
+	TEST_EQ(hwcrypto_rsa_calls, 1, "  hwcrypto tried");
+	TEST_PTR_EQ(hwcrypto_rsa_sig, vb2_signature_data(sig2),
+		    "  hwcrypto sig");
+
+	hwcrypto_rsa_retval = VB2_SUCCESS;
+	memcpy(sig2, sig, sig_total_size);
+	vb2_signature_data(sig2)[0] ^= 0x5A;
+	TEST_EQ(vb2_verify_data(test_data, test_size, sig2, &pubk, &wb),
+		0, "vb2_verify_data() hwcrypto good");
+
+	hwcrypto_rsa_retval = VB2_ERROR_RSA_PADDING;
+	memcpy(sig2, sig, sig_total_size);
+	TEST_EQ(vb2_verify_data(test_data, test_size, sig2, &pubk, &wb),
+		VB2_ERROR_RSA_PADDING, "vb2_verify_data() hwcrypto bad");
+	hwcrypto_rsa_retval = VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+
 	free(sig2);
 }
 
@@ -192,7 +192,7 @@ static void test_verify_fw_preamble(const VbPublicKey *public_key,
 
 	hdr = (struct vb2_fw_preamble *)
 		CreateFirmwarePreamble(0x1234, kernel_subkey, body_sig,
-				       private_key, 0x5678);
+				       private_key, 0x5678, NULL);
 	TEST_PTR_NEQ(hdr, NULL,
 		     "VerifyFirmwarePreamble() prereq test preamble");
 	if (!hdr)
@@ -0,0 +1,218 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for the host pool of vboot 2.0 contexts.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2api.h"
+#include "2misc.h"
+#include "2secdata.h"
+#include "host_context_pool.h"
+#include "test_common.h"
+
+#define POOL_SIZE 3
+#define NUM_THREADS 8
+#define ITERATIONS 50
+
+static struct vb2_gbb_header mock_gbb;
+
+/* How many contexts are out at once, and the most there have been */
+static pthread_mutex_t count_lock = PTHREAD_MUTEX_INITIALIZER;
+static int in_use, max_in_use;
+
+struct thread_state {
+	pthread_t thread;
+	struct vb2_context_pool *pool;
+	int id;
+	int bad;
+};
+
+/* Each verification reads the GBB through its own context */
+int vb2ex_read_resource(struct vb2_context *ctx,
+			enum vb2_resource_index index,
+			uint32_t offset,
+			void *buf,
+			uint32_t size)
+{
+	const struct vb2_gbb_header *gbb = ctx->non_vboot_context;
+
+	if (index != VB2_RES_GBB || !gbb || offset + size > sizeof(*gbb))
+		return VB2_ERROR_EX_READ_RESOURCE_INDEX;
+
+	memcpy(buf, (const uint8_t *)gbb + offset, size);
+	return VB2_SUCCESS;
+}
+
+static void reset_mock_gbb(void)
+{
+	memset(&mock_gbb, 0, sizeof(mock_gbb));
+	memcpy(mock_gbb.signature, VB2_GBB_SIGNATURE, VB2_GBB_SIGNATURE_SIZE);
+	mock_gbb.major_version = VB2_GBB_MAJOR_VER;
+	mock_gbb.minor_version = VB2_GBB_MINOR_VER;
+	mock_gbb.header_size = sizeof(mock_gbb);
+}
+
+static void pool_tests(void)
+{
+	struct vb2_context_pool *pool;
+	struct vb2_context initial;
+	struct vb2_context *ctx, *ctx2;
+	uint8_t zeros[sizeof(struct vb2_shared_data)];
+	uint8_t *workbuf;
+
+	TEST_PTR_EQ(vb2_context_pool_create(0, 1024, NULL), NULL,
+		    "No contexts");
+	TEST_PTR_EQ(vb2_context_pool_create(1, 0, NULL), NULL,
+		    "No work buffer");
+	vb2_context_pool_free(NULL);
+
+	/* Without an initial context, each gets new secdata */
+	pool = vb2_context_pool_create(2, VB2_WORKBUF_RECOMMENDED_SIZE, NULL);
+	TEST_PTR_NEQ(pool, NULL, "Create pool");
+	ctx = vb2_context_pool_get(pool);
+	ctx2 = vb2_context_pool_get(pool);
+	TEST_PTR_NEQ(ctx, ctx2, "  contexts are different");
+	TEST_PTR_NEQ(ctx->workbuf, ctx2->workbuf, "  and so are the buffers");
+	TEST_EQ(ctx->workbuf_size, VB2_WORKBUF_RECOMMENDED_SIZE,
+		"  workbuf size");
+	TEST_EQ(ctx->workbuf_used, 0, "  nothing used");
+	TEST_TRUE(vb2_aligned(ctx->workbuf, VB2_WORKBUF_ALIGN),
+		  "  workbuf aligned");
+	TEST_TRUE(vb2_aligned(ctx2->workbuf, VB2_WORKBUF_ALIGN),
+		  "  both of them");
+	TEST_SUCC(vb2api_secdata_check(ctx), "  secdata created");
+	TEST_NEQ(ctx->flags & VB2_CONTEXT_SECDATA_CHANGED, 0,
+		 "  and needs saving");
+	vb2_context_pool_put(pool, ctx2);
+	vb2_context_pool_put(pool, ctx);
+	vb2_context_pool_free(pool);
+
+	/* An initial context is copied, other than its work buffer */
+	memset(&initial, 0, sizeof(initial));
+	vb2api_secdata_create(&initial);
+	initial.flags = VB2_CONTEXT_RECOVERY_MODE;
+	initial.nvdata[3] = 0x5a;
+	initial.workbuf = zeros;
+	initial.workbuf_size = sizeof(zeros);
+	initial.workbuf_used = 12;
+	initial.non_vboot_context = &mock_gbb;
+	pool = vb2_context_pool_create(1, VB2_WORKBUF_RECOMMENDED_SIZE,
+				       &initial);
+	ctx = vb2_context_pool_get(pool);
+	TEST_EQ(ctx->flags, VB2_CONTEXT_RECOVERY_MODE, "Initial flags");
+	TEST_EQ(ctx->nvdata[3], 0x5a, "  nvdata");
+	TEST_SUCC(vb2api_secdata_check(ctx), "  secdata");
+	TEST_PTR_EQ(ctx->non_vboot_context, &mock_gbb, "  caller's context");
+	TEST_PTR_NEQ(ctx->workbuf, zeros, "  own workbuf");
+	TEST_EQ(ctx->workbuf_used, 0, "  nothing used");
+
+	/* What a verification changes is put back */
+	workbuf = ctx->workbuf;
+	ctx->flags = 0;
+	TEST_EQ(vb2api_fw_phase1(ctx), 0, "Phase 1");
+	TEST_NEQ(ctx->workbuf_used, 0, "  used some workbuf");
+	TEST_NEQ(ctx->flags & VB2_CONTEXT_NVDATA_CHANGED, 0,
+		 "  changed nvdata");
+	ctx->nvdata[3] = 0;
+	ctx->non_vboot_context = NULL;
+	ctx->workbuf = zeros;
+	vb2_context_pool_put(pool, ctx);
+
+	memset(zeros, 0, sizeof(zeros));
+	ctx = vb2_context_pool_get(pool);
+	TEST_EQ(ctx->flags, VB2_CONTEXT_RECOVERY_MODE, "Reset flags");
+	TEST_EQ(ctx->nvdata[3], 0x5a, "  nvdata");
+	TEST_PTR_EQ(ctx->non_vboot_context, &mock_gbb, "  caller's context");
+	TEST_PTR_EQ(ctx->workbuf, workbuf, "  same workbuf");
+	TEST_EQ(ctx->workbuf_used, 0, "  nothing used");
+	TEST_EQ(memcmp(ctx->workbuf, zeros, sizeof(zeros)), 0,
+		"  shared data cleared");
+	vb2_context_pool_put(pool, ctx);
+	vb2_context_pool_free(pool);
+}
+
+static void *verify_thread(void *arg)
+{
+	struct thread_state *t = arg;
+	struct vb2_gbb_header gbb;
+	struct vb2_context *ctx;
+	int i;
+
+	/* Each thread has its own GBB, which its contexts should find */
+	memcpy(&gbb, &mock_gbb, sizeof(gbb));
+	memset(gbb.hwid_digest, t->id, sizeof(gbb.hwid_digest));
+
+	for (i = 0; i < ITERATIONS; i++) {
+		ctx = vb2_context_pool_get(t->pool);
+
+		pthread_mutex_lock(&count_lock);
+		if (++in_use > max_in_use)
+			max_in_use = in_use;
+		pthread_mutex_unlock(&count_lock);
+
+		if (ctx->workbuf_used || ctx->flags != 0)
+			t->bad++;
+		ctx->non_vboot_context = &gbb;
+		if (vb2api_fw_phase1(ctx) ||
+		    memcmp(vb2_get_sd(ctx)->gbb_hwid_digest, gbb.hwid_digest,
+			   sizeof(gbb.hwid_digest)))
+			t->bad++;
+		ctx->non_vboot_context = NULL;
+
+		pthread_mutex_lock(&count_lock);
+		in_use--;
+		pthread_mutex_unlock(&count_lock);
+
+		vb2_context_pool_put(t->pool, ctx);
+	}
+
+	return NULL;
+}
+
+static void thread_tests(void)
+{
+	struct thread_state threads[NUM_THREADS];
+	struct vb2_context initial;
+	struct vb2_context_pool *pool;
+	int bad = 0;
+	int i;
+
+	memset(&initial, 0, sizeof(initial));
+	vb2api_secdata_create(&initial);
+	initial.flags = 0;
+	pool = vb2_context_pool_create(POOL_SIZE, VB2_WORKBUF_RECOMMENDED_SIZE,
+				       &initial);
+	TEST_PTR_NEQ(pool, NULL, "Create pool for threads");
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		threads[i].pool = pool;
+		threads[i].id = i + 1;
+		threads[i].bad = 0;
+		pthread_create(&threads[i].thread, NULL, verify_thread,
+			       &threads[i]);
+	}
+	for (i = 0; i < NUM_THREADS; i++) {
+		pthread_join(threads[i].thread, NULL);
+		bad += threads[i].bad;
+	}
+
+	TEST_EQ(bad, 0, "Every thread verified with a fresh context");
+	TEST_TRUE(max_in_use <= POOL_SIZE, "  no more out than the pool has");
+	vb2_context_pool_free(pool);
+}
+
+int main(int argc, char *argv[])
+{
+	reset_mock_gbb();
+	pool_tests();
+	thread_tests();
+
+	return gTestSuccess ? 0 : 255;
+}
@@ -0,0 +1,373 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * In-process fuzzing entry points for the parsers and verifiers which see
+ * untrusted data.
+ *
+ * Each target takes one input and runs it through the function under test,
+ * using work buffers set up once at startup, so an iteration doesn't allocate
+ * anything and an in-process fuzzer can call it millions of times.  The
+ * driver runs a target over input files in a loop and reports throughput, or
+ * reads inputs from stdin in AFL persistent mode when built with
+ * afl-clang-fast.  Building with -DVB_FUZZ_LIBFUZZER drops main() and
+ * provides LLVMFuzzerTestOneInput() instead, with the target and key taken
+ * from $VB_FUZZ_TARGET and $VB_FUZZ_KEY.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2rsa.h"
+#include "vb2_common.h"
+
+#include "cgptlib_internal.h"
+#include "file_type.h"
+#include "gpt_misc.h"
+#include "host_common.h"
+#include "vboot_common.h"
+#include "vboot_workbuf.h"
+
+/* Largest input passed to a target; longer ones are truncated */
+#define MAX_INPUT_SIZE (4 * 1024 * 1024)
+
+#define GPT_ENTRIES_SIZE (MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry))
+#define GPT_FUZZ_DRIVE_SECTORS (32 * 1024)
+
+/* Most verifiers work in place, so each iteration gets a fresh copy */
+static uint8_t input[MAX_INPUT_SIZE] __attribute__ ((aligned (8)));
+
+static uint8_t workbuf[VB2_WORKBUF_RECOMMENDED_SIZE + 16384]
+	__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+
+static uint8_t gpt_buf[2 * (512 + GPT_ENTRIES_SIZE)];
+
+/* Keys, set up once */
+static uint8_t *key_data;
+static uint64_t key_size;
+static struct vb2_public_key vb2_key;
+static VbPublicKey *vb1_key;
+static RSAPublicKey *vb1_rsa;
+
+struct fuzz_target {
+	const char *name;
+	/* Needs a .vbpubk from -k */
+	int needs_key;
+	/* Returns 0 if the input was accepted */
+	int (*run)(const uint8_t *data, size_t size);
+};
+
+static uint32_t copy_input(const uint8_t *data, size_t size)
+{
+	if (size > sizeof(input))
+		size = sizeof(input);
+	memcpy(input, data, size);
+	return size;
+}
+
+static int fuzz_vb2_keyblock(const uint8_t *data, size_t size)
+{
+	struct vb2_workbuf wb;
+	uint32_t len = copy_input(data, size);
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+	return vb2_verify_keyblock((struct vb2_keyblock *)input, len,
+				   &vb2_key, &wb);
+}
+
+static int fuzz_vb2_fw_preamble(const uint8_t *data, size_t size)
+{
+	struct vb2_workbuf wb;
+	uint32_t len = copy_input(data, size);
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+	return vb2_verify_fw_preamble((struct vb2_fw_preamble *)input, len,
+				      &vb2_key, &wb);
+}
+
+static int fuzz_keyblock(const uint8_t *data, size_t size)
+{
+	struct vb2_workbuf saved;
+	uint32_t len = copy_input(data, size);
+	int rv;
+
+	VbWorkbufSave(&saved);
+	rv = KeyBlockVerify((VbKeyBlockHeader *)input, len, vb1_key, 0);
+	VbWorkbufRestore(&saved);
+	return rv;
+}
+
+static int fuzz_kernel_preamble(const uint8_t *data, size_t size)
+{
+	struct vb2_workbuf saved;
+	uint32_t len = copy_input(data, size);
+	int rv;
+
+	VbWorkbufSave(&saved);
+	rv = VerifyKernelPreamble((VbKernelPreambleHeader *)input, len,
+				  vb1_rsa);
+	VbWorkbufRestore(&saved);
+	return rv;
+}
+
+/*
+ * The input is the primary header sector and entries, then the secondary
+ * entries and header sector, the way they are at each end of the disk.
+ * Short inputs are padded with zeroes.  The drive is as big as the primary
+ * header says, so real GPTs pass.
+ */
+static int fuzz_gpt(const uint8_t *data, size_t size)
+{
+	static const GptData zero_gpt;
+	GptData gpt = zero_gpt;
+	uint64_t drive_sectors;
+
+	if (size > sizeof(gpt_buf))
+		size = sizeof(gpt_buf);
+	memcpy(gpt_buf, data, size);
+	memset(gpt_buf + size, 0, sizeof(gpt_buf) - size);
+
+	gpt.primary_header = gpt_buf;
+	gpt.primary_entries = gpt_buf + 512;
+	gpt.secondary_entries = gpt_buf + 512 + GPT_ENTRIES_SIZE;
+	gpt.secondary_header = gpt_buf + 512 + 2 * GPT_ENTRIES_SIZE;
+	gpt.sector_bytes = 512;
+
+	drive_sectors = ((GptHeader *)gpt_buf)->alternate_lba + 1;
+	if (drive_sectors < 2)
+		drive_sectors = GPT_FUZZ_DRIVE_SECTORS;
+	gpt.streaming_drive_sectors = drive_sectors;
+	gpt.gpt_drive_sectors = drive_sectors;
+
+	return GptSanityCheck(&gpt);
+}
+
+static int fuzz_file_type(const uint8_t *data, size_t size)
+{
+	uint32_t len = copy_input(data, size);
+
+	return futil_file_type_buf(input, len) == FILE_TYPE_UNKNOWN;
+}
+
+static const struct fuzz_target targets[] = {
+	{"vb2_verify_keyblock", 1, fuzz_vb2_keyblock},
+	{"vb2_verify_fw_preamble", 1, fuzz_vb2_fw_preamble},
+	{"KeyBlockVerify", 1, fuzz_keyblock},
+	{"VerifyKernelPreamble", 1, fuzz_kernel_preamble},
+	{"GptSanityCheck", 0, fuzz_gpt},
+	{"futil_file_type_buf", 0, fuzz_file_type},
+};
+
+static const struct fuzz_target *find_target(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(targets); i++) {
+		if (!strcmp(name, targets[i].name))
+			return targets + i;
+	}
+	return NULL;
+}
+
+/**
+ * Set up the keys and work buffers for a target.  Returns 0 if success.
+ */
+static int setup_target(const struct fuzz_target *t, const char *key_file)
+{
+	if (t->needs_key) {
+		if (!key_file) {
+			fprintf(stderr, "%s needs a key\n", t->name);
+			return 1;
+		}
+
+		key_data = ReadFile(key_file, &key_size);
+		if (!key_data ||
+		    vb2_unpack_key(&vb2_key, key_data, key_size)) {
+			fprintf(stderr, "Can't read key %s\n", key_file);
+			return 1;
+		}
+
+		vb1_key = (VbPublicKey *)key_data;
+		vb1_rsa = PublicKeyToRSA(vb1_key);
+		if (!vb1_rsa) {
+			fprintf(stderr, "Can't unpack key %s\n", key_file);
+			return 1;
+		}
+	}
+
+	/* What vboot1 allocates while verifying comes from here */
+	VbWorkbufInit(workbuf, sizeof(workbuf));
+	return 0;
+}
+
+#ifdef VB_FUZZ_LIBFUZZER
+
+static const struct fuzz_target *libfuzzer_target;
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	const char *name = getenv("VB_FUZZ_TARGET");
+
+	libfuzzer_target = name ? find_target(name) : NULL;
+	if (!libfuzzer_target) {
+		fprintf(stderr, "Set VB_FUZZ_TARGET to a target name\n");
+		exit(1);
+	}
+	if (setup_target(libfuzzer_target, getenv("VB_FUZZ_KEY")))
+		exit(1);
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	libfuzzer_target->run(data, size);
+	return 0;
+}
+
+#else /* !VB_FUZZ_LIBFUZZER */
+
+#ifndef __AFL_LOOP
+#define __AFL_LOOP(x) (!afl_loop_done++)
+static int afl_loop_done;
+#endif
+
+/**
+ * Persistent mode: each pass reads one input from stdin.
+ */
+static int run_stdin(const struct fuzz_target *t)
+{
+	static uint8_t buf[MAX_INPUT_SIZE];
+	ssize_t got;
+	size_t size;
+
+	while (__AFL_LOOP(10000)) {
+		size = 0;
+		while (size < sizeof(buf) &&
+		       (got = read(0, buf + size, sizeof(buf) - size)) > 0)
+			size += got;
+		t->run(buf, size);
+	}
+	return 0;
+}
+
+/**
+ * Run every file through the target, the given number of times, and report
+ * how fast that went.
+ */
+static int run_files(const struct fuzz_target *t, char **files, int count,
+		     uint64_t iterations)
+{
+	struct timespec start, end;
+	uint8_t **data;
+	uint64_t *sizes;
+	uint64_t i, accepted = 0, execs = 0;
+	double secs;
+	int f;
+
+	data = calloc(count, sizeof(*data));
+	sizes = calloc(count, sizeof(*sizes));
+	if (!data || !sizes)
+		return 1;
+
+	for (f = 0; f < count; f++) {
+		data[f] = ReadFile(files[f], sizes + f);
+		if (!data[f]) {
+			fprintf(stderr, "Can't read %s\n", files[f]);
+			return 1;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++) {
+		for (f = 0; f < count; f++) {
+			if (!t->run(data[f], sizes[f]))
+				accepted++;
+			execs++;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%s: %d inputs, %" PRIu64 " execs, %" PRIu64 " accepted, "
+	       "%.0f execs/sec\n", t->name, count, execs, accepted,
+	       secs > 0 ? execs / secs : 0.0);
+
+	for (f = 0; f < count; f++)
+		free(data[f]);
+	free(data);
+	free(sizes);
+	return 0;
+}
+
+static void print_help(const char *progname)
+{
+	int i;
+
+	printf("\nUsage: %s [-k key.vbpubk] [-n iterations] <target> "
+	       "[input ...]\n\n"
+	       "Runs each input through the target in this process, -n times\n"
+	       "over (default 1), and reports throughput.  With no inputs,\n"
+	       "reads them from stdin in AFL persistent mode.\n\n"
+	       "Targets (* = needs -k):\n", progname);
+	for (i = 0; i < ARRAY_SIZE(targets); i++)
+		printf("  %s%s\n", targets[i].name,
+		       targets[i].needs_key ? " *" : "");
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const struct fuzz_target *t;
+	const char *key_file = NULL;
+	uint64_t iterations = 1;
+	char *e;
+	int c;
+
+	while ((c = getopt(argc, argv, "k:n:h")) != -1) {
+		switch (c) {
+		case 'k':
+			key_file = optarg;
+			break;
+		case 'n':
+			iterations = strtoull(optarg, &e, 0);
+			if (!*optarg || (e && *e)) {
+				fprintf(stderr, "Invalid count \"%s\"\n",
+					optarg);
+				return 1;
+			}
+			break;
+		default:
+			print_help(argv[0]);
+			return c != 'h';
+		}
+	}
+
+	if (optind >= argc) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	t = find_target(argv[optind]);
+	if (!t) {
+		fprintf(stderr, "Unknown target %s\n", argv[optind]);
+		return 1;
+	}
+
+	if (setup_target(t, key_file))
+		return 1;
+
+	if (optind + 1 == argc)
+		return run_stdin(t);
+
+	return run_files(t, argv + optind + 1, argc - optind - 1, iterations);
+}
+
+#endif /* VB_FUZZ_LIBFUZZER */
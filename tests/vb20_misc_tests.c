@@ -46,6 +46,7 @@ static struct {
 } mock_vblock;
 
 static int mock_read_res_fail_on_call;
+static int mock_map_res_retval;
 static int mock_unpack_key_retval;
 static int mock_verify_keyblock_retval;
 static int mock_verify_preamble_retval;
@@ -76,6 +77,7 @@ static void reset_common_data(enum reset_type t)
 	vb2_secdata_init(&cc);
 
 	mock_read_res_fail_on_call = 0;
+	mock_map_res_retval = VB2_ERROR_EX_MAP_RESOURCE_UNSUPPORTED;
 	mock_unpack_key_retval = VB2_SUCCESS;
 	mock_verify_keyblock_retval = VB2_SUCCESS;
 	mock_verify_preamble_retval = VB2_SUCCESS;
@@ -145,6 +147,25 @@ int vb2ex_read_resource(struct vb2_context *ctx,
 	return VB2_SUCCESS;
 }
 
+int vb2ex_map_resource(struct vb2_context *ctx,
+		       enum vb2_resource_index index,
+		       uint32_t offset,
+		       const void **ptr,
+		       uint32_t *size)
+{
+	/* Only the vblock can be mapped */
+	if (mock_map_res_retval || index != VB2_RES_FW_VBLOCK)
+		return mock_map_res_retval ? mock_map_res_retval :
+			VB2_ERROR_EX_MAP_RESOURCE_UNSUPPORTED;
+
+	if (offset > sizeof(mock_vblock))
+		return VB2_ERROR_EX_READ_RESOURCE_SIZE;
+
+	*ptr = (uint8_t *)&mock_vblock + offset;
+	*size = sizeof(mock_vblock) - offset;
+	return VB2_SUCCESS;
+}
+
 int vb2_unpack_key(struct vb2_public_key *key,
 		   const uint8_t *buf,
 		   uint32_t size)
@@ -205,6 +226,46 @@ static void verify_keyblock_tests(void)
 		sd->workbuf_data_key_offset + sd->workbuf_data_key_size,
 		"workbuf used after");
 
+	/* A mapped keyblock is used in place, so only the root key is read */
+	reset_common_data(FOR_KEYBLOCK);
+	mock_map_res_retval = VB2_SUCCESS;
+	mock_read_res_fail_on_call = 2;
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "keyblock mapped");
+	k = (struct vb2_packed_key *)(cc.workbuf + sd->workbuf_data_key_offset);
+	TEST_EQ(k->key_version, 2, "  data key version");
+	TEST_EQ(memcmp(cc.workbuf + sd->workbuf_data_key_offset +
+		       k->key_offset, mock_vblock.k.data_key_data,
+		       sizeof(mock_vblock.k.data_key_data)),
+		0, "  data key data");
+
+	reset_common_data(FOR_KEYBLOCK);
+	mock_map_res_retval = VB2_ERROR_EX_READ_RESOURCE_INDEX;
+	TEST_EQ(vb2_load_fw_keyblock(&cc),
+		VB2_ERROR_EX_READ_RESOURCE_INDEX,
+		"keyblock map error");
+
+	reset_common_data(FOR_KEYBLOCK);
+	mock_map_res_retval = VB2_SUCCESS;
+	kb->keyblock_size = sizeof(mock_vblock) + 1;
+	TEST_EQ(vb2_load_fw_keyblock(&cc),
+		VB2_ERROR_EX_READ_RESOURCE_SIZE,
+		"keyblock mapping too small is read");
+
+	reset_common_data(FOR_KEYBLOCK);
+	mock_map_res_retval = VB2_SUCCESS;
+	cc.workbuf_used = cc.workbuf_size - sd->gbb_rootkey_size;
+	kb->data_key.key_size = sizeof(mock_vblock.k.data_key_data) + 32;
+	TEST_EQ(vb2_load_fw_keyblock(&cc),
+		VB2_ERROR_FW_KEYBLOCK_WORKBUF,
+		"keyblock mapped no room for data key");
+
+	/* A data key bigger than the root key overwrites the keyblock */
+	reset_common_data(FOR_KEYBLOCK);
+	kb->data_key.key_size = sizeof(mock_vblock.k.data_key_data) + 32;
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "keyblock big data key");
+	TEST_EQ(sd->vblock_preamble_offset, sizeof(mock_vblock.k),
+		"  preamble offset");
+
 	/* Test failures */
 	reset_common_data(FOR_KEYBLOCK);
 	cc.workbuf_used = cc.workbuf_size - sd->gbb_rootkey_size + 8;
@@ -266,6 +327,33 @@ static void verify_keyblock_tests(void)
 	TEST_EQ(vb2_load_fw_keyblock(&cc),
 		VB2_ERROR_FW_KEYBLOCK_VERSION_ROLLBACK,
 		"keyblock rollback");
+
+	/* A bad signature is reported ahead of a bad version */
+	reset_common_data(FOR_KEYBLOCK);
+	kb->data_key.key_version = 0x10000;
+	mock_verify_keyblock_retval = VB2_ERROR_KEYBLOCK_SIG_INVALID;
+	TEST_EQ(vb2_load_fw_keyblock(&cc),
+		VB2_ERROR_KEYBLOCK_SIG_INVALID,
+		"keyblock bad signature and version range");
+	TEST_EQ(vb2_nv_get(&cc, VB2_NV_RECOVERY_REQUEST),
+		VB2_RECOVERY_FW_KEYBLOCK, "  recovery reason");
+
+	reset_common_data(FOR_KEYBLOCK);
+	kb->data_key.key_version = 1;
+	mock_verify_keyblock_retval = VB2_ERROR_KEYBLOCK_SIG_INVALID;
+	TEST_EQ(vb2_load_fw_keyblock(&cc),
+		VB2_ERROR_KEYBLOCK_SIG_INVALID,
+		"keyblock bad signature and rollback");
+	TEST_EQ(vb2_nv_get(&cc, VB2_NV_RECOVERY_REQUEST),
+		VB2_RECOVERY_FW_KEYBLOCK, "  recovery reason");
+
+	reset_common_data(FOR_KEYBLOCK);
+	kb->data_key.key_version = 1;
+	TEST_EQ(vb2_load_fw_keyblock(&cc),
+		VB2_ERROR_FW_KEYBLOCK_VERSION_ROLLBACK,
+		"keyblock rollback after verify");
+	TEST_EQ(vb2_nv_get(&cc, VB2_NV_RECOVERY_REQUEST),
+		VB2_RECOVERY_FW_KEY_ROLLBACK, "  recovery reason");
 }
 
 static void verify_preamble_tests(void)
@@ -369,10 +457,155 @@ static void verify_preamble_tests(void)
 	TEST_EQ(v, 0x20002, "no roll forward");
 }
 
+/* Load the keyblock and preamble with the verify cache enabled */
+static int load_cached(void)
+{
+	int rv;
+
+	cc.flags |= VB2_CONTEXT_VERIFY_CACHE;
+	rv = vb2_load_fw_keyblock(&cc);
+	if (!rv)
+		rv = vb2_load_fw_preamble(&cc);
+	return rv;
+}
+
+static void verify_cache_tests(void)
+{
+	struct vb2_keyblock *kb = &mock_vblock.k.kb;
+	uint8_t cache[VB2_VERIFY_CACHE_SIZE];
+
+	/* First boot fills in the cache */
+	reset_common_data(FOR_KEYBLOCK);
+	TEST_SUCC(load_cached(), "cache first boot");
+	TEST_NEQ(cc.flags & VB2_CONTEXT_VERIFY_CACHE_CHANGED, 0,
+		 "  cache changed");
+	TEST_EQ(sd->status & (VB2_SD_STATUS_KEYBLOCK_CACHED |
+			      VB2_SD_STATUS_PREAMBLE_CACHED), 0,
+		"  not cached");
+	memcpy(cache, cc.verify_cache, sizeof(cache));
+
+	/* Next boot skips verifying, even if signatures would now fail */
+	reset_common_data(FOR_KEYBLOCK);
+	memcpy(cc.verify_cache, cache, sizeof(cache));
+	mock_verify_keyblock_retval = VB2_ERROR_KEYBLOCK_MAGIC;
+	mock_verify_preamble_retval = VB2_ERROR_PREAMBLE_SIG_INVALID;
+	TEST_SUCC(load_cached(), "cache hit");
+	TEST_NEQ(sd->status & VB2_SD_STATUS_KEYBLOCK_CACHED, 0,
+		 "  keyblock cached");
+	TEST_NEQ(sd->status & VB2_SD_STATUS_PREAMBLE_CACHED, 0,
+		 "  preamble cached");
+	TEST_EQ(cc.flags & VB2_CONTEXT_VERIFY_CACHE_CHANGED, 0,
+		"  cache not changed");
+	TEST_EQ(sd->fw_version, 0x20002, "  version");
+
+	/* Rollback is still checked on a hit */
+	reset_common_data(FOR_KEYBLOCK);
+	memcpy(cc.verify_cache, cache, sizeof(cache));
+	sd->fw_version_secdata = 0x30000;
+	TEST_EQ(load_cached(), VB2_ERROR_FW_KEYBLOCK_VERSION_ROLLBACK,
+		"cache hit rollback");
+
+	/* Different keyblock misses */
+	reset_common_data(FOR_KEYBLOCK);
+	memcpy(cc.verify_cache, cache, sizeof(cache));
+	mock_vblock.k.kbdata[0]++;
+	mock_verify_keyblock_retval = VB2_ERROR_KEYBLOCK_MAGIC;
+	TEST_EQ(load_cached(), VB2_ERROR_KEYBLOCK_MAGIC,
+		"cache miss keyblock");
+	mock_vblock.k.kbdata[0]--;
+
+	/* Different preamble misses */
+	reset_common_data(FOR_KEYBLOCK);
+	memcpy(cc.verify_cache, cache, sizeof(cache));
+	mock_vblock.p.predata[0]++;
+	mock_verify_preamble_retval = VB2_ERROR_PREAMBLE_SIG_INVALID;
+	TEST_EQ(load_cached(), VB2_ERROR_PREAMBLE_SIG_INVALID,
+		"cache miss preamble");
+	mock_vblock.p.predata[0]--;
+
+	/* Other slot misses */
+	reset_common_data(FOR_KEYBLOCK);
+	memcpy(cc.verify_cache, cache, sizeof(cache));
+	sd->fw_slot = 1;
+	mock_verify_keyblock_retval = VB2_ERROR_KEYBLOCK_MAGIC;
+	TEST_EQ(load_cached(), VB2_ERROR_KEYBLOCK_MAGIC, "cache other slot");
+
+	/* Not used unless caller enables it */
+	reset_common_data(FOR_KEYBLOCK);
+	memcpy(cc.verify_cache, cache, sizeof(cache));
+	mock_verify_keyblock_retval = VB2_ERROR_KEYBLOCK_MAGIC;
+	TEST_EQ(vb2_load_fw_keyblock(&cc), VB2_ERROR_KEYBLOCK_MAGIC,
+		"cache disabled");
+
+	/* Key version changes are saved */
+	reset_common_data(FOR_KEYBLOCK);
+	memcpy(cc.verify_cache, cache, sizeof(cache));
+	kb->data_key.key_version = 3;
+	TEST_SUCC(load_cached(), "cache new key version");
+	TEST_NEQ(cc.flags & VB2_CONTEXT_VERIFY_CACHE_CHANGED, 0,
+		 "  cache changed");
+}
+
+static void vblock_prefix_tests(void)
+{
+	struct vb2_fw_preamble *pre = &mock_vblock.p.pre;
+	uint32_t pre_offset;
+
+	/* One read of the vblock serves both the keyblock and preamble */
+	reset_common_data(FOR_KEYBLOCK);
+	cc.vblock_prefix_size = sizeof(mock_vblock);
+	mock_read_res_fail_on_call = 3;
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "prefix keyblock");
+	TEST_NEQ(sd->workbuf_vblock_prefix_size, 0, "  prefix kept");
+	pre_offset = (sd->workbuf_data_key_offset + sd->workbuf_data_key_size +
+		      VB2_WORKBUF_ALIGN - 1) & ~(VB2_WORKBUF_ALIGN - 1);
+	TEST_SUCC(vb2_load_fw_preamble(&cc), "prefix preamble");
+	TEST_EQ(sd->workbuf_vblock_prefix_size, 0, "  prefix freed");
+	TEST_EQ(sd->workbuf_preamble_offset, pre_offset, "  preamble offset");
+	TEST_EQ(memcmp(cc.workbuf + sd->workbuf_preamble_offset, pre,
+		       sizeof(mock_vblock.p)),
+		0, "  preamble copied");
+	TEST_EQ(cc.workbuf_used, pre_offset + sizeof(mock_vblock.p),
+		"  workbuf used");
+
+	/* A preamble which isn't all in the prefix is read after the key */
+	reset_common_data(FOR_KEYBLOCK);
+	cc.vblock_prefix_size = sizeof(mock_vblock.k) + 8;
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "short prefix keyblock");
+	TEST_NEQ(sd->workbuf_vblock_prefix_size, 0, "  prefix kept");
+	pre_offset = (sd->workbuf_data_key_offset + sd->workbuf_data_key_size +
+		      VB2_WORKBUF_ALIGN - 1) & ~(VB2_WORKBUF_ALIGN - 1);
+	TEST_SUCC(vb2_load_fw_preamble(&cc), "short prefix preamble");
+	TEST_EQ(sd->workbuf_vblock_prefix_size, 0, "  prefix freed");
+	TEST_EQ(sd->workbuf_preamble_offset, pre_offset, "  preamble offset");
+
+	/* So is a keyblock which isn't */
+	reset_common_data(FOR_KEYBLOCK);
+	cc.vblock_prefix_size = sizeof(struct vb2_keyblock);
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "tiny prefix keyblock");
+	TEST_EQ(sd->workbuf_vblock_prefix_size, 0, "  prefix dropped");
+	TEST_EQ(cc.workbuf_used,
+		sd->workbuf_data_key_offset + sd->workbuf_data_key_size,
+		"  workbuf used");
+
+	/* A prefix which can't be read is ignored */
+	reset_common_data(FOR_KEYBLOCK);
+	cc.vblock_prefix_size = sizeof(mock_vblock) + 1;
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "bad prefix keyblock");
+	TEST_EQ(sd->workbuf_vblock_prefix_size, 0, "  no prefix");
+
+	reset_common_data(FOR_KEYBLOCK);
+	cc.vblock_prefix_size = cc.workbuf_size;
+	TEST_SUCC(vb2_load_fw_keyblock(&cc), "huge prefix keyblock");
+	TEST_EQ(sd->workbuf_vblock_prefix_size, 0, "  no prefix");
+}
+
 int main(int argc, char* argv[])
 {
 	verify_keyblock_tests();
 	verify_preamble_tests();
+	verify_cache_tests();
+	vblock_prefix_tests();
 
 	return gTestSuccess ? 0 : 255;
 }
@@ -86,6 +86,8 @@ static void test_verify_digest(struct vb2_public_key *key) {
 	Memcpy(sig, signatures[0], sizeof(sig));
 	TEST_SUCC(vb2_rsa_verify_digest(key, sig, test_message_sha1_hash, &wb),
 		  "vb2_rsa_verify_digest() good");
+	TEST_EQ(Memcmp(sig, signatures[0], sizeof(sig)), 0,
+		"vb2_rsa_verify_digest() leaves sig alone");
 
 	Memcpy(sig, signatures[0], sizeof(sig));
 	vb2_workbuf_init(&wb, workbuf, sizeof(sig) * 3 - 1);
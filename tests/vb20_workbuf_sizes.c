@@ -0,0 +1,379 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Measures how much work buffer vboot2 firmware verification really needs.
+ *
+ * Usage: vb20_workbuf_sizes <keys_dir> [--all]
+ *
+ * For each combination of root key and firmware data key algorithm (just the
+ * ones in active use, unless --all is given), this signs a firmware image
+ * with the test keys, verifies it with the vb2api calls in order, and records
+ * the work buffer high-water mark of each call.  A header with the peak for
+ * each combination and a per-phase breakdown is printed on stdout.
+ *
+ * Needs a build with WORKBUF_STATS=1; see 'make workbuf_sizes'.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2api.h"
+#include "2common.h"
+#include "2misc.h"
+#include "2struct.h"
+#include "host_common.h"
+#include "vb2_common.h"
+
+/* Big enough that nothing we measure runs out */
+#define MEASURE_WORKBUF_SIZE (64 * 1024)
+
+#define BODY_SIZE 4096
+
+#ifndef VB2_WORKBUF_STATS
+/* Uninstrumented builds can't measure anything, but should still build */
+static void vb2_workbuf_stats_reset(void)
+{
+}
+
+static uint32_t vb2_workbuf_stats_peak(const void *buf)
+{
+	return 0;
+}
+#endif
+
+enum phase {
+	PHASE_FW_PHASE1,
+	PHASE_FW_PHASE2,
+	PHASE_FW_KEYBLOCK,
+	PHASE_FW_PREAMBLE,
+	PHASE_INIT_HASH,
+	PHASE_CHECK_HASH,
+	PHASE_COUNT
+};
+
+static const char * const phase_names[PHASE_COUNT] = {
+	"phase1", "phase2", "keyblock", "preamble", "init_hash", "check_hash"
+};
+
+struct perm {
+	int root_alg;
+	int data_alg;
+};
+
+/* Permutations of root and firmware data key algorithms in active use */
+static const struct perm active_perms[] = {
+	{VB2_ALG_RSA4096_SHA256, VB2_ALG_RSA2048_SHA256},
+	{VB2_ALG_RSA8192_SHA512, VB2_ALG_RSA2048_SHA256},
+	{VB2_ALG_RSA8192_SHA512, VB2_ALG_RSA4096_SHA256},
+};
+
+/* Resources for the image being measured */
+static uint8_t *gbb;
+static uint32_t gbb_size;
+static uint8_t *vblock;
+static uint32_t vblock_size;
+static uint8_t body[BODY_SIZE];
+
+int vb2ex_read_resource(struct vb2_context *ctx,
+			enum vb2_resource_index index,
+			uint32_t offset,
+			void *buf,
+			uint32_t size)
+{
+	const uint8_t *res;
+	uint32_t res_size;
+
+	switch (index) {
+	case VB2_RES_GBB:
+		res = gbb;
+		res_size = gbb_size;
+		break;
+	case VB2_RES_FW_VBLOCK:
+		res = vblock;
+		res_size = vblock_size;
+		break;
+	default:
+		return VB2_ERROR_UNKNOWN;
+	}
+
+	if (offset > res_size || size > res_size - offset)
+		return VB2_ERROR_UNKNOWN;
+
+	memcpy(buf, res + offset, size);
+	return VB2_SUCCESS;
+}
+
+int vb2ex_tpm_clear_owner(struct vb2_context *ctx)
+{
+	return VB2_SUCCESS;
+}
+
+/**
+ * Read the test key pair for [alg] from [keys_dir].
+ */
+static int read_keys(const char *keys_dir, int alg,
+		     VbPrivateKey **private_key, VbPublicKey **public_key)
+{
+	char filename[1024];
+	int rsa_len = siglen_map[alg] * 8;
+
+	snprintf(filename, sizeof(filename), "%s/key_rsa%d.pem",
+		 keys_dir, rsa_len);
+	*private_key = PrivateKeyReadPem(filename, alg);
+
+	snprintf(filename, sizeof(filename), "%s/key_rsa%d.keyb",
+		 keys_dir, rsa_len);
+	*public_key = PublicKeyReadKeyb(filename, alg, 1);
+
+	if (!*private_key || !*public_key) {
+		fprintf(stderr, "Error reading test keys for %s\n",
+			algo_strings[alg]);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Build a GBB holding [root_key], and a firmware vblock signed by
+ * [root_private_key] whose preamble and body are signed by [data_key].
+ */
+static int build_image(const VbPublicKey *root_key,
+		       const VbPrivateKey *root_private_key,
+		       const VbPublicKey *data_key,
+		       const VbPrivateKey *data_private_key)
+{
+	struct vb2_gbb_header *h;
+	VbKeyBlockHeader *keyblock;
+	VbFirmwarePreambleHeader *preamble;
+	VbSignature *body_sig;
+	uint32_t root_key_size = root_key->key_offset + root_key->key_size;
+
+	/* GBB is just the header and root key */
+	gbb_size = sizeof(*h) + root_key_size;
+	gbb = calloc(gbb_size, 1);
+	h = (struct vb2_gbb_header *)gbb;
+	memcpy(h->signature, VB2_GBB_SIGNATURE, VB2_GBB_SIGNATURE_SIZE);
+	h->major_version = VB2_GBB_MAJOR_VER;
+	h->minor_version = VB2_GBB_MINOR_VER;
+	h->header_size = sizeof(*h);
+	h->rootkey_offset = sizeof(*h);
+	h->rootkey_size = root_key_size;
+	memcpy(gbb + h->rootkey_offset, root_key, root_key_size);
+
+	/* The data key doubles as the kernel subkey */
+	keyblock = KeyBlockCreate(data_key, root_private_key, 0);
+	body_sig = CalculateSignature(body, sizeof(body), data_private_key);
+	preamble = body_sig ?
+		CreateFirmwarePreamble(1, data_key, body_sig,
+				       data_private_key, 0, NULL) : NULL;
+	free(body_sig);
+	if (!keyblock || !preamble) {
+		free(keyblock);
+		free(preamble);
+		fprintf(stderr, "Error signing firmware image\n");
+		return 1;
+	}
+
+	vblock_size = keyblock->key_block_size + preamble->preamble_size;
+	vblock = malloc(vblock_size);
+	memcpy(vblock, keyblock, keyblock->key_block_size);
+	memcpy(vblock + keyblock->key_block_size, preamble,
+	       preamble->preamble_size);
+
+	free(keyblock);
+	free(preamble);
+	return 0;
+}
+
+/**
+ * Return how much of the work buffer has been used since the last reset,
+ * including what the context is holding on to.
+ */
+static uint32_t workbuf_peak(const struct vb2_context *ctx)
+{
+	uint32_t peak = vb2_workbuf_stats_peak(ctx->workbuf);
+
+	return peak > ctx->workbuf_used ? peak : ctx->workbuf_used;
+}
+
+/**
+ * Verify the image, recording the peak use of each phase in [peaks].
+ */
+static int measure(uint32_t *peaks)
+{
+	uint8_t workbuf[MEASURE_WORKBUF_SIZE]
+		__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	struct vb2_context ctx;
+	uint32_t body_size;
+	int phase;
+	int rv = VB2_SUCCESS;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.workbuf = workbuf;
+	ctx.workbuf_size = sizeof(workbuf);
+
+	rv = vb2api_secdata_create(&ctx);
+	if (rv)
+		return rv;
+
+	for (phase = 0; phase < PHASE_COUNT && !rv; phase++) {
+		vb2_workbuf_stats_reset();
+
+		switch (phase) {
+		case PHASE_FW_PHASE1:
+			rv = vb2api_fw_phase1(&ctx);
+			break;
+		case PHASE_FW_PHASE2:
+			rv = vb2api_fw_phase2(&ctx);
+			break;
+		case PHASE_FW_KEYBLOCK:
+			rv = vb2_load_fw_keyblock(&ctx);
+			break;
+		case PHASE_FW_PREAMBLE:
+			rv = vb2_load_fw_preamble(&ctx);
+			break;
+		case PHASE_INIT_HASH:
+			rv = vb2api_init_hash(&ctx, VB2_HASH_TAG_FW_BODY,
+					      &body_size);
+			if (!rv && body_size != sizeof(body))
+				rv = VB2_ERROR_UNKNOWN;
+			break;
+		case PHASE_CHECK_HASH:
+			rv = vb2api_extend_hash(&ctx, body, sizeof(body));
+			if (!rv)
+				rv = vb2api_check_hash(&ctx);
+			break;
+		}
+
+		peaks[phase] = workbuf_peak(&ctx);
+		if (rv)
+			fprintf(stderr, "Error: %s failed (%#x)\n",
+				phase_names[phase], rv);
+	}
+
+	return rv;
+}
+
+/**
+ * Print [alg] as a macro name fragment, e.g. "RSA4096_SHA256".
+ */
+static void print_alg_name(int alg)
+{
+	const char *c;
+
+	for (c = algo_strings[alg]; *c; c++)
+		putchar(*c == ' ' ? '_' : *c);
+}
+
+int main(int argc, char *argv[])
+{
+	struct perm all_perms[VB2_ALG_COUNT * VB2_ALG_COUNT];
+	const struct perm *perms = active_perms;
+	int perm_count = ARRAY_SIZE(active_perms);
+	uint32_t peaks[ARRAY_SIZE(all_perms)][PHASE_COUNT];
+	uint32_t perm_peak, max_peak = 0;
+	int i, phase;
+
+#ifndef VB2_WORKBUF_STATS
+	fprintf(stderr, "%s needs a build with WORKBUF_STATS=1\n", argv[0]);
+	return 1;
+#endif
+
+	if (argc == 3 && !strcasecmp(argv[2], "--all")) {
+		for (i = 0; i < ARRAY_SIZE(all_perms); i++) {
+			all_perms[i].root_alg = i / VB2_ALG_COUNT;
+			all_perms[i].data_alg = i % VB2_ALG_COUNT;
+		}
+		perms = all_perms;
+		perm_count = ARRAY_SIZE(all_perms);
+	} else if (argc != 2) {
+		fprintf(stderr, "Usage: %s <keys_dir> [--all]\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i < sizeof(body); i++)
+		body[i] = (uint8_t)i;
+
+	/* Measure everything first, so errors don't leave half a header */
+	for (i = 0; i < perm_count; i++) {
+		VbPrivateKey *root_private_key, *data_private_key;
+		VbPublicKey *root_key, *data_key;
+		int rv;
+
+		fprintf(stderr, "Measuring root key %s, data key %s\n",
+			algo_strings[perms[i].root_alg],
+			algo_strings[perms[i].data_alg]);
+
+		if (read_keys(argv[1], perms[i].root_alg,
+			      &root_private_key, &root_key) ||
+		    read_keys(argv[1], perms[i].data_alg,
+			      &data_private_key, &data_key))
+			return 1;
+
+		rv = build_image(root_key, root_private_key,
+				 data_key, data_private_key);
+		if (!rv)
+			rv = measure(peaks[i]);
+
+		PrivateKeyFree(root_private_key);
+		PrivateKeyFree(data_private_key);
+		free(root_key);
+		free(data_key);
+		free(gbb);
+		free(vblock);
+		gbb = vblock = NULL;
+
+		if (rv)
+			return 1;
+	}
+
+	printf("/* Generated by vb20_workbuf_sizes; do not edit. */\n\n"
+	       "/*\n"
+	       " * Peak work buffer use in bytes, for each root key and "
+	       "firmware data key\n"
+	       " * algorithm, from vb2api_fw_phase1() through "
+	       "vb2api_check_hash():\n"
+	       " *\n"
+	       " * %-16s %-16s", "root key", "data key");
+	for (phase = 0; phase < PHASE_COUNT; phase++)
+		printf(" %10s", phase_names[phase]);
+	printf("\n");
+	for (i = 0; i < perm_count; i++) {
+		printf(" * %-16s %-16s", algo_strings[perms[i].root_alg],
+		       algo_strings[perms[i].data_alg]);
+		for (phase = 0; phase < PHASE_COUNT; phase++)
+			printf(" %10d", (int)peaks[i][phase]);
+		printf("\n");
+	}
+	printf(" */\n\n"
+	       "#ifndef VBOOT_REFERENCE_VB2_WORKBUF_SIZES_H_\n"
+	       "#define VBOOT_REFERENCE_VB2_WORKBUF_SIZES_H_\n\n");
+
+	for (i = 0; i < perm_count; i++) {
+		perm_peak = 0;
+		for (phase = 0; phase < PHASE_COUNT; phase++) {
+			if (peaks[i][phase] > perm_peak)
+				perm_peak = peaks[i][phase];
+		}
+		if (perm_peak > max_peak)
+			max_peak = perm_peak;
+
+		printf("#define VB2_WORKBUF_SIZE_");
+		print_alg_name(perms[i].root_alg);
+		printf("_");
+		print_alg_name(perms[i].data_alg);
+		printf(" %d\n", (int)perm_peak);
+	}
+
+	printf("\n/* Enough for any of the above */\n"
+	       "#define VB2_WORKBUF_SIZE_MAX %d\n\n"
+	       "#endif  /* VBOOT_REFERENCE_VB2_WORKBUF_SIZES_H_ */\n",
+	       (int)max_peak);
+
+	return 0;
+}
@@ -17,6 +17,7 @@
 
 #include "vb2_common.h"
 
+#include "host_fw_preamble2.h"
 #include "host_key2.h"
 #include "host_signature2.h"
 
@@ -31,6 +32,7 @@ static struct vb2_shared_data *sd;
 static const uint8_t mock_body[320] = "Mock body";
 static const int mock_body_size = sizeof(mock_body);
 static const int mock_hash_alg = VB2_HASH_SHA256;
+static const int mock_block_size = 128;
 static int mock_sig_size;
 
 static const struct vb2_guid test_guid[4] = {
@@ -53,12 +55,15 @@ static struct vb2_digest_context hwcrypto_emulation_dc;
 static int retval_hwcrypto;
 static int retval_vb2_load_fw_keyblock;
 static int retval_vb2_load_fw_preamble;
+static int retval_vb2ex_digest_multi;
+static int mock_digest_multi_count;
 
 /* Type of test to reset for */
 enum reset_type {
 	FOR_MISC,
 	FOR_EXTEND_HASH,
 	FOR_CHECK_HASH,
+	FOR_HASH_BLOCKS,
 };
 
 static void reset_common_data(enum reset_type t)
@@ -66,7 +71,8 @@ static void reset_common_data(enum reset_type t)
 	const struct vb2_private_key *hash_key;
 	struct vb2_fw_preamble *pre;
 	struct vb2_signature *sig;
-	uint32_t sig_offset;
+	struct vb2_signature **blocks;
+	uint32_t sig_offset, block_count;
 
 	int i;
 
@@ -88,6 +94,8 @@ static void reset_common_data(enum reset_type t)
 	retval_hwcrypto = VB2_SUCCESS;
 	retval_vb2_load_fw_keyblock = VB2_SUCCESS;
 	retval_vb2_load_fw_preamble = VB2_SUCCESS;
+	retval_vb2ex_digest_multi = VB2_ERROR_EX_DIGEST_MULTI_UNSUPPORTED;
+	mock_digest_multi_count = 0;
 
 	vb2_private_key_hash(&hash_key, mock_hash_alg);
 
@@ -111,6 +119,20 @@ static void reset_common_data(enum reset_type t)
 		free(sig);
 	}
 
+	/* Last GUID is hashed in blocks */
+	if (t == FOR_HASH_BLOCKS) {
+		vb2_fw_preamble_hash_blocks(&blocks, &block_count, mock_body,
+					    mock_body_size, mock_block_size,
+					    mock_hash_alg, test_guid + 3);
+		for (i = 0; i < block_count; i++) {
+			memcpy((uint8_t *)pre + sig_offset, blocks[i],
+			       blocks[i]->c.total_size);
+			sig_offset += blocks[i]->c.total_size;
+		}
+		pre->hash_count += block_count;
+		vb2_fw_preamble_free_hash_blocks(blocks, block_count);
+	}
+
 	sd->workbuf_preamble_size = sig_offset;
 	ctx.workbuf_used = sd->workbuf_preamble_offset
 		+ sd->workbuf_preamble_size;
@@ -175,6 +197,23 @@ int vb2ex_hwcrypto_digest_finalize(uint8_t *digest,
 	return retval_hwcrypto;
 }
 
+int vb2ex_digest_multi(enum vb2_hash_algorithm hash_alg,
+		       uint32_t count,
+		       const uint8_t * const *bufs,
+		       const uint32_t *sizes,
+		       uint8_t * const *digests,
+		       uint32_t digest_size)
+{
+	mock_digest_multi_count = count;
+
+	/* Stand in for the other cores */
+	if (retval_vb2ex_digest_multi == VB2_SUCCESS)
+		return vb2_digest_multi(hash_alg, count, bufs, sizes, digests,
+					digest_size);
+
+	return retval_vb2ex_digest_multi;
+}
+
 /* Tests */
 
 static void phase3_tests(void)
@@ -307,6 +346,10 @@ static void check_hash_tests(void)
 	struct vb2_fw_preamble *pre;
 	struct vb2_signature *sig;
 	struct vb2_digest_context *dc;
+	enum vb2_hash_algorithm hash_alg;
+	uint8_t digest[VB2_SHA512_DIGEST_SIZE];
+	uint32_t digest_size;
+	int compressed;
 
 	reset_common_data(FOR_CHECK_HASH);
 	pre = (struct vb2_fw_preamble *)
@@ -315,7 +358,17 @@ static void check_hash_tests(void)
 	dc = (struct vb2_digest_context *)
 		(ctx.workbuf + sd->workbuf_hash_offset);
 
+	digest_size = sizeof(digest);
+	TEST_EQ(vb2api_get_body_digest(&ctx, &hash_alg, digest, &digest_size),
+		VB2_ERROR_API_BODY_DIGEST, "body digest before check");
+
 	TEST_SUCC(vb2api_check_hash(&ctx), "check hash good");
+	TEST_SUCC(vb2api_get_body_digest(&ctx, &hash_alg, digest,
+					 &digest_size), "  body digest");
+	TEST_EQ(hash_alg, sig->hash_alg, "  body digest alg");
+	TEST_EQ(digest_size, sig->sig_size, "  body digest size");
+	TEST_SUCC(memcmp(digest, (uint8_t *)sig + sig->sig_offset,
+			 digest_size), "  body digest matches");
 
 	reset_common_data(FOR_CHECK_HASH);
 	sd->hash_tag = 0;
@@ -341,6 +394,9 @@ static void check_hash_tests(void)
 	*((uint8_t *)sig + sig->sig_offset) ^= 0x55;
 	TEST_EQ(vb2api_check_hash(&ctx),
 		VB2_ERROR_API_CHECK_HASH_SIG, "check hash sig");
+	digest_size = sizeof(digest);
+	TEST_EQ(vb2api_get_body_digest(&ctx, &hash_alg, digest, &digest_size),
+		VB2_ERROR_API_BODY_DIGEST, "  no body digest");
 
 	if (hwcrypto_state == HWCRYPTO_ENABLED) {
 		reset_common_data(FOR_CHECK_HASH);
@@ -354,11 +410,192 @@ static void check_hash_tests(void)
 		TEST_EQ(vb2api_check_hash(&ctx),
 			VB2_ERROR_SHA_FINALIZE_ALGORITHM, "check hash finaliz");
 	}
+
+	/* Body compression */
+	reset_common_data(FOR_CHECK_HASH);
+	TEST_EQ(vb2api_get_body_compression(&ctx, &compressed),
+		VB2_ERROR_API_BODY_COMPRESSION, "compression before check");
+	TEST_SUCC(vb2api_check_hash(&ctx), "check hash uncompressed");
+	compressed = -1;
+	TEST_SUCC(vb2api_get_body_compression(&ctx, &compressed),
+		  "  get compression");
+	TEST_EQ(compressed, 0, "  not compressed");
+
+	reset_common_data(FOR_CHECK_HASH);
+	pre = (struct vb2_fw_preamble *)
+		(ctx.workbuf + sd->workbuf_preamble_offset);
+	pre->flags |= VB2_FIRMWARE_PREAMBLE_BODY_COMPRESSED;
+	TEST_SUCC(vb2api_check_hash(&ctx), "check hash compressed");
+	TEST_SUCC(vb2api_get_body_compression(&ctx, &compressed),
+		  "  get compression");
+	TEST_EQ(compressed, 1, "  compressed");
+
+	reset_common_data(FOR_CHECK_HASH);
+	pre = (struct vb2_fw_preamble *)
+		(ctx.workbuf + sd->workbuf_preamble_offset);
+	pre->flags |= VB2_FIRMWARE_PREAMBLE_BODY_COMPRESSED;
+	sig = (struct vb2_signature *)((uint8_t *)pre + pre->hash_offset);
+	*((uint8_t *)sig + sig->sig_offset) ^= 0x55;
+	TEST_EQ(vb2api_check_hash(&ctx),
+		VB2_ERROR_API_CHECK_HASH_SIG, "check hash compressed sig");
+	TEST_EQ(vb2api_get_body_compression(&ctx, &compressed),
+		VB2_ERROR_API_BODY_COMPRESSION, "  no compression");
+}
+
+static void hash_block_tests(void)
+{
+	struct vb2_fw_preamble *pre;
+	struct vb2_signature *sig;
+	uint32_t offset, size;
+	int i;
+
+	reset_common_data(FOR_HASH_BLOCKS);
+	for (i = 0; i < 3; i++) {
+		TEST_SUCC(vb2api_get_hash_block(&ctx, test_guid + 3, i,
+						&offset, &size),
+			  "get hash block");
+		TEST_EQ(offset, i * mock_block_size, "  offset");
+		TEST_EQ(size, i < 2 ? mock_block_size :
+			mock_body_size - 2 * mock_block_size, "  size");
+	}
+	TEST_EQ(vb2api_get_hash_block(&ctx, test_guid + 3, 3, &offset, &size),
+		VB2_ERROR_API_HASH_BLOCK_NUM, "get hash block past end");
+	TEST_SUCC(vb2api_get_hash_block(&ctx, test_guid + 1, 0, &offset, &size),
+		  "get hash block single hash");
+	TEST_EQ(size, mock_body_size - 16, "  size");
+	TEST_EQ(vb2api_get_hash_block(&ctx, test_guid + 1, 1, &offset, &size),
+		VB2_ERROR_API_HASH_BLOCK_NUM, "get hash block single hash end");
+
+	/* Blocks can be checked in any order */
+	TEST_SUCC(vb2api_check_hash_block(&ctx, test_guid + 3, 2,
+					  mock_body + 2 * mock_block_size,
+					  mock_body_size - 2 * mock_block_size),
+		  "check hash block 2");
+	TEST_SUCC(vb2api_check_hash_block(&ctx, test_guid + 3, 0, mock_body,
+					  mock_block_size),
+		  "check hash block 0");
+	TEST_EQ(vb2api_check_hash_block(&ctx, test_guid + 3, 1, mock_body,
+					mock_block_size),
+		VB2_ERROR_API_HASH_BLOCK_SIG, "check hash block wrong data");
+	TEST_EQ(vb2api_check_hash_block(&ctx, test_guid + 3, 1, mock_body,
+					mock_block_size - 1),
+		VB2_ERROR_API_HASH_BLOCK_SIZE, "check hash block size");
+	TEST_EQ(vb2api_check_hash_block(&ctx, test_guid + 3, 3, mock_body,
+					mock_block_size),
+		VB2_ERROR_API_HASH_BLOCK_NUM, "check hash block past end");
+
+	/* Can't hash it all at once, since that would only check block 0 */
+	TEST_EQ(vb2api_init_hash2(&ctx, test_guid + 3, &size),
+		VB2_ERROR_API_INIT_HASH_BLOCKS, "init hash blocks");
+	TEST_SUCC(vb2api_init_hash2(&ctx, test_guid + 2, &size),
+		  "init hash before blocks");
+
+	reset_common_data(FOR_HASH_BLOCKS);
+	pre = (struct vb2_fw_preamble *)
+		(ctx.workbuf + sd->workbuf_preamble_offset);
+	sig = (struct vb2_signature *)((uint8_t *)pre + pre->hash_offset +
+				       3 * mock_sig_size);
+	sig->hash_alg = VB2_HASH_INVALID;
+	TEST_EQ(vb2api_check_hash_block(&ctx, test_guid + 3, 0, mock_body,
+					mock_block_size),
+		VB2_ERROR_SHA_INIT_ALGORITHM, "check hash block algorithm");
+
+	reset_common_data(FOR_HASH_BLOCKS);
+	ctx.workbuf_used = ctx.workbuf_size - sizeof(struct vb2_digest_context);
+	TEST_EQ(vb2api_check_hash_block(&ctx, test_guid + 3, 0, mock_body,
+					mock_block_size),
+		VB2_ERROR_API_HASH_BLOCK_WORKBUF, "check hash block workbuf");
+
+	reset_common_data(FOR_HASH_BLOCKS);
+	sd->workbuf_preamble_size = 0;
+	TEST_EQ(vb2api_get_hash_block(&ctx, test_guid + 3, 0, &offset, &size),
+		VB2_ERROR_API_HASH_BLOCK_PREAMBLE, "get hash block preamble");
+	TEST_EQ(vb2api_check_hash_block(&ctx, test_guid + 3, 0, mock_body,
+					mock_block_size),
+		VB2_ERROR_API_HASH_BLOCK_PREAMBLE, "check hash block preamble");
+}
+
+static void hash_blocks_tests(void)
+{
+	struct vb2_fw_preamble *pre;
+	struct vb2_signature *sig;
+	struct vb2_guid guid = {.raw = {0x55}};
+	uint8_t body[sizeof(mock_body)];
+
+	/* On this core */
+	reset_common_data(FOR_HASH_BLOCKS);
+	TEST_SUCC(vb2api_check_hash_blocks(&ctx, test_guid + 3, mock_body,
+					   mock_body_size),
+		  "check hash blocks");
+	TEST_EQ(mock_digest_multi_count, 3, "  offered to other cores");
+
+	/* On the other cores */
+	reset_common_data(FOR_HASH_BLOCKS);
+	retval_vb2ex_digest_multi = VB2_SUCCESS;
+	TEST_SUCC(vb2api_check_hash_blocks(&ctx, test_guid + 3, mock_body,
+					   mock_body_size),
+		  "check hash blocks multi-core");
+	TEST_EQ(mock_digest_multi_count, 3, "  hashed on other cores");
+
+	reset_common_data(FOR_HASH_BLOCKS);
+	retval_vb2ex_digest_multi = VB2_ERROR_MOCK;
+	TEST_EQ(vb2api_check_hash_blocks(&ctx, test_guid + 3, mock_body,
+					 mock_body_size),
+		VB2_ERROR_MOCK, "check hash blocks other cores fail");
+
+	/* A component with a single hash is one block */
+	reset_common_data(FOR_HASH_BLOCKS);
+	TEST_SUCC(vb2api_check_hash_blocks(&ctx, test_guid + 1, mock_body,
+					   mock_body_size - 16),
+		  "check hash blocks single hash");
+	TEST_EQ(mock_digest_multi_count, 1, "  one block");
+
+	reset_common_data(FOR_HASH_BLOCKS);
+	memcpy(body, mock_body, sizeof(body));
+	body[mock_block_size + 1] ^= 0x55;
+	TEST_EQ(vb2api_check_hash_blocks(&ctx, test_guid + 3, body,
+					 mock_body_size),
+		VB2_ERROR_API_HASH_BLOCK_SIG, "check hash blocks bad data");
+
+	reset_common_data(FOR_HASH_BLOCKS);
+	TEST_EQ(vb2api_check_hash_blocks(&ctx, test_guid + 3, mock_body,
+					 mock_body_size - 1),
+		VB2_ERROR_API_HASH_BLOCK_SIZE, "check hash blocks too small");
+	TEST_EQ(vb2api_check_hash_blocks(&ctx, test_guid + 3, mock_body,
+					 mock_body_size + 1),
+		VB2_ERROR_API_HASH_BLOCK_SIZE, "check hash blocks too big");
+	TEST_EQ(vb2api_check_hash_blocks(&ctx, &guid, mock_body,
+					 mock_body_size),
+		VB2_ERROR_API_HASH_BLOCK_NUM, "check hash blocks no blocks");
+
+	reset_common_data(FOR_HASH_BLOCKS);
+	pre = (struct vb2_fw_preamble *)
+		(ctx.workbuf + sd->workbuf_preamble_offset);
+	sig = (struct vb2_signature *)((uint8_t *)pre + pre->hash_offset +
+				       3 * mock_sig_size);
+	sig->hash_alg = VB2_HASH_SHA1;
+	TEST_EQ(vb2api_check_hash_blocks(&ctx, test_guid + 3, mock_body,
+					 mock_body_size),
+		VB2_ERROR_API_HASH_BLOCKS_ALG, "check hash blocks algorithms");
+
+	reset_common_data(FOR_HASH_BLOCKS);
+	ctx.workbuf_used = ctx.workbuf_size - 16;
+	TEST_EQ(vb2api_check_hash_blocks(&ctx, test_guid + 3, mock_body,
+					 mock_body_size),
+		VB2_ERROR_API_HASH_BLOCK_WORKBUF, "check hash blocks workbuf");
+
+	reset_common_data(FOR_HASH_BLOCKS);
+	sd->workbuf_preamble_size = 0;
+	TEST_EQ(vb2api_check_hash_blocks(&ctx, test_guid + 3, mock_body,
+					 mock_body_size),
+		VB2_ERROR_API_HASH_BLOCK_PREAMBLE, "check hash blocks preamble");
 }
 
 int main(int argc, char* argv[])
 {
 	phase3_tests();
+	hash_block_tests();
+	hash_blocks_tests();
 
 	fprintf(stderr, "Running hash API tests without hwcrypto support...\n");
 	hwcrypto_state = HWCRYPTO_DISABLED;
@@ -15,6 +15,7 @@
 #include "vb2_common.h"
 #include "host_common.h"
 #include "host_key2.h"
+#include "host_keyblock2.h"
 #include "host_signature2.h"
 #include "test_common.h"
 
@@ -22,6 +23,20 @@
 static const uint8_t test_data[] = "This is some test data to sign.";
 static const uint32_t test_size = sizeof(test_data);
 
+/* Mock hardware crypto engine */
+static int hwcrypto_rsa_retval = VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+static int hwcrypto_rsa_calls;
+static const uint8_t *hwcrypto_rsa_sig;
+
+int vb2ex_hwcrypto_rsa_verify(const struct vb2_public_key *key,
+			      const uint8_t *sig,
+			      const uint8_t *digest)
+{
+	hwcrypto_rsa_calls++;
+	hwcrypto_rsa_sig = sig;
+	return hwcrypto_rsa_retval;
+}
+
 static void test_unpack_key(const struct vb2_packed_key *key)
 {
 	struct vb2_public_key pubk;
@@ -233,9 +248,352 @@ static void test_verify_data(const struct vb2_public_key *pubk_orig,
 	TEST_EQ(vb2_verify_data(test_data, test_size, sig2, &pubk, &wb),
 		VB2_ERROR_RSA_PADDING, "vb2_verify_data() wrong sig");
 
+	/* Hardware crypto engine is tried first */
+	memcpy(buf2, sig, size);
+	hwcrypto_rsa_calls = 0;
+	TEST_EQ(vb2_verify_data(test_data, test_size, sig2, &pubk, &wb),
+		0, "vb2_verify_data() hwcrypto unsupported");
+	TEST_EQ(hwcrypto_rsa_calls, 1, "  hwcrypto tried");
+	TEST_PTR_EQ(hwcrypto_rsa_sig, buf2 + sig2->sig_offset,
+		    "  hwcrypto sig");
+
+	hwcrypto_rsa_retval = VB2_SUCCESS;
+	memcpy(buf2, sig, size);
+	buf2[sig2->sig_offset] ^= 0x5A;
+	TEST_EQ(vb2_verify_data(test_data, test_size, sig2, &pubk, &wb),
+		0, "vb2_verify_data() hwcrypto good");
+
+	hwcrypto_rsa_retval = VB2_ERROR_RSA_PADDING;
+	memcpy(buf2, sig, size);
+	TEST_EQ(vb2_verify_data(test_data, test_size, sig2, &pubk, &wb),
+		VB2_ERROR_RSA_PADDING, "vb2_verify_data() hwcrypto bad");
+	hwcrypto_rsa_retval = VB2_ERROR_EX_HWCRYPTO_UNSUPPORTED;
+
 	free(buf2);
 }
 
+/**
+ * Verify a keyblock signed with several keys
+ */
+static void test_verify_keyblock_keys(const char *keys_dir)
+{
+	const struct vb2_guid guid_big = {.raw = {0xb1}};
+	const struct vb2_guid guid_small = {.raw = {0x5a}};
+	struct vb2_private_key *prik_big, *prik_small;
+	const struct vb2_private_key *priks[2];
+	struct vb2_public_key *pubk_big, *pubk_small, pubks[2];
+	struct vb2_keyblock *kb;
+	struct vb2_signature *sig_big, *sig_small;
+	uint8_t *buf2;
+	uint32_t size;
+	char filename[1024];
+
+	uint8_t workbuf[VB2_KEY_BLOCK_VERIFY_WORKBUF_BYTES]
+		 __attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	struct vb2_workbuf wb;
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+
+	sprintf(filename, "%s/key_rsa8192.pem", keys_dir);
+	TEST_SUCC(vb2_private_key_read_pem(&prik_big, filename),
+		  "Read big private key");
+	prik_big->sig_alg = VB2_SIG_RSA8192;
+	prik_big->hash_alg = VB2_HASH_SHA512;
+	prik_big->guid = guid_big;
+	sprintf(filename, "%s/key_rsa8192.keyb", keys_dir);
+	TEST_SUCC(vb2_public_key_read_keyb(&pubk_big, filename),
+		  "Read big public key");
+	pubk_big->hash_alg = VB2_HASH_SHA512;
+	pubk_big->guid = &guid_big;
+
+	sprintf(filename, "%s/key_rsa2048.pem", keys_dir);
+	TEST_SUCC(vb2_private_key_read_pem(&prik_small, filename),
+		  "Read small private key");
+	prik_small->sig_alg = VB2_SIG_RSA2048;
+	prik_small->hash_alg = VB2_HASH_SHA256;
+	prik_small->guid = guid_small;
+	sprintf(filename, "%s/key_rsa2048.keyb", keys_dir);
+	TEST_SUCC(vb2_public_key_read_keyb(&pubk_small, filename),
+		  "Read small public key");
+	pubk_small->hash_alg = VB2_HASH_SHA256;
+	pubk_small->guid = &guid_small;
+
+	/* Sign with the expensive key first, as during a key rotation */
+	priks[0] = prik_big;
+	priks[1] = prik_small;
+	TEST_SUCC(vb2_keyblock_create(&kb, pubk_small, priks, 2, 0, ""),
+		  "Create keyblock");
+	size = kb->c.total_size;
+	buf2 = malloc(size);
+	memcpy(buf2, kb, size);
+	sig_big = (struct vb2_signature *)((uint8_t *)kb + kb->sig_offset);
+	sig_small = (struct vb2_signature *)
+		((uint8_t *)sig_big + sig_big->c.total_size);
+
+	pubks[0] = *pubk_big;
+	pubks[1] = *pubk_small;
+
+	/* The cheap signature is tried first, and is enough */
+	hwcrypto_rsa_calls = 0;
+	TEST_SUCC(vb2_verify_keyblock_keys(kb, size, pubks, 2, &wb),
+		  "vb2_verify_keyblock_keys()");
+	TEST_EQ(hwcrypto_rsa_calls, 1, "  one signature checked");
+	TEST_PTR_EQ(hwcrypto_rsa_sig,
+		    (uint8_t *)sig_small + sig_small->sig_offset,
+		    "  cheapest");
+
+	/* If it fails, the next one is tried */
+	memcpy(kb, buf2, size);
+	((uint8_t *)sig_small + sig_small->sig_offset)[0] ^= 0x5a;
+	hwcrypto_rsa_calls = 0;
+	TEST_SUCC(vb2_verify_keyblock_keys(kb, size, pubks, 2, &wb),
+		  "vb2_verify_keyblock_keys() fallback");
+	TEST_EQ(hwcrypto_rsa_calls, 2, "  both signatures checked");
+	TEST_PTR_EQ(hwcrypto_rsa_sig,
+		    (uint8_t *)sig_big + sig_big->sig_offset,
+		    "  then the big one");
+
+	memcpy(kb, buf2, size);
+	((uint8_t *)sig_small + sig_small->sig_offset)[0] ^= 0x5a;
+	((uint8_t *)sig_big + sig_big->sig_offset)[0] ^= 0x5a;
+	TEST_EQ(vb2_verify_keyblock_keys(kb, size, pubks, 2, &wb),
+		VB2_ERROR_RSA_PADDING, "vb2_verify_keyblock_keys() all bad");
+
+	/* Only signatures from trusted keys are tried */
+	memcpy(kb, buf2, size);
+	hwcrypto_rsa_calls = 0;
+	TEST_SUCC(vb2_verify_keyblock_keys(kb, size, pubks, 1, &wb),
+		  "vb2_verify_keyblock_keys() big key only");
+	TEST_EQ(hwcrypto_rsa_calls, 1, "  one signature checked");
+	TEST_PTR_EQ(hwcrypto_rsa_sig,
+		    (uint8_t *)sig_big + sig_big->sig_offset,
+		    "  big one");
+
+	memcpy(kb, buf2, size);
+	TEST_EQ(vb2_verify_keyblock_keys(kb, size, pubks, 0, &wb),
+		VB2_ERROR_KEYBLOCK_SIG_GUID,
+		"vb2_verify_keyblock_keys() no keys");
+
+	/* A signature over the wrong amount of data falls through too */
+	memcpy(kb, buf2, size);
+	sig_small->data_size--;
+	TEST_SUCC(vb2_verify_keyblock_keys(kb, size, pubks, 2, &wb),
+		  "vb2_verify_keyblock_keys() small signed wrong size");
+
+	memcpy(kb, buf2, size);
+	sig_small->data_size--;
+	TEST_EQ(vb2_verify_keyblock_keys(kb, size, pubks + 1, 1, &wb),
+		VB2_ERROR_KEYBLOCK_SIGNED_SIZE,
+		"vb2_verify_keyblock_keys() only small signed wrong size");
+
+	/* Later signatures are sanity-checked even if not needed */
+	memcpy(kb, buf2, size);
+	sig_small->c.struct_version_major++;
+	TEST_EQ(vb2_verify_keyblock_keys(kb, size, pubks, 1, &wb),
+		VB2_ERROR_SIG_VERSION,
+		"vb2_verify_keyblock_keys() corrupt second sig");
+
+	free(buf2);
+	free(kb);
+	vb2_private_key_free(prik_big);
+	vb2_private_key_free(prik_small);
+	vb2_public_key_free(pubk_big);
+	vb2_public_key_free(pubk_small);
+}
+
+/**
+ * Verify a keyblock against a table of trusted keys
+ */
+static void test_verify_keyblock_table(const char *keys_dir)
+{
+	const struct vb2_guid guid_big = {.raw = {0xb1}};
+	const struct vb2_guid guid_small = {.raw = {0x5a}};
+	const struct vb2_guid guid_other = {.raw = {0x80}};
+	struct vb2_private_key *prik_big, *prik_small;
+	const struct vb2_private_key *priks[1];
+	struct vb2_public_key *pubk_big, *pubk_small, key;
+	const struct vb2_public_key *pubks[2];
+	struct vb2_key_table *table, *table2;
+	struct vb2_key_table_entry *entries, entry;
+	struct vb2_packed_key *pkey;
+	struct vb2_keyblock *kb, *kb_big;
+	uint32_t size;
+	char filename[1024];
+
+	uint8_t workbuf[VB2_KEY_BLOCK_VERIFY_WORKBUF_BYTES]
+		 __attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	struct vb2_workbuf wb;
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+
+	sprintf(filename, "%s/key_rsa8192.pem", keys_dir);
+	TEST_SUCC(vb2_private_key_read_pem(&prik_big, filename),
+		  "Read big private key");
+	prik_big->sig_alg = VB2_SIG_RSA8192;
+	prik_big->hash_alg = VB2_HASH_SHA512;
+	prik_big->guid = guid_big;
+	sprintf(filename, "%s/key_rsa8192.keyb", keys_dir);
+	TEST_SUCC(vb2_public_key_read_keyb(&pubk_big, filename),
+		  "Read big public key");
+	pubk_big->hash_alg = VB2_HASH_SHA512;
+	pubk_big->guid = &guid_big;
+
+	sprintf(filename, "%s/key_rsa2048.pem", keys_dir);
+	TEST_SUCC(vb2_private_key_read_pem(&prik_small, filename),
+		  "Read small private key");
+	prik_small->sig_alg = VB2_SIG_RSA2048;
+	prik_small->hash_alg = VB2_HASH_SHA256;
+	prik_small->guid = guid_small;
+	sprintf(filename, "%s/key_rsa2048.keyb", keys_dir);
+	TEST_SUCC(vb2_public_key_read_keyb(&pubk_small, filename),
+		  "Read small public key");
+	pubk_small->hash_alg = VB2_HASH_SHA256;
+	pubk_small->guid = &guid_small;
+
+	/* Keys are sorted by GUID, whatever order they're given in */
+	pubks[0] = pubk_big;
+	pubks[1] = pubk_small;
+	TEST_SUCC(vb2_key_table_create(&table, pubks, 2, "trusted"),
+		  "Create key table");
+	size = table->c.total_size;
+	TEST_SUCC(vb2_verify_key_table(table, size), "vb2_verify_key_table()");
+	TEST_EQ(table->key_count, 2, "  key_count");
+	entries = (struct vb2_key_table_entry *)
+		((uint8_t *)table + table->entry_offset);
+	TEST_EQ(memcmp(&entries[0].guid, &guid_small, sizeof(guid_small)), 0,
+		"  small first");
+	TEST_EQ(memcmp(&entries[1].guid, &guid_big, sizeof(guid_big)), 0,
+		"  big second");
+
+	TEST_SUCC(vb2_key_table_find(&key, table, &guid_big),
+		  "vb2_key_table_find() big");
+	TEST_EQ(key.sig_alg, VB2_SIG_RSA8192, "  sig_alg");
+	TEST_SUCC(vb2_key_table_find(&key, table, &guid_small),
+		  "vb2_key_table_find() small");
+	TEST_EQ(key.sig_alg, VB2_SIG_RSA2048, "  sig_alg");
+	TEST_EQ(vb2_key_table_find(&key, table, &guid_other),
+		VB2_ERROR_KEY_TABLE_NOT_FOUND, "vb2_key_table_find() missing");
+
+	pubks[1] = pubk_big;
+	TEST_EQ(vb2_key_table_create(&table2, pubks, 2, NULL),
+		VB2_ERROR_KEY_TABLE_CREATE_DUPLICATE,
+		"Create key table duplicate GUID");
+	TEST_PTR_EQ(table2, NULL, "  table_ptr");
+
+	/* Each keyblock goes straight to the key it was signed with */
+	priks[0] = prik_small;
+	TEST_SUCC(vb2_keyblock_create(&kb, pubk_small, priks, 1, 0, ""),
+		  "Create small keyblock");
+	priks[0] = prik_big;
+	TEST_SUCC(vb2_keyblock_create(&kb_big, pubk_small, priks, 1, 0, ""),
+		  "Create big keyblock");
+
+	hwcrypto_rsa_calls = 0;
+	TEST_SUCC(vb2_verify_keyblock_table(kb, kb->c.total_size, table, &wb),
+		  "vb2_verify_keyblock_table() small");
+	TEST_EQ(hwcrypto_rsa_calls, 1, "  one signature checked");
+	TEST_SUCC(vb2_verify_keyblock_table(kb_big, kb_big->c.total_size,
+					    table, &wb),
+		  "vb2_verify_keyblock_table() big");
+
+	((struct vb2_signature *)((uint8_t *)kb + kb->sig_offset))->guid =
+		guid_other;
+	TEST_EQ(vb2_verify_keyblock_table(kb, kb->c.total_size, table, &wb),
+		VB2_ERROR_KEYBLOCK_SIG_GUID,
+		"vb2_verify_keyblock_table() untrusted key");
+
+	/* Corrupt tables */
+	table2 = malloc(size);
+
+	memcpy(table2, table, size);
+	table2->c.magic = VB2_MAGIC_PACKED_KEY;
+	TEST_EQ(vb2_verify_key_table(table2, size), VB2_ERROR_KEY_TABLE_MAGIC,
+		"vb2_verify_key_table() magic");
+
+	memcpy(table2, table, size);
+	TEST_EQ(vb2_verify_key_table(table2, size - 4),
+		VB2_ERROR_COMMON_TOTAL_SIZE, "vb2_verify_key_table() size");
+
+	memcpy(table2, table, size);
+	table2->c.struct_version_major++;
+	TEST_EQ(vb2_verify_key_table(table2, size),
+		VB2_ERROR_KEY_TABLE_HEADER_VERSION,
+		"vb2_verify_key_table() major version");
+
+	memcpy(table2, table, size);
+	table2->c.struct_version_minor++;
+	TEST_SUCC(vb2_verify_key_table(table2, size),
+		  "vb2_verify_key_table() minor version");
+
+	memcpy(table2, table, size);
+	table2->c.fixed_size -= 4;
+	table2->c.desc_size += 4;
+	TEST_EQ(vb2_verify_key_table(table2, size), VB2_ERROR_KEY_TABLE_SIZE,
+		"vb2_verify_key_table() header size");
+
+	memcpy(table2, table, size);
+	table2->key_count = 0x40000000;
+	TEST_EQ(vb2_verify_key_table(table2, size),
+		VB2_ERROR_KEY_TABLE_ENTRIES,
+		"vb2_verify_key_table() key count overflow");
+
+	memcpy(table2, table, size);
+	table2->entry_offset = size - 4;
+	TEST_EQ(vb2_verify_key_table(table2, size),
+		VB2_ERROR_KEY_TABLE_ENTRIES,
+		"vb2_verify_key_table() entries outside");
+
+	memcpy(table2, table, size);
+	entries = (struct vb2_key_table_entry *)
+		((uint8_t *)table2 + table2->entry_offset);
+	entry = entries[0];
+	entries[0] = entries[1];
+	entries[1] = entry;
+	TEST_EQ(vb2_verify_key_table(table2, size), VB2_ERROR_KEY_TABLE_ORDER,
+		"vb2_verify_key_table() unsorted");
+
+	memcpy(table2, table, size);
+	entries[1].guid = entries[0].guid;
+	TEST_EQ(vb2_verify_key_table(table2, size), VB2_ERROR_KEY_TABLE_ORDER,
+		"vb2_verify_key_table() duplicate");
+
+	memcpy(table2, table, size);
+	entries[0].key_offset = size - 4;
+	TEST_EQ(vb2_key_table_find(&key, table2, &guid_small),
+		VB2_ERROR_KEY_TABLE_KEY_OUTSIDE,
+		"vb2_key_table_find() key outside");
+
+	/* An entry can't vouch for a key with a different GUID */
+	memcpy(table2, table, size);
+	entries[0].key_offset = entries[1].key_offset;
+	TEST_EQ(vb2_key_table_find(&key, table2, &guid_small),
+		VB2_ERROR_KEY_TABLE_KEY_GUID,
+		"vb2_key_table_find() wrong key");
+
+	memcpy(table2, table, size);
+	pkey = (struct vb2_packed_key *)
+		((uint8_t *)table2 + entries[0].key_offset);
+	pkey->c.magic = VB2_MAGIC_SIGNATURE;
+	TEST_EQ(vb2_key_table_find(&key, table2, &guid_small),
+		VB2_ERROR_UNPACK_KEY_MAGIC, "vb2_key_table_find() bad key");
+	priks[0] = prik_small;
+	free(kb);
+	TEST_SUCC(vb2_keyblock_create(&kb, pubk_small, priks, 1, 0, ""),
+		  "Create small keyblock again");
+	TEST_EQ(vb2_verify_keyblock_table(kb, kb->c.total_size, table2, &wb),
+		VB2_ERROR_UNPACK_KEY_MAGIC,
+		"vb2_verify_keyblock_table() bad key");
+
+	free(table2);
+	free(table);
+	free(kb);
+	free(kb_big);
+	vb2_private_key_free(prik_big);
+	vb2_private_key_free(prik_small);
+	vb2_public_key_free(pubk_big);
+	vb2_public_key_free(pubk_small);
+}
+
 int test_algorithm(int key_algorithm, const char *keys_dir)
 {
 	char filename[1024];
@@ -298,6 +656,8 @@ int main(int argc, char *argv[]) {
 			if (test_algorithm(key_algs[i], argv[1]))
 				return 1;
 		}
+		test_verify_keyblock_keys(argv[1]);
+		test_verify_keyblock_table(argv[1]);
 
 	} else if (argc == 3 && !strcasecmp(argv[2], "--all")) {
 		/* Test all the algorithms */
@@ -210,6 +210,8 @@ static void test_sig_size(void)
 		VB2_SHA256_DIGEST_SIZE, "vb2_sig_size() SHA256");
 	TEST_EQ(vb2_sig_size(VB2_SIG_NONE, VB2_HASH_SHA512),
 		VB2_SHA512_DIGEST_SIZE, "vb2_sig_size() SHA512");
+	TEST_EQ(vb2_sig_size(VB2_SIG_NONE, VB2_HASH_BLAKE2S),
+		VB2_BLAKE2S_DIGEST_SIZE, "vb2_sig_size() BLAKE2s");
 }
 
 /**
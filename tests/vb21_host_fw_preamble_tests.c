@@ -32,6 +32,9 @@ static void preamble_tests(const char *keys_dir)
 	struct vb2_fw_preamble *fp;
 	const struct vb2_private_key *prikhash;
 	struct vb2_signature *hashes[3];
+	struct vb2_signature **blocks;
+	uint32_t block_count;
+	const struct vb2_guid test_guid = {.raw = {0x55}};
 	char fname[1024];
 	const char test_desc[] = "Test fw preamble";
 	const uint32_t test_version = 2061;
@@ -106,6 +109,41 @@ static void preamble_tests(const char *keys_dir)
 		"Create preamble bad sig");
 	TEST_PTR_EQ(fp, NULL, "  fp_ptr");
 
+	/* Test hashing in blocks */
+	prik4096->hash_alg = VB2_HASH_SHA256;
+	TEST_SUCC(vb2_fw_preamble_hash_blocks(&blocks, &block_count,
+					      test_data3, sizeof(test_data3),
+					      8, VB2_HASH_SHA256, &test_guid),
+		  "Hash blocks");
+	TEST_EQ(block_count, 3, "  block_count");
+	for (i = 0; i < block_count; i++) {
+		TEST_EQ(blocks[i]->data_size, i < 2 ? 8 :
+			sizeof(test_data3) - 16, "  block data_size");
+		TEST_EQ(memcmp(&blocks[i]->guid, &test_guid,
+			       sizeof(test_guid)), 0, "  block guid");
+		TEST_EQ(blocks[i]->c.desc_size, 0, "  block desc");
+	}
+	TEST_SUCC(vb2_fw_preamble_create(&fp, prik4096,
+					 (const struct vb2_signature **)blocks,
+					 block_count, test_version, test_flags,
+					 test_desc),
+		  "Create preamble with blocks");
+	TEST_SUCC(vb2_verify_fw_preamble(fp, fp->c.total_size, pubk4096, &wb),
+		  "Verify preamble with blocks");
+	free(fp);
+	vb2_fw_preamble_free_hash_blocks(blocks, block_count);
+
+	TEST_EQ(vb2_fw_preamble_hash_blocks(&blocks, &block_count,
+					    test_data3, sizeof(test_data3),
+					    0, VB2_HASH_SHA256, &test_guid),
+		VB2_FW_PREAMBLE_HASH_BLOCKS_SIZE, "Hash blocks size 0");
+	TEST_PTR_EQ(blocks, NULL, "  blocks");
+	TEST_EQ(vb2_fw_preamble_hash_blocks(&blocks, &block_count,
+					    test_data3, sizeof(test_data3),
+					    8, VB2_HASH_INVALID, &test_guid),
+		VB2_FW_PREAMBLE_HASH_BLOCKS_HASH, "Hash blocks bad hash");
+	TEST_EQ(block_count, 0, "  block_count");
+
 	/* Free keys */
 	vb2_public_key_free(pubk4096);
 	vb2_private_key_free(prik4096);
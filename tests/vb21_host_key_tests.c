@@ -165,6 +165,68 @@ static void private_key_tests(const struct alg_combo *combo,
 	unlink(testfile);
 }
 
+static void private_key_store_tests(const struct alg_combo *combo,
+				    const char *pemfile)
+{
+	struct vb2_private_key_store *store;
+	struct vb2_private_key *key;
+	const struct vb2_private_key *ckey, *ckey2;
+	const char *testfile = "test.vbprik2";
+	const char *hashfile = "test_hash.vbprik2";
+	const struct vb2_guid test_guid = {.raw = {0xbb}};
+
+	TEST_SUCC(vb2_private_key_store_create(&store), "Create key store");
+	TEST_PTR_NEQ(store, NULL, "  store_ptr");
+
+	TEST_SUCC(vb2_private_key_store_read_pem(store, &ckey, pemfile,
+						 combo->hash_alg),
+		  "Store read pem");
+	TEST_PTR_NEQ(ckey, NULL, "  key_ptr");
+	TEST_EQ(ckey->sig_alg, combo->sig_alg, "  sig_alg");
+	TEST_EQ(ckey->hash_alg, combo->hash_alg, "  hash_alg");
+	TEST_SUCC(vb2_private_key_store_read_pem(store, &ckey2, pemfile,
+						 combo->hash_alg),
+		  "Store read pem again");
+	TEST_PTR_EQ(ckey2, ckey, "  same key");
+	TEST_SUCC(vb2_private_key_store_read_pem(store, &ckey2, pemfile,
+						 VB2_HASH_SHA1),
+		  "Store read pem other hash");
+	TEST_PTR_NEQ(ckey2, ckey, "  other key");
+	TEST_EQ(ckey2->hash_alg, VB2_HASH_SHA1, "  hash_alg");
+	TEST_EQ(vb2_private_key_store_read_pem(store, &ckey2, "no_such_key",
+					       combo->hash_alg),
+		VB2_ERROR_READ_PEM_FILE_OPEN, "Store read pem - no key");
+	TEST_PTR_EQ(ckey2, NULL, "  key_ptr");
+
+	/* Packed keys too, including bare hash keys */
+	TEST_SUCC(vb2_private_key_read_pem(&key, pemfile), "Read pem");
+	key->hash_alg = combo->hash_alg;
+	key->sig_alg = combo->sig_alg;
+	key->guid = test_guid;
+	TEST_SUCC(vb2_private_key_write(key, testfile), "Write key");
+	vb2_private_key_free(key);
+	TEST_SUCC(vb2_private_key_hash(&ckey, combo->hash_alg), "Hash key");
+	TEST_SUCC(vb2_private_key_write(ckey, hashfile), "Write hash key");
+
+	TEST_SUCC(vb2_private_key_store_read(store, &ckey, testfile),
+		  "Store read key");
+	TEST_EQ(memcmp(&ckey->guid, &test_guid, sizeof(test_guid)), 0,
+		"  guid");
+	TEST_SUCC(vb2_private_key_store_read(store, &ckey2, testfile),
+		  "Store read key again");
+	TEST_PTR_EQ(ckey2, ckey, "  same key");
+	TEST_SUCC(vb2_private_key_store_read(store, &ckey2, hashfile),
+		  "Store read hash key");
+	TEST_EQ(ckey2->sig_alg, VB2_SIG_NONE, "  sig_alg");
+	TEST_EQ(vb2_private_key_store_read(store, &ckey2, "no_such_key"),
+		VB2_ERROR_READ_FILE_OPEN, "Store read key - no key");
+
+	unlink(testfile);
+	unlink(hashfile);
+	vb2_private_key_store_free(store);
+	vb2_private_key_store_free(NULL);
+}
+
 static void public_key_tests(const struct alg_combo *combo,
 			     const char *keybfile)
 {
@@ -276,6 +338,77 @@ static void public_key_tests(const struct alg_combo *combo,
 	free(pkey);
 }
 
+static void ed25519_key_tests(const char *keys_dir)
+{
+	struct vb2_private_key *key, *k2;
+	const struct vb2_private_key *ckey;
+	struct vb2_private_key_store *store;
+	struct vb2_packed_private_key *pkey;
+	struct vb2_public_key *pubk, k3;
+	struct vb2_packed_key *packed;
+	const char *testfile = "test.vbprik2";
+	const struct vb2_guid test_guid = {.raw = {0xcc}};
+	char pemfile[1024];
+	uint8_t *buf;
+	uint32_t bufsize;
+
+	printf("***Testing Ed25519 keys\n");
+
+	sprintf(pemfile, "%s/key_ed25519.pem", keys_dir);
+
+	TEST_SUCC(vb2_private_key_read_pem(&key, pemfile), "Read Ed25519 pem");
+	TEST_PTR_EQ(key->rsa_private_key, NULL, "  rsa_private_key");
+	TEST_EQ(key->sig_alg, VB2_SIG_ED25519, "  sig_alg");
+	key->hash_alg = VB2_HASH_SHA512;
+	key->guid = test_guid;
+
+	TEST_SUCC(vb2_private_key_write(key, testfile), "Write Ed25519 key");
+	TEST_SUCC(vb2_private_key_read(&k2, testfile), "Read Ed25519 key");
+	TEST_EQ(k2->sig_alg, VB2_SIG_ED25519, "  sig_alg");
+	TEST_EQ(memcmp(k2->ed25519_key, key->ed25519_key,
+		       sizeof(key->ed25519_key)), 0, "  same key");
+	vb2_private_key_free(k2);
+
+	TEST_SUCC(vb2_read_file(testfile, &buf, &bufsize), "Read key raw");
+	pkey = (struct vb2_packed_private_key *)buf;
+	TEST_EQ(pkey->key_size, 32, "  only the seed");
+	pkey->key_size -= 4;
+	TEST_EQ(vb2_private_key_unpack(&k2, buf, bufsize),
+		VB2_ERROR_UNPACK_PRIVATE_KEY_ED25519,
+		"Unpack private key bad Ed25519 seed");
+	free(buf);
+	unlink(testfile);
+
+	TEST_SUCC(vb2_private_key_store_create(&store), "Create key store");
+	TEST_SUCC(vb2_private_key_store_read_pem(store, &ckey, pemfile,
+						 VB2_HASH_SHA256),
+		  "Store read Ed25519 pem");
+	TEST_EQ(ckey->sig_alg, VB2_SIG_ED25519, "  sig_alg");
+	TEST_EQ(ckey->hash_alg, VB2_HASH_SHA256, "  hash_alg");
+	vb2_private_key_store_free(store);
+
+	TEST_SUCC(vb2_public_key_from_ed25519(&pubk, key),
+		  "Ed25519 public key");
+	TEST_EQ(pubk->sig_alg, VB2_SIG_ED25519, "  sig_alg");
+	pubk->hash_alg = VB2_HASH_SHA512;
+	pubk->guid = &test_guid;
+	TEST_SUCC(vb2_public_key_pack(&packed, pubk), "Pack Ed25519 key");
+	TEST_EQ(packed->key_size, VB2_ED25519_PUBLIC_KEY_SIZE, "  key_size");
+	TEST_SUCC(vb2_unpack_key(&k3, (uint8_t *)packed,
+				 packed->c.total_size),
+		  "Unpack Ed25519 key");
+	TEST_EQ(memcmp(k3.ed25519_key, key->ed25519_key + 32,
+		       VB2_ED25519_PUBLIC_KEY_SIZE), 0, "  same key");
+	free(packed);
+	vb2_public_key_free(pubk);
+
+	key->sig_alg = VB2_SIG_RSA2048;
+	TEST_EQ(vb2_public_key_from_ed25519(&pubk, key),
+		VB2_ERROR_PUBLIC_KEY_ED25519, "Ed25519 public key not Ed25519");
+	TEST_PTR_EQ(pubk, NULL, "  key_ptr");
+	vb2_private_key_free(key);
+}
+
 static int test_algorithm(const struct alg_combo *combo, const char *keys_dir)
 {
 	int rsa_bits = vb2_rsa_sig_size(combo->sig_alg) * 8;
@@ -288,6 +421,7 @@ static int test_algorithm(const struct alg_combo *combo, const char *keys_dir)
 	sprintf(keybfile, "%s/key_rsa%d.keyb", keys_dir, rsa_bits);
 
 	private_key_tests(combo, pemfile);
+	private_key_store_tests(combo, pemfile);
 	public_key_tests(combo, keybfile);
 
 	return 0;
@@ -302,6 +436,7 @@ int main(int argc, char *argv[]) {
 			if (test_algorithm(test_algs + i, argv[1]))
 				return 1;
 		}
+		ed25519_key_tests(argv[1]);
 	} else {
 		fprintf(stderr, "Usage: %s <keys_dir>", argv[0]);
 		return -1;
@@ -5,6 +5,7 @@
  * Tests for host misc library vboot2 functions
  */
 
+#include <stdio.h>
 #include <unistd.h>
 
 #include "2sysincludes.h"
@@ -68,10 +69,66 @@ static void file_tests(void)
 	unlink(testfile);
 }
 
+static void map_tests(void)
+{
+	const char *testfile = "map_tests.dat";
+	const uint8_t test_data[] = "Some test data";
+	uint8_t *map_data;
+	uint32_t map_size;
+	uint8_t *read_data;
+	uint32_t read_size;
+
+	unlink(testfile);
+
+	TEST_EQ(vb2_map_file(testfile, VB2_MAP_RO, &map_data, &map_size),
+		VB2_ERROR_MAP_FILE_OPEN, "vb2_map_file() missing");
+	TEST_PTR_EQ(map_data, NULL, "  no data");
+	TEST_EQ(map_size, 0, "  no size");
+
+	TEST_SUCC(vb2_write_file(testfile, test_data, sizeof(test_data)),
+		  "vb2_write_file() good");
+	TEST_SUCC(vb2_map_file(testfile, VB2_MAP_RO, &map_data, &map_size),
+		  "vb2_map_file() read-only");
+	TEST_EQ(map_size, sizeof(test_data), "  data size");
+	TEST_EQ(memcmp(map_data, test_data, map_size), 0, "  data");
+	TEST_SUCC(vb2_unmap_file(map_data, map_size, VB2_MAP_RO), "  unmap");
+
+	/* Private changes don't reach the file */
+	TEST_SUCC(vb2_map_file(testfile, VB2_MAP_COW, &map_data, &map_size),
+		  "vb2_map_file() copy-on-write");
+	map_data[0] = 'X';
+	TEST_SUCC(vb2_unmap_file(map_data, map_size, VB2_MAP_COW), "  unmap");
+	TEST_SUCC(vb2_read_file(testfile, &read_data, &read_size), "  read");
+	TEST_EQ(memcmp(read_data, test_data, read_size), 0, "  unchanged");
+	free(read_data);
+
+	/* Shared changes do */
+	TEST_SUCC(vb2_map_file(testfile, VB2_MAP_RW, &map_data, &map_size),
+		  "vb2_map_file() read-write");
+	map_data[0] = 'X';
+	TEST_SUCC(vb2_unmap_file(map_data, map_size, VB2_MAP_RW), "  unmap");
+	TEST_SUCC(vb2_read_file(testfile, &read_data, &read_size), "  read");
+	TEST_EQ(read_data[0], 'X', "  changed");
+	TEST_EQ(memcmp(read_data + 1, test_data + 1, read_size - 1), 0,
+		"  rest unchanged");
+	free(read_data);
+	unlink(testfile);
+
+	/* Empty files can't really be mapped, but still work */
+	fclose(fopen(testfile, "wb"));
+	TEST_SUCC(vb2_map_file(testfile, VB2_MAP_RO, &map_data, &map_size),
+		  "vb2_map_file() empty");
+	TEST_PTR_NEQ(map_data, NULL, "  data");
+	TEST_EQ(map_size, 0, "  size");
+	TEST_SUCC(vb2_unmap_file(map_data, map_size, VB2_MAP_RO), "  unmap");
+	unlink(testfile);
+}
+
 int main(int argc, char* argv[])
 {
 	misc_tests();
 	file_tests();
+	map_tests();
 
 	return gTestSuccess ? 0 : 255;
 }
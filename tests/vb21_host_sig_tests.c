@@ -28,6 +28,8 @@ static const struct alg_combo test_algs[] = {
 	{"RSA2048/SHA-256", VB2_SIG_RSA2048, VB2_HASH_SHA256},
 	{"RSA4096/SHA-256", VB2_SIG_RSA4096, VB2_HASH_SHA256},
 	{"RSA8192/SHA-512", VB2_SIG_RSA8192, VB2_HASH_SHA512},
+	{"RSA4096/BLAKE2s", VB2_SIG_RSA4096, VB2_HASH_BLAKE2S},
+	{"Ed25519/SHA-512", VB2_SIG_ED25519, VB2_HASH_SHA512},
 };
 
 const struct vb2_guid test_guid = {.raw = {0xaa}};
@@ -41,10 +43,14 @@ static void sig_tests(const struct alg_combo *combo,
 		      const char *keybfile)
 {
 	struct vb2_private_key *prik, prik2;
-	const struct vb2_private_key *prihash, *priks[2];
+	const struct vb2_private_key *prihash, *priks[2], *priks3[3];
 	struct vb2_public_key *pubk, pubhash;
+	const struct vb2_public_key *pubks[2];
 	struct vb2_signature *sig, *sig2;
-	uint32_t size;
+	struct vb2_sign_context sc;
+	uint32_t size, sig_size2, sig_next;
+	int i;
+	int results[2];
 
 	uint8_t workbuf[VB2_VERIFY_DATA_WORKBUF_BYTES]
 		 __attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
@@ -65,7 +71,12 @@ static void sig_tests(const struct alg_combo *combo,
 	prik->sig_alg = combo->sig_alg;
 	vb2_private_key_set_desc(prik, test_desc);
 
-	TEST_SUCC(vb2_public_key_read_keyb(&pubk, keybfile), "Read pub key");
+	if (combo->sig_alg == VB2_SIG_ED25519)
+		TEST_SUCC(vb2_public_key_from_ed25519(&pubk, prik),
+			  "Read pub key");
+	else
+		TEST_SUCC(vb2_public_key_read_keyb(&pubk, keybfile),
+			  "Read pub key");
 	pubk->guid = &test_guid;
 	pubk->hash_alg = combo->hash_alg;
 	vb2_public_key_set_desc(pubk, test_desc);
@@ -115,6 +126,27 @@ static void sig_tests(const struct alg_combo *combo,
 	TEST_EQ(vb2_sign_data(&sig, test_data, test_size, &prik2, NULL),
 		VB2_SIGN_DATA_SIG_SIZE, "Sign bad sig alg");
 
+	/* Sign test data in pieces */
+	TEST_SUCC(vb2_sign_data(&sig, test_data, test_size, prik, NULL),
+		  "Sign whole");
+	TEST_SUCC(vb2_sign_init(&sc, prik), "Sign init");
+	TEST_SUCC(vb2_sign_extend(&sc, test_data, 5), "Sign extend");
+	TEST_SUCC(vb2_sign_extend(&sc, test_data + 5, test_size - 5),
+		  "Sign extend again");
+	TEST_SUCC(vb2_sign_finalize(&sc, &sig2, NULL), "Sign finalize");
+	TEST_EQ(sig2->data_size, test_size, "  data_size");
+	TEST_EQ(sig2->c.total_size, sig->c.total_size, "  size");
+	TEST_EQ(memcmp(sig2, sig, sig->c.total_size), 0, "  same as whole");
+	TEST_SUCC(vb2_verify_data(test_data, test_size, sig2, pubk, &wb),
+		  "  verify");
+	free(sig);
+	free(sig2);
+
+	TEST_SUCC(vb2_sign_init(&sc, &prik2), "Sign init bad sig alg");
+	TEST_EQ(vb2_sign_finalize(&sc, &sig, NULL),
+		VB2_SIGN_DATA_SIG_SIZE, "  finalize");
+	TEST_PTR_EQ(sig, NULL, "  sig_ptr");
+
 	/* Sign an object with a little (24 bytes) data */
 	c_sig_offs = sizeof(*c) + 24;
 	TEST_SUCC(vb2_sig_size_for_key(&size, prik, NULL), "Sig size");
@@ -156,6 +188,98 @@ static void sig_tests(const struct alg_combo *combo,
 
 	TEST_EQ(size, sig->c.total_size + sig2->c.total_size,
 		"Sigs size total");
+	sig_size2 = size;
+
+	/* Verify all the signatures on it */
+	c->total_size += 4;
+	TEST_SUCC(vb2_sign_object_multiple(buf, c_sig_offs, priks, 2),
+		  "Sign multiple again");
+	pubks[0] = pubk;
+	pubks[1] = &pubhash;
+	results[0] = results[1] = -1;
+	TEST_SUCC(vb2_verify_object_multiple(buf, c_sig_offs, 2, pubks, 2,
+					     results),
+		  "Verify multiple");
+	TEST_EQ(results[0], 0, "  sig 1");
+	TEST_EQ(results[1], 0, "  sig 2");
+	TEST_SUCC(vb2_verify_data(buf, c_sig_offs, sig, pubk, &wb),
+		  "  object untouched");
+
+	TEST_SUCC(vb2_sign_object_multiple(buf, c_sig_offs, priks, 2),
+		  "Sign multiple again");
+	TEST_SUCC(vb2_verify_object_multiple(buf, c_sig_offs, 2, pubks + 1, 1,
+					     results),
+		  "Verify multiple one key");
+	TEST_EQ(results[0], VB2_VERIFY_OBJECT_NO_KEY, "  sig 1 no key");
+	TEST_EQ(results[1], 0, "  sig 2");
+
+	TEST_EQ(vb2_verify_object_multiple(buf, c_sig_offs, 2, pubks, 0, NULL),
+		VB2_VERIFY_OBJECT_NO_KEY, "Verify multiple no keys");
+
+	free(buf);
+
+	/* Sign with keys of several hashes; same as signing one at a time */
+	priks3[0] = prik;
+	priks3[1] = prihash;
+	TEST_SUCC(vb2_private_key_hash(&priks3[2], VB2_HASH_SHA1),
+		  "Private SHA-1 hash key");
+	TEST_SUCC(vb2_sig_size_for_keys(&size, priks3, 3), "Sigs size");
+	bufsize = c_sig_offs + size;
+	buf = calloc(1, bufsize);
+	memset(buf + sizeof(*c), 0x34, 24);
+	c = (struct vb2_struct_common *)buf;
+	c->total_size = bufsize;
+	TEST_SUCC(vb2_sign_object_multiple(buf, c_sig_offs, priks3, 3),
+		  "Sign multiple hashes");
+	sig_next = c_sig_offs;
+	for (i = 0; i < 3; i++) {
+		sig = (struct vb2_signature *)(buf + sig_next);
+		TEST_SUCC(vb2_sign_data(&sig2, buf, c_sig_offs, priks3[i],
+					NULL), "  sign alone");
+		TEST_EQ(memcmp(sig, sig2, sig2->c.total_size), 0,
+			"  same signature");
+		sig_next += sig2->c.total_size;
+		free(sig2);
+	}
+
+	prik2 = *prik;
+	prik2.sig_alg = VB2_SIG_INVALID;
+	priks3[2] = &prik2;
+	TEST_EQ(vb2_sign_object_multiple(buf, c_sig_offs, priks3, 3),
+		VB2_SIGN_DATA_SIG_SIZE, "Sign multiple bad key");
+	TEST_SUCC(vb2_sign_object_multiple(buf, c_sig_offs, priks3, 0),
+		  "Sign multiple no keys");
+	free(buf);
+
+	/* Back to the doubly signed object */
+	bufsize = c_sig_offs + sig_size2;
+	buf = calloc(1, bufsize);
+	memset(buf + sizeof(*c), 0x12, 24);
+	c = (struct vb2_struct_common *)buf;
+	c->total_size = bufsize;
+	TEST_SUCC(vb2_sign_object_multiple(buf, c_sig_offs, priks, 2),
+		  "Sign multiple again");
+	sig = (struct vb2_signature *)(buf + c_sig_offs);
+	sig2 = (struct vb2_signature *)(buf + c_sig_offs + sig->c.total_size);
+
+	((uint8_t *)sig2 + sig2->sig_offset)[0] ^= 0x5a;
+	TEST_SUCC(vb2_verify_object_multiple(buf, c_sig_offs, 2, pubks, 2,
+					     results),
+		  "Verify multiple one bad");
+	TEST_EQ(results[0], 0, "  sig 1");
+	TEST_EQ(results[1], VB2_ERROR_VDATA_VERIFY_DIGEST, "  sig 2 bad");
+
+	((uint8_t *)sig + sig->sig_offset)[0] ^= 0x5a;
+	TEST_EQ(vb2_verify_object_multiple(buf, c_sig_offs, 2, pubks, 2,
+					   results),
+		combo->sig_alg == VB2_SIG_ED25519 ? VB2_ERROR_ED25519_VERIFY :
+		VB2_ERROR_RSA_PADDING, "Verify multiple all bad");
+	TEST_EQ(results[1], VB2_ERROR_VDATA_VERIFY_DIGEST, "  sig 2 bad");
+
+	sig2->c.struct_version_major++;
+	TEST_EQ(vb2_verify_object_multiple(buf, c_sig_offs, 2, pubks, 2,
+					   results),
+		VB2_ERROR_SIG_VERSION, "Verify multiple bad header");
 
 	free(buf);
 
@@ -163,6 +287,44 @@ static void sig_tests(const struct alg_combo *combo,
 	vb2_public_key_free(pubk);
 }
 
+/* RFC 8032 section 7.1, test 2 */
+static void ed25519_sign_tests(void)
+{
+	static const uint8_t seed[32] = {
+		0x4c, 0xcd, 0x08, 0x9b, 0x28, 0xff, 0x96, 0xda,
+		0x9d, 0xb6, 0xc3, 0x46, 0xec, 0x11, 0x4e, 0x0f,
+		0x5b, 0x8a, 0x31, 0x9f, 0x35, 0xab, 0xa6, 0x24,
+		0xda, 0x8c, 0xf6, 0xed, 0x4f, 0xb8, 0xa6, 0xfb,
+	};
+	static const uint8_t pk[32] = {
+		0x3d, 0x40, 0x17, 0xc3, 0xe8, 0x43, 0x89, 0x5a,
+		0x92, 0xb7, 0x0a, 0xa7, 0x4d, 0x1b, 0x7e, 0xbc,
+		0x9c, 0x98, 0x2c, 0xcf, 0x2e, 0xc4, 0x96, 0x8c,
+		0xc0, 0xcd, 0x55, 0xf1, 0x2a, 0xf4, 0x66, 0x0c,
+	};
+	static const uint8_t expect_sig[64] = {
+		0x92, 0xa0, 0x09, 0xa9, 0xf0, 0xd4, 0xca, 0xb8,
+		0x72, 0x0e, 0x82, 0x0b, 0x5f, 0x64, 0x25, 0x40,
+		0xa2, 0xb2, 0x7b, 0x54, 0x16, 0x50, 0x3f, 0x8f,
+		0xb3, 0x76, 0x22, 0x23, 0xeb, 0xdb, 0x69, 0xda,
+		0x08, 0x5a, 0xc1, 0xe4, 0x3e, 0x15, 0x99, 0x6e,
+		0x45, 0x8f, 0x36, 0x13, 0xd0, 0xf1, 0x1d, 0x8c,
+		0x38, 0x7b, 0x2e, 0xae, 0xb4, 0x30, 0x2a, 0xee,
+		0xb0, 0x0d, 0x29, 0x16, 0x12, 0xbb, 0x0c, 0x00,
+	};
+	const uint8_t msg[] = {0x72};
+	uint8_t key[64];
+	uint8_t sig[64];
+
+	memcpy(key, seed, sizeof(seed));
+	vb2_ed25519_keypair(key);
+	TEST_EQ(memcmp(key, seed, sizeof(seed)), 0, "Ed25519 keypair seed");
+	TEST_EQ(memcmp(key + 32, pk, sizeof(pk)), 0, "  public key");
+
+	vb2_ed25519_sign(sig, key, msg, sizeof(msg));
+	TEST_EQ(memcmp(sig, expect_sig, sizeof(sig)), 0, "Ed25519 sign");
+}
+
 static int test_algorithm(const struct alg_combo *combo, const char *keys_dir)
 {
 	int rsa_bits = vb2_rsa_sig_size(combo->sig_alg) * 8;
@@ -171,6 +333,13 @@ static int test_algorithm(const struct alg_combo *combo, const char *keys_dir)
 
 	printf("***Testing algorithm: %s\n", combo->name);
 
+	if (combo->sig_alg == VB2_SIG_ED25519) {
+		/* The public key comes from the private key */
+		sprintf(pemfile, "%s/key_ed25519.pem", keys_dir);
+		sig_tests(combo, pemfile, NULL);
+		return 0;
+	}
+
 	sprintf(pemfile, "%s/key_rsa%d.pem", keys_dir, rsa_bits);
 	sprintf(keybfile, "%s/key_rsa%d.keyb", keys_dir, rsa_bits);
 
@@ -188,6 +357,7 @@ int main(int argc, char *argv[]) {
 			if (test_algorithm(test_algs + i, argv[1]))
 				return 1;
 		}
+		ed25519_sign_tests();
 	} else {
 		fprintf(stderr, "Usage: %s <keys_dir>", argv[0]);
 		return -1;
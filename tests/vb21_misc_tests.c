@@ -48,8 +48,12 @@ static struct {
 } mock_vblock;
 
 static int mock_read_res_fail_on_call;
+static int mock_map_res_retval;
 static int mock_unpack_key_retval;
 static int mock_verify_keyblock_retval;
+static int mock_verify_key_table_retval;
+static int mock_verify_keyblock_table_retval;
+static int mock_verify_keyblock_table_calls;
 static int mock_verify_preamble_retval;
 
 /* Type of test to reset for */
@@ -79,8 +83,12 @@ static void reset_common_data(enum reset_type t)
 	vb2_secdata_init(&ctx);
 
 	mock_read_res_fail_on_call = 0;
+	mock_map_res_retval = VB2_ERROR_EX_MAP_RESOURCE_UNSUPPORTED;
 	mock_unpack_key_retval = VB2_SUCCESS;
 	mock_verify_keyblock_retval = VB2_SUCCESS;
+	mock_verify_key_table_retval = VB2_SUCCESS;
+	mock_verify_keyblock_table_retval = VB2_SUCCESS;
+	mock_verify_keyblock_table_calls = 0;
 	mock_verify_preamble_retval = VB2_SUCCESS;
 
 	/* Set up mock data for verifying keyblock */
@@ -91,6 +99,7 @@ static void reset_common_data(enum reset_type t)
 	sd->gbb_rootkey_size = sizeof(mock_gbb.rootkey_data);
 	sd->last_fw_result = VB2_FW_RESULT_SUCCESS;
 
+	mock_gbb.rootkey.c.magic = VB2_MAGIC_PACKED_KEY;
 	mock_gbb.rootkey.sig_alg = VB2_SIG_RSA8192;
 	mock_gbb.rootkey.key_offset =
 		vb2_offset_of(&mock_gbb.rootkey,
@@ -151,6 +160,25 @@ int vb2ex_read_resource(struct vb2_context *ctx,
 	return VB2_SUCCESS;
 }
 
+int vb2ex_map_resource(struct vb2_context *ctx,
+		       enum vb2_resource_index index,
+		       uint32_t offset,
+		       const void **ptr,
+		       uint32_t *size)
+{
+	/* Only the vblock can be mapped */
+	if (mock_map_res_retval || index != VB2_RES_FW_VBLOCK)
+		return mock_map_res_retval ? mock_map_res_retval :
+			VB2_ERROR_EX_MAP_RESOURCE_UNSUPPORTED;
+
+	if (offset > sizeof(mock_vblock))
+		return VB2_ERROR_EX_READ_RESOURCE_SIZE;
+
+	*ptr = (uint8_t *)&mock_vblock + offset;
+	*size = sizeof(mock_vblock) - offset;
+	return VB2_SUCCESS;
+}
+
 int vb2_unpack_key(struct vb2_public_key *key,
 		    const uint8_t *buf,
 		    uint32_t size)
@@ -166,6 +194,20 @@ int vb2_verify_keyblock(struct vb2_keyblock *block,
 	return mock_verify_keyblock_retval;
 }
 
+int vb2_verify_key_table(const struct vb2_key_table *table, uint32_t size)
+{
+	return mock_verify_key_table_retval;
+}
+
+int vb2_verify_keyblock_table(struct vb2_keyblock *block,
+			      uint32_t size,
+			      const struct vb2_key_table *table,
+			      const struct vb2_workbuf *wb)
+{
+	mock_verify_keyblock_table_calls++;
+	return mock_verify_keyblock_table_retval;
+}
+
 int vb2_verify_fw_preamble(struct vb2_fw_preamble *preamble,
 			    uint32_t size,
 			    const struct vb2_public_key *key,
@@ -213,6 +255,38 @@ static void load_keyblock_tests(void)
 		sd->workbuf_data_key_offset + sd->workbuf_data_key_size,
 		"workbuf used after");
 
+	/* A mapped keyblock is used in place, so only the root key is read */
+	reset_common_data(FOR_KEYBLOCK);
+	mock_map_res_retval = VB2_SUCCESS;
+	mock_read_res_fail_on_call = 2;
+	TEST_SUCC(vb2_load_fw_keyblock(&ctx), "keyblock mapped");
+	k = (struct vb2_packed_key *)(ctx.workbuf +
+				      sd->workbuf_data_key_offset);
+	TEST_EQ(memcmp(ctx.workbuf + sd->workbuf_data_key_offset +
+		       k->key_offset, mock_vblock.k.data_key_data,
+		       sizeof(mock_vblock.k.data_key_data)),
+		0, "  data key data");
+
+	reset_common_data(FOR_KEYBLOCK);
+	mock_map_res_retval = VB2_ERROR_EX_READ_RESOURCE_INDEX;
+	TEST_EQ(vb2_load_fw_keyblock(&ctx),
+		VB2_ERROR_EX_READ_RESOURCE_INDEX,
+		"keyblock map error");
+
+	reset_common_data(FOR_KEYBLOCK);
+	mock_map_res_retval = VB2_SUCCESS;
+	kb->c.total_size = sizeof(mock_vblock) + 1;
+	TEST_EQ(vb2_load_fw_keyblock(&ctx),
+		VB2_ERROR_EX_READ_RESOURCE_SIZE,
+		"keyblock mapping too small is read");
+
+	reset_common_data(FOR_KEYBLOCK);
+	mock_map_res_retval = VB2_SUCCESS;
+	ctx.workbuf_used = ctx.workbuf_size - sd->gbb_rootkey_size;
+	TEST_EQ(vb2_load_fw_keyblock(&ctx),
+		VB2_ERROR_FW_KEYBLOCK_WORKBUF,
+		"keyblock mapped no room for data key");
+
 	/* Test failures */
 	reset_common_data(FOR_KEYBLOCK);
 	ctx.workbuf_used = ctx.workbuf_size - sd->gbb_rootkey_size + 8;
@@ -274,6 +348,56 @@ static void load_keyblock_tests(void)
 	TEST_EQ(vb2_load_fw_keyblock(&ctx),
 		VB2_ERROR_FW_KEYBLOCK_VERSION_ROLLBACK,
 		"keyblock rollback");
+
+	/* A bad signature is reported ahead of a bad version */
+	reset_common_data(FOR_KEYBLOCK);
+	dk->key_version = 0x10000;
+	mock_verify_keyblock_retval = VB2_ERROR_KEYBLOCK_SIG_INVALID;
+	TEST_EQ(vb2_load_fw_keyblock(&ctx),
+		VB2_ERROR_KEYBLOCK_SIG_INVALID,
+		"keyblock bad signature and version range");
+	TEST_EQ(vb2_nv_get(&ctx, VB2_NV_RECOVERY_REQUEST),
+		VB2_RECOVERY_FW_KEYBLOCK, "  recovery reason");
+
+	reset_common_data(FOR_KEYBLOCK);
+	dk->key_version = 1;
+	mock_verify_keyblock_retval = VB2_ERROR_KEYBLOCK_SIG_INVALID;
+	TEST_EQ(vb2_load_fw_keyblock(&ctx),
+		VB2_ERROR_KEYBLOCK_SIG_INVALID,
+		"keyblock bad signature and rollback");
+	TEST_EQ(vb2_nv_get(&ctx, VB2_NV_RECOVERY_REQUEST),
+		VB2_RECOVERY_FW_KEYBLOCK, "  recovery reason");
+
+	reset_common_data(FOR_KEYBLOCK);
+	dk->key_version = 1;
+	TEST_EQ(vb2_load_fw_keyblock(&ctx),
+		VB2_ERROR_FW_KEYBLOCK_VERSION_ROLLBACK,
+		"keyblock rollback after verify");
+	TEST_EQ(vb2_nv_get(&ctx, VB2_NV_RECOVERY_REQUEST),
+		VB2_RECOVERY_FW_KEY_ROLLBACK, "  recovery reason");
+
+	/* The GBB may hold a table of root keys instead */
+	reset_common_data(FOR_KEYBLOCK);
+	mock_gbb.rootkey.c.magic = VB2_MAGIC_KEY_TABLE;
+	mock_unpack_key_retval = VB2_ERROR_UNPACK_KEY_SIG_ALGORITHM;
+	mock_verify_keyblock_retval = VB2_ERROR_KEYBLOCK_MAGIC;
+	TEST_SUCC(vb2_load_fw_keyblock(&ctx), "keyblock root key table");
+	TEST_EQ(mock_verify_keyblock_table_calls, 1, "  verified with table");
+
+	reset_common_data(FOR_KEYBLOCK);
+	mock_gbb.rootkey.c.magic = VB2_MAGIC_KEY_TABLE;
+	mock_verify_key_table_retval = VB2_ERROR_KEY_TABLE_ORDER;
+	TEST_EQ(vb2_load_fw_keyblock(&ctx),
+		VB2_ERROR_KEY_TABLE_ORDER,
+		"keyblock bad root key table");
+	TEST_EQ(mock_verify_keyblock_table_calls, 0, "  not used");
+
+	reset_common_data(FOR_KEYBLOCK);
+	mock_gbb.rootkey.c.magic = VB2_MAGIC_KEY_TABLE;
+	mock_verify_keyblock_table_retval = VB2_ERROR_KEYBLOCK_SIG_GUID;
+	TEST_EQ(vb2_load_fw_keyblock(&ctx),
+		VB2_ERROR_KEYBLOCK_SIG_GUID,
+		"keyblock not signed by a table key");
 }
 
 static void load_preamble_tests(void)
@@ -296,6 +420,28 @@ static void load_preamble_tests(void)
 	TEST_EQ(sd->workbuf_data_key_offset, 0, "data key offset gone");
 	TEST_EQ(sd->workbuf_data_key_size, 0, "data key size gone");
 
+	/* A mapped preamble is copied into place without being read */
+	reset_common_data(FOR_PREAMBLE);
+	mock_map_res_retval = VB2_SUCCESS;
+	mock_read_res_fail_on_call = 1;
+	TEST_SUCC(vb2_load_fw_preamble(&ctx), "preamble mapped");
+	TEST_EQ(memcmp(ctx.workbuf + sd->workbuf_preamble_offset, pre,
+		       sd->workbuf_preamble_size),
+		0, "  preamble copied");
+
+	/* Put the data key at the very end of the work buffer */
+	reset_common_data(FOR_PREAMBLE);
+	mock_map_res_retval = VB2_SUCCESS;
+	memmove(ctx.workbuf + ctx.workbuf_size - sd->workbuf_data_key_size,
+		ctx.workbuf + sd->workbuf_data_key_offset,
+		sd->workbuf_data_key_size);
+	sd->workbuf_data_key_offset =
+		ctx.workbuf_size - sd->workbuf_data_key_size;
+	ctx.workbuf_used = ctx.workbuf_size;
+	TEST_EQ(vb2_load_fw_preamble(&ctx),
+		VB2_ERROR_FW_PREAMBLE2_WORKBUF,
+		"preamble mapped no room");
+
 	/* Expected failures */
 	reset_common_data(FOR_PREAMBLE);
 	sd->workbuf_data_key_size = 0;
@@ -378,10 +524,63 @@ static void load_preamble_tests(void)
 	TEST_EQ(v, 0x20002, "no roll forward");
 }
 
+static void vblock_prefix_tests(void)
+{
+	struct vb2_fw_preamble *pre = &mock_vblock.p.pre;
+	uint32_t pre_offset;
+
+	/* One read of the vblock serves both the keyblock and preamble */
+	reset_common_data(FOR_KEYBLOCK);
+	ctx.vblock_prefix_size = sizeof(mock_vblock);
+	mock_read_res_fail_on_call = 3;
+	TEST_SUCC(vb2_load_fw_keyblock(&ctx), "prefix keyblock");
+	TEST_NEQ(sd->workbuf_vblock_prefix_size, 0, "  prefix kept");
+	pre_offset = sd->workbuf_data_key_offset;
+	TEST_SUCC(vb2_load_fw_preamble(&ctx), "prefix preamble");
+	TEST_EQ(sd->workbuf_vblock_prefix_size, 0, "  prefix freed");
+	TEST_EQ(sd->workbuf_preamble_offset, pre_offset, "  preamble offset");
+	TEST_EQ(memcmp(ctx.workbuf + sd->workbuf_preamble_offset, pre,
+		       sizeof(mock_vblock.p)),
+		0, "  preamble copied");
+	TEST_EQ(ctx.workbuf_used, pre_offset + sizeof(mock_vblock.p),
+		"  workbuf used");
+
+	/* A preamble which isn't all in the prefix is read after the key */
+	reset_common_data(FOR_KEYBLOCK);
+	ctx.vblock_prefix_size = sizeof(mock_vblock.k) + 8;
+	TEST_SUCC(vb2_load_fw_keyblock(&ctx), "short prefix keyblock");
+	TEST_NEQ(sd->workbuf_vblock_prefix_size, 0, "  prefix kept");
+	pre_offset = sd->workbuf_data_key_offset;
+	TEST_SUCC(vb2_load_fw_preamble(&ctx), "short prefix preamble");
+	TEST_EQ(sd->workbuf_vblock_prefix_size, 0, "  prefix freed");
+	TEST_EQ(sd->workbuf_preamble_offset, pre_offset, "  preamble offset");
+
+	/* So is a keyblock which isn't */
+	reset_common_data(FOR_KEYBLOCK);
+	ctx.vblock_prefix_size = sizeof(struct vb2_keyblock);
+	TEST_SUCC(vb2_load_fw_keyblock(&ctx), "tiny prefix keyblock");
+	TEST_EQ(sd->workbuf_vblock_prefix_size, 0, "  prefix dropped");
+	TEST_EQ(ctx.workbuf_used,
+		sd->workbuf_data_key_offset + sd->workbuf_data_key_size,
+		"  workbuf used");
+
+	/* A prefix which can't be read is ignored */
+	reset_common_data(FOR_KEYBLOCK);
+	ctx.vblock_prefix_size = sizeof(mock_vblock) + 1;
+	TEST_SUCC(vb2_load_fw_keyblock(&ctx), "bad prefix keyblock");
+	TEST_EQ(sd->workbuf_vblock_prefix_size, 0, "  no prefix");
+
+	reset_common_data(FOR_KEYBLOCK);
+	ctx.vblock_prefix_size = ctx.workbuf_size;
+	TEST_SUCC(vb2_load_fw_keyblock(&ctx), "huge prefix keyblock");
+	TEST_EQ(sd->workbuf_vblock_prefix_size, 0, "  no prefix");
+}
+
 int main(int argc, char* argv[])
 {
 	load_keyblock_tests();
 	load_preamble_tests();
+	vblock_prefix_tests();
 
 	return gTestSuccess ? 0 : 255;
 }
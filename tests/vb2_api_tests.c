@@ -121,6 +121,9 @@ static void phase1_tests(void)
 	TEST_EQ(sd->recovery_reason, 0, "  not recovery");
 	TEST_EQ(cc.flags & VB2_CONTEXT_RECOVERY_MODE, 0, "  recovery flag");
 	TEST_EQ(cc.flags & VB2_CONTEXT_CLEAR_RAM, 0, "  clear ram flag");
+	TEST_EQ(sd->timestamp_count, 2, "  timestamps");
+	TEST_EQ(sd->timestamps[0].id, VB2_TS_FW_PHASE1_ENTER, "  enter");
+	TEST_EQ(sd->timestamps[1].id, VB2_TS_FW_PHASE1_EXIT, "  exit");
 
 	reset_common_data(FOR_MISC);
 	retval_vb2_fw_parse_gbb = VB2_ERROR_GBB_MAGIC;
@@ -156,6 +159,9 @@ static void phase2_tests(void)
 	reset_common_data(FOR_MISC);
 	TEST_SUCC(vb2api_fw_phase2(&cc), "phase2 good");
 	TEST_EQ(cc.flags & VB2_CONTEXT_CLEAR_RAM, 0, "  clear ram flag");
+	TEST_EQ(sd->timestamp_count, 2, "  timestamps");
+	TEST_EQ(sd->timestamps[0].id, VB2_TS_FW_PHASE2_ENTER, "  enter");
+	TEST_EQ(sd->timestamps[1].id, VB2_TS_FW_PHASE2_EXIT, "  exit");
 
 	reset_common_data(FOR_MISC);
 	cc.flags |= VB2_CONTEXT_DEVELOPER_MODE;
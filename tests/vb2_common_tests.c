@@ -17,6 +17,30 @@ static void test_memcmp(void)
 	TEST_EQ(vb2_safe_memcmp("foo", "foo", 3), 0, "memcmp equal");
 	TEST_NEQ(vb2_safe_memcmp("foo1", "foo2", 4), 0, "memcmp different");
 	TEST_EQ(vb2_safe_memcmp("foo1", "foo2", 0), 0, "memcmp 0-size");
+
+	{
+		/* Word at a time or not, a difference anywhere is found */
+		uint8_t a[80], b[80];
+		int offs_a, offs_b, i, ok = 1;
+
+		for (i = 0; i < sizeof(a); i++)
+			a[i] = b[i] = i;
+		for (offs_a = 0; offs_a < 8; offs_a++) {
+			for (offs_b = 0; offs_b < 8; offs_b++) {
+				if (vb2_safe_memcmp(a + offs_a, b + offs_b, 64)
+				    == (offs_a == offs_b))
+					ok = 0;
+				for (i = 0; i < 64; i++) {
+					b[offs_a + i] ^= 0x10;
+					if (!vb2_safe_memcmp(a + offs_a,
+							     b + offs_a, 64))
+						ok = 0;
+					b[offs_a + i] ^= 0x10;
+				}
+			}
+		}
+		TEST_EQ(ok, 1, "memcmp all offsets");
+	}
 }
 
 /**
@@ -0,0 +1,91 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for CRC-8 functions.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_common.h"
+#include "crc8.h"
+
+#include "2sysincludes.h"
+#include "2crc8.h"
+
+/* Bit-at-a-time CRC-8 the library used to use, as a reference */
+static uint8_t ref_crc8(const uint8_t *data, uint32_t size)
+{
+	unsigned crc = 0;
+	uint32_t i, j;
+
+	for (j = size; j; j--, data++) {
+		crc ^= (*data << 8);
+		for (i = 8; i; i--) {
+			if (crc & 0x8000)
+				crc ^= (0x1070 << 3);
+			crc <<= 1;
+		}
+	}
+
+	return (uint8_t)(crc >> 8);
+}
+
+static void crc8_test(void)
+{
+	uint8_t buf[256];
+	int mismatch = 0;
+	int i, j;
+
+	/* Known values */
+	TEST_EQ(vb2_crc8("", 0), 0, "Empty");
+	TEST_EQ(vb2_crc8("123456789", 9), 0xf4, "Check value");
+	TEST_EQ(Crc8("123456789", 9), 0xf4, "Check value vboot1");
+
+	/* Every single byte value */
+	for (i = 0; i < 256; i++) {
+		buf[0] = i;
+		if (vb2_crc8(buf, 1) != ref_crc8(buf, 1) ||
+		    Crc8(buf, 1) != ref_crc8(buf, 1))
+			mismatch++;
+	}
+	TEST_EQ(mismatch, 0, "All single bytes");
+
+	/* Every pair of bytes, so each byte is seen with every prior CRC */
+	mismatch = 0;
+	for (i = 0; i < 256; i++) {
+		for (j = 0; j < 256; j++) {
+			buf[0] = i;
+			buf[1] = j;
+			if (vb2_crc8(buf, 2) != ref_crc8(buf, 2) ||
+			    Crc8(buf, 2) != ref_crc8(buf, 2))
+				mismatch++;
+		}
+	}
+	TEST_EQ(mismatch, 0, "All byte pairs");
+
+	/* Pseudo-random buffers of every length */
+	srand(42);
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = rand();
+	mismatch = 0;
+	for (i = 0; i <= sizeof(buf); i++) {
+		if (vb2_crc8(buf, i) != ref_crc8(buf, i) ||
+		    Crc8(buf, i) != ref_crc8(buf, i))
+			mismatch++;
+	}
+	TEST_EQ(mismatch, 0, "Random buffers");
+
+	/* Negative lengths are treated as empty */
+	TEST_EQ(Crc8(buf, -1), 0, "Negative length");
+}
+
+int main(int argc, char* argv[])
+{
+	crc8_test();
+
+	return gTestSuccess ? 0 : 255;
+}
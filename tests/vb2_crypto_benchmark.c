@@ -0,0 +1,353 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Benchmarks for the vboot2 crypto primitives and the CRCs.
+ *
+ * Usage: vb2_crypto_benchmark <keys_dir> [runs]
+ *
+ * Each operation is timed [runs] times after a warm-up, and the minimum,
+ * median, 90th and 99th percentile, maximum, mean and standard deviation of
+ * the time per operation are printed as JSON on stdout, so results from
+ * different boards can be compared by a script.  Progress goes to stderr.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2crc8.h"
+#include "2rsa.h"
+#include "2sha.h"
+#include "crc32.h"
+#include "host_common.h"
+#include "timer_utils.h"
+#include "vb2_common.h"
+
+#define DEFAULT_RUNS 15
+#define MAX_RUNS 1000
+#define WARMUP_RUNS 3
+
+/* Each run repeats the operation until it takes at least this long */
+#define MIN_RUN_NSECS 1000000ULL
+
+/* Buffer sizes go from 64 bytes to 16 MB, in steps of 4x */
+#define MIN_BUFFER_SIZE 64
+#define MAX_BUFFER_SIZE (16 * 1024 * 1024)
+
+/* vb2_crc8() is only ever used on small structs */
+#define MAX_CRC8_SIZE (64 * 1024)
+
+typedef void (*bench_fn)(void *arg);
+
+static int runs = DEFAULT_RUNS;
+static int results_printed;
+
+struct buffer_arg {
+	const uint8_t *buf;
+	uint32_t size;
+	enum vb2_hash_algorithm hash_alg;
+};
+
+struct rsa_arg {
+	const struct vb2_public_key *key;
+	const uint8_t *sig;
+	const uint8_t *padded;
+	const uint8_t *digest;
+	struct vb2_workbuf wb;
+	int failed;
+};
+
+/* Keeps the compiler from dropping CRCs whose results aren't used */
+static volatile uint32_t crc_sink;
+
+static void bench_digest(void *arg)
+{
+	struct buffer_arg *a = (struct buffer_arg *)arg;
+	struct vb2_digest_context dc;
+	uint8_t digest[VB2_SHA512_DIGEST_SIZE];
+
+	vb2_digest_init(&dc, a->hash_alg);
+	vb2_digest_extend(&dc, a->buf, a->size);
+	vb2_digest_finalize(&dc, digest, sizeof(digest));
+}
+
+static void bench_crc32(void *arg)
+{
+	struct buffer_arg *a = (struct buffer_arg *)arg;
+
+	crc_sink = Crc32(a->buf, a->size);
+}
+
+static void bench_crc8(void *arg)
+{
+	struct buffer_arg *a = (struct buffer_arg *)arg;
+
+	crc_sink = vb2_crc8(a->buf, a->size);
+}
+
+static void bench_rsa(void *arg)
+{
+	struct rsa_arg *a = (struct rsa_arg *)arg;
+
+	if (vb2_rsa_verify_digest(a->key, a->sig, a->digest, &a->wb))
+		a->failed = 1;
+}
+
+static void bench_rsa_padding(void *arg)
+{
+	struct rsa_arg *a = (struct rsa_arg *)arg;
+
+	if (vb2_check_padding(a->padded, a->key))
+		a->failed = 1;
+}
+
+/**
+ * Time [fn] and print a JSON result for it.
+ *
+ * If [size] is non-zero, it is the number of bytes [fn] processes, and the
+ * median throughput is printed too.
+ */
+static void bench(const char *name, uint32_t size, bench_fn fn, void *arg)
+{
+	TimerStats st;
+
+	if (TimeFunction(fn, arg, WARMUP_RUNS, runs, MIN_RUN_NSECS, &st)) {
+		fprintf(stderr, "Can't time %s\n", name);
+		return;
+	}
+
+	printf("%s\n    {\"name\": \"%s\", \"size\": %u, "
+	       "\"iterations\": %" PRIu64 ", \"ns_min\": %.1f, "
+	       "\"ns_p50\": %.1f, \"ns_p90\": %.1f, \"ns_p99\": %.1f, "
+	       "\"ns_max\": %.1f, \"ns_mean\": %.1f, \"ns_stddev\": %.1f",
+	       results_printed ? "," : "", name, size, st.iterations,
+	       st.ns_min, st.ns_p50, st.ns_p90, st.ns_p99, st.ns_max,
+	       st.ns_mean, st.ns_stddev);
+	if (st.cycles_p50)
+		printf(", \"cycles_p50\": %.1f", st.cycles_p50);
+	if (size)
+		printf(", \"mb_per_sec\": %.2f", size * 1e3 / st.ns_p50);
+	printf("}");
+	fflush(stdout);
+	results_printed++;
+
+	fprintf(stderr, "# %-20s %10u bytes: %12.1f ns median\n",
+		name, size, st.ns_p50);
+}
+
+/* Time [fn] on each buffer size up to [max_size] */
+static void bench_sizes(const char *name, struct buffer_arg *a,
+			const uint8_t *buf, uint32_t max_size, bench_fn fn)
+{
+	uint32_t size;
+
+	a->buf = buf;
+	for (size = MIN_BUFFER_SIZE; size <= max_size; size *= 4) {
+		a->size = size;
+		bench(name, size, fn, a);
+	}
+}
+
+static void bench_hashes(const uint8_t *buf)
+{
+	static const struct {
+		enum vb2_sha256_impl impl;
+		const char *name;
+	} sha256_impls[] = {
+		{VB2_SHA256_IMPL_C, "sha256/c"},
+		{VB2_SHA256_IMPL_X86_SHA, "sha256/x86_sha"},
+		{VB2_SHA256_IMPL_ARMV8_CE, "sha256/armv8_ce"},
+	};
+	struct buffer_arg a;
+	int i;
+
+	if (vb2_digest_size(VB2_HASH_SHA1)) {
+		a.hash_alg = VB2_HASH_SHA1;
+		bench_sizes("sha1", &a, buf, MAX_BUFFER_SIZE, bench_digest);
+	}
+
+	if (vb2_digest_size(VB2_HASH_SHA256)) {
+		a.hash_alg = VB2_HASH_SHA256;
+		for (i = 0; i < ARRAY_SIZE(sha256_impls); i++) {
+			if (vb2_sha256_select_impl(sha256_impls[i].impl))
+				continue;
+			bench_sizes(sha256_impls[i].name, &a, buf,
+				    MAX_BUFFER_SIZE, bench_digest);
+		}
+		vb2_sha256_select_impl(VB2_SHA256_IMPL_AUTO);
+	}
+
+	if (vb2_digest_size(VB2_HASH_SHA512)) {
+		a.hash_alg = VB2_HASH_SHA512;
+		bench_sizes("sha512", &a, buf, MAX_BUFFER_SIZE, bench_digest);
+	}
+
+	if (vb2_digest_size(VB2_HASH_BLAKE2S)) {
+		a.hash_alg = VB2_HASH_BLAKE2S;
+		bench_sizes("blake2s", &a, buf, MAX_BUFFER_SIZE, bench_digest);
+	}
+}
+
+static void bench_crcs(const uint8_t *buf)
+{
+	static const struct {
+		enum crc32_impl impl;
+		const char *name;
+	} crc32_impls[] = {
+		{CRC32_IMPL_BYTEWISE, "crc32/bytewise"},
+		{CRC32_IMPL_SLICE_BY_8, "crc32/slice_by_8"},
+		{CRC32_IMPL_PCLMUL, "crc32/pclmul"},
+		{CRC32_IMPL_ARMV8, "crc32/armv8"},
+	};
+	struct buffer_arg a;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(crc32_impls); i++) {
+		if (Crc32SelectImpl(crc32_impls[i].impl))
+			continue;
+		bench_sizes(crc32_impls[i].name, &a, buf, MAX_BUFFER_SIZE,
+			    bench_crc32);
+	}
+	Crc32SelectImpl(CRC32_IMPL_AUTO);
+
+	bench_sizes("crc8", &a, buf, MAX_CRC8_SIZE, bench_crc8);
+}
+
+/* Time verifying a signature with each RSA key size */
+static int bench_rsa_sizes(const char *keys_dir, const uint8_t *buf)
+{
+	static const int rsa_bits[] = {1024, 2048, 4096, 8192};
+	uint8_t workbuf[VB2_VERIFY_RSA_DIGEST_WORKBUF_BYTES]
+		__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	uint8_t padded[VB2_MAX_RSA_SIG_BYTES];
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+	char filename[1024];
+	char name[32];
+	struct vb2_digest_context dc;
+	int rv = 0;
+	int i;
+
+	if (vb2_digest_init(&dc, VB2_HASH_SHA256) ||
+	    vb2_digest_extend(&dc, buf, MIN_BUFFER_SIZE) ||
+	    vb2_digest_finalize(&dc, digest, sizeof(digest))) {
+		fprintf(stderr, "Error hashing test data\n");
+		return 1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(rsa_bits); i++) {
+		/* RSA*_SHA256 follows RSA*_SHA1 for each key size */
+		int alg = 3 * i + 1;
+		VbPrivateKey *private_key = NULL;
+		VbPublicKey *packed_key = NULL;
+		struct vb2_signature *sig = NULL;
+		struct vb2_public_key key;
+		struct rsa_arg a;
+
+		sprintf(filename, "%s/key_rsa%d.pem", keys_dir, rsa_bits[i]);
+		private_key = PrivateKeyReadPem(filename, alg);
+		sprintf(filename, "%s/key_rsa%d.keyb", keys_dir, rsa_bits[i]);
+		packed_key = PublicKeyReadKeyb(filename, alg, 1);
+		if (!private_key || !packed_key) {
+			fprintf(stderr, "Error reading rsa%d keys from %s\n",
+				rsa_bits[i], keys_dir);
+			rv = 1;
+			goto next;
+		}
+
+		if (vb2_unpack_key(&key, (const uint8_t *)packed_key,
+				   packed_key->key_offset +
+				   packed_key->key_size)) {
+			fprintf(stderr, "Error unpacking rsa%d key\n",
+				rsa_bits[i]);
+			rv = 1;
+			goto next;
+		}
+
+		sig = (struct vb2_signature *)
+			CalculateSignature(buf, MIN_BUFFER_SIZE, private_key);
+		if (!sig) {
+			fprintf(stderr, "Error signing with rsa%d key\n",
+				rsa_bits[i]);
+			rv = 1;
+			goto next;
+		}
+
+		memset(&a, 0, sizeof(a));
+		a.key = &key;
+		a.sig = vb2_signature_data(sig);
+		a.digest = digest;
+		vb2_workbuf_init(&a.wb, workbuf, sizeof(workbuf));
+
+		sprintf(name, "rsa%d_verify", rsa_bits[i]);
+		bench(name, 0, bench_rsa, &a);
+		if (a.failed) {
+			fprintf(stderr, "rsa%d signature didn't verify\n",
+				rsa_bits[i]);
+			rv = 1;
+		}
+
+		/* Verifying leaves the decrypted signature in the work buffer */
+		if (a.failed || sig->sig_size > sizeof(padded))
+			goto next;
+		memcpy(padded, workbuf, sig->sig_size);
+		a.padded = padded;
+		sprintf(name, "rsa%d_padding", rsa_bits[i]);
+		bench(name, 0, bench_rsa_padding, &a);
+		if (a.failed) {
+			fprintf(stderr, "rsa%d padding didn't check\n",
+				rsa_bits[i]);
+			rv = 1;
+		}
+
+	next:
+		free(sig);
+		free(packed_key);
+		if (private_key)
+			PrivateKeyFree(private_key);
+	}
+
+	return rv;
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t *buf;
+	int rv;
+	int i;
+
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "Usage: %s <keys_dir> [runs]\n", argv[0]);
+		return 1;
+	}
+	if (argc == 3) {
+		runs = atoi(argv[2]);
+		if (runs < 1 || runs > MAX_RUNS) {
+			fprintf(stderr, "Runs must be 1-%d\n", MAX_RUNS);
+			return 1;
+		}
+	}
+
+	/* Random-looking data, but the same every time */
+	buf = malloc(MAX_BUFFER_SIZE);
+	if (!buf) {
+		fprintf(stderr, "Can't allocate test buffer\n");
+		return 1;
+	}
+	srand(0);
+	for (i = 0; i < MAX_BUFFER_SIZE; i++)
+		buf[i] = (uint8_t)rand();
+
+	printf("{\n  \"runs\": %d,\n  \"results\": [", runs);
+	bench_hashes(buf);
+	bench_crcs(buf);
+	rv = bench_rsa_sizes(argv[1], buf);
+	printf("\n  ]\n}\n");
+
+	free(buf);
+	return rv;
+}
@@ -0,0 +1,222 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for Ed25519 signature verification.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2ed25519.h"
+#include "2ed25519_private.h"
+#include "2sha.h"
+
+#include "test_common.h"
+
+/* Test vectors 1-3 from RFC 8032 section 7.1 */
+static const uint8_t seed1[] = {
+	0x9d, 0x61, 0xb1, 0x9d, 0xef, 0xfd, 0x5a, 0x60,
+	0xba, 0x84, 0x4a, 0xf4, 0x92, 0xec, 0x2c, 0xc4,
+	0x44, 0x49, 0xc5, 0x69, 0x7b, 0x32, 0x69, 0x19,
+	0x70, 0x3b, 0xac, 0x03, 0x1c, 0xae, 0x7f, 0x60
+};
+
+static const uint8_t pk1[] = {
+	0xd7, 0x5a, 0x98, 0x01, 0x82, 0xb1, 0x0a, 0xb7,
+	0xd5, 0x4b, 0xfe, 0xd3, 0xc9, 0x64, 0x07, 0x3a,
+	0x0e, 0xe1, 0x72, 0xf3, 0xda, 0xa6, 0x23, 0x25,
+	0xaf, 0x02, 0x1a, 0x68, 0xf7, 0x07, 0x51, 0x1a
+};
+
+static const uint8_t sig1[] = {
+	0xe5, 0x56, 0x43, 0x00, 0xc3, 0x60, 0xac, 0x72,
+	0x90, 0x86, 0xe2, 0xcc, 0x80, 0x6e, 0x82, 0x8a,
+	0x84, 0x87, 0x7f, 0x1e, 0xb8, 0xe5, 0xd9, 0x74,
+	0xd8, 0x73, 0xe0, 0x65, 0x22, 0x49, 0x01, 0x55,
+	0x5f, 0xb8, 0x82, 0x15, 0x90, 0xa3, 0x3b, 0xac,
+	0xc6, 0x1e, 0x39, 0x70, 0x1c, 0xf9, 0xb4, 0x6b,
+	0xd2, 0x5b, 0xf5, 0xf0, 0x59, 0x5b, 0xbe, 0x24,
+	0x65, 0x51, 0x41, 0x43, 0x8e, 0x7a, 0x10, 0x0b
+};
+
+static const uint8_t pk2[] = {
+	0x3d, 0x40, 0x17, 0xc3, 0xe8, 0x43, 0x89, 0x5a,
+	0x92, 0xb7, 0x0a, 0xa7, 0x4d, 0x1b, 0x7e, 0xbc,
+	0x9c, 0x98, 0x2c, 0xcf, 0x2e, 0xc4, 0x96, 0x8c,
+	0xc0, 0xcd, 0x55, 0xf1, 0x2a, 0xf4, 0x66, 0x0c
+};
+
+static const uint8_t sig2[] = {
+	0x92, 0xa0, 0x09, 0xa9, 0xf0, 0xd4, 0xca, 0xb8,
+	0x72, 0x0e, 0x82, 0x0b, 0x5f, 0x64, 0x25, 0x40,
+	0xa2, 0xb2, 0x7b, 0x54, 0x16, 0x50, 0x3f, 0x8f,
+	0xb3, 0x76, 0x22, 0x23, 0xeb, 0xdb, 0x69, 0xda,
+	0x08, 0x5a, 0xc1, 0xe4, 0x3e, 0x15, 0x99, 0x6e,
+	0x45, 0x8f, 0x36, 0x13, 0xd0, 0xf1, 0x1d, 0x8c,
+	0x38, 0x7b, 0x2e, 0xae, 0xb4, 0x30, 0x2a, 0xee,
+	0xb0, 0x0d, 0x29, 0x16, 0x12, 0xbb, 0x0c, 0x00
+};
+
+static const uint8_t pk3[] = {
+	0xfc, 0x51, 0xcd, 0x8e, 0x62, 0x18, 0xa1, 0xa3,
+	0x8d, 0xa4, 0x7e, 0xd0, 0x02, 0x30, 0xf0, 0x58,
+	0x08, 0x16, 0xed, 0x13, 0xba, 0x33, 0x03, 0xac,
+	0x5d, 0xeb, 0x91, 0x15, 0x48, 0x90, 0x80, 0x25
+};
+
+static const uint8_t sig3[] = {
+	0x62, 0x91, 0xd6, 0x57, 0xde, 0xec, 0x24, 0x02,
+	0x48, 0x27, 0xe6, 0x9c, 0x3a, 0xbe, 0x01, 0xa3,
+	0x0c, 0xe5, 0x48, 0xa2, 0x84, 0x74, 0x3a, 0x44,
+	0x5e, 0x36, 0x80, 0xd7, 0xdb, 0x5a, 0xc3, 0xac,
+	0x18, 0xff, 0x9b, 0x53, 0x8d, 0x16, 0xf2, 0x90,
+	0xae, 0x67, 0xf7, 0x60, 0x98, 0x4d, 0xc6, 0x59,
+	0x4a, 0x7c, 0x15, 0xe9, 0x71, 0x6e, 0xd2, 0x8d,
+	0xc0, 0x27, 0xbe, 0xce, 0xea, 0x1e, 0xc4, 0x0a
+};
+
+/* L - 1, the largest canonical scalar */
+static const uint8_t l_minus_1[] = {
+	0xec, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58,
+	0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10
+};
+
+/* (2^512 - 1) mod L */
+static const uint8_t max_reduced[] = {
+	0x00, 0x0f, 0x9c, 0x44, 0xe3, 0x11, 0x06, 0xa4,
+	0x47, 0x93, 0x85, 0x68, 0xa7, 0x1b, 0x0e, 0xd0,
+	0x65, 0xbe, 0xf5, 0x17, 0xd2, 0x73, 0xec, 0xce,
+	0x3d, 0x9a, 0x30, 0x7c, 0x1b, 0x41, 0x99, 0x03
+};
+
+static const uint8_t msg2[] = {0x72};
+static const uint8_t msg3[] = {0xaf, 0x82};
+
+static uint8_t workbuf[VB2_VERIFY_ED25519_WORKBUF_BYTES]
+	__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+
+static int verify(const uint8_t *pk, const uint8_t *sig, const uint8_t *msg,
+		  uint32_t size)
+{
+	struct vb2_workbuf wb;
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf));
+	return vb2_ed25519_verify(pk, sig, msg, size, &wb);
+}
+
+static void vector_tests(void)
+{
+	TEST_SUCC(verify(pk1, sig1, NULL, 0), "RFC 8032 test 1");
+	TEST_SUCC(verify(pk2, sig2, msg2, sizeof(msg2)), "RFC 8032 test 2");
+	TEST_SUCC(verify(pk3, sig3, msg3, sizeof(msg3)), "RFC 8032 test 3");
+
+	/* Right signatures, wrong messages or keys */
+	TEST_EQ(verify(pk2, sig2, msg3, 1), VB2_ERROR_ED25519_VERIFY,
+		"Wrong message");
+	TEST_EQ(verify(pk2, sig2, msg2, 0), VB2_ERROR_ED25519_VERIFY,
+		"Wrong message size");
+	TEST_EQ(verify(pk3, sig2, msg2, sizeof(msg2)),
+		VB2_ERROR_ED25519_VERIFY, "Wrong key");
+}
+
+static void bad_sig_tests(void)
+{
+	uint8_t sig[VB2_ED25519_SIG_SIZE];
+	uint8_t pk[VB2_ED25519_PUBLIC_KEY_SIZE];
+	struct vb2_workbuf wb;
+	int i, bad = 0;
+
+	/* Flip each bit of R and S in turn */
+	for (i = 0; i < 8 * sizeof(sig); i++) {
+		memcpy(sig, sig2, sizeof(sig));
+		sig[i / 8] ^= 1 << (i % 8);
+		if (!verify(pk2, sig, msg2, sizeof(msg2)))
+			bad++;
+	}
+	TEST_EQ(bad, 0, "Every bit of the signature matters");
+
+	/* S + L is the same scalar, but not allowed */
+	memcpy(sig, sig2, sizeof(sig));
+	sig[63] += 0x10;
+	TEST_EQ(verify(pk2, sig, msg2, sizeof(msg2)), VB2_ERROR_ED25519_SIG,
+		"S out of range");
+	memset(sig + 32, 0xff, 32);
+	TEST_EQ(verify(pk2, sig, msg2, sizeof(msg2)), VB2_ERROR_ED25519_SIG,
+		"S all ones");
+
+	/* y = 2 isn't on the curve */
+	memset(pk, 0, sizeof(pk));
+	pk[0] = 2;
+	TEST_EQ(verify(pk, sig2, msg2, sizeof(msg2)), VB2_ERROR_ED25519_KEY,
+		"Key not on curve");
+
+	/* y = p + 1 is the encoding of y = 1, but not the canonical one */
+	memset(pk, 0xff, sizeof(pk));
+	pk[0] = 0xee;
+	pk[31] = 0x7f;
+	TEST_EQ(verify(pk, sig2, msg2, sizeof(msg2)), VB2_ERROR_ED25519_KEY,
+		"Key not canonical");
+
+	vb2_workbuf_init(&wb, workbuf, sizeof(workbuf) - 1);
+	TEST_EQ(vb2_ed25519_verify(pk2, sig2, msg2, sizeof(msg2), &wb),
+		VB2_ERROR_ED25519_WORKBUF, "Work buffer too small");
+}
+
+static void private_tests(void)
+{
+	struct vb2_sha512_context ctx;
+	uint8_t h[VB2_SHA512_DIGEST_SIZE];
+	uint8_t pk[VB2_ED25519_PUBLIC_KEY_SIZE];
+	uint8_t a[32], b[32], c[32], r[32];
+	int i;
+
+	/* The public key is [clamped SHA-512(seed)]B */
+	vb2_sha512_init(&ctx);
+	vb2_sha512_update(&ctx, seed1, sizeof(seed1));
+	vb2_sha512_finalize(&ctx, h);
+	h[0] &= 248;
+	h[31] &= 127;
+	h[31] |= 64;
+	vb2_ed25519_scalarmult_base(pk, h);
+	TEST_EQ(memcmp(pk, pk1, sizeof(pk)), 0, "Public key from seed");
+
+	/* Scalars less than L are left alone */
+	memset(h, 0, sizeof(h));
+	memcpy(h, l_minus_1, 32);
+	vb2_ed25519_reduce(r, h);
+	TEST_EQ(memcmp(r, l_minus_1, 32), 0, "Reduce canonical scalar");
+	memset(h, 0xff, sizeof(h));
+	vb2_ed25519_reduce(r, h);
+	TEST_EQ(memcmp(r, max_reduced, 32), 0, "Reduce 2^512 - 1");
+
+	/* (1 * b + 0) mod L = b; (2 * (L - 1) + 2) mod L = 0 */
+	memset(a, 0, sizeof(a));
+	memset(c, 0, sizeof(c));
+	a[0] = 1;
+	memcpy(b, sig3 + 32, 32);
+	vb2_ed25519_muladd(r, a, b, c);
+	TEST_EQ(memcmp(r, b, 32), 0, "Muladd identity");
+
+	a[0] = 2;
+	c[0] = 2;
+	vb2_ed25519_muladd(r, a, l_minus_1, c);
+	for (i = 0; i < 32; i++)
+		if (r[i])
+			break;
+	TEST_EQ(i, 32, "Muladd wraps at L");
+}
+
+int main(int argc, char *argv[])
+{
+	vector_tests();
+	bad_sig_tests();
+	private_tests();
+
+	return gTestSuccess ? 0 : 255;
+}
@@ -26,6 +26,7 @@ void *mock_resource_ptr;
 uint32_t mock_resource_size;
 int mock_tpm_clear_called;
 int mock_tpm_clear_retval;
+uint64_t mock_timer;
 
 
 static void reset_common_data(void)
@@ -73,6 +74,11 @@ int vb2ex_tpm_clear_owner(struct vb2_context *ctx)
 	return mock_tpm_clear_retval;
 }
 
+uint64_t vb2ex_get_timer(void)
+{
+	return mock_timer++;
+}
+
 /* Tests */
 
 static void init_context_tests(void)
@@ -107,6 +113,40 @@ static void init_context_tests(void)
 		VB2_ERROR_INITCTX_WORKBUF_ALIGN, "Init unaligned");
 }
 
+static void timestamp_tests(void)
+{
+	struct vb2_context c = {
+		.workbuf = workbuf,
+		.workbuf_size = sizeof(workbuf),
+	};
+
+	reset_common_data();
+	TEST_EQ(sd->timestamp_count, 0, "No timestamps yet");
+
+	mock_timer = 1000;
+	vb2_record_timestamp(&cc, VB2_TS_FW_PHASE1_ENTER);
+	vb2_record_timestamp(&cc, VB2_TS_FW_PHASE1_EXIT);
+	TEST_EQ(sd->timestamp_count, 2, "Timestamp count");
+	TEST_EQ(sd->timestamps[0].id, VB2_TS_FW_PHASE1_ENTER, "Timestamp 0 id");
+	TEST_EQ(sd->timestamps[0].time, 1000, "Timestamp 0 time");
+	TEST_EQ(sd->timestamps[1].id, VB2_TS_FW_PHASE1_EXIT, "Timestamp 1 id");
+	TEST_EQ(sd->timestamps[1].time, 1001, "Timestamp 1 time");
+
+	/* Oldest timestamps are overwritten once the ring is full */
+	sd->timestamp_count = VB2_MAX_TIMESTAMPS;
+	vb2_record_timestamp(&cc, VB2_TS_FW_PHASE2_ENTER);
+	TEST_EQ(sd->timestamp_count, VB2_MAX_TIMESTAMPS + 1,
+		"Timestamp count keeps going");
+	TEST_EQ(sd->timestamps[0].id, VB2_TS_FW_PHASE2_ENTER,
+		"Timestamp ring wraps");
+
+	/* Nowhere to put them before the context is initialized */
+	memset(workbuf, 0xaa, sizeof(workbuf));
+	vb2_record_timestamp(&c, VB2_TS_FW_PHASE1_ENTER);
+	TEST_EQ(((struct vb2_shared_data *)workbuf)->timestamp_count,
+		0xaaaaaaaa, "No timestamp before init");
+}
+
 static void misc_tests(void)
 {
 	struct vb2_workbuf wb;
@@ -479,6 +519,7 @@ static void select_slot_tests(void)
 int main(int argc, char* argv[])
 {
 	init_context_tests();
+	timestamp_tests();
 	misc_tests();
 	gbb_tests();
 	fail_tests();
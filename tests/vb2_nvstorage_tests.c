@@ -175,6 +175,20 @@ static void nv_storage_test(void)
 		vb2_nv_set(&c, vnf->param, vnf->test_value2);
 	test_changed(&c, 0, "No regen CRC if data not changed");
 
+	/* Changes which cancel out don't need saving */
+	goodcrc = c.nvdata[15];
+	vb2_nv_set(&c, VB2_NV_LOCALIZATION_INDEX, 3);
+	test_changed(&c, 1, "Changed localization");
+	vb2_nv_set(&c, VB2_NV_LOCALIZATION_INDEX, 0xB0);
+	test_changed(&c, 0, "Changed localization back");
+	TEST_EQ(c.nvdata[15], goodcrc, "  CRC back too");
+
+	/* But they do once the caller has saved the first change */
+	vb2_nv_set(&c, VB2_NV_LOCALIZATION_INDEX, 3);
+	c.flags &= ~VB2_CONTEXT_NVDATA_CHANGED;
+	vb2_nv_set(&c, VB2_NV_LOCALIZATION_INDEX, 0xB0);
+	test_changed(&c, 1, "Changed localization back after save");
+
 	/* Test out-of-range fields mapping to defaults or failing */
 	vb2_nv_init(&c);
 	vb2_nv_set(&c, VB2_NV_TRY_COUNT, 16);
@@ -191,6 +205,28 @@ static void nv_storage_test(void)
 	vb2_nv_set(&c, VB2_NV_FW_RESULT, VB2_FW_RESULT_UNKNOWN + 100);
 	TEST_EQ(vb2_nv_get(&c, VB2_NV_FW_RESULT),
 		VB2_FW_RESULT_UNKNOWN, "Firmware result out of range");
+	vb2_nv_set(&c, VB2_NV_FW_PREV_RESULT, VB2_FW_RESULT_SUCCESS);
+	vb2_nv_set(&c, VB2_NV_FW_PREV_RESULT, 0x17);
+	TEST_EQ(vb2_nv_get(&c, VB2_NV_FW_PREV_RESULT),
+		VB2_FW_RESULT_UNKNOWN, "Firmware prev result out of range");
+	vb2_nv_set(&c, VB2_NV_RECOVERY_SUBCODE, 0x1AC);
+	TEST_EQ(vb2_nv_get(&c, VB2_NV_RECOVERY_SUBCODE),
+		0xAC, "Recovery subcode truncated");
+	vb2_nv_set(&c, VB2_NV_DEV_BOOT_USB, 5);
+	TEST_EQ(vb2_nv_get(&c, VB2_NV_DEV_BOOT_USB), 1, "Flag set by non-zero");
+
+	/* Fields sharing a byte leave each other alone */
+	vb2_nv_init(&c);
+	vb2_nv_set(&c, VB2_NV_FW_RESULT, VB2_FW_RESULT_TRYING);
+	vb2_nv_set(&c, VB2_NV_FW_TRIED, 1);
+	vb2_nv_set(&c, VB2_NV_TRY_NEXT, 1);
+	vb2_nv_set(&c, VB2_NV_FW_PREV_RESULT, VB2_FW_RESULT_FAILURE);
+	vb2_nv_set(&c, VB2_NV_FW_PREV_TRIED, 1);
+	TEST_EQ(c.nvdata[7], 0x7D, "Boot2 byte");
+	vb2_nv_set(&c, VB2_NV_FW_PREV_RESULT, VB2_FW_RESULT_TRYING);
+	TEST_EQ(c.nvdata[7], 0x5D, "Boot2 byte after prev result");
+	TEST_EQ(vb2_nv_get(&c, VB2_NV_FW_RESULT), VB2_FW_RESULT_TRYING,
+		"  result kept");
 }
 
 int main(int argc, char* argv[])
@@ -5,7 +5,10 @@
 
 /* FIPS 180-2 Tests for message digest functions. */
 
+#include <stdio.h>
+
 #include "2sysincludes.h"
+#include "2common.h"
 #include "2rsa.h"
 #include "2sha.h"
 #include "2return_codes.h"
@@ -43,6 +46,14 @@ void sha1_tests(void)
 	test_inputs[1] = (uint8_t *) multiblock_msg1;
 	test_inputs[2] = (uint8_t *) long_msg;
 
+	if (!VB2_SUPPORT_SHA1) {
+		TEST_EQ(vb2_digest(test_inputs[0],
+				   strlen((char *)test_inputs[0]),
+				   VB2_HASH_SHA1, digest, sizeof(digest)),
+			VB2_ERROR_SHA_INIT_ALGORITHM, "SHA1 disabled");
+		return;
+	}
+
 	for (i = 0; i < 3; i++) {
 		TEST_SUCC(vb2_digest(test_inputs[i],
 				     strlen((char *)test_inputs[i]),
@@ -81,6 +92,64 @@ void sha256_tests(void)
 		VB2_ERROR_SHA_FINALIZE_DIGEST_SIZE, "vb2_digest() too small");
 }
 
+/* Check that each SHA-256 implementation matches the C one */
+void sha256_impl_tests(void)
+{
+	static const enum vb2_sha256_impl impls[] = {
+		VB2_SHA256_IMPL_X86_SHA,
+		VB2_SHA256_IMPL_ARMV8_CE,
+	};
+	uint8_t buf[1031];
+	uint8_t expect[VB2_SHA256_DIGEST_SIZE];
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+	struct vb2_digest_context dc;
+	int i, j, size, step;
+
+	for (j = 0; j < sizeof(buf); j++)
+		buf[j] = (uint8_t)(j * 7 + (j >> 3));
+
+	TEST_SUCC(vb2_sha256_select_impl(VB2_SHA256_IMPL_C),
+		  "Select C SHA-256");
+	sha256_tests();
+	TEST_EQ(vb2_sha256_select_impl(VB2_SHA256_IMPL_ARMV8_CE + 1),
+		VB2_ERROR_SHA_IMPL_UNSUPPORTED, "Select bad SHA-256 impl");
+
+	for (i = 0; i < ARRAY_SIZE(impls); i++) {
+		if (vb2_sha256_select_impl(impls[i])) {
+			printf("SHA-256 impl %d not supported; skipping\n",
+			       impls[i]);
+			continue;
+		}
+		printf("Testing SHA-256 impl %d\n", impls[i]);
+		sha256_tests();
+
+		/* Odd sizes and odd extend boundaries, against C */
+		for (size = 0; size <= sizeof(buf); size += 37) {
+			for (step = 1; step <= 256; step *= 4) {
+				vb2_sha256_select_impl(VB2_SHA256_IMPL_C);
+				vb2_digest(buf, size, VB2_HASH_SHA256,
+					   expect, sizeof(expect));
+
+				vb2_sha256_select_impl(impls[i]);
+				vb2_digest_init(&dc, VB2_HASH_SHA256);
+				for (j = 0; j < size; j += step)
+					vb2_digest_extend(&dc, buf + j,
+						size - j < step ? size - j : step);
+				vb2_digest_finalize(&dc, digest,
+						    sizeof(digest));
+				if (memcmp(digest, expect, sizeof(digest)))
+					break;
+			}
+			if (step <= 256)
+				break;
+		}
+		TEST_EQ(size > sizeof(buf), 1, "  matches C implementation");
+	}
+
+	TEST_SUCC(vb2_sha256_select_impl(VB2_SHA256_IMPL_AUTO),
+		  "Select auto SHA-256");
+}
+
 void sha512_tests(void)
 {
 	uint8_t digest[VB2_SHA512_DIGEST_SIZE];
@@ -91,6 +160,14 @@ void sha512_tests(void)
 	test_inputs[1] = (uint8_t *) multiblock_msg2;
 	test_inputs[2] = (uint8_t *) long_msg;
 
+	if (!VB2_SUPPORT_SHA512) {
+		TEST_EQ(vb2_digest(test_inputs[0],
+				   strlen((char *)test_inputs[0]),
+				   VB2_HASH_SHA512, digest, sizeof(digest)),
+			VB2_ERROR_SHA_INIT_ALGORITHM, "SHA512 disabled");
+		return;
+	}
+
 	for (i = 0; i < 3; i++) {
 		TEST_SUCC(vb2_digest(test_inputs[i],
 				     strlen((char *)test_inputs[i]),
@@ -106,19 +183,154 @@ void sha512_tests(void)
 		VB2_ERROR_SHA_FINALIZE_DIGEST_SIZE, "vb2_digest() too small");
 }
 
+void blake2s_tests(void)
+{
+	static const uint8_t empty_digest[VB2_BLAKE2S_DIGEST_SIZE] = {
+		0x69, 0x21, 0x7a, 0x30, 0x79, 0x90, 0x80, 0x94,
+		0xe1, 0x11, 0x21, 0xd0, 0x42, 0x35, 0x4a, 0x7c,
+		0x1f, 0x55, 0xb6, 0x48, 0x2c, 0xa1, 0xa5, 0x1e,
+		0x1b, 0x25, 0x0d, 0xfd, 0x1e, 0xd0, 0xee, 0xf9
+	};
+	uint8_t digest[VB2_BLAKE2S_DIGEST_SIZE];
+	struct vb2_digest_context dc;
+	uint8_t *test_inputs[3];
+	uint32_t len, i;
+
+	test_inputs[0] = (uint8_t *) oneblock_msg;
+	test_inputs[1] = (uint8_t *) multiblock_msg2;
+	test_inputs[2] = (uint8_t *) long_msg;
+
+	if (!VB2_SUPPORT_BLAKE2S) {
+		TEST_EQ(vb2_digest(test_inputs[0],
+				   strlen((char *)test_inputs[0]),
+				   VB2_HASH_BLAKE2S, digest, sizeof(digest)),
+			VB2_ERROR_SHA_INIT_ALGORITHM, "BLAKE2s disabled");
+		return;
+	}
+
+	TEST_EQ(vb2_digest_size(VB2_HASH_BLAKE2S), VB2_BLAKE2S_DIGEST_SIZE,
+		"BLAKE2s digest size");
+
+	for (i = 0; i < 3; i++) {
+		TEST_SUCC(vb2_digest(test_inputs[i],
+				     strlen((char *)test_inputs[i]),
+				     VB2_HASH_BLAKE2S, digest,
+				     sizeof(digest)),
+			  "vb2_digest() BLAKE2s");
+		TEST_EQ(memcmp(digest, blake2s_results[i], sizeof(digest)),
+			0, "BLAKE2s digest");
+	}
+
+	TEST_SUCC(vb2_digest(test_inputs[0], 0, VB2_HASH_BLAKE2S, digest,
+			     sizeof(digest)), "vb2_digest() BLAKE2s empty");
+	TEST_EQ(memcmp(digest, empty_digest, sizeof(digest)), 0,
+		"BLAKE2s empty digest");
+
+	/*
+	 * A byte at a time, so the last block is held back at every block
+	 * boundary, and whole blocks exactly
+	 */
+	len = strlen((char *)test_inputs[1]);
+	vb2_digest_init(&dc, VB2_HASH_BLAKE2S);
+	for (i = 0; i < len; i++)
+		vb2_digest_extend(&dc, test_inputs[1] + i, 1);
+	vb2_digest_finalize(&dc, digest, sizeof(digest));
+	TEST_EQ(memcmp(digest, blake2s_results[1], sizeof(digest)), 0,
+		"BLAKE2s byte at a time");
+
+	vb2_digest_init(&dc, VB2_HASH_BLAKE2S);
+	for (i = 0; i < 1000000; i += 50000)
+		vb2_digest_extend(&dc, test_inputs[2] + i, 50000);
+	vb2_digest_finalize(&dc, digest, sizeof(digest));
+	TEST_EQ(memcmp(digest, blake2s_results[2], sizeof(digest)), 0,
+		"BLAKE2s in chunks");
+
+	TEST_EQ(vb2_digest(test_inputs[0], strlen((char *)test_inputs[0]),
+			   VB2_HASH_BLAKE2S, digest, sizeof(digest) - 1),
+		VB2_ERROR_SHA_FINALIZE_DIGEST_SIZE, "vb2_digest() too small");
+}
+
+/* Check multi-buffer digests against one buffer at a time */
+static void multi_check(enum vb2_hash_algorithm hash_alg, const char *desc)
+{
+	enum { COUNT = 23 };
+	static uint8_t data[COUNT * 700];
+	static uint8_t results[COUNT][VB2_SHA512_DIGEST_SIZE];
+	const uint8_t *bufs[COUNT];
+	uint32_t sizes[COUNT];
+	uint8_t *digests[COUNT];
+	uint8_t expect[VB2_SHA512_DIGEST_SIZE];
+	int digest_size = vb2_digest_size(hash_alg);
+	int i, bad = 0;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = (uint8_t)(i * 13 + (i >> 5));
+
+	/* Empty, short, whole blocks, and a few much longer than the rest */
+	for (i = 0; i < COUNT; i++) {
+		bufs[i] = data + i * 311;
+		sizes[i] = (i * 173) % 700;
+		digests[i] = results[i];
+	}
+	sizes[3] = 0;
+	sizes[5] = 128;
+	sizes[8] = 256;
+	sizes[12] = sizeof(data) - 12 * 311;
+	sizes[13] = 7000;
+
+	memset(results, 0, sizeof(results));
+	TEST_SUCC(vb2_digest_multi(hash_alg, COUNT, bufs, sizes, digests,
+				   digest_size), desc);
+	for (i = 0; i < COUNT; i++) {
+		vb2_digest(bufs[i], sizes[i], hash_alg,
+			   expect, sizeof(expect));
+		if (memcmp(results[i], expect, digest_size))
+			bad++;
+	}
+	TEST_EQ(bad, 0, "  digests match");
+
+	TEST_EQ(vb2_digest_multi(hash_alg, COUNT, bufs, sizes, digests,
+				 digest_size - 1),
+		VB2_ERROR_SHA_FINALIZE_DIGEST_SIZE, "  digest too small");
+}
+
+void multi_tests(void)
+{
+	if (VB2_SUPPORT_SHA1)
+		multi_check(VB2_HASH_SHA1, "vb2_digest_multi() SHA1");
+
+	/* The C transform makes SHA-256 use the lanes */
+	vb2_sha256_select_impl(VB2_SHA256_IMPL_C);
+	multi_check(VB2_HASH_SHA256, "vb2_digest_multi() SHA256 C");
+	vb2_sha256_select_impl(VB2_SHA256_IMPL_AUTO);
+	multi_check(VB2_HASH_SHA256, "vb2_digest_multi() SHA256");
+
+	if (VB2_SUPPORT_SHA512)
+		multi_check(VB2_HASH_SHA512, "vb2_digest_multi() SHA512");
+
+	if (VB2_SUPPORT_BLAKE2S)
+		multi_check(VB2_HASH_BLAKE2S, "vb2_digest_multi() BLAKE2s");
+
+	TEST_SUCC(vb2_digest_multi(VB2_HASH_SHA256, 0, NULL, NULL, NULL,
+				   VB2_SHA256_DIGEST_SIZE),
+		  "vb2_digest_multi() no buffers");
+}
+
 void misc_tests(void)
 {
 	uint8_t digest[VB2_SHA512_DIGEST_SIZE];
 	struct vb2_digest_context dc;
 
 	/* Crypto algorithm to hash algorithm mapping */
-	TEST_EQ(vb2_crypto_to_hash(VB2_ALG_RSA1024_SHA1), VB2_HASH_SHA1,
+	TEST_EQ(vb2_crypto_to_hash(VB2_ALG_RSA1024_SHA1),
+		VB2_SUPPORT_SHA1 ? VB2_HASH_SHA1 : VB2_HASH_INVALID,
 		"Crypto map to SHA1");
 	TEST_EQ(vb2_crypto_to_hash(VB2_ALG_RSA2048_SHA256), VB2_HASH_SHA256,
 		"Crypto map to SHA256");
 	TEST_EQ(vb2_crypto_to_hash(VB2_ALG_RSA4096_SHA256), VB2_HASH_SHA256,
 		"Crypto map to SHA256 2");
-	TEST_EQ(vb2_crypto_to_hash(VB2_ALG_RSA8192_SHA512), VB2_HASH_SHA512,
+	TEST_EQ(vb2_crypto_to_hash(VB2_ALG_RSA8192_SHA512),
+		VB2_SUPPORT_SHA512 ? VB2_HASH_SHA512 : VB2_HASH_INVALID,
 		"Crypto map to SHA512");
 	TEST_EQ(vb2_crypto_to_hash(VB2_ALG_COUNT), VB2_HASH_INVALID,
 		"Crypto map to invalid");
@@ -151,7 +363,10 @@ int main(int argc, char *argv[])
 
 	sha1_tests();
 	sha256_tests();
+	sha256_impl_tests();
 	sha512_tests();
+	blake2s_tests();
+	multi_tests();
 	misc_tests();
 
 	free(long_msg);
@@ -0,0 +1,209 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for firmware verification cache.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_common.h"
+#include "vboot_common.h"
+
+#include "2common.h"
+#include "2api.h"
+#include "2misc.h"
+#include "2sha.h"
+#include "2verify_cache.h"
+
+static uint8_t workbuf[VB2_WORKBUF_RECOMMENDED_SIZE]
+	__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+static struct vb2_context cc;
+static struct vb2_shared_data *sd;
+static struct vb2_verify_cache *vc;
+
+static uint8_t kb_digest[VB2_SHA256_DIGEST_SIZE];
+static uint8_t pre_digest[VB2_SHA256_DIGEST_SIZE];
+
+static void reset_common_data(void)
+{
+	memset(workbuf, 0xaa, sizeof(workbuf));
+
+	memset(&cc, 0, sizeof(cc));
+	cc.workbuf = workbuf;
+	cc.workbuf_size = sizeof(workbuf);
+	cc.flags = VB2_CONTEXT_VERIFY_CACHE;
+
+	vb2_init_context(&cc);
+	sd = vb2_get_sd(&cc);
+	sd->fw_slot = 1;
+	sd->fw_version = 0x20003;
+
+	vc = (struct vb2_verify_cache *)cc.verify_cache;
+
+	memset(kb_digest, 0x11, sizeof(kb_digest));
+	memset(pre_digest, 0x22, sizeof(pre_digest));
+};
+
+/* Check keyblock, then save a cache for the preamble */
+static void fill_cache(void)
+{
+	vb2_verify_cache_check_keyblock(&cc, kb_digest);
+	vb2_verify_cache_save(&cc, pre_digest);
+	cc.flags &= ~VB2_CONTEXT_VERIFY_CACHE_CHANGED;
+	sd->status &= ~VB2_SD_STATUS_KEYBLOCK_CACHED;
+}
+
+static void digest_tests(void)
+{
+	struct vb2_workbuf wb;
+	struct vb2_digest_context dc;
+	const char *data = "abcdef";
+	uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+	uint8_t expect[VB2_SHA256_DIGEST_SIZE];
+
+	TEST_EQ(sizeof(struct vb2_verify_cache), VB2_VERIFY_CACHE_SIZE,
+		"Struct size");
+
+	reset_common_data();
+	vb2_workbuf_from_ctx(&cc, &wb);
+	vb2_digest_init(&dc, VB2_HASH_SHA256);
+	vb2_digest_extend(&dc, (const uint8_t *)data, 6);
+	vb2_digest_finalize(&dc, expect, sizeof(expect));
+
+	TEST_SUCC(vb2_verify_cache_digest(data, 2, data + 2, 4, digest, &wb),
+		  "Digest two buffers");
+	TEST_SUCC(memcmp(digest, expect, sizeof(digest)),
+		  "  same as one buffer");
+	TEST_SUCC(vb2_verify_cache_digest(data, 6, NULL, 0, digest, &wb),
+		  "Digest one buffer");
+	TEST_SUCC(memcmp(digest, expect, sizeof(digest)), "  contents");
+
+	wb.size = sizeof(struct vb2_digest_context) - 1;
+	TEST_EQ(vb2_verify_cache_digest(data, 6, NULL, 0, digest, &wb),
+		VB2_ERROR_VERIFY_CACHE_WORKBUF, "Digest workbuf");
+}
+
+static void check_tests(void)
+{
+	/* Empty cache misses */
+	reset_common_data();
+	TEST_EQ(vb2_verify_cache_check_keyblock(&cc, kb_digest),
+		VB2_ERROR_VERIFY_CACHE_INVALID, "Empty cache");
+	TEST_SUCC(memcmp(sd->verify_cache_keyblock_digest, kb_digest,
+			 sizeof(kb_digest)), "  saved keyblock digest");
+	TEST_EQ(sd->status & VB2_SD_STATUS_KEYBLOCK_CACHED, 0, "  not cached");
+	TEST_EQ(vb2_verify_cache_check_preamble(&cc, pre_digest),
+		VB2_ERROR_VERIFY_CACHE_MISS, "  preamble needs keyblock");
+
+	/* Both hit after saving */
+	reset_common_data();
+	fill_cache();
+	TEST_SUCC(vb2_verify_cache_check_keyblock(&cc, kb_digest),
+		  "Keyblock hit");
+	TEST_NEQ(sd->status & VB2_SD_STATUS_KEYBLOCK_CACHED, 0, "  cached");
+	TEST_SUCC(vb2_verify_cache_check_preamble(&cc, pre_digest),
+		  "Preamble hit");
+	TEST_NEQ(sd->status & VB2_SD_STATUS_PREAMBLE_CACHED, 0, "  cached");
+
+	/* Disabled by caller */
+	reset_common_data();
+	fill_cache();
+	cc.flags &= ~VB2_CONTEXT_VERIFY_CACHE;
+	TEST_EQ(vb2_verify_cache_check_keyblock(&cc, kb_digest),
+		VB2_ERROR_VERIFY_CACHE_DISABLED, "Disabled");
+
+	/* Bad contents */
+	reset_common_data();
+	fill_cache();
+	vc->magic++;
+	TEST_EQ(vb2_verify_cache_check_keyblock(&cc, kb_digest),
+		VB2_ERROR_VERIFY_CACHE_INVALID, "Bad magic");
+
+	reset_common_data();
+	fill_cache();
+	vc->struct_version++;
+	TEST_EQ(vb2_verify_cache_check_keyblock(&cc, kb_digest),
+		VB2_ERROR_VERIFY_CACHE_INVALID, "Bad version");
+
+	reset_common_data();
+	fill_cache();
+	vc->keyblock_digest[4]++;
+	TEST_EQ(vb2_verify_cache_check_keyblock(&cc, kb_digest),
+		VB2_ERROR_VERIFY_CACHE_INVALID, "Bad CRC");
+
+	/* Other slot */
+	reset_common_data();
+	fill_cache();
+	sd->fw_slot = 0;
+	TEST_EQ(vb2_verify_cache_check_keyblock(&cc, kb_digest),
+		VB2_ERROR_VERIFY_CACHE_MISS, "Other slot");
+
+	/* Different keyblock */
+	reset_common_data();
+	fill_cache();
+	kb_digest[0]++;
+	TEST_EQ(vb2_verify_cache_check_keyblock(&cc, kb_digest),
+		VB2_ERROR_VERIFY_CACHE_MISS, "Different keyblock");
+	TEST_EQ(sd->status & VB2_SD_STATUS_KEYBLOCK_CACHED, 0, "  not cached");
+
+	/* Different preamble */
+	reset_common_data();
+	fill_cache();
+	vb2_verify_cache_check_keyblock(&cc, kb_digest);
+	pre_digest[31]++;
+	TEST_EQ(vb2_verify_cache_check_preamble(&cc, pre_digest),
+		VB2_ERROR_VERIFY_CACHE_MISS, "Different preamble");
+	TEST_EQ(sd->status & VB2_SD_STATUS_PREAMBLE_CACHED, 0, "  not cached");
+}
+
+static void save_tests(void)
+{
+	/* Save fills in the cache */
+	reset_common_data();
+	vb2_verify_cache_check_keyblock(&cc, kb_digest);
+	vb2_verify_cache_save(&cc, pre_digest);
+	TEST_NEQ(cc.flags & VB2_CONTEXT_VERIFY_CACHE_CHANGED, 0, "Save changes");
+	TEST_EQ(vc->magic, VB2_VERIFY_CACHE_MAGIC, "  magic");
+	TEST_EQ(vc->struct_version, VB2_VERIFY_CACHE_VERSION, "  version");
+	TEST_EQ(vc->fw_slot, 1, "  slot");
+	TEST_EQ(vc->fw_version, 0x20003, "  fw version");
+	TEST_SUCC(memcmp(vc->keyblock_digest, kb_digest, sizeof(kb_digest)),
+		  "  keyblock digest");
+	TEST_SUCC(memcmp(vc->preamble_digest, pre_digest, sizeof(pre_digest)),
+		  "  preamble digest");
+
+	/* Saving the same thing again doesn't change it */
+	cc.flags &= ~VB2_CONTEXT_VERIFY_CACHE_CHANGED;
+	vb2_verify_cache_save(&cc, pre_digest);
+	TEST_EQ(cc.flags & VB2_CONTEXT_VERIFY_CACHE_CHANGED, 0,
+		"Save same doesn't change");
+
+	/* New version does */
+	sd->fw_version++;
+	vb2_verify_cache_save(&cc, pre_digest);
+	TEST_NEQ(cc.flags & VB2_CONTEXT_VERIFY_CACHE_CHANGED, 0,
+		 "Save new version changes");
+	TEST_EQ(vc->fw_version, 0x20004, "  fw version");
+
+	/* Nothing saved if caller didn't enable the cache */
+	reset_common_data();
+	cc.flags = 0;
+	vb2_verify_cache_check_keyblock(&cc, kb_digest);
+	vb2_verify_cache_save(&cc, pre_digest);
+	TEST_EQ(cc.flags & VB2_CONTEXT_VERIFY_CACHE_CHANGED, 0,
+		"Save disabled");
+	TEST_EQ(vc->magic, 0, "  not filled in");
+}
+
+int main(int argc, char* argv[])
+{
+	digest_tests();
+	check_tests();
+	save_tests();
+
+	return gTestSuccess ? 0 : 255;
+}
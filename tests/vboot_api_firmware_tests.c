@@ -109,7 +109,8 @@ uint32_t RollbackFirmwareLock(void) {
   return mock_rfl_retval;
 }
 
-uint32_t SetTPMBootModeState(int developer_mode, int recovery_mode,
+uint32_t SetTPMBootModeState(VbSharedDataHeader *shared,
+			     int developer_mode, int recovery_mode,
 			     uint64_t fw_keyblock_flags,
 			     GoogleBinaryBlockHeader *gbb) {
   if (recovery_mode)
@@ -9,6 +9,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "2sysincludes.h"
+#include "2api.h"
+#include "2misc.h"
+#include "2secdata.h"
 #include "gbb_header.h"
 #include "host_common.h"
 #include "rollback_index.h"
@@ -35,6 +39,11 @@ static int rfs_disable_dev_request;
 static uint8_t backup_space[BACKUP_NV_SIZE];
 static int backup_write_called;
 static int backup_read_called;
+static int rfs_called;
+static int rsst_called;
+static uint8_t ctx_workbuf[VB2_WORKBUF_RECOMMENDED_SIZE]
+	__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+static struct vb2_context ctx;
 
 /* Reset mock data (for use before each test) */
 static void ResetMocks(void)
@@ -73,6 +82,23 @@ static void ResetMocks(void)
 
 	rfs_clear_tpm_request = 0;
 	rfs_disable_dev_request = 0;
+	rfs_called = 0;
+	rsst_called = 0;
+}
+
+/* Set up a vboot2 context for VbInit() to use, with that NV data */
+static void ResetVb2Context(const VbNvContext *nv)
+{
+	struct vb2_secdata *sec = (struct vb2_secdata *)ctx.secdata;
+
+	Memset(&ctx, 0, sizeof(ctx));
+	Memset(ctx_workbuf, 0, sizeof(ctx_workbuf));
+	ctx.workbuf = ctx_workbuf;
+	ctx.workbuf_size = sizeof(ctx_workbuf);
+	Memcpy(ctx.nvdata, nv->raw, sizeof(ctx.nvdata));
+	sec->struct_version = VB2_SECDATA_VERSION;
+	sec->fw_versions = 0x30004;
+	cparams.vb2_ctx = &ctx;
 }
 
 /****************************************************************************/
@@ -117,6 +143,12 @@ uint64_t VbExGetTimer(void)
 	return mock_timer;
 }
 
+uint32_t RollbackSelfTestStart(void)
+{
+	rsst_called++;
+	return TPM_SUCCESS;
+}
+
 uint32_t RollbackS3Resume(void)
 {
 	return rollback_s3_retval;
@@ -128,6 +160,7 @@ uint32_t RollbackFirmwareSetup(int is_hw_dev,
                                /* two outputs on success */
                                int *is_virt_dev, uint32_t *version)
 {
+	rfs_called++;
 	rfs_clear_tpm_request = clear_tpm_owner_request;
 	rfs_disable_dev_request = disable_dev_request;
 
@@ -169,6 +202,7 @@ static void VbInitTest(void)
 	TEST_EQ(iparams.out_flags, 0, "  out flags");
 	TEST_EQ(nv_write_called, 0,
 		"  NV write not called since nothing changed");
+	TEST_EQ(rsst_called, 1, "  TPM self test started early");
 
 	/* If NV data is trashed, we initialize it */
 	ResetMocks();
@@ -213,6 +247,26 @@ static void VbInitTest(void)
 	TestVbInit(0, 0, "  flags test EC slow update");
 	TEST_EQ(shared->flags, VBSD_EC_SLOW_UPDATE, "  shared flags");
 
+	ResetMocks();
+	iparams.flags = VB_INIT_FLAG_PARTIAL_KERNEL_CHECK;
+	TestVbInit(0, 0, "  flags test partial kernel check");
+	TEST_EQ(shared->flags, VBSD_PARTIAL_KERNEL_CHECK, "  shared flags");
+
+	ResetMocks();
+	iparams.flags = VB_INIT_FLAG_LAZY_SECONDARY_GPT;
+	TestVbInit(0, 0, "  flags test lazy secondary GPT");
+	TEST_EQ(shared->flags, VBSD_LAZY_SECONDARY_GPT, "  shared flags");
+
+	ResetMocks();
+	iparams.flags = VB_INIT_FLAG_LAZY_SECONDARY_GPT_WRITE;
+	TestVbInit(0, 0, "  flags test lazy secondary GPT write");
+	TEST_EQ(shared->flags, VBSD_LAZY_SECONDARY_GPT_WRITE, "  shared flags");
+
+	ResetMocks();
+	iparams.flags = VB_INIT_FLAG_DEV_KEY_BLOCK_HASH_FIRST;
+	TestVbInit(0, 0, "  flags test dev key block hash first");
+	TEST_EQ(shared->flags, VBSD_DEV_KEY_BLOCK_HASH_FIRST, "  shared flags");
+
 	/* S3 resume */
 	ResetMocks();
 	iparams.flags = VB_INIT_FLAG_S3_RESUME;
@@ -224,6 +278,7 @@ static void VbInitTest(void)
 	TEST_EQ(iparams.out_flags, 0, "  out flags");
 	TEST_EQ(shared->recovery_reason, 0,
 		"  S3 doesn't look at recovery request");
+	TEST_EQ(rsst_called, 0, "  no early TPM self test");
 
 	/* S3 resume with TPM resume error */
 	ResetMocks();
@@ -757,11 +812,68 @@ static void VbInitTestBackup(void)
 }
 
 
+static void VbInitTestVb2Context(void)
+{
+	struct vb2_secdata *sec = (struct vb2_secdata *)ctx.secdata;
+	VbNvContext nv;
+	uint32_t u;
+
+	/* NV data and secdata come from the context; storage isn't read */
+	ResetMocks();
+	Memcpy(&nv, &vnc, sizeof(nv));
+	VbNvSet(&nv, VBNV_LOCALIZATION_INDEX, 3);
+	VbNvTeardown(&nv);
+	ResetVb2Context(&nv);
+	mock_rfs_retval = TPM_E_IOERROR;
+	TestVbInit(0, 0, "vb2 context");
+	TEST_EQ(rfs_called, 0, "  no RollbackFirmwareSetup()");
+	TEST_EQ(rsst_called, 0, "  no RollbackSelfTestStart()");
+	TEST_EQ(nv_write_called, 0, "  nothing to write");
+	TEST_EQ(shared->fw_version_tpm, 0x30004, "  shared fw_version_tpm");
+	TEST_EQ(shared->fw_version_tpm_start, 0x30004, "  fw_version_tpm_start");
+	TEST_EQ(shared->flags, 0, "  shared flags");
+
+	/* Virtual dev switch comes from secdata */
+	ResetMocks();
+	ResetVb2Context(&vnc);
+	sec->flags = VB2_SECDATA_FLAG_DEV_MODE;
+	iparams.flags = VB_INIT_FLAG_VIRTUAL_DEV_SWITCH;
+	TestVbInit(0, 0, "vb2 context dev mode");
+	TEST_EQ(shared->flags,
+		VBSD_BOOT_DEV_SWITCH_ON | VBSD_HONOR_VIRT_DEV_SWITCH,
+		"  shared flags");
+
+	/* Changes are written, and copied back to the context */
+	ResetMocks();
+	Memcpy(&nv, &vnc, sizeof(nv));
+	VbNvSet(&nv, VBNV_DISABLE_DEV_REQUEST, 1);
+	VbNvTeardown(&nv);
+	ResetVb2Context(&nv);
+	ctx.flags |= VB2_CONTEXT_NVDATA_CHANGED;
+	iparams.flags = VB_INIT_FLAG_VIRTUAL_DEV_SWITCH;
+	TestVbInit(0, 0, "vb2 context NV change");
+	TEST_EQ(nv_write_called, 1, "  written");
+	VbNvGet(&vnc, VBNV_DISABLE_DEV_REQUEST, &u);
+	TEST_EQ(u, 0, "  disable dev request cleared");
+	TEST_EQ(memcmp(ctx.nvdata, vnc.raw, sizeof(vnc.raw)), 0,
+		"  context updated");
+	TEST_EQ(ctx.flags & VB2_CONTEXT_NVDATA_CHANGED, 0,
+		"  context doesn't need writing");
+
+	/* NV data the context reset is restored from backup */
+	ResetMocks();
+	ResetVb2Context(&vnc);
+	vb2_get_sd(&ctx)->status = VB2_SD_STATUS_NV_REINIT;
+	TestVbInit(0, 0, "vb2 context lost NV");
+	TEST_EQ(backup_read_called, 1, "  backup read");
+}
+
 int main(int argc, char *argv[])
 {
 	VbInitTest();
 	VbInitTestTPM();
 	VbInitTestBackup();
+	VbInitTestVb2Context();
 
 	return gTestSuccess ? 0 : 255;
 }
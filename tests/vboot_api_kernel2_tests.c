@@ -44,12 +44,22 @@ static uint32_t screens_displayed[8];
 static uint32_t screens_count = 0;
 static uint32_t mock_num_disks[8];
 static uint32_t mock_num_disks_count;
+static VbError_t mock_disk_wait_retval[8];
+static uint32_t mock_disk_wait_count;
+static int disk_wait_calls;
+static int vbtlk_calls;
+static VbError_t mock_key_wait_retval;
+static int key_wait_calls;
+static uint32_t key_wait_timeout;
+static uint32_t mock_audio_wait_ms;
 
 extern enum VbEcBootMode_t VbGetMode(void);
 
 /* Reset mock data (for use before each test) */
 static void ResetMocks(void)
 {
+	int i;
+
 	Memset(&cparams, 0, sizeof(cparams));
 	cparams.shared_data_size = sizeof(shared_data);
 	cparams.shared_data_blob = shared_data;
@@ -95,6 +105,19 @@ static void ResetMocks(void)
 
 	Memset(mock_num_disks, 0, sizeof(mock_num_disks));
 	mock_num_disks_count = 0;
+
+	/* Polling, unless a test says otherwise */
+	for (i = 0; i < ARRAY_SIZE(mock_disk_wait_retval); i++)
+		mock_disk_wait_retval[i] = VBERROR_DISK_NO_CHANGE;
+	mock_disk_wait_retval[0] = VBERROR_DISK_WAIT_UNSUPPORTED;
+	mock_disk_wait_count = 0;
+	disk_wait_calls = 0;
+	vbtlk_calls = 0;
+
+	mock_key_wait_retval = VBERROR_KEYBOARD_WAIT_UNSUPPORTED;
+	key_wait_calls = 0;
+	key_wait_timeout = 0;
+	mock_audio_wait_ms = 1000;
 }
 
 /* Mock functions */
@@ -114,6 +137,13 @@ uint32_t VbExKeyboardRead(void)
 	return VbExKeyboardReadWithFlags(NULL);
 }
 
+VbError_t VbExKeyboardWait(uint32_t timeout_ms)
+{
+	key_wait_calls++;
+	key_wait_timeout = timeout_ms;
+	return mock_key_wait_retval;
+}
+
 uint32_t VbExKeyboardReadWithFlags(uint32_t *key_flags)
 {
 	if (mock_keypress_count < ARRAY_SIZE(mock_keypress)) {
@@ -160,6 +190,16 @@ VbError_t VbExDiskFreeInfo(VbDiskInfo *infos,
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbExDiskWaitForChange(uint32_t disk_flags, uint32_t timeout_ms)
+{
+	disk_wait_calls++;
+
+	/* After the mocked results run out, nothing changes */
+	if (mock_disk_wait_count < ARRAY_SIZE(mock_disk_wait_retval))
+		return mock_disk_wait_retval[mock_disk_wait_count++];
+	return VBERROR_DISK_NO_CHANGE;
+}
+
 int VbExTrustEC(int devidx)
 {
 	return trust_ec;
@@ -175,9 +215,15 @@ int VbAudioLooping(VbAudioContext *audio)
 	return 1;
 }
 
+uint32_t VbAudioWaitMs(VbAudioContext *audio)
+{
+	return mock_audio_wait_ms;
+}
+
 uint32_t VbTryLoadKernel(VbCommonParams *cparams, LoadKernelParams *p,
                          uint32_t get_info_flags)
 {
+	vbtlk_calls++;
 	return vbtlk_retval + get_info_flags;
 }
 
@@ -258,6 +304,26 @@ static void VbUserConfirmsTest(void)
 			       VB_CONFIRM_MUST_TRUST_KEYBOARD),
 		0, "Recovery button stuck");
 
+	/* Developer mode tries waiting for keys again */
+	ResetMocks();
+	mock_key_wait_retval = VBERROR_SUCCESS;
+	VbBootDeveloper(&cparams, &lkp);
+
+	/* A physical recovery button is polled more often */
+	ResetMocks();
+	mock_key_wait_retval = VBERROR_SUCCESS;
+	mock_keypress[1] = '\r';
+	TEST_EQ(VbUserConfirms(&cparams, 0), 1, "Wait for keys");
+	TEST_EQ(key_wait_calls, 1, "  waited");
+	TEST_EQ(key_wait_timeout, 20, "  polling rec button");
+
+	ResetMocks();
+	mock_key_wait_retval = VBERROR_SUCCESS;
+	shared->flags |= VBSD_BOOT_REC_SWITCH_VIRTUAL;
+	mock_keypress[1] = '\r';
+	TEST_EQ(VbUserConfirms(&cparams, 0), 1, "Wait for keys, virtual rec");
+	TEST_EQ(key_wait_timeout, 100, "  longer wait");
+
 	printf("...done.\n");
 }
 
@@ -442,6 +508,29 @@ static void VbBootDevTest(void)
 	TEST_EQ(u, 0, "  recovery reason");
 	TEST_EQ(audio_looping_calls_left, 0, "  used up audio");
 
+	/* Waits for keys between notes, if the platform can */
+	ResetMocks();
+	mock_key_wait_retval = VBERROR_SUCCESS;
+	TEST_EQ(VbBootDeveloper(&cparams, &lkp), 1002, "Wait for keys");
+	TEST_EQ(key_wait_calls, 31, "  waited each time");
+	TEST_EQ(key_wait_timeout, 100, "  up to 100ms");
+
+	ResetMocks();
+	mock_key_wait_retval = VBERROR_SUCCESS;
+	mock_audio_wait_ms = 7;
+	TEST_EQ(VbBootDeveloper(&cparams, &lkp), 1002, "Wait for next note");
+	TEST_EQ(key_wait_timeout, 7, "  until the note");
+
+	ResetMocks();
+	mock_key_wait_retval = VBERROR_SUCCESS;
+	mock_audio_wait_ms = 0;
+	TEST_EQ(VbBootDeveloper(&cparams, &lkp), 1002, "Note due now");
+	TEST_EQ(key_wait_calls, 0, "  no wait");
+
+	ResetMocks();
+	TEST_EQ(VbBootDeveloper(&cparams, &lkp), 1002, "Can't wait for keys");
+	TEST_EQ(key_wait_calls, 1, "  asked once, then polled");
+
 	printf("...done.\n");
 }
 
@@ -539,6 +628,57 @@ static void VbBootRecTest(void)
 	TEST_EQ(screens_displayed[2], VB_SCREEN_RECOVERY_INSERT,
 		"  insert screen");
 
+	/* Without disk change events, disks are looked at every second */
+	ResetMocks();
+	vbtlk_retval = VBERROR_NO_DISK_FOUND - VB_DISK_FLAG_REMOVABLE;
+	shared->flags |= VBSD_BOOT_REC_SWITCH_ON;
+	shutdown_request_calls_left = 120;
+	TEST_EQ(VbBootRecovery(&cparams, &lkp), VBERROR_SHUTDOWN_REQUESTED,
+		"Poll for disks");
+	TEST_EQ(vbtlk_calls, 3, "  try every second");
+	TEST_EQ(disk_wait_calls, 1, "  wait unsupported");
+
+	/* With them, only when they change */
+	ResetMocks();
+	vbtlk_retval = VBERROR_NO_DISK_FOUND - VB_DISK_FLAG_REMOVABLE;
+	shared->flags |= VBSD_BOOT_REC_SWITCH_ON;
+	shutdown_request_calls_left = 120;
+	mock_disk_wait_retval[0] = VBERROR_DISK_NO_CHANGE;
+	TEST_EQ(VbBootRecovery(&cparams, &lkp), VBERROR_SHUTDOWN_REQUESTED,
+		"Wait for disks");
+	TEST_EQ(vbtlk_calls, 1, "  try once");
+	TEST_EQ(disk_wait_calls, 120, "  wait between key checks");
+
+	ResetMocks();
+	vbtlk_retval = VBERROR_NO_DISK_FOUND - VB_DISK_FLAG_REMOVABLE;
+	shared->flags |= VBSD_BOOT_REC_SWITCH_ON;
+	shutdown_request_calls_left = 120;
+	mock_disk_wait_retval[0] = VBERROR_DISK_NO_CHANGE;
+	mock_disk_wait_retval[1] = VBERROR_DISK_NO_CHANGE;
+	mock_disk_wait_retval[2] = VBERROR_SUCCESS;
+	mock_disk_wait_retval[3] = VBERROR_SUCCESS;
+	TEST_EQ(VbBootRecovery(&cparams, &lkp), VBERROR_SHUTDOWN_REQUESTED,
+		"Disk change");
+	TEST_EQ(vbtlk_calls, 3, "  try again at once");
+
+	/* Waiting for disks to be removed too */
+	ResetMocks();
+	shutdown_request_calls_left = 100;
+	mock_num_disks[0] = 1;
+	mock_num_disks[1] = 1;
+	mock_num_disks[2] = 0;
+	mock_disk_wait_retval[0] = VBERROR_DISK_NO_CHANGE;
+	mock_disk_wait_retval[1] = VBERROR_SUCCESS;
+	vbtlk_retval = VBERROR_NO_DISK_FOUND - VB_DISK_FLAG_REMOVABLE;
+	TEST_EQ(VbBootRecovery(&cparams, &lkp), VBERROR_SHUTDOWN_REQUESTED,
+		"Wait for removal");
+	TEST_EQ(mock_num_disks_count, 3, "  looked after removal");
+	TEST_EQ(screens_displayed[0], VB_SCREEN_RECOVERY_REMOVE,
+		"  remove screen");
+	TEST_EQ(screens_displayed[1], VB_SCREEN_BLANK,
+		"  blank screen");
+	TEST_EQ(vbtlk_calls, 1, "  try once");
+
 	/* Bad disk count doesn't require removal */
 	ResetMocks();
 	mock_num_disks[0] = -1;
@@ -36,6 +36,13 @@ static int ec_run_image;
 static int update_retval;
 static int ec_updated;
 static int get_expected_retval;
+static int get_expected_calls;
+static int chunk_size;
+static int chunk_hash_retval;
+static int chunk_update_retval;
+static uint32_t chunk_differs;
+static uint32_t chunks_written;
+static int chunk_bytes_written;
 static int shutdown_request_calls_left;
 
 static uint8_t mock_ec_hash[32];
@@ -81,6 +88,13 @@ static void ResetMocks(void)
 	update_retval = VBERROR_SUCCESS;
 	run_retval = VBERROR_SUCCESS;
 	get_expected_retval = VBERROR_SUCCESS;
+	get_expected_calls = 0;
+	chunk_size = 0;
+	chunk_hash_retval = VBERROR_SUCCESS;
+	chunk_update_retval = VBERROR_SUCCESS;
+	chunk_differs = 0;
+	chunks_written = 0;
+	chunk_bytes_written = 0;
 	shutdown_request_calls_left = -1;
 
 	Memset(mock_ec_hash, 0, sizeof(mock_ec_hash));
@@ -151,6 +165,7 @@ VbError_t VbExEcGetExpectedRW(int devidx, enum VbSelectFirmware_t select,
                               const uint8_t **image, int *image_size)
 {
 	static uint8_t fake_image[64] = {5, 6, 7, 8};
+	get_expected_calls++;
 	*image = fake_image;
 	*image_size = sizeof(fake_image);
 	return get_expected_retval;
@@ -180,6 +195,35 @@ VbError_t VbExEcUpdateRW(int devidx, const uint8_t *image, int image_size)
 	return update_retval;
 }
 
+VbError_t VbExEcGetRWChunkSize(int devidx, int *chunk_size_ptr)
+{
+	*chunk_size_ptr = chunk_size;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExEcHashRWChunk(int devidx, int offset, int size,
+			    const uint8_t **hash, int *hash_size)
+{
+	static uint8_t chunk_hash[32];
+
+	/* Chunks flagged in chunk_differs don't match the expected image */
+	Memcpy(chunk_hash, mock_sha, sizeof(chunk_hash));
+	if (chunk_differs & (1 << (offset / chunk_size)))
+		chunk_hash[1]++;
+
+	*hash = chunk_hash;
+	*hash_size = sizeof(chunk_hash);
+	return chunk_hash_retval;
+}
+
+VbError_t VbExEcUpdateRWChunk(int devidx, int offset, const uint8_t *data,
+			      int size)
+{
+	chunks_written |= 1 << (offset / chunk_size);
+	chunk_bytes_written += size;
+	return chunk_update_retval;
+}
+
 VbError_t VbDisplayScreen(VbCommonParams *cparams, uint32_t screen, int force,
                           VbNvContext *vncptr)
 {
@@ -283,6 +327,51 @@ static void VbSoftwareSyncTest(void)
 	test_ssync(VBERROR_EC_REBOOT_TO_RO_REQUIRED,
 		   VBNV_RECOVERY_EC_EXPECTED_IMAGE, "Can't fetch image");
 
+	/* Hash from the firmware preamble */
+	ResetMocks();
+	mock_in_rw = 1;
+	want_ec_hash_size = -1;
+	Memcpy(shared->ec_rw_hash, mock_ec_hash, sizeof(shared->ec_rw_hash));
+	shared->ec_rw_hash_size = sizeof(shared->ec_rw_hash);
+	test_ssync(0, 0, "Preamble hash");
+	TEST_EQ(get_expected_calls, 0, "  image not fetched");
+	TEST_EQ(ec_updated, 0, "  ec not updated");
+
+	ResetMocks();
+	want_ec_hash_size = -1;
+	mock_ec_hash[0]++;
+	Memcpy(shared->ec_rw_hash, mock_sha, sizeof(shared->ec_rw_hash));
+	shared->ec_rw_hash_size = sizeof(shared->ec_rw_hash);
+	test_ssync(0, 0, "Preamble hash differs from EC");
+	TEST_EQ(get_expected_calls, 1, "  image fetched");
+	TEST_EQ(ec_updated, 1, "  ec updated");
+
+	ResetMocks();
+	want_ec_hash_size = -1;
+	mock_ec_hash[0]++;
+	Memcpy(shared->ec_rw_hash, mock_sha, sizeof(shared->ec_rw_hash));
+	shared->ec_rw_hash[1]++;
+	shared->ec_rw_hash_size = sizeof(shared->ec_rw_hash);
+	test_ssync(VBERROR_EC_REBOOT_TO_RO_REQUIRED,
+		   VBNV_RECOVERY_EC_HASH_MISMATCH,
+		   "Preamble hash differs from image");
+
+	ResetMocks();
+	mock_in_rw = 1;
+	Memcpy(shared->ec_rw_hash, mock_ec_hash, sizeof(shared->ec_rw_hash));
+	shared->ec_rw_hash[0]++;
+	shared->ec_rw_hash_size = sizeof(shared->ec_rw_hash);
+	test_ssync(0, 0, "BIOS hash wins over preamble hash");
+	TEST_EQ(ec_updated, 0, "  ec not updated");
+
+	ResetMocks();
+	mock_in_rw = 1;
+	want_ec_hash_size = -1;
+	Memcpy(shared->ec_rw_hash, mock_ec_hash, sizeof(shared->ec_rw_hash));
+	shared->ec_rw_hash_size = 16;
+	test_ssync(0, 0, "Preamble hash wrong size");
+	TEST_EQ(get_expected_calls, 1, "  image fetched");
+
 	/* Updates required */
 	ResetMocks();
 	mock_in_rw = 1;
@@ -323,6 +412,49 @@ static void VbSoftwareSyncTest(void)
 	test_ssync(0, 0, "Slow update");
 	TEST_EQ(screens_displayed[0], VB_SCREEN_WAIT, "  wait screen");
 
+	/* Chunked updates */
+	ResetMocks();
+	mock_ec_hash[0]++;
+	chunk_size = 16;
+	chunk_differs = 0x0a;
+	test_ssync(0, 0, "Chunked update");
+	TEST_EQ(ec_updated, 0, "  not updated whole");
+	TEST_EQ(chunks_written, 0x0a, "  only changed chunks written");
+	TEST_EQ(chunk_bytes_written, 32, "  bytes written");
+	TEST_EQ(ec_run_image, 1, "  ec run image");
+
+	ResetMocks();
+	mock_ec_hash[0]++;
+	chunk_size = 24;
+	chunk_differs = 0x04;
+	test_ssync(0, 0, "Chunked update, short last chunk");
+	TEST_EQ(chunks_written, 0x04, "  last chunk written");
+	TEST_EQ(chunk_bytes_written, 16, "  bytes written");
+
+	ResetMocks();
+	mock_ec_hash[0]++;
+	chunk_size = 16;
+	chunk_hash_retval = VBERROR_SIMULATED;
+	test_ssync(0, 0, "Chunked update, can't hash chunks");
+	TEST_EQ(chunks_written, 0x0f, "  all chunks written");
+
+	ResetMocks();
+	mock_ec_hash[0]++;
+	chunk_size = 16;
+	chunk_differs = 0x0f;
+	chunk_update_retval = VBERROR_SIMULATED;
+	test_ssync(VBERROR_EC_REBOOT_TO_RO_REQUIRED,
+		   VBNV_RECOVERY_EC_UPDATE, "Chunked update failed");
+	TEST_EQ(chunks_written, 0x01, "  stopped at first failure");
+
+	ResetMocks();
+	mock_ec_hash[0]++;
+	chunk_size = 16;
+	chunk_differs = 0x0f;
+	chunk_update_retval = VBERROR_EC_REBOOT_TO_RO_REQUIRED;
+	test_ssync(VBERROR_EC_REBOOT_TO_RO_REQUIRED,
+		   0, "Reboot during chunked update");
+
 	/* RW cases, no update */
 	ResetMocks();
 	mock_in_rw = 1;
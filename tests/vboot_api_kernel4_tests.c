@@ -29,6 +29,9 @@ static VbSharedDataHeader *shared = (VbSharedDataHeader *)shared_data;
 static GoogleBinaryBlockHeader gbb;
 
 static int ecsync_retval;
+static int ecsync_start_retval;
+static int ecsync_calls;
+static int ecsync_before_boot;
 static uint32_t rkr_version;
 static uint32_t new_version;
 static int rkr_retval, rkw_retval, rkl_retval;
@@ -37,6 +40,8 @@ static VbError_t vbboot_retval;
 /* Reset mock data (for use before each test) */
 static void ResetMocks(void)
 {
+	MockCostReset();
+
 	Memset(&cparams, 0, sizeof(cparams));
 	cparams.shared_data_size = sizeof(shared_data);
 	cparams.shared_data_blob = shared_data;
@@ -58,6 +63,9 @@ static void ResetMocks(void)
 	VbSharedDataInit(shared, sizeof(shared_data));
 
 	ecsync_retval = VBERROR_SUCCESS;
+	ecsync_start_retval = VBERROR_EC_HASH_START_UNSUPPORTED;
+	ecsync_calls = 0;
+	ecsync_before_boot = -1;
 	rkr_version = new_version = 0x10002;
 	rkr_retval = rkw_retval = rkl_retval = VBERROR_SUCCESS;
 	vbboot_retval = VBERROR_SUCCESS;
@@ -73,12 +81,19 @@ VbError_t VbExNvStorageRead(uint8_t *buf)
 
 VbError_t VbExNvStorageWrite(const uint8_t *buf)
 {
+	MockCostNvWrite();
 	Memcpy(vnc.raw, buf, sizeof(vnc.raw));
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbExEcHashRWStart(int devidx)
+{
+	return ecsync_start_retval;
+}
+
 VbError_t VbEcSoftwareSync(int devidx, VbCommonParams *cparams)
 {
+	ecsync_calls++;
 	return ecsync_retval;
 }
 
@@ -103,6 +118,7 @@ uint32_t RollbackKernelLock(int recovery_mode)
 VbError_t VbBootNormal(VbCommonParams *cparams, LoadKernelParams *p)
 {
 	shared->kernel_version_tpm = new_version;
+	ecsync_before_boot = ecsync_calls;
 
 	if (vbboot_retval == -1)
 		return VBERROR_SIMULATED;
@@ -162,6 +178,45 @@ static void VbSlkTest(void)
 	ecsync_retval = VBERROR_SIMULATED;
 	test_slk(0, 0, "EC sync disabled by GBB");
 
+	ResetMocks();
+	shared->flags |= VBSD_EC_SOFTWARE_SYNC;
+	test_slk(0, 0, "EC sync before kernel");
+	TEST_EQ(ecsync_before_boot, 1, "  synced first");
+
+	ResetMocks();
+	shared->flags |= VBSD_EC_SOFTWARE_SYNC;
+	ecsync_start_retval = VBERROR_SUCCESS;
+	test_slk(0, 0, "EC sync overlaps kernel load");
+	TEST_EQ(ecsync_before_boot, 0, "  not synced first");
+	TEST_EQ(ecsync_calls, 1, "  synced after");
+
+	ResetMocks();
+	shared->flags |= VBSD_EC_SOFTWARE_SYNC;
+	ecsync_start_retval = VBERROR_SUCCESS;
+	ecsync_retval = VBERROR_SIMULATED;
+	test_slk(VBERROR_SIMULATED, 0, "EC sync bad after kernel load");
+	TEST_PTR_EQ(kparams.disk_handle, NULL, "  no disk returned");
+
+	ResetMocks();
+	shared->flags |= VBSD_EC_SOFTWARE_SYNC;
+	ecsync_start_retval = VBERROR_SUCCESS;
+	vbboot_retval = -1;
+	test_slk(VBERROR_SIMULATED, 0, "No EC sync if no kernel");
+	TEST_EQ(ecsync_calls, 0, "  not synced");
+
+	ResetMocks();
+	shared->flags |= VBSD_EC_SOFTWARE_SYNC | VBSD_BOOT_DEV_SWITCH_ON;
+	ecsync_start_retval = VBERROR_SUCCESS;
+	test_slk(0, 0, "Dev mode EC sync before kernel");
+	TEST_EQ(ecsync_calls, 1, "  synced");
+
+	ResetMocks();
+	shared->flags |= VBSD_EC_SOFTWARE_SYNC;
+	shared->recovery_reason = 123;
+	ecsync_start_retval = VBERROR_SUCCESS;
+	test_slk(0, 0, "Recovery EC sync before kernel");
+	TEST_EQ(ecsync_calls, 1, "  synced");
+
 	/* Rollback kernel version */
 	ResetMocks();
 	rkr_retval = 123;
@@ -241,9 +296,45 @@ static void VbSlkTest(void)
 
 }
 
+/* Test how often each boot scenario writes NV storage; it's slow */
+static void VbSlkCostTest(void)
+{
+	ResetMocks();
+	test_slk(0, 0, "Normal boot NV writes");
+	TEST_LE(mock_cost.nv_writes, 0, "  none");
+
+	ResetMocks();
+	new_version = 0x20003;
+	test_slk(0, 0, "Roll forward NV writes");
+	TEST_LE(mock_cost.nv_writes, 0, "  none");
+
+	ResetMocks();
+	shared->flags |= VBSD_BOOT_DEV_SWITCH_ON;
+	test_slk(0, 0, "Dev boot NV writes");
+	TEST_LE(mock_cost.nv_writes, 0, "  none");
+
+	ResetMocks();
+	shared->recovery_reason = 123;
+	test_slk(0, 0, "Recovery boot NV writes");
+	TEST_LE(mock_cost.nv_writes, 0, "  none");
+
+	ResetMocks();
+	vbboot_retval = -1;
+	test_slk(VBERROR_SIMULATED, 0, "Failed boot NV writes");
+	TEST_LE(mock_cost.nv_writes, 0, "  none");
+
+	/* Asking for recovery takes exactly one */
+	ResetMocks();
+	rkr_retval = 123;
+	test_slk(VBERROR_TPM_READ_KERNEL,
+		 VBNV_RECOVERY_RW_TPM_R_ERROR, "Recovery request NV writes");
+	TEST_EQ(mock_cost.nv_writes, 1, "  one");
+}
+
 int main(void)
 {
 	VbSlkTest();
+	VbSlkCostTest();
 
 	if (vboot_api_stub_check_memory())
 		return 255;
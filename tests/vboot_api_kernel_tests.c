@@ -173,6 +173,23 @@ test_case_t test[] = {
 		.expected_to_load_disk = 0,
 		.expected_return_val = 1
 	},
+	{
+		.name = "native 4K drive",
+		.want_flags = VB_DISK_FLAG_FIXED,
+		.disks_to_provide = {
+			/* wrong LBA */
+			{1024, 100,  VB_DISK_FLAG_FIXED, 0},
+			{4096, 100,  VB_DISK_FLAG_FIXED, pickme},
+		},
+		.disk_count_to_return = DEFAULT_COUNT,
+		.diskgetinfo_return_val = VBERROR_SUCCESS,
+		.loadkernel_return_val = {0, 1, 1, 1, 1, 1, 1, 1, 1, 1,},
+
+		.expected_recovery_request_val = VBNV_RECOVERY_NOT_REQUESTED,
+		.expected_to_find_disk = pickme,
+		.expected_to_load_disk = pickme,
+		.expected_return_val = VBERROR_SUCCESS
+	},
 };
 
 /****************************************************************************/
@@ -187,6 +204,7 @@ static const char *got_find_disk;
 static const char *got_load_disk;
 static uint32_t got_return_val;
 static uint32_t got_external_mismatch;
+static uint8_t mock_header_fill;
 
 /**
  * Reset mock data (for use before each test)
@@ -196,6 +214,7 @@ static void ResetMocks(int i)
 	Memset(&lkparams, 0, sizeof(lkparams));
 	Memset(&mock_disks, 0, sizeof(mock_disks));
 	load_kernel_calls = 0;
+	mock_header_fill = 0;
 
 	got_recovery_request_val = VBNV_RECOVERY_NOT_REQUESTED;
 	got_find_disk = 0;
@@ -275,6 +294,19 @@ VbError_t VbExDiskFreeInfo(VbDiskInfo *infos,
 	return VBERROR_SUCCESS;
 }
 
+VbError_t VbExDiskRead(VbExDiskHandle_t handle, uint64_t lba_start,
+                       uint64_t lba_count, void *buffer)
+{
+	const char *name = (const char *)handle;
+	char *p = (char *)buffer;
+
+	/* Each disk's GPT header sector holds its name */
+	Memset(buffer, mock_header_fill, lba_count * 512);
+	while (*name)
+		*p++ = *name++;
+	return VBERROR_SUCCESS;
+}
+
 VbError_t LoadKernel(LoadKernelParams *params, VbCommonParams *cparams)
 {
 	got_find_disk = (const char *)params->disk_handle;
@@ -319,9 +351,55 @@ static void VbTryLoadKernelTest(void)
 	}
 }
 
+static void VbTryLoadKernelCacheTest(void)
+{
+	/* The "no valid drives" case, where two drives fail to load */
+	int i = 4;
+
+	printf("Testing VbTryLoadKernelCache()...\n");
+
+	ResetMocks(i);
+	VbTryLoadKernelCache(1);
+	TEST_EQ(VbTryLoadKernel(0, &lkparams, test[i].want_flags), 1,
+		"First try");
+	TEST_EQ(load_kernel_calls, 2, "  tried both");
+
+	ResetMocks(i);
+	TEST_EQ(VbTryLoadKernel(0, &lkparams, test[i].want_flags), 1,
+		"Second try");
+	TEST_EQ(load_kernel_calls, 0, "  tried neither");
+	TEST_EQ(got_recovery_request_val, VBNV_RECOVERY_RW_NO_KERNEL,
+		"  recovery_request");
+	TEST_PTR_EQ(got_load_disk, 0, "  load disk");
+
+	ResetMocks(i);
+	mock_header_fill = 1;
+	TEST_EQ(VbTryLoadKernel(0, &lkparams, test[i].want_flags), 1,
+		"Changed GPT");
+	TEST_EQ(load_kernel_calls, 2, "  tried both");
+
+	ResetMocks(i);
+	test[i].disks_to_provide[6].lba_count = 200;
+	mock_header_fill = 1;
+	TEST_EQ(VbTryLoadKernel(0, &lkparams, test[i].want_flags), 1,
+		"Changed size");
+	TEST_EQ(load_kernel_calls, 1, "  tried one");
+	test[i].disks_to_provide[6].lba_count = 100;
+
+	ResetMocks(i);
+	VbTryLoadKernelCache(0);
+	TEST_EQ(VbTryLoadKernel(0, &lkparams, test[i].want_flags), 1,
+		"Not remembered");
+	TEST_EQ(load_kernel_calls, 2, "  tried both");
+	TEST_EQ(VbTryLoadKernel(0, &lkparams, test[i].want_flags), 1,
+		"Still not remembered");
+	TEST_EQ(load_kernel_calls, 4, "  tried both again");
+}
+
 int main(void)
 {
 	VbTryLoadKernelTest();
+	VbTryLoadKernelCacheTest();
 
 	if (vboot_api_stub_check_memory())
 		return 255;
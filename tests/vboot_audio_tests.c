@@ -50,6 +50,11 @@ static uint8_t notebuf[sizeof(good_header) +
 static VbDevMusic *use_hdr;
 static VbDevMusicNote *use_notes;
 static uint32_t use_size;
+static uint64_t mock_timer;
+static int beep_calls;
+static VbError_t mock_beep_notes_retval;
+static const VbBeepNote *beep_notes;
+static uint32_t beep_notes_count;
 
 /* Set correct checksum for custom notes */
 void FixChecksum(VbDevMusic *hdr) {
@@ -73,6 +78,11 @@ static void ResetMocks(void) {
   Memcpy(use_notes, good_notes, sizeof(good_notes));
   FixChecksum(use_hdr);
   use_size = sizeof(notebuf);
+  mock_timer = 0;
+  beep_calls = 0;
+  mock_beep_notes_retval = VBERROR_BEEP_NOTES_UNSUPPORTED;
+  beep_notes = 0;
+  beep_notes_count = 0;
 }
 
 /* Compare two sets of notes */
@@ -103,6 +113,26 @@ uint32_t VbExMaxMusicSize(void) {
   return use_size;
 }
 
+/* Time passes only while sleeping, 1000 ticks per msec */
+uint64_t VbExGetTimer(void) {
+  return mock_timer;
+}
+
+void VbExSleepMs(uint32_t msec) {
+  mock_timer += msec * 1000ULL;
+}
+
+VbError_t VbExBeep(uint32_t msec, uint32_t frequency) {
+  beep_calls++;
+  return VBERROR_SUCCESS;
+}
+
+VbError_t VbExBeepNotes(const VbBeepNote *notes, uint32_t count) {
+  beep_notes = notes;
+  beep_notes_count = count;
+  return mock_beep_notes_retval;
+}
+
 
 /****************************************************************************/
 
@@ -216,10 +246,71 @@ static void VbAudioTest(void) {
 }
 
 
+static void VbAudioWaitTest(void) {
+  VbAudioContext* a = 0;
+
+  ResetMocks();
+  a = VbAudioOpen(&cparams);
+  TEST_EQ(VbAudioWaitMs(a), 0, "VbAudioWaitMs( first note due )");
+  VbAudioLooping(a);
+  TEST_EQ(VbAudioWaitMs(a), 100, "VbAudioWaitMs( first note )");
+  mock_timer += 40 * 1000;
+  TEST_EQ(VbAudioWaitMs(a), 60, "VbAudioWaitMs( partway )");
+  mock_timer += 60 * 1000;
+  TEST_EQ(VbAudioWaitMs(a), 0, "VbAudioWaitMs( next note due )");
+  VbAudioLooping(a);
+  TEST_EQ(VbAudioWaitMs(a), 100, "VbAudioWaitMs( second note )");
+
+  /* Skipping ahead lands in the right note */
+  mock_timer += 450 * 1000;
+  VbAudioLooping(a);
+  TEST_EQ(a->next_note, 5, "VbAudioWaitMs( skip ) note");
+  TEST_EQ(VbAudioWaitMs(a), 250, "VbAudioWaitMs( skip )");
+
+  /* And the end is the end */
+  mock_timer += 31000 * 1000;
+  TEST_EQ(VbAudioLooping(a), 0, "VbAudioWaitMs( end ) not looping");
+  TEST_EQ(VbAudioWaitMs(a), 0, "VbAudioWaitMs( end )");
+  VbAudioClose(a);
+}
+
+static void VbAudioNotesTest(void) {
+  VbAudioContext* a = 0;
+
+  /* Played a note at a time */
+  ResetMocks();
+  a = VbAudioOpen(&cparams);
+  TEST_EQ(beep_notes_count, use_hdr->count, "VbExBeepNotes( unsupported )");
+  TEST_EQ(a->playing_notes, 0, "VbExBeepNotes( unsupported ) not playing");
+  beep_calls = 0;
+  VbAudioLooping(a);
+  TEST_EQ(beep_calls, 1, "VbExBeepNotes( unsupported ) beeps");
+  VbAudioClose(a);
+
+  /* Played all at once */
+  ResetMocks();
+  mock_beep_notes_retval = VBERROR_SUCCESS;
+  a = VbAudioOpen(&cparams);
+  TEST_PTR_EQ(beep_notes, a->music_notes, "VbExBeepNotes( notes )");
+  TEST_EQ(beep_notes_count, a->note_count, "VbExBeepNotes( count )");
+  TEST_EQ(a->playing_notes, 1, "VbExBeepNotes( playing )");
+  beep_calls = 0;
+  VbAudioLooping(a);
+  mock_timer += 100 * 1000;
+  VbAudioLooping(a);
+  TEST_EQ(beep_calls, 0, "VbExBeepNotes( no beeps )");
+  TEST_EQ(a->next_note, 2, "VbExBeepNotes( still timed )");
+  VbAudioClose(a);
+  TEST_EQ(beep_calls, 1, "VbExBeepNotes( stopped )");
+}
+
+
 int main(int argc, char* argv[]) {
   int error_code = 0;
 
   VbAudioTest();
+  VbAudioWaitTest();
+  VbAudioNotesTest();
 
   if (!gTestSuccess)
     error_code = 255;
@@ -5,6 +5,7 @@
  * Tests for firmware image library.
  */
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,6 +41,140 @@ static void VerifyPublicKeyToRSA(const VbPublicKey *orig_key)
 	}
 }
 
+static void VerifyPublicKeyToRSAInPlace(const VbPublicKey *orig_key)
+{
+	RSAPublicKey *rsa, in_place;
+	uint64_t bytes;
+	uint8_t *buf;
+	VbPublicKey *key = PublicKeyAlloc(orig_key->key_size, 0, 0);
+
+	PublicKeyCopy(key, orig_key);
+	key->algorithm = kNumAlgorithms;
+	TEST_NEQ(PublicKeyToRSAInPlace(key, &in_place), 0,
+		 "PublicKeyToRSAInPlace() invalid algorithm");
+
+	PublicKeyCopy(key, orig_key);
+	key->key_size -= 1;
+	TEST_NEQ(PublicKeyToRSAInPlace(key, &in_place), 0,
+		 "PublicKeyToRSAInPlace() invalid size");
+
+	PublicKeyCopy(key, orig_key);
+	GetPublicKeyData(key)[0] ^= 0x01;
+	TEST_NEQ(PublicKeyToRSAInPlace(key, &in_place), 0,
+		 "PublicKeyToRSAInPlace() invalid length");
+
+	/* Key data which isn't aligned has to be copied instead */
+	buf = malloc(sizeof(VbPublicKey) + 1 + orig_key->key_size);
+	memcpy(buf, orig_key, sizeof(VbPublicKey));
+	memcpy(buf + sizeof(VbPublicKey) + 1, GetPublicKeyDataC(orig_key),
+	       orig_key->key_size);
+	((VbPublicKey *)buf)->key_offset = sizeof(VbPublicKey) + 1;
+	TEST_NEQ(PublicKeyToRSAInPlace((VbPublicKey *)buf, &in_place), 0,
+		 "PublicKeyToRSAInPlace() unaligned");
+	free(buf);
+
+	rsa = PublicKeyToRSA(orig_key);
+	TEST_EQ(PublicKeyToRSAInPlace(orig_key, &in_place), 0,
+		"PublicKeyToRSAInPlace() ok");
+	TEST_PTR_EQ(in_place.n, GetPublicKeyDataC(orig_key) + 8,
+		    "  modulus not copied");
+	if (rsa) {
+		bytes = rsa->len * sizeof(uint32_t);
+		TEST_EQ(in_place.len, rsa->len, "  len");
+		TEST_EQ(in_place.n0inv, rsa->n0inv, "  n0inv");
+		TEST_EQ(in_place.algorithm, rsa->algorithm, "  algorithm");
+		TEST_EQ(memcmp(in_place.n, rsa->n, bytes), 0, "  modulus");
+		TEST_EQ(memcmp(in_place.rr, rsa->rr, bytes), 0, "  R^2");
+		RSAPublicKeyFree(rsa);
+	}
+	free(key);
+}
+
+static void VerifyPublicKeyCache(const VbPublicKey *orig_key)
+{
+	PublicKeyCache cache;
+	RSAPublicKey *rsa, *rsa2;
+	RSAPublicKey *full[PUBLIC_KEY_CACHE_SIZE];
+	RSAPublicKey lent;
+	VbPublicKey *key = PublicKeyAlloc(orig_key->key_size, 0, 0);
+	int i;
+
+	/* Without a cache, each key is converted and freed */
+	rsa = PublicKeyCacheGet(NULL, orig_key);
+	rsa2 = PublicKeyCacheGet(NULL, orig_key);
+	TEST_PTR_NEQ(rsa, rsa2, "PublicKeyCacheGet() no cache");
+	PublicKeyCacheRelease(NULL, rsa);
+	PublicKeyCacheRelease(NULL, rsa2);
+
+	memset(&cache, 0, sizeof(cache));
+	rsa = PublicKeyCacheGet(&cache, orig_key);
+	TEST_PTR_NEQ(rsa, NULL, "PublicKeyCacheGet() ok");
+	TEST_PTR_EQ(PublicKeyCacheGet(&cache, orig_key), rsa,
+		    "PublicKeyCacheGet() same key");
+
+	/* Keys are matched by contents, not address */
+	PublicKeyCopy(key, orig_key);
+	TEST_PTR_EQ(PublicKeyCacheGet(&cache, key), rsa,
+		    "PublicKeyCacheGet() copy of key");
+	PublicKeyCacheRelease(&cache, rsa);
+
+	key->algorithm ^= 1;
+	rsa2 = PublicKeyCacheGet(&cache, key);
+	TEST_PTR_NEQ(rsa2, rsa, "PublicKeyCacheGet() other algorithm");
+	PublicKeyCacheRelease(&cache, rsa2);
+
+	PublicKeyCopy(key, orig_key);
+	GetPublicKeyData(key)[12] ^= 0x10;
+	rsa2 = PublicKeyCacheGet(&cache, key);
+	TEST_PTR_NEQ(rsa2, rsa, "PublicKeyCacheGet() other modulus");
+	PublicKeyCacheRelease(&cache, rsa2);
+
+	/* Once the cache is full, keys are the caller's to free */
+	for (i = 0; i < PUBLIC_KEY_CACHE_SIZE; i++) {
+		PublicKeyCopy(key, orig_key);
+		GetPublicKeyData(key)[8 + i] ^= 0x01;
+		full[i] = PublicKeyCacheGet(&cache, key);
+	}
+	TEST_EQ(cache.count, PUBLIC_KEY_CACHE_SIZE, "PublicKeyCache full");
+	TEST_PTR_NEQ(full[PUBLIC_KEY_CACHE_SIZE - 1], NULL,
+		     "PublicKeyCacheGet() when full");
+	for (i = 0; i < PUBLIC_KEY_CACHE_SIZE; i++)
+		PublicKeyCacheRelease(&cache, full[i]);
+
+	PublicKeyCopy(key, orig_key);
+	key->key_size -= 1;
+	TEST_PTR_EQ(PublicKeyCacheGet(&cache, key), NULL,
+		    "PublicKeyCacheGet() invalid size");
+
+	PublicKeyCacheFree(&cache);
+	TEST_EQ(cache.count, 0, "PublicKeyCacheFree()");
+
+	/* A lent key is handed out like the cache's own, but not freed */
+	TEST_EQ(PublicKeyToRSAInPlace(orig_key, &lent), 0,
+		"PublicKeyCacheLend() convert key");
+	PublicKeyCacheLend(&cache, &lent);
+	TEST_EQ(cache.lent, 1, "PublicKeyCacheLend()");
+	TEST_PTR_EQ(PublicKeyCacheGet(&cache, orig_key), &lent,
+		    "PublicKeyCacheGet() lent key");
+	key->key_size = orig_key->key_size;
+	PublicKeyCopy(key, orig_key);
+	TEST_PTR_EQ(PublicKeyCacheGet(&cache, key), &lent,
+		    "PublicKeyCacheGet() copy of lent key");
+	PublicKeyCacheRelease(&cache, &lent);
+
+	GetPublicKeyData(key)[12] ^= 0x10;
+	rsa = PublicKeyCacheGet(&cache, key);
+	TEST_PTR_NEQ(rsa, &lent, "PublicKeyCacheGet() beside lent key");
+	TEST_EQ(cache.count, 2, "  is kept");
+	PublicKeyCacheLend(&cache, &lent);
+	TEST_EQ(cache.lent, 1, "PublicKeyCacheLend() after own keys");
+
+	PublicKeyCacheFree(&cache);
+	TEST_EQ(cache.count, 0, "PublicKeyCacheFree() with lent key");
+	TEST_EQ(cache.lent, 0, "  forgets it");
+	free(key);
+}
+
 static void VerifyDataTest(const VbPublicKey *public_key,
                            const VbPrivateKey *private_key)
 {
@@ -105,6 +240,144 @@ static void VerifyDigestTest(const VbPublicKey *public_key,
 	VbExFree(digest);
 }
 
+static void SignContextTest(const VbPublicKey *public_key,
+			    const VbPrivateKey *private_key)
+{
+	const uint8_t test_data[] = "This is some test data to sign in parts.";
+	VbSignature *sig, *sig2;
+	uint8_t recovered[SHA512_DIGEST_SIZE];
+	SignContext ctx;
+	RSAPublicKey *rsa;
+	uint8_t *digest;
+
+	sig = CalculateSignature(test_data, sizeof(test_data), private_key);
+	rsa = PublicKeyToRSA(public_key);
+	TEST_NEQ(sig && rsa, 0, "SignContext() prerequisites");
+	if (!sig || !rsa)
+		return;
+
+	/* Signing in pieces gives the same signature as all at once */
+	SignContextInit(&ctx, private_key);
+	SignContextUpdate(&ctx, test_data, 7);
+	SignContextUpdate(&ctx, test_data + 7, 0);
+	SignContextUpdate(&ctx, test_data + 7, sizeof(test_data) - 7);
+	sig2 = SignContextFinal(&ctx);
+	TEST_PTR_NEQ(sig2, NULL, "SignContextFinal()");
+	if (!sig2)
+		return;
+	TEST_EQ(sig2->data_size, sizeof(test_data), "  data size");
+	TEST_EQ(sig2->sig_size, sig->sig_size, "  sig size");
+	TEST_EQ(memcmp(GetSignatureData(sig2), GetSignatureData(sig),
+		       sig->sig_size), 0, "  same as CalculateSignature()");
+	TEST_EQ(VerifyData(test_data, sizeof(test_data), sig2, rsa), 0,
+		"  verifies");
+	free(sig2);
+
+	/* So does signing the digest */
+	digest = DigestBuf(test_data, sizeof(test_data),
+			   (int)private_key->algorithm);
+	sig2 = CalculateSignatureFromDigest(digest, sizeof(test_data),
+					    private_key);
+	TEST_PTR_NEQ(sig2, NULL, "CalculateSignatureFromDigest()");
+	if (sig2) {
+		TEST_EQ(sig2->data_size, sizeof(test_data), "  data size");
+		TEST_EQ(memcmp(GetSignatureData(sig2), GetSignatureData(sig),
+			       sig->sig_size), 0,
+			"  same as CalculateSignature()");
+		free(sig2);
+	}
+
+	/* And the digest can be had back from the signature */
+	memset(recovered, 0, sizeof(recovered));
+	TEST_EQ(SignatureRecoverDigest(sig, rsa, recovered), 0,
+		"SignatureRecoverDigest()");
+	TEST_EQ(memcmp(recovered, digest, hash_size_map[rsa->algorithm]), 0,
+		"  digest");
+	GetSignatureData(sig)[0] ^= 0x5A;
+	TEST_NEQ(SignatureRecoverDigest(sig, rsa, recovered), 0,
+		 "SignatureRecoverDigest() wrong sig");
+	GetSignatureData(sig)[0] ^= 0x5A;
+	sig->sig_size -= 16;
+	TEST_NEQ(SignatureRecoverDigest(sig, rsa, recovered), 0,
+		 "SignatureRecoverDigest() sig size");
+
+	RSAPublicKeyFree(rsa);
+	free(sig);
+	VbExFree(digest);
+}
+
+#define STORE_TEST_THREADS 4
+
+static const uint8_t store_test_data[] = "Signed from several threads.";
+
+static void *StoreSignThread(void *key)
+{
+	return CalculateSignature(store_test_data, sizeof(store_test_data),
+				  key);
+}
+
+static void PrivateKeyStoreTest(const char *pem_file, int key_algorithm,
+				const VbPublicKey *public_key)
+{
+	PrivateKeyStore *store = PrivateKeyStoreNew();
+	const VbPrivateKey *key, *key2;
+	pthread_t threads[STORE_TEST_THREADS];
+	VbSignature *sig;
+	RSAPublicKey *rsa;
+	void *thread_sig;
+	int i;
+
+	TEST_PTR_NEQ(store, NULL, "PrivateKeyStoreNew()");
+	if (!store)
+		return;
+
+	key = PrivateKeyStoreReadPem(store, pem_file, key_algorithm);
+	TEST_PTR_NEQ(key, NULL, "PrivateKeyStoreReadPem()");
+	if (!key) {
+		PrivateKeyStoreFree(store);
+		return;
+	}
+	TEST_EQ(key->algorithm, key_algorithm, "  algorithm");
+	key2 = PrivateKeyStoreReadPem(store, pem_file, key_algorithm);
+	TEST_PTR_EQ(key2, key, "  read only once");
+	key2 = PrivateKeyStoreReadPem(store, pem_file,
+				      key_algorithm % 3 ? key_algorithm - 1 :
+				      key_algorithm + 1);
+	TEST_PTR_NEQ(key2, NULL, "  other algorithm");
+	TEST_PTR_NEQ(key2, key, "  is another key");
+	TEST_PTR_EQ(PrivateKeyStoreReadPem(store, "no_such_key.pem",
+					   key_algorithm), NULL,
+		    "  missing file");
+	TEST_PTR_EQ(PrivateKeyStoreReadPem(store, pem_file, kNumAlgorithms),
+		    NULL, "  bad algorithm");
+
+	/* Sign with it from several threads at once */
+	sig = CalculateSignature(store_test_data, sizeof(store_test_data),
+				 key);
+	rsa = PublicKeyToRSA(public_key);
+	TEST_NEQ(sig && rsa, 0, "  prerequisites");
+	for (i = 0; i < STORE_TEST_THREADS; i++)
+		TEST_EQ(pthread_create(threads + i, NULL, StoreSignThread,
+				       (void *)key), 0, "  start thread");
+	for (i = 0; i < STORE_TEST_THREADS; i++) {
+		pthread_join(threads[i], &thread_sig);
+		TEST_PTR_NEQ(thread_sig, NULL, "  thread signed");
+		if (!thread_sig || !sig || !rsa)
+			continue;
+		TEST_EQ(memcmp(GetSignatureData(thread_sig),
+			       GetSignatureData(sig), sig->sig_size), 0,
+			"  same signature");
+		TEST_EQ(VerifyData(store_test_data, sizeof(store_test_data),
+				   thread_sig, rsa), 0, "  verifies");
+		free(thread_sig);
+	}
+
+	if (rsa)
+		RSAPublicKeyFree(rsa);
+	free(sig);
+	PrivateKeyStoreFree(store);
+}
+
 static void ReSignKernelPreamble(VbKernelPreambleHeader *h,
                                  const VbPrivateKey *key)
 {
@@ -122,6 +395,8 @@ static void VerifyKernelPreambleTest(const VbPublicKey *public_key,
 	VbKernelPreambleHeader *h;
 	RSAPublicKey *rsa;
 	unsigned hsize;
+	uint32_t compression;
+	uint64_t load_size;
 
 	/* Create a dummy signature */
 	VbSignature *body_sig = SignatureAlloc(56, 78);
@@ -202,6 +477,50 @@ static void VerifyKernelPreambleTest(const VbPublicKey *public_key,
 	TEST_NEQ(VerifyKernelPreamble(h, hsize, rsa), 0,
 		 "VerifyKernelPreamble() body sig off end");
 
+	/* A compressed body must be one the firmware can decompress */
+	TEST_EQ(VbGetKernelBodyCompression(hdr, &compression, &load_size), 0,
+		"VbGetKernelBodyCompression() uncompressed");
+	TEST_EQ(compression, COMPRESS_NONE, "  compression");
+	TEST_EQ(load_size, 78, "  load size");
+
+	Memcpy(h, hdr, hsize);
+	h->body_compression = COMPRESS_LZMA1;
+	h->body_load_size = 0x10000;
+	ReSignKernelPreamble(h, private_key);
+	TEST_EQ(VerifyKernelPreamble(h, hsize, rsa), 0,
+		"VerifyKernelPreamble() compressed");
+	VbGetKernelBodyCompression(h, &compression, &load_size);
+	TEST_EQ(compression, COMPRESS_LZMA1, "  compression");
+	TEST_EQ(load_size, 0x10000, "  load size");
+
+	h->header_version_minor = 3;
+	ReSignKernelPreamble(h, private_key);
+	TEST_EQ(VerifyKernelPreamble(h, hsize, rsa), 0,
+		"VerifyKernelPreamble() compression in 2.3");
+	VbGetKernelBodyCompression(h, &compression, &load_size);
+	TEST_EQ(compression, COMPRESS_NONE, "  not compressed");
+	TEST_EQ(load_size, 78, "  load size");
+
+	Memcpy(h, hdr, hsize);
+	h->body_compression = COMPRESS_LZMA1;
+	ReSignKernelPreamble(h, private_key);
+	TEST_NEQ(VerifyKernelPreamble(h, hsize, rsa), 0,
+		 "VerifyKernelPreamble() compressed no load size");
+
+	Memcpy(h, hdr, hsize);
+	h->body_compression = COMPRESS_RLE;
+	h->body_load_size = 0x10000;
+	ReSignKernelPreamble(h, private_key);
+	TEST_NEQ(VerifyKernelPreamble(h, hsize, rsa), 0,
+		 "VerifyKernelPreamble() compressed RLE");
+
+	Memcpy(h, hdr, hsize);
+	h->body_compression = MAX_COMPRESS;
+	h->body_load_size = 0x10000;
+	ReSignKernelPreamble(h, private_key);
+	TEST_NEQ(VerifyKernelPreamble(h, hsize, rsa), 0,
+		 "VerifyKernelPreamble() compression unknown");
+
 	/* TODO: verify parser can support a bigger header. */
 
 	free(h);
@@ -209,6 +528,185 @@ static void VerifyKernelPreambleTest(const VbPublicKey *public_key,
 	free(hdr);
 }
 
+static void VerifyKernelBodyBlocksTest(const VbPublicKey *public_key,
+				       const VbPrivateKey *private_key)
+{
+	const uint64_t body_size = 10000;
+	VbKernelPreambleHeader *hdr;
+	VbKernelPreambleHeader *h;
+	VbSignature *body_sig;
+	RSAPublicKey *rsa;
+	uint8_t *body;
+	unsigned hsize;
+	int i;
+
+	body = (uint8_t *)malloc(body_size);
+	for (i = 0; i < body_size; i++)
+		body[i] = (uint8_t)(i * 3);
+	body_sig = CalculateSignature(body, body_size, private_key);
+
+	rsa = PublicKeyToRSA(public_key);
+	hdr = CreateKernelPreambleWithBodyHashes(0x1234, 0x100000, 0x300000,
+						 0x4000, body_sig, 0, 0, 0,
+						 body, 4096, 4096, 8000, 0,
+						 private_key);
+	TEST_NEQ(hdr && rsa, 0, "VerifyKernelBodyBlocks() prerequisites");
+	if (!hdr)
+		return;
+	hsize = (unsigned) hdr->preamble_size;
+	h = (VbKernelPreambleHeader *)malloc(hsize);
+
+	TEST_EQ(hdr->header_version_minor, 4, "  minor version");
+	TEST_EQ(hdr->body_hash_count, 3, "  hash count");
+	TEST_EQ(VbKernelHasBodyHashes(hdr), VBOOT_SUCCESS, "  has hashes");
+	TEST_EQ(VerifyKernelPreamble(hdr, hsize, rsa), 0,
+		"VerifyKernelPreamble() with body hashes");
+	TEST_EQ(VerifyData(body, body_size, &hdr->body_signature, rsa), 0,
+		"  body signature still good");
+
+	TEST_EQ(VerifyKernelBodyBlocks(hdr, body, 0, body_size, rsa), 0,
+		"VerifyKernelBodyBlocks() whole body");
+	TEST_EQ(VerifyKernelBodyBlocks(hdr, body, 4096, 1, rsa), 0,
+		"VerifyKernelBodyBlocks() one byte");
+	TEST_EQ(VerifyKernelBodyBlocks(hdr, body, 8192, 0, rsa), 0,
+		"VerifyKernelBodyBlocks() nothing");
+	TEST_NEQ(VerifyKernelBodyBlocks(hdr, body, 8192, 1809, rsa), 0,
+		 "VerifyKernelBodyBlocks() off end");
+	TEST_NEQ(VerifyKernelBodyBlocks(hdr, body, body_size + 1, 0, rsa), 0,
+		 "VerifyKernelBodyBlocks() start off end");
+
+	/* Only the blocks asked for are checked */
+	body[9000] ^= 0x55;
+	TEST_EQ(VerifyKernelBodyBlocks(hdr, body, 0, 8192, rsa), 0,
+		"VerifyKernelBodyBlocks() skips changed block");
+	TEST_NEQ(VerifyKernelBodyBlocks(hdr, body, 8000, 200, rsa), 0,
+		 "VerifyKernelBodyBlocks() changed last block");
+	body[9000] ^= 0x55;
+
+	Memcpy(h, hdr, hsize);
+	h->header_version_minor = 2;
+	TEST_EQ(VbKernelHasBodyHashes(h), VBOOT_KERNEL_PREAMBLE_NO_BODY_HASHES,
+		"VbKernelHasBodyHashes() 2.2");
+	TEST_NEQ(VerifyKernelBodyBlocks(h, body, 0, body_size, rsa), 0,
+		 "VerifyKernelBodyBlocks() no hashes");
+
+	/* Preamble checks */
+	Memcpy(h, hdr, hsize);
+	h->body_hash_count++;
+	ReSignKernelPreamble(h, private_key);
+	TEST_NEQ(VerifyKernelPreamble(h, hsize, rsa), 0,
+		 "VerifyKernelPreamble() hash count wrong");
+
+	Memcpy(h, hdr, hsize);
+	h->body_hash_block_size = 0;
+	ReSignKernelPreamble(h, private_key);
+	TEST_NEQ(VerifyKernelPreamble(h, hsize, rsa), 0,
+		 "VerifyKernelPreamble() hash block size 0");
+
+	Memcpy(h, hdr, hsize);
+	h->body_hash_offset = h->preamble_signature.data_size - 1;
+	ReSignKernelPreamble(h, private_key);
+	TEST_NEQ(VerifyKernelPreamble(h, hsize, rsa), 0,
+		 "VerifyKernelPreamble() hashes not signed");
+
+	Memcpy(h, hdr, hsize);
+	h->body_hash_tail_offset = body_size + 1;
+	ReSignKernelPreamble(h, private_key);
+	TEST_NEQ(VerifyKernelPreamble(h, hsize, rsa), 0,
+		 "VerifyKernelPreamble() tail off end");
+
+	Memcpy(h, hdr, hsize);
+	((uint8_t *)h)[h->body_hash_offset] ^= 0x34;
+	TEST_NEQ(VerifyKernelPreamble(h, hsize, rsa), 0,
+		 "VerifyKernelPreamble() hash changed");
+
+	Memcpy(h, hdr, hsize);
+	h->body_compression = COMPRESS_LZMA1;
+	h->body_load_size = 2 * body_size;
+	ReSignKernelPreamble(h, private_key);
+	TEST_NEQ(VerifyKernelPreamble(h, hsize, rsa), 0,
+		 "VerifyKernelPreamble() compressed body hashes");
+
+	free(h);
+
+	/* Signing the body on the same pass gives the same preamble */
+	h = SignKernelBodyAndPreamble(0x1234, 0x100000, 0x300000, 0x4000,
+				      0, 0, 0, body, body_size, private_key,
+				      4096, 4096, 8000, 0, private_key);
+	TEST_PTR_NEQ(h, NULL, "SignKernelBodyAndPreamble()");
+	if (h) {
+		TEST_EQ(h->preamble_size, hsize, "  size");
+		TEST_EQ(memcmp(h, hdr, hsize), 0, "  same as two passes");
+		free(h);
+	}
+
+	/* So does building it in a buffer, which isn't touched past the end */
+	TEST_EQ(KernelPreambleSize(body_sig->sig_size, body_size, 4096, 0,
+				   private_key), hsize, "KernelPreambleSize()");
+	h = (VbKernelPreambleHeader *)malloc(hsize + 1);
+	((uint8_t *)h)[hsize] = 0xa5;
+	TEST_EQ(SignKernelBodyAndPreambleInto(h, hsize, 0x1234, 0x100000,
+					      0x300000, 0x4000, 0, 0, 0,
+					      body, body_size, private_key,
+					      4096, 4096, 8000, 0,
+					      private_key), 0,
+		"SignKernelBodyAndPreambleInto()");
+	TEST_EQ(memcmp(h, hdr, hsize), 0, "  same preamble");
+	TEST_EQ(((uint8_t *)h)[hsize], 0xa5, "  nothing past the end");
+	TEST_NEQ(SignKernelBodyAndPreambleInto(h, hsize - 1, 0x1234, 0x100000,
+					       0x300000, 0x4000, 0, 0, 0,
+					       body, body_size, private_key,
+					       4096, 4096, 8000, 0,
+					       private_key), 0,
+		 "SignKernelBodyAndPreambleInto() buffer too small");
+	free(h);
+	free(hdr);
+
+	hdr = CreateKernelPreamble(0x1234, 0x100000, 0x300000, 0x4000,
+				   body_sig, 0, 0, 0, 0, private_key);
+	h = SignKernelBodyAndPreamble(0x1234, 0x100000, 0x300000, 0x4000,
+				      0, 0, 0, body, body_size, private_key,
+				      0, 0, 0, 0, private_key);
+	TEST_PTR_NEQ(h, NULL, "SignKernelBodyAndPreamble() no hashes");
+	if (h && hdr) {
+		TEST_EQ(h->preamble_size, hdr->preamble_size, "  size");
+		TEST_EQ(memcmp(h, hdr, hdr->preamble_size), 0,
+			"  same as CreateKernelPreamble()");
+	}
+	free(h);
+	h = NULL;
+	if (hdr) {
+		hsize = hdr->preamble_size;
+		h = (VbKernelPreambleHeader *)malloc(hsize);
+		TEST_EQ(CreateKernelPreambleInto(h, hsize, 0x1234, 0x100000,
+						 0x300000, 0x4000, body_sig,
+						 0, 0, 0, 0, private_key), 0,
+			"CreateKernelPreambleInto()");
+		TEST_EQ(memcmp(h, hdr, hsize), 0, "  same preamble");
+	}
+	free(h);
+	free(hdr);
+
+	/* Bad args */
+	TEST_PTR_EQ(CreateKernelPreambleWithBodyHashes(
+			    0x1234, 0x100000, 0x300000, 0x4000, body_sig, 0, 0,
+			    0, NULL, 4096, 0, 0, 0, private_key), NULL,
+		    "CreateKernelPreambleWithBodyHashes() no body");
+	TEST_PTR_EQ(CreateKernelPreambleWithBodyHashes(
+			    0x1234, 0x100000, 0x300000, 0x4000, body_sig, 0, 0,
+			    0, body, 4096, body_size + 1, 0, 0, private_key),
+		    NULL, "CreateKernelPreambleWithBodyHashes() head too big");
+	TEST_PTR_EQ(SignKernelBodyAndPreamble(
+			    0x1234, 0x100000, 0x300000, 0x4000, 0, 0, 0, body,
+			    body_size, private_key, 4096, 0, body_size + 1, 0,
+			    private_key),
+		    NULL, "SignKernelBodyAndPreamble() tail too big");
+
+	RSAPublicKeyFree(rsa);
+	free(body_sig);
+	free(body);
+}
+
 int test_algorithm(int key_algorithm, const char *keys_dir)
 {
 	char filename[1024];
@@ -234,9 +732,15 @@ int test_algorithm(int key_algorithm, const char *keys_dir)
 	}
 
 	VerifyPublicKeyToRSA(public_key);
+	VerifyPublicKeyToRSAInPlace(public_key);
+	VerifyPublicKeyCache(public_key);
 	VerifyDataTest(public_key, private_key);
 	VerifyDigestTest(public_key, private_key);
+	SignContextTest(public_key, private_key);
+	sprintf(filename, "%s/key_rsa%d.pem", keys_dir, rsa_len);
+	PrivateKeyStoreTest(filename, key_algorithm, public_key);
 	VerifyKernelPreambleTest(public_key, private_key);
+	VerifyKernelBodyBlocksTest(public_key, private_key);
 
 	if (public_key)
 		free(public_key);
@@ -49,6 +49,15 @@ static void KeyBlockVerifyTest(const VbPublicKey *public_key,
 	TEST_NEQ(KeyBlockVerify(hdr, hsize, NULL, 0), 0,
 		 "KeyBlockVerify() missing key");
 
+	TEST_EQ(KeyBlockSize(data_key, private_key), hsize, "KeyBlockSize()");
+	Memset(h, 0, hsize);
+	TEST_EQ(KeyBlockCreateInto(h, hsize, data_key, private_key, 0x1234), 0,
+		"KeyBlockCreateInto()");
+	TEST_EQ(memcmp(h, hdr, hsize), 0, "  same key block");
+	TEST_NEQ(KeyBlockCreateInto(h, hsize - 1, data_key, private_key,
+				    0x1234), 0,
+		 "KeyBlockCreateInto() buffer too small");
+
 	TEST_NEQ(KeyBlockVerify(hdr, hsize - 1, NULL, 1), 0,
 		 "KeyBlockVerify() size--");
 	TEST_EQ(KeyBlockVerify(hdr, hsize + 1, NULL, 1), 0,
@@ -171,13 +180,15 @@ static void VerifyFirmwarePreambleTest(const VbPublicKey *public_key,
 	VbFirmwarePreambleHeader *h;
 	RSAPublicKey *rsa;
 	unsigned hsize;
+	const uint8_t ec_rw[] = "EC-RW image";
+	VbSignature *ec_rw_hash;
 
 	/* Create a dummy signature */
 	VbSignature* body_sig = SignatureAlloc(56, 78);
 
 	rsa = PublicKeyToRSA(public_key);
 	hdr = CreateFirmwarePreamble(0x1234, kernel_subkey, body_sig,
-				     private_key, 0x5678);
+				     private_key, 0x5678, NULL);
 	TEST_NEQ(hdr && rsa, 0, "VerifyFirmwarePreamble() prerequisites");
 	if (!hdr)
 		return;
@@ -193,6 +204,18 @@ static void VerifyFirmwarePreambleTest(const VbPublicKey *public_key,
 	TEST_EQ(VerifyFirmwarePreamble(hdr, hsize + 1, rsa), 0,
 		"VerifyFirmwarePreamble() size++");
 
+	TEST_EQ(FirmwarePreambleSize(kernel_subkey, body_sig, private_key,
+				     NULL), hsize, "FirmwarePreambleSize()");
+	TEST_EQ(CreateFirmwarePreambleInto(h, hsize, 0x1234, kernel_subkey,
+					   body_sig, private_key, 0x5678,
+					   NULL), 0,
+		"CreateFirmwarePreambleInto()");
+	TEST_EQ(memcmp(h, hdr, hsize), 0, "  same preamble");
+	TEST_NEQ(CreateFirmwarePreambleInto(h, hsize - 1, 0x1234,
+					    kernel_subkey, body_sig,
+					    private_key, 0x5678, NULL), 0,
+		 "CreateFirmwarePreambleInto() buffer too small");
+
 	/* Care about major version but not minor */
 	Memcpy(h, hdr, hsize);
 	h->header_version_major++;
@@ -267,11 +290,63 @@ static void VerifyFirmwarePreambleTest(const VbPublicKey *public_key,
 	TEST_EQ(VbGetFirmwarePreambleFlags(h), 0,
 		"VbGetFirmwarePreambleFlags() v2.0");
 
+	/* No EC-RW hash unless one was supplied */
+	Memcpy(h, hdr, hsize);
+	TEST_PTR_EQ(VbGetFirmwarePreambleEcRwHash(h), NULL,
+		    "VbGetFirmwarePreambleEcRwHash() none");
+
 	/* TODO: verify with extra padding at end of header. */
 
 	free(h);
-	RSAPublicKeyFree(rsa);
 	free(hdr);
+
+	/* Now with an EC-RW hash */
+	ec_rw_hash = CalculateSha256(ec_rw, sizeof(ec_rw));
+	hdr = CreateFirmwarePreamble(0x1234, kernel_subkey, body_sig,
+				     private_key, 0x5678, ec_rw_hash);
+	TEST_PTR_NEQ(hdr, NULL, "CreateFirmwarePreamble() with EC-RW hash");
+	if (!hdr)
+		goto out;
+	hsize = (unsigned) hdr->preamble_size;
+	h = (VbFirmwarePreambleHeader *)malloc(hsize + 16384);
+
+	TEST_EQ(VerifyFirmwarePreamble(hdr, hsize, rsa), 0,
+		"VerifyFirmwarePreamble() EC-RW hash ok");
+	TEST_EQ(hdr->ec_rw_hash.data_size, sizeof(ec_rw),
+		"  EC-RW hash data size");
+	TEST_PTR_NEQ(VbGetFirmwarePreambleEcRwHash(hdr), NULL,
+		     "VbGetFirmwarePreambleEcRwHash()");
+	TEST_EQ(Memcmp(VbGetFirmwarePreambleEcRwHash(hdr),
+		       GetSignatureDataC(ec_rw_hash), SHA256_DIGEST_SIZE), 0,
+		"  hash matches");
+
+	Memcpy(h, hdr, hsize);
+	h->ec_rw_hash.sig_offset = hsize;
+	ReSignFirmwarePreamble(h, private_key);
+	TEST_NEQ(VerifyFirmwarePreamble(h, hsize, rsa), 0,
+		 "VerifyFirmwarePreamble() EC-RW hash off end");
+
+	Memcpy(h, hdr, hsize);
+	GetSignatureData(&h->ec_rw_hash)[0] ^= 0x12;
+	TEST_NEQ(VerifyFirmwarePreamble(h, hsize, rsa), 0,
+		 "VerifyFirmwarePreamble() EC-RW hash signed");
+
+	Memcpy(h, hdr, hsize);
+	h->ec_rw_hash.sig_size--;
+	TEST_PTR_EQ(VbGetFirmwarePreambleEcRwHash(h), NULL,
+		    "VbGetFirmwarePreambleEcRwHash() wrong size");
+
+	Memcpy(h, hdr, hsize);
+	h->header_version_minor = 1;
+	TEST_PTR_EQ(VbGetFirmwarePreambleEcRwHash(h), NULL,
+		    "VbGetFirmwarePreambleEcRwHash() v2.1");
+
+	free(h);
+	free(hdr);
+ out:
+	free(ec_rw_hash);
+	free(body_sig);
+	RSAPublicKeyFree(rsa);
 }
 
 int test_permutation(int signing_key_algorithm, int data_key_algorithm,
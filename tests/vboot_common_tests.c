@@ -5,10 +5,17 @@
  * Tests for firmware vboot_common.c
  */
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#define _STUB_IMPLEMENTATION_  /* So we can free() what's expanded */
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "host_misc.h"
 #include "test_common.h"
 #include "utility.h"
 #include "vboot_common.h"
@@ -28,10 +35,10 @@ static void StructPackingTest(void)
 	TEST_EQ(EXPECTED_VBFIRMWAREPREAMBLEHEADER2_0_SIZE,
 		sizeof(VbFirmwarePreambleHeader2_0),
 		"sizeof(VbFirmwarePreambleHeader2_0)");
-	TEST_EQ(EXPECTED_VBFIRMWAREPREAMBLEHEADER2_1_SIZE,
+	TEST_EQ(EXPECTED_VBFIRMWAREPREAMBLEHEADER2_2_SIZE,
 		sizeof(VbFirmwarePreambleHeader),
 		"sizeof(VbFirmwarePreambleHeader)");
-	TEST_EQ(EXPECTED_VBKERNELPREAMBLEHEADER2_2_SIZE,
+	TEST_EQ(EXPECTED_VBKERNELPREAMBLEHEADER2_4_SIZE,
 		sizeof(VbKernelPreambleHeader),
 		"sizeof(VbKernelPreambleHeader)");
 
@@ -40,8 +47,27 @@ static void StructPackingTest(void)
 		"sizeof(VbSharedDataHeader) V1");
 
 	TEST_EQ(VB_SHARED_DATA_HEADER_SIZE_V2,
-		sizeof(VbSharedDataHeader),
+		(long)&((VbSharedDataHeader*)NULL)->timestamp_count,
 		"sizeof(VbSharedDataHeader) V2");
+
+	TEST_EQ(VB_SHARED_DATA_HEADER_SIZE_V3_MIN,
+		(long)&((VbSharedDataHeader*)NULL)->lk_call_io,
+		"sizeof(VbSharedDataHeader) V3 min");
+
+	TEST_EQ(VB_SHARED_DATA_HEADER_SIZE_V3,
+		sizeof(VbSharedDataHeader),
+		"sizeof(VbSharedDataHeader) V3");
+
+	/* Flushed from one to the other */
+	TEST_EQ(EXPECTED_VB2_CRYPTO_STATS_SIZE,
+		sizeof(struct vb2_crypto_stats),
+		"sizeof(vb2_crypto_stats)");
+	TEST_EQ(EXPECTED_VB2_CRYPTO_STATS_SIZE,
+		sizeof(VbSharedDataCryptoStats),
+		"sizeof(VbSharedDataCryptoStats)");
+	TEST_EQ(offsetof(struct vb2_crypto_stats, decompress_out_bytes),
+		offsetof(VbSharedDataCryptoStats, decompress_out_bytes),
+		"VbSharedDataCryptoStats layout");
 }
 
 /* Test array size macro */
@@ -188,11 +214,46 @@ static void PublicKeyTest(void)
 		"PublicKeyCopy data");
 }
 
+/* Key block checks which don't need the signature */
+static void KeyBlockPreVerifyTest(void)
+{
+	VbKeyBlockHeader h;
+	const uint64_t flags =
+		KEY_BLOCK_FLAG_DEVELOPER_0 | KEY_BLOCK_FLAG_RECOVERY_0;
+
+	Memset(&h, 0, sizeof(h));
+	h.key_block_flags = flags | KEY_BLOCK_FLAG_DEVELOPER_1;
+	h.data_key.key_version = 3;
+
+	TEST_EQ(KeyBlockPreVerify(&h, sizeof(h), flags, 3), VBOOT_SUCCESS,
+		"KeyBlockPreVerify() ok");
+	TEST_EQ(KeyBlockPreVerify(&h, sizeof(h), 0, 0), VBOOT_SUCCESS,
+		"KeyBlockPreVerify() nothing required");
+	TEST_EQ(KeyBlockPreVerify(&h, sizeof(h) - 1, flags, 3),
+		VBOOT_KEY_BLOCK_INVALID, "KeyBlockPreVerify() too small");
+	TEST_EQ(KeyBlockPreVerify(&h, sizeof(h),
+				  flags | KEY_BLOCK_FLAG_RECOVERY_1, 3),
+		VBOOT_KEY_BLOCK_FLAGS, "KeyBlockPreVerify() flags");
+	TEST_EQ(KeyBlockPreVerify(&h, sizeof(h), flags, 4),
+		VBOOT_KEY_BLOCK_VERSION, "KeyBlockPreVerify() rollback");
+
+	/* Flags are checked before the version */
+	TEST_EQ(KeyBlockPreVerify(&h, sizeof(h),
+				  flags | KEY_BLOCK_FLAG_RECOVERY_1, 4),
+		VBOOT_KEY_BLOCK_FLAGS, "KeyBlockPreVerify() flags first");
+
+	h.data_key.key_version = 0x10000;
+	TEST_EQ(KeyBlockPreVerify(&h, sizeof(h), flags, 0),
+		VBOOT_KEY_BLOCK_VERSION, "KeyBlockPreVerify() version range");
+}
+
 /* VbSharedData utility tests */
 static void VbSharedDataTest(void)
 {
-	uint8_t buf[VB_SHARED_DATA_MIN_SIZE + 1];
+	uint8_t buf[VB_SHARED_DATA_REC_SIZE];
 	VbSharedDataHeader* d = (VbSharedDataHeader*)buf;
+	uint64_t full_size = sizeof(VbSharedDataHeader) +
+		VB_SHARED_DATA_MIN_SIZE - VB_SHARED_DATA_HEADER_SIZE_V3_MIN;
 
 	TEST_NEQ(VBOOT_SUCCESS,
 		 VbSharedDataInit(d, sizeof(VbSharedDataHeader) - 1),
@@ -204,8 +265,26 @@ static void VbSharedDataTest(void)
 		 VbSharedDataInit(NULL, VB_SHARED_DATA_MIN_SIZE),
 		 "VbSharedDataInit null");
 
+	/* A minimum size buffer leaves room for the subkey, not the extras */
 	Memset(buf, 0x68, sizeof(buf));
 	TEST_EQ(VBOOT_SUCCESS, VbSharedDataInit(d, VB_SHARED_DATA_MIN_SIZE),
+		"VbSharedDataInit minimum");
+	TEST_EQ(d->struct_size, VB_SHARED_DATA_HEADER_SIZE_V3_MIN,
+		"VbSharedDataInit minimum struct_size");
+	TEST_EQ(VBOOT_SUCCESS, VbSharedDataInit(d, full_size - 1),
+		"VbSharedDataInit short");
+	TEST_EQ(d->struct_size, VB_SHARED_DATA_HEADER_SIZE_V3_MIN,
+		"VbSharedDataInit short struct_size");
+	TEST_EQ(d->data_used, d->struct_size,
+		"VbSharedDataInit short data_used");
+	TEST_EQ(d->lk_call_io[0].gpt.read_calls, 0x68686868,
+		"VbSharedDataInit short leaves the rest");
+	TEST_TRUE(d->data_size - d->data_used >=
+		  VB_SHARED_DATA_MIN_SIZE - VB_SHARED_DATA_HEADER_SIZE_V3_MIN,
+		  "VbSharedDataInit short room left");
+
+	Memset(buf, 0x68, sizeof(buf));
+	TEST_EQ(VBOOT_SUCCESS, VbSharedDataInit(d, full_size),
 		"VbSharedDataInit");
 
 	/* Check fields that should have been initialized */
@@ -214,8 +293,7 @@ static void VbSharedDataTest(void)
 		"VbSharedDataInit version");
 	TEST_EQ(d->struct_size, sizeof(VbSharedDataHeader),
 		"VbSharedDataInit struct_size");
-	TEST_EQ(d->data_size, VB_SHARED_DATA_MIN_SIZE,
-		"VbSharedDataInit data_size");
+	TEST_EQ(d->data_size, full_size, "VbSharedDataInit data_size");
 	TEST_EQ(d->data_used, d->struct_size, "VbSharedDataInit data_used");
 	TEST_EQ(d->firmware_index, 0xFF, "VbSharedDataInit firmware index");
 
@@ -227,6 +305,220 @@ static void VbSharedDataTest(void)
 
 	TEST_NEQ(VBOOT_SUCCESS, VbSharedDataSetKernelKey(NULL, NULL),
 		 "VbSharedDataSetKernelKey null");
+
+	/* Timestamps go in a ring */
+	TEST_EQ(d->timestamp_count, 0, "VbSharedDataInit timestamp_count");
+	VbSharedDataRecordTimestamp(d, VBSD_TS_LOAD_KERNEL_ENTER);
+	TEST_EQ(d->timestamp_count, 1, "Timestamp count");
+	TEST_EQ(d->timestamps[0].id, VBSD_TS_LOAD_KERNEL_ENTER, "Timestamp id");
+	d->timestamp_count = VBSD_MAX_TIMESTAMPS + 1;
+	VbSharedDataRecordTimestamp(d, VBSD_TS_LOAD_KERNEL_EXIT);
+	TEST_EQ(d->timestamp_count, VBSD_MAX_TIMESTAMPS + 2,
+		"Timestamp count past ring size");
+	TEST_EQ(d->timestamps[1].id, VBSD_TS_LOAD_KERNEL_EXIT,
+		"Timestamp wraps around");
+
+	/* Version 2 structs don't have room for them */
+	d->struct_version = 2;
+	d->timestamp_count = 0;
+	VbSharedDataRecordTimestamp(d, VBSD_TS_LOAD_KERNEL_ENTER);
+	TEST_EQ(d->timestamp_count, 0, "No timestamps in v2 struct");
+	VbSharedDataRecordTimestamp(NULL, VBSD_TS_LOAD_KERNEL_ENTER);
+	d->struct_version = VB_SHARED_DATA_VERSION;
+
+	/* Crypto stats are only counted by instrumented builds */
+	TEST_EQ(d->crypto_stats.crc32_bytes, 0,
+		"VbSharedDataInit crypto_stats");
+#ifdef VB2_CRYPTO_STATS
+	vb2_crypto_stats_flush(&(struct vb2_crypto_stats){});
+	vb2_crypto_stats.crc32_bytes = 100;
+	vb2_crypto_stats.rsa_verifies[1] = 2;
+	VbSharedDataFlushCryptoStats(d);
+	vb2_crypto_stats.crc32_bytes = 10;
+	VbSharedDataFlushCryptoStats(d);
+	TEST_EQ(d->crypto_stats.crc32_bytes, 110, "Crypto stats add up");
+	TEST_EQ(d->crypto_stats.rsa_verifies[1], 2, "  and are cleared");
+	d->struct_size = VB_SHARED_DATA_HEADER_SIZE_V3 - 1;
+	vb2_crypto_stats.crc32_bytes = 10;
+	VbSharedDataFlushCryptoStats(d);
+	TEST_EQ(d->crypto_stats.crc32_bytes, 110,
+		"No crypto stats in short v3 struct");
+	d->struct_size = sizeof(*d);
+#else
+	VbSharedDataFlushCryptoStats(d);
+	TEST_EQ(d->crypto_stats.crc32_bytes, 0, "Crypto stats not counted");
+#endif
+	VbSharedDataFlushCryptoStats(NULL);
+}
+
+/* Compact VbSharedData encoding tests */
+static void VbSharedDataCompactTest(void)
+{
+	uint8_t buf[VB_SHARED_DATA_REC_SIZE];
+	uint8_t out[VB_SHARED_DATA_REC_SIZE];
+	VbSharedDataHeader *d = (VbSharedDataHeader *)buf;
+	VbSharedDataHeader *e;
+	VbSharedDataCompactHeader *h = (VbSharedDataCompactHeader *)out;
+	VbSharedDataRecord *rec;
+	uint64_t e_size;
+	uint32_t size, small;
+	int i;
+
+	Memset(buf, 0x68, sizeof(buf));
+	VbSharedDataInit(d, sizeof(buf));
+	d->flags = 0x1234;
+	d->recovery_reason = 3;
+	d->kernel_version_lowest = 0x10002;
+	d->lk_call_count = 2;
+	d->lk_calls[0].kernel_parts_found = 2;
+	d->lk_calls[0].parts[1].sector_start = 1000;
+	d->lk_calls[0].parts[2].sector_start = 2000;  /* Not tried */
+	d->lk_call_io[0].parts[1].read_bytes = 4096;
+	d->lk_call_io[0].parts[2].read_bytes = 8192;  /* Not tried */
+	d->lk_calls[1].kernel_parts_found = 1;
+	d->lk_calls[1].return_code = 5;
+	d->lk_calls[2].return_code = 6;               /* Not called */
+	VbSharedDataRecordTimestamp(d, VBSD_TS_LOAD_KERNEL_ENTER);
+	VbSharedDataRecordTimestamp(d, VBSD_TS_LOAD_KERNEL_EXIT);
+	d->timestamps[2].id = VBSD_TS_EC_SOFTWARE_SYNC_ENTER;  /* Not recorded */
+	d->ec_rw_hash_size = 32;
+	Memset(d->ec_rw_hash, 0xec, sizeof(d->ec_rw_hash));
+	d->measurement_count = 1;
+	d->measurements[0].event = VBSD_MEASURE_HWID;
+	d->measurements[1].event = VBSD_MEASURE_BOOT_MODE;  /* Not logged */
+	d->crypto_stats.rsa_verifies[1] = 3;
+	d->kernel_subkey_data_offset = VbSharedDataReserve(d, 64);
+	d->kernel_subkey_data_size = 64;
+	PublicKeyInit(&d->kernel_subkey, buf + d->kernel_subkey_data_offset,
+		      64);
+	d->kernel_subkey.algorithm = 3;
+	for (i = 0; i < 64; i++)
+		buf[d->kernel_subkey_data_offset + i] = i;
+
+	size = sizeof(out);
+	TEST_EQ(VbSharedDataCompact(d, out, &size), VBOOT_SUCCESS, "Compact");
+	TEST_EQ(h->magic, VB_SHARED_DATA_COMPACT_MAGIC, "  magic");
+	TEST_EQ(h->size, size, "  size");
+	TEST_TRUE(size < 1024, "  much smaller");
+	TEST_EQ(size % 4, 0, "  padded");
+	TEST_TRUE(VbSharedDataIsCompact(out, size), "  recognized");
+	TEST_FALSE(VbSharedDataIsCompact(buf, sizeof(buf)),
+		   "  whole blob isn't compact");
+
+	/* Too small says how much is needed */
+	small = size - 1;
+	TEST_NEQ(VbSharedDataCompact(d, out, &small), VBOOT_SUCCESS,
+		 "Compact too small");
+	TEST_EQ(small, size, "  needed size");
+	small = 0;
+	TEST_NEQ(VbSharedDataCompact(d, out, &small), VBOOT_SUCCESS,
+		 "Compact into nothing");
+	size = sizeof(out);
+	VbSharedDataCompact(d, out, &size);
+
+	e = VbSharedDataExpand(out, size, &e_size);
+	TEST_PTR_NEQ(e, NULL, "Expand");
+	if (!e)
+		return;
+	TEST_EQ(e_size, sizeof(*e) + 64, "  size");
+	TEST_EQ(e->data_used, e_size, "  data used");
+	TEST_EQ(e->magic, VB_SHARED_DATA_MAGIC, "  magic");
+	TEST_EQ(e->struct_version, VB_SHARED_DATA_VERSION, "  version");
+	TEST_EQ(e->flags, 0x1234, "  flags");
+	TEST_EQ(e->recovery_reason, 3, "  recovery reason");
+	TEST_EQ(e->kernel_version_lowest, 0x10002, "  kernel version");
+	TEST_EQ(e->lk_call_count, 2, "  call count");
+	TEST_EQ(e->lk_calls[0].parts[1].sector_start, 1000, "  part");
+	TEST_EQ(e->lk_calls[0].parts[2].sector_start, 0, "  untried part");
+	TEST_EQ(e->lk_call_io[0].parts[1].read_bytes, 4096, "  part io");
+	TEST_EQ(e->lk_call_io[0].parts[2].read_bytes, 0, "  untried part io");
+	TEST_EQ(e->lk_calls[1].return_code, 5, "  second call");
+	TEST_EQ(e->lk_calls[2].return_code, 0, "  no third call");
+	TEST_EQ(e->timestamp_count, 2, "  timestamp count");
+	TEST_EQ(e->timestamps[1].id, VBSD_TS_LOAD_KERNEL_EXIT, "  timestamp");
+	TEST_EQ(e->timestamps[2].id, 0, "  unrecorded timestamp");
+	TEST_EQ(memcmp(e->ec_rw_hash, d->ec_rw_hash, 32), 0, "  EC hash");
+	TEST_EQ(e->measurement_count, 1, "  measurement count");
+	TEST_EQ(e->measurements[0].event, VBSD_MEASURE_HWID, "  measurement");
+	TEST_EQ(e->measurements[1].event, 0, "  unlogged measurement");
+	TEST_EQ(e->crypto_stats.rsa_verifies[1], 3, "  crypto stats");
+	TEST_EQ(e->kernel_subkey_data_size, 64, "  subkey size");
+	TEST_EQ(e->kernel_subkey.algorithm, 3, "  subkey algorithm");
+	TEST_EQ(memcmp(GetPublicKeyData(&e->kernel_subkey),
+		       buf + d->kernel_subkey_data_offset, 64), 0,
+		"  subkey data");
+	free(e);
+
+	/* Version 2 structs only have their own fields */
+	d->struct_version = 2;
+	d->struct_size = VB_SHARED_DATA_HEADER_SIZE_V2;
+	size = sizeof(out);
+	TEST_EQ(VbSharedDataCompact(d, out, &size), VBOOT_SUCCESS,
+		"Compact v2");
+	e = VbSharedDataExpand(out, size, NULL);
+	TEST_PTR_NEQ(e, NULL, "  expand");
+	if (e) {
+		TEST_EQ(e->struct_version, 2, "  version");
+		TEST_EQ(e->recovery_reason, 3, "  recovery reason");
+		TEST_EQ(e->timestamp_count, 0, "  no timestamps");
+		TEST_EQ(e->crypto_stats.rsa_verifies[1], 0,
+			"  no crypto stats");
+		free(e);
+	}
+	d->struct_version = VB_SHARED_DATA_VERSION;
+	d->struct_size = sizeof(*d);
+
+	/* Bad input */
+	TEST_NEQ(VbSharedDataCompact(NULL, out, &size), VBOOT_SUCCESS,
+		 "Compact null");
+	d->magic++;
+	TEST_NEQ(VbSharedDataCompact(d, out, &size), VBOOT_SUCCESS,
+		 "Compact bad magic");
+	d->magic--;
+	d->kernel_subkey_data_offset = d->data_used;
+	TEST_NEQ(VbSharedDataCompact(d, out, &size), VBOOT_SUCCESS,
+		 "Compact bad subkey");
+	d->kernel_subkey_data_offset = d->data_used - 64;
+
+	size = sizeof(out);
+	VbSharedDataCompact(d, out, &size);
+	TEST_PTR_EQ(VbSharedDataExpand(out, size - 1, NULL), NULL,
+		    "Expand truncated");
+	TEST_PTR_EQ(VbSharedDataExpand(out, sizeof(*h) - 1, NULL), NULL,
+		    "Expand no header");
+	h->version++;
+	TEST_PTR_EQ(VbSharedDataExpand(out, size, NULL), NULL,
+		    "Expand bad version");
+	h->version--;
+	rec = (VbSharedDataRecord *)(out + sizeof(*h));
+	rec->size += 0x100;
+	TEST_PTR_EQ(VbSharedDataExpand(out, size, NULL), NULL,
+		    "Expand span too big");
+	rec->size -= 0x100;
+	*(uint32_t *)(rec + 1) = sizeof(*d);
+	TEST_PTR_EQ(VbSharedDataExpand(out, size, NULL), NULL,
+		    "Expand span past header");
+	*(uint32_t *)(rec + 1) = 0;
+	h->record_count++;
+	TEST_PTR_EQ(VbSharedDataExpand(out, size, NULL), NULL,
+		    "Expand too many records");
+	h->record_count--;
+
+	/* Readers skip records they don't know */
+	rec->tag = 0x7f;
+	e = VbSharedDataExpand(out, size, NULL);
+	TEST_PTR_EQ(e, NULL, "Expand without the first span");
+	rec->tag = VBSD_REC_HEADER_SPAN;
+	rec = (VbSharedDataRecord *)((uint8_t *)(rec + 1) +
+				     ((rec->size + 3) & ~3));
+	rec->tag = 0x7f;
+	e = VbSharedDataExpand(out, size, NULL);
+	TEST_PTR_NEQ(e, NULL, "Expand with an unknown record");
+	if (e) {
+		TEST_EQ(e->recovery_reason, 0, "  skipped it");
+		TEST_EQ(e->flags, 0x1234, "  kept the rest");
+		free(e);
+	}
 }
 
 int main(int argc, char* argv[])
@@ -235,7 +527,9 @@ int main(int argc, char* argv[])
 	ArraySizeTest();
 	VerifyHelperFunctions();
 	PublicKeyTest();
+	KeyBlockPreVerifyTest();
 	VbSharedDataTest();
+	VbSharedDataCompactTest();
 
 	if (vboot_api_stub_check_memory())
 		return 255;
@@ -11,6 +11,8 @@
 #include <string.h>
 
 #include "bmpblk_font.h"
+#include "bmpblk_rle.h"
+#include "gbb_access.h"
 #include "gbb_header.h"
 #include "host_common.h"
 #include "region.h"
@@ -29,6 +31,15 @@ static char gbb_data[4096 + sizeof(GoogleBinaryBlockHeader)];
 static GoogleBinaryBlockHeader *gbb = (GoogleBinaryBlockHeader *)gbb_data;
 static BmpBlockHeader *bhdr;
 static char debug_info[4096];
+static int decompress_calls;
+static int display_image_calls;
+static int set_dimension_calls;
+static int debug_info_calls;
+static uint32_t display_image_x[16];
+static uint32_t stream_x, stream_y, stream_bytes;
+static int display_rects_calls;
+static VbDisplayRect display_rects[16];
+static uint32_t display_rects_count;
 
 /* Reset mock data (for use before each test) */
 static void ResetMocks(void)
@@ -83,14 +94,94 @@ static void ResetMocks(void)
 	VbSharedDataInit(shared, sizeof(shared_data));
 
 	*debug_info = 0;
+	decompress_calls = 0;
+	display_image_calls = 0;
+	set_dimension_calls = 0;
+	debug_info_calls = 0;
 }
 
 /* Mocks */
 
+VbError_t VbExDisplayImage(uint32_t x, uint32_t y,
+			   void *buffer, uint32_t buffersize)
+{
+	if (display_image_calls < ARRAY_SIZE(display_image_x))
+		display_image_x[display_image_calls] = x;
+	display_image_calls++;
+	return VBERROR_SUCCESS;
+}
+
+/* Only used with DISPLAY_LAYOUT; counts the images as if drawn in turn */
+VbError_t VbExDisplayLayout(const VbDisplayImage *images, uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		VbExDisplayImage(images[i].x, images[i].y, images[i].buffer,
+				 images[i].buffersize);
+	return VBERROR_SUCCESS;
+}
+
+/* Only used with DISPLAY_FONT_ATLAS; keeps the rectangles of the last call */
+VbError_t VbExDisplayImageRects(void *buffer, uint32_t buffersize,
+				const VbDisplayRect *rects, uint32_t count)
+{
+	display_rects_calls++;
+	display_rects_count = count;
+	Memcpy(display_rects, rects,
+	       (count < 16 ? count : 16) * sizeof(*rects));
+	return VBERROR_SUCCESS;
+}
+
+/*
+ * Only used with DECOMPRESS_STREAM; the image counts as drawn once its stream
+ * is closed.
+ */
+VbError_t VbExDecompressStreamOpen(uint32_t compression_type,
+				   uint32_t original_size, uint32_t x,
+				   uint32_t y, VbExDecompressStream_t *stream)
+{
+	stream_x = x;
+	stream_y = y;
+	stream_bytes = 0;
+	*stream = &stream_bytes;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDecompressStreamWrite(VbExDecompressStream_t stream,
+				    const void *inbuf, uint32_t in_size)
+{
+	*(uint32_t *)stream += in_size;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDecompressStreamClose(VbExDecompressStream_t stream)
+{
+	return VbExDisplayImage(stream_x, stream_y, NULL,
+				*(uint32_t *)stream);
+}
+
+VbError_t VbExDisplaySetDimension(uint32_t width, uint32_t height)
+{
+	set_dimension_calls++;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDecompress(void *inbuf, uint32_t in_size,
+			 uint32_t compression_type,
+			 void *outbuf, uint32_t *out_size)
+{
+	decompress_calls++;
+	Memcpy(outbuf, inbuf, in_size);
+	*out_size = in_size;
+	return VBERROR_SUCCESS;
+}
+
 VbError_t VbExDisplayDebugInfo(const char *info_str)
 {
 	strncpy(debug_info, info_str, sizeof(debug_info));
 	debug_info[sizeof(debug_info) - 1] = '\0';
+	debug_info_calls++;
 	return VBERROR_SUCCESS;
 }
 
@@ -138,6 +229,40 @@ static void DebugInfoTest(void)
 	ResetMocks();
 	VbDisplayDebugInfo(&cparams, &vnc);
 	TEST_NEQ(*debug_info, '\0', "Some debug info was displayed");
+	TEST_PTR_NEQ(strstr(debug_info, "HWID: Test HWID\n"), NULL, "  HWID");
+	TEST_PTR_NEQ(strstr(debug_info, "\ngbb.rootkey: "), NULL,
+		     "  root key");
+
+	/* Unchanged debug info isn't shown again */
+	VbDisplayDebugInfo(&cparams, &vnc);
+	TEST_EQ(debug_info_calls, 1, "Same debug info not shown again");
+
+	/* The HWID is only read once per boot */
+	strcpy(gbb_data + gbb->hwid_offset, "New HWID");
+	VbNvSet(&vnc, VBNV_DEV_BOOT_USB, 1);
+	VbDisplayDebugInfo(&cparams, &vnc);
+	TEST_EQ(debug_info_calls, 2, "Changed debug info shown");
+	TEST_PTR_NEQ(strstr(debug_info, "dev_boot_usb: 1"), NULL, "  flag");
+	TEST_PTR_NEQ(strstr(debug_info, "HWID: Test HWID\n"), NULL,
+		     "  HWID kept");
+
+	/* Other text covers it up, so it's shown again */
+	VbDisplayDebugText("Other text");
+	VbDisplayDebugInfo(&cparams, &vnc);
+	TEST_EQ(debug_info_calls, 4, "Shown again after other text");
+
+	/* So does drawing a screen */
+	VbDisplayScreen(&cparams, VB_SCREEN_BLANK, 1, &vnc);
+	VbDisplayDebugInfo(&cparams, &vnc);
+	TEST_EQ(debug_info_calls, 5, "Shown again after a screen");
+	VbApiKernelFree(&cparams);
+
+	/* The next boot reads the HWID again */
+	ResetMocks();
+	strcpy(gbb_data + gbb->hwid_offset, "New HWID");
+	VbDisplayDebugInfo(&cparams, &vnc);
+	TEST_PTR_NEQ(strstr(debug_info, "HWID: New HWID\n"), NULL,
+		     "HWID read again next boot");
 	VbApiKernelFree(&cparams);
 }
 
@@ -210,6 +335,314 @@ static void DisplayKeyTest(void)
 	VbApiKernelFree(&cparams);
 }
 
+/*
+ * Put three compressed images in screen 0 of each localization.  Their data
+ * is "image <localization><num>".
+ */
+static void SetupImages(void)
+{
+	ScreenLayout *layout = (ScreenLayout *)(bhdr + 1);
+	uint32_t offset = 2048;
+	int loc, i;
+
+	bhdr->number_of_screenlayouts = 1;
+	for (loc = 0; loc < bhdr->number_of_localizations; loc++, layout++) {
+		for (i = 0; i < 3; i++) {
+			ImageInfo *info = (ImageInfo *)(gbb_data + offset);
+
+			layout->images[i].image_info_offset =
+				offset - gbb->bmpfv_offset;
+			info->format = FORMAT_BMP;
+			info->compression = COMPRESS_LZMA1;
+			info->compressed_size = 16;
+			info->original_size = 16;
+			offset += sizeof(*info);
+			sprintf(gbb_data + offset, "image %d%d", loc, i);
+			offset += info->compressed_size;
+		}
+	}
+}
+
+/* Read an image, and check it and how many times it was decompressed */
+static void ReadImage(uint32_t localization, uint32_t image_num,
+		      int expect_calls, const char *why)
+{
+	ScreenLayout layout;
+	ImageInfo image_info;
+	char expect[16];
+	char *data = NULL;
+	uint32_t size = 0;
+
+	decompress_calls = 0;
+	TEST_EQ(VbGbbReadImage(&cparams, localization, 0, image_num, &layout,
+			       &image_info, &data, &size), 0, why);
+	sprintf(expect, "image %d%d", localization, image_num);
+	TEST_STR_EQ(data, expect, "  data");
+	TEST_EQ(size, 16, "  size");
+	TEST_EQ(image_info.format, FORMAT_BMP, "  format");
+	TEST_EQ(decompress_calls, expect_calls, "  decompressed");
+	VbExFree(data);
+}
+
+/* Test keeping decompressed images */
+static void ImageCacheTest(void)
+{
+	/* Not kept by default */
+	ResetMocks();
+	SetupImages();
+	ReadImage(0, 0, 1, "Image not kept");
+	ReadImage(0, 0, 1, "Image not kept again");
+	TEST_PTR_EQ(cparams.image_cache, NULL, "  cache empty");
+	VbApiKernelFree(&cparams);
+
+	/* Room for two images; the least recently used one is dropped */
+	ResetMocks();
+	SetupImages();
+	cparams.image_cache_size = 32;
+	ReadImage(0, 0, 1, "Image 0");
+	ReadImage(0, 1, 1, "Image 1");
+	ReadImage(0, 0, 0, "Image 0 kept");
+	ReadImage(0, 2, 1, "Image 2");
+	TEST_EQ(cparams.image_cache_used, 32, "  cache full");
+	ReadImage(0, 0, 0, "Image 0 still kept");
+	ReadImage(0, 1, 1, "Image 1 dropped");
+
+	/* Other localizations are kept apart */
+	ReadImage(1, 1, 1, "Image 1, localization 1");
+	ReadImage(1, 1, 0, "Image 1, localization 1 kept");
+	ReadImage(0, 1, 0, "Image 1, localization 0 kept");
+	VbApiKernelFree(&cparams);
+	TEST_PTR_EQ(cparams.image_cache, NULL, "  cache freed");
+	TEST_EQ(cparams.image_cache_used, 0, "  cache empty");
+
+	/* Images bigger than the cache aren't kept */
+	ResetMocks();
+	SetupImages();
+	cparams.image_cache_size = 15;
+	ReadImage(0, 0, 1, "Image too big");
+	ReadImage(0, 0, 1, "Image too big again");
+	VbApiKernelFree(&cparams);
+}
+
+/* Decode some run-length encoded data, and check how it came out */
+static void RleCheck(const uint8_t *in, uint32_t in_size, uint32_t out_max,
+		     const char *expect, uint32_t expect_size, const char *why)
+{
+	uint8_t out[64];
+	uint32_t out_size = out_max;
+
+	Memset(out, 0, sizeof(out));
+	TEST_EQ(VbRleDecode(in, in_size, out, &out_size), 0, why);
+	TEST_EQ(out_size, expect_size, "  size");
+	TEST_EQ(memcmp(out, expect, expect_size), 0, "  data");
+}
+
+static void RleTest(void)
+{
+	const uint8_t bytes[] = {1, 2, 'a', 'b', 'c', RLE_RUN + 2, 'd', 0, 'e'};
+	const uint8_t pixels[] = {3, RLE_RUN + 1, 'x', 'y', 'z',
+				  1, 'a', 'b', 'c', 'd', 'e', 'f'};
+	const uint8_t long_run[] = {2, 0xff, 'p', 'q'};
+	const uint8_t bad_unit[] = {RLE_MAX_UNIT + 1, 0, 'a'};
+	const uint8_t short_literal[] = {1, 3, 'a', 'b'};
+	const uint8_t short_run[] = {2, RLE_RUN, 'a'};
+	uint8_t out[300];
+	uint32_t out_size;
+	uint32_t i;
+
+	RleCheck(bytes, sizeof(bytes), 64, "abcdddde", 8, "RLE bytes");
+	RleCheck(pixels, sizeof(pixels), 64, "xyzxyzxyzabcdef", 15,
+		 "RLE pixels");
+	RleCheck(bytes, 1, 64, "", 0, "RLE nothing");
+
+	out_size = sizeof(out);
+	TEST_EQ(VbRleDecode(long_run, sizeof(long_run), out, &out_size), 0,
+		"RLE longest run");
+	TEST_EQ(out_size, 2 * RLE_MAX_RUN, "  size");
+	for (i = 0; i < out_size && out[i] == (i & 1 ? 'q' : 'p'); i++)
+		;
+	TEST_EQ(i, out_size, "  data");
+
+	out_size = 7;
+	TEST_EQ(VbRleDecode(bytes, sizeof(bytes), out, &out_size),
+		VBERROR_INVALID_BMPFV, "RLE too big");
+	out_size = 4;
+	TEST_EQ(VbRleDecode(bytes, 3, out, &out_size),
+		VBERROR_INVALID_BMPFV, "RLE data cut short");
+	out_size = sizeof(out);
+	TEST_EQ(VbRleDecode(bytes, 0, out, &out_size),
+		VBERROR_INVALID_BMPFV, "RLE empty");
+	TEST_EQ(VbRleDecode(bad_unit, sizeof(bad_unit), out, &out_size),
+		VBERROR_INVALID_BMPFV, "RLE bad unit");
+	TEST_EQ(VbRleDecode(short_literal, sizeof(short_literal), out,
+			    &out_size),
+		VBERROR_INVALID_BMPFV, "RLE literal cut short");
+	TEST_EQ(VbRleDecode(short_run, sizeof(short_run), out, &out_size),
+		VBERROR_INVALID_BMPFV, "RLE run cut short");
+
+	/* Images are decoded without VbExDecompress() */
+	ResetMocks();
+	SetupImages();
+	for (i = 0; i < 3; i++) {
+		ImageInfo *info = (ImageInfo *)(gbb_data + 2048 +
+						i * (sizeof(*info) + 16));
+		uint8_t *data = (uint8_t *)(info + 1);
+		char image[16];
+
+		/* "image 0<i>", then zeroes */
+		Memcpy(image, data, sizeof(image));
+		data[0] = 1;
+		data[1] = 8;
+		Memcpy(data + 2, image, 9);
+		data[11] = RLE_RUN + 5;
+		data[12] = 0;
+		info->compression = COMPRESS_RLE;
+		info->compressed_size = 13;
+	}
+	ReadImage(0, 1, 0, "RLE image");
+	VbApiKernelFree(&cparams);
+}
+
+/* Add a [width]x[height] bitmap to the GBB; returns its image info offset */
+static uint32_t AddBitmap(uint32_t *offset, uint32_t width, uint32_t height)
+{
+	ImageInfo *info = (ImageInfo *)(gbb_data + *offset);
+	uint32_t image_info_offset = *offset - gbb->bmpfv_offset;
+
+	info->format = FORMAT_BMP;
+	info->width = width;
+	info->height = height;
+	info->compression = COMPRESS_NONE;
+	info->compressed_size = 16;
+	info->original_size = 16;
+	*offset += sizeof(*info) + info->compressed_size;
+	return image_info_offset;
+}
+
+static void PlaceImage(ScreenLayout *layout, int i, uint32_t image_info_offset,
+		       uint32_t x, uint32_t y)
+{
+	layout->images[i].image_info_offset = image_info_offset;
+	layout->images[i].x = x;
+	layout->images[i].y = y;
+}
+
+/*
+ * Screen 0 of each localization is a background, a logo, a message which
+ * differs for each localization, an icon on top of the message, and a
+ * footer.  The message for localization 2 is narrower than the others.
+ */
+static void SetupScreens(void)
+{
+	ScreenLayout *layout = (ScreenLayout *)(bhdr + 1);
+	uint32_t offset = 2048;
+	uint32_t background, logo, icon, footer;
+	int loc;
+
+	/* The layouts go over the keys, so move those past the images */
+	cparams.gbb->rootkey_offset = 3584;
+	cparams.gbb->recovery_key_offset = 3712;
+
+	bhdr->number_of_screenlayouts = 1;
+	background = AddBitmap(&offset, 640, 480);
+	logo = AddBitmap(&offset, 200, 100);
+	icon = AddBitmap(&offset, 20, 20);
+	footer = AddBitmap(&offset, 10, 10);
+	for (loc = 0; loc < bhdr->number_of_localizations; loc++, layout++) {
+		PlaceImage(layout, 0, background, 0, 0);
+		PlaceImage(layout, 1, logo, 100, 50);
+		PlaceImage(layout, 2,
+			   AddBitmap(&offset, loc == 2 ? 300 : 400, 40),
+			   100, 300);
+		PlaceImage(layout, 3, icon, 450, 310);
+		PlaceImage(layout, 4, footer, 10, 450);
+	}
+}
+
+static void SetLocalization(uint32_t loc)
+{
+	VbNvSet(&vnc, VBNV_LOCALIZATION_INDEX, loc);
+	VbNvTeardown(&vnc);
+}
+
+/* Test drawing only the parts of a screen which changed */
+static void RedrawTest(void)
+{
+	ResetMocks();
+	SetupScreens();
+	/* Start from something which isn't in the GBB */
+	VbDisplayScreen(&cparams, VB_SCREEN_BLANK, 1, &vnc);
+
+	SetLocalization(0);
+	display_image_calls = 0;
+	TEST_EQ(VbDisplayScreen(&cparams, VB_SCREEN_DEVELOPER_WARNING, 1,
+				&vnc), 0, "Draw screen");
+	TEST_EQ(display_image_calls, 5, "  all images drawn");
+	TEST_EQ(set_dimension_calls, 1, "  dimension set");
+
+	/* The message changed, and the icon on top of it is drawn again */
+	SetLocalization(1);
+	display_image_calls = 0;
+	set_dimension_calls = 0;
+	TEST_EQ(VbDisplayScreen(&cparams, VB_SCREEN_DEVELOPER_WARNING, 1,
+				&vnc), 0, "Change localization");
+	TEST_EQ(display_image_calls, 2, "  two images drawn");
+	TEST_EQ(display_image_x[0], 100, "  message");
+	TEST_EQ(display_image_x[1], 450, "  icon");
+	TEST_EQ(set_dimension_calls, 0, "  dimension not set");
+
+	/* Nothing changed */
+	display_image_calls = 0;
+	TEST_EQ(VbDisplayScreen(&cparams, VB_SCREEN_DEVELOPER_WARNING, 1,
+				&vnc), 0, "Same screen again");
+	TEST_EQ(display_image_calls, 0, "  nothing drawn");
+
+	/* A smaller message can't cover up the old one */
+	SetLocalization(2);
+	display_image_calls = 0;
+	TEST_EQ(VbDisplayScreen(&cparams, VB_SCREEN_DEVELOPER_WARNING, 1,
+				&vnc), 0, "Smaller message");
+	TEST_EQ(display_image_calls, 5, "  all images drawn");
+
+	/* A larger one can */
+	SetLocalization(0);
+	display_image_calls = 0;
+	TEST_EQ(VbDisplayScreen(&cparams, VB_SCREEN_DEVELOPER_WARNING, 1,
+				&vnc), 0, "Larger message");
+	TEST_EQ(display_image_calls, 2, "  two images drawn");
+
+	/* Debug info goes over the screen as it is the first time... */
+	display_image_calls = 0;
+	VbDisplayDebugInfo(&cparams, &vnc);
+	TEST_NEQ(*debug_info, '\0', "Debug info");
+	TEST_EQ(display_image_calls, 0, "  nothing drawn");
+
+	/* ...and isn't drawn again if it hasn't changed... */
+	VbDisplayDebugInfo(&cparams, &vnc);
+	TEST_EQ(display_image_calls, 0, "Same debug info draws nothing");
+
+	/* ...but the screen is drawn again to cover up the old debug info */
+	VbNvSet(&vnc, VBNV_DEV_BOOT_LEGACY, 1);
+	VbDisplayDebugInfo(&cparams, &vnc);
+	TEST_EQ(display_image_calls, 5, "Debug info again draws everything");
+
+	/* Debug text has to be covered up too */
+	VbDisplayDebugText("warning");
+	TEST_STR_EQ(debug_info, "warning", "Debug text");
+	display_image_calls = 0;
+	TEST_EQ(VbDisplayScreen(&cparams, VB_SCREEN_DEVELOPER_WARNING, 1,
+				&vnc), 0, "Redraw after debug text");
+	TEST_EQ(display_image_calls, 5, "  all images drawn");
+
+	/* A screen which isn't in the GBB leaves nothing to redraw over */
+	VbDisplayScreen(&cparams, VB_SCREEN_BLANK, 1, &vnc);
+	display_image_calls = 0;
+	TEST_EQ(VbDisplayScreen(&cparams, VB_SCREEN_DEVELOPER_WARNING, 1,
+				&vnc), 0, "Redraw after blank screen");
+	TEST_EQ(display_image_calls, 5, "  all images drawn");
+	VbApiKernelFree(&cparams);
+}
+
 static void FontTest(void)
 {
 	FontArrayHeader h;
@@ -240,7 +673,10 @@ static void FontTest(void)
 	Memcpy(eptr, eh, sizeof(eh));
 
 	fptr = VbInternalizeFontData((FontArrayHeader *)buf);
-	TEST_PTR_EQ(fptr, buf, "Internalize");
+	TEST_PTR_NEQ(fptr, NULL, "Internalize");
+	TEST_PTR_EQ(fptr->fonthdr, buf, "  font data");
+	TEST_PTR_EQ(fptr->glyphs['C'], &eptr[2], "  glyph table");
+	TEST_PTR_EQ(fptr->glyphs['X'], NULL, "  missing glyph");
 
 	TEST_PTR_EQ(VbFindFontGlyph(fptr, 'B', &bufferptr, &buffersize),
 		    &eptr[1].info, "Glyph found");
@@ -253,8 +689,83 @@ static void FontTest(void)
 	VbRenderTextAtPos(NULL, 0, 0, 0, fptr);
 	VbRenderTextAtPos("ABC", 0, 0, 0, NULL);
 
+	/* Text is drawn a glyph at a time */
+	display_image_calls = 0;
+	VbRenderTextAtPos("AB\nC", 0, 0, 0, fptr);
+	TEST_EQ(display_image_calls, 3, "Render text");
+
+	VbDoneWithFontForNow(fptr);
+
+	/* The first copy of a glyph wins */
+	eptr[2].ascii = 'B';
+	fptr = VbInternalizeFontData((FontArrayHeader *)buf);
+	TEST_PTR_EQ(VbFindFontGlyph(fptr, 'B', &bufferptr, &buffersize),
+		    &eptr[1].info, "Duplicate glyph");
+	VbDoneWithFontForNow(fptr);
+
+	/* A font needs at least one glyph */
+	h.num_entries = 0;
+	Memcpy(buf, &h, sizeof(h));
+	TEST_PTR_EQ(VbInternalizeFontData((FontArrayHeader *)buf), NULL,
+		    "Internalize empty font");
+	TEST_PTR_EQ(VbInternalizeFontData(NULL), NULL, "Internalize NULL");
+	VbDoneWithFontForNow(NULL);
+}
+
+static void FontAtlasTest(void)
+{
+	uint8_t buf[sizeof(FontAtlasHeader) + 'C' * sizeof(FontAtlasGlyph) +
+		    sizeof(RawImageHeader)];
+	FontAtlasHeader *h = (FontAtlasHeader *)buf;
+	FontAtlasGlyph *g = (FontAtlasGlyph *)(h + 1);
+	VbFont_t *fptr;
+
+	/* 'A', 'B' and a space, in an image 22 pixels wide; no 'C' */
+	Memset(buf, 0, sizeof(buf));
+	Memcpy(h->signature, FONT_ATLAS_SIGNATURE, FONT_SIGNATURE_SIZE);
+	h->num_glyphs = 'C';
+	h->default_glyph = 'A';
+	h->line_height = 12;
+	h->image_size = sizeof(RawImageHeader);
+	g['A'] = (FontAtlasGlyph){.x = 0, .width = 8, .height = 10};
+	g['B'] = (FontAtlasGlyph){.x = 8, .width = 9, .height = 12};
+	g[' '] = (FontAtlasGlyph){.x = 17, .width = 5, .height = 12};
+
+	/* Only drawn by a firmware library built with DISPLAY_FONT_ATLAS */
+	fptr = VbInternalizeFontData((FontArrayHeader *)buf);
+	if (!fptr) {
+		TEST_PTR_EQ(fptr, NULL, "Atlas fonts not drawn");
+		return;
+	}
+	TEST_PTR_EQ(fptr->atlas, buf, "Internalize atlas");
+
+	/* Each line is one call; missing glyphs are the default one */
+	display_rects_calls = 0;
+	display_image_calls = 0;
+	VbRenderTextAtPos("AB\n C", 0, 100, 50, fptr);
+	TEST_EQ(display_rects_calls, 2, "Render atlas text");
+	TEST_EQ(display_image_calls, 0, "  not a glyph at a time");
+	TEST_EQ(display_rects_count, 2, "  second line");
+	TEST_EQ(display_rects[0].x, 100, "  x");
+	TEST_EQ(display_rects[0].y, 62, "  line height");
+	TEST_EQ(display_rects[0].src_x, 17, "  space");
+	TEST_EQ(display_rects[1].x, 105, "  next x");
+	TEST_EQ(display_rects[1].src_x, 0, "  default glyph");
+	TEST_EQ(display_rects[1].width, 8, "  width");
+	TEST_EQ(display_rects[1].height, 10, "  height");
+
+	VbRenderTextAtPos("BB", 1, 100, 50, fptr);
+	TEST_EQ(display_rects[1].x, 82, "Right to left");
 	VbDoneWithFontForNow(fptr);
 
+	/* The default glyph has to be in the table */
+	h->default_glyph = 'C';
+	TEST_PTR_EQ(VbInternalizeFontData((FontArrayHeader *)buf), NULL,
+		    "Bad default glyph");
+	h->default_glyph = 'A';
+	h->num_glyphs = FONT_ATLAS_MAX_GLYPHS + 1;
+	TEST_PTR_EQ(VbInternalizeFontData((FontArrayHeader *)buf), NULL,
+		    "Too many glyphs");
 }
 
 int main(void)
@@ -262,7 +773,11 @@ int main(void)
 	DebugInfoTest();
 	LocalizationTest();
 	DisplayKeyTest();
+	ImageCacheTest();
+	RedrawTest();
+	RleTest();
 	FontTest();
+	FontAtlasTest();
 
 	if (vboot_api_stub_check_memory())
 		return 255;
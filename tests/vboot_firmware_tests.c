@@ -13,6 +13,7 @@
 #include "gbb_header.h"
 #include "host_common.h"
 #include "load_firmware_fw.h"
+#include "rollback_index.h"
 #include "test_common.h"
 #include "vboot_common.h"
 #include "vboot_nvstorage.h"
@@ -21,8 +22,13 @@
 /* Mock data */
 static VbCommonParams cparams;
 static VbSelectFirmwareParams fparams;
-static VbKeyBlockHeader vblock[2];
-static VbFirmwarePreambleHeader mpreamble[2];
+/* Preambles follow the key blocks, so key_block_size can reach them */
+static struct {
+  VbKeyBlockHeader vblock[2];
+  VbFirmwarePreambleHeader mpreamble[2];
+} mock_blocks;
+static VbKeyBlockHeader* vblock = mock_blocks.vblock;
+static VbFirmwarePreambleHeader* mpreamble = mock_blocks.mpreamble;
 static VbNvContext vnc;
 static uint8_t shared_data[VB_SHARED_DATA_MIN_SIZE];
 static VbSharedDataHeader* shared = (VbSharedDataHeader*)shared_data;
@@ -33,6 +39,8 @@ static uint32_t digest_size;
 static uint8_t* digest_returned;
 static uint8_t* digest_expect_ptr;
 static int hash_fw_index;
+static int hash_fw_calls;
+static int mock_lock_started;
 
 #define TEST_KEY_DATA	\
 	"Test contents for the root key this should be 64 chars long."
@@ -55,8 +63,7 @@ static void ResetMocks(void) {
   fparams.verification_block_B = vblock + 1;
   fparams.verification_size_B = sizeof(VbKeyBlockHeader);
 
-  Memset(vblock, 0, sizeof(vblock));
-  Memset(mpreamble, 0, sizeof(mpreamble));
+  Memset(&mock_blocks, 0, sizeof(mock_blocks));
   for (i = 0; i < 2; i++) {
     /* Default verification blocks to working in all modes */
     vblock[i].key_block_flags = 0x0F;
@@ -98,6 +105,8 @@ static void ResetMocks(void) {
   digest_returned = NULL;
   digest_expect_ptr = NULL;
   hash_fw_index = -1;
+  hash_fw_calls = 0;
+  mock_lock_started = 0;
 }
 
 /****************************************************************************/
@@ -120,6 +129,12 @@ int KeyBlockVerify(const VbKeyBlockHeader* block, uint64_t size,
   return block->header_version_major;
 }
 
+int KeyBlockVerifyCached(const VbKeyBlockHeader* block, uint64_t size,
+                         const VbPublicKey *key, int hash_only,
+                         PublicKeyCache *cache) {
+  return KeyBlockVerify(block, size, key, hash_only);
+}
+
 int VerifyFirmwarePreamble(const VbFirmwarePreambleHeader* preamble,
                            uint64_t size, const RSAPublicKey* key) {
   TEST_PTR_EQ(key, &data_key, "  Verify preamble data key");
@@ -153,13 +168,14 @@ void DigestUpdate(DigestContext* ctx, const uint8_t* data, uint32_t len) {
   digest_size += len;
 }
 
-uint8_t* DigestFinal(DigestContext* ctx) {
-  digest_returned = (uint8_t*)VbExMalloc(4);
-  return digest_returned;
+int DigestFinalInto(DigestContext* ctx, uint8_t* digest, uint32_t size) {
+  digest_returned = digest;
+  return 0;
 }
 
 VbError_t VbExHashFirmwareBody(VbCommonParams* cparams,
                                uint32_t firmware_index) {
+  hash_fw_calls++;
   if (VB_SELECT_FIRMWARE_A == firmware_index)
     hash_fw_index = 0;
   else if (VB_SELECT_FIRMWARE_B == firmware_index)
@@ -183,11 +199,19 @@ VbError_t VbExHashFirmwareBody(VbCommonParams* cparams,
   return mpreamble[hash_fw_index].body_signature.sig_offset;
 }
 
+uint32_t RollbackFirmwareLockStart(void) {
+  TEST_EQ(hash_fw_index, -1, "Lock started before hashing body");
+  mock_lock_started++;
+  return TPM_SUCCESS;
+}
+
 int VerifyDigest(const uint8_t* digest, const VbSignature *sig,
                  const RSAPublicKey* key) {
   TEST_PTR_EQ(digest, digest_returned, "Verifying expected digest");
   TEST_PTR_EQ(key, &data_key, "Verifying using data key");
-  TEST_PTR_EQ(sig, &mpreamble[hash_fw_index].body_signature, "Verifying sig");
+  if (hash_fw_index >= 0)
+    TEST_PTR_EQ(sig, &mpreamble[hash_fw_index].body_signature,
+                "Verifying sig");
   /* Mocked function uses sig size as return value for verifying digest */
   return sig->sig_size;
 }
@@ -399,6 +423,62 @@ static void LoadFirmwareTest(void) {
   TEST_EQ(hash_fw_index, 0, "Hash firmware data A");
   TEST_EQ(digest_size, mpreamble[0].body_signature.data_size,
           "Verified all data expected");
+  TEST_EQ(mock_lock_started, 1, "Locked TPM while hashing");
+
+  /* Bodies the caller already has are hashed without calling back */
+  ResetMocks();
+  fparams.body_A = vblock;
+  fparams.body_size_A = mpreamble[0].body_signature.data_size;
+  digest_expect_ptr = (uint8_t*)vblock;
+  TestLoadFirmware(VBERROR_SUCCESS, 0, "Verify firmware body from memory");
+  TEST_EQ(shared->firmware_index, 0, "  boot A");
+  TEST_EQ(hash_fw_calls, 0, "  no callback");
+  TEST_EQ(digest_size, mpreamble[0].body_signature.data_size,
+          "  hashed all of it");
+
+  ResetMocks();
+  vblock[1].key_block_flags = 0;  /* Invalid */
+  fparams.body_A = vblock;
+  fparams.body_size_A = mpreamble[0].body_signature.data_size - 1;
+  digest_expect_ptr = (uint8_t*)vblock;
+  TestLoadFirmware(VBERROR_LOAD_FIRMWARE,
+                   (VBNV_RECOVERY_RO_INVALID_RW_CHECK_MIN +
+                    VBSD_LF_CHECK_HASH_WRONG_SIZE),
+                   "Firmware body from memory wrong size");
+  TEST_EQ(hash_fw_calls, 0, "  no callback");
+
+  /* Don't lock early if the TPM version may need to roll forward */
+  ResetMocks();
+  vblock[1].key_block_flags = 0;  /* Invalid */
+  mpreamble[0].firmware_version = 5;
+  TestLoadFirmware(VBERROR_SUCCESS, 0, "Verify newer firmware body");
+  TEST_EQ(mock_lock_started, 0, "Didn't lock TPM while hashing");
+  TEST_EQ(shared->fw_version_tpm, 0x20005, "TPM version advanced");
+
+  /* Only start the lock once if the first body is bad */
+  ResetMocks();
+  mpreamble[0].body_signature.sig_size = 1;  /* Mock bad sig */
+  TestLoadFirmware(VBERROR_SUCCESS, 0, "Verify second firmware body");
+  TEST_EQ(shared->firmware_index, 1, "Boot B shared index");
+  TEST_EQ(mock_lock_started, 1, "Locked TPM once");
+  TEST_EQ(hash_fw_calls, 2, "Hashed both bodies");
+
+  /* A bad header for A falls back to B without touching A's body */
+  ResetMocks();
+  mpreamble[0].header_version_major = 1;  /* Simulate failure */
+  TestLoadFirmware(VBERROR_SUCCESS, 0, "Fall back to B after bad preamble");
+  TEST_EQ(shared->check_fw_a_result, VBSD_LF_CHECK_VERIFY_PREAMBLE,
+          "  preamble A invalid");
+  TEST_EQ(shared->firmware_index, 1, "  boot B");
+  TEST_EQ(hash_fw_calls, 1, "  only hashed one body");
+  TEST_EQ(hash_fw_index, 1, "  which was B's");
+
+  /* Good A at the TPM version doesn't need B's header or body at all */
+  ResetMocks();
+  TestLoadFirmware(VBERROR_SUCCESS, 0, "Boot A without checking B");
+  TEST_EQ(shared->check_fw_b_result, VBSD_LF_CHECK_NOT_DONE,
+          "  B not checked");
+  TEST_EQ(hash_fw_calls, 1, "  only hashed A's body");
 
   /* Test error getting firmware body */
   ResetMocks();
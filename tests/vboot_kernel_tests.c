@@ -12,6 +12,7 @@
 
 #include "cgptlib.h"
 #include "cgptlib_internal.h"
+#include "crc32.h"
 #include "gbb_header.h"
 #include "gpt.h"
 #include "host_common.h"
@@ -21,6 +22,7 @@
 #include "vboot_common.h"
 #include "vboot_kernel.h"
 #include "vboot_nvstorage.h"
+#include "vboot_workbuf.h"
 
 #define LOGCALL(fmt, args...) sprintf(call_log + strlen(call_log), fmt, ##args)
 #define TEST_CALLS(expect_log) TEST_STR_EQ(call_log, expect_log, "  calls")
@@ -41,22 +43,56 @@ static int mock_part_next;
 
 /* Mock data */
 static char call_log[4096];
-static uint8_t kernel_buffer[80000];
+static uint8_t kernel_buffer[200000];
+static uint8_t load_buffer[80000];
+static uint8_t *mock_body_buffer;
+static int resolve_supported;
+static int resolve_calls;
 static int disk_read_to_fail;
 static int disk_write_to_fail;
 static int gpt_init_fail;
 static int key_block_verify_fail;  /* 0=ok, 1=sig, 2=hash */
+static int key_block_verify_calls;
 static int preamble_verify_fail;
 static int verify_data_fail;
+static int verify_data_calls;
+static int verify_blocks_fail;
+static RSAPublicKey mock_rsa_key;
 static RSAPublicKey *mock_data_key;
 static int mock_data_key_allocated;
 static int gpt_flag_external;
+static int gpt_flag_lazy;
+static int gpt_flag_lazy_write;
+static uint64_t mock_timer;
+static int stream_chunks_supported;
+static int stream_chunks_calls;
+static int stream_chunks_done;
+static uint32_t stream_chunk_bytes;
+static uint32_t mock_sector_bytes;
+static int decompress_stream_supported;
+static int decompress_stream_open_fail;
+static int decompress_calls;
+static int decompress_stream_writes;
+
+/* Mock decompression stream; the mock "compression" halves the data */
+static struct {
+	uint8_t *out;
+	uint32_t out_size;
+	uint32_t done;
+} mock_decompress;
+
+/* Mock stream, in the mock disk's sectors */
+static struct {
+	VbExDiskHandle_t handle;
+	uint64_t sector;
+	uint64_t sectors_left;
+} mock_stream;
 
 static uint8_t gbb_data[sizeof(GoogleBinaryBlockHeader) + 2048];
 static GoogleBinaryBlockHeader *gbb = (GoogleBinaryBlockHeader*)gbb_data;
 static VbExDiskHandle_t handle;
 static VbNvContext vnc;
-static uint8_t shared_data[VB_SHARED_DATA_MIN_SIZE];
+static uint8_t shared_data[VB_SHARED_DATA_REC_SIZE];
 static VbSharedDataHeader *shared = (VbSharedDataHeader *)shared_data;
 static LoadKernelParams lkp;
 static VbKeyBlockHeader kbh;
@@ -70,11 +106,16 @@ static GptHeader *mock_gpt_secondary =
 
 
 /**
- * Prepare a valid GPT header that will pass CheckHeader() tests
+ * Prepare a valid GPT header that will pass CheckHeader() tests, for the mock
+ * disk in [sector_bytes]-byte sectors.
  */
-static void SetupGptHeader(GptHeader *h, int is_secondary)
+static void SetupGptHeader(GptHeader *h, int is_secondary,
+			   uint32_t sector_bytes)
 {
-	Memset(h, '\0', MOCK_SECTOR_SIZE);
+	uint64_t sector_count = sizeof(mock_disk) / sector_bytes;
+	uint64_t entries_sectors;
+
+	Memset(h, '\0', sector_bytes);
 
 	/* "EFI PART" */
 	memcpy(h->signature, GPT_HEADER_SIGNATURE, GPT_HEADER_SIGNATURE_SIZE);
@@ -86,16 +127,17 @@ static void SetupGptHeader(GptHeader *h, int is_secondary)
 	h->number_of_entries = MAX_NUMBER_OF_ENTRIES;
 
 	/* Set LBA pointers for primary or secondary header */
+	entries_sectors = CalculateEntriesSectors(h, sector_bytes);
 	if (is_secondary) {
-		h->my_lba = MOCK_SECTOR_COUNT - GPT_HEADER_SECTORS;
-		h->entries_lba = h->my_lba - CalculateEntriesSectors(h);
+		h->my_lba = sector_count - GPT_HEADER_SECTORS;
+		h->entries_lba = h->my_lba - entries_sectors;
 	} else {
 		h->my_lba = GPT_PMBR_SECTORS;
 		h->entries_lba = h->my_lba + 1;
 	}
 
-	h->first_usable_lba = 2 + CalculateEntriesSectors(h);
-	h->last_usable_lba = MOCK_SECTOR_COUNT - 2 - CalculateEntriesSectors(h);
+	h->first_usable_lba = 2 + entries_sectors;
+	h->last_usable_lba = sector_count - 2 - entries_sectors;
 
 	h->header_crc32 = HeaderCrc(h);
 }
@@ -111,29 +153,57 @@ static void ResetCallLog(void)
 static void ResetMocks(void)
 {
 	ResetCallLog();
+	MockCostReset();
 
 	memset(&mock_disk, 0, sizeof(mock_disk));
-	SetupGptHeader(mock_gpt_primary, 0);
-	SetupGptHeader(mock_gpt_secondary, 1);
+	SetupGptHeader(mock_gpt_primary, 0, MOCK_SECTOR_SIZE);
+	SetupGptHeader(mock_gpt_secondary, 1, MOCK_SECTOR_SIZE);
+	mock_sector_bytes = MOCK_SECTOR_SIZE;
 
 	disk_read_to_fail = -1;
 	disk_write_to_fail = -1;
 
 	gpt_init_fail = 0;
 	key_block_verify_fail = 0;
+	key_block_verify_calls = 0;
 	preamble_verify_fail = 0;
 	verify_data_fail = 0;
+	verify_data_calls = 0;
+	verify_blocks_fail = 0;
 
-	mock_data_key = (RSAPublicKey *)"TestDataKey";
+	memset(&mock_rsa_key, 0, sizeof(mock_rsa_key));
+	mock_rsa_key.algorithm = 4;  /* RSA2048 with SHA256 */
+	mock_data_key = &mock_rsa_key;
 	mock_data_key_allocated = 0;
 
 	gpt_flag_external = 0;
+	gpt_flag_lazy = 0;
+	gpt_flag_lazy_write = 0;
+	mock_timer = 0;
+
+	stream_chunks_supported = 0;
+	stream_chunks_calls = 0;
+	stream_chunks_done = 0;
+	stream_chunk_bytes = 0;
+
+	mock_body_buffer = kernel_buffer;
+	resolve_supported = 0;
+	resolve_calls = 0;
+
+	decompress_stream_supported = 0;
+	decompress_stream_open_fail = 0;
+	decompress_calls = 0;
+	decompress_stream_writes = 0;
+	memset(&mock_decompress, 0, sizeof(mock_decompress));
 
 	memset(gbb, 0, sizeof(*gbb));
 	gbb->major_version = GBB_MAJOR_VER;
 	gbb->minor_version = GBB_MINOR_VER;
 	gbb->flags = 0;
 
+	/* LoadKernel() keeps the recovery key it read for the next call */
+	if (cparams.recovery_key)
+		VbExFree(cparams.recovery_key);
 	memset(&cparams, '\0', sizeof(cparams));
 	cparams.gbb = gbb;
 	cparams.gbb_data = gbb;
@@ -163,6 +233,12 @@ static void ResetMocks(void)
 	kbh.data_key.key_version = 2;
 	kbh.key_block_flags = -1;
 	kbh.key_block_size = sizeof(kbh);
+	/*
+	 * Make the data key look like mock_rsa_key (len 0, n0inv 0) to the key
+	 * cache, so partitions share it.  Its data is its own zero key_offset.
+	 */
+	kbh.data_key.algorithm = mock_rsa_key.algorithm;
+	kbh.data_key.key_size = 2 * sizeof(uint32_t);
 
 	memset(&kph, 0, sizeof(kph));
 	kph.kernel_version = 1;
@@ -179,17 +255,170 @@ static void ResetMocks(void)
 
 /* Mocks */
 
+uint64_t VbExGetTimer(void)
+{
+	return mock_timer += 10;
+}
+
 VbError_t VbExDiskRead(VbExDiskHandle_t handle, uint64_t lba_start,
                        uint64_t lba_count, void *buffer)
 {
 	LOGCALL("VbExDiskRead(h, %d, %d)\n", (int)lba_start, (int)lba_count);
 
+	MockCostDiskRead(lba_count * mock_sector_bytes);
+
 	if ((int)lba_start == disk_read_to_fail)
 		return VBERROR_SIMULATED;
 
-	memcpy(buffer, &mock_disk[lba_start * MOCK_SECTOR_SIZE],
-	       lba_count * MOCK_SECTOR_SIZE);
+	memcpy(buffer, &mock_disk[lba_start * mock_sector_bytes],
+	       lba_count * mock_sector_bytes);
+
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExStreamOpen(VbExDiskHandle_t handle, uint64_t lba_start,
+			 uint64_t lba_count, VbExStream_t *stream)
+{
+	if (!handle) {
+		*stream = NULL;
+		return VBERROR_UNKNOWN;
+	}
+
+	mock_stream.handle = handle;
+	mock_stream.sector = lba_start;
+	mock_stream.sectors_left = lba_count;
+	*stream = (VbExStream_t)&mock_stream;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExStreamRead(VbExStream_t stream, uint32_t bytes, void *buffer)
+{
+	uint64_t sectors = bytes / mock_sector_bytes;
+	VbError_t rv;
+
+	/* Like the stub, only whole sectors can be read */
+	if (bytes % mock_sector_bytes || sectors > mock_stream.sectors_left)
+		return VBERROR_UNKNOWN;
+
+	rv = VbExDiskRead(mock_stream.handle, mock_stream.sector, sectors,
+			  buffer);
+	if (rv)
+		return rv;
+
+	mock_stream.sector += sectors;
+	mock_stream.sectors_left -= sectors;
+	return VBERROR_SUCCESS;
+}
+
+void VbExStreamClose(VbExStream_t stream)
+{
+}
+
+VbError_t VbExStreamReadChunks(VbExStream_t stream, uint32_t bytes,
+			       void *buffer, uint32_t chunk_bytes,
+			       VbExStreamChunkDone_t done, void *ctx)
+{
+	uint8_t *chunk = buffer;
+	VbError_t rv;
+
+	if (!stream_chunks_supported)
+		return VBERROR_STREAM_CHUNKS_UNSUPPORTED;
+
+	stream_chunks_calls++;
+	stream_chunk_bytes = chunk_bytes;
+
+	/* Read it all at once, then report it a piece at a time */
+	rv = VbExStreamRead(stream, bytes, buffer);
+	if (rv)
+		return rv;
+
+	while (bytes) {
+		uint32_t n = bytes < chunk_bytes ? bytes : chunk_bytes;
+
+		done(ctx, chunk, n);
+		stream_chunks_done++;
+		chunk += n;
+		bytes -= n;
+	}
+
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExKernelBufferResolve(uint64_t load_address, uint64_t size,
+				  void **buffer)
+{
+	if (!resolve_supported)
+		return VBERROR_KERNEL_BUFFER_UNSUPPORTED;
 
+	LOGCALL("VbExKernelBufferResolve(0x%x, %d)\n", (int)load_address,
+		(int)size);
+	resolve_calls++;
+	*buffer = load_buffer;
+	return VBERROR_SUCCESS;
+}
+
+/* Each byte of input decompresses to two of output */
+static void MockDecompress(const uint8_t *in, uint32_t in_size, uint8_t *out)
+{
+	uint32_t i;
+
+	for (i = 0; i < in_size; i++)
+		out[2 * i] = out[2 * i + 1] = in[i];
+}
+
+VbError_t VbExDecompress(void *inbuf, uint32_t in_size,
+			 uint32_t compression_type,
+			 void *outbuf, uint32_t *out_size)
+{
+	decompress_calls++;
+	TEST_EQ(compression_type, COMPRESS_LZMA1, "  compression type");
+
+	if (2 * in_size > *out_size)
+		return VBERROR_SIMULATED;
+
+	MockDecompress(inbuf, in_size, outbuf);
+	*out_size = 2 * in_size;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDecompressStreamOpenMemory(uint32_t compression_type,
+					 void *outbuf, uint32_t out_size,
+					 VbExDecompressStream_t *stream)
+{
+	if (!decompress_stream_supported)
+		return VBERROR_DECOMPRESS_STREAM_UNSUPPORTED;
+	if (decompress_stream_open_fail)
+		return VBERROR_SIMULATED;
+
+	TEST_EQ(compression_type, COMPRESS_LZMA1, "  stream compression");
+	mock_decompress.out = outbuf;
+	mock_decompress.out_size = out_size;
+	mock_decompress.done = 0;
+	*stream = (VbExDecompressStream_t)&mock_decompress;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDecompressStreamWrite(VbExDecompressStream_t stream,
+				    const void *inbuf, uint32_t in_size)
+{
+	TEST_PTR_EQ(stream, &mock_decompress, "  decompress stream");
+	decompress_stream_writes++;
+
+	if (2 * (mock_decompress.done + in_size) > mock_decompress.out_size)
+		return VBERROR_SIMULATED;
+
+	MockDecompress(inbuf, in_size,
+		       mock_decompress.out + 2 * mock_decompress.done);
+	mock_decompress.done += in_size;
+	return VBERROR_SUCCESS;
+}
+
+VbError_t VbExDecompressStreamClose(VbExDecompressStream_t stream)
+{
+	TEST_PTR_EQ(stream, &mock_decompress, "  decompress stream closed");
+
+	if (2 * mock_decompress.done != mock_decompress.out_size)
+		return VBERROR_SIMULATED;
 	return VBERROR_SUCCESS;
 }
 
@@ -198,11 +427,13 @@ VbError_t VbExDiskWrite(VbExDiskHandle_t handle, uint64_t lba_start,
 {
 	LOGCALL("VbExDiskWrite(h, %d, %d)\n", (int)lba_start, (int)lba_count);
 
+	MockCostDiskWrite(lba_count * mock_sector_bytes);
+
 	if ((int)lba_start == disk_write_to_fail)
 		return VBERROR_SIMULATED;
 
-	memcpy(&mock_disk[lba_start * MOCK_SECTOR_SIZE], buffer,
-	       lba_count * MOCK_SECTOR_SIZE);
+	memcpy(&mock_disk[lba_start * mock_sector_bytes], buffer,
+	       lba_count * mock_sector_bytes);
 
 	return VBERROR_SUCCESS;
 }
@@ -221,6 +452,10 @@ int GptNextKernelEntry(GptData *gpt, uint64_t *start_sector, uint64_t *size)
 
 	if (gpt->flags & GPT_FLAG_EXTERNAL)
 		gpt_flag_external++;
+	if (gpt->flags & GPT_FLAG_LAZY_SECONDARY)
+		gpt_flag_lazy++;
+	if (gpt->flags & GPT_FLAG_LAZY_SECONDARY_WRITE)
+		gpt_flag_lazy_write++;
 
 	gpt->current_kernel = mock_part_next;
 	*start_sector = p->start;
@@ -236,8 +471,25 @@ void GetCurrentKernelUniqueGuid(GptData *gpt, void *dest)
 	memcpy(dest, fake_guid, sizeof(fake_guid));
 }
 
+int KeyBlockPreVerify(const VbKeyBlockHeader *block, uint64_t size,
+		      uint64_t flags, uint64_t min_key_version)
+{
+	/* Use this as an opportunity to override the key block */
+	memcpy((void *)block, &kbh, sizeof(kbh));
+
+	if ((kbh.key_block_flags & flags) != flags)
+		return VBOOT_KEY_BLOCK_FLAGS;
+	if (kbh.data_key.key_version < min_key_version ||
+	    kbh.data_key.key_version > 0xFFFF)
+		return VBOOT_KEY_BLOCK_VERSION;
+	return VBOOT_SUCCESS;
+}
+
 int KeyBlockVerify(const VbKeyBlockHeader *block, uint64_t size,
 		   const VbPublicKey *key, int hash_only) {
+	key_block_verify_calls++;
+	if (!hash_only)
+		MockCostRsa();
 
 	if (hash_only && key_block_verify_fail >= 2)
 		return VBERROR_SIMULATED;
@@ -249,6 +501,13 @@ int KeyBlockVerify(const VbKeyBlockHeader *block, uint64_t size,
 	return VBERROR_SUCCESS;
 }
 
+int KeyBlockVerifyCached(const VbKeyBlockHeader *block, uint64_t size,
+			 const VbPublicKey *key, int hash_only,
+			 PublicKeyCache *cache)
+{
+	return KeyBlockVerify(block, size, key, hash_only);
+}
+
 RSAPublicKey *PublicKeyToRSA(const VbPublicKey *key)
 {
 	TEST_EQ(mock_data_key_allocated, 0, "  mock data key not allocated");
@@ -269,6 +528,8 @@ void RSAPublicKeyFree(RSAPublicKey* key)
 int VerifyKernelPreamble(const VbKernelPreambleHeader *preamble,
 			 uint64_t size, const RSAPublicKey *key)
 {
+	MockCostRsa();
+
 	if (preamble_verify_fail)
 		return VBERROR_SIMULATED;
 
@@ -277,15 +538,39 @@ int VerifyKernelPreamble(const VbKernelPreambleHeader *preamble,
 	return VBERROR_SUCCESS;
 }
 
-int VerifyData(const uint8_t *data, uint64_t size, const VbSignature *sig,
-	       const RSAPublicKey *key)
+int VerifyDigest(const uint8_t *digest, const VbSignature *sig,
+		 const RSAPublicKey *key)
 {
+	uint8_t *expect;
+
+	verify_data_calls++;
+	MockCostRsa();
+
+	/* The streamed hash must match hashing the whole body at once */
+	expect = DigestBuf(mock_body_buffer, sig->data_size, key->algorithm);
+	TEST_EQ(memcmp(digest, expect, SHA256_DIGEST_SIZE), 0,
+		"  body digest");
+	VbWorkbufFree(expect);
+
 	if (verify_data_fail)
 		return VBERROR_SIMULATED;
 
 	return VBERROR_SUCCESS;
 }
 
+int VerifyKernelBodyBlocks(const VbKernelPreambleHeader *preamble,
+			   const uint8_t *body, uint64_t offset,
+			   uint64_t size, const RSAPublicKey *key)
+{
+	LOGCALL("VerifyKernelBodyBlocks(0x%x, 0x%x)\n", (int)offset,
+		(int)size);
+
+	if (verify_blocks_fail)
+		return VBERROR_SIMULATED;
+
+	return VBERROR_SUCCESS;
+}
+
 
 /**
  * Test reading/writing GPT
@@ -298,13 +583,19 @@ static void ReadWriteGptTest(void)
 	g.sector_bytes = MOCK_SECTOR_SIZE;
 	g.streaming_drive_sectors = g.gpt_drive_sectors = MOCK_SECTOR_COUNT;
 	g.valid_headers = g.valid_entries = MASK_BOTH;
+	g.flags = 0;
 
 	ResetMocks();
+	mock_disk[2 * MOCK_SECTOR_SIZE] = 0x12;
+	mock_disk[991 * MOCK_SECTOR_SIZE] = 0x34;
 	TEST_EQ(AllocAndReadGptData(handle, &g), 0, "AllocAndRead");
-	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
-		   "VbExDiskRead(h, 2, 32)\n"
-		   "VbExDiskRead(h, 1023, 1)\n"
-		   "VbExDiskRead(h, 991, 32)\n");
+	/* Each header is read along with its entries */
+	TEST_CALLS("VbExDiskRead(h, 1, 33)\n"
+		   "VbExDiskRead(h, 991, 33)\n");
+	TEST_EQ(g.primary_entries[0], 0x12, "  primary entries");
+	TEST_EQ(g.secondary_entries[0], 0x34, "  secondary entries");
+	TEST_EQ(((GptHeader *)g.secondary_header)->my_lba, 1023,
+		"  secondary header");
 	ResetCallLog();
 	/*
 	 * Valgrind complains about access to uninitialized memory here, so
@@ -314,6 +605,72 @@ static void ReadWriteGptTest(void)
 	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree");
 	TEST_CALLS("");
 
+	/*
+	 * Entries that aren't next to the header are read separately.  Only
+	 * an external GPT can have fewer than the max.
+	 */
+	ResetMocks();
+	g.flags = GPT_FLAG_EXTERNAL;
+	mock_gpt_primary->number_of_entries = MAX_NUMBER_OF_ENTRIES / 2;
+	mock_gpt_primary->header_crc32 = HeaderCrc(mock_gpt_primary);
+	mock_gpt_secondary->number_of_entries = MAX_NUMBER_OF_ENTRIES / 2;
+	mock_gpt_secondary->entries_lba = 1007;
+	mock_gpt_secondary->header_crc32 = HeaderCrc(mock_gpt_secondary);
+	mock_disk[1007 * MOCK_SECTOR_SIZE] = 0x56;
+	TEST_EQ(AllocAndReadGptData(handle, &g), 0, "AllocAndRead fewer entries");
+	TEST_CALLS("VbExDiskRead(h, 1, 33)\n"
+		   "VbExDiskRead(h, 991, 33)\n"
+		   "VbExDiskRead(h, 1007, 16)\n");
+	TEST_EQ(g.secondary_entries[0], 0x56, "  secondary entries");
+	Memset(g.primary_header, '\0', g.sector_bytes);
+	WriteAndFreeGptData(handle, &g);
+	g.flags = 0;
+
+	/* A drive too small for that reads them separately */
+	ResetMocks();
+	g.streaming_drive_sectors = g.gpt_drive_sectors = 66;
+	TEST_EQ(AllocAndReadGptData(handle, &g), 1, "AllocAndRead small drive");
+	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
+		   "VbExDiskRead(h, 65, 1)\n");
+	WriteAndFreeGptData(handle, &g);
+	g.streaming_drive_sectors = g.gpt_drive_sectors = MOCK_SECTOR_COUNT;
+
+	/* A good primary GPT is enough if the secondary is left to the OS */
+	ResetMocks();
+	g.flags = GPT_FLAG_LAZY_SECONDARY;
+	mock_gpt_primary->entries_crc32 =
+		Crc32(&mock_disk[2 * MOCK_SECTOR_SIZE],
+		      MAX_NUMBER_OF_ENTRIES * sizeof(GptEntry));
+	mock_gpt_primary->header_crc32 = HeaderCrc(mock_gpt_primary);
+	TEST_EQ(AllocAndReadGptData(handle, &g), 0, "AllocAndRead lazy");
+	TEST_CALLS("VbExDiskRead(h, 1, 33)\n");
+	TEST_EQ(g.secondary_unread, 1, "  secondary unread");
+	TEST_EQ(((GptHeader *)g.secondary_header)->my_lba, 0,
+		"  secondary header zeroed");
+	ResetCallLog();
+	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree lazy");
+	TEST_CALLS("");
+
+	/* But bad primary entries mean the secondary is read after all */
+	ResetMocks();
+	TEST_EQ(AllocAndReadGptData(handle, &g), 0,
+		"AllocAndRead lazy, bad primary entries");
+	TEST_CALLS("VbExDiskRead(h, 1, 33)\n"
+		   "VbExDiskRead(h, 991, 33)\n");
+	TEST_EQ(g.secondary_unread, 0, "  secondary read");
+	WriteAndFreeGptData(handle, &g);
+
+	/* As does a bad primary header */
+	ResetMocks();
+	Memset(mock_gpt_primary, '\0', sizeof(*mock_gpt_primary));
+	TEST_EQ(AllocAndReadGptData(handle, &g), 0,
+		"AllocAndRead lazy, bad primary header");
+	TEST_CALLS("VbExDiskRead(h, 1, 33)\n"
+		   "VbExDiskRead(h, 991, 33)\n");
+	TEST_EQ(g.secondary_unread, 0, "  secondary read");
+	WriteAndFreeGptData(handle, &g);
+	g.flags = 0;
+
 	/*
 	 * Invalidate primary GPT header,
 	 * check that AllocAndReadGptData still succeeds
@@ -323,14 +680,13 @@ static void ReadWriteGptTest(void)
 	TEST_EQ(AllocAndReadGptData(handle, &g), 0,
 		"AllocAndRead primary invalid");
 	TEST_EQ(CheckHeader(mock_gpt_primary, 0, g.streaming_drive_sectors,
-                g.gpt_drive_sectors, 0),
+                g.gpt_drive_sectors, 0, g.sector_bytes),
                 1, "Primary header is invalid");
 	TEST_EQ(CheckHeader(mock_gpt_secondary, 1, g.streaming_drive_sectors,
-		g.gpt_drive_sectors, 0),
+		g.gpt_drive_sectors, 0, g.sector_bytes),
                 0, "Secondary header is valid");
-	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
-		   "VbExDiskRead(h, 1023, 1)\n"
-		   "VbExDiskRead(h, 991, 32)\n");
+	TEST_CALLS("VbExDiskRead(h, 1, 33)\n"
+		   "VbExDiskRead(h, 991, 33)\n");
 	WriteAndFreeGptData(handle, &g);
 
 	/*
@@ -342,14 +698,13 @@ static void ReadWriteGptTest(void)
 	TEST_EQ(AllocAndReadGptData(handle, &g), 0,
 		"AllocAndRead secondary invalid");
 	TEST_EQ(CheckHeader(mock_gpt_primary, 0, g.streaming_drive_sectors,
-		g.gpt_drive_sectors, 0),
+		g.gpt_drive_sectors, 0, g.sector_bytes),
                 0, "Primary header is valid");
 	TEST_EQ(CheckHeader(mock_gpt_secondary, 1, g.streaming_drive_sectors,
-		g.gpt_drive_sectors, 0),
+		g.gpt_drive_sectors, 0, g.sector_bytes),
                 1, "Secondary header is invalid");
-	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
-		   "VbExDiskRead(h, 2, 32)\n"
-		   "VbExDiskRead(h, 1023, 1)\n");
+	TEST_CALLS("VbExDiskRead(h, 1, 33)\n"
+		   "VbExDiskRead(h, 991, 33)\n");
 	WriteAndFreeGptData(handle, &g);
 
 	/*
@@ -362,13 +717,13 @@ static void ReadWriteGptTest(void)
 	TEST_EQ(AllocAndReadGptData(handle, &g), 1,
 		"AllocAndRead primary and secondary invalid");
 	TEST_EQ(CheckHeader(mock_gpt_primary, 0, g.streaming_drive_sectors,
-		g.gpt_drive_sectors, 0),
+		g.gpt_drive_sectors, 0, g.sector_bytes),
                 1, "Primary header is invalid");
 	TEST_EQ(CheckHeader(mock_gpt_secondary, 1, g.streaming_drive_sectors,
-		g.gpt_drive_sectors, 0),
+		g.gpt_drive_sectors, 0, g.sector_bytes),
                 1, "Secondary header is invalid");
-	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
-		   "VbExDiskRead(h, 1023, 1)\n");
+	TEST_CALLS("VbExDiskRead(h, 1, 33)\n"
+		   "VbExDiskRead(h, 991, 33)\n");
 	WriteAndFreeGptData(handle, &g);
 
 	/*
@@ -387,13 +742,11 @@ static void ReadWriteGptTest(void)
 	GptRepair(&g);
 	TEST_EQ(WriteAndFreeGptData(handle, &g), 0,
 		"Fix Primary GPT: WriteAndFreeGptData");
-	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
-		   "VbExDiskRead(h, 1023, 1)\n"
-		   "VbExDiskRead(h, 991, 32)\n"
-		   "VbExDiskWrite(h, 1, 1)\n"
-		   "VbExDiskWrite(h, 2, 32)\n");
+	TEST_CALLS("VbExDiskRead(h, 1, 33)\n"
+		   "VbExDiskRead(h, 991, 33)\n"
+		   "VbExDiskWrite(h, 1, 33)\n");
 	TEST_EQ(CheckHeader(mock_gpt_primary, 0, g.streaming_drive_sectors,
-		g.gpt_drive_sectors, 0),
+		g.gpt_drive_sectors, 0, g.sector_bytes),
                 0, "Fix Primary GPT: Primary header is valid");
 
 	/*
@@ -412,15 +765,60 @@ static void ReadWriteGptTest(void)
 	GptRepair(&g);
 	TEST_EQ(WriteAndFreeGptData(handle, &g), 0,
 		"Fix Secondary GPT: WriteAndFreeGptData");
-	TEST_CALLS("VbExDiskRead(h, 1, 1)\n"
-		   "VbExDiskRead(h, 2, 32)\n"
-		   "VbExDiskRead(h, 1023, 1)\n"
-		   "VbExDiskWrite(h, 1023, 1)\n"
-		   "VbExDiskWrite(h, 991, 32)\n");
+	TEST_CALLS("VbExDiskRead(h, 1, 33)\n"
+		   "VbExDiskRead(h, 991, 33)\n"
+		   "VbExDiskWrite(h, 991, 33)\n");
 	TEST_EQ(CheckHeader(mock_gpt_secondary, 1, g.streaming_drive_sectors,
-		g.gpt_drive_sectors, 0),
+		g.gpt_drive_sectors, 0, g.sector_bytes),
                 0, "Fix Secondary GPT: Secondary header is valid");
 
+	/* Only the sectors of the entries which were out of date */
+	ResetMocks();
+	mock_disk[996 * MOCK_SECTOR_SIZE + 8] = 0x12;
+	mock_disk[999 * MOCK_SECTOR_SIZE + 100] = 0x34;
+	TEST_EQ(AllocAndReadGptData(handle, &g), 0,
+		"Fix Secondary entries: AllocAndRead");
+	g.valid_headers = MASK_BOTH;
+	g.valid_entries = MASK_PRIMARY;
+	GptRepair(&g);
+	TEST_EQ(WriteAndFreeGptData(handle, &g), 0,
+		"Fix Secondary entries: WriteAndFreeGptData");
+	TEST_CALLS("VbExDiskRead(h, 1, 33)\n"
+		   "VbExDiskRead(h, 991, 33)\n"
+		   "VbExDiskWrite(h, 996, 4)\n");
+	TEST_EQ(mock_disk[996 * MOCK_SECTOR_SIZE + 8] |
+		mock_disk[999 * MOCK_SECTOR_SIZE + 100], 0,
+		"Fix Secondary entries: repaired");
+
+	ResetMocks();
+	mock_disk[6 * MOCK_SECTOR_SIZE] = 0x56;
+	TEST_EQ(AllocAndReadGptData(handle, &g), 0,
+		"Fix Primary entries: AllocAndRead");
+	g.valid_headers = MASK_BOTH;
+	g.valid_entries = MASK_SECONDARY;
+	GptRepair(&g);
+	TEST_EQ(WriteAndFreeGptData(handle, &g), 0,
+		"Fix Primary entries: WriteAndFreeGptData");
+	TEST_CALLS("VbExDiskRead(h, 1, 33)\n"
+		   "VbExDiskRead(h, 991, 33)\n"
+		   "VbExDiskWrite(h, 6, 1)\n");
+	TEST_EQ(mock_disk[6 * MOCK_SECTOR_SIZE], 0,
+		"Fix Primary entries: repaired");
+
+	/* Changed entries at the start still go out with the header */
+	ResetMocks();
+	mock_disk[2 * MOCK_SECTOR_SIZE] = 0x56;
+	AllocAndReadGptData(handle, &g);
+	g.valid_headers = MASK_BOTH;
+	g.valid_entries = MASK_SECONDARY;
+	GptRepair(&g);
+	g.modified |= GPT_MODIFIED_HEADER1;
+	TEST_EQ(WriteAndFreeGptData(handle, &g), 0,
+		"Fix Primary entries and header");
+	TEST_CALLS("VbExDiskRead(h, 1, 33)\n"
+		   "VbExDiskRead(h, 991, 33)\n"
+		   "VbExDiskWrite(h, 1, 2)\n");
+
 	/* Data which is changed is written */
 	ResetMocks();
 	AllocAndReadGptData(handle, &g);
@@ -432,8 +830,35 @@ static void ReadWriteGptTest(void)
 	h->number_of_entries = MAX_NUMBER_OF_ENTRIES;
 	h->size_of_entry = sizeof(GptEntry);
 	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree mod 1");
+	/* The header and entries next to it are written together */
+	TEST_CALLS("VbExDiskWrite(h, 1, 33)\n");
+
+	/* Just the entries */
+	ResetMocks();
+	AllocAndReadGptData(handle, &g);
+	g.modified |= GPT_MODIFIED_ENTRIES1;
+	ResetCallLog();
+	Memset(g.primary_header, '\0', g.sector_bytes);
+	h = (GptHeader*)g.primary_header;
+	h->entries_lba = 2;
+	h->number_of_entries = MAX_NUMBER_OF_ENTRIES;
+	h->size_of_entry = sizeof(GptEntry);
+	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree entries 1");
+	TEST_CALLS("VbExDiskWrite(h, 2, 32)\n");
+
+	/* Entries apart from the header are written separately */
+	ResetMocks();
+	AllocAndReadGptData(handle, &g);
+	g.modified |= GPT_MODIFIED_HEADER1 | GPT_MODIFIED_ENTRIES1;
+	ResetCallLog();
+	Memset(g.primary_header, '\0', g.sector_bytes);
+	h = (GptHeader*)g.primary_header;
+	h->entries_lba = 3;
+	h->number_of_entries = MAX_NUMBER_OF_ENTRIES;
+	h->size_of_entry = sizeof(GptEntry);
+	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree apart");
 	TEST_CALLS("VbExDiskWrite(h, 1, 1)\n"
-		   "VbExDiskWrite(h, 2, 32)\n");
+		   "VbExDiskWrite(h, 3, 32)\n");
 
 	/* Data which is changed is written */
 	ResetMocks();
@@ -448,10 +873,8 @@ static void ReadWriteGptTest(void)
 	h = (GptHeader*)g.secondary_header;
 	h->entries_lba = 991;
 	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree mod all");
-	TEST_CALLS("VbExDiskWrite(h, 1, 1)\n"
-		   "VbExDiskWrite(h, 2, 32)\n"
-		   "VbExDiskWrite(h, 1023, 1)\n"
-		   "VbExDiskWrite(h, 991, 32)\n");
+	TEST_CALLS("VbExDiskWrite(h, 1, 33)\n"
+		   "VbExDiskWrite(h, 991, 33)\n");
 
 	/* If legacy signature, don't modify GPT header/entries 1 */
 	ResetMocks();
@@ -461,8 +884,7 @@ static void ReadWriteGptTest(void)
 	g.modified = -1;
 	ResetCallLog();
 	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree mod all");
-	TEST_CALLS("VbExDiskWrite(h, 1023, 1)\n"
-		   "VbExDiskWrite(h, 991, 32)\n");
+	TEST_CALLS("VbExDiskWrite(h, 991, 33)\n");
 
 	/* Error reading */
 	ResetMocks();
@@ -472,22 +894,30 @@ static void ReadWriteGptTest(void)
 	WriteAndFreeGptData(handle, &g);
 
 	ResetMocks();
-	disk_read_to_fail = 2;
+	disk_read_to_fail = 991;
 	TEST_NEQ(AllocAndReadGptData(handle, &g), 0, "AllocAndRead disk fail");
 	Memset(g.primary_header, '\0', g.sector_bytes);
 	WriteAndFreeGptData(handle, &g);
 
 	ResetMocks();
-	disk_read_to_fail = 991;
+	mock_gpt_primary->entries_lba = 3;
+	mock_gpt_primary->first_usable_lba++;
+	mock_gpt_primary->header_crc32 = HeaderCrc(mock_gpt_primary);
+	disk_read_to_fail = 3;
 	TEST_NEQ(AllocAndReadGptData(handle, &g), 0, "AllocAndRead disk fail");
 	Memset(g.primary_header, '\0', g.sector_bytes);
 	WriteAndFreeGptData(handle, &g);
 
 	ResetMocks();
-	disk_read_to_fail = 1023;
+	g.flags = GPT_FLAG_EXTERNAL;
+	mock_gpt_secondary->number_of_entries = MAX_NUMBER_OF_ENTRIES / 2;
+	mock_gpt_secondary->entries_lba = 1007;
+	mock_gpt_secondary->header_crc32 = HeaderCrc(mock_gpt_secondary);
+	disk_read_to_fail = 1007;
 	TEST_NEQ(AllocAndReadGptData(handle, &g), 0, "AllocAndRead disk fail");
 	Memset(g.primary_header, '\0', g.sector_bytes);
 	WriteAndFreeGptData(handle, &g);
+	g.flags = 0;
 
 	/* Error writing */
 	ResetMocks();
@@ -498,12 +928,12 @@ static void ReadWriteGptTest(void)
 	TEST_NEQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree disk fail");
 
 	ResetMocks();
-	disk_write_to_fail = 2;
+	disk_write_to_fail = 3;
 	AllocAndReadGptData(handle, &g);
 	g.modified = -1;
 	Memset(g.primary_header, '\0', g.sector_bytes);
 	h = (GptHeader*)g.primary_header;
-	h->entries_lba = 2;
+	h->entries_lba = 3;
 	TEST_NEQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree disk fail");
 
 	ResetMocks();
@@ -566,7 +996,11 @@ static void InvalidParamsTest(void)
 
 static void LoadKernelTest(void)
 {
+	static uint8_t workbuf[VB_KERNEL_WORKBUF_RECOMMENDED_SIZE]
+		__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+	struct vb2_workbuf wb;
 	uint32_t u;
+	int i;
 
 	ResetMocks();
 
@@ -633,18 +1067,73 @@ static void LoadKernelTest(void)
 	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
 		"Fail key block dev sig");
 
+	/* Dev mode can be told to check the hash first */
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_DEVELOPER |
+		BOOT_FLAG_DEV_KEY_BLOCK_HASH_FIRST;
+	key_block_verify_fail = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Key block dev hash first");
+	TEST_EQ(key_block_verify_calls, 1, "  signature not checked");
+	TEST_EQ(shared->lk_calls[0].parts[0].flags &
+		VBSD_LKP_FLAG_KEY_BLOCK_VALID, 0, "  counts as self-signed");
+
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_DEVELOPER |
+		BOOT_FLAG_DEV_KEY_BLOCK_HASH_FIRST;
+	key_block_verify_fail = 2;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Fail key block dev hash first");
+
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_DEVELOPER |
+		BOOT_FLAG_DEV_KEY_BLOCK_HASH_FIRST;
+	VbNvSet(&vnc, VBNV_DEV_BOOT_SIGNED_ONLY, 1);
+	VbNvTeardown(&vnc);
+	key_block_verify_fail = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Key block hash first ignored when signed only");
+
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_DEV_KEY_BLOCK_HASH_FIRST;
+	key_block_verify_fail = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Key block hash first ignored in normal mode");
+
 	/* Check key block flag mismatches */
 	ResetMocks();
 	kbh.key_block_flags =
 		KEY_BLOCK_FLAG_RECOVERY_0 | KEY_BLOCK_FLAG_DEVELOPER_1;
 	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
 		"Key block dev flag mismatch");
+	TEST_EQ(shared->lk_calls[0].parts[0].check_result,
+		VBSD_LKP_CHECK_DEV_MISMATCH, "  check result");
+	TEST_EQ(key_block_verify_calls, 0, "  signature not checked");
 
 	ResetMocks();
 	kbh.key_block_flags =
 		KEY_BLOCK_FLAG_RECOVERY_1 | KEY_BLOCK_FLAG_DEVELOPER_0;
 	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
 		"Key block rec flag mismatch");
+	TEST_EQ(shared->lk_calls[0].parts[0].check_result,
+		VBSD_LKP_CHECK_REC_MISMATCH, "  check result");
+
+	/* When several checks fail, the same one is recorded as before */
+	ResetMocks();
+	kbh.key_block_flags =
+		KEY_BLOCK_FLAG_RECOVERY_1 | KEY_BLOCK_FLAG_DEVELOPER_1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Key block dev and rec flag mismatch");
+	TEST_EQ(shared->lk_calls[0].parts[0].check_result,
+		VBSD_LKP_CHECK_REC_MISMATCH, "  check result");
+
+	ResetMocks();
+	kbh.key_block_flags =
+		KEY_BLOCK_FLAG_RECOVERY_0 | KEY_BLOCK_FLAG_DEVELOPER_1;
+	kbh.data_key.key_version = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Key block flag mismatch and rollback");
+	TEST_EQ(shared->lk_calls[0].parts[0].check_result,
+		VBSD_LKP_CHECK_KEY_ROLLBACK, "  check result");
 
 	ResetMocks();
 	lkp.boot_flags |= BOOT_FLAG_RECOVERY;
@@ -664,6 +1153,9 @@ static void LoadKernelTest(void)
 	kbh.data_key.key_version = 1;
 	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
 		"Key block kernel key rollback");
+	TEST_EQ(shared->lk_calls[0].parts[0].check_result,
+		VBSD_LKP_CHECK_KEY_ROLLBACK, "  check result");
+	TEST_EQ(key_block_verify_calls, 0, "  signature not checked");
 
 	ResetMocks();
 	kbh.data_key.key_version = 0x10000;
@@ -687,6 +1179,7 @@ static void LoadKernelTest(void)
 	kbh.data_key.key_version = 1;
 	lkp.boot_flags |= BOOT_FLAG_DEVELOPER;
 	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Key version ignored in dev mode");
+	TEST_EQ(key_block_verify_calls, 1, "  signature still checked");
 
 	ResetMocks();
 	kbh.data_key.key_version = 1;
@@ -756,6 +1249,55 @@ static void LoadKernelTest(void)
 	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
 		"Fail reading kernel data");
 
+	/* Body read and hashed in several chunks */
+	ResetMocks();
+	for (i = 0; i < 400 * MOCK_SECTOR_SIZE; i++)
+		mock_disk[100 * MOCK_SECTOR_SIZE + i] = (uint8_t)(i * 7);
+	mock_parts[0].size = 400;
+	kph.body_signature.data_size = 350 * MOCK_SECTOR_SIZE;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Kernel in chunks");
+
+	ResetMocks();
+	mock_parts[0].size = 400;
+	kph.body_signature.data_size = 350 * MOCK_SECTOR_SIZE;
+	disk_read_to_fail = 356;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Fail reading later kernel chunk");
+
+	/* Read more if the headers don't fit in what we read */
+	ResetMocks();
+	kph.preamble_size += 65536;
+	memcpy(mock_disk + 100 * MOCK_SECTOR_SIZE + kbh.key_block_size,
+	       &kph, sizeof(kph));
+	mock_parts[0].size = 300;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Kernel headers past 64KB");
+
+	ResetMocks();
+	lkp.header_read_size = 4000;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Header read size");
+	TEST_PTR_NEQ(strstr(call_log, "VbExDiskRead(h, 100, 8)\n"
+			    "VbExDiskRead(h, 108, 128)\n"), NULL,
+		     "  read only headers first");
+
+	ResetMocks();
+	lkp.header_read_size = 1024;
+	memcpy(mock_disk + 100 * MOCK_SECTOR_SIZE + kbh.key_block_size,
+	       &kph, sizeof(kph));
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Header read size too small");
+	TEST_PTR_NEQ(strstr(call_log, "VbExDiskRead(h, 100, 2)\n"
+			    "VbExDiskRead(h, 102, 6)\n"), NULL,
+		     "  read rest of headers");
+
+	/* Later partitions only read as much as the first one's headers */
+	ResetMocks();
+	mock_parts[1].start = 300;
+	mock_parts[1].size = 150;
+	disk_read_to_fail = 228;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Second kernel good");
+	TEST_EQ(lkp.partition_number, 2, "  part num");
+	TEST_PTR_NEQ(strstr(call_log, "VbExDiskRead(h, 300, 8)\n"), NULL,
+		     "  read only headers");
+
 	ResetMocks();
 	verify_data_fail = 1;
 	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,	"Bad data");
@@ -765,6 +1307,569 @@ static void LoadKernelTest(void)
 	lkp.boot_flags |= BOOT_FLAG_EXTERNAL_GPT;
 	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Succeed external GPT");
 	TEST_EQ(gpt_flag_external, 1, "GPT was external");
+
+	/* So does LAZY_SECONDARY_GPT, except in recovery mode */
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_LAZY_SECONDARY_GPT;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Succeed lazy secondary GPT");
+	TEST_EQ(gpt_flag_lazy, 1, "  GPT was lazy");
+	TEST_EQ(gpt_flag_lazy_write, 0, "  but writes both copies");
+
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_LAZY_SECONDARY_GPT |
+		BOOT_FLAG_LAZY_SECONDARY_GPT_WRITE;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0,
+		"Succeed lazy secondary GPT write");
+	TEST_EQ(gpt_flag_lazy_write, 1, "  GPT write was lazy");
+
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_LAZY_SECONDARY_GPT_WRITE;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Lazy write needs lazy read");
+	TEST_EQ(gpt_flag_lazy_write, 0, "  GPT write wasn't lazy");
+
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_LAZY_SECONDARY_GPT | BOOT_FLAG_RECOVERY |
+		BOOT_FLAG_LAZY_SECONDARY_GPT_WRITE;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Recovery checks both GPTs");
+	TEST_EQ(gpt_flag_lazy, 0, "  GPT wasn't lazy");
+	TEST_EQ(gpt_flag_lazy_write, 0, "  GPT write wasn't lazy");
+
+	/* Allocations from a work buffer are all reclaimed on return */
+	ResetMocks();
+	VbWorkbufInit(workbuf, sizeof(workbuf));
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Succeed with workbuf");
+	TEST_NEQ(VbWorkbufPeak(), 0, "  workbuf used");
+	VbWorkbufSave(&wb);
+	TEST_PTR_EQ(wb.buf, workbuf, "  workbuf reclaimed");
+	VbWorkbufInit(NULL, 0);
+}
+
+/**
+ * Test a native 4K drive
+ */
+static void Sector4kTest(void)
+{
+	GptHeader *h1 = (GptHeader *)&mock_disk[4096];
+	GptHeader *h2 = (GptHeader *)&mock_disk[sizeof(mock_disk) - 4096];
+	GptData g;
+
+	ResetMocks();
+	mock_sector_bytes = 4096;
+	memset(mock_disk, 0, sizeof(mock_disk));
+	SetupGptHeader(h1, 0, 4096);
+	SetupGptHeader(h2, 1, 4096);
+	mock_disk[2 * 4096] = 0x12;
+
+	g.sector_bytes = 4096;
+	g.streaming_drive_sectors = g.gpt_drive_sectors = 128;
+	g.flags = 0;
+	TEST_EQ(AllocAndReadGptData(handle, &g), 0, "AllocAndRead 4K");
+	/* 16 KB of entries is 4 sectors */
+	TEST_CALLS("VbExDiskRead(h, 1, 5)\n"
+		   "VbExDiskRead(h, 123, 5)\n");
+	TEST_EQ(g.primary_entries[0], 0x12, "  primary entries");
+	TEST_EQ(CheckHeader((GptHeader *)g.primary_header, 0,
+			    g.streaming_drive_sectors, g.gpt_drive_sectors,
+			    0, g.sector_bytes), 0, "  primary header valid");
+	TEST_EQ(CheckHeader((GptHeader *)g.secondary_header, 1,
+			    g.streaming_drive_sectors, g.gpt_drive_sectors,
+			    0, g.sector_bytes), 0, "  secondary header valid");
+	ResetCallLog();
+	g.modified = -1;
+	TEST_EQ(WriteAndFreeGptData(handle, &g), 0, "WriteAndFree 4K");
+	TEST_CALLS("VbExDiskWrite(h, 1, 5)\n"
+		   "VbExDiskWrite(h, 123, 5)\n");
+
+	/* And the kernel's read from it in 4K sectors */
+	ResetMocks();
+	mock_sector_bytes = 4096;
+	memset(mock_disk, 0, sizeof(mock_disk));
+	SetupGptHeader(h1, 0, 4096);
+	SetupGptHeader(h2, 1, 4096);
+	lkp.bytes_per_lba = 4096;
+	lkp.streaming_lba_count = lkp.gpt_lba_count = 128;
+	mock_parts[0].start = 12;
+	mock_parts[0].size = 20;  /* 80 KB */
+	kph.body_signature.data_size = 18 * 4096;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "LoadKernel 4K");
+	TEST_EQ(lkp.partition_number, 1, "  part num");
+	TEST_EQ(shared->lk_calls[0].sector_size, 4096, "  sector size");
+	/* The header, then the rest of the body */
+	TEST_CALLS("VbExDiskRead(h, 1, 5)\n"
+		   "VbExDiskRead(h, 123, 5)\n"
+		   "VbExDiskRead(h, 12, 16)\n"
+		   "VbExDiskRead(h, 28, 3)\n");
+}
+
+/**
+ * Test counting disk reads
+ */
+static void IoStatsTest(void)
+{
+	VbSharedDataKernelCallIo *io = shared->lk_call_io;
+
+	ResetMocks();
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Count reads");
+	TEST_EQ(io->gpt.read_calls, 2, "  GPT read calls");
+	TEST_EQ(io->gpt.read_bytes, 66 * MOCK_SECTOR_SIZE, "  GPT read bytes");
+	TEST_EQ(io->gpt.read_ticks, 20, "  GPT read ticks");
+	/* Headers and the start of the body, then the rest of the body */
+	TEST_EQ(io->parts[0].read_calls, 2, "  kernel read calls");
+	TEST_EQ(io->parts[0].read_bytes, 4096 + kph.body_signature.data_size,
+		"  kernel read bytes");
+	TEST_EQ(io->parts[0].read_ticks, 20, "  kernel read ticks");
+
+	ResetMocks();
+	mock_parts[1].start = 300;
+	mock_parts[1].size = 150;
+	disk_read_to_fail = 100;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Count reads per partition");
+	TEST_EQ(io->parts[0].read_calls, 1, "  failed kernel read calls");
+	TEST_EQ(io->parts[1].read_calls, 2, "  good kernel read calls");
+
+	/* Each call gets its own counts */
+	mock_part_next = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Count reads again");
+	TEST_EQ(io[1].gpt.read_calls, 2, "  second call GPT read calls");
+	TEST_EQ(io[1].parts[0].read_calls, 2, "  second call kernel reads");
+	TEST_EQ(io->parts[1].read_calls, 2, "  first call unchanged");
+
+	ResetMocks();
+	disk_read_to_fail = 991;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_NO_KERNEL_FOUND,
+		"Count reads when GPT read fails");
+	TEST_EQ(io->gpt.read_calls, 2, "  GPT read calls");
+
+	/* Older structs don't have room for the counts */
+	ResetMocks();
+	shared->struct_version = 2;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Don't count reads in v2");
+	TEST_EQ(io->gpt.read_calls, 0, "  no GPT read calls");
+	TEST_EQ(io->parts[0].read_calls, 0, "  no kernel read calls");
+
+	/* Nor do ones in a minimum size buffer */
+	ResetMocks();
+	VbSharedDataInit(shared, VB_SHARED_DATA_MIN_SIZE);
+	shared->kernel_version_tpm = 0x20001;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Don't count reads in short v3");
+	TEST_EQ(io->gpt.read_calls, 0, "  no GPT read calls");
+	TEST_EQ(io->parts[0].read_calls, 0, "  no kernel read calls");
+}
+
+/**
+ * Test checking only the body blocks needed to boot
+ */
+static void PartialBodyTest(void)
+{
+	VbSharedDataKernelCall *shcall = shared->lk_calls;
+
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_PARTIAL_BODY_CHECK;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "No body hashes");
+	TEST_EQ(verify_data_calls, 1, "  whole body checked");
+	TEST_EQ(shcall->parts[0].flags & VBSD_LKP_FLAG_BODY_PARTIAL, 0,
+		"  not partial");
+
+	ResetMocks();
+	kph.header_version_minor = 3;
+	kph.body_hash_count = 18;
+	kph.body_hash_block_size = 4096;
+	kph.body_hash_head_size = 4096;
+	kph.body_hash_tail_offset = 0x10000;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Partial check not asked for");
+	TEST_EQ(verify_data_calls, 1, "  whole body checked");
+	TEST_PTR_EQ(strstr(call_log, "VerifyKernelBodyBlocks"), NULL,
+		    "  no blocks checked");
+
+	ResetMocks();
+	kph.header_version_minor = 3;
+	kph.body_hash_count = 18;
+	kph.body_hash_block_size = 4096;
+	kph.body_hash_head_size = 4096;
+	kph.body_hash_tail_offset = 0x10000;
+	lkp.boot_flags |= BOOT_FLAG_PARTIAL_BODY_CHECK;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Partial body check");
+	TEST_EQ(verify_data_calls, 0, "  whole body not checked");
+	TEST_PTR_NEQ(strstr(call_log, "VerifyKernelBodyBlocks(0x0, 0x1000)\n"
+			    "VerifyKernelBodyBlocks(0x10000, 0x1200)\n"),
+		     NULL, "  head and tail checked");
+	TEST_EQ(shcall->parts[0].flags & VBSD_LKP_FLAG_BODY_PARTIAL,
+		VBSD_LKP_FLAG_BODY_PARTIAL, "  partial");
+
+	ResetMocks();
+	kph.header_version_minor = 3;
+	kph.body_hash_count = 18;
+	kph.body_hash_block_size = 4096;
+	lkp.boot_flags |= BOOT_FLAG_PARTIAL_BODY_CHECK;
+	verify_blocks_fail = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Bad body block");
+	TEST_EQ(shcall->parts[0].check_result, VBSD_LKP_CHECK_VERIFY_DATA,
+		"  check result");
+
+	/* Recovery kernels are always checked in full */
+	ResetMocks();
+	kph.header_version_minor = 3;
+	kph.body_hash_count = 18;
+	kph.body_hash_block_size = 4096;
+	lkp.boot_flags |= BOOT_FLAG_PARTIAL_BODY_CHECK | BOOT_FLAG_RECOVERY;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Recovery checks whole body");
+	TEST_EQ(verify_data_calls, 1, "  whole body checked");
+	TEST_PTR_EQ(strstr(call_log, "VerifyKernelBodyBlocks"), NULL,
+		    "  no blocks checked");
+}
+
+/**
+ * Test reading the body in chunks
+ */
+static void ChunkedBodyTest(void)
+{
+	VbSharedDataKernelCallIo *io = shared->lk_call_io;
+
+	ResetMocks();
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Chunks unsupported");
+	TEST_EQ(stream_chunks_calls, 0, "  not read in chunks");
+	TEST_EQ(verify_data_calls, 1, "  body checked");
+
+	/* Rest of the body is a chunk and a bit */
+	ResetMocks();
+	stream_chunks_supported = 1;
+	kph.body_signature.data_size = 70144 + 65536;
+	mock_parts[0].size = 300;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Read body in chunks");
+	TEST_EQ(stream_chunks_calls, 1, "  one chunked read");
+	TEST_EQ(stream_chunk_bytes, 65536, "  chunk size");
+	TEST_EQ(stream_chunks_done, 2, "  chunks done");
+	TEST_EQ(verify_data_calls, 1, "  body checked");
+	TEST_EQ(io->parts[0].read_calls, 2, "  kernel read calls");
+	TEST_EQ(io->parts[0].read_bytes, 4096 + kph.body_signature.data_size,
+		"  kernel read bytes");
+
+	/* Chunks aren't needed if the body was read with the headers */
+	ResetMocks();
+	stream_chunks_supported = 1;
+	kph.body_signature.data_size = 4096;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Small body");
+	TEST_EQ(stream_chunks_calls, 0, "  not read in chunks");
+
+	ResetMocks();
+	stream_chunks_supported = 1;
+	kph.body_signature.data_size = 70144 + 65536;
+	mock_parts[0].size = 300;
+	disk_read_to_fail = 100 + 65536 / MOCK_SECTOR_SIZE;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Chunked read fails");
+	TEST_EQ(shared->lk_calls->parts[0].check_result,
+		VBSD_LKP_CHECK_READ_DATA, "  check result");
+	TEST_EQ(stream_chunks_done, 0, "  no chunks done");
+}
+
+/* Both GPT headers and entry arrays */
+#define GPT_READ_BYTES (2 * 33 * MOCK_SECTOR_SIZE)
+/* The first read of a kernel partition, which holds the headers */
+#define KERNEL_FIRST_READ_BYTES 65536
+/* The headers and body of the default mock kernel */
+#define KERNEL_READ_BYTES (4096 + 70144)
+
+/**
+ * Check what a scenario cost against upper bounds
+ */
+static void test_cost(uint32_t disk_reads, uint64_t disk_read_bytes,
+		      uint32_t rsa_ops, uint64_t elapsed_us)
+{
+	TEST_LE(mock_cost.disk_reads, disk_reads, "  disk reads");
+	TEST_LE(mock_cost.disk_read_bytes, disk_read_bytes,
+		"  disk read bytes");
+	TEST_LE(mock_cost.rsa_ops, rsa_ops, "  RSA ops");
+	TEST_LE(mock_cost.elapsed_us, elapsed_us, "  simulated time");
+	TEST_EQ(mock_cost.disk_writes, 0, "  no disk writes");
+}
+
+/**
+ * Test how much work each boot scenario takes, so it doesn't creep up
+ */
+static void CostTest(void)
+{
+	/* GPT, headers, rest of body; key block, preamble and body sigs */
+	ResetMocks();
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Normal boot cost");
+	test_cost(4, GPT_READ_BYTES + KERNEL_READ_BYTES, 3, 16440);
+
+	/* Dev: a self-signed key block is tried, then only hashed */
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_DEVELOPER;
+	key_block_verify_fail = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Dev boot cost");
+	test_cost(4, GPT_READ_BYTES + KERNEL_READ_BYTES, 3, 16440);
+
+	ResetMocks();
+	lkp.boot_flags |= BOOT_FLAG_RECOVERY;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Recovery boot cost");
+	test_cost(4, GPT_READ_BYTES + KERNEL_READ_BYTES, 3, 16440);
+
+	/* A first kernel which can't be read costs only that read */
+	ResetMocks();
+	mock_parts[0].start = 300;
+	mock_parts[0].size = 150;
+	mock_parts[1].start = 100;
+	mock_parts[1].size = 150;
+	disk_read_to_fail = 300;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Second kernel cost");
+	test_cost(5, GPT_READ_BYTES + KERNEL_FIRST_READ_BYTES +
+		  KERNEL_READ_BYTES, 3, 17180);
+
+	/* Only the first of two good kernels is read */
+	ResetMocks();
+	mock_parts[1].start = 300;
+	mock_parts[1].size = 150;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Two good kernels cost");
+	test_cost(4, GPT_READ_BYTES + KERNEL_READ_BYTES, 3, 16440);
+
+	/* Each bad kernel costs its first read and key block check */
+	ResetMocks();
+	mock_parts[1].start = 300;
+	mock_parts[1].size = 150;
+	key_block_verify_fail = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Two bad kernels cost");
+	test_cost(4, GPT_READ_BYTES + 2 * KERNEL_FIRST_READ_BYTES, 2, 12000);
+}
+
+/**
+ * Test reading the body straight to where the platform will run it.
+ */
+static void ResolveBufferTest(void)
+{
+	/* By default the body goes in kernel_buffer */
+	ResetMocks();
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Resolve unsupported");
+	TEST_PTR_EQ(lkp.kernel_buffer, kernel_buffer, "  kernel_buffer");
+	TEST_EQ(lkp.kernel_buffer_size, sizeof(kernel_buffer), "  size");
+	TEST_EQ(lkp.bootloader_offset == (uint64_t)-1, 1,
+		"  bootloader outside");
+	TEST_EQ(lkp.vmlinuz_header_size, 0, "  no vmlinuz header");
+
+	/* Otherwise it's read into the platform's buffer, and checked there */
+	ResetMocks();
+	resolve_supported = 1;
+	mock_body_buffer = load_buffer;
+	memset(load_buffer, 0, sizeof(load_buffer));
+	/* Body starts 4 KB into the partition */
+	mock_disk[108 * MOCK_SECTOR_SIZE] = 0xa5;
+	mock_disk[108 * MOCK_SECTOR_SIZE + 70143] = 0x5a;
+	kph.body_load_address = 0x100000;
+	kph.bootloader_address = 0x108000;
+	kph.header_version_minor = 1;
+	kph.vmlinuz_header_address = 0x100200;
+	kph.vmlinuz_header_size = 0x100;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Resolve buffer");
+	TEST_EQ(resolve_calls, 1, "  resolved once");
+	TEST_PTR_NEQ(strstr(call_log, "VbExKernelBufferResolve(0x100000, 70144)"),
+		     NULL, "  with load address and size");
+	TEST_PTR_EQ(lkp.kernel_buffer, load_buffer, "  kernel_buffer");
+	TEST_EQ(lkp.kernel_buffer_size, 70144, "  size");
+	TEST_EQ(load_buffer[0], 0xa5, "  body start read there");
+	TEST_EQ(load_buffer[70143], 0x5a, "  body end read there");
+	TEST_EQ(kernel_buffer[0], 0, "  not into kernel_buffer");
+	TEST_EQ(lkp.bootloader_address, 0x108000, "  bootloader addr");
+	TEST_EQ(lkp.bootloader_offset, 0x8000, "  bootloader offset");
+	TEST_EQ(lkp.vmlinuz_header_offset, 0x200, "  vmlinuz header offset");
+	TEST_EQ(lkp.vmlinuz_header_size, 0x100, "  vmlinuz header size");
+
+	/* Parts outside the body have no offset */
+	ResetMocks();
+	kph.body_load_address = 0x100000;
+	kph.bootloader_address = 0x100000 + 70144 - 0x1000;
+	kph.header_version_minor = 1;
+	kph.vmlinuz_header_address = 0xff000;
+	kph.vmlinuz_header_size = 0x100;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Offsets outside body");
+	TEST_EQ(lkp.bootloader_offset == (uint64_t)-1, 1, "  bootloader");
+	TEST_EQ(lkp.vmlinuz_header_offset, 0, "  vmlinuz header offset");
+	TEST_EQ(lkp.vmlinuz_header_size, 0, "  vmlinuz header size");
+
+	/* The buffer for a body which doesn't verify isn't passed back */
+	ResetMocks();
+	resolve_supported = 1;
+	mock_body_buffer = load_buffer;
+	lkp.kernel_buffer = NULL;
+	lkp.kernel_buffer_size = 0;
+	verify_data_fail = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Resolved body bad");
+	TEST_PTR_EQ(lkp.kernel_buffer, NULL, "  kernel_buffer");
+	TEST_EQ(lkp.kernel_buffer_size, 0, "  size");
+
+	/* Nor is the load address */
+	ResetMocks();
+	kph.body_load_address = (size_t)kernel_buffer;
+	lkp.kernel_buffer = NULL;
+	lkp.kernel_buffer_size = 0;
+	verify_data_fail = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Load address body bad");
+	TEST_PTR_EQ(lkp.kernel_buffer, NULL, "  kernel_buffer");
+
+	/* A buffer from the platform needn't fit in kernel_buffer */
+	ResetMocks();
+	resolve_supported = 1;
+	mock_body_buffer = load_buffer;
+	lkp.kernel_buffer_size = 8192;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Resolved body big");
+	TEST_PTR_EQ(lkp.kernel_buffer, load_buffer, "  kernel_buffer");
+}
+
+/* Compressed mock body; it's more than the first read of the partition */
+#define COMPRESSED_BODY_SIZE 63488
+
+/**
+ * Set up a compressed body, which decompresses to twice its size.
+ */
+static void SetupCompressedBody(void)
+{
+	int i;
+
+	kph.header_version_minor = 4;
+	kph.body_compression = COMPRESS_LZMA1;
+	kph.body_signature.data_size = COMPRESSED_BODY_SIZE;
+	kph.body_load_size = 2 * COMPRESSED_BODY_SIZE;
+	kph.body_load_address = 0x100000;
+	kph.bootloader_address = 0x100000 + 0x18000;
+	kph.bootloader_size = 0x1000;
+
+	/* Body starts 4 KB into the partition, and is checked there */
+	mock_body_buffer = &mock_disk[108 * MOCK_SECTOR_SIZE];
+	for (i = 0; i < COMPRESSED_BODY_SIZE; i++)
+		mock_body_buffer[i] = (uint8_t)(i * 7);
+}
+
+/* Check kernel_buffer holds the decompressed mock body */
+static int CompressedBodyLoaded(void)
+{
+	int i;
+
+	for (i = 0; i < COMPRESSED_BODY_SIZE; i++) {
+		if (kernel_buffer[2 * i] != (uint8_t)(i * 7) ||
+		    kernel_buffer[2 * i + 1] != (uint8_t)(i * 7))
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * Test loading a kernel whose body is stored compressed.
+ */
+static void CompressedBodyTest(void)
+{
+	VbSharedDataKernelPart *part = shared->lk_calls->parts;
+
+	/* Read after the space it decompresses to, then decompressed */
+	ResetMocks();
+	SetupCompressedBody();
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Compressed body");
+	TEST_EQ(part->check_result, VBSD_LKP_CHECK_KERNEL_GOOD,
+		"  check result");
+	TEST_EQ(part->flags & VBSD_LKP_FLAG_BODY_COMPRESSED,
+		VBSD_LKP_FLAG_BODY_COMPRESSED, "  flagged compressed");
+	TEST_EQ(verify_data_calls, 1, "  compressed body checked");
+	TEST_EQ(decompress_calls, 1, "  decompressed once");
+	TEST_EQ(CompressedBodyLoaded(), 1, "  decompressed into buffer");
+	TEST_EQ(lkp.bootloader_offset, 0x18000,
+		"  bootloader in decompressed body");
+	TEST_EQ(shared->lk_call_io->parts[0].read_bytes,
+		4096 + COMPRESSED_BODY_SIZE, "  only compressed body read");
+
+	/* If there's no room after it, it's read into a buffer of its own */
+	ResetMocks();
+	SetupCompressedBody();
+	lkp.kernel_buffer_size = 2 * COMPRESSED_BODY_SIZE + 4096;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Compressed body own buffer");
+	TEST_EQ(decompress_calls, 1, "  decompressed once");
+	TEST_EQ(CompressedBodyLoaded(), 1, "  decompressed into buffer");
+
+	/* The platform can decompress it as it's read */
+	ResetMocks();
+	SetupCompressedBody();
+	decompress_stream_supported = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Compressed body streamed");
+	TEST_EQ(decompress_calls, 0, "  not decompressed after");
+	TEST_EQ(decompress_stream_writes, 2, "  headers read, then the rest");
+	TEST_EQ(verify_data_calls, 1, "  compressed body checked");
+	TEST_EQ(CompressedBodyLoaded(), 1, "  decompressed into buffer");
+
+	/* A body which doesn't verify isn't decompressed */
+	ResetMocks();
+	SetupCompressedBody();
+	verify_data_fail = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Compressed body bad");
+	TEST_EQ(part->check_result, VBSD_LKP_CHECK_VERIFY_DATA,
+		"  check result");
+	TEST_EQ(decompress_calls, 0, "  not decompressed");
+
+	/* Nor is one whose streamed decompression wrote to the buffer */
+	ResetMocks();
+	SetupCompressedBody();
+	decompress_stream_supported = 1;
+	verify_data_fail = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Compressed body streamed bad");
+	TEST_EQ(part->check_result, VBSD_LKP_CHECK_VERIFY_DATA,
+		"  check result");
+
+	/* It must decompress to the size in the preamble */
+	ResetMocks();
+	SetupCompressedBody();
+	kph.body_load_size += 2;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Compressed body short");
+	TEST_EQ(part->check_result, VBSD_LKP_CHECK_DECOMPRESS,
+		"  check result");
+
+	ResetMocks();
+	SetupCompressedBody();
+	decompress_stream_supported = 1;
+	kph.body_load_size += 2;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Compressed body streamed short");
+	TEST_EQ(part->check_result, VBSD_LKP_CHECK_DECOMPRESS,
+		"  check result");
+
+	ResetMocks();
+	SetupCompressedBody();
+	kph.body_load_size -= 2;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Compressed body long");
+	TEST_EQ(part->check_result, VBSD_LKP_CHECK_DECOMPRESS,
+		"  check result");
+
+	ResetMocks();
+	SetupCompressedBody();
+	decompress_stream_supported = 1;
+	decompress_stream_open_fail = 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Decompress stream open fails");
+	TEST_EQ(part->check_result, VBSD_LKP_CHECK_DECOMPRESS,
+		"  check result");
+
+	/* The decompressed body must fit in the kernel buffer */
+	ResetMocks();
+	SetupCompressedBody();
+	lkp.kernel_buffer_size = 2 * COMPRESSED_BODY_SIZE - 1;
+	TEST_EQ(LoadKernel(&lkp, &cparams), VBERROR_INVALID_KERNEL_FOUND,
+		"Compressed body too big");
+	TEST_EQ(part->check_result, VBSD_LKP_CHECK_BODY_EXCEEDS_MEM,
+		"  check result");
+
+	/* Older preambles have no compression */
+	ResetMocks();
+	SetupCompressedBody();
+	kph.header_version_minor = 3;
+	mock_body_buffer = kernel_buffer;
+	TEST_EQ(LoadKernel(&lkp, &cparams), 0, "Compression in 2.3 ignored");
+	TEST_EQ(decompress_calls, 0, "  not decompressed");
+	TEST_EQ(part->flags & VBSD_LKP_FLAG_BODY_COMPRESSED, 0,
+		"  not flagged compressed");
 }
 
 int main(void)
@@ -772,7 +1877,15 @@ int main(void)
 	ReadWriteGptTest();
 	InvalidParamsTest();
 	LoadKernelTest();
+	ResolveBufferTest();
+	Sector4kTest();
+	IoStatsTest();
+	PartialBodyTest();
+	ChunkedBodyTest();
+	CompressedBodyTest();
+	CostTest();
 
+	ResetMocks();
 	if (vboot_api_stub_check_memory())
 		return 255;
 
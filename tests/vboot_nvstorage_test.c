@@ -167,6 +167,25 @@ static void VbNvStorageTest(void) {
   VbNvTeardown(&c);
   TEST_EQ(c.raw_changed, 0, "No raw change if data not changed");
 
+  /* Changes which cancel out don't need writing either */
+  VbNvSetup(&c);
+  VbNvGet(&c, VBNV_LOCALIZATION_INDEX, &data);
+  VbNvSet(&c, VBNV_LOCALIZATION_INDEX, data + 1);
+  VbNvSet(&c, VBNV_LOCALIZATION_INDEX, data);
+  VbNvTeardown(&c);
+  TEST_EQ(c.raw_changed, 0, "No raw change if changed back");
+
+  /* Each teardown only reports changes since the one before */
+  VbNvSetup(&c);
+  VbNvSet(&c, VBNV_LOCALIZATION_INDEX, data + 1);
+  VbNvTeardown(&c);
+  TEST_EQ(c.raw_changed, 1, "Raw change on first teardown");
+  VbNvTeardown(&c);
+  TEST_EQ(c.raw_changed, 0, "No raw change on second teardown");
+  VbNvSet(&c, VBNV_LOCALIZATION_INDEX, data);
+  VbNvTeardown(&c);
+  TEST_EQ(c.raw_changed, 1, "Raw change after changing back");
+
   /* Test out-of-range fields mapping to defaults */
   VbNvSetup(&c);
   VbNvSet(&c, VBNV_TRY_B_COUNT, 16);
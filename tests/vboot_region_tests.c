@@ -11,11 +11,13 @@
 #include <string.h>
 
 #include "bmpblk_font.h"
+#include "gbb_access.h"
 #include "gbb_header.h"
 #include "host_common.h"
 #include "rollback_index.h"
 #include "test_common.h"
 #include "vboot_common.h"
+#include "vboot_kernel.h"
 #include "vboot_nvstorage.h"
 #include "vboot_struct.h"
 
@@ -31,6 +33,7 @@ static VbSharedDataHeader* shared = (VbSharedDataHeader*)shared_data;
 static uint32_t mock_tpm_version;
 static uint32_t mock_lf_tpm_version;  /* TPM version set by LoadFirmware() */
 static uint32_t mock_seen_region;
+static int mock_region_reads;
 /* Mock return values, so we can simulate errors */
 static VbError_t mock_lf_retval;
 
@@ -110,13 +113,15 @@ static void ResetMocks(void) {
 	shared->fw_version_tpm_start = mock_tpm_version;
 	mock_lf_retval = 0;
 	mock_seen_region = 0;
+	mock_region_reads = 0;
 }
 
 /****************************************************************************/
 /* Mocked verification functions */
 
-uint32_t SetTPMBootModeState(int developer_mode, int recovery_mode,
-			     uint64_t fw_keyblock_flags
+uint32_t SetTPMBootModeState(VbSharedDataHeader *shared,
+			     int developer_mode, int recovery_mode,
+			     uint64_t fw_keyblock_flags,
 			     GoogleBinaryBlockHeader *gbb) {
   return VBERROR_SUCCESS;
 }
@@ -138,6 +143,7 @@ VbError_t VbExRegionRead(VbCommonParams *cparams,
 	if (region != VB_REGION_GBB)
 		return VBERROR_UNSUPPORTED_REGION;
 	mock_seen_region |= 1 << region;
+	mock_region_reads++;
 	if (offset + size > sizeof(gbb_data))
 		return VBERROR_REGION_READ_INVALID;
 	memcpy(buf, gbb_data + offset, size);
@@ -200,10 +206,60 @@ static void VbRegionReadTest(void) {
 		VBERROR_NO_DISK_FOUND, "Kernel");
 }
 
+static void VbGbbReadImageTest(void) {
+	ScreenLayout layout;
+	ImageInfo image_info;
+	ScreenLayout *layouts;
+	char *data;
+	uint32_t size;
+
+	ResetMocks();
+	cparams.gbb = VbExMalloc(sizeof(*cparams.gbb));
+	Memcpy(cparams.gbb, gbb_data, sizeof(*cparams.gbb));
+
+	/* Header, layouts, image info and data */
+	TEST_EQ(VbGbbReadImage(&cparams, 0, 0, 0, &layout, &image_info,
+			       &data, &size), VBERROR_SUCCESS, "Read image 0");
+	TEST_EQ(layout.images[0].x, 1, "  layout");
+	TEST_STR_EQ(data, "original", "  data");
+	TEST_EQ(mock_region_reads, 4, "  region reads");
+	VbExFree(data);
+
+	/* Header and layouts are kept, so only image info and data */
+	mock_region_reads = 0;
+	TEST_EQ(VbGbbReadImage(&cparams, 0, 0, 1, &layout, &image_info,
+			       &data, &size), VBERROR_SUCCESS, "Read image 1");
+	TEST_EQ(layout.images[1].x, 2, "  layout");
+	TEST_EQ(mock_region_reads, 2, "  region reads");
+	VbExFree(data);
+
+	/* Another localization reads its layouts */
+	mock_region_reads = 0;
+	TEST_EQ(VbGbbReadImage(&cparams, 1, 0, 0, &layout, &image_info,
+			       &data, &size), VBERROR_NO_IMAGE_PRESENT,
+		"Read localization 1");
+	TEST_EQ(mock_region_reads, 1, "  region reads");
+	TEST_EQ(cparams.layouts_localization, 1, "  layouts kept");
+
+	/* Screens past the table are read on their own */
+	layouts = cparams.layouts;
+	mock_region_reads = 0;
+	if (VBERROR_SUCCESS == VbGbbReadImage(&cparams, 1, 1, 0, &layout,
+					      &image_info, &data, &size))
+		VbExFree(data);
+	TEST_NEQ(mock_region_reads, 0, "Read screen past table");
+	TEST_PTR_EQ(cparams.layouts, layouts, "  layouts still kept");
+	TEST_EQ(cparams.layouts_localization, 1, "  for localization 1");
+
+	VbApiKernelFree(&cparams);
+	TEST_PTR_EQ(cparams.layouts, NULL, "  layouts free");
+}
+
 int main(int argc, char* argv[]) {
   int error_code = 0;
 
   VbRegionReadTest();
+  VbGbbReadImageTest();
 
   if (vboot_api_stub_check_memory())
     error_code = 255;
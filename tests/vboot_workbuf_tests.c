@@ -0,0 +1,110 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for vboot_workbuf
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test_common.h"
+#include "vboot_api.h"
+#include "vboot_workbuf.h"
+
+static uint8_t workbuf[1024]
+	__attribute__ ((aligned (VB2_WORKBUF_ALIGN)));
+
+static int InWorkbuf(const void *ptr)
+{
+	return (const uint8_t *)ptr >= workbuf &&
+		(const uint8_t *)ptr < workbuf + sizeof(workbuf);
+}
+
+static void WorkbufTest(void)
+{
+	struct vb2_workbuf saved, saved2;
+	uint8_t *p, *p2, *p3;
+
+	/* Without a work buffer, allocations come from the heap */
+	VbWorkbufInit(NULL, 0);
+	p = VbWorkbufAlloc(16);
+	TEST_PTR_NEQ(p, NULL, "No workbuf alloc");
+	TEST_EQ(InWorkbuf(p), 0, "  from heap");
+	VbWorkbufFree(p);
+	VbWorkbufFree(NULL);
+	TEST_EQ(VbWorkbufPeak(), 0, "  no peak");
+
+	/* With one, they come from it, aligned */
+	VbWorkbufInit(workbuf, sizeof(workbuf));
+	VbWorkbufSave(&saved);
+	p = VbWorkbufAlloc(13);
+	TEST_PTR_EQ(p, workbuf, "Alloc from workbuf");
+	p2 = VbWorkbufAlloc(0);
+	TEST_EQ(InWorkbuf(p2), 1, "  zero size");
+	TEST_EQ((uintptr_t)p2 & (VB2_WORKBUF_ALIGN - 1), 0, "  aligned");
+	TEST_EQ(VbWorkbufPeak(), 2 * VB2_WORKBUF_ALIGN, "  peak");
+
+	/* Freeing doesn't reclaim the space */
+	VbWorkbufFree(p2);
+	p3 = VbWorkbufAlloc(8);
+	TEST_PTR_NEQ(p3, p2, "Free doesn't reclaim");
+	VbWorkbufFree(p3);
+	VbWorkbufFree(p);
+
+	/* Restoring does */
+	VbWorkbufRestore(&saved);
+	p = VbWorkbufAlloc(8);
+	TEST_PTR_EQ(p, workbuf, "Restore reclaims");
+	TEST_EQ(VbWorkbufPeak(), 3 * VB2_WORKBUF_ALIGN, "  peak kept");
+
+	/* Nested scopes */
+	VbWorkbufSave(&saved2);
+	p2 = VbWorkbufAlloc(8);
+	VbWorkbufRestore(&saved2);
+	p3 = VbWorkbufAlloc(8);
+	TEST_PTR_EQ(p3, p2, "Nested restore");
+	VbWorkbufRestore(&saved);
+
+	/* Falls back to the heap when full */
+	p = VbWorkbufAlloc(sizeof(workbuf));
+	TEST_PTR_EQ(p, workbuf, "Fill workbuf");
+	VbWorkbufSave(&saved2);
+	p2 = VbWorkbufAlloc(1);
+	TEST_PTR_NEQ(p2, NULL, "Full workbuf alloc");
+	TEST_EQ(InWorkbuf(p2), 0, "  from heap");
+	VbWorkbufFree(p2);
+	TEST_EQ(VbWorkbufPeak(), sizeof(workbuf), "  peak");
+
+	/* Restoring a state saved at the very end still works */
+	VbWorkbufRestore(&saved2);
+	VbWorkbufRestore(&saved);
+	p = VbWorkbufAlloc(8);
+	TEST_PTR_EQ(p, workbuf, "Restore from full");
+
+	/* States saved with no work buffer are ignored */
+	VbWorkbufInit(NULL, 0);
+	VbWorkbufSave(&saved);
+	VbWorkbufInit(workbuf, sizeof(workbuf));
+	p = VbWorkbufAlloc(8);
+	VbWorkbufRestore(&saved);
+	p2 = VbWorkbufAlloc(8);
+	TEST_PTR_NEQ(p2, p, "Ignore foreign state");
+	TEST_EQ(InWorkbuf(p2), 1, "  still in workbuf");
+
+	/* Init resets the peak */
+	VbWorkbufInit(workbuf, sizeof(workbuf));
+	TEST_EQ(VbWorkbufPeak(), 0, "Init resets peak");
+	VbWorkbufInit(NULL, 0);
+}
+
+int main(void)
+{
+	WorkbufTest();
+
+	if (vboot_api_stub_check_memory())
+		return 255;
+
+	return gTestSuccess ? 0 : 255;
+}
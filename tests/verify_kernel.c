@@ -10,6 +10,7 @@
 #include <string.h>
 
 #include "host_common.h"
+#include "host_kernel_scan.h"
 #include "util_misc.h"
 #include "vboot_common.h"
 #include "vboot_api.h"
@@ -23,6 +24,7 @@ static VbNvContext nvc;
 
 static LoadKernelParams params;
 static VbCommonParams cparams;
+static KernelScan scan;
 
 VbError_t VbExDiskRead(VbExDiskHandle_t handle, uint64_t lba_start,
 		       uint64_t lba_count, void *buffer)
@@ -34,10 +36,24 @@ VbError_t VbExDiskRead(VbExDiskHandle_t handle, uint64_t lba_start,
 	if (lba_start + lba_count > params.streaming_lba_count)
 		return VBERROR_UNKNOWN;
 
+	/* Use the headers already read by the scan, if there was one */
+	if (0 == KernelScanRead(&scan, lba_start, lba_count, buffer))
+		return VBERROR_SUCCESS;
+
 	memcpy(buffer, diskbuf + lba_start * 512, lba_count * 512);
 	return VBERROR_SUCCESS;
 }
 
+static int ScanDiskRead(void *ctx, uint64_t lba_start, uint64_t lba_count,
+			void *buffer)
+{
+	if (lba_start + lba_count > params.streaming_lba_count)
+		return 1;
+
+	memcpy(buffer, diskbuf + lba_start * 512, lba_count * 512);
+	return 0;
+}
+
 VbError_t VbExDiskWrite(VbExDiskHandle_t handle, uint64_t lba_start,
 			uint64_t lba_count, const void *buffer)
 {
@@ -54,7 +70,9 @@ VbError_t VbExDiskWrite(VbExDiskHandle_t handle, uint64_t lba_start,
 
 static void print_help(const char *progname)
 {
-	printf("\nUsage: %s <disk_image> <kernel.vbpubk>\n\n",
+	printf("\nUsage: %s [-p] <disk_image> <kernel.vbpubk>\n\n"
+	       "  -p  Check the headers of all the kernel partitions at once,\n"
+	       "      then pick one the same way as usual\n\n",
 	       progname);
 }
 
@@ -62,8 +80,15 @@ int main(int argc, char *argv[])
 {
 	VbPublicKey *kernkey;
 	uint64_t disk_bytes = 0;
+	int parallel = 0;
 	int rv;
 
+	if (argc > 1 && !strcmp(argv[1], "-p")) {
+		parallel = 1;
+		argc--;
+		argv++;
+	}
+
 	if (argc < 3) {
 		print_help(argv[0]);
 		return 1;
@@ -118,8 +143,18 @@ int main(int argc, char *argv[])
 	VbNvSetup(&nvc);
 	params.nv_context = &nvc;
 
+	if (parallel) {
+		if (0 != KernelScanDisk(&scan, &params, kernkey,
+					ScanDiskRead, NULL)) {
+			fprintf(stderr, "Can't read GPT\n");
+			return 1;
+		}
+		KernelScanPrint(&scan);
+	}
+
 	/* Try loading kernel */
 	rv = LoadKernel(&params, &cparams);
+	KernelScanFree(&scan);
 	if (rv != VBERROR_SUCCESS) {
 		fprintf(stderr, "LoadKernel() failed with code %d\n", rv);
 		return 1;
@@ -3,7 +3,6 @@
 // found in the LICENSE file.
 
 #include <errno.h>
-#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
 #include <stdarg.h>
@@ -11,12 +10,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "2sysincludes.h"
+#include "2return_codes.h"
 #include "bmpblk_font.h"
+#include "host_common.h"
 #include "image_types.h"
 #include "vboot_api.h"
 
@@ -36,6 +37,7 @@ static void error(const char *fmt, ...)
 /* Command line options */
 enum {
   OPT_OUTFILE = 1000,
+  OPT_ATLAS,
 };
 
 #define DEFAULT_OUTFILE "font.bin"
@@ -43,6 +45,7 @@ enum {
 
 static struct option long_opts[] = {
   {"outfile", 1, 0,                   OPT_OUTFILE             },
+  {"atlas", 1, 0,                     OPT_ATLAS               },
   {NULL, 0, 0, 0}
 };
 
@@ -62,6 +65,10 @@ static void HelpAndDie(void) {
           "\n"
           "OPTIONS are:\n"
           "  --outfile <filename>      Output file (default is %s)\n"
+          "  --atlas <format>          Put all the glyphs in one image, in\n"
+          "                            the panel's pixel format: xrgb8888,\n"
+          "                            rgb888 or rgb565. Firmware built with\n"
+          "                            DISPLAY_FONT_ATLAS draws text from it.\n"
           "\n", progname, progname, DEFAULT_OUTFILE);
   exit(1);
 }
@@ -70,38 +77,22 @@ static void HelpAndDie(void) {
 
 // Returns pointer to buffer containing entire file, sets length.
 static void *read_entire_file(const char *filename, size_t *length) {
-  int fd;
-  struct stat sbuf;
-  void *ptr;
+  uint8_t *ptr;
+  uint32_t size;
 
   *length = 0;                          // just in case
 
-  if (0 != stat(filename, &sbuf)) {
-    error("Unable to stat %s: %s\n", filename, strerror(errno));
+  if (VB2_SUCCESS != vb2_map_file(filename, VB2_MAP_RO, &ptr, &size)) {
+    error("Unable to read %s: %s\n", filename, strerror(errno));
     return 0;
   }
 
-  if (!sbuf.st_size) {
+  if (!size) {
     error("File %s is empty\n", filename);
     return 0;
   }
 
-  fd = open(filename, O_RDONLY);
-  if (fd < 0) {
-    error("Unable to open %s: %s\n", filename, strerror(errno));
-    return 0;
-  }
-
-  ptr = mmap(0, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-  if (MAP_FAILED == ptr) {
-    error("Unable to mmap %s: %s\n", filename, strerror(errno));
-    close(fd);
-    return 0;
-  }
-
-  *length = sbuf.st_size;
-
-  close(fd);
+  *length = size;
 
   return ptr;
 }
@@ -109,17 +100,133 @@ static void *read_entire_file(const char *filename, size_t *length) {
 
 // Reclaims buffer from read_entire_file().
 static void discard_file(void *ptr, size_t length) {
-  munmap(ptr, length);
+  vb2_unmap_file(ptr, length, VB2_MAP_RO);
 }
 
 //////////////////////////////////////////////////////////////////////////////
 
+// Returns the character a glyph file is for, or -1 if the name doesn't say.
+static int parse_ascii(const char *imgfile) {
+  const char *s = strrchr(imgfile, '_');
+  uint32_t ascii;
+
+  if (!s || 1 != sscanf(s, "_%x.bmp", &ascii) || ascii > INT_MAX)
+    return -1;
+  return ascii;
+}
+
+// Writes the glyphs as a font atlas (see bmpblk_font.h): they're converted
+// to raw pixels and put side by side in one image. Returns 0 if success.
+static int write_atlas(FILE *ofp, int numimages, char **imgfiles,
+                       uint32_t pixel_format) {
+  FontAtlasGlyph glyphs[FONT_ATLAS_MAX_GLYPHS];
+  RawImageHeader *glyph_raw[FONT_ATLAS_MAX_GLYPHS];
+  uint32_t pixel_size = raw_pixel_size(pixel_format);
+  FontAtlasHeader header;
+  RawImageHeader rhdr;
+  uint8_t *image = NULL;
+  uint32_t width = 0, height = 0, stride, i, y;
+  int num_glyphs = 0;
+  int retval = 1;
+  int c;
+
+  memset(glyphs, 0, sizeof(glyphs));
+  memset(glyph_raw, 0, sizeof(glyph_raw));
+
+  for (i = 0; i < numimages; i++) {
+    uint32_t raw_size;
+    size_t imgsize;
+    void *imgdata;
+
+    c = parse_ascii(imgfiles[i]);
+    if (c < 0 || c >= FONT_ATLAS_MAX_GLYPHS) {
+      error("Unable to parse a character below 0x%x from filename %s\n",
+            FONT_ATLAS_MAX_GLYPHS, imgfiles[i]);
+      goto out;
+    }
+    // Like the firmware does with other fonts, the first one wins
+    if (glyph_raw[c]) {
+      printf("%s => 0x%x again, skipped\n", imgfiles[i], c);
+      continue;
+    }
+
+    imgdata = read_entire_file(imgfiles[i], &imgsize);
+    if (!imgdata)
+      goto out;
+    glyph_raw[c] = bmp_to_raw(imgdata, imgsize, pixel_format, &raw_size);
+    discard_file(imgdata, imgsize);
+    if (!glyph_raw[c]) {
+      error("Unable to convert %s to raw pixels\n", imgfiles[i]);
+      goto out;
+    }
+
+    glyphs[c].x = width;
+    glyphs[c].width = glyph_raw[c]->width;
+    glyphs[c].height = glyph_raw[c]->height;
+    width += glyph_raw[c]->width;
+    if (glyph_raw[c]->height > height)
+      height = glyph_raw[c]->height;
+    if (width > UINT16_MAX || height > UINT16_MAX || !glyphs[c].width) {
+      error("%s doesn't fit in the atlas\n", imgfiles[i]);
+      goto out;
+    }
+    if (c >= num_glyphs)
+      num_glyphs = c + 1;
+    printf("%s => 0x%x %dx%d at %d\n", imgfiles[i], c,
+           glyphs[c].width, glyphs[c].height, glyphs[c].x);
+  }
+
+  // Rows start on 4-byte boundaries, as bmp_to_raw() does them
+  stride = ((width * pixel_size + 3) / 4) * 4;
+  image = calloc(1, stride * height);
+  if (!image)
+    goto out;
+  for (c = 0; c < num_glyphs; c++) {
+    const RawImageHeader *g = glyph_raw[c];
+
+    for (y = 0; g && y < g->height; y++)
+      memcpy(image + y * stride + glyphs[c].x * pixel_size,
+             (const uint8_t *)(g + 1) + y * g->stride,
+             g->width * pixel_size);
+  }
+
+  memset(&rhdr, 0, sizeof(rhdr));
+  memcpy(rhdr.signature, RAW_IMAGE_SIGNATURE, RAW_IMAGE_SIGNATURE_SIZE);
+  rhdr.width = width;
+  rhdr.height = height;
+  rhdr.stride = stride;
+  rhdr.pixel_format = pixel_format;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.signature, FONT_ATLAS_SIGNATURE, FONT_SIGNATURE_SIZE);
+  header.num_glyphs = num_glyphs;
+  header.default_glyph = parse_ascii(imgfiles[0]);
+  header.line_height = height;
+  header.image_size = sizeof(rhdr) + stride * height;
+
+  if (1 != fwrite(&header, sizeof(header), 1, ofp) ||
+      1 != fwrite(glyphs, sizeof(glyphs[0]) * num_glyphs, 1, ofp) ||
+      1 != fwrite(&rhdr, sizeof(rhdr), 1, ofp) ||
+      1 != fwrite(image, stride * height, 1, ofp)) {
+    error("Can't write atlas: %s\n", strerror(errno));
+    goto out;
+  }
+  printf("atlas is %dx%d, %d bytes\n", width, height, header.image_size);
+  retval = 0;
+
+out:
+  for (c = 0; c < FONT_ATLAS_MAX_GLYPHS; c++)
+    free(glyph_raw[c]);
+  free(image);
+  return retval;
+}
 
 
 int main(int argc, char* argv[]) {
   char* outfile = DEFAULT_OUTFILE;
   int numimages = 0;
   int parse_error = 0;
+  uint32_t atlas_format = RAW_PIXEL_INVALID;
   int i;
   FILE *ofp;
   FontArrayHeader header;
@@ -137,6 +244,19 @@ int main(int argc, char* argv[]) {
         outfile = optarg;
         break;
 
+      case OPT_ATLAS:
+        if (!strcmp(optarg, "xrgb8888")) {
+          atlas_format = RAW_PIXEL_XRGB8888;
+        } else if (!strcmp(optarg, "rgb888")) {
+          atlas_format = RAW_PIXEL_RGB888;
+        } else if (!strcmp(optarg, "rgb565")) {
+          atlas_format = RAW_PIXEL_RGB565;
+        } else {
+          printf("Unknown pixel format \"%s\"\n", optarg);
+          parse_error = 1;
+        }
+        break;
+
     default:
         /* Unhandled option */
         printf("Unknown option\n");
@@ -157,6 +277,13 @@ int main(int argc, char* argv[]) {
   if (!ofp)
     fatal("Unable to open %s: %s\n", outfile, strerror(errno));
 
+  if (atlas_format) {
+    if (write_atlas(ofp, numimages, argv + optind, atlas_format))
+      goto bad1;
+    fclose(ofp);
+    return 0;
+  }
+
   memcpy(&header.signature, FONT_SIGNATURE, FONT_SIGNATURE_SIZE);
   header.num_entries = numimages;
   if (1 != fwrite(&header, sizeof(header), 1, ofp)) {
@@ -166,13 +293,12 @@ int main(int argc, char* argv[]) {
 
   for(i=0; i<numimages; i++) {
     char *imgfile = argv[optind+i];
-    char *s;
-    uint32_t ascii;
+    int ascii;
     void *imgdata = 0;
     size_t imgsize, filesize, diff;
 
-    s = strrchr(imgfile, '_');
-    if (!s || 1 != sscanf(s, "_%x.bmp", &ascii)) { // This is not foolproof.
+    ascii = parse_ascii(imgfile);
+    if (ascii < 0) { // This is not foolproof.
       error("Unable to parse the character from filename %s\n", imgfile);
       goto bad1;
     }
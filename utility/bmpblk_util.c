@@ -4,55 +4,45 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <lzma.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "2sysincludes.h"
+#include "2return_codes.h"
+#include "bmpblk_rle.h"
 #include "bmpblk_util.h"
 #include "eficompress.h"
+#include "host_common.h"
 #include "vboot_api.h"
 
 // Returns pointer to buffer containing entire file, sets length.
 static void *read_entire_file(const char *filename, size_t *length) {
-  int fd;
-  struct stat sbuf;
-  void *ptr;
+  uint8_t *ptr;
+  uint32_t size;
 
   *length = 0;                          // just in case
 
-  if (0 != stat(filename, &sbuf)) {
-    fprintf(stderr, "Unable to stat %s: %s\n", filename, strerror(errno));
+  if (VB2_SUCCESS != vb2_map_file(filename, VB2_MAP_RO, &ptr, &size)) {
+    fprintf(stderr, "Unable to read %s: %s\n", filename, strerror(errno));
     return 0;
   }
 
-  if (!sbuf.st_size) {
+  if (!size) {
     fprintf(stderr, "File %s is empty\n", filename);
     return 0;
   }
 
-  fd = open(filename, O_RDONLY);
-  if (fd < 0) {
-    fprintf(stderr, "Unable to open %s: %s\n", filename, strerror(errno));
-    return 0;
-  }
-
-  ptr = mmap(0, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-  if (MAP_FAILED == ptr) {
-    fprintf(stderr, "Unable to mmap %s: %s\n", filename, strerror(errno));
-    close(fd);
-    return 0;
-  }
-
-  *length = sbuf.st_size;
-
-  close(fd);
+  *length = size;
 
   return ptr;
 }
@@ -60,7 +50,7 @@ static void *read_entire_file(const char *filename, size_t *length) {
 
 // Reclaims buffer from read_entire_file().
 static void discard_file(void *ptr, size_t length) {
-  munmap(ptr, length);
+  vb2_unmap_file(ptr, length, VB2_MAP_RO);
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -129,7 +119,7 @@ static void *do_efi_decompress(ImageInfo *img) {
     return 0;
   }
 
-  r = EfiDecompress(ibuf, isize, obuf, osize, sbuf, ssize);
+  r = EfiDecompressFast(ibuf, isize, obuf, osize, sbuf, ssize);
   if (r != EFI_SUCCESS) {
     fprintf(stderr, "EfiDecompress failed with code %d\n", r);
     free(obuf);
@@ -185,11 +175,244 @@ static void *do_lzma_decompress(ImageInfo *img) {
 }
 
 
+static void *do_rle_decompress(ImageInfo *img) {
+  uint32_t osize = img->original_size;
+  void *obuf = malloc(osize);
+
+  if (!obuf) {
+    fprintf(stderr, "Can't allocate %d bytes: %s\n",
+            osize,
+            strerror(errno));
+    return 0;
+  }
+
+  if (VbRleDecode((const uint8_t *)(img + 1), img->compressed_size,
+                  obuf, &osize) || osize != img->original_size) {
+    fprintf(stderr, "Unable to decode run-length encoded data\n");
+    free(obuf);
+    return 0;
+  }
+  return obuf;
+}
+
+
+// One image, decompressed ahead of writing it out or timed for stats.
+typedef struct DecodedImage {
+  ImageInfo *img;
+  uint32_t offset;
+  void *data;
+  int free_data;
+  uint64_t nsecs;
+} DecodedImage;
+
+// Decompress one image, timing how long it takes. Returns 0 if it worked.
+static int decode_image(DecodedImage *d) {
+  struct timespec start, end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  // Nothing is extracted for empty images, so there's nothing to decompress
+  switch(d->img->compressed_size ? d->img->compression : COMPRESS_NONE) {
+  case COMPRESS_NONE:
+    d->data = d->img + 1;
+    d->free_data = 0;
+    break;
+  case COMPRESS_EFIv1:
+    d->data = do_efi_decompress(d->img);
+    d->free_data = 1;
+    break;
+  case COMPRESS_LZMA1:
+    d->data = do_lzma_decompress(d->img);
+    d->free_data = 1;
+    break;
+  case COMPRESS_RLE:
+    d->data = do_rle_decompress(d->img);
+    d->free_data = 1;
+    break;
+  default:
+    fprintf(stderr, "Unsupported compression method encountered.\n");
+    d->data = 0;
+    break;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  d->nsecs = (end.tv_sec - start.tv_sec) * 1000000000ULL +
+    end.tv_nsec - start.tv_nsec;
+  return d->data ? 0 : 1;
+}
+
+// Work shared by the decompression threads.
+typedef struct DecodeQueue {
+  DecodedImage *images;
+  uint32_t count;
+  uint32_t next;
+  int failed;
+  pthread_mutex_t lock;
+} DecodeQueue;
+
+// Decompress images from the queue until there are none left.
+static void *decode_worker(void *arg) {
+  DecodeQueue *queue = (DecodeQueue *)arg;
+  uint32_t i;
+  int r;
+
+  for (;;) {
+    pthread_mutex_lock(&queue->lock);
+    i = queue->next++;
+    pthread_mutex_unlock(&queue->lock);
+    if (i >= queue->count)
+      break;
+    r = decode_image(&queue->images[i]);
+    if (r) {
+      pthread_mutex_lock(&queue->lock);
+      queue->failed = 1;
+      pthread_mutex_unlock(&queue->lock);
+    }
+  }
+  return 0;
+}
+
+// Decompress all the images, on a thread per CPU. If a thread can't start,
+// the ones that did (or this one) pick up its share. Returns 0 if they all
+// worked.
+static int decode_images(DecodedImage *images, uint32_t count) {
+  DecodeQueue queue;
+  pthread_t *threads;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t nthreads = cpus > 1 ? (uint32_t)cpus : 1;
+  uint32_t started = 0;
+  uint32_t i;
+
+  if (nthreads > count)
+    nthreads = count;
+  threads = malloc(nthreads * sizeof(*threads));
+  if (!threads)
+    nthreads = 0;
+
+  queue.images = images;
+  queue.count = count;
+  queue.next = 0;
+  queue.failed = 0;
+  pthread_mutex_init(&queue.lock, 0);
+  while (started < nthreads &&
+         !pthread_create(&threads[started], 0, decode_worker, &queue))
+    started++;
+  decode_worker(&queue);
+  for (i = 0; i < started; i++)
+    pthread_join(threads[i], 0);
+  pthread_mutex_destroy(&queue.lock);
+
+  free(threads);
+  return queue.failed;
+}
+
+// Find every ImageInfo stored in the bmpblock. Returns NULL if any of them
+// don't fit in it.
+static DecodedImage *find_images(void *ptr, size_t length) {
+  BmpBlockHeader *hdr = (BmpBlockHeader *)ptr;
+  DecodedImage *images;
+  uint64_t offset;
+  uint32_t i;
+
+  offset = sizeof(BmpBlockHeader) +
+    (uint64_t)sizeof(ScreenLayout) *
+    hdr->number_of_localizations *
+    hdr->number_of_screenlayouts;
+  // One spare, so that an empty list isn't mistaken for running out
+  if (offset > length) {
+    fprintf(stderr, "Screen layouts are outside the BMPBLOCK\n");
+    return 0;
+  }
+  images = calloc(hdr->number_of_imageinfos + 1, sizeof(*images));
+  if (!images)
+    return 0;
+
+  for (i = 0; i < hdr->number_of_imageinfos; i++) {
+    ImageInfo *img = (ImageInfo *)((uint8_t *)ptr + offset);
+    if (offset + sizeof(ImageInfo) > length ||
+        offset + sizeof(ImageInfo) + img->compressed_size > length) {
+      fprintf(stderr, "Image %d is outside the BMPBLOCK\n", i);
+      free(images);
+      return 0;
+    }
+    images[i].img = img;
+    images[i].offset = offset;
+    offset += sizeof(ImageInfo);
+    offset += img->compressed_size;
+    // 4-byte aligned
+    if ((offset & 3) > 0)
+      offset = (offset & ~3) + 4;
+  }
+
+  return images;
+}
+
+// Free what decode_images() decompressed, and the list itself.
+static void free_images(DecodedImage *images, uint32_t count) {
+  uint32_t i;
+
+  if (!images)
+    return;
+  for (i = 0; i < count; i++)
+    if (images[i].free_data)
+      free(images[i].data);
+  free(images);
+}
+
+static int compare_uint32(const void *a, const void *b) {
+  uint32_t ua = *(const uint32_t *)a;
+  uint32_t ub = *(const uint32_t *)b;
+  return (ua > ub) - (ua < ub);
+}
+
+// Count the images the screen layouts point at, and how many bytes it would
+// take to give every reference its own copy of the image, beyond what's
+// actually stored. Returns the number of references.
+static uint32_t count_image_refs(const void *ptr, size_t length,
+                                 uint32_t *stored, uint64_t *saved) {
+  const BmpBlockHeader *hdr = (const BmpBlockHeader *)ptr;
+  uint64_t num_screens = (uint64_t)hdr->number_of_localizations *
+    hdr->number_of_screenlayouts;
+  uint32_t *refs;
+  uint32_t num_refs = 0;
+  uint32_t i, j;
+
+  *stored = 0;
+  *saved = 0;
+  if (num_screens > (length - sizeof(BmpBlockHeader)) / sizeof(ScreenLayout))
+    return 0;
+  refs = malloc(num_screens * MAX_IMAGE_IN_LAYOUT * sizeof(*refs));
+  if (!refs)
+    return 0;
+
+  for (i = 0; i < num_screens; i++) {
+    const ScreenLayout *scr = (const ScreenLayout *)
+      ((const uint8_t *)ptr + sizeof(BmpBlockHeader) +
+       i * sizeof(ScreenLayout));
+    for (j = 0; j < MAX_IMAGE_IN_LAYOUT; j++) {
+      uint32_t offset = scr->images[j].image_info_offset;
+      if (offset && offset <= length - sizeof(ImageInfo))
+        refs[num_refs++] = offset;
+    }
+  }
+
+  qsort(refs, num_refs, sizeof(*refs), compare_uint32);
+  for (i = 0; i < num_refs; i++) {
+    if (i && refs[i] == refs[i - 1]) {
+      const ImageInfo *img = (const ImageInfo *)
+        ((const uint8_t *)ptr + refs[i]);
+      *saved += sizeof(ImageInfo) + ((img->compressed_size + 3) & ~3);
+    } else {
+      (*stored)++;
+    }
+  }
+
+  free(refs);
+  return num_refs;
+}
 
 // Show what's inside. If todir is NULL, just print. Otherwise unpack.
 int dump_bmpblock(const char *infile, int show_as_yaml,
                   const char *todir, int overwrite) {
-  void *ptr, *data_ptr;
+  void *ptr;
   size_t length = 0;
   BmpBlockHeader *hdr;
   ImageInfo *img;
@@ -198,7 +421,9 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
   int screen_num;
   int i;
   int offset;
-  int free_data;
+  DecodedImage *decoded = 0;
+  uint32_t refs, stored;
+  uint64_t saved;
   char image_name[80];
   char full_path_name[PATH_MAX];
   int yfd, bfd;
@@ -260,6 +485,9 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
     printf("  %d screens\n", hdr->number_of_screenlayouts);
     printf("  %d localizations\n", hdr->number_of_localizations);
     printf("  %d discrete images\n", hdr->number_of_imageinfos);
+    refs = count_image_refs(ptr, length, &stored, &saved);
+    printf("  %d image references to %d images, sharing saves %" PRIu64
+           " bytes\n", refs, stored, saved);
     discard_file(ptr, length);
     return 0;
   }
@@ -281,11 +509,24 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
   img = (ImageInfo *)(ptr + offset);
   if (img->compression)
     fprintf(yfp, "compression: %d\n", img->compression);
+
+  // Decompress everything up front, all at once.
+  if (todir) {
+    decoded = find_images(ptr, length);
+    if (!decoded || decode_images(decoded, hdr->number_of_imageinfos)) {
+      fclose(yfp);
+      free_images(decoded, hdr->number_of_imageinfos);
+      discard_file(ptr, length);
+      return 1;
+    }
+  }
+
   fprintf(yfp, "images:\n");
   for(i=0; i<hdr->number_of_imageinfos; i++) {
     img = (ImageInfo *)(ptr + offset);
     if (img->compressed_size) {
-      sprintf(image_name, "img_%08x.bmp", offset);
+      sprintf(image_name, "img_%08x.%s", offset,
+              img->format == FORMAT_RAW ? "raw" : "bmp");
       if (img->tag == TAG_HWID) {
         fprintf(yfp, "  %s: %s  # %dx%d  %d/%d  tag=%d fmt=%d\n",
                 RENDER_HWID, image_name,
@@ -314,6 +555,7 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
           fprintf(stderr, "Unable to open %s: %s\n", full_path_name,
                   strerror(errno));
           fclose(yfp);
+          free_images(decoded, hdr->number_of_imageinfos);
           discard_file(ptr, length);
           return 1;
         }
@@ -323,52 +565,20 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
                   strerror(errno));
           close(bfd);
           fclose(yfp);
+          free_images(decoded, hdr->number_of_imageinfos);
           discard_file(ptr, length);
           return 1;
         }
-        switch(img->compression) {
-        case COMPRESS_NONE:
-          data_ptr = ptr + offset + sizeof(ImageInfo);
-          free_data = 0;
-          break;
-        case COMPRESS_EFIv1:
-          data_ptr = do_efi_decompress(img);
-          if (!data_ptr) {
-            fclose(bfp);
-            fclose(yfp);
-            discard_file(ptr, length);
-            return 1;
-          }
-          free_data = 1;
-          break;
-        case COMPRESS_LZMA1:
-          data_ptr = do_lzma_decompress(img);
-          if (!data_ptr) {
-            fclose(bfp);
-            fclose(yfp);
-            discard_file(ptr, length);
-            return 1;
-          }
-          free_data = 1;
-          break;
-        default:
-          fprintf(stderr, "Unsupported compression method encountered.\n");
-          fclose(bfp);
-          fclose(yfp);
-          discard_file(ptr, length);
-          return 1;
-        }
-        if (1 != fwrite(data_ptr, img->original_size, 1, bfp)) {
+        if (1 != fwrite(decoded[i].data, img->original_size, 1, bfp)) {
           fprintf(stderr, "Unable to write %s: %s\n", full_path_name,
                   strerror(errno));
           fclose(bfp);
           fclose(yfp);
+          free_images(decoded, hdr->number_of_imageinfos);
           discard_file(ptr, length);
           return 1;
         }
         fclose(bfp);
-        if (free_data)
-          free(data_ptr);
       }
     }
     offset += sizeof(ImageInfo);
@@ -448,8 +658,119 @@ int dump_bmpblock(const char *infile, int show_as_yaml,
   if (todir)
     fclose(yfp);
 
+  free_images(decoded, hdr->number_of_imageinfos);
   discard_file(ptr, length);
 
   return 0;
 }
 
+
+// Find the decoded image at an offset, or NULL if there isn't one.
+static DecodedImage *image_at(DecodedImage *images, uint32_t count,
+                              uint32_t offset) {
+  uint32_t lo = 0, hi = count;
+
+  // find_images() lists them in order of offset
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (images[mid].offset == offset)
+      return &images[mid];
+    if (images[mid].offset < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return 0;
+}
+
+// Show how big each image is and how long it takes to decompress, then the
+// same added up over the screens of each locale.
+int stats_bmpblock(const char *infile) {
+  void *ptr;
+  size_t length = 0;
+  BmpBlockHeader *hdr;
+  DecodedImage *images;
+  const char *locale_name = 0;
+  uint32_t loc_num, screen_num, i;
+
+  ptr = (void *)read_entire_file(infile, &length);
+  if (!ptr)
+    return 1;
+
+  if (length < sizeof(BmpBlockHeader) ||
+      0 != memcmp(ptr, BMPBLOCK_SIGNATURE, BMPBLOCK_SIGNATURE_SIZE)) {
+    fprintf(stderr, "File %s is not a BMPBLOCK\n", infile);
+    discard_file(ptr, length);
+    return 1;
+  }
+  hdr = (BmpBlockHeader *)ptr;
+
+  // Decompressed one at a time, so that they don't slow each other down
+  images = find_images(ptr, length);
+  if (!images) {
+    discard_file(ptr, length);
+    return 1;
+  }
+  for (i = 0; i < hdr->number_of_imageinfos; i++) {
+    if (decode_image(&images[i])) {
+      free_images(images, hdr->number_of_imageinfos);
+      discard_file(ptr, length);
+      return 1;
+    }
+  }
+
+  printf("# %-12s %6s %12s %12s %12s\n", "image", "comp",
+         "compressed", "original", "usecs");
+  for (i = 0; i < hdr->number_of_imageinfos; i++) {
+    ImageInfo *img = images[i].img;
+    printf("  img_%08x %6d %12d %12d %12.1f\n", images[i].offset,
+           img->compression, img->compressed_size, img->original_size,
+           images[i].nsecs / 1000.0);
+  }
+
+  if (hdr->locale_string_offset && hdr->locale_string_offset < length)
+    locale_name = (const char *)ptr + hdr->locale_string_offset;
+
+  printf("# %-12s %6s %12s %12s %12s\n", "locale", "images",
+         "compressed", "original", "usecs");
+  for (loc_num = 0; loc_num < hdr->number_of_localizations; loc_num++) {
+    uint64_t compressed = 0, original = 0, nsecs = 0;
+    uint32_t count = 0;
+    char name[32];
+
+    for (screen_num = 0; screen_num < hdr->number_of_screenlayouts;
+         screen_num++) {
+      ScreenLayout *scr = (ScreenLayout *)
+        ((uint8_t *)ptr + sizeof(BmpBlockHeader) +
+         (loc_num * hdr->number_of_screenlayouts + screen_num) *
+         sizeof(ScreenLayout));
+      for (i = 0; i < MAX_IMAGE_IN_LAYOUT; i++) {
+        DecodedImage *d = image_at(images, hdr->number_of_imageinfos,
+                                   scr->images[i].image_info_offset);
+        if (!scr->images[i].image_info_offset || !d)
+          continue;
+        compressed += d->img->compressed_size;
+        original += d->img->original_size;
+        nsecs += d->nsecs;
+        count++;
+      }
+    }
+
+    // Locale names are listed in order, each null-terminated, up to an
+    // empty one
+    if (locale_name && *locale_name &&
+        memchr(locale_name, 0, (char *)ptr + length - locale_name)) {
+      snprintf(name, sizeof(name), "%s", locale_name);
+      locale_name += strlen(locale_name) + 1;
+    } else {
+      locale_name = 0;
+      snprintf(name, sizeof(name), "%d", loc_num);
+    }
+    printf("  %-12s %6d %12" PRIu64 " %12" PRIu64 " %12.1f\n", name, count,
+           compressed, original, nsecs / 1000.0);
+  }
+
+  free_images(images, hdr->number_of_imageinfos);
+  discard_file(ptr, length);
+  return 0;
+}
@@ -9,11 +9,15 @@
 #include <errno.h>
 #include <getopt.h>
 #include <lzma.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include <yaml.h>
 
 #include "bmpblk_utility.h"
@@ -21,6 +25,9 @@
 #include "vboot_api.h"
 
 extern "C" {
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
 #include "eficompress.h"
 }
 
@@ -34,6 +41,306 @@ static void error(const char *format, ...) {
   exit(1);
 }
 
+// Run-length encode some content (see bmpblk_header.h).  Raw images are
+// encoded a pixel at a time, and anything else a byte at a time.
+static string rle_encode(const string &content) {
+  ImageInfo info;
+  uint32_t unit = 1;
+  if (FORMAT_RAW == identify_image_type(content.data(), content.size(),
+                                        &info)) {
+    const RawImageHeader *raw = (const RawImageHeader *)content.data();
+    uint32_t size = raw_pixel_size(raw->pixel_format);
+    if (size && content.size() % size == 0)
+      unit = size;
+  }
+
+  string result(1, (char)unit);
+  const char *data = content.data();
+  size_t units = content.size() / unit;
+  size_t literal_start = 0, literal_units = 0;
+  size_t i = 0;
+  while (i < units) {
+    size_t run = 1;
+    while (i + run < units && run < RLE_MAX_RUN &&
+           !memcmp(data + (i + run) * unit, data + i * unit, unit))
+      run++;
+
+    if (run < 2) {
+      if (!literal_units)
+        literal_start = i;
+      literal_units++;
+      i++;
+    }
+    if (literal_units && (run >= 2 || literal_units == RLE_MAX_LITERAL ||
+                          i == units)) {
+      result += (char)(literal_units - 1);
+      result.append(data + literal_start * unit, literal_units * unit);
+      literal_units = 0;
+    }
+    if (run >= 2) {
+      result += (char)(RLE_RUN + run - 2);
+      result.append(data + i * unit, unit);
+      i += run;
+    }
+  }
+  return result;
+}
+
+// Compress one image's content with the given method.
+static string compress_content(const string &content, uint32_t compression) {
+  string result;
+
+  switch(compression) {
+  case COMPRESS_NONE:
+    result = content;
+    break;
+  case COMPRESS_RLE:
+    result = rle_encode(content);
+    break;
+  case COMPRESS_EFIv1:
+  {
+    // The content will always compress smaller (so sez the docs).
+    uint32_t tmpsize = content.size();
+    uint8_t *tmpbuf = (uint8_t *)malloc(tmpsize);
+    // The size of the compressed content is also returned.
+    if (EFI_SUCCESS != EfiCompress((uint8_t *)content.c_str(), tmpsize,
+                                   tmpbuf, &tmpsize)) {
+      error("Unable to compress!\n");
+    }
+    result.assign((const char *)tmpbuf, tmpsize);
+    free(tmpbuf);
+  }
+  break;
+  case COMPRESS_LZMA1:
+  {
+    // Calculate the worst case of buffer size.
+    uint32_t tmpsize = lzma_stream_buffer_bound(content.size());
+    uint8_t *tmpbuf = (uint8_t *)malloc(tmpsize);
+    lzma_stream stream = LZMA_STREAM_INIT;
+    lzma_options_lzma options;
+    lzma_ret result_code;
+
+    lzma_lzma_preset(&options, 9);
+    result_code = lzma_alone_encoder(&stream, &options);
+    if (result_code != LZMA_OK) {
+      error("Unable to initialize easy encoder (error: %d)!\n", result_code);
+    }
+
+    stream.next_in = (uint8_t *)content.data();
+    stream.avail_in = content.size();
+    stream.next_out = tmpbuf;
+    stream.avail_out = tmpsize;
+    result_code = lzma_code(&stream, LZMA_FINISH);
+    if (result_code != LZMA_STREAM_END) {
+      error("Unable to encode data (error: %d)!\n", result_code);
+    }
+
+    result.assign((const char *)tmpbuf, tmpsize - stream.avail_out);
+    lzma_end(&stream);
+    free(tmpbuf);
+  }
+  break;
+  default:
+    error("Unsupported compression method attempted.\n");
+  }
+
+  return result;
+}
+
+// One distinct image content to compress, shared by every image that has it.
+struct CompressJob {
+  const string *content;
+  string cache_filename;
+  string compressed;
+  bool cached;
+};
+
+// Work shared by the compression threads.
+struct CompressQueue {
+  vector<CompressJob> *jobs;
+  uint32_t compression;
+  pthread_mutex_t lock;
+  size_t next;
+};
+
+// Compress jobs from the queue until there are none left.
+static void *compress_worker(void *arg) {
+  CompressQueue *queue = (CompressQueue *)arg;
+
+  for (;;) {
+    pthread_mutex_lock(&queue->lock);
+    size_t i = queue->next++;
+    pthread_mutex_unlock(&queue->lock);
+    if (i >= queue->jobs->size())
+      break;
+    CompressJob &job = (*queue->jobs)[i];
+    job.compressed = compress_content(*job.content, queue->compression);
+  }
+  return NULL;
+}
+
+// SHA-256 of some image content, in hex.
+static string content_digest(const string &content) {
+  struct vb2_digest_context dc;
+  uint8_t digest[VB2_SHA256_DIGEST_SIZE];
+  char hex[2 * VB2_SHA256_DIGEST_SIZE + 1];
+
+  if (vb2_digest_init(&dc, VB2_HASH_SHA256) ||
+      vb2_digest_extend(&dc, (const uint8_t *)content.data(),
+                        content.size()) ||
+      vb2_digest_finalize(&dc, digest, sizeof(digest))) {
+    error("Unable to hash image content\n");
+  }
+  for (int i = 0; i < VB2_SHA256_DIGEST_SIZE; i++)
+    sprintf(hex + 2 * i, "%02x", digest[i]);
+  return hex;
+}
+
+// Name of the cache file for some content compressed a given way.
+static string cache_filename(const string &dir, const string &digest,
+                             uint32_t compression) {
+  char suffix[16];
+
+  sprintf(suffix, ".%u", compression);
+  return dir + "/" + digest + suffix;
+}
+
+// Read a cache file; returns false if it isn't there.
+static bool read_cache_file(const string &filename, string &content) {
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (!fp)
+    return false;
+
+  char buffer[4096];
+  size_t n;
+  content.clear();
+  while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    content.append(buffer, n);
+  bool ok = !ferror(fp);
+  fclose(fp);
+  return ok;
+}
+
+// Write a cache file.  Failing to is not an error; it's just not cached.
+static void write_cache_file(const string &filename, const string &content) {
+  string tmpname = filename + ".XXXXXX";
+  vector<char> tmpbuf(tmpname.begin(), tmpname.end());
+  tmpbuf.push_back('\0');
+
+  int fd = mkstemp(&tmpbuf[0]);
+  if (fd < 0)
+    return;
+  FILE *fp = fdopen(fd, "wb");
+  if (!fp) {
+    close(fd);
+    unlink(&tmpbuf[0]);
+    return;
+  }
+  bool ok = fwrite(content.data(), 1, content.size(), fp) == content.size();
+  if (fclose(fp))
+    ok = false;
+  // Renaming it into place means another run never sees half a file.
+  if (!ok || rename(&tmpbuf[0], filename.c_str()))
+    unlink(&tmpbuf[0]);
+}
+
+// What an image source file looked like when it was last read, so that an
+// unchanged one needn't be read again.
+struct SourceEntry {
+  string digest;
+  uint64_t size;
+  int64_t mtime_sec;
+  long mtime_nsec;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+};
+
+// Source entries, by the real path of the file.
+typedef map<string, SourceEntry> SourceIndex;
+
+// Name of the source index in a cache directory.
+static string source_index_filename(const string &dir) {
+  return dir + "/index";
+}
+
+// Read the source index, one "digest size sec nsec format width height path"
+// line per file.  Lines that don't parse are ignored.
+static void read_source_index(const string &filename, SourceIndex &index) {
+  string content;
+  if (!read_cache_file(filename, content))
+    return;
+
+  size_t start = 0;
+  while (start < content.size()) {
+    size_t end = content.find('\n', start);
+    if (end == string::npos)
+      end = content.size();
+    string line = content.substr(start, end - start);
+    start = end + 1;
+
+    char digest[2 * VB2_SHA256_DIGEST_SIZE + 1];
+    unsigned long long size;
+    long long mtime_sec;
+    long mtime_nsec;
+    unsigned int format, width, height;
+    int path_start = 0;
+    if (sscanf(line.c_str(), "%64s %llu %lld %ld %u %u %u %n", digest, &size,
+               &mtime_sec, &mtime_nsec, &format, &width, &height,
+               &path_start) != 7 || !path_start ||
+        strlen(digest) != 2 * VB2_SHA256_DIGEST_SIZE)
+      continue;
+
+    SourceEntry &entry = index[line.substr(path_start)];
+    entry.digest = digest;
+    entry.size = size;
+    entry.mtime_sec = mtime_sec;
+    entry.mtime_nsec = mtime_nsec;
+    entry.format = format;
+    entry.width = width;
+    entry.height = height;
+  }
+}
+
+// Write the source index back out.
+static void write_source_index(const string &filename,
+                               const SourceIndex &index) {
+  string content;
+  char line[256];
+
+  for (SourceIndex::const_iterator it = index.begin(); it != index.end();
+       ++it) {
+    const SourceEntry &entry = it->second;
+    snprintf(line, sizeof(line), "%s %llu %lld %ld %u %u %u ",
+             entry.digest.c_str(), (unsigned long long)entry.size,
+             (long long)entry.mtime_sec, entry.mtime_nsec, entry.format,
+             entry.width, entry.height);
+    content += line;
+    content += it->first;
+    content += '\n';
+  }
+  write_cache_file(filename, content);
+}
+
+// Find out what's on disk for an image source: its real path, and the size
+// and modification time to compare with the index.
+static bool stat_source(const string &filename, string &path,
+                        SourceEntry &stamp) {
+  struct stat sb;
+  char *real = realpath(filename.c_str(), NULL);
+  if (!real)
+    return false;
+  path = real;
+  free(real);
+  if (stat(path.c_str(), &sb) || !S_ISREG(sb.st_mode) ||
+      path.find('\n') != string::npos)
+    return false;
+  stamp.size = sb.st_size;
+  stamp.mtime_sec = sb.st_mtim.tv_sec;
+  stamp.mtime_nsec = sb.st_mtim.tv_nsec;
+  return true;
+}
+
 ///////////////////////////////////////////////////////////////////////
 // BmpBlock Utility implementation
 
@@ -55,6 +362,7 @@ namespace vboot_reference {
     support_font_ = true;
     got_font_ = false;
     got_rtol_font_ = false;
+    raw_format_ = RAW_PIXEL_INVALID;
   }
 
   BmpBlockUtil::~BmpBlockUtil() {
@@ -65,6 +373,14 @@ namespace vboot_reference {
     set_compression_ = true;
   }
 
+  void BmpBlockUtil::set_cache_dir(const char *dir) {
+    cache_dir_ = dir;
+  }
+
+  void BmpBlockUtil::set_raw_format(uint32_t pixel_format) {
+    raw_format_ = pixel_format;
+  }
+
   void BmpBlockUtil::load_from_config(const char *filename) {
     load_yaml_config(filename);
     fill_bmpblock_header();
@@ -386,81 +702,175 @@ namespace vboot_reference {
   }
 
   void BmpBlockUtil::load_all_image_files() {
+    // Sources that haven't changed since the last run with this cache are
+    // matched by real path, size and modification time, and their
+    // compressed content comes straight from the cache without reading them.
+    SourceIndex index;
+    bool index_changed = false;
+    map<string, string> blobs;
+    vector<string> image_digest(config_.image_names.size());
+    if (!cache_dir_.empty())
+      read_source_index(source_index_filename(cache_dir_), index);
+    // Anything modified since a second before now could still change within
+    // the same timestamp, so isn't trusted to the index.
+    time_t recent = time(NULL) - 1;
+
     for (unsigned int i = 0; i < config_.image_names.size(); i++) {
       StrImageConfigMap::iterator it =
         config_.images_map.find(config_.image_names[i]);
+      ImageConfig &image = it->second;
+      string path;
+      SourceEntry stamp;
+      // The index describes source files, not what they're converted to
+      bool have_stamp = !cache_dir_.empty() && !raw_format_ &&
+        stat_source(image.filename, path, stamp);
+
+      if (have_stamp) {
+        SourceIndex::iterator found = index.find(path);
+        if (found != index.end() && found->second.size == stamp.size &&
+            found->second.mtime_sec == stamp.mtime_sec &&
+            found->second.mtime_nsec == stamp.mtime_nsec) {
+          const SourceEntry &entry = found->second;
+          string filename = cache_filename(cache_dir_, entry.digest,
+                                           compression_);
+          bool cached = blobs.count(entry.digest) > 0;
+          if (!cached && read_cache_file(filename, blobs[entry.digest])) {
+            cached = true;
+            if (debug_)
+              printf("using cached %s for \"%s\"\n", filename.c_str(),
+                     config_.image_names[i].c_str());
+          }
+          if (cached) {
+            image.data.original_size = entry.size;
+            image.data.format = entry.format;
+            image.data.width = entry.width;
+            image.data.height = entry.height;
+            image_digest[i] = entry.digest;
+            continue;
+          }
+          blobs.erase(entry.digest);
+        }
+      }
+
       if (debug_) {
         printf("loading image \"%s\" from \"%s\"\n",
                config_.image_names[i].c_str(),
-               it->second.filename.c_str());
+               image.filename.c_str());
       }
-      const string &content = read_image_file(it->second.filename.c_str());
-      it->second.raw_content = content;
-      it->second.data.original_size = content.size();
-      it->second.data.format =
+      string content = read_image_file(image.filename.c_str());
+      image.data.format =
         identify_image_type(content.c_str(),
-                            (uint32_t)content.size(), &it->second.data);
-      if (FORMAT_INVALID == it->second.data.format) {
-        error("Unsupported image format in %s\n", it->second.filename.c_str());
+                            (uint32_t)content.size(), &image.data);
+      if (FORMAT_INVALID == image.data.format) {
+        error("Unsupported image format in %s\n", image.filename.c_str());
       }
-      switch(compression_) {
-      case COMPRESS_NONE:
-        it->second.data.compression = compression_;
-        it->second.compressed_content = content;
-        it->second.data.compressed_size = content.size();
-        break;
-      case COMPRESS_EFIv1:
-      {
-        // The content will always compress smaller (so sez the docs).
-        uint32_t tmpsize = content.size();
-        uint8_t *tmpbuf = (uint8_t *)malloc(tmpsize);
-        // The size of the compressed content is also returned.
-        if (EFI_SUCCESS != EfiCompress((uint8_t *)content.c_str(), tmpsize,
-                                       tmpbuf, &tmpsize)) {
-          error("Unable to compress!\n");
-        }
-        it->second.data.compression = compression_;
-        it->second.compressed_content.assign((const char *)tmpbuf, tmpsize);
-        it->second.data.compressed_size = tmpsize;
-        free(tmpbuf);
+      if (raw_format_ && FORMAT_BMP == image.data.format) {
+        uint32_t raw_size;
+        void *raw = bmp_to_raw(content.data(), content.size(), raw_format_,
+                               &raw_size);
+        if (!raw)
+          error("Unable to convert %s to raw pixels\n",
+                image.filename.c_str());
+        content.assign((const char *)raw, raw_size);
+        free(raw);
+        image.data.format = FORMAT_RAW;
       }
-      break;
-      case COMPRESS_LZMA1:
-      {
-        // Calculate the worst case of buffer size.
-        uint32_t tmpsize = lzma_stream_buffer_bound(content.size());
-        uint8_t *tmpbuf = (uint8_t *)malloc(tmpsize);
-        lzma_stream stream = LZMA_STREAM_INIT;
-        lzma_options_lzma options;
-        lzma_ret result;
-
-        lzma_lzma_preset(&options, 9);
-        result = lzma_alone_encoder(&stream, &options);
-        if (result != LZMA_OK) {
-          error("Unable to initialize easy encoder (error: %d)!\n", result);
-        }
+      image.raw_content = content;
+      image.data.original_size = content.size();
+      image_digest[i] = content_digest(content);
+
+      if (have_stamp && stamp.size == content.size() &&
+          stamp.mtime_sec < recent) {
+        stamp.digest = image_digest[i];
+        stamp.format = image.data.format;
+        stamp.width = image.data.width;
+        stamp.height = image.data.height;
+        index[path] = stamp;
+        index_changed = true;
+      }
+    }
 
-        stream.next_in = (uint8_t *)content.data();
-        stream.avail_in = content.size();
-        stream.next_out = tmpbuf;
-        stream.avail_out = tmpsize;
-        result = lzma_code(&stream, LZMA_FINISH);
-        if (result != LZMA_STREAM_END) {
-          error("Unable to encode data (error: %d)!\n", result);
+    // Images often share content, so only compress each distinct one once.
+    vector<CompressJob> jobs;
+    map<string, size_t> job_index;
+    vector<size_t> image_job(config_.image_names.size());
+    for (unsigned int i = 0; i < config_.image_names.size(); i++) {
+      map<string, size_t>::iterator found = job_index.find(image_digest[i]);
+      if (found == job_index.end()) {
+        CompressJob job;
+        job.content =
+          &config_.images_map[config_.image_names[i]].raw_content;
+        job.cached = false;
+        map<string, string>::iterator blob = blobs.find(image_digest[i]);
+        if (blob != blobs.end()) {
+          job.compressed = blob->second;
+          job.cached = true;
+        } else if (!cache_dir_.empty()) {
+          job.cache_filename = cache_filename(cache_dir_, image_digest[i],
+                                              compression_);
         }
-
-        it->second.data.compression = compression_;
-        it->second.compressed_content.assign((const char *)tmpbuf,
-                                             tmpsize - stream.avail_out);
-        it->second.data.compressed_size = tmpsize - stream.avail_out;
-        lzma_end(&stream);
-        free(tmpbuf);
+        found = job_index.insert(std::make_pair(image_digest[i],
+                                                jobs.size())).first;
+        jobs.push_back(job);
       }
-      break;
-      default:
-        error("Unsupported compression method attempted.\n");
+      image_job[i] = found->second;
+    }
+
+    // Anything compressed the same way by an earlier run needn't be redone.
+    vector<CompressJob> todo;
+    vector<size_t> todo_job;
+    for (size_t i = 0; i < jobs.size(); i++) {
+      if (jobs[i].cached)
+        continue;
+      if (!jobs[i].cache_filename.empty() &&
+          read_cache_file(jobs[i].cache_filename, jobs[i].compressed)) {
+        if (debug_)
+          printf("using cached %s\n", jobs[i].cache_filename.c_str());
+        continue;
       }
+      todo.push_back(jobs[i]);
+      todo_job.push_back(i);
+    }
+
+    // Compress the rest on all the CPUs; if a thread can't start, the ones
+    // that did (or this one) pick up its share.
+    CompressQueue queue;
+    queue.jobs = &todo;
+    queue.compression = compression_;
+    queue.next = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nthreads = cpus > 1 ? (size_t)cpus : 1;
+    if (nthreads > todo.size())
+      nthreads = todo.size();
+    vector<pthread_t> threads(nthreads);
+    size_t started = 0;
+    while (started < nthreads &&
+           !pthread_create(&threads[started], NULL, compress_worker, &queue))
+      started++;
+    compress_worker(&queue);
+    for (size_t i = 0; i < started; i++)
+      pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&queue.lock);
+
+    for (size_t i = 0; i < todo.size(); i++) {
+      CompressJob &job = jobs[todo_job[i]];
+      job.compressed = todo[i].compressed;
+      if (!job.cache_filename.empty())
+        write_cache_file(job.cache_filename, job.compressed);
     }
+
+    for (unsigned int i = 0; i < config_.image_names.size(); i++) {
+      ImageConfig &image = config_.images_map[config_.image_names[i]];
+      const CompressJob &job = jobs[image_job[i]];
+      image.data.compression = compression_;
+      image.compressed_content = job.compressed;
+      image.data.compressed_size = job.compressed.size();
+    }
+
+    // The index is only written once the compressed content it points to is.
+    if (index_changed)
+      write_source_index(source_index_filename(cache_dir_), index);
   }
 
   const string BmpBlockUtil::read_image_file(const char *filename) {
@@ -504,20 +914,39 @@ namespace vboot_reference {
       assert(config_.header.number_of_screenlayouts ==
              config_.localizations[i].size());
     }
-    config_.header.number_of_imageinfos = config_.images_map.size();
+    config_.header.number_of_imageinfos = 0;   // Filled by pack_bmpblock()
     config_.header.locale_string_offset = 0; // Filled by pack_bmpblock()
   }
 
   void BmpBlockUtil::pack_bmpblock() {
     bmpblock_.clear();
 
-    /* Compute the ImageInfo offsets from start of BMPBLOCK. */
+    /* Compute the ImageInfo offsets from start of BMPBLOCK.  Images with
+     * the same ImageInfo and content are only stored once, and all the
+     * ScreenLayouts using any of them point at that copy. */
     uint32_t current_offset = sizeof(BmpBlockHeader) +
       sizeof(ScreenLayout) * (config_.header.number_of_localizations *
                               config_.header.number_of_screenlayouts);
+    map<string, uint32_t> stored_offsets;
+    config_.header.number_of_imageinfos = 0;
     for (StrImageConfigMap::iterator it = config_.images_map.begin();
          it != config_.images_map.end();
          ++it) {
+      string key(reinterpret_cast<const char*>(&it->second.data),
+                 sizeof(it->second.data));
+      key += it->second.compressed_content;
+      map<string, uint32_t>::iterator stored = stored_offsets.find(key);
+      if (stored != stored_offsets.end()) {
+        it->second.offset = stored->second;
+        if (debug_)
+          printf("  \"%s\": filename=\"%s\" shares offset=0x%x\n",
+                 it->first.c_str(),
+                 it->second.filename.c_str(),
+                 it->second.offset);
+        continue;
+      }
+      stored_offsets[key] = current_offset;
+      config_.header.number_of_imageinfos++;
       it->second.offset = current_offset;
       if (debug_)
         printf("  \"%s\": filename=\"%s\" offset=0x%x tag=%d fmt=%d\n",
@@ -649,12 +1078,16 @@ namespace vboot_reference {
       "\n"
       "To create a new BMPBLOCK file using config from YAML file:\n"
       "\n"
-      "  %s [-z NUM] -c YAML BMPBLOCK\n"
+      "  %s [-z NUM] [-r FORMAT] [-C DIR] -c YAML BMPBLOCK\n"
       "\n"
       "    -z NUM  = compression algorithm to use\n"
       "              0 = none\n"
       "              1 = EFIv1\n"
       "              2 = LZMA1\n"
+      "              3 = RLE (cheapest to decode; best with -r)\n"
+      "    -r FORMAT = convert BMPs to raw pixels for the panel, so the\n"
+      "              firmware needn't decode them: xrgb8888, rgb888, rgb565\n"
+      "    -C DIR  = keep compressed images in DIR for later runs\n"
       "\n", prog_name);
     printf(
       "To display the contents of a BMPBLOCK:\n"
@@ -663,6 +1096,11 @@ namespace vboot_reference {
       "\n"
       "    -y  = display as yaml\n"
       "\n", prog_name);
+    printf(
+      "To show image sizes and decompression times in a BMPBLOCK:\n"
+      "\n"
+      "  %s -s BMPBLOCK\n"
+      "\n", prog_name);
     printf(
       "To unpack a BMPBLOCK file:\n"
       "\n"
@@ -685,10 +1123,12 @@ namespace vboot_reference {
     else
       prog_name = argv[0];
 
-    int overwrite = 0, extract_mode = 0;
+    int overwrite = 0, extract_mode = 0, stats_mode = 0;
     int compression = 0;
     int set_compression = 0;
     const char *config_fn = 0, *bmpblock_fn = 0, *extract_dir = ".";
+    const char *cache_dir = 0;
+    uint32_t raw_format = RAW_PIXEL_INVALID;
     int show_as_yaml = 0;
     bool debug = false;
 
@@ -696,14 +1136,20 @@ namespace vboot_reference {
     opterr = 0;                           // quiet
     int errorcnt = 0;
     char *e = 0;
-    while ((opt = getopt(argc, argv, ":c:xz:fd:yD")) != -1) {
+    while ((opt = getopt(argc, argv, ":c:C:xsz:r:fd:yD")) != -1) {
       switch (opt) {
       case 'c':
         config_fn = optarg;
         break;
+      case 'C':
+        cache_dir = optarg;
+        break;
       case 'x':
         extract_mode = 1;
         break;
+      case 's':
+        stats_mode = 1;
+        break;
       case 'y':
         show_as_yaml = 1;
         break;
@@ -721,6 +1167,19 @@ namespace vboot_reference {
         }
         set_compression = 1;
         break;
+      case 'r':
+        if (!strcmp(optarg, "xrgb8888")) {
+          raw_format = RAW_PIXEL_XRGB8888;
+        } else if (!strcmp(optarg, "rgb888")) {
+          raw_format = RAW_PIXEL_RGB888;
+        } else if (!strcmp(optarg, "rgb565")) {
+          raw_format = RAW_PIXEL_RGB565;
+        } else {
+          fprintf(stderr, "%s: unknown pixel format \"%s\"\n",
+                  prog_name, optarg);
+          errorcnt++;
+        }
+        break;
       case 'f':
         overwrite = 1;
         break;
@@ -760,12 +1219,18 @@ namespace vboot_reference {
     if (config_fn) {
       if (set_compression)
         util.force_compression(compression);
+      if (cache_dir)
+        util.set_cache_dir(cache_dir);
+      if (raw_format)
+        util.set_raw_format(raw_format);
       util.load_from_config(config_fn);
       util.pack_bmpblock();
       util.write_to_bmpblock(bmpblock_fn);
     }
 
-    else if (extract_mode) {
+    else if (stats_mode) {
+      return stats_bmpblock(bmpblock_fn);
+    } else if (extract_mode) {
       return dump_bmpblock(bmpblock_fn, 1, extract_dir, overwrite);
     } else {
       return dump_bmpblock(bmpblock_fn, show_as_yaml, 0, 0);
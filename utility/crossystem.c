@@ -5,9 +5,14 @@
  * Chrome OS firmware/system interface utility
  */
 
+#include <errno.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include "crossystem.h"
 
@@ -88,12 +93,20 @@ const Param sys_param_list[] = {
   {"tpm_fwver", 0, "Firmware version stored in TPM", "0x%08x"},
   {"tpm_kernver", 0, "Kernel version stored in TPM", "0x%08x"},
   {"tried_fwb", 0, "Tried firmware B before A this boot"},
+  {"vdat_crypto_stats", IS_STRING|NO_PRINT_ALL,
+   "Crypto work counts from VbSharedData (not in print-all)"},
   {"vdat_flags", 0, "Flags from VbSharedData", "0x%08x"},
   {"vdat_lfdebug", IS_STRING|NO_PRINT_ALL,
    "LoadFirmware() debug data (not in print-all)"},
   {"vdat_lkdebug", IS_STRING|NO_PRINT_ALL,
    "LoadKernel() debug data (not in print-all)"},
+  {"vdat_measurements", IS_STRING|NO_PRINT_ALL,
+   "Measured boot event log from VbSharedData (not in print-all)"},
   {"vdat_timers", IS_STRING, "Timer values from VbSharedData"},
+  {"vdat_timestamp_count", 0,
+   "Boot phase timestamps recorded in VbSharedData"},
+  {"vdat_timestamps", IS_STRING|NO_PRINT_ALL,
+   "Boot phase timestamps from VbSharedData (not in print-all)"},
   {"wpsw_boot", 0, "Firmware write protect hardware switch position at boot"},
   {"wpsw_cur", 0, "Firmware write protect hardware switch current position"},
   /* Terminate with null name */
@@ -115,9 +128,15 @@ void PrintHelp(const char *progname) {
          "    Sets the parameter(s) to the specified value(s).\n"
          "  %s [param1?value1] [param2?value2 [...]]]\n"
          "    Checks if the parameter(s) all contain the specified value(s).\n"
-         "Stops at the first error."
+         "Stops at the first error.\n"
+         "  %s --serve SOCKET\n"
+         "    Answers requests on a Unix socket, keeping firmware state\n"
+         "    loaded between them.  Each request is one line of params as\n"
+         "    above.  Each reply is a line with the exit status and the\n"
+         "    length of the output, then the output and a newline.\n"
          "\n"
-         "Valid parameters:\n", progname, progname, progname, progname);
+         "Valid parameters:\n", progname, progname, progname, progname,
+         progname);
   for (p = sys_param_list; p->name; p++)
     printf("  %-22s  %s\n", p->name, p->desc);
 }
@@ -179,21 +198,21 @@ int CheckParam(const Param* p, char* expect) {
 }
 
 
-/* Print the specified parameter.
+/* Print the specified parameter to [out].
  *
  * Returns 0 if success, non-zero if error. */
-int PrintParam(const Param* p) {
+int PrintParam(const Param* p, FILE* out) {
   if (p->flags & IS_STRING) {
     char buf[VB_MAX_STRING_PROPERTY];
     const char* v = VbGetSystemPropertyString(p->name, buf, sizeof(buf));
     if (!v)
       return 1;
-    printf("%s", v);
+    fprintf(out, "%s", v);
   } else {
     int v = VbGetSystemPropertyInt(p->name);
     if (v == -1)
       return 1;
-    printf(p->format ? p->format : "%d", v);
+    fprintf(out, p->format ? p->format : "%d", v);
   }
   return 0;
 }
@@ -230,10 +249,191 @@ int PrintAllParams(int force_all) {
 }
 
 
-int main(int argc, char* argv[]) {
+/* Get, set or check each of the [count] params in [args], printing values
+ * space-delimited to [out].  Stops at the first error.  Modifies [args].
+ *
+ * Returns 0 if success, 1 if a parameter couldn't be got, set or didn't
+ * match, or 2 if a parameter was poorly formed or unknown. */
+static int ProcessParams(int count, char* args[], FILE* out) {
   int retval = 0;
+  int batched = 0;
   int i;
 
+  /* Make all the NV storage changes with one read and write.  If that
+   * can't start, each set will just read and write for itself. */
+  for (i = 0; i < count; i++) {
+    if (strchr(args[i], '=')) {
+      batched = (0 == VbBeginSystemPropertyWrites());
+      break;
+    }
+  }
+
+  for (i = 0; i < count && retval == 0; i++) {
+    char* has_set = strchr(args[i], '=');
+    char* has_expect = strchr(args[i], '?');
+    char* name = strtok(args[i], "=?");
+    char* value = strtok(NULL, "=?");
+    const Param* p;
+
+    /* Make sure args are well-formed. '' or '=foo' or '?foo' not allowed. */
+    if (!name || has_set == args[i] || has_expect == args[i]) {
+      fprintf(stderr, "Poorly formed parameter\n");
+      retval = 2;
+      break;
+    }
+    if (!value)
+      value=""; /* Allow setting/checking an empty string ('foo=' or 'foo?') */
+    if (has_set && has_expect) {
+      fprintf(stderr, "Use either = or ? in a parameter, but not both.\n");
+      retval = 2;
+      break;
+    }
+
+    /* Find the parameter */
+    p = FindParam(name);
+    if (!p) {
+      fprintf(stderr, "Invalid parameter name: %s\n", name);
+      retval = 2;
+      break;
+    }
+
+    if (i > 0)
+      fprintf(out, " ");  /* Output params space-delimited */
+    if (has_set)
+      retval = SetParam(p, value);
+    else if (has_expect)
+      retval = CheckParam(p, value);
+    else
+      retval = PrintParam(p, out);
+  }
+
+  /* Like unbatched sets, keep the ones made before any error */
+  if (batched && 0 != VbCommitSystemPropertyWrites() && retval == 0)
+    retval = 1;
+
+  return retval;
+}
+
+
+/* Answer one client on [fd] until it hangs up. */
+static void ServeClient(int fd) {
+  /* Separate streams, since stdio can't switch a socket between read and
+   * write */
+  FILE* in = fdopen(fd, "r");
+  FILE* f = NULL;
+  char* line = NULL;
+  size_t line_size = 0;
+  char* args[256];
+  char* out;
+  size_t out_size;
+
+  if (in) {
+    int fd2 = dup(fd);
+    if (fd2 >= 0) {
+      f = fdopen(fd2, "w");
+      if (!f)
+        close(fd2);
+    }
+  }
+  if (!f) {
+    if (in)
+      fclose(in);
+    else
+      close(fd);
+    return;
+  }
+
+  while (getline(&line, &line_size, in) > 0) {
+    FILE* o = open_memstream(&out, &out_size);
+    int count = 0;
+    char* save;
+    char* arg;
+    int rv;
+
+    if (!o)
+      break;
+
+    for (arg = strtok_r(line, " \t\r\n", &save); arg;
+         arg = strtok_r(NULL, " \t\r\n", &save)) {
+      if (count == sizeof(args) / sizeof(args[0]))
+        break;
+      args[count++] = arg;
+    }
+
+    if (arg) {
+      fprintf(stderr, "Too many parameters\n");
+      rv = 2;
+    } else {
+      /* Something else may have written NV storage since the last request */
+      VbInvalidateSystemPropertyCache();
+      rv = ProcessParams(count, args, o);
+    }
+    fclose(o);
+
+    /* Values may span lines, so say how long the output is */
+    fprintf(f, "%d %zu\n", rv, out_size);
+    fwrite(out, 1, out_size, f);
+    fputc('\n', f);
+    free(out);
+    if (fflush(f))
+      break;
+  }
+
+  free(line);
+  fclose(f);
+  fclose(in);
+}
+
+
+/* Serve requests on the Unix socket at [path] until killed.
+ *
+ * Returns non-zero on error; doesn't return otherwise. */
+static int Serve(const char* path) {
+  struct sockaddr_un addr;
+  int sock;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path);
+    return 1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0) {
+    perror("socket");
+    return 1;
+  }
+  unlink(path);
+  if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) ||
+      listen(sock, 16)) {
+    fprintf(stderr, "Can't listen on %s: %s\n", path, strerror(errno));
+    close(sock);
+    return 1;
+  }
+
+  /* A client hanging up mid-reply mustn't kill us */
+  signal(SIGPIPE, SIG_IGN);
+
+  /* One client at a time, so requests never race each other's NV writes */
+  for (;;) {
+    int fd = accept(sock, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("accept");
+      close(sock);
+      return 1;
+    }
+    ServeClient(fd);
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  int retval;
+
   char* progname = strrchr(argv[0], '/');
   if (progname)
     progname++;
@@ -258,44 +458,20 @@ int main(int argc, char* argv[]) {
     return 0;
   }
 
-  /* Otherwise, loop through params and get/set them */
-  for (i = 1; i < argc && retval == 0; i++) {
-    char* has_set = strchr(argv[i], '=');
-    char* has_expect = strchr(argv[i], '?');
-    char* name = strtok(argv[i], "=?");
-    char* value = strtok(NULL, "=?");
-    const Param* p;
-
-    /* Make sure args are well-formed. '' or '=foo' or '?foo' not allowed. */
-    if (!name || has_set == argv[i] || has_expect == argv[i]) {
-      fprintf(stderr, "Poorly formed parameter\n");
-      PrintHelp(progname);
-      return 1;
-    }
-    if (!value)
-      value=""; /* Allow setting/checking an empty string ('foo=' or 'foo?') */
-    if (has_set && has_expect) {
-      fprintf(stderr, "Use either = or ? in a parameter, but not both.\n");
-      PrintHelp(progname);
-      return 1;
-    }
-
-    /* Find the parameter */
-    p = FindParam(name);
-    if (!p) {
-      fprintf(stderr, "Invalid parameter name: %s\n", name);
+  /* Serve requests from a socket */
+  if (!strcasecmp(argv[1], "--serve")) {
+    if (argc != 3) {
       PrintHelp(progname);
       return 1;
     }
+    return Serve(argv[2]);
+  }
 
-    if (i > 1)
-      printf(" ");  /* Output params space-delimited */
-    if (has_set)
-      retval = SetParam(p, value);
-    else if (has_expect)
-      retval = CheckParam(p, value);
-    else
-      retval = PrintParam(p);
+  /* Otherwise, loop through params and get/set them */
+  retval = ProcessParams(argc - 1, argv + 1, stdout);
+  if (retval == 2) {
+    PrintHelp(progname);
+    return 1;
   }
 
   return retval;
@@ -26,6 +26,11 @@ Abstract:
   This sequence is further divided into Blocks and Huffman codings
   are applied to each Block.
 
+  Repeated strings are found with hash chains over the last WNDSIZ
+  bytes of the source; how far each chain is followed is set by the
+  effort level. All state is kept in a COMPRESS_DATA allocated for
+  each call, so several compressions can run at once.
+
 --*/
 
 #include <errno.h>
@@ -44,20 +49,18 @@ Abstract:
 // Macro Definitions
 //
 
-typedef INT16             NODE;
 #define UINT8_BIT         8
 #define THRESHOLD         3
-#define INIT_CRC          0
 #define WNDBIT            13
 #define WNDSIZ            (1U << WNDBIT)
 #define MAXMATCH          256
-#define PERC_FLAG         0x8000U
 #define CODE_BIT          16
-#define NIL               0
-#define MAX_HASH_VAL      (3 * WNDSIZ + (WNDSIZ / 512 + 1) * UINT8_MAX)
-#define HASH(p, c)        ((p) + ((c) << (WNDBIT - 9)) + WNDSIZ * 2)
-#define CRCPOLY           0xA001
-#define UPDATE_CRC(c)     mCrc = mCrcTable[(mCrc ^ (c)) & 0xFF] ^ (mCrc >> UINT8_BIT)
+#define NIL               (-1)
+#define HASHBIT           15
+#define HASHSIZ           (1U << HASHBIT)
+#define HASH(p)           ((((UINT32)(p)[0] << 10) ^ ((UINT32)(p)[1] << 5) ^ \
+                            (UINT32)(p)[2]) & (HASHSIZ - 1))
+#define BLOCK_BUFSIZ      (16 * 1024U)
 
 //
 // C: the Char&Len Set; P: the Position Set; T: the exTra Set
@@ -76,212 +79,272 @@ typedef INT16             NODE;
 #endif
 
 //
-// Function Prototypes
+// How hard each effort level looks for matches: the most earlier
+// positions tried, and a match length that is good enough to stop at.
 //
 
-STATIC
-VOID
-PutDword(
-  IN UINT32 Data
-  );
-
-STATIC
-EFI_STATUS
-AllocateMemory (
-  );
+typedef struct {
+  UINT32  mMaxChain;
+  UINT32  mNiceLen;
+} COMPRESS_LEVEL;
+
+STATIC const COMPRESS_LEVEL mLevels[EFI_COMPRESS_LEVEL_MAX] = {
+  {    4,   8 },
+  {    8,  16 },
+  {   16,  32 },
+  {   32,  64 },
+  {   64, 128 },
+  {  128, MAXMATCH },
+  {  256, MAXMATCH },
+  { 1024, MAXMATCH },
+  { 4096, MAXMATCH },
+};
+
+typedef struct {
+  UINT8   *mSrc;          // Source data, and where it ends
+  UINT8   *mSrcUpperLimit;
+  UINT8   *mDst;          // Next byte of compressed data, and where it ends
+  UINT8   *mDstUpperLimit;
+  UINT32  mCompSize;
+  UINT32  mOrigSize;
 
-STATIC
-VOID
-FreeMemory (
-  );
+  //
+  // Match finder: the latest position with each hash, and for each
+  // position in the window the previous one with the same hash.
+  //
+  INT32   mHead[HASHSIZ];
+  INT32   mPrev[WNDSIZ];
+  UINT32  mMaxChain;
+  UINT32  mNiceLen;
+  INT32   mMatchLen;
+  INT32   mMatchPos;
 
-STATIC
-VOID
-InitSlide (
-  );
+  //
+  // Huffman coding of the current block
+  //
+  UINT8   mBuf[BLOCK_BUFSIZ];
+  UINT32  mOutputPos;
+  UINT32  mOutputMask;
+  UINT32  mCPos;
+  UINT32  mSubBitBuf;
+  INT32   mBitCount;
+
+  UINT8   mCLen[NC];
+  UINT8   mPTLen[NPT];
+  UINT8   *mLen;
+  INT16   mHeap[NC + 1];
+  INT32   mHeapSize;
+  INT32   mN;
+  INT32   mDepth;
+  UINT16  *mFreq;
+  UINT16  *mSortPtr;
+  UINT16  mLenCnt[17];
+  UINT16  mLeft[2 * NC - 1];
+  UINT16  mRight[2 * NC - 1];
+  UINT16  mCFreq[2 * NC - 1];
+  UINT16  mCCode[NC];
+  UINT16  mPFreq[2 * NP - 1];
+  UINT16  mPTCode[NPT];
+  UINT16  mTFreq[2 * NT - 1];
+} COMPRESS_DATA;
 
-STATIC
-NODE
-Child (
-  IN NODE q,
-  IN UINT8 c
-  );
+//
+// Function Prototypes
+//
 
 STATIC
 VOID
-MakeChild (
-  IN NODE q,
-  IN UINT8 c,
-  IN NODE r
+PutDword(
+  IN COMPRESS_DATA  *Cd,
+  IN UINT32         Data
   );
 
 STATIC
 VOID
-Split (
-  IN NODE Old
+InitSlide (
+  IN COMPRESS_DATA  *Cd
   );
 
 STATIC
 VOID
-InsertNode (
+FindMatch (
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          Pos
   );
 
 STATIC
 VOID
-DeleteNode (
+InsertPos (
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          Pos
   );
 
 STATIC
 VOID
-GetNextMatch (
-  );
-
-STATIC
-EFI_STATUS
 Encode (
+  IN COMPRESS_DATA  *Cd
   );
 
 STATIC
 VOID
 CountTFreq (
+  IN COMPRESS_DATA  *Cd
   );
 
 STATIC
 VOID
 WritePTLen (
-  IN INT32 n,
-  IN INT32 nbit,
-  IN INT32 Special
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          n,
+  IN INT32          nbit,
+  IN INT32          Special
   );
 
 STATIC
 VOID
 WriteCLen (
+  IN COMPRESS_DATA  *Cd
   );
 
 STATIC
 VOID
 EncodeC (
-  IN INT32 c
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          c
   );
 
 STATIC
 VOID
 EncodeP (
-  IN UINT32 p
+  IN COMPRESS_DATA  *Cd,
+  IN UINT32         p
   );
 
 STATIC
 VOID
 SendBlock (
+  IN COMPRESS_DATA  *Cd
   );
 
 STATIC
 VOID
 Output (
-  IN UINT32 c,
-  IN UINT32 p
+  IN COMPRESS_DATA  *Cd,
+  IN UINT32         c,
+  IN UINT32         p
   );
 
 STATIC
 VOID
 HufEncodeStart (
+  IN COMPRESS_DATA  *Cd
   );
 
 STATIC
 VOID
 HufEncodeEnd (
-  );
-
-STATIC
-VOID
-MakeCrcTable (
+  IN COMPRESS_DATA  *Cd
   );
 
 STATIC
 VOID
 PutBits (
-  IN INT32 n,
-  IN UINT32 x
-  );
-
-STATIC
-INT32
-FreadCrc (
-  OUT UINT8 *p,
-  IN  INT32 n
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          n,
+  IN UINT32         x
   );
 
 STATIC
 VOID
 InitPutBits (
+  IN COMPRESS_DATA  *Cd
   );
 
 STATIC
 VOID
 CountLen (
-  IN INT32 i
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          i
   );
 
 STATIC
 VOID
 MakeLen (
-  IN INT32 Root
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          Root
   );
 
 STATIC
 VOID
 DownHeap (
-  IN INT32 i
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          i
   );
 
 STATIC
 VOID
 MakeCode (
-  IN  INT32 n,
-  IN  UINT8 Len[],
-  OUT UINT16 Code[]
+  IN  COMPRESS_DATA *Cd,
+  IN  INT32         n,
+  IN  UINT8         Len[],
+  OUT UINT16        Code[]
   );
 
 STATIC
 INT32
 MakeTree (
-  IN  INT32   NParm,
-  IN  UINT16  FreqParm[],
-  OUT UINT8   LenParm[],
-  OUT UINT16  CodeParm[]
+  IN  COMPRESS_DATA *Cd,
+  IN  INT32         NParm,
+  IN  UINT16        FreqParm[],
+  OUT UINT8         LenParm[],
+  OUT UINT16        CodeParm[]
   );
 
 
 //
-//  Global Variables
+// functions
 //
 
-STATIC UINT8  *mSrc, *mDst, *mSrcUpperLimit, *mDstUpperLimit;
+EFI_STATUS
+EfiCompress (
+  IN      UINT8   *SrcBuffer,
+  IN      UINT32  SrcSize,
+  IN      UINT8   *DstBuffer,
+  IN OUT  UINT32  *DstSize
+  )
+/*++
 
-STATIC UINT8  *mLevel, *mText, *mChildCount, *mBuf, mCLen[NC], mPTLen[NPT], *mLen;
-STATIC INT16  mHeap[NC + 1];
-STATIC INT32  mRemainder, mMatchLen, mBitCount, mHeapSize, mN;
-STATIC UINT32 mBufSiz = 0, mOutputPos, mOutputMask, mSubBitBuf, mCrc;
-STATIC UINT32 mCompSize, mOrigSize;
+Routine Description:
 
-STATIC UINT16 *mFreq, *mSortPtr, mLenCnt[17], mLeft[2 * NC - 1], mRight[2 * NC - 1],
-              mCrcTable[UINT8_MAX + 1], mCFreq[2 * NC - 1], mCCode[NC],
-              mPFreq[2 * NP - 1], mPTCode[NPT], mTFreq[2 * NT - 1];
+  The main compression routine, at the default effort level.
 
-STATIC NODE   mPos, mMatchPos, mAvail, *mPosition, *mParent, *mPrev, *mNext = NULL;
+Arguments:
 
+  SrcBuffer   - The buffer storing the source data
+  SrcSize     - The size of source data
+  DstBuffer   - The buffer to store the compressed data
+  DstSize     - On input, the size of DstBuffer; On output,
+                the size of the actual compressed data.
 
-//
-// functions
-//
+Returns:
+
+  EFI_BUFFER_TOO_SMALL  - The DstBuffer is too small. In this case,
+                DstSize contains the size needed.
+  EFI_SUCCESS           - Compression is successful.
+
+--*/
+{
+  return EfiCompressLevel(SrcBuffer, SrcSize, DstBuffer, DstSize,
+                          EFI_COMPRESS_LEVEL_DEFAULT);
+}
 
 EFI_STATUS
-EfiCompress (
+EfiCompressLevel (
   IN      UINT8   *SrcBuffer,
   IN      UINT32  SrcSize,
   IN      UINT8   *DstBuffer,
-  IN OUT  UINT32  *DstSize
+  IN OUT  UINT32  *DstSize,
+  IN      UINT32  Level
   )
 /*++
 
@@ -296,76 +359,79 @@ Arguments:
   DstBuffer   - The buffer to store the compressed data
   DstSize     - On input, the size of DstBuffer; On output,
                 the size of the actual compressed data.
+  Level       - Effort level, from EFI_COMPRESS_LEVEL_MIN (fastest)
+                to EFI_COMPRESS_LEVEL_MAX (smallest output)
 
 Returns:
 
   EFI_BUFFER_TOO_SMALL  - The DstBuffer is too small. In this case,
                 DstSize contains the size needed.
+  EFI_INVALID_PARAMETER - The Level is out of range.
+  EFI_OUT_OF_RESOURCES  - Not enough memory for compression process.
   EFI_SUCCESS           - Compression is successful.
 
 --*/
 {
-  EFI_STATUS Status = EFI_SUCCESS;
+  COMPRESS_DATA *Cd;
+  UINT32        CompSize;
+
+  if (Level < EFI_COMPRESS_LEVEL_MIN || Level > EFI_COMPRESS_LEVEL_MAX) {
+    return EFI_INVALID_PARAMETER;
+  }
 
   //
   // Initializations
   //
-  mBufSiz = 0;
-  mBuf = NULL;
-  mText       = NULL;
-  mLevel      = NULL;
-  mChildCount = NULL;
-  mPosition   = NULL;
-  mParent     = NULL;
-  mPrev       = NULL;
-  mNext       = NULL;
-
-
-  mSrc = SrcBuffer;
-  mSrcUpperLimit = mSrc + SrcSize;
-  mDst = DstBuffer;
-  mDstUpperLimit = mDst + *DstSize;
+  Cd = malloc (sizeof(*Cd));
+  if (Cd == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
 
-  PutDword(0L);
-  PutDword(0L);
+  Cd->mSrc = SrcBuffer;
+  Cd->mSrcUpperLimit = SrcBuffer + SrcSize;
+  Cd->mDst = DstBuffer;
+  Cd->mDstUpperLimit = DstBuffer + *DstSize;
+  Cd->mMaxChain = mLevels[Level - 1].mMaxChain;
+  Cd->mNiceLen = mLevels[Level - 1].mNiceLen;
 
-  MakeCrcTable ();
+  PutDword(Cd, 0L);
+  PutDword(Cd, 0L);
 
-  mOrigSize = mCompSize = 0;
-  mCrc = INIT_CRC;
+  Cd->mOrigSize = SrcSize;
+  Cd->mCompSize = 0;
 
   //
   // Compress it
   //
 
-  Status = Encode();
-  if (EFI_ERROR (Status)) {
-    return EFI_OUT_OF_RESOURCES;
-  }
+  Encode(Cd);
 
   //
   // Null terminate the compressed data
   //
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = 0;
+  if (Cd->mDst < Cd->mDstUpperLimit) {
+    *Cd->mDst++ = 0;
   }
 
   //
   // Fill in compressed size and original size
   //
-  mDst = DstBuffer;
-  PutDword(mCompSize+1);
-  PutDword(mOrigSize);
+  Cd->mDst = DstBuffer;
+  PutDword(Cd, Cd->mCompSize+1);
+  PutDword(Cd, Cd->mOrigSize);
+
+  CompSize = Cd->mCompSize;
+  free (Cd);
 
   //
   // Return
   //
 
-  if (mCompSize + 1 + 8 > *DstSize) {
-    *DstSize = mCompSize + 1 + 8;
+  if (CompSize + 1 + 8 > *DstSize) {
+    *DstSize = CompSize + 1 + 8;
     return EFI_BUFFER_TOO_SMALL;
   } else {
-    *DstSize = mCompSize + 1 + 8;
+    *DstSize = CompSize + 1 + 8;
     return EFI_SUCCESS;
   }
 
@@ -374,7 +440,8 @@ Returns:
 STATIC
 VOID
 PutDword(
-  IN UINT32 Data
+  IN COMPRESS_DATA  *Cd,
+  IN UINT32         Data
   )
 /*++
 
@@ -384,571 +451,228 @@ Routine Description:
 
 Arguments:
 
+  Cd      - the compression state
   Data    - the dword to put
 
 Returns: (VOID)
 
 --*/
 {
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8)(((UINT8)(Data        )) & 0xff);
+  if (Cd->mDst < Cd->mDstUpperLimit) {
+    *Cd->mDst++ = (UINT8)(((UINT8)(Data        )) & 0xff);
   }
 
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8)(((UINT8)(Data >> 0x08)) & 0xff);
+  if (Cd->mDst < Cd->mDstUpperLimit) {
+    *Cd->mDst++ = (UINT8)(((UINT8)(Data >> 0x08)) & 0xff);
   }
 
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8)(((UINT8)(Data >> 0x10)) & 0xff);
+  if (Cd->mDst < Cd->mDstUpperLimit) {
+    *Cd->mDst++ = (UINT8)(((UINT8)(Data >> 0x10)) & 0xff);
   }
 
-  if (mDst < mDstUpperLimit) {
-    *mDst++ = (UINT8)(((UINT8)(Data >> 0x18)) & 0xff);
+  if (Cd->mDst < Cd->mDstUpperLimit) {
+    *Cd->mDst++ = (UINT8)(((UINT8)(Data >> 0x18)) & 0xff);
   }
 }
 
 STATIC
-EFI_STATUS
-AllocateMemory ()
-/*++
-
-Routine Description:
-
-  Allocate memory spaces for data structures used in compression process
-
-Argements: (VOID)
-
-Returns:
-
-  EFI_SUCCESS           - Memory is allocated successfully
-  EFI_OUT_OF_RESOURCES  - Allocation fails
-
---*/
-{
-  UINT32      i;
-
-  mText       = malloc (WNDSIZ * 2 + MAXMATCH);
-  for (i = 0 ; i < WNDSIZ * 2 + MAXMATCH; i ++) {
-    mText[i] = 0;
-  }
-
-  mLevel      = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof(*mLevel));
-  mChildCount = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof(*mChildCount));
-  mPosition   = malloc ((WNDSIZ + UINT8_MAX + 1) * sizeof(*mPosition));
-  mParent     = malloc (WNDSIZ * 2 * sizeof(*mParent));
-  mPrev       = malloc (WNDSIZ * 2 * sizeof(*mPrev));
-  mNext       = malloc ((MAX_HASH_VAL + 1) * sizeof(*mNext));
-
-  mBufSiz = 16 * 1024U;
-  while ((mBuf = malloc(mBufSiz)) == NULL) {
-    mBufSiz = (mBufSiz / 10U) * 9U;
-    if (mBufSiz < 4 * 1024U) {
-      return EFI_OUT_OF_RESOURCES;
-    }
-  }
-  mBuf[0] = 0;
-
-  return EFI_SUCCESS;
-}
-
 VOID
-FreeMemory ()
-/*++
-
-Routine Description:
-
-  Called when compression is completed to free memory previously allocated.
-
-Arguments: (VOID)
-
-Returns: (VOID)
-
---*/
-{
-  if (mText) {
-    free (mText);
-  }
-
-  if (mLevel) {
-    free (mLevel);
-  }
-
-  if (mChildCount) {
-    free (mChildCount);
-  }
-
-  if (mPosition) {
-    free (mPosition);
-  }
-
-  if (mParent) {
-    free (mParent);
-  }
-
-  if (mPrev) {
-    free (mPrev);
-  }
-
-  if (mNext) {
-    free (mNext);
-  }
-
-  if (mBuf) {
-    free (mBuf);
-  }
-
-  return;
-}
-
-
-STATIC
-VOID
-InitSlide ()
-/*++
-
-Routine Description:
-
-  Initialize String Info Log data structures
-
-Arguments: (VOID)
-
-Returns: (VOID)
-
---*/
-{
-  NODE i;
-
-  for (i = WNDSIZ; i <= WNDSIZ + UINT8_MAX; i++) {
-    mLevel[i] = 1;
-    mPosition[i] = NIL;  /* sentinel */
-  }
-  for (i = WNDSIZ; i < WNDSIZ * 2; i++) {
-    mParent[i] = NIL;
-  }
-  mAvail = 1;
-  for (i = 1; i < WNDSIZ - 1; i++) {
-    mNext[i] = (NODE)(i + 1);
-  }
-
-  mNext[WNDSIZ - 1] = NIL;
-  for (i = WNDSIZ * 2; i <= MAX_HASH_VAL; i++) {
-    mNext[i] = NIL;
-  }
-}
-
-
-STATIC
-NODE
-Child (
-  IN NODE q,
-  IN UINT8 c
+InitSlide (
+  IN COMPRESS_DATA  *Cd
   )
 /*++
 
 Routine Description:
 
-  Find child node given the parent node and the edge character
+  Initialize the match finder with no earlier positions
 
 Arguments:
 
-  q       - the parent node
-  c       - the edge character
-
-Returns:
+  Cd      - the compression state
 
-  The child node (NIL if not found)
+Returns: (VOID)
 
 --*/
 {
-  NODE r;
+  UINT32 i;
 
-  r = mNext[HASH(q, c)];
-  mParent[NIL] = q;  /* sentinel */
-  while (mParent[r] != q) {
-    r = mNext[r];
+  for (i = 0; i < HASHSIZ; i++) {
+    Cd->mHead[i] = NIL;
   }
-
-  return r;
 }
 
 STATIC
 VOID
-MakeChild (
-  IN NODE q,
-  IN UINT8 c,
-  IN NODE r
+InsertPos (
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          Pos
   )
 /*++
 
 Routine Description:
 
-  Create a new child for a given parent node.
+  Add a source position to the hash chains, without looking for a match.
 
 Arguments:
 
-  q       - the parent node
-  c       - the edge character
-  r       - the child node
+  Cd      - the compression state
+  Pos     - the source position
 
 Returns: (VOID)
 
 --*/
 {
-  NODE h, t;
-
-  h = (NODE)HASH(q, c);
-  t = mNext[h];
-  mNext[h] = r;
-  mNext[r] = t;
-  mPrev[t] = r;
-  mPrev[r] = h;
-  mParent[r] = q;
-  mChildCount[q]++;
+  UINT32 h;
+
+  if (Cd->mSrc + Pos + THRESHOLD > Cd->mSrcUpperLimit) {
+    return;
+  }
+  h = HASH(Cd->mSrc + Pos);
+  Cd->mPrev[Pos & (WNDSIZ - 1)] = Cd->mHead[h];
+  Cd->mHead[h] = Pos;
 }
 
 STATIC
 VOID
-Split (
-  NODE Old
+FindMatch (
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          Pos
   )
 /*++
 
 Routine Description:
 
-  Split a node.
+  Find the longest earlier string matching the one at a source position,
+  then add the position to the hash chains. The result is left in
+  mMatchLen and mMatchPos; mMatchLen is below THRESHOLD if there is
+  no useful match.
 
 Arguments:
 
-  Old     - the node to split
-
-Returns: (VOID)
-
---*/
-{
-  NODE New, t;
-
-  New = mAvail;
-  mAvail = mNext[New];
-  mChildCount[New] = 0;
-  t = mPrev[Old];
-  mPrev[New] = t;
-  mNext[t] = New;
-  t = mNext[Old];
-  mNext[New] = t;
-  mPrev[t] = New;
-  mParent[New] = mParent[Old];
-  mLevel[New] = (UINT8)mMatchLen;
-  mPosition[New] = mPos;
-  MakeChild(New, mText[mMatchPos + mMatchLen], Old);
-  MakeChild(New, mText[mPos + mMatchLen], mPos);
-}
-
-STATIC
-VOID
-InsertNode ()
-/*++
-
-Routine Description:
-
-  Insert string info for current position into the String Info Log
-
-Arguments: (VOID)
+  Cd      - the compression state
+  Pos     - the source position
 
 Returns: (VOID)
 
 --*/
 {
-  NODE q, r, j, t;
-  UINT8 c, *t1, *t2;
+  UINT8   *Cur, *Cand;
+  INT32   MaxLen, Len, Prev;
+  UINT32  Chain;
 
-  if (mMatchLen >= 4) {
-
-    //
-    // We have just got a long match, the target tree
-    // can be located by MatchPos + 1. Travese the tree
-    // from bottom up to get to a proper starting point.
-    // The usage of PERC_FLAG ensures proper node deletion
-    // in DeleteNode() later.
-    //
-
-    mMatchLen--;
-    r = (INT16)((mMatchPos + 1) | WNDSIZ);
-    while ((q = mParent[r]) == NIL) {
-      r = mNext[r];
-    }
-    while (mLevel[q] >= mMatchLen) {
-      r = q;  q = mParent[q];
-    }
-    t = q;
-    while (mPosition[t] < 0) {
-      mPosition[t] = mPos;
-      t = mParent[t];
-    }
-    if (t < WNDSIZ) {
-      mPosition[t] = (NODE)(mPos | PERC_FLAG);
-    }
-  } else {
-
-    //
-    // Locate the target tree
-    //
-
-    q = (INT16)(mText[mPos] + WNDSIZ);
-    c = mText[mPos + 1];
-    if ((r = Child(q, c)) == NIL) {
-      MakeChild(q, c, mPos);
-      mMatchLen = 1;
-      return;
-    }
-    mMatchLen = 2;
+  Cd->mMatchLen = 0;
+  MaxLen = (INT32)(Cd->mSrcUpperLimit - (Cd->mSrc + Pos));
+  if (MaxLen > MAXMATCH) {
+    MaxLen = MAXMATCH;
   }
+  if (MaxLen < THRESHOLD) {
+    return;
+  }
+
+  Cur = Cd->mSrc + Pos;
+  Prev = Cd->mHead[HASH(Cur)];
+  Chain = Cd->mMaxChain;
 
   //
-  // Traverse down the tree to find a match.
-  // Update Position value along the route.
-  // Node split or creation is involved.
+  // Positions further back than the window can't be pointed to, and
+  // their entries in mPrev have been reused.
   //
-
-  for ( ; ; ) {
-    if (r >= WNDSIZ) {
-      j = MAXMATCH;
-      mMatchPos = r;
-    } else {
-      j = mLevel[r];
-      mMatchPos = (NODE)(mPosition[r] & ~PERC_FLAG);
-    }
-    if (mMatchPos >= mPos) {
-      mMatchPos -= WNDSIZ;
-    }
-    t1 = &mText[mPos + mMatchLen];
-    t2 = &mText[mMatchPos + mMatchLen];
-    while (mMatchLen < j) {
-      if (*t1 != *t2) {
-        Split(r);
-        return;
+  while (Prev != NIL && Pos - Prev < (INT32)WNDSIZ && Chain-- > 0) {
+    Cand = Cd->mSrc + Prev;
+    if (Cand[Cd->mMatchLen] == Cur[Cd->mMatchLen] && Cand[0] == Cur[0]) {
+      Len = 1;
+      while (Len < MaxLen && Cand[Len] == Cur[Len]) {
+        Len++;
+      }
+      if (Len > Cd->mMatchLen) {
+        Cd->mMatchLen = Len;
+        Cd->mMatchPos = Prev;
+        if (Len >= MaxLen || Len >= (INT32)Cd->mNiceLen) {
+          break;
+        }
       }
-      mMatchLen++;
-      t1++;
-      t2++;
-    }
-    if (mMatchLen >= MAXMATCH) {
-      break;
-    }
-    mPosition[r] = mPos;
-    q = r;
-    if ((r = Child(q, *t1)) == NIL) {
-      MakeChild(q, *t1, mPos);
-      return;
     }
-    mMatchLen++;
-  }
-  t = mPrev[r];
-  mPrev[mPos] = t;
-  mNext[t] = mPos;
-  t = mNext[r];
-  mNext[mPos] = t;
-  mPrev[t] = mPos;
-  mParent[mPos] = q;
-  mParent[r] = NIL;
-
-  //
-  // Special usage of 'next'
-  //
-  mNext[r] = mPos;
-
-}
-
-STATIC
-VOID
-DeleteNode ()
-/*++
-
-Routine Description:
-
-  Delete outdated string info. (The Usage of PERC_FLAG
-  ensures a clean deletion)
-
-Arguments: (VOID)
-
-Returns: (VOID)
-
---*/
-{
-  NODE q, r, s, t, u;
-
-  if (mParent[mPos] == NIL) {
-    return;
+    Prev = Cd->mPrev[Prev & (WNDSIZ - 1)];
   }
 
-  r = mPrev[mPos];
-  s = mNext[mPos];
-  mNext[r] = s;
-  mPrev[s] = r;
-  r = mParent[mPos];
-  mParent[mPos] = NIL;
-  if (r >= WNDSIZ || --mChildCount[r] > 1) {
-    return;
-  }
-  t = (NODE)(mPosition[r] & ~PERC_FLAG);
-  if (t >= mPos) {
-    t -= WNDSIZ;
-  }
-  s = t;
-  q = mParent[r];
-  while ((u = mPosition[q]) & PERC_FLAG) {
-    u &= ~PERC_FLAG;
-    if (u >= mPos) {
-      u -= WNDSIZ;
-    }
-    if (u > s) {
-      s = u;
-    }
-    mPosition[q] = (INT16)(s | WNDSIZ);
-    q = mParent[q];
-  }
-  if (q < WNDSIZ) {
-    if (u >= mPos) {
-      u -= WNDSIZ;
-    }
-    if (u > s) {
-      s = u;
-    }
-    mPosition[q] = (INT16)(s | WNDSIZ | PERC_FLAG);
-  }
-  s = Child(r, mText[t + mLevel[r]]);
-  t = mPrev[s];
-  u = mNext[s];
-  mNext[t] = u;
-  mPrev[u] = t;
-  t = mPrev[r];
-  mNext[t] = s;
-  mPrev[s] = t;
-  t = mNext[r];
-  mPrev[t] = s;
-  mNext[s] = t;
-  mParent[s] = mParent[r];
-  mParent[r] = NIL;
-  mNext[r] = mAvail;
-  mAvail = r;
+  InsertPos(Cd, Pos);
 }
 
 STATIC
 VOID
-GetNextMatch ()
-/*++
-
-Routine Description:
-
-  Advance the current position (read in new data if needed).
-  Delete outdated string info. Find a match string for current position.
-
-Arguments: (VOID)
-
-Returns: (VOID)
-
---*/
-{
-  INT32 n;
-
-  mRemainder--;
-  if (++mPos == WNDSIZ * 2) {
-    memmove(&mText[0], &mText[WNDSIZ], WNDSIZ + MAXMATCH);
-    n = FreadCrc(&mText[WNDSIZ + MAXMATCH], WNDSIZ);
-    mRemainder += n;
-    mPos = WNDSIZ;
-  }
-  DeleteNode();
-  InsertNode();
-}
-
-STATIC
-EFI_STATUS
-Encode ()
+Encode (
+  IN COMPRESS_DATA  *Cd
+  )
 /*++
 
 Routine Description:
 
   The main controlling routine for compression process.
 
-Arguments: (VOID)
+Arguments:
 
-Returns:
+  Cd      - the compression state
 
-  EFI_SUCCESS           - The compression is successful
-  EFI_OUT_0F_RESOURCES  - Not enough memory for compression process
+Returns: (VOID)
 
 --*/
 {
-  EFI_STATUS  Status;
+  INT32       Pos, SrcSize;
   INT32       LastMatchLen;
-  NODE        LastMatchPos;
-
-  Status = AllocateMemory();
-  if (EFI_ERROR(Status)) {
-    FreeMemory();
-    return Status;
-  }
-
-  InitSlide();
+  INT32       LastMatchPos;
 
-  HufEncodeStart();
+  InitSlide(Cd);
 
-  mRemainder = FreadCrc(&mText[WNDSIZ], WNDSIZ + MAXMATCH);
+  HufEncodeStart(Cd);
 
-  mMatchLen = 0;
-  mPos = WNDSIZ;
-  InsertNode();
-  if (mMatchLen > mRemainder) {
-    mMatchLen = mRemainder;
-  }
-  while (mRemainder > 0) {
-    LastMatchLen = mMatchLen;
-    LastMatchPos = mMatchPos;
-    GetNextMatch();
-    if (mMatchLen > mRemainder) {
-      mMatchLen = mRemainder;
-    }
+  SrcSize = (INT32)(Cd->mSrcUpperLimit - Cd->mSrc);
+  Pos = 0;
+  FindMatch(Cd, Pos);
+  while (Pos < SrcSize) {
+    LastMatchLen = Cd->mMatchLen;
+    LastMatchPos = Cd->mMatchPos;
+    FindMatch(Cd, ++Pos);
 
-    if (mMatchLen > LastMatchLen || LastMatchLen < THRESHOLD) {
+    if (Cd->mMatchLen > LastMatchLen || LastMatchLen < THRESHOLD) {
 
       //
       // Not enough benefits are gained by outputting a pointer,
       // so just output the original character
       //
 
-      Output(mText[mPos - 1], 0);
+      Output(Cd, Cd->mSrc[Pos - 1], 0);
     } else {
 
       //
       // Outputting a pointer is beneficial enough, do it.
       //
 
-      Output(LastMatchLen + (UINT8_MAX + 1 - THRESHOLD),
-             (mPos - LastMatchPos - 2) & (WNDSIZ - 1));
-      while (--LastMatchLen > 0) {
-        GetNextMatch();
-      }
-      if (mMatchLen > mRemainder) {
-        mMatchLen = mRemainder;
+      Output(Cd, LastMatchLen + (UINT8_MAX + 1 - THRESHOLD),
+             (Pos - 1 - LastMatchPos - 1) & (WNDSIZ - 1));
+      while (--LastMatchLen > 1) {
+        InsertPos(Cd, ++Pos);
       }
+      FindMatch(Cd, ++Pos);
     }
   }
 
-  HufEncodeEnd();
-  FreeMemory();
-  return EFI_SUCCESS;
+  HufEncodeEnd(Cd);
 }
 
 STATIC
 VOID
-CountTFreq ()
+CountTFreq (
+  IN COMPRESS_DATA  *Cd
+  )
 /*++
 
 Routine Description:
 
   Count the frequencies for the Extra Set
 
-Arguments: (VOID)
+Arguments:
+
+  Cd      - the compression state
 
 Returns: (VOID)
 
@@ -957,33 +681,33 @@ Returns: (VOID)
   INT32 i, k, n, Count;
 
   for (i = 0; i < NT; i++) {
-    mTFreq[i] = 0;
+    Cd->mTFreq[i] = 0;
   }
   n = NC;
-  while (n > 0 && mCLen[n - 1] == 0) {
+  while (n > 0 && Cd->mCLen[n - 1] == 0) {
     n--;
   }
   i = 0;
   while (i < n) {
-    k = mCLen[i++];
+    k = Cd->mCLen[i++];
     if (k == 0) {
       Count = 1;
-      while (i < n && mCLen[i] == 0) {
+      while (i < n && Cd->mCLen[i] == 0) {
         i++;
         Count++;
       }
       if (Count <= 2) {
-        mTFreq[0] = (UINT16)(mTFreq[0] + Count);
+        Cd->mTFreq[0] = (UINT16)(Cd->mTFreq[0] + Count);
       } else if (Count <= 18) {
-        mTFreq[1]++;
+        Cd->mTFreq[1]++;
       } else if (Count == 19) {
-        mTFreq[0]++;
-        mTFreq[1]++;
+        Cd->mTFreq[0]++;
+        Cd->mTFreq[1]++;
       } else {
-        mTFreq[2]++;
+        Cd->mTFreq[2]++;
       }
     } else {
-      mTFreq[k + 2]++;
+      Cd->mTFreq[k + 2]++;
     }
   }
 }
@@ -991,9 +715,10 @@ Returns: (VOID)
 STATIC
 VOID
 WritePTLen (
-  IN INT32 n,
-  IN INT32 nbit,
-  IN INT32 Special
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          n,
+  IN INT32          nbit,
+  IN INT32          Special
   )
 /*++
 
@@ -1003,6 +728,7 @@ Routine Description:
 
 Arguments:
 
+  Cd      - the compression state
   n       - the number of symbols
   nbit    - the number of bits needed to represent 'n'
   Special - the special symbol that needs to be take care of
@@ -1013,37 +739,41 @@ Returns: (VOID)
 {
   INT32 i, k;
 
-  while (n > 0 && mPTLen[n - 1] == 0) {
+  while (n > 0 && Cd->mPTLen[n - 1] == 0) {
     n--;
   }
-  PutBits(nbit, n);
+  PutBits(Cd, nbit, n);
   i = 0;
   while (i < n) {
-    k = mPTLen[i++];
+    k = Cd->mPTLen[i++];
     if (k <= 6) {
-      PutBits(3, k);
+      PutBits(Cd, 3, k);
     } else {
-      PutBits(k - 3, (1U << (k - 3)) - 2);
+      PutBits(Cd, k - 3, (1U << (k - 3)) - 2);
     }
     if (i == Special) {
-      while (i < 6 && mPTLen[i] == 0) {
+      while (i < 6 && Cd->mPTLen[i] == 0) {
         i++;
       }
-      PutBits(2, (i - 3) & 3);
+      PutBits(Cd, 2, (i - 3) & 3);
     }
   }
 }
 
 STATIC
 VOID
-WriteCLen ()
+WriteCLen (
+  IN COMPRESS_DATA  *Cd
+  )
 /*++
 
 Routine Description:
 
   Outputs the code length array for Char&Length Set
 
-Arguments: (VOID)
+Arguments:
+
+  Cd      - the compression state
 
 Returns: (VOID)
 
@@ -1052,36 +782,36 @@ Returns: (VOID)
   INT32 i, k, n, Count;
 
   n = NC;
-  while (n > 0 && mCLen[n - 1] == 0) {
+  while (n > 0 && Cd->mCLen[n - 1] == 0) {
     n--;
   }
-  PutBits(CBIT, n);
+  PutBits(Cd, CBIT, n);
   i = 0;
   while (i < n) {
-    k = mCLen[i++];
+    k = Cd->mCLen[i++];
     if (k == 0) {
       Count = 1;
-      while (i < n && mCLen[i] == 0) {
+      while (i < n && Cd->mCLen[i] == 0) {
         i++;
         Count++;
       }
       if (Count <= 2) {
         for (k = 0; k < Count; k++) {
-          PutBits(mPTLen[0], mPTCode[0]);
+          PutBits(Cd, Cd->mPTLen[0], Cd->mPTCode[0]);
         }
       } else if (Count <= 18) {
-        PutBits(mPTLen[1], mPTCode[1]);
-        PutBits(4, Count - 3);
+        PutBits(Cd, Cd->mPTLen[1], Cd->mPTCode[1]);
+        PutBits(Cd, 4, Count - 3);
       } else if (Count == 19) {
-        PutBits(mPTLen[0], mPTCode[0]);
-        PutBits(mPTLen[1], mPTCode[1]);
-        PutBits(4, 15);
+        PutBits(Cd, Cd->mPTLen[0], Cd->mPTCode[0]);
+        PutBits(Cd, Cd->mPTLen[1], Cd->mPTCode[1]);
+        PutBits(Cd, 4, 15);
       } else {
-        PutBits(mPTLen[2], mPTCode[2]);
-        PutBits(CBIT, Count - 20);
+        PutBits(Cd, Cd->mPTLen[2], Cd->mPTCode[2]);
+        PutBits(Cd, CBIT, Count - 20);
       }
     } else {
-      PutBits(mPTLen[k + 2], mPTCode[k + 2]);
+      PutBits(Cd, Cd->mPTLen[k + 2], Cd->mPTCode[k + 2]);
     }
   }
 }
@@ -1089,16 +819,18 @@ Returns: (VOID)
 STATIC
 VOID
 EncodeC (
-  IN INT32 c
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          c
   )
 {
-  PutBits(mCLen[c], mCCode[c]);
+  PutBits(Cd, Cd->mCLen[c], Cd->mCCode[c]);
 }
 
 STATIC
 VOID
 EncodeP (
-  IN UINT32 p
+  IN COMPRESS_DATA  *Cd,
+  IN UINT32         p
   )
 {
   UINT32 c, q;
@@ -1109,22 +841,26 @@ EncodeP (
     q >>= 1;
     c++;
   }
-  PutBits(mPTLen[c], mPTCode[c]);
+  PutBits(Cd, Cd->mPTLen[c], Cd->mPTCode[c]);
   if (c > 1) {
-    PutBits(c - 1, p & (0xFFFFU >> (17 - c)));
+    PutBits(Cd, c - 1, p & (0xFFFFU >> (17 - c)));
   }
 }
 
 STATIC
 VOID
-SendBlock ()
+SendBlock (
+  IN COMPRESS_DATA  *Cd
+  )
 /*++
 
 Routine Description:
 
   Huffman code the block and output it.
 
-Argument: (VOID)
+Argument:
+
+  Cd      - the compression state
 
 Returns: (VOID)
 
@@ -1133,53 +869,53 @@ Returns: (VOID)
   UINT32 i, k, Flags, Root, Pos, Size;
   Flags = 0;
 
-  Root = MakeTree(NC, mCFreq, mCLen, mCCode);
-  Size = mCFreq[Root];
-  PutBits(16, Size);
+  Root = MakeTree(Cd, NC, Cd->mCFreq, Cd->mCLen, Cd->mCCode);
+  Size = Cd->mCFreq[Root];
+  PutBits(Cd, 16, Size);
   if (Root >= NC) {
-    CountTFreq();
-    Root = MakeTree(NT, mTFreq, mPTLen, mPTCode);
+    CountTFreq(Cd);
+    Root = MakeTree(Cd, NT, Cd->mTFreq, Cd->mPTLen, Cd->mPTCode);
     if (Root >= NT) {
-      WritePTLen(NT, TBIT, 3);
+      WritePTLen(Cd, NT, TBIT, 3);
     } else {
-      PutBits(TBIT, 0);
-      PutBits(TBIT, Root);
+      PutBits(Cd, TBIT, 0);
+      PutBits(Cd, TBIT, Root);
     }
-    WriteCLen();
+    WriteCLen(Cd);
   } else {
-    PutBits(TBIT, 0);
-    PutBits(TBIT, 0);
-    PutBits(CBIT, 0);
-    PutBits(CBIT, Root);
+    PutBits(Cd, TBIT, 0);
+    PutBits(Cd, TBIT, 0);
+    PutBits(Cd, CBIT, 0);
+    PutBits(Cd, CBIT, Root);
   }
-  Root = MakeTree(NP, mPFreq, mPTLen, mPTCode);
+  Root = MakeTree(Cd, NP, Cd->mPFreq, Cd->mPTLen, Cd->mPTCode);
   if (Root >= NP) {
-    WritePTLen(NP, PBIT, -1);
+    WritePTLen(Cd, NP, PBIT, -1);
   } else {
-    PutBits(PBIT, 0);
-    PutBits(PBIT, Root);
+    PutBits(Cd, PBIT, 0);
+    PutBits(Cd, PBIT, Root);
   }
   Pos = 0;
   for (i = 0; i < Size; i++) {
     if (i % UINT8_BIT == 0) {
-      Flags = mBuf[Pos++];
+      Flags = Cd->mBuf[Pos++];
     } else {
       Flags <<= 1;
     }
     if (Flags & (1U << (UINT8_BIT - 1))) {
-      EncodeC(mBuf[Pos++] + (1U << UINT8_BIT));
-      k = mBuf[Pos++] << UINT8_BIT;
-      k += mBuf[Pos++];
-      EncodeP(k);
+      EncodeC(Cd, Cd->mBuf[Pos++] + (1U << UINT8_BIT));
+      k = Cd->mBuf[Pos++] << UINT8_BIT;
+      k += Cd->mBuf[Pos++];
+      EncodeP(Cd, k);
     } else {
-      EncodeC(mBuf[Pos++]);
+      EncodeC(Cd, Cd->mBuf[Pos++]);
     }
   }
   for (i = 0; i < NC; i++) {
-    mCFreq[i] = 0;
+    Cd->mCFreq[i] = 0;
   }
   for (i = 0; i < NP; i++) {
-    mPFreq[i] = 0;
+    Cd->mPFreq[i] = 0;
   }
 }
 
@@ -1187,8 +923,9 @@ Returns: (VOID)
 STATIC
 VOID
 Output (
-  IN UINT32 c,
-  IN UINT32 p
+  IN COMPRESS_DATA  *Cd,
+  IN UINT32         c,
+  IN UINT32         p
   )
 /*++
 
@@ -1198,6 +935,7 @@ Routine Description:
 
 Arguments:
 
+  Cd    - the compression state
   c     - The original character or the 'String Length' element of a Pointer
   p     - The 'Position' field of a Pointer
 
@@ -1205,88 +943,73 @@ Returns: (VOID)
 
 --*/
 {
-  STATIC UINT32 CPos;
-
-  if ((mOutputMask >>= 1) == 0) {
-    mOutputMask = 1U << (UINT8_BIT - 1);
-    if (mOutputPos >= mBufSiz - 3 * UINT8_BIT) {
-      SendBlock();
-      mOutputPos = 0;
+  if ((Cd->mOutputMask >>= 1) == 0) {
+    Cd->mOutputMask = 1U << (UINT8_BIT - 1);
+    if (Cd->mOutputPos >= BLOCK_BUFSIZ - 3 * UINT8_BIT) {
+      SendBlock(Cd);
+      Cd->mOutputPos = 0;
     }
-    CPos = mOutputPos++;
-    mBuf[CPos] = 0;
+    Cd->mCPos = Cd->mOutputPos++;
+    Cd->mBuf[Cd->mCPos] = 0;
   }
-  mBuf[mOutputPos++] = (UINT8) c;
-  mCFreq[c]++;
+  Cd->mBuf[Cd->mOutputPos++] = (UINT8) c;
+  Cd->mCFreq[c]++;
   if (c >= (1U << UINT8_BIT)) {
-    mBuf[CPos] |= mOutputMask;
-    mBuf[mOutputPos++] = (UINT8)(p >> UINT8_BIT);
-    mBuf[mOutputPos++] = (UINT8) p;
+    Cd->mBuf[Cd->mCPos] |= Cd->mOutputMask;
+    Cd->mBuf[Cd->mOutputPos++] = (UINT8)(p >> UINT8_BIT);
+    Cd->mBuf[Cd->mOutputPos++] = (UINT8) p;
     c = 0;
     while (p) {
       p >>= 1;
       c++;
     }
-    mPFreq[c]++;
+    Cd->mPFreq[c]++;
   }
 }
 
 STATIC
 VOID
-HufEncodeStart ()
+HufEncodeStart (
+  IN COMPRESS_DATA  *Cd
+  )
 {
   INT32 i;
 
   for (i = 0; i < NC; i++) {
-    mCFreq[i] = 0;
+    Cd->mCFreq[i] = 0;
   }
   for (i = 0; i < NP; i++) {
-    mPFreq[i] = 0;
+    Cd->mPFreq[i] = 0;
   }
-  mOutputPos = mOutputMask = 0;
-  InitPutBits();
+  Cd->mOutputPos = Cd->mOutputMask = 0;
+  Cd->mBuf[0] = 0;
+  InitPutBits(Cd);
   return;
 }
 
 STATIC
 VOID
-HufEncodeEnd ()
+HufEncodeEnd (
+  IN COMPRESS_DATA  *Cd
+  )
 {
-  SendBlock();
+  SendBlock(Cd);
 
   //
   // Flush remaining bits
   //
-  PutBits(UINT8_BIT - 1, 0);
+  PutBits(Cd, UINT8_BIT - 1, 0);
 
   return;
 }
 
 
-STATIC
-VOID
-MakeCrcTable ()
-{
-  UINT32 i, j, r;
-
-  for (i = 0; i <= UINT8_MAX; i++) {
-    r = i;
-    for (j = 0; j < UINT8_BIT; j++) {
-      if (r & 1) {
-        r = (r >> 1) ^ CRCPOLY;
-      } else {
-        r >>= 1;
-      }
-    }
-    mCrcTable[i] = (UINT16)r;
-  }
-}
-
 STATIC
 VOID
 PutBits (
-  IN INT32 n,
-  IN UINT32 x
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          n,
+  IN UINT32         x
   )
 /*++
 
@@ -1296,6 +1019,7 @@ Routine Description:
 
 Argments:
 
+  Cd  - the compression state
   n   - the rightmost n bits of the data is used
   x   - the data
 
@@ -1305,82 +1029,46 @@ Returns: (VOID)
 {
   UINT8 Temp;
 
-  if (n < mBitCount) {
-    mSubBitBuf |= x << (mBitCount -= n);
+  if (n < Cd->mBitCount) {
+    Cd->mSubBitBuf |= x << (Cd->mBitCount -= n);
   } else {
 
-    Temp = (UINT8)(mSubBitBuf | (x >> (n -= mBitCount)));
-    if (mDst < mDstUpperLimit) {
-      *mDst++ = Temp;
+    Temp = (UINT8)(Cd->mSubBitBuf | (x >> (n -= Cd->mBitCount)));
+    if (Cd->mDst < Cd->mDstUpperLimit) {
+      *Cd->mDst++ = Temp;
     }
-    mCompSize++;
+    Cd->mCompSize++;
 
     if (n < UINT8_BIT) {
-      mSubBitBuf = x << (mBitCount = UINT8_BIT - n);
+      Cd->mSubBitBuf = x << (Cd->mBitCount = UINT8_BIT - n);
     } else {
 
       Temp = (UINT8)(x >> (n - UINT8_BIT));
-      if (mDst < mDstUpperLimit) {
-        *mDst++ = Temp;
+      if (Cd->mDst < Cd->mDstUpperLimit) {
+        *Cd->mDst++ = Temp;
       }
-      mCompSize++;
+      Cd->mCompSize++;
 
-      mSubBitBuf = x << (mBitCount = 2 * UINT8_BIT - n);
+      Cd->mSubBitBuf = x << (Cd->mBitCount = 2 * UINT8_BIT - n);
     }
   }
 }
 
-STATIC
-INT32
-FreadCrc (
-  OUT UINT8 *p,
-  IN  INT32 n
-  )
-/*++
-
-Routine Description:
-
-  Read in source data
-
-Arguments:
-
-  p   - the buffer to hold the data
-  n   - number of bytes to read
-
-Returns:
-
-  number of bytes actually read
-
---*/
-{
-  INT32 i;
-
-  for (i = 0; mSrc < mSrcUpperLimit && i < n; i++) {
-    *p++ = *mSrc++;
-  }
-  n = i;
-
-  p -= n;
-  mOrigSize += n;
-  while (--i >= 0) {
-    UPDATE_CRC(*p++);
-  }
-  return n;
-}
-
-
 STATIC
 VOID
-InitPutBits ()
+InitPutBits (
+  IN COMPRESS_DATA  *Cd
+  )
 {
-  mBitCount = UINT8_BIT;
-  mSubBitBuf = 0;
+  Cd->mBitCount = UINT8_BIT;
+  Cd->mSubBitBuf = 0;
 }
 
 STATIC
 VOID
 CountLen (
-  IN INT32 i
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          i
   )
 /*++
 
@@ -1390,28 +1078,28 @@ Routine Description:
 
 Arguments:
 
+  Cd  - the compression state
   i   - the top node
 
 Returns: (VOID)
 
 --*/
 {
-  STATIC INT32 Depth = 0;
-
-  if (i < mN) {
-    mLenCnt[(Depth < 16) ? Depth : 16]++;
+  if (i < Cd->mN) {
+    Cd->mLenCnt[(Cd->mDepth < 16) ? Cd->mDepth : 16]++;
   } else {
-    Depth++;
-    CountLen(mLeft [i]);
-    CountLen(mRight[i]);
-    Depth--;
+    Cd->mDepth++;
+    CountLen(Cd, Cd->mLeft [i]);
+    CountLen(Cd, Cd->mRight[i]);
+    Cd->mDepth--;
   }
 }
 
 STATIC
 VOID
 MakeLen (
-  IN INT32 Root
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          Root
   )
 /*++
 
@@ -1421,6 +1109,7 @@ Routine Description:
 
 Arguments:
 
+  Cd     - the compression state
   Root   - the root of the tree
 
 --*/
@@ -1429,9 +1118,10 @@ Arguments:
   UINT32 Cum;
 
   for (i = 0; i <= 16; i++) {
-    mLenCnt[i] = 0;
+    Cd->mLenCnt[i] = 0;
   }
-  CountLen(Root);
+  Cd->mDepth = 0;
+  CountLen(Cd, Root);
 
   //
   // Adjust the length count array so that
@@ -1440,23 +1130,23 @@ Arguments:
 
   Cum = 0;
   for (i = 16; i > 0; i--) {
-    Cum += mLenCnt[i] << (16 - i);
+    Cum += Cd->mLenCnt[i] << (16 - i);
   }
   while (Cum != (1U << 16)) {
-    mLenCnt[16]--;
+    Cd->mLenCnt[16]--;
     for (i = 15; i > 0; i--) {
-      if (mLenCnt[i] != 0) {
-        mLenCnt[i]--;
-        mLenCnt[i+1] += 2;
+      if (Cd->mLenCnt[i] != 0) {
+        Cd->mLenCnt[i]--;
+        Cd->mLenCnt[i+1] += 2;
         break;
       }
     }
     Cum--;
   }
   for (i = 16; i > 0; i--) {
-    k = mLenCnt[i];
+    k = Cd->mLenCnt[i];
     while (--k >= 0) {
-      mLen[*mSortPtr++] = (UINT8)i;
+      Cd->mLen[*Cd->mSortPtr++] = (UINT8)i;
     }
   }
 }
@@ -1464,7 +1154,8 @@ Arguments:
 STATIC
 VOID
 DownHeap (
-  IN INT32 i
+  IN COMPRESS_DATA  *Cd,
+  IN INT32          i
   )
 {
   INT32 j, k;
@@ -1473,26 +1164,28 @@ DownHeap (
   // priority queue: send i-th entry down heap
   //
 
-  k = mHeap[i];
-  while ((j = 2 * i) <= mHeapSize) {
-    if (j < mHeapSize && mFreq[mHeap[j]] > mFreq[mHeap[j + 1]]) {
+  k = Cd->mHeap[i];
+  while ((j = 2 * i) <= Cd->mHeapSize) {
+    if (j < Cd->mHeapSize &&
+        Cd->mFreq[Cd->mHeap[j]] > Cd->mFreq[Cd->mHeap[j + 1]]) {
       j++;
     }
-    if (mFreq[k] <= mFreq[mHeap[j]]) {
+    if (Cd->mFreq[k] <= Cd->mFreq[Cd->mHeap[j]]) {
       break;
     }
-    mHeap[i] = mHeap[j];
+    Cd->mHeap[i] = Cd->mHeap[j];
     i = j;
   }
-  mHeap[i] = (INT16)k;
+  Cd->mHeap[i] = (INT16)k;
 }
 
 STATIC
 VOID
 MakeCode (
-  IN  INT32 n,
-  IN  UINT8 Len[],
-  OUT UINT16 Code[]
+  IN  COMPRESS_DATA *Cd,
+  IN  INT32         n,
+  IN  UINT8         Len[],
+  OUT UINT16        Code[]
   )
 /*++
 
@@ -1502,6 +1195,7 @@ Routine Description:
 
 Arguments:
 
+  Cd    - the compression state
   n     - number of symbols
   Len   - the code length array
   Code  - stores codes for each symbol
@@ -1515,7 +1209,7 @@ Returns: (VOID)
 
   Start[1] = 0;
   for (i = 1; i <= 16; i++) {
-    Start[i + 1] = (UINT16)((Start[i] + mLenCnt[i]) << 1);
+    Start[i + 1] = (UINT16)((Start[i] + Cd->mLenCnt[i]) << 1);
   }
   for (i = 0; i < n; i++) {
     Code[i] = Start[Len[i]]++;
@@ -1525,10 +1219,11 @@ Returns: (VOID)
 STATIC
 INT32
 MakeTree (
-  IN  INT32   NParm,
-  IN  UINT16  FreqParm[],
-  OUT UINT8   LenParm[],
-  OUT UINT16  CodeParm[]
+  IN  COMPRESS_DATA *Cd,
+  IN  INT32         NParm,
+  IN  UINT16        FreqParm[],
+  OUT UINT8         LenParm[],
+  OUT UINT16        CodeParm[]
   )
 /*++
 
@@ -1538,6 +1233,7 @@ Routine Description:
 
 Arguments:
 
+  Cd       - the compression state
   NParm    - number of symbols
   FreqParm - frequency of each symbol
   LenParm  - code length for each symbol
@@ -1555,52 +1251,52 @@ Returns:
   // make tree, calculate len[], return root
   //
 
-  mN = NParm;
-  mFreq = FreqParm;
-  mLen = LenParm;
-  Avail = mN;
-  mHeapSize = 0;
-  mHeap[1] = 0;
-  for (i = 0; i < mN; i++) {
-    mLen[i] = 0;
-    if (mFreq[i]) {
-      mHeap[++mHeapSize] = (INT16)i;
+  Cd->mN = NParm;
+  Cd->mFreq = FreqParm;
+  Cd->mLen = LenParm;
+  Avail = Cd->mN;
+  Cd->mHeapSize = 0;
+  Cd->mHeap[1] = 0;
+  for (i = 0; i < Cd->mN; i++) {
+    Cd->mLen[i] = 0;
+    if (Cd->mFreq[i]) {
+      Cd->mHeap[++Cd->mHeapSize] = (INT16)i;
     }
   }
-  if (mHeapSize < 2) {
-    CodeParm[mHeap[1]] = 0;
-    return mHeap[1];
+  if (Cd->mHeapSize < 2) {
+    CodeParm[Cd->mHeap[1]] = 0;
+    return Cd->mHeap[1];
   }
-  for (i = mHeapSize / 2; i >= 1; i--) {
+  for (i = Cd->mHeapSize / 2; i >= 1; i--) {
 
     //
     // make priority queue
     //
-    DownHeap(i);
+    DownHeap(Cd, i);
   }
-  mSortPtr = CodeParm;
+  Cd->mSortPtr = CodeParm;
   do {
-    i = mHeap[1];
-    if (i < mN) {
-      *mSortPtr++ = (UINT16)i;
+    i = Cd->mHeap[1];
+    if (i < Cd->mN) {
+      *Cd->mSortPtr++ = (UINT16)i;
     }
-    mHeap[1] = mHeap[mHeapSize--];
-    DownHeap(1);
-    j = mHeap[1];
-    if (j < mN) {
-      *mSortPtr++ = (UINT16)j;
+    Cd->mHeap[1] = Cd->mHeap[Cd->mHeapSize--];
+    DownHeap(Cd, 1);
+    j = Cd->mHeap[1];
+    if (j < Cd->mN) {
+      *Cd->mSortPtr++ = (UINT16)j;
     }
     k = Avail++;
-    mFreq[k] = (UINT16)(mFreq[i] + mFreq[j]);
-    mHeap[1] = (INT16)k;
-    DownHeap(1);
-    mLeft[k] = (UINT16)i;
-    mRight[k] = (UINT16)j;
-  } while (mHeapSize > 1);
-
-  mSortPtr = CodeParm;
-  MakeLen(k);
-  MakeCode(NParm, LenParm, CodeParm);
+    Cd->mFreq[k] = (UINT16)(Cd->mFreq[i] + Cd->mFreq[j]);
+    Cd->mHeap[1] = (INT16)k;
+    DownHeap(Cd, 1);
+    Cd->mLeft[k] = (UINT16)i;
+    Cd->mRight[k] = (UINT16)j;
+  } while (Cd->mHeapSize > 1);
+
+  Cd->mSortPtr = CodeParm;
+  MakeLen(Cd, k);
+  MakeCode(Cd, NParm, LenParm, CodeParm);
 
   //
   // return root
@@ -673,6 +673,755 @@ Returns: (VOID)
   return ;
 }
 
+//
+// Fast decoder. This reads the same bitstream as Decode() above, which is
+// kept as the reference, but keeps 64 bits of the source at a time so it
+// refills whole words instead of single bytes, uses a wider table for the
+// Position and exTra Sets so their codes are almost never walked bit by
+// bit, and checks the source more carefully so corrupt data can't make it
+// read or write outside its buffers.
+//
+#define FAST_CTABLE_BITS  12
+#define FAST_PTTABLE_BITS 10
+
+//
+// Where the fast decoder is in the source. FastDecode() keeps a copy of this
+// in a local so the compiler knows writing the output doesn't change it.
+//
+typedef struct {
+  UINT8   *mSrcBase;  // Starting address of compressed data
+  UINT32  mInBuf;
+  UINT32  mCompSize;
+
+  //
+  // The next mBitCount bits of the source, from the top bit of mBitBuf down
+  //
+  UINT64  mBitBuf;
+  UINT32  mBitCount;
+} FAST_BITS;
+
+typedef struct {
+  FAST_BITS mBits;
+  UINT8   *mDstBase;  // Starting address of decompressed data
+  UINT32  mOutBuf;
+  UINT32  mOrigSize;
+
+  UINT16  mBlockSize;
+  UINT16  mBadTableFlag;
+
+  UINT16  mLeft[2 * NC - 1];
+  UINT16  mRight[2 * NC - 1];
+  UINT8   mCLen[NC];
+  UINT8   mPTLen[NPT];
+  UINT16  mCTable[1U << FAST_CTABLE_BITS];
+  UINT16  mPTTable[1U << FAST_PTTABLE_BITS];
+
+  UINT8   mPBit;
+} FAST_SCRATCH_DATA;
+
+STATIC
+VOID
+FastFillBuf (
+  IN  FAST_BITS  *Bits
+  )
+/*++
+
+Routine Description:
+
+  Make sure there are at least 56 bits in mBitBuf, padding with zero bits
+  past the end of the source.
+
+Arguments:
+
+  Bits      - The fast decoder source position
+
+Returns: (VOID)
+
+--*/
+{
+  UINT8   *Src;
+  UINT64  Word;
+  UINT32  Bytes;
+
+  if (Bits->mBitCount > 56) {
+    return;
+  }
+
+  Src = Bits->mSrcBase + Bits->mInBuf;
+  if (Bits->mInBuf + 8 <= Bits->mCompSize) {
+    //
+    // Load a whole word; bits past the whole bytes taken are loaded again
+    // next time, which is harmless since they're the same bits.
+    //
+    Word = ((UINT64) Src[0] << 56) | ((UINT64) Src[1] << 48) |
+           ((UINT64) Src[2] << 40) | ((UINT64) Src[3] << 32) |
+           ((UINT64) Src[4] << 24) | ((UINT64) Src[5] << 16) |
+           ((UINT64) Src[6] << 8)  | (UINT64) Src[7];
+    Bits->mBitBuf |= Word >> Bits->mBitCount;
+    Bytes = (63 - Bits->mBitCount) >> 3;
+    Bits->mInBuf += Bytes;
+    Bits->mBitCount += Bytes * 8;
+    return;
+  }
+
+  while (Bits->mBitCount <= 56) {
+    if (Bits->mInBuf < Bits->mCompSize) {
+      Bits->mBitBuf |= (UINT64) Bits->mSrcBase[Bits->mInBuf++] <<
+                     (56 - Bits->mBitCount);
+    }
+    Bits->mBitCount += 8;
+  }
+}
+
+STATIC
+VOID
+FastSkipBits (
+  IN  FAST_BITS  *Bits,
+  IN  UINT32     NumOfBits
+  )
+/*++
+
+Routine Description:
+
+  Drop NumOfBits bits from mBitBuf; there must be that many in it.
+
+Arguments:
+
+  Bits      - The fast decoder source position
+  NumOfBits - The number of bits to drop
+
+Returns: (VOID)
+
+--*/
+{
+  Bits->mBitBuf <<= NumOfBits;
+  Bits->mBitCount -= NumOfBits;
+}
+
+STATIC
+UINT32
+FastGetBits (
+  IN  FAST_BITS  *Bits,
+  IN  UINT32     NumOfBits
+  )
+/*++
+
+Routine Description:
+
+  Pop NumOfBits bits (1 to 32) from the source.
+
+Arguments:
+
+  Bits      - The fast decoder source position
+  NumOfBits - The number of bits to pop
+
+Returns:
+
+  The bits that are popped out.
+
+--*/
+{
+  UINT32  OutBits;
+
+  FastFillBuf (Bits);
+  OutBits = (UINT32) (Bits->mBitBuf >> (64 - NumOfBits));
+  FastSkipBits (Bits, NumOfBits);
+
+  return OutBits;
+}
+
+STATIC
+UINT16
+FastMakeTable (
+  IN  FAST_SCRATCH_DATA  *Sd,
+  IN  UINT16             NumOfChar,
+  IN  UINT8              *BitLen,
+  IN  UINT16             TableBits,
+  OUT UINT16             *Table
+  )
+/*++
+
+Routine Description:
+
+  Creates Huffman Code mapping table according to code length array, as
+  MakeTable() does, but rejects code lengths that don't form a complete code
+  instead of overrunning the table.
+
+Arguments:
+
+  Sd        - The fast decoder scratch data
+  NumOfChar - Number of symbols in the symbol set
+  BitLen    - Code length array
+  TableBits - The width of the mapping table
+  Table     - The table
+
+Returns:
+
+  0         - OK.
+  BAD_TABLE - The table is corrupted.
+
+--*/
+{
+  UINT32  Count[17];
+  UINT32  Weight[17];
+  UINT32  Start[18];
+  UINT16  *Pointer;
+  UINT32  Index3;
+  UINT32  Index;
+  UINT32  Len;
+  UINT16  Char;
+  UINT32  JuBits;
+  UINT16  Avail;
+  UINT32  NextCode;
+  UINT32  Mask;
+
+  for (Index = 0; Index <= 16; Index++) {
+    Count[Index] = 0;
+  }
+
+  for (Index = 0; Index < NumOfChar; Index++) {
+    if (BitLen[Index] > 16) {
+      return (UINT16) BAD_TABLE;
+    }
+    Count[BitLen[Index]]++;
+  }
+
+  Start[1] = 0;
+
+  for (Index = 1; Index <= 16; Index++) {
+    Start[Index + 1] = Start[Index] + (Count[Index] << (16 - Index));
+  }
+
+  if (Start[17] != (1U << 16)) {
+    return (UINT16) BAD_TABLE;
+  }
+
+  JuBits = 16 - TableBits;
+
+  for (Index = 1; Index <= TableBits; Index++) {
+    Start[Index] >>= JuBits;
+    Weight[Index] = 1U << (TableBits - Index);
+  }
+
+  while (Index <= 16) {
+    Weight[Index] = 1U << (16 - Index);
+    Index++;
+  }
+
+  Index = Start[TableBits + 1] >> JuBits;
+  while (Index < (1U << TableBits)) {
+    Table[Index++] = 0;
+  }
+
+  Avail = NumOfChar;
+  Mask  = 1U << (15 - TableBits);
+
+  for (Char = 0; Char < NumOfChar; Char++) {
+
+    Len = BitLen[Char];
+    if (Len == 0) {
+      continue;
+    }
+
+    NextCode = Start[Len] + Weight[Len];
+
+    if (Len <= TableBits) {
+
+      for (Index = Start[Len]; Index < NextCode; Index++) {
+        Table[Index] = Char;
+      }
+
+    } else {
+
+      Index3  = Start[Len];
+      Pointer = &Table[Index3 >> JuBits];
+      Index   = Len - TableBits;
+
+      while (Index != 0) {
+        if (*Pointer == 0) {
+          Sd->mRight[Avail] = Sd->mLeft[Avail] = 0;
+          *Pointer = Avail++;
+        }
+
+        if (Index3 & Mask) {
+          Pointer = &Sd->mRight[*Pointer];
+        } else {
+          Pointer = &Sd->mLeft[*Pointer];
+        }
+
+        Index3 <<= 1;
+        Index--;
+      }
+
+      *Pointer = Char;
+
+    }
+
+    Start[Len] = NextCode;
+  }
+  //
+  // Succeeds
+  //
+  return 0;
+}
+
+STATIC
+UINT16
+FastDecodeSymbol (
+  IN  FAST_SCRATCH_DATA  *Sd,
+  IN  FAST_BITS          *Bits,
+  IN  UINT16             *Table,
+  IN  UINT32             TableBits,
+  IN  UINT8              *BitLen,
+  IN  UINT16             NumOfChar
+  )
+/*++
+
+Routine Description:
+
+  Decode one symbol with a table from FastMakeTable(). The caller must have
+  called FastFillBuf() since the last 40 bits were taken.
+
+Arguments:
+
+  Sd        - The fast decoder scratch data
+  Bits      - The fast decoder source position
+  Table     - The mapping table
+  TableBits - The width of the mapping table
+  BitLen    - Code length array
+  NumOfChar - Number of symbols in the symbol set
+
+Returns:
+
+  The symbol decoded.
+
+--*/
+{
+  UINT16  Val;
+  UINT64  Mask;
+
+  Val = Table[Bits->mBitBuf >> (64 - TableBits)];
+
+  if (Val >= NumOfChar) {
+    Mask = 1ULL << (63 - TableBits);
+
+    do {
+      if (Bits->mBitBuf & Mask) {
+        Val = Sd->mRight[Val];
+      } else {
+        Val = Sd->mLeft[Val];
+      }
+
+      Mask >>= 1;
+    } while (Val >= NumOfChar);
+  }
+
+  FastSkipBits (Bits, BitLen[Val]);
+
+  return Val;
+}
+
+STATIC
+UINT16
+FastReadPTLen (
+  IN  FAST_SCRATCH_DATA  *Sd,
+  IN  UINT16             nn,
+  IN  UINT16             nbit,
+  IN  UINT16             Special
+  )
+/*++
+
+Routine Description:
+
+  Reads code lengths for the Extra Set or the Position Set
+
+Arguments:
+
+  Sd        - The fast decoder scratch data
+  nn        - Number of symbols
+  nbit      - Number of bits needed to represent nn
+  Special   - The special symbol that needs to be taken care of
+
+Returns:
+
+  0         - OK.
+  BAD_TABLE - Table is corrupted.
+
+--*/
+{
+  UINT16  Number;
+  UINT16  CharC;
+  UINT16  Index;
+  UINT64  Mask;
+
+  Number = (UINT16) FastGetBits (&Sd->mBits, nbit);
+
+  if (Number == 0) {
+    CharC = (UINT16) FastGetBits (&Sd->mBits, nbit);
+
+    for (Index = 0; Index < (1U << FAST_PTTABLE_BITS); Index++) {
+      Sd->mPTTable[Index] = CharC;
+    }
+
+    for (Index = 0; Index < nn; Index++) {
+      Sd->mPTLen[Index] = 0;
+    }
+
+    return CharC < nn ? 0 : (UINT16) BAD_TABLE;
+  }
+
+  if (Number > nn) {
+    return (UINT16) BAD_TABLE;
+  }
+
+  Index = 0;
+
+  while (Index < Number) {
+
+    FastFillBuf (&Sd->mBits);
+    CharC = (UINT16) (Sd->mBits.mBitBuf >> (64 - 3));
+
+    if (CharC == 7) {
+      Mask = 1ULL << (63 - 3);
+      while ((Mask & Sd->mBits.mBitBuf) && CharC <= 16) {
+        Mask >>= 1;
+        CharC += 1;
+      }
+      if (CharC > 16) {
+        return (UINT16) BAD_TABLE;
+      }
+    }
+
+    FastSkipBits (&Sd->mBits, (CharC < 7) ? 3 : CharC - 3);
+
+    Sd->mPTLen[Index++] = (UINT8) CharC;
+
+    if (Index == Special) {
+      CharC = (UINT16) FastGetBits (&Sd->mBits, 2);
+      if (Index + CharC > nn) {
+        return (UINT16) BAD_TABLE;
+      }
+      while ((INT16) (--CharC) >= 0) {
+        Sd->mPTLen[Index++] = 0;
+      }
+    }
+  }
+
+  while (Index < nn) {
+    Sd->mPTLen[Index++] = 0;
+  }
+
+  return FastMakeTable (Sd, nn, Sd->mPTLen, FAST_PTTABLE_BITS, Sd->mPTTable);
+}
+
+STATIC
+UINT16
+FastReadCLen (
+  IN  FAST_SCRATCH_DATA  *Sd
+  )
+/*++
+
+Routine Description:
+
+  Reads code lengths for Char&Len Set.
+
+Arguments:
+
+  Sd    - The fast decoder scratch data
+
+Returns:
+
+  0         - OK.
+  BAD_TABLE - Table is corrupted.
+
+--*/
+{
+  UINT16  Number;
+  UINT16  CharC;
+  UINT16  Index;
+
+  Number = (UINT16) FastGetBits (&Sd->mBits, CBIT);
+
+  if (Number == 0) {
+    CharC = (UINT16) FastGetBits (&Sd->mBits, CBIT);
+
+    for (Index = 0; Index < NC; Index++) {
+      Sd->mCLen[Index] = 0;
+    }
+
+    for (Index = 0; Index < (1U << FAST_CTABLE_BITS); Index++) {
+      Sd->mCTable[Index] = CharC;
+    }
+
+    return CharC < NC ? 0 : (UINT16) BAD_TABLE;
+  }
+
+  if (Number > NC) {
+    return (UINT16) BAD_TABLE;
+  }
+
+  Index = 0;
+  while (Index < Number) {
+
+    FastFillBuf (&Sd->mBits);
+    CharC = FastDecodeSymbol (Sd, &Sd->mBits, Sd->mPTTable,
+                              FAST_PTTABLE_BITS, Sd->mPTLen, NT);
+
+    if (CharC <= 2) {
+
+      if (CharC == 0) {
+        CharC = 1;
+      } else if (CharC == 1) {
+        CharC = (UINT16) (FastGetBits (&Sd->mBits, 4) + 3);
+      } else if (CharC == 2) {
+        CharC = (UINT16) (FastGetBits (&Sd->mBits, CBIT) + 20);
+      }
+
+      if (Index + CharC > Number) {
+        return (UINT16) BAD_TABLE;
+      }
+      while ((INT16) (--CharC) >= 0) {
+        Sd->mCLen[Index++] = 0;
+      }
+
+    } else {
+
+      Sd->mCLen[Index++] = (UINT8) (CharC - 2);
+
+    }
+  }
+
+  while (Index < NC) {
+    Sd->mCLen[Index++] = 0;
+  }
+
+  return FastMakeTable (Sd, NC, Sd->mCLen, FAST_CTABLE_BITS, Sd->mCTable);
+}
+
+STATIC
+VOID
+FastDecode (
+  IN  FAST_SCRATCH_DATA  *Sd
+  )
+/*++
+
+Routine Description:
+
+  Decode the source data and put the resulting data into the destination
+  buffer, as Decode() does.
+
+Arguments:
+
+  Sd            - The fast decoder scratch data
+
+Returns: (VOID)
+
+ --*/
+{
+  FAST_BITS  Bits;
+  UINT8   *Dst;
+  UINT32  OutBuf;
+  UINT32  OrigSize;
+  UINT32  DataIdx;
+  UINT32  Pos;
+  UINT32  Count;
+  UINT16  CharC;
+
+  Dst       = Sd->mDstBase;
+  OutBuf    = Sd->mOutBuf;
+  OrigSize  = Sd->mOrigSize;
+  Bits      = Sd->mBits;
+
+  for (;;) {
+    if (Sd->mBlockSize == 0) {
+      //
+      // Starting a new block
+      //
+      Sd->mBits         = Bits;
+      Sd->mBlockSize    = (UINT16) FastGetBits (&Sd->mBits, 16);
+      Sd->mBadTableFlag = FastReadPTLen (Sd, NT, TBIT, 3);
+      if (Sd->mBadTableFlag == 0) {
+        Sd->mBadTableFlag = FastReadCLen (Sd);
+      }
+      if (Sd->mBadTableFlag == 0) {
+        Sd->mBadTableFlag = FastReadPTLen (Sd, MAXNP, Sd->mPBit,
+                                           (UINT16) (-1));
+      }
+      if (Sd->mBadTableFlag != 0) {
+        break;
+      }
+      Bits = Sd->mBits;
+    }
+
+    Sd->mBlockSize--;
+    FastFillBuf (&Bits);
+    CharC = FastDecodeSymbol (Sd, &Bits, Sd->mCTable, FAST_CTABLE_BITS,
+                              Sd->mCLen, NC);
+
+    if (CharC < 256) {
+      //
+      // Process an Original character
+      //
+      if (OutBuf >= OrigSize) {
+        break;
+      }
+      Dst[OutBuf++] = (UINT8) CharC;
+
+    } else {
+      //
+      // Process a Pointer
+      //
+      Count = CharC - (UINT8_MAX + 1 - THRESHOLD);
+
+      CharC = FastDecodeSymbol (Sd, &Bits, Sd->mPTTable, FAST_PTTABLE_BITS,
+                                Sd->mPTLen, MAXNP);
+      Pos = CharC;
+      if (CharC > 1) {
+        Pos = (1U << (CharC - 1)) + FastGetBits (&Bits, CharC - 1);
+      }
+
+      if (Pos >= OutBuf) {
+        //
+        // Points before the start of the data
+        //
+        Sd->mBadTableFlag = (UINT16) BAD_TABLE;
+        break;
+      }
+      DataIdx = OutBuf - Pos - 1;
+
+      if (Count > OrigSize - OutBuf) {
+        Count = OrigSize - OutBuf;
+      }
+
+      if (Pos == 0) {
+        //
+        // A run of the last byte
+        //
+        memset (Dst + OutBuf, Dst[DataIdx], Count);
+        OutBuf += Count;
+      } else if (Pos >= 7 && Count + 7 <= OrigSize - OutBuf) {
+        //
+        // Copy 8 bytes at a time. Each 8 comes from before where it goes,
+        // and there's room past the end for the last one to overrun.
+        //
+        Count += OutBuf;
+        do {
+          memcpy (Dst + OutBuf, Dst + DataIdx, 8);
+          OutBuf += 8;
+          DataIdx += 8;
+        } while (OutBuf < Count);
+        OutBuf = Count;
+      } else {
+        while (Count-- > 0) {
+          Dst[OutBuf++] = Dst[DataIdx++];
+        }
+      }
+      if (OutBuf >= OrigSize) {
+        break;
+      }
+    }
+  }
+
+  Sd->mOutBuf = OutBuf;
+  Sd->mBits   = Bits;
+}
+
+EFI_STATUS
+EFIAPI
+EfiDecompressFast (
+  IN      VOID                    *Source,
+  IN      UINT32                  SrcSize,
+  IN OUT  VOID                    *Destination,
+  IN      UINT32                  DstSize,
+  IN OUT  VOID                    *Scratch,
+  IN      UINT32                  ScratchSize
+  )
+/*++
+
+Routine Description:
+
+  Same as EfiDecompress(), using the fast decoder. The scratch buffer size
+  from EfiGetInfo() is big enough for either.
+
+Arguments:
+
+  Source      - The source buffer containing the compressed data.
+  SrcSize     - The size of source buffer
+  Destination - The destination buffer to store the decompressed data
+  DstSize     - The size of destination buffer.
+  Scratch     - The buffer used internally by the decompress routine. This  buffer is needed to store intermediate data.
+  ScratchSize - The size of scratch buffer.
+
+Returns:
+
+  EFI_SUCCESS           - Decompression is successfull
+  EFI_INVALID_PARAMETER - The source data is corrupted
+
+--*/
+{
+  UINT32             CompSize;
+  UINT32             OrigSize;
+  FAST_SCRATCH_DATA  *Sd;
+  UINT8              *Src;
+
+  Src = Source;
+
+  if (ScratchSize < sizeof (FAST_SCRATCH_DATA)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Sd = (FAST_SCRATCH_DATA *) Scratch;
+
+  if (SrcSize < 8) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  CompSize  = Src[0] + (Src[1] << 8) + (Src[2] << 16) + (Src[3] << 24);
+  OrigSize  = Src[4] + (Src[5] << 8) + (Src[6] << 16) + (Src[7] << 24);
+
+  //
+  // If compressed file size is 0, return
+  //
+  if (OrigSize == 0) {
+    return EFI_SUCCESS;
+  }
+
+  if (SrcSize - 8 < CompSize) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (DstSize != OrigSize) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  //
+  // The tables are all filled in before they're used, so unlike Decompress()
+  // this only needs to clear the decoder state.
+  //
+  Sd->mBits.mSrcBase  = Src + 8;
+  Sd->mBits.mInBuf    = 0;
+  Sd->mBits.mCompSize = CompSize;
+  Sd->mBits.mBitBuf   = 0;
+  Sd->mBits.mBitCount = 0;
+  Sd->mDstBase      = Destination;
+  Sd->mOutBuf       = 0;
+  Sd->mOrigSize     = OrigSize;
+  Sd->mBlockSize    = 0;
+  Sd->mBadTableFlag = 0;
+  Sd->mPBit         = 4;
+
+  FastDecode (Sd);
+
+  if (Sd->mBadTableFlag != 0) {
+    //
+    // Something wrong with the source
+    //
+    return EFI_INVALID_PARAMETER;
+  }
+
+  return EFI_SUCCESS;
+}
+
 EFI_STATUS
 GetInfo (
   IN      VOID    *Source,
@@ -702,7 +1451,13 @@ Returns:
 {
   UINT8 *Src;
 
+  //
+  // Big enough for either decoder
+  //
   *ScratchSize  = sizeof (SCRATCH_DATA);
+  if (*ScratchSize < sizeof (FAST_SCRATCH_DATA)) {
+    *ScratchSize = sizeof (FAST_SCRATCH_DATA);
+  }
 
   Src           = Source;
   if (SrcSize < 8) {
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "bmpblk_header.h"
@@ -57,6 +58,18 @@ ImageFormat identify_image_type(const void *buf, uint32_t bufsize,
     return FORMAT_BMP;
   }
 
+  const RawImageHeader *rhdr = buf;
+  if (bufsize >= sizeof(RawImageHeader) &&
+      0 == memcmp(rhdr->signature, RAW_IMAGE_SIGNATURE,
+                  RAW_IMAGE_SIGNATURE_SIZE)) {
+    if (info) {
+      info->format = FORMAT_RAW;
+      info->width = rhdr->width;
+      info->height = rhdr->height;
+    }
+    return FORMAT_RAW;
+  }
+
   const FontArrayHeader *fhdr = buf;
   if (0 == memcmp(&fhdr->signature, FONT_SIGNATURE, FONT_SIGNATURE_SIZE) &&
       fhdr->num_entries > 0) {
@@ -65,7 +78,120 @@ ImageFormat identify_image_type(const void *buf, uint32_t bufsize,
     return FORMAT_FONT;
   }
 
+  const FontAtlasHeader *ahdr = buf;
+  if (bufsize >= sizeof(FontAtlasHeader) &&
+      0 == memcmp(&ahdr->signature, FONT_ATLAS_SIGNATURE,
+                  FONT_SIGNATURE_SIZE) &&
+      ahdr->num_glyphs > 0) {
+    if (info)
+      info->format = FORMAT_FONT;
+    return FORMAT_FONT;
+  }
+
   return FORMAT_INVALID;
 }
 
+uint32_t raw_pixel_size(uint32_t pixel_format) {
+  switch (pixel_format) {
+  case RAW_PIXEL_XRGB8888:
+    return 4;
+  case RAW_PIXEL_RGB888:
+    return 3;
+  case RAW_PIXEL_RGB565:
+    return 2;
+  default:
+    return 0;
+  }
+}
+
+void *bmp_to_raw(const void *buf, uint32_t bufsize, uint32_t pixel_format,
+                 uint32_t *out_size) {
+  const BMP_IMAGE_HEADER *bhdr = buf;
+  const uint8_t *bmp = buf;
+  uint32_t pixel_size = raw_pixel_size(pixel_format);
+  ImageInfo info;
 
+  if (FORMAT_BMP != identify_image_type(buf, bufsize, &info) ||
+      bhdr->CompressionType != 0 || !pixel_size)
+    return NULL;
+
+  // Rows are stored bottom up, unless the height is negative
+  int32_t height = (int32_t)bhdr->PixelHeight;
+  int bottom_up = height > 0;
+  uint32_t rows = bottom_up ? height : -height;
+  uint32_t width = bhdr->PixelWidth;
+  uint32_t bpp = bhdr->BitPerPixel;
+  uint64_t row_size = (((uint64_t)width * bpp + 31) / 32) * 4;
+  if (bhdr->ImageOffset > bufsize ||
+      row_size * rows > bufsize - bhdr->ImageOffset)
+    return NULL;
+
+  // Anything below 24 bits per pixel indexes a palette of blue, green, red,
+  // unused entries, which follows the header.
+  const uint8_t *palette = bmp + 14 + bhdr->HeaderSize;
+  uint32_t colors = 0;
+  if (bpp < 24) {
+    colors = bhdr->NumberOfColors ? bhdr->NumberOfColors : 1U << bpp;
+    if (colors > (1U << bpp) || 14 + bhdr->HeaderSize > bufsize ||
+        colors * 4 > bufsize - 14 - bhdr->HeaderSize)
+      return NULL;
+  }
+
+  // Rows start on 4-byte boundaries, like the frame buffers they're for
+  uint64_t stride = (((uint64_t)width * pixel_size + 3) / 4) * 4;
+  uint64_t size = sizeof(RawImageHeader) + stride * rows;
+  if (size > UINT32_MAX)
+    return NULL;
+  uint8_t *raw = calloc(1, size);
+  if (!raw)
+    return NULL;
+
+  RawImageHeader *rhdr = (RawImageHeader *)raw;
+  memcpy(rhdr->signature, RAW_IMAGE_SIGNATURE, RAW_IMAGE_SIGNATURE_SIZE);
+  rhdr->width = width;
+  rhdr->height = rows;
+  rhdr->stride = stride;
+  rhdr->pixel_format = pixel_format;
+
+  for (uint32_t y = 0; y < rows; y++) {
+    const uint8_t *in = bmp + bhdr->ImageOffset +
+      row_size * (bottom_up ? rows - 1 - y : y);
+    uint8_t *out = raw + sizeof(RawImageHeader) + stride * y;
+
+    for (uint32_t x = 0; x < width; x++, out += pixel_size) {
+      const uint8_t *bgr;
+      if (bpp == 24) {
+        bgr = in + 3 * x;
+      } else {
+        uint32_t bit = x * bpp;
+        uint32_t index = (in[bit / 8] >> (8 - bpp - bit % 8)) &
+          ((1U << bpp) - 1);
+        if (index >= colors) {
+          free(raw);
+          return NULL;
+        }
+        bgr = palette + 4 * index;
+      }
+
+      switch (pixel_format) {
+      case RAW_PIXEL_XRGB8888:
+        out[3] = 0;
+        // Fall through
+      case RAW_PIXEL_RGB888:
+        out[0] = bgr[0];
+        out[1] = bgr[1];
+        out[2] = bgr[2];
+        break;
+      case RAW_PIXEL_RGB565: {
+        uint16_t v = (bgr[2] >> 3) << 11 | (bgr[1] >> 2) << 5 | bgr[0] >> 3;
+        out[0] = v & 0xff;
+        out[1] = v >> 8;
+        break;
+      }
+      }
+    }
+  }
+
+  *out_size = size;
+  return raw;
+}
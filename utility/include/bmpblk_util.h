@@ -10,4 +10,8 @@
 int dump_bmpblock(const char *infile, int show_as_yaml,
                   const char *todir, int overwrite);
 
+// Print the sizes and decompression times of the images in a BMPBLOCK, per
+// image and per locale.
+int stats_bmpblock(const char *infile);
+
 #endif // VBOOT_REFERENCE_BMPBLK_UTIL_H_
@@ -68,6 +68,12 @@ class BmpBlockUtil {
   /* What compression to use for the images */
   void force_compression(uint32_t compression);
 
+  /* Where to keep compressed images between runs; empty for nowhere. */
+  void set_cache_dir(const char *dir);
+
+  /* Convert BMP images to raw pixels in this RAW_PIXEL_... format. */
+  void set_raw_format(uint32_t pixel_format);
+
  private:
   /* Elemental function called from load_from_config.
    * Load the config file (yaml format) and parse it. */
@@ -118,6 +124,12 @@ class BmpBlockUtil {
   /* Internal variables to determine whether or not to specify compression */
   bool set_compression_;                // true if we force it
   uint32_t compression_;                // what we force it to
+
+  /* Directory of compressed images from earlier runs */
+  string cache_dir_;
+
+  /* Pixel format to convert BMPs to, or RAW_PIXEL_INVALID to keep them */
+  uint32_t raw_format_;
 };
 
 }  // namespace vboot_reference
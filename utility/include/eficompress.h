@@ -11,6 +11,7 @@
 #define UINT8 uint8_t
 #define INT32 int32_t
 #define UINT32 uint32_t
+#define UINT64 uint64_t
 #define STATIC static
 #define IN /**/
 #define OUT /**/
@@ -65,6 +66,20 @@ EfiCompress (
   IN OUT  UINT32  *DstSize
   );
 
+/* Effort levels for EfiCompressLevel(); higher is slower but smaller */
+#define EFI_COMPRESS_LEVEL_MIN     1
+#define EFI_COMPRESS_LEVEL_MAX     9
+#define EFI_COMPRESS_LEVEL_DEFAULT EFI_COMPRESS_LEVEL_MAX
+
+EFI_STATUS
+EfiCompressLevel (
+  IN      UINT8   *SrcBuffer,
+  IN      UINT32  SrcSize,
+  IN      UINT8   *DstBuffer,
+  IN OUT  UINT32  *DstSize,
+  IN      UINT32  Level
+  );
+
 EFI_STATUS
 EFIAPI
 EfiGetInfo (
@@ -84,3 +99,15 @@ EfiDecompress (
   IN OUT  VOID                    *Scratch,
   IN      UINT32                  ScratchSize
   );
+
+/* Same as EfiDecompress(), but faster and safer with corrupt data */
+EFI_STATUS
+EFIAPI
+EfiDecompressFast (
+  IN      VOID                    *Source,
+  IN      UINT32                  SrcSize,
+  IN OUT  VOID                    *Destination,
+  IN      UINT32                  DstSize,
+  IN OUT  VOID                    *Scratch,
+  IN      UINT32                  ScratchSize
+  );
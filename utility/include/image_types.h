@@ -17,6 +17,15 @@ extern "C" {
 ImageFormat identify_image_type(const void *buf, uint32_t bufsize,
                                 ImageInfo *info);
 
+/* Bytes per pixel of a RAW_PIXEL_... format, or 0 if it isn't one */
+uint32_t raw_pixel_size(uint32_t pixel_format);
+
+/* Convert an uncompressed BMP to a FORMAT_RAW image in the given pixel
+ * format.  Returns a buffer of *out_size bytes for the caller to free(), or
+ * NULL if the BMP can't be converted. */
+void *bmp_to_raw(const void *buf, uint32_t bufsize, uint32_t pixel_format,
+                 uint32_t *out_size);
+
 #ifdef __cplusplus
 }
 #endif  /* __cplusplus */
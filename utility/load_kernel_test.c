@@ -16,6 +16,7 @@
 
 #include "gbb_header.h"
 #include "host_common.h"
+#include "host_kernel_scan.h"
 #include "load_firmware_fw.h"
 #include "load_kernel_fw.h"
 #include "rollback_index.h"
@@ -30,6 +31,7 @@ static LoadKernelParams lkp;
 static VbCommonParams cparams;
 static VbNvContext vnc;
 static FILE *image_file = NULL;
+static KernelScan scan;
 
 
 /* Boot device stub implementations to read from the image file */
@@ -44,6 +46,10 @@ VbError_t VbExDiskRead(VbExDiskHandle_t handle, uint64_t lba_start,
     return 1;
   }
 
+  /* Use the headers already read by the scan, if there was one */
+  if (0 == KernelScanRead(&scan, lba_start, lba_count, buffer))
+    return VBERROR_SUCCESS;
+
   fseek(image_file, lba_start * lkp.bytes_per_lba, SEEK_SET);
   if (1 != fread(buffer, lba_count * lkp.bytes_per_lba, 1, image_file)) {
     fprintf(stderr, "Read error.");
@@ -52,6 +58,22 @@ VbError_t VbExDiskRead(VbExDiskHandle_t handle, uint64_t lba_start,
   return VBERROR_SUCCESS;
 }
 
+/* Read for the kernel partition scan, which reads from several threads */
+static int ScanDiskRead(void *ctx, uint64_t lba_start, uint64_t lba_count,
+                        void *buffer) {
+  size_t size = lba_count * lkp.bytes_per_lba;
+
+  if (lba_start + lba_count > lkp.streaming_lba_count)
+    return 1;
+
+  if ((ssize_t)size != pread(fileno(image_file), buffer, size,
+                             lba_start * lkp.bytes_per_lba)) {
+    fprintf(stderr, "Read error.");
+    return 1;
+  }
+  return 0;
+}
+
 
 VbError_t VbExDiskWrite(VbExDiskHandle_t handle, uint64_t lba_start,
                         uint64_t lba_count, const void *buffer) {
@@ -87,6 +109,7 @@ int main(int argc, char* argv[]) {
   VbError_t rv;
   int c, argsleft;
   int errorcnt = 0;
+  int parallel = 0;
   char *e = 0;
 
   Memset(&lkp, 0, sizeof(LoadKernelParams));
@@ -99,7 +122,7 @@ int main(int argc, char* argv[]) {
 
   /* Parse options */
   opterr = 0;
-  while ((c=getopt(argc, argv, ":b:")) != -1)
+  while ((c=getopt(argc, argv, ":b:p")) != -1)
   {
     switch (c)
     {
@@ -111,6 +134,9 @@ int main(int argc, char* argv[]) {
         errorcnt++;
       }
       break;
+    case 'p':
+      parallel = 1;
+      break;
     case '?':
       fprintf(stderr, "Unrecognized switch: -%c\n", optopt);
       errorcnt++;
@@ -140,6 +166,7 @@ int main(int argc, char* argv[]) {
             (uint64_t)BOOT_FLAG_DEVELOPER);
     fprintf(stderr, "               %" PRIu64 " = recovery mode on\n",
             (uint64_t)BOOT_FLAG_RECOVERY);
+    fprintf(stderr, "  -p         check all kernel partitions at once first\n");
     return 1;
   }
 
@@ -217,9 +244,21 @@ int main(int argc, char* argv[]) {
   }
   lkp.kernel_buffer_size = KERNEL_BUFFER_SIZE;
 
+  /* Read and check all the kernel headers at once, so LoadKernel() doesn't
+   * have to wait for each partition in turn. */
+  if (parallel) {
+    if (0 != KernelScanDisk(&scan, &lkp, &shared->kernel_subkey,
+                            ScanDiskRead, NULL)) {
+      fprintf(stderr, "Unable to read GPT\n");
+      return 1;
+    }
+    KernelScanPrint(&scan);
+  }
+
   /* Call LoadKernel() */
   rv = LoadKernel(&lkp, &cparams);
   printf("LoadKernel() returned %d\n", rv);
+  KernelScanFree(&scan);
 
   if (VBERROR_SUCCESS == rv) {
     printf("Partition number:   %" PRIu64 "\n", lkp.partition_number);
@@ -20,7 +20,7 @@ int main(int argc, char* argv[]) {
   int algorithm = -1;
   int error_code = 0;
   uint8_t* digest = NULL;
-  uint8_t* padded_digest = NULL;
+  uint8_t padded_digest[MAX_SIGNATURE_DIGEST_SIZE];
   uint64_t len;
   uint32_t padded_digest_len;
 
@@ -40,16 +40,13 @@ int main(int argc, char* argv[]) {
     return -1;
   }
 
-  padded_digest = PrependDigestInfo(algorithm, digest);
   padded_digest_len = (hash_size_map[algorithm] +
                        digestinfo_size_map[algorithm]);
 
-  if (!padded_digest)
+  if (PrependDigestInfoInto(algorithm, digest, padded_digest,
+                            sizeof(padded_digest)) ||
+      1 != fwrite(padded_digest, padded_digest_len, 1, stdout))
     error_code = -1;
-  if(padded_digest &&
-     1 != fwrite(padded_digest, padded_digest_len, 1, stdout))
-    error_code = -1;
-  free(padded_digest);
   free(digest);
   return error_code;
 }
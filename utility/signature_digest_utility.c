@@ -5,11 +5,21 @@
  * Utility that outputs the cryptographic digest of a contents of a
  * file in a format that can be directly used to generate PKCS#1 v1.5
  * signatures via the "openssl" command line utility.
+ *
+ * With --manifest, digests every file listed (one path per line) in the
+ * manifest and writes them back to back in the same order, for handing a
+ * whole batch of signing requests to an offline signer at once.
  */
 
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "2sysincludes.h"
+#include "2common.h"
+#include "2sha.h"
 
 #include "file_keys.h"
 #include "host_common.h"
@@ -17,16 +27,123 @@
 #include "signature_digest.h"
 
 
+/* Read [filename] into [*buf], growing it (and [*buf_size]) if it's too
+ * small, so that one buffer can be used for the whole batch.  Returns the
+ * file size, or -1 on error. */
+static int64_t ReadIntoBuffer(const char* filename, uint8_t** buf,
+                              uint64_t* buf_size) {
+  FILE* f;
+  struct stat sb;
+  uint8_t* newbuf;
+  int64_t size = -1;
+
+  f = fopen(filename, "rb");
+  if (!f)
+    return -1;
+  if (0 == fstat(fileno(f), &sb) && sb.st_size <= UINT32_MAX) {
+    size = sb.st_size;
+    if (size > *buf_size) {
+      newbuf = realloc(*buf, size);
+      if (newbuf) {
+        *buf = newbuf;
+        *buf_size = size;
+      } else {
+        size = -1;
+      }
+    }
+    if (size > 0 && 1 != fread(*buf, size, 1, f))
+      size = -1;
+  }
+  fclose(f);
+  return size;
+}
+
+/* Digest the files listed in [manifest] and write DigestInfo || Digest for
+ * each to stdout.  Files are read VB2_DIGEST_MULTI_LANES at a time into the
+ * same buffers, and each group is hashed together with vb2_digest_multi(). */
+static int DigestManifest(unsigned int algorithm, const char* manifest) {
+  const int digestinfo_size = digestinfo_size_map[algorithm];
+  const int digest_size = hash_size_map[algorithm];
+  const int out_size = digestinfo_size + digest_size;
+  enum vb2_hash_algorithm hash_alg = vb2_crypto_to_hash(algorithm);
+  uint8_t* bufs[VB2_DIGEST_MULTI_LANES] = { NULL };
+  uint64_t buf_sizes[VB2_DIGEST_MULTI_LANES] = { 0 };
+  uint32_t sizes[VB2_DIGEST_MULTI_LANES];
+  uint8_t out[VB2_DIGEST_MULTI_LANES][VB2_SHA512_DIGEST_SIZE + 32];
+  uint8_t* digests[VB2_DIGEST_MULTI_LANES];
+  char filename[4096];
+  FILE* f;
+  int64_t size;
+  int count = 0;
+  int done = 0;
+  int error_code = 0;
+  int i;
+
+  if (out_size > sizeof(out[0])) {
+    fprintf(stderr, "Invalid Algorithm!\n");
+    return -1;
+  }
+  f = fopen(manifest, "r");
+  if (!f) {
+    fprintf(stderr, "Could not read file: %s\n", manifest);
+    return -1;
+  }
+
+  for (i = 0; i < VB2_DIGEST_MULTI_LANES; i++) {
+    memcpy(out[i], hash_digestinfo_map[algorithm], digestinfo_size);
+    digests[i] = out[i] + digestinfo_size;
+  }
+
+  while (!done && !error_code) {
+    if (fgets(filename, sizeof(filename), f)) {
+      filename[strcspn(filename, "\r\n")] = '\0';
+      if (!filename[0])
+        continue;
+      size = ReadIntoBuffer(filename, &bufs[count], &buf_sizes[count]);
+      if (size < 0) {
+        fprintf(stderr, "Could not read file: %s\n", filename);
+        error_code = -1;
+        break;
+      }
+      sizes[count++] = size;
+      if (count < VB2_DIGEST_MULTI_LANES)
+        continue;
+    } else {
+      done = 1;
+      if (!count)
+        break;
+    }
+
+    if (vb2_digest_multi(hash_alg, count, (const uint8_t * const *)bufs,
+                         sizes, digests, digest_size)) {
+      error_code = -1;
+      break;
+    }
+    for (i = 0; i < count; i++) {
+      if (1 != fwrite(out[i], out_size, 1, stdout))
+        error_code = -1;
+    }
+    count = 0;
+  }
+
+  fclose(f);
+  for (i = 0; i < VB2_DIGEST_MULTI_LANES; i++)
+    free(bufs[i]);
+  return error_code;
+}
+
 int main(int argc, char* argv[]) {
   int algorithm = -1;
   int error_code = 0;
   uint8_t* buf = NULL;
-  uint8_t* signature_digest = NULL;
+  uint8_t signature_digest[MAX_SIGNATURE_DIGEST_SIZE];
   uint64_t len;
   uint32_t signature_digest_len;
 
-  if (argc != 3) {
-    fprintf(stderr, "Usage: %s <alg_id> <file>", argv[0]);
+  if (argc != 3 && !(argc == 4 && !strcmp(argv[2], "--manifest"))) {
+    fprintf(stderr, "Usage: %s <alg_id> <file>\n"
+            "       %s <alg_id> --manifest <manifest_file>\n",
+            argv[0], argv[0]);
     return -1;
   }
   algorithm = atoi(argv[1]);
@@ -35,21 +152,21 @@ int main(int argc, char* argv[]) {
     return -1;
   }
 
+  if (argc == 4)
+    return DigestManifest(algorithm, argv[3]);
+
   buf = BufferFromFile(argv[2], &len);
   if (!buf) {
     fprintf(stderr, "Could not read file: %s\n", argv[2]);
     return -1;
   }
 
-  signature_digest = SignatureDigest(buf, len, algorithm);
   signature_digest_len = (hash_size_map[algorithm] +
                           digestinfo_size_map[algorithm]);
-  if (!signature_digest)
-    error_code = -1;
-  if(signature_digest &&
-     1 != fwrite(signature_digest, signature_digest_len, 1, stdout))
+  if (SignatureDigestInto(buf, len, algorithm, signature_digest,
+                          sizeof(signature_digest)) ||
+      1 != fwrite(signature_digest, signature_digest_len, 1, stdout))
     error_code = -1;
-  free(signature_digest);
   free(buf);
   return error_code;
 }
@@ -545,6 +545,12 @@ int main(void) {
          (int) (offsetof(TPM_NV_DATA_PUBLIC, permission) +
                 2 * PCR_SELECTION_FIX +
                 offsetof(TPM_NV_ATTRIBUTES, attributes)));
+  /* dataSize follows the attributes and three TPM_BOOLs */
+  printf("const int kNvDataPublicDataSizeOffset = %d;\n",
+         (int) (offsetof(TPM_NV_DATA_PUBLIC, permission) +
+                2 * PCR_SELECTION_FIX +
+                offsetof(TPM_NV_ATTRIBUTES, attributes) +
+                sizeof(uint32_t) + 3 * sizeof(TPM_BOOL)));
 
   FreeCommands(commands);
   return 0;
@@ -363,6 +363,8 @@ static uint32_t HandlerSendRaw(void) {
 }
 
 
+static uint32_t HandlerBatch(void);
+
 /* Table of TPM commands.
  */
 command_record command_table[] = {
@@ -411,10 +413,99 @@ command_record command_table[] = {
   { "savestate", "save", "execute TPM_SaveState", TlclSaveState },
   { "sendraw", "raw", "send a raw request and print raw response",
     HandlerSendRaw },
+  { "batch", "batch", "run commands from a file or stdin, one per line, "
+    "over one TPM connection (batch [<file>])", HandlerBatch },
 };
 
 static int n_commands = sizeof(command_table) / sizeof(command_table[0]);
 
+/* Finds a command by name or abbreviation.  Returns NULL if there's none.
+ */
+static command_record* FindCommand(const char* cmd) {
+  command_record* c;
+  for (c = command_table; c < command_table + n_commands; c++) {
+    if (strcmp(cmd, c->name) == 0 || strcmp(cmd, c->abbr) == 0)
+      return c;
+  }
+  return NULL;
+}
+
+#define MAX_BATCH_ARGS 256
+
+/* Runs commands from |f|, one per line, over the TPM connection opened by
+ * the caller, stopping at the first failure.  Blank lines and lines starting
+ * with '#' are skipped.  Returns the exit code for the failure, or 0.
+ */
+static int RunBatch(const char* progname, FILE* f) {
+  char* line = NULL;
+  size_t line_size = 0;
+  char* batch_args[MAX_BATCH_ARGS + 1];
+  int line_num = 0;
+  int rv = 0;
+
+  while (rv == 0 && getline(&line, &line_size, f) > 0) {
+    command_record* c;
+    char* save;
+    char* arg;
+    int n = 1;
+
+    line_num++;
+    batch_args[0] = (char*)progname;
+    for (arg = strtok_r(line, " \t\r\n", &save);
+         arg && n < MAX_BATCH_ARGS;
+         arg = strtok_r(NULL, " \t\r\n", &save))
+      batch_args[n++] = arg;
+    batch_args[n] = NULL;
+    if (n == 1 || batch_args[1][0] == '#')
+      continue;
+    if (arg) {
+      fprintf(stderr, "%s: line %d: too many arguments\n", progname,
+              line_num);
+      rv = OTHER_ERROR;
+      break;
+    }
+
+    c = FindCommand(batch_args[1]);
+    if (!c || c->handler == HandlerBatch) {
+      fprintf(stderr, "%s: line %d: unknown command: %s\n", progname,
+              line_num, batch_args[1]);
+      rv = OTHER_ERROR;
+      break;
+    }
+
+    /* Handlers take their arguments from the globals */
+    nargs = n;
+    args = batch_args;
+    rv = ErrorCheck(c->handler(), batch_args[1]);
+    fflush(stdout);
+  }
+
+  free(line);
+  return rv;
+}
+
+static uint32_t HandlerBatch(void) {
+  FILE* f = stdin;
+  int rv;
+
+  if (nargs > 3) {
+    fprintf(stderr, "usage: tpmc batch [<file>]\n");
+    exit(OTHER_ERROR);
+  }
+  if (nargs == 3 && strcmp(args[2], "-")) {
+    f = fopen(args[2], "r");
+    if (!f) {
+      fprintf(stderr, "cannot open %s\n", args[2]);
+      exit(OTHER_ERROR);
+    }
+  }
+  rv = RunBatch(args[0], f);
+  if (f != stdin)
+    fclose(f);
+  /* Errors were already reported, so just pass on the exit code */
+  exit(rv);
+}
+
 int main(int argc, char* argv[]) {
   char *progname;
   progname = strrchr(argv[0], '/');
@@ -441,12 +532,10 @@ int main(int argc, char* argv[]) {
       return 0;
     }
 
-    TlclLibInit();
-
-    for (c = command_table; c < command_table + n_commands; c++) {
-      if (strcmp(cmd, c->name) == 0 || strcmp(cmd, c->abbr) == 0) {
-        return ErrorCheck(c->handler(), cmd);
-      }
+    c = FindCommand(cmd);
+    if (c) {
+      TlclLibInit();
+      return ErrorCheck(c->handler(), cmd);
     }
 
     /* No command matched. */